@@ -38,6 +38,10 @@
 #include <stdio.h>
 #include <OpenIPMI/ipmiif.h>
 #include <OpenIPMI/ipmi_cmdlang.h>
+#include <OpenIPMI/ipmi_conn.h>
+
+/* Internal includes, do not use in your programs */
+#include <OpenIPMI/internal/ipmi_domain.h>
 
 static void
 con_list_handler(ipmi_domain_t *domain, int conn, void *cb_data)
@@ -145,6 +149,146 @@ con_activate(ipmi_domain_t *domain, int conn, void *cb_data)
     ipmi_cmdlang_out(cmd_info, "Connection activated", conn_name);
 }
 
+static void
+con_latency_tracking(ipmi_domain_t *domain, int conn, void *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    ipmi_cmdlang_t  *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
+    int             curr_arg = ipmi_cmdlang_get_curr_arg(cmd_info);
+    int             argc = ipmi_cmdlang_get_argc(cmd_info);
+    char            **argv = ipmi_cmdlang_get_argv(cmd_info);
+    ipmi_con_t      *con;
+    int             val;
+    int             rv;
+    char            conn_name[IPMI_DOMAIN_NAME_LEN+20];
+    int             p;
+
+    if ((argc - curr_arg) < 1) {
+	cmdlang->errstr = "Not enough parameters";
+	cmdlang->err = EINVAL;
+	goto out_err;
+    }
+
+    ipmi_cmdlang_get_bool(argv[curr_arg], &val, cmd_info);
+    if (cmdlang->err) {
+	cmdlang->errstr = "invalid enable setting";
+	goto out_err;
+    }
+
+    if (_ipmi_domain_get_connection(domain, conn, &con) || !con) {
+	cmdlang->errstr = "Invalid connection";
+	cmdlang->err = EINVAL;
+	goto out_err;
+    }
+
+    rv = ipmi_con_set_latency_tracking(con, val);
+    if (rv) {
+	cmdlang->errstr = "Unable to set latency tracking";
+	cmdlang->err = rv;
+	goto out_err;
+    }
+
+    p = ipmi_domain_get_name(domain, conn_name, sizeof(conn_name));
+    snprintf(conn_name+p, sizeof(conn_name)-p, ".%d", conn);
+    ipmi_cmdlang_out(cmd_info, "Latency tracking set", conn_name);
+    return;
+
+ out_err:
+    ipmi_domain_get_name(domain, cmdlang->objstr, cmdlang->objstr_len);
+    cmdlang->location = "cmd_conn.c(con_latency_tracking)";
+}
+
+static void
+con_latency_handler(ipmi_con_t               *ipmi,
+		    const ipmi_con_latency_t *lat,
+		    void                     *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    unsigned int    i;
+
+    ipmi_cmdlang_out(cmd_info, "Command", NULL);
+    ipmi_cmdlang_down(cmd_info);
+    ipmi_cmdlang_out_hex(cmd_info, "NetFN", lat->netfn);
+    ipmi_cmdlang_out_hex(cmd_info, "Cmd", lat->cmd);
+    ipmi_cmdlang_out_long(cmd_info, "Count", lat->count);
+    ipmi_cmdlang_out_long(cmd_info, "Resends", lat->resends);
+    ipmi_cmdlang_out_long(cmd_info, "Timeouts", lat->timeouts);
+    if (lat->count) {
+	ipmi_cmdlang_out_long(cmd_info, "Min", lat->min_usec);
+	ipmi_cmdlang_out_long(cmd_info, "Avg", lat->total_usec / lat->count);
+	ipmi_cmdlang_out_long(cmd_info, "Max", lat->max_usec);
+	ipmi_cmdlang_out_long(cmd_info, "P50",
+			      ipmi_con_latency_percentile(lat, 50));
+	ipmi_cmdlang_out_long(cmd_info, "P90",
+			      ipmi_con_latency_percentile(lat, 90));
+	ipmi_cmdlang_out_long(cmd_info, "P99",
+			      ipmi_con_latency_percentile(lat, 99));
+    }
+    for (i=0; i<IPMI_CON_LAT_BUCKETS; i++) {
+	if (!lat->buckets[i])
+	    continue;
+	ipmi_cmdlang_out(cmd_info, "Bucket", NULL);
+	ipmi_cmdlang_down(cmd_info);
+	ipmi_cmdlang_out_long(cmd_info, "Low", ipmi_con_latency_bucket_low(i));
+	ipmi_cmdlang_out_long(cmd_info, "High",
+			      ipmi_con_latency_bucket_high(i));
+	ipmi_cmdlang_out_long(cmd_info, "Count", lat->buckets[i]);
+	ipmi_cmdlang_up(cmd_info);
+    }
+    ipmi_cmdlang_up(cmd_info);
+}
+
+static void
+con_latency(ipmi_domain_t *domain, int conn, void *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    ipmi_cmdlang_t  *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
+    int             curr_arg = ipmi_cmdlang_get_curr_arg(cmd_info);
+    int             argc = ipmi_cmdlang_get_argc(cmd_info);
+    char            **argv = ipmi_cmdlang_get_argv(cmd_info);
+    ipmi_con_t      *con;
+    int             reset = 0;
+    int             rv;
+    char            conn_name[IPMI_DOMAIN_NAME_LEN+20];
+    int             p;
+
+    if (curr_arg < argc) {
+	if (strcmp(argv[curr_arg], "-reset") != 0) {
+	    cmdlang->errstr = "Invalid option";
+	    cmdlang->err = EINVAL;
+	    goto out_err;
+	}
+	reset = 1;
+    }
+
+    if (_ipmi_domain_get_connection(domain, conn, &con) || !con) {
+	cmdlang->errstr = "Invalid connection";
+	cmdlang->err = EINVAL;
+	goto out_err;
+    }
+
+    p = ipmi_domain_get_name(domain, conn_name, sizeof(conn_name));
+    snprintf(conn_name+p, sizeof(conn_name)-p, ".%d", conn);
+
+    ipmi_cmdlang_out(cmd_info, "Connection", NULL);
+    ipmi_cmdlang_down(cmd_info);
+    ipmi_cmdlang_out(cmd_info, "Name", conn_name);
+    ipmi_cmdlang_out_bool(cmd_info, "Tracking",
+			  ipmi_con_get_latency_tracking(con));
+    rv = ipmi_con_latency_snapshot(con, reset, con_latency_handler, cmd_info);
+    ipmi_cmdlang_up(cmd_info);
+    if (rv) {
+	cmdlang->errstr = "Unable to get latency histograms";
+	cmdlang->err = rv;
+	goto out_err;
+    }
+    return;
+
+ out_err:
+    ipmi_domain_get_name(domain, cmdlang->objstr, cmdlang->objstr_len);
+    cmdlang->location = "cmd_conn.c(con_latency)";
+}
+
 static ipmi_cmdlang_cmd_t *conn_cmds;
 
 static ipmi_cmdlang_init_t cmds_conn[] =
@@ -161,6 +305,13 @@ static ipmi_cmdlang_init_t cmds_conn[] =
     { "activate", &conn_cmds,
       "<connection> - Dump information about a connection",
       ipmi_cmdlang_connection_handler, con_activate, NULL },
+    { "latency_tracking", &conn_cmds,
+      "<connection> <enable> - Turn command latency tracking on or off",
+      ipmi_cmdlang_connection_handler, con_latency_tracking, NULL },
+    { "latency", &conn_cmds,
+      "<connection> [-reset] - Dump the command latency histograms of"
+      " a connection, times are in microseconds.  -reset clears them",
+      ipmi_cmdlang_connection_handler, con_latency, NULL },
 };
 #define CMDS_CONN_LEN (sizeof(cmds_conn)/sizeof(ipmi_cmdlang_init_t))
 
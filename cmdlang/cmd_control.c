@@ -682,6 +682,9 @@ control_event_handler(ipmi_control_t *control,
     return IPMI_EVENT_NOT_HANDLED;
 }
 
+void ipmi_cmdlang_index_control(ipmi_control_t *control,
+			       enum ipmi_update_e op);
+
 void
 ipmi_cmdlang_control_change(enum ipmi_update_e op,
 			    ipmi_entity_t      *entity,
@@ -693,6 +696,8 @@ ipmi_cmdlang_control_change(enum ipmi_update_e op,
     ipmi_cmd_info_t *evi;
     char            control_name[IPMI_CONTROL_NAME_LEN];
 
+    ipmi_cmdlang_index_control(control, op);
+
     ipmi_control_get_name(control, control_name, sizeof(control_name));
 
     evi = ipmi_cmdlang_alloc_event_info();
@@ -93,6 +93,8 @@ domain_info(ipmi_domain_t *domain, void *cb_data)
 			 ipmi_domain_get_sel_rescan_time(domain));
     ipmi_cmdlang_out_int(cmd_info, "IPMB Rescan Time",
 			 ipmi_domain_get_ipmb_rescan_time(domain));
+    ipmi_cmdlang_out_int(cmd_info, "IPMB Full Rescan Time",
+			 ipmi_domain_get_ipmb_full_rescan_time(domain));
     ipmi_cmdlang_up(cmd_info);
 }
 
@@ -110,6 +112,7 @@ void ipmi_cmdlang_mc_change(enum ipmi_update_e op,
 			    ipmi_domain_t      *domain,
 			    ipmi_mc_t          *mc,
 			    void               *cb_data);
+void ipmi_cmdlang_index_domain(ipmi_domain_t *domain, enum ipmi_update_e op);
 
 static void
 domain_new_done(ipmi_domain_t *domain,
@@ -300,10 +303,10 @@ static void
 domain_open(ipmi_cmd_info_t *cmd_info)
 {
     ipmi_cmdlang_t *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
-    ipmi_args_t    *con_parms[2];
+    ipmi_args_t    *con_parms[IPMI_DOMAIN_MAX_CONS];
     int            set = 0;
     int            i, j;
-    ipmi_con_t     *con[2];
+    ipmi_con_t     *con[IPMI_DOMAIN_MAX_CONS];
     int            rv;
     char           *name;
     int            curr_arg = ipmi_cmdlang_get_curr_arg(cmd_info);
@@ -347,11 +350,12 @@ domain_open(ipmi_cmd_info_t *cmd_info)
     }
     set++;
 
-    if (curr_arg < argc) {
+    while ((curr_arg < argc) && (set < IPMI_DOMAIN_MAX_CONS)) {
 	rv = ipmi_parse_args2(&curr_arg, argc, argv, &con_parms[set]);
 	if (rv) {
-	    ipmi_free_args(con_parms[0]);
-	    cmdlang->errstr = "Second connection parms are invalid";
+	    for (j=0; j<set; j++)
+		ipmi_free_args(con_parms[j]);
+	    cmdlang->errstr = "Additional connection parms are invalid";
 	    cmdlang->err = rv;
 	    goto out;
 	}
@@ -935,6 +939,45 @@ domain_ipmb_rescan_time(ipmi_domain_t *domain, void *cb_data)
     }
 }
 
+static void
+domain_ipmb_full_rescan_time(ipmi_domain_t *domain, void *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    ipmi_cmdlang_t  *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
+    int             time;
+    int             curr_arg = ipmi_cmdlang_get_curr_arg(cmd_info);
+    int             argc = ipmi_cmdlang_get_argc(cmd_info);
+    char            **argv = ipmi_cmdlang_get_argv(cmd_info);
+    char            domain_name[IPMI_DOMAIN_NAME_LEN];
+
+    if ((argc - curr_arg) < 1) {
+	cmdlang->errstr = "Not enough parameters";
+	cmdlang->err = EINVAL;
+	goto out_err;
+    }
+
+    ipmi_cmdlang_get_int(argv[curr_arg], &time, cmd_info);
+    if (cmdlang->err || (time < 0)) {
+	cmdlang->errstr = "time invalid";
+	cmdlang->err = EINVAL;
+	goto out_err;
+    }
+    curr_arg++;
+
+    ipmi_domain_set_ipmb_full_rescan_time(domain, time);
+
+    ipmi_domain_get_name(domain, domain_name, sizeof(domain_name));
+    ipmi_cmdlang_out(cmd_info, "Domain IPMB full rescan time set",
+		     domain_name);
+
+ out_err:
+    if (cmdlang->err) {
+	ipmi_domain_get_name(domain, cmdlang->objstr,
+			     cmdlang->objstr_len);
+	cmdlang->location = "cmd_domain.c(domain_ipmb_full_rescan_time)";
+    }
+}
+
 static void
 handle_stat(ipmi_domain_t *domain, ipmi_domain_stat_t *stat, void *cb_data)
 {
@@ -950,20 +993,98 @@ handle_stat(ipmi_domain_t *domain, ipmi_domain_stat_t *stat, void *cb_data)
     ipmi_mem_free(s);
 }
 
+typedef struct domain_counts_s
+{
+    int mcs;
+    int entities;
+    int sensors;
+} domain_counts_t;
+
+static void
+count_mc(ipmi_domain_t *domain, ipmi_mc_t *mc, void *cb_data)
+{
+    domain_counts_t *counts = cb_data;
+
+    counts->mcs++;
+}
+
+static void
+count_sensor(ipmi_entity_t *entity, ipmi_sensor_t *sensor, void *cb_data)
+{
+    domain_counts_t *counts = cb_data;
+
+    counts->sensors++;
+}
+
+static void
+count_entity(ipmi_entity_t *entity, void *cb_data)
+{
+    domain_counts_t *counts = cb_data;
+
+    counts->entities++;
+    ipmi_entity_iterate_sensors(entity, count_sensor, counts);
+}
+
 static void
 domain_stats(ipmi_domain_t *domain, void *cb_data)
 {
     ipmi_cmd_info_t *cmd_info = cb_data;
     char            domain_name[IPMI_DOMAIN_NAME_LEN];
+    domain_counts_t counts;
+
+    memset(&counts, 0, sizeof(counts));
+    ipmi_domain_iterate_mcs(domain, count_mc, &counts);
+    ipmi_domain_iterate_entities(domain, count_entity, &counts);
 
     ipmi_domain_get_name(domain, domain_name, sizeof(domain_name));
     ipmi_cmdlang_out(cmd_info, "Domain statistics", NULL);
     ipmi_cmdlang_down(cmd_info);
     ipmi_cmdlang_out(cmd_info, "Domain", domain_name);
+    ipmi_cmdlang_out_int(cmd_info, "MCs", counts.mcs);
+    ipmi_cmdlang_out_int(cmd_info, "Entities", counts.entities);
+    ipmi_cmdlang_out_int(cmd_info, "Sensors", counts.sensors);
     ipmi_domain_stat_iterate(domain, NULL, NULL, handle_stat, cmd_info);
     ipmi_cmdlang_up(cmd_info);
 }
 
+static void
+domain_bringup_trace(ipmi_domain_t *domain, void *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    ipmi_cmdlang_t  *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
+    int             rv;
+    int             curr_arg = ipmi_cmdlang_get_curr_arg(cmd_info);
+    int             argc = ipmi_cmdlang_get_argc(cmd_info);
+    char            **argv = ipmi_cmdlang_get_argv(cmd_info);
+    char            domain_name[IPMI_DOMAIN_NAME_LEN];
+
+    if ((argc - curr_arg) < 1) {
+	/* Not enough parameters */
+	cmdlang->errstr = "Not enough parameters";
+	cmdlang->err = EINVAL;
+	goto out_err;
+    }
+
+    rv = ipmi_domain_write_bringup_trace(domain, argv[curr_arg]);
+    if (rv) {
+	if (rv == ENOSYS)
+	    cmdlang->errstr = "Domain was not opened with -recordbringup";
+	else
+	    cmdlang->errstr = "Unable to write the trace file";
+	cmdlang->err = rv;
+	goto out_err;
+    }
+
+    ipmi_domain_get_name(domain, domain_name, sizeof(domain_name));
+    ipmi_cmdlang_out(cmd_info, "Bring-up trace written", domain_name);
+    return;
+
+ out_err:
+    ipmi_domain_get_name(domain, cmdlang->objstr,
+			 cmdlang->objstr_len);
+    cmdlang->location = "cmd_domain.c(domain_bringup_trace)";
+}
+
 typedef struct domain_close_info_s
 {
     char            domain_name[IPMI_DOMAIN_NAME_LEN];
@@ -1115,6 +1236,8 @@ domain_change(ipmi_domain_t      *domain,
     char            *errstr = NULL;
     char            domain_name[IPMI_DOMAIN_NAME_LEN];
 
+    ipmi_cmdlang_index_domain(domain, op);
+
     evi = ipmi_cmdlang_alloc_event_info();
     if (!evi) {
 	rv = ENOMEM;
@@ -1244,10 +1367,11 @@ static ipmi_cmdlang_init_t cmds_domain[] =
       "Obsolete, use domain open",
       domain_new, NULL, NULL },
     { "open", &domain_cmds,
-      "<domain name> [<options>] <domain parms> [<domain parms>]- Set up a"
-      " new domain using an argument parser.  Format for the connection's"
-      " <domain parms> depends on the connections type.  Two connections"
-      " (to two different MCs) can be done by specifying two sets of parms."
+      "<domain name> [<options>] <domain parms> [<domain parms> ...] - Set"
+      " up a new domain using an argument parser.  Format for the connection's"
+      " <domain parms> depends on the connections type.  Up to four"
+      " connections (to different MCs) can be done by specifying more sets"
+      " of parms."
       " Connections types are:",
       domain_open, NULL, NULL, domain_open_help },
     { "close", &domain_cmds,
@@ -1281,9 +1405,19 @@ static ipmi_cmdlang_init_t cmds_domain[] =
       "<domain> <time in seconds> - Set the time between IPMB rescans"
       " for this domain.  zero disables scans.",
       ipmi_cmdlang_domain_handler, domain_ipmb_rescan_time, NULL },
+    { "ipmb_full_rescan_time", &domain_cmds,
+      "<domain> <time in seconds> - Only scan the whole IPMB this"
+      " often, rescans in between probe the known MCs and events"
+      " trigger probes of changed addresses.  Zero scans the whole"
+      " bus every time.",
+      ipmi_cmdlang_domain_handler, domain_ipmb_full_rescan_time, NULL },
     { "stats", &domain_cmds,
       "<domain> - Dump all the domain's statistics",
       ipmi_cmdlang_domain_handler, domain_stats, NULL },
+    { "bringup_trace", &domain_cmds,
+      "<domain> <file> - Write the recorded bring-up steps of the domain"
+      " to the file as a Chrome trace",
+      ipmi_cmdlang_domain_handler, domain_bringup_trace, NULL },
 };
 #define CMDS_DOMAIN_LEN (sizeof(cmds_domain)/sizeof(ipmi_cmdlang_init_t))
 
@@ -53,6 +53,7 @@ void ipmi_cmdlang_control_change(enum ipmi_update_e op,
 				 ipmi_entity_t      *entity,
 				 ipmi_control_t      *control,
 				 void               *cb_data);
+void ipmi_cmdlang_index_entity(ipmi_entity_t *entity, enum ipmi_update_e op);
 
 static void
 entity_iterate_handler(ipmi_entity_t *entity, ipmi_entity_t *parent,
@@ -995,6 +996,8 @@ ipmi_cmdlang_entity_change(enum ipmi_update_e op,
     ipmi_cmd_info_t *evi;
     char            entity_name[IPMI_ENTITY_NAME_LEN];
 
+    ipmi_cmdlang_index_entity(entity, op);
+
     ipmi_entity_get_name(entity, entity_name, sizeof(entity_name));
 
     evi = ipmi_cmdlang_alloc_event_info();
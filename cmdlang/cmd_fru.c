@@ -90,6 +90,52 @@ fru_info(ipmi_fru_t *fru, void *cb_data)
     ipmi_cmdlang_dump_fru_info(cmd_info, fru);
 }
 
+/*
+ * Dump every FRU the domain knows about, both the ones allocated with
+ * the domain fru command and the ones the entities read during
+ * discovery, so a whole inventory comes out of one command.
+ */
+static void
+fru_dump_all_fru(ipmi_fru_t *fru, void *cb_data)
+{
+    ipmi_cmdlang_dump_fru_info(cb_data, fru);
+}
+
+static void
+fru_dump_all_entity(ipmi_entity_t *entity, void *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    ipmi_fru_t      *fru;
+    char            entity_name[IPMI_ENTITY_NAME_LEN];
+
+    /* Same cheat as the entity fru command, see the note there. */
+    fru = ipmi_entity_get_fru(entity);
+    if (!fru)
+	return;
+
+    ipmi_entity_get_name(entity, entity_name, sizeof(entity_name));
+    ipmi_cmdlang_out(cmd_info, "Entity", NULL);
+    ipmi_cmdlang_down(cmd_info);
+    ipmi_cmdlang_out(cmd_info, "Name", entity_name);
+    ipmi_cmdlang_dump_fru_info(cmd_info, fru);
+    ipmi_cmdlang_up(cmd_info);
+}
+
+static void
+fru_dump_all(ipmi_domain_t *domain, void *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    char            domain_name[IPMI_DOMAIN_NAME_LEN];
+
+    ipmi_domain_get_name(domain, domain_name, sizeof(domain_name));
+    ipmi_cmdlang_out(cmd_info, "Domain", NULL);
+    ipmi_cmdlang_down(cmd_info);
+    ipmi_cmdlang_out(cmd_info, "Name", domain_name);
+    ipmi_fru_iterate_frus(domain, fru_dump_all_fru, cmd_info);
+    ipmi_domain_iterate_entities(domain, fru_dump_all_entity, cmd_info);
+    ipmi_cmdlang_up(cmd_info);
+}
+
 static char *areas[IPMI_FRU_FTR_NUMBER] =
 {
     "internal_use",
@@ -728,6 +774,11 @@ static ipmi_cmdlang_init_t cmds_fru[] =
     { "info", &fru_cmds,
       "<fru> - Dump information about a FRU",
       ipmi_cmdlang_fru_handler, fru_info, NULL },
+    { "dump_all", &fru_cmds,
+      "[<domain>] - Dump information about every FRU in the domain,"
+      " including the FRUs read for entities, or in all domains if no"
+      " domain is given",
+      ipmi_cmdlang_domain_handler, fru_dump_all, NULL },
     { "areainfo", &fru_cmds,
       "<fru> - Dump the info about the FRU's areas",
       ipmi_cmdlang_fru_handler, fru_areainfo, NULL },
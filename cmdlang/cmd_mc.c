@@ -653,8 +653,30 @@ typedef struct sdr_info_s
 {
     ipmi_cmd_info_t *cmd_info;
     char            mc_name[IPMI_MC_NAME_LEN];
+    int             total_size;
 } sdr_info_t;
 
+static int
+sdr_out(ipmi_sdr_info_t *sdrs, const ipmi_sdr_t *sdr, void *cb_data)
+{
+    sdr_info_t      *info = cb_data;
+    ipmi_cmd_info_t *cmd_info = info->cmd_info;
+    char            str[20];
+
+    ipmi_cmdlang_out(cmd_info, "SDR", NULL);
+    ipmi_cmdlang_down(cmd_info);
+    ipmi_cmdlang_out_int(cmd_info, "Record ID", sdr->record_id);
+    ipmi_cmdlang_out_int(cmd_info, "Type", sdr->type);
+    snprintf(str, sizeof(str), "%d.%d", sdr->major_version,
+	     sdr->minor_version);
+    ipmi_cmdlang_out(cmd_info, "Version", str);
+    ipmi_cmdlang_out_binary(cmd_info, "Data",
+			    (char *) sdr->data, sdr->length);
+    ipmi_cmdlang_up(cmd_info);
+    info->total_size += sdr->length+5;
+    return 0;
+}
+
 void
 sdrs_fetched(ipmi_sdr_info_t *sdrs,
 	     int             err,
@@ -665,9 +687,6 @@ sdrs_fetched(ipmi_sdr_info_t *sdrs,
     sdr_info_t      *info = cb_data;
     ipmi_cmd_info_t *cmd_info = info->cmd_info;
     ipmi_cmdlang_t  *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
-    unsigned int    i;
-    int             rv;
-    int             total_size = 0;
 
     if (err) {
 	cmdlang->err = err;
@@ -684,27 +703,9 @@ sdrs_fetched(ipmi_sdr_info_t *sdrs,
     ipmi_cmdlang_out(cmd_info, "MC", NULL);
     ipmi_cmdlang_down(cmd_info);
     ipmi_cmdlang_out(cmd_info, "Name", info->mc_name);
-    for (i=0; i<count; i++) {
-	ipmi_sdr_t sdr;
-	char       str[20];
-
-	rv = ipmi_get_sdr_by_index(sdrs, i, &sdr);
-	if (rv)
-	    continue;
-
-        ipmi_cmdlang_out(cmd_info, "SDR", NULL);
-	ipmi_cmdlang_down(cmd_info);
-        ipmi_cmdlang_out_int(cmd_info, "Record ID", sdr.record_id);
-        ipmi_cmdlang_out_int(cmd_info, "Type", sdr.type);
-	snprintf(str, sizeof(str), "%d.%d", sdr.major_version,
-		 sdr.minor_version);
-        ipmi_cmdlang_out(cmd_info, "Version", str);
-	ipmi_cmdlang_out_binary(cmd_info, "Data",
-				(char *) sdr.data, sdr.length);
-	ipmi_cmdlang_up(cmd_info);
-	total_size += sdr.length+5;
-    }
-    ipmi_cmdlang_out_int(cmd_info, "Total Size", total_size);
+    info->total_size = 0;
+    ipmi_sdr_iterate_sdrs(sdrs, sdr_out, info);
+    ipmi_cmdlang_out_int(cmd_info, "Total Size", info->total_size);
     ipmi_cmdlang_up(cmd_info);
 
  out_err:
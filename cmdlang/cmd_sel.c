@@ -105,6 +105,22 @@ threshold_event_handler(ipmi_sensor_t               *sensor,
     return IPMI_EVENT_NOT_HANDLED;
 }
 
+static void
+sel_list_event_out(ipmi_event_t *event, ipmi_cmd_info_t *cmd_info)
+{
+    ipmi_cmdlang_out(cmd_info, "Event", NULL);
+    ipmi_cmdlang_down(cmd_info);
+    ipmi_cmdlang_event_out(event, cmd_info);
+    ipmi_cmdlang_up(cmd_info);
+}
+
+static int
+sel_list_event(ipmi_domain_t *domain, ipmi_event_t *event, void *cb_data)
+{
+    sel_list_event_out(event, cb_data);
+    return 0;
+}
+
 static void
 sel_list(ipmi_domain_t *domain, void *cb_data)
 {
@@ -155,13 +171,20 @@ sel_list(ipmi_domain_t *domain, void *cb_data)
     ipmi_cmdlang_out_int(cmd_info, "Entries", count1);
     ipmi_cmdlang_out_int(cmd_info, "Slots in use", count2);
 
+    if (!h) {
+	/* Nothing here calls back into the SEL, so the events can be
+	   printed in place. */
+	ipmi_domain_iterate_events(domain, sel_list_event, cmd_info);
+	ipmi_cmdlang_up(cmd_info);
+	return;
+    }
+
     event = ipmi_domain_first_event(domain);
     while (event) {
 	ipmi_cmdlang_out(cmd_info, "Event", NULL);
 	ipmi_cmdlang_down(cmd_info);
 	ipmi_cmdlang_event_out(event, cmd_info);
-	if (h)
-	    ipmi_event_call_handler(domain, h, event, cmd_info);
+	ipmi_event_call_handler(domain, h, event, cmd_info);
 	ipmi_cmdlang_up(cmd_info);
 	event2 = ipmi_domain_next_event(domain, event);
 	ipmi_event_free(event);
@@ -180,6 +203,13 @@ sel_list(ipmi_domain_t *domain, void *cb_data)
 	ipmi_event_handlers_free(h);
 }
 
+static int
+mc_sel_list_event(ipmi_mc_t *mc, ipmi_event_t *event, void *cb_data)
+{
+    sel_list_event_out(event, cb_data);
+    return 0;
+}
+
 static void
 mc_sel_list(ipmi_mc_t *mc, void *cb_data)
 {
@@ -224,13 +254,18 @@ mc_sel_list(ipmi_mc_t *mc, void *cb_data)
     ipmi_cmdlang_out_int(cmd_info, "Slots in use",
 			 ipmi_mc_sel_entries_used(mc));
 
+    if (!h) {
+	ipmi_mc_iterate_events(mc, mc_sel_list_event, cmd_info);
+	ipmi_cmdlang_up(cmd_info);
+	return;
+    }
+
     event = ipmi_mc_first_event(mc);
     while (event) {
 	ipmi_cmdlang_out(cmd_info, "Event", NULL);
 	ipmi_cmdlang_down(cmd_info);
 	ipmi_cmdlang_event_out(event, cmd_info);
-	if (h)
-	    ipmi_event_call_handler(domain, h, event, cmd_info);
+	ipmi_event_call_handler(domain, h, event, cmd_info);
 	ipmi_cmdlang_up(cmd_info);
 	event2 = ipmi_mc_next_event(mc, event);
 	ipmi_event_free(event);
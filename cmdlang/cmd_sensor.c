@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_err.h>
 #include <OpenIPMI/ipmi_cmdlang.h>
 
 /* Internal includes, do not use in your programs */
@@ -325,30 +326,17 @@ sensor_info(ipmi_sensor_t *sensor, void *cb_data)
 }
 
 static void
-read_sensor(ipmi_sensor_t             *sensor,
-	    int                       err,
-	    enum ipmi_value_present_e value_present,
-	    unsigned int              raw_val,
-	    double                    val,
-	    ipmi_states_t             *states,
-	    void                      *cb_data)
+read_sensor_out(ipmi_sensor_t             *sensor,
+		enum ipmi_value_present_e value_present,
+		unsigned int              raw_val,
+		double                    val,
+		ipmi_states_t             *states,
+		ipmi_cmd_info_t           *cmd_info)
 {
-    ipmi_cmd_info_t    *cmd_info = cb_data;
-    ipmi_cmdlang_t     *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
     enum ipmi_thresh_e thresh;
     char               sensor_name[IPMI_SENSOR_NAME_LEN];
     int                rv;
 
-    ipmi_cmdlang_lock(cmd_info);
-    if (err) {
-	cmdlang->errstr = "Error reading sensor";
-	cmdlang->err = err;
-	ipmi_sensor_get_name(sensor, cmdlang->objstr,
-			     cmdlang->objstr_len);
-	cmdlang->location = "cmd_sensor.c(read_sensor)";
-	goto out;
-    }
-
     ipmi_sensor_get_name(sensor, sensor_name, sizeof(sensor_name));
 
     ipmi_cmdlang_out(cmd_info, "Sensor", NULL);
@@ -391,23 +379,19 @@ read_sensor(ipmi_sensor_t             *sensor,
 	ipmi_cmdlang_up(cmd_info);
     }
     ipmi_cmdlang_up(cmd_info);
-
- out:
-    ipmi_cmdlang_unlock(cmd_info);
-    ipmi_cmdlang_cmd_info_put(cmd_info);
 }
 
 static void
-read_sensor_states(ipmi_sensor_t *sensor,
-		   int           err,
-		   ipmi_states_t *states,
-		   void          *cb_data)
+read_sensor(ipmi_sensor_t             *sensor,
+	    int                       err,
+	    enum ipmi_value_present_e value_present,
+	    unsigned int              raw_val,
+	    double                    val,
+	    ipmi_states_t             *states,
+	    void                      *cb_data)
 {
-    ipmi_cmd_info_t *cmd_info = cb_data;
-    ipmi_cmdlang_t  *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
-    int             i;
-    char            sensor_name[IPMI_SENSOR_NAME_LEN];
-    int             rv;
+    ipmi_cmd_info_t    *cmd_info = cb_data;
+    ipmi_cmdlang_t     *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
 
     ipmi_cmdlang_lock(cmd_info);
     if (err) {
@@ -415,10 +399,26 @@ read_sensor_states(ipmi_sensor_t *sensor,
 	cmdlang->err = err;
 	ipmi_sensor_get_name(sensor, cmdlang->objstr,
 			     cmdlang->objstr_len);
-	cmdlang->location = "cmd_sensor.c(read_sensor_states)";
+	cmdlang->location = "cmd_sensor.c(read_sensor)";
 	goto out;
     }
 
+    read_sensor_out(sensor, value_present, raw_val, val, states, cmd_info);
+
+ out:
+    ipmi_cmdlang_unlock(cmd_info);
+    ipmi_cmdlang_cmd_info_put(cmd_info);
+}
+
+static void
+read_sensor_states_out(ipmi_sensor_t   *sensor,
+		       ipmi_states_t   *states,
+		       ipmi_cmd_info_t *cmd_info)
+{
+    int             i;
+    char            sensor_name[IPMI_SENSOR_NAME_LEN];
+    int             rv;
+
     ipmi_sensor_get_name(sensor, sensor_name, sizeof(sensor_name));
 
     ipmi_cmdlang_out(cmd_info, "Sensor", NULL);
@@ -449,6 +449,28 @@ read_sensor_states(ipmi_sensor_t *sensor,
 	ipmi_cmdlang_up(cmd_info);
     }
     ipmi_cmdlang_up(cmd_info);
+}
+
+static void
+read_sensor_states(ipmi_sensor_t *sensor,
+		   int           err,
+		   ipmi_states_t *states,
+		   void          *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    ipmi_cmdlang_t  *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
+
+    ipmi_cmdlang_lock(cmd_info);
+    if (err) {
+	cmdlang->errstr = "Error reading sensor";
+	cmdlang->err = err;
+	ipmi_sensor_get_name(sensor, cmdlang->objstr,
+			     cmdlang->objstr_len);
+	cmdlang->location = "cmd_sensor.c(read_sensor_states)";
+	goto out;
+    }
+
+    read_sensor_states_out(sensor, states, cmd_info);
 
  out:
     ipmi_cmdlang_unlock(cmd_info);
@@ -480,6 +502,95 @@ sensor_get(ipmi_sensor_t *sensor, void *cb_data)
     }
 }
 
+/*
+ * Read every sensor under a domain or entity in one command.  All the
+ * reads are started at once so the library can run them in parallel
+ * and each result is output as it comes in.  A sensor that fails is
+ * reported in its own output and does not fail the command, otherwise
+ * one bad sensor would hide all the others.
+ */
+static void
+sensor_get_all_err(ipmi_sensor_t *sensor, int err, ipmi_cmd_info_t *cmd_info)
+{
+    char sensor_name[IPMI_SENSOR_NAME_LEN];
+    char errval[128];
+
+    ipmi_sensor_get_name(sensor, sensor_name, sizeof(sensor_name));
+    ipmi_cmdlang_out(cmd_info, "Sensor", NULL);
+    ipmi_cmdlang_down(cmd_info);
+    ipmi_cmdlang_out(cmd_info, "Name", sensor_name);
+    ipmi_cmdlang_out_int(cmd_info, "Error", err);
+    ipmi_cmdlang_out(cmd_info, "Error String",
+		     ipmi_get_error_string(err, errval, sizeof(errval)));
+    ipmi_cmdlang_up(cmd_info);
+}
+
+static void
+read_sensor_all(ipmi_sensor_t             *sensor,
+		int                       err,
+		enum ipmi_value_present_e value_present,
+		unsigned int              raw_val,
+		double                    val,
+		ipmi_states_t             *states,
+		void                      *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+
+    ipmi_cmdlang_lock(cmd_info);
+    if (err)
+	sensor_get_all_err(sensor, err, cmd_info);
+    else
+	read_sensor_out(sensor, value_present, raw_val, val, states,
+			cmd_info);
+    ipmi_cmdlang_unlock(cmd_info);
+    ipmi_cmdlang_cmd_info_put(cmd_info);
+}
+
+static void
+read_sensor_states_all(ipmi_sensor_t *sensor,
+		       int           err,
+		       ipmi_states_t *states,
+		       void          *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+
+    ipmi_cmdlang_lock(cmd_info);
+    if (err)
+	sensor_get_all_err(sensor, err, cmd_info);
+    else
+	read_sensor_states_out(sensor, states, cmd_info);
+    ipmi_cmdlang_unlock(cmd_info);
+    ipmi_cmdlang_cmd_info_put(cmd_info);
+}
+
+static void
+sensor_get_all_handler(ipmi_entity_t *entity,
+		       ipmi_sensor_t *sensor,
+		       void          *cb_data)
+{
+    ipmi_cmd_info_t *cmd_info = cb_data;
+    int             rv;
+
+    ipmi_cmdlang_cmd_info_get(cmd_info);
+    if (ipmi_sensor_get_event_reading_type(sensor)
+	== IPMI_EVENT_READING_TYPE_THRESHOLD)
+    {
+	rv = ipmi_sensor_get_reading(sensor, read_sensor_all, cmd_info);
+    } else {
+	rv = ipmi_sensor_get_states(sensor, read_sensor_states_all, cmd_info);
+    }
+    if (rv) {
+	ipmi_cmdlang_cmd_info_put(cmd_info);
+	sensor_get_all_err(sensor, rv, cmd_info);
+    }
+}
+
+static void
+sensor_get_all(ipmi_entity_t *entity, void *cb_data)
+{
+    ipmi_entity_iterate_sensors(entity, sensor_get_all_handler, cb_data);
+}
+
 static void
 sensor_rearm_done(ipmi_sensor_t *sensor,
 		  int           err,
@@ -1306,6 +1417,8 @@ sensor_threshold_event_handler(ipmi_sensor_t               *sensor,
     return IPMI_EVENT_NOT_HANDLED;
 }
 
+void ipmi_cmdlang_index_sensor(ipmi_sensor_t *sensor, enum ipmi_update_e op);
+
 void
 ipmi_cmdlang_sensor_change(enum ipmi_update_e op,
 			   ipmi_entity_t      *entity,
@@ -1317,6 +1430,8 @@ ipmi_cmdlang_sensor_change(enum ipmi_update_e op,
     ipmi_cmd_info_t *evi;
     char            sensor_name[IPMI_SENSOR_NAME_LEN];
 
+    ipmi_cmdlang_index_sensor(sensor, op);
+
     ipmi_sensor_get_name(sensor, sensor_name, sizeof(sensor_name));
 
     evi = ipmi_cmdlang_alloc_event_info();
@@ -1394,6 +1509,13 @@ static ipmi_cmdlang_init_t cmds_sensor[] =
     { "get", &sensor_cmds,
       "<sensor> - Get the sensor's current reading",
       ipmi_cmdlang_sensor_handler, sensor_get, NULL },
+    { "get_all", &sensor_cmds,
+      "[<domain> | <entity>] - Get the current reading of every sensor"
+      " in the domain or entity, or in all domains if nothing is given."
+      "  The readings are all started at once and output as they come"
+      " in.  A sensor that cannot be read reports its error in its own"
+      " output instead of failing the command.",
+      ipmi_cmdlang_entity_handler, sensor_get_all, NULL },
     { "rearm", &sensor_cmds,
       "<sensor> global | <thresholds> | <discrete states> - "
       " Rearm the sensor.  If global is specified, then rearm"
@@ -54,6 +54,8 @@
 /* Internal includes, do not use in your programs */
 #include <OpenIPMI/internal/ipmi_locks.h>
 #include <OpenIPMI/internal/ipmi_malloc.h>
+#include <OpenIPMI/internal/ipmi_utils.h>
+#include <OpenIPMI/internal/htable.h>
 
 /*
  * This is the value passed to a command handler.
@@ -162,6 +164,316 @@ parse_ipmi_objstr(char *str,
 }
 
 
+/*
+ * Name index.  With a lot of domains, looking at every domain and
+ * object and comparing names for each command gets expensive.  The
+ * add and delete handlers keep the full names here, a table of
+ * domains each with a table of its entities, sensors and controls, so
+ * a fully specified name is a hash lookup.  Ids are kept, not
+ * pointers, and the name is checked again when the id is converted,
+ * so a stale entry is just a miss.  On a miss the objects are scanned
+ * the old way.
+ */
+enum name_type_e { NAME_DOMAIN, NAME_ENTITY, NAME_SENSOR, NAME_CONTROL };
+
+typedef struct name_ent_s
+{
+    enum name_type_e type;
+    unsigned int     hash;
+    union {
+	ipmi_domain_id_t  domain;
+	ipmi_entity_id_t  entity;
+	ipmi_sensor_id_t  sensor;
+	ipmi_control_id_t control;
+    } id;
+
+    /* Domain entries only.  Objects may be reported before their
+       domain, so the entry may not have the id yet. */
+    int              id_set;
+    htable_t         *objs;
+
+    char             name[1];
+} name_ent_t;
+
+static ipmi_lock_t *name_lock;
+static htable_t    *domain_names;
+
+static unsigned int
+name_hash(enum name_type_e type, const char *name)
+{
+    uint32_t hash = 2166136261U;
+
+    hash = (hash ^ type) * 16777619U;
+    for (; *name; name++)
+	hash = (hash ^ (unsigned char) *name) * 16777619U;
+    return ipmi_hash_uint(hash);
+}
+
+typedef struct name_find_s
+{
+    enum name_type_e type;
+    const char       *name;
+} name_find_t;
+
+static int
+name_cmp(void *item, void *cb_data)
+{
+    name_ent_t  *e = item;
+    name_find_t *f = cb_data;
+
+    return (e->type == f->type) && (strcmp(e->name, f->name) == 0);
+}
+
+static name_ent_t *
+name_find(htable_t *tab, enum name_type_e type, const char *name,
+	  unsigned int hash)
+{
+    name_find_t f;
+
+    f.type = type;
+    f.name = name;
+    return htable_find(tab, hash, name_cmp, &f);
+}
+
+static name_ent_t *
+name_ent_alloc(enum name_type_e type, const char *name, unsigned int hash)
+{
+    name_ent_t *e;
+
+    e = ipmi_mem_alloc(sizeof(*e) + strlen(name));
+    if (!e)
+	return NULL;
+    memset(e, 0, sizeof(*e));
+    e->type = type;
+    e->hash = hash;
+    strcpy(e->name, name);
+    return e;
+}
+
+static void
+name_ent_free(void *item, void *cb_data)
+{
+    ipmi_mem_free(item);
+}
+
+static void
+name_domain_free(void *item, void *cb_data)
+{
+    name_ent_t *d = item;
+
+    htable_iter(d->objs, name_ent_free, NULL);
+    free_htable(d->objs);
+    ipmi_mem_free(d);
+}
+
+/* Must be called with name_lock held. */
+static name_ent_t *
+name_domain_get(const char *domain, int create)
+{
+    unsigned int hash = name_hash(NAME_DOMAIN, domain);
+    name_ent_t   *d;
+
+    d = name_find(domain_names, NAME_DOMAIN, domain, hash);
+    if (d || !create)
+	return d;
+
+    d = name_ent_alloc(NAME_DOMAIN, domain, hash);
+    if (!d)
+	return NULL;
+    d->objs = alloc_htable();
+    if (!d->objs) {
+	ipmi_mem_free(d);
+	return NULL;
+    }
+    if (!htable_add(domain_names, hash, d)) {
+	free_htable(d->objs);
+	ipmi_mem_free(d);
+	return NULL;
+    }
+    return d;
+}
+
+void
+ipmi_cmdlang_index_domain(ipmi_domain_t *domain, enum ipmi_update_e op)
+{
+    char       name[IPMI_DOMAIN_NAME_LEN];
+    name_ent_t *d;
+
+    if (!domain_names)
+	return;
+
+    ipmi_domain_get_name(domain, name, sizeof(name));
+    ipmi_lock(name_lock);
+    if (op == IPMI_ADDED) {
+	d = name_domain_get(name, 1);
+	if (d) {
+	    d->id.domain = ipmi_domain_convert_to_id(domain);
+	    d->id_set = 1;
+	}
+    } else if (op == IPMI_DELETED) {
+	d = name_domain_get(name, 0);
+	if (d) {
+	    htable_remove(domain_names, d->hash, d);
+	    name_domain_free(d, NULL);
+	}
+    }
+    ipmi_unlock(name_lock);
+}
+
+static void
+name_index_obj(enum name_type_e   type,
+	       const char         *name,
+	       enum ipmi_update_e op,
+	       const void         *id,
+	       size_t             id_len)
+{
+    char         dname[IPMI_DOMAIN_NAME_LEN];
+    const char   *c;
+    unsigned int hash;
+    name_ent_t   *d, *e;
+
+    if (!domain_names)
+	return;
+
+    c = strchr(name, '(');
+    if (!c || ((size_t) (c - name) >= sizeof(dname)))
+	return;
+    memcpy(dname, name, c - name);
+    dname[c - name] = '\0';
+    hash = name_hash(type, name);
+
+    ipmi_lock(name_lock);
+    d = name_domain_get(dname, op == IPMI_ADDED);
+    if (!d)
+	goto out_unlock;
+    e = name_find(d->objs, type, name, hash);
+    if (op == IPMI_ADDED) {
+	if (!e) {
+	    e = name_ent_alloc(type, name, hash);
+	    if (e && !htable_add(d->objs, hash, e)) {
+		ipmi_mem_free(e);
+		e = NULL;
+	    }
+	}
+	if (e)
+	    memcpy(&e->id, id, id_len);
+    } else if ((op == IPMI_DELETED) && e) {
+	htable_remove(d->objs, hash, e);
+	ipmi_mem_free(e);
+    }
+ out_unlock:
+    ipmi_unlock(name_lock);
+}
+
+void
+ipmi_cmdlang_index_entity(ipmi_entity_t *entity, enum ipmi_update_e op)
+{
+    char             name[IPMI_ENTITY_NAME_LEN];
+    ipmi_entity_id_t id = ipmi_entity_convert_to_id(entity);
+
+    ipmi_entity_get_name(entity, name, sizeof(name));
+    name_index_obj(NAME_ENTITY, name, op, &id, sizeof(id));
+}
+
+void
+ipmi_cmdlang_index_sensor(ipmi_sensor_t *sensor, enum ipmi_update_e op)
+{
+    char             name[IPMI_SENSOR_NAME_LEN];
+    ipmi_sensor_id_t id = ipmi_sensor_convert_to_id(sensor);
+
+    ipmi_sensor_get_name(sensor, name, sizeof(name));
+    name_index_obj(NAME_SENSOR, name, op, &id, sizeof(id));
+}
+
+void
+ipmi_cmdlang_index_control(ipmi_control_t *control, enum ipmi_update_e op)
+{
+    char              name[IPMI_CONTROL_NAME_LEN];
+    ipmi_control_id_t id = ipmi_control_convert_to_id(control);
+
+    ipmi_control_get_name(control, name, sizeof(name));
+    name_index_obj(NAME_CONTROL, name, op, &id, sizeof(id));
+}
+
+/* Build the full name of an object from the parts of the command's
+   object string and look it up.  Returns 0 if it was found. */
+static int
+name_index_lookup(enum name_type_e type,
+		  const char       *domain,
+		  const char       *class,
+		  const char       *obj,
+		  char             *name,
+		  size_t           name_len,
+		  void             *id,
+		  size_t           id_len)
+{
+    name_ent_t *d, *e = NULL;
+    int        len;
+
+    if (!domain_names)
+	return ENOENT;
+
+    switch (type) {
+    case NAME_DOMAIN:
+	len = snprintf(name, name_len, "%s", domain);
+	break;
+    case NAME_ENTITY:
+	len = snprintf(name, name_len, "%s(%s)", domain, class);
+	break;
+    default:
+	len = snprintf(name, name_len, "%s(%s).%s", domain, class, obj);
+	break;
+    }
+    if ((len < 0) || ((size_t) len >= name_len))
+	return ENOENT;
+
+    ipmi_lock(name_lock);
+    d = name_domain_get(domain, 0);
+    if (d) {
+	if (type == NAME_DOMAIN) {
+	    if (d->id_set)
+		e = d;
+	} else {
+	    e = name_find(d->objs, type, name, name_hash(type, name));
+	}
+    }
+    if (e)
+	memcpy(id, &e->id, id_len);
+    ipmi_unlock(name_lock);
+
+    return e ? 0 : ENOENT;
+}
+
+static int
+name_index_init(os_handler_t *os_hnd)
+{
+    int rv;
+
+    rv = ipmi_create_lock_os_hnd(os_hnd, &name_lock);
+    if (rv)
+	return rv;
+    domain_names = alloc_htable();
+    if (!domain_names) {
+	ipmi_destroy_lock(name_lock);
+	name_lock = NULL;
+	return ENOMEM;
+    }
+    return 0;
+}
+
+static void
+name_index_shutdown(void)
+{
+    if (!domain_names)
+	return;
+    htable_iter(domain_names, name_domain_free, NULL);
+    free_htable(domain_names);
+    domain_names = NULL;
+    ipmi_destroy_lock(name_lock);
+    name_lock = NULL;
+}
+
+
 /*
  * Handling for iterating domains.
  */
@@ -172,6 +484,7 @@ typedef struct domain_iter_info_s
     ipmi_domain_ptr_cb handler;
     void               *cb_data;
     ipmi_cmd_info_t    *cmd_info;
+    int                found;
 } domain_iter_info_t;
 
 static void
@@ -185,8 +498,10 @@ for_each_domain_handler(ipmi_domain_t *domain, void *cb_data)
 	return;
 
     ipmi_domain_get_name(domain, domain_name, sizeof(domain_name));
-    if ((!info->cmpstr) || (strcmp(info->cmpstr, domain_name) == 0))
+    if ((!info->cmpstr) || (strcmp(info->cmpstr, domain_name) == 0)) {
+	info->found = 1;
 	info->handler(domain, info->cb_data);
+    }
 }
 
 static void
@@ -210,6 +525,20 @@ for_each_domain(ipmi_cmd_info_t    *cmd_info,
     info.handler = handler;
     info.cb_data = cb_data;
     info.cmd_info = cmd_info;
+
+    if (domain) {
+	char             name[IPMI_DOMAIN_NAME_LEN];
+	ipmi_domain_id_t id;
+
+	info.found = 0;
+	if ((name_index_lookup(NAME_DOMAIN, domain, NULL, NULL,
+			       name, sizeof(name), &id, sizeof(id)) == 0)
+	    && (ipmi_domain_pointer_cb(id, for_each_domain_handler, &info)
+		== 0)
+	    && info.found)
+	    return;
+    }
+
     ipmi_domain_iterate_domains(for_each_domain_handler, &info);
 }
 
@@ -735,6 +1064,8 @@ typedef struct entity_iter_info_s
     ipmi_entity_ptr_cb handler;
     void               *cb_data;
     ipmi_cmd_info_t    *cmd_info;
+    char               *fullname; /* Set for a lookup from the index. */
+    int                found;
 } entity_iter_info_t;
 
 static void
@@ -749,6 +1080,13 @@ for_each_entity_handler(ipmi_entity_t *entity, void *cb_data)
 	return;
 
     ipmi_entity_get_name(entity, entity_name, sizeof(entity_name));
+    if (info->fullname) {
+	if (strcmp(info->fullname, entity_name) == 0) {
+	    info->found = 1;
+	    info->handler(entity, info->cb_data);
+	}
+	return;
+    }
     c = strchr(entity_name, '(');
     if (!c)
 	goto out_err;
@@ -797,6 +1135,23 @@ for_each_entity(ipmi_cmd_info_t    *cmd_info,
     info.handler = handler;
     info.cb_data = cb_data;
     info.cmd_info = cmd_info;
+    info.fullname = NULL;
+
+    if (domain && class) {
+	char             name[IPMI_ENTITY_NAME_LEN];
+	ipmi_entity_id_t id;
+
+	info.fullname = name;
+	info.found = 0;
+	if ((name_index_lookup(NAME_ENTITY, domain, class, NULL,
+			       name, sizeof(name), &id, sizeof(id)) == 0)
+	    && (ipmi_entity_pointer_cb(id, for_each_entity_handler, &info)
+		== 0)
+	    && info.found)
+	    return;
+	info.fullname = NULL;
+    }
+
     for_each_domain(cmd_info, domain, NULL, NULL,
 		    for_each_entity_domain_handler, &info);
 }
@@ -836,6 +1191,8 @@ typedef struct sensor_iter_info_s
     ipmi_sensor_ptr_cb handler;
     void               *cb_data;
     ipmi_cmd_info_t    *cmd_info;
+    char               *fullname; /* Set for a lookup from the index. */
+    int                found;
 } sensor_iter_info_t;
 
 static void
@@ -848,6 +1205,13 @@ for_each_sensor_handler(ipmi_entity_t *entity,
     char               *c;
 
     ipmi_sensor_get_name(sensor, sensor_name, sizeof(sensor_name));
+    if (info->fullname) {
+	if (strcmp(info->fullname, sensor_name) == 0) {
+	    info->found = 1;
+	    info->handler(sensor, info->cb_data);
+	}
+	return;
+    }
     c = strchr(sensor_name, '(');
     if (!c)
 	goto out_err;
@@ -874,6 +1238,12 @@ for_each_sensor_entity_handler(ipmi_entity_t *entity, void *cb_data)
     ipmi_entity_iterate_sensors(entity, for_each_sensor_handler, cb_data);
 }
 
+static void
+for_each_sensor_id_handler(ipmi_sensor_t *sensor, void *cb_data)
+{
+    for_each_sensor_handler(NULL, sensor, cb_data);
+}
+
 static void
 for_each_sensor(ipmi_cmd_info_t    *cmd_info,
 		char               *domain,
@@ -888,6 +1258,23 @@ for_each_sensor(ipmi_cmd_info_t    *cmd_info,
     info.handler = handler;
     info.cb_data = cb_data;
     info.cmd_info = cmd_info;
+    info.fullname = NULL;
+
+    if (domain && class && obj) {
+	char             name[IPMI_SENSOR_NAME_LEN];
+	ipmi_sensor_id_t id;
+
+	info.fullname = name;
+	info.found = 0;
+	if ((name_index_lookup(NAME_SENSOR, domain, class, obj,
+			       name, sizeof(name), &id, sizeof(id)) == 0)
+	    && (ipmi_sensor_pointer_cb(id, for_each_sensor_id_handler, &info)
+		== 0)
+	    && info.found)
+	    return;
+	info.fullname = NULL;
+    }
+
     for_each_entity(cmd_info, domain, class, NULL,
 		    for_each_sensor_entity_handler, &info);
 }
@@ -927,6 +1314,8 @@ typedef struct control_iter_info_s
     ipmi_control_ptr_cb handler;
     void                *cb_data;
     ipmi_cmd_info_t     *cmd_info;
+    char                *fullname; /* Set for a lookup from the index. */
+    int                 found;
 } control_iter_info_t;
 
 static void
@@ -939,6 +1328,13 @@ for_each_control_handler(ipmi_entity_t  *entity,
     char               *c;
 
     ipmi_control_get_name(control, control_name, sizeof(control_name));
+    if (info->fullname) {
+	if (strcmp(info->fullname, control_name) == 0) {
+	    info->found = 1;
+	    info->handler(control, info->cb_data);
+	}
+	return;
+    }
     c = strchr(control_name, '(');
     if (!c)
 	goto out_err;
@@ -965,6 +1361,12 @@ for_each_control_entity_handler(ipmi_entity_t *entity, void *cb_data)
     ipmi_entity_iterate_controls(entity, for_each_control_handler, cb_data);
 }
 
+static void
+for_each_control_id_handler(ipmi_control_t *control, void *cb_data)
+{
+    for_each_control_handler(NULL, control, cb_data);
+}
+
 static void
 for_each_control(ipmi_cmd_info_t     *cmd_info,
 		 char                *domain,
@@ -979,6 +1381,23 @@ for_each_control(ipmi_cmd_info_t     *cmd_info,
     info.handler = handler;
     info.cb_data = cb_data;
     info.cmd_info = cmd_info;
+    info.fullname = NULL;
+
+    if (domain && class && obj) {
+	char              name[IPMI_CONTROL_NAME_LEN];
+	ipmi_control_id_t id;
+
+	info.fullname = name;
+	info.found = 0;
+	if ((name_index_lookup(NAME_CONTROL, domain, class, obj,
+			       name, sizeof(name), &id, sizeof(id)) == 0)
+	    && (ipmi_control_pointer_cb(id, for_each_control_id_handler,
+					&info) == 0)
+	    && info.found)
+	    return;
+	info.fullname = NULL;
+    }
+
     for_each_entity(cmd_info, domain, class, NULL,
 		    for_each_control_entity_handler, &info);
 }
@@ -2703,6 +3122,34 @@ debug(ipmi_cmd_info_t *cmd_info)
 	cmdlang->location = "cmdlang.c(debug)";
 }
 
+static void
+memstats(ipmi_cmd_info_t *cmd_info)
+{
+    ipmi_cmdlang_t           *cmdlang = ipmi_cmdinfo_get_cmdlang(cmd_info);
+    ipmi_malloc_type_stats_t stats;
+    unsigned int             i;
+    int                      rv;
+
+    for (i=0; i<IPMI_MEM_TYPE_NUM; i++) {
+	rv = ipmi_malloc_type_stats(i, &stats);
+	if (rv) {
+	    cmdlang->errstr = "Memory accounting is not enabled";
+	    cmdlang->err = rv;
+	    cmdlang->location = "cmdlang.c(memstats)";
+	    return;
+	}
+	ipmi_cmdlang_out(cmd_info, "Type", NULL);
+	ipmi_cmdlang_down(cmd_info);
+	ipmi_cmdlang_out(cmd_info, "Name", stats.name);
+	ipmi_cmdlang_out_long(cmd_info, "Live Bytes", stats.live_bytes);
+	ipmi_cmdlang_out_long(cmd_info, "Live Objects", stats.live_objects);
+	ipmi_cmdlang_out_long(cmd_info, "Allocs", stats.allocs);
+	ipmi_cmdlang_out_long(cmd_info, "Alloc Bytes", stats.alloc_bytes);
+	ipmi_cmdlang_out_long(cmd_info, "Frees", stats.frees);
+	ipmi_cmdlang_up(cmd_info);
+    }
+}
+
 static ipmi_cmdlang_init_t cmds_global[] =
 {
     { "evinfo", NULL,
@@ -2716,6 +3163,10 @@ static ipmi_cmdlang_init_t cmds_global[] =
       " msg, rawmsg, events, con0, con1, con2, con3.  This is primarily"
       " for designers of OpenIPMI trying to debug problems.",
       debug, NULL, NULL },
+    { "memstats", NULL,
+      "- Dump the memory allocation counters for each subsystem.  Memory"
+      " accounting must have been turned on at startup.",
+      memstats, NULL, NULL },
 };
 #define CMDS_GLOBAL_LEN (sizeof(cmds_global)/sizeof(ipmi_cmdlang_init_t))
 
@@ -2740,6 +3191,9 @@ ipmi_cmdlang_init(os_handler_t *os_hnd)
 {
     int rv;
 
+    rv = name_index_init(os_hnd);
+    if (rv) return rv;
+
     rv = ipmi_cmdlang_domain_init(os_hnd);
     if (rv) return rv;
 
@@ -2803,6 +3257,7 @@ ipmi_cmdlang_cleanup(void)
     ipmi_cmdlang_lanparm_shutdown();
     ipmi_cmdlang_solparm_shutdown();
     cleanup_level(cmd_list);
+    name_index_shutdown();
 }
 
 static int do_evinfo = 0;
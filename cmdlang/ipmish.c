@@ -83,6 +83,10 @@ static int done = 0;
 static int evcount = 0;
 static int handling_input = 0;
 static int cmd_redisp = 1;
+
+/* Write JSON instead of text, see ipmi_cmdlang_json_setup(). */
+static int use_json = 0;
+static ipmi_cmdlang_json_t json_data;
 #ifdef HAVE_UCDSNMP
 static int do_snmp = 0;
 #endif
@@ -586,33 +590,58 @@ static ipmi_cmdlang_t cmdlang =
 
 int *done_ptr = NULL;
 
+static void
+clear_cmd_err(ipmi_cmdlang_t *info)
+{
+    if (info->errstr_dynalloc)
+	ipmi_mem_free(info->errstr);
+    info->errstr_dynalloc = 0;
+    info->errstr = NULL;
+    info->location = NULL;
+    info->objstr[0] = '\0';
+    info->err = 0;
+}
+
+static void
+out_cmd_err(ipmi_cmdlang_t *info, FILE *s)
+{
+    char errval[128];
+
+    if (!info->location)
+	info->location = "";
+    if (strlen(info->objstr) == 0) {
+	fprintf(s, "error: %s: %s (0x%x, %s)\n",
+		info->location, info->errstr,
+		info->err,
+		ipmi_get_error_string(info->err, errval, sizeof(errval)));
+    } else {
+	fprintf(s, "error: %s %s: %s (0x%x, %s)\n",
+		info->location, info->objstr, info->errstr,
+		info->err,
+		ipmi_get_error_string(info->err, errval, sizeof(errval)));
+    }
+}
+
 static void
 cmd_done(ipmi_cmdlang_t *info)
 {
     out_data_t *out_data = info->user_data;
 
-    if (info->err) {
-	char errval[128];
-	if (!info->location)
-	    info->location = "";
-	if (strlen(info->objstr) == 0) {
-	    fprintf(out_data->stream, "error: %s: %s (0x%x, %s)\n",
-		    info->location, info->errstr,
-		    info->err,
-		    ipmi_get_error_string(info->err, errval, sizeof(errval)));
+    if (use_json) {
+	ipmi_cmdlang_json_done(info);
+	clear_cmd_err(info);
+	if (done_ptr) {
+	    *done_ptr = 1;
 	} else {
-	    fprintf(out_data->stream, "error: %s %s: %s (0x%x, %s)\n",
-		    info->location, info->objstr, info->errstr,
-		    info->err,
-		    ipmi_get_error_string(info->err, errval, sizeof(errval)));
+	    handling_input = 1;
+	    enable_term_fd(info);
 	}
-	if (info->errstr_dynalloc)
-	    ipmi_mem_free(info->errstr);
-	info->errstr_dynalloc = 0;
-	info->errstr = NULL;
-	info->location = NULL;
-	info->objstr[0] = '\0';
-	info->err = 0;
+	return;
+    }
+
+    if (info->err) {
+	out_cmd_err(info, out_data->stream);
+	clear_cmd_err(info);
     }
 
     if (done_ptr) {
@@ -652,6 +681,11 @@ ipmi_cmdlang_report_event(ipmi_cmdlang_event_t *event)
     int                         indent2;
     unsigned int                i;
 
+    if (use_json) {
+	ipmi_cmdlang_json_event(&json_data, event);
+	return;
+    }
+
     if (handling_input && !done && cmd_redisp)
 	fputc('\n', stdout);
     ipmi_cmdlang_event_restart(event);
@@ -740,7 +774,7 @@ setup_term(os_handler_t *os_hnd)
 #endif
 
     stifle_history(500);
-    rl_callback_handler_install("> ", rl_ipmish_cb_handler);
+    rl_callback_handler_install(use_json ? "" : "> ", rl_ipmish_cb_handler);
     lout_data.stream = stdout;
 
     cmdlang.os_hnd = os_hnd;
@@ -785,6 +819,121 @@ exit_cmd(ipmi_cmd_info_t *cmd_info)
     ipmi_cmdlang_out(cmd_info, "Exiting ipmish", NULL);
 }
 
+/*
+ * Running the lines of a read file at the same time.  Each line gets
+ * its own cmdlang and its output is collected in memory, then written
+ * out in one piece when the line finishes so the output of different
+ * lines doesn't get mixed together.  The line number of the line in
+ * the file tags its output.
+ */
+static int max_parallel = 1;
+
+typedef struct par_cmd_s
+{
+    ipmi_cmdlang_t      cmdlang; /* Must be first, see par_cmd_done(). */
+    out_data_t          out_data;
+    ipmi_cmdlang_json_t json;
+    char                tag[16];
+    char                objstr[IPMI_MAX_NAME_LEN];
+    char                line[256];
+    char                cmdline[256]; /* Gets chopped up by cmdlang. */
+    FILE                *mem;
+    char                *buf;
+    size_t              len;
+    int                 *running;
+} par_cmd_t;
+
+static void
+par_cmd_done(ipmi_cmdlang_t *info)
+{
+    par_cmd_t *pc = (par_cmd_t *) info;
+
+    if (use_json) {
+	ipmi_cmdlang_json_done(info);
+    } else if (info->err) {
+	out_cmd_err(info, pc->mem);
+    }
+    clear_cmd_err(info);
+
+    fclose(pc->mem);
+    if (!use_json)
+	printf("> [%s] %s", pc->tag, pc->line);
+    fwrite(pc->buf, 1, pc->len, stdout);
+    fflush(stdout);
+    free(pc->buf);
+    (*pc->running)--;
+    free(pc);
+}
+
+static int
+par_cmd_start(ipmi_cmdlang_t *cmdlang, char *cmdline, int lineno,
+	      int *running)
+{
+    par_cmd_t *pc;
+
+    pc = malloc(sizeof(*pc));
+    if (!pc)
+	return ENOMEM;
+    memset(pc, 0, sizeof(*pc));
+    pc->mem = open_memstream(&pc->buf, &pc->len);
+    if (!pc->mem) {
+	free(pc);
+	return ENOMEM;
+    }
+    snprintf(pc->tag, sizeof(pc->tag), "%d", lineno);
+    strcpy(pc->line, cmdline);
+    strcpy(pc->cmdline, cmdline);
+    pc->running = running;
+
+    pc->cmdlang.os_hnd = cmdlang->os_hnd;
+    pc->cmdlang.done = par_cmd_done;
+    pc->cmdlang.objstr = pc->objstr;
+    pc->cmdlang.objstr_len = sizeof(pc->objstr);
+    if (use_json) {
+	ipmi_cmdlang_json_setup(&pc->cmdlang, &pc->json, pc->mem);
+	pc->json.tag = pc->tag;
+    } else {
+	pc->cmdlang.out = out_value;
+	pc->cmdlang.out_binary = out_binary;
+	pc->cmdlang.out_unicode = out_unicode;
+	pc->cmdlang.down = down_level;
+	pc->cmdlang.up = up_level;
+	pc->out_data.stream = pc->mem;
+	pc->cmdlang.user_data = &pc->out_data;
+    }
+
+    (*running)++;
+    ipmi_cmdlang_handle(&pc->cmdlang, pc->cmdline);
+    return 0;
+}
+
+static int
+read_parallel(ipmi_cmdlang_t *cmdlang, FILE *s)
+{
+    char cmdline[256];
+    int  running = 0;
+    int  lineno = 0;
+    int  rv = 0;
+
+    while (fgets(cmdline, sizeof(cmdline), s)) {
+	lineno++;
+	while (running >= max_parallel) {
+	    snmp_setup_fds(cmdlang->os_hnd);
+	    cmdlang->os_hnd->perform_one_op(cmdlang->os_hnd, NULL);
+	}
+	rv = par_cmd_start(cmdlang, cmdline, lineno, &running);
+	if (rv)
+	    break;
+    }
+
+    /* Everything started has a pointer to running, wait for it all. */
+    while (running) {
+	snmp_setup_fds(cmdlang->os_hnd);
+	cmdlang->os_hnd->perform_one_op(cmdlang->os_hnd, NULL);
+    }
+    return rv;
+}
+
 static int read_nest = 0;
 static void
 read_cmd(ipmi_cmd_info_t *cmd_info)
@@ -800,6 +949,7 @@ read_cmd(ipmi_cmd_info_t *cmd_info)
     char           **argv = ipmi_cmdlang_get_argv(cmd_info);
     int            *saved_done_ptr;
     char           *fname;
+    int            rv;
 
     if ((argc - curr_arg) < 1) {
 	cmdlang->errstr = "No filename entered";
@@ -824,14 +974,22 @@ read_cmd(ipmi_cmd_info_t *cmd_info)
     saved_done_ptr = done_ptr;
 
     /* not record the file's commands into history */
-    while (fgets(cmdline, sizeof(cmdline), s)) {
-	my_out_data.stream = stdout;
-	my_out_data.indent = 0;
-	my_cmdlang.user_data = &my_out_data;
+    if (max_parallel > 1)
+	rv = read_parallel(cmdlang, s);
+    else
+	rv = 0;
+    while ((max_parallel <= 1) && fgets(cmdline, sizeof(cmdline), s)) {
+	if (use_json) {
+	    my_cmdlang.user_data = &json_data;
+	} else {
+	    my_out_data.stream = stdout;
+	    my_out_data.indent = 0;
+	    my_cmdlang.user_data = &my_out_data;
+	    printf("> %s", cmdline);
+	    fflush(stdout);
+	}
 	cdone = 0;
 	done_ptr = &cdone;
-	printf("> %s", cmdline);
-	fflush(stdout);
 	ipmi_cmdlang_handle(&my_cmdlang, cmdline);
 	while (!cdone) {
 	    snmp_setup_fds(cmdlang->os_hnd);
@@ -848,6 +1006,12 @@ read_cmd(ipmi_cmd_info_t *cmd_info)
 	enable_term_fd(cmdlang);
     }
 
+    if (rv) {
+	cmdlang->errstr = "Unable to start command";
+	cmdlang->err = rv;
+	goto out_err;
+    }
+
     ipmi_cmdlang_out(cmd_info, "File read", fname);
 
     return;
@@ -958,8 +1122,13 @@ static char *usage_str =
 "  --execute <string> - execute the given string at startup.  This may be\n"
 "    entered multiple times for multiple commands.\n"
 "  -x <string> - same as --execute\n"
+"  --json - write command output and events as JSON, one line for each.\n"
+"  --parallel <n> - run up to n lines of a file given to the read command\n"
+"    at the same time.  Each line's output is written when it finishes,\n"
+"    tagged with its line number in the file.\n"
 "  --dlock - turn on lock debugging.\n"
 "  --dmem - turn on memory debugging.\n"
+"  --memacct - turn on memory accounting, see the memstats command.\n"
 "  --drawmsg - turn on raw message tracing.\n"
 "  --dmsg - turn on message tracing debugging.\n"
 "  --dmsgerr - turn on printing out low-level message errors.\n"
@@ -1016,11 +1185,29 @@ main(int argc, char *argv[])
 	    }
 	    add_exec_str(argv[curr_arg]);
 	    curr_arg++;
+	} else if (strcmp(arg, "--json") == 0) {
+	    use_json = 1;
+	} else if (strcmp(arg, "--parallel") == 0) {
+	    if (curr_arg >= argc) {
+		fprintf(stderr, "No option given for %s", arg);
+		usage(argv[0]);
+		return 1;
+	    }
+	    max_parallel = strtoul(argv[curr_arg], NULL, 0);
+	    if (max_parallel < 1) {
+		fprintf(stderr, "Invalid value for %s: %s\n", arg,
+			argv[curr_arg]);
+		usage(argv[0]);
+		return 1;
+	    }
+	    curr_arg++;
 	} else if (strcmp(arg, "--dlock") == 0) {
 	    DEBUG_LOCKS_ENABLE();
 	    use_debug_os = 1;
 	} else if (strcmp(arg, "--dmem") == 0) {
 	    DEBUG_MALLOC_ENABLE();
+	} else if (strcmp(arg, "--memacct") == 0) {
+	    MALLOC_ACCOUNTING_ENABLE();
 	} else if (strcmp(arg, "--drawmsg") == 0) {
 	    DEBUG_RAWMSG_ENABLE();
 	} else if (strcmp(arg, "--dmsg") == 0) {
@@ -1114,6 +1301,11 @@ main(int argc, char *argv[])
 
     setup_cmds();
 
+    if (use_json) {
+	ipmi_cmdlang_json_setup(&cmdlang, &json_data, stdout);
+	cmd_redisp = 0;
+    }
+
     setup_term(os_hnd);
 
     while (execs) {
@@ -1121,8 +1313,10 @@ main(int argc, char *argv[])
 	int         cdone = 0;
 	read_nest = 1;
 	execs = e->next;
-	printf("> %s\n", e->str);
-	fflush(stdout);
+	if (!use_json) {
+	    printf("> %s\n", e->str);
+	    fflush(stdout);
+	}
 	done_ptr = &cdone;
 	rl_ipmish_cb_handler(e->str);
 	while (!cdone) {
@@ -1162,10 +1356,12 @@ main(int argc, char *argv[])
 
     os_hnd->free_os_handler(os_hnd);
 
-    /* remove the prompt which editline printed */
-    printf("\b\b  \b\b");
-    if (evcount)
-	printf("\n");
+    if (!use_json) {
+	/* remove the prompt which editline printed */
+	printf("\b\b  \b\b");
+	if (evcount)
+	    printf("\n");
+    }
     fflush(stdout);
 
     if (rv)
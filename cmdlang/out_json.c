@@ -0,0 +1,287 @@
+/*
+ * out_json.c
+ *
+ * JSON output for the OpenIPMI command interpreter
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <OpenIPMI/ipmi_cmdlang.h>
+
+/*
+ * Everything is written as it comes in, the only state is whether
+ * anything has been written at the current level and whether the
+ * last output was a name without a value that may get nested output
+ * under it.
+ */
+
+static void
+json_str(FILE *s, const char *str)
+{
+    const unsigned char *c = (const unsigned char *) str;
+
+    putc('"', s);
+    for (; *c; c++) {
+	if (*c == '"' || *c == '\\') {
+	    putc('\\', s);
+	    putc(*c, s);
+	} else if (*c < 0x20 || *c >= 0x7f) {
+	    /* Strings from IPMI may be anything, keep the JSON valid. */
+	    fprintf(s, "\\u%4.4x", *c);
+	} else {
+	    putc(*c, s);
+	}
+    }
+    putc('"', s);
+}
+
+static void
+json_start(ipmi_cmdlang_json_t *json, const char *type)
+{
+    if (json->started)
+	return;
+    putc('{', json->stream);
+    if (json->tag) {
+	fputs("\"tag\":", json->stream);
+	json_str(json->stream, json->tag);
+	putc(',', json->stream);
+    }
+    fprintf(json->stream, "\"%s\":[", type);
+    json->started = 1;
+    json->first = 1;
+    json->pending = 0;
+    json->level = 0;
+}
+
+/* Start a new entry at the current level. */
+static void
+json_next(ipmi_cmdlang_json_t *json)
+{
+    if (json->pending) {
+	/* The last name got nothing nested under it. */
+	fputs(",null]", json->stream);
+	json->pending = 0;
+    }
+    if (!json->first)
+	putc(',', json->stream);
+    json->first = 0;
+}
+
+static void
+json_out(ipmi_cmdlang_json_t *json, const char *name, const char *value)
+{
+    json_start(json, "out");
+    json_next(json);
+    putc('[', json->stream);
+    json_str(json->stream, name);
+    if (value) {
+	putc(',', json->stream);
+	json_str(json->stream, value);
+	putc(']', json->stream);
+    } else {
+	json->pending = 1;
+    }
+}
+
+static void
+json_out_binary(ipmi_cmdlang_json_t *json, const char *name,
+		const char *value, unsigned int len)
+{
+    unsigned int i;
+
+    json_start(json, "out");
+    json_next(json);
+    putc('[', json->stream);
+    json_str(json->stream, name);
+    fputs(",[", json->stream);
+    for (i = 0; i < len; i++)
+	fprintf(json->stream, i ? ",%u" : "%u", value[i] & 0xff);
+    fputs("]]", json->stream);
+}
+
+static void
+json_down(ipmi_cmdlang_json_t *json)
+{
+    json_start(json, "out");
+    if (!json->pending) {
+	/* Nesting without a name, give it an empty one. */
+	json_next(json);
+	fputs("[\"\"", json->stream);
+    }
+    fputs(",[", json->stream);
+    json->pending = 0;
+    json->first = 1;
+    json->level++;
+}
+
+static void
+json_up(ipmi_cmdlang_json_t *json)
+{
+    if (!json->started || !json->level)
+	return;
+    if (json->pending) {
+	fputs(",null]", json->stream);
+	json->pending = 0;
+    }
+    fputs("]]", json->stream);
+    json->first = 0;
+    json->level--;
+}
+
+/* Close everything that is still open. */
+static void
+json_finish(ipmi_cmdlang_json_t *json)
+{
+    while (json->level)
+	json_up(json);
+    if (json->pending) {
+	fputs(",null]", json->stream);
+	json->pending = 0;
+    }
+    putc(']', json->stream);
+}
+
+static void
+out_json(ipmi_cmdlang_t *cmdlang, const char *name, const char *value)
+{
+    json_out(cmdlang->user_data, name, value);
+}
+
+static void
+out_json_binary(ipmi_cmdlang_t *cmdlang, const char *name,
+		const char *value, unsigned int len)
+{
+    json_out_binary(cmdlang->user_data, name, value, len);
+}
+
+static void
+down_json(ipmi_cmdlang_t *cmdlang)
+{
+    json_down(cmdlang->user_data);
+}
+
+static void
+up_json(ipmi_cmdlang_t *cmdlang)
+{
+    json_up(cmdlang->user_data);
+}
+
+void
+ipmi_cmdlang_json_setup(ipmi_cmdlang_t      *cmdlang,
+			ipmi_cmdlang_json_t *json,
+			FILE                *stream)
+{
+    memset(json, 0, sizeof(*json));
+    json->stream = stream;
+    cmdlang->user_data = json;
+    cmdlang->out = out_json;
+    cmdlang->out_binary = out_json_binary;
+    cmdlang->out_unicode = out_json_binary;
+    cmdlang->down = down_json;
+    cmdlang->up = up_json;
+}
+
+void
+ipmi_cmdlang_json_done(ipmi_cmdlang_t *cmdlang)
+{
+    ipmi_cmdlang_json_t *json = cmdlang->user_data;
+    FILE *s = json->stream;
+
+    json_start(json, "out");
+    json_finish(json);
+    if (cmdlang->err) {
+	fputs(",\"error\":{\"location\":", s);
+	json_str(s, cmdlang->location ? cmdlang->location : "");
+	fputs(",\"object\":", s);
+	json_str(s, cmdlang->objstr ? cmdlang->objstr : "");
+	fputs(",\"errstr\":", s);
+	json_str(s, cmdlang->errstr ? cmdlang->errstr : "");
+	fprintf(s, ",\"err\":%d}", cmdlang->err);
+    }
+    fputs("}\n", s);
+    json->started = 0;
+
+    if (json->evstream) {
+	fclose(json->evstream);
+	fwrite(json->evbuf, 1, json->evlen, s);
+	free(json->evbuf);
+	json->evstream = NULL;
+	json->evbuf = NULL;
+	json->evlen = 0;
+    }
+    fflush(s);
+}
+
+static void
+json_event(FILE *stream, ipmi_cmdlang_event_t *event)
+{
+    ipmi_cmdlang_json_t         ev;
+    unsigned int                level, len;
+    enum ipmi_cmdlang_out_types type;
+    char                        *name, *value;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.stream = stream;
+    json_start(&ev, "event");
+    ipmi_cmdlang_event_restart(event);
+    while (ipmi_cmdlang_event_next_field(event, &level, &type, &name, &len,
+					 &value))
+    {
+	while (ev.level < level)
+	    json_down(&ev);
+	while (ev.level > level)
+	    json_up(&ev);
+	if (type == IPMI_CMDLANG_STRING)
+	    json_out(&ev, name, value);
+	else
+	    json_out_binary(&ev, name, value, len);
+    }
+    json_finish(&ev);
+    fputs("}\n", stream);
+}
+
+void
+ipmi_cmdlang_json_event(ipmi_cmdlang_json_t  *json,
+			ipmi_cmdlang_event_t *event)
+{
+    if (!json->started) {
+	json_event(json->stream, event);
+	fflush(json->stream);
+	return;
+    }
+
+    /*
+     * A command's line is being written, hold the event until it is
+     * done so the lines don't get mixed together.
+     */
+    if (!json->evstream) {
+	json->evstream = open_memstream(&json->evbuf, &json->evlen);
+	if (!json->evstream)
+	    return;
+    }
+    json_event(json->evstream, event);
+}
@@ -61,6 +61,11 @@ typedef struct g_os_hnd_data_s
     gint      priority;
     os_vlog_t log_handler;
 
+    /* The timer source and the sorted list of running timers it owns. */
+    GSource           *timer_source;
+    GMutex            *timer_lock;
+    os_hnd_timer_id_t *timers;
+
 #ifdef HAVE_GDBM
     char      *gdbm_filename;
     GDBM_FILE gdbmf;
@@ -154,31 +159,148 @@ remove_fd(os_handler_t *handler, os_hnd_fd_id_t *fd_data)
     return 0;
 }
 
+/*
+ * All the timers for an OS handler are kept in a single list sorted
+ * by expiry time and run from one custom GSource, instead of having a
+ * separate glib timeout source for each timer.  glib only has to look
+ * at the first timer to know how long to sleep, and all the timers
+ * that have expired get run in one dispatch.
+ */
 struct os_hnd_timer_id_s
 {
-    void           *cb_data;
-    os_timed_out_t timed_out;
-    int            running;
-    os_handler_t   *handler;
-    guint          ev_id;
+    void              *cb_data;
+    os_timed_out_t    timed_out;
+    int               running;
+    os_handler_t      *handler;
+    gint64            expire; /* Monotonic time, in microseconds. */
+    os_hnd_timer_id_t *next, *prev;
 };
 
+typedef struct timer_source_s
+{
+    GSource         source;
+    g_os_hnd_data_t *info;
+} timer_source_t;
+
+/* Must be called with the timer lock held. */
+static void
+timer_unlink(g_os_hnd_data_t *info, os_hnd_timer_id_t *id)
+{
+    if (id->prev)
+	id->prev->next = id->next;
+    else
+	info->timers = id->next;
+    if (id->next)
+	id->next->prev = id->prev;
+    id->next = NULL;
+    id->prev = NULL;
+}
+
+/*
+ * Must be called with the timer lock held.  Timers with the same
+ * expiry time run in the order they were started.  Returns true if
+ * the timer went to the front of the list.
+ */
+static int
+timer_insert(g_os_hnd_data_t *info, os_hnd_timer_id_t *id)
+{
+    os_hnd_timer_id_t *prev = NULL, *curr = info->timers;
+
+    while (curr && curr->expire <= id->expire) {
+	prev = curr;
+	curr = curr->next;
+    }
+    id->prev = prev;
+    id->next = curr;
+    if (curr)
+	curr->prev = id;
+    if (prev) {
+	prev->next = id;
+	return 0;
+    }
+    info->timers = id;
+    return 1;
+}
+
 static gboolean
-timer_handler(gpointer data)
+timer_source_prepare(GSource *source, gint *timeout)
 {
-    os_hnd_timer_id_t *timer_data = (os_hnd_timer_id_t *) data;
-    /* Make a copy of this, because the handler may delete the timer
-       data. */
+    g_os_hnd_data_t *info = ((timer_source_t *) source)->info;
+    gint64          now;
+    gboolean        rv = FALSE;
+
+    g_mutex_lock(info->timer_lock);
+    if (!info->timers) {
+	*timeout = -1;
+    } else {
+	now = g_source_get_time(source);
+	if (info->timers->expire <= now) {
+	    *timeout = 0;
+	    rv = TRUE;
+	} else {
+	    *timeout = (info->timers->expire - now + 999) / 1000;
+	}
+    }
+    g_mutex_unlock(info->timer_lock);
+    return rv;
+}
+
+static gboolean
+timer_source_check(GSource *source)
+{
+    g_os_hnd_data_t *info = ((timer_source_t *) source)->info;
+    gboolean        rv;
+
+    g_mutex_lock(info->timer_lock);
+    rv = info->timers && info->timers->expire <= g_source_get_time(source);
+    g_mutex_unlock(info->timer_lock);
+    return rv;
+}
+
+static gboolean
+timer_source_dispatch(GSource     *source,
+		      GSourceFunc callback,
+		      gpointer    user_data)
+{
+    g_os_hnd_data_t   *info = ((timer_source_t *) source)->info;
+    gint64            now = g_get_monotonic_time();
+    os_hnd_timer_id_t *id;
     void              *cb_data;
     os_timed_out_t    timed_out;
 
-    timed_out = timer_data->timed_out;
-    cb_data = timer_data->cb_data;
-    timer_data->running = 0;
-    timed_out(cb_data, timer_data);
-    return FALSE;
+    /*
+     * Only run timers that had expired when we started, a handler
+     * that restarts its timer with a zero timeout will not keep us
+     * here forever.
+     */
+    for (;;) {
+	g_mutex_lock(info->timer_lock);
+	id = info->timers;
+	if (!id || id->expire > now) {
+	    g_mutex_unlock(info->timer_lock);
+	    break;
+	}
+	timer_unlink(info, id);
+	/* Make a copy of this, because the handler may delete the timer
+	   data. */
+	timed_out = id->timed_out;
+	cb_data = id->cb_data;
+	id->running = 0;
+	g_mutex_unlock(info->timer_lock);
+
+	timed_out(cb_data, id);
+    }
+
+    return TRUE;
 }
 
+static GSourceFuncs timer_source_funcs =
+{
+    .prepare = timer_source_prepare,
+    .check = timer_source_check,
+    .dispatch = timer_source_dispatch,
+};
+
 static int
 start_timer(os_handler_t      *handler, 
 	    os_hnd_timer_id_t *id,
@@ -187,32 +309,43 @@ start_timer(os_handler_t      *handler,
 	    void              *cb_data)
 {
     g_os_hnd_data_t *info = handler->internal_data;
-    guint           interval;
+    int             first;
 
-    if (id->running)
+    g_mutex_lock(info->timer_lock);
+    if (id->running) {
+	g_mutex_unlock(info->timer_lock);
 	return EBUSY;
+    }
 
     id->running = 1;
     id->cb_data = cb_data;
     id->timed_out = timed_out;
-
-    interval = (timeout->tv_sec * 1000) | ((timeout->tv_usec + 999) / 1000);
-    id->ev_id = g_timeout_add_full(info->priority,
-				   interval,
-				   timer_handler,
-				   id,
-				   NULL);
+    id->expire = (g_get_monotonic_time()
+		  + ((gint64) timeout->tv_sec * G_TIME_SPAN_SECOND)
+		  + timeout->tv_usec);
+    first = timer_insert(info, id);
+    g_mutex_unlock(info->timer_lock);
+
+    /* The main loop may be sleeping on a later timer, or none at all. */
+    if (first)
+	g_main_context_wakeup(g_source_get_context(info->timer_source));
     return 0;
 }
 
 static int
 stop_timer(os_handler_t *handler, os_hnd_timer_id_t *id)
 {
-    if (!id->running)
+    g_os_hnd_data_t *info = handler->internal_data;
+
+    g_mutex_lock(info->timer_lock);
+    if (!id->running) {
+	g_mutex_unlock(info->timer_lock);
 	return EINVAL;
+    }
 
     id->running = 0;
-    g_source_remove(id->ev_id);
+    timer_unlink(info, id);
+    g_mutex_unlock(info->timer_lock);
 
     return 0;
 }
@@ -227,8 +360,7 @@ alloc_timer(os_handler_t      *handler,
     if (!timer_data)
 	return ENOMEM;
 
-    timer_data->running = 0;
-    timer_data->timed_out = NULL;
+    memset(timer_data, 0, sizeof(*timer_data));
     timer_data->handler = handler;
 
     *id = timer_data;
@@ -628,6 +760,9 @@ free_os_handler(os_handler_t *os_hnd)
 {
     g_os_hnd_data_t *info = os_hnd->internal_data;
 
+    g_source_destroy(info->timer_source);
+    g_source_unref(info->timer_source);
+    g_mutex_free(info->timer_lock);
 #ifdef HAVE_GDBM
     g_mutex_free(info->gdbm_lock);
     if (info->gdbm_filename)
@@ -870,15 +1005,29 @@ ipmi_glib_get_os_handler(int priority)
     }
     memset(info, 0, sizeof(*info));
 
+    info->timer_lock = g_mutex_new();
+    if (!info->timer_lock) {
+	g_free(info);
+	g_free(rv);
+	return NULL;
+    }
+
 #ifdef HAVE_GDBM
     info->gdbm_lock = g_mutex_new();
     if (!info->gdbm_lock) {
-	free(info);
-	free(rv);
+	g_mutex_free(info->timer_lock);
+	g_free(info);
+	g_free(rv);
 	return NULL;
     }
 #endif
 
+    info->timer_source = g_source_new(&timer_source_funcs,
+				      sizeof(timer_source_t));
+    ((timer_source_t *) info->timer_source)->info = info;
+    g_source_set_priority(info->timer_source, priority);
+    g_source_attach(info->timer_source, NULL);
+
     info->priority = priority;
     rv->internal_data = info;
 
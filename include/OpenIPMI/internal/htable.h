@@ -0,0 +1,121 @@
+/*
+ * htable.h
+ *
+ * Resizable open-addressing hash tables of pointers.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+#ifndef _HTABLE_H
+#define _HTABLE_H
+
+/*
+ * A hash table of pointers kept in one array with linear probing.
+ * The user computes the hash value for an item (see
+ * ipmi_hash_pointer() and ipmi_hash_uint()) and passes it to every
+ * call, the table stores it with the item so it never has to call
+ * back to rehash.  The array doubles when it gets 3/4 full and halves
+ * when it gets under 1/8 full.  Items are not kept in any order, and
+ * adding or removing items moves others around, so the table must
+ * not be changed while iterating over it.  There is no locking, the
+ * user must provide that.
+ */
+
+typedef struct htable_s htable_t;
+
+/* Returns NULL on failure. */
+htable_t *alloc_htable(void);
+void free_htable(htable_t *tab);
+
+/* The number of items in the table. */
+unsigned int htable_count(htable_t *tab);
+
+/* Add an item with the given hash.  The item must not be NULL and
+   may be added more than once.  Returns 0 on failure, 1 on
+   success. */
+int htable_add(htable_t *tab, unsigned int hash, void *item);
+
+/* Remove the given item, which was added with the given hash.
+   Returns 1 if it was found and 0 if not. */
+int htable_remove(htable_t *tab, unsigned int hash, void *item);
+
+/* This should return true if the item matches, false if not. */
+typedef int (*htable_cmp_cb)(void *item, void *cb_data);
+
+/* Find an item with the given hash that cmp matches, NULL if none.
+   If cmp is NULL, cb_data is compared to the item pointers. */
+void *htable_find(htable_t *tab, unsigned int hash,
+		  htable_cmp_cb cmp, void *cb_data);
+
+/* Call the handler with each item in the table, in no particular
+   order.  The table must not be modified from the handler. */
+typedef void (*htable_iter_cb)(void *item, void *cb_data);
+void htable_iter(htable_t *tab, htable_iter_cb handler, void *cb_data);
+
+/* Like the above, but only for the items added with the given hash. */
+void htable_iter_hash(htable_t *tab, unsigned int hash,
+		      htable_iter_cb handler, void *cb_data);
+
+/* Copy up to "max" item pointers into "items" and return the number
+   copied.  Use this to walk the table with the lock released. */
+unsigned int htable_copy(htable_t *tab, void **items, unsigned int max);
+
+/* Internal data structures, DO NOT USE THESE. */
+
+typedef struct htable_entry_s
+{
+    void         *item; /* NULL if the slot is empty. */
+    unsigned int hash;
+} htable_entry_t;
+
+struct htable_s
+{
+    htable_entry_t *entries;
+    unsigned int   size; /* Always 2^n */
+    unsigned int   count;
+};
+
+#endif /* _HTABLE_H */
@@ -0,0 +1,86 @@
+/*
+ * ipmi_arena.h
+ *
+ * Chunked allocation for objects that live about as long as a domain
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _IPMI_ARENA_H
+#define _IPMI_ARENA_H
+
+#include <OpenIPMI/os_handler.h>
+#include <OpenIPMI/internal/ipmi_malloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An arena hands out objects carved from large chunks, for things
+ * like the sensors and entities read from the SDRs that are created
+ * in bulk when a domain comes up and mostly live until it goes away.
+ * Objects are still freed one at a time with ipmi_arena_free(), a
+ * chunk goes back to the allocator when everything in it has been
+ * freed, so an object that goes away early (an SDR reread, for
+ * instance) is fine, its space just isn't reused until the rest of
+ * its chunk is gone.  Releasing the arena frees all the empty chunks
+ * at once, chunks with objects still in use go when the last one is
+ * freed.
+ *
+ * Objects from a NULL arena, big objects, and everything when debug
+ * allocation is on are allocated normally, ipmi_arena_free() still
+ * has to be used to free them.
+ */
+typedef struct ipmi_arena_s ipmi_arena_t;
+
+int ipmi_arena_alloc_arena(os_handler_t *os_hnd, ipmi_arena_t **arena);
+
+/* Allocations are aligned like ipmi_mem_alloc(), and not zeroed.  If
+   the file defines IPMI_MEM_TYPE, objects that are not put in a chunk
+   are accounted to that type; the chunks are accounted to the
+   domain. */
+void *ipmi_arena_alloc_type(ipmi_arena_t *arena, int size, unsigned int type);
+#ifdef IPMI_MEM_TYPE
+#define ipmi_arena_alloc(arena, size) \
+	ipmi_arena_alloc_type(arena, size, IPMI_MEM_TYPE)
+#else
+#define ipmi_arena_alloc(arena, size) \
+	ipmi_arena_alloc_type(arena, size, IPMI_MEM_TYPE_OTHER)
+#endif
+
+void ipmi_arena_free(void *data);
+
+/* The arena can't be allocated from after this. */
+void ipmi_arena_release(ipmi_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IPMI_ARENA_H */
@@ -42,6 +42,7 @@
 #include <OpenIPMI/internal/ipmi_entity.h>
 #include <OpenIPMI/internal/ipmi_sensor.h>
 #include <OpenIPMI/internal/ipmi_control.h>
+#include <OpenIPMI/internal/ipmi_arena.h>
 
 /* Handle validation and usecounts on domains. */
 int _ipmi_domain_get(ipmi_domain_t *domain);
@@ -50,6 +51,19 @@ void _ipmi_domain_put(ipmi_domain_t *domain);
 /* Return the OS handler used by the mc. */
 os_handler_t *ipmi_domain_get_os_hnd(ipmi_domain_t *domain);
 
+/* Allocate a timer for something in the domain, on the same reactor
+   as the domain's first connection if the OS handler has them. */
+int _ipmi_domain_alloc_timer(ipmi_domain_t *domain, os_hnd_timer_id_t **id);
+
+/* The arena for objects that live as long as the domain, see
+   ipmi_arena.h.  May be NULL. */
+ipmi_arena_t *_ipmi_domain_arena(ipmi_domain_t *domain);
+
+/* Something says the MC at the IPMB address may have come or gone,
+   probe it now if the domain is doing targeted rescans (see
+   ipmi_domain_set_ipmb_full_rescan_time()). */
+void _ipmi_domain_ipmb_changed(ipmi_domain_t *domain, int channel, int addr);
+
 /* Return the entity info for the given domain. */
 ipmi_entity_info_t *ipmi_domain_get_entities(ipmi_domain_t *domain);
 
@@ -66,8 +80,18 @@ int ipmi_create_mc(ipmi_domain_t     *domain,
 		   unsigned int      addr_len,
 		   ipmi_mc_t         **new_mc);
 
+/* Take the MC out of the domain's address tables.  Must be called
+   with the domain MC lock and the MC table lock held, both are
+   released. */
 int _ipmi_remove_mc_from_domain(ipmi_domain_t *domain, ipmi_mc_t *mc);
 
+/* Lock the domain's MC address tables for write.  Lookups by address
+   only take this lock, not the domain MC lock, so anything that
+   depends on no one finding an MC must hold it.  Taken after the
+   domain MC lock and the MC lock. */
+void _ipmi_domain_mc_table_lock(ipmi_domain_t *domain);
+void _ipmi_domain_mc_table_unlock(ipmi_domain_t *domain);
+
 /* Attempt to find the MC, and if it doesn't exist create it and
    return it. */
 int _ipmi_find_or_create_mc_by_slave_addr(ipmi_domain_t *domain,
@@ -252,6 +276,10 @@ void _ipmi_domain_shutdown(void);
 /* Is the domain currently in shutdown? */
 int _ipmi_domain_in_shutdown(ipmi_domain_t *domain);
 
+/* Is the domain being closed without reporting its objects as
+   deleted?  See IPMI_DOMAIN_CLOSE_NO_CALLBACKS. */
+int _ipmi_domain_quiet_close(ipmi_domain_t *domain);
+
 /* Used as a refcount to know when the domain is completely
    operational. */
 void _ipmi_get_domain_fully_up(ipmi_domain_t *domain, char *name);
@@ -262,6 +290,104 @@ int _ipmi_domain_get_connection(ipmi_domain_t *domain,
 				int           con_num,
 				ipmi_con_t    **con);
 
+/* The most messages every connection of the domain can have
+   outstanding at once (the smallest connection window), 1 if no
+   connection says. */
+unsigned int _ipmi_domain_max_outstanding(ipmi_domain_t *domain);
+
+/* Start an MC through the domain's MC startup scheduler, which only
+   runs as many MC startups at once as _ipmi_domain_max_outstanding()
+   and runs the ones with device SDRs (has_sdrs) first.  start is
+   called when the MC may start, possibly before this returns.
+   scheduled is set if it took a slot; then
+   _ipmi_domain_mc_startup_done() must be called when the startup is
+   done.  The MC must not go away while waiting to start. */
+typedef void (*_ipmi_domain_mc_startup_cb)(ipmi_mc_t *mc, int scheduled);
+int _ipmi_domain_mc_startup(ipmi_domain_t              *domain,
+			    ipmi_mc_t                  *mc,
+			    int                        has_sdrs,
+			    _ipmi_domain_mc_startup_cb start);
+void _ipmi_domain_mc_startup_done(ipmi_domain_t *domain);
+
+/* The per-MC concurrency all the domain's connections can handle
+   (the smallest mc_concurrency of the connections), used as the
+   initial max concurrent ops of new MCs.  Always at least 1. */
+unsigned int _ipmi_domain_mc_concurrency(ipmi_domain_t *domain);
+
+/* The bring-up phases timed in the domain statistics.  The time
+   since "start" is added, in milliseconds, to the statistic for the
+   phase, see ipmi_domain_stat_iterate(). */
+#define IPMI_DOMAIN_PHASE_CONNECT	0
+#define IPMI_DOMAIN_PHASE_OEM_CHECK	1
+#define IPMI_DOMAIN_PHASE_SDR_FETCH	2
+#define IPMI_DOMAIN_PHASE_IPMB_SCAN	3
+#define IPMI_DOMAIN_PHASE_ENTITY_SENSOR	4
+#define IPMI_DOMAIN_PHASE_NUM		5
+void _ipmi_domain_phase_time(ipmi_domain_t  *domain,
+			     unsigned int   phase,
+			     struct timeval *start);
+
+/* A table of handles, so a sensor or control id can be turned into
+   the object with an index and a compare instead of finding the MC
+   and then the object in it.  The handle is kept in the id, it is
+   only a hint; the MC sequence number and the key (the type, lun and
+   number of the object) must match for the lookup to return the
+   object.  If no handle can be allocated (or the id has 0), the id is
+   found the normal way.  All of these must be called with the
+   domain's entity lock held. */
+#define IPMI_DOMAIN_MAX_HANDLES		((1 << 21) - 1)
+#define IPMI_DOMAIN_HANDLE_SENSOR	0x10000
+#define IPMI_DOMAIN_HANDLE_CONTROL	0x20000
+#define IPMI_DOMAIN_HANDLE_KEY(type, lun, num)	((type) | ((lun) << 8) | (num))
+unsigned int _ipmi_domain_handle_alloc(ipmi_domain_t *domain,
+				       void          *obj,
+				       long          seq,
+				       unsigned int  key);
+void _ipmi_domain_handle_free(ipmi_domain_t *domain, unsigned int handle);
+void *_ipmi_domain_handle_lookup(ipmi_domain_t *domain,
+				 unsigned int  handle,
+				 long          seq,
+				 unsigned int  key);
+
+/* The handler set with ipmi_domain_set_sensor_update_handler(), or
+   NULL. */
+ipmi_sensor_update_cb _ipmi_domain_get_sensor_update_handler(
+    ipmi_domain_t *domain,
+    void          **cb_data);
+
+/* Start and end a pass over SDRs and note an update inside one, see
+   ipmi_domain_set_update_batch_handler().  These do nothing if no
+   batch handler is set.  For entity changes sensor and control are
+   NULL, for sensors control is NULL and the other way around. */
+void _ipmi_domain_update_batch_start(ipmi_domain_t *domain);
+void _ipmi_domain_update_batch_end(ipmi_domain_t *domain);
+void _ipmi_domain_update_batch_note(ipmi_domain_t      *domain,
+				    enum ipmi_update_e op,
+				    ipmi_entity_t      *entity,
+				    ipmi_sensor_t      *sensor,
+				    ipmi_control_t     *control);
+
+/* Spans for the bring-up recorder, see
+   ipmi_domain_write_bringup_trace().  A span is a named piece of
+   work on a track (a line in the trace), parent is the span that had
+   to finish (or start) before this one could.  Start returns the span
+   id, or 0 if the domain is not recording, 0 may be passed to end and
+   as a parent.  The name must be a constant string, detail is
+   copied. */
+#define IPMI_SPAN_TRACK_DOMAIN		0
+#define IPMI_SPAN_TRACK_MC_BASE		0x100
+#define IPMI_SPAN_TRACK_MC(chan, addr)	(IPMI_SPAN_TRACK_MC_BASE	\
+					 + ((chan) << 8) + (addr))
+#define IPMI_SPAN_TRACK_PRESENCE	0x10000
+int _ipmi_domain_span_start(ipmi_domain_t *domain,
+			    const char    *name,
+			    const char    *detail,
+			    unsigned int  track,
+			    int           parent);
+void _ipmi_domain_span_end(ipmi_domain_t *domain, int span);
+/* The span of the running full IPMB scan, 0 if none. */
+int _ipmi_domain_scan_span(ipmi_domain_t *domain);
+
 /* Option settings. */
 int ipmi_option_SDRs(ipmi_domain_t *domain);
 int ipmi_option_SEL(ipmi_domain_t *domain);
@@ -273,6 +399,8 @@ int ipmi_option_set_sel_time(ipmi_domain_t *domain);
 int ipmi_option_activate_if_possible(ipmi_domain_t *domain);
 int ipmi_option_local_only(ipmi_domain_t *domain);
 int ipmi_option_use_cache(ipmi_domain_t *domain);
+int ipmi_option_sdr_incremental(ipmi_domain_t *domain);
+int ipmi_option_sel_cache(ipmi_domain_t *domain);
 
 void _ipmi_option_set_local_only_if_not_specified(ipmi_domain_t *domain,
 						  int           val);
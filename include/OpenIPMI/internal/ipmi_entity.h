@@ -170,6 +170,9 @@ void ipmi_entities_iterate_entities(ipmi_entity_info_t *ent,
 				    ipmi_entity_ptr_cb handler,
 				    void               *cb_data);
 
+/* Take a snapshot of the ids of the entities in the entity info. */
+int _ipmi_entities_snapshot(ipmi_entity_info_t *ents, ipmi_snapshot_t **snap);
+
 /* Scan all the entities in the container and re-detect their precence
    if a presence-modifying event has occurred.  Non-event operations
    (like adding and removing sensors) will not automatically rescan
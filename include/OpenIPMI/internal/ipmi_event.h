@@ -39,6 +39,10 @@
 /* The event code here is considered internal to OpenIPMI, normal
    users shouldn't use it. */
 
+/* Set up and free the pool of event objects. */
+int _ipmi_event_init(void);
+void _ipmi_event_shutdown(void);
+
 /* Allocate an event with the given data. */
 ipmi_event_t *ipmi_event_alloc(ipmi_mcid_t   mcid,
 			       unsigned int  record_id,
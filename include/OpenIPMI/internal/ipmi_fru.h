@@ -161,7 +161,9 @@ void _ipmi_fru_ref_nolock(ipmi_fru_t *fru);
  *
  * You can also override the function that sends the write message.
  * this function will get the data as formatted for a normal FRU
- * write.
+ * write.  Since the done callback does not say which write finished,
+ * only one write is outstanding at a time when this is overridden;
+ * the normal (NULL) handler keeps several outstanding.
  */
 typedef void (*_ipmi_fru_timestamp_cb)(ipmi_fru_t    *fru,
 				       ipmi_domain_t *domain,
@@ -58,6 +58,33 @@ int ipmi_create_global_lock(ipmi_lock_t **new_lock);
 /* Get a globally unique sequence number. */
 long ipmi_get_seq(void);
 
+/* Get the timeout for the next run of a periodic background job
+   that runs every "seconds" seconds, with the audit jitter applied.
+   "first" should be set for the first run, which is spread over a
+   wider range since it has no phase yet. */
+void _ipmi_pace_interval(os_handler_t   *os_hnd,
+			 unsigned int   seconds,
+			 int            first,
+			 struct timeval *timeout);
+
+/* Take a token from the background operation bucket.  Returns 0 if
+   the operation may go ahead, or EAGAIN with the time to wait before
+   trying again in "wait". */
+int _ipmi_pace_background(os_handler_t *os_hnd, struct timeval *wait);
+
+/* Get a shared, refcounted copy of a string.  The same contents
+   always give back the same pointer, so interned strings can be
+   compared by pointer.  The result is nil terminated (len does not
+   include the nil) and must not be modified.  Returns NULL if out of
+   memory. */
+const char *_ipmi_str_intern(const char *str, unsigned int len);
+
+/* Add a reference to an interned string, str may be NULL. */
+const char *_ipmi_str_intern_ref(const char *str);
+
+/* Release an interned string, str may be NULL. */
+void _ipmi_str_unintern(const char *str);
+
 /* The event state data structure. */
 struct ipmi_event_state_s
 {
@@ -176,6 +203,24 @@ const char *_ipmi_entity_id_name(const ipmi_entity_id_t entity_id);
 
 #include <OpenIPMI/ipmi_debug.h>
 
+/* The contents of an ipmi_snapshot_t, the ids are filled in by
+   whoever allocates it. */
+#define IPMI_SNAPSHOT_MCS	1
+#define IPMI_SNAPSHOT_ENTITIES	2
+#define IPMI_SNAPSHOT_SENSORS	3
+struct ipmi_snapshot_s
+{
+    unsigned int refcount;
+    int          kind;
+    unsigned int count;
+    union {
+	ipmi_mcid_t      mc;
+	ipmi_entity_id_t entity;
+	ipmi_sensor_id_t sensor;
+    } ids[0];
+};
+ipmi_snapshot_t *_ipmi_snapshot_alloc(int kind, unsigned int count);
+
 /* Lock/unlock the entities/mcs for the given domain. */
 void _ipmi_domain_entity_lock(ipmi_domain_t *domain);
 void _ipmi_domain_entity_unlock(ipmi_domain_t *domain);
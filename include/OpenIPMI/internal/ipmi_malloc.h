@@ -77,6 +77,82 @@ extern int __ipmi_debug_malloc;
 #define DEBUG_MALLOC	(__ipmi_debug_malloc)
 #define DEBUG_MALLOC_ENABLE() __ipmi_debug_malloc = 1
 
+/* Pooled allocation.  If enabled before the first call to
+   ipmi_malloc_init(), allocations that fit one of the pool size
+   classes are kept on per-thread free lists when freed and handed
+   back out without going to the OS handler.  Each thread caches a
+   limited number of objects per class, the rest are freed normally.
+   This is only done if the compiler supports thread-local variables,
+   and debug allocation overrides it. */
+extern int __ipmi_malloc_pools;
+#define MALLOC_POOLS_ENABLE() __ipmi_malloc_pools = 1
+
+/* Counters for a pool size class, class 0 is the smallest.  "allocs"
+   counts all allocations in the class and "hits" the ones that came
+   from a thread's cache.  "frees" counts all frees and "releases" the
+   ones that went back to the OS handler because the cache was full.
+   Returns EINVAL if the class doesn't exist and ENOSYS if pools are
+   not in use. */
+typedef struct ipmi_malloc_pool_stats_s
+{
+    unsigned int  size;
+    unsigned long allocs;
+    unsigned long hits;
+    unsigned long frees;
+    unsigned long releases;
+} ipmi_malloc_pool_stats_t;
+int ipmi_malloc_pool_stats(unsigned int size_class,
+			   ipmi_malloc_pool_stats_t *stats);
+
+/* Free everything in the calling thread's pool caches.  Threads that
+   allocate from OpenIPMI should call this before they exit, or the
+   cached objects are lost. */
+void ipmi_malloc_pool_thread_cleanup(void);
+
+/* Allocation accounting.  If enabled before the first call to
+   ipmi_malloc_init(), every allocation is tagged with the subsystem
+   that made it and per-subsystem counters are kept.  A source file
+   picks its tag by defining IPMI_MEM_TYPE to one of the values below
+   before including this file, files that don't are counted as
+   "other".  This works with pools, debug allocation overrides it. */
+#define IPMI_MEM_TYPE_OTHER	0
+#define IPMI_MEM_TYPE_DOMAIN	1
+#define IPMI_MEM_TYPE_CONN	2
+#define IPMI_MEM_TYPE_MC	3
+#define IPMI_MEM_TYPE_ENTITY	4
+#define IPMI_MEM_TYPE_SENSOR	5
+#define IPMI_MEM_TYPE_SDR	6
+#define IPMI_MEM_TYPE_SEL	7
+#define IPMI_MEM_TYPE_FRU	8
+#define IPMI_MEM_TYPE_LAN	9
+#define IPMI_MEM_TYPE_NUM	10
+
+extern int __ipmi_malloc_accounting;
+#define MALLOC_ACCOUNTING_ENABLE() __ipmi_malloc_accounting = 1
+
+void *ipmi_mem_alloc_type(int size, unsigned int type);
+
+#ifdef IPMI_MEM_TYPE
+#define ipmi_mem_alloc(size) ipmi_mem_alloc_type(size, IPMI_MEM_TYPE)
+#endif
+
+/* Counters for an allocation type.  "live_bytes" and "live_objects"
+   are what is currently allocated, "allocs", "alloc_bytes" and
+   "frees" only go up, so sample them twice to get a rate.  Returns
+   EINVAL if the type doesn't exist and ENOSYS if accounting is not
+   in use. */
+typedef struct ipmi_malloc_type_stats_s
+{
+    const char    *name;
+    unsigned long live_bytes;
+    unsigned long live_objects;
+    unsigned long allocs;
+    unsigned long alloc_bytes;
+    unsigned long frees;
+} ipmi_malloc_type_stats_t;
+int ipmi_malloc_type_stats(unsigned int type,
+			   ipmi_malloc_type_stats_t *stats);
+
 /* Used by the malloc code to generate logs.  If not set, logs will go
    nowhere. */
 extern void (*ipmi_malloc_log)(enum ipmi_log_type_e log_type,
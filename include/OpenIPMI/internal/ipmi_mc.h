@@ -38,6 +38,7 @@
 
 #include <OpenIPMI/internal/ipmi_sensor.h>
 #include <OpenIPMI/internal/ipmi_control.h>
+#include <OpenIPMI/internal/opq.h>
 
 /* Allow entities to keep information that came from an MC in the MC
    itself so that when the MC is destroyed, it can be cleaned up. */
@@ -73,6 +74,11 @@ void _ipmi_mc_startup_put(ipmi_mc_t *mc, char *caller);
    all it's for. */
 void _ipmi_mc_force_active(ipmi_mc_t *mc, int val);
 
+/* The number of stateless operations that may be run at once on one
+   of the MC's queues, from ipmi_mc_set_max_concurrent_ops() capped
+   by the connection window.  Always at least 1. */
+unsigned int _ipmi_mc_op_concurrency(ipmi_mc_t *mc);
+
 /* Get the sensors that the given MC owns. */
 ipmi_sensor_info_t *_ipmi_mc_get_sensors(ipmi_mc_t *mc);
 
@@ -152,6 +158,13 @@ void _ipmi_mc_shutdown(void);
 /* Returns EEXIST if the event is already there. */
 int _ipmi_mc_sel_event_add(ipmi_mc_t *mc, ipmi_event_t *event);
 
+/* A new event came in from the MC, so its SEL has probably changed.
+   Check the SEL soon instead of waiting for the next scan, and go
+   back to the normal scan interval.  Hints that come in before the
+   check runs all share it.  Returns 1 if a check is coming, 0 if the
+   SEL is not being scanned and the caller has to fetch it. */
+int _ipmi_mc_sel_event_hint(ipmi_mc_t *mc);
+
 int _ipmi_mc_check_oem_event_handler(ipmi_mc_t *mc, ipmi_event_t *event);
 int _ipmi_mc_check_sel_oem_event_handler(ipmi_mc_t *mc, ipmi_event_t *event);
 
@@ -181,6 +194,12 @@ int _ipmi_mc_get_device_id_data_from_rsp(ipmi_mc_t *mc, ipmi_msg_t *rsp);
    not.  Must be called with an error-free message. */
 int _ipmi_mc_device_data_compares(ipmi_mc_t *mc, ipmi_msg_t *rsp);
 
+/* Rebuild the get device id response the MC's data came from into
+   rsp_data, which must hold at least 16 bytes.  Returns the
+   length. */
+unsigned int _ipmi_mc_get_device_id_rsp(ipmi_mc_t *mc,
+					unsigned char *rsp_data);
+
 /* Called when a new MC has been added to the system, to kick of
    processing it. */
 int _ipmi_mc_handle_new(ipmi_mc_t *mc);
@@ -205,6 +224,12 @@ void _ipmi_mc_check_mc(ipmi_mc_t *mc);
 /* Create chassis conrols for an MC. */
 int _ipmi_chassis_create_controls(ipmi_mc_t *mc, unsigned char instance);
 
+/* Count how long operations wait in the given queue against the MC,
+   in the "mc_opq_waits" and "mc_opq_wait_ms" domain statistics with
+   the MC's name as the instance.  Call right after allocating the
+   queue. */
+void _ipmi_mc_track_opq_waits(ipmi_mc_t *mc, opq_t *opq);
+
 /* Generate a unique number for the MC. */
 unsigned int ipmi_mc_get_unique_nmu(ipmi_mc_t *mc);
 
@@ -101,6 +101,19 @@ int ipmi_sel_set_new_event_handler(ipmi_sel_info_t               *sel,
 				   ipmi_sel_new_event_handler_cb handler,
 				   void                          *cb_data);
 
+/* Call the handler with each undeleted event in order, without
+   taking a reference to them.  The SEL lock is held while the
+   handler runs, so the handler must not call other functions on this
+   SEL, and the event is only good until the handler returns unless
+   the handler calls ipmi_event_dup() on it.  If the handler returns
+   non-zero, the iteration stops. */
+typedef int (*ipmi_sel_iterate_events_cb)(ipmi_sel_info_t *sel,
+					  ipmi_event_t    *event,
+					  void            *cb_data);
+int ipmi_sel_iterate_events(ipmi_sel_info_t            *sel,
+			    ipmi_sel_iterate_events_cb handler,
+			    void                       *cb_data);
+
 /* Fetch all the sels.  The array size should point to a value that
    holds the number of elements in the passed in array.  The
    array_size will be set to the actual number of elements put into
@@ -110,6 +123,16 @@ int ipmi_get_all_sels(ipmi_sel_info_t *sel,
 		      int             *array_size,
 		      ipmi_event_t    **array);
 
+/* Fetch the events with a timestamp from start up to (but not
+   including) end, in timestamp order.  array_size works like
+   ipmi_get_all_sels(), except that on E2BIG it is set to the number
+   of events needed. */
+int ipmi_sel_get_events_by_time(ipmi_sel_info_t *sel,
+				ipmi_time_t     start,
+				ipmi_time_t     end,
+				int             *array_size,
+				ipmi_event_t    **array);
+
 typedef void (*ipmi_sel_op_done_cb_t)(ipmi_sel_info_t *sel,
 				      void            *cb_data,
 				      int             err);
@@ -125,6 +148,17 @@ int ipmi_sel_del_event_by_recid(ipmi_sel_info_t       *sel,
 				ipmi_sel_op_done_cb_t handler,
 				void                  *cb_data);
 
+/* Delete a set of events by record id as one operation.  It uses one
+   reservation (getting a new one only if it is lost) and sends the
+   deletes as fast as the connection allows.  The handler is called
+   once when all are done with the first error seen, if any.  Record
+   ids that are not in the SEL are not an error. */
+int ipmi_sel_del_events_by_recid(ipmi_sel_info_t       *sel,
+				 const unsigned int    *record_ids,
+				 unsigned int          count,
+				 ipmi_sel_op_done_cb_t handler,
+				 void                  *cb_data);
+
 /* Clear all events in the SEL, but only if the last event in the SEL
    matches "last_event".  If the clear operation fails or cannot be
    done because the event doesn't match up, then an error is returned.
@@ -149,6 +149,18 @@ int ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
 			       double            val,
 			       int               *result);
 
+/* Convert count raw values, raw[i] for sensors[i], into results[i].
+   If errs is not NULL, errs[i] is set to the error converting that
+   value (or 0), otherwise a failed conversion leaves its result
+   alone.  Returns the first error, or 0 if all conversions worked.
+   The sensors may belong to different MCs, but the caller must hold
+   the lock for each of them. */
+int ipmi_sensor_convert_from_raw_batch(ipmi_sensor_t      **sensors,
+				       const int          *raw,
+				       double             *results,
+				       int                *errs,
+				       unsigned int       count);
+
 /* These calls allow OEM code to set up a sensor. */
 void ipmi_sensor_set_owner(ipmi_sensor_t *sensor, int owner);
 void ipmi_sensor_set_channel(ipmi_sensor_t *sensor, int channel);
@@ -453,6 +465,16 @@ int ipmi_sensor_id_add_opq(ipmi_sensor_id_t      sensor_id,
 			   ipmi_sensor_op_info_t *info,
 			   void                  *cb_data);
 
+/* Like ipmi_sensor_add_opq(), but for operations that don't change
+   the sensor and don't care what else is running, like reading it.
+   Up to the MC's concurrent op limit of these may run at once; other
+   operations still wait for them and run alone.  The operation must
+   still call ipmi_sensor_opq_done() when it finishes. */
+int ipmi_sensor_add_opq_concurrent(ipmi_sensor_t         *sensor,
+				   ipmi_sensor_op_cb     handler,
+				   ipmi_sensor_op_info_t *info,
+				   void                  *cb_data);
+
 /* When an operation is completed (even if it fails), this *MUST* be
    called to cause the next operation to run. */
 void ipmi_sensor_opq_done(ipmi_sensor_t *sensor);
@@ -25,6 +25,8 @@
 
 /* Do a hash on a pointer value. */
 unsigned int ipmi_hash_pointer(void *);
+/* Do a hash on an integer value. */
+unsigned int ipmi_hash_uint(unsigned int val);
 
 typedef void (*ipmi_ifru_cb)(ipmi_domain_t *domain, ipmi_fru_t *fru,
 			     int err, void *cb_data);
@@ -0,0 +1,174 @@
+/*
+ * ivec.h
+ *
+ * Growable arrays with list-like iterators.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+#ifndef _IVEC_H
+#define _IVEC_H
+
+/*
+ * A vector of pointers that works like an ilist, but keeps the items
+ * in one array so searching and iterating don't chase pointers and
+ * adding an item doesn't allocate once the array is big enough.
+ * Inserting or deleting anywhere but the end moves the items after
+ * it, which is cheap for the short lists this is used for.  The
+ * iterator calls behave like the ilist ones: an iterator is either on
+ * an item or "unpositioned", next and prev return false and don't
+ * move at the ends, and delete moves to the next item.  Unlike an
+ * ilist, an iterator holds an index, so adding or removing items
+ * before it other than through the iterator itself moves it to a
+ * different item.
+ */
+
+typedef struct ivec_s ivec_t;
+typedef struct ivec_iter_s ivec_iter_t;
+
+/* Returns NULL on failure. */
+ivec_t *alloc_ivec(void);
+void free_ivec(ivec_t *vec);
+
+/* Make sure the vector can hold "count" items without allocating, so
+   adds up to that size can't fail.  Returns 0 on failure, 1 on
+   success. */
+int ivec_reserve(ivec_t *vec, unsigned int count);
+
+/* Returns true if the vector is empty, false if not. */
+int ivec_empty(ivec_t *vec);
+
+/* The number of items in the vector. */
+unsigned int ivec_count(ivec_t *vec);
+
+/* Return false on failure, true on success.  Adding before or after
+   an iterator leaves it on the same item.  Adding before an
+   unpositioned iterator adds at the tail, after adds at the head,
+   like the ilist calls. */
+int ivec_add_head(ivec_t *vec, void *item);
+int ivec_add_tail(ivec_t *vec, void *item);
+int ivec_add_before(ivec_iter_t *iter, void *item);
+int ivec_add_after(ivec_iter_t *iter, void *item);
+
+/* Position the iterator.  Return false on failure (empty vector or at
+   the end), true on success. */
+int ivec_first(ivec_iter_t *iter);
+int ivec_last(ivec_iter_t *iter);
+int ivec_next(ivec_iter_t *iter);
+int ivec_prev(ivec_iter_t *iter);
+
+/* Remove the first or last item and return it, NULL if the vector is
+   empty. */
+void *ivec_remove_first(ivec_t *vec);
+void *ivec_remove_last(ivec_t *vec);
+
+/* Direct access by index, for vectors kept sorted by the user.
+   ivec_get_at() and ivec_remove_at() return NULL if pos is past the
+   end.  ivec_add_at() adds at the tail if pos is past the end and
+   returns false on failure, true on success. */
+void *ivec_get_at(ivec_t *vec, unsigned int pos);
+int ivec_add_at(ivec_t *vec, unsigned int pos, void *item);
+void *ivec_remove_at(ivec_t *vec, unsigned int pos);
+
+/* Remove a given item from the vector, if it is there.  Return 1 if
+   it was found and 0 if it was not found. */
+int ivec_remove_item_from_list(ivec_t *vec, void *item);
+
+/* Returns failue (false) if unpositioned. */
+int ivec_delete(ivec_iter_t *iter); /* Position on next element after del */
+
+/* Set unpositioned.  Next will go to the first item, prev to the last
+   item. */
+void ivec_unpositioned(ivec_iter_t *iter);
+
+/* Returns NULL if unpositioned or vector empty. */
+void *ivec_get(ivec_iter_t *iter);
+
+/* This should return true if the item matches, false if not. */
+typedef int (*ivec_search_cb)(void *item, void *cb_data);
+
+/* Search forward (starting at the next item) for something.  Returns
+   NULL if not found, the item if found.  iter will be positioned on
+   the item, too.  To search from the beginning, set the iterator to
+   the "unpositioined" position. */
+void *ivec_search_iter(ivec_iter_t *iter, ivec_search_cb cmp, void *cb_data);
+
+/* Search from the beginning, but without an iterator.  This will
+   return the first item found. */
+void *ivec_search(ivec_t *vec, ivec_search_cb cmp, void *cb_data);
+
+/* Called with an iterator positioned on the item. */
+typedef void (*ivec_iter_cb)(ivec_iter_t *iter, void *item, void *cb_data);
+
+/* Call the given handler for each item in the vector.  You may delete
+   the current item the iterator references while this is happening,
+   but no other items, and you may not add items. */
+void ivec_iter(ivec_t *vec, ivec_iter_cb handler, void *cb_data);
+
+/* Like the above, but run the vector backwards. */
+void ivec_iter_rev(ivec_t *vec, ivec_iter_cb handler, void *cb_data);
+
+/* Initialize a statically declared iterator, it will be positioned
+   on the first item. */
+void ivec_init_iter(ivec_iter_t *iter, ivec_t *vec);
+
+/* Internal data structures, DO NOT USE THESE. */
+
+struct ivec_s
+{
+    void         **items;
+    unsigned int len;
+    unsigned int size;
+};
+
+struct ivec_iter_s
+{
+    ivec_t *vec;
+    int    pos; /* -1 if unpositioned */
+    int    deleted;
+};
+
+#endif /* _IVEC_H */
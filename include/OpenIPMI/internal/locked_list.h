@@ -92,7 +92,9 @@ int locked_list_remove(locked_list_t *ll, void *item, void *item2);
 
 /* Iterate over the items of the list.  The prefunc version has a
    function that can be called before the lock is removed.  This allows
-   the refcount on an object to be incremented or whatnot. */
+   the refcount on an object to be incremented or whatnot.
+   locked_list_iterate() doesn't take the lock at all, only adds and
+   removes do, so it is cheap for lists that rarely change. */
 void locked_list_iterate(locked_list_t          *ll,
 			 locked_list_handler_cb handler,
 			 void                   *cb_data);
@@ -66,18 +66,41 @@ void opq_destroy(opq_t *opq);
    on success, 0 on failure, or -1 if it would have been queued. */
 int opq_new_op(opq_t *opq, opq_handler_cb handler, void *cb_data, int nowait);
 
+/* Normally one operation runs at a time.  This allows up to "max"
+   operations added with opq_new_op_concurrent() to run at the same
+   time.  Every other operation depends on the ones before it, it
+   waits for everything running to finish and nothing else starts
+   until it is done. */
+void opq_set_max_running(opq_t *opq, unsigned int max);
+
+/* Like opq_new_op(), but the operation does not depend on other
+   concurrent operations, so it runs as soon as nothing it depends on
+   is queued or running and fewer than the maximum are running.  Each
+   concurrent operation must call opq_op_done() when it is done.
+   These run at normal priority, cannot yield and cannot have done
+   handlers. */
+int opq_new_op_concurrent(opq_t *opq, opq_handler_cb handler, void *cb_data,
+			  int nowait);
+
 typedef struct opq_elem_s opq_elem_t;
 opq_elem_t *opq_alloc_elem(void);
 void opq_free_elem(opq_elem_t *elem);
 
-/* Like opq_new_op, but allows the head or tail to be specified.  The
-   interface is open to support real priorities, but there's no
-   requirement for that yet.  Also allows an opq_elem_t to be passed
-   in; then the operation cannot fail.  Note that if this succeeds,
-   you do *not* need to free the elem, and the elem must be allocated
-   with opq_alloc_elem(). */
-#define OPQ_ADD_HEAD	100
-#define OPQ_ADD_TAIL	0
+/* Like opq_new_op, but allows a priority to be specified.  Queued
+   operations run highest priority first, and in order within a
+   priority.  OPQ_ADD_HEAD puts the operation ahead of everything
+   queued, OPQ_ADD_TAIL is the normal priority that opq_new_op() and
+   opq_new_op_with_done() use.  Use OPQ_PRIO_INTERACTIVE for things a
+   user is waiting on and OPQ_PRIO_BACKGROUND for bulk operations that
+   can let those go first, see opq_op_yield().  Also allows an
+   opq_elem_t to be passed in; then the operation cannot fail.  Note
+   that if this succeeds, you do *not* need to free the elem, and the
+   elem must be allocated with opq_alloc_elem(). */
+#define OPQ_ADD_HEAD		100
+#define OPQ_PRIO_INTERACTIVE	10
+#define OPQ_ADD_TAIL		0
+#define OPQ_PRIO_NORMAL		OPQ_ADD_TAIL
+#define OPQ_PRIO_BACKGROUND	-10
 int opq_new_op_prio(opq_t *opq, opq_handler_cb handler, void *cb_data,
 		    int nowait, int prio, opq_elem_t *elem);
 
@@ -109,6 +132,31 @@ void opq_add_block(opq_t *opq);
    operation to run, if there is one. */
 void opq_op_done(opq_t *opq);
 
+/* Returns true if an operation with a higher priority than the
+   running one is waiting. */
+int opq_preempt_pending(opq_t *opq);
+
+/* Called from a running operation between the steps of a long
+   operation.  If an operation with a higher priority is waiting, this
+   queues the handler to continue the current operation at the front
+   of its priority, runs the waiting operations, and returns true; the
+   caller must return without doing anything more, its handler will
+   be called when it is its turn again.  The done handler of the
+   current operation, if any, is kept until the operation finishes.
+   Returns false if the caller should just keep going. */
+int opq_op_yield(opq_t *opq, opq_handler_cb handler, void *cb_data);
+
+/* Report how long operations wait in the queue.  When an operation
+   that had to be queued starts, handler is called with the number of
+   milliseconds it waited.  When the queue is destroyed free_cb, if
+   not NULL, is called with the cb_data.  This must be set before
+   anything is queued. */
+typedef void (*opq_wait_cb)(void *cb_data, unsigned int wait_ms);
+void opq_set_wait_handler(opq_t       *opq,
+			  opq_wait_cb handler,
+			  void        (*free_cb)(void *cb_data),
+			  void        *cb_data);
+
 /* Returns true if the queue has current working stuff, false if not. */
 int opq_stuff_in_progress(opq_t *opq);
 
@@ -0,0 +1,135 @@
+/*
+ * ipmi_batch.h
+ *
+ * Run a set of IPMI operations across a domain as one batch
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _IPMI_BATCH_H
+#define _IPMI_BATCH_H
+
+#include <OpenIPMI/ipmi_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A batch is a set of items, each one either an IPMI command sent to
+ * an MC with ipmi_mc_send_command() or an operation the user starts,
+ * that is run as one operation with a single completion.  The items
+ * are grouped by their MC and started going around the MCs, with as
+ * many outstanding on each MC as the MC allows and as many overall as
+ * the batch window (by default the domain's outstanding message
+ * limit).  Within an MC, items are started in index order.
+ *
+ * Allocate a batch with ipmi_batch_alloc() (with the domain lock
+ * held), fill in every item with ipmi_batch_set_cmd() or
+ * ipmi_batch_set_mc(), then ipmi_batch_start() it.  The batch is
+ * freed after done returns.
+ */
+typedef struct ipmi_batch_s ipmi_batch_t;
+
+/* Start item idx, which was set with ipmi_batch_set_mc().  Return an
+   error if nothing was started, the item then finishes with that
+   error.  Otherwise ipmi_batch_item_done() must be called for the
+   item when it finishes, possibly before this returns. */
+typedef int (*ipmi_batch_start_cb)(ipmi_batch_t *batch,
+				   unsigned int idx,
+				   void         *cb_data);
+
+/* Item idx has finished.  For a command item that got a response,
+   err is 0 and rsp is the response; the completion code is in
+   rsp->data[0].  Otherwise rsp is NULL and err is set if the item
+   failed. */
+typedef void (*ipmi_batch_item_cb)(ipmi_batch_t *batch,
+				   unsigned int idx,
+				   int          err,
+				   ipmi_msg_t   *rsp,
+				   void         *cb_data);
+
+/* Every item has finished.  errs is the number of items that failed,
+   including commands with a non-zero completion code.  domain is
+   NULL if the domain went away. */
+typedef void (*ipmi_batch_done_cb)(ipmi_domain_t *domain,
+				   ipmi_batch_t  *batch,
+				   unsigned int  errs,
+				   void          *cb_data);
+
+/* start may be NULL if every item is a command, item_done may be
+   NULL if the per-item results are not needed. */
+int ipmi_batch_alloc(ipmi_domain_t       *domain,
+		     unsigned int        count,
+		     ipmi_batch_start_cb start,
+		     ipmi_batch_item_cb  item_done,
+		     ipmi_batch_done_cb  done,
+		     void                *cb_data,
+		     ipmi_batch_t        **batch);
+
+/* Free a batch that has not been started. */
+void ipmi_batch_free(ipmi_batch_t *batch);
+
+/* Make item idx the given command to the given MC.  The message data
+   is copied. */
+int ipmi_batch_set_cmd(ipmi_batch_t     *batch,
+		       unsigned int     idx,
+		       ipmi_mcid_t      mc_id,
+		       unsigned int     lun,
+		       const ipmi_msg_t *msg);
+
+/* Make item idx an operation on the given MC, started with the start
+   callback. */
+int ipmi_batch_set_mc(ipmi_batch_t *batch,
+		      unsigned int idx,
+		      ipmi_mcid_t  mc_id);
+
+/* Set the most items that may be outstanding at once across all the
+   MCs, 0 to use the domain's limit. */
+void ipmi_batch_set_window(ipmi_batch_t *batch, unsigned int window);
+
+/* Resend a command item up to retries more times if it comes back
+   with a timeout or node busy completion code.  The default is 0.
+   Only use this for commands without side effects. */
+void ipmi_batch_set_retries(ipmi_batch_t *batch, unsigned int retries);
+
+/* Start running the batch.  done is always called, possibly before
+   this returns. */
+void ipmi_batch_start(ipmi_batch_t *batch);
+
+/* Report that a started item has finished. */
+void ipmi_batch_item_done(ipmi_batch_t *batch, unsigned int idx, int err);
+
+unsigned int ipmi_batch_get_count(ipmi_batch_t *batch);
+void *ipmi_batch_get_cb_data(ipmi_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IPMI_BATCH_H */
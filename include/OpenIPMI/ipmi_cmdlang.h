@@ -34,6 +34,7 @@
 #ifndef __IPMI_CMDLANG_H
 #define __IPMI_CMDLANG_H
 
+#include <stdio.h>
 #include <OpenIPMI/selector.h>
 #include <OpenIPMI/ipmi_bits.h>
 #include <OpenIPMI/ipmi_types.h>
@@ -352,6 +353,49 @@ void ipmi_cmdlang_global_err(char *objstr,
 /* Supplied by the user to report events. */
 void ipmi_cmdlang_report_event(ipmi_cmdlang_event_t *event);
 
+/*
+ * JSON output.  ipmi_cmdlang_json_setup() points the cmdlang's
+ * user_data at the json structure and sets its output functions.
+ * Output is written as it is generated, and each command's output is
+ * one line:
+ *
+ *   {"out":[...]}
+ *
+ * with ,"error":{"location":...,"object":...,"errstr":...,"err":n}
+ * added before the closing brace if the command failed.  Each output
+ * is a two element array, ["name","value"], ["name",null] if it has
+ * no value, ["name",[1,2,...]] for binary and unicode data, or
+ * ["name",[...]] if there is nested output under the name.  The
+ * cmdlang's done function must call ipmi_cmdlang_json_done() to
+ * finish the line.  Events given to ipmi_cmdlang_json_event() are
+ * written the same way as {"event":[...]} lines, after the current
+ * command's line if one is being written.  If tag is set after
+ * ipmi_cmdlang_json_setup(), a
+ * "tag":"<tag>" member is put first in each command's line so
+ * commands run at the same time can be told apart.
+ */
+typedef struct ipmi_cmdlang_json_s
+{
+    FILE         *stream;
+    const char   *tag;
+
+    /* Internal state. */
+    int          started;
+    int          first;
+    int          pending;
+    unsigned int level;
+    FILE         *evstream;
+    char         *evbuf;
+    size_t       evlen;
+} ipmi_cmdlang_json_t;
+
+void ipmi_cmdlang_json_setup(ipmi_cmdlang_t      *cmdlang,
+			     ipmi_cmdlang_json_t *json,
+			     FILE                *stream);
+void ipmi_cmdlang_json_done(ipmi_cmdlang_t *cmdlang);
+void ipmi_cmdlang_json_event(ipmi_cmdlang_json_t  *json,
+			     ipmi_cmdlang_event_t *event);
+
 /* In callbacks, you must use these to lock the cmd_info structure. */
 void ipmi_cmdlang_lock(ipmi_cmd_info_t *info);
 void ipmi_cmdlang_unlock(ipmi_cmd_info_t *info);
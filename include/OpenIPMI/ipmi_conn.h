@@ -181,6 +181,14 @@ typedef struct ipmi_con_option_s
    this is ignored.*/
 #define IPMI_CON_MSG_OPTION_SIDE_EFFECTS	3
 
+/* The response is useless after this many milliseconds (set by ival,
+   0 for no deadline, the default).  The connection will not resend
+   the command once a response could not come back in time, and will
+   drop it from its queue if it has not been sent by then; either way
+   the response is an IPMI_TIMEOUT_CC error.  If not implemented,
+   this is ignored. */
+#define IPMI_CON_MSG_OPTION_DEADLINE		4
+
 
 /* The data structure representing a connection.  The low-level handler
    fills this out then calls ipmi_init_con() with the connection. */
@@ -414,6 +422,33 @@ struct ipmi_con_s
        not long enough to hold it. */
     int (*get_port_info)(ipmi_con_t *ipmi, unsigned int port,
 			 char *info, int *info_len);
+
+    /* Free message items kept by the connection, set up by
+       ipmi_con_msg_cache_init().  Only the message item code should
+       touch these. */
+    os_hnd_lock_t *msgi_lock;
+    ipmi_msgi_t   *msgi_free;
+    unsigned int  msgi_free_count;
+    unsigned int  msgi_max;
+
+    /* How many stateless operations the connection is happy to have
+       running at once against one MC, used as the default for
+       ipmi_mc_set_max_concurrent_ops() on MCs the domain creates.
+       Zero (the default) means one at a time. */
+    unsigned int  mc_concurrency;
+
+    /* Command latency histograms, see ipmi_con_set_latency_tracking().
+       NULL until tracking is first turned on. */
+    struct ipmi_con_lat_table_s *latency;
+
+    /* Set when the domain is closed with
+       IPMI_DOMAIN_CLOSE_NO_SESSION_CLOSE, the connection should not
+       tell the remote end it is closing the session. */
+    int skip_close_session;
+
+    /* Returns the OS handler reactor the connection's I/O and timers
+       run on, or -1 if it isn't tied to one.  May be NULL. */
+    int (*get_reactor)(ipmi_con_t *ipmi);
 };
 
 #define IPMI_CONN_NAME(c) (c->name ? c->name : "")
@@ -435,6 +470,16 @@ int ipmi_handle_snmp_trap_data(const void          *src_addr,
 			       const unsigned char *data,
 			       unsigned int        data_len);
 
+/* Normally a trap just causes the SEL of the MC it came from to be
+   checked, since the trap data can't be reliably matched to the SEL.
+   If this is turned on, a trap that has the event generator, sensor
+   number and timestamp is turned into an event and delivered
+   directly.  The record id is taken from the trap's sequence number
+   and the LUN is assumed to be zero, so only turn this on if the
+   BMCs work that way.  Off by default. */
+void ipmi_set_snmp_trap_decode(int decode);
+int ipmi_get_snmp_trap_decode(void);
+
 /* These calls deal with OEM-type handlers for connections.  Certain
    connections can be detected with special means (beyond just the
    manufacturer and product id) and this allows handlers for these
@@ -487,6 +532,21 @@ ipmi_msgi_t *ipmi_alloc_msg_item(void);
 void ipmi_free_msg_item(ipmi_msgi_t *item);
 void *ipmi_alloc_msg_item_data(unsigned int size);
 void ipmi_free_msg_item_data(void *data);
+
+/* Per-connection message items.  ipmi_con_msg_cache_init() allocates
+   "count" message items up front (generally the most messages the
+   connection can have outstanding) and keeps up to that many freed
+   items around, so the send and response paths don't have to go to
+   the heap.  The items are normal message items and may be freed
+   with ipmi_free_msg_item(), they just don't go back to the cache
+   then.  ipmi_con_alloc_msg_item() and ipmi_con_free_msg_item() work
+   like the normal calls if the cache is not set up or ipmi is NULL.
+   The connection code should call ipmi_con_msg_cache_cleanup() when
+   it frees the connection. */
+int ipmi_con_msg_cache_init(ipmi_con_t *ipmi, unsigned int count);
+void ipmi_con_msg_cache_cleanup(ipmi_con_t *ipmi);
+ipmi_msgi_t *ipmi_con_alloc_msg_item(ipmi_con_t *ipmi);
+void ipmi_con_free_msg_item(ipmi_con_t *ipmi, ipmi_msgi_t *item);
 /* Move the data from the old message item to the new one, NULL-ing
    out the old item's data.  This will free the new_item's original
    data if necessary.  This will *not* copy the data items, just the
@@ -536,6 +596,73 @@ void ipmi_con_attr_put(ipmi_con_attr_t *attr);
 int ipmi_con_attr_init(ipmi_con_t *con);
 void ipmi_con_attr_cleanup(ipmi_con_t *con);
 
+/*
+ * Command latency histograms.  If tracking is turned on for a
+ * connection, the connection keeps a histogram of the response times
+ * for each netfn/cmd it sends, along with the number of responses,
+ * resends and timeouts.  The buckets are log-linear, with
+ * IPMI_CON_LAT_SUB_BUCKETS buckets per power of two, so the bucket a
+ * time falls in is within 1/IPMI_CON_LAT_SUB_BUCKETS of it, from 1
+ * microsecond up to over an hour.  Times are in microseconds.
+ *
+ * Turning tracking off stops recording, but keeps what has been
+ * recorded until the connection goes away.  The connections that
+ * support this are LAN and SMI; for SMI the driver does any resends,
+ * so those are not counted.
+ */
+#define IPMI_CON_LAT_SUB_BITS		3
+#define IPMI_CON_LAT_SUB_BUCKETS	(1 << IPMI_CON_LAT_SUB_BITS)
+#define IPMI_CON_LAT_BUCKETS		((32 - IPMI_CON_LAT_SUB_BITS + 1) \
+					 * IPMI_CON_LAT_SUB_BUCKETS)
+
+typedef struct ipmi_con_latency_s
+{
+    unsigned char      netfn;
+    unsigned char      cmd;
+    unsigned long      count;		/* Responses timed */
+    unsigned long      resends;
+    unsigned long      timeouts;
+    unsigned long long total_usec;
+    unsigned long      min_usec;
+    unsigned long      max_usec;
+    unsigned long      buckets[IPMI_CON_LAT_BUCKETS];
+} ipmi_con_latency_t;
+
+int ipmi_con_set_latency_tracking(ipmi_con_t *ipmi, int enable);
+int ipmi_con_get_latency_tracking(ipmi_con_t *ipmi);
+
+/* Call handler with a copy of the histogram of every command the
+   connection has seen.  If reset is true, the histograms are cleared
+   at the same time.  handler may be NULL to just reset them.  The
+   handler is not called with any connection locks held. */
+typedef void (*ipmi_con_latency_cb)(ipmi_con_t               *ipmi,
+				    const ipmi_con_latency_t *lat,
+				    void                     *cb_data);
+int ipmi_con_latency_snapshot(ipmi_con_t          *ipmi,
+			      int                 reset,
+			      ipmi_con_latency_cb handler,
+			      void                *cb_data);
+
+/* The range of times (inclusive) that fall in a bucket, and the
+   approximate pct percentile (0-100) of a histogram, which is the
+   top of the bucket it falls in. */
+unsigned long ipmi_con_latency_bucket_low(unsigned int bucket);
+unsigned long ipmi_con_latency_bucket_high(unsigned int bucket);
+unsigned long ipmi_con_latency_percentile(const ipmi_con_latency_t *lat,
+					  unsigned int             pct);
+
+/* For connection code.  Record a response (or a timeout if timed_out
+   is set) to a command, this does nothing if tracking is off.
+   ipmi_con_latency_cleanup() must be called when the connection is
+   freed. */
+void ipmi_con_latency_add(ipmi_con_t    *ipmi,
+			  unsigned char netfn,
+			  unsigned char cmd,
+			  unsigned long usec,
+			  unsigned int  resends,
+			  int           timed_out);
+void ipmi_con_latency_cleanup(ipmi_con_t *ipmi);
+
 #ifdef __cplusplus
 }
 #endif
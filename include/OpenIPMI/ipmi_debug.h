@@ -111,6 +111,78 @@ void ipmi_report_lock_error(os_handler_t *handler, char *str);
 #define IPMI_REPORT_LOCK_ERROR(handler, str) do {} while (0)
 #endif
 
+/*
+ * Message lifecycle trace points.  These are meant to find where the
+ * time goes without the cost of the text logs above.  A single
+ * handler may be registered with ipmi_trace_set_handler(), it is
+ * called for the points whose bits are set in the mask.  When a point
+ * is off the cost is a test of a global variable.
+ *
+ * The handler is called in whatever context the point is hit, often
+ * with connection locks held, so it must be quick and must not call
+ * back into OpenIPMI.  It should take its own timestamps.  Changing
+ * the handler is not synchronized with calls to the old one; turn
+ * the points off and wait a bit before freeing anything the old
+ * handler uses.
+ */
+enum ipmi_trace_point_e {
+    IPMI_TRACE_MSG_SEND = 0,	/* A message was sent by a connection. */
+    IPMI_TRACE_MSG_RESEND,	/* The connection resent a message. */
+    IPMI_TRACE_MSG_RECV,	/* The response to a message came in. */
+    IPMI_TRACE_MSG_TIMEOUT,	/* A message ran out of retries. */
+    IPMI_TRACE_RSP_CB_START,	/* Calling a response handler. */
+    IPMI_TRACE_RSP_CB_DONE,	/* The response handler returned. */
+    IPMI_TRACE_OPQ_ENQUEUE,	/* An operation had to wait in a queue. */
+    IPMI_TRACE_OPQ_START,	/* An operation's handler is called. */
+    IPMI_TRACE_OPQ_DONE,	/* The running operation finished. */
+    IPMI_TRACE_NUM_POINTS
+};
+#define IPMI_TRACE_BIT(point)	(1 << (point))
+#define IPMI_TRACE_ALL		((1 << IPMI_TRACE_NUM_POINTS) - 1)
+
+typedef struct ipmi_trace_info_s
+{
+    enum ipmi_trace_point_e point;
+
+    /* The connection (an ipmi_con_t) for message points, otherwise
+       NULL. */
+    void         *con;
+
+    /* The operation queue for the opq points, otherwise NULL. */
+    void         *opq;
+
+    /* Ties together the points of one message or operation.  For
+       messages this is the connection's internal message tracking
+       (sequence table entry or pending command), for response
+       callbacks it is the message item, and for the opq it is the
+       handler data of the operation (NULL for OPQ_DONE). */
+    const void   *id;
+
+    /* The LAN sequence number for LAN messages, otherwise 0. */
+    unsigned int seq;
+
+    /* The message, or -1 if there isn't one. */
+    int          netfn;
+    int          cmd;
+} ipmi_trace_info_t;
+
+typedef void (*ipmi_trace_cb)(const ipmi_trace_info_t *info, void *cb_data);
+
+/* Set the handler and the points (IPMI_TRACE_BIT()s) it is called
+   for.  A zero mask or NULL handler turns tracing off. */
+void ipmi_trace_set_handler(unsigned int  mask,
+			    ipmi_trace_cb handler,
+			    void          *cb_data);
+
+extern unsigned int __ipmi_trace_mask;
+void __ipmi_trace(enum ipmi_trace_point_e point, void *con, void *opq,
+		  const void *id, unsigned int seq, int netfn, int cmd);
+#define IPMI_TRACE(point, con, opq, id, seq, netfn, cmd) \
+	do {								\
+	    if (__ipmi_trace_mask & IPMI_TRACE_BIT(point))		\
+		__ipmi_trace(point, con, opq, id, seq, netfn, cmd);	\
+	} while (0)
+
 extern int __ipmi_debug_locks;
 #define DEBUG_LOCKS	(__ipmi_debug_locks)
 #define DEBUG_LOCKS_ENABLE() __ipmi_debug_locks = 1
@@ -449,6 +449,84 @@ int ipmi_fru_get_product_info_custom(ipmi_fru_t   *fru,
 				     char         *str,
 				     unsigned int *strlen);
 
+/* Zero-copy versions of the string getters above.  These return a
+   pointer to the decoded string held in the FRU and its length, which
+   does not include a nil; ASCII strings are not nil terminated.  The
+   pointer is good until the field is changed or the FRU is freed, so
+   the user must hold a reference to the FRU and not change it while
+   using the string.  type may be NULL. */
+int ipmi_fru_get_chassis_info_part_number_ref(ipmi_fru_t           *fru,
+					      enum ipmi_str_type_e *type,
+					      const char           **str,
+					      unsigned int         *strlen);
+int ipmi_fru_get_chassis_info_serial_number_ref(ipmi_fru_t           *fru,
+						enum ipmi_str_type_e *type,
+						const char           **str,
+						unsigned int         *strlen);
+int ipmi_fru_get_chassis_info_custom_ref(ipmi_fru_t           *fru,
+					 unsigned int         num,
+					 enum ipmi_str_type_e *type,
+					 const char           **str,
+					 unsigned int         *strlen);
+int ipmi_fru_get_board_info_board_manufacturer_ref(ipmi_fru_t           *fru,
+						   enum ipmi_str_type_e *type,
+						   const char           **str,
+						   unsigned int         *strlen);
+int ipmi_fru_get_board_info_board_product_name_ref(ipmi_fru_t           *fru,
+						   enum ipmi_str_type_e *type,
+						   const char           **str,
+						   unsigned int         *strlen);
+int ipmi_fru_get_board_info_board_serial_number_ref(ipmi_fru_t           *fru,
+						    enum ipmi_str_type_e *type,
+						    const char           **str,
+						    unsigned int         *strlen);
+int ipmi_fru_get_board_info_board_part_number_ref(ipmi_fru_t           *fru,
+						  enum ipmi_str_type_e *type,
+						  const char           **str,
+						  unsigned int         *strlen);
+int ipmi_fru_get_board_info_fru_file_id_ref(ipmi_fru_t           *fru,
+					    enum ipmi_str_type_e *type,
+					    const char           **str,
+					    unsigned int         *strlen);
+int ipmi_fru_get_board_info_custom_ref(ipmi_fru_t           *fru,
+				       unsigned int         num,
+				       enum ipmi_str_type_e *type,
+				       const char           **str,
+				       unsigned int         *strlen);
+int ipmi_fru_get_product_info_manufacturer_name_ref(ipmi_fru_t           *fru,
+						    enum ipmi_str_type_e *type,
+						    const char           **str,
+						    unsigned int         *strlen);
+int ipmi_fru_get_product_info_product_name_ref(ipmi_fru_t           *fru,
+					       enum ipmi_str_type_e *type,
+					       const char           **str,
+					       unsigned int         *strlen);
+int ipmi_fru_get_product_info_product_part_model_number_ref(ipmi_fru_t           *fru,
+							    enum ipmi_str_type_e *type,
+							    const char           **str,
+							    unsigned int         *strlen);
+int ipmi_fru_get_product_info_product_version_ref(ipmi_fru_t           *fru,
+						  enum ipmi_str_type_e *type,
+						  const char           **str,
+						  unsigned int         *strlen);
+int ipmi_fru_get_product_info_product_serial_number_ref(ipmi_fru_t           *fru,
+							enum ipmi_str_type_e *type,
+							const char           **str,
+							unsigned int         *strlen);
+int ipmi_fru_get_product_info_asset_tag_ref(ipmi_fru_t           *fru,
+					    enum ipmi_str_type_e *type,
+					    const char           **str,
+					    unsigned int         *strlen);
+int ipmi_fru_get_product_info_fru_file_id_ref(ipmi_fru_t           *fru,
+					      enum ipmi_str_type_e *type,
+					      const char           **str,
+					      unsigned int         *strlen);
+int ipmi_fru_get_product_info_custom_ref(ipmi_fru_t           *fru,
+					 unsigned int         num,
+					 enum ipmi_str_type_e *type,
+					 const char           **str,
+					 unsigned int         *strlen);
+
 /*
  * Multi-records work differently from other record types.  They are always
  * blocks of binary data.  The "type" field (along with the other fields)
@@ -531,6 +609,42 @@ int ipmi_fru_get(ipmi_fru_t                *fru,
 		 char                      **data,
 		 unsigned int              *data_len);
 
+/*
+ * A flat, read-only view of the standard FRU fields.  Each field is
+ * handed to the handler in ipmi_fru_get() index order, array items
+ * (the custom fields) one at a time with num set to the item number;
+ * num is -1 for fields that are not arrays.  Fields that are not
+ * present are skipped.  Nothing is allocated: data points at the
+ * decoded value (ASCII strings are not nil terminated) and is only
+ * good during the call.  For string and binary fields offset and
+ * raw_len give where the field is in the raw FRU data, otherwise
+ * they are zero.
+ *
+ * The FRU is locked during the iteration, the handler must not change
+ * it.  If the handler returns non-zero the iteration stops and that
+ * value is returned.  Like ipmi_fru_get(), this does not include the
+ * multi-records.
+ */
+typedef struct ipmi_fru_field_s
+{
+    const char                *name;
+    int                       index;
+    int                       num;
+    enum ipmi_fru_data_type_e dtype;
+    int                       intval;
+    time_t                    time;
+    const char                *data;
+    unsigned int              data_len;
+    unsigned int              offset;
+    unsigned int              raw_len;
+} ipmi_fru_field_t;
+typedef int (*ipmi_fru_field_cb)(ipmi_fru_t             *fru,
+				 const ipmi_fru_field_t *field,
+				 void                   *cb_data);
+int ipmi_fru_iterate_fields(ipmi_fru_t        *fru,
+			    ipmi_fru_field_cb handler,
+			    void              *cb_data);
+
 /* Convert an idx to a name (does not require a FRU).  Return an error
    if the index is out of range. */
 char *ipmi_fru_index_to_str(int idx);
@@ -775,6 +889,22 @@ int ipmi_fru_set_data_val(ipmi_fru_t                *fru,
  */
 int ipmi_fru_write(ipmi_fru_t *fru, ipmi_fru_cb done, void *cb_data);
 
+/*
+ * Like ipmi_fru_write(), but progress() is called (if not NULL) each
+ * time a piece of the changed data has been written, with the number
+ * of bytes written so far and the total number of bytes to write.
+ * Both callbacks get cb_data.
+ */
+typedef void (*ipmi_fru_write_progress_cb)(ipmi_domain_t *domain,
+					   ipmi_fru_t    *fru,
+					   unsigned int  written,
+					   unsigned int  total,
+					   void          *cb_data);
+int ipmi_fru_write_progress(ipmi_fru_t                 *fru,
+			    ipmi_fru_write_progress_cb progress,
+			    ipmi_fru_cb                done,
+			    void                       *cb_data);
+
 
 /* The interface to get individual field from the decoded OEM FRU
  * multi-record hierarchy.  Usage:
@@ -142,12 +142,14 @@ int ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
 #define IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_NONE		0
 #define IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA1	1
 #define IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_MD5	2
+#define IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA256	3
 #define IPMI_LANP_INTEGRITY_ALGORITHM		8
 #define IPMI_LANP_INTEGRITY_ALGORITHM_BMCPICK			(~0)
 #define IPMI_LANP_INTEGRITY_ALGORITHM_NONE			0
 #define IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA1_96		1
 #define IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_MD5_128		2
 #define IPMI_LANP_INTEGRITY_ALGORITHM_MD5_128			3
+#define IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128		4
 #define IPMI_LANP_CONFIDENTIALITY_ALGORITHM	9
 #define IPMI_LANP_CONFIDENTIALITY_ALGORITHM_BMCPICK		(~0)
 #define IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE		0
@@ -172,9 +174,60 @@ int ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
    this is 2, but 2 may even be too much for some systems.  A larger
    number may improve performance for systems that can handle it.  The
    maximum value is 63, but that's way bigger than anyone should need.
-   5-6 should be enough for anything.  The value is set in parm_val */
+   5-6 should be enough for anything.  The value is set in parm_val.
+   Messages to IPMB addresses count against this like any other, but
+   if the BMC answers a Send Message with "node busy" the number of
+   bridged messages outstanding is held to what the BMC was carrying
+   and the busy message is resent, the lan_bridge_busy statistic
+   counts these. */
 #define IPMI_LANP_MAX_OUTSTANDING_MSG_COUNT	12
 
+/* Normally a message without side effects is retried every second.
+   If this is set true (in parm_val), the connection instead measures
+   the round-trip time of its responses and derives the retry timeout
+   from a smoothed RTT estimate (Jacobson/Karels, as in RFC 6298),
+   doubling it on each retry.  Messages with side effects still use
+   the fixed 5 second timeout. */
+#define IPMI_LANP_ADAPTIVE_RSP_TIMEOUT		13
+
+/* The lower and upper bounds of the adaptive retry timeout, in
+   microseconds, set in parm_val.  These default to
+   IPMI_LAN_DEFAULT_MIN_RSP_TIMEOUT and IPMI_LAN_DEFAULT_MAX_RSP_TIMEOUT
+   and are only used if IPMI_LANP_ADAPTIVE_RSP_TIMEOUT is set. */
+#define IPMI_LANP_MIN_RSP_TIMEOUT		14
+#define IPMI_LANP_MAX_RSP_TIMEOUT		15
+#define IPMI_LAN_DEFAULT_MIN_RSP_TIMEOUT	50000
+#define IPMI_LAN_DEFAULT_MAX_RSP_TIMEOUT	5000000
+
+/* If true (in parm_val), the number of outstanding messages adapts to
+   the BMC.  It starts at 2, grows by one after each window's worth of
+   responses while the window is full, and halves when a message to
+   the BMC times out or packets arrive out of sequence range.
+   IPMI_LANP_MAX_OUTSTANDING_MSG_COUNT then sets the ceiling, which
+   defaults to 16. */
+#define IPMI_LANP_ADAPTIVE_MSG_WINDOW		16
+
+/* Resume RMCP+ sessions across a restart of the program.  If set,
+   parm_val is the maximum age in seconds of a saved session, zero
+   (the default) turns this off.  When the connection is closed, the
+   session ids, sequence numbers and keys of each working RMCP+
+   session are saved in the OS handler database instead of closing
+   the session.  When the connection is started again with the same
+   address, port, user and privilege, the saved session is checked by
+   setting the session privilege; if that fails the normal session
+   setup is done.  The BMC drops idle sessions on its own, so this is
+   only useful for quick restarts, and the database holds keys so it
+   must be kept private.  A saved session is only used once. */
+#define IPMI_LANP_SESSION_RESUME		17
+
+/* Put the connection's socket and timers on the given reactor of the
+   OS handler (see get_num_reactors() in os_handler.h), taken modulo
+   the number of reactors.  IPMI_LAN_REACTOR_AUTO, the default, lets
+   the placement policy pick, see ipmi_lan_set_reactor_policy().  This
+   does nothing if the OS handler has only one reactor. */
+#define IPMI_LANP_REACTOR			18
+#define IPMI_LAN_REACTOR_AUTO			(-1)
+
 /*
  * Set up an IPMI LAN connection.  The boatload of parameters are:
  *
@@ -545,6 +598,156 @@ int ipmi_lan_send_command_forceip(ipmi_con_t            *ipmi,
 				  ipmi_msgi_t           *rspi);
 
 
+/*
+ * LAN connections share UDP sockets.  This sets the number of
+ * connections that may share one socket.  The default is 32, the
+ * maximum is IPMI_LAN_MAX_CONS_PER_FD (RMCP+ session setup can only
+ * tell 256 connections apart on one socket).  Raising this reduces
+ * the number of sockets used when a large number of connections are
+ * open.  A new value only applies to sockets opened after it is set.
+ * Returns EINVAL if the value is zero or too large.
+ */
+#define IPMI_LAN_MAX_CONS_PER_FD	256
+int ipmi_lan_set_max_cons_per_fd(unsigned int max_cons);
+unsigned int ipmi_lan_get_max_cons_per_fd(void);
+
+/*
+ * How LAN connections without IPMI_LANP_REACTOR are put on the
+ * reactors of an OS handler that has more than one.  A domain's
+ * timers go on the reactor of its first connection, so its messages,
+ * timeouts and the memory the reactor's threads allocate for it stay
+ * together.
+ *
+ * IPMI_LAN_REACTOR_ROUND_ROBIN - The default.  A connection takes a
+ *   free slot on any socket, new sockets go on the reactors in turn.
+ * IPMI_LAN_REACTOR_HASH - By a hash of the BMC's first address, so a
+ *   BMC lands on the same reactor every time.
+ * IPMI_LAN_REACTOR_LEAST_LOADED - On the reactor with the fewest
+ *   connections of the same address family.
+ *
+ * Only applies to connections set up after it is set.  Returns EINVAL
+ * for an unknown policy.
+ */
+#define IPMI_LAN_REACTOR_ROUND_ROBIN	0
+#define IPMI_LAN_REACTOR_HASH		1
+#define IPMI_LAN_REACTOR_LEAST_LOADED	2
+int ipmi_lan_set_reactor_policy(unsigned int policy);
+unsigned int ipmi_lan_get_reactor_policy(void);
+
+/*
+ * Receive batching on the shared LAN sockets.  Many LAN connections
+ * share a single UDP socket; by default one datagram is read from
+ * the socket each time it becomes readable.  If the batch size is
+ * larger than one (and the platform has recvmmsg()), up to that many
+ * datagrams are pulled from the socket with one system call and all
+ * of them are dispatched before returning to the selector.  The batch
+ * size is global and applies to every LAN socket; it may be changed
+ * at any time.  Setting a value of zero or larger than
+ * IPMI_LAN_MAX_RECV_BATCH returns EINVAL.  Setting a value larger
+ * than one returns ENOSYS if the platform does not support it.
+ */
+#define IPMI_LAN_MAX_RECV_BATCH	32
+int ipmi_lan_set_recv_batch_size(unsigned int batch_size);
+unsigned int ipmi_lan_get_recv_batch_size(void);
+
+/* Receive statistics for all LAN sockets, summed.  "batches" is the
+   number of reads that returned data, "packets" the number of
+   datagrams received by those reads, "full_batches" the number of
+   reads that filled the whole batch (a good sign the batch size
+   should be raised), and "max_batch" the largest number of datagrams
+   received by a single read. */
+typedef struct ipmi_lan_recv_batch_stats_s
+{
+    unsigned long batches;
+    unsigned long packets;
+    unsigned long full_batches;
+    unsigned int  max_batch;
+} ipmi_lan_recv_batch_stats_t;
+void ipmi_lan_get_recv_batch_stats(ipmi_lan_recv_batch_stats_t *stats);
+
+/*
+ * Transmit coalescing on the shared LAN sockets.  If the batch size
+ * is larger than one (and the platform has sendmmsg()), packets sent
+ * on a LAN socket are queued and sent together with one system call
+ * when batch_size packets are queued or when the first queued packet
+ * has waited max_delay microseconds, whichever comes first.  A
+ * max_delay of zero sends the queue on the next pass through the
+ * selector, which coalesces everything generated in the same pass
+ * without adding any real latency.  Note that send errors are not
+ * reported for queued packets, the normal retransmit handling takes
+ * care of lost packets.  The batch size may not be zero or larger
+ * than IPMI_LAN_MAX_XMIT_BATCH and the delay may not be larger than
+ * IPMI_LAN_MAX_XMIT_DELAY, EINVAL is returned in those cases.  ENOSYS
+ * is returned if batching is not supported by the platform.
+ */
+#define IPMI_LAN_MAX_XMIT_BATCH	32
+#define IPMI_LAN_MAX_XMIT_DELAY	100000
+int ipmi_lan_set_xmit_batch(unsigned int batch_size, unsigned int max_delay);
+void ipmi_lan_get_xmit_batch(unsigned int *batch_size,
+			     unsigned int *max_delay);
+
+/*
+ * Fetch the current state of the response time estimator for a LAN
+ * connection, all in microseconds.  srtt and rttvar are zero until
+ * the first response has been timed.  rto is the timeout the next
+ * message without side effects will use.  Returns EINVAL if the
+ * connection is not a valid LAN connection.
+ */
+typedef struct ipmi_lan_rtt_info_s
+{
+    int          adaptive;
+    unsigned int samples;
+    unsigned int srtt;
+    unsigned int rttvar;
+    unsigned int rto;
+} ipmi_lan_rtt_info_t;
+int ipmi_lan_get_rtt_info(ipmi_con_t *ipmi, ipmi_lan_rtt_info_t *info);
+
+/*
+ * Fetch the current outstanding message limit of a LAN connection and
+ * its ceiling (they are the same unless the window is adaptive).
+ * Returns EINVAL if the connection is not a valid LAN connection.
+ */
+int ipmi_lan_get_msg_window(ipmi_con_t   *ipmi,
+			    unsigned int *window,
+			    unsigned int *max_window);
+
+/*
+ * The statistics of a LAN connection are always counted in the
+ * connection, ipmi_lan_get_stats() fetches them.  stats is an array
+ * of *num_stats entries, index n is the statistic named by
+ * ipmi_lan_stat_name(n); on return *num_stats is set to
+ * ipmi_lan_num_stats().  The values are read without stopping the
+ * connection, so they may be slightly out of step with each other.
+ */
+unsigned int ipmi_lan_num_stats(void);
+const char *ipmi_lan_stat_name(unsigned int stat);
+int ipmi_lan_get_stats(ipmi_con_t    *ipmi,
+		       unsigned long *stats,
+		       unsigned int  *num_stats);
+
+/*
+ * By default each statistic update is also passed to the stat
+ * handlers registered on the connection (the domain registers one).
+ * That is a list walk per packet; if the statistics are fetched with
+ * ipmi_lan_get_stats() instead, pass zero here to turn it off.
+ */
+int ipmi_lan_set_stat_push(ipmi_con_t *ipmi, int push);
+
+/*
+ * Limit how many LAN addresses may be establishing a session at the
+ * same time, across all connections.  When many connections are
+ * started together (or come back after a network outage), the rest
+ * wait in a FIFO until a running handshake finishes, successfully
+ * or not.  While limited, an address that is already waiting or
+ * handshaking is not started again by the connection audit.  Zero
+ * (the default) means no limit.  ipmi_lan_get_connecting() returns
+ * the number of handshakes running and waiting.
+ */
+int ipmi_lan_set_max_connecting(unsigned int max_connecting);
+unsigned int ipmi_lan_get_max_connecting(void);
+void ipmi_lan_get_connecting(unsigned int *running, unsigned int *waiting);
+
 /*
  * Hacks for various things.  Don't use this stuff unless you *really*
  * know what you are doing.
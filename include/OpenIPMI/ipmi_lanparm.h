@@ -159,6 +159,18 @@ int ipmi_lan_get_config(ipmi_lanparm_t         *lanparm,
 			ipmi_lan_get_config_cb done,
 			void                   *cb_data);
 
+/* Like ipmi_lan_get_config(), but only fetch the given parameters
+   (IPMI_LANPARM_xxx values), plus the destination or cipher suite
+   counts they need.  This is for checking a few parameters against a
+   desired configuration without fetching everything.  Only the
+   fields for the given parameters are valid in the returned config,
+   and it cannot be passed to ipmi_lan_set_config(). */
+int ipmi_lan_get_config_parms(ipmi_lanparm_t         *lanparm,
+			      unsigned int           *parms,
+			      unsigned int           num_parms,
+			      ipmi_lan_get_config_cb done,
+			      void                   *cb_data);
+
 /* Set the full LAN configuration.  The config *MUST* be locked and
    the lanparm must match the LAN that it was fetched with.  Note that
    a copy is made of the configuration, so you are free to do whatever
@@ -169,6 +169,18 @@ int ipmi_mc_send_command_sideeff(ipmi_mc_t                  *mc,
 				 ipmi_mc_response_handler_t rsp_handler,
 				 void                       *rsp_data);
 
+/* Send with message options, see ipmi_send_command_addr_options().
+   For instance, a sensor poller that has no use for a reading more
+   than 500ms late can pass IPMI_CON_MSG_OPTION_DEADLINE with an ival
+   of 500 so the command is not retried past that. */
+struct ipmi_con_option_s;
+int ipmi_mc_send_command_options(ipmi_mc_t                      *mc,
+				 unsigned int                   lun,
+				 const ipmi_msg_t               *cmd,
+				 const struct ipmi_con_option_s *options,
+				 ipmi_mc_response_handler_t     rsp_handler,
+				 void                           *rsp_data);
+
 /* Reset the MC, either a cold or warm reset depending on the type.
    Note that the effects of a reset are not defined by IPMI, so this
    might do wierd things.  Some systems do not support resetting the
@@ -228,6 +240,22 @@ int ipmi_mc_reread_sensors(ipmi_mc_t       *mc,
 void ipmi_mc_set_sel_rescan_time(ipmi_mc_t *mc, unsigned int seconds);
 unsigned int ipmi_mc_get_sel_rescan_time(ipmi_mc_t *mc);
 
+/* If larger than the rescan time, each SEL scan that finds nothing
+   new doubles the time to the next one, up to this many seconds.  A
+   change in the SEL or an event from the MC goes back to the rescan
+   time, and an event from the MC also causes a scan right away. */
+void ipmi_mc_set_sel_rescan_max_time(ipmi_mc_t *mc, unsigned int seconds);
+unsigned int ipmi_mc_get_sel_rescan_max_time(ipmi_mc_t *mc);
+
+/* Set how many stateless operations (currently sensor readings and
+   state fetches) may be outstanding at once for each sensor on the
+   MC.  The default comes from the domain's connections: the system
+   interface allows several since the driver queues them, other
+   connections run them one at a time as before.  Zero means let as many run as the connection can have messages
+   outstanding; no value is allowed to go past that. */
+void ipmi_mc_set_max_concurrent_ops(ipmi_mc_t *mc, unsigned int max);
+unsigned int ipmi_mc_get_max_concurrent_ops(ipmi_mc_t *mc);
+
 /* Reread the sel.  When the hander is called, all the events in the
    SEL have been fetched into the local copy of the SEL (with the
    obvious caveat that this is a distributed system and other things
@@ -281,6 +309,17 @@ int ipmi_mc_del_event(ipmi_mc_t                 *mc,
 		      ipmi_mc_del_event_done_cb handler,
 		      void                      *cb_data);
 
+/* Delete the events with the given record ids from the SEL.  This is
+   much faster than deleting them one at a time, the deletes share one
+   reservation and several are sent at once.  The handler is called
+   once, with the first error seen.  Not supported if an OEM handles
+   SEL deletes for the MC. */
+int ipmi_mc_del_events_by_recid(ipmi_mc_t                 *mc,
+				const unsigned int        *record_ids,
+				unsigned int              count,
+				ipmi_mc_del_event_done_cb handler,
+				void                      *cb_data);
+
 /* Clear out all the events in the SEL if and only if the last_event
    passed in is the last event in the SEL.  Note that use of this is
    *HIGHLY* discouraged.  This is only here for HPI support.  In
@@ -301,6 +340,29 @@ ipmi_event_t *ipmi_mc_next_event(ipmi_mc_t *mc, const ipmi_event_t *event);
 ipmi_event_t *ipmi_mc_prev_event(ipmi_mc_t *mc, const ipmi_event_t *event);
 ipmi_event_t *ipmi_mc_event_by_recid(ipmi_mc_t *mc,
 				     unsigned int record_id);
+/* Call the handler with each event in the MC's SEL, in the same order
+   as ipmi_mc_first_event() and ipmi_mc_next_event(), without taking
+   a reference to each one.  The event is only good until the handler
+   returns; use ipmi_event_dup() to keep it.  The SEL is locked while
+   the handler runs, so the handler must not do anything else with
+   this MC's SEL.  If the handler returns non-zero, the iteration
+   stops. */
+typedef int (*ipmi_mc_iterate_events_cb)(ipmi_mc_t    *mc,
+					 ipmi_event_t *event,
+					 void         *cb_data);
+int ipmi_mc_iterate_events(ipmi_mc_t                 *mc,
+			   ipmi_mc_iterate_events_cb handler,
+			   void                      *cb_data);
+
+/* Copy out the events logged from start up to (but not including)
+   end, oldest first.  *array_size holds the size of the array and is
+   set to the number of events returned.  If the array is too small,
+   this returns E2BIG and sets *array_size to the size needed. */
+int ipmi_mc_events_by_time(ipmi_mc_t    *mc,
+			   ipmi_time_t  start,
+			   ipmi_time_t  end,
+			   int          *array_size,
+			   ipmi_event_t **array);
 int ipmi_mc_sel_count(ipmi_mc_t *mc);
 int ipmi_mc_sel_entries_used(ipmi_mc_t *mc);
 int ipmi_mc_sel_get_major_version(ipmi_mc_t *mc);
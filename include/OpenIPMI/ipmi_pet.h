@@ -106,6 +106,51 @@ int ipmi_pet_create_mc(ipmi_mc_t        *mc,
 		       void             *cb_data,
 		       ipmi_pet_t       **ret_pet);
 
+/*
+ * Set up the same PET on a set of MCs, for rolling out a trap
+ * destination to a lot of BMCs at once.  The MCs may be in different
+ * domains.  The config holds the same values as the parameters to
+ * ipmi_pet_create_mc().  At most max_concurrent MCs are set up at
+ * once (0 picks a default).  If progress is not NULL, it is called
+ * each time an MC finishes, with the number finished and failed so
+ * far.  When all are finished, done is called with a result for
+ * each MC, in the same order as mcs.  The PETs in the results
+ * belong to the caller, they keep checking the configuration like
+ * any other PET; use ipmi_pet_destroy() if that is not wanted.  The
+ * results are freed when done returns.
+ */
+typedef struct ipmi_pet_config_s
+{
+    unsigned int   channel;
+    struct in_addr ip_addr;
+    unsigned char  mac_addr[6];
+    unsigned int   eft_sel;
+    unsigned int   policy_num;
+    unsigned int   apt_sel;
+    unsigned int   lan_dest_sel;
+} ipmi_pet_config_t;
+typedef struct ipmi_pet_provision_result_s
+{
+    ipmi_mcid_t mc_id;
+    int         err;
+    ipmi_pet_t  *pet; /* NULL if the PET could not be created. */
+} ipmi_pet_provision_result_t;
+typedef void (*ipmi_pet_provision_progress_cb)(unsigned int finished,
+					       unsigned int failed,
+					       unsigned int total,
+					       void         *cb_data);
+typedef void (*ipmi_pet_provision_done_cb)(ipmi_pet_provision_result_t *results,
+					   unsigned int                count,
+					   unsigned int                failed,
+					   void                        *cb_data);
+int ipmi_pet_provision(ipmi_mcid_t                    *mcs,
+		       unsigned int                   num_mcs,
+		       ipmi_pet_config_t              *config,
+		       unsigned int                   max_concurrent,
+		       ipmi_pet_provision_progress_cb progress,
+		       ipmi_pet_provision_done_cb     done,
+		       void                           *cb_data);
+
 /* Destroy a PET.  Note that if you destroy all PETs, this will result
    in the SNMP trap UDP port being closed. */
 int ipmi_pet_destroy(ipmi_pet_t       *pet,
@@ -105,6 +105,13 @@ void ipmi_posix_os_handler_set_sel(os_handler_t *os_hnd, selector_t *sel);
    does not have to be queued); a signal handler will be installed for
    it. */
 os_handler_t *ipmi_posix_thread_setup_os_handler(int wake_sig);
+/* Like the above, but the selector has num_reactors reactors (see
+   sel_alloc_selector_reactors()).  Each thread that calls
+   operation_loop() or perform_one_op() is assigned to a reactor the
+   first time it does so, round-robin, so you must run at least
+   num_reactors threads. */
+os_handler_t *ipmi_posix_thread_setup_os_handler_reactors(int wake_sig,
+						unsigned int num_reactors);
 /* Gets the selector associated with the OS handler. */
 selector_t *ipmi_posix_thread_os_handler_get_sel(os_handler_t *os_hnd);
 
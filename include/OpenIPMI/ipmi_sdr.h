@@ -131,6 +131,29 @@ int ipmi_get_all_sdrs(ipmi_sdr_info_t *sdr,
 		      int             *array_size,
 		      ipmi_sdr_t      *array);
 
+/* Call the handler with each SDR in order, without copying them.  The
+   SDR lock is held while the handler runs, so the handler must not
+   call other functions on this SDR repository, and the SDR pointer
+   is only good until the handler returns.  If the handler returns
+   non-zero, the iteration stops. */
+typedef int (*ipmi_sdr_iterate_sdrs_cb)(ipmi_sdr_info_t  *sdrs,
+					const ipmi_sdr_t *sdr,
+					void             *cb_data);
+int ipmi_sdr_iterate_sdrs(ipmi_sdr_info_t          *sdrs,
+			  ipmi_sdr_iterate_sdrs_cb handler,
+			  void                     *cb_data);
+
+/* Call the handler with the repository's array of SDRs and the
+   number of them, without copying them.  The same rules as
+   ipmi_sdr_iterate_sdrs() apply. */
+typedef void (*ipmi_sdr_array_cb_t)(ipmi_sdr_info_t  *sdrs,
+				    const ipmi_sdr_t *array,
+				    unsigned int     count,
+				    void             *cb_data);
+int ipmi_sdr_array_cb(ipmi_sdr_info_t     *sdrs,
+		      ipmi_sdr_array_cb_t handler,
+		      void                *cb_data);
+
 /* Get various information from the IPMI SDR info commands. */
 int ipmi_sdr_get_major_version(ipmi_sdr_info_t *sdr, int *val);
 int ipmi_sdr_get_minor_version(ipmi_sdr_info_t *sdr, int *val);
@@ -0,0 +1,150 @@
+/*
+ * ipmi_sel_archive.h
+ *
+ * A compact columnar file format for archiving SEL entries
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __IPMI_SEL_ARCHIVE_H
+#define __IPMI_SEL_ARCHIVE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A SEL archive holds SEL entries from any number of MCs in a form
+ * that is cheap to write as they come in and cheap to scan
+ * afterwards.  The file is a short header followed by blocks.  Each
+ * block holds up to a fixed number of entries, stored column by
+ * column (all the timestamps, then all the record ids, and so on),
+ * and a table of the MCs its entries came from.  The writer buffers
+ * a block in memory and appends it when it fills or is flushed, so a
+ * file that is still being written, or whose writer died, can be read
+ * up to its last complete block.
+ *
+ * The reader maps the file and hands out pointers straight into it,
+ * nothing is copied.  The file is in the writer's byte order, a
+ * reader with the other byte order refuses it.
+ */
+
+/* The bytes of a SEL entry after the record id and type. */
+#define IPMI_SEL_ARCHIVE_DATA_LEN	13
+
+typedef struct ipmi_sel_archive_mc_s
+{
+    char    domain[32];		/* Nil terminated, cut short if too long. */
+    uint8_t channel;
+    uint8_t addr;
+    uint8_t pad[6];
+} ipmi_sel_archive_mc_t;
+
+/*
+ * Writing.
+ */
+typedef struct ipmi_sel_archive_writer_s ipmi_sel_archive_writer_t;
+
+/* Create (or truncate) the file.  rows_per_block is how many entries
+   are buffered before a block is written, 0 gives a default of 4096;
+   it may not be more than 65535. */
+int ipmi_sel_archive_create(const char                *path,
+			    unsigned int              rows_per_block,
+			    ipmi_sel_archive_writer_t **writer);
+
+/* Add an entry from the MC at channel/addr in the named domain.  time
+   is in nanoseconds, as from ipmi_event_get_timestamp().  type is the
+   SEL record type and must fit in a byte.  data is the entry after
+   the record id and type, as from ipmi_event_get_data(), if it is
+   short the rest is zeroed.  For system event records (type 2) the
+   sensor type, sensor number and event type columns are filled in
+   from it, for other records they are zero. */
+int ipmi_sel_archive_add(ipmi_sel_archive_writer_t *writer,
+			 const char                *domain,
+			 unsigned int              channel,
+			 unsigned int              addr,
+			 unsigned int              record_id,
+			 unsigned int              type,
+			 int64_t                   time,
+			 const unsigned char       *data,
+			 unsigned int              data_len);
+
+/* Write out what is buffered as a block, if anything is. */
+int ipmi_sel_archive_flush(ipmi_sel_archive_writer_t *writer);
+
+/* Flush, close the file and free the writer.  The writer is freed
+   even if this returns an error. */
+int ipmi_sel_archive_finish(ipmi_sel_archive_writer_t *writer);
+
+/*
+ * Reading.
+ */
+typedef struct ipmi_sel_archive_s ipmi_sel_archive_t;
+
+/* The columns of a block.  Entry i of the block is time[i],
+   record_id[i], and so on, and came from the MC mcs[mc[i]].  The
+   pointers are into the mapped file and are good until the archive
+   is closed. */
+typedef struct ipmi_sel_archive_block_s
+{
+    unsigned int                rows;
+    unsigned int                num_mcs;
+    const ipmi_sel_archive_mc_t *mcs;
+    const int64_t               *time;
+    const uint16_t              *record_id;
+    const uint16_t              *mc;
+    const uint8_t               *type;
+    const uint8_t               *sensor_type;
+    const uint8_t               *sensor_num;
+    const uint8_t               *event_type;
+    const uint8_t               (*data)[IPMI_SEL_ARCHIVE_DATA_LEN];
+} ipmi_sel_archive_block_t;
+
+/* Map an archive.  Complete blocks written after this are not
+   seen. */
+int ipmi_sel_archive_open(const char *path, ipmi_sel_archive_t **archive);
+
+void ipmi_sel_archive_close(ipmi_sel_archive_t *archive);
+
+unsigned int ipmi_sel_archive_num_blocks(ipmi_sel_archive_t *archive);
+
+/* Total entries in all the blocks. */
+uint64_t ipmi_sel_archive_num_rows(ipmi_sel_archive_t *archive);
+
+/* Returns EINVAL if idx is past the last block. */
+int ipmi_sel_archive_get_block(ipmi_sel_archive_t       *archive,
+			       unsigned int             idx,
+			       ipmi_sel_archive_block_t *block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IPMI_SEL_ARCHIVE_H */
@@ -0,0 +1,119 @@
+/*
+ * ipmi_shm_ring.h
+ *
+ * A shared memory ring for passing results between processes
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __IPMI_SHM_RING_H
+#define __IPMI_SHM_RING_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * When domains are spread across several processes, each process
+ * (a producer) writes its sensor readings and events as fixed size
+ * records into a file mapped shared by all of them, and one consumer
+ * process reads them all from there.  Each producer has its own ring
+ * in the file, so producers never contend with each other and need
+ * no locks; the consumer takes records from the rings in turn.  If a
+ * producer's ring is full the record is dropped and counted.  Put
+ * the file on a memory file system, like /dev/shm.
+ *
+ * The consumer polls, nothing is signalled when records are added.
+ */
+typedef struct ipmi_shm_ring_s ipmi_shm_ring_t;
+
+#define IPMI_SHM_REC_READING	1
+#define IPMI_SHM_REC_EVENT	2
+
+typedef struct ipmi_shm_rec_s
+{
+    uint32_t      type;
+    uint32_t      producer;	/* Filled in by ipmi_shm_ring_put(). */
+    int64_t       time;		/* Real time in microseconds. */
+    char          domain[32];
+    char          name[64];	/* Sensor name or MC name for events. */
+    int32_t       err;
+
+    /* For readings, value_present is an enum ipmi_value_present_e
+       and raw is the raw reading.  For events, raw is the record id
+       and data is the event data. */
+    uint32_t      value_present;
+    double        value;
+    uint32_t      raw;
+    uint32_t      data_len;
+    unsigned char data[24];
+} ipmi_shm_rec_t;
+
+/* Create (or recreate) the ring file with a ring for each of
+   num_producers producers, each holding slots records.  slots is
+   rounded up to a power of two. */
+int ipmi_shm_ring_create(const char      *path,
+			 unsigned int    num_producers,
+			 unsigned int    slots,
+			 ipmi_shm_ring_t **ring);
+
+/* Map an existing ring file, in a producer or the consumer. */
+int ipmi_shm_ring_attach(const char *path, ipmi_shm_ring_t **ring);
+
+/* Unmap the ring, the file stays. */
+void ipmi_shm_ring_detach(ipmi_shm_ring_t *ring);
+
+unsigned int ipmi_shm_ring_num_producers(ipmi_shm_ring_t *ring);
+
+/* Add a record to producer's ring.  Only one thread may put to a
+   given producer.  Returns EAGAIN if the ring is full. */
+int ipmi_shm_ring_put(ipmi_shm_ring_t      *ring,
+		      unsigned int         producer,
+		      const ipmi_shm_rec_t *rec);
+
+/* Take the next record, from whichever producer is next in turn that
+   has one.  There may only be one consumer.  Returns EAGAIN if all
+   the rings are empty. */
+int ipmi_shm_ring_get(ipmi_shm_ring_t *ring, ipmi_shm_rec_t *rec);
+
+/* How many records a producer has dropped because its ring was
+   full. */
+uint64_t ipmi_shm_ring_dropped(ipmi_shm_ring_t *ring, unsigned int producer);
+
+/* Pick which of num_shards processes should handle the named
+   domain.  The same name always gives the same shard for the same
+   num_shards. */
+unsigned int ipmi_shm_ring_shard(const char *name, unsigned int num_shards);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IPMI_SHM_RING_H */
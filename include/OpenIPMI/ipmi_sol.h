@@ -73,6 +73,8 @@
 #ifndef _IPMI_SOL_H
 #define _IPMI_SOL_H
 
+#include <sys/uio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -489,6 +491,92 @@ int ipmi_sol_set_bit_rate(ipmi_sol_conn_t *conn, unsigned char rate);
 unsigned char ipmi_sol_get_bit_rate(ipmi_sol_conn_t *conn);
 
 
+/**
+ * Coalesce received data before calling the data received callbacks.
+ * Data from the BMC is ACKed and held until max_bytes have built up
+ * or the oldest held data is max_ms old, then the callbacks get it
+ * all in one call.  If a callback NACKs the coalesced data, it is
+ * held and delivered again when the NACK is released, and packets
+ * from the BMC are NACKed in the meantime.  Held data is delivered
+ * when the connection closes.
+ *
+ * If both values are zero, coalescing is turned off (the default)
+ * and each packet is delivered as it arrives.  If only one is zero,
+ * a default is used for it.  Only allowed while the connection is
+ * closed.
+ *
+ * @param [in] conn	The IPMI SoL connection to configure.
+ * @param [in] max_bytes	Deliver once this many bytes are held.
+ * @param [in] max_ms	Deliver once data has been held this long.
+ * @return	Zero on success, otherwise an error code.
+ */
+int ipmi_sol_set_receive_coalesce(ipmi_sol_conn_t *conn,
+				  unsigned int    max_bytes,
+				  unsigned int    max_ms);
+
+/**
+ * Query the receive coalescing limits, both are zero if it is off.
+ */
+void ipmi_sol_get_receive_coalesce(ipmi_sol_conn_t *conn,
+				   unsigned int    *max_bytes,
+				   unsigned int    *max_ms);
+
+
+/**
+ * Called from the library's thread when data has been put into an
+ * empty receive ring.  This should only wake up the thread that
+ * reads the ring, it may be called when the reader has already taken
+ * the data.
+ */
+typedef void (*ipmi_sol_ring_ready_cb)(ipmi_sol_conn_t *conn,
+				       void            *cb_data);
+
+/**
+ * Put received data into a ring that the application reads with
+ * ipmi_sol_ring_read() on its own thread, instead of calling the data
+ * received callbacks (and coalescing) on the library's thread.  The
+ * ring has one writer, the library, and one reader, so the two sides
+ * do not lock against each other.
+ *
+ * A packet from the BMC is ACKed if it fits in the ring.  If it does
+ * not, it is NACKed and the BMC holds the data until the reader has
+ * emptied half the ring, so how fast the BMC may send is set by how
+ * fast the application reads.
+ *
+ * size is rounded up to a power of two and must be at least twice
+ * the largest SoL packet; zero turns the ring off.  Only allowed
+ * while the connection is closed.  The ring is emptied when the
+ * connection is opened, data left in it after a close may still be
+ * read.
+ *
+ * @param [in] conn	The IPMI SoL connection to configure.
+ * @param [in] size	The ring size in bytes.
+ * @param [in] ready	Called when the ring goes from empty to not empty,
+ *			may be NULL if the reader polls.
+ * @param [in] cb_data	Passed to ready.
+ * @return	Zero on success, otherwise an error code.
+ */
+int ipmi_sol_set_receive_ring(ipmi_sol_conn_t        *conn,
+			      unsigned int           size,
+			      ipmi_sol_ring_ready_cb ready,
+			      void                   *cb_data);
+
+/**
+ * Take up to len bytes of received data from the receive ring.  Only
+ * one thread may read the ring.  If this frees enough space for a
+ * NACKed BMC to start sending again, the NACK is released.
+ *
+ * @param [in] conn	The IPMI SoL connection.
+ * @param [out] buf	Where to put the data.
+ * @param [in] len	The size of buf.
+ * @return	The number of bytes taken, zero if the ring is empty or
+ *		there is no ring.
+ */
+unsigned int ipmi_sol_ring_read(ipmi_sol_conn_t *conn,
+				void            *buf,
+				unsigned int    len);
+
+
 /**
  * Opens the SoL connection using the previously set nonvolatile and
  * volatile parameters.
@@ -594,6 +682,31 @@ int ipmi_sol_write(ipmi_sol_conn_t *conn,
 		   ipmi_sol_transmit_complete_cb cb,
 		   void            *cb_data);
 
+/**
+ * Send the bytes from a set of buffers to the remote.
+ *
+ * Just like ipmi_sol_write(), but the data comes from iovcnt buffers,
+ * sent in order, and the callback is called once when the BMC has
+ * ACKed all of them.  The buffers may be reused as soon as this
+ * returns.
+ *
+ * @param [in] conn	The IPMI SoL connection over which to transmit.
+ * @param [in] iov	The buffers to transmit.
+ * @param [in] iovcnt	The number of buffers.
+ * @param [in] cb	The callback to call when the transmission is complete.
+ *			This callback will only be called if this function call
+ *			returns zero.
+ * @param [in] cb_data	User-defined data to pass to the callback.
+ * @return	Zero on success
+ *		EINVAL	if a request is made to transmit zero bytes
+ *		or a nonzero IPMI error code on failure.
+ */
+int ipmi_sol_writev(ipmi_sol_conn_t    *conn,
+		    const struct iovec *iov,
+		    int                iovcnt,
+		    ipmi_sol_transmit_complete_cb cb,
+		    void               *cb_data);
+
 
 /**
  * Release a NACK
@@ -735,6 +848,117 @@ int ipmi_sol_flush(ipmi_sol_conn_t *conn,
 		   ipmi_sol_flush_complete_cb cb,
 		   void            *cb_data);
 
+
+/**************************************************************************
+ ** SoL console multiplexer
+ **
+ ** Collects the output of many SoL connections, all running on the
+ ** same OS handler, into a single append-only log.  Received data
+ ** is buffered in memory and written to the log with one write()
+ ** per flush, either when the buffered data reaches the flush
+ ** threshold or when the flush interval expires.  Each chunk of
+ ** console data is written as a text header line:
+ **
+ **    <seconds>.<microseconds> <console name> <length>\n
+ **
+ ** followed by exactly <length> bytes of raw console data, so the
+ ** log can be split back into per-console streams.  If the buffer
+ ** fills up because the log cannot keep up, incoming packets are
+ ** NACKed (and later released) so the BMCs hold the data instead
+ ** of it being dropped.
+ **/
+
+typedef struct ipmi_sol_mux_s ipmi_sol_mux_t;
+typedef struct ipmi_sol_mux_console_s ipmi_sol_mux_console_t;
+
+/**
+ * Allocate a multiplexer that logs to the given file descriptor.
+ * The fd is not closed by the multiplexer; if it is non-blocking,
+ * short writes are retried on the next flush.
+ *
+ * @param [in] os_hnd		The OS handler the SoL connections run on.
+ * @param [in] fd		The log file descriptor.
+ * @param [in] flush_threshold	Write the log when this many bytes are
+ *				buffered.  Zero selects a default.
+ * @param [in] flush_interval_ms The maximum time data sits in the
+ *				buffer before being written.  Zero selects
+ *				a default.
+ * @param [out] mux		The new multiplexer.
+ * @return	zero on success, or an errno on failure.
+ */
+int ipmi_sol_mux_alloc(os_handler_t   *os_hnd,
+		       int            fd,
+		       unsigned int   flush_threshold,
+		       unsigned int   flush_interval_ms,
+		       ipmi_sol_mux_t **mux);
+
+/**
+ * Flush the buffered data, remove all the consoles and free the
+ * multiplexer.  The SoL connections themselves are not closed.
+ */
+void ipmi_sol_mux_free(ipmi_sol_mux_t *mux);
+
+/**
+ * Write out any buffered data now.
+ *
+ * @return	zero if everything was written, EAGAIN if the fd
+ *		could only take part of it, or the errno from write().
+ */
+int ipmi_sol_mux_flush(ipmi_sol_mux_t *mux);
+
+/**
+ * Start logging the data received on a SoL connection under the
+ * given name.  The name is copied and must not contain whitespace.
+ * The connection does not need to be open yet.
+ */
+int ipmi_sol_mux_add_console(ipmi_sol_mux_t         *mux,
+			     ipmi_sol_conn_t        *conn,
+			     const char             *name,
+			     ipmi_sol_mux_console_t **console);
+
+/**
+ * Stop logging a console.  Data from it that is already buffered
+ * is still written to the log.  The connection must not be
+ * delivering data on another thread while this is called; close it
+ * first or call this from the connection's own callbacks.
+ */
+int ipmi_sol_mux_remove_console(ipmi_sol_mux_console_t *console);
+
+/**
+ * Per-console counters, see ipmi_sol_mux_console_get_stats().
+ */
+typedef struct ipmi_sol_mux_console_stats_s
+{
+    /* Console bytes received from the BMC. */
+    unsigned long long bytes_received;
+    /* Console bytes that have been written to the log. */
+    unsigned long long bytes_logged;
+    /* Received but not yet written. */
+    unsigned long long bytes_pending;
+    /* Number of packets NACKed because the buffer was full. */
+    unsigned long      nacks;
+    /* How long the oldest unwritten data from this console has
+       been waiting, in milliseconds.  Zero if nothing is pending. */
+    unsigned long      lag_ms;
+    /* Time since data was last received on the console, in
+       milliseconds, or ULONG_MAX if nothing has been received. */
+    unsigned long      idle_ms;
+} ipmi_sol_mux_console_stats_t;
+
+void ipmi_sol_mux_console_get_stats(ipmi_sol_mux_console_t       *console,
+				    ipmi_sol_mux_console_stats_t *stats);
+
+/**
+ * Iterate over all the consoles in the multiplexer, to collect
+ * statistics.  The handler must not add or remove consoles.
+ */
+typedef void (*ipmi_sol_mux_console_cb)(ipmi_sol_mux_console_t *console,
+					const char             *name,
+					void                   *cb_data);
+void ipmi_sol_mux_iterate_consoles(ipmi_sol_mux_t          *mux,
+				   ipmi_sol_mux_console_cb handler,
+				   void                    *cb_data);
+
 #ifdef __cplusplus
 }
 #endif
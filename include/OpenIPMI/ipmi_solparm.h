@@ -137,6 +137,17 @@ int ipmi_sol_get_config(ipmi_solparm_t         *solparm,
 			ipmi_sol_get_config_cb done,
 			void                   *cb_data);
 
+/* Like ipmi_sol_get_config(), but only fetch the given parameters
+   (IPMI_SOLPARM_xxx values).  This is for checking a few parameters
+   against a desired configuration without fetching everything.  Only
+   the fields for the given parameters are valid in the returned
+   config, and it cannot be passed to ipmi_sol_set_config(). */
+int ipmi_sol_get_config_parms(ipmi_solparm_t         *solparm,
+			      unsigned int           *parms,
+			      unsigned int           num_parms,
+			      ipmi_sol_get_config_cb done,
+			      void                   *cb_data);
+
 /* Set the full SOL configuration.  The config *MUST* be locked and
    the solparm must match the SOL that it was fetched with.  Note that
    a copy is made of the configuration, so you are free to do whatever
@@ -197,6 +197,7 @@ struct ipmi_sensor_id_s
     ipmi_mcid_t  mcid;
     unsigned int lun        : 3;
     unsigned int sensor_num : 8;
+    unsigned int handle     : 21; /* A lookup hint, 0 if none. */
 };
 #define IPMI_SENSOR_ID_INVALID { IPMI_MCID_INVALID, 0, 0 }
 
@@ -205,6 +206,7 @@ struct ipmi_control_id_s
     ipmi_mcid_t  mcid;
     unsigned int lun         : 3;
     unsigned int control_num : 8;
+    unsigned int handle      : 21; /* A lookup hint, 0 if none. */
 };
 #define IPMI_CONTROL_ID_INVALID { IPMI_MCID_INVALID, 0, 0 }
 
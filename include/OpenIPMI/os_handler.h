@@ -86,6 +86,9 @@ typedef struct os_hnd_rwlock_s os_hnd_rwlock_t;
 /* An os-independent condition variable. */
 typedef struct os_hnd_cond_s os_hnd_cond_t;
 
+/* A queue of work to run in order on a worker thread. */
+typedef struct os_hnd_work_queue_s os_hnd_work_queue_t;
+
 /* An os-independent file descriptor holder. */
 typedef struct os_hnd_fd_id_s os_hnd_fd_id_t;
 
@@ -113,6 +116,9 @@ typedef void (*os_fd_data_freed_t)(int fd, void *data);
    this will be called when all handlers are done. */
 typedef void (*os_timer_freed_t)(void *data);
 
+/* A piece of work to run from a work queue. */
+typedef void (*os_work_t)(void *cb_data);
+
 typedef struct os_handler_s os_handler_t;
 
 /* A function to output logs, used to override the default functions. */
@@ -276,6 +282,10 @@ struct os_handler_s
        compatability with old os handlers. */
     int (*is_locked)(os_handler_t  *handler,
 		     os_hnd_lock_t *id);
+
+    /* Read/write locks.  These are optional, if create_rwlock is
+       NULL the normal lock is used instead.  They need not be
+       recursive, a thread must not claim one it already holds. */
     int (*create_rwlock)(os_handler_t  *handler,
 			 os_hnd_rwlock_t **id);
     int (*destroy_rwlock)(os_handler_t  *handler,
@@ -288,6 +298,8 @@ struct os_handler_s
 		      os_hnd_rwlock_t *id);
     int (*write_unlock)(os_handler_t  *handler,
 			os_hnd_rwlock_t *id);
+
+    /* No longer implemented, see above. */
     int (*is_readlocked)(os_handler_t    *handler,
 			 os_hnd_rwlock_t *id);
     int (*is_writelocked)(os_handler_t    *handler,
@@ -303,7 +315,9 @@ struct os_handler_s
        fetch_completed to true.  Otherwise, if it cannot fetch the
        data without delay, it will set fetch_completed to false and
        start the database operation, calling got_data() when it is
-       done.
+       done.  If got_data is NULL the caller can't wait, the fetch
+       must be done in the call or fail.  Stores may be done later,
+       but a find after a store must see the stored data.
 
        The data returned should be freed by database_free.  Note that
        these routines are optional and do not need to be here, they
@@ -328,8 +342,12 @@ struct os_handler_s
 			  unsigned char *data);
     /* Sets the filename to use for the database to the one specified.
        The meaning is system-dependent.  On *nix systems it defaults
-       to $HOME/.OpenIPMI_db.  This is for use by the user, OpenIPMI
-       proper does not use this. */
+       to $HOME/.OpenIPMI_db.  On the POSIX handlers, a name that
+       starts with "map:" keeps the items in the database_map()
+       directory instead of gdbm, where finds map them in place and
+       any number of processes can read them at once; that is also
+       what is used when gdbm is not available.  This is for use by
+       the user, OpenIPMI proper does not use this. */
     int (*database_set_filename)(os_handler_t *handler,
 				 char         *name);
 
@@ -347,6 +365,72 @@ struct os_handler_s
 
     int (*get_monotonic_time)(os_handler_t *handler, struct timeval *tv);
     int (*get_real_time)(os_handler_t *handler, struct timeval *tv);
+
+    /* Some OS handlers run more than one reactor, an event loop with
+       its own fds, timers and locks.  These return the number of
+       reactors and put an fd or timer on a specific one, so things
+       that work together (like a socket and the timers for its
+       messages) get handled by the same threads.  The fd and timer
+       are used and freed with the normal calls.  These may be NULL,
+       which means there is only one reactor. */
+    unsigned int (*get_num_reactors)(os_handler_t *handler);
+    int (*add_fd_to_wait_for_reactor)(os_handler_t       *handler,
+				      unsigned int       reactor,
+				      int                fd,
+				      os_data_ready_t    data_ready,
+				      void               *cb_data,
+				      os_fd_data_freed_t freed,
+				      os_hnd_fd_id_t     **id);
+    int (*alloc_timer_reactor)(os_handler_t      *handler,
+			       unsigned int      reactor,
+			       os_hnd_timer_id_t **id);
+
+    /* A pool of worker threads for running callbacks that may take a
+       while, so they don't hold up the threads doing I/O.  Work is
+       put on a work queue.  The work on a queue runs in order, one at
+       a time, and different queues run in parallel.  start_workers()
+       starts the pool; until it is called alloc_work_queue() returns
+       ENOSYS and callers should just do the work inline.  Freeing a
+       queue lets the work already on it finish first.  These may be
+       NULL if the OS handler has no pool. */
+    int (*start_workers)(os_handler_t *handler, unsigned int num_workers);
+    int (*alloc_work_queue)(os_handler_t        *handler,
+			    os_hnd_work_queue_t **queue);
+    int (*free_work_queue)(os_handler_t        *handler,
+			   os_hnd_work_queue_t *queue);
+    int (*queue_work)(os_handler_t        *handler,
+		      os_hnd_work_queue_t *queue,
+		      os_work_t           work,
+		      void                *cb_data);
+
+    /* A database of items that can be mapped in place.  An item
+       stored with database_map_store() can be mapped read-only by
+       database_map() instead of being copied, so it loads quickly
+       and processes using the same database share the memory.
+       Replacing an item doesn't change the data for anyone that has
+       it mapped.  The data from database_map() must not be written
+       and stays valid until database_unmap() is called with the
+       returned map.  The items are separate from the ones in
+       database_store()/database_find(), but
+       database_set_filename() sets where both are kept.  These may be
+       NULL. */
+    int (*database_map_store)(os_handler_t  *handler,
+			      char          *key,
+			      unsigned char *data,
+			      unsigned int  data_len);
+    int (*database_map)(os_handler_t  *handler,
+			char          *key,
+			unsigned char **data,
+			unsigned int  *data_len,
+			void          **map);
+    void (*database_unmap)(os_handler_t *handler, void *map);
+
+    /* Like get_monotonic_time, but may return a time read a little
+       earlier, like at the start of the current pass through the
+       event loop, to save reading the clock for every timestamp.
+       May be NULL. */
+    int (*get_cached_monotonic_time)(os_handler_t *handler,
+				     struct timeval *tv);
 };
 
 /* Only use these to allocate/free OS handlers. */
@@ -55,6 +55,53 @@ int sel_alloc_selector_thread(selector_t **new_selector, int wake_sig,
 			      void (*sel_unlock)(sel_lock_t *),
 			      void *cb_data);
 
+/* Like the above, but with flags to change how the selector works.
+   SEL_FLAG_TIMER_WHEEL keeps timers in a hierarchical timer wheel
+   with 1ms ticks instead of a heap, making starting and stopping
+   timers constant time for programs with lots of them.  Timers may
+   go off up to a tick late, and timers that expire in the same tick
+   are not run in any particular order. */
+#define SEL_FLAG_TIMER_WHEEL	(1 << 0)
+/* SEL_FLAG_IO_URING waits for fds with io_uring instead of epoll, so
+   re-arming an fd after its handler runs doesn't take a system call
+   and one wait can return many events.  If io_uring isn't compiled in
+   or the kernel doesn't support it, epoll is used.  Setting the
+   OPENIPMI_SEL_IO_URING environment variable turns this on for all
+   selectors. */
+#define SEL_FLAG_IO_URING	(1 << 1)
+/* SEL_FLAG_SELECT uses select() even if epoll is available, mostly
+   for comparing the two.  It overrides SEL_FLAG_IO_URING. */
+#define SEL_FLAG_SELECT		(1 << 2)
+int sel_alloc_selector_thread_flags(selector_t **new_selector, int wake_sig,
+				    sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+				    void (*sel_lock_free)(sel_lock_t *),
+				    void (*sel_lock)(sel_lock_t *),
+				    void (*sel_unlock)(sel_lock_t *),
+				    void *cb_data,
+				    unsigned int flags);
+
+/* Create a selector with num_reactors reactors.  Each reactor is a
+   complete threaded selector with its own epoll set, timers and
+   locks, so threads running different reactors do not contend with
+   each other.  The returned selector is reactor 0, use
+   sel_get_reactor() to get the others and put fds and timers on them
+   by passing that selector to the normal calls.  Every reactor must
+   have at least one thread calling sel_select() on it.  Freeing the
+   returned selector frees all the reactors. */
+int sel_alloc_selector_reactors(selector_t **new_selector,
+				unsigned int num_reactors, int wake_sig,
+				sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+				void (*sel_lock_free)(sel_lock_t *),
+				void (*sel_lock)(sel_lock_t *),
+				void (*sel_unlock)(sel_lock_t *),
+				void *cb_data,
+				unsigned int flags);
+/* The number of reactors, 1 for a normal selector. */
+unsigned int sel_num_reactors(selector_t *sel);
+/* Get a reactor by number, NULL if out of range.  Any reactor of
+   the selector may be passed in. */
+selector_t *sel_get_reactor(selector_t *sel, unsigned int reactor);
+
   /* Create a selector for use in a single-threaded environment.  No
      need for locks or wakeups.  This just call the above call with
      NULL for all the values. */
@@ -122,6 +169,17 @@ int sel_stop_timer_with_done(sel_timer_t *timer,
 /* Use this for times provided to sel_start_time() */
 void sel_get_monotonic_time(struct timeval *tv);
 
+/* Like sel_get_monotonic_time(), but from a handler called by
+   sel_select() this returns the time read at the start of the
+   handling (after waiting) instead of reading the clock each time.
+   Use it where being off by the time the handlers take doesn't
+   matter, like starting timers.  Outside of sel_select() (or without
+   thread-local storage) it reads the clock.
+   sel_refresh_monotonic_time() reads the clock and updates the value
+   the following sel_get_cached_monotonic_time() calls return. */
+void sel_get_cached_monotonic_time(struct timeval *tv);
+void sel_refresh_monotonic_time(struct timeval *tv);
+
 typedef struct sel_runner_s sel_runner_t;
 typedef void (*sel_runner_func_t)(sel_runner_t *runner, void *cb_data);
 int sel_alloc_runner(selector_t *sel, sel_runner_t **new_runner);
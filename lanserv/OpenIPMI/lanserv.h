@@ -64,10 +64,11 @@ extern "C" {
 #endif
 
 /*
- * Restrictions: <=64 sessions
+ * The default for the maximum number of sessions on a LAN channel, it
+ * can be raised with max_sessions in the config.  The session table
+ * grows as needed up to the maximum.
  */
-#define SESSION_BITS_REQ	6 /* Bits required to hold a session. */
-#define SESSION_MASK		0x3f
+#define DEFAULT_MAX_SESSIONS	MAX_SESSIONS
 
 typedef struct session_s session_t;
 typedef struct lanserv_data_s lanserv_data_t;
@@ -112,10 +113,11 @@ typedef struct auth_data_s
     unsigned char role;
     unsigned char username_len;
     unsigned char username[16];
-    unsigned char sik[20];
-    unsigned char k1[20];
-    unsigned char k2[20];
+    unsigned char sik[32];
+    unsigned char k1[32];
+    unsigned char k2[32];
     unsigned int  akey_len;
+    unsigned int  ukey_len;
     unsigned int  integ_len;
     void          *adata;
     const void    *akey;
@@ -135,9 +137,19 @@ struct session_s
     unsigned int active : 1;
     unsigned int in_startup : 1;
     unsigned int rmcpplus : 1;
+    unsigned int cleanup_pending : 1;
+
+    /* The number of threads checking a message for the session
+       without the lock.  A close while this is set leaves the keys
+       and the slot for the last of them to clean up. */
+    unsigned int in_use;
 
     int           handle; /* My index in the table. */
 
+    /* Chains active sessions in the sid hash and free ones in the
+       free list. */
+    session_t     *next;
+
     uint32_t        recv_seq;
     uint32_t        xmit_seq;
     uint32_t        sid;
@@ -162,8 +174,11 @@ struct session_s
     unsigned char priv;
     unsigned char max_priv;
 
-    /* The number of seconds left before the session is shut down. */
-    unsigned int time_left;
+    /* The monotonic time (in seconds) the session is shut down at if
+       nothing comes in for it.  Active sessions are kept in the lan's
+       expiry list in order of this. */
+    long      expires;
+    session_t *exp_next, *exp_prev;
 
     /* Address of the message that started the sessions. */
     void *src_addr;
@@ -250,8 +265,26 @@ struct lanserv_data_s
 
     /* Don't fill in the below in the user code. */
 
-    /* session 0 is not used. */
-    session_t sessions[MAX_SESSIONS+1];
+    /* The maximum number of sessions, set from the config. */
+    unsigned int max_sessions;
+
+    /* Sessions by handle, grown as needed.  Session 0 is not used. */
+    session_t **sessions;
+    unsigned int sessions_len;
+    session_t *free_sessions;
+
+    /* Active sessions in the order they time out.  Every session gets
+       the same timeout from the time of its last message, so one that
+       has a message is just moved to the end.  If the system has
+       timers, expiry_timer is run for the first session's timeout,
+       otherwise the tick handler checks the front of the list. */
+    session_t *exp_head, *exp_tail;
+    ipmi_timer_t *expiry_timer;
+    int expiry_timer_running;
+
+    /* Active sessions hashed by sid, the size is a power of 2. */
+    session_t **sid_hash;
+    unsigned int sid_hash_size;
 
     /* Used to make the sid somewhat unique. */
     uint32_t sid_seq;
@@ -259,6 +292,16 @@ struct lanserv_data_s
     ipmi_authdata_t challenge_auth;
     unsigned int next_challenge_seq;
 
+    /*
+     * Get Channel Authentication Capabilities responses (without the
+     * OEM id) by RMCP+ and privilege level, valid if the privilege's
+     * bit is set in auth_caps_valid and auth_caps_gen matches the
+     * sysinfo users_gen.
+     */
+    uint8_t auth_caps_rsp[2][NUM_PRIV_LEVEL][5];
+    uint8_t auth_caps_valid[2];
+    unsigned int auth_caps_gen;
+
     lanparm_data_t lanparm;
     unsigned char lanparm_changed[lanread_len];
     unsigned int persist_changed;
@@ -267,16 +310,53 @@ struct lanserv_data_s
     /* Used to access and set the external LAN config items. */
     const char *config_prog;
 
+    /* In-process replacement for config_prog, see below. */
+    int (*config_get)(lanserv_data_t *lan, unsigned int item,
+		      lanparm_data_t *lanparm, void *cb_data);
+    int (*config_set)(lanserv_data_t *lan, unsigned char *changed,
+		      lanparm_data_t *lanparm, void *cb_data);
+    int (*config_check)(lanserv_data_t *lan, unsigned int item,
+			lanparm_data_t *lanparm, void *cb_data);
+    void *config_cb_data;
+
     lan_addr_t lan_addr;
     int lan_addr_set;
     uint16_t port;
+
+    /*
+     * ASF presence pings are answered from the receive path without
+     * taking the lock, see handle_asf().  The pong is the same every
+     * time except for the message tag, so it is built once.  At most
+     * asf_ping_limit pings are answered each second, the rest are
+     * dropped.  The counters are only written by the receive path.
+     */
+    unsigned int asf_ping_limit;
+    uint8_t asf_pong[28];
+    long asf_ping_sec;
+    unsigned int asf_ping_this_sec;
+    unsigned long asf_pings;
+    unsigned long asf_pongs;
+    unsigned long asf_ping_dropped;
 };
 
 
+/*
+ * Handle an RMCP message of the ASF class.  This does not need the
+ * lock, and it only touches ASF data in lan, so it can be called
+ * directly from where packets are received, as long as only one
+ * thread receives for the interface.
+ */
 void handle_asf(lanserv_data_t *lan,
 		unsigned char *data, int len,
 		void *from_addr, int from_len);
 
+/* Build the ASF pong, called by ipmi_lan_init(). */
+void ipmi_lan_asf_init(lanserv_data_t *lan);
+
+/*
+ * Handle a received LAN message.  If the system has lock functions,
+ * call this without the lock held, it takes it as needed.
+ */
 void ipmi_handle_lan_msg(lanserv_data_t *lan,
 			 unsigned char *data, int len,
 			 void *from_addr, int from_len);
@@ -289,6 +369,32 @@ int lanserv_read_config(sys_data_t   *sys,
 
 int ipmi_lan_init(lanserv_data_t *lan);
 
+/*
+ * Handle the external LAN config items (the lanread_e values) in
+ * process instead of running the lan_config_program for each access.
+ * This is generally called from a loadlib module's
+ * ipmi_sim_module_post_init(), the lanserv_data_t is the chan_info of
+ * the LAN channel.  get() fills in the given item in lanparm, set()
+ * writes every item whose entry in changed (lanread_len long) is set,
+ * check() returns non-zero if the value of the item in lanparm is not
+ * supported.  Any of them may be NULL to keep using the program for
+ * that operation.
+ */
+void ipmi_lan_set_config_func(lanserv_data_t *lan,
+			      int (*get)(lanserv_data_t *lan,
+					 unsigned int item,
+					 lanparm_data_t *lanparm,
+					 void *cb_data),
+			      int (*set)(lanserv_data_t *lan,
+					 unsigned char *changed,
+					 lanparm_data_t *lanparm,
+					 void *cb_data),
+			      int (*check)(lanserv_data_t *lan,
+					   unsigned int item,
+					   lanparm_data_t *lanparm,
+					   void *cb_data),
+			      void *cb_data);
+
 typedef void (*ipmi_payload_handler_cb)(lanserv_data_t *lan, msg_t *msg);
 
 int ipmi_register_payload(unsigned int payload_id,
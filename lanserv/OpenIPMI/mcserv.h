@@ -107,6 +107,7 @@ int ipmi_mc_alloc_unconfigured(sys_data_t *sys, unsigned char ipmb,
 
 unsigned char ipmi_mc_get_ipmb(lmc_data_t *mc);
 channel_t **ipmi_mc_get_channelset(lmc_data_t *mc);
+sys_data_t *ipmi_mc_get_sysinfo(lmc_data_t *mc);
 ipmi_sol_t *ipmi_mc_get_sol(lmc_data_t *mc);
 startcmd_t *ipmi_mc_get_startcmdinfo(lmc_data_t *mc);
 user_t *ipmi_mc_get_users(lmc_data_t *mc);
@@ -141,6 +142,21 @@ int ipmi_mc_add_device_sdr(lmc_data_t    *mc,
 			   unsigned char *data,
 			   unsigned int  data_len);
 
+/*
+ * Binary SDR images, as written by "sdrcomp -b".  The header is the
+ * magic, then the version, the number of SDRs, and the length of the
+ * SDR data as 32-bit little endian values.  The SDRs follow back to
+ * back.  The image is mapped and the SDRs used in place, so loading
+ * the same image into many MCs costs nothing extra.  The record ids
+ * in the image must not already be in use.  Use a lun of -1 for the
+ * main SDR repository.
+ */
+#define IPMI_SDR_IMAGE_MAGIC	"OIPMISDR"
+#define IPMI_SDR_IMAGE_VERSION	1
+#define IPMI_SDR_IMAGE_HDR_LEN	20
+
+int ipmi_mc_load_sdr_image(lmc_data_t *mc, int lun, const char *filename);
+
 enum fru_io_cb_op { FRU_IO_READ, FRU_IO_WRITE };
 
 typedef int (*fru_io_cb)(void *cb_data,
@@ -214,6 +230,19 @@ int ipmi_mc_sensor_set_value(lmc_data_t    *mc,
 			     unsigned char value,
 			     int           gen_event);
 
+/*
+ * Generate events at the given rate (per second) for the given time
+ * (in seconds, 0 is forever) by toggling a bit in the sensors, in
+ * turn.  Sensors are given as (lun << 8) | num, if there are none
+ * all the MC's sensors are used.  A rate of 0 stops a storm.
+ */
+int ipmi_mc_sensor_storm(lmc_data_t    *mc,
+			 unsigned int  rate,
+			 unsigned int  duration,
+			 unsigned char bit,
+			 unsigned int  num_sensors,
+			 uint16_t      *sensors);
+
 int ipmi_mc_sensor_set_hysteresis(lmc_data_t    *mc,
 				  unsigned char lun,
 				  unsigned char sens_num,
@@ -284,11 +313,55 @@ int ipmi_mc_add_polled_sensor(lmc_data_t    *mc,
 					  const char **errstr),
 			      void *cb_data);
 
+/*
+ * A sensor group reads a set of existing sensors with one call.  Every
+ * period (in milliseconds) read() is called with a value and an error
+ * slot for each sensor, in the order they were added.  It fills in
+ * the value of each sensor it could read and sets the error for the
+ * ones it could not.  The sensors are then all updated, and events
+ * generated, in one pass.  Groups with the same period are polled
+ * together from one timer.  read() is called from the main loop, so
+ * it should not block for long.
+ */
+typedef struct ipmi_sensor_group_s ipmi_sensor_group_t;
+
+int ipmi_mc_alloc_sensor_group(lmc_data_t   *mc,
+			       unsigned int period,
+			       void (*read)(void *cb_data,
+					    unsigned int num_sensors,
+					    unsigned int *vals,
+					    int *errs),
+			       void *cb_data,
+			       ipmi_sensor_group_t **group);
+int ipmi_sensor_group_add_sensor(ipmi_sensor_group_t *group,
+				 unsigned char lun,
+				 unsigned char sens_num);
+void ipmi_sensor_group_free(ipmi_sensor_group_t *group);
+
 int ipmi_mc_set_power(lmc_data_t *mc, unsigned char power, int gen_int);
 
 int ipmi_mc_set_num_leds(lmc_data_t   *mc,
 			 unsigned int count);
 
+/*
+ * ATCA FRUs of an MC, FRU 0 is the MC itself.  The bulk calls work on
+ * FRUs first through last.  ipmi_mc_set_fru_led takes the LED function
+ * and color as in the PICMG Set FRU LED State command.
+ */
+int ipmi_mc_set_num_frus(lmc_data_t *mc, unsigned int count);
+int ipmi_mc_set_fru_hs_state(lmc_data_t   *mc,
+			     unsigned int first,
+			     unsigned int last,
+			     unsigned int state,
+			     int          gen_event);
+int ipmi_mc_set_fru_led(lmc_data_t    *mc,
+			unsigned int  first,
+			unsigned int  last,
+			unsigned int  led,
+			unsigned char off_dur,
+			unsigned char on_dur,
+			unsigned char color);
+
 void ipmi_emu_set_device_id(lmc_data_t *emu, unsigned char device_id);
 unsigned char ipmi_emu_get_device_id(lmc_data_t *emu);
 void ipmi_set_has_device_sdrs(lmc_data_t *emu, unsigned char has_device_sdrs);
@@ -66,6 +66,22 @@ int write_persist(persist_t *p);
 int write_persist_file(persist_t *p, FILE *f);
 void free_persist(persist_t *p);
 
+/*
+ * Append the items in p to the journal of the persist with the same
+ * name instead of rewriting it.  Items replace ones with the same
+ * name, add_persist_del() items remove them.  read_persist() returns
+ * the file with the journal applied, write_persist() replaces both.
+ */
+int journal_persist(persist_t *p);
+int add_persist_del(persist_t *p, const char *name, ...);
+
+/* Sync journal writes to disk, they are only synced every
+   persist_journal_sync_count records otherwise.  A journal is folded
+   into its file when it gets persist_journal_max records. */
+void persist_sync(void);
+extern int persist_journal_sync_count;
+extern int persist_journal_max;
+
 int add_persist_data(persist_t *p, void *data, unsigned int len,
 		     const char *name, ...);
 int read_persist_data(persist_t *p, void **data, unsigned int *len,
@@ -96,5 +112,7 @@ void free_persist_str(char *str);
 
 /* Can be set to zero to disable persistence. */
 extern int persist_enable;
+/* Set to keep the persist command from turning persistence on. */
+extern int persist_locked_off;
 
 #endif /* __PERSIST_H__ */
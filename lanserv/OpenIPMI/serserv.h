@@ -68,6 +68,13 @@ typedef struct ser_codec_s {
     int (*setup)(serserv_data_t *si);
     void (*connected)(serserv_data_t *si);
     void (*disconnected)(serserv_data_t *si);
+
+    /*
+     * Optional, handle a block of received data at once.  If NULL,
+     * handle_char() is called for each byte.
+     */
+    void (*handle_data)(unsigned char *data, unsigned int len,
+			serserv_data_t *si);
 } ser_codec_t;
 
 typedef struct ser_oem_handler_s {
@@ -105,6 +112,7 @@ struct serserv_data_s {
     /* Settings */
     int           debug;
     unsigned int  do_connect : 1;
+    unsigned int  shared : 1; /* Fleet nodes share one listening socket */
     unsigned int  echo : 1;
     unsigned int  do_attn : 1;
     unsigned char my_ipmb;
@@ -62,6 +62,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 #include <arpa/nameser.h>
 #include <resolv.h>
 #include <netdb.h>
@@ -135,8 +136,9 @@ struct channel_s
     unsigned int privilege_limit : 4;
     unsigned int privilege_limit_nonv : 4;
 
+    /* The most sessions IPMI can report for a channel. */
 #define MAX_SESSIONS 63
-    unsigned int active_sessions : 6;
+    unsigned int active_sessions;
 
     struct {
 	unsigned char allowed_auths;
@@ -162,6 +164,9 @@ struct channel_s
     /* Available for the specific channel code. */
     void *chan_info;
 
+    /* Response fault injection, see chan_fault_config().  NULL if off. */
+    struct chan_fault_s *fault;
+
     /* Set or clear the attn flag.  If irq is set, set/clear the irq. */
     void (*set_atn)(channel_t *chan, int val, int irq);
 
@@ -291,6 +296,7 @@ typedef struct sockaddr_ip_s {
 #ifdef PF_INET6
             struct sockaddr_in6 s_addr6;
 #endif
+            struct sockaddr_un  s_addrun;
         } s_ipsock;
 /*    socklen_t addr_len;*/
 } sockaddr_ip_t;
@@ -405,6 +411,23 @@ struct sys_data_s {
     void (*cfree)(channel_t *chan, void *data);
     int (*lan_channel_init)(void *info, channel_t *chan);
     int (*ser_channel_init)(void *info, channel_t *chan);
+
+    /*
+     * Set these if messages are handled in more than one thread.  The
+     * lock protects all the emulator and server state and must be
+     * recursive.  The LAN code takes it itself, so the receive path
+     * can check and decrypt messages for established sessions in
+     * parallel; everything else is done with it held.  NULL if there
+     * is only one thread.
+     */
+    void (*lock)(sys_data_t *sys);
+    void (*unlock)(sys_data_t *sys);
+
+    /*
+     * Incremented when a user is changed, so cached responses that
+     * depend on the users can tell they are stale.
+     */
+    unsigned int users_gen;
 };
 
 static inline void
@@ -470,6 +493,26 @@ void ipmi_do_kill(startcmd_t *startcmd, int noblock);
 int chan_init(channel_t *chan);
 void sysinfo_init(sys_data_t *sys);
 
+/*
+ * Inject faults into the responses from the MC going out a channel,
+ * for testing how clients handle slow or lossy BMCs.  The tokens are
+ * "off" or any of:
+ *   delay=<ms>         Delay every response this long.
+ *   jitter=<ms>        Add a random delay, uniform up to this long...
+ *   jitter_dist=<d>    ...or, if this is "exp", exponential with this
+ *                      mean.  The default is "uniform".
+ *   loss=<percent>     Drop this many responses.
+ *   dup=<percent>      Send this many responses twice.
+ *   reorder=<percent>  Hold this many responses up to reorder_delay
+ *                      more, so later ones may pass them.
+ *   reorder_delay=<ms> The default is 100.
+ *   seed=<n>           Seed the random numbers, for repeatable runs.
+ * Settings not given are reset.  Responses the LAN code makes itself,
+ * for session setup, are not affected.
+ */
+int chan_fault_config(sys_data_t *sys, channel_t *chan, char **toks,
+		      const char **errstr);
+
 
 #define MAX_CONFIG_LINE 1024
 
@@ -44,6 +44,7 @@
 #include <OpenIPMI/ipmi_mc.h>
 #include <OpenIPMI/ipmi_lan.h>
 #include <OpenIPMI/extcmd.h>
+#include <OpenIPMI/persist.h>
 
 static void ipmi_mc_start_cmd(lmc_data_t *mc);
 
@@ -152,24 +153,11 @@ handle_iana_netfn(lmc_data_t    *mc,
     *rdata_len += 3;
 }
 
+/* Indexed by command, handler is NULL if not registered. */
 static struct oi_iana_cmd_elem {
-    uint8_t cmd;
     cmd_handler_f handler;
     void *cb_data;
-    struct oi_iana_cmd_elem *next;
-} *oi_iana_cmds;
-
-static struct oi_iana_cmd_elem *find_oi_iana(uint8_t cmd)
-{
-    struct oi_iana_cmd_elem *p = oi_iana_cmds;
-
-    while (p) {
-	if (p->cmd == cmd)
-	    return p;
-	p = p->next;
-    }
-    return NULL;
-}
+} oi_iana_cmds[256];
 
 static void handle_oi_iana_cmd(lmc_data_t    *mc,
 			       msg_t         *msg,
@@ -177,10 +165,9 @@ static void handle_oi_iana_cmd(lmc_data_t    *mc,
 			       unsigned int  *rdata_len,
 			       void          *cb_data)
 {
-    struct oi_iana_cmd_elem *p;
+    struct oi_iana_cmd_elem *p = &oi_iana_cmds[msg->cmd];
 
-    p = find_oi_iana(msg->cmd);
-    if (!p) {
+    if (!p->handler) {
 	handle_invalid_cmd(mc, rdata, rdata_len);
 	return;
     }
@@ -192,23 +179,16 @@ int
 ipmi_emu_register_oi_iana_handler(uint8_t cmd, cmd_handler_f handler,
 				  void *cb_data)
 {
-    struct oi_iana_cmd_elem *p;
     int rv;
 
-    if (find_oi_iana(cmd))
+    if (oi_iana_cmds[cmd].handler)
 	return EAGAIN;
     rv = ipmi_emu_register_iana_handler(OPENIPMI_IANA, handle_oi_iana_cmd,
 					NULL);
     if (rv != 0 && rv != EAGAIN)
 	return rv;
-    p = malloc(sizeof(*p));
-    if (!p)
-	return ENOMEM;
-    p->cmd = cmd;
-    p->handler = handler;
-    p->cb_data = cb_data;
-    p->next = oi_iana_cmds;
-    oi_iana_cmds = p;
+    oi_iana_cmds[cmd].handler = handler;
+    oi_iana_cmds[cmd].cb_data = cb_data;
     return 0;
 }
 
@@ -226,6 +206,9 @@ typedef struct netfn_handler_s {
     int (*check_capable)(lmc_data_t *mc);
 } netfn_handler_t;
 
+/* Incremented when a command handler is registered. */
+static unsigned int dispatch_gen = 1;
+
 static netfn_handler_t netfn_handlers[32] = {
     [IPMI_APP_NETFN >> 1] = { .handlers = app_netfn_handlers },
     [IPMI_STORAGE_NETFN >> 1] = { .handlers = storage_netfn_handlers },
@@ -262,11 +245,95 @@ ipmi_emu_register_cmd_handler(unsigned char netfn, unsigned char cmd,
 
     netfn_handlers[ni].cb_data[cmd] = cb_data;
     netfn_handlers[ni].handlers[cmd] = handler;
+    dispatch_gen++;
     return 0;
 }
 
+/*
+ * The netfn table above, flattened so a message is dispatched with
+ * one indexed load and a call.  There is one table for MCs with
+ * chassis support and one for those without, each MC points to the
+ * one it uses.  They are rebuilt if a handler is registered after
+ * they were built.
+ */
+typedef struct emu_dispatch_s {
+    cmd_handler_f handler;
+    void          *cb_data;
+} emu_dispatch_t;
+
+static emu_dispatch_t *dispatch_tables[2];
+static unsigned int dispatch_built_gen[2];
+
+static void
+dispatch_invalid_cmd(lmc_data_t    *mc,
+		     msg_t         *msg,
+		     unsigned char *rdata,
+		     unsigned int  *rdata_len,
+		     void          *cb_data)
+{
+    handle_invalid_cmd(mc, rdata, rdata_len);
+}
+
+static emu_dispatch_t *
+get_dispatch_table(int chassis_capable)
+{
+    emu_dispatch_t *t = dispatch_tables[chassis_capable];
+    unsigned int ni, cmd;
+
+    if (t && dispatch_built_gen[chassis_capable] == dispatch_gen)
+	return t;
+
+    if (!t) {
+	t = malloc(32 * 256 * sizeof(*t));
+	if (!t)
+	    return NULL;
+	dispatch_tables[chassis_capable] = t;
+    }
+
+    for (ni = 0; ni < 32; ni++) {
+	netfn_handler_t *n = &netfn_handlers[ni];
+
+	for (cmd = 0; cmd < 256; cmd++, t++) {
+	    t->handler = dispatch_invalid_cmd;
+	    t->cb_data = NULL;
+	    if (n->check_capable && !chassis_capable)
+		continue;
+	    if (n->main_handler) {
+		t->handler = n->main_handler;
+		t->cb_data = n->main_handler_cb_data;
+	    } else if (n->handlers && n->handlers[cmd]) {
+		t->handler = n->handlers[cmd];
+		if (n->cb_data)
+		    t->cb_data = n->cb_data[cmd];
+	    }
+	}
+    }
+    dispatch_built_gen[chassis_capable] = dispatch_gen;
+    return dispatch_tables[chassis_capable];
+}
+
+static void
+mc_set_dispatch(lmc_data_t *mc)
+{
+    mc->dispatch = get_dispatch_table(check_chassis_capable(mc) != 0);
+    mc->dispatch_gen = dispatch_gen;
+}
+
+/* Emulators that have something for the tick to do. */
+static emu_data_t *tick_pending;
+
 void
-ipmi_emu_tick(emu_data_t *emu, unsigned int seconds)
+ipmi_emu_need_tick(emu_data_t *emu)
+{
+    if (emu->tick_pending)
+	return;
+    emu->tick_pending = 1;
+    emu->tick_next = tick_pending;
+    tick_pending = emu;
+}
+
+static void
+emu_tick(emu_data_t *emu, unsigned int seconds)
 {
     if (emu->atca_fru_inv_locked) {
 	emu->atca_fru_inv_lock_timeout -= seconds;
@@ -283,6 +350,33 @@ ipmi_emu_tick(emu_data_t *emu, unsigned int seconds)
     }
 }
 
+void
+ipmi_emu_tick(emu_data_t *emu, unsigned int seconds)
+{
+    emu_tick(emu, seconds);
+
+    /* Group commit for journaled SEL and SDR changes. */
+    persist_sync();
+}
+
+void
+ipmi_emu_tick_pending(unsigned int seconds)
+{
+    emu_data_t *emu, *next;
+
+    emu = tick_pending;
+    tick_pending = NULL;
+    for (; emu; emu = next) {
+	next = emu->tick_next;
+	emu->tick_pending = 0;
+	emu_tick(emu, seconds);
+	if (emu->atca_fru_inv_locked || emu->users_changed)
+	    ipmi_emu_need_tick(emu);
+    }
+
+    persist_sync();
+}
+
 void
 ipmi_emu_handle_msg(emu_data_t    *emu,
 		    lmc_data_t    *srcmc,
@@ -378,21 +472,18 @@ ipmi_emu_handle_msg(emu_data_t    *emu,
 	msg = omsg;
     }
 
-    if (netfn_handlers[msg->netfn >> 1].check_capable &&
-	!netfn_handlers[msg->netfn >> 1].check_capable(mc))
-	handle_invalid_cmd(mc, rdata, rdata_len);
-    else if (netfn_handlers[msg->netfn >> 1].main_handler)
-	netfn_handlers[msg->netfn >> 1].main_handler(mc, msg, rdata, rdata_len,
-			 netfn_handlers[msg->netfn >> 1].main_handler_cb_data);
-    else if (netfn_handlers[msg->netfn >> 1].handlers &&
-	     netfn_handlers[msg->netfn >> 1].handlers[msg->cmd]) {
-	void *cb_data = NULL;
-	if (netfn_handlers[msg->netfn >> 1].cb_data)
-	    cb_data = netfn_handlers[msg->netfn >> 1].cb_data[msg->cmd];
-	netfn_handlers[msg->netfn >> 1].handlers[msg->cmd](mc, msg, rdata,
-		 rdata_len, cb_data);
-    } else
-	handle_invalid_cmd(mc, rdata, rdata_len);
+    if (mc->dispatch_gen != dispatch_gen)
+	mc_set_dispatch(mc);
+    if (mc->dispatch) {
+	emu_dispatch_t *d = &mc->dispatch[((msg->netfn >> 1) & 0x1f) * 256
+					  + msg->cmd];
+
+	d->handler(mc, msg, rdata, rdata_len, d->cb_data);
+    } else {
+	/* Out of memory for the table. */
+	rdata[0] = IPMI_OUT_OF_SPACE_CC;
+	*rdata_len = 1;
+    }
 
     if (omsg->netfn == IPMI_APP_NETFN && omsg->cmd == IPMI_SEND_MSG_CMD) {
 	/* An encapsulated command, put the response into the receive q. */
@@ -510,7 +601,8 @@ ipmi_emu_get_user_data(emu_data_t *emu)
 void
 ipmi_mc_destroy(lmc_data_t *mc)
 {
-    sel_entry_t *entry, *n_entry;
+    sel_entry_t  *entry, *n_entry;
+    unsigned int i;
 
     entry = mc->sel.entries;
     while (entry) {
@@ -518,6 +610,14 @@ ipmi_mc_destroy(lmc_data_t *mc)
 	free(entry);
 	entry = n_entry;
     }
+    ipmi_mc_stop_sensor_storm(mc);
+    ipmi_mc_free_sensor_groups(mc);
+    recid_index_free(&mc->sel.index);
+    recid_index_free(&mc->main_sdrs.index);
+    for (i = 0; i < 4; i++)
+	recid_index_free(&mc->device_sdrs[i].index);
+    if (mc->picmg_frus != &mc->picmg_fru0)
+	free(mc->picmg_frus);
     free(mc);
 }
 
@@ -545,6 +645,7 @@ ipmi_mc_enable(lmc_data_t *mc)
     sys_data_t *sys = mc->sysinfo;
 
     mc->enabled = 1;
+    mc_set_dispatch(mc);
 
     for (i = 0; i < IPMI_MAX_CHANNELS; i++) {
 	channel_t *chan = mc->channels[i];
@@ -582,12 +683,15 @@ int
 ipmi_mc_set_num_leds(lmc_data_t   *mc,
 		     unsigned int count)
 {
+    unsigned int i;
+
     if (count > MAX_LEDS)
 	return EINVAL;
     if (mc->emu->atca_mode && (count < MIN_ATCA_LEDS))
 	return EINVAL;
 
-    mc->num_leds = count;
+    for (i=0; i<mc->num_picmg_frus; i++)
+	mc->picmg_frus[i].num_leds = count;
     return 0;
 }
 
@@ -643,6 +747,19 @@ chan_start_cmd(channel_t *chan)
     ipmi_mc_start_cmd(chan->mc);
 }
 
+static void
+start_poweroff_timer(lmc_data_t *mc)
+{
+    struct timeval tv;
+
+    if (!mc->poweroff_timer || mc->poweroff_timer_running)
+	return;
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    if (!mc->sysinfo->start_timer(mc->poweroff_timer, &tv))
+	mc->poweroff_timer_running = 1;
+}
+
 static void
 ipmi_mc_stop_cmd(lmc_data_t *mc, int do_it_now)
 {
@@ -653,6 +770,7 @@ ipmi_mc_stop_cmd(lmc_data_t *mc, int do_it_now)
 	mc->startcmd.wait_poweroff = mc->startcmd.poweroff_wait_time;
     else
 	mc->startcmd.wait_poweroff = 1; /* Just power off now. */
+    start_poweroff_timer(mc);
 }
 
 static void
@@ -667,6 +785,12 @@ ipmi_mc_get_channelset(lmc_data_t *mc)
     return mc->channels;
 }
 
+sys_data_t *
+ipmi_mc_get_sysinfo(lmc_data_t *mc)
+{
+    return mc->sysinfo;
+}
+
 ipmi_sol_t *
 ipmi_mc_get_sol(lmc_data_t *mc)
 {
@@ -727,6 +851,8 @@ ipmi_mc_alloc_unconfigured(sys_data_t *sys, unsigned char ipmb,
 	return ENOMEM;
     memset(mc, 0, sizeof(*mc));
     mc->ipmb = ipmb;
+    mc->picmg_frus = &mc->picmg_fru0;
+    mc->num_picmg_frus = 1;
     sys->ipmb_addrs[ipmb] = mc;
 
     mc->startcmd.poweroff_wait_time = 60;
@@ -811,6 +937,17 @@ handle_tick(void *info, unsigned int seconds)
     }
 }
 
+static void
+poweroff_timeout(void *cb_data)
+{
+    lmc_data_t *mc = cb_data;
+
+    mc->poweroff_timer_running = 0;
+    handle_tick(mc, 1);
+    if (mc->startcmd.wait_poweroff)
+	start_poweroff_timer(mc);
+}
+
 static void
 handle_child_quit(void *info, pid_t pid)
 {
@@ -857,6 +994,7 @@ ipmi_emu_add_mc(emu_data_t    *emu,
     mc->dynamic_sensor_population = flags & IPMI_MC_DYNAMIC_SENSOR_POPULATION;
     memcpy(mc->mfg_id, mfg_id, 3);
     memcpy(mc->product_id, product_id, 2);
+    mc_device_id_changed(mc);
 
     /* Enable the event log by default. */
     mc->global_enables = 1 << IPMI_MC_EVENT_LOG_BIT;
@@ -875,26 +1013,28 @@ ipmi_emu_add_mc(emu_data_t    *emu,
     mc->event_receiver = sys->bmc_ipmb;
     mc->event_receiver_lun = 0;
 
-    mc->hs_sensor = NULL;
+    mc->picmg_frus[0].hs_sensor = NULL;
 
     if (emu->atca_mode) {
-	mc->num_leds = 2;
+	led_data_t *leds = mc->picmg_frus[0].leds;
+
+	mc->picmg_frus[0].num_leds = 2;
 
 	/* By default only blue LED has local control. */
-	mc->leds[0].loc_cnt = 1;
-	mc->leds[0].loc_cnt_sup = 1;
+	leds[0].loc_cnt = 1;
+	leds[0].loc_cnt_sup = 1;
 
-	mc->leds[0].def_loc_cnt_color = 1; /* Blue LED */
-	mc->leds[0].def_override_color = 1;
-	mc->leds[0].color_sup = 0x2;
-	mc->leds[0].color = 0x1;
+	leds[0].def_loc_cnt_color = 1; /* Blue LED */
+	leds[0].def_override_color = 1;
+	leds[0].color_sup = 0x2;
+	leds[0].color = 0x1;
 
 	for (i=1; i<MAX_LEDS; i++) {
 	    /* Others default to red */
-	    mc->leds[i].def_loc_cnt_color = 2;
-	    mc->leds[i].def_override_color = 2;
-	    mc->leds[i].color_sup = 0x2;
-	    mc->leds[i].color = 0x2;
+	    leds[i].def_loc_cnt_color = 2;
+	    leds[i].def_override_color = 2;
+	    leds[i].color_sup = 0x2;
+	    leds[i].color = 0x2;
 	}
     }
 
@@ -917,9 +1057,14 @@ ipmi_emu_add_mc(emu_data_t    *emu,
 	mc->child_quit_handler.info = mc;
 	mc->child_quit_handler.handler = handle_child_quit;
 	ipmi_register_child_quit_handler(&mc->child_quit_handler);
-	mc->tick_handler.info = mc;
-	mc->tick_handler.handler = handle_tick;
-	ipmi_register_tick_handler(&mc->tick_handler);
+	if (!sys->alloc_timer
+	    || sys->alloc_timer(sys, poweroff_timeout, mc, &mc->poweroff_timer))
+	{
+	    mc->poweroff_timer = NULL;
+	    mc->tick_handler.info = mc;
+	    mc->tick_handler.handler = handle_tick;
+	    ipmi_register_tick_handler(&mc->tick_handler);
+	}
 	mc->channels[15]->start_cmd = chan_start_cmd;
 	mc->channels[15]->stop_cmd = chan_stop_cmd;
     }
@@ -933,6 +1078,7 @@ void
 ipmi_mc_set_device_id(lmc_data_t *mc, unsigned char device_id)
 {
     mc->device_id = device_id;
+    mc_device_id_changed(mc);
 }
 
 unsigned char
@@ -945,6 +1091,7 @@ void
 ipmi_set_has_device_sdrs(lmc_data_t *mc, unsigned char has_device_sdrs)
 {
     mc->has_device_sdrs = has_device_sdrs;
+    mc_device_id_changed(mc);
 }
 
 unsigned char
@@ -957,6 +1104,7 @@ void
 ipmi_set_device_revision(lmc_data_t *mc, unsigned char device_revision)
 {
     mc->device_revision = device_revision;
+    mc_device_id_changed(mc);
 }
 
 unsigned char
@@ -969,6 +1117,7 @@ void
 ipmi_set_major_fw_rev(lmc_data_t *mc, unsigned char major_fw_rev)
 {
     mc->major_fw_rev = major_fw_rev;
+    mc_device_id_changed(mc);
 }
 
 unsigned char
@@ -981,6 +1130,7 @@ void
 ipmi_set_minor_fw_rev(lmc_data_t *mc, unsigned char minor_fw_rev)
 {
     mc->minor_fw_rev = minor_fw_rev;
+    mc_device_id_changed(mc);
 }
 
 unsigned char
@@ -993,6 +1143,7 @@ void
 ipmi_set_device_support(lmc_data_t *mc, unsigned char device_support)
 {
     mc->device_support = device_support;
+    mc_device_id_changed(mc);
 }
 
 unsigned char
@@ -1005,6 +1156,7 @@ void
 ipmi_set_mfg_id(lmc_data_t *mc, unsigned char mfg_id[3])
 {
     memcpy(mc->mfg_id, mfg_id, 3);
+    mc_device_id_changed(mc);
 }
 
 void
@@ -1017,6 +1169,7 @@ void
 ipmi_set_product_id(lmc_data_t *mc, unsigned char product_id[2])
 {
     memcpy(mc->product_id, product_id, 2);
+    mc_device_id_changed(mc);
 }
 
 void
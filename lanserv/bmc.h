@@ -65,16 +65,50 @@
 
 #define OPENIPMI_IANA		40820 /* OpenIPMI's own number */
 
+/*
+ * SEL and SDR records are kept in a list in record order, and are
+ * indexed by record id so that Get SEL Entry and Get SDR don't have
+ * to walk the list.  Record ids are 16 bits, the index is a two level
+ * table with the pages allocated as they are used.  If an allocation
+ * fails the index is marked broken and lookups walk the list.
+ */
+#define RECID_PAGE_SHIFT	8
+#define RECID_PAGE_SIZE		(1 << RECID_PAGE_SHIFT)
+#define RECID_NUM_PAGES		(65536 / RECID_PAGE_SIZE)
+typedef struct recid_index_s
+{
+    void **pages[RECID_NUM_PAGES];
+    int  broken;
+} recid_index_t;
+
+void *recid_index_find(recid_index_t *idx, uint16_t record_id);
+void recid_index_set(recid_index_t *idx, uint16_t record_id, void *item);
+void recid_index_free(recid_index_t *idx);
+
+/*
+ * SDR and FRU data is kept with a reference count, and identical data
+ * added to different MCs is only kept once.  That's what happens when
+ * a fleet of BMCs is set up from one config.  Shared data must not be
+ * written; get a private copy with ipmi_data_unshare() first.
+ */
+unsigned char *ipmi_data_alloc(unsigned int len);
+unsigned char *ipmi_data_share(unsigned char *data);
+unsigned char *ipmi_data_unshare(unsigned char *data);
+void ipmi_data_free(unsigned char *data);
+
 typedef struct sel_entry_s
 {
     uint16_t           record_id;
     unsigned char      data[16];
     struct sel_entry_s *next;
+    struct sel_entry_s *prev;
 } sel_entry_t;
 
 typedef struct sel_s
 {
     sel_entry_t   *entries;
+    sel_entry_t   *tail;
+    recid_index_t index;
     int           count;
     int           max_count;
     uint32_t      last_add_time;
@@ -92,7 +126,9 @@ typedef struct sdr_s
     uint16_t      record_id;
     unsigned int  length;
     unsigned char *data;
+    int           mapped; /* data is in an SDR image, don't free it. */
     struct sdr_s  *next;
+    struct sdr_s  *prev;
 } sdr_t;
 
 typedef struct sdrs_s
@@ -109,6 +145,8 @@ typedef struct sdrs_s
 
     /* A linked list of SDR entries. */
     sdr_t         *sdrs;
+    sdr_t         *tail;
+    recid_index_t index;
 } sdrs_t;
 
 typedef struct sensor_s sensor_t;
@@ -156,6 +194,10 @@ struct sensor_s
     struct timeval poll_timer_time;
     int (*poll)(void *cb_data, unsigned int *val, const char **errstr);
     void *cb_data;
+
+    /* Encoded Get Sensor Reading response, if reading_rsp_valid. */
+    unsigned char reading_rsp[5];
+    int reading_rsp_valid;
 };
 
 typedef struct fru_data_s fru_data_t;
@@ -197,6 +239,24 @@ typedef struct led_data_s
     unsigned char def_override_color;
 } led_data_t;
 
+#define MAX_LEDS 8
+#define MIN_ATCA_LEDS 2
+
+/* The PICMG state of one FRU of an MC, FRU 0 is the MC itself. */
+typedef struct picmg_fru_s
+{
+    unsigned int  num_leds;
+    led_data_t    leds[MAX_LEDS];
+
+    /* The hot-swap sensor, NULL if not valid.  Without one the
+       M-state is just kept in hs_state. */
+    sensor_t      *hs_sensor;
+    unsigned char hs_state;
+
+    unsigned char activation_locked : 1;
+    unsigned char deactivation_locked : 1;
+} picmg_fru_t;
+
 struct lmc_data_s
 {
     emu_data_t *emu;
@@ -220,6 +280,11 @@ struct lmc_data_s
     pef_data_t pef;
     pef_data_t pef_rollback;
 
+    /* Counts down wait_poweroff.  A timer only runs while a poweroff
+       is in progress, the tick handler is used if there are no
+       timers. */
+    ipmi_timer_t *poweroff_timer;
+    int poweroff_timer_running;
     ipmi_tick_handler_t tick_handler;
     ipmi_child_quit_t child_quit_handler;
     startcmd_t startcmd;
@@ -238,6 +303,10 @@ struct lmc_data_s
     unsigned char product_id[2];   /* bytes 11-12 */
     unsigned char aux_fw_rev[4];   /* bytes 13-16 */
 
+    /* The encoded response from the above, if dev_id_rsp_valid. */
+    unsigned char dev_id_rsp[16];
+    int dev_id_rsp_valid;
+
 #define IPMI_MC_MSG_FLAG_WATCHDOG_TIMEOUT_MASK	(1 << 3)
 #define IPMI_MC_MSG_FLAG_EVT_BUF_FULL		(1 << 1)
 #define IPMI_MC_MSG_FLAG_RCV_MSG_QUEUE		(1 << 0)
@@ -285,6 +354,7 @@ struct lmc_data_s
     unsigned char num_sensors_per_lun[4];
     sensor_t *(sensors[4][255]);
     uint32_t sensor_population_change_time;
+    struct sensor_storm_s *storm;
 
     fru_data_t *frulist;
 
@@ -299,13 +369,14 @@ struct lmc_data_s
     const char *chassis_control_prog;
 
     unsigned char power_value;
-#define MAX_LEDS 8
-#define MIN_ATCA_LEDS 2
-    unsigned int  num_leds;
-    led_data_t leds[MAX_LEDS];
 
-    /* Will be NULL if not valid. */
-    sensor_t      *hs_sensor;
+    /* PICMG FRUs, indexed by FRU device id.  FRU 0 is kept in
+       picmg_fru0 so there is always one, picmg_frus points to it
+       until more are added. */
+#define MAX_PICMG_FRUS 255
+    unsigned int  num_picmg_frus;
+    picmg_fru_t   *picmg_frus;
+    picmg_fru_t   picmg_fru0;
 
 #define IPMI_MC_WATCHDOG_USE_MASK 0xc7
 #define IPMI_MC_WATCHDOG_ACTION_MASK 0x77
@@ -332,6 +403,12 @@ struct lmc_data_s
     struct timeval watchdog_time; /* Set time */
     struct timeval watchdog_expiry; /* Timeout time */
     ipmi_timer_t *watchdog_timer;
+
+    /* The flattened [netfn][cmd] command table for this MC, picked
+       when the MC is enabled and again if handlers are registered
+       after that (dispatch_gen is then out of date). */
+    struct emu_dispatch_s *dispatch;
+    unsigned int dispatch_gen;
 };
 
 typedef struct atca_site_s
@@ -374,6 +451,11 @@ struct emu_data_s
 
     struct timeval last_addr_change_time;
     emu_addr_t addr[MAX_EMU_ADDR];
+
+    /* On the list of emulators with a lock timing out or users to
+       write, see ipmi_emu_need_tick(). */
+    int tick_pending;
+    emu_data_t *tick_next;
 };
 
 /* Device ID support bits */
@@ -388,6 +470,9 @@ struct emu_data_s
 
 fru_data_t *find_fru(lmc_data_t *mc, unsigned int devid);
 
+void ipmi_mc_stop_sensor_storm(lmc_data_t *mc);
+void ipmi_mc_free_sensor_groups(lmc_data_t *mc);
+
 int start_poweron_timer(lmc_data_t *mc);
 
 sdr_t *find_sdr_by_recid(sdrs_t     *sdrs,
@@ -414,6 +499,8 @@ void mc_new_event(lmc_data_t *mc,
 #define IPMI_SDR_GET_SDR_ALLOC_INFO_SDR_SUPPORTED	(1 << 0)
 
 void picmg_led_set(lmc_data_t *mc, sensor_t *sensor);
+void picmg_add_hs_sensor(lmc_data_t *mc, sensor_t *sensor);
+void picmg_remove_hs_sensor(lmc_data_t *mc, sensor_t *sensor);
 void set_sensor_bit(lmc_data_t *mc, sensor_t *sensor, unsigned char bit,
 		    unsigned char value,
 		    unsigned char evd1, unsigned char evd2, unsigned char evd3,
@@ -434,6 +521,13 @@ void handle_picmg_msg(lmc_data_t    *mc,
 		      unsigned int  *rdata_len);
 
 #define set_bit(m, b, v) (m) = (v) ? ((m) | (1 << (b))) : ((m) & ~(1 << (b)))
+
+/*
+ * Call these when anything in a Get Sensor Reading or Get Device ID
+ * response changes, so the cached response is rebuilt.
+ */
+#define sensor_reading_changed(s) ((s)->reading_rsp_valid = 0)
+#define mc_device_id_changed(mc) ((mc)->dev_id_rsp_valid = 0)
 #define bit_set(m, b) (!!((m) & (1 << (b))))
 
 #endif /* __BMC_H_ */
@@ -48,17 +48,23 @@ handle_get_device_id(lmc_data_t    *mc,
 		     unsigned int  *rdata_len,
 		     void          *cb_data)
 {
-    memset(rdata, 0, 12);
-    rdata[1] = mc->device_id;
-    rdata[2] = ((mc->has_device_sdrs << 0x7)
+    unsigned char *d = mc->dev_id_rsp;
+
+    if (!mc->dev_id_rsp_valid) {
+	memset(d, 0, 12);
+	d[1] = mc->device_id;
+	d[2] = ((mc->has_device_sdrs << 0x7)
 		| (mc->device_revision & 0xf));
-    rdata[3] = mc->major_fw_rev & 0x7f;
-    rdata[4] = mc->minor_fw_rev;
-    rdata[5] = 0x02;
-    rdata[6] = mc->device_support;
-    memcpy(rdata+7, mc->mfg_id, 3);
-    memcpy(rdata+10, mc->product_id, 2);
-    memcpy(rdata+12, mc->aux_fw_rev, 4);
+	d[3] = mc->major_fw_rev & 0x7f;
+	d[4] = mc->minor_fw_rev;
+	d[5] = 0x02;
+	d[6] = mc->device_support;
+	memcpy(d+7, mc->mfg_id, 3);
+	memcpy(d+10, mc->product_id, 2);
+	memcpy(d+12, mc->aux_fw_rev, 4);
+	mc->dev_id_rsp_valid = 1;
+    }
+    memcpy(rdata, d, 16);
     *rdata_len = 16;
 }
 
@@ -66,6 +72,7 @@ void
 ipmi_mc_set_dev_revision(lmc_data_t *mc, unsigned char dev_revision)
 {
     mc->device_revision = dev_revision;
+    mc_device_id_changed(mc);
 }
 
 void
@@ -74,12 +81,14 @@ ipmi_mc_set_fw_revision(lmc_data_t *mc, unsigned char fw_revision_major,
 {
     mc->major_fw_rev = fw_revision_major;
     mc->minor_fw_rev = fw_revision_minor;
+    mc_device_id_changed(mc);
 }
 
 void
 ipmi_mc_set_aux_fw_revision(lmc_data_t *mc, unsigned char aux_fw_revision[4])
 {
     memcpy(mc->aux_fw_rev, aux_fw_revision, 4);
+    mc_device_id_changed(mc);
 }
 
 void
@@ -423,6 +432,9 @@ handle_get_channel_info(lmc_data_t    *mc,
 	protocol_type = mc->channels[lchan]->protocol_type;
 	session_support = mc->channels[lchan]->session_support;
 	active_sessions = mc->channels[lchan]->active_sessions;
+	if (mc->channels[lchan]->active_sessions > MAX_SESSIONS)
+	    /* Only 6 bits to report it in. */
+	    active_sessions = MAX_SESSIONS;
     }
 
     rdata[0] = 0;
@@ -562,6 +574,8 @@ set_users_changed(lmc_data_t *mc)
 {
     mc->users_changed = 1;
     mc->emu->users_changed = 1;
+    ipmi_emu_need_tick(mc->emu);
+    mc->sysinfo->users_gen++;
 }
 
 static void
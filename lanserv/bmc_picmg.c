@@ -119,7 +119,7 @@ handle_set_hs_led(lmc_data_t    *mc,
     if (check_msg_length(msg, 1, rdata, rdata_len))
 	return;
 
-    mc->leds[0].color = msg->data[0];
+    mc->picmg_frus[0].leds[0].color = msg->data[0];
 
     printf("Setting hotswap LED to %d\n", msg->data[0]);
 
@@ -135,7 +135,7 @@ handle_get_hs_led(lmc_data_t    *mc,
 		  void          *cb_data)
 {
     rdata[0] = 0;
-    rdata[1] = mc->leds[0].color;
+    rdata[1] = mc->picmg_frus[0].leds[0].color;
     *rdata_len = 2;
 }
 
@@ -146,6 +146,110 @@ cmd_handler_f oem0_netfn_handlers[256] = {
     [0x04] = handle_get_hs_led
 };
 
+/*
+ * Return the FRU addressed by the FRU device id in msg->data[1].  If
+ * there is no such FRU the error response is filled in and NULL is
+ * returned.  The message length must already have been checked.
+ */
+static picmg_fru_t *
+picmg_msg_fru(lmc_data_t    *mc,
+	      msg_t         *msg,
+	      unsigned char *rdata,
+	      unsigned int  *rdata_len)
+{
+    if (msg->data[1] >= mc->num_picmg_frus) {
+	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
+	*rdata_len = 1;
+	return NULL;
+    }
+    return &mc->picmg_frus[msg->data[1]];
+}
+
+static unsigned int
+picmg_fru_get_hs_state(picmg_fru_t *fru)
+{
+    unsigned int i;
+
+    if (!fru->hs_sensor)
+	return fru->hs_state;
+
+    for (i=0; i<8; i++) {
+	if (bit_set(fru->hs_sensor->event_status, i))
+	    return i;
+    }
+    return 0;
+}
+
+/* Set the blue LED's local control state from the hot-swap state. */
+static void
+picmg_fru_hs_led(picmg_fru_t *fru, unsigned int fru_id, unsigned int state)
+{
+    led_data_t *led = &fru->leds[0];
+
+    printf("ATCA hot-swap state of FRU %d is %d\n", fru_id, state);
+
+    switch (state) {
+    case 0:
+    case 3:
+    case 4:
+	/* off */
+	led->def_off_dur = 0;
+	led->def_on_dur = 0;
+	break;
+
+    case 1:
+	/* on */
+	led->def_off_dur = 0xff;
+	led->def_on_dur = 0;
+	break;
+
+    case 2:
+	/* long blink */
+	led->def_off_dur = 10;
+	led->def_on_dur = 90;
+	break;
+
+    case 5:
+    case 6:
+	/* short blink */
+	led->def_off_dur = 90;
+	led->def_on_dur = 10;
+	break;
+		
+    case 7:
+	/* Nothing to do */
+	break;
+    }
+
+    if (led->loc_cnt) {
+	led->off_dur = led->def_off_dur;
+	led->on_dur = led->def_on_dur;
+	printf("Setting ATCA LED %d of FRU %d to %s %x %x %x\n",
+	       0, fru_id,
+	       led->loc_cnt ? "local_control" : "override",
+	       led->off_dur,
+	       led->on_dur,
+	       led->color);
+    }
+}
+
+static void
+picmg_fru_set_hs_state(lmc_data_t *mc, unsigned int fru_id, unsigned int state,
+		       int gen_event)
+{
+    picmg_fru_t *fru = &mc->picmg_frus[fru_id];
+    sensor_t    *hssens = fru->hs_sensor;
+
+    if (hssens) {
+	/* The sensor's update handler takes care of the LED. */
+	ipmi_mc_sensor_set_bit_clr_rest(mc, hssens->lun, hssens->num,
+					state, gen_event);
+    } else {
+	fru->hs_state = state;
+	picmg_fru_hs_led(fru, fru_id, state);
+    }
+}
+
 static void
 handle_picmg_get_properties(lmc_data_t    *mc,
 			    msg_t         *msg,
@@ -156,7 +260,7 @@ handle_picmg_get_properties(lmc_data_t    *mc,
     rdata[0] = 0;
     rdata[1] = IPMI_PICMG_GRP_EXT;
     rdata[2] = 0x22; /* Version 2.2 */
-    rdata[3] = 0; /* Only have one FRU. */
+    rdata[3] = mc->num_picmg_frus - 1; /* Max FRU device id. */
     rdata[4] = 0; /* As defined by spec. */
     *rdata_len = 5;
 }
@@ -221,7 +325,9 @@ handle_picmg_get_address_info(lmc_data_t    *mc,
 	}
     }
 
-    if ((hw_addr >= 128) || (!sites[hw_addr].valid) || (devid > 0)) {
+    if ((hw_addr >= 128) || (!sites[hw_addr].valid)
+	|| (devid >= mc->num_picmg_frus))
+    {
 	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
 	*rdata_len = 1;
 	return;
@@ -248,11 +354,8 @@ handle_picmg_cmd_fru_control(lmc_data_t    *mc,
     if (check_msg_length(msg, 3, rdata, rdata_len))
 	return;
 
-    if (msg->data[1] != 0) {
-	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
-	*rdata_len = 1;
+    if (!picmg_msg_fru(mc, msg, rdata, rdata_len))
 	return;
-    }
 
     if (msg->data[2] >= 4) {
 	rdata[0] = IPMI_INVALID_DATA_FIELD_CC;
@@ -275,27 +378,27 @@ handle_picmg_cmd_get_fru_led_properties(lmc_data_t    *mc,
 					unsigned int  *rdata_len,
 					void          *cb_data)
 {
+    picmg_fru_t *fru;
+
     if (check_msg_length(msg, 2, rdata, rdata_len))
 	return;
 
-    if (msg->data[1] != 0) {
-	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
-	*rdata_len = 1;
+    fru = picmg_msg_fru(mc, msg, rdata, rdata_len);
+    if (!fru)
 	return;
-    }
 
     rdata[0] = 0;
     rdata[1] = IPMI_PICMG_GRP_EXT;
-    if (mc->num_leds <= 2) {
-	mc->num_leds = 2;
+    if (fru->num_leds <= 2) {
+	fru->num_leds = 2;
 	rdata[2] = 0x03; /* We support the first 2 LEDs. */
 	rdata[3] = 0x00;
-    } else if (mc->num_leds == 3) {
+    } else if (fru->num_leds == 3) {
 	rdata[2] = 0x07; /* We support the first 3 LEDs. */
 	rdata[3] = 0x00;
     } else {
 	rdata[2] = 0xf; /* We support the first 4 LEDs. */
-	rdata[3] = mc->num_leds = 4; /* How many more do we support? */
+	rdata[3] = fru->num_leds = 4; /* How many more do we support? */
     }
     *rdata_len = 4;
 }
@@ -307,19 +410,18 @@ handle_picmg_cmd_get_led_color_capabilities(lmc_data_t    *mc,
 					    unsigned int  *rdata_len,
 					    void          *cb_data)
 {
+    picmg_fru_t  *fru;
     unsigned int led;
 
     if (check_msg_length(msg, 3, rdata, rdata_len))
 	return;
 
-    if (msg->data[1] != 0) {
-	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
-	*rdata_len = 1;
+    fru = picmg_msg_fru(mc, msg, rdata, rdata_len);
+    if (!fru)
 	return;
-    }
 
     led = msg->data[2];
-    if (led >= mc->num_leds) {
+    if (led >= fru->num_leds) {
 	rdata[0] = IPMI_INVALID_DATA_FIELD_CC;
 	*rdata_len = 1;
 	return;
@@ -327,9 +429,9 @@ handle_picmg_cmd_get_led_color_capabilities(lmc_data_t    *mc,
 
     rdata[0] = 0;
     rdata[1] = IPMI_PICMG_GRP_EXT;
-    rdata[2] = mc->leds[led].color_sup;
-    rdata[3] = mc->leds[led].def_loc_cnt_color;
-    rdata[4] = mc->leds[led].def_override_color;
+    rdata[2] = fru->leds[led].color_sup;
+    rdata[3] = fru->leds[led].def_loc_cnt_color;
+    rdata[4] = fru->leds[led].def_override_color;
 
     *rdata_len = 5;
 }
@@ -337,51 +439,66 @@ handle_picmg_cmd_get_led_color_capabilities(lmc_data_t    *mc,
 void
 picmg_led_set(lmc_data_t *mc, sensor_t *sensor)
 {
-    printf("ATCA hot-swap state is %d\n", sensor->value);
+    unsigned int i;
 
-    switch (sensor->value) {
-    case 0:
-    case 3:
-    case 4:
-	/* off */
-	mc->leds[0].def_off_dur = 0;
-	mc->leds[0].def_on_dur = 0;
-	break;
+    for (i=0; i<mc->num_picmg_frus; i++) {
+	if (mc->picmg_frus[i].hs_sensor == sensor) {
+	    picmg_fru_hs_led(&mc->picmg_frus[i], i, sensor->value);
+	    break;
+	}
+    }
+}
 
-    case 1:
-	/* on */
-	mc->leds[0].def_off_dur = 0xff;
-	mc->leds[0].def_on_dur = 0;
-	break;
+/*
+ * Set an LED of a FRU the way Set FRU LED State does, off_dur is the
+ * LED function (0xfc for local control).  Returns EINVAL if the
+ * setting is not valid for the LED.
+ */
+static int
+picmg_fru_set_led(picmg_fru_t *fru, unsigned int fru_id, unsigned int led,
+		  unsigned char off_dur, unsigned char on_dur,
+		  unsigned char color)
+{
+    led_data_t *ledp;
 
-    case 2:
-	/* long blink */
-	mc->leds[0].def_off_dur = 10;
-	mc->leds[0].def_on_dur = 90;
-	break;
+    if (led >= fru->num_leds)
+	return EINVAL;
+    ledp = &fru->leds[led];
 
-    case 5:
-    case 6:
-	/* short blink */
-	mc->leds[0].def_off_dur = 90;
-	mc->leds[0].def_on_dur = 10;
-	break;
-		
-    case 7:
-	/* Nothing to do */
+    switch (off_dur) {
+    case 0xfc: /* Local control */
+	if (!ledp->loc_cnt_sup)
+	    return EINVAL;
+
+	ledp->loc_cnt = 1;
+
+	ledp->off_dur = ledp->def_off_dur;
+	ledp->on_dur = ledp->def_on_dur;
+	ledp->color = ledp->def_loc_cnt_color;
 	break;
-    }
 
-    if (mc->leds[0].loc_cnt) {
-	mc->leds[0].off_dur = mc->leds[0].def_off_dur;
-	mc->leds[0].on_dur = mc->leds[0].def_on_dur;
-	printf("Setting ATCA LED %d to %s %x %x %x\n",
-	       0,
-	       mc->leds[0].loc_cnt ? "local_control" : "override",
-	       mc->leds[0].off_dur,
-	       mc->leds[0].on_dur,
-	       mc->leds[0].color);
+    case 0xfb:
+    case 0xfd:
+    case 0xfe:
+	return EINVAL;
+
+    default: /* Override mode */
+	ledp->loc_cnt = 0;
+	ledp->off_dur = off_dur;
+	ledp->on_dur = on_dur;
+	if (color == 0xf)
+	    ledp->color = ledp->def_override_color;
+	else if (color != 0xe) /* 0xe is don't change. */
+	    ledp->color = color;
     }
+
+    printf("Setting ATCA LED %d of FRU %d to %s %x %x %x\n",
+	   led, fru_id,
+	   ledp->loc_cnt ? "local_control" : "override",
+	   ledp->off_dur,
+	   ledp->on_dur,
+	   ledp->color);
+    return 0;
 }
 
 static void
@@ -391,63 +508,23 @@ handle_picmg_cmd_set_fru_led_state(lmc_data_t    *mc,
 				   unsigned int  *rdata_len,
 				   void          *cb_data)
 {
-    unsigned int led;
+    picmg_fru_t  *fru;
 
     if (check_msg_length(msg, 3, rdata, rdata_len))
 	return;
 
-    if (msg->data[1] != 0) {
-	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
-	*rdata_len = 1;
+    fru = picmg_msg_fru(mc, msg, rdata, rdata_len);
+    if (!fru)
 	return;
-    }
 
-    led = msg->data[2];
-    if (led >= mc->num_leds) {
-	rdata[0] = IPMI_INVALID_DATA_FIELD_CC;
-	*rdata_len = 1;
-	return;
-    }
-
-    switch (msg->data[3]) {
-    case 0xfc: /* Local control */
-	if (!mc->leds[led].loc_cnt_sup) {
-	    rdata[0] = IPMI_INVALID_DATA_FIELD_CC;
-	    *rdata_len = 1;
-	    return;
-	}
-
-	mc->leds[led].loc_cnt = 1;
-
-	mc->leds[led].off_dur = mc->leds[led].def_off_dur;
-	mc->leds[led].on_dur = mc->leds[led].def_on_dur;
-	mc->leds[led].color = mc->leds[led].def_loc_cnt_color;
-	break;
-
-    case 0xfb:
-    case 0xfd:
-    case 0xfe:
+    if (picmg_fru_set_led(fru, msg->data[1], msg->data[2], msg->data[3],
+			  msg->data[4], msg->data[5]))
+    {
 	rdata[0] = IPMI_INVALID_DATA_FIELD_CC;
 	*rdata_len = 1;
 	return;
-
-    default: /* Override mode */
-	mc->leds[led].loc_cnt = 0;
-	mc->leds[led].off_dur = msg->data[3];
-	mc->leds[led].on_dur = msg->data[4];
-	if (msg->data[5] == 0xf)
-	    mc->leds[led].color = mc->leds[led].def_override_color;
-	else if (msg->data[5] != 0xe) /* 0xe is don't change. */
-	    mc->leds[led].color = msg->data[5];
     }
 
-    printf("Setting ATCA LED %d to %s %x %x %x\n",
-	   led,
-	   mc->leds[led].loc_cnt ? "local_control" : "override",
-	   mc->leds[led].off_dur,
-	   mc->leds[led].on_dur,
-	   mc->leds[led].color);
-
     rdata[0] = 0;
     rdata[1] = IPMI_PICMG_GRP_EXT;
     *rdata_len = 2;
@@ -460,19 +537,18 @@ handle_picmg_cmd_get_fru_led_state(lmc_data_t    *mc,
 				   unsigned int  *rdata_len,
 				   void          *cb_data)
 {
+    picmg_fru_t  *fru;
     unsigned int led;
 
     if (check_msg_length(msg, 3, rdata, rdata_len))
 	return;
 
-    if (msg->data[1] != 0) {
-	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
-	*rdata_len = 1;
+    fru = picmg_msg_fru(mc, msg, rdata, rdata_len);
+    if (!fru)
 	return;
-    }
 
     led = msg->data[2];
-    if (led >= mc->num_leds) {
+    if (led >= fru->num_leds) {
 	rdata[0] = IPMI_INVALID_DATA_FIELD_CC;
 	*rdata_len = 1;
 	return;
@@ -481,22 +557,22 @@ handle_picmg_cmd_get_fru_led_state(lmc_data_t    *mc,
     rdata[0] = 0;
     rdata[1] = IPMI_PICMG_GRP_EXT;
     rdata[2] = 0x00;
-    if (mc->leds[led].loc_cnt_sup)
+    if (fru->leds[led].loc_cnt_sup)
 	rdata[2] |= 0x01; /* Local control support */
 
-    if (mc->leds[led].loc_cnt) {
-	rdata[3] = mc->leds[led].off_dur;
-	rdata[4] = mc->leds[led].on_dur;
-	rdata[5] = mc->leds[led].color;
+    if (fru->leds[led].loc_cnt) {
+	rdata[3] = fru->leds[led].off_dur;
+	rdata[4] = fru->leds[led].on_dur;
+	rdata[5] = fru->leds[led].color;
 	*rdata_len = 6;
     } else {
 	rdata[2] |= 0x02; /* override state. */
-	rdata[3] = mc->leds[led].def_off_dur;
-	rdata[4] = mc->leds[led].def_on_dur;
-	rdata[5] = mc->leds[led].def_loc_cnt_color;
-	rdata[6] = mc->leds[led].off_dur;
-	rdata[7] = mc->leds[led].on_dur;
-	rdata[8] = mc->leds[led].color;
+	rdata[3] = fru->leds[led].def_off_dur;
+	rdata[4] = fru->leds[led].def_on_dur;
+	rdata[5] = fru->leds[led].def_loc_cnt_color;
+	rdata[6] = fru->leds[led].off_dur;
+	rdata[7] = fru->leds[led].on_dur;
+	rdata[8] = fru->leds[led].color;
 	*rdata_len = 9;
     }
 }
@@ -538,7 +614,24 @@ handle_picmg_cmd_set_fru_activation_policy(lmc_data_t    *mc,
 					   unsigned int  *rdata_len,
 					   void          *cb_data)
 {
-    handle_invalid_cmd(mc, rdata, rdata_len);
+    picmg_fru_t *fru;
+
+    if (check_msg_length(msg, 4, rdata, rdata_len))
+	return;
+
+    fru = picmg_msg_fru(mc, msg, rdata, rdata_len);
+    if (!fru)
+	return;
+
+    /* data[2] is the mask of bits to change, data[3] the values. */
+    if (msg->data[2] & 0x01)
+	fru->activation_locked = msg->data[3] & 0x01;
+    if (msg->data[2] & 0x02)
+	fru->deactivation_locked = (msg->data[3] >> 1) & 0x01;
+
+    rdata[0] = 0;
+    rdata[1] = IPMI_PICMG_GRP_EXT;
+    *rdata_len = 2;
 }
 
 static void
@@ -548,7 +641,20 @@ handle_picmg_cmd_get_fru_activation_policy(lmc_data_t    *mc,
 					   unsigned int  *rdata_len,
 					   void          *cb_data)
 {
-    handle_invalid_cmd(mc, rdata, rdata_len);
+    picmg_fru_t *fru;
+
+    if (check_msg_length(msg, 2, rdata, rdata_len))
+	return;
+
+    fru = picmg_msg_fru(mc, msg, rdata, rdata_len);
+    if (!fru)
+	return;
+
+    rdata[0] = 0;
+    rdata[1] = IPMI_PICMG_GRP_EXT;
+    rdata[2] = (fru->activation_locked
+		| (fru->deactivation_locked << 1));
+    *rdata_len = 3;
 }
 
 static void
@@ -558,19 +664,21 @@ handle_picmg_cmd_set_fru_activation(lmc_data_t    *mc,
 				    unsigned int  *rdata_len,
 				    void          *cb_data)
 {
-    int      op;
-    sensor_t *hssens;
+    int          op;
+    picmg_fru_t  *fru;
+    unsigned int fru_id;
+    unsigned int state;
 
     if (check_msg_length(msg, 3, rdata, rdata_len))
 	return;
 
-    if (msg->data[1] != 0) {
-	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
-	*rdata_len = 1;
+    fru = picmg_msg_fru(mc, msg, rdata, rdata_len);
+    if (!fru)
 	return;
-    }
+    fru_id = msg->data[1];
 
-    if (! mc->hs_sensor) {
+    /* FRU 0 without a hot-swap sensor is not managed. */
+    if ((fru_id == 0) && !fru->hs_sensor) {
 	handle_invalid_cmd(mc, rdata, rdata_len);
 	return;
     }
@@ -582,32 +690,21 @@ handle_picmg_cmd_set_fru_activation(lmc_data_t    *mc,
 	return;
     }
 
-    hssens = mc->hs_sensor;
+    state = picmg_fru_get_hs_state(fru);
     switch (op) {
     case 0:
-	if (bit_set(hssens->event_status, 3)
-	    || bit_set(hssens->event_status, 4)
-	    || bit_set(hssens->event_status, 5))
-	{
-	    /* Transition to m6. */
-	    ipmi_mc_sensor_set_bit_clr_rest(mc, hssens->lun, hssens->num,
-					    6, 1);
-
-	    /* Transition to m1. */
-	    ipmi_mc_sensor_set_bit_clr_rest(mc, hssens->lun, hssens->num,
-					    1, 1);
+	if ((state == 3) || (state == 4) || (state == 5)) {
+	    /* Transition to m6, then to m1. */
+	    picmg_fru_set_hs_state(mc, fru_id, 6, 1);
+	    picmg_fru_set_hs_state(mc, fru_id, 1, 1);
 	}
 	break;
 
     case 1:
-	if (bit_set(hssens->event_status, 2)) {
-	    /* Transition to m3. */
-	    ipmi_mc_sensor_set_bit_clr_rest(mc, hssens->lun, hssens->num,
-					    3, 1);
-
-	    /* Transition to m4. */
-	    ipmi_mc_sensor_set_bit_clr_rest(mc, hssens->lun, hssens->num,
-					    4, 1);
+	if (state == 2) {
+	    /* Transition to m3, then to m4. */
+	    picmg_fru_set_hs_state(mc, fru_id, 3, 1);
+	    picmg_fru_set_hs_state(mc, fru_id, 4, 1);
 	}
     }
 
@@ -806,11 +903,8 @@ handle_picmg_cmd_fru_control_capabilities(lmc_data_t    *mc,
     if (check_msg_length(msg, 2, rdata, rdata_len))
 	return;
 
-    if (msg->data[1] != 0) {
-	rdata[0] = IPMI_DESTINATION_UNAVAILABLE_CC;
-	*rdata_len = 1;
+    if (!picmg_msg_fru(mc, msg, rdata, rdata_len))
 	return;
-    }
 
     rdata[0] = 0;
     rdata[1] = IPMI_PICMG_GRP_EXT;
@@ -882,6 +976,7 @@ handle_picmg_cmd_fru_inventory_device_lock_control(lmc_data_t    *mc,
 	ipmi_set_uint32(rdata+4, emu->atca_fru_inv_curr_timestamp);
 	*rdata_len = 8;
 	emu->atca_fru_inv_lock_timeout = 20;
+	ipmi_emu_need_tick(emu);
 	break;
 
     case 2:
@@ -924,6 +1019,16 @@ handle_picmg_cmd_fru_inventory_device_lock_control(lmc_data_t    *mc,
 	    *rdata_len = 1;
 	    break;
 	}
+	if (!fru->fru_io_cb) {
+	    unsigned char *data = ipmi_data_unshare(fru->data);
+
+	    if (!data) {
+		rdata[0] = IPMI_OUT_OF_SPACE_CC;
+		*rdata_len = 1;
+		break;
+	    }
+	    fru->data = data;
+	}
 	memcpy(fru->data, emu->temp_fru_inv_data,
 	       emu->temp_fru_inv_data_len);
 	free(emu->temp_fru_inv_data);
@@ -1045,6 +1150,131 @@ handle_picmg_cmd_get_shelf_manager_ip_addresses(lmc_data_t    *mc,
     *rdata_len = 10 + ap->addr_len;
 }
 
+static int
+picmg_sensor_fru(lmc_data_t *mc, sensor_t *sensor)
+{
+    unsigned int i;
+
+    for (i=0; i<mc->num_picmg_frus; i++) {
+	if (mc->picmg_frus[i].hs_sensor == sensor)
+	    return i;
+    }
+    return -1;
+}
+
+/*
+ * A hot-swap sensor goes to the lowest FRU that does not have one
+ * yet.  Sensors that find no FRU are picked up when FRUs are added.
+ */
+void
+picmg_add_hs_sensor(lmc_data_t *mc, sensor_t *sensor)
+{
+    unsigned int i;
+
+    sensor->sensor_update_handler = picmg_led_set;
+    for (i=0; i<mc->num_picmg_frus; i++) {
+	if (!mc->picmg_frus[i].hs_sensor) {
+	    mc->picmg_frus[i].hs_sensor = sensor;
+	    break;
+	}
+    }
+}
+
+void
+picmg_remove_hs_sensor(lmc_data_t *mc, sensor_t *sensor)
+{
+    int fru_id = picmg_sensor_fru(mc, sensor);
+
+    if (fru_id >= 0)
+	mc->picmg_frus[fru_id].hs_sensor = NULL;
+}
+
+int
+ipmi_mc_set_num_frus(lmc_data_t *mc, unsigned int count)
+{
+    picmg_fru_t  *frus;
+    unsigned int i, j;
+    sensor_t     *sensor;
+
+    if ((count < 1) || (count > MAX_PICMG_FRUS))
+	return EINVAL;
+
+    if (count > mc->num_picmg_frus) {
+	frus = malloc(count * sizeof(*frus));
+	if (!frus)
+	    return ENOMEM;
+	memcpy(frus, mc->picmg_frus, mc->num_picmg_frus * sizeof(*frus));
+	for (i=mc->num_picmg_frus; i<count; i++) {
+	    /* New FRUs get the LED setup of FRU 0 and start in M0. */
+	    memset(&frus[i], 0, sizeof(frus[i]));
+	    frus[i].num_leds = frus[0].num_leds;
+	    memcpy(frus[i].leds, frus[0].leds, sizeof(frus[i].leds));
+	}
+	if (mc->picmg_frus != &mc->picmg_fru0)
+	    free(mc->picmg_frus);
+	mc->picmg_frus = frus;
+    } else {
+	for (i=count; i<mc->num_picmg_frus; i++)
+	    mc->picmg_frus[i].hs_sensor = NULL;
+    }
+    mc->num_picmg_frus = count;
+
+    if (!mc->emu->atca_mode)
+	return 0;
+
+    /* Give any hot-swap sensors without a FRU to the new FRUs. */
+    for (i=0; i<4; i++) {
+	for (j=0; j<255; j++) {
+	    sensor = mc->sensors[i][j];
+	    if (sensor && (sensor->sensor_type == 0xf0)
+		&& (picmg_sensor_fru(mc, sensor) < 0))
+		picmg_add_hs_sensor(mc, sensor);
+	}
+    }
+    return 0;
+}
+
+int
+ipmi_mc_set_fru_hs_state(lmc_data_t   *mc,
+			 unsigned int first,
+			 unsigned int last,
+			 unsigned int state,
+			 int          gen_event)
+{
+    unsigned int i;
+
+    if ((first > last) || (last >= mc->num_picmg_frus) || (state >= 8))
+	return EINVAL;
+
+    for (i=first; i<=last; i++)
+	picmg_fru_set_hs_state(mc, i, state, gen_event);
+    return 0;
+}
+
+int
+ipmi_mc_set_fru_led(lmc_data_t    *mc,
+		    unsigned int  first,
+		    unsigned int  last,
+		    unsigned int  led,
+		    unsigned char off_dur,
+		    unsigned char on_dur,
+		    unsigned char color)
+{
+    unsigned int i;
+    int          rv;
+
+    if ((first > last) || (last >= mc->num_picmg_frus))
+	return EINVAL;
+
+    for (i=first; i<=last; i++) {
+	rv = picmg_fru_set_led(&mc->picmg_frus[i], i, led, off_dur, on_dur,
+			       color);
+	if (rv)
+	    return rv;
+    }
+    return 0;
+}
+
 int
 ipmi_emu_atca_enable(emu_data_t *emu)
 {
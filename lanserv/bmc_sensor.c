@@ -41,6 +41,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <math.h>
 
 #include <OpenIPMI/ipmi_err.h>
 #include <OpenIPMI/ipmi_msgbits.h>
@@ -181,12 +182,7 @@ handle_get_device_sdr(lmc_data_t    *mc,
     if (record_id == 0) {
 	entry = mc->device_sdrs[msg->rs_lun].sdrs;
     } else if (record_id == 0xffff) {
-	entry = mc->device_sdrs[msg->rs_lun].sdrs;
-	if (entry) {
-	    while (entry->next) {
-		entry = entry->next;
-	    }
-	}
+	entry = mc->device_sdrs[msg->rs_lun].tail;
     } else {
 	entry = find_sdr_by_recid(&mc->device_sdrs[msg->rs_lun],
 				  record_id, NULL);
@@ -352,6 +348,7 @@ set_sensor_bit(lmc_data_t *mc, sensor_t *sensor, unsigned char bit,
     } else if (value != bit_set(sensor->event_status, bit)) {
 	/* The bit value has changed. */
 	set_bit(sensor->event_status, bit, value);
+	sensor_reading_changed(sensor);
 	if (value && bit_set(sensor->event_enabled[0], bit)) {
 	    do_event(mc, sensor, gen_event, IPMI_ASSERTION,
 		     evd1 | bit, evd2, evd3);
@@ -369,6 +366,8 @@ check_thresholds(lmc_data_t *mc, sensor_t *sensor, int gen_event)
     int bits_to_set = 0;
     int bits_to_clear = 0;
 
+    sensor_reading_changed(sensor);
+
     for (i=0; i<3; i++) {
 	if (bit_set(sensor->threshold_supported, i)) {
 	    if (sensor->value <= sensor->thresholds[i])
@@ -571,6 +570,7 @@ handle_set_sensor_event_enable(lmc_data_t    *mc,
 
     sensor->events_enabled = (msg->data[1] >> 7) & 1;
     sensor->scanning_enabled = (msg->data[1] >> 6) & 1;
+    sensor_reading_changed(sensor);
 
     sensor_poll(sensor);
 	
@@ -723,12 +723,17 @@ handle_get_sensor_reading(lmc_data_t    *mc,
 	return;
     }
 
-    rdata[0] = 0;
-    rdata[1] = sensor->value;
-    rdata[2] = ((sensor->events_enabled << 7)
-		| ((sensor->scanning_enabled && sensor->enabled) << 6));
-    rdata[3] = sensor->event_status & 0xff;
-    rdata[4] = (sensor->event_status >> 8) & 0xff;
+    if (!sensor->reading_rsp_valid) {
+	sensor->reading_rsp[0] = 0;
+	sensor->reading_rsp[1] = sensor->value;
+	sensor->reading_rsp[2] = ((sensor->events_enabled << 7)
+				  | ((sensor->scanning_enabled
+				      && sensor->enabled) << 6));
+	sensor->reading_rsp[3] = sensor->event_status & 0xff;
+	sensor->reading_rsp[4] = (sensor->event_status >> 8) & 0xff;
+	sensor->reading_rsp_valid = 1;
+    }
+    memcpy(rdata, sensor->reading_rsp, 5);
     *rdata_len = 5;
 }
 
@@ -865,6 +870,7 @@ ipmi_mc_sensor_set_bit_clr_rest(lmc_data_t   *mc,
     }
 
     sensor->value = bit;
+    sensor_reading_changed(sensor);
     set_sensor_bit(mc, sensor, bit, 1, 0, 0xff, 0xff, gen_event);
 
     if (sensor->sensor_update_handler)
@@ -887,6 +893,7 @@ ipmi_mc_sensor_set_enabled(lmc_data_t    *mc,
     sensor = mc->sensors[lun][sens_num];
 
     sensor->enabled = enabled;
+    sensor_reading_changed(sensor);
 
     sensor_poll(sensor);
 
@@ -900,6 +907,7 @@ set_sensor_value(lmc_data_t    *mc,
 		 int           gen_event)
 {
     sensor->value = value;
+    sensor_reading_changed(sensor);
 
     if (sensor->sensor_update_handler)
 	sensor->sensor_update_handler(mc, sensor);
@@ -995,6 +1003,7 @@ ipmi_mc_sensor_set_event_support(lmc_data_t    *mc,
 	sensor->events_enabled = events_enable;
     if (init_scanning)
 	sensor->scanning_enabled = scanning_enable;
+    sensor_reading_changed(sensor);
     sensor->event_support = event_support;
     sensor->event_supported[0] = assert_supported;
     sensor->event_supported[1] = deassert_supported;
@@ -1145,9 +1154,8 @@ ipmi_mc_add_sensor(lmc_data_t    *mc,
     mc->sensors[lun][sens_num] = sensor;
 
     if (mc->emu->atca_mode && (type == 0xf0)) {
-	/* This is the ATCA hot-swap sensor. */
-	mc->hs_sensor = sensor;
-	sensor->sensor_update_handler = picmg_led_set;
+	/* This is an ATCA hot-swap sensor. */
+	picmg_add_hs_sensor(mc, sensor);
     }
 
     bmc = ipmi_emu_get_bmc_mc(mc->emu);
@@ -1158,6 +1166,7 @@ ipmi_mc_add_sensor(lmc_data_t    *mc,
     sensor->enabled = 1;
     /* Clear any status we might have just generated. */
     sensor->event_status = 0;
+    sensor_reading_changed(sensor);
 
     return 0;
 }
@@ -1214,6 +1223,7 @@ file_poll(void *cb_data, unsigned int *rval, const char **errstr)
 	    return EINVAL;
 	}
 	sensor->enabled = bit_set(dsensor->event_status, f->depends_sensor_bit);
+	sensor_reading_changed(sensor);
 	if (!sensor->enabled) 
 	    return 0;
     }
@@ -1451,6 +1461,7 @@ file_post_init(void *cb_data, const char **errstr)
     }
 
     sensor->event_status = f->initstate;
+    sensor_reading_changed(sensor);
 
     return 0;
 }
@@ -1463,7 +1474,172 @@ static ipmi_sensor_handler_t file_sensor =
     .postinit = file_post_init
 };
 
-static ipmi_sensor_handler_t *sensor_handlers = &file_sensor;
+/*
+ * Generate readings from a waveform, for testing how clients handle
+ * changing sensors without having to push values in.
+ */
+enum wave_shape { WAVE_RAMP, WAVE_SINE, WAVE_WALK, WAVE_SQUARE };
+
+struct wave_data {
+    lmc_data_t *mc;
+    enum wave_shape shape;
+    int min;
+    int max;
+    unsigned int period; /* In milliseconds */
+    unsigned int phase;  /* In milliseconds */
+    int step;
+    int val;
+    unsigned int seed;
+};
+
+static int
+wave_poll(void *cb_data, unsigned int *rval, const char **errstr)
+{
+    struct wave_data *w = cb_data;
+    sys_data_t *sys = w->mc->sysinfo;
+    struct timeval tv;
+    unsigned long long ms;
+    double pos;
+    int range = w->max - w->min;
+
+    sys->get_monotonic_time(sys, &tv);
+    ms = ((unsigned long long) tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+    pos = ((double) ((ms + w->phase) % w->period)) / w->period;
+
+    switch (w->shape) {
+    case WAVE_RAMP:
+	w->val = w->min + (int) (pos * range);
+	break;
+
+    case WAVE_SINE:
+	w->val = w->min + (int) (((1.0 + sin(2 * M_PI * pos)) / 2) * range);
+	break;
+
+    case WAVE_SQUARE:
+	w->val = (pos < 0.5) ? w->min : w->max;
+	break;
+
+    case WAVE_WALK:
+	w->val += (rand_r(&w->seed) % (2 * w->step + 1)) - w->step;
+	if (w->val < w->min)
+	    w->val = w->min;
+	else if (w->val > w->max)
+	    w->val = w->max;
+	break;
+    }
+
+    *rval = w->val;
+    return 0;
+}
+
+static int
+wave_init(lmc_data_t *mc,
+	  unsigned char lun, unsigned char sensor_num,
+	  char **toks, void *cb_data, void **rcb_data,
+	  const char **errstr)
+{
+    struct wave_data *w;
+    const char *tok;
+    char *end;
+
+    tok = mystrtok(NULL, " \t\n", toks);
+    if (!tok) {
+	*errstr = "No wave shape given";
+	return EINVAL;
+    }
+
+    w = malloc(sizeof(*w));
+    if (!w)
+	return ENOMEM;
+    memset(w, 0, sizeof(*w));
+    w->mc = mc;
+    w->max = 255;
+    w->period = 60000;
+    w->step = 1;
+    w->seed = (ipmi_mc_get_ipmb(mc) << 16) | (lun << 8) | sensor_num;
+
+    if (strcmp(tok, "ramp") == 0)
+	w->shape = WAVE_RAMP;
+    else if (strcmp(tok, "sine") == 0)
+	w->shape = WAVE_SINE;
+    else if (strcmp(tok, "walk") == 0)
+	w->shape = WAVE_WALK;
+    else if (strcmp(tok, "square") == 0)
+	w->shape = WAVE_SQUARE;
+    else {
+	*errstr = "Invalid wave shape, shapes are ramp, sine, walk and square";
+	goto out_err;
+    }
+
+    tok = mystrtok(NULL, " \t\n", toks);
+    while (tok) {
+	if (strncmp("min=", tok, 4) == 0) {
+	    w->min = strtol(tok + 4, &end, 0);
+	    if (*end != '\0') {
+		*errstr = "Invalid min value";
+		goto out_err;
+	    }
+	} else if (strncmp("max=", tok, 4) == 0) {
+	    w->max = strtol(tok + 4, &end, 0);
+	    if (*end != '\0') {
+		*errstr = "Invalid max value";
+		goto out_err;
+	    }
+	} else if (strncmp("period=", tok, 7) == 0) {
+	    w->period = strtoul(tok + 7, &end, 0);
+	    if ((*end != '\0') || (w->period == 0)) {
+		*errstr = "Invalid period value";
+		goto out_err;
+	    }
+	} else if (strncmp("phase=", tok, 6) == 0) {
+	    w->phase = strtoul(tok + 6, &end, 0);
+	    if (*end != '\0') {
+		*errstr = "Invalid phase value";
+		goto out_err;
+	    }
+	} else if (strncmp("step=", tok, 5) == 0) {
+	    w->step = strtol(tok + 5, &end, 0);
+	    if ((*end != '\0') || (w->step < 0)) {
+		*errstr = "Invalid step value";
+		goto out_err;
+	    }
+	} else if (strncmp("seed=", tok, 5) == 0) {
+	    w->seed = strtoul(tok + 5, &end, 0);
+	    if (*end != '\0') {
+		*errstr = "Invalid seed value";
+		goto out_err;
+	    }
+	} else {
+	    *errstr = "Invalid wave option, options are min=, max=, period=,"
+		" phase=, step= and seed=";
+	    goto out_err;
+	}
+	tok = mystrtok(NULL, " \t\n", toks);
+    }
+
+    if (w->min > w->max) {
+	*errstr = "Wave min is greater than max";
+	goto out_err;
+    }
+    w->val = w->min + ((w->max - w->min) / 2);
+
+    *rcb_data = w;
+    return 0;
+
+  out_err:
+    free(w);
+    return -1;
+}
+
+static ipmi_sensor_handler_t wave_sensor =
+{
+    .name = "wave",
+    .poll = wave_poll,
+    .init = wave_init,
+    .next = &file_sensor
+};
+
+static ipmi_sensor_handler_t *sensor_handlers = &wave_sensor;
 
 int
 ipmi_sensor_add_handler(ipmi_sensor_handler_t *handler)
@@ -1489,10 +1665,32 @@ ipmi_sensor_find_handler(const char *name)
 static void
 free_sensor(lmc_data_t *mc, sensor_t *sensor)
 {
+    if (mc->emu->atca_mode && (sensor->sensor_type == 0xf0))
+	picmg_remove_hs_sensor(mc, sensor);
     mc->sensors[sensor->lun][sensor->num] = NULL;
     free(sensor);
 }
 
+/*
+ * Set a sensor from a polled value, a reading for threshold sensors
+ * or a bitmask of states for discrete ones.
+ */
+static void
+sensor_set_polled_val(lmc_data_t *mc, sensor_t *sensor, unsigned int val)
+{
+    if (sensor->event_reading_code == IPMI_EVENT_READING_TYPE_THRESHOLD) {
+	if (val > 255)
+	    val = 255;
+	set_sensor_value(mc, sensor, val, 1);
+    } else {
+	unsigned int i;
+
+	for (i = 0; i < 15; i++)
+	    set_sensor_bit(mc, sensor,
+			   i, ((val >> i) & 1), 0, 0xff, 0xff, 1);
+    }
+}
+
 static void
 sensor_poll(void *cb_data)
 {
@@ -1512,26 +1710,364 @@ sensor_poll(void *cb_data)
 			     strerror(err), errstr);
 	    goto out_restart;
 	}
-	
-	if (sensor->event_reading_code == IPMI_EVENT_READING_TYPE_THRESHOLD) {
-	    if (val < 0)
-		val = 0;
-	    else if (val > 255)
-		val = 255;
-	    set_sensor_value(mc, sensor, val, 1);
-	} else {
-	    unsigned int i;
-	    
-	    for (i = 0; i < 15; i++)
-		set_sensor_bit(mc, sensor,
-			       i, ((val >> i) & 1), 0, 0xff, 0xff, 1);
-	}
+
+	sensor_set_polled_val(mc, sensor, val);
 
       out_restart:
 	mc->sysinfo->start_timer(sensor->poll_timer, &sensor->poll_timer_time);
     }
 }
 
+/*
+ * Sensor groups.  Groups are kept on a poll slot for their system and
+ * period, and all the groups on a slot are read from its timer.
+ */
+struct sensor_poll_slot_s {
+    sys_data_t          *sys;
+    unsigned int        period;
+    struct timeval      tv;
+    ipmi_timer_t        *timer;
+    ipmi_sensor_group_t *groups;
+
+    struct sensor_poll_slot_s *next;
+};
+
+static struct sensor_poll_slot_s *sensor_poll_slots;
+
+struct ipmi_sensor_group_s {
+    lmc_data_t                *mc;
+    struct sensor_poll_slot_s *slot;
+    void (*read)(void *cb_data, unsigned int num_sensors,
+		 unsigned int *vals, int *errs);
+    void                      *cb_data;
+
+    /* Sensors are (lun << 8) | num, looked up on each poll. */
+    unsigned int              num_sensors;
+    uint16_t                  *sensors;
+    unsigned int              *vals;
+    int                       *errs;
+
+    ipmi_sensor_group_t       *next;
+};
+
+static void
+sensor_group_poll(ipmi_sensor_group_t *group)
+{
+    lmc_data_t *mc = group->mc;
+    sensor_t *sensor;
+    unsigned int i;
+    uint16_t s;
+
+    if (!group->num_sensors)
+	return;
+
+    memset(group->errs, 0, group->num_sensors * sizeof(int));
+    group->read(group->cb_data, group->num_sensors, group->vals, group->errs);
+
+    for (i = 0; i < group->num_sensors; i++) {
+	s = group->sensors[i];
+	sensor = mc->sensors[s >> 8][s & 0xff];
+	if (!sensor || !sensor->scanning_enabled)
+	    continue;
+	if (group->errs[i]) {
+	    mc->sysinfo->log(mc->sysinfo, OS_ERROR, NULL,
+			     "Error getting sensor value (%2.2x,%d,%d): %s",
+			     ipmi_mc_get_ipmb(mc), sensor->lun, sensor->num,
+			     strerror(group->errs[i]));
+	    continue;
+	}
+	sensor_set_polled_val(mc, sensor, group->vals[i]);
+    }
+}
+
+static void
+sensor_poll_slot_timeout(void *cb_data)
+{
+    struct sensor_poll_slot_s *slot = cb_data;
+    ipmi_sensor_group_t *group;
+
+    for (group = slot->groups; group; group = group->next)
+	sensor_group_poll(group);
+
+    slot->sys->start_timer(slot->timer, &slot->tv);
+}
+
+int
+ipmi_mc_alloc_sensor_group(lmc_data_t   *mc,
+			   unsigned int period,
+			   void (*read)(void *cb_data,
+					unsigned int num_sensors,
+					unsigned int *vals,
+					int *errs),
+			   void *cb_data,
+			   ipmi_sensor_group_t **rgroup)
+{
+    sys_data_t *sys = mc->sysinfo;
+    struct sensor_poll_slot_s *slot;
+    ipmi_sensor_group_t *group;
+    int err;
+
+    if (!period || !read)
+	return EINVAL;
+
+    group = malloc(sizeof(*group));
+    if (!group)
+	return ENOMEM;
+    memset(group, 0, sizeof(*group));
+    group->mc = mc;
+    group->read = read;
+    group->cb_data = cb_data;
+
+    for (slot = sensor_poll_slots; slot; slot = slot->next) {
+	if (slot->sys == sys && slot->period == period)
+	    break;
+    }
+    if (!slot) {
+	slot = malloc(sizeof(*slot));
+	if (!slot) {
+	    free(group);
+	    return ENOMEM;
+	}
+	memset(slot, 0, sizeof(*slot));
+	slot->sys = sys;
+	slot->period = period;
+	slot->tv.tv_sec = period / 1000;
+	slot->tv.tv_usec = (period % 1000) * 1000;
+	err = sys->alloc_timer(sys, sensor_poll_slot_timeout, slot,
+			       &slot->timer);
+	if (err) {
+	    free(slot);
+	    free(group);
+	    return err;
+	}
+	slot->next = sensor_poll_slots;
+	sensor_poll_slots = slot;
+	sys->start_timer(slot->timer, &slot->tv);
+    }
+
+    group->slot = slot;
+    group->next = slot->groups;
+    slot->groups = group;
+    *rgroup = group;
+    return 0;
+}
+
+int
+ipmi_sensor_group_add_sensor(ipmi_sensor_group_t *group,
+			     unsigned char lun,
+			     unsigned char sens_num)
+{
+    unsigned int n = group->num_sensors + 1;
+    uint16_t *sensors;
+    unsigned int *vals;
+    int *errs;
+
+    if ((lun >= 4) || (sens_num >= 255) || !group->mc->sensors[lun][sens_num])
+	return EINVAL;
+
+    sensors = realloc(group->sensors, n * sizeof(*sensors));
+    if (!sensors)
+	return ENOMEM;
+    group->sensors = sensors;
+    vals = realloc(group->vals, n * sizeof(*vals));
+    if (!vals)
+	return ENOMEM;
+    group->vals = vals;
+    errs = realloc(group->errs, n * sizeof(*errs));
+    if (!errs)
+	return ENOMEM;
+    group->errs = errs;
+
+    group->sensors[group->num_sensors] = (lun << 8) | sens_num;
+    group->num_sensors = n;
+    return 0;
+}
+
+void
+ipmi_sensor_group_free(ipmi_sensor_group_t *group)
+{
+    struct sensor_poll_slot_s *slot = group->slot, **sp;
+    ipmi_sensor_group_t **gp;
+
+    for (gp = &slot->groups; *gp != group; gp = &(*gp)->next)
+	;
+    *gp = group->next;
+    free(group->sensors);
+    free(group->vals);
+    free(group->errs);
+    free(group);
+
+    if (slot->groups)
+	return;
+    for (sp = &sensor_poll_slots; *sp != slot; sp = &(*sp)->next)
+	;
+    *sp = slot->next;
+    slot->sys->stop_timer(slot->timer);
+    slot->sys->free_timer(slot->timer);
+    free(slot);
+}
+
+void
+ipmi_mc_free_sensor_groups(lmc_data_t *mc)
+{
+    struct sensor_poll_slot_s *slot, *next_slot;
+    ipmi_sensor_group_t *group, *next;
+
+    for (slot = sensor_poll_slots; slot; slot = next_slot) {
+	/* Freeing the last group frees the slot. */
+	next_slot = slot->next;
+	for (group = slot->groups; group; group = next) {
+	    next = group->next;
+	    if (group->mc == mc)
+		ipmi_sensor_group_free(group);
+	}
+    }
+}
+
+/*
+ * Event storms.  The timer runs STORM_INTERVAL times a second and
+ * toggles a bit in as many sensors as needed to keep up the rate.
+ */
+#define STORM_INTERVAL 10
+
+struct sensor_storm_s {
+    lmc_data_t    *mc;
+    ipmi_timer_t  *timer;
+    unsigned int  rate;
+    unsigned int  intervals_left; /* 0 means run until stopped */
+    unsigned int  owed;
+    unsigned char bit;
+    unsigned int  num_sensors;
+    unsigned int  next;
+    uint16_t      sensors[];
+};
+
+static void
+sensor_storm_timeout(void *cb_data)
+{
+    struct sensor_storm_s *storm = cb_data;
+    lmc_data_t *mc = storm->mc;
+    struct timeval tv;
+    unsigned int count, tries;
+    sensor_t *sensor;
+    uint16_t s;
+
+    storm->owed += storm->rate;
+    count = storm->owed / STORM_INTERVAL;
+    storm->owed %= STORM_INTERVAL;
+
+    /* Skip sensors that have gone away, but don't spin if all have. */
+    tries = storm->num_sensors;
+    while (count && tries) {
+	s = storm->sensors[storm->next];
+	storm->next = (storm->next + 1) % storm->num_sensors;
+	sensor = mc->sensors[s >> 8][s & 0xff];
+	if (!sensor) {
+	    tries--;
+	    continue;
+	}
+	tries = storm->num_sensors;
+	set_sensor_bit(mc, sensor, storm->bit,
+		       !bit_set(sensor->event_status, storm->bit),
+		       0, 0xff, 0xff, 1);
+	count--;
+    }
+
+    if (storm->intervals_left && (--storm->intervals_left == 0)) {
+	ipmi_mc_stop_sensor_storm(mc);
+	return;
+    }
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 1000000 / STORM_INTERVAL;
+    mc->sysinfo->start_timer(storm->timer, &tv);
+}
+
+void
+ipmi_mc_stop_sensor_storm(lmc_data_t *mc)
+{
+    struct sensor_storm_s *storm = mc->storm;
+
+    if (!storm)
+	return;
+    mc->storm = NULL;
+    mc->sysinfo->stop_timer(storm->timer);
+    mc->sysinfo->free_timer(storm->timer);
+    free(storm);
+}
+
+int
+ipmi_mc_sensor_storm(lmc_data_t    *mc,
+		     unsigned int  rate,
+		     unsigned int  duration,
+		     unsigned char bit,
+		     unsigned int  num_sensors,
+		     uint16_t      *sensors)
+{
+    struct sensor_storm_s *storm;
+    struct timeval tv;
+    unsigned int i, j;
+    int err;
+
+    ipmi_mc_stop_sensor_storm(mc);
+    if (rate == 0)
+	return 0;
+
+    if (bit >= 15)
+	return EINVAL;
+
+    if (num_sensors == 0) {
+	for (i = 0; i < 4; i++) {
+	    for (j = 0; j < 255; j++) {
+		if (mc->sensors[i][j])
+		    num_sensors++;
+	    }
+	}
+	if (num_sensors == 0)
+	    return EINVAL;
+    } else {
+	for (i = 0; i < num_sensors; i++) {
+	    if (((sensors[i] >> 8) >= 4) || ((sensors[i] & 0xff) >= 255)
+		|| !mc->sensors[sensors[i] >> 8][sensors[i] & 0xff])
+		return EINVAL;
+	}
+    }
+
+    storm = malloc(sizeof(*storm) + (num_sensors * sizeof(uint16_t)));
+    if (!storm)
+	return ENOMEM;
+    memset(storm, 0, sizeof(*storm));
+    storm->mc = mc;
+    storm->rate = rate;
+    storm->intervals_left = duration * STORM_INTERVAL;
+    storm->bit = bit;
+    storm->num_sensors = num_sensors;
+    if (sensors) {
+	memcpy(storm->sensors, sensors, num_sensors * sizeof(uint16_t));
+    } else {
+	num_sensors = 0;
+	for (i = 0; i < 4; i++) {
+	    for (j = 0; j < 255; j++) {
+		if (mc->sensors[i][j])
+		    storm->sensors[num_sensors++] = (i << 8) | j;
+	    }
+	}
+    }
+
+    err = mc->sysinfo->alloc_timer(mc->sysinfo, sensor_storm_timeout, storm,
+				   &storm->timer);
+    if (err) {
+	free(storm);
+	return err;
+    }
+    mc->storm = storm;
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 1000000 / STORM_INTERVAL;
+    mc->sysinfo->start_timer(storm->timer, &tv);
+    return 0;
+}
+
 int
 ipmi_mc_add_polled_sensor(lmc_data_t    *mc,
 			  unsigned char lun,
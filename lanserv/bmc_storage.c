@@ -34,10 +34,12 @@
 
 #include <errno.h>
 #include <malloc.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #include <OpenIPMI/ipmi_err.h>
@@ -52,30 +54,233 @@
 #define IPMI_SEL_SUPPORTS_RESERVE        (1 << 1)
 #define IPMI_SEL_SUPPORTS_GET_ALLOC_INFO (1 << 0)
 
+void *
+recid_index_find(recid_index_t *idx, uint16_t record_id)
+{
+    void **page = idx->pages[record_id >> RECID_PAGE_SHIFT];
+
+    if (!page)
+	return NULL;
+    return page[record_id & (RECID_PAGE_SIZE - 1)];
+}
+
+void
+recid_index_set(recid_index_t *idx, uint16_t record_id, void *item)
+{
+    void **page = idx->pages[record_id >> RECID_PAGE_SHIFT];
+
+    if (!page) {
+	if (!item)
+	    return;
+	page = calloc(RECID_PAGE_SIZE, sizeof(void *));
+	if (!page) {
+	    idx->broken = 1;
+	    return;
+	}
+	idx->pages[record_id >> RECID_PAGE_SHIFT] = page;
+    }
+    page[record_id & (RECID_PAGE_SIZE - 1)] = item;
+}
+
+void
+recid_index_free(recid_index_t *idx)
+{
+    unsigned int i;
+
+    for (i = 0; i < RECID_NUM_PAGES; i++) {
+	if (idx->pages[i]) {
+	    free(idx->pages[i]);
+	    idx->pages[i] = NULL;
+	}
+    }
+    idx->broken = 0;
+}
+
+typedef struct shared_data_s
+{
+    unsigned int refcount;
+    unsigned int len;
+    uint32_t     hash;
+    int          hashed;
+    struct shared_data_s *next;
+    unsigned char data[];
+} shared_data_t;
+
+#define SHARED_DATA_HASH_SIZE 1024
+static shared_data_t *shared_data_hash[SHARED_DATA_HASH_SIZE];
+
+static shared_data_t *
+data_to_shared(unsigned char *data)
+{
+    return (shared_data_t *) (data - offsetof(shared_data_t, data));
+}
+
+static uint32_t
+shared_data_hashval(unsigned char *data, unsigned int len)
+{
+    uint32_t h = 2166136261U;
+    unsigned int i;
+
+    for (i = 0; i < len; i++) {
+	h ^= data[i];
+	h *= 16777619;
+    }
+    return h;
+}
+
+static void
+shared_data_unhash(shared_data_t *sd)
+{
+    shared_data_t **p = &shared_data_hash[sd->hash % SHARED_DATA_HASH_SIZE];
+
+    while (*p && (*p != sd))
+	p = &(*p)->next;
+    if (*p)
+	*p = sd->next;
+    sd->hashed = 0;
+}
+
+unsigned char *
+ipmi_data_alloc(unsigned int len)
+{
+    shared_data_t *sd = malloc(sizeof(*sd) + len);
+
+    if (!sd)
+	return NULL;
+    sd->refcount = 1;
+    sd->len = len;
+    sd->hashed = 0;
+    sd->next = NULL;
+    return sd->data;
+}
+
+/*
+ * Call when data is complete.  If the same data is already kept, this
+ * frees the passed in data and returns the kept copy.
+ */
+unsigned char *
+ipmi_data_share(unsigned char *data)
+{
+    shared_data_t *sd = data_to_shared(data), *o;
+    uint32_t h;
+
+    if (sd->hashed)
+	return data;
+
+    h = shared_data_hashval(data, sd->len);
+    o = shared_data_hash[h % SHARED_DATA_HASH_SIZE];
+    while (o) {
+	if ((o->hash == h) && (o->len == sd->len)
+	    && (memcmp(o->data, data, sd->len) == 0))
+	{
+	    o->refcount++;
+	    ipmi_data_free(data);
+	    return o->data;
+	}
+	o = o->next;
+    }
+
+    sd->hash = h;
+    sd->hashed = 1;
+    sd->next = shared_data_hash[h % SHARED_DATA_HASH_SIZE];
+    shared_data_hash[h % SHARED_DATA_HASH_SIZE] = sd;
+    return data;
+}
+
+/*
+ * Returns data that may be written, which is a new copy if someone
+ * else is using it.  The passed in data is not valid after this
+ * unless it is returned.  Returns NULL if out of memory, the data is
+ * unchanged then.
+ */
+unsigned char *
+ipmi_data_unshare(unsigned char *data)
+{
+    shared_data_t *sd = data_to_shared(data);
+    unsigned char *ndata;
+
+    if (sd->refcount == 1) {
+	if (sd->hashed)
+	    shared_data_unhash(sd);
+	return data;
+    }
+
+    ndata = ipmi_data_alloc(sd->len);
+    if (!ndata)
+	return NULL;
+    memcpy(ndata, data, sd->len);
+    sd->refcount--;
+    return ndata;
+}
+
+void
+ipmi_data_free(unsigned char *data)
+{
+    shared_data_t *sd;
+
+    if (!data)
+	return;
+    sd = data_to_shared(data);
+    if (--sd->refcount > 0)
+	return;
+    if (sd->hashed)
+	shared_data_unhash(sd);
+    free(sd);
+}
+
+static void
+sel_link_entry(lmc_data_t *mc, sel_entry_t *e)
+{
+    e->next = NULL;
+    e->prev = mc->sel.tail;
+    if (mc->sel.tail)
+	mc->sel.tail->next = e;
+    else
+	mc->sel.entries = e;
+    mc->sel.tail = e;
+    if (!recid_index_find(&mc->sel.index, e->record_id))
+	recid_index_set(&mc->sel.index, e->record_id, e);
+    mc->sel.count++;
+}
+
+static void
+sel_unlink_entry(lmc_data_t *mc, sel_entry_t *e)
+{
+    if (e->prev)
+	e->prev->next = e->next;
+    else
+	mc->sel.entries = e->next;
+    if (e->next)
+	e->next->prev = e->prev;
+    else
+	mc->sel.tail = e->prev;
+    if (recid_index_find(&mc->sel.index, e->record_id) == e)
+	recid_index_set(&mc->sel.index, e->record_id, NULL);
+    mc->sel.count--;
+}
+
 static sel_entry_t *
 find_sel_event_by_recid(lmc_data_t  *mc,
-			uint16_t    record_id,
-			sel_entry_t **prev)
+			uint16_t    record_id)
 {
     sel_entry_t *entry;
-    sel_entry_t *p_entry = NULL;
+
+    if (!mc->sel.index.broken)
+	return recid_index_find(&mc->sel.index, record_id);
 
     entry = mc->sel.entries;
     while (entry) {
 	if (record_id == entry->record_id)
 	    break;
-	p_entry = entry;
 	entry = entry->next;
     }
-    if (prev)
-	*prev = p_entry;
     return entry;
 }
 
 static int
 handle_sel(const char *name, void *data, unsigned int len, void *cb_data)
 {
-    sel_entry_t *e, *n;
+    sel_entry_t *n;
     lmc_data_t *mc = cb_data;
 
     if (len != 16) {
@@ -91,17 +296,7 @@ handle_sel(const char *name, void *data, unsigned int len, void *cb_data)
 
     memcpy(n->data, data, 16);
     n->record_id = n->data[0] | (n->data[1] << 8);
-    n->next = NULL;
-
-    e = mc->sel.entries;
-    if (!e)
-	mc->sel.entries = n;
-    else {
-	while (e->next)
-	    e = e->next;
-	e->next = n;
-    }
-    mc->sel.count++;
+    sel_link_entry(mc, n);
 
   out:
     return ITER_PERSIST_CONTINUE;
@@ -127,6 +322,8 @@ ipmi_mc_enable_sel(lmc_data_t    *mc,
     persist_t *p;
 
     mc->sel.entries = NULL;
+    mc->sel.tail = NULL;
+    recid_index_free(&mc->sel.index);
     mc->sel.count = 0;
     mc->sel.max_count = max_entries;
     mc->sel.last_add_time = 0;
@@ -185,6 +382,46 @@ rewrite_sels(lmc_data_t *mc)
 	free_persist(p);
 }
 
+/*
+ * Adding and deleting single entries goes to the persist journal, the
+ * whole SEL is only rewritten when it is cleared.
+ */
+static void
+journal_sel_entry(lmc_data_t *mc, sel_entry_t *e, int deleted)
+{
+    persist_t *p = NULL;
+    int err;
+
+    p = alloc_persist("sel.%2.2x", ipmi_mc_get_ipmb(mc));
+    if (!p) {
+	err = ENOMEM;
+	goto out_err;
+    }
+
+    if (deleted) {
+	err = add_persist_del(p, "%d", e->record_id);
+    } else {
+	err = add_persist_int(p, mc->sel.last_add_time, "last_add_time");
+	if (!err)
+	    err = add_persist_data(p, e->data, 16, "%d", e->record_id);
+    }
+    if (err)
+	goto out_err;
+
+    err = journal_persist(p);
+    if (err)
+	goto out_err;
+    free_persist(p);
+    return;
+
+  out_err:
+    mc->sysinfo->log(mc->sysinfo, OS_ERROR, NULL,
+		     "Unable to write persistent SELs for MC %d: %d",
+		     ipmi_mc_get_ipmb(mc), err);
+    if (p)
+	free_persist(p);
+}
+
 int
 ipmi_mc_add_to_sel(lmc_data_t    *mc,
 		   unsigned char record_type,
@@ -212,7 +449,7 @@ ipmi_mc_add_to_sel(lmc_data_t    *mc,
     mc->sel.next_entry++;
     start_record_id = e->record_id;
     while ((mc->sel.next_entry == 0)
-	   || find_sel_event_by_recid(mc, e->record_id, NULL))
+	   || find_sel_event_by_recid(mc, e->record_id))
     {
 	e->record_id++;
 	if (e->record_id == start_record_id)
@@ -231,24 +468,14 @@ ipmi_mc_add_to_sel(lmc_data_t    *mc,
 	memcpy(e->data+3, event, 13);
     }
 
-    e->next = NULL;
-    if (!mc->sel.entries) {
-	mc->sel.entries = e;
-    } else {
-	sel_entry_t *f = mc->sel.entries;
-	while (f->next)
-	    f = f->next;
-	f->next = e;
-    }
-
-    mc->sel.count++;
+    sel_link_entry(mc, e);
 
     mc->sel.last_add_time = t.tv_sec + mc->sel.time_offset;
 
     if (recid)
 	*recid = e->record_id;
 
-    rewrite_sels(mc);
+    journal_sel_entry(mc, e, 0);
 
     return 0;
 }
@@ -397,14 +624,9 @@ handle_get_sel_entry(lmc_data_t    *mc,
     if (record_id == 0) {
 	entry = mc->sel.entries;
     } else if (record_id == 0xffff) {
-	entry = mc->sel.entries;
-	if (entry) {
-	    while (entry->next) {
-		entry = entry->next;
-	    }
-	}
+	entry = mc->sel.tail;
     } else {
-	entry = find_sel_event_by_recid(mc, record_id, NULL);
+	entry = find_sel_event_by_recid(mc, record_id);
     }
 
     if (entry == NULL) {
@@ -465,7 +687,7 @@ handle_delete_sel_entry(lmc_data_t    *mc,
 			void          *cb_data)
 {
     uint16_t    record_id;
-    sel_entry_t *entry, *p_entry;
+    sel_entry_t *entry;
 
     if (!(mc->device_support & IPMI_DEVID_SEL_DEVICE)) {
 	handle_invalid_cmd(mc, rdata, rdata_len);
@@ -494,18 +716,10 @@ handle_delete_sel_entry(lmc_data_t    *mc,
 
     if (record_id == 0) {
 	entry = mc->sel.entries;
-	p_entry = NULL;
     } else if (record_id == 0xffff) {
-	entry = mc->sel.entries;
-	p_entry = NULL;
-	if (entry) {
-	    while (entry->next) {
-		p_entry = entry;
-		entry = entry->next;
-	    }
-	}
+	entry = mc->sel.tail;
     } else {
-	entry = find_sel_event_by_recid(mc, record_id, &p_entry);
+	entry = find_sel_event_by_recid(mc, record_id);
     }
     if (!entry) {
 	rdata[0] = IPMI_NOT_PRESENT_CC;
@@ -513,10 +727,7 @@ handle_delete_sel_entry(lmc_data_t    *mc,
 	return;
     }
 
-    if (p_entry)
-	p_entry->next = entry->next;
-    else
-	mc->sel.entries = entry->next;
+    sel_unlink_entry(mc, entry);
 
     /* Clear the overflow flag. */
     mc->sel.flags &= ~0x80;
@@ -525,10 +736,8 @@ handle_delete_sel_entry(lmc_data_t    *mc,
     ipmi_set_uint16(rdata+1, entry->record_id);
     *rdata_len = 3;
 
-    mc->sel.count--;
+    journal_sel_entry(mc, entry, 1);
     free(entry);
-
-    rewrite_sels(mc);
 }
 
 static void
@@ -581,6 +790,8 @@ handle_clear_sel(lmc_data_t    *mc,
     if (op == 0xaa) {
 	entry = mc->sel.entries;
 	mc->sel.entries = NULL;
+	mc->sel.tail = NULL;
+	recid_index_free(&mc->sel.index);
 	mc->sel.count = 0;
 	while (entry) {
 	    n_entry = entry->next;
@@ -662,20 +873,53 @@ find_sdr_by_recid(sdrs_t     *sdrs,
 		  sdr_t      **prev)
 {
     sdr_t *entry;
-    sdr_t *p_entry = NULL;
 
-    entry = sdrs->sdrs;
-    while (entry) {
-	if (record_id == entry->record_id)
-	    break;
-	p_entry = entry;
-	entry = entry->next;
+    if (!sdrs->index.broken) {
+	entry = recid_index_find(&sdrs->index, record_id);
+    } else {
+	entry = sdrs->sdrs;
+	while (entry) {
+	    if (record_id == entry->record_id)
+		break;
+	    entry = entry->next;
+	}
     }
     if (prev)
-	*prev = p_entry;
+	*prev = entry ? entry->prev : NULL;
     return entry;
 }
 
+static void
+sdr_link_entry(sdrs_t *sdrs, sdr_t *entry)
+{
+    entry->next = NULL;
+    entry->prev = sdrs->tail;
+    if (sdrs->tail)
+	sdrs->tail->next = entry;
+    else
+	sdrs->sdrs = entry;
+    sdrs->tail = entry;
+    if (!recid_index_find(&sdrs->index, entry->record_id))
+	recid_index_set(&sdrs->index, entry->record_id, entry);
+    sdrs->sdr_count++;
+}
+
+static void
+sdr_unlink_entry(sdrs_t *sdrs, sdr_t *entry)
+{
+    if (entry->prev)
+	entry->prev->next = entry->next;
+    else
+	sdrs->sdrs = entry->next;
+    if (entry->next)
+	entry->next->prev = entry->prev;
+    else
+	sdrs->tail = entry->prev;
+    if (recid_index_find(&sdrs->index, entry->record_id) == entry)
+	recid_index_set(&sdrs->index, entry->record_id, NULL);
+    sdrs->sdr_count--;
+}
+
 sdr_t *
 new_sdr_entry(sdrs_t *sdrs, unsigned char length)
 {
@@ -695,9 +939,11 @@ new_sdr_entry(sdrs_t *sdrs, unsigned char length)
     if (!entry)
 	return NULL;
 
-    entry->data = malloc(length + 6);
-    if (!entry->data)
+    entry->data = ipmi_data_alloc(length + 6);
+    if (!entry->data) {
+	free(entry);
 	return NULL;
+    }
 
     entry->record_id = sdrs->next_entry;
 
@@ -706,10 +952,22 @@ new_sdr_entry(sdrs_t *sdrs, unsigned char length)
     ipmi_set_uint16(entry->data, entry->record_id);
 
     entry->length = length + 6;
+    entry->mapped = 0;
     entry->next = NULL;
+    entry->prev = NULL;
     return entry;
 }
 
+/* The persist name read_mc_sdrs() uses for the repository. */
+static persist_t *
+alloc_sdrs_persist(lmc_data_t *mc, sdrs_t *sdrs)
+{
+    if (sdrs == &mc->main_sdrs)
+	return alloc_persist("sdr.%2.2x.main", ipmi_mc_get_ipmb(mc));
+    return alloc_persist("sdr.%2.2x.device%d", ipmi_mc_get_ipmb(mc),
+			 (int) (sdrs - mc->device_sdrs));
+}
+
 static void
 rewrite_sdrs(lmc_data_t *mc, sdrs_t *sdrs)
 {
@@ -717,7 +975,7 @@ rewrite_sdrs(lmc_data_t *mc, sdrs_t *sdrs)
     sdr_t *sdr;
     int err;
 
-    p = alloc_persist("sdr.%2.2x.main", ipmi_mc_get_ipmb(mc));
+    p = alloc_sdrs_persist(mc, sdrs);
     if (!p) {
 	err = ENOMEM;
 	goto out_err;
@@ -752,57 +1010,81 @@ rewrite_sdrs(lmc_data_t *mc, sdrs_t *sdrs)
 	free_persist(p);
 }
 
+/* Like the SEL, single adds and deletes go to the persist journal. */
+static void
+journal_sdr_entry(lmc_data_t *mc, sdrs_t *sdrs, sdr_t *sdr, int deleted)
+{
+    persist_t *p = NULL;
+    unsigned int recid = ipmi_get_uint16(sdr->data);
+    int err;
+
+    p = alloc_sdrs_persist(mc, sdrs);
+    if (!p) {
+	err = ENOMEM;
+	goto out_err;
+    }
+
+    if (deleted) {
+	err = add_persist_int(p, sdrs->last_erase_time, "last_erase_time");
+	if (!err)
+	    err = add_persist_del(p, "%d", recid);
+    } else {
+	err = add_persist_int(p, sdrs->last_add_time, "last_add_time");
+	if (!err)
+	    err = add_persist_data(p, sdr->data, sdr->length, "%d", recid);
+    }
+    if (err)
+	goto out_err;
+
+    err = journal_persist(p);
+    if (err)
+	goto out_err;
+    free_persist(p);
+    return;
+
+  out_err:
+    mc->sysinfo->log(mc->sysinfo, OS_ERROR, NULL,
+		     "Unable to write persistent SDRs for MC %d: %d",
+		     ipmi_mc_get_ipmb(mc), err);
+    if (p)
+	free_persist(p);
+}
+
 void
 add_sdr_entry(lmc_data_t *mc, sdrs_t *sdrs, sdr_t *entry)
 {
-    sdr_t          *p;
     struct timeval t;
 
-    entry->next = NULL;
-    p = sdrs->sdrs;
-    if (!p)
-	sdrs->sdrs = entry;
-    else {
-	while (p->next)
-	    p = p->next;
-	p->next = entry;
-    }
+    entry->data = ipmi_data_share(entry->data);
+    sdr_link_entry(sdrs, entry);
 
     mc->emu->sysinfo->get_monotonic_time(mc->emu->sysinfo, &t);
     sdrs->last_add_time = t.tv_sec + mc->main_sdrs.time_offset;
-    sdrs->sdr_count++;
 
-    rewrite_sdrs(mc, sdrs);
+    journal_sdr_entry(mc, sdrs, entry, 0);
 }
 
 static void
 free_sdr(sdr_t *sdr)
 {
-    free(sdr->data);
+    if (!sdr->mapped)
+	ipmi_data_free(sdr->data);
     free(sdr);
 }
 
 static int
 handle_sdr(const char *name, void *data, unsigned int len, void *cb_data)
 {
-    sdr_t *sdr, *p;
+    sdr_t *sdr;
     sdrs_t *sdrs = cb_data;
 
     sdr = new_sdr_entry(sdrs, len);
     if (!sdr)
 	return ENOMEM;
     memcpy(sdr->data, data, len);
+    sdr->data = ipmi_data_share(sdr->data);
 
-    sdr->next = NULL;
-    p = sdrs->sdrs;
-    if (!p)
-	sdrs->sdrs = sdr;
-    else {
-	while (p->next)
-	    p = p->next;
-	p->next = sdr;
-    }
-    sdrs->sdr_count++;
+    sdr_link_entry(sdrs, sdr);
 
     return ITER_PERSIST_CONTINUE;
 }
@@ -876,10 +1158,10 @@ ipmi_mc_add_device_sdr(lmc_data_t    *mc,
     if (!entry)
 	return ENOMEM;
 
-    add_sdr_entry(mc, &mc->device_sdrs[lun], entry);
-
     memcpy(entry->data+2, data+2, data_len-2);
 
+    add_sdr_entry(mc, &mc->device_sdrs[lun], entry);
+
     mc->emu->sysinfo->get_monotonic_time(mc->emu->sysinfo, &t);
     mc->sensor_population_change_time = t.tv_sec + mc->main_sdrs.time_offset;
     mc->lun_has_sensors[lun] = 1;
@@ -887,6 +1169,164 @@ ipmi_mc_add_device_sdr(lmc_data_t    *mc,
     return 0;
 }
 
+/*
+ * SDR images stay mapped until exit, and are looked up by filename so
+ * every MC that loads the same image uses the same mapping.
+ */
+typedef struct sdr_image_s {
+    char               *filename;
+    unsigned char      *data;
+    size_t             len;
+    unsigned int       count;
+    struct sdr_image_s *next;
+} sdr_image_t;
+
+static sdr_image_t *sdr_images;
+
+static int
+map_sdr_image(const char *filename, sdr_image_t **rimage)
+{
+    sdr_image_t   *image;
+    struct stat   st;
+    unsigned char *d;
+    unsigned int  count, len, i, pos;
+    int           fd, err;
+
+    for (image = sdr_images; image; image = image->next) {
+	if (strcmp(image->filename, filename) == 0) {
+	    *rimage = image;
+	    return 0;
+	}
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+	return errno;
+    if (fstat(fd, &st) == -1) {
+	err = errno;
+	close(fd);
+	return err;
+    }
+    if (st.st_size < IPMI_SDR_IMAGE_HDR_LEN) {
+	close(fd);
+	return EINVAL;
+    }
+    d = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    err = errno;
+    close(fd);
+    if (d == MAP_FAILED)
+	return err;
+
+    /* Check the whole thing now, the SDR code trusts the lengths. */
+    err = EINVAL;
+    if (memcmp(d, IPMI_SDR_IMAGE_MAGIC, 8) != 0)
+	goto out_err;
+    if (ipmi_get_uint32(d + 8) != IPMI_SDR_IMAGE_VERSION)
+	goto out_err;
+    count = ipmi_get_uint32(d + 12);
+    len = ipmi_get_uint32(d + 16);
+    if (len != st.st_size - IPMI_SDR_IMAGE_HDR_LEN)
+	goto out_err;
+    pos = IPMI_SDR_IMAGE_HDR_LEN;
+    for (i = 0; i < count; i++) {
+	if ((pos + 5 > st.st_size) || (pos + d[pos + 4] + 5 > st.st_size))
+	    goto out_err;
+	pos += d[pos + 4] + 5;
+    }
+    if (pos != st.st_size)
+	goto out_err;
+
+    err = ENOMEM;
+    image = malloc(sizeof(*image));
+    if (!image)
+	goto out_err;
+    image->filename = strdup(filename);
+    if (!image->filename) {
+	free(image);
+	goto out_err;
+    }
+    image->data = d;
+    image->len = st.st_size;
+    image->count = count;
+    image->next = sdr_images;
+    sdr_images = image;
+    *rimage = image;
+    return 0;
+
+  out_err:
+    munmap(d, st.st_size);
+    return err;
+}
+
+int
+ipmi_mc_load_sdr_image(lmc_data_t *mc, int lun, const char *filename)
+{
+    sdr_image_t    *image;
+    sdrs_t         *sdrs;
+    sdr_t          *entry;
+    unsigned char  *d;
+    unsigned int   i, pos;
+    uint16_t       recid;
+    struct timeval t;
+    int            err;
+
+    if (lun == -1) {
+	if (!(mc->device_support & IPMI_DEVID_SDR_REPOSITORY_DEV))
+	    return ENOSYS;
+	sdrs = &mc->main_sdrs;
+    } else if ((lun >= 0) && (lun < 4)) {
+	if (!mc->has_device_sdrs)
+	    return ENOSYS;
+	sdrs = &mc->device_sdrs[lun];
+    } else
+	return EINVAL;
+
+    err = map_sdr_image(filename, &image);
+    if (err)
+	return err;
+
+    /* Check the record ids first so we add all or nothing. */
+    pos = IPMI_SDR_IMAGE_HDR_LEN;
+    for (i = 0; i < image->count; i++) {
+	d = image->data + pos;
+	if (find_sdr_by_recid(sdrs, ipmi_get_uint16(d), NULL))
+	    return EEXIST;
+	pos += d[4] + 5;
+    }
+
+    pos = IPMI_SDR_IMAGE_HDR_LEN;
+    for (i = 0; i < image->count; i++) {
+	d = image->data + pos;
+	pos += d[4] + 5;
+
+	entry = malloc(sizeof(*entry));
+	if (!entry)
+	    return ENOMEM;
+	recid = ipmi_get_uint16(d);
+	entry->record_id = recid;
+	entry->length = d[4] + 5;
+	entry->data = d;
+	entry->mapped = 1;
+	sdr_link_entry(sdrs, entry);
+	if (recid >= sdrs->next_entry) {
+	    sdrs->next_entry = recid + 1;
+	    if (sdrs->next_entry == 0xffff)
+		sdrs->next_entry = 1;
+	}
+    }
+
+    mc->emu->sysinfo->get_monotonic_time(mc->emu->sysinfo, &t);
+    if (lun == -1) {
+	sdrs->last_add_time = t.tv_sec + mc->main_sdrs.time_offset;
+    } else {
+	mc->sensor_population_change_time = (t.tv_sec
+					     + mc->main_sdrs.time_offset);
+	mc->lun_has_sensors[lun] = 1;
+	mc->num_sensors_per_lun[lun] += image->count;
+    }
+    return 0;
+}
+
 static void
 handle_get_sdr_repository_info(lmc_data_t    *mc,
 			       msg_t         *msg,
@@ -1010,12 +1450,7 @@ handle_get_sdr(lmc_data_t    *mc,
     if (record_id == 0) {
 	entry = mc->main_sdrs.sdrs;
     } else if (record_id == 0xffff) {
-	entry = mc->main_sdrs.sdrs;
-	if (entry) {
-	    while (entry->next) {
-		entry = entry->next;
-	    }
-	}
+	entry = mc->main_sdrs.tail;
     } else {
 	entry = find_sdr_by_recid(&mc->main_sdrs, record_id, NULL);
     }
@@ -1231,7 +1666,7 @@ handle_delete_sdr(lmc_data_t    *mc,
 		  void          *cb_data)
 {
     uint16_t       record_id;
-    sdr_t          *entry, *p_entry;
+    sdr_t          *entry;
     struct timeval t;
 
     if (!(mc->device_support & IPMI_DEVID_SDR_REPOSITORY_DEV)) {
@@ -1256,18 +1691,10 @@ handle_delete_sdr(lmc_data_t    *mc,
 
     if (record_id == 0) {
 	entry = mc->main_sdrs.sdrs;
-	p_entry = NULL;
     } else if (record_id == 0xffff) {
-	entry = mc->main_sdrs.sdrs;
-	p_entry = NULL;
-	if (entry) {
-	    while (entry->next) {
-		p_entry = entry;
-		entry = entry->next;
-	    }
-	}
+	entry = mc->main_sdrs.tail;
     } else {
-	entry = find_sdr_by_recid(&mc->main_sdrs, record_id, &p_entry);
+	entry = find_sdr_by_recid(&mc->main_sdrs, record_id, NULL);
     }
     if (!entry) {
 	rdata[0] = IPMI_NOT_PRESENT_CC;
@@ -1275,21 +1702,17 @@ handle_delete_sdr(lmc_data_t    *mc,
 	return;
     }
 
-    if (p_entry)
-	p_entry->next = entry->next;
-    else
-	mc->main_sdrs.sdrs = entry->next;
+    sdr_unlink_entry(&mc->main_sdrs, entry);
 
     rdata[0] = 0;
     ipmi_set_uint16(rdata+1, entry->record_id);
     *rdata_len = 3;
 
-    free_sdr(entry);
-
     mc->emu->sysinfo->get_monotonic_time(mc->emu->sysinfo, &t);
     mc->main_sdrs.last_erase_time = t.tv_sec + mc->main_sdrs.time_offset;
-    mc->main_sdrs.sdr_count--;
-    rewrite_sdrs(mc, &mc->main_sdrs);
+    journal_sdr_entry(mc, &mc->main_sdrs, entry, 1);
+
+    free_sdr(entry);
 }
 
 static void
@@ -1341,6 +1764,10 @@ handle_clear_sdr_repository(lmc_data_t    *mc,
     rdata[1] = 1;
     if (op == 0) {
 	entry = mc->main_sdrs.sdrs;
+	mc->main_sdrs.sdrs = NULL;
+	mc->main_sdrs.tail = NULL;
+	recid_index_free(&mc->main_sdrs.index);
+	mc->main_sdrs.sdr_count = 0;
 	while (entry) {
 	    n_entry = entry->next;
 	    free_sdr(entry);
@@ -1787,6 +2214,14 @@ handle_write_fru_data(lmc_data_t    *mc,
 	    goto out_unlock;
 	}
     } else {
+	unsigned char *data = ipmi_data_unshare(fru->data);
+
+	if (!data) {
+	    rdata[0] = IPMI_OUT_OF_SPACE_CC;
+	    *rdata_len = 1;
+	    goto out_unlock;
+	}
+	fru->data = data;
 	memcpy(fru->data+offset, msg->data+3, count);
     }
     rdata[0] = 0;
@@ -1881,7 +2316,11 @@ ipmi_mc_add_fru_data(lmc_data_t    *mc,
     }
 
     if (fru->data) {
-	free(fru->data);
+	if (fru->fru_io_cb)
+	    free(fru->data);
+	else
+	    ipmi_data_free(fru->data);
+	fru->data = NULL;
 	fru->length = 0;
     }
 
@@ -1889,10 +2328,11 @@ ipmi_mc_add_fru_data(lmc_data_t    *mc,
 	fru->fru_io_cb = fru_io_cb;
 	fru->data = data;
     } else if (length) {
-	fru->data = malloc(length);
+	fru->data = ipmi_data_alloc(length);
 	if (!fru->data)
 	    return ENOMEM;
 	memcpy(fru->data, data, length);
+	fru->data = ipmi_data_share(fru->data);
     } else
 	fru->data = NULL;
 
@@ -555,6 +555,24 @@ get_sock_addr(char **tokptr, sockaddr_ip_t *addr, socklen_t *len,
     }
     p = mystrtok(NULL, " \t\n", tokptr);
 
+    if ((socktype == SOCK_STREAM) && (strcmp(s, "unix") == 0)) {
+	struct sockaddr_un *uaddr = &addr->s_ipsock.s_addrun;
+
+	if (!p) {
+	    *err = "No unix socket path specified";
+	    return -1;
+	}
+	if (strlen(p) >= sizeof(uaddr->sun_path)) {
+	    *err = "Unix socket path too long";
+	    return -1;
+	}
+	memset(uaddr, 0, sizeof(*uaddr));
+	uaddr->sun_family = AF_UNIX;
+	strcpy(uaddr->sun_path, p);
+	*len = sizeof(*uaddr);
+	return 0;
+    }
+
 #ifdef HAVE_GETADDRINFO
     {
 	struct addrinfo     hints, *res0;
@@ -789,10 +807,18 @@ read_config(sys_data_t *sys,
 		    if (!dlibs) {
 			dlibs = dlib;
 		    } else {
+			/* The config is read again for each fleet node,
+			   only load a library once. */
 			dlibp = dlibs;
-			while (dlibp->next)
+			while (dlibp->next && strcmp(dlibp->file, library))
 			    dlibp = dlibp->next;
-			dlibp->next = dlib;
+			if (strcmp(dlibp->file, library) == 0) {
+			    free(dlib);
+			    free((char *) library);
+			    free((char *) initstr);
+			} else {
+			    dlibp->next = dlib;
+			}
 		    }
 		}
 	    }
@@ -868,6 +894,18 @@ read_config(sys_data_t *sys,
 	    err = get_sock_addr(&tokptr,
 				&sys->console_addr, &sys->console_addr_len,
 				NULL, SOCK_STREAM, &errstr);
+	} else if (strcmp(tok, "fault_inject") == 0) {
+	    unsigned int chan_num;
+
+	    err = get_uint(&tokptr, &chan_num, &errstr);
+	    if (!err && ((chan_num >= IPMI_MAX_CHANNELS)
+			 || !sys->chan_set[chan_num])) {
+		errstr = "fault_inject channel is not defined";
+		err = -1;
+	    }
+	    if (!err)
+		err = chan_fault_config(sys, sys->chan_set[chan_num], &tokptr,
+					&errstr);
 	} else {
 	    errstr = "Invalid configuration option";
 	    err = -1;
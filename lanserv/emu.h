@@ -62,6 +62,13 @@
 
 void ipmi_emu_tick(emu_data_t *emu, unsigned int seconds);
 
+/* Only the emulators that have something timing out or something to
+   write need to be ticked.  ipmi_emu_need_tick() puts the emulator on
+   the list, ipmi_emu_tick_pending() ticks everything on the list and
+   syncs the persistent data. */
+void ipmi_emu_need_tick(emu_data_t *emu);
+void ipmi_emu_tick_pending(unsigned int seconds);
+
 typedef void (*ipmi_emu_sleep_cb)(emu_data_t *emu, struct timeval *time);
 
 emu_data_t *ipmi_emu_alloc(void *user_data, ipmi_emu_sleep_cb sleeper,
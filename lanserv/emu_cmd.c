@@ -346,6 +346,69 @@ device_sdr_add(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
     return rv;
 }
 
+static int
+sdr_image(emu_out_t *out, lmc_data_t *mc, int lun, char **toks)
+{
+    const char *filename, *errstr;
+    int        rv;
+
+    rv = get_delim_str(toks, &filename, &errstr);
+    if (rv) {
+	out->printf(out, "**Could not get SDR image filename: %s\n", errstr);
+	return rv;
+    }
+
+    rv = ipmi_mc_load_sdr_image(mc, lun, filename);
+    if (rv)
+	out->printf(out, "**Unable to load SDR image %s, error 0x%x\n",
+		    filename, rv);
+    free((char *) filename);
+    return rv;
+}
+
+static int
+main_sdr_image(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
+{
+    return sdr_image(out, mc, -1, toks);
+}
+
+static int
+device_sdr_image(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
+{
+    int           rv;
+    unsigned char lun;
+
+    rv = emu_get_uchar(out, toks, &lun, "LUN", 0);
+    if (rv)
+	return rv;
+
+    return sdr_image(out, mc, lun, toks);
+}
+
+static int
+chan_fault(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
+{
+    int           rv;
+    unsigned char chan_num;
+    channel_t     **chans = ipmi_mc_get_channelset(mc);
+    const char    *errstr;
+
+    rv = emu_get_uchar(out, toks, &chan_num, "channel", 0);
+    if (rv)
+	return rv;
+
+    if ((chan_num >= IPMI_MAX_CHANNELS) || !chans[chan_num]) {
+	out->printf(out, "**Channel %d is not defined\n", chan_num);
+	return EINVAL;
+    }
+
+    rv = chan_fault_config(ipmi_mc_get_sysinfo(mc), chans[chan_num], toks,
+			   &errstr);
+    if (rv)
+	out->printf(out, "**Unable to set fault injection: %s\n", errstr);
+    return rv;
+}
+
 static int
 sensor_add(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
 {
@@ -513,6 +576,60 @@ sensor_set_bit_clr_rest(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **
     return rv;
 }
 
+#define MAX_STORM_SENSORS 64
+
+static int
+sensor_storm(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
+{
+    int           rv;
+    unsigned int  rate;
+    unsigned int  duration;
+    unsigned char bit;
+    unsigned char lun;
+    unsigned char num;
+    uint16_t      sensors[MAX_STORM_SENSORS];
+    unsigned int  num_sensors = 0;
+
+    rv = emu_get_uint(out, toks, &rate, "events per second");
+    if (rv)
+	return rv;
+
+    if (rate == 0)
+	/* Just stop the storm. */
+	return ipmi_mc_sensor_storm(mc, 0, 0, 0, 0, NULL);
+
+    rv = emu_get_uint(out, toks, &duration, "duration");
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &bit, "bit to toggle", 0);
+    if (rv)
+	return rv;
+
+    for (;;) {
+	rv = emu_get_uchar(out, toks, &lun, "LUN", 1);
+	if (rv == ENOSPC)
+	    break;
+	if (rv)
+	    return rv;
+	rv = emu_get_uchar(out, toks, &num, "sensor num", 0);
+	if (rv)
+	    return rv;
+	if (num_sensors >= MAX_STORM_SENSORS) {
+	    out->printf(out, "**Too many sensors given, max is %d\n",
+			MAX_STORM_SENSORS);
+	    return EINVAL;
+	}
+	sensors[num_sensors++] = (lun << 8) | num;
+    }
+
+    rv = ipmi_mc_sensor_storm(mc, rate, duration, bit, num_sensors,
+			      num_sensors ? sensors : NULL);
+    if (rv)
+	out->printf(out, "**Unable to start sensor storm, error 0x%x\n", rv);
+    return rv;
+}
+
 static int
 sensor_set_value(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
 {
@@ -1020,6 +1137,96 @@ mc_set_num_leds(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
     return rv;
 }
 
+static int
+mc_set_num_frus(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
+{
+    int           rv;
+    unsigned char count;
+
+    rv = emu_get_uchar(out, toks, &count, "number of FRUs", 0);
+    if (rv)
+	return rv;
+
+    rv = ipmi_mc_set_num_frus(mc, count);
+    if (rv)
+	out->printf(out, "**Unable to set number of FRUs, error 0x%x\n", rv);
+    return rv;
+}
+
+static int
+mc_set_fru_hs_state(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc,
+		    char **toks)
+{
+    int           rv;
+    unsigned char first;
+    unsigned char last;
+    unsigned char state;
+    unsigned char gen_event;
+
+    rv = emu_get_uchar(out, toks, &first, "first FRU", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &last, "last FRU", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &state, "hot-swap state", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &gen_event, "generate event", 0);
+    if (rv)
+	return rv;
+
+    rv = ipmi_mc_set_fru_hs_state(mc, first, last, state, gen_event);
+    if (rv)
+	out->printf(out, "**Unable to set FRU hot-swap state, error 0x%x\n",
+		    rv);
+    return rv;
+}
+
+static int
+mc_set_fru_led(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
+{
+    int           rv;
+    unsigned char first;
+    unsigned char last;
+    unsigned char led;
+    unsigned char off_dur;
+    unsigned char on_dur;
+    unsigned char color;
+
+    rv = emu_get_uchar(out, toks, &first, "first FRU", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &last, "last FRU", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &led, "LED", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &off_dur, "LED function", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &on_dur, "on duration", 0);
+    if (rv)
+	return rv;
+
+    rv = emu_get_uchar(out, toks, &color, "color", 0);
+    if (rv)
+	return rv;
+
+    rv = ipmi_mc_set_fru_led(mc, first, last, led, off_dur, on_dur, color);
+    if (rv)
+	out->printf(out, "**Unable to set FRU LED, error 0x%x\n", rv);
+    return rv;
+}
+
 static int
 read_cmds(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
 {
@@ -1105,7 +1312,8 @@ persist_cmd(emu_out_t *out, emu_data_t *emu, lmc_data_t *mc, char **toks)
 
     while ((tok = mystrtok(NULL, " \t\n", toks))) {
 	if (strcmp(tok, "on") == 0) {
-	    persist_enable = 1;
+	    if (!persist_locked_off)
+		persist_enable = 1;
 	} else if (strcmp(tok, "off") == 0) {
 	    persist_enable = 0;
 	} else {
@@ -1188,7 +1396,14 @@ static struct emu_cmd_info cmds[] =
     { "include",	NOMC,		read_cmds,		 &cmds[27] },
     { "sleep",		NOMC,		sleep_cmd,		 &cmds[28] },
     { "debug",		NOMC,		debug_cmd,		 &cmds[29] },
-    { "persist",	NOMC,		persist_cmd,		 NULL },
+    { "persist",	NOMC,		persist_cmd,		 &cmds[30] },
+    { "sensor_storm",	MC,		sensor_storm,		 &cmds[31] },
+    { "main_sdr_image",	MC,		main_sdr_image,		 &cmds[32] },
+    { "device_sdr_image", MC,		device_sdr_image,	 &cmds[33] },
+    { "chan_fault",	MC,		chan_fault,		 &cmds[35] },
+    { "mc_set_num_frus",MC,		mc_set_num_frus,	 &cmds[36] },
+    { "mc_set_fru_hs_state", MC,	mc_set_fru_hs_state,	 &cmds[37] },
+    { "mc_set_fru_led",	MC,		mc_set_fru_led,		 NULL },
     { NULL }
 };
 
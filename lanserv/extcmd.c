@@ -52,7 +52,9 @@
  *      products derived from this software without specific prior
  *      written permission.
  */
+#include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netinet/ether.h>
@@ -62,6 +64,8 @@
 #include <stdio.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include <OpenIPMI/serv.h>
 #include <OpenIPMI/extcmd.h>
@@ -272,6 +276,266 @@ add_cmd(char **cmd, const char *name, char *value, int freevalue)
     return rv;
 }
 
+/*
+ * A command starting with EXTCMD_COPROC_PREFIX is run once as
+ * "<cmd> coproc" and kept around.  Each operation is written to it
+ * as a single line holding what would otherwise be the command's
+ * arguments ("get parm parm ...", "set parm "val" ...") and the
+ * helper answers with the same output the command would give,
+ * followed by a "done <status>" line.
+ */
+#define EXTCMD_COPROC_PREFIX "coproc:"
+
+typedef struct extcmd_coproc_s {
+    char *cmd;
+    pid_t pid;
+    int fd;
+    FILE *from;
+    struct extcmd_coproc_s *next;
+} extcmd_coproc_t;
+
+static extcmd_coproc_t *coprocs;
+
+static void
+coproc_stop(extcmd_coproc_t *c)
+{
+    if (c->from) {
+	fclose(c->from);
+	c->from = NULL;
+    }
+    if (c->fd >= 0) {
+	close(c->fd);
+	c->fd = -1;
+    }
+    if (c->pid > 0) {
+	waitpid(c->pid, NULL, 0);
+	c->pid = -1;
+    }
+}
+
+static int
+coproc_start(extcmd_coproc_t *c)
+{
+    int fds[2];
+    char *cmd;
+    pid_t pid;
+
+    /*
+     * A socket rather than a pipe so a dead helper gives us EPIPE
+     * from send() instead of a SIGPIPE.
+     */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+	return errno;
+
+    cmd = malloc(strlen(c->cmd) + 8);
+    if (!cmd) {
+	close(fds[0]);
+	close(fds[1]);
+	return ENOMEM;
+    }
+    strcpy(cmd, c->cmd);
+    strcat(cmd, " coproc");
+
+    pid = fork();
+    if (pid == -1) {
+	int err = errno;
+	free(cmd);
+	close(fds[0]);
+	close(fds[1]);
+	return err;
+    }
+    if (pid == 0) {
+	close(fds[0]);
+	dup2(fds[1], 0);
+	dup2(fds[1], 1);
+	if (fds[1] > 1)
+	    close(fds[1]);
+	execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+	_exit(127);
+    }
+    free(cmd);
+    close(fds[1]);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+    c->from = fdopen(fds[0], "r");
+    if (!c->from) {
+	close(fds[0]);
+	c->fd = -1;
+	coproc_stop(c);
+	return ENOMEM;
+    }
+    c->fd = fds[0];
+    c->pid = pid;
+    return 0;
+}
+
+static extcmd_coproc_t *
+coproc_find(const char *cmd)
+{
+    extcmd_coproc_t *c;
+
+    for (c = coprocs; c; c = c->next) {
+	if (strcmp(c->cmd, cmd) == 0)
+	    return c;
+    }
+
+    c = malloc(sizeof(*c));
+    if (!c)
+	return NULL;
+    c->cmd = strdup(cmd);
+    if (!c->cmd) {
+	free(c);
+	return NULL;
+    }
+    c->pid = -1;
+    c->fd = -1;
+    c->from = NULL;
+    c->next = coprocs;
+    coprocs = c;
+    return c;
+}
+
+static int
+coproc_send(extcmd_coproc_t *c, const char *line)
+{
+    size_t len = strlen(line);
+    ssize_t rv;
+
+    while (len > 0) {
+	rv = send(c->fd, line, len, MSG_NOSIGNAL);
+	if (rv == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return errno;
+	}
+	line += rv;
+	len -= rv;
+    }
+    return 0;
+}
+
+static int
+coproc_run(sys_data_t *sys, const char *incmd, const char *args,
+	   char *buf, unsigned int buflen, int *status)
+{
+    extcmd_coproc_t *c;
+    char line[256];
+    char *req;
+    unsigned int pos = 0, len;
+    int rv, tries;
+
+    c = coproc_find(incmd);
+    if (!c)
+	return ENOMEM;
+
+    req = malloc(strlen(args) + 2);
+    if (!req)
+	return ENOMEM;
+    strcpy(req, args);
+    strcat(req, "\n");
+
+    /*
+     * If the helper has gone away, start a new one.  A request that
+     * was never delivered is safe to send again.
+     */
+    for (tries = 0; tries < 2; tries++) {
+	if (c->pid <= 0) {
+	    rv = coproc_start(c);
+	    if (rv)
+		goto out;
+	}
+	rv = coproc_send(c, req);
+	if (!rv)
+	    break;
+	coproc_stop(c);
+    }
+    if (rv)
+	goto out;
+
+    buf[0] = '\0';
+    for (;;) {
+	if (!fgets(line, sizeof(line), c->from)) {
+	    sys->log(sys, OS_ERROR, NULL,
+		     "extcmd helper (%s) exited during %s", incmd, args);
+	    coproc_stop(c);
+	    rv = EIO;
+	    goto out;
+	}
+	if (strncmp(line, "done ", 5) == 0) {
+	    *status = strtol(line + 5, NULL, 0);
+	    break;
+	}
+	len = strlen(line);
+	if (pos + len >= buflen) {
+	    /* Keep reading to stay in sync, but report it. */
+	    rv = E2BIG;
+	    continue;
+	}
+	memcpy(buf + pos, line, len + 1);
+	pos += len;
+    }
+
+  out:
+    free(req);
+    return rv;
+}
+
+/*
+ * Run the operation in args and collect its output in buf.  Returns
+ * an errno if the command could not be run, otherwise the command's
+ * exit status is returned in status.
+ */
+static int
+extcmd_run(sys_data_t *sys, const char *incmd, const char *args,
+	   const char *what, char *buf, unsigned int buflen, int *status)
+{
+    FILE *f;
+    char *cmd;
+    int rv = 0;
+
+    if (strncmp(incmd, EXTCMD_COPROC_PREFIX,
+		strlen(EXTCMD_COPROC_PREFIX)) == 0) {
+	rv = coproc_run(sys, incmd + strlen(EXTCMD_COPROC_PREFIX), args,
+			buf, buflen, status);
+	goto out;
+    }
+
+    cmd = malloc(strlen(incmd) + strlen(args) + 2);
+    if (!cmd)
+	return ENOMEM;
+    strcpy(cmd, incmd);
+    strcat(cmd, " ");
+    strcat(cmd, args);
+
+    f = popen(cmd, "r");
+    if (!f) {
+	rv = errno;
+	sys->log(sys, OS_ERROR, NULL,
+		 "Unable to execute extcmd %s command (%s): %s\n",
+		 what, cmd, strerror(rv));
+	free(cmd);
+	return rv;
+    }
+
+    rv = fread(buf, 1, buflen - 1, f);
+    if ((unsigned int) rv == buflen - 1)
+	rv = E2BIG;
+    else {
+	buf[rv] = '\0';
+	rv = 0;
+    }
+
+    *status = pclose(f);
+    free(cmd);
+
+  out:
+    if (rv == E2BIG)
+	sys->log(sys, OS_ERROR, NULL,
+		 "Output of extcmd config %s command (%s %s) is too big",
+		 what, incmd, args);
+    return rv;
+}
+
 int
 extcmd_getvals(sys_data_t *sys,
 	       void *baseloc, const char *incmd, extcmd_info_t *ts,
@@ -279,19 +543,16 @@ extcmd_getvals(sys_data_t *sys,
 {
     int rv;
     char *cmd;
-    FILE *f;
     unsigned int i;
     char buf[2048];
-    unsigned int buflen = sizeof(buf);
+    int status;
 
     if (!incmd)
 	return 0;
 
-    cmd = malloc(strlen(incmd) + 5);
+    cmd = strdup("get");
     if (!cmd)
 	return ENOMEM;
-    strcpy(cmd, incmd);
-    strcat(cmd, " get");
 
     for (i = 0; i < count; i++) {
 	rv = add_cmd(&cmd, ts[i].name, NULL, 0);
@@ -302,28 +563,15 @@ extcmd_getvals(sys_data_t *sys,
 	}
     }
 
-    f = popen(cmd, "r");
-    if (!f) {
-	sys->log(sys, OS_ERROR, NULL,
-		 "Unable to execute extcmd read command (%s): %s\n",
-		 cmd, strerror(errno));
-	rv = errno;
-	goto out;
-    }
-
-    rv = fread(buf, 1, buflen - 1, f);
-    if ((unsigned int) rv == buflen - 1) {
-	sys->log(sys, OS_ERROR, NULL,
-		 "Output of extcmd config read command (%s) is too big", cmd);
-	rv = EINVAL;
+    rv = extcmd_run(sys, incmd, cmd, "read", buf, sizeof(buf), &status);
+    if (rv)
 	goto out;
-    }
-    buf[rv] = '\0';
 
-    rv = pclose(f);
-    if (rv) {
+    if (status) {
 	sys->log(sys, OS_ERROR, NULL, 
-		 "extcmd read command (%s) failed: %x: %s", cmd, rv, buf);
+		 "extcmd read command (%s %s) failed: %x: %s", incmd, cmd,
+		 status, buf);
+	rv = status;
 	goto out;
     }
 
@@ -348,20 +596,17 @@ extcmd_setvals(sys_data_t *sys,
 {
     int rv = 0;
     char *cmd;
-    FILE *f;
     unsigned int i;
     char buf[2048];
-    unsigned int buflen = sizeof(buf);
     int oneset = 0;
+    int status;
 
     if (!incmd)
 	return 0;
 
-    cmd = malloc(strlen(incmd) + 5);
+    cmd = strdup("set");
     if (!cmd)
 	return ENOMEM;
-    strcpy(cmd, incmd);
-    strcat(cmd, " set");
 
     for (i = 0; i < count; i++) {
 	if (setit && !setit[i])
@@ -378,28 +623,15 @@ extcmd_setvals(sys_data_t *sys,
     if (!oneset)
 	goto out;
 
-    f = popen(cmd, "r");
-    if (!f) {
-	sys->log(sys, OS_ERROR, NULL,
-		 "Unable to execute extcmd write command (%s): %s\n",
-		 cmd, strerror(errno));
-	rv = errno;
+    rv = extcmd_run(sys, incmd, cmd, "write", buf, sizeof(buf), &status);
+    if (rv)
 	goto out;
-    }
 
-    rv = fread(buf, 1, buflen - 1, f);
-    if ((unsigned int) rv == buflen - 1) {
-	sys->log(sys, OS_ERROR, NULL,
-		 "Output of extcmd config write command (%s) is too big", cmd);
-	rv = EINVAL;
-	goto out;
-    }
-    buf[rv] = '\0';
-
-    rv = pclose(f);
-    if (rv) {
+    if (status) {
 	sys->log(sys, OS_ERROR, NULL, 
-		 "extcmd write command (%s) failed: %x: %s", cmd, rv, buf);
+		 "extcmd write command (%s %s) failed: %x: %s", incmd, cmd,
+		 status, buf);
+	rv = status;
 	goto out;
     }
 
@@ -415,19 +647,16 @@ extcmd_checkvals(sys_data_t *sys,
 {
     int rv = 0;
     char *cmd;
-    FILE *f;
     unsigned int i;
     char buf[2048];
-    unsigned int buflen = sizeof(buf);
+    int status;
 
     if (!incmd)
 	return 0;
 
-    cmd = malloc(strlen(incmd) + 7);
+    cmd = strdup("check");
     if (!cmd)
 	return ENOMEM;
-    strcpy(cmd, incmd);
-    strcat(cmd, " check");
 
     for (i = 0; i < count; i++) {
 	rv = add_cmd(&cmd, ts[i].name, extcmd_setval(baseloc, ts + i), 1);
@@ -443,26 +672,12 @@ extcmd_checkvals(sys_data_t *sys,
 	}
     }
 
-    f = popen(cmd, "r");
-    if (!f) {
-	sys->log(sys, OS_ERROR, NULL,
-		 "Unable to execute extcmd check command (%s): %s\n",
-		 cmd, strerror(errno));
-	rv = errno;
-	goto out;
-    }
-
-    rv = fread(buf, 1, buflen - 1, f);
-    if ((unsigned int) rv == buflen - 1) {
-	sys->log(sys, OS_ERROR, NULL,
-		 "Output of extcmd config check command (%s) is too big", cmd);
-	rv = EINVAL;
+    rv = extcmd_run(sys, incmd, cmd, "check", buf, sizeof(buf), &status);
+    if (rv)
 	goto out;
-    }
-    buf[rv] = '\0';
 
     /* Return value should tell us if it's ok. */
-    rv = pclose(f);
+    rv = status;
 
   out:
     free(cmd);
@@ -54,6 +54,13 @@
  *      written permission.
  */
 
+#include <config.h>
+
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+/* Get recvmmsg(), sendmmsg() and struct mmsghdr. */
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -69,13 +76,13 @@
 #include <netdb.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <popt.h> /* Option parsing made easy */
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <signal.h>
 #include <sys/wait.h>
-
-#include <config.h>
+#include <pthread.h>
 
 #if HAVE_SYSLOG
 #include <syslog.h>
@@ -103,6 +110,73 @@ static char *command_string = NULL;
 static char *command_file = NULL;
 static int debug = 0;
 static int nostdio = 0;
+static int num_workers = 0;
+static int fleet_size = 0;
+static int fleet_ip = 0;
+
+/*
+ * With worker threads, LAN messages are handled in the threads and the
+ * main loop does everything else.  All the emulator state is under
+ * one lock; it is recursive because emulator code can call back into
+ * things that take it.  The LAN code drops it to check and decrypt
+ * messages, which is where the time goes with many sessions.  Without
+ * workers the lock is not used.
+ */
+static pthread_mutex_t sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t sim_owner;
+static unsigned int sim_depth;
+
+static void
+sim_lock(sys_data_t *sys)
+{
+    if (!num_workers)
+	return;
+    if (__atomic_load_n(&sim_depth, __ATOMIC_ACQUIRE)
+	&& pthread_equal(sim_owner, pthread_self())) {
+	sim_depth++;
+	return;
+    }
+    pthread_mutex_lock(&sim_mutex);
+    sim_owner = pthread_self();
+    __atomic_store_n(&sim_depth, 1, __ATOMIC_RELEASE);
+}
+
+static void
+sim_unlock(sys_data_t *sys)
+{
+    if (!num_workers)
+	return;
+    if (sim_depth > 1) {
+	sim_depth--;
+	return;
+    }
+    __atomic_store_n(&sim_depth, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sim_mutex);
+}
+
+/* Let go of the lock completely, returning what to pass to
+   sim_relock(). */
+static unsigned int
+sim_unlock_all(void)
+{
+    unsigned int depth = sim_depth;
+
+    if (!num_workers || !depth)
+	return 0;
+    __atomic_store_n(&sim_depth, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sim_mutex);
+    return depth;
+}
+
+static void
+sim_relock(unsigned int depth)
+{
+    if (!depth)
+	return;
+    pthread_mutex_lock(&sim_mutex);
+    sim_owner = pthread_self();
+    __atomic_store_n(&sim_depth, depth, __ATOMIC_RELEASE);
+}
 
 /*
  * Keep track of open sockets so we can close them on exec().
@@ -167,6 +241,17 @@ struct misc_data
     os_handler_waiter_factory_t *waiter_factory;
     os_hnd_timer_id_t *timer;
     console_info_t *consoles;
+
+    /* LAN messages for a session always go to the same queue. */
+    os_hnd_work_queue_t **lan_queues;
+
+    /* In fleet mode, the node number (0 is the first) and the next
+       node after this one. */
+    unsigned int fleet_node;
+    misc_data_t *fleet_next;
+
+    /* The serial channel, if it shares the first node's listener. */
+    serserv_data_t *shared_ser;
 };
 
 static misc_data_t *global_misc_data;
@@ -235,6 +320,104 @@ sys_gen_rand(sys_data_t *lan, void *data, int len)
     return 0;
 }
 
+/*
+ * LAN packets are received and, when not using worker threads, their
+ * responses sent in batches of up to this many, to cut down on the
+ * syscalls per message.
+ */
+#define LAN_BATCH_SIZE		16
+#define LAN_XMIT_MAX_LEN	512
+
+typedef struct lan_xmit_pkt_s
+{
+    sim_addr_t    l;
+    int           len;
+    unsigned char data[LAN_XMIT_MAX_LEN];
+} lan_xmit_pkt_t;
+
+/*
+ * Only used from the main thread without workers, responses from
+ * worker threads are sent immediately.
+ */
+static struct {
+    int            batching;
+    unsigned int   count;
+    lan_xmit_pkt_t pkts[LAN_BATCH_SIZE];
+} lan_xmit;
+
+static void
+lan_xmit_flush(void)
+{
+    unsigned int   count = lan_xmit.count;
+    unsigned int   i;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[LAN_BATCH_SIZE];
+    struct iovec   iov[LAN_BATCH_SIZE];
+    unsigned int   sent = 0, n;
+    int            rv;
+
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    for (i = 0; i < count; i++) {
+	lan_xmit_pkt_t *pkt = &lan_xmit.pkts[i];
+
+	iov[i].iov_base = pkt->data;
+	iov[i].iov_len = pkt->len;
+	msgs[i].msg_hdr.msg_name = &pkt->l.addr;
+	msgs[i].msg_hdr.msg_namelen = pkt->l.addr_len;
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (sent < count) {
+	/* Each call can only send on one fd. */
+	for (n = sent + 1; n < count; n++) {
+	    if (lan_xmit.pkts[n].l.xmit_fd != lan_xmit.pkts[sent].l.xmit_fd)
+		break;
+	}
+	rv = sendmmsg(lan_xmit.pkts[sent].l.xmit_fd, msgs + sent, n - sent, 0);
+	if (rv <= 0)
+	    /* The first message failed, drop it and go on.  This is
+	       UDP, the remote end will retry. */
+	    sent++;
+	else
+	    sent += rv;
+    }
+#else
+    for (i = 0; i < count; i++) {
+	lan_xmit_pkt_t *pkt = &lan_xmit.pkts[i];
+
+	sendto(pkt->l.xmit_fd, pkt->data, pkt->len, 0,
+	       (struct sockaddr *) &pkt->l.addr, pkt->l.addr_len);
+    }
+#endif
+    lan_xmit.count = 0;
+}
+
+static int
+lan_xmit_queue(sim_addr_t *l, struct iovec *data, int vecs)
+{
+    lan_xmit_pkt_t *pkt;
+    unsigned int   len = 0;
+    int            i;
+
+    for (i = 0; i < vecs; i++)
+	len += data[i].iov_len;
+    if (len > LAN_XMIT_MAX_LEN)
+	return 0;
+
+    if (lan_xmit.count >= LAN_BATCH_SIZE)
+	lan_xmit_flush();
+
+    pkt = &lan_xmit.pkts[lan_xmit.count++];
+    pkt->l = *l;
+    pkt->len = 0;
+    for (i = 0; i < vecs; i++) {
+	memcpy(pkt->data + pkt->len, data[i].iov_base, data[i].iov_len);
+	pkt->len += data[i].iov_len;
+    }
+    return 1;
+}
+
 static void
 lan_send(lanserv_data_t *lan,
 	 struct iovec *data, int vecs,
@@ -249,6 +432,9 @@ lan_send(lanserv_data_t *lan,
     if (!l)
 	return;
 
+    if (lan_xmit.batching && lan_xmit_queue(l, data, vecs))
+	return;
+
     msg.msg_name = &(l->addr);
     msg.msg_namelen = l->addr_len;
     msg.msg_iov = data;
@@ -264,50 +450,185 @@ lan_send(lanserv_data_t *lan,
 }
 
 static void
-lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
+handle_lan_pkt(lanserv_data_t *lan, unsigned char *msgd, int len,
+	       sim_addr_t *l)
 {
-    lanserv_data_t    *lan = cb_data;
-    int           len;
-    sim_addr_t    l;
-    unsigned char msgd[256];
-
-    l.addr_len = sizeof(l.addr);
-    len = recvfrom(lan_fd, msgd, sizeof(msgd), 0,
-		   (struct sockaddr *) &(l.addr), &(l.addr_len));
-    if (len < 0) {
-	if (errno != EINTR) {
-	    perror("Error receiving message");
-	    exit(1);
-	}
-	goto out;
-    }
-    l.xmit_fd = lan_fd;
-
     if (lan->sysinfo->debug & DEBUG_RAW_MSG) {
-	debug_log_raw_msg(lan->sysinfo, (void *) &l.addr, l.addr_len,
+	debug_log_raw_msg(lan->sysinfo, (void *) &l->addr, l->addr_len,
 			  "Raw LAN receive from:");
 	debug_log_raw_msg(lan->sysinfo, msgd, len,
 			  " Receive message:");
     }
 
     if (len < 4)
-	goto out;
+	return;
 
     if (msgd[0] != 6)
-	goto out; /* Invalid version */
+	return; /* Invalid version */
 
     /* Check the message class. */
     switch (msgd[3]) {
 	case 6:
-	    handle_asf(lan, msgd, len, &l, sizeof(l));
+	    handle_asf(lan, msgd, len, l, sizeof(*l));
 	    break;
 
 	case 7:
-	    ipmi_handle_lan_msg(lan, msgd, len, &l, sizeof(l));
+	    ipmi_handle_lan_msg(lan, msgd, len, l, sizeof(*l));
 	    break;
     }
- out:
-    return;
+}
+
+typedef struct lan_pkt_s
+{
+    lanserv_data_t *lan;
+    sim_addr_t     l;
+    int            len;
+    unsigned char  msgd[256];
+} lan_pkt_t;
+
+static void
+lan_pkt_work(void *cb_data)
+{
+    lan_pkt_t *pkt = cb_data;
+
+    handle_lan_pkt(pkt->lan, pkt->msgd, pkt->len, &pkt->l);
+    free(pkt);
+}
+
+/*
+ * Pick the worker queue for a LAN message by its session id, so a
+ * session's messages are handled in order.  Messages without a
+ * session (session setup and ASF) are spread by source address.
+ */
+static unsigned int
+lan_pkt_shard(lan_pkt_t *pkt)
+{
+    unsigned char *d = pkt->msgd;
+    unsigned int  off;
+    uint32_t      h = 0;
+    int           i;
+
+    if ((pkt->len > 6) && (d[3] == 7)) {
+	if (d[4] == 6) {
+	    /* RMCP+, the session id follows the payload type and the
+	       OEM IANA and payload id if it's an OEM payload. */
+	    off = 6;
+	    if ((d[5] & 0x3f) == 2)
+		off += 6;
+	} else {
+	    /* RMCP, the session id follows the session sequence. */
+	    off = 9;
+	}
+	if (pkt->len >= (int) (off + 4))
+	    h = ipmi_get_uint32(d + off);
+    }
+    if (!h) {
+	unsigned char *a = (unsigned char *) &pkt->l.addr;
+
+	for (i = 0; i < (int) pkt->l.addr_len; i++)
+	    h = (h * 31) + a[i];
+    }
+    /* Session ids are even and the low bits are the session slot, mix
+       it up so all the queues get used. */
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h % num_workers;
+}
+
+/*
+ * Receive what is waiting on the socket, up to LAN_BATCH_SIZE
+ * packets if the platform can do it in one call.  Returns the number
+ * of packets received or -1 on error.
+ */
+static int
+lan_recv_pkts(int lan_fd, lan_pkt_t *pkts)
+{
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[LAN_BATCH_SIZE];
+    struct iovec   iov[LAN_BATCH_SIZE];
+    int            i, count;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < LAN_BATCH_SIZE; i++) {
+	iov[i].iov_base = pkts[i].msgd;
+	iov[i].iov_len = sizeof(pkts[i].msgd);
+	msgs[i].msg_hdr.msg_name = &pkts[i].l.addr;
+	msgs[i].msg_hdr.msg_namelen = sizeof(pkts[i].l.addr);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Take what is there, don't wait for a full batch. */
+    count = recvmmsg(lan_fd, msgs, LAN_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    for (i = 0; i < count; i++) {
+	pkts[i].len = msgs[i].msg_len;
+	pkts[i].l.addr_len = msgs[i].msg_hdr.msg_namelen;
+    }
+    return count;
+#else
+    pkts[0].l.addr_len = sizeof(pkts[0].l.addr);
+    pkts[0].len = recvfrom(lan_fd, pkts[0].msgd, sizeof(pkts[0].msgd), 0,
+			   (struct sockaddr *) &(pkts[0].l.addr),
+			   &(pkts[0].l.addr_len));
+    if (pkts[0].len < 0)
+	return -1;
+    return 1;
+#endif
+}
+
+static void
+lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
+{
+    lanserv_data_t *lan = cb_data;
+    misc_data_t    *data = lan->user_info;
+    lan_pkt_t      pkts[LAN_BATCH_SIZE], *pkt;
+    int            i, count;
+
+    count = lan_recv_pkts(lan_fd, pkts);
+    if (count < 0) {
+	if ((errno != EINTR) && (errno != EAGAIN)) {
+	    perror("Error receiving message");
+	    exit(1);
+	}
+	return;
+    }
+
+    if (!data->lan_queues) {
+	lan_xmit.batching = 1;
+	for (i = 0; i < count; i++) {
+	    pkts[i].l.xmit_fd = lan_fd;
+	    handle_lan_pkt(lan, pkts[i].msgd, pkts[i].len, &pkts[i].l);
+	}
+	lan_xmit.batching = 0;
+	lan_xmit_flush();
+	return;
+    }
+
+    for (i = 0; i < count; i++) {
+	/* Answer presence pings here, a flood of them shouldn't have to
+	   wait behind sessions in the worker queues. */
+	if ((pkts[i].len >= 4) && (pkts[i].msgd[0] == 6)
+	    && (pkts[i].msgd[3] == 6))
+	{
+	    pkts[i].l.xmit_fd = lan_fd;
+	    handle_asf(lan, pkts[i].msgd, pkts[i].len, &pkts[i].l,
+		       sizeof(pkts[i].l));
+	    continue;
+	}
+
+	/* Only copy what was received. */
+	pkt = malloc(sizeof(*pkt));
+	if (!pkt)
+	    continue; /* Drop it. */
+	memcpy(pkt, &pkts[i], offsetof(lan_pkt_t, msgd) + pkts[i].len);
+	pkt->l.xmit_fd = lan_fd;
+	pkt->lan = lan;
+	if (data->os_hnd->queue_work(data->os_hnd,
+				     data->lan_queues[lan_pkt_shard(pkt)],
+				     lan_pkt_work, pkt))
+	    free(pkt);
+    }
 }
 
 static int
@@ -343,6 +664,64 @@ open_lan_fd(struct sockaddr *addr, socklen_t addr_len)
     return fd;
 }
 
+/*
+ * Fleet node n uses the addresses from the config with n added to the
+ * port, or to the IP address with --fleet-ip.  Unix socket paths get
+ * ".n" appended.
+ */
+static int
+fleet_addr(sockaddr_ip_t *addr, unsigned int node)
+{
+    uint16_t      *port;
+    unsigned char *ip;
+    unsigned int  iplen, v, i;
+
+    switch (addr->s_ipsock.s_addr.sa_family) {
+    case AF_INET:
+	port = &addr->s_ipsock.s_addr4.sin_port;
+	ip = (unsigned char *) &addr->s_ipsock.s_addr4.sin_addr.s_addr;
+	iplen = 4;
+	break;
+#ifdef PF_INET6
+    case AF_INET6:
+	port = &addr->s_ipsock.s_addr6.sin6_port;
+	ip = addr->s_ipsock.s_addr6.sin6_addr.s6_addr;
+	iplen = 16;
+	break;
+#endif
+    case AF_UNIX:
+    {
+	char   *path = addr->s_ipsock.s_addrun.sun_path;
+	size_t len = strlen(path);
+	size_t left = sizeof(addr->s_ipsock.s_addrun.sun_path) - len;
+
+	if (snprintf(path + len, left, ".%u", node) >= (int) left)
+	    return ENAMETOOLONG;
+	return 0;
+    }
+    default:
+	return EINVAL;
+    }
+
+    if (!fleet_ip) {
+	v = ntohs(*port) + node;
+	if (v > 0xffff)
+	    return ERANGE;
+	*port = htons(v);
+	return 0;
+    }
+
+    v = node;
+    for (i = iplen; v && (i > 0); i--) {
+	v += ip[i - 1];
+	ip[i - 1] = v & 0xff;
+	v >>= 8;
+    }
+    if (v)
+	return ERANGE;
+    return 0;
+}
+
 static int
 lan_channel_init(void *info, channel_t *chan)
 {
@@ -363,12 +742,30 @@ lan_channel_init(void *info, channel_t *chan)
 	exit(1);
     }
 
+    if (lan->guid && data->fleet_node) {
+	/* Fleet nodes need their own GUID. */
+	uint32_t v = ipmi_get_uint32(lan->guid + 12) + data->fleet_node;
+
+	ipmi_set_uint32(lan->guid + 12, v);
+    }
+
     if (lan->guid) {
 	lmc_data_t *sys = ipmi_emu_get_bmc_mc(data->emu);
 	if (sys)
 	    ipmi_emu_set_mc_guid(sys, lan->guid, 0);
     }
 
+    if (lan->lan_addr_set && data->fleet_node) {
+	err = fleet_addr(&lan->lan_addr.addr, data->fleet_node);
+	if (err) {
+	    fprintf(stderr, "No LAN address for fleet node %u: %s\n",
+		    data->fleet_node, strerror(err));
+	    exit(1);
+	}
+	if (!fleet_ip)
+	    lan->port += data->fleet_node;
+    }
+
     if (lan->lan_addr_set) {
 	lan_fd = open_lan_fd(&lan->lan_addr.addr.s_ipsock.s_addr,
 			     lan->lan_addr.addr_len);
@@ -423,15 +820,19 @@ ser_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	if ((len < 0) && (errno == EINTR))
 	    return;
 
+	sim_lock(ser->sysinfo);
 	if (ser->codec->disconnected)
 	    ser->codec->disconnected(ser);
+	sim_unlock(ser->sysinfo);
 	ser->os_hnd->remove_fd_to_wait_for(ser->os_hnd, id);
 	close(fd);
 	ser->con_fd = -1;
 	return;
     }
 
+    sim_lock(ser->sysinfo);
     serserv_handle_data(ser, msgd, len);
+    sim_unlock(ser->sysinfo);
 }
 
 static void
@@ -451,7 +852,28 @@ ser_bind_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	exit(1);
     }
 
-    if (ser->con_fd >= 0) {
+    if (ser->shared) {
+	/*
+	 * Give the connection to the lowest numbered fleet node that
+	 * does not have one.
+	 */
+	misc_data_t *node;
+
+	ser = NULL;
+	for (node = global_misc_data; node; node = node->fleet_next) {
+	    serserv_data_t *nser = node->shared_ser;
+
+	    if (!nser || nser->con_fd >= 0)
+		continue;
+	    if (!ser || (node->fleet_node <
+			 ((misc_data_t *) ser->user_info)->fleet_node))
+		ser = nser;
+	}
+	if (!ser) {
+	    close(rv);
+	    return;
+	}
+    } else if (ser->con_fd >= 0) {
 	close(rv);
 	return;
     }
@@ -469,8 +891,10 @@ ser_bind_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	ser->con_fd = -1;
 	close(rv);
     } else {
+	sim_lock(ser->sysinfo);
 	if (ser->codec->connected)
 	    ser->codec->connected(ser);
+	sim_unlock(ser->sysinfo);
     }
 }
 
@@ -489,13 +913,35 @@ ser_channel_init(void *info, channel_t *chan)
     ser->user_info = data;
     ser->send_out = ser_send;
 
+    if (ser->shared) {
+	data->shared_ser = ser;
+	if (data->fleet_node) {
+	    /* Connections come in on the first node's socket. */
+	    err = serserv_init(ser);
+	    if (err) {
+		fprintf(stderr, "Unable to init serial: 0x%x\n", err);
+		exit(1);
+	    }
+	    ser->bind_fd = -1;
+	    ser->con_fd = -1;
+	    return 0;
+	}
+    } else if (data->fleet_node) {
+	err = fleet_addr(&ser->addr.addr, data->fleet_node);
+	if (err) {
+	    fprintf(stderr, "No serial address for fleet node %u: %s\n",
+		    data->fleet_node, strerror(err));
+	    exit(1);
+	}
+    }
+
     err = serserv_init(ser);
     if (err) {
 	fprintf(stderr, "Unable to init serial: 0x%x\n", err);
 	exit(1);
     }
 
-    fd = socket(addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    fd = socket(addr->sa_family, SOCK_STREAM, 0);
     if (fd == -1) {
 	perror("Unable to create socket");
 	exit(1);
@@ -528,6 +974,10 @@ ser_channel_init(void *info, channel_t *chan)
 	    exit(1);
 	}
 
+	if (addr->sa_family == AF_UNIX)
+	    /* Remove the socket left by a previous run. */
+	    unlink(ser->addr.addr.s_ipsock.s_addrun.sun_path);
+
 	err = bind(fd, addr, ser->addr.addr_len);
 	if (err == -1) {
 	    fprintf(stderr, "Unable to bind to serial TCP port: %s\n",
@@ -537,7 +987,7 @@ ser_channel_init(void *info, channel_t *chan)
 	ser->bind_fd = fd;
 	ser->con_fd = -1;
 
-	err = listen(fd, 1);
+	err = listen(fd, (ser->shared && fleet_size > 1) ? fleet_size : 1);
 	if (err == -1) {
 	    fprintf(stderr, "Unable to listen to serial TCP port: %s\n",
 		    strerror(errno));
@@ -573,7 +1023,8 @@ static void
 isim_log(sys_data_t *sys, int logtype, msg_t *msg, const char *format,
 	 va_list ap, int len)
 {
-    misc_data_t *data = sys->info;
+    /* All the fleet nodes log to the first node's consoles. */
+    misc_data_t *data = global_misc_data;
     char *str;
     console_info_t *con;
 
@@ -607,12 +1058,15 @@ isim_log(sys_data_t *sys, int logtype, msg_t *msg, const char *format,
 	vsprintf(str, format, ap);
     }
 
+    /* Workers log without the lock. */
+    sim_lock(sys);
     con = data->consoles;
     while (con) {
 	con->out.printf(&con->out, "%s", str);
 	con->out.printf(&con->out, "\n");
 	con = con->next;
     }
+    sim_unlock(sys);
 #if HAVE_SYSLOG
     if (logtype == DEBUG)
 	syslog(LOG_DEBUG, "%s", str);
@@ -717,6 +1171,33 @@ static struct poptOption poptOpts[]=
 	"nostdio",
 	""
     },
+    {
+	"workers",
+	'w',
+	POPT_ARG_INT,
+	&num_workers,
+	'w',
+	"handle LAN messages in this many threads",
+	""
+    },
+    {
+	"fleet",
+	'F',
+	POPT_ARG_INT,
+	&fleet_size,
+	'F',
+	"simulate this many BMCs from the config",
+	""
+    },
+    {
+	"fleet-ip",
+	'I',
+	POPT_ARG_NONE,
+	&fleet_ip,
+	'I',
+	"give fleet nodes separate IP addresses instead of ports",
+	""
+    },
     POPT_AUTOHELP
     {
 	NULL,
@@ -894,6 +1375,7 @@ user_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
     int         count;
 
     count = read(fd, rc, sizeof(rc));
+    sim_lock(info->data->sys);
     if (count == 0)
 	goto closeit;
     while (count > 0) {
@@ -902,11 +1384,13 @@ user_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	c++;
 	count--;
     }
+    sim_unlock(info->data->sys);
     return;
 
  closeit:
     if (info->shutdown_on_close) {
 	ipmi_emu_shutdown(info->data->emu);
+	sim_unlock(info->data->sys);
 	return;
     }
 
@@ -918,6 +1402,7 @@ user_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	info->data->consoles = info->next;
     if (info->next)
 	info->next->prev = info->prev;
+    sim_unlock(info->data->sys);
     free(info);
 }
 
@@ -974,11 +1459,13 @@ console_bind_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	free(newcon);
     }
 
+    sim_lock(misc->sys);
     newcon->next = misc->consoles;
     if (newcon->next)
 	newcon->next->prev = newcon;
     newcon->prev = NULL;
     misc->consoles = newcon;
+    sim_unlock(misc->sys);
 
     err = write(rv, telnet_init_seq, sizeof(telnet_init_seq));
     err = write(rv, "> ", 2);
@@ -1030,6 +1517,7 @@ sleeper(emu_data_t *emu, struct timeval *time)
 {
     misc_data_t    *data = ipmi_emu_get_user_data(emu);
     os_handler_waiter_t *waiter;
+    unsigned int   depth;
 
     waiter = os_handler_alloc_waiter(data->waiter_factory);
     if (!waiter) {
@@ -1037,7 +1525,9 @@ sleeper(emu_data_t *emu, struct timeval *time)
 	exit(1);
     }
 
+    depth = sim_unlock_all();
     os_handler_waiter_wait(waiter, time);
+    sim_relock(depth);
     os_handler_waiter_release(waiter);
 }
 
@@ -1055,21 +1545,30 @@ static void
 io_read_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 {
     ipmi_io_t *io = cb_data;
+
+    sim_lock(io->data->sys);
     io->read_cb(fd, io->cb_data);
+    sim_unlock(io->data->sys);
 }
 
 static void
 io_write_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 {
     ipmi_io_t *io = cb_data;
+
+    sim_lock(io->data->sys);
     io->write_cb(fd, io->cb_data);
+    sim_unlock(io->data->sys);
 }
 
 static void
 io_except_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 {
     ipmi_io_t *io = cb_data;
+
+    sim_lock(io->data->sys);
     io->except_cb(fd, io->cb_data);
+    sim_unlock(io->data->sys);
 }
 
 static void
@@ -1162,7 +1661,9 @@ timer_cb(void *cb_data, os_hnd_timer_id_t *id)
 {
     ipmi_timer_t *timer = cb_data;
 
+    sim_lock(timer->data->sys);
     timer->cb(timer->cb_data);
+    sim_unlock(timer->data->sys);
 }
 
 static int
@@ -1201,13 +1702,15 @@ tick(void *cb_data, os_hnd_timer_id_t *id)
     int err;
     ipmi_tick_handler_t *h;
 
+    sim_lock(data->sys);
     h = tick_handlers;
     while(h) {
 	h->handler(h->info, 1);
 	h = h->next;
     }
 
-    ipmi_emu_tick(data->emu, 1);
+    ipmi_emu_tick_pending(1);
+    sim_unlock(data->sys);
 
     tv.tv_sec = 1;
     tv.tv_usec = 0;
@@ -1262,11 +1765,13 @@ sigchld_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
     if (rv == -1)
 	return;
 
+    sim_lock(global_misc_data->sys);
     h = child_quit_handlers;
     while (h) {
 	h->handler(h->info, rv);
 	h = h->next;
     }
+    sim_unlock(global_misc_data->sys);
 }
 
 static ipmi_shutdown_t *shutdown_handlers;
@@ -1348,6 +1853,122 @@ static int ipmi_get_real_time(sys_data_t *sys, struct timeval *tv)
     return os_hnd->get_real_time(os_hnd, tv);
 }
 
+static void
+sim_sysinfo_init(sys_data_t *sys, misc_data_t *data)
+{
+    sysinfo_init(sys);
+    sys->info = data;
+    sys->alloc = balloc;
+    sys->free = bfree;
+    sys->get_monotonic_time = ipmi_get_monotonic_time;
+    sys->get_real_time = ipmi_get_real_time;
+    sys->alloc_timer = ipmi_alloc_timer;
+    sys->start_timer = ipmi_start_timer;
+    sys->stop_timer = ipmi_stop_timer;
+    sys->free_timer = ipmi_free_timer;
+    sys->add_io_hnd = ipmi_add_io_hnd;
+    sys->io_set_hnds = ipmi_io_set_hnds;
+    sys->io_set_enables = ipmi_io_set_enables;
+    sys->remove_io_hnd = ipmi_remove_io_hnd;
+    sys->gen_rand = sys_gen_rand;
+    sys->debug = debug;
+    sys->log = sim_log;
+    sys->csmi_send = smi_send;
+    sys->clog = sim_chan_log;
+    sys->calloc = ialloc;
+    sys->cfree = ifree;
+    sys->lan_channel_init = lan_channel_init;
+    sys->ser_channel_init = ser_channel_init;
+    if (num_workers) {
+	sys->lock = sim_lock;
+	sys->unlock = sim_unlock;
+    }
+    data->sys = sys;
+}
+
+static void
+sim_set_bmc(sys_data_t *sys, lmc_data_t *mc)
+{
+    sys->mc = mc;
+    sys->chan_set = ipmi_mc_get_channelset(mc);
+    sys->startcmd = ipmi_mc_get_startcmdinfo(mc);
+    sys->cpef = ipmi_mc_get_pef(mc);
+    sys->cusers = ipmi_mc_get_users(mc);
+    sys->sol = ipmi_mc_get_sol(mc);
+}
+
+/*
+ * Set up another BMC from the config and command file for fleet
+ * mode.  It shares everything but the emulator with the first node.
+ * The consoles and loadable modules only work with the first node,
+ * and SOL and starting a VM are only done there.
+ */
+static int
+fleet_add_node(misc_data_t *first, unsigned int node)
+{
+    misc_data_t *data;
+    sys_data_t  *sys;
+    lmc_data_t  *mc;
+    emu_out_t   out = { dummy_printf, NULL };
+    unsigned int i;
+    int err;
+
+    data = malloc(sizeof(*data));
+    sys = malloc(sizeof(*sys));
+    if (!data || !sys) {
+	free(data);
+	free(sys);
+	return ENOMEM;
+    }
+    *data = *first;
+    data->fleet_node = node;
+    data->consoles = NULL;
+    data->shared_ser = NULL;
+    sim_sysinfo_init(sys, data);
+
+    data->emu = ipmi_emu_alloc(data, sleeper, sys);
+    if (!data->emu)
+	return ENOMEM;
+
+    err = ipmi_mc_alloc_unconfigured(sys, 0x20, &mc);
+    if (err)
+	return err;
+    sim_set_bmc(sys, mc);
+
+    if (read_config(sys, config_file, 0))
+	return EINVAL;
+
+    for (i = 0; i < IPMI_MAX_MCS; i++) {
+	if (!sys->ipmb_addrs[i])
+	    continue;
+	ipmi_mc_get_sol(sys->ipmb_addrs[i])->configured = 0;
+	ipmi_mc_get_startcmdinfo(sys->ipmb_addrs[i])->startcmd = NULL;
+    }
+
+    if (command_file) {
+	err = read_command_file(&out, data->emu, command_file);
+	if (err)
+	    return err;
+    }
+
+    if (command_string) {
+	/* The command is parsed in place. */
+	char *cmd = strdup(command_string);
+
+	if (!cmd)
+	    return ENOMEM;
+	ipmi_emu_cmd(&out, data->emu, cmd);
+	free(cmd);
+    }
+
+    if (!sys->bmc_ipmb || !sys->ipmb_addrs[sys->bmc_ipmb])
+	return EINVAL;
+
+    data->fleet_next = first->fleet_next;
+    first->fleet_next = data;
+    return 0;
+}
+
 int
 main(int argc, const char *argv[])
 {
@@ -1383,12 +2004,46 @@ main(int argc, const char *argv[])
 
     global_misc_data = &data;
 
-    data.os_hnd = ipmi_posix_setup_os_handler();
+    data.fleet_node = 0;
+    data.fleet_next = NULL;
+    data.shared_ser = NULL;
+    if (fleet_size > 1) {
+	/* The nodes would all write the same state files. */
+	persist_enable = 0;
+	persist_locked_off = 1;
+    }
+
+    data.lan_queues = NULL;
+    if (num_workers < 0)
+	num_workers = 0;
+    if (num_workers)
+	/* Workers start timers and such, so the OS handler must be
+	   thread safe. */
+	data.os_hnd = ipmi_posix_thread_setup_os_handler(SIGUSR1);
+    else
+	data.os_hnd = ipmi_posix_setup_os_handler();
     if (!data.os_hnd) {
 	fprintf(stderr, "Unable to allocate OS handler\n");
 	exit(1);
     }
 
+    if (num_workers) {
+	err = data.os_hnd->start_workers(data.os_hnd, num_workers);
+	if (!err) {
+	    data.lan_queues = malloc(sizeof(*data.lan_queues) * num_workers);
+	    if (!data.lan_queues)
+		err = ENOMEM;
+	}
+	for (i = 0; !err && i < num_workers; i++)
+	    err = data.os_hnd->alloc_work_queue(data.os_hnd,
+						&data.lan_queues[i]);
+	if (err) {
+	    fprintf(stderr, "Unable to start worker threads: %s\n",
+		    strerror(err));
+	    exit(1);
+	}
+    }
+
     err = os_handler_alloc_waiter_factory(data.os_hnd, 0, 0,
 					  &data.waiter_factory);
     if (err) {
@@ -1402,30 +2057,7 @@ main(int argc, const char *argv[])
 	exit(1);
     }
 
-    sysinfo_init(&sysinfo);
-    sysinfo.info = &data;
-    sysinfo.alloc = balloc;
-    sysinfo.free = bfree;
-    sysinfo.get_monotonic_time = ipmi_get_monotonic_time;
-    sysinfo.get_real_time = ipmi_get_real_time;
-    sysinfo.alloc_timer = ipmi_alloc_timer;
-    sysinfo.start_timer = ipmi_start_timer;
-    sysinfo.stop_timer = ipmi_stop_timer;
-    sysinfo.free_timer = ipmi_free_timer;
-    sysinfo.add_io_hnd = ipmi_add_io_hnd;
-    sysinfo.io_set_hnds = ipmi_io_set_hnds;
-    sysinfo.io_set_enables = ipmi_io_set_enables;
-    sysinfo.remove_io_hnd = ipmi_remove_io_hnd;
-    sysinfo.gen_rand = sys_gen_rand;
-    sysinfo.debug = debug;
-    sysinfo.log = sim_log;
-    sysinfo.csmi_send = smi_send;
-    sysinfo.clog = sim_chan_log;
-    sysinfo.calloc = ialloc;
-    sysinfo.cfree = ifree;
-    sysinfo.lan_channel_init = lan_channel_init;
-    sysinfo.ser_channel_init = ser_channel_init;
-    data.sys = &sysinfo;
+    sim_sysinfo_init(&sysinfo, &data);
 
     err = pipe(sigpipeh);
     if (err) {
@@ -1478,12 +2110,7 @@ main(int argc, const char *argv[])
 	    fprintf(stderr, "Out of memory allocation BMC MC\n");
 	exit(1);
     }
-    sysinfo.mc = mc;
-    sysinfo.chan_set = ipmi_mc_get_channelset(mc);
-    sysinfo.startcmd = ipmi_mc_get_startcmdinfo(mc);
-    sysinfo.cpef = ipmi_mc_get_pef(mc);
-    sysinfo.cusers = ipmi_mc_get_users(mc);
-    sysinfo.sol = ipmi_mc_get_sol(mc);
+    sim_set_bmc(&sysinfo, mc);
 
     if (read_config(&sysinfo, config_file, print_version))
 	exit(1);
@@ -1546,8 +2173,16 @@ main(int argc, const char *argv[])
     if (command_file)
 	read_command_file(&stdio_console.out, data.emu, command_file);
 
-    if (command_string)
-	ipmi_emu_cmd(&stdio_console.out, data.emu, command_string);
+    if (command_string) {
+	char *cmd = strdup(command_string);
+
+	if (!cmd) {
+	    fprintf(stderr, "Out of memory\n");
+	    goto out;
+	}
+	ipmi_emu_cmd(&stdio_console.out, data.emu, cmd);
+	free(cmd);
+    }
 
     if (!sysinfo.bmc_ipmb || !sysinfo.ipmb_addrs[sysinfo.bmc_ipmb]) {
 	sysinfo.log(&sysinfo, SETUP_ERROR, NULL,
@@ -1555,17 +2190,28 @@ main(int argc, const char *argv[])
 	goto out;
     }
 
+    for (i = 1; i < fleet_size; i++) {
+	err = fleet_add_node(&data, i);
+	if (err) {
+	    fprintf(stderr, "Unable to set up fleet node %d: %s\n", i,
+		    strerror(err));
+	    goto out;
+	}
+    }
+
     sysinfo.console_fd = -1;
     if (sysinfo.console_addr_len) {
 	int nfd;
 	int val;
 
 	nfd = socket(sysinfo.console_addr.s_ipsock.s_addr.sa_family,
-		     SOCK_STREAM, IPPROTO_TCP);
+		     SOCK_STREAM, 0);
 	if (nfd == -1) {
 	    perror("Console socket open");
 	    goto out;
 	}
+	if (sysinfo.console_addr.s_ipsock.s_addr.sa_family == AF_UNIX)
+	    unlink(sysinfo.console_addr.s_ipsock.s_addrun.sun_path);
 	err = bind(nfd, (struct sockaddr *) &sysinfo.console_addr,
 		   sysinfo.console_addr_len);
 	if (err) {
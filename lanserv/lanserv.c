@@ -53,6 +53,13 @@
  *      written permission.
  */
 
+#include <config.h>
+
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+/* Get recvmmsg(), sendmmsg() and struct mmsghdr. */
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -72,8 +79,6 @@
 #include <signal.h>
 #include <sys/wait.h>
 
-#include <config.h>
-
 #if HAVE_SYSLOG
 #include <syslog.h>
 #endif
@@ -127,6 +132,101 @@ typedef struct lanserv_addr_s
     int             xmit_fd;
 } lanserv_addr_t;
 
+/*
+ * LAN packets are received, and responses that are ready while
+ * handling them sent, in batches of up to this many to cut down on
+ * the syscalls per message.  Responses from the IPMI device come
+ * later and are sent immediately.
+ */
+#define LAN_BATCH_SIZE		16
+#define LAN_XMIT_MAX_LEN	512
+
+typedef struct lan_xmit_pkt_s
+{
+    lanserv_addr_t l;
+    int            len;
+    unsigned char  data[LAN_XMIT_MAX_LEN];
+} lan_xmit_pkt_t;
+
+static struct {
+    int            batching;
+    unsigned int   count;
+    lan_xmit_pkt_t pkts[LAN_BATCH_SIZE];
+} lan_xmit;
+
+static void
+lan_xmit_flush(void)
+{
+    unsigned int   count = lan_xmit.count;
+    unsigned int   i;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[LAN_BATCH_SIZE];
+    struct iovec   iov[LAN_BATCH_SIZE];
+    unsigned int   sent = 0, n;
+    int            rv;
+
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    for (i = 0; i < count; i++) {
+	lan_xmit_pkt_t *pkt = &lan_xmit.pkts[i];
+
+	iov[i].iov_base = pkt->data;
+	iov[i].iov_len = pkt->len;
+	msgs[i].msg_hdr.msg_name = &pkt->l.addr;
+	msgs[i].msg_hdr.msg_namelen = pkt->l.addr_len;
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (sent < count) {
+	/* Each call can only send on one fd. */
+	for (n = sent + 1; n < count; n++) {
+	    if (lan_xmit.pkts[n].l.xmit_fd != lan_xmit.pkts[sent].l.xmit_fd)
+		break;
+	}
+	rv = sendmmsg(lan_xmit.pkts[sent].l.xmit_fd, msgs + sent, n - sent, 0);
+	if (rv <= 0)
+	    /* The first message failed, drop it and go on.  This is
+	       UDP, the remote end will retry. */
+	    sent++;
+	else
+	    sent += rv;
+    }
+#else
+    for (i = 0; i < count; i++) {
+	lan_xmit_pkt_t *pkt = &lan_xmit.pkts[i];
+
+	sendto(pkt->l.xmit_fd, pkt->data, pkt->len, 0,
+	       (struct sockaddr *) &pkt->l.addr, pkt->l.addr_len);
+    }
+#endif
+    lan_xmit.count = 0;
+}
+
+static int
+lan_xmit_queue(lanserv_addr_t *l, struct iovec *data, int vecs)
+{
+    lan_xmit_pkt_t *pkt;
+    unsigned int   len = 0;
+    int            i;
+
+    for (i = 0; i < vecs; i++)
+	len += data[i].iov_len;
+    if (len > LAN_XMIT_MAX_LEN)
+	return 0;
+
+    if (lan_xmit.count >= LAN_BATCH_SIZE)
+	lan_xmit_flush();
+
+    pkt = &lan_xmit.pkts[lan_xmit.count++];
+    pkt->l = *l;
+    pkt->len = 0;
+    for (i = 0; i < vecs; i++) {
+	memcpy(pkt->data + pkt->len, data[i].iov_base, data[i].iov_len);
+	pkt->len += data[i].iov_len;
+    }
+    return 1;
+}
+
 static void
 lan_send(lanserv_data_t *lan,
 	 struct iovec *data, int vecs,
@@ -136,6 +236,9 @@ lan_send(lanserv_data_t *lan,
     lanserv_addr_t *l = addr;
     int           rv;
 
+    if (lan_xmit.batching && lan_xmit_queue(l, data, vecs))
+	return;
+
     msg.msg_name = &(l->addr);
     msg.msg_namelen = l->addr_len;
     msg.msg_iov = data;
@@ -327,27 +430,11 @@ handle_msg_ipmi_dev(int smi_fd, void *cb_data, os_hnd_fd_id_t *id)
 }
 
 static void
-lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
+handle_lan_pkt(lanserv_data_t *lan, unsigned char *data, int len,
+	       lanserv_addr_t *l)
 {
-    lanserv_data_t *lan = cb_data;
-    int                len;
-    lanserv_addr_t     l;
-    unsigned char      data[256];
-
-    l.addr_len = sizeof(l.addr);
-    len = recvfrom(lan_fd, data, sizeof(data), 0, 
-		    (struct sockaddr *)&(l.addr), &(l.addr_len));
-    if (len < 0) {
-	if (errno != EINTR) {
-	    perror("Error receiving message");
-	    exit(1);
-	}
-	return;
-    }
-    l.xmit_fd = lan_fd;
-
     if (lan->sysinfo->debug & DEBUG_RAW_MSG) {
-	debug_log_raw_msg(lan->sysinfo, (void *) &l.addr, l.addr_len,
+	debug_log_raw_msg(lan->sysinfo, (void *) &l->addr, l->addr_len,
 			  "Raw LAN receive from:");
 	debug_log_raw_msg(lan->sysinfo, data, len,
 			  " Receive message:");
@@ -362,15 +449,88 @@ lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
     /* Check the message class. */
     switch (data[3]) {
 	case 6:
-	    handle_asf(lan, data, len, &l, sizeof(l));
+	    handle_asf(lan, data, len, l, sizeof(*l));
 	    break;
 
 	case 7:
-	    ipmi_handle_lan_msg(lan, data, len, &l, sizeof(l));
+	    ipmi_handle_lan_msg(lan, data, len, l, sizeof(*l));
 	    break;
     }
 }
 
+typedef struct lan_pkt_s
+{
+    lanserv_addr_t l;
+    int            len;
+    unsigned char  data[256];
+} lan_pkt_t;
+
+/*
+ * Receive what is waiting on the socket, up to LAN_BATCH_SIZE
+ * packets if the platform can do it in one call.  Returns the number
+ * of packets received or -1 on error.
+ */
+static int
+lan_recv_pkts(int lan_fd, lan_pkt_t *pkts)
+{
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[LAN_BATCH_SIZE];
+    struct iovec   iov[LAN_BATCH_SIZE];
+    int            i, count;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < LAN_BATCH_SIZE; i++) {
+	iov[i].iov_base = pkts[i].data;
+	iov[i].iov_len = sizeof(pkts[i].data);
+	msgs[i].msg_hdr.msg_name = &pkts[i].l.addr;
+	msgs[i].msg_hdr.msg_namelen = sizeof(pkts[i].l.addr);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Take what is there, don't wait for a full batch. */
+    count = recvmmsg(lan_fd, msgs, LAN_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    for (i = 0; i < count; i++) {
+	pkts[i].len = msgs[i].msg_len;
+	pkts[i].l.addr_len = msgs[i].msg_hdr.msg_namelen;
+    }
+    return count;
+#else
+    pkts[0].l.addr_len = sizeof(pkts[0].l.addr);
+    pkts[0].len = recvfrom(lan_fd, pkts[0].data, sizeof(pkts[0].data), 0,
+			   (struct sockaddr *) &(pkts[0].l.addr),
+			   &(pkts[0].l.addr_len));
+    if (pkts[0].len < 0)
+	return -1;
+    return 1;
+#endif
+}
+
+static void
+lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
+{
+    lanserv_data_t *lan = cb_data;
+    lan_pkt_t      pkts[LAN_BATCH_SIZE];
+    int            i, count;
+
+    count = lan_recv_pkts(lan_fd, pkts);
+    if (count < 0) {
+	if ((errno != EINTR) && (errno != EAGAIN)) {
+	    perror("Error receiving message");
+	    exit(1);
+	}
+	return;
+    }
+
+    lan_xmit.batching = 1;
+    for (i = 0; i < count; i++) {
+	pkts[i].l.xmit_fd = lan_fd;
+	handle_lan_pkt(lan, pkts[i].data, pkts[i].len, &pkts[i].l);
+    }
+    lan_xmit.batching = 0;
+    lan_xmit_flush();
+}
+
 static int
 ipmi_open(char *ipmi_dev)
 {
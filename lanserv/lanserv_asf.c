@@ -92,6 +92,50 @@ rmcp_set_uint32(uint8_t *data, int val)
 }
 
 #define ASF_IANA 4542
+
+#define DEFAULT_ASF_PING_LIMIT 1000
+
+void
+ipmi_lan_asf_init(lanserv_data_t *lan)
+{
+    uint8_t *rsp = lan->asf_pong;
+
+    if (!lan->asf_ping_limit)
+	lan->asf_ping_limit = DEFAULT_ASF_PING_LIMIT;
+
+    rsp[0] = 6;
+    rsp[1] = 0;
+    rsp[2] = 0xff; /* No ack, the ack is not required, so we don't do it. */
+    rsp[3] = 6; /* ASF class */
+    rmcp_set_uint32(rsp+4, ASF_IANA);
+    rsp[8] = 0x40; /* Presense Pong */
+    rsp[9] = 0; /* Message tag, filled in from the ping */
+    rsp[10] = 0;
+    rsp[11] = 16; /* Data length */
+    rmcp_set_uint32(rsp+12, ASF_IANA); /* no special capabilities */
+    rmcp_set_uint32(rsp+16, 0); /* no special capabilities */
+    rsp[20] = 0x81; /* We support IPMI */
+    rsp[21] = 0x0; /* No supported interactions */
+    memset(rsp+22, 0, 6); /* Reserved. */
+}
+
+/* Returns true if the ping may be answered. */
+static int
+asf_ping_allowed(lanserv_data_t *lan)
+{
+    struct timeval now;
+
+    lan->sysinfo->get_monotonic_time(lan->sysinfo, &now);
+    if (now.tv_sec != lan->asf_ping_sec) {
+	lan->asf_ping_sec = now.tv_sec;
+	lan->asf_ping_this_sec = 0;
+    }
+    if (lan->asf_ping_this_sec >= lan->asf_ping_limit)
+	return 0;
+    lan->asf_ping_this_sec++;
+    return 1;
+}
+
 void
 handle_asf(lanserv_data_t *lan,
 	   uint8_t *data, int len,
@@ -109,26 +153,21 @@ handle_asf(lanserv_data_t *lan,
     if (data[8] != 0x80)
 	return; /* Not a presence ping. */
 
-    /* Ok, it's a valid RMCP/ASF Presence Ping, start working on the
-       response. */
-    rsp[0] = 6;
-    rsp[1] = 0;
-    rsp[2] = 0xff; /* No ack, the ack is not required, so we don't do it. */
-    rsp[3] = 6; /* ASF class */
-    rmcp_set_uint32(rsp+4, ASF_IANA);
-    rsp[8] = 0x40; /* Presense Pong */
+    lan->asf_pings++;
+    if (!asf_ping_allowed(lan)) {
+	lan->asf_ping_dropped++;
+	return;
+    }
+
+    /* Ok, it's a valid RMCP/ASF Presence Ping, only the tag differs
+       from the prebuilt response. */
+    memcpy(rsp, lan->asf_pong, sizeof(rsp));
     rsp[9] = data[9]; /* Message tag */
-    rsp[10] = 0;
-    rsp[11] = 16; /* Data length */
-    rmcp_set_uint32(rsp+12, ASF_IANA); /* no special capabilities */
-    rmcp_set_uint32(rsp+16, 0); /* no special capabilities */
-    rsp[20] = 0x81; /* We support IPMI */
-    rsp[21] = 0x0; /* No supported interactions */
-    memset(rsp+22, 0, 6); /* Reserved. */
 
     vec[0].iov_base = rsp;
-    vec[0].iov_len = 28;
+    vec[0].iov_len = sizeof(rsp);
 
     /* Return the response. */
     lan->send_out(lan, vec, 1, from_addr, from_len);
+    lan->asf_pongs++;
 }
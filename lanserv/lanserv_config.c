@@ -138,6 +138,20 @@ lanserv_read_config(sys_data_t    *sys,
 	} else if (strcmp(tok, "allowed_auths_admin") == 0) {
 	    err = get_auths(&tokptr, &val, &errstr);
 	    lan->channel.priv_info[3].allowed_auths = val;
+	} else if (strcmp(tok, "max_sessions") == 0) {
+	    err = get_uint(&tokptr, &val, &errstr);
+	    if (!err && (val == 0)) {
+		err = -1;
+		errstr = "max_sessions must be at least 1";
+	    }
+	    lan->max_sessions = val;
+	} else if (strcmp(tok, "asf_ping_limit") == 0) {
+	    err = get_uint(&tokptr, &val, &errstr);
+	    if (!err && (val == 0)) {
+		err = -1;
+		errstr = "asf_ping_limit must be at least 1";
+	    }
+	    lan->asf_ping_limit = val;
 	} else if (strcmp(tok, "addr") == 0) {
 	    if (lan->lan_addr_set) {
 		fprintf(stderr, "LAN address already set, line %d\n", *line);
@@ -105,29 +105,231 @@ find_user(lanserv_data_t *lan, uint8_t *user, int name_only_lookup, int priv)
     return rv;
 }
 
+static void
+lan_lock(lanserv_data_t *lan)
+{
+    if (lan->sysinfo->lock)
+	lan->sysinfo->lock(lan->sysinfo);
+}
+
+static void
+lan_unlock(lanserv_data_t *lan)
+{
+    if (lan->sysinfo->unlock)
+	lan->sysinfo->unlock(lan->sysinfo);
+}
+
+static unsigned int
+sid_hash(lanserv_data_t *lan, uint32_t sid)
+{
+    /* Sids come from a sequence, so the low bits spread fine. */
+    return (sid >> 1) & (lan->sid_hash_size - 1);
+}
+
 static session_t *
 sid_to_session(lanserv_data_t *lan, unsigned int sid)
 {
-    int       idx;
     session_t *session;
 
-    if (sid & 1)
+    if ((sid & 1) || !lan->sid_hash)
 	return NULL;
-    idx = (sid >> 1) & SESSION_MASK;
-    if (idx > MAX_SESSIONS)
+    session = lan->sid_hash[sid_hash(lan, sid)];
+    while (session && (session->sid != sid))
+	session = session->next;
+    return session;
+}
+
+static int
+grow_sid_hash(lanserv_data_t *lan)
+{
+    session_t    **old = lan->sid_hash, **hash;
+    unsigned int old_size = lan->sid_hash_size, size, i, h;
+    session_t    *session, *next;
+
+    size = old_size ? old_size * 2 : 64;
+    hash = lan->channel.alloc(&lan->channel, size * sizeof(*hash));
+    if (!hash)
+	return ENOMEM;
+    memset(hash, 0, size * sizeof(*hash));
+
+    lan->sid_hash = hash;
+    lan->sid_hash_size = size;
+    for (i = 0; i < old_size; i++) {
+	for (session = old[i]; session; session = next) {
+	    next = session->next;
+	    h = sid_hash(lan, session->sid);
+	    session->next = hash[h];
+	    hash[h] = session;
+	}
+    }
+    if (old)
+	lan->channel.free(&lan->channel, old);
+    return 0;
+}
+
+static int
+grow_sessions(lanserv_data_t *lan)
+{
+    unsigned int old_len = lan->sessions_len, len, i;
+    session_t    **sessions, *block;
+
+    if (old_len > lan->max_sessions)
+	return ENOSPC;
+    len = old_len ? old_len * 2 : 16;
+    if (len > lan->max_sessions + 1)
+	len = lan->max_sessions + 1;
+
+    sessions = lan->channel.alloc(&lan->channel, len * sizeof(*sessions));
+    if (!sessions)
+	return ENOMEM;
+    /* Session 0 is not used, but give it a slot so handles index
+       the table. */
+    i = old_len ? old_len : 1;
+    block = lan->channel.alloc(&lan->channel, (len - i) * sizeof(*block));
+    if (!block) {
+	lan->channel.free(&lan->channel, sessions);
+	return ENOMEM;
+    }
+    memset(block, 0, (len - i) * sizeof(*block));
+
+    sessions[0] = NULL;
+    if (old_len) {
+	memcpy(sessions, lan->sessions, old_len * sizeof(*sessions));
+	lan->channel.free(&lan->channel, lan->sessions);
+    }
+    /* Put them on the free list so the lowest handle comes first. */
+    for (; i < len; i++)
+	sessions[i] = block++;
+    for (i = len - 1; i >= (old_len ? old_len : 1); i--) {
+	sessions[i]->handle = i;
+	sessions[i]->next = lan->free_sessions;
+	lan->free_sessions = sessions[i];
+    }
+    lan->sessions = sessions;
+    lan->sessions_len = len;
+    return 0;
+}
+
+/*
+ * Get a free session, give it a new sid and make it active.  The
+ * caller fills in the rest.
+ */
+static session_t *
+alloc_session(lanserv_data_t *lan)
+{
+    session_t *session;
+    int       handle;
+    unsigned int h;
+
+    if (lan->channel.active_sessions >= lan->max_sessions)
 	return NULL;
-    session = lan->sessions + idx;
-    if (!session->active)
+    if (!lan->free_sessions && grow_sessions(lan))
 	return NULL;
-    if (session->sid != sid)
+    if ((lan->channel.active_sessions >= lan->sid_hash_size)
+	&& grow_sid_hash(lan))
 	return NULL;
+
+    session = lan->free_sessions;
+    lan->free_sessions = session->next;
+    handle = session->handle;
+    memset(session, 0, sizeof(*session));
+    session->handle = handle;
+
+    /* Skip 0 and anything still in use if the sequence wraps. */
+    do {
+	session->sid = lan->sid_seq << 1;
+	lan->sid_seq++;
+    } while (!session->sid || sid_to_session(lan, session->sid));
+
+    session->active = 1;
+    h = sid_hash(lan, session->sid);
+    session->next = lan->sid_hash[h];
+    lan->sid_hash[h] = session;
+    lan->channel.active_sessions++;
     return session;
 }
 
+/* Clean up the keys of a closed session and put it on the free list. */
+static void
+release_session(lanserv_data_t *lan, session_t *session)
+{
+    session->cleanup_pending = 0;
+    if (session->authtype <= 4)
+	ipmi_auths[session->authtype].authcode_cleanup(session->authdata);
+    if (session->integh)
+	session->integh->cleanup(lan, session);
+    if (session->confh)
+	session->confh->cleanup(lan, session);
+
+    session->next = lan->free_sessions;
+    lan->free_sessions = session;
+}
+
+static void
+session_expiry_unlink(lanserv_data_t *lan, session_t *session)
+{
+    if (session->exp_prev)
+	session->exp_prev->exp_next = session->exp_next;
+    else if (lan->exp_head == session)
+	lan->exp_head = session->exp_next;
+    else
+	return; /* Not in the list. */
+    if (session->exp_next)
+	session->exp_next->exp_prev = session->exp_prev;
+    else
+	lan->exp_tail = session->exp_prev;
+    session->exp_next = NULL;
+    session->exp_prev = NULL;
+}
+
+static long
+lan_now(lanserv_data_t *lan)
+{
+    struct timeval now;
+
+    lan->sysinfo->get_monotonic_time(lan->sysinfo, &now);
+    return now.tv_sec;
+}
+
+static void
+start_expiry_timer(lanserv_data_t *lan)
+{
+    struct timeval tv;
+    long           left;
+
+    if (!lan->expiry_timer || lan->expiry_timer_running || !lan->exp_head)
+	return;
+
+    left = lan->exp_head->expires - lan_now(lan);
+    tv.tv_sec = left > 0 ? left : 0;
+    tv.tv_usec = 0;
+    if (!lan->sysinfo->start_timer(lan->expiry_timer, &tv))
+	lan->expiry_timer_running = 1;
+}
+
+/* A message came in for the session, restart its timeout. */
+static void
+session_touch(lanserv_data_t *lan, session_t *session)
+{
+    session_expiry_unlink(lan, session);
+    session->expires = lan_now(lan) + lan->default_session_timeout;
+    session->exp_prev = lan->exp_tail;
+    if (lan->exp_tail)
+	lan->exp_tail->exp_next = session;
+    else
+	lan->exp_head = session;
+    lan->exp_tail = session;
+
+    /* If the timer is running it is for an earlier session, it will
+       be restarted for this one when it gets here. */
+    start_expiry_timer(lan);
+}
+
 static void
 close_session(lanserv_data_t *lan, session_t *session)
 {
     unsigned int i;
+    session_t    **s;
 
     for (i = 0; i < LANSERV_NUM_CLOSERS; i++) {
 	if (session->closers[i].close_cb) {
@@ -140,17 +342,22 @@ close_session(lanserv_data_t *lan, session_t *session)
     }
 
     session->active = 0;
-    if (session->authtype <= 4)
-	ipmi_auths[session->authtype].authcode_cleanup(session->authdata);
-    if (session->integh)
-	session->integh->cleanup(lan, session);
-    if (session->confh)
-	session->confh->cleanup(lan, session);
+    session_expiry_unlink(lan, session);
+    s = &lan->sid_hash[sid_hash(lan, session->sid)];
+    while (*s && (*s != session))
+	s = &(*s)->next;
+    if (*s)
+	*s = session->next;
+    session->next = NULL;
     lan->channel.active_sessions--;
     if (session->src_addr) {
 	lan->channel.free(&lan->channel, session->src_addr);
 	session->src_addr = NULL;
     }
+    if (session->in_use)
+	session->cleanup_pending = 1;
+    else
+	release_session(lan, session);
 }
 
 static int
@@ -588,6 +795,7 @@ static void
 handle_get_channel_auth_capabilities(lanserv_data_t *lan, msg_t *msg)
 {
     uint8_t   data[9];
+    uint8_t   *d = data;
     uint8_t   chan;
     uint8_t   priv;
     int       do_rmcpp;
@@ -609,26 +817,45 @@ handle_get_channel_auth_capabilities(lanserv_data_t *lan, msg_t *msg)
     } else {
 	if (! lan->guid)
 	    do_rmcpp = 0; /* Must have a GUID to do RMCP+ */
-	data[0] = 0;
-	data[1] = chan;
-	data[2] = lan->channel.priv_info[priv-1].allowed_auths;
+
+	if (lan->auth_caps_gen != lan->sysinfo->users_gen) {
+	    lan->auth_caps_valid[0] = 0;
+	    lan->auth_caps_valid[1] = 0;
+	    lan->auth_caps_gen = lan->sysinfo->users_gen;
+	}
+	if ((priv >= 1) && (priv <= NUM_PRIV_LEVEL)) {
+	    d = lan->auth_caps_rsp[do_rmcpp][priv-1];
+	    if (lan->auth_caps_valid[do_rmcpp] & (1 << priv))
+		goto out_cached;
+	}
+
+	d[0] = 0;
+	d[1] = chan;
+	d[2] = lan->channel.priv_info[priv-1].allowed_auths;
 	if (do_rmcpp)
-	    data[2] |= 0x80;
-	data[3] = 0x04; /* per-message authentication is on,
-			   user-level authenitcation is on,
-			   non-null user names disabled,
-			   no anonymous support. */
+	    d[2] |= 0x80;
+	d[3] = 0x04; /* per-message authentication is on,
+			user-level authenitcation is on,
+			non-null user names disabled,
+			no anonymous support. */
 	if (lan->users[1].valid) {
 	    if (is_authval_null(lan->users[1].pw))
-		data[3] |= 0x01; /* Anonymous login. */
+		d[3] |= 0x01; /* Anonymous login. */
 	    else
-		data[3] |= 0x02; /* Null user supported. */
+		d[3] |= 0x02; /* Null user supported. */
 	}
 	if (lan->bmc_key)
-	    data[3] |= 0x20;
-	data[4] = 0;
+	    d[3] |= 0x20;
+	d[4] = 0;
 	if (do_rmcpp)
-	    data[4] |= 0x3; /* Support RMCP and RMCP+ */
+	    d[4] |= 0x3; /* Support RMCP and RMCP+ */
+	if (d != data)
+	    lan->auth_caps_valid[do_rmcpp] |= 1 << priv;
+
+      out_cached:
+	if (d != data)
+	    memcpy(data, d, 5);
+	/* The manufacturer can change under us, don't cache it. */
 	data[5] = lan->channel.manufacturer_id & 0xff;
 	data[6] = (lan->channel.manufacturer_id >> 8) & 0xff;
 	data[7] = (lan->channel.manufacturer_id >> 16) & 0xff;
@@ -672,7 +899,7 @@ handle_get_session_challenge(lanserv_data_t *lan, msg_t *msg)
 	return;
     }
 
-    if (lan->channel.active_sessions >= MAX_SESSIONS) {
+    if (lan->channel.active_sessions >= lan->max_sessions) {
 	lan->sysinfo->log(lan->sysinfo, SESSION_CHALLENGE_FAILED, msg,
 		 "Session challenge failed: To many open sessions");
 	return_err(lan, msg, NULL, IPMI_OUT_OF_SPACE_CC);
@@ -710,12 +937,15 @@ static unsigned char cipher_suites[] = {
     0xc0, 0x0b, 0x02, 0x43, 0x80,
     0xc0, 0x0c, 0x02, 0x43, 0x81,
     0xc0, 0x0d, 0x02, 0x43, 0x82,
-    0xc0, 0x0e, 0x02, 0x43, 0x83
+    0xc0, 0x0e, 0x02, 0x43, 0x83,
+    0xc0, 0x0f, 0x03, 0x40, 0x80,
+    0xc0, 0x10, 0x03, 0x44, 0x80,
+    0xc0, 0x11, 0x03, 0x44, 0x81
 };
 
 static unsigned char cipher_algos[] = {
-    0x00, 0x01, 0x02,
-    0x40, 0x41, 0x42, 0x43,
+    0x00, 0x01, 0x02, 0x03,
+    0x40, 0x41, 0x42, 0x43, 0x44,
     0x80, 0x81, 0x82, 0x83
 };
 
@@ -835,18 +1065,6 @@ ifree(void *info, void *data)
     lan->channel.free(&lan->channel, data);
 }
 
-static session_t *
-find_free_session(lanserv_data_t *lan)
-{
-    int i;
-    /* Find a free session.  Session 0 is invalid. */
-    for (i=1; i<=MAX_SESSIONS; i++) {
-	if (! lan->sessions[i].active)
-	    return &(lan->sessions[i]);
-    }
-    return NULL;
-}
-
 static void
 handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 {
@@ -910,7 +1128,7 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 	return;
     }
 
-    if (lan->channel.active_sessions >= MAX_SESSIONS) {
+    if (lan->channel.active_sessions >= lan->max_sessions) {
 	lan->sysinfo->log(lan->sysinfo, NEW_SESSION_FAILED, msg,
 		 "Session challenge failed: To many open sessions");
 	return;
@@ -978,7 +1196,7 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 	goto out_free;
     }
 
-    session = find_free_session(lan);
+    session = alloc_session(lan);
 
     if (!session) {
 	lan->sysinfo->log(lan->sysinfo, NEW_SESSION_FAILED, msg,
@@ -992,12 +1210,12 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 	lan->sysinfo->log(lan->sysinfo, NEW_SESSION_FAILED, msg,
 		 "Activate session failed: out of memory");
 	return_err(lan, msg, &dummy_session, IPMI_UNKNOWN_ERR_CC);
+	close_session(lan, session);
 	goto out_free;
     }
     memcpy(session->src_addr, msg->src_addr, msg->src_len);
     session->src_len = msg->src_len;
 
-    session->active = 1;
     session->rmcpplus = 0;
     session->authtype = auth;
     session->authdata = dummy_session.authdata;
@@ -1006,7 +1224,9 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 	lan->sysinfo->log(lan->sysinfo, NEW_SESSION_FAILED, msg,
 		 "Activate session failed: Could not generate random number");
 	return_err(lan, msg, &dummy_session, IPMI_UNKNOWN_ERR_CC);
-	goto out_free;
+	/* The session has the authdata now and frees it. */
+	close_session(lan, session);
+	return;
     }
     session->recv_seq = ipmi_get_uint32(seq_data) & ~1;
     if (!session->recv_seq)
@@ -1015,19 +1235,12 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
     session->max_priv = priv;
     session->priv = IPMI_PRIVILEGE_USER; /* Start at user privilege. */
     session->userid = user->idx;
-    session->time_left = lan->default_session_timeout;
+    session_touch(lan, session);
 
-    lan->channel.active_sessions++;
     lan->sysinfo->log(lan->sysinfo, NEW_SESSION, msg,
 	     "Activate session: Session opened for user 0x%x, max priv %d",
 	     user_idx, priv);
 
-    if (lan->sid_seq == 0)
-	lan->sid_seq++;
-    session->sid = ((lan->sid_seq << (SESSION_BITS_REQ+1))
-		    | (session->handle << 1));
-    lan->sid_seq++;
-
     data[0] = 0;
     data[1] = auth;
     
@@ -1195,23 +1408,23 @@ handle_get_session_info(lanserv_data_t *lan, session_t *session, msg_t *msg)
 	}
 	
 	handle = msg->data[1];
-	if (handle >= MAX_SESSIONS) {
+	if ((handle == 0) || (handle > lan->max_sessions)) {
 	    return_err(lan, msg, session, IPMI_INVALID_DATA_FIELD_CC);
 	    return;
 	}
-	if (lan->sessions[handle].active)
-	    nses = &lan->sessions[handle];
+	if ((handle < lan->sessions_len) && lan->sessions[handle]->active)
+	    nses = lan->sessions[handle];
     } else if (idx == 0) {
 	nses = session;
     } else {
-	int i;
+	unsigned int i;
 
 	if (idx <= lan->channel.active_sessions) {
-	    for (i=0; i<=MAX_SESSIONS; i++) {
-		if (lan->sessions[i].active) {
+	    for (i = 1; i < lan->sessions_len; i++) {
+		if (lan->sessions[i]->active) {
 		    idx--;
 		    if (idx == 0) {
-			nses = &lan->sessions[i];
+			nses = lan->sessions[i];
 			break;
 		    }
 		}
@@ -1219,9 +1432,15 @@ handle_get_session_info(lanserv_data_t *lan, session_t *session, msg_t *msg)
 	}
     }
 
+    /* These are 6-bit fields, past that the best we can do is say
+       it's full. */
     data[0] = 0;
     data[2] = MAX_SESSIONS;
+    if (lan->max_sessions < MAX_SESSIONS)
+	data[2] = lan->max_sessions;
     data[3] = lan->channel.active_sessions;
+    if (lan->channel.active_sessions > MAX_SESSIONS)
+	data[3] = MAX_SESSIONS;
     if (nses) {
 	data[1] = nses->handle;
 	data[4] = nses->userid;
@@ -1260,6 +1479,56 @@ static extcmd_info_t lanread_vals[] = {
 };
 #undef BASETYPE
 
+/*
+ * The external LAN config items come from the in-process functions if
+ * a module has set them, otherwise from the config program.
+ */
+static int
+lan_ext_get(lanserv_data_t *lan, unsigned int item)
+{
+    if (lan->config_get)
+	return lan->config_get(lan, item, &lan->lanparm, lan->config_cb_data);
+    return extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
+			  lanread_vals + item, 1);
+}
+
+static int
+lan_ext_set(lanserv_data_t *lan)
+{
+    if (lan->config_set)
+	return lan->config_set(lan, lan->lanparm_changed, &lan->lanparm,
+			       lan->config_cb_data);
+    return extcmd_setvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
+			  lanread_vals, lan->lanparm_changed, lanread_len);
+}
+
+static int
+lan_ext_check(lanserv_data_t *lan, unsigned int item)
+{
+    if (lan->config_check)
+	return lan->config_check(lan, item, &lan->lanparm,
+				 lan->config_cb_data);
+    return extcmd_checkvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
+			    lanread_vals + item, 1);
+}
+
+void
+ipmi_lan_set_config_func(lanserv_data_t *lan,
+			 int (*get)(lanserv_data_t *lan, unsigned int item,
+				    lanparm_data_t *lanparm, void *cb_data),
+			 int (*set)(lanserv_data_t *lan,
+				    unsigned char *changed,
+				    lanparm_data_t *lanparm, void *cb_data),
+			 int (*check)(lanserv_data_t *lan, unsigned int item,
+				      lanparm_data_t *lanparm, void *cb_data),
+			 void *cb_data)
+{
+    lan->config_get = get;
+    lan->config_set = set;
+    lan->config_check = check;
+    lan->config_cb_data = cb_data;
+}
+
 static void
 write_lan_config(lanserv_data_t *lan)
 {
@@ -1281,8 +1550,7 @@ write_lan_config(lanserv_data_t *lan)
 	lan->persist_changed = 0;
     }
 
-    if (extcmd_setvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-		       lanread_vals, lan->lanparm_changed, lanread_len)) {
+    if (lan_ext_set(lan)) {
 	lan->sysinfo->log(lan->sysinfo, OS_ERROR, NULL,
 			  "Error writing external LANPARM values");
     } else {
@@ -1450,8 +1718,7 @@ set_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
 	oldval = lan->lanparm.ip_addr_src;
 	lan->lanparm.ip_addr_src = msg->data[2];
 	/* Check to see if the system supports this value */
-	rv = extcmd_checkvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-			      lanread_vals + ip_addr_src_o, 1);
+	rv = lan_ext_check(lan, ip_addr_src_o);
 	if (rv) {
 	    lan->lanparm.ip_addr_src = oldval;
 	    rdata[0] = IPMI_INVALID_DATA_FIELD_CC;
@@ -1594,8 +1861,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 3:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[ip_addr_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + ip_addr_o, 1);
+	    rv = lan_ext_get(lan, ip_addr_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1609,8 +1875,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 4:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[ip_addr_src_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + ip_addr_src_o, 1);
+	    rv = lan_ext_get(lan, ip_addr_src_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1623,8 +1888,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 5:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[mac_addr_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + mac_addr_o, 1);
+	    rv = lan_ext_get(lan, mac_addr_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1638,8 +1902,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 6:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[subnet_mask_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + subnet_mask_o, 1);
+	    rv = lan_ext_get(lan, subnet_mask_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1659,8 +1922,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 12:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[default_gw_ip_addr_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + default_gw_ip_addr_o, 1);
+	    rv = lan_ext_get(lan, default_gw_ip_addr_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1674,8 +1936,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 13:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[default_gw_mac_addr_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + default_gw_mac_addr_o, 1);
+	    rv = lan_ext_get(lan, default_gw_mac_addr_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1689,8 +1950,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 14:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[backup_gw_ip_addr_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + backup_gw_ip_addr_o, 1);
+	    rv = lan_ext_get(lan, backup_gw_ip_addr_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1704,8 +1964,7 @@ get_lan_config_parms(channel_t *chan, msg_t *msg, unsigned char *rdata,
     case 15:
 	if (!lan->lanparm.set_in_progress ||
 	    !lan->lanparm_changed[backup_gw_mac_addr_o]) {
-	    rv = extcmd_getvals(lan->sysinfo, &lan->lanparm, lan->config_prog,
-				lanread_vals + backup_gw_mac_addr_o, 1);
+	    rv = lan_ext_get(lan, backup_gw_mac_addr_o);
 	    if (rv) {
 		rdata[0] = IPMI_UNKNOWN_ERR_CC;
 		*rdata_len = 1;
@@ -1780,7 +2039,7 @@ handle_normal_session(lanserv_data_t *lan, msg_t *msg)
 	return;
     }
 
-    session->time_left = lan->default_session_timeout;
+    session_touch(lan, session);
 
     if (lan->channel.oem.oem_handle_msg &&
 	lan->channel.oem.oem_handle_msg(&lan->channel, msg))
@@ -1918,6 +2177,7 @@ rakp_hmac_sha1_init(lanserv_data_t *lan, session_t *session)
 {
     session->auth_data.akey = EVP_sha1();
     session->auth_data.akey_len = 20;
+    session->auth_data.ukey_len = 20;
     session->auth_data.integ_len = 12;
     return 0;
 }
@@ -1927,6 +2187,17 @@ rakp_hmac_md5_init(lanserv_data_t *lan, session_t *session)
 {
     session->auth_data.akey = EVP_md5();
     session->auth_data.akey_len = 16;
+    session->auth_data.ukey_len = 16;
+    session->auth_data.integ_len = 16;
+    return 0;
+}
+
+static int 
+rakp_hmac_sha256_init(lanserv_data_t *lan, session_t *session)
+{
+    session->auth_data.akey = EVP_sha256();
+    session->auth_data.akey_len = 32;
+    session->auth_data.ukey_len = 20;
     session->auth_data.integ_len = 16;
     return 0;
 }
@@ -1955,7 +2226,7 @@ rakp_hmac_set2(lanserv_data_t *lan, session_t *session,
     memcpy(idata+58, a->username, idata[57]);
     user = &(lan->users[session->userid]);
 
-    HMAC(a->akey, user->pw, a->akey_len,
+    HMAC(a->akey, user->pw, a->ukey_len,
 	 idata, 58+idata[57], data + *data_len, &ilen);
 
     *data_len += a->akey_len;
@@ -1970,13 +2241,13 @@ rakp_hmac_set2(lanserv_data_t *lan, session_t *session,
 	p = lan->bmc_key;
     else
 	p = user->pw;
-    HMAC(a->akey, p, a->akey_len, idata, 34+idata[33], a->sik, &ilen);
+    HMAC(a->akey, p, a->ukey_len, idata, 34+idata[33], a->sik, &ilen);
 
     /* Now generate k1 and k2. */
-    memset(idata, 1, a->akey_len);
-    HMAC(a->akey, a->sik, a->akey_len, idata, a->akey_len, a->k1, &ilen);
-    memset(idata, 2, a->akey_len);
-    HMAC(a->akey, a->sik, a->akey_len, idata, a->akey_len, a->k2, &ilen);
+    memset(idata, 1, a->ukey_len);
+    HMAC(a->akey, a->sik, a->akey_len, idata, a->ukey_len, a->k1, &ilen);
+    memset(idata, 2, a->ukey_len);
+    HMAC(a->akey, a->sik, a->akey_len, idata, a->ukey_len, a->k2, &ilen);
 
     return 0;
 }
@@ -1987,7 +2258,7 @@ rakp_hmac_check3(lanserv_data_t *lan, session_t *session,
 {
     unsigned char       idata[38];
     unsigned int        ilen;
-    unsigned char       integ[20];
+    unsigned char       integ[EVP_MAX_MD_SIZE];
     user_t              *user = &(lan->users[session->userid]);
     auth_data_t         *a = &session->auth_data;
 
@@ -2000,7 +2271,7 @@ rakp_hmac_check3(lanserv_data_t *lan, session_t *session,
     idata[21] = a->username_len;
     memcpy(idata+22, a->username, idata[21]);
 
-    HMAC(a->akey, user->pw, a->akey_len, idata, 22+idata[21], integ, &ilen);
+    HMAC(a->akey, user->pw, a->ukey_len, idata, 22+idata[21], integ, &ilen);
     if (memcmp(integ, data+(*data_len)-a->akey_len, a->akey_len) != 0)
 	return EINVAL;
 
@@ -2016,9 +2287,9 @@ rakp_hmac_set4(lanserv_data_t *lan, session_t *session,
     unsigned char       idata[36];
     unsigned int        ilen;
     auth_data_t         *a = &session->auth_data;
-    unsigned char       integ[20];
+    unsigned char       integ[EVP_MAX_MD_SIZE];
 
-    if (((*data_len) + a->akey_len) > max_len)
+    if (((*data_len) + a->integ_len) > max_len)
 	return E2BIG;
 
     memcpy(idata+0, a->rem_rand, 16);
@@ -2047,7 +2318,15 @@ static auth_handlers_t rakp_hmac_md5 =
     .check3 = rakp_hmac_check3,
     .set4 = rakp_hmac_set4
 };
-#define RAKP_INIT , &rakp_hmac_sha1, &rakp_hmac_md5
+
+static auth_handlers_t rakp_hmac_sha256 =
+{
+    .init = rakp_hmac_sha256_init,
+    .set2 = rakp_hmac_set2,
+    .check3 = rakp_hmac_check3,
+    .set4 = rakp_hmac_set4
+};
+#define RAKP_INIT , &rakp_hmac_sha1, &rakp_hmac_md5, &rakp_hmac_sha256
 
 static int
 hmac_sha1_init(lanserv_data_t *lan, session_t *session)
@@ -2070,6 +2349,16 @@ hmac_md5_init(lanserv_data_t *lan, session_t *session)
     return 0;
 }
 
+static int
+hmac_sha256_init(lanserv_data_t *lan, session_t *session)
+{
+    session->auth_data.ikey2 = EVP_sha256();
+    session->auth_data.ikey = session->auth_data.k1;
+    session->auth_data.ikey_len = 32;
+    session->auth_data.integ_len = 16;
+    return 0;
+}
+
 static void
 hmac_cleanup(lanserv_data_t *lan, session_t *session)
 {
@@ -2082,7 +2371,7 @@ hmac_add(lanserv_data_t *lan, session_t *session,
 {
     auth_data_t   *a = &session->auth_data;
     unsigned int  ilen;
-    unsigned char integ[20];
+    unsigned char integ[EVP_MAX_MD_SIZE];
 
     if (((*data_len) + a->ikey_len) > data_size)
 	return E2BIG;
@@ -2096,7 +2385,7 @@ hmac_add(lanserv_data_t *lan, session_t *session,
 static int
 hmac_check(lanserv_data_t *lan, session_t *session, msg_t *msg)
 {
-    unsigned char integ[20];
+    unsigned char integ[EVP_MAX_MD_SIZE];
     auth_data_t   *a = &session->auth_data;
     unsigned int  ilen;
 
@@ -2191,8 +2480,11 @@ static integ_handlers_t hmac_md5_integ =
 { hmac_md5_init, hmac_cleanup, hmac_add, hmac_check };
 static integ_handlers_t md5_integ =
 { md5_init, md5_cleanup, md5_add, md5_check };
+static integ_handlers_t hmac_sha256_integ =
+{ hmac_sha256_init, hmac_cleanup, hmac_add, hmac_check };
 #define HMAC_INIT , &hmac_sha1_integ, &hmac_md5_integ
 #define MD5_INIT , &md5_integ
+#define HMAC_SHA256_INIT , &hmac_sha256_integ
 
 static int
 aes_cbc_init(lanserv_data_t *lan, session_t *session)
@@ -2217,7 +2509,7 @@ aes_cbc_encrypt(lanserv_data_t *lan, session_t *session,
     unsigned char  *d;
     unsigned char  *iv;
     unsigned int   i;
-    EVP_CIPHER_CTX ctx;
+    EVP_CIPHER_CTX *ctx;
     int            rv;
     int            outlen;
     int            tmplen;
@@ -2264,14 +2556,18 @@ aes_cbc_encrypt(lanserv_data_t *lan, session_t *session,
     *data_size += 16;
 
     /* Ok, we're set to do the crypt operation. */
-    EVP_CIPHER_CTX_init(&ctx);
-    EVP_EncryptInit_ex(&ctx, EVP_aes_128_cbc(), NULL, a->ckey, iv);
-    EVP_CIPHER_CTX_set_padding(&ctx, 0);
-    if (!EVP_EncryptUpdate(&ctx, *pos, &outlen, d, l)) {
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+	free(d);
+	return ENOMEM;
+    }
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, a->ckey, iv);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    if (!EVP_EncryptUpdate(ctx, *pos, &outlen, d, l)) {
 	rv = ENOMEM;
 	goto out_cleanup;
     }
-    if (!EVP_EncryptFinal_ex(&ctx, (*pos) + outlen, &tmplen)) {
+    if (!EVP_EncryptFinal_ex(ctx, (*pos) + outlen, &tmplen)) {
 	rv = ENOMEM; /* right? */
 	goto out_cleanup;
     }
@@ -2281,7 +2577,7 @@ aes_cbc_encrypt(lanserv_data_t *lan, session_t *session,
     *data_len = outlen + 16;
 
  out_cleanup:
-    EVP_CIPHER_CTX_cleanup(&ctx);
+    EVP_CIPHER_CTX_free(ctx);
     free(d);
     return rv;
 }
@@ -2292,7 +2588,7 @@ aes_cbc_decrypt(lanserv_data_t *lan, session_t *session, msg_t *msg)
     auth_data_t    *a = &session->auth_data;
     unsigned int   l = msg->len;
     unsigned char  *d;
-    EVP_CIPHER_CTX ctx;
+    EVP_CIPHER_CTX *ctx;
     int            outlen;
     unsigned char  *pad;
     int            padlen;
@@ -2312,10 +2608,14 @@ aes_cbc_decrypt(lanserv_data_t *lan, session_t *session, msg_t *msg)
     memcpy(d, msg->data+16, l);
 
     /* Ok, we're set to do the decrypt operation. */
-    EVP_CIPHER_CTX_init(&ctx);
-    EVP_DecryptInit_ex(&ctx, EVP_aes_128_cbc(), NULL, a->k2, msg->data);
-    EVP_CIPHER_CTX_set_padding(&ctx, 0);
-    if (!EVP_DecryptUpdate(&ctx, msg->data+16, &outlen, d, l)) {
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+	free(d);
+	return ENOMEM;
+    }
+    EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, a->k2, msg->data);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    if (!EVP_DecryptUpdate(ctx, msg->data+16, &outlen, d, l)) {
 	rv = EINVAL;
 	goto out_cleanup;
     }
@@ -2348,7 +2648,7 @@ aes_cbc_decrypt(lanserv_data_t *lan, session_t *session, msg_t *msg)
     msg->len = outlen;
 
  out_cleanup:
-    EVP_CIPHER_CTX_cleanup(&ctx);
+    EVP_CIPHER_CTX_free(ctx);
     free(d);
     return rv;
 }
@@ -2364,6 +2664,7 @@ unsigned int default_conf = 1; /* AES-CBC-128 */
 #define RAKP_INIT , NULL, NULL
 #define MD5_INIT , NULL
 #define HMAC_INIT , NULL
+#define HMAC_SHA256_INIT
 #define AES_CBC_INIT , NULL
 unsigned int default_auth = 0;
 unsigned int default_integ = 0;
@@ -2371,7 +2672,7 @@ unsigned int default_conf = 0;
 #endif
 integ_handlers_t *integs[64] =
 {
-    NULL HMAC_INIT MD5_INIT
+    NULL HMAC_INIT MD5_INIT HMAC_SHA256_INIT
 };
 conf_handlers_t *confs[64] =
 {
@@ -2402,6 +2703,9 @@ struct valid_cypher_suites_s
     { 2, 3, 1 },
     { 2, 3, 2 },
     { 2, 3, 3 },
+    { 3, 0, 0 },
+    { 3, 4, 0 },
+    { 3, 4, 1 },
     { -1, -1. -1 }
 };
 
@@ -2510,7 +2814,7 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
 	goto out_err;
     }
 
-    session = find_free_session(lan);
+    session = alloc_session(lan);
     if (!session) {
 	lan->sysinfo->log(lan->sysinfo, NEW_SESSION_FAILED, msg,
 		 "Activate session failed: out of free sessions");
@@ -2528,7 +2832,6 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
     memcpy(session->src_addr, msg->src_addr, msg->src_len);
     session->src_len = msg->src_len;
 
-    session->active = 1;
     session->in_startup = 1;
     session->rmcpplus = 1;
     session->authtype = IPMI_AUTHTYPE_RMCP_PLUS;
@@ -2555,11 +2858,7 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
     session->confh = confs[conf];
 
     session->userid = 0;
-    session->time_left = lan->default_session_timeout;
-
-    session->sid = ((lan->sid_seq << (SESSION_BITS_REQ+1))
-		    | (session->handle << 1));
-    lan->sid_seq++;
+    session_touch(lan, session);
 
     lan->sysinfo->log(lan->sysinfo, NEW_SESSION, msg,
 	     "Activate session: Session started, max priv %d", priv);
@@ -2580,8 +2879,6 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
     data[31] = 8;
     data[32] = conf;
 
-    lan->channel.active_sessions++;
-
     return_rmcpp_rsp(lan, session, msg, 0x11, data, 36, NULL, 0);
     return;
  out_err:
@@ -2596,7 +2893,7 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
 static void
 handle_rakp1_payload(lanserv_data_t *lan, msg_t *msg)
 {
-    unsigned char data[64];
+    unsigned char data[72];
     unsigned char priv;
     session_t     *session = NULL;
     uint32_t      sid;
@@ -2864,48 +3161,63 @@ ipmi_handle_rmcpp_msg(lanserv_data_t *lan, msg_t *msg)
     msg->rmcpp.authdata = msg->data + len;
     msg->len = len;
 
+    lan_lock(lan);
     if (msg->sid == 0) {
 	if (msg->rmcpp.authenticated || msg->rmcpp.encrypted) {
 	    lan->sysinfo->log(lan->sysinfo, LAN_ERR, msg,
 		     "LAN msg failure:"
 		     " Got encrypted or authenticated SID 0 msg");
-	    return;
+	    goto out_unlock;
 	}
     } else {
 	session_t    *session = sid_to_session(lan, msg->sid);
-	int          rv;
+	int          irv, drv = 0;
 	int          diff;
 
 	if (session == NULL) {
 	    lan->sysinfo->log(lan->sysinfo, INVALID_MSG, msg,
 		     "Normal session message failure: Invalid SID");
-	    return;
+	    goto out_unlock;
 	}
 
 	if (!session->rmcpplus) {
 	    lan->sysinfo->log(lan->sysinfo, INVALID_MSG, msg,
 		     "Normal session message failure:"
 		     " RMCP+ msg on RMCP session");
-	    return;
+	    goto out_unlock;
 	}
 
 	imsg.rmcpp.encrypted = msg->rmcpp.encrypted;
 	imsg.rmcpp.authenticated = msg->rmcpp.authenticated;
 
-	rv = check_message_integrity(lan, session, &imsg);
-	if (rv) {
+	/* This only needs the session keys, so do it without the lock
+	   to let other threads work.  The session may get closed
+	   meanwhile, but its slot and keys are kept until we are done. */
+	session->in_use++;
+	lan_unlock(lan);
+	irv = check_message_integrity(lan, session, &imsg);
+	if (!irv)
+	    drv = decrypt_message(lan, session, msg);
+	lan_lock(lan);
+	session->in_use--;
+	if (!session->active) {
+	    if (session->cleanup_pending && !session->in_use)
+		release_session(lan, session);
+	    goto out_unlock;
+	}
+
+	if (irv) {
 	    lan->sysinfo->log(lan->sysinfo, LAN_ERR, msg,
 		     "LAN msg failure:"
 		     " Message integrity failed");
-	    return;
+	    goto out_unlock;
 	}
 
-	rv = decrypt_message(lan, session, msg);
-	if (rv) {
+	if (drv) {
 	    lan->sysinfo->log(lan->sysinfo, LAN_ERR, msg,
 		     "LAN msg failure:"
 		     " Message decryption failed");
-	    return;
+	    goto out_unlock;
 	}
 
 	/* Check that the session sequence number is valid.  We make
@@ -2919,7 +3231,7 @@ ipmi_handle_rmcpp_msg(lanserv_data_t *lan, msg_t *msg)
 	if ((diff < -16) || (diff > 15)) {
 	    lan->sysinfo->log(lan->sysinfo, INVALID_MSG, msg,
 		     "Normal session message failure: SEQ out of range");
-	    return;
+	    goto out_unlock;
 	}
 
 	/* We wait until after the message is authenticated to set the
@@ -2930,6 +3242,8 @@ ipmi_handle_rmcpp_msg(lanserv_data_t *lan, msg_t *msg)
 
     if (payload_handlers[msg->rmcpp.payload])
 	payload_handlers[msg->rmcpp.payload](lan, msg);
+ out_unlock:
+    lan_unlock(lan);
 }
 
 static void
@@ -2976,6 +3290,7 @@ ipmi_handle_rmcp_msg(lanserv_data_t *lan, msg_t *msg)
 
     /* Validate even, non-zero sids here.  The odd sids are temporary
        sessions and get authenticated in that handling. */
+    lan_lock(lan);
     if ((msg->sid > 0) && ((msg->sid & 1) == 0)) {
 	/* The "-6, +7" is cheating a little, but we need the last
 	   checksum to correctly calculate the code. */
@@ -2986,22 +3301,32 @@ ipmi_handle_rmcp_msg(lanserv_data_t *lan, msg_t *msg)
 	if (session == NULL) {
 	    lan->sysinfo->log(lan->sysinfo, INVALID_MSG, msg,
 		     "Normal session message failure: Invalid SID");
-	    return;
+	    goto out_unlock;
 	}
 
 	if (session->rmcpplus) {
 	    lan->sysinfo->log(lan->sysinfo, INVALID_MSG, msg,
 		     "Normal session message failure:"
 		     " RMCP msg on RMCP+ session");
-	    return;
+	    goto out_unlock;
 	}
 
+	/* Like RMCP+, check the authcode without the lock. */
+	session->in_use++;
+	lan_unlock(lan);
 	rv = auth_check(session, tsid, tseq, msg->data, msg->len,
 			msg->rmcp.authcode);
+	lan_lock(lan);
+	session->in_use--;
+	if (!session->active) {
+	    if (session->cleanup_pending && !session->in_use)
+		release_session(lan, session);
+	    goto out_unlock;
+	}
 	if (rv) {
 	    lan->sysinfo->log(lan->sysinfo, AUTH_FAILED, msg,
 		     "Normal session message failure: auth failure");
-	    return;
+	    goto out_unlock;
 	}
 
 	/* Check that the session sequence number is valid.  We make sure
@@ -3011,7 +3336,7 @@ ipmi_handle_rmcp_msg(lanserv_data_t *lan, msg_t *msg)
 	if ((diff < -8) || (diff > 8)) {
 	    lan->sysinfo->log(lan->sysinfo, INVALID_MSG, msg,
 		 "Normal session message failure: SEQ out of range");
-	    return;
+	    goto out_unlock;
 	}
 
 	/* We wait until after the message is authenticated to set the
@@ -3021,6 +3346,8 @@ ipmi_handle_rmcp_msg(lanserv_data_t *lan, msg_t *msg)
     }
 
     handle_ipmi_payload(lan, msg);
+ out_unlock:
+    lan_unlock(lan);
 }
 
 void
@@ -3061,29 +3388,40 @@ ipmi_handle_lan_msg(lanserv_data_t *lan,
 
 }
 
+/* Close the sessions at the front of the expiry list that are due. */
 static void
-ipmi_lan_tick(void *info, unsigned int time_since_last)
+lan_expire_sessions(lanserv_data_t *lan)
 {
-    lanserv_data_t *lan = info;
-    int i;
+    session_t *session;
+    long now = lan_now(lan);
 
-    for (i=1; i<=MAX_SESSIONS; i++) {
-	if (lan->sessions[i].active) {
-	    if (lan->sessions[i].time_left <= time_since_last) {
-		msg_t msg = { 0 }; /* A fake message to hold the address. */
+    while ((session = lan->exp_head) && (session->expires <= now)) {
+	msg_t msg = { 0 }; /* A fake message to hold the address. */
 
-		msg.src_addr = lan->sessions[i].src_addr;
-		msg.src_len = lan->sessions[i].src_len;
-		lan->sysinfo->log(lan->sysinfo, SESSION_CLOSED, &msg,
-			 "Session closed: Closed due to timeout");
-		close_session(lan, &(lan->sessions[i]));
-	    } else {
-		lan->sessions[i].time_left -= time_since_last;
-	    }
-	}
+	msg.src_addr = session->src_addr;
+	msg.src_len = session->src_len;
+	lan->sysinfo->log(lan->sysinfo, SESSION_CLOSED, &msg,
+			  "Session closed: Closed due to timeout");
+	close_session(lan, session);
     }
 }
 
+static void
+lan_expiry_timeout(void *cb_data)
+{
+    lanserv_data_t *lan = cb_data;
+
+    lan->expiry_timer_running = 0;
+    lan_expire_sessions(lan);
+    start_expiry_timer(lan);
+}
+
+static void
+ipmi_lan_tick(void *info, unsigned int time_since_last)
+{
+    lan_expire_sessions(info);
+}
+
 static int
 read_lan_config(lanserv_data_t *lan)
 {
@@ -3170,14 +3508,15 @@ ipmi_lan_init(lanserv_data_t *lan)
     int rv;
     uint8_t challenge_data[16];
 
-    for (i=0; i<=MAX_SESSIONS; i++) {
-	lan->sessions[i].handle = i;
-    }
+    if (!lan->max_sessions)
+	lan->max_sessions = DEFAULT_MAX_SESSIONS;
 
     rv = read_lan_config(lan);
     if (rv)
 	return rv;
 
+    ipmi_lan_asf_init(lan);
+
     lan->lanparm.num_destinations = 0; /* LAN alerts not supported */
 
     lan->lanparm.num_cipher_suites = 15;
@@ -3212,9 +3551,17 @@ ipmi_lan_init(lanserv_data_t *lan)
 
     chan_init(&lan->channel);
 
-    lan->tick_handler.handler = ipmi_lan_tick;
-    lan->tick_handler.info = lan;
-    ipmi_register_tick_handler(&lan->tick_handler);
+    /* Sessions time out on a timer if the system has them, so the
+       sessions are not looked at until one is due. */
+    if (!lan->sysinfo->alloc_timer
+	|| lan->sysinfo->alloc_timer(lan->sysinfo, lan_expiry_timeout, lan,
+				     &lan->expiry_timer))
+    {
+	lan->expiry_timer = NULL;
+	lan->tick_handler.handler = ipmi_lan_tick;
+	lan->tick_handler.info = lan;
+	ipmi_register_tick_handler(&lan->tick_handler);
+    }
 
  out:
     return rv;
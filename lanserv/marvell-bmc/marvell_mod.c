@@ -112,8 +112,14 @@ static unsigned int cold_power_up = 1;
  */
 static unsigned int debug;
 
-/* 1 second poll time */
-static unsigned int poll_time = 2000000;
+/*
+ * 1 second poll time.  Sensors with poll_ticks set are only read
+ * every poll_ticks polls.
+ */
+static unsigned int poll_time = 1000000;
+
+/* Temperatures change slowly, read them every other poll by default. */
+static unsigned int temp_poll_ticks = 2;
 
 static lmc_data_t *bmc_mc;
 
@@ -377,12 +383,7 @@ diff_timeval_ms(struct timeval *tv1, struct timeval *tv2)
 static unsigned char
 checksum(unsigned char *data, int size)
 {
-	unsigned char csum = 0;
-	
-	for (; size > 0; size--, data++)
-		csum += *data;
-
-	return csum;
+	return ipmb_checksum(data, size, 0);
 }
 
 /*
@@ -528,6 +529,67 @@ get_uintval(const char *fname, unsigned int *val)
     return 0;
 }
 
+/*
+ * Read a sysfs file, keeping it open in *fd (-1 if it is not open)
+ * between calls.  sysfs generates the contents again for every read
+ * at offset 0, so a new value only takes a pread().  On an error the
+ * file is closed so it is opened again next time, in case the device
+ * went away and came back.
+ */
+static int
+pread_sysfs(const char *fname, int *fd, char *line, unsigned int size)
+{
+    int rv;
+
+    if (*fd == -1) {
+	*fd = open(fname, O_RDONLY);
+	if (*fd == -1)
+	    return errno;
+    }
+    rv = pread(*fd, line, size - 1, 0);
+    if (rv <= 0) {
+	int retval = rv ? errno : EIO;
+	close(*fd);
+	*fd = -1;
+	return retval;
+    }
+    line[rv] = '\0';
+    return 0;
+}
+
+static int
+get_intval_fd(const char *fname, int *fd, int *val)
+{
+    char line[80];
+    int rv;
+
+    rv = pread_sysfs(fname, fd, line, sizeof(line));
+    if (!rv)
+	*val = strtol(line, NULL, 0);
+    return rv;
+}
+
+static int
+get_uintval_fd(const char *fname, int *fd, unsigned int *val)
+{
+    char line[80];
+    int rv;
+
+    rv = pread_sysfs(fname, fd, line, sizeof(line));
+    if (!rv)
+	*val = strtoul(line, NULL, 0);
+    return rv;
+}
+
+static void
+close_fd(int *fd)
+{
+    if (*fd != -1) {
+	close(*fd);
+	*fd = -1;
+    }
+}
+
 /*
  * Fetch a signed integer ASCII value from a file an convert it.
  */
@@ -1849,6 +1911,13 @@ struct sensor_info {
     int mult;
     int div;
     int sub;
+
+    /* Only read every poll_ticks polls, 0 means every poll. */
+    unsigned int poll_ticks;
+
+    /* The open sysfs files, for the switch and for each board. */
+    int fd;
+    int board_fd[NUM_BOARDS];
 };
 static struct sensor_info empty_sensors[] = { { NULL } };
 
@@ -2051,6 +2120,34 @@ static struct sensor_handling system_sensors =
 };
 
 
+static unsigned int scan_count;
+
+static void
+init_sensor_table(struct sensor_handling *h, unsigned int poll_ticks)
+{
+    unsigned int i, j;
+
+    for (i = 0; h->switch_s[i].filename; i++) {
+	h->switch_s[i].poll_ticks = poll_ticks;
+	h->switch_s[i].fd = -1;
+    }
+    for (i = 0; h->board[i].filename; i++) {
+	h->board[i].poll_ticks = poll_ticks;
+	for (j = 0; j < NUM_BOARDS; j++)
+	    h->board[i].board_fd[j] = -1;
+    }
+}
+
+/*
+ * Is the sensor due to be read on this poll?  Ones without a valid
+ * reading are always read.
+ */
+static int
+sensor_due(struct sensor_info *s, char valid)
+{
+    return !valid || s->poll_ticks <= 1 || (scan_count % s->poll_ticks) == 0;
+}
+
 static int
 get_readings(sys_data_t *sys, struct sensor_handling *h, int *rmax)
 {
@@ -2062,18 +2159,23 @@ get_readings(sys_data_t *sys, struct sensor_handling *h, int *rmax)
     for (i = 0; h->switch_s[i].filename; i++) {
 	int value;
 
-	err = get_intval(h->switch_s[i].filename, &value);
-	if (debug & 2)
-	    sys->log(sys, DEBUG, NULL, "Read value %s: %d %d",
-		     h->switch_s[i].filename, err, value);
-	if (err) {
-	    h->switch_valids[i] = 0;
-	} else {
+	if (sensor_due(&h->switch_s[i], h->switch_valids[i])) {
+	    err = get_intval_fd(h->switch_s[i].filename, &h->switch_s[i].fd,
+				&value);
+	    if (debug & 2)
+		sys->log(sys, DEBUG, NULL, "Read value %s: %d %d",
+			 h->switch_s[i].filename, err, value);
+	    if (err) {
+		h->switch_valids[i] = 0;
+	    } else {
+		h->switch_valids[i] = 1;
+		h->switch_last_values[i] = value;
+	    }
+	}
+	if (h->switch_valids[i]) {
 	    success = 1;
-	    h->switch_valids[i] = 1;
-	    h->switch_last_values[i] = value;
-	    if (value > max)
-		max = value;
+	    if (h->switch_last_values[i] > max)
+		max = h->switch_last_values[i];
 	}
     }
 
@@ -2081,47 +2183,53 @@ get_readings(sys_data_t *sys, struct sensor_handling *h, int *rmax)
 	for (j = 0; j < NUM_BOARDS; j++) {
 	    int value;
 	    char filename[100];
+	    int *fd = &h->board[i].board_fd[j];
 
 	    if (!boards[j].present ||
 		(h->board[i].invalid_if_off && !board_power_state(sys, j))) {
+		/* The device may go away, don't hold it open. */
+		close_fd(fd);
 		h->board_valids[i][j] = 0;
 		continue;
 	    }
 
-	    sprintf(filename, h->board[i].filename, j + 1, j + 1);
-
-	    err = get_intval(filename, &value);
-	    if ( err && h->board[i].create_file) {
-		/* The sysfs file doesn't exist, create it. */
-		char cfilename[100];
-		FILE *f;
-
-		sprintf(cfilename, h->board[i].create_file, j + 1);
-		f = fopen(cfilename, "w");
-		if (!f) {
-		    sys->log(sys, OS_ERROR, NULL, "Unable to create %s",
-			     filename);
-		} else {
-		    fprintf(f, "%s\n", h->board[i].create_data);
-		    fclose(f);
+	    if (sensor_due(&h->board[i], h->board_valids[i][j])) {
+		sprintf(filename, h->board[i].filename, j + 1, j + 1);
+
+		err = get_intval_fd(filename, fd, &value);
+		if ( err && h->board[i].create_file) {
+		    /* The sysfs file doesn't exist, create it. */
+		    char cfilename[100];
+		    FILE *f;
+
+		    sprintf(cfilename, h->board[i].create_file, j + 1);
+		    f = fopen(cfilename, "w");
+		    if (!f) {
+			sys->log(sys, OS_ERROR, NULL, "Unable to create %s",
+				 filename);
+		    } else {
+			fprintf(f, "%s\n", h->board[i].create_data);
+			fclose(f);
+		    }
+		    err = get_intval_fd(filename, fd, &value);
 		}
-		err = get_intval(filename, &value);
-	    }
 
-	    if (debug & 2)
-		sys->log(sys, DEBUG, NULL, "Read value %s: %d %d",
-			 filename, err, value);
-	    if (err) {
-		sys->log(sys, OS_ERROR, NULL, "Sensor read error of %s: %s",
-			 filename, strerror(err));
-		h->board_valids[i][j] = 0;
-	    } else {
-		success = 1;
+		if (debug & 2)
+		    sys->log(sys, DEBUG, NULL, "Read value %s: %d %d",
+			     filename, err, value);
+		if (err) {
+		    sys->log(sys, OS_ERROR, NULL, "Sensor read error of %s: %s",
+			     filename, strerror(err));
+		    h->board_valids[i][j] = 0;
+		    continue;
+		}
 		h->board_valids[i][j] = 1;
 		h->board_last_values[i][j] = value;
-		if (value > max)
-		    max = value;
 	    }
+
+	    success = 1;
+	    if (h->board_last_values[i][j] > max)
+		max = h->board_last_values[i][j];
 	}
     }
 
@@ -2186,6 +2294,7 @@ static uint16_t dimm_errors[NUM_BOARDS];
 
 static int ps_status_good[2];
 static unsigned int ps_status_word[2];
+static int ps_status_fd[2] = { -1, -1 };
 
 static void
 scan_eeprom_sensors(sys_data_t *sys)
@@ -2229,7 +2338,7 @@ scan_ps_sensors(sys_data_t *sys)
     int rv;
     unsigned int i;
 
-    rv = get_uintval("/sys/class/wixpmbus/STATUS_1", &i);
+    rv = get_uintval_fd("/sys/class/wixpmbus/STATUS_1", &ps_status_fd[0], &i);
     if (rv) {
 	/* Not present */
 	ps_status_good[0] = 0;
@@ -2237,7 +2346,7 @@ scan_ps_sensors(sys_data_t *sys)
 	ps_status_good[0] = 1;
 	ps_status_word[0] = i;
     }
-    rv = get_uintval("/sys/class/wixpmbus/STATUS_2", &i);
+    rv = get_uintval_fd("/sys/class/wixpmbus/STATUS_2", &ps_status_fd[1], &i);
     if (rv) {
 	/* Not present */
 	ps_status_good[1] = 0;
@@ -2254,6 +2363,10 @@ static char *fan_fail_led[4]  =
     "/sys/class/astgpio/GPIOP2",
     "/sys/class/astgpio/GPIOP3",
 };
+static int fan_fail_led_state[4] = { -1, -1, -1, -1 };
+
+/* The fan speeds are read with the switch sensors, starting here. */
+#define FIRST_FAN_SENSOR 3
 
 static void *
 scan_sensors(void *cb_data)
@@ -2292,35 +2405,36 @@ scan_sensors(void *cb_data)
 		max_duty = duty;
 	}
 
+	/* The fan speeds are in here, so read these first. */
+	get_readings(sys, &system_sensors, NULL);
+
 	duty = 0;
-	for (i = 1; i < 9; i++) {
-	    char filename[50];
-	    int val;
+	for (i = 0; i < 8; i++) {
+	    int val = switch_sensor_last_values[FIRST_FAN_SENSOR + i];
 
-	    sprintf(filename, "/sys/class/astfan/fan%u_input", i);
-	    err = get_intval(filename, &val);
-	    if (err) {
+	    if (!switch_sensor_valids[FIRST_FAN_SENSOR + i]) {
 		sys->log(sys, OS_ERROR, NULL,
-			 "Can't read fan speed for %s: %s", filename,
-			 strerror(err));
+			 "Can't read fan speed for %s",
+			 switch_sensors[FIRST_FAN_SENSOR + i].filename);
 		/* Can't read fan, better safe than sorry. */
 		duty = 90;
-		fan_fail[i - 1] = 1;
+		fan_fail[i] = 1;
 	    } else {
 		/* A fan is failing. */
 		if (val < 1000) {
-		    fan_fail[i - 1] = 1;
+		    fan_fail[i] = 1;
 		    duty = 90;
 		} else
-		    fan_fail[i - 1] = 0;
+		    fan_fail[i] = 0;
 	    }
 	}
 
 	for (i = 0; i < 4; i++) {
-	    if (fan_fail[i * 2] || fan_fail[i * 2 + 1])
-		set_intval(fan_fail_led[i], 1);
-	    else
-		set_intval(fan_fail_led[i], 0);
+	    int fail = fan_fail[i * 2] || fan_fail[i * 2 + 1];
+
+	    if (fail != fan_fail_led_state[i]
+		&& !set_intval(fan_fail_led[i], fail))
+		fan_fail_led_state[i] = fail;
 	}
 
 	if (duty > max_duty)
@@ -2346,8 +2460,6 @@ scan_sensors(void *cb_data)
 	    }
 	}
 
-	get_readings(sys, &system_sensors, NULL);
-
 	scan_eeprom_sensors(sys);
 
 	scan_ps_sensors(sys);
@@ -2368,6 +2480,8 @@ scan_sensors(void *cb_data)
 	    wdt_test_timer_ran = 0;
 	}
 
+	scan_count++;
+
 	/* Wait until poll_time seconds after the last scan started */
 	sys->get_monotonic_time(sys, &now);
 	diff_timeval(&wait, &next, &now);
@@ -2926,6 +3040,8 @@ ipmi_sim_module_init(sys_data_t *sys, const char *initstr_i)
 	    disable_wdt = 1;
 	} else if (strncmp(c, "poll_time=", 10) == 0) {
 	    poll_time = strtoul(c + 10, NULL, 0);
+	} else if (strncmp(c, "temp_poll_ticks=", 16) == 0) {
+	    temp_poll_ticks = strtoul(c + 16, NULL, 0);
 	} else {
 	    sys->log(sys, SETUP_ERROR, NULL, "Warning: MV: Unknown init"
 		     " string: %s", c);
@@ -3253,6 +3369,11 @@ ipmi_sim_module_post_init(sys_data_t *sys)
     ipmi_mc_sensor_set_bit(bmc_mc, 0, 8, 0, 1, 0);
     ipmi_mc_sensor_set_bit(bmc_mc, 0, 9, 0, 1, 0);
 
+    init_sensor_table(&main_temp, temp_poll_ticks);
+    init_sensor_table(&mb_temp, temp_poll_ticks);
+    init_sensor_table(&front_temp, temp_poll_ticks);
+    init_sensor_table(&system_sensors, 0);
+
     rv = pthread_create(&scan_thread, NULL, scan_sensors, sys);
     if (rv) {
 	sys->log(sys, OS_ERROR, NULL,
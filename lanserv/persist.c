@@ -61,12 +61,14 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdarg.h>
+#include <unistd.h>
 #include <OpenIPMI/persist.h>
 
 enum pitem_type {
     PITEM_DATA = 'd',
     PITEM_INT = 'i',
-    PITEM_STR = 's'
+    PITEM_STR = 's',
+    PITEM_DEL = 'x'	/* Only in journals, removes the item. */
 };
 
 struct pitem {
@@ -84,6 +86,33 @@ struct persist_s {
 };
 
 int persist_enable = 1;
+int persist_locked_off;
+
+/*
+ * Journals.  Rewriting a whole file for every change is expensive for
+ * big files like the SEL, so single changes can be appended to a
+ * journal next to the file (the name with ".jnl" added) with
+ * journal_persist() instead.  read_persist() applies the journal on
+ * top of the file, and write_persist() replaces both.  The first line
+ * of a journal identifies the version of the file it applies to, so a
+ * journal left over from a crash in write_persist() is ignored.
+ *
+ * Journal writes are flushed right away but only synced to disk every
+ * persist_journal_sync_count records or when persist_sync() is
+ * called, so a burst of changes costs one fsync.  A journal with
+ * persist_journal_max records is folded into its file.
+ */
+int persist_journal_sync_count = 32;
+int persist_journal_max = 1024;
+
+struct pjournal {
+    char *fname;
+    FILE *f;
+    unsigned int records;
+    unsigned int unsynced;
+    struct pjournal *next;
+};
+static struct pjournal *journals;
 
 static char *app = NULL;
 static const char *basedir;
@@ -259,115 +288,431 @@ write_data(void *idata, unsigned int len, FILE *f)
     }
 }
 
-persist_t *
-read_persist(const char *name, ...)
+static struct pitem *
+parse_pitem(char *line)
+{
+    char *name = line;
+    char *type = strchr(name, ':');
+    char *val;
+    char *end;
+    struct pitem *pi;
+
+    if (!type)
+	return NULL;
+    *type++ = '\0';
+    if (strlen(name) == 0 || !*type || *(type + 1) != ':')
+	return NULL;
+    *(type + 1) = '\0';
+    val = type + 2;
+
+    pi = malloc(sizeof(*pi));
+    if (!pi)
+	return NULL;
+
+    pi->iname = strdup(name);
+    if (!pi->iname) {
+	free(pi);
+	return NULL;
+    }
+    pi->type = type[0];
+
+    switch (type[0]) {
+    case PITEM_DATA:
+	pi->data = read_data(val, &pi->dval, 0);
+	if (!pi->data)
+	    goto bad_data;
+	break;
+    case PITEM_INT:
+	pi->data = NULL;
+	pi->dval = strtol(val, &end, 0);
+	if (*end != '\n' && *end != '\0')
+	    goto bad_data;
+	break;
+    case PITEM_STR:
+	pi->data = read_data(val, &pi->dval, 1);
+	if (!pi->data)
+	    goto bad_data;
+	break;
+    case PITEM_DEL:
+	pi->data = NULL;
+	pi->dval = 0;
+	break;
+    bad_data:
+    default:
+	free(pi->iname);
+	free(pi);
+	return NULL;
+    }
+
+    return pi;
+}
+
+static void
+free_pitem(struct pitem *pi)
+{
+    if (pi->data)
+	free(pi->data);
+    free(pi->iname);
+    free(pi);
+}
+
+static struct pitem **
+find_pi_name(persist_t *p, const char *name)
+{
+    struct pitem **pi = &p->items;
+
+    while (*pi) {
+	if (strcmp((*pi)->iname, name) == 0)
+	    break;
+	pi = &(*pi)->next;
+    }
+    return pi;
+}
+
+static void
+reverse_items(persist_t *p)
+{
+    struct pitem *pi = p->items, *next;
+
+    p->items = NULL;
+    while (pi) {
+	next = pi->next;
+	pi->next = p->items;
+	p->items = pi;
+	pi = next;
+    }
+}
+
+/*
+ * Get the line that ties a journal to a version of its file.  A file
+ * that doesn't exist yet is version "0 0".
+ */
+static void
+journal_base_id(const char *fname, char *id, unsigned int len)
+{
+    struct stat st;
+
+    if (stat(fname, &st) != 0)
+	snprintf(id, len, "#base 0 0\n");
+    else
+	snprintf(id, len, "#base %lu %lu\n", (unsigned long) st.st_ino,
+		 (unsigned long) st.st_size);
+}
+
+/*
+ * Apply the journal on top of the items read from the file.  Changed
+ * items are updated in place, new items go on the end.  Returns the
+ * number of records applied or -1 if there is no usable journal.
+ */
+static int
+apply_journal(persist_t *p)
+{
+    char *fname, *jname;
+    char id[64];
+    FILE *f;
+    char *line = NULL;
+    size_t n = 0;
+    struct pitem *pi, *old, **opi, **tail;
+    int count = 0;
+
+    fname = get_fname(p, "");
+    if (!fname)
+	return -1;
+    jname = get_fname(p, ".jnl");
+    if (!jname) {
+	free(fname);
+	return -1;
+    }
+    journal_base_id(fname, id, sizeof(id));
+    f = fopen(jname, "r");
+    free(fname);
+    free(jname);
+    if (!f)
+	return -1;
+
+    if (getline(&line, &n, f) == -1 || strcmp(line, id) != 0) {
+	free(line);
+	fclose(f);
+	return -1;
+    }
+
+    for (tail = &p->items; *tail; tail = &(*tail)->next)
+	;
+    while (getline(&line, &n, f) != -1) {
+	pi = parse_pitem(line);
+	if (!pi)
+	    continue;
+	count++;
+	opi = find_pi_name(p, pi->iname);
+	old = *opi;
+	if (pi->type == PITEM_DEL) {
+	    if (old) {
+		*opi = old->next;
+		if (tail == &old->next)
+		    tail = opi;
+		free_pitem(old);
+	    }
+	    free_pitem(pi);
+	} else if (old) {
+	    pi->next = old->next;
+	    *opi = pi;
+	    if (tail == &old->next)
+		tail = &pi->next;
+	    free_pitem(old);
+	} else {
+	    pi->next = NULL;
+	    *tail = pi;
+	    tail = &pi->next;
+	}
+    }
+    free(line);
+    fclose(f);
+    return count;
+}
+
+static int
+read_persist_p(persist_t *p)
 {
     char *fname;
-    va_list ap;
-    persist_t *p;
     FILE *f;
     char *line;
-    char *end;
     size_t n;
+    struct pitem *pi;
+
+    fname = get_fname(p, "");
+    if (!fname)
+	return ENOMEM;
+    f = fopen(fname, "r");
+    free(fname);
+    if (f) {
+	for (line = NULL; getline(&line, &n, f) != -1;
+	     free(line), line = NULL) {
+	    pi = parse_pitem(line);
+	    if (!pi)
+		continue;
+	    pi->next = p->items;
+	    p->items = pi;
+	}
+	free(line);
+	fclose(f);
+    }
+
+    if (apply_journal(p) < 0 && !f)
+	return ENOENT;
+    return 0;
+}
+
+persist_t *
+read_persist(const char *name, ...)
+{
+    va_list ap;
+    persist_t *p;
 
     if (!persist_enable)
 	return NULL;
 
     va_start(ap, name);
     p = alloc_vpersist(name, ap);
+    va_end(ap);
     if (!p)
 	return NULL;
-    fname = get_fname(p, "");
-    if (!fname) {
+    if (read_persist_p(p)) {
 	free_persist(p);
 	return NULL;
     }
-    f = fopen(fname, "r");
-    free(fname);
-    if (!f) {
-	free_persist(p);
-	return NULL;
+
+    return p;
+}
+
+static void
+write_pitem(struct pitem *pi, FILE *f)
+{
+    fprintf(f, "%s:%c:", pi->iname, pi->type);
+    switch (pi->type) {
+    case PITEM_DATA:
+    case PITEM_STR:
+	write_data(pi->data, pi->dval, f);
+	break;
+    case PITEM_INT:
+	fprintf(f, "%ld", pi->dval);
+	break;
+    case PITEM_DEL:
+	break;
+    }
+    fputc('\n', f);
+}
+
+int
+write_persist_file(persist_t *p, FILE *f)
+{
+    struct pitem *pi;
+
+    for (pi = p->items; pi; pi = pi->next) {
+	if (pi->type != PITEM_DEL)
+	    write_pitem(pi, f);
     }
+    return 0;
+}
 
-    for (line = NULL; getline(&line, &n, f) != -1; free(line), line = NULL) {
-	char *name = line;
-	char *type = strchr(name, ':');
-	char *val;
-	struct pitem *pi;
+static void
+sync_journal(struct pjournal *j)
+{
+    if (j->unsynced) {
+	fflush(j->f);
+	fsync(fileno(j->f));
+	j->unsynced = 0;
+    }
+}
 
-	if (!type)
-	    continue;
-	*type++ = '\0';
-	if (strlen(name) == 0 || !*type || *(type + 1) != ':')
-	    continue;
-	*(type + 1) = '\0';
-	val = type + 2;
-
-	pi = malloc(sizeof(*pi));
-	if (!pi) {
-	    free(line);
-	    free_persist(p);
-	    return NULL;
+/* Close the journal for the file and remove it. */
+static void
+drop_journal(persist_t *p)
+{
+    struct pjournal **jp, *j;
+    char *jname;
+
+    jname = get_fname(p, ".jnl");
+    if (!jname)
+	return;
+    for (jp = &journals; *jp; jp = &(*jp)->next) {
+	if (strcmp((*jp)->fname, jname) == 0) {
+	    j = *jp;
+	    *jp = j->next;
+	    fclose(j->f);
+	    free(j->fname);
+	    free(j);
+	    break;
 	}
+    }
+    unlink(jname);
+    free(jname);
+}
 
-	pi->iname = strdup(name);
-	if (!pi->iname) {
-	    free(pi);
-	    free(line);
-	    free_persist(p);
-	    return NULL;
+static struct pjournal *
+open_journal(persist_t *p)
+{
+    struct pjournal *j;
+    char *fname, *jname;
+    char id[64];
+    char *line = NULL;
+    size_t n = 0;
+    FILE *f;
+    unsigned int records = 0;
+    int valid = 0;
+
+    jname = get_fname(p, ".jnl");
+    if (!jname)
+	return NULL;
+    for (j = journals; j; j = j->next) {
+	if (strcmp(j->fname, jname) == 0) {
+	    free(jname);
+	    return j;
 	}
-	pi->type = type[0];
+    }
 
-	switch (type[0]) {
-	case PITEM_DATA:
-	    pi->data = read_data(val, &pi->dval, 0);
-	    if (!pi->data)
-		goto bad_data;
-	    break;
-	case PITEM_INT:
-	    pi->data = NULL;
-	    pi->dval = strtol(val, &end, 0);
-	    if (*end != '\n' && *end != '\0')
-		goto bad_data;
-	    break;
-	case PITEM_STR:
-	    pi->data = read_data(val, &pi->dval, 1);
-	    if (!pi->data)
-		goto bad_data;
-	    break;
-	bad_data:
-	default:
-	    free(pi->iname);
-	    free(pi);
-	    continue;
+    fname = get_fname(p, "");
+    if (!fname) {
+	free(jname);
+	return NULL;
+    }
+    journal_base_id(fname, id, sizeof(id));
+    free(fname);
+
+    /* Keep an existing journal if it goes with the current file. */
+    f = fopen(jname, "r");
+    if (f) {
+	if (getline(&line, &n, f) != -1 && strcmp(line, id) == 0) {
+	    valid = 1;
+	    while (getline(&line, &n, f) != -1)
+		records++;
 	}
+	free(line);
+	fclose(f);
+    }
 
-	pi->next = p->items;
-	p->items = pi;
+    j = malloc(sizeof(*j));
+    if (!j) {
+	free(jname);
+	return NULL;
+    }
+    j->fname = jname;
+    j->f = fopen(jname, valid ? "a" : "w");
+    if (!j->f) {
+	free(jname);
+	free(j);
+	return NULL;
     }
+    if (!valid)
+	fputs(id, j->f);
+    j->records = records;
+    j->unsynced = 0;
+    j->next = journals;
+    journals = j;
+    return j;
+}
 
-    return p;
+/* Fold the journal into the file. */
+static int
+compact_persist(persist_t *p)
+{
+    persist_t *full;
+    int rv;
+
+    full = alloc_persist("%s", p->name);
+    if (!full)
+	return ENOMEM;
+    rv = read_persist_p(full);
+    if (!rv) {
+	/* write_persist() wants the newest item first. */
+	reverse_items(full);
+	rv = write_persist(full);
+    }
+    free_persist(full);
+    return rv;
 }
 
 int
-write_persist_file(persist_t *p, FILE *f)
+journal_persist(persist_t *p)
 {
+    struct pjournal *j;
     struct pitem *pi;
+    unsigned int count = 0;
+    int rv = 0;
+
+    if (!persist_enable)
+	return 0;
 
+    j = open_journal(p);
+    if (!j)
+	return ENOMEM;
+
+    /* Items are kept newest first, the journal needs them in order. */
+    reverse_items(p);
     for (pi = p->items; pi; pi = pi->next) {
-	fprintf(f, "%s:%c:", pi->iname, pi->type);
-	switch (pi->type) {
-	case PITEM_DATA:
-	case PITEM_STR:
-	    write_data(pi->data, pi->dval, f);
-	    break;
-	case PITEM_INT:
-	    fprintf(f, "%ld", pi->dval);
-	}
-	fputc('\n', f);
+	write_pitem(pi, j->f);
+	count++;
     }
-    return 0;
+    reverse_items(p);
+    if (fflush(j->f) != 0)
+	rv = errno;
+
+    j->records += count;
+    j->unsynced += count;
+    if (j->records >= (unsigned int) persist_journal_max)
+	rv = compact_persist(p);
+    else if (j->unsynced >= (unsigned int) persist_journal_sync_count)
+	sync_journal(j);
+
+    return rv;
+}
+
+void
+persist_sync(void)
+{
+    struct pjournal *j;
+
+    for (j = journals; j; j = j->next)
+	sync_journal(j);
 }
 
 int
@@ -403,6 +748,9 @@ write_persist(persist_t *p)
 
     if (rename(fname, fname2) != 0)
 	rv = errno;
+    else
+	/* The file now has everything, the journal no longer applies. */
+	drop_journal(p);
 
     free(fname);
     free(fname2);
@@ -435,6 +783,9 @@ iterate_persist(persist_t *p,
 	    if (int_func)
 		rv = int_func(pi->iname, pi->dval, cb_data);
 	    break;
+
+	case PITEM_DEL:
+	    break;
 	}
 
 	if (rv != ITER_PERSIST_CONTINUE)
@@ -452,11 +803,7 @@ free_persist(persist_t *p)
     while (p->items) {
 	pi = p->items;
 	p->items = pi->next;
-
-	if (pi->data)
-	    free(pi->data);
-	free(pi->iname);
-	free(pi);
+	free_pitem(pi);
     }
     free(p);
 }
@@ -500,17 +847,13 @@ alloc_pi(persist_t *p, enum pitem_type type, const void *data, long len,
 static struct pitem *
 find_pi(persist_t *p, const char *iname, va_list ap)
 {
-    struct pitem *pi = p->items;
+    struct pitem *pi;
     char *name = do_va_nameit(iname, ap);
 
     if (!name)
 	return NULL;
 
-    while (pi) {
-	if (strcmp(pi->iname, name) == 0)
-	    break;
-	pi = pi->next;
-    }
+    pi = *find_pi_name(p, name);
     free(name);
     return pi;
 }
@@ -553,6 +896,18 @@ read_persist_data(persist_t *p, void **data, unsigned int *len,
     return 0;
 }
 
+int
+add_persist_del(persist_t *p, const char *name, ...)
+{
+    va_list ap;
+    int rv;
+
+    va_start(ap, name);
+    rv = alloc_pi(p, PITEM_DEL, NULL, 0, name, ap);
+    va_end(ap);
+    return rv;
+}
+
 int
 add_persist_int(persist_t *p, long val, const char *name, ...)
 {
@@ -44,6 +44,9 @@
 
 #include "persist.c"
 
+/* For the SDR image format. */
+#include <OpenIPMI/mcserv.h>
+
 #define MAX_SDR_LINE 256
 
 struct sdr_field_name {
@@ -1558,12 +1561,60 @@ static char *progname;
 
 static void help(void)
 {
-    fprintf(stderr, "%s [-r] <input file>\n", progname);
+    fprintf(stderr, "%s [-r | -b] <input file>\n", progname);
     exit(1);
 }
 
+enum out_type { OUT_PERSIST, OUT_RAW, OUT_IMAGE };
+
+/* SDRs collected for a binary image, the header needs the totals. */
+static unsigned char *image_data;
+static unsigned int image_len;
+static unsigned int image_size;
+
 static void
-parse_file(const char *filename, FILE *f, persist_t *p, int outraw,
+add_image_sdr(unsigned char *sdr, unsigned int sdrlen)
+{
+    if (image_len + sdrlen > image_size) {
+	unsigned char *n;
+
+	image_size = (image_size ? image_size * 2 : 4096) + sdrlen;
+	n = realloc(image_data, image_size);
+	if (!n) {
+	    fprintf(stderr, "Out of memory\n");
+	    exit(1);
+	}
+	image_data = n;
+    }
+    memcpy(image_data + image_len, sdr, sdrlen);
+    image_len += sdrlen;
+}
+
+static void
+put_le32(unsigned char *d, unsigned int v)
+{
+    d[0] = v & 0xff;
+    d[1] = (v >> 8) & 0xff;
+    d[2] = (v >> 16) & 0xff;
+    d[3] = (v >> 24) & 0xff;
+}
+
+static void
+write_image(unsigned int count)
+{
+    unsigned char hdr[IPMI_SDR_IMAGE_HDR_LEN];
+
+    memcpy(hdr, IPMI_SDR_IMAGE_MAGIC, 8);
+    put_le32(hdr + 8, IPMI_SDR_IMAGE_VERSION);
+    put_le32(hdr + 12, count);
+    put_le32(hdr + 16, image_len);
+    fwrite(hdr, sizeof(hdr), 1, stdout);
+    if (image_len)
+	fwrite(image_data, image_len, 1, stdout);
+}
+
+static void
+parse_file(const char *filename, FILE *f, persist_t *p, enum out_type outtype,
 	   unsigned int *sdrnum)
 {
     char buf[MAX_SDR_LINE];
@@ -1616,8 +1667,10 @@ parse_file(const char *filename, FILE *f, persist_t *p, int outraw,
 	    sdr[0] = *sdrnum & 0xff;
 	    sdr[1] = (*sdrnum >> 8) & 0xff;
 
-	    if (outraw) {
+	    if (outtype == OUT_RAW) {
 		fwrite(sdr, sdrlen, 1, stdout);
+	    } else if (outtype == OUT_IMAGE) {
+		add_image_sdr(sdr, sdrlen);
 	    } else {
 		err = add_persist_data(p, sdr, sdrlen, "%d", *sdrnum);
 		if (err) {
@@ -1668,7 +1721,7 @@ parse_file(const char *filename, FILE *f, persist_t *p, int outraw,
 		exit(1);
 	    }
 
-	    parse_file(nfilename, f2, p, outraw, sdrnum);
+	    parse_file(nfilename, f2, p, outtype, sdrnum);
 	    
 	    fclose(f2);
 	} else {
@@ -1688,7 +1741,7 @@ main(int argc, char *argv[])
     persist_t *p = NULL;
     unsigned int sdrnum = 1;
     int argn;
-    int outraw = 0;
+    enum out_type outtype = OUT_PERSIST;
 
     progname = argv[0];
 
@@ -1698,7 +1751,9 @@ main(int argc, char *argv[])
 	if (strcmp(argv[argn], "--") == 0)
 	    break;
 	if (strcmp(argv[argn], "-r") == 0) {
-	    outraw = 1;
+	    outtype = OUT_RAW;
+	} else if (strcmp(argv[argn], "-b") == 0) {
+	    outtype = OUT_IMAGE;
 	} else {
 	    fprintf(stderr, "Invalid option: %s\n", argv[argn]);
 	    exit(1);
@@ -1716,7 +1771,7 @@ main(int argc, char *argv[])
 	exit(1);
     }
 
-    if (!outraw) {
+    if (outtype == OUT_PERSIST) {
 	p = alloc_persist("");
 	if (!p) {
 	    fprintf(stderr, "Out of memory\n");
@@ -1724,11 +1779,14 @@ main(int argc, char *argv[])
 	}
     }
 
-    parse_file(argv[argn], f, p, outraw, &sdrnum);
+    parse_file(argv[argn], f, p, outtype, &sdrnum);
 
     fclose(f);
 
-    if (!outraw) {
+    if (outtype == OUT_IMAGE)
+	write_image(sdrnum - 1);
+
+    if (outtype == OUT_PERSIST) {
 	add_persist_int(p, time(NULL), "last_add_time");
 	write_persist_file(p, stdout);
 	free_persist(p);
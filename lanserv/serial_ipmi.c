@@ -434,6 +434,48 @@ dm_handle_char(unsigned char ch, serserv_data_t *si)
     }
 }
 
+/* Bytes dm_handle_char() must see, everything else is plain data. */
+static const unsigned char dm_special[256] = {
+    [DM_START_CHAR] = 1, [DM_STOP_CHAR] = 1,
+    [DM_PACKET_HANDSHAKE] = 1, [DM_DATA_ESCAPE_CHAR] = 1
+};
+
+/*
+ * Copy runs of plain data straight into the message, only going a
+ * character at a time for the framing and escape characters and the
+ * character after an escape.
+ */
+static void
+dm_handle_data(unsigned char *data, unsigned int len, serserv_data_t *si)
+{
+    struct dm_data *info = si->codec_info;
+    unsigned char  *end = data + len, *run;
+    unsigned int   n, room;
+
+    while (data < end) {
+	if (dm_special[*data] || info->in_escape || info->recv_msg_too_many) {
+	    dm_handle_char(*data++, si);
+	    continue;
+	}
+
+	run = data;
+	while ((data < end) && !dm_special[*data])
+	    data++;
+	if (!info->in_recv_msg)
+	    /* Ignore characters outside of messages. */
+	    continue;
+
+	n = data - run;
+	room = sizeof(info->recv_msg) - info->recv_msg_len;
+	if (n > room) {
+	    n = room;
+	    info->recv_msg_too_many = 1;
+	}
+	memcpy(info->recv_msg + info->recv_msg_len, run, n);
+	info->recv_msg_len += n;
+    }
+}
+
 static void
 dm_send(msg_t *imsg, serserv_data_t *si)
 {
@@ -873,6 +915,40 @@ vm_handle_char(unsigned char ch, serserv_data_t *si)
     }
 }
 
+/* Bytes vm_handle_char() must see, everything else is plain data. */
+static const unsigned char vm_special[256] = {
+    [VM_MSG_CHAR] = 1, [VM_CMD_CHAR] = 1, [VM_ESCAPE_CHAR] = 1
+};
+
+/* Like dm_handle_data(), but VM data between messages is kept. */
+static void
+vm_handle_data(unsigned char *data, unsigned int len, serserv_data_t *si)
+{
+    struct vm_data *info = si->codec_info;
+    unsigned char  *end = data + len, *run;
+    unsigned int   n, room;
+
+    while (data < end) {
+	if (vm_special[*data] || info->in_escape || info->recv_msg_too_many) {
+	    vm_handle_char(*data++, si);
+	    continue;
+	}
+
+	run = data;
+	while ((data < end) && !vm_special[*data])
+	    data++;
+
+	n = data - run;
+	room = sizeof(info->recv_msg) - info->recv_msg_len;
+	if (n > room) {
+	    n = room;
+	    info->recv_msg_too_many = 1;
+	}
+	memcpy(info->recv_msg + info->recv_msg_len, run, n);
+	info->recv_msg_len += n;
+    }
+}
+
 static void
 vm_add_char(unsigned char ch, unsigned char *c, unsigned int *pos)
 {
@@ -1037,11 +1113,12 @@ static ser_codec_t codecs[] = {
     { "TerminalMode",
       tm_handle_char, tm_send, tm_setup },
     { "Direct",
-      dm_handle_char, dm_send, dm_setup },
+      dm_handle_char, dm_send, dm_setup, NULL, NULL, dm_handle_data },
     { "RadisysAscii",
       ra_handle_char, ra_send, ra_setup },
     { "VM",
-      vm_handle_char, vm_send, vm_setup, vm_connected, vm_disconnected },
+      vm_handle_char, vm_send, vm_setup, vm_connected, vm_disconnected,
+      vm_handle_data },
     { NULL }
 };
 
@@ -1183,6 +1260,11 @@ serserv_handle_data(serserv_data_t *ser, uint8_t *data, unsigned int len)
 {
     unsigned int i;
 
+    if (ser->codec->handle_data) {
+	ser->codec->handle_data(data, len, ser);
+	return;
+    }
+
     for (i = 0; i < len; i++)
 	ser->codec->handle_char(data[i], ser);
 }
@@ -1263,6 +1345,10 @@ serserv_read_config(char **tokptr, sys_data_t *sys, const char **errstr)
 	    ser->do_connect = 1;
 	    continue;
 	}
+	if (strcmp(tok, "shared") == 0) {
+	    ser->shared = 1;
+	    continue;
+	}
 
 	tok2 = mystrtok(NULL, " \t\n", tokptr);
 	if (strcmp(tok, "codec") == 0) {
@@ -1318,11 +1404,17 @@ serserv_read_config(char **tokptr, sys_data_t *sys, const char **errstr)
 		return -1;
 	    }
 	} else {
-	    *errstr = "Invalid setting, not connect, codec, oem, attn, or ipmb";
+	    *errstr = "Invalid setting, not connect, shared, codec, oem, attn,"
+		" or ipmb";
 	    return -1;
 	}
     }
 
+    if (ser->shared && ser->do_connect) {
+	*errstr = "shared only works when listening, not with connect";
+	goto out_err;
+    }
+
     if (!ser->codec) {
 	*errstr = "codec not specified";
 	goto out_err;
@@ -59,10 +59,13 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <math.h>
 
 #include <OpenIPMI/ipmi_mc.h>
 #include <OpenIPMI/ipmi_msgbits.h>
 #include <OpenIPMI/serv.h>
+#include <OpenIPMI/internal/ipmi_checksum.h>
 
 int
 ipmi_oem_send_msg(channel_t     *chan,
@@ -101,6 +104,215 @@ ipmi_oem_send_msg(channel_t     *chan,
     return rv;
 }
 
+typedef struct chan_fault_s
+{
+    sys_data_t   *sys;
+    unsigned int delay;
+    unsigned int jitter;
+    int          exp_jitter;
+    double       loss;
+    double       dup;
+    double       reorder;
+    unsigned int reorder_delay;
+    unsigned int seed;
+} chan_fault_t;
+
+typedef struct chan_fault_rsp_s
+{
+    channel_t     *chan;
+    sys_data_t    *sys;
+    msg_t         *msg;
+    rsp_msg_t     rsp;
+    int           dup;
+    ipmi_timer_t  *timer;
+    unsigned char data[];
+} chan_fault_rsp_t;
+
+/* Returns a random number in [0, 1). */
+static double
+chan_fault_rand(chan_fault_t *f)
+{
+    return rand_r(&f->seed) / (RAND_MAX + 1.0);
+}
+
+static void
+chan_fault_timeout(void *cb_data)
+{
+    chan_fault_rsp_t *fr = cb_data;
+    channel_t        *chan = fr->chan;
+
+    chan->return_rsp(chan, fr->msg, &fr->rsp);
+    if (fr->dup)
+	chan->return_rsp(chan, fr->msg, &fr->rsp);
+    chan->free(chan, fr->msg);
+    fr->sys->free_timer(fr->timer);
+    free(fr);
+}
+
+/*
+ * Returns 1 if the response was dropped or will be sent later, 0 if
+ * it should be sent now.
+ */
+static int
+chan_fault_rsp(channel_t *chan, msg_t *msg, rsp_msg_t *rsp)
+{
+    chan_fault_t     *f = chan->fault;
+    chan_fault_rsp_t *fr;
+    unsigned int     delay;
+    int              dup;
+    struct timeval   tv;
+
+    if ((f->loss > 0) && (chan_fault_rand(f) * 100 < f->loss)) {
+	chan->free(chan, msg);
+	return 1;
+    }
+
+    dup = (f->dup > 0) && (chan_fault_rand(f) * 100 < f->dup);
+
+    delay = f->delay;
+    if (f->jitter) {
+	if (f->exp_jitter)
+	    delay += -log(1.0 - chan_fault_rand(f)) * f->jitter;
+	else
+	    delay += chan_fault_rand(f) * (f->jitter + 1);
+    }
+    if ((f->reorder > 0) && (chan_fault_rand(f) * 100 < f->reorder))
+	delay += chan_fault_rand(f) * (f->reorder_delay + 1);
+
+    if (!delay) {
+	if (!dup)
+	    return 0;
+	chan->return_rsp(chan, msg, rsp);
+	chan->return_rsp(chan, msg, rsp);
+	chan->free(chan, msg);
+	return 1;
+    }
+
+    fr = malloc(sizeof(*fr) + rsp->data_len);
+    if (!fr)
+	/* Just send it now. */
+	return 0;
+    fr->chan = chan;
+    fr->sys = f->sys;
+    fr->msg = msg;
+    fr->rsp = *rsp;
+    fr->rsp.data = fr->data;
+    memcpy(fr->data, rsp->data, rsp->data_len);
+    fr->dup = dup;
+    if (f->sys->alloc_timer(f->sys, chan_fault_timeout, fr, &fr->timer)) {
+	free(fr);
+	return 0;
+    }
+
+    tv.tv_sec = delay / 1000;
+    tv.tv_usec = (delay % 1000) * 1000;
+    f->sys->start_timer(fr->timer, &tv);
+    return 1;
+}
+
+static int
+chan_fault_get_uint(const char *val, unsigned int *rv)
+{
+    char *end;
+
+    *rv = strtoul(val, &end, 0);
+    return (*val == '\0') || (*end != '\0');
+}
+
+static int
+chan_fault_get_percent(const char *val, double *rv)
+{
+    char *end;
+
+    *rv = strtod(val, &end);
+    return ((*val == '\0') || (*end != '\0') || (*rv < 0) || (*rv > 100));
+}
+
+int
+chan_fault_config(sys_data_t *sys, channel_t *chan, char **toks,
+		  const char **errstr)
+{
+    chan_fault_t *f;
+    const char   *tok;
+    const char   *val;
+    int          err = 0;
+
+    tok = mystrtok(NULL, " \t\n", toks);
+    if (!tok) {
+	*errstr = "No fault injection settings given";
+	return EINVAL;
+    }
+
+    if (strcmp(tok, "off") == 0) {
+	/* Responses already held keep their own copy of what they need. */
+	if (chan->fault) {
+	    free(chan->fault);
+	    chan->fault = NULL;
+	}
+	return 0;
+    }
+
+    f = malloc(sizeof(*f));
+    if (!f) {
+	*errstr = "Out of memory";
+	return ENOMEM;
+    }
+    memset(f, 0, sizeof(*f));
+    f->sys = sys;
+    f->reorder_delay = 100;
+    f->seed = chan->channel_num;
+
+    while (tok) {
+	val = strchr(tok, '=');
+	if (!val) {
+	    *errstr = "Fault injection settings must be name=value";
+	    goto out_err;
+	}
+	val++;
+
+	if (strncmp(tok, "delay=", 6) == 0)
+	    err = chan_fault_get_uint(val, &f->delay);
+	else if (strncmp(tok, "jitter=", 7) == 0)
+	    err = chan_fault_get_uint(val, &f->jitter);
+	else if (strncmp(tok, "jitter_dist=", 12) == 0) {
+	    if (strcmp(val, "exp") == 0)
+		f->exp_jitter = 1;
+	    else if (strcmp(val, "uniform") == 0)
+		f->exp_jitter = 0;
+	    else
+		err = 1;
+	} else if (strncmp(tok, "loss=", 5) == 0)
+	    err = chan_fault_get_percent(val, &f->loss);
+	else if (strncmp(tok, "dup=", 4) == 0)
+	    err = chan_fault_get_percent(val, &f->dup);
+	else if (strncmp(tok, "reorder=", 8) == 0)
+	    err = chan_fault_get_percent(val, &f->reorder);
+	else if (strncmp(tok, "reorder_delay=", 14) == 0)
+	    err = chan_fault_get_uint(val, &f->reorder_delay);
+	else if (strncmp(tok, "seed=", 5) == 0)
+	    err = chan_fault_get_uint(val, &f->seed);
+	else {
+	    *errstr = "Invalid fault injection setting";
+	    goto out_err;
+	}
+	if (err) {
+	    *errstr = "Invalid fault injection value";
+	    goto out_err;
+	}
+
+	tok = mystrtok(NULL, " \t\n", toks);
+    }
+
+    if (chan->fault)
+	free(chan->fault);
+    chan->fault = f;
+    return 0;
+
+  out_err:
+    free(f);
+    return EINVAL;
+}
+
 void
 ipmi_handle_smi_rsp(channel_t *chan, msg_t *msg, uint8_t *rspd, int rsp_len)
 {
@@ -116,6 +328,9 @@ ipmi_handle_smi_rsp(channel_t *chan, msg_t *msg, uint8_t *rspd, int rsp_len)
 	/* OEM code handled the response. */
 	return;
 
+    if (chan->fault && chan_fault_rsp(chan, msg, &rsp))
+	return;
+
     chan->return_rsp(chan, msg, &rsp);
     chan->free(chan, msg);
 }
@@ -299,10 +514,7 @@ void ipmi_set_uint32(uint8_t *data, int val)
 uint8_t
 ipmb_checksum(uint8_t *data, int size, uint8_t start)
 {
-	uint8_t csum = start;
-	
-	for (; size > 0; size--, data++)
-		csum += *data;
-
-	return csum;
+	if (size <= 0)
+		return start;
+	return ipmi_checksum(data, size, start);
 }
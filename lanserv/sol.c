@@ -57,6 +57,7 @@
 
 #define SOL_INBUF_SIZE 32
 #define SOL_OUTBUF_SIZE 16384
+#define MAX_HISTORY_SEND 64
 
 #define SOL_TELNET_IAC		255
 #define SOL_TELNET_DONT		254
@@ -99,12 +100,15 @@ struct soldata_s {
 
     /*
      * A circular history buffer.  Note that history_end points to the
-     * last byte (not one past the last byte) and history_start points
-     * to the first byte.
+     * last byte (not one past the last byte).  history_total counts
+     * all the bytes ever added, and history data is found by its
+     * offset in that count, see history_ptr().  history_cleared is
+     * the count when the history was last read with readclear.
      */
     unsigned char *history;
-    int history_start;
     int history_end;
+    uint64_t history_total;
+    uint64_t history_cleared;
 
     /*
      * Used to register history file handler on a shutdown.
@@ -118,10 +122,16 @@ struct soldata_s {
      */
     unsigned int history_return_size;
 
-    /* A copy of the history, used for reliable streaming. */
-    unsigned char *history_copy;
-    unsigned int history_copy_size;
-    unsigned int history_pos;
+    /*
+     * The history being streamed, as offsets in history_total,
+     * followed by the end message.  It is read out of the ring a
+     * packet at a time; the current packet is kept for resends.
+     */
+    uint64_t history_next;
+    uint64_t history_stop;
+    unsigned int history_endmsg_pos;
+    unsigned char history_pkt[MAX_HISTORY_SEND];
+    unsigned int history_pkt_len;
     msg_t history_dummy_send_msg;
     channel_t *history_channel;
     int history_last_acked_packet;
@@ -625,10 +635,10 @@ sol_tcp_setup(ipmi_sol_t *sol)
 
 static char *end_history_msg = "\r\n<End Of History>\r\n";
 
-#define MAX_HISTORY_SEND 64
 #define MAX_SOL_RESENDS 4
 static void sol_timeout(void *cb_data);
 static void sol_history_timeout(void *cb_data);
+static void sol_history_fill_packet(ipmi_sol_t *sol);
 static void sol_data_ready(int fd, void *cb_data);
 static void sol_write_ready(int fd, void *cb_data);
 
@@ -705,63 +715,80 @@ sol_session_closed(lmc_data_t *mc, uint32_t session_id, void *cb_data)
 			   sol->soldata->history_dummy_send_msg.src_addr);
 	    sol->soldata->history_dummy_send_msg.src_addr = NULL;
 	}
-	if (sol->soldata->history_copy) {
-	    sd->sys->free(sd->sys, sol->soldata->history_copy);
-	    sol->soldata->history_copy = NULL;
-	}
+	sd->history_pkt_len = 0;
 	sol->history_active = 0;
 	sol->history_session_id = 0;
     }
 }
 
+/*
+ * Find the history byte at offset "off" in history_total.  Returns
+ * how many bytes, at most "len", can be read there in one piece, or 0
+ * if the byte is no longer in the ring.
+ */
+static unsigned int
+history_ptr(ipmi_sol_t *sol, uint64_t off, unsigned int len,
+	    unsigned char **data)
+{
+    soldata_t *sd = sol->soldata;
+    uint64_t back = sd->history_total - off;
+    int pos;
+
+    if (back == 0 || back > sol->history_size)
+	return 0;
+
+    pos = sd->history_end + 1 - (int) back;
+    if (pos < 0)
+	pos += sol->history_size;
+    if (len > back)
+	len = back;
+    if (len > sol->history_size - pos)
+	len = sol->history_size - pos;
+    *data = sd->history + pos;
+    return len;
+}
+
+/*
+ * The offset of the oldest history byte to return.  The history
+ * return size only limits what is sent to the user.
+ */
+static uint64_t
+history_first(ipmi_sol_t *sol, int use_return_size)
+{
+    soldata_t *sd = sol->soldata;
+    uint64_t first = sd->history_cleared;
+
+    if (sd->history_total - first > sol->history_size)
+	first = sd->history_total - sol->history_size;
+    if (use_return_size && sd->history_return_size
+	&& (sd->history_total - first > sd->history_return_size))
+	first = sd->history_total - sd->history_return_size;
+    return first;
+}
+
 static unsigned char *
 copy_history_buffer(ipmi_sol_t *sol, unsigned int *rsize)
 {
     soldata_t *sd = sol->soldata;
-    unsigned int to_copy;
     unsigned int endmsg_size = strlen(end_history_msg);
-    unsigned char *dest = sd->sys->alloc(sd->sys,
-					 sol->history_size + endmsg_size);
-    unsigned int size;
-    int start;
+    uint64_t off = history_first(sol, 1);
+    unsigned int size = sd->history_total - off;
+    unsigned int pos, len;
+    unsigned char *dest, *data;
 
+    dest = sd->sys->alloc(sd->sys, size + endmsg_size);
     if (!dest)
 	return NULL;
 
-    if (sd->history_start > sd->history_end)
-	/* Buffer is filled. */
-	size = sol->history_size;
-    else if (sd->history_start == sd->history_end)
-	size = 0; /* Nothing written yet. */
-    else
-	/* Buffer is not yet filled, just runs from start to end */
-	size = sd->history_end - sd->history_start + 1;
-
-    start = sd->history_start;
-    if (sd->history_return_size && (size > sd->history_return_size)) {
-	start += size - sd->history_return_size;
-	if (start >= (int) sol->history_size)
-	    start -= sol->history_size;
-	size = sd->history_return_size;
-    }
-
-    if (start > sd->history_end) {
-	/* Buffer spans end, copy in two chunks. */
-	to_copy = sol->history_size - start;
-	memcpy(dest + to_copy, sd->history, sd->history_end + 1);
-    } else {
-	/* Buffer is not yet filled, just runs from start to end */
-	to_copy = sd->history_end - start + 1;
+    for (pos = 0; pos < size; pos += len) {
+	len = history_ptr(sol, off + pos, size - pos, &data);
+	memcpy(dest + pos, data, len);
     }
-    memcpy(dest, sd->history + start, to_copy);
     memcpy(dest + size, end_history_msg, endmsg_size);
-    size += endmsg_size;
-    *rsize = size;
+    *rsize = size + endmsg_size;
 
-    if (sol->readclear) {
-	sd->history_start = 0;
-	sd->history_end = -1;
-    }
+    if (sol->readclear)
+	sd->history_cleared = sd->history_total;
 
     return dest;
 }
@@ -876,13 +903,13 @@ ipmi_sol_activate(lmc_data_t    *mc,
     } else if (instance == 2 && sol->history_size) {
 	struct timeval tv;
 
-	sd->history_copy = copy_history_buffer(sol, &sd->history_copy_size);
-	if (!sd->history_copy) {
-	    rdata[0] = IPMI_OUT_OF_SPACE_CC;
-	    *rdata_len = 1;
-	    return;
-	}
-	sd->history_pos = 0;
+	/* Send what is in the history now, it is read as it goes. */
+	sd->history_next = history_first(sol, 1);
+	sd->history_stop = sd->history_total;
+	sd->history_endmsg_pos = 0;
+	if (sol->readclear)
+	    sd->history_cleared = sd->history_total;
+	sol_history_fill_packet(sol);
 	sol->history_active = 1;
 	sol->history_session_id = msg->sid;
 	sd->history_channel = channel;
@@ -1227,13 +1254,9 @@ send_history_data(ipmi_sol_t *sol, int need_send_ack)
     soldata_t *sd = sol->soldata;
     rsp_msg_t msg;
     unsigned char data[MAX_HISTORY_SEND + 4];
-    int to_send;
 
-    to_send = sd->history_copy_size - sd->history_pos;
-    if (to_send <= 0)
+    if (!sd->history_pkt_len)
 	return need_send_ack;
-    if (to_send > MAX_HISTORY_SEND)
-	to_send = MAX_HISTORY_SEND;
 
     data[0] = sd->history_curr_packet_seq;
     if (need_send_ack) {
@@ -1245,9 +1268,9 @@ send_history_data(ipmi_sol_t *sol, int need_send_ack)
     }
     data[3] = 1 << 6; /* Always ready to get data, we just throw it away */
 
-    memcpy(data + 4, sd->history_copy + sd->history_pos, to_send);
+    memcpy(data + 4, sd->history_pkt, sd->history_pkt_len);
     msg.data = data;
-    msg.data_len = to_send + 4;
+    msg.data_len = sd->history_pkt_len + 4;
 
     sd->history_channel->return_rsp(sd->history_channel,
 				    &sd->history_dummy_send_msg, &msg);
@@ -1272,11 +1295,53 @@ send_history_ack(ipmi_sol_t *sol)
 				    &sd->history_dummy_send_msg, &msg);
 }
 
+/*
+ * Read the next packet of history out of the ring.  If the viewer is
+ * slow enough that the ring has wrapped over the data, skip to the
+ * oldest data still there.
+ */
 static void
-sol_history_next_packet(soldata_t *sd)
+sol_history_fill_packet(ipmi_sol_t *sol)
 {
+    soldata_t *sd = sol->soldata;
+    unsigned int endmsg_size = strlen(end_history_msg);
+    unsigned int len = 0, n;
+    unsigned char *data;
+
+    while (len < MAX_HISTORY_SEND && sd->history_next < sd->history_stop) {
+	n = MAX_HISTORY_SEND - len;
+	if (sd->history_stop - sd->history_next < n)
+	    n = sd->history_stop - sd->history_next;
+	n = history_ptr(sol, sd->history_next, n, &data);
+	if (!n) {
+	    sd->history_next = sd->history_total - sol->history_size;
+	    continue;
+	}
+	memcpy(sd->history_pkt + len, data, n);
+	len += n;
+	sd->history_next += n;
+    }
+
+    if (len < MAX_HISTORY_SEND && sd->history_endmsg_pos < endmsg_size) {
+	n = MAX_HISTORY_SEND - len;
+	if (endmsg_size - sd->history_endmsg_pos < n)
+	    n = endmsg_size - sd->history_endmsg_pos;
+	memcpy(sd->history_pkt + len, end_history_msg + sd->history_endmsg_pos,
+	       n);
+	len += n;
+	sd->history_endmsg_pos += n;
+    }
+
+    sd->history_pkt_len = len;
+}
+
+static void
+sol_history_next_packet(ipmi_sol_t *sol)
+{
+    soldata_t *sd = sol->soldata;
+
     /* Only send one size for history, no need to check msg's count */
-    sd->history_pos += MAX_HISTORY_SEND;
+    sol_history_fill_packet(sol);
     sd->history_curr_packet_seq++;
     if (sd->history_curr_packet_seq >= 16)
 	sd->history_curr_packet_seq = 1;
@@ -1291,9 +1356,9 @@ sol_history_timeout(void *cb_data)
     struct timeval tv;
 
     if (sd->history_num_sends > MAX_SOL_RESENDS)
-	sol_history_next_packet(sd);
+	sol_history_next_packet(sol);
 
-    if (sd->history_pos >= sd->history_copy_size)
+    if (!sd->history_pkt_len)
 	return;
 
     sd->history_num_sends++;
@@ -1336,7 +1401,7 @@ handle_sol_history_payload(lanserv_data_t *lan, ipmi_sol_t *sol, msg_t *msg)
 	    sd->history_in_nack = 1;
 	} else {
 	    sd->history_in_nack = 0;
-	    sol_history_next_packet(sd);
+	    sol_history_next_packet(sol);
 	    need_send_ack = send_history_data(sol, need_send_ack);
 	}
 	sd->sys->stop_timer(sd->history_timer);
@@ -1415,6 +1480,8 @@ add_to_history(ipmi_sol_t *sol, unsigned char *buf, unsigned int len)
     if (!sd->history || len == 0)
 	return;
 
+    sd->history_total += len;
+
     /*
      * No point in handling more data than we can take, only take the
      * last history size section.
@@ -1438,22 +1505,6 @@ add_to_history(ipmi_sol_t *sol, unsigned char *buf, unsigned int len)
      * and the end of the buffer.
      */
     memcpy(sd->history + sd->history_end + 1, buf, len);
-    if (sd->history_start > sd->history_end) {
-	/*
-	 * Before we completely fill the buffer, history_start will
-	 * always be <= history_end.  After we fill the buffer,
-	 * history_end will always be < history_start.
-	 */
-	sd->history_start += len;
-	if (sd->history_start >= (int) sol->history_size)
-	    sd->history_start -= sol->history_size;
-    } else if (sd->history_start == sd->history_end) {
-	/*
-	 * First write to the buffer, it starts with start == end == 0,
-	 * so we need to fix things up on the first write.
-	 */
-	sd->history_start++;
-    }
     sd->history_end += len;
 }
 
@@ -1776,6 +1827,9 @@ handle_sol_shutdown(void *info, int sig)
     ipmi_sol_t *sol = info;
     soldata_t *sd = sol->soldata;
     FILE *f;
+    uint64_t off;
+    unsigned int len;
+    unsigned char *data;
 
     if (sol->configured < 2 || !sd)
 	return;
@@ -1783,24 +1837,23 @@ handle_sol_shutdown(void *info, int sig)
     sol->configured--;
     sd->shutdown(sol);
 
-    if (!sol->backupfile || (sd->history_start == sd->history_end))
+    if (!sol->backupfile || !sd->history)
+	return;
+
+    off = history_first(sol, 0);
+    if (off == sd->history_total)
 	return;
 
     /*
-     * Write the current history to the backup file.
+     * Write the current history to the backup file.  It laps over
+     * the end of the ring, so it may take two writes.
      */
     f = fopen(sol->backupfile, "w");
     if (!f)
 	return;
-    if (sd->history_end >= sd->history_start) {
-	/* History is fully contained between start and end. */
-	fwrite(sd->history + sd->history_start, 1,
-	       sd->history_end - sd->history_start + 1, f);
-    } else {
-	/* History laps over end, need two writes. */
-	fwrite(sd->history + sd->history_start, 1,
-	       sol->history_size - sd->history_start, f);
-	fwrite(sd->history, 1, sd->history_end + 1, f);
+    for (; off < sd->history_total; off += len) {
+	len = history_ptr(sol, off, sd->history_total - off, &data);
+	fwrite(data, 1, len, f);
     }
     fclose(f);
 }
@@ -1844,13 +1897,15 @@ sol_init_mc(sys_data_t *sys, lmc_data_t *mc)
 	    return ENOMEM;
 	}
 
+	sd->history_end = -1;
 	if (sol->backupfile) {
 	    FILE *f = fopen(sol->backupfile, "r");
 	    if (f) {
 		/* Ignore errors, it doesn't really matter. */
 		fseek(f, -sol->history_size, SEEK_END);
-		sd->history_end = fread(sd->history, 1, sol->history_size, f);
-		sd->history_end--; /* end point to last, not one after. */
+		sd->history_total = fread(sd->history, 1, sol->history_size, f);
+		/* end point to last, not one after. */
+		sd->history_end = sd->history_total - 1;
 		fclose(f);
 	    }
 	}
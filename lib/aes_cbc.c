@@ -40,37 +40,83 @@
 #include <openssl/evp.h>
 #include <OpenIPMI/ipmi_lan.h>
 #include <OpenIPMI/internal/ipmi_malloc.h>
+#include <OpenIPMI/internal/ipmi_locks.h>
 
+/*
+ * The key schedule is set up once per session in a context for each
+ * direction, each packet just sets a new IV.  The contexts are used
+ * by any thread sending or receiving, so each has a lock.
+ */
 typedef struct aes_cbc_info_s
 {
-    unsigned char k2[16];
+    EVP_CIPHER_CTX *ectx;
+    EVP_CIPHER_CTX *dctx;
+    ipmi_lock_t    *elock;
+    ipmi_lock_t    *dlock;
 } aes_cbc_info_t;
 
+static void
+aes_cbc_info_free(aes_cbc_info_t *info)
+{
+    if (info->ectx)
+	EVP_CIPHER_CTX_free(info->ectx);
+    if (info->dctx)
+	EVP_CIPHER_CTX_free(info->dctx);
+    if (info->elock)
+	ipmi_destroy_lock(info->elock);
+    if (info->dlock)
+	ipmi_destroy_lock(info->dlock);
+    ipmi_mem_free(info);
+}
+
 static int
 aes_cbc_init(ipmi_con_t *ipmi, ipmi_rmcpp_auth_t *ainfo, void **conf_data)
 {
-    aes_cbc_info_t *info;
-    unsigned int   k2len;
+    aes_cbc_info_t      *info;
+    const unsigned char *k2;
+    unsigned int        k2len;
+    int                 rv;
+
+    if (ipmi_rmcpp_auth_get_k2_len(ainfo) < 16)
+	return EINVAL;
+    k2 = ipmi_rmcpp_auth_get_k2(ainfo, &k2len);
 
     info = ipmi_mem_alloc(sizeof(*info));
     if (!info)
 	return ENOMEM;
+    memset(info, 0, sizeof(*info));
+
+    rv = ipmi_create_lock_os_hnd(ipmi->os_hnd, &info->elock);
+    if (rv)
+	goto out_err;
+    rv = ipmi_create_lock_os_hnd(ipmi->os_hnd, &info->dlock);
+    if (rv)
+	goto out_err;
+
+    rv = ENOMEM;
+    info->ectx = EVP_CIPHER_CTX_new();
+    info->dctx = EVP_CIPHER_CTX_new();
+    if (!info->ectx || !info->dctx)
+	goto out_err;
+    if (!EVP_EncryptInit_ex(info->ectx, EVP_aes_128_cbc(), NULL, k2, NULL))
+	goto out_err;
+    if (!EVP_DecryptInit_ex(info->dctx, EVP_aes_128_cbc(), NULL, k2, NULL))
+	goto out_err;
+    EVP_CIPHER_CTX_set_padding(info->ectx, 0);
+    EVP_CIPHER_CTX_set_padding(info->dctx, 0);
 
-    if (ipmi_rmcpp_auth_get_k2_len(ainfo) < 16)
-	return EINVAL;
-    
-    memcpy(info->k2, ipmi_rmcpp_auth_get_k2(ainfo, &k2len), 16);
     *conf_data = info;
     return 0;
+
+ out_err:
+    aes_cbc_info_free(info);
+    return rv;
 }
 
 static void
 aes_cbc_free(ipmi_con_t *ipmi, void *conf_data)
 {
-    aes_cbc_info_t *info = conf_data;
-
-    memset(info->k2, 0, 16);
-    ipmi_mem_free(info);
+    aes_cbc_info_free(conf_data);
 }
 
 static int
@@ -85,11 +131,9 @@ aes_cbc_encrypt(ipmi_con_t    *ipmi,
     unsigned char  *iv;
     unsigned int   l = *payload_len;
     unsigned int   i;
-    unsigned char  *d;
-    EVP_CIPHER_CTX ctx;
-    int            rv;
+    unsigned char  *d = *payload;
+    int            rv = 0;
     int            outlen;
-    int            tmplen;
     unsigned char  *padpos;
     unsigned char  padval;
     unsigned int   padlen;
@@ -108,15 +152,8 @@ aes_cbc_encrypt(ipmi_con_t    *ipmi,
     if (l > *max_payload_len)
 	return E2BIG;
 
-    /* We store the unencrypted data here, then crypt into the real
-       data. */
-    d = ipmi_mem_alloc(l);
-    if (!d)
-	return ENOMEM;
-
-    memcpy(d, *payload, *payload_len);
-
-    /* Now add the padding. */
+    /* Now add the padding, right after the data.  We encrypt in
+       place, CBC handles that fine. */
     padpos = d + *payload_len;
     padval = 1;
     for (i=0; i<padlen; i++, padpos++, padval++)
@@ -126,38 +163,27 @@ aes_cbc_encrypt(ipmi_con_t    *ipmi,
     /* Now create the initialization vector, including making room for it. */
     iv = (*payload)-16;
     rv = ipmi->os_hnd->get_random(ipmi->os_hnd, iv, 16);
-    if (rv) {
-	ipmi_mem_free(d);
+    if (rv)
 	return rv;
-    }
     *header_len -= 16;
     *max_payload_len += 16;
 
-    /* Ok, we're set to do the crypt operation. */
-    EVP_CIPHER_CTX_init(&ctx);
-    EVP_EncryptInit_ex(&ctx, EVP_aes_128_cbc(), NULL, info->k2, iv);
-    EVP_CIPHER_CTX_set_padding(&ctx, 0);
-    if (!EVP_EncryptUpdate(&ctx, *payload, &outlen, d, l)) {
-	rv = ENOMEM; /* right? */
-	goto out_cleanup;
-    }
-    if (!EVP_EncryptFinal_ex(&ctx, (*payload) + outlen, &tmplen)) {
+    /* Ok, we're set to do the crypt operation.  The key is already
+       set up, just set the IV.  We have already 16-byte aligned the
+       data and turned off padding, so EncryptFinal_ex is not
+       needed. */
+    ipmi_lock(info->elock);
+    if (!EVP_EncryptInit_ex(info->ectx, NULL, NULL, NULL, iv)
+	|| !EVP_EncryptUpdate(info->ectx, d, &outlen, d, l))
 	rv = ENOMEM; /* right? */
-	goto out_cleanup;
-    }
-    outlen += tmplen;
-
-    /* Don't call EncryptFinal_ex, it adds 16 bytes of useless data.
-       We have already 16-byte aligned the data, no need for it. */
+    ipmi_unlock(info->elock);
+    if (rv)
+	return rv;
 
     *payload = iv;
     *payload_len = outlen + 16;
 
- out_cleanup:
-    EVP_CIPHER_CTX_cleanup(&ctx);
-    ipmi_mem_free(d);
-
-    return rv;
+    return 0;
 }
 
 static int
@@ -168,9 +194,7 @@ aes_cbc_decrypt(ipmi_con_t    *ipmi,
 {
     aes_cbc_info_t *info = conf_data;
     unsigned int   l = *payload_len;
-    unsigned char  *d;
     unsigned char  *p;
-    EVP_CIPHER_CTX ctx;
     int            outlen;
     int            rv = 0;
     unsigned char  *pad;
@@ -184,44 +208,33 @@ aes_cbc_decrypt(ipmi_con_t    *ipmi,
 	return EINVAL;
 
     l -= 16;
-    /* We store the encrypted data here, then decrypt into the real
-       data. */
-    d = ipmi_mem_alloc(l);
-    if (!d)
-	return ENOMEM;
+    if (l % 16)
+	return EINVAL;
 
     p = (*payload)+16;
 
-    memcpy(d, p, l);
-
-    /* Ok, we're set to do the decrypt operation. */
-    EVP_CIPHER_CTX_init(&ctx);
-    EVP_DecryptInit_ex(&ctx, EVP_aes_128_cbc(), NULL, info->k2, *payload);
-    EVP_CIPHER_CTX_set_padding(&ctx, 0);
-    if (!EVP_DecryptUpdate(&ctx, p, &outlen, d, l)) {
+    /* Ok, we're set to do the decrypt operation, in place. */
+    ipmi_lock(info->dlock);
+    if (!EVP_DecryptInit_ex(info->dctx, NULL, NULL, NULL, *payload)
+	|| !EVP_DecryptUpdate(info->dctx, p, &outlen, p, l))
 	rv = EINVAL;
-	goto out_cleanup;
-    }
+    ipmi_unlock(info->dlock);
+    if (rv)
+	return rv;
 
-    if (outlen < 16) {
-	rv = EINVAL;
-	goto out_cleanup;
-    }
+    if (outlen < 16)
+	return EINVAL;
 
     /* Now remove the padding */
     pad = p + outlen - 1;
     padlen = *pad;
-    if (padlen >= 16) {
-	rv = EINVAL;
-	goto out_cleanup;
-    }
+    if (padlen >= 16)
+	return EINVAL;
     outlen--;
     pad--;
     while (padlen) {
-	if (*pad != padlen) {
-	    rv = EINVAL;
-	    goto out_cleanup;
-	}
+	if (*pad != padlen)
+	    return EINVAL;
 	outlen--;
 	pad--;
 	padlen--;
@@ -230,10 +243,7 @@ aes_cbc_decrypt(ipmi_con_t    *ipmi,
     *payload = p;
     *payload_len = outlen;
 
- out_cleanup:
-    EVP_CIPHER_CTX_cleanup(&ctx);
-    ipmi_mem_free(d);
-    return rv;
+    return 0;
 }
 
 static ipmi_rmcpp_confidentiality_t aes_conf =
@@ -0,0 +1,212 @@
+/*
+ * arena.c
+ *
+ * Chunked allocation for objects that live about as long as a domain
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_DOMAIN
+
+#include <errno.h>
+#include <string.h>
+
+#include <OpenIPMI/internal/ipmi_int.h>
+#include <OpenIPMI/internal/ipmi_locks.h>
+#include <OpenIPMI/internal/ipmi_arena.h>
+
+/* A chunk holds this much, objects bigger than an eighth of it are
+   allocated on their own so a chunk doesn't waste much at its end. */
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+#define ARENA_ALIGN		16
+
+typedef struct arena_chunk_s arena_chunk_t;
+
+/* Put in front of every object, chunk is NULL if the object was
+   allocated on its own. */
+typedef union arena_hdr_u
+{
+    arena_chunk_t *chunk;
+    char          align[ARENA_ALIGN];
+} arena_hdr_t;
+
+struct arena_chunk_s
+{
+    ipmi_arena_t  *arena;
+    arena_chunk_t *next, *prev;
+    unsigned int  used;
+    unsigned int  live;
+    arena_hdr_t   data[0];
+};
+
+struct ipmi_arena_s
+{
+    ipmi_lock_t   *lock;
+    arena_chunk_t *chunks;
+
+    /* Allocation comes from the front chunk. */
+    arena_chunk_t *cur;
+    int           released;
+};
+
+int
+ipmi_arena_alloc_arena(os_handler_t *os_hnd, ipmi_arena_t **arena)
+{
+    ipmi_arena_t *a;
+    int          rv;
+
+    a = ipmi_mem_alloc(sizeof(*a));
+    if (!a)
+	return ENOMEM;
+    memset(a, 0, sizeof(*a));
+    rv = ipmi_create_lock_os_hnd(os_hnd, &a->lock);
+    if (rv) {
+	ipmi_mem_free(a);
+	return rv;
+    }
+    *arena = a;
+    return 0;
+}
+
+static void
+arena_destroy(ipmi_arena_t *arena)
+{
+    ipmi_destroy_lock(arena->lock);
+    ipmi_mem_free(arena);
+}
+
+static void
+chunk_unlink(ipmi_arena_t *arena, arena_chunk_t *chunk)
+{
+    if (chunk->prev)
+	chunk->prev->next = chunk->next;
+    else
+	arena->chunks = chunk->next;
+    if (chunk->next)
+	chunk->next->prev = chunk->prev;
+    if (arena->cur == chunk)
+	arena->cur = NULL;
+    ipmi_mem_free(chunk);
+}
+
+void *
+ipmi_arena_alloc_type(ipmi_arena_t *arena, int size, unsigned int type)
+{
+    arena_chunk_t *chunk;
+    arena_hdr_t   *hdr;
+    unsigned int  len;
+
+    if (size < 0)
+	return NULL;
+    len = (sizeof(arena_hdr_t) + size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (!arena || DEBUG_MALLOC || (len > ARENA_CHUNK_SIZE / 8)) {
+	hdr = ipmi_mem_alloc_type(sizeof(arena_hdr_t) + size, type);
+	if (!hdr)
+	    return NULL;
+	hdr->chunk = NULL;
+	return hdr + 1;
+    }
+
+    ipmi_lock(arena->lock);
+    chunk = arena->cur;
+    if (!chunk || (chunk->used + len > ARENA_CHUNK_SIZE)) {
+	chunk = ipmi_mem_alloc(sizeof(*chunk) + ARENA_CHUNK_SIZE);
+	if (!chunk) {
+	    ipmi_unlock(arena->lock);
+	    return NULL;
+	}
+	chunk->arena = arena;
+	chunk->used = 0;
+	chunk->live = 0;
+	chunk->prev = NULL;
+	chunk->next = arena->chunks;
+	if (arena->chunks)
+	    arena->chunks->prev = chunk;
+	arena->chunks = chunk;
+	arena->cur = chunk;
+    }
+    hdr = (arena_hdr_t *) (((char *) chunk->data) + chunk->used);
+    chunk->used += len;
+    chunk->live++;
+    hdr->chunk = chunk;
+    ipmi_unlock(arena->lock);
+
+    return hdr + 1;
+}
+
+void
+ipmi_arena_free(void *data)
+{
+    arena_hdr_t   *hdr = ((arena_hdr_t *) data) - 1;
+    arena_chunk_t *chunk = hdr->chunk;
+    ipmi_arena_t  *arena;
+    int           destroy = 0;
+
+    if (!chunk) {
+	ipmi_mem_free(hdr);
+	return;
+    }
+
+    arena = chunk->arena;
+    ipmi_lock(arena->lock);
+    chunk->live--;
+    if (chunk->live == 0) {
+	if (chunk == arena->cur)
+	    /* Still allocating from it, just start over. */
+	    chunk->used = 0;
+	else
+	    chunk_unlink(arena, chunk);
+	destroy = arena->released && !arena->chunks;
+    }
+    ipmi_unlock(arena->lock);
+
+    if (destroy)
+	arena_destroy(arena);
+}
+
+void
+ipmi_arena_release(ipmi_arena_t *arena)
+{
+    arena_chunk_t *chunk, *next;
+    int           destroy;
+
+    ipmi_lock(arena->lock);
+    arena->released = 1;
+    arena->cur = NULL;
+    for (chunk = arena->chunks; chunk; chunk = next) {
+	next = chunk->next;
+	if (chunk->live == 0)
+	    chunk_unlink(arena, chunk);
+    }
+    destroy = !arena->chunks;
+    ipmi_unlock(arena->lock);
+
+    if (destroy)
+	arena_destroy(arena);
+}
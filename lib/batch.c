@@ -0,0 +1,510 @@
+/*
+ * batch.c
+ *
+ * Run a set of IPMI operations across a domain as one batch
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_mc.h>
+#include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_batch.h>
+
+#include <OpenIPMI/internal/ipmi_int.h>
+#include <OpenIPMI/internal/ipmi_domain.h>
+#include <OpenIPMI/internal/ipmi_mc.h>
+
+typedef struct batch_item_s batch_item_t;
+
+struct batch_item_s
+{
+    ipmi_batch_t *batch;
+    unsigned int idx;
+    unsigned int group;
+    int          set;
+    ipmi_mcid_t  mc_id;
+
+    /* For command items. */
+    int          is_cmd;
+    unsigned int lun;
+    ipmi_msg_t   msg;
+    unsigned int tries;
+    int          send_err;
+
+    /* On the group's resend list. */
+    batch_item_t *next;
+};
+
+/* The items on one MC, a range of the sorted items plus the ones
+   waiting to be resent. */
+typedef struct batch_group_s
+{
+    unsigned int next;
+    unsigned int end;
+    unsigned int outstanding;
+    unsigned int window;
+    batch_item_t *resend, *resend_tail;
+} batch_group_t;
+
+struct ipmi_batch_s
+{
+    ipmi_domain_id_t    domain_id;
+    ipmi_lock_t         *lock;
+
+    batch_item_t        *items;
+    unsigned int        count;
+
+    /* Items sorted by MC, each MC is a group. */
+    batch_item_t        **order;
+    batch_group_t       *groups;
+    unsigned int        num_groups;
+    unsigned int        next_group;
+
+    unsigned int        window;
+    unsigned int        retries;
+    unsigned int        outstanding;
+    unsigned int        done_count;
+    unsigned int        errs;
+    int                 issuing;
+
+    ipmi_batch_start_cb start;
+    ipmi_batch_item_cb  item_done;
+    ipmi_batch_done_cb  done;
+    void                *cb_data;
+};
+
+void
+ipmi_batch_free(ipmi_batch_t *batch)
+{
+    unsigned int i;
+
+    if (batch->items) {
+	for (i=0; i<batch->count; i++) {
+	    if (batch->items[i].msg.data)
+		ipmi_mem_free(batch->items[i].msg.data);
+	}
+	ipmi_mem_free(batch->items);
+    }
+    if (batch->order)
+	ipmi_mem_free(batch->order);
+    if (batch->groups)
+	ipmi_mem_free(batch->groups);
+    if (batch->lock)
+	ipmi_destroy_lock(batch->lock);
+    ipmi_mem_free(batch);
+}
+
+int
+ipmi_batch_alloc(ipmi_domain_t       *domain,
+		 unsigned int        count,
+		 ipmi_batch_start_cb start,
+		 ipmi_batch_item_cb  item_done,
+		 ipmi_batch_done_cb  done,
+		 void                *cb_data,
+		 ipmi_batch_t        **rbatch)
+{
+    ipmi_batch_t *batch;
+    unsigned int i;
+    int          rv;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (!done || (count == 0))
+	return EINVAL;
+
+    batch = ipmi_mem_alloc(sizeof(*batch));
+    if (!batch)
+	return ENOMEM;
+    memset(batch, 0, sizeof(*batch));
+
+    rv = ipmi_create_lock(domain, &batch->lock);
+    if (rv) {
+	batch->lock = NULL;
+	goto out_err;
+    }
+
+    rv = ENOMEM;
+    batch->items = ipmi_mem_alloc(sizeof(*batch->items) * count);
+    if (!batch->items)
+	goto out_err;
+    memset(batch->items, 0, sizeof(*batch->items) * count);
+    batch->count = count;
+    batch->order = ipmi_mem_alloc(sizeof(*batch->order) * count);
+    batch->groups = ipmi_mem_alloc(sizeof(*batch->groups) * count);
+    if (!batch->order || !batch->groups)
+	goto out_err;
+
+    for (i=0; i<count; i++) {
+	batch->items[i].batch = batch;
+	batch->items[i].idx = i;
+	batch->order[i] = &batch->items[i];
+    }
+
+    batch->domain_id = ipmi_domain_convert_to_id(domain);
+    batch->window = _ipmi_domain_max_outstanding(domain);
+    if (batch->window == 0)
+	batch->window = 1;
+    batch->start = start;
+    batch->item_done = item_done;
+    batch->done = done;
+    batch->cb_data = cb_data;
+
+    *rbatch = batch;
+    return 0;
+
+ out_err:
+    ipmi_batch_free(batch);
+    return rv;
+}
+
+int
+ipmi_batch_set_cmd(ipmi_batch_t     *batch,
+		   unsigned int     idx,
+		   ipmi_mcid_t      mc_id,
+		   unsigned int     lun,
+		   const ipmi_msg_t *msg)
+{
+    batch_item_t  *item;
+    unsigned char *data = NULL;
+
+    if ((idx >= batch->count) || (msg->data_len > IPMI_MAX_MSG_LENGTH))
+	return EINVAL;
+
+    if (msg->data_len) {
+	data = ipmi_mem_alloc(msg->data_len);
+	if (!data)
+	    return ENOMEM;
+	memcpy(data, msg->data, msg->data_len);
+    }
+
+    item = &batch->items[idx];
+    if (item->msg.data)
+	ipmi_mem_free(item->msg.data);
+    item->set = 1;
+    item->is_cmd = 1;
+    item->mc_id = mc_id;
+    item->lun = lun;
+    item->msg = *msg;
+    item->msg.data = data;
+    return 0;
+}
+
+int
+ipmi_batch_set_mc(ipmi_batch_t *batch,
+		  unsigned int idx,
+		  ipmi_mcid_t  mc_id)
+{
+    batch_item_t *item;
+
+    if ((idx >= batch->count) || !batch->start)
+	return EINVAL;
+
+    item = &batch->items[idx];
+    if (item->msg.data) {
+	ipmi_mem_free(item->msg.data);
+	item->msg.data = NULL;
+    }
+    item->set = 1;
+    item->is_cmd = 0;
+    item->mc_id = mc_id;
+    return 0;
+}
+
+void
+ipmi_batch_set_window(ipmi_batch_t *batch, unsigned int window)
+{
+    if (window)
+	batch->window = window;
+}
+
+void
+ipmi_batch_set_retries(ipmi_batch_t *batch, unsigned int retries)
+{
+    batch->retries = retries;
+}
+
+unsigned int
+ipmi_batch_get_count(ipmi_batch_t *batch)
+{
+    return batch->count;
+}
+
+void *
+ipmi_batch_get_cb_data(ipmi_batch_t *batch)
+{
+    return batch->cb_data;
+}
+
+static void
+batch_done_cb(ipmi_domain_t *domain, void *cb_data)
+{
+    ipmi_batch_t *batch = cb_data;
+
+    batch->done(domain, batch, batch->errs, batch->cb_data);
+}
+
+static void
+batch_finish(ipmi_batch_t *batch)
+{
+    int rv;
+
+    rv = ipmi_domain_pointer_cb(batch->domain_id, batch_done_cb, batch);
+    if (rv)
+	/* The domain went away, still report the results. */
+	batch->done(NULL, batch, batch->errs, batch->cb_data);
+    ipmi_batch_free(batch);
+}
+
+static void batch_issue(ipmi_batch_t *batch);
+static void batch_item_finished(batch_item_t *item,
+				int          err,
+				ipmi_msg_t   *rsp);
+
+static void
+batch_cmd_rsp(ipmi_mc_t *mc, ipmi_msg_t *rsp, void *cb_data)
+{
+    batch_item_t  *item = cb_data;
+    ipmi_batch_t  *batch = item->batch;
+    batch_group_t *group = &batch->groups[item->group];
+
+    if ((rsp->data_len > 0)
+	&& ((rsp->data[0] == IPMI_TIMEOUT_CC)
+	    || (rsp->data[0] == IPMI_NODE_BUSY_CC))
+	&& (item->tries < batch->retries))
+    {
+	/* Put it back on its MC to go out again. */
+	item->tries++;
+	ipmi_lock(batch->lock);
+	group->outstanding--;
+	batch->outstanding--;
+	item->next = NULL;
+	if (group->resend_tail)
+	    group->resend_tail->next = item;
+	else
+	    group->resend = item;
+	group->resend_tail = item;
+	batch_issue(batch);
+	return;
+    }
+
+    batch_item_finished(item, 0, rsp);
+}
+
+static void
+batch_send_cmd(ipmi_mc_t *mc, void *cb_data)
+{
+    batch_item_t *item = cb_data;
+
+    item->send_err = ipmi_mc_send_command(mc, item->lun, &item->msg,
+					  batch_cmd_rsp, item);
+}
+
+static int
+batch_item_start(batch_item_t *item)
+{
+    ipmi_batch_t *batch = item->batch;
+    int          rv;
+
+    if (!item->set)
+	return EINVAL;
+
+    if (!item->is_cmd)
+	return batch->start(batch, item->idx, batch->cb_data);
+
+    item->send_err = 0;
+    rv = ipmi_mc_pointer_cb(item->mc_id, batch_send_cmd, item);
+    if (!rv)
+	rv = item->send_err;
+    return rv;
+}
+
+/* Start as many items as the windows allow, going around the MCs so
+   no MC waits on another.  Must be called with the batch lock held,
+   it releases it. */
+static void
+batch_issue(ipmi_batch_t *batch)
+{
+    batch_group_t *group;
+    batch_item_t  *item;
+    unsigned int  tries;
+    int           rv;
+
+    if (batch->issuing) {
+	/* Whoever is issuing will see the change. */
+	ipmi_unlock(batch->lock);
+	return;
+    }
+    batch->issuing = 1;
+
+    while (batch->outstanding < batch->window) {
+	group = NULL;
+	for (tries=0; tries<batch->num_groups; tries++) {
+	    batch_group_t *g = &batch->groups[batch->next_group];
+
+	    batch->next_group = (batch->next_group + 1) % batch->num_groups;
+	    if ((g->resend || (g->next < g->end))
+		&& (g->outstanding < g->window))
+	    {
+		group = g;
+		break;
+	    }
+	}
+	if (!group)
+	    break;
+
+	if (group->resend) {
+	    item = group->resend;
+	    group->resend = item->next;
+	    if (!group->resend)
+		group->resend_tail = NULL;
+	} else {
+	    item = batch->order[group->next];
+	    group->next++;
+	}
+	group->outstanding++;
+	batch->outstanding++;
+
+	/* The item may finish before the call returns. */
+	ipmi_unlock(batch->lock);
+	rv = batch_item_start(item);
+	ipmi_lock(batch->lock);
+	if ((rv == EAGAIN) && (batch->outstanding > 1)) {
+	    /* The domain is at its command limit.  Put the item back
+	       at the front of its MC and let the next completion
+	       pick things up again. */
+	    group->outstanding--;
+	    batch->outstanding--;
+	    item->next = group->resend;
+	    group->resend = item;
+	    if (!group->resend_tail)
+		group->resend_tail = item;
+	    break;
+	}
+	if (rv) {
+	    ipmi_unlock(batch->lock);
+	    batch_item_finished(item, rv, NULL);
+	    ipmi_lock(batch->lock);
+	}
+    }
+
+    batch->issuing = 0;
+    if (batch->done_count == batch->count) {
+	ipmi_unlock(batch->lock);
+	batch_finish(batch);
+	return;
+    }
+    ipmi_unlock(batch->lock);
+}
+
+static void
+batch_item_finished(batch_item_t *item, int err, ipmi_msg_t *rsp)
+{
+    ipmi_batch_t *batch = item->batch;
+
+    if (batch->item_done)
+	batch->item_done(batch, item->idx, err, rsp, batch->cb_data);
+
+    ipmi_lock(batch->lock);
+    if (err || (rsp && ((rsp->data_len < 1) || (rsp->data[0] != 0))))
+	batch->errs++;
+    batch->groups[item->group].outstanding--;
+    batch->outstanding--;
+    batch->done_count++;
+    batch_issue(batch);
+}
+
+void
+ipmi_batch_item_done(ipmi_batch_t *batch, unsigned int idx, int err)
+{
+    if (idx >= batch->count)
+	return;
+    batch_item_finished(&batch->items[idx], err, NULL);
+}
+
+static int
+batch_item_cmp(const void *a, const void *b)
+{
+    const batch_item_t *i1 = *((batch_item_t * const *) a);
+    const batch_item_t *i2 = *((batch_item_t * const *) b);
+    int                rv;
+
+    rv = ipmi_cmp_mc_id_noseq(i1->mc_id, i2->mc_id);
+    if (rv)
+	return rv;
+    /* Keep the caller's order within an MC. */
+    if (i1->idx < i2->idx)
+	return -1;
+    if (i1->idx > i2->idx)
+	return 1;
+    return 0;
+}
+
+static void
+batch_mc_window(ipmi_mc_t *mc, void *cb_data)
+{
+    unsigned int *window = cb_data;
+
+    *window = _ipmi_mc_op_concurrency(mc);
+}
+
+void
+ipmi_batch_start(ipmi_batch_t *batch)
+{
+    batch_group_t *group = NULL;
+    unsigned int  i;
+
+    qsort(batch->order, batch->count, sizeof(*batch->order), batch_item_cmp);
+
+    for (i=0; i<batch->count; i++) {
+	batch_item_t *item = batch->order[i];
+
+	if ((i == 0)
+	    || ipmi_cmp_mc_id_noseq(batch->order[i-1]->mc_id, item->mc_id))
+	{
+	    group = &batch->groups[batch->num_groups];
+	    batch->num_groups++;
+	    memset(group, 0, sizeof(*group));
+	    group->next = i;
+	    /* If the MC is not there, the items will fail anyway. */
+	    group->window = 1;
+	    ipmi_mc_pointer_cb(item->mc_id, batch_mc_window, &group->window);
+	    if (group->window == 0)
+		group->window = 1;
+	}
+	group->end = i + 1;
+	item->group = batch->num_groups - 1;
+    }
+
+    ipmi_lock(batch->lock);
+    batch_issue(batch);
+}
@@ -0,0 +1,428 @@
+/*
+ * bench_rmcpp.c
+ *
+ * Microbenchmark for the LAN packet encode and decode paths.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * This pulls in ipmi_lan.c directly (like utils/test_md5.c does with
+ * md5.c) so it can get at the static formatting and receive code.  It
+ * sets up a fake session for each IPMI 1.5 authtype and RMCP+ cipher
+ * suite, then formats an IPMI request with lan15_format_msg() or
+ * rmcpp_format_msg() and feeds the result back through
+ * handle_lan15_recv() or handle_rmcpp_recv().  The integrity and
+ * confidentiality keys are the same in both directions, so the packet
+ * goes all the way through the checks to handle_payload(), which
+ * drops it since no command is outstanding.  No sockets are used.
+ *
+ * It must be linked with the static libOpenIPMI, so the copy of
+ * ipmi_lan.c here is the only one; "make bench_rmcpp" does that.
+ */
+
+/* This must come first, it sets up the feature macros. */
+#include "ipmi_lan.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <OpenIPMI/ipmi_posix.h>
+
+#define BENCH_SESSION_ID 0x12345678
+#define BENCH_BATCH      16
+
+typedef struct bench_suite_s
+{
+    const char   *name;
+    unsigned int authtype;	/* IPMI 1.5 authtype or IPMI_AUTHTYPE_RMCP_PLUS */
+    unsigned int key_len;	/* SIK/K1/K2 length from the RAKP algorithm */
+    unsigned int integ;
+    unsigned int conf;
+} bench_suite_t;
+
+static bench_suite_t suites[] =
+{
+    { "lan15 none",		IPMI_AUTHTYPE_NONE, 0, 0, 0 },
+    { "lan15 straight",		IPMI_AUTHTYPE_STRAIGHT, 0, 0, 0 },
+    { "lan15 md2",		IPMI_AUTHTYPE_MD2, 0, 0, 0 },
+    { "lan15 md5",		IPMI_AUTHTYPE_MD5, 0, 0, 0 },
+    { "rmcp+ none/none",	IPMI_AUTHTYPE_RMCP_PLUS, 20,
+      IPMI_LANP_INTEGRITY_ALGORITHM_NONE,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE },
+    { "rmcp+ hmac_sha1/none",	IPMI_AUTHTYPE_RMCP_PLUS, 20,
+      IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA1_96,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE },
+    { "rmcp+ hmac_sha1/aes",	IPMI_AUTHTYPE_RMCP_PLUS, 20,
+      IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA1_96,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_AES_CBC_128 },
+    { "rmcp+ hmac_md5/none",	IPMI_AUTHTYPE_RMCP_PLUS, 16,
+      IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_MD5_128,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE },
+    { "rmcp+ hmac_md5/aes",	IPMI_AUTHTYPE_RMCP_PLUS, 16,
+      IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_MD5_128,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_AES_CBC_128 },
+    { "rmcp+ md5/none",		IPMI_AUTHTYPE_RMCP_PLUS, 16,
+      IPMI_LANP_INTEGRITY_ALGORITHM_MD5_128,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE },
+    { "rmcp+ md5/aes",		IPMI_AUTHTYPE_RMCP_PLUS, 16,
+      IPMI_LANP_INTEGRITY_ALGORITHM_MD5_128,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_AES_CBC_128 },
+    { "rmcp+ hmac_sha256/none",	IPMI_AUTHTYPE_RMCP_PLUS, 32,
+      IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE },
+    { "rmcp+ hmac_sha256/aes",	IPMI_AUTHTYPE_RMCP_PLUS, 32,
+      IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128,
+      IPMI_LANP_CONFIDENTIALITY_ALGORITHM_AES_CBC_128 },
+    { NULL }
+};
+
+static os_handler_t *os_hnd;
+
+static void
+bench_free(ipmi_con_t *ipmi)
+{
+    lan_data_t *lan = ipmi->con_data;
+
+    if (lan->ip[0].conf_info && lan->ip[0].conf_data)
+	lan->ip[0].conf_info->conf_free(ipmi, lan->ip[0].conf_data);
+    if (lan->ip[0].integ_info && lan->ip[0].integ_data)
+	lan->ip[0].integ_info->integ_free(ipmi, lan->ip[0].integ_data);
+    if (lan->authdata)
+	ipmi_auths[lan->ip[0].working_authtype].authcode_cleanup
+	    (lan->authdata);
+    if (lan->lan_stat_list)
+	locked_list_destroy(lan->lan_stat_list);
+    if (lan->seq_num_lock)
+	ipmi_destroy_lock(lan->seq_num_lock);
+    if (lan->ip_lock)
+	ipmi_destroy_lock(lan->ip_lock);
+    ipmi_mem_free(lan);
+    ipmi_mem_free(ipmi);
+}
+
+static int
+bench_alloc(bench_suite_t *s, ipmi_con_t **rcon)
+{
+    ipmi_con_t         *ipmi;
+    lan_data_t         *lan;
+    ipmi_rmcpp_auth_t  *ainfo;
+    unsigned char      password[IPMI_PASSWORD_MAX];
+    unsigned int       i;
+    int                rv;
+
+    ipmi = ipmi_mem_alloc(sizeof(*ipmi));
+    if (!ipmi)
+	return ENOMEM;
+    memset(ipmi, 0, sizeof(*ipmi));
+    lan = ipmi_mem_alloc(sizeof(*lan));
+    if (!lan) {
+	ipmi_mem_free(ipmi);
+	return ENOMEM;
+    }
+    memset(lan, 0, sizeof(*lan));
+    ipmi->os_hnd = os_hnd;
+    ipmi->con_data = lan;
+    ipmi->ipmb_addr[0] = 0x20;
+    lan->ipmi = ipmi;
+
+    rv = ipmi_create_lock_os_hnd(os_hnd, &lan->ip_lock);
+    if (rv)
+	goto out_err;
+    rv = ipmi_create_lock_os_hnd(os_hnd, &lan->seq_num_lock);
+    if (rv)
+	goto out_err;
+    lan->lan_stat_list = locked_list_alloc(os_hnd);
+    if (!lan->lan_stat_list) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+
+    lan->ip[0].working = 1;
+    lan->ip[0].working_authtype = s->authtype;
+    lan->ip[0].session_id = BENCH_SESSION_ID;
+    lan->ip[0].mgsys_session_id = BENCH_SESSION_ID;
+    lan->ip[0].outbound_seq_num = 1;
+    lan->ip[0].unauth_out_seq_num = 1;
+
+    if (s->authtype != IPMI_AUTHTYPE_RMCP_PLUS) {
+	if (s->authtype == IPMI_AUTHTYPE_NONE)
+	    goto out;
+	if (!ipmi_auths[s->authtype].authcode_init) {
+	    rv = ENOSYS;
+	    goto out_err;
+	}
+	memset(password, 0, sizeof(password));
+	strcpy((char *) password, "benchmark");
+	rv = ipmi_auths[s->authtype].authcode_init(password, &lan->authdata,
+						   NULL, auth_alloc,
+						   auth_free);
+	if (rv)
+	    goto out_err;
+	goto out;
+    }
+
+    /* Fake the output of the RAKP exchange. */
+    ainfo = &lan->ip[0].ainfo;
+    ainfo->lan = lan;
+    for (i=0; i<s->key_len; i++) {
+	ainfo->sik[i] = i;
+	ainfo->k1[i] = i + 0x40;
+	ainfo->k2[i] = i + 0x80;
+    }
+    ainfo->sik_len = s->key_len;
+    ainfo->k1_len = s->key_len;
+    ainfo->k2_len = s->key_len;
+
+    lan->ip[0].working_integ = s->integ;
+    lan->ip[0].working_conf = s->conf;
+    lan->ip[0].integ_info = integs[s->integ];
+    lan->ip[0].conf_info = confs[s->conf];
+    if (!lan->ip[0].integ_info || !lan->ip[0].conf_info) {
+	/* Probably built without OpenSSL. */
+	rv = ENOSYS;
+	goto out_err;
+    }
+    rv = lan->ip[0].integ_info->integ_init(ipmi, ainfo,
+					   &lan->ip[0].integ_data);
+    if (rv)
+	goto out_err;
+    rv = lan->ip[0].conf_info->conf_init(ipmi, ainfo,
+					 &lan->ip[0].conf_data);
+    if (rv)
+	goto out_err;
+
+ out:
+    *rcon = ipmi;
+    return 0;
+
+ out_err:
+    bench_free(ipmi);
+    return rv;
+}
+
+static int
+bench_format(ipmi_con_t    *ipmi,
+	     ipmi_msg_t    *msg,
+	     unsigned char *buf,
+	     unsigned char **rdata,
+	     unsigned int  *rlen)
+{
+    lan_data_t                  *lan = ipmi->con_data;
+    ipmi_system_interface_addr_t si;
+    unsigned char               *tmsg = buf + IPMI_LAN_MAX_HEADER;
+    unsigned int                pos = IPMI_MAX_LAN_LEN;
+    int                         out_of_session = 0;
+    unsigned char               oem_iana[3] = { 0, 0, 0 };
+    int                         rv;
+
+    si.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
+    si.channel = IPMI_BMC_CHANNEL;
+    si.lun = 0;
+    rv = payloads[IPMI_RMCPP_PAYLOAD_TYPE_IPMI]->format_for_xmit
+	(ipmi, (ipmi_addr_t *) &si, sizeof(si), msg, tmsg, &pos,
+	 &out_of_session, 1);
+    if (rv)
+	return rv;
+
+    if (lan->ip[0].working_authtype == IPMI_AUTHTYPE_RMCP_PLUS)
+	rv = rmcpp_format_msg(lan, 0, IPMI_RMCPP_PAYLOAD_TYPE_IPMI,
+			      !out_of_session, &tmsg, &pos,
+			      IPMI_MAX_LAN_LEN, IPMI_LAN_MAX_HEADER,
+			      oem_iana, 0, NULL);
+    else
+	rv = lan15_format_msg(lan, 0, &tmsg, &pos);
+    if (rv)
+	return rv;
+
+    *rdata = tmsg;
+    *rlen = pos;
+    return 0;
+}
+
+static void
+bench_recv(ipmi_con_t *ipmi, unsigned char *data, unsigned int len)
+{
+    lan_data_t *lan = ipmi->con_data;
+
+    if (lan->ip[0].working_authtype == IPMI_AUTHTYPE_RMCP_PLUS)
+	handle_rmcpp_recv(ipmi, lan, 0, data, len);
+    else
+	handle_lan15_recv(ipmi, lan, 0, data, len);
+}
+
+static double
+tv_usec_diff(struct timeval *start, struct timeval *end)
+{
+    return (((double) (end->tv_sec - start->tv_sec)) * 1000000.0
+	    + (end->tv_usec - start->tv_usec));
+}
+
+static int
+bench_run(bench_suite_t *s, unsigned int count, unsigned int size)
+{
+    ipmi_con_t     *ipmi;
+    lan_data_t     *lan;
+    ipmi_msg_t     msg;
+    unsigned char  msg_data[IPMI_MAX_MSG_LENGTH];
+    unsigned char  buf[BENCH_BATCH][IPMI_MAX_LAN_LEN+IPMI_LAN_MAX_HEADER];
+    unsigned char  *data[BENCH_BATCH];
+    unsigned int   len[BENCH_BATCH];
+    unsigned int   i, j, n;
+    struct timeval start, end;
+    double         enc_usec = 0, dec_usec = 0;
+    uint32_t       *out_seq, *in_seq;
+    int            rv = 0;
+
+    rv = bench_alloc(s, &ipmi);
+    if (rv) {
+	printf("%-24s skipped: %s\n", s->name, strerror(rv));
+	return 0;
+    }
+    lan = ipmi->con_data;
+    if ((s->authtype == IPMI_AUTHTYPE_RMCP_PLUS)
+	&& (s->integ == IPMI_LANP_INTEGRITY_ALGORITHM_NONE))
+    {
+	out_seq = &lan->ip[0].unauth_out_seq_num;
+	in_seq = &lan->ip[0].unauth_in_seq_num;
+    } else {
+	out_seq = &lan->ip[0].outbound_seq_num;
+	in_seq = &lan->ip[0].inbound_seq_num;
+    }
+
+    for (i=0; i<size; i++)
+	msg_data[i] = i;
+    msg.netfn = IPMI_APP_NETFN;
+    msg.cmd = IPMI_GET_DEVICE_ID_CMD;
+    msg.data = msg_data;
+    msg.data_len = size;
+
+    /* Packets are formatted and then received a batch at a time so
+       the clock is not read around every call.  They are received in
+       order, so they are always in the sequence number window. */
+    for (i=0; i<count; i+=n) {
+	n = count - i;
+	if (n > BENCH_BATCH)
+	    n = BENCH_BATCH;
+
+	os_hnd->get_monotonic_time(os_hnd, &start);
+	for (j=0; j<n; j++) {
+	    rv = bench_format(ipmi, &msg, buf[j], &data[j], &len[j]);
+	    if (rv) {
+		printf("%-24s format failed: %s\n", s->name, strerror(rv));
+		goto out;
+	    }
+	}
+	os_hnd->get_monotonic_time(os_hnd, &end);
+	enc_usec += tv_usec_diff(&start, &end);
+
+	os_hnd->get_monotonic_time(os_hnd, &start);
+	for (j=0; j<n; j++)
+	    bench_recv(ipmi, data[j], len[j]);
+	os_hnd->get_monotonic_time(os_hnd, &end);
+	dec_usec += tv_usec_diff(&start, &end);
+
+	/* The receive path only moves the sequence number after a
+	   packet has passed all the checks, so if the last one made it
+	   through they all did. */
+	if (*in_seq != *out_seq - 1) {
+	    printf("%-24s packets were rejected on receive\n", s->name);
+	    rv = EINVAL;
+	    goto out;
+	}
+    }
+
+    if (enc_usec < 1)
+	enc_usec = 1;
+    if (dec_usec < 1)
+	dec_usec = 1;
+    printf("%-24s %4u  %10.0f %8.0f  %10.0f %8.0f\n", s->name, len[0],
+	   count * 1000000.0 / enc_usec, enc_usec * 1000.0 / count,
+	   count * 1000000.0 / dec_usec, dec_usec * 1000.0 / count);
+
+ out:
+    bench_free(ipmi);
+    return rv;
+}
+
+static void
+usage(char *name)
+{
+    fprintf(stderr,
+	    "%s [-n <count>] [-s <size>] [<suite name substring>]\n"
+	    "Format and receive <count> (default 100000) IPMI requests with"
+	    " <size>\n"
+	    "(default 16) bytes of data for each authtype and cipher"
+	    " suite.\n", name);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int count = 100000;
+    unsigned int size = 16;
+    char         *match = NULL;
+    char         *end;
+    int          i;
+    int          rv = 0;
+
+    for (i=1; i<argc; i++) {
+	if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc)) {
+	    count = strtoul(argv[++i], &end, 0);
+	    if ((*end != '\0') || (count == 0))
+		usage(argv[0]);
+	} else if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc)) {
+	    size = strtoul(argv[++i], &end, 0);
+	    if ((*end != '\0') || (size > IPMI_MAX_MSG_LENGTH - 32))
+		usage(argv[0]);
+	} else if (argv[i][0] == '-')
+	    usage(argv[0]);
+	else
+	    match = argv[i];
+    }
+
+    os_hnd = ipmi_posix_setup_os_handler();
+    if (!os_hnd) {
+	fprintf(stderr, "Unable to allocate os handler\n");
+	exit(1);
+    }
+    rv = ipmi_init(os_hnd);
+    if (rv) {
+	fprintf(stderr, "Unable to initialize OpenIPMI: %s\n", strerror(rv));
+	exit(1);
+    }
+
+    printf("%-24s %4s  %10s %8s  %10s %8s\n", "suite", "len",
+	   "enc pkt/s", "ns/pkt", "dec pkt/s", "ns/pkt");
+    for (i=0; suites[i].name; i++) {
+	if (match && !strstr(suites[i].name, match))
+	    continue;
+	if (bench_run(&suites[i], count, size))
+	    rv = 1;
+    }
+
+    ipmi_shutdown();
+    os_hnd->free_os_handler(os_hnd);
+    return rv;
+}
@@ -0,0 +1,1219 @@
+/*
+ * bench_sdr.c
+ *
+ * A benchmark of the SDR, entity and sensor processing code
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * This builds a large main SDR repository from a template and runs
+ * it through the same steps a domain does when it comes up: the SDRs
+ * are added to the domain's ipmi_sdr_info_t, the entities are scanned
+ * from them, the sensors are created, and entity presence is
+ * evaluated.  Then every threshold sensor converts all its raw values
+ * to floating point and back.  The time for each step and the memory
+ * it allocated are reported per 1000 SDRs.
+ *
+ * The template is the SDRs for one board, either the built-in one or
+ * a file from "sdrcomp -r" or "sdrcomp -b".  Each copy of it gets its
+ * own sensor numbers and its entity instances are made device
+ * relative, so copies are distinct.  Up to 16 copies share a set of
+ * MCs on channel 0; every MC address the template uses gets moved to
+ * its own IPMB address for each set.  System relative entity
+ * association records are turned into device relative ones to match.
+ *
+ * There is no network.  The domain has a connection that answers
+ * commands itself: Get Device ID gets a BMC with no SDR repository or
+ * SEL, so the domain comes up without fetching anything, Get Sensor
+ * Reading returns a reading with the first state set, and everything
+ * else gets an invalid command error.  The answers are queued and
+ * handed back from the main loop, so nothing is handled recursively.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_sdr.h>
+#include <OpenIPMI/ipmi_msgbits.h>
+#include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_auth.h>
+#include <OpenIPMI/ipmi_posix.h>
+
+#include <OpenIPMI/internal/ipmi_int.h>
+#include <OpenIPMI/internal/ipmi_domain.h>
+#include <OpenIPMI/internal/ipmi_entity.h>
+#include <OpenIPMI/internal/ipmi_sensor.h>
+
+/* From sdrcomp, see lanserv/OpenIPMI/mcserv.h. */
+#define SDR_IMAGE_MAGIC		"OIPMISDR"
+#define SDR_IMAGE_HDR_LEN	20
+
+#define BENCH_MAX_MCS		112	/* Even IPMB addresses from 0x20 */
+#define BENCH_MAX_PER_MC	16
+#define BENCH_TIMEOUT		10	/* Seconds to wait for the domain */
+
+static os_handler_t *os_hnd;
+
+/***********************************************************************
+ *
+ * The SDR corpus
+ *
+ **********************************************************************/
+
+/* Fill in a sensor record.  data is the record body past the header,
+   so data[0] is the owner id. */
+static void
+full_sensor(ipmi_sdr_t *sdr, unsigned int num, unsigned int ent_id,
+	    unsigned int ent_inst, unsigned int type, unsigned int format,
+	    unsigned int units, unsigned int linearization, int m, int b,
+	    int r_exp, const char *name)
+{
+    unsigned char *d = sdr->data;
+    unsigned int  len = strlen(name);
+
+    memset(sdr, 0, sizeof(*sdr));
+    sdr->major_version = 1;
+    sdr->minor_version = 5;
+    sdr->type = IPMI_SDR_FULL_SENSOR_RECORD;
+    d[0] = 0x20;
+    d[2] = num;
+    d[3] = ent_id;
+    d[4] = ent_inst;
+    d[5] = 0x67;		/* Scanning, events and thresholds at init */
+    d[6] = 0x68;		/* Readable/settable thresholds, no rearm */
+    d[7] = type;
+    d[8] = IPMI_EVENT_READING_TYPE_THRESHOLD;
+    d[9] = 0x95;		/* Upper critical and non-critical going high */
+    d[10] = 0x3a;		/* Thresholds readable */
+    d[11] = 0x95;
+    d[12] = 0x3a;
+    d[13] = 0x3f;		/* All thresholds readable */
+    d[14] = 0x3f;		/* All thresholds settable */
+    d[15] = format << 6;
+    d[16] = units;
+    d[18] = linearization;
+    d[19] = m & 0xff;
+    d[20] = (m >> 2) & 0xc0;
+    d[21] = b & 0xff;
+    d[22] = (b >> 2) & 0xc0;
+    d[24] = (r_exp & 0xf) << 4;
+    d[26] = 0x80;		/* Nominal reading */
+    d[29] = 0xff;		/* Sensor maximum */
+    d[30] = 0x00;		/* Sensor minimum */
+    d[31] = 0xf0;		/* Upper non-recoverable */
+    d[32] = 0xe0;		/* Upper critical */
+    d[33] = 0xd0;		/* Upper non-critical */
+    d[37] = 2;			/* Hysteresis */
+    d[38] = 2;
+    d[42] = 0xc0 | len;
+    memcpy(d + 43, name, len);
+    sdr->length = 43 + len;
+}
+
+static void
+compact_sensor(ipmi_sdr_t *sdr, unsigned int num, unsigned int ent_id,
+	       unsigned int ent_inst, unsigned int type,
+	       unsigned int reading_type, unsigned int mask, const char *name)
+{
+    unsigned char *d = sdr->data;
+    unsigned int  len = strlen(name);
+
+    memset(sdr, 0, sizeof(*sdr));
+    sdr->major_version = 1;
+    sdr->minor_version = 5;
+    sdr->type = IPMI_SDR_COMPACT_SENSOR_RECORD;
+    d[0] = 0x20;
+    d[2] = num;
+    d[3] = ent_id;
+    d[4] = ent_inst;
+    d[5] = 0x63;
+    d[6] = 0x40;
+    d[7] = type;
+    d[8] = reading_type;
+    d[9] = mask & 0xff;
+    d[10] = (mask >> 8) & 0x7f;
+    d[11] = mask & 0xff;
+    d[12] = (mask >> 8) & 0x7f;
+    d[13] = mask & 0xff;
+    d[14] = (mask >> 8) & 0x7f;
+    d[15] = IPMI_ANALOG_DATA_FORMAT_NOT_ANALOG << 6;
+    d[26] = 0xc0 | len;
+    memcpy(d + 27, name, len);
+    sdr->length = 27 + len;
+}
+
+/* A board with a few processors, power supplies, fans and memory and
+   the sensors for them, all on one MC. */
+static unsigned int
+builtin_template(ipmi_sdr_t *t)
+{
+    unsigned int  n = 0;
+    unsigned char *d;
+    const char    *name = "bench board";
+
+    /* The MC itself. */
+    memset(&t[n], 0, sizeof(t[n]));
+    t[n].major_version = 1;
+    t[n].minor_version = 5;
+    t[n].type = IPMI_SDR_MC_DEVICE_LOCATOR_RECORD;
+    d = t[n].data;
+    d[0] = 0x20;
+    d[3] = 0x09;		/* FRU inventory and sensor device */
+    d[7] = IPMI_ENTITY_ID_SYSTEM_BOARD;
+    d[8] = 1;
+    d[10] = 0xc0 | strlen(name);
+    memcpy(d + 11, name, strlen(name));
+    t[n].length = 11 + strlen(name);
+    n++;
+
+    /* The board contains the processors, power supplies and fans. */
+    memset(&t[n], 0, sizeof(t[n]));
+    t[n].major_version = 1;
+    t[n].minor_version = 5;
+    t[n].type = IPMI_SDR_ENITY_ASSOCIATION_RECORD;
+    t[n].length = 11;
+    d = t[n].data;
+    d[0] = IPMI_ENTITY_ID_SYSTEM_BOARD;
+    d[1] = 1;
+    d[3] = IPMI_ENTITY_ID_PROCESSOR;
+    d[4] = 1;
+    d[5] = IPMI_ENTITY_ID_POWER_SUPPLY;
+    d[6] = 1;
+    d[7] = IPMI_ENTITY_ID_FAN_COOLING;
+    d[8] = 1;
+    d[9] = IPMI_ENTITY_ID_MEMORY_MODULE;
+    d[10] = 1;
+    n++;
+
+    full_sensor(&t[n++], 0, IPMI_ENTITY_ID_PROCESSOR, 1,
+		IPMI_SENSOR_TYPE_TEMPERATURE, IPMI_ANALOG_DATA_FORMAT_UNSIGNED,
+		IPMI_UNIT_TYPE_DEGREES_C, IPMI_LINEARIZATION_LINEAR,
+		1, 0, 0, "CPU Temp");
+    full_sensor(&t[n++], 1, IPMI_ENTITY_ID_SYSTEM_BOARD, 1,
+		IPMI_SENSOR_TYPE_TEMPERATURE, IPMI_ANALOG_DATA_FORMAT_2_COMPL,
+		IPMI_UNIT_TYPE_DEGREES_C, IPMI_LINEARIZATION_LINEAR,
+		1, -40, 0, "Board Temp");
+    full_sensor(&t[n++], 2, IPMI_ENTITY_ID_SYSTEM_BOARD, 1,
+		IPMI_SENSOR_TYPE_VOLTAGE, IPMI_ANALOG_DATA_FORMAT_UNSIGNED,
+		IPMI_UNIT_TYPE_VOLTS, IPMI_LINEARIZATION_LINEAR,
+		16, 0, -3, "3.3V");
+    full_sensor(&t[n++], 3, IPMI_ENTITY_ID_POWER_SUPPLY, 1,
+		IPMI_SENSOR_TYPE_VOLTAGE, IPMI_ANALOG_DATA_FORMAT_UNSIGNED,
+		IPMI_UNIT_TYPE_VOLTS, IPMI_LINEARIZATION_LINEAR,
+		63, 0, -3, "12V");
+    full_sensor(&t[n++], 4, IPMI_ENTITY_ID_POWER_SUPPLY, 1,
+		IPMI_SENSOR_TYPE_CURRENT, IPMI_ANALOG_DATA_FORMAT_UNSIGNED,
+		IPMI_UNIT_TYPE_AMPS, IPMI_LINEARIZATION_LINEAR,
+		5, 0, -2, "PS Current");
+    full_sensor(&t[n++], 5, IPMI_ENTITY_ID_FAN_COOLING, 1,
+		IPMI_SENSOR_TYPE_FAN, IPMI_ANALOG_DATA_FORMAT_UNSIGNED,
+		IPMI_UNIT_TYPE_RPM, IPMI_LINEARIZATION_1_OVER_X,
+		1, 0, 6, "Fan Speed");
+    full_sensor(&t[n++], 6, IPMI_ENTITY_ID_POWER_SUPPLY, 1,
+		IPMI_SENSOR_TYPE_OTHER_UNITS_BASED_SENSOR,
+		IPMI_ANALOG_DATA_FORMAT_UNSIGNED,
+		IPMI_UNIT_TYPE_WATTS, IPMI_LINEARIZATION_SQR,
+		3, 0, 0, "PS Power");
+    full_sensor(&t[n++], 7, IPMI_ENTITY_ID_MEMORY_MODULE, 1,
+		IPMI_SENSOR_TYPE_TEMPERATURE, IPMI_ANALOG_DATA_FORMAT_1_COMPL,
+		IPMI_UNIT_TYPE_DEGREES_C, IPMI_LINEARIZATION_LINEAR,
+		1, 0, 0, "DIMM Temp");
+
+    compact_sensor(&t[n++], 8, IPMI_ENTITY_ID_POWER_SUPPLY, 1,
+		   IPMI_SENSOR_TYPE_ENTITY_PRESENCE,
+		   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC, 0x0003,
+		   "PS Presence");
+    compact_sensor(&t[n++], 9, IPMI_ENTITY_ID_PROCESSOR, 1,
+		   IPMI_SENSOR_TYPE_PROCESSOR,
+		   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC, 0x0083,
+		   "CPU Status");
+    compact_sensor(&t[n++], 10, IPMI_ENTITY_ID_MEMORY_MODULE, 1,
+		   IPMI_SENSOR_TYPE_MEMORY,
+		   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC, 0x0023,
+		   "DIMM Status");
+    compact_sensor(&t[n++], 11, IPMI_ENTITY_ID_FAN_COOLING, 1,
+		   IPMI_SENSOR_TYPE_FAN,
+		   IPMI_EVENT_READING_TYPE_DISCRETE_REDUNDANCY, 0x0003,
+		   "Fan Redundancy");
+    compact_sensor(&t[n++], 12, IPMI_ENTITY_ID_SYSTEM_BOARD, 1,
+		   IPMI_SENSOR_TYPE_WATCHDOG_2,
+		   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC, 0x000f,
+		   "Watchdog");
+
+    return n;
+}
+
+/* Read SDRs from sdrcomp output, either raw or an image.  Returns the
+   number read, or 0 on error. */
+static unsigned int
+file_template(const char *filename, ipmi_sdr_t *t, unsigned int max)
+{
+    FILE          *f;
+    unsigned char hdr[SDR_IMAGE_HDR_LEN];
+    unsigned char rec[5];
+    unsigned int  n = 0;
+    size_t        len;
+
+    f = fopen(filename, "r");
+    if (!f) {
+	fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
+	return 0;
+    }
+
+    len = fread(hdr, 1, sizeof(hdr), f);
+    if ((len < sizeof(hdr)) || (memcmp(hdr, SDR_IMAGE_MAGIC, 8) != 0))
+	/* Not an image, just SDRs back to back. */
+	rewind(f);
+
+    while (fread(rec, 1, 5, f) == 5) {
+	if (n >= max) {
+	    fprintf(stderr, "%s: More than %u SDRs\n", filename, max);
+	    n = 0;
+	    break;
+	}
+	memset(&t[n], 0, sizeof(t[n]));
+	t[n].major_version = rec[2] & 0xf;
+	t[n].minor_version = (rec[2] >> 4) & 0xf;
+	t[n].type = rec[3];
+	t[n].length = rec[4];
+	if (fread(t[n].data, 1, rec[4], f) != rec[4]) {
+	    fprintf(stderr, "%s: Truncated SDR\n", filename);
+	    n = 0;
+	    break;
+	}
+	n++;
+    }
+    fclose(f);
+    return n;
+}
+
+typedef struct bench_corpus_s
+{
+    ipmi_sdr_t   *sdrs;
+    unsigned int count;
+    unsigned int per_mc;
+    unsigned int num_span;	/* Sensor numbers used by one copy */
+    unsigned int inst_span;	/* Entity instances used by one copy */
+
+    /* The MC addresses the template uses, each copy moves them to
+       addresses of its own. */
+    unsigned char addrs[BENCH_MAX_MCS];
+    unsigned int  num_addrs;
+} bench_corpus_t;
+
+static int
+find_addr(bench_corpus_t *c, unsigned int addr)
+{
+    unsigned int i;
+
+    for (i=0; i<c->num_addrs; i++) {
+	if (c->addrs[i] == (addr & 0xfe))
+	    return i;
+    }
+    return -1;
+}
+
+static int
+note_addr(bench_corpus_t *c, unsigned int addr)
+{
+    if (find_addr(c, addr) >= 0)
+	return 0;
+    if (c->num_addrs >= BENCH_MAX_MCS)
+	return E2BIG;
+    c->addrs[c->num_addrs++] = addr & 0xfe;
+    return 0;
+}
+
+static unsigned int
+copy_addr(bench_corpus_t *c, unsigned int addr, unsigned int copy)
+{
+    int idx = find_addr(c, addr);
+
+    if (idx < 0)
+	return addr;
+    return 0x20 + (((copy / c->per_mc) * c->num_addrs + idx) * 2);
+}
+
+static unsigned int
+ent_inst(bench_corpus_t *c, unsigned int inst, unsigned int copy)
+{
+    unsigned int i = inst & 0x7f;
+
+    if (i >= 0x60)
+	i -= 0x60;
+    i = (i % c->inst_span) * c->per_mc + (copy % c->per_mc);
+    return (inst & 0x80) | (0x60 + (i & 0x1f));
+}
+
+/* Add one copy of the template to the corpus.  Returns the number of
+   SDRs added. */
+static unsigned int
+add_copy(bench_corpus_t *c, ipmi_sdr_t *t, unsigned int tcount,
+	 unsigned int copy)
+{
+    unsigned int  addr = copy_addr(c, c->addrs[0], copy);
+    unsigned int  num_base = (copy % c->per_mc) * c->num_span;
+    unsigned int  i, j, n = 0;
+    ipmi_sdr_t    *sdr;
+    unsigned char *d;
+
+    for (i=0; i<tcount; i++) {
+	sdr = &c->sdrs[c->count];
+	*sdr = t[i];
+	d = sdr->data;
+	switch (sdr->type) {
+	case IPMI_SDR_FULL_SENSOR_RECORD:
+	case IPMI_SDR_COMPACT_SENSOR_RECORD:
+	case 0x03:		/* Event only */
+	    d[0] = copy_addr(c, d[0], copy);
+	    d[1] &= 0x03;
+	    d[2] += num_base;
+	    d[4] = ent_inst(c, d[4], copy);
+	    break;
+
+	case IPMI_SDR_ENITY_ASSOCIATION_RECORD:
+	    /* Make it device relative, on the first MC, the contained
+	       entities move from pairs to address, channel, id,
+	       instance. */
+	    sdr->type = IPMI_SDR_DR_ENITY_ASSOCIATION_RECORD;
+	    sdr->length = 21;
+	    d[4] = t[i].data[2];
+	    d[1] = ent_inst(c, t[i].data[1], copy);
+	    d[2] = addr;
+	    d[3] = 0;
+	    for (j=0; j<4; j++) {
+		d[5+(j*4)] = addr;
+		d[6+(j*4)] = 0;
+		d[7+(j*4)] = t[i].data[3+(j*2)];
+		if (t[i].data[3+(j*2)])
+		    d[8+(j*4)] = ent_inst(c, t[i].data[4+(j*2)], copy);
+		else
+		    d[8+(j*4)] = 0;
+	    }
+	    break;
+
+	case IPMI_SDR_DR_ENITY_ASSOCIATION_RECORD:
+	    d[1] = ent_inst(c, d[1], copy);
+	    d[2] = copy_addr(c, d[2], copy);
+	    d[3] = 0;
+	    for (j=5; j<21; j+=4) {
+		d[j] = copy_addr(c, d[j], copy);
+		d[j+1] = 0;
+		if (d[j+2])
+		    d[j+3] = ent_inst(c, d[j+3], copy);
+	    }
+	    break;
+
+	case IPMI_SDR_GENERIC_DEVICE_LOCATOR_RECORD:
+	    d[0] = copy_addr(c, d[0], copy);
+	    d[1] &= 0xfe;
+	    d[2] &= 0x1f;
+	    d[8] = ent_inst(c, d[8], copy);
+	    break;
+
+	case IPMI_SDR_FRU_DEVICE_LOCATOR_RECORD:
+	    d[0] = copy_addr(c, d[0], copy);
+	    d[3] &= 0x0f;
+	    d[8] = ent_inst(c, d[8], copy);
+	    break;
+
+	case IPMI_SDR_MC_DEVICE_LOCATOR_RECORD:
+	    d[0] = copy_addr(c, d[0], copy);
+	    d[1] &= 0xf0;
+	    d[8] = ent_inst(c, d[8], copy);
+	    break;
+
+	default:
+	    /* OEM and the like, only keep one copy. */
+	    if (copy != 0)
+		continue;
+	}
+	sdr->record_id = c->count;
+	c->count++;
+	n++;
+    }
+    return n;
+}
+
+static int
+build_corpus(bench_corpus_t *c, ipmi_sdr_t *t, unsigned int tcount,
+	     unsigned int target)
+{
+    unsigned int i, j, copies, max_num = 0, max_inst = 0, num, inst;
+    int          rv = 0;
+
+    if (!tcount)
+	return EINVAL;
+
+    /* Find the MCs a copy uses and how many sensor numbers and
+       instances it needs on each, to see how many copies fit. */
+    c->num_addrs = 0;
+    for (i=0; i<tcount; i++) {
+	num = 0;
+	inst = 0;
+	switch (t[i].type) {
+	case IPMI_SDR_FULL_SENSOR_RECORD:
+	case 0x03:
+	    rv = note_addr(c, t[i].data[0]);
+	    num = t[i].data[2] + 1;
+	    inst = t[i].data[4];
+	    break;
+	case IPMI_SDR_COMPACT_SENSOR_RECORD:
+	    rv = note_addr(c, t[i].data[0]);
+	    /* Shared records cover several sensor numbers. */
+	    num = t[i].data[2] + (t[i].data[18] & 0xf);
+	    if (num == t[i].data[2])
+		num++;
+	    inst = t[i].data[4];
+	    break;
+	case IPMI_SDR_GENERIC_DEVICE_LOCATOR_RECORD:
+	case IPMI_SDR_FRU_DEVICE_LOCATOR_RECORD:
+	case IPMI_SDR_MC_DEVICE_LOCATOR_RECORD:
+	    rv = note_addr(c, t[i].data[0]);
+	    inst = t[i].data[8];
+	    break;
+	case IPMI_SDR_DR_ENITY_ASSOCIATION_RECORD:
+	    rv = note_addr(c, t[i].data[2]);
+	    for (j=5; !rv && (j<21); j+=4) {
+		if (t[i].data[j+2])
+		    rv = note_addr(c, t[i].data[j]);
+	    }
+	    break;
+	}
+	if (rv) {
+	    fprintf(stderr, "The template uses too many MCs\n");
+	    return rv;
+	}
+	inst &= 0x7f;
+	if (inst >= 0x60)
+	    inst -= 0x60;
+	if (num > max_num)
+	    max_num = num;
+	if (inst > max_inst)
+	    max_inst = inst;
+    }
+    if (c->num_addrs == 0)
+	note_addr(c, 0x20);
+    c->num_span = max_num ? max_num : 1;
+    c->inst_span = max_inst + 1;
+    c->per_mc = 256 / c->num_span;
+    if (c->per_mc > 32 / c->inst_span)
+	c->per_mc = 32 / c->inst_span;
+    if (c->per_mc > BENCH_MAX_PER_MC)
+	c->per_mc = BENCH_MAX_PER_MC;
+    if (c->per_mc == 0)
+	c->per_mc = 1;
+
+    copies = (target + tcount - 1) / tcount;
+    if (copies == 0)
+	copies = 1;
+    i = (BENCH_MAX_MCS / c->num_addrs) * c->per_mc;
+    if (copies > i) {
+	fprintf(stderr, "Only %u copies of the %u SDR template fit, that is"
+		" at most %u SDRs\n", i, tcount, i * tcount);
+	return E2BIG;
+    }
+
+    c->sdrs = malloc(sizeof(ipmi_sdr_t) * copies * tcount);
+    if (!c->sdrs)
+	return ENOMEM;
+    c->count = 0;
+    for (i=0; i<copies; i++)
+	add_copy(c, t, tcount, i);
+    return 0;
+}
+
+/***********************************************************************
+ *
+ * A connection that answers for itself
+ *
+ **********************************************************************/
+
+typedef struct bench_cmd_s
+{
+    ipmi_addr_t           addr;
+    unsigned int          addr_len;
+    unsigned char         netfn;
+    unsigned char         cmd;
+    unsigned char         data[IPMI_MAX_MSG_LENGTH];
+    unsigned int          data_len;
+    ipmi_ll_rsp_handler_t rsp_handler;
+    ipmi_msgi_t           *rspi;
+    struct bench_cmd_s    *next;
+} bench_cmd_t;
+
+static bench_cmd_t            *cmd_head, *cmd_tail;
+static unsigned long          cmds_handled;
+static ipmi_ll_con_changed_cb con_changed;
+static void                   *con_changed_cb_data;
+static int                    con_up_pending;
+
+static int
+bench_start_con(ipmi_con_t *ipmi)
+{
+    con_up_pending = 1;
+    return 0;
+}
+
+static int
+bench_add_con_change_handler(ipmi_con_t             *ipmi,
+			     ipmi_ll_con_changed_cb handler,
+			     void                   *cb_data)
+{
+    con_changed = handler;
+    con_changed_cb_data = cb_data;
+    return 0;
+}
+
+static int
+bench_remove_con_change_handler(ipmi_con_t             *ipmi,
+				ipmi_ll_con_changed_cb handler,
+				void                   *cb_data)
+{
+    con_changed = NULL;
+    return 0;
+}
+
+static int
+bench_add_ipmb_addr_handler(ipmi_con_t           *ipmi,
+			    ipmi_ll_ipmb_addr_cb handler,
+			    void                 *cb_data)
+{
+    return 0;
+}
+
+static int
+bench_remove_ipmb_addr_handler(ipmi_con_t           *ipmi,
+			       ipmi_ll_ipmb_addr_cb handler,
+			       void                 *cb_data)
+{
+    return 0;
+}
+
+static int
+bench_add_event_handler(ipmi_con_t            *ipmi,
+			ipmi_ll_evt_handler_t handler,
+			void                  *cb_data)
+{
+    return 0;
+}
+
+static int
+bench_remove_event_handler(ipmi_con_t            *ipmi,
+			   ipmi_ll_evt_handler_t handler,
+			   void                  *cb_data)
+{
+    return 0;
+}
+
+static int
+bench_send_command(ipmi_con_t            *ipmi,
+		   const ipmi_addr_t     *addr,
+		   unsigned int          addr_len,
+		   const ipmi_msg_t      *msg,
+		   ipmi_ll_rsp_handler_t rsp_handler,
+		   ipmi_msgi_t           *rspi)
+{
+    bench_cmd_t *c;
+
+    if ((addr_len > sizeof(c->addr)) || (msg->data_len > sizeof(c->data)))
+	return EINVAL;
+    c = malloc(sizeof(*c));
+    if (!c)
+	return ENOMEM;
+    memcpy(&c->addr, addr, addr_len);
+    c->addr_len = addr_len;
+    c->netfn = msg->netfn;
+    c->cmd = msg->cmd;
+    memcpy(c->data, msg->data, msg->data_len);
+    c->data_len = msg->data_len;
+    c->rsp_handler = rsp_handler;
+    c->rspi = rspi;
+    c->next = NULL;
+    if (cmd_tail)
+	cmd_tail->next = c;
+    else
+	cmd_head = c;
+    cmd_tail = c;
+    return 0;
+}
+
+static void
+bench_free_cmds(void)
+{
+    bench_cmd_t *c;
+
+    while (cmd_head) {
+	c = cmd_head;
+	cmd_head = c->next;
+	ipmi_free_msg_item(c->rspi);
+	free(c);
+    }
+    cmd_tail = NULL;
+}
+
+static int
+bench_close_connection_done(ipmi_con_t            *ipmi,
+			    ipmi_ll_con_closed_cb handler,
+			    void                  *cb_data)
+{
+    bench_free_cmds();
+    if (ipmi->name)
+	ipmi_mem_free(ipmi->name);
+    if (handler)
+	handler(ipmi, cb_data);
+    ipmi_mem_free(ipmi);
+    return 0;
+}
+
+static int
+bench_close_connection(ipmi_con_t *ipmi)
+{
+    return bench_close_connection_done(ipmi, NULL, NULL);
+}
+
+static ipmi_con_t *
+bench_alloc_con(void)
+{
+    ipmi_con_t *ipmi;
+
+    ipmi = ipmi_mem_alloc(sizeof(*ipmi));
+    if (!ipmi)
+	return NULL;
+    memset(ipmi, 0, sizeof(*ipmi));
+    ipmi->os_hnd = os_hnd;
+    ipmi->con_type = "bench";
+    ipmi->priv_level = IPMI_PRIVILEGE_ADMIN;
+    ipmi->ipmb_addr[0] = 0x20;
+    ipmi->start_con = bench_start_con;
+    ipmi->add_con_change_handler = bench_add_con_change_handler;
+    ipmi->remove_con_change_handler = bench_remove_con_change_handler;
+    ipmi->add_ipmb_addr_handler = bench_add_ipmb_addr_handler;
+    ipmi->remove_ipmb_addr_handler = bench_remove_ipmb_addr_handler;
+    ipmi->add_event_handler = bench_add_event_handler;
+    ipmi->remove_event_handler = bench_remove_event_handler;
+    ipmi->send_command = bench_send_command;
+    ipmi->close_connection = bench_close_connection;
+    ipmi->close_connection_done = bench_close_connection_done;
+    return ipmi;
+}
+
+static void
+bench_answer(bench_cmd_t *c)
+{
+    ipmi_msg_t    rsp;
+    unsigned char data[12];
+
+    rsp.netfn = c->netfn | 1;
+    rsp.cmd = c->cmd;
+    rsp.data = data;
+    memset(data, 0, sizeof(data));
+    if ((c->netfn == IPMI_APP_NETFN) && (c->cmd == IPMI_GET_DEVICE_ID_CMD)) {
+	data[1] = 0x20;		/* Device id */
+	data[2] = 0x01;		/* No device SDRs */
+	data[3] = 0x01;
+	data[5] = 0x51;		/* IPMI 1.5 */
+	data[6] = 0x00;		/* No SDR repository, SEL or sensors */
+	rsp.data_len = 12;
+    } else if ((c->netfn == IPMI_SENSOR_EVENT_NETFN)
+	       && (c->cmd == IPMI_GET_SENSOR_READING_CMD)
+	       && (c->data_len >= 1))
+    {
+	data[1] = 0x40 + (c->data[0] & 0x3f);
+	data[2] = 0xc0;		/* Events and scanning enabled */
+	data[3] = 0x01;		/* First state/threshold set */
+	data[4] = 0x80;
+	rsp.data_len = 5;
+    } else {
+	data[0] = IPMI_INVALID_CMD_CC;
+	rsp.data_len = 1;
+    }
+
+    /* Broadcasts come back as normal sends, like the real connections
+       do it. */
+    if (c->addr.addr_type == IPMI_IPMB_BROADCAST_ADDR_TYPE)
+	c->addr.addr_type = IPMI_IPMB_ADDR_TYPE;
+    ipmi_handle_rsp_item_copyall(NULL, c->rspi, &c->addr, c->addr_len, &rsp,
+				 c->rsp_handler);
+    cmds_handled++;
+}
+
+/* Answer commands and run timers until *done is set, or until there
+   is nothing left to do if done is NULL. */
+static int
+bench_run_until(ipmi_con_t *ipmi, int *done)
+{
+    struct timeval start, now, tv;
+    bench_cmd_t    *c;
+    int            idle = 0;
+
+    os_hnd->get_monotonic_time(os_hnd, &start);
+    while (!done || !*done) {
+	if (con_up_pending) {
+	    con_up_pending = 0;
+	    if (con_changed)
+		con_changed(ipmi, 0, 0, 1, con_changed_cb_data);
+	    idle = 0;
+	    continue;
+	}
+	if (cmd_head) {
+	    c = cmd_head;
+	    cmd_head = c->next;
+	    if (!cmd_head)
+		cmd_tail = NULL;
+	    bench_answer(c);
+	    free(c);
+	    idle = 0;
+	    continue;
+	}
+
+	/* Nothing queued, let any timers that are due run. */
+	if (!done && idle)
+	    break;
+	tv.tv_sec = 0;
+	tv.tv_usec = done ? 10000 : 0;
+	os_hnd->perform_one_op(os_hnd, &tv);
+	idle = 1;
+
+	os_hnd->get_monotonic_time(os_hnd, &now);
+	if (now.tv_sec - start.tv_sec > BENCH_TIMEOUT)
+	    return ETIMEDOUT;
+    }
+    return 0;
+}
+
+/***********************************************************************
+ *
+ * The benchmark
+ *
+ **********************************************************************/
+
+typedef struct bench_phase_s
+{
+    const char     *name;
+    struct timeval start;
+    long           start_mem;
+} bench_phase_t;
+
+static unsigned int num_sdrs;
+
+static long
+mem_in_use(void)
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+
+    return mi.uordblks + mi.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+static void
+phase_start(bench_phase_t *p, const char *name)
+{
+    p->name = name;
+    p->start_mem = mem_in_use();
+    os_hnd->get_monotonic_time(os_hnd, &p->start);
+}
+
+static void
+phase_end(bench_phase_t *p)
+{
+    struct timeval end;
+    double         usec;
+    long           mem;
+
+    os_hnd->get_monotonic_time(os_hnd, &end);
+    mem = mem_in_use();
+    usec = (((double) (end.tv_sec - p->start.tv_sec)) * 1000000.0
+	    + (end.tv_usec - p->start.tv_usec));
+    printf("%-16s %10.0f %12.1f", p->name, usec,
+	   usec * 1000.0 / num_sdrs);
+    if ((mem >= 0) && (p->start_mem >= 0))
+	printf(" %12.1f", ((double) (mem - p->start_mem)) / num_sdrs);
+    else
+	printf(" %12s", "-");
+    printf("\n");
+}
+
+typedef struct bench_info_s
+{
+    bench_corpus_t  *corpus;
+    ipmi_con_t      *ipmi;
+    int             err;
+    ipmi_sensor_id_t *sensors;
+    unsigned int    num_sensors;
+    unsigned int    sensors_room;
+    unsigned int    num_entities;
+    unsigned int    num_present;
+    unsigned int    num_threshold;
+    double          sum;	/* So the conversions aren't optimized out */
+} bench_info_t;
+
+static int fully_up;
+
+static void
+domain_up(ipmi_domain_t *domain, void *cb_data)
+{
+    fully_up = 1;
+}
+
+static void
+load_sdrs(ipmi_domain_t *domain, void *cb_data)
+{
+    bench_info_t    *info = cb_data;
+    ipmi_sdr_info_t *sdrs = ipmi_domain_get_main_sdrs(domain);
+    unsigned int    i;
+    int             rv;
+
+    for (i=0; i<info->corpus->count; i++) {
+	rv = ipmi_sdr_add(sdrs, &info->corpus->sdrs[i]);
+	if (rv) {
+	    info->err = rv;
+	    return;
+	}
+    }
+}
+
+static void
+scan_sdrs(ipmi_domain_t *domain, void *cb_data)
+{
+    bench_info_t *info = cb_data;
+
+    _ipmi_domain_update_batch_start(domain);
+    info->err = ipmi_entity_scan_sdrs(domain, NULL,
+				      ipmi_domain_get_entities(domain),
+				      ipmi_domain_get_main_sdrs(domain));
+    _ipmi_domain_update_batch_end(domain);
+}
+
+static void
+handle_sdrs(ipmi_domain_t *domain, void *cb_data)
+{
+    bench_info_t *info = cb_data;
+
+    _ipmi_domain_update_batch_start(domain);
+    info->err = ipmi_sensor_handle_sdrs(domain, NULL,
+					ipmi_domain_get_main_sdrs(domain));
+    _ipmi_domain_update_batch_end(domain);
+}
+
+static void
+count_entity(ipmi_entity_t *ent, void *cb_data)
+{
+    bench_info_t     *info = cb_data;
+    ipmi_snapshot_t  *snap;
+    ipmi_sensor_id_t *n;
+    unsigned int     i, count;
+
+    info->num_entities++;
+    if (ipmi_entity_is_present(ent))
+	info->num_present++;
+
+    if (ipmi_entity_snapshot_sensors(ent, &snap))
+	return;
+    count = ipmi_snapshot_count(snap);
+    if (info->num_sensors + count > info->sensors_room) {
+	n = realloc(info->sensors, sizeof(*n) * (info->sensors_room * 2
+						 + count));
+	if (!n) {
+	    ipmi_snapshot_put(snap);
+	    return;
+	}
+	info->sensors = n;
+	info->sensors_room = info->sensors_room * 2 + count;
+    }
+    for (i=0; i<count; i++)
+	ipmi_snapshot_get_sensor_id(snap, i,
+				    &info->sensors[info->num_sensors++]);
+    ipmi_snapshot_put(snap);
+}
+
+static void
+count_entities(ipmi_domain_t *domain, void *cb_data)
+{
+    ipmi_domain_iterate_entities(domain, count_entity, cb_data);
+}
+
+static void
+detect_presence(ipmi_domain_t *domain, void *cb_data)
+{
+    bench_info_t *info = cb_data;
+
+    info->err = ipmi_detect_domain_presence_changes(domain, 1);
+}
+
+static void
+lookup_sensor(ipmi_sensor_t *sensor, void *cb_data)
+{
+    bench_info_t *info = cb_data;
+
+    info->sum += ipmi_sensor_get_num(sensor, NULL, NULL);
+}
+
+static void
+convert_sensor(ipmi_sensor_t *sensor, void *cb_data)
+{
+    bench_info_t *info = cb_data;
+    double       val;
+    int          raw;
+    int          i;
+
+    if ((ipmi_sensor_get_event_reading_type(sensor)
+	 != IPMI_EVENT_READING_TYPE_THRESHOLD)
+	|| (ipmi_sensor_get_analog_data_format(sensor)
+	    == IPMI_ANALOG_DATA_FORMAT_NOT_ANALOG))
+	return;
+
+    info->num_threshold++;
+    for (i=0; i<256; i++) {
+	if (ipmi_sensor_convert_from_raw(sensor, i, &val))
+	    continue;
+	if (ipmi_sensor_convert_to_raw(sensor, ROUND_NORMAL, val, &raw) == 0)
+	    info->sum += val + raw;
+    }
+}
+
+static int
+bench_run(bench_corpus_t *corpus)
+{
+    ipmi_con_t         *ipmi;
+    ipmi_domain_id_t   domain_id;
+    ipmi_open_option_t options[6];
+    bench_info_t       info;
+    bench_phase_t      p;
+    unsigned int       i, count;
+    int                rv;
+
+    ipmi = bench_alloc_con();
+    if (!ipmi)
+	return ENOMEM;
+
+    /* Nothing but the domain's own startup and the SDRs given to
+       it. */
+    memset(options, 0, sizeof(options));
+    options[0].option = IPMI_OPEN_OPTION_ALL;
+    options[0].ival = 0;
+    options[1].option = IPMI_OPEN_OPTION_SET_EVENT_RCVR;
+    options[1].ival = 0;
+    options[2].option = IPMI_OPEN_OPTION_SET_SEL_TIME;
+    options[2].ival = 0;
+    options[3].option = IPMI_OPEN_OPTION_USE_CACHE;
+    options[3].ival = 0;
+    options[4].option = IPMI_OPEN_OPTION_ACTIVATE_IF_POSSIBLE;
+    options[4].ival = 0;
+    options[5].option = IPMI_OPEN_OPTION_IPMB_SCAN;
+    options[5].ival = 0;
+    rv = ipmi_open_domain("bench", &ipmi, 1, NULL, NULL, domain_up, NULL,
+			  options, 6, &domain_id);
+    if (rv) {
+	fprintf(stderr, "Unable to open the domain: %s\n", strerror(rv));
+	ipmi->close_connection(ipmi);
+	return rv;
+    }
+    rv = bench_run_until(ipmi, &fully_up);
+    if (rv) {
+	fprintf(stderr, "The domain did not come up\n");
+	return rv;
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.corpus = corpus;
+    info.ipmi = ipmi;
+    num_sdrs = corpus->count;
+
+    printf("%u SDRs, %u copies of the template per MC\n\n",
+	   corpus->count, corpus->per_mc);
+    printf("%-16s %10s %12s %12s\n", "phase", "usec",
+	   "usec/1000", "bytes/SDR");
+
+    phase_start(&p, "sdr_add");
+    ipmi_domain_pointer_cb(domain_id, load_sdrs, &info);
+    phase_end(&p);
+    if (info.err)
+	goto out_err;
+
+    phase_start(&p, "entity_scan");
+    ipmi_domain_pointer_cb(domain_id, scan_sdrs, &info);
+    phase_end(&p);
+    if (info.err)
+	goto out_err;
+
+    phase_start(&p, "sensor_create");
+    ipmi_domain_pointer_cb(domain_id, handle_sdrs, &info);
+    phase_end(&p);
+    if (info.err)
+	goto out_err;
+
+    /* Handle the update callbacks and anything else that got queued
+       from creating everything. */
+    phase_start(&p, "settle");
+    rv = bench_run_until(ipmi, NULL);
+    phase_end(&p);
+    if (rv)
+	goto out_timeout;
+
+    phase_start(&p, "presence");
+    ipmi_domain_pointer_cb(domain_id, detect_presence, &info);
+    rv = bench_run_until(ipmi, NULL);
+    phase_end(&p);
+    if (rv)
+	goto out_timeout;
+    if (info.err)
+	goto out_err;
+
+    /* Doing it again with nothing changed is the common case. */
+    phase_start(&p, "entity_rescan");
+    ipmi_domain_pointer_cb(domain_id, scan_sdrs, &info);
+    phase_end(&p);
+    if (info.err)
+	goto out_err;
+
+    phase_start(&p, "sensor_rescan");
+    ipmi_domain_pointer_cb(domain_id, handle_sdrs, &info);
+    rv = bench_run_until(ipmi, NULL);
+    phase_end(&p);
+    if (rv)
+	goto out_timeout;
+    if (info.err)
+	goto out_err;
+
+    ipmi_domain_pointer_cb(domain_id, count_entities, &info);
+    count = info.num_sensors;
+
+    phase_start(&p, "sensor_lookup");
+    for (i=0; i<count; i++) {
+	ipmi_sensor_pointer_cb(info.sensors[i], lookup_sensor, &info);
+    }
+    phase_end(&p);
+
+    phase_start(&p, "convert");
+    for (i=0; i<count; i++) {
+	ipmi_sensor_pointer_cb(info.sensors[i], convert_sensor, &info);
+    }
+    phase_end(&p);
+
+    printf("\n%u entities (%u present), %u sensors (%u threshold),"
+	   " %lu commands\n", info.num_entities, info.num_present, count,
+	   info.num_threshold, cmds_handled);
+
+    free(info.sensors);
+    return 0;
+
+ out_timeout:
+    fprintf(stderr, "Timed out waiting for %s\n", p.name);
+    return rv;
+
+ out_err:
+    fprintf(stderr, "%s failed: %s\n", p.name, strerror(info.err));
+    return info.err;
+}
+
+static void
+usage(char *name)
+{
+    fprintf(stderr,
+	    "%s [-n <sdrs>] [-f <sdrcomp output>]\n"
+	    "Build a main SDR repository of about <sdrs> (default 10000)"
+	    " SDRs from copies\n"
+	    "of a template and time processing it.  The template is a"
+	    " built-in board\n"
+	    "unless a file from \"sdrcomp -r\" or \"sdrcomp -b\" is"
+	    " given.\n", name);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int   target = 10000;
+    char           *filename = NULL;
+    char           *end;
+    ipmi_sdr_t     *t;
+    unsigned int   tcount;
+    bench_corpus_t corpus;
+    int            i;
+    int            rv;
+
+    for (i=1; i<argc; i++) {
+	if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc)) {
+	    target = strtoul(argv[++i], &end, 0);
+	    if ((*end != '\0') || (target == 0))
+		usage(argv[0]);
+	} else if ((strcmp(argv[i], "-f") == 0) && (i+1 < argc)) {
+	    filename = argv[++i];
+	} else
+	    usage(argv[0]);
+    }
+
+    t = malloc(sizeof(*t) * 256);
+    if (!t) {
+	fprintf(stderr, "Out of memory\n");
+	exit(1);
+    }
+    if (filename)
+	tcount = file_template(filename, t, 256);
+    else
+	tcount = builtin_template(t);
+    if (!tcount)
+	exit(1);
+
+    memset(&corpus, 0, sizeof(corpus));
+    rv = build_corpus(&corpus, t, tcount, target);
+    free(t);
+    if (rv)
+	exit(1);
+
+    os_hnd = ipmi_posix_setup_os_handler();
+    if (!os_hnd) {
+	fprintf(stderr, "Unable to allocate os handler\n");
+	exit(1);
+    }
+    rv = ipmi_init(os_hnd);
+    if (rv) {
+	fprintf(stderr, "Unable to initialize OpenIPMI: %s\n", strerror(rv));
+	exit(1);
+    }
+
+    rv = bench_run(&corpus);
+
+    free(corpus.sdrs);
+    ipmi_shutdown();
+    os_hnd->free_os_handler(os_hnd);
+    return rv ? 1 : 0;
+}
@@ -33,8 +33,10 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/os_handler.h>
 #include <OpenIPMI/ipmi_err.h>
 #include <OpenIPMI/ipmi_msgbits.h>
 
@@ -482,3 +484,254 @@ _ipmi_chassis_create_controls(ipmi_mc_t *mc, unsigned char instance)
 	_ipmi_entity_put(chassis_ent);
     return rv;
 }
+
+/***********************************************************************
+ *
+ * Sending a chassis control to a set of domains.
+ *
+ **********************************************************************/
+
+typedef struct chassis_fanout_s chassis_fanout_t;
+
+typedef struct chassis_fanout_ent_s
+{
+    chassis_fanout_t *fo;
+    unsigned int     idx;
+    struct timeval   start;
+    int              err;
+} chassis_fanout_ent_t;
+
+struct chassis_fanout_s
+{
+    ipmi_lock_t                  *lock;
+    os_handler_t                 *os_hnd;
+    os_hnd_timer_id_t            *timer;
+    unsigned char                op;
+
+    ipmi_chassis_fanout_result_t *results;
+    chassis_fanout_ent_t         *ents;
+    unsigned int                 count;
+
+    unsigned int                 next;
+    unsigned int                 window;
+    unsigned int                 outstanding;
+    unsigned int                 failed;
+    unsigned int                 stagger_ms;
+    int                          timer_running;
+    int                          issuing;
+
+    ipmi_chassis_fanout_done_cb  done;
+    void                         *cb_data;
+};
+
+static void
+chassis_fanout_free(chassis_fanout_t *fo)
+{
+    if (fo->timer)
+	fo->os_hnd->free_timer(fo->os_hnd, fo->timer);
+    if (fo->lock)
+	ipmi_destroy_lock(fo->lock);
+    if (fo->results)
+	ipmi_mem_free(fo->results);
+    if (fo->ents)
+	ipmi_mem_free(fo->ents);
+    ipmi_mem_free(fo);
+}
+
+static void chassis_fanout_issue(chassis_fanout_t *fo);
+
+static int
+chassis_fanout_rsp(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
+{
+    chassis_fanout_ent_t *ent = rspi->data1;
+    chassis_fanout_t     *fo = ent->fo;
+    ipmi_msg_t           *msg = &rspi->msg;
+    struct timeval       now;
+    int                  err = 0;
+    long                 ms;
+
+    fo->os_hnd->get_monotonic_time(fo->os_hnd, &now);
+    ms = (((now.tv_sec - ent->start.tv_sec) * 1000)
+	  + ((now.tv_usec - ent->start.tv_usec) / 1000));
+    if (ms < 0)
+	ms = 0;
+
+    if (!domain)
+	err = ECANCELED;
+    else if (msg->data_len < 1)
+	err = EINVAL;
+    else if (msg->data[0] != 0)
+	err = IPMI_IPMI_ERR_VAL(msg->data[0]);
+
+    ipmi_lock(fo->lock);
+    fo->results[ent->idx].err = err;
+    fo->results[ent->idx].latency_ms = ms;
+    if (err)
+	fo->failed++;
+    fo->outstanding--;
+    chassis_fanout_issue(fo);
+    return IPMI_MSG_ITEM_NOT_USED;
+}
+
+static void
+chassis_fanout_start(ipmi_domain_t *domain, void *cb_data)
+{
+    chassis_fanout_ent_t         *ent = cb_data;
+    chassis_fanout_t             *fo = ent->fo;
+    ipmi_system_interface_addr_t si;
+    ipmi_msg_t                   msg;
+    unsigned char                data[1];
+
+    si.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
+    si.channel = IPMI_BMC_CHANNEL;
+    si.lun = 0;
+
+    msg.netfn = IPMI_CHASSIS_NETFN;
+    msg.cmd = IPMI_CHASSIS_CONTROL_CMD;
+    msg.data_len = 1;
+    msg.data = data;
+    data[0] = fo->op;
+
+    fo->os_hnd->get_monotonic_time(fo->os_hnd, &ent->start);
+    ent->err = ipmi_send_command_addr(domain,
+				      (ipmi_addr_t *) &si, sizeof(si),
+				      &msg, chassis_fanout_rsp, ent, NULL);
+}
+
+static void
+chassis_fanout_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    chassis_fanout_t *fo = cb_data;
+
+    ipmi_lock(fo->lock);
+    fo->timer_running = 0;
+    chassis_fanout_issue(fo);
+}
+
+/* Start as many commands as the window and stagger allow, and report
+   the results if everything is done.  Must be called with the lock
+   held, releases it. */
+static void
+chassis_fanout_issue(chassis_fanout_t *fo)
+{
+    chassis_fanout_ent_t *ent;
+    struct timeval       timeout;
+    int                  rv;
+
+    if (fo->issuing) {
+	ipmi_unlock(fo->lock);
+	return;
+    }
+    fo->issuing = 1;
+
+    while (!fo->timer_running && (fo->next < fo->count)
+	   && (fo->outstanding < fo->window))
+    {
+	ent = &fo->ents[fo->next];
+	fo->next++;
+	fo->outstanding++;
+	ipmi_unlock(fo->lock);
+
+	ent->err = 0;
+	rv = ipmi_domain_pointer_cb(fo->results[ent->idx].domain_id,
+				    chassis_fanout_start, ent);
+	if (!rv)
+	    rv = ent->err;
+
+	ipmi_lock(fo->lock);
+	if (rv) {
+	    /* Nothing was sent, so don't wait before the next one. */
+	    fo->results[ent->idx].err = rv;
+	    fo->failed++;
+	    fo->outstanding--;
+	    continue;
+	}
+
+	if (fo->stagger_ms && (fo->next < fo->count)) {
+	    timeout.tv_sec = fo->stagger_ms / 1000;
+	    timeout.tv_usec = (fo->stagger_ms % 1000) * 1000;
+	    rv = fo->os_hnd->start_timer(fo->os_hnd, fo->timer, &timeout,
+					 chassis_fanout_timeout, fo);
+	    if (!rv)
+		fo->timer_running = 1;
+	}
+    }
+    fo->issuing = 0;
+
+    if ((fo->outstanding == 0) && (fo->next >= fo->count)
+	&& !fo->timer_running)
+    {
+	ipmi_unlock(fo->lock);
+	fo->done(fo->results, fo->count, fo->failed, fo->cb_data);
+	chassis_fanout_free(fo);
+	return;
+    }
+    ipmi_unlock(fo->lock);
+}
+
+int
+ipmi_chassis_control_fanout(ipmi_domain_id_t            *domains,
+			    unsigned int                num_domains,
+			    unsigned int                op,
+			    unsigned int                max_concurrent,
+			    unsigned int                stagger_ms,
+			    ipmi_chassis_fanout_done_cb done,
+			    void                        *cb_data)
+{
+    chassis_fanout_t *fo;
+    unsigned int     i;
+    int              rv;
+
+    if (!domains || (num_domains == 0) || !done
+	|| (op > IPMI_CHASSIS_CTL_SOFT_SHUTDOWN))
+	return EINVAL;
+
+    fo = ipmi_mem_alloc(sizeof(*fo));
+    if (!fo)
+	return ENOMEM;
+    memset(fo, 0, sizeof(*fo));
+    fo->os_hnd = ipmi_get_global_os_handler();
+
+    rv = ipmi_create_global_lock(&fo->lock);
+    if (rv) {
+	fo->lock = NULL;
+	goto out_err;
+    }
+    rv = fo->os_hnd->alloc_timer(fo->os_hnd, &fo->timer);
+    if (rv) {
+	fo->timer = NULL;
+	goto out_err;
+    }
+
+    rv = ENOMEM;
+    fo->results = ipmi_mem_alloc(sizeof(*fo->results) * num_domains);
+    fo->ents = ipmi_mem_alloc(sizeof(*fo->ents) * num_domains);
+    if (!fo->results || !fo->ents)
+	goto out_err;
+
+    for (i=0; i<num_domains; i++) {
+	fo->results[i].domain_id = domains[i];
+	fo->results[i].err = 0;
+	fo->results[i].latency_ms = 0;
+	fo->ents[i].fo = fo;
+	fo->ents[i].idx = i;
+	fo->ents[i].err = 0;
+    }
+
+    fo->op = op;
+    fo->count = num_domains;
+    fo->window = max_concurrent;
+    if (fo->window == 0)
+	fo->window = num_domains;
+    fo->stagger_ms = stagger_ms;
+    fo->done = done;
+    fo->cb_data = cb_data;
+
+    ipmi_lock(fo->lock);
+    chassis_fanout_issue(fo);
+    return 0;
+
+ out_err:
+    chassis_fanout_free(fo);
+    return rv;
+}
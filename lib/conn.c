@@ -31,6 +31,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_CONN
+
 #include <errno.h>
 #include <string.h>
 
@@ -573,6 +575,251 @@ ipmi_ll_con_stat_get_user_data(ipmi_ll_stat_info_t *info)
     return info->user_data;
 }
 
+/***********************************************************************
+ *
+ * Command latency histograms
+ *
+ **********************************************************************/
+#define LAT_HASH_SIZE 64
+
+typedef struct lat_entry_s
+{
+    ipmi_con_latency_t lat;
+    struct lat_entry_s *next;
+} lat_entry_t;
+
+struct ipmi_con_lat_table_s
+{
+    ipmi_lock_t  *lock;
+    int          enabled;
+    unsigned int count;
+    lat_entry_t  *hash[LAT_HASH_SIZE];
+};
+
+static unsigned int
+lat_bucket(unsigned long usec)
+{
+    unsigned int msb;
+
+    if (usec > 0xffffffffUL)
+	usec = 0xffffffffUL;
+    if (usec < IPMI_CON_LAT_SUB_BUCKETS)
+	return usec;
+    msb = 31 - __builtin_clz((unsigned int) usec);
+    return (((msb - IPMI_CON_LAT_SUB_BITS + 1) * IPMI_CON_LAT_SUB_BUCKETS)
+	    + ((usec >> (msb - IPMI_CON_LAT_SUB_BITS))
+	       & (IPMI_CON_LAT_SUB_BUCKETS - 1)));
+}
+
+unsigned long
+ipmi_con_latency_bucket_low(unsigned int bucket)
+{
+    unsigned int octave = bucket / IPMI_CON_LAT_SUB_BUCKETS;
+    unsigned int sub = bucket % IPMI_CON_LAT_SUB_BUCKETS;
+
+    if (bucket >= IPMI_CON_LAT_BUCKETS)
+	return 0;
+    if (octave == 0)
+	return bucket;
+    return ((unsigned long) (IPMI_CON_LAT_SUB_BUCKETS + sub)) << (octave - 1);
+}
+
+unsigned long
+ipmi_con_latency_bucket_high(unsigned int bucket)
+{
+    unsigned int octave = bucket / IPMI_CON_LAT_SUB_BUCKETS;
+
+    if (bucket >= IPMI_CON_LAT_BUCKETS)
+	return 0;
+    if (octave == 0)
+	return bucket;
+    return (ipmi_con_latency_bucket_low(bucket)
+	    + (1UL << (octave - 1)) - 1);
+}
+
+unsigned long
+ipmi_con_latency_percentile(const ipmi_con_latency_t *lat, unsigned int pct)
+{
+    unsigned long long want, seen = 0;
+    unsigned int       i;
+
+    if (lat->count == 0)
+	return 0;
+    if (pct > 100)
+	pct = 100;
+    want = (((unsigned long long) lat->count * pct) + 99) / 100;
+    if (want == 0)
+	want = 1;
+    for (i=0; i<IPMI_CON_LAT_BUCKETS; i++) {
+	seen += lat->buckets[i];
+	if (seen >= want) {
+	    unsigned long high = ipmi_con_latency_bucket_high(i);
+	    return high > lat->max_usec ? lat->max_usec : high;
+	}
+    }
+    return lat->max_usec;
+}
+
+int
+ipmi_con_set_latency_tracking(ipmi_con_t *ipmi, int enable)
+{
+    struct ipmi_con_lat_table_s *t, *expected = NULL;
+    int                         rv;
+
+    t = __atomic_load_n(&ipmi->latency, __ATOMIC_ACQUIRE);
+    if (!t) {
+	if (!enable)
+	    return 0;
+	t = ipmi_mem_alloc(sizeof(*t));
+	if (!t)
+	    return ENOMEM;
+	memset(t, 0, sizeof(*t));
+	rv = ipmi_create_lock_os_hnd(ipmi->os_hnd, &t->lock);
+	if (rv) {
+	    ipmi_mem_free(t);
+	    return rv;
+	}
+	if (!__atomic_compare_exchange_n(&ipmi->latency, &expected, t, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+	    /* Someone else got there first. */
+	    ipmi_destroy_lock(t->lock);
+	    ipmi_mem_free(t);
+	    t = expected;
+	}
+    }
+    __atomic_store_n(&t->enabled, enable != 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int
+ipmi_con_get_latency_tracking(ipmi_con_t *ipmi)
+{
+    struct ipmi_con_lat_table_s *t;
+
+    t = __atomic_load_n(&ipmi->latency, __ATOMIC_ACQUIRE);
+    return t && __atomic_load_n(&t->enabled, __ATOMIC_RELAXED);
+}
+
+void
+ipmi_con_latency_add(ipmi_con_t    *ipmi,
+		     unsigned char netfn,
+		     unsigned char cmd,
+		     unsigned long usec,
+		     unsigned int  resends,
+		     int           timed_out)
+{
+    struct ipmi_con_lat_table_s *t;
+    lat_entry_t                 *e;
+    unsigned int                h;
+
+    t = __atomic_load_n(&ipmi->latency, __ATOMIC_ACQUIRE);
+    if (!t || !__atomic_load_n(&t->enabled, __ATOMIC_RELAXED))
+	return;
+
+    /* Responses have the odd netfn, count them with the request. */
+    netfn &= ~1;
+    h = ((netfn << 3) ^ cmd) % LAT_HASH_SIZE;
+
+    ipmi_lock(t->lock);
+    for (e = t->hash[h]; e; e = e->next) {
+	if ((e->lat.netfn == netfn) && (e->lat.cmd == cmd))
+	    break;
+    }
+    if (!e) {
+	e = ipmi_mem_alloc(sizeof(*e));
+	if (!e)
+	    goto out_unlock;
+	memset(e, 0, sizeof(*e));
+	e->lat.netfn = netfn;
+	e->lat.cmd = cmd;
+	e->next = t->hash[h];
+	t->hash[h] = e;
+	t->count++;
+    }
+
+    e->lat.resends += resends;
+    if (timed_out) {
+	e->lat.timeouts++;
+    } else {
+	if ((e->lat.count == 0) || (usec < e->lat.min_usec))
+	    e->lat.min_usec = usec;
+	if (usec > e->lat.max_usec)
+	    e->lat.max_usec = usec;
+	e->lat.count++;
+	e->lat.total_usec += usec;
+	e->lat.buckets[lat_bucket(usec)]++;
+    }
+ out_unlock:
+    ipmi_unlock(t->lock);
+}
+
+int
+ipmi_con_latency_snapshot(ipmi_con_t          *ipmi,
+			  int                 reset,
+			  ipmi_con_latency_cb handler,
+			  void                *cb_data)
+{
+    struct ipmi_con_lat_table_s *t;
+    ipmi_con_latency_t          *copy = NULL;
+    lat_entry_t                 *e;
+    unsigned int                i, count = 0;
+
+    t = __atomic_load_n(&ipmi->latency, __ATOMIC_ACQUIRE);
+    if (!t)
+	return 0;
+
+    ipmi_lock(t->lock);
+    if (handler && t->count) {
+	copy = ipmi_mem_alloc(sizeof(*copy) * t->count);
+	if (!copy) {
+	    ipmi_unlock(t->lock);
+	    return ENOMEM;
+	}
+    }
+    for (i=0; i<LAT_HASH_SIZE; i++) {
+	for (e = t->hash[i]; e; e = e->next) {
+	    if (copy)
+		copy[count++] = e->lat;
+	    if (reset) {
+		unsigned char netfn = e->lat.netfn, cmd = e->lat.cmd;
+
+		memset(&e->lat, 0, sizeof(e->lat));
+		e->lat.netfn = netfn;
+		e->lat.cmd = cmd;
+	    }
+	}
+    }
+    ipmi_unlock(t->lock);
+
+    for (i=0; i<count; i++)
+	handler(ipmi, &copy[i], cb_data);
+    if (copy)
+	ipmi_mem_free(copy);
+    return 0;
+}
+
+void
+ipmi_con_latency_cleanup(ipmi_con_t *ipmi)
+{
+    struct ipmi_con_lat_table_s *t = ipmi->latency;
+    lat_entry_t                 *e;
+    unsigned int                i;
+
+    if (!t)
+	return;
+    ipmi->latency = NULL;
+    for (i=0; i<LAT_HASH_SIZE; i++) {
+	while (t->hash[i]) {
+	    e = t->hash[i];
+	    t->hash[i] = e->next;
+	    ipmi_mem_free(e);
+	}
+    }
+    ipmi_destroy_lock(t->lock);
+    ipmi_mem_free(t);
+}
+
 /***********************************************************************
  *
  * Init/shutdown
@@ -37,6 +37,7 @@
 
 #include <OpenIPMI/ipmiif.h>
 #include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_batch.h>
 
 #include <OpenIPMI/internal/opq.h>
 #include <OpenIPMI/internal/locked_list.h>
@@ -69,6 +70,9 @@ struct ipmi_control_s
 {
     unsigned int usecount;
 
+    /* The domain handle given out in ids, 0 if none yet. */
+    unsigned int handle;
+
     ipmi_domain_t *domain;
     ipmi_mc_t *mc;
     unsigned char lun;
@@ -196,6 +200,17 @@ ipmi_control_convert_to_id(ipmi_control_t *control)
     val.lun = control->lun;
     val.control_num = control->num;
 
+    if (!control->handle && !control->destroyed) {
+	_ipmi_domain_entity_lock(control->domain);
+	if (!control->handle)
+	    control->handle = _ipmi_domain_handle_alloc(
+		control->domain, control, val.mcid.seq,
+		IPMI_DOMAIN_HANDLE_KEY(IPMI_DOMAIN_HANDLE_CONTROL,
+				       control->lun, control->num));
+	_ipmi_domain_entity_unlock(control->domain);
+    }
+    val.handle = control->handle;
+
     return val;
 }
 
@@ -257,6 +272,66 @@ mc_cb(ipmi_mc_t *mc, void *cb_data)
 	_ipmi_entity_put(entity);
 }
 
+/* Find the control with the handle in the id, without looking up
+   the MC.  Returns ENOENT if the handle is not good so the caller can
+   do it the normal way. */
+static int
+control_handle_cb(ipmi_control_id_t   id,
+		  ipmi_control_ptr_cb handler,
+		  void                *cb_data)
+{
+    ipmi_domain_t  *domain = id.mcid.domain_id.domain;
+    ipmi_control_t *control;
+    ipmi_entity_t  *entity;
+    ipmi_mc_t      *mc;
+    int            rv;
+
+    rv = _ipmi_domain_get(domain);
+    if (rv)
+	return rv;
+
+    _ipmi_domain_entity_lock(domain);
+    control = _ipmi_domain_handle_lookup(domain, id.handle, id.mcid.seq,
+					 IPMI_DOMAIN_HANDLE_KEY(
+					     IPMI_DOMAIN_HANDLE_CONTROL,
+					     id.lun, id.control_num));
+    if (!control || !control->mc) {
+	rv = ENOENT;
+	goto out_unlock;
+    }
+
+    rv = _ipmi_entity_get(control->entity);
+    if (rv)
+	goto out_unlock;
+    entity = control->entity;
+
+    rv = _ipmi_control_get(control);
+    if (rv) {
+	_ipmi_domain_entity_unlock(domain);
+	_ipmi_entity_put(entity);
+	goto out;
+    }
+
+    /* Hold the MC like a normal lookup would, it stays around while
+       the control is not destroyed. */
+    mc = control->mc;
+    _ipmi_mc_get(mc);
+    _ipmi_domain_entity_unlock(domain);
+
+    handler(control, cb_data);
+
+    _ipmi_control_put(control);
+    _ipmi_entity_put(entity);
+    _ipmi_mc_put(mc);
+    goto out;
+
+ out_unlock:
+    _ipmi_domain_entity_unlock(domain);
+ out:
+    _ipmi_domain_put(domain);
+    return rv;
+}
+
 int
 ipmi_control_pointer_cb(ipmi_control_id_t   id,
 			ipmi_control_ptr_cb handler,
@@ -268,6 +343,12 @@ ipmi_control_pointer_cb(ipmi_control_id_t   id,
     if (id.lun >= 5)
 	return EINVAL;
 
+    if (id.handle) {
+	rv = control_handle_cb(id, handler, cb_data);
+	if (rv != ENOENT)
+	    return rv;
+    }
+
     info.handler = handler;
     info.cb_data = cb_data;
     info.id = id;
@@ -410,6 +491,13 @@ handler_list_cleanup(void *cb_data, void *item1, void *item2)
 static void
 control_final_destroy(ipmi_control_t *control)
 {
+    if (control->handle) {
+	_ipmi_domain_entity_lock(control->domain);
+	_ipmi_domain_handle_free(control->domain, control->handle);
+	control->handle = 0;
+	_ipmi_domain_entity_unlock(control->domain);
+    }
+
     _ipmi_entity_get(control->entity);
     _ipmi_entity_call_control_handlers(control->entity, control, IPMI_DELETED);
 
@@ -1256,6 +1344,151 @@ ipmi_control_id_identifier_get_val(ipmi_control_id_t              control_id,
     return rv;
 }
 
+/***********************************************************************
+ *
+ * Setting and getting a set of controls as a batch.
+ *
+ **********************************************************************/
+
+typedef struct control_batch_s control_batch_t;
+
+typedef struct control_batch_ent_s
+{
+    control_batch_t *cb;
+    unsigned int    idx;   /* Index into the ops. */
+} control_batch_ent_t;
+
+struct control_batch_s
+{
+    ipmi_batch_t                 *batch;
+
+    ipmi_control_batch_op_t      *ops;
+    unsigned int                 count;
+    control_batch_ent_t          *ents;
+
+    ipmi_domain_control_batch_cb done;
+    void                         *cb_data;
+};
+
+static void
+control_batch_free(control_batch_t *cb)
+{
+    if (cb->ents)
+	ipmi_mem_free(cb->ents);
+    ipmi_mem_free(cb);
+}
+
+static void
+control_batch_done(ipmi_domain_t *domain,
+		   ipmi_batch_t  *batch,
+		   unsigned int  errs,
+		   void          *cb_data)
+{
+    control_batch_t *cb = cb_data;
+
+    cb->done(domain, cb->ops, cb->count, cb->cb_data);
+    control_batch_free(cb);
+}
+
+static void
+control_batch_set(ipmi_control_t *control, int err, void *cb_data)
+{
+    control_batch_ent_t *ent = cb_data;
+
+    ent->cb->ops[ent->idx].err = err;
+    ipmi_batch_item_done(ent->cb->batch, ent->idx, err);
+}
+
+static void
+control_batch_got(ipmi_control_t *control,
+		  int            err,
+		  int            *val,
+		  void           *cb_data)
+{
+    control_batch_ent_t     *ent = cb_data;
+    ipmi_control_batch_op_t *op = &ent->cb->ops[ent->idx];
+
+    if (!err && control)
+	memcpy(op->vals, val,
+	       sizeof(int) * ipmi_control_get_num_vals(control));
+    op->err = err;
+    ipmi_batch_item_done(ent->cb->batch, ent->idx, err);
+}
+
+static int
+control_batch_start(ipmi_batch_t *batch, unsigned int idx, void *cb_data)
+{
+    control_batch_t         *cb = cb_data;
+    ipmi_control_batch_op_t *op = &cb->ops[idx];
+    int                     rv;
+
+    if (op->set)
+	rv = ipmi_control_id_set_val(op->control_id, op->vals,
+				     control_batch_set, &cb->ents[idx]);
+    else
+	rv = ipmi_control_id_get_val(op->control_id,
+				     control_batch_got, &cb->ents[idx]);
+    if (rv)
+	op->err = rv;
+    return rv;
+}
+
+int
+ipmi_domain_control_batch(ipmi_domain_t                *domain,
+			  ipmi_control_batch_op_t      *ops,
+			  unsigned int                 count,
+			  ipmi_domain_control_batch_cb done,
+			  void                         *cb_data)
+{
+    control_batch_t *cb;
+    unsigned int    i;
+    int             rv;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (!done || !ops || (count == 0))
+	return EINVAL;
+
+    for (i=0; i<count; i++) {
+	if (!ops[i].vals)
+	    return EINVAL;
+    }
+
+    cb = ipmi_mem_alloc(sizeof(*cb));
+    if (!cb)
+	return ENOMEM;
+    memset(cb, 0, sizeof(*cb));
+
+    rv = ENOMEM;
+    cb->ents = ipmi_mem_alloc(sizeof(*cb->ents) * count);
+    if (!cb->ents)
+	goto out_err;
+
+    cb->ops = ops;
+    cb->count = count;
+    cb->done = done;
+    cb->cb_data = cb_data;
+
+    rv = ipmi_batch_alloc(domain, count, control_batch_start, NULL,
+			  control_batch_done, cb, &cb->batch);
+    if (rv)
+	goto out_err;
+
+    for (i=0; i<count; i++) {
+	ops[i].err = 0;
+	cb->ents[i].cb = cb;
+	cb->ents[i].idx = i;
+	ipmi_batch_set_mc(cb->batch, i, ops[i].control_id.mcid);
+    }
+
+    ipmi_batch_start(cb->batch);
+    return 0;
+
+ out_err:
+    control_batch_free(cb);
+    return rv;
+}
+
 /***********************************************************************
  *
  * Event handling for controls.
@@ -31,9 +31,12 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_DOMAIN
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 
 #include <OpenIPMI/ipmi_conn.h>
 #include <OpenIPMI/ipmiif.h>
@@ -43,7 +46,8 @@
 #include <OpenIPMI/ipmi_auth.h>
 
 #include <OpenIPMI/internal/locked_list.h>
-#include <OpenIPMI/internal/ilist.h>
+#include <OpenIPMI/internal/ivec.h>
+#include <OpenIPMI/internal/htable.h>
 #include <OpenIPMI/internal/ipmi_event.h>
 #include <OpenIPMI/internal/ipmi_int.h>
 #include <OpenIPMI/internal/ipmi_oem.h>
@@ -72,6 +76,9 @@ dump_hex(const unsigned char *data, int len)
 /* Re-query the SEL every 10 seconds by default. */
 #define IPMI_SEL_QUERY_INTERVAL 10
 
+/* Probe up to 4 IPMB addresses at once by default. */
+#define DEFAULT_IPMB_SCAN_PARALLEL 4
+
 /* Timer structure for rescanning the bus. */
 typedef struct audit_domain_info_s
 {
@@ -83,24 +90,65 @@ typedef struct audit_domain_info_s
 
 /* Used to keep a record of a bus scan. */
 typedef struct mc_ipmb_scan_info_s mc_ipmb_scan_info_t;
-struct mc_ipmb_scan_info_s
+
+/* One Get Device ID of a bus scan.  A scan runs several of these at
+   once, but handles their results in address order. */
+#define PROBE_IDLE	0
+#define PROBE_WAITING	1
+#define PROBE_DONE	2
+typedef struct mc_ipmb_probe_s
 {
+    mc_ipmb_scan_info_t *info;
+    int                 state;
     ipmi_addr_t         addr;
+    unsigned int        missed_responses;
+    int                 give_up; /* The MC missed too many responses */
+    int                 timer_running;
+    os_hnd_timer_id_t   *timer;
+
+    /* The response, kept until it is this probe's turn. */
+    ipmi_addr_t         rsp_addr;
+    unsigned int        rsp_addr_len;
+    ipmi_msg_t          rsp;
+    unsigned char       rsp_data[IPMI_MAX_MSG_LENGTH];
+} mc_ipmb_probe_t;
+
+struct mc_ipmb_scan_info_s
+{
+    ipmi_addr_t         addr; /* The template for the probe addresses. */
     unsigned int        addr_len;
     ipmi_domain_t       *domain;
     ipmi_msg_t          msg;
+    unsigned int        next_addr;
     unsigned int        end_addr;
+    int                 addrs_left;
     ipmi_domain_cb      done_handler;
     void                *cb_data;
     mc_ipmb_scan_info_t *next;
-    unsigned int        missed_responses;
     int                 cancelled;
-    int                 timer_running;
+    unsigned int        timers_running;
     os_handler_t        *os_hnd;
-    os_hnd_timer_id_t   *timer;
     ipmi_lock_t         *lock;
+
+    /* Only one thread handles results and starts new probes, if
+       another thread gets a result while that is going on it sets
+       advance_again instead. */
+    int                 in_advance;
+    int                 advance_again;
+
+    /* The probes in use are the "active" ones starting at "head",
+       wrapping around, in address order. */
+    unsigned int        num_probes;
+    unsigned int        head;
+    unsigned int        active;
+    mc_ipmb_probe_t     *probes;
+
+    /* Probes must get a token from _ipmi_pace_background(). */
+    int                 throttled;
 };
 
+static void free_bus_scan(mc_ipmb_scan_info_t *info);
+
 /* This structure tracks messages sent to the domain, it is primarily
    here so messages can be rerouted to other connections when a
    connection fails. */
@@ -119,7 +167,10 @@ typedef struct ll_msg_s
 
     int                          side_effects;
 
-    ilist_item_t link;
+    /* When the user stops caring about the response, for the
+       connection's deadline option. */
+    int                          has_deadline;
+    struct timeval               deadline;
 } ll_msg_t;
 
 typedef struct activate_timer_info_s
@@ -133,12 +184,55 @@ typedef struct activate_timer_info_s
 
 typedef struct domain_check_oem_s domain_check_oem_t;
 
-typedef struct mc_table_s
+/* The work queue for one user event handler when events to the
+   handlers are queued. */
+typedef struct event_hqueue_s
+{
+    ipmi_event_handler_cb handler;
+    void                  *cb_data;
+    os_hnd_work_queue_t   *wq;
+    struct event_hqueue_s *next;
+} event_hqueue_t;
+
+/* How many recent events of a sensor are remembered to find
+   duplicates. */
+#define EVENT_DEDUP_HIST 4
+
+/* The filter state of one sensor. */
+typedef struct event_filter_s
+{
+    ipmi_sensor_id_t id;
+
+    /* The direction/type byte and event data of recent events, and
+       when they came in. */
+    struct {
+	unsigned char  data[4];
+	struct timeval time;
+    } recent[EVENT_DEDUP_HIST];
+    unsigned int     num_recent;
+    unsigned int     next_recent;
+
+    /* The current rate limit period. */
+    struct timeval   period_start;
+    unsigned int     period_count;
+    unsigned int     suppressed;
+} event_filter_t;
+
+static void
+free_event_filter(void *item, void *cb_data)
+{
+    ipmi_mem_free(item);
+}
+
+
+typedef struct bringup_span_s bringup_span_t;
+
+typedef struct domain_handle_s
 {
-    unsigned short size;
-    unsigned short curr;
-    ipmi_mc_t      **mcs;
-} mc_table_t;
+    void         *obj; /* NULL if free. */
+    long         seq;
+    unsigned int key;  /* The next free slot if free. */
+} domain_handle_t;
 
 struct ipmi_domain_s
 {
@@ -149,6 +243,7 @@ struct ipmi_domain_s
     /* Used to handle shutdown race conditions. */
     int             valid;
     int             in_shutdown;
+    unsigned int    close_flags;
 
     /* Is anyone using this domain? */
     unsigned int    usecount;
@@ -159,6 +254,15 @@ struct ipmi_domain_s
     /* OS handler to use for domain operations. */
     os_handler_t *os_hnd;
 
+    /* The reactor of the first connection, the domain's timers go
+       there too.  -1 if the connection isn't on one. */
+    int reactor;
+
+    /* Sensors and entities from the SDRs are allocated from here.
+       NULL if it couldn't be allocated, they are allocated normally
+       then. */
+    ipmi_arena_t *arena;
+
     /* A lock for handling miscellaneous data changes. */
     ipmi_lock_t *domain_lock;
 
@@ -191,15 +295,36 @@ struct ipmi_domain_s
     /* Used for generating unique numbers for a domain. */
     unsigned int uniq_num;
 
-#define IPMB_HASH 32
-    mc_table_t ipmb_mcs[IPMB_HASH];
-#define MAX_CONS 2
+    /* IPMB MCs, hashed by channel and slave address. */
+    htable_t   *ipmb_mcs;
+
+    /* The IPMB MCs sorted by channel and address for iterating.  This
+       is rebuilt from the hash table the next time it is needed after
+       an MC is added or removed. */
+    ipmi_mc_t    **ipmb_mc_order;
+    unsigned int ipmb_mc_order_len;
+    int          ipmb_mc_order_stale;
+#define MAX_CONS IPMI_DOMAIN_MAX_CONS
     ipmi_mc_t *sys_intf_mcs[MAX_CONS];
     ipmi_lock_t *mc_lock;
 
+    /* Protects ipmb_mcs, ipmb_mc_order and sys_intf_mcs.  Finding an
+       MC by address happens for every message and event, so that
+       only takes this for read and not the domain MC lock.  Nothing
+       is called with this held. */
+    ipmi_rwlock_t *mc_table_lock;
+
+    /* MC startups running and waiting to run, see
+       _ipmi_domain_mc_startup().  Queue 0 is for MCs with device SDRs,
+       queue 1 for the rest. */
+    ipmi_lock_t           *mc_startup_lock;
+    unsigned int          mc_startups_running;
+    struct mc_startup_s   *mc_startup_q[2];
+    struct mc_startup_s   *mc_startup_q_tail[2];
+
     /* A list of outstanding messages.  We use this so we can reroute
        messages to another connection in case a connection fails. */
-    ilist_t     *cmds;
+    ivec_t     *cmds;
     ipmi_lock_t *cmds_lock;
     long        cmds_seq; /* Sequence number for messages to avoid
 			     reuse problems. */
@@ -207,11 +332,93 @@ struct ipmi_domain_s
 				       switchovers to avoid handling
 				       old messages. */
 
+    /* Every message sent through the domain and not yet answered,
+       and the limit on that (0 for none).  A send past the limit
+       fails with EAGAIN and sets cmds_blocked, then cmd_ready is
+       called once things drain to half the limit.  Protected by
+       cmds_lock. */
+    unsigned int cmds_outstanding;
+    unsigned int cmds_limit;
+    int          cmds_blocked;
+    ipmi_domain_cmd_ready_cb cmd_ready;
+    void         *cmd_ready_cb_data;
+
     locked_list_t            *event_handlers;
     locked_list_t            *event_handlers_cl;
+
+    /* If the OS handler has a worker pool, incoming events are
+       handled from this so the event and sensor handlers don't hold
+       up I/O.  The queue keeps the domain's events in order. */
+    os_hnd_work_queue_t      *event_wq;
+
+    /* If event_queue_max is not zero, the calls to the user's event
+       handlers are queued to the worker pool instead of being made
+       from the thread that got the event, with at most
+       event_queue_max waiting.  Each handler gets its own queue so a
+       slow handler only holds up its own events. */
+    ipmi_lock_t              *event_queue_lock;
+    unsigned int             event_queue_max;
+    unsigned int             event_queue_count;
+    event_hqueue_t           *event_hqueues;
+    ipmi_domain_stat_t       *event_queued_stat;
+    ipmi_domain_stat_t       *event_queue_full_stat;
+
+    /* Dropping of duplicate and excess sensor events, see
+       ipmi_domain_set_event_dedup_window() and
+       ipmi_domain_set_event_rate_limit().  The filter state for each
+       sensor is kept in event_filters, hashed by sensor. */
+    ipmi_lock_t              *event_filter_lock;
+    htable_t                 *event_filters;
+    unsigned int             event_dedup_window;
+    unsigned int             event_rate_max;
+    unsigned int             event_rate_period;
+    ipmi_event_suppressed_cb event_suppressed_handler;
+    void                     *event_suppressed_cb_data;
+
+    /* See ipmi_domain_set_sensor_update_handler(). */
+    ipmi_sensor_update_cb    sensor_update_handler;
+    void                     *sensor_update_cb_data;
+
+    /* See ipmi_domain_set_update_batch_handler().  batch_depth counts
+       the SDR passes running, changes are only kept while it is not
+       zero.  These are all under domain_lock. */
+    ipmi_update_batch_cb       update_batch_handler;
+    void                       *update_batch_cb_data;
+    unsigned int               batch_depth;
+    ipmi_update_batch_change_t *batch_changes;
+    unsigned int               batch_num_changes;
+    unsigned int               batch_changes_size;
+    ipmi_domain_stat_t       *event_dedup_stat;
+    ipmi_domain_stat_t       *event_rate_limit_stat;
     ipmi_oem_event_handler_cb oem_event_handler;
     void                      *oem_event_cb_data;
 
+    /* Time spent in each bring-up phase and the commands sent and
+       responses received, all in the domain statistics.  bringup_start
+       is when the current connection attempt started, phase_start when
+       the current phase started. */
+    struct timeval           bringup_start;
+    struct timeval           phase_start;
+    struct timeval           ipmb_scan_start;
+    int                      ipmb_scan_timed;
+    ipmi_domain_stat_t       *phase_stats[IPMI_DOMAIN_PHASE_NUM];
+    ipmi_domain_stat_t       *cmds_sent_stat;
+    ipmi_domain_stat_t       *cmd_bytes_sent_stat;
+    ipmi_domain_stat_t       *rsps_received_stat;
+    ipmi_domain_stat_t       *rsp_bytes_received_stat;
+
+    /* Bring-up recording, see IPMI_OPEN_OPTION_RECORD_BRINGUP.  The
+       lock is only allocated if recording is on.  Span ids are the
+       index in spans plus one, zero means no span.  step_span is the
+       current step of the domain's own bring-up, scan_span the full
+       IPMB scan the MCs found depend on. */
+    ipmi_lock_t              *bringup_lock;
+    bringup_span_t           *spans;
+    unsigned int             num_spans;
+    unsigned int             spans_size;
+    int                      step_span;
+    int                      scan_span;
+
     locked_list_t            *new_sensor_handlers; /* callbacks for
                                              OEM-specific sensors*/
 
@@ -220,13 +427,35 @@ struct ipmi_domain_s
     /* Are we in the middle of an MC bus scan? */
     int scanning_bus_count;
 
+    /* The MCs came from the saved topology, so the bus scans don't
+       need to hold up fully up. */
+    int scan_in_background;
+
+    /* The bus scans being started are from the audit, so their
+       probes go through the background operation limit. */
+    int throttle_scans;
+
     ipmi_entity_info_t    *entities;
     ipmi_lock_t           *entities_lock;
 
+    /* Handles for sensor and control ids, so they can be found
+       without looking up the MC, see _ipmi_domain_handle_alloc().
+       handles_free is the first free slot (+1), 0 if none.  These
+       are protected by the entities lock. */
+    domain_handle_t       *handles;
+    unsigned int          handles_size;
+    unsigned int          handles_free;
+
     ipmi_lock_t   *con_lock;
     int           working_conn;
     ipmi_con_t    *conn[MAX_CONS];
     int           con_active[MAX_CONS];
+
+    /* How IPMB messages pick a connection, and how many tracked
+       messages each connection has outstanding (protected by
+       cmds_lock). */
+    int           con_routing;
+    unsigned int  con_outstanding[MAX_CONS];
     unsigned char con_ipmb_addr[MAX_CONS][MAX_IPMI_USED_CHANNELS];
 
     int           con_up[MAX_CONS];
@@ -257,6 +486,13 @@ struct ipmi_domain_s
     os_hnd_timer_id_t   *audit_domain_timer;
     audit_domain_info_t *audit_domain_timer_info;
 
+    /* If not zero, the audit only scans the whole IPMB this often, in
+       seconds, and in between just probes the MCs already known.
+       Addresses that events say have changed are probed right away.
+       last_full_ipmb_scan is monotonic time. */
+    unsigned int        ipmb_full_rescan_interval;
+    struct timeval      last_full_ipmb_scan;
+
     /* This is a list of all the bus scans currently happening, so
        they can be properly freed. */
     mc_ipmb_scan_info_t *bus_scans_running;
@@ -271,7 +507,7 @@ struct ipmi_domain_s
     locked_list_t *mc_upd_cl_handlers;
 
     /* A list of IPMB addresses to not scan. */
-    ilist_t     *ipmb_ignores;
+    ivec_t     *ipmb_ignores;
     ipmi_lock_t *ipmb_ignores_lock;
 
     /* This is a timer that waits a little while before activating a
@@ -281,6 +517,10 @@ struct ipmi_domain_s
     activate_timer_info_t *activate_timer_info;
 
     unsigned int default_sel_rescan_time;
+    unsigned int default_sel_rescan_max_time;
+
+    /* How many addresses an IPMB scan probes at once. */
+    unsigned int ipmb_scan_parallel;
 
     /* Used to inform the user that the main SDR has been read. */
     ipmi_domain_cb SDRs_read_handler;
@@ -320,9 +560,6 @@ struct ipmi_domain_s
     /* Statistics for the domain. */
     locked_list_t *stats;
 
-    /* Keep a linked-list of these. */
-    ipmi_domain_t *next, *prev;
-
     /* Cruft... */
     struct ipmi_domain_mc_upd_s     *mc_upd_cruft;
     struct ipmi_event_handler_id_s  *event_cruft;
@@ -346,6 +583,9 @@ struct ipmi_domain_s
     unsigned int option_local_only : 1;
     unsigned int option_local_only_set : 1;
     unsigned int option_use_cache : 1;
+    unsigned int option_sdr_incremental : 1;
+    unsigned int option_sel_cache : 1;
+    unsigned int option_record_bringup : 1;
 };
 
 /* A list of all domains in the system. */
@@ -360,6 +600,8 @@ static void cancel_domain_oem_check(ipmi_domain_t *domain);
 static void real_close_connection(ipmi_domain_t *domain);
 
 static void free_domain_cruft(ipmi_domain_t *domain);
+static void bringup_step(ipmi_domain_t *domain, const char *name);
+static void free_bringup_spans(ipmi_domain_t *domain);
 
 static void ll_con_changed(ipmi_con_t   *ipmi,
 			   int          err,
@@ -538,6 +780,14 @@ _ipmi_domain_in_shutdown(ipmi_domain_t *domain)
     return domain->in_shutdown;
 }
 
+int
+_ipmi_domain_quiet_close(ipmi_domain_t *domain)
+{
+    return (domain->in_shutdown
+	    && (domain->close_flags & IPMI_DOMAIN_CLOSE_NO_CALLBACKS)
+	    && !domain->oem_data);
+}
+
 static void
 iterate_cleanup_mc(ipmi_domain_t *domain, ipmi_mc_t *mc, void *cb_data)
 {
@@ -610,16 +860,16 @@ cleanup_domain(ipmi_domain_t *domain)
     if ((domain->cmds_lock) && (domain->cmds)) {
 	ll_msg_t     *nmsg;
 	int          ok;
-	ilist_iter_t iter;
+	ivec_iter_t iter;
 
 	ipmi_lock(domain->cmds_lock);
 
-	ilist_init_iter(&iter, domain->cmds);
-	ok = ilist_first(&iter);
+	ivec_init_iter(&iter, domain->cmds);
+	ok = ivec_first(&iter);
 	while (ok) {
 	    ipmi_msgi_t *rspi;
 
-	    nmsg = ilist_get(&iter);
+	    nmsg = ivec_get(&iter);
 	    rspi = nmsg->rsp_item;
 
 	    rspi->msg.netfn = nmsg->msg.netfn | 1;
@@ -629,16 +879,19 @@ cleanup_domain(ipmi_domain_t *domain)
 	    rspi->msg.data[0] = IPMI_UNKNOWN_ERR_CC;
 	    deliver_rsp(domain, nmsg->rsp_handler, rspi);
 	    
-	    ilist_delete(&iter);
+	    ivec_delete(&iter);
 	    ipmi_mem_free(nmsg);
-	    ok = ilist_first(&iter);
+	    ok = ivec_first(&iter);
 	}
 	ipmi_unlock(domain->cmds_lock);
     }
     if (domain->cmds_lock)
 	ipmi_destroy_lock(domain->cmds_lock);
     if (domain->cmds)
-	free_ilist(domain->cmds);
+	free_ivec(domain->cmds);
+
+    if (domain->mc_startup_lock)
+	ipmi_destroy_lock(domain->mc_startup_lock);
 
     /* Shutdown code called here. */
     if (domain->shutdown_handler)
@@ -743,6 +996,51 @@ cleanup_domain(ipmi_domain_t *domain)
 	}
     }
 
+    if (domain->event_wq)
+	domain->os_hnd->free_work_queue(domain->os_hnd, domain->event_wq);
+
+    /* Work still on these finds the domain gone and does nothing. */
+    while (domain->event_hqueues) {
+	event_hqueue_t *hq = domain->event_hqueues;
+
+	domain->event_hqueues = hq->next;
+	domain->os_hnd->free_work_queue(domain->os_hnd, hq->wq);
+	ipmi_mem_free(hq);
+    }
+    if (domain->event_queued_stat)
+	ipmi_domain_stat_put(domain->event_queued_stat);
+    if (domain->event_queue_full_stat)
+	ipmi_domain_stat_put(domain->event_queue_full_stat);
+    if (domain->event_queue_lock)
+	ipmi_destroy_lock(domain->event_queue_lock);
+
+    if (domain->event_filters) {
+	htable_iter(domain->event_filters, free_event_filter, NULL);
+	free_htable(domain->event_filters);
+    }
+    if (domain->event_dedup_stat)
+	ipmi_domain_stat_put(domain->event_dedup_stat);
+    if (domain->event_rate_limit_stat)
+	ipmi_domain_stat_put(domain->event_rate_limit_stat);
+    if (domain->event_filter_lock)
+	ipmi_destroy_lock(domain->event_filter_lock);
+
+    for (i=0; i<IPMI_DOMAIN_PHASE_NUM; i++) {
+	if (domain->phase_stats[i])
+	    ipmi_domain_stat_put(domain->phase_stats[i]);
+    }
+    if (domain->cmds_sent_stat)
+	ipmi_domain_stat_put(domain->cmds_sent_stat);
+    if (domain->cmd_bytes_sent_stat)
+	ipmi_domain_stat_put(domain->cmd_bytes_sent_stat);
+    if (domain->rsps_received_stat)
+	ipmi_domain_stat_put(domain->rsps_received_stat);
+    if (domain->rsp_bytes_received_stat)
+	ipmi_domain_stat_put(domain->rsp_bytes_received_stat);
+    free_bringup_spans(domain);
+    if (domain->batch_changes)
+	ipmi_mem_free(domain->batch_changes);
+
     if (domain->event_handlers) {
 	locked_list_iterate(domain->event_handlers, event_handler_cleanup,
 			    domain);
@@ -763,32 +1061,37 @@ cleanup_domain(ipmi_domain_t *domain)
         locked_list_destroy(domain->new_sensor_handlers);
 
     if (domain->ipmb_ignores) {
-	ilist_iter_t iter;
-	ilist_init_iter(&iter, domain->ipmb_ignores);
-	while (ilist_first(&iter)) {
-	    ilist_delete(&iter);
+	ivec_iter_t iter;
+	ivec_init_iter(&iter, domain->ipmb_ignores);
+	while (ivec_first(&iter)) {
+	    ivec_delete(&iter);
 	}
-	free_ilist(domain->ipmb_ignores);
+	free_ivec(domain->ipmb_ignores);
     }
     if (domain->bus_scans_running) {
 	mc_ipmb_scan_info_t *item;
+	mc_ipmb_probe_t     *probe;
+	unsigned int        i, running;
 	while (domain->bus_scans_running) {
 	    item = domain->bus_scans_running;
 	    domain->bus_scans_running = item->next;
 	    ipmi_lock(item->lock);
-	    if (item->timer_running) {
-		if (item->os_hnd->stop_timer(item->os_hnd, item->timer)) {
-		    item->cancelled = 1;
-		    ipmi_unlock(item->lock);
-		    item = NULL;
+	    for (i=0; i<item->num_probes; i++) {
+		probe = &item->probes[i];
+		if (probe->timer_running
+		    && !item->os_hnd->stop_timer(item->os_hnd, probe->timer))
+		{
+		    probe->timer_running = 0;
+		    item->timers_running--;
 		}
 	    }
-	    if (item) {
-		ipmi_unlock(item->lock);
-		item->os_hnd->free_timer(item->os_hnd, item->timer);
-		ipmi_destroy_lock(item->lock);
-		ipmi_mem_free(item);
-	    }
+	    /* Timers we couldn't stop are in their handler, the last
+	       one will free the scan. */
+	    item->cancelled = 1;
+	    running = item->timers_running;
+	    ipmi_unlock(item->lock);
+	    if (!running)
+		free_bus_scan(item);
 	}
     }
 
@@ -796,6 +1099,8 @@ cleanup_domain(ipmi_domain_t *domain)
        refer to them. */
     if (domain->entities)
 	ipmi_entity_info_destroy(domain->entities);
+    if (domain->handles)
+	ipmi_mem_free(domain->handles);
     if (domain->entities_lock)
 	ipmi_destroy_lock(domain->entities_lock);
 
@@ -809,10 +1114,10 @@ cleanup_domain(ipmi_domain_t *domain)
     if (domain->mc_upd_cl_handlers)
 	locked_list_destroy(domain->mc_upd_cl_handlers);
 
-    for (i=0; i<IPMB_HASH; i++) {
-	if (domain->ipmb_mcs[i].mcs)
-	    ipmi_mem_free(domain->ipmb_mcs[i].mcs);
-    }
+    if (domain->ipmb_mcs)
+	free_htable(domain->ipmb_mcs);
+    if (domain->ipmb_mc_order)
+	ipmi_mem_free(domain->ipmb_mc_order);
 
     /* We wait until here to call the OEM data destroyer, the process
        of destroying information that has previously gone on can call
@@ -824,11 +1129,17 @@ cleanup_domain(ipmi_domain_t *domain)
     if (domain->con_stat_info)
 	ipmi_ll_con_free_stat_info(domain->con_stat_info);
 
+    /* Anything still using arena memory keeps its chunk around. */
+    if (domain->arena)
+	ipmi_arena_release(domain->arena);
+
     /* Locks must be last, because they can be used by many things. */
     if (domain->ipmb_ignores_lock)
 	ipmi_destroy_lock(domain->ipmb_ignores_lock);
     if (domain->mc_lock)
 	ipmi_destroy_lock(domain->mc_lock);
+    if (domain->mc_table_lock)
+	ipmi_destroy_rwlock(domain->mc_table_lock);
     if (domain->con_lock)
 	ipmi_destroy_lock(domain->con_lock);
     if (domain->domain_lock)
@@ -905,6 +1216,20 @@ process_options(ipmi_domain_t      *domain,
 	case IPMI_OPEN_OPTION_USE_CACHE:
 	    domain->option_use_cache = options[i].ival != 0;
 	    break;
+	case IPMI_OPEN_OPTION_SDR_INCREMENTAL:
+	    domain->option_sdr_incremental = options[i].ival != 0;
+	    break;
+	case IPMI_OPEN_OPTION_SEL_CACHE:
+	    domain->option_sel_cache = options[i].ival != 0;
+	    break;
+	case IPMI_OPEN_OPTION_RECORD_BRINGUP:
+	    domain->option_record_bringup = options[i].ival != 0;
+	    break;
+	case IPMI_OPEN_OPTION_SPREAD_CONS:
+	    domain->con_routing = (options[i].ival
+				   ? IPMI_DOMAIN_ROUTE_SPREAD
+				   : IPMI_DOMAIN_ROUTE_WORKING);
+	    break;
 	case IPMI_OPEN_OPTION_ACTIVATE_IF_POSSIBLE:
 	    domain->option_activate_if_possible = options[i].ival != 0;
 	    break;
@@ -920,6 +1245,41 @@ process_options(ipmi_domain_t      *domain,
     return 0;
 }
 
+static const char *phase_stat_names[IPMI_DOMAIN_PHASE_NUM] =
+{
+    "bringup_connect_ms",
+    "bringup_oem_check_ms",
+    "bringup_sdr_fetch_ms",
+    "bringup_ipmb_scan_ms",
+    "bringup_entity_sensor_ms",
+};
+
+void
+_ipmi_domain_phase_time(ipmi_domain_t  *domain,
+			unsigned int   phase,
+			struct timeval *start)
+{
+    struct timeval now;
+    long           ms;
+
+    if ((phase >= IPMI_DOMAIN_PHASE_NUM) || !domain->phase_stats[phase])
+	return;
+
+    domain->os_hnd->get_monotonic_time(domain->os_hnd, &now);
+    ms = ((now.tv_sec - start->tv_sec) * 1000
+	  + (now.tv_usec - start->tv_usec) / 1000);
+    if (ms > 0)
+	ipmi_domain_stat_add(domain->phase_stats[phase], ms);
+}
+
+/* End the current bring-up phase and start the next one. */
+static void
+phase_done(ipmi_domain_t *domain, unsigned int phase)
+{
+    _ipmi_domain_phase_time(domain, phase, &domain->phase_start);
+    domain->os_hnd->get_monotonic_time(domain->os_hnd, &domain->phase_start);
+}
+
 static int
 setup_domain(const char         *name,
 	     ipmi_con_t         *ipmi[],
@@ -953,6 +1313,7 @@ setup_domain(const char         *name,
     domain->option_local_only = 0;
     domain->option_local_only_set = 0;
     domain->option_use_cache = 1;
+    domain->con_routing = IPMI_DOMAIN_ROUTE_WORKING;
 
     priv = IPMI_PRIVILEGE_ADMIN;
     for (i=0; i<num_con; i++) {
@@ -978,6 +1339,9 @@ setup_domain(const char         *name,
     }
 
     domain->os_hnd = ipmi[0]->os_hnd;
+    domain->reactor = -1;
+    if (ipmi[0]->get_reactor)
+	domain->reactor = ipmi[0]->get_reactor(ipmi[0]);
 
     domain->valid = 1;
     domain->in_shutdown = 0;
@@ -1029,10 +1393,22 @@ setup_domain(const char         *name,
     /* Set the default timer intervals. */
     domain->audit_domain_interval = IPMI_AUDIT_DOMAIN_INTERVAL;
 
+    domain->ipmb_scan_parallel = DEFAULT_IPMB_SCAN_PARALLEL;
+
+    domain->ipmb_mcs = alloc_htable();
+    if (!domain->ipmb_mcs) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+
     rv = ipmi_create_lock(domain, &domain->mc_lock);
     if (rv)
 	goto out_err;
 
+    rv = ipmi_create_rwlock_os_hnd(domain->os_hnd, &domain->mc_table_lock);
+    if (rv)
+	goto out_err;
+
     rv = ipmi_create_lock(domain, &domain->con_lock);
     if (rv)
 	goto out_err;
@@ -1041,6 +1417,9 @@ setup_domain(const char         *name,
     if (rv)
 	goto out_err;
 
+    if (ipmi_arena_alloc_arena(domain->os_hnd, &domain->arena))
+	domain->arena = NULL;
+
     rv = ipmi_create_lock(domain, &domain->entities_lock);
     if (rv)
 	goto out_err;
@@ -1061,8 +1440,7 @@ setup_domain(const char         *name,
     if (rv)
 	goto out_err;
 
-    rv = domain->os_hnd->alloc_timer(domain->os_hnd,
-				     &(domain->activate_timer));
+    rv = _ipmi_domain_alloc_timer(domain, &(domain->activate_timer));
     if (rv)
 	goto out_err;
 
@@ -1078,6 +1456,55 @@ setup_domain(const char         *name,
 	goto out_err;
     }
 
+    rv = ipmi_create_lock(domain, &domain->event_queue_lock);
+    if (rv)
+	goto out_err;
+    ipmi_domain_stat_register(domain, "event_queued", domain->name,
+			      &domain->event_queued_stat);
+    ipmi_domain_stat_register(domain, "event_queue_full", domain->name,
+			      &domain->event_queue_full_stat);
+
+    rv = ipmi_create_lock(domain, &domain->event_filter_lock);
+    if (rv)
+	goto out_err;
+    domain->event_filters = alloc_htable();
+    if (!domain->event_filters) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+    ipmi_domain_stat_register(domain, "event_deduped", domain->name,
+			      &domain->event_dedup_stat);
+    ipmi_domain_stat_register(domain, "event_rate_limited", domain->name,
+			      &domain->event_rate_limit_stat);
+
+    for (i=0; i<IPMI_DOMAIN_PHASE_NUM; i++)
+	ipmi_domain_stat_register(domain, phase_stat_names[i], domain->name,
+				  &domain->phase_stats[i]);
+    ipmi_domain_stat_register(domain, "cmds_sent", domain->name,
+			      &domain->cmds_sent_stat);
+    ipmi_domain_stat_register(domain, "cmd_bytes_sent", domain->name,
+			      &domain->cmd_bytes_sent_stat);
+    ipmi_domain_stat_register(domain, "rsps_received", domain->name,
+			      &domain->rsps_received_stat);
+    ipmi_domain_stat_register(domain, "rsp_bytes_received", domain->name,
+			      &domain->rsp_bytes_received_stat);
+    domain->os_hnd->get_monotonic_time(domain->os_hnd,
+				       &domain->bringup_start);
+
+    if (domain->option_record_bringup) {
+	rv = ipmi_create_lock(domain, &domain->bringup_lock);
+	if (rv)
+	    goto out_err;
+	bringup_step(domain, "connect");
+    }
+
+    /* Not having a worker pool is fine, events are just handled
+       inline. */
+    if (domain->os_hnd->alloc_work_queue
+	&& domain->os_hnd->alloc_work_queue(domain->os_hnd,
+					    &domain->event_wq))
+	domain->event_wq = NULL;
+
     domain->attr = locked_list_alloc(domain->os_hnd);
     if (!domain->attr) {
 	rv = ENOMEM;
@@ -1109,7 +1536,11 @@ setup_domain(const char         *name,
     if (rv)
 	goto out_err;
 
-    domain->cmds = alloc_ilist();
+    rv = ipmi_create_lock(domain, &domain->mc_startup_lock);
+    if (rv)
+	goto out_err;
+
+    domain->cmds = alloc_ivec();
     if (! domain->cmds) {
 	rv = ENOMEM;
 	goto out_err;
@@ -1149,7 +1580,7 @@ setup_domain(const char         *name,
     if (rv)
 	goto out_err;
 
-    domain->ipmb_ignores = alloc_ilist();
+    domain->ipmb_ignores = alloc_ivec();
     if (! domain->ipmb_ignores) {
 	rv = ENOMEM;
 	goto out_err;
@@ -1171,13 +1602,12 @@ setup_domain(const char         *name,
     rv = ipmi_create_lock(domain, &domain->audit_domain_timer_info->lock);
     if (rv)
 	goto out_err;
-    rv = domain->os_hnd->alloc_timer(domain->os_hnd,
-				     &(domain->audit_domain_timer));
+    rv = _ipmi_domain_alloc_timer(domain, &(domain->audit_domain_timer));
     if (rv)
 	goto out_err;
 
-    timeout.tv_sec = domain->audit_domain_interval;
-    timeout.tv_usec = 0;
+    _ipmi_pace_interval(domain->os_hnd, domain->audit_domain_interval, 1,
+			&timeout);
     domain->os_hnd->start_timer(domain->os_hnd,
 				domain->audit_domain_timer,
 				&timeout,
@@ -1265,42 +1695,29 @@ _ipmi_domain_mc_unlock(ipmi_domain_t *domain)
  *
  **********************************************************************/
 
-/* A open hash table of all the registered domains. */
-#define DOMAIN_HASH_SIZE 128
-static ipmi_domain_t *domains[DOMAIN_HASH_SIZE];
+/* A hash table of all the registered domains. */
+static htable_t *domains;
 static ipmi_lock_t *domains_lock;
 static int domains_initialized = 0;
 
-static void
+static int
 add_known_domain(ipmi_domain_t *domain)
 {
-    unsigned int hash = ipmi_hash_pointer(domain) % DOMAIN_HASH_SIZE;
+    int rv = 0;
 
     ipmi_lock(domains_lock);
-
-    domain->prev = NULL;
-    domain->next = domains[hash];
-    if (domains[hash])
-	domains[hash]->prev = domain;
-    domains[hash] = domain;
-
+    if (!htable_add(domains, ipmi_hash_pointer(domain), domain))
+	rv = ENOMEM;
     ipmi_unlock(domains_lock);
+
+    return rv;
 }
 
 static void
 remove_known_domain(ipmi_domain_t *domain)
 {
     ipmi_lock(domains_lock);
-
-    if (domain->next)
-	domain->next->prev = domain->prev;
-    if (domain->prev)
-	domain->prev->next = domain->next;
-    else {
-	unsigned int hash = ipmi_hash_pointer(domain) % DOMAIN_HASH_SIZE;
-	domains[hash] = domain->next;
-    }
-
+    htable_remove(domains, ipmi_hash_pointer(domain), domain);
     ipmi_unlock(domains_lock);
 }
 
@@ -1309,22 +1726,14 @@ remove_known_domain(ipmi_domain_t *domain)
 int
 _ipmi_domain_get(ipmi_domain_t *domain)
 {
-    unsigned int  hash = ipmi_hash_pointer(domain) % DOMAIN_HASH_SIZE;
-    ipmi_domain_t *c;
-    int           rv = 0;
+    int rv = 0;
 
     if (!domains_initialized)
 	    return ECANCELED;
 
     ipmi_lock(domains_lock);
 
-    c = domains[hash];
-    while (c != NULL) {
-	if (c == domain)
-	    break;
-	c = c->next;
-    }
-    if (c == NULL) {
+    if (!htable_find(domains, ipmi_hash_pointer(domain), NULL, domain)) {
 	rv = EINVAL;
 	goto out;
     }
@@ -1372,7 +1781,126 @@ typedef struct oem_handlers_s {
 } oem_handlers_t;
 
 /* FIXME - do we need a lock?  Probably, add it. */
-static ilist_t *oem_handlers;
+static ivec_t *oem_handlers;
+
+/*
+ * The checks send commands to the BMC and take a while, and every BMC
+ * of the same type gives the same answer.  So remember which check
+ * matched (or that none did) for each type of BMC, later domains
+ * with the same BMC go straight to that check.  Entries point into
+ * oem_handlers, so the cache is flushed whenever that changes.  This
+ * is protected by domains_lock.
+ */
+typedef struct oem_check_cache_s
+{
+    unsigned int   manufacturer_id;
+    unsigned int   product_id;
+    unsigned int   major_fw_revision;
+    unsigned int   minor_fw_revision;
+    oem_handlers_t *handler; /* NULL if nothing matched. */
+} oem_check_cache_t;
+
+static htable_t *oem_check_cache;
+
+static unsigned int
+oem_check_cache_hash(oem_check_cache_t *key)
+{
+    unsigned int val;
+
+    val = ipmi_hash_uint(key->manufacturer_id);
+    val = ipmi_hash_uint(val ^ key->product_id);
+    val = ipmi_hash_uint(val ^ ((key->major_fw_revision << 8)
+				| key->minor_fw_revision));
+    return val;
+}
+
+static int
+oem_check_cache_cmp(void *item, void *cb_data)
+{
+    oem_check_cache_t *ent = item;
+    oem_check_cache_t *key = cb_data;
+
+    return ((ent->manufacturer_id == key->manufacturer_id)
+	    && (ent->product_id == key->product_id)
+	    && (ent->major_fw_revision == key->major_fw_revision)
+	    && (ent->minor_fw_revision == key->minor_fw_revision));
+}
+
+static void
+oem_check_cache_free(void *item, void *cb_data)
+{
+    ipmi_mem_free(item);
+}
+
+static void
+flush_oem_check_cache(void)
+{
+    ipmi_lock(domains_lock);
+    if (oem_check_cache) {
+	htable_iter(oem_check_cache, oem_check_cache_free, NULL);
+	free_htable(oem_check_cache);
+    }
+    /* If this fails we just run without a cache. */
+    oem_check_cache = alloc_htable();
+    ipmi_unlock(domains_lock);
+}
+
+/* Returns 1 and fills in key->handler if the BMC type is cached. */
+static int
+oem_check_cache_find(oem_check_cache_t *key)
+{
+    oem_check_cache_t *ent = NULL;
+
+    ipmi_lock(domains_lock);
+    if (oem_check_cache)
+	ent = htable_find(oem_check_cache, oem_check_cache_hash(key),
+			  oem_check_cache_cmp, key);
+    if (ent)
+	key->handler = ent->handler;
+    ipmi_unlock(domains_lock);
+    return ent != NULL;
+}
+
+static void
+oem_check_cache_set(oem_check_cache_t *key, oem_handlers_t *handler)
+{
+    unsigned int      hash = oem_check_cache_hash(key);
+    oem_check_cache_t *ent;
+
+    ipmi_lock(domains_lock);
+    if (!oem_check_cache)
+	goto out;
+    ent = htable_find(oem_check_cache, hash, oem_check_cache_cmp, key);
+    if (!ent) {
+	ent = ipmi_mem_alloc(sizeof(*ent));
+	if (!ent)
+	    goto out;
+	*ent = *key;
+	if (!htable_add(oem_check_cache, hash, ent)) {
+	    ipmi_mem_free(ent);
+	    goto out;
+	}
+    }
+    ent->handler = handler;
+ out:
+    ipmi_unlock(domains_lock);
+}
+
+static void
+oem_check_cache_drop(oem_check_cache_t *key)
+{
+    unsigned int      hash = oem_check_cache_hash(key);
+    oem_check_cache_t *ent = NULL;
+
+    ipmi_lock(domains_lock);
+    if (oem_check_cache)
+	ent = htable_find(oem_check_cache, hash, oem_check_cache_cmp, key);
+    if (ent) {
+	htable_remove(oem_check_cache, hash, ent);
+	ipmi_mem_free(ent);
+    }
+    ipmi_unlock(domains_lock);
+}
 
 int
 ipmi_register_domain_oem_check(ipmi_domain_oem_check check,
@@ -1387,11 +1915,14 @@ ipmi_register_domain_oem_check(ipmi_domain_oem_check check,
     new_item->check = check;
     new_item->cb_data = cb_data;
 
-    if (! ilist_add_tail(oem_handlers, new_item, NULL)) {
+    if (! ivec_add_tail(oem_handlers, new_item)) {
 	ipmi_mem_free(new_item);
 	return ENOMEM;
     }
 
+    /* The new check may match BMCs that nothing matched before. */
+    flush_oem_check_cache();
+
     return 0;
 }
 
@@ -1411,15 +1942,16 @@ ipmi_deregister_domain_oem_check(ipmi_domain_oem_check check,
 {
     oem_handlers_t *hndlr;
     oem_handlers_t tmp;
-    ilist_iter_t   iter;
+    ivec_iter_t   iter;
 
     tmp.check = check;
     tmp.cb_data = cb_data;
-    ilist_init_iter(&iter, oem_handlers);
-    ilist_unpositioned(&iter);
-    hndlr = ilist_search_iter(&iter, oem_handler_cmp, &tmp);
+    ivec_init_iter(&iter, oem_handlers);
+    ivec_unpositioned(&iter);
+    hndlr = ivec_search_iter(&iter, oem_handler_cmp, &tmp);
     if (hndlr) {
-	ilist_delete(&iter);
+	ivec_delete(&iter);
+	flush_oem_check_cache();
 	ipmi_mem_free(hndlr);
 	return 0;
     }
@@ -1432,26 +1964,46 @@ struct domain_check_oem_s
     ipmi_domain_oem_check_done done;
     void                       *cb_data;
     oem_handlers_t             *curr_handler;
+
+    /* The BMC type, for the cache. */
+    oem_check_cache_t          key;
+    int                        from_cache;
+    int                        failed;
 };
 
 static void domain_oem_check_done(ipmi_domain_t *domain,
 				  int           err,
 				  void          *cb_data);
 
+/* Report the result and remember it for other BMCs of the same type.
+   "match" is the check that took the domain, NULL if none did. */
+static void
+finish_oem_domain_check(ipmi_domain_t      *domain,
+			domain_check_oem_t *check,
+			int                err,
+			oem_handlers_t     *match)
+{
+    /* Don't remember a miss if some check could not be tried. */
+    if (!err && (match || !check->failed))
+	oem_check_cache_set(&check->key, match);
+    check->done(domain, err, check->cb_data);
+    ipmi_mem_free(check);
+}
+
 static void
 start_oem_domain_check(ipmi_domain_t      *domain, 
 		       domain_check_oem_t *check)
 {
-    ilist_iter_t     iter;
+    ivec_iter_t     iter;
 
-    ilist_init_iter(&iter, oem_handlers);
-    if (!ilist_first(&iter)) {
+    check->from_cache = 0;
+    ivec_init_iter(&iter, oem_handlers);
+    if (!ivec_first(&iter)) {
 	/* Empty list, just go on */
-	check->done(domain, 0, check->cb_data);
-	ipmi_mem_free(check);
+	finish_oem_domain_check(domain, check, 0, NULL);
 	goto out;
     } else {
-	oem_handlers_t *h = ilist_get(&iter);
+	oem_handlers_t *h = ivec_get(&iter);
 	int            rv = ENOSYS;
 
 	while (rv) {
@@ -1461,19 +2013,14 @@ start_oem_domain_check(ipmi_domain_t      *domain,
 		break;
 	    if (rv != ENOSYS)
 		break;
-	    if (!ilist_next(&iter)) {
+	    if (!ivec_next(&iter)) {
 		/* End of list, just go on */
-		check->done(domain, 0, check->cb_data);
-		ipmi_mem_free(check);
+		finish_oem_domain_check(domain, check, 0, NULL);
 		goto out;
 	    }
-	    h = ilist_get(&iter);
+	    h = ivec_get(&iter);
 	}
 	if (rv) {
-	    if (rv == ENOSYS)
-		/* This just means that we didn't match anything. */
-		rv = 0;
-
 	    /* We didn't get a check to start, just give up. */
 	    check->done(domain, rv, check->cb_data);
 	    ipmi_mem_free(check);
@@ -1497,13 +2044,13 @@ next_oem_domain_check(ipmi_domain_t      *domain,
 		      domain_check_oem_t *check)
 {
     oem_handlers_t *h;
-    ilist_iter_t   iter;
+    ivec_iter_t   iter;
 
     /* We can't keep an interater in the check, because the list may
        change during execution. */
-    ilist_init_iter(&iter, oem_handlers);
-    ilist_unpositioned(&iter);
-    h = ilist_search_iter(&iter, oem_handler_cmp2, check->curr_handler);
+    ivec_init_iter(&iter, oem_handlers);
+    ivec_unpositioned(&iter);
+    h = ivec_search_iter(&iter, oem_handler_cmp2, check->curr_handler);
     if (!h) {
 	/* The current handler we were working on went away, start over. */
 	start_oem_domain_check(domain, check);
@@ -1511,20 +2058,16 @@ next_oem_domain_check(ipmi_domain_t      *domain,
 	int rv = 1;
 
 	while (rv) {
-	    if (!ilist_next(&iter)) {
+	    if (!ivec_next(&iter)) {
 		/* End of list, just go on */
-		check->done(domain, 0, check->cb_data);
-		ipmi_mem_free(check);
+		finish_oem_domain_check(domain, check, 0, NULL);
 		goto out;
 	    }
-	    h = ilist_get(&iter);
+	    h = ivec_get(&iter);
 	    check->curr_handler = h;
 	    rv = h->check(domain, domain_oem_check_done, check);
-	}
-	if (rv) {
-	    /* We didn't get a check to start, just give up. */
-	    check->done(domain, 0, check->cb_data);
-	    ipmi_mem_free(check);
+	    if (rv && (rv != ENOSYS))
+		check->failed = 1;
 	}
     }
  out:
@@ -1547,20 +2090,63 @@ domain_oem_check_done(ipmi_domain_t *domain,
     if (err != ENOSYS) {
 	/* Either we got a success or some error trying to install the
 	   OEM handlers. */
-	check->done(domain, err, check->cb_data);
-	ipmi_mem_free(check);
+	if (err)
+	    check->failed = 1;
+	finish_oem_domain_check(domain, check, err,
+				err ? NULL : check->curr_handler);
+	return;
+    }
+
+    if (check->from_cache) {
+	/* The BMC didn't answer like the last one of its type did,
+	   forget about it and do the full check. */
+	oem_check_cache_drop(&check->key);
+	start_oem_domain_check(domain, check);
 	return;
     }
 
     next_oem_domain_check(domain, check);
 }
 
+/* Try the check that matched the last BMC of this type.  Returns 0 if
+   it was started (or there is nothing to check), non-zero if the
+   full check needs to be done. */
+static int
+cached_oem_domain_check(ipmi_domain_t      *domain,
+			domain_check_oem_t *check)
+{
+    oem_check_cache_t key = check->key;
+    ivec_iter_t       iter;
+    oem_handlers_t    *h;
+
+    if (!oem_check_cache_find(&key))
+	return ENOENT;
+
+    if (!key.handler) {
+	/* Nothing matched this type of BMC. */
+	check->done(domain, 0, check->cb_data);
+	ipmi_mem_free(check);
+	return 0;
+    }
+
+    ivec_init_iter(&iter, oem_handlers);
+    ivec_unpositioned(&iter);
+    h = ivec_search_iter(&iter, oem_handler_cmp2, key.handler);
+    if (!h)
+	return ENOENT;
+
+    check->curr_handler = h;
+    check->from_cache = 1;
+    return h->check(domain, domain_oem_check_done, check);
+}
+
 static int
 check_oem_handlers(ipmi_domain_t              *domain,
 		   ipmi_domain_oem_check_done done,
 		   void                       *cb_data)
 {
     domain_check_oem_t *check;
+    ipmi_mc_t          *mc = domain->si_mc;
 
     check = ipmi_mem_alloc(sizeof(*check));
     if (!check)
@@ -1569,6 +2155,16 @@ check_oem_handlers(ipmi_domain_t              *domain,
     check->done = done;
     check->cb_data = cb_data;
     check->cancelled = 0;
+    check->failed = 0;
+    check->from_cache = 0;
+    check->key.manufacturer_id = ipmi_mc_manufacturer_id(mc);
+    check->key.product_id = ipmi_mc_product_id(mc);
+    check->key.major_fw_revision = ipmi_mc_major_fw_revision(mc);
+    check->key.minor_fw_revision = ipmi_mc_minor_fw_revision(mc);
+    check->key.handler = NULL;
+
+    if (cached_oem_domain_check(domain, check) == 0)
+	return 0;
 
     start_oem_domain_check(domain, check);
 
@@ -1618,7 +2214,29 @@ int _ipmi_domain_fru_call_special_setup(ipmi_domain_t *domain,
  *
  **********************************************************************/
 
-#define HASH_SLAVE_ADDR(x) (((x) >> 1) & (IPMB_HASH-1))
+static unsigned int
+hash_ipmb_addr(const ipmi_ipmb_addr_t *ipmb)
+{
+    return ipmi_hash_uint((ipmb->channel << 8) | ipmb->slave_addr);
+}
+
+typedef struct mc_addr_cmp_s
+{
+    const ipmi_addr_t *addr;
+    unsigned int      addr_len;
+} mc_addr_cmp_t;
+
+static int
+mc_addr_cmp(void *item, void *cb_data)
+{
+    mc_addr_cmp_t *info = cb_data;
+    ipmi_addr_t   addr2;
+    unsigned int  addr2_len;
+
+    ipmi_mc_get_ipmi_address(item, &addr2, &addr2_len);
+    return ipmi_addr_equal_nolun(info->addr, info->addr_len,
+				 &addr2, addr2_len);
+}
 
 ipmi_mc_t *
 _ipmi_find_mc_by_addr(ipmi_domain_t     *domain,
@@ -1630,7 +2248,7 @@ _ipmi_find_mc_by_addr(ipmi_domain_t     *domain,
     if (addr_len > sizeof(ipmi_addr_t))
 	return NULL;
 
-    ipmi_lock(domain->mc_lock);
+    ipmi_rwlock_read_lock(domain->mc_table_lock);
     if (addr->addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE) {
 	if (addr->channel == IPMI_BMC_CHANNEL)
 	    mc = domain->si_mc;
@@ -1638,36 +2256,23 @@ _ipmi_find_mc_by_addr(ipmi_domain_t     *domain,
 	    mc = domain->sys_intf_mcs[addr->channel];
     } else if (addr->addr_type == IPMI_IPMB_ADDR_TYPE) {
 	const ipmi_ipmb_addr_t *ipmb = (ipmi_ipmb_addr_t *) addr;
-	int                    idx;
-	const mc_table_t       *tab;
-	ipmi_addr_t            addr2;
-	unsigned int           addr2_len;
-	int                    i;
+	mc_addr_cmp_t          info;
 
 	if (addr_len >= sizeof(*ipmb)) {
-	    idx = HASH_SLAVE_ADDR(ipmb->slave_addr);
-	    tab = &(domain->ipmb_mcs[idx]);
-	    for (i=0; i<tab->size; i++) {
-		if (tab->mcs[i]) {
-		    ipmi_mc_get_ipmi_address(tab->mcs[i], &addr2, &addr2_len);
-
-		    if (ipmi_addr_equal_nolun(addr, addr_len,
-					      &addr2, addr2_len))
-		    {
-			mc = tab->mcs[i];
-			break;
-		    }
-		}
-	    }
+	    info.addr = addr;
+	    info.addr_len = addr_len;
+	    mc = htable_find(domain->ipmb_mcs, hash_ipmb_addr(ipmb),
+			     mc_addr_cmp, &info);
 	}
     }
 
-    /* If we cannot get the MC, it has been destroyed. */
+    /* If we cannot get the MC, it has been destroyed.  The use count
+       is atomic, so this is safe with only the read lock. */
     if (mc) {
 	if (_ipmi_mc_get(mc))
 	    mc = NULL;
     }
-    ipmi_unlock(domain->mc_lock);
+    ipmi_rwlock_read_unlock(domain->mc_table_lock);
 
     return mc;
 }
@@ -1679,14 +2284,14 @@ in_ipmb_ignores(ipmi_domain_t *domain,
 {
     unsigned long addr;
     unsigned char first, last, ichan;
-    ilist_iter_t iter;
+    ivec_iter_t iter;
     int          rv = 0;
 
     ipmi_lock(domain->ipmb_ignores_lock);
-    ilist_init_iter(&iter, domain->ipmb_ignores);
-    ilist_unpositioned(&iter);
-    while (ilist_next(&iter)) {
-	addr = (unsigned long) ilist_get(&iter);
+    ivec_init_iter(&iter, domain->ipmb_ignores);
+    ivec_unpositioned(&iter);
+    while (ivec_next(&iter)) {
+	addr = (unsigned long) ivec_get(&iter);
 	first = addr & 0xff;
 	last = (addr >> 8) & 0xff;
 	ichan = (addr >> 16) & 0xff;
@@ -1707,7 +2312,7 @@ ipmi_domain_add_ipmb_ignore(ipmi_domain_t *domain,
     int           rv = 0;
 
     ipmi_lock(domain->ipmb_ignores_lock);
-    if (! ilist_add_tail(domain->ipmb_ignores, (void *) addr, NULL))
+    if (! ivec_add_tail(domain->ipmb_ignores, (void *) addr))
 	rv = ENOMEM;
     ipmi_unlock(domain->ipmb_ignores_lock);
 
@@ -1725,7 +2330,7 @@ ipmi_domain_add_ipmb_ignore_range(ipmi_domain_t *domain,
     int           rv = 0;
 
     ipmi_lock(domain->ipmb_ignores_lock);
-    if (! ilist_add_tail(domain->ipmb_ignores, (void *) addr, NULL))
+    if (! ivec_add_tail(domain->ipmb_ignores, (void *) addr))
 	return ENOMEM;
     ipmi_unlock(domain->ipmb_ignores_lock);
 
@@ -1763,6 +2368,7 @@ add_mc_to_domain(ipmi_domain_t *domain, ipmi_mc_t *mc)
     ipmi_mc_get_ipmi_address(mc, addr, &addr_len);
     
     ipmi_lock(domain->mc_lock);
+    ipmi_rwlock_write_lock(domain->mc_table_lock);
 
     if (addr->addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE) {
 	if (addr->channel >= MAX_CONS)
@@ -1771,38 +2377,14 @@ add_mc_to_domain(ipmi_domain_t *domain, ipmi_mc_t *mc)
 	    domain->sys_intf_mcs[addr->channel] = mc;
     } else if (addr->addr_type == IPMI_IPMB_ADDR_TYPE) {
 	ipmi_ipmb_addr_t *ipmb = (ipmi_ipmb_addr_t *) addr;
-	int              idx;
-	mc_table_t       *tab;
-	int              i;
-
-	idx = HASH_SLAVE_ADDR(ipmb->slave_addr);
-	tab = &(domain->ipmb_mcs[idx]);
-	if (tab->size == tab->curr) {
-	    ipmi_mc_t **nmcs;
 
-	    nmcs = ipmi_mem_alloc(sizeof(ipmi_mc_t *) * (tab->size+5));
-	    if (!nmcs) {
-		rv = ENOMEM;
-		goto out_unlock;
-	    }
-	    if (tab->mcs) {
-		memcpy(nmcs, tab->mcs, sizeof(ipmi_mc_t *) * tab->size);
-		ipmi_mem_free(tab->mcs);
-	    }
-	    memset(nmcs+tab->size, 0, sizeof(ipmi_mc_t *) * 5);
-	    tab->size += 5;
-	    tab->mcs = nmcs;
-	}
-	for (i=0; i<tab->size; i++) {
-	    if (!tab->mcs[i]) {
-		tab->mcs[i] = mc;
-		tab->curr++;
-		break;
-	    }
-	}
+	if (!htable_add(domain->ipmb_mcs, hash_ipmb_addr(ipmb), mc))
+	    rv = ENOMEM;
+	else
+	    domain->ipmb_mc_order_stale = 1;
     }
 
-out_unlock:
+    ipmi_rwlock_write_unlock(domain->mc_table_lock);
     ipmi_unlock(domain->mc_lock);
 
     return rv;
@@ -1818,6 +2400,9 @@ call_mc_upd_handlers(ipmi_domain_t      *domain,
     CHECK_DOMAIN_LOCK(domain);
     CHECK_MC_LOCK(mc);
 
+    if ((op == IPMI_DELETED) && _ipmi_domain_quiet_close(domain))
+	return;
+
     info.domain = domain;
     info.op = op;
     info.mc = mc;
@@ -1897,8 +2482,20 @@ ipmi_domain_remove_mc_updated_handler_cl(ipmi_domain_t            *domain,
 	return EINVAL;
 }
 
-/* Must be called with the domain MC lock held.  It will be
-   released. */
+void
+_ipmi_domain_mc_table_lock(ipmi_domain_t *domain)
+{
+    ipmi_rwlock_write_lock(domain->mc_table_lock);
+}
+
+void
+_ipmi_domain_mc_table_unlock(ipmi_domain_t *domain)
+{
+    ipmi_rwlock_write_unlock(domain->mc_table_lock);
+}
+
+/* Must be called with the domain MC lock and the MC table lock
+   held.  They will be released. */
 int
 _ipmi_remove_mc_from_domain(ipmi_domain_t *domain, ipmi_mc_t *mc)
 {
@@ -1918,21 +2515,13 @@ _ipmi_remove_mc_from_domain(ipmi_domain_t *domain, ipmi_mc_t *mc)
 	}
     } else if (addr->addr_type == IPMI_IPMB_ADDR_TYPE) {
 	ipmi_ipmb_addr_t *ipmb = (ipmi_ipmb_addr_t *) addr;
-	int              idx;
-	mc_table_t       *tab;
-	int              i;
 
-	idx = HASH_SLAVE_ADDR(ipmb->slave_addr);
-	tab = &(domain->ipmb_mcs[idx]);
-	for (i=0; i<tab->size; i++) {
-	    if (tab->mcs[i] == mc) {
-		tab->curr--;
-		tab->mcs[i] = NULL;
-		found = 1;
-	    }
-	}
+	found = htable_remove(domain->ipmb_mcs, hash_ipmb_addr(ipmb), mc);
+	if (found)
+	    domain->ipmb_mc_order_stale = 1;
     }
 
+    ipmi_rwlock_write_unlock(domain->mc_table_lock);
     ipmi_unlock(domain->mc_lock);
 
     if (found) {
@@ -2018,38 +2607,80 @@ static int cmp_nmsg(void *item, void *cb_data)
 static int
 find_and_remove_msg(ipmi_domain_t *domain, ll_msg_t *nmsg, long seq)
 {
-    ilist_iter_t iter;
+    ivec_iter_t iter;
     int          rv = 0;
 
-    ilist_init_iter(&iter, domain->cmds);
-    ilist_unpositioned(&iter);
-    if ((ilist_search_iter(&iter, cmp_nmsg, nmsg) != NULL)
+    ivec_init_iter(&iter, domain->cmds);
+    ivec_unpositioned(&iter);
+    if ((ivec_search_iter(&iter, cmp_nmsg, nmsg) != NULL)
 	&& (nmsg->seq == seq))
     {
-	ilist_delete(&iter);
+	ivec_delete(&iter);
+	domain->con_outstanding[nmsg->con]--;
 	rv = 1;
     }
     return rv;
 }
 
+/* A message sent through the domain is done.  Must be called with
+   the cmds_lock held, returns true if cmd_ready should be called
+   after it is released. */
 static int
-ll_rsp_handler(ipmi_con_t   *ipmi,
-	       ipmi_msgi_t  *orspi)
+cmd_finished(ipmi_domain_t *domain)
 {
-    ipmi_msgi_t   *rspi;
-    ipmi_domain_t *domain = orspi->data1;
-    ll_msg_t      *nmsg = orspi->data2;
-    long          seq = (long) orspi->data3;
-    long          conn_seq = (long) orspi->data4;
-    int           rv;
-
-    rv = _ipmi_domain_get(domain);
-    if (rv)
-	/* No need to report these to the upper layer, they have
-	   already been delivered in the cleanup code. */
-	return IPMI_MSG_ITEM_NOT_USED;
+    domain->cmds_outstanding--;
+    if (domain->cmds_blocked
+	&& (domain->cmds_outstanding <= domain->cmds_limit / 2))
+    {
+	domain->cmds_blocked = 0;
+	return 1;
+    }
+    return 0;
+}
 
-    ipmi_lock(domain->cmds_lock);
+static void
+call_cmd_ready(ipmi_domain_t *domain)
+{
+    ipmi_domain_cmd_ready_cb handler;
+    void                     *cb_data;
+
+    ipmi_lock(domain->cmds_lock);
+    handler = domain->cmd_ready;
+    cb_data = domain->cmd_ready_cb_data;
+    ipmi_unlock(domain->cmds_lock);
+    if (handler)
+	handler(domain, cb_data);
+}
+
+static void
+count_rsp(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
+{
+    if (domain->rsps_received_stat)
+	ipmi_domain_stat_add(domain->rsps_received_stat, 1);
+    if (domain->rsp_bytes_received_stat)
+	ipmi_domain_stat_add(domain->rsp_bytes_received_stat,
+			     rspi->msg.data_len);
+}
+
+static int
+ll_rsp_handler(ipmi_con_t   *ipmi,
+	       ipmi_msgi_t  *orspi)
+{
+    ipmi_msgi_t   *rspi;
+    ipmi_domain_t *domain = orspi->data1;
+    ll_msg_t      *nmsg = orspi->data2;
+    long          seq = (long) orspi->data3;
+    long          conn_seq = (long) orspi->data4;
+    int           ready;
+    int           rv;
+
+    rv = _ipmi_domain_get(domain);
+    if (rv)
+	/* No need to report these to the upper layer, they have
+	   already been delivered in the cleanup code. */
+	return IPMI_MSG_ITEM_NOT_USED;
+
+    ipmi_lock(domain->cmds_lock);
     if (conn_seq != domain->conn_seq[nmsg->con]) {
 	/* The message has been rerouted, just ignore this response. */
 	ipmi_unlock(domain->cmds_lock);
@@ -2060,7 +2691,9 @@ ll_rsp_handler(ipmi_con_t   *ipmi,
 	ipmi_unlock(domain->cmds_lock);
 	goto out_unlock;
     }
+    ready = cmd_finished(domain);
     ipmi_unlock(domain->cmds_lock);
+    count_rsp(domain, orspi);
 
     rspi = nmsg->rsp_item;
     if (nmsg->rsp_handler) {
@@ -2071,6 +2704,8 @@ ll_rsp_handler(ipmi_con_t   *ipmi,
     } else
 	ipmi_free_msg_item(rspi);
     ipmi_mem_free(nmsg);
+    if (ready)
+	call_cmd_ready(domain);
  out_unlock:
     _ipmi_domain_put(domain);
     return IPMI_MSG_ITEM_NOT_USED;
@@ -2082,6 +2717,7 @@ ll_si_rsp_handler(ipmi_con_t *ipmi, ipmi_msgi_t *orspi)
     ipmi_msgi_t                  *rspi;
     ipmi_domain_t                *domain = orspi->data1;
     ll_msg_t                     *nmsg = orspi->data2;
+    int                          ready;
     int                          rv;
 
     rspi = nmsg->rsp_item;
@@ -2095,6 +2731,11 @@ ll_si_rsp_handler(ipmi_con_t *ipmi, ipmi_msgi_t *orspi)
 	return IPMI_MSG_ITEM_NOT_USED;
     }
 
+    ipmi_lock(domain->cmds_lock);
+    ready = cmd_finished(domain);
+    ipmi_unlock(domain->cmds_lock);
+    count_rsp(domain, orspi);
+
     if (nmsg->rsp_handler) {
 	ipmi_move_msg_item(rspi, orspi);
 	/* Set the LUN from the response message. */
@@ -2103,6 +2744,8 @@ ll_si_rsp_handler(ipmi_con_t *ipmi, ipmi_msgi_t *orspi)
     } else
 	ipmi_free_msg_item(rspi);
     ipmi_mem_free(nmsg);
+    if (ready)
+	call_cmd_ready(domain);
 
     _ipmi_domain_put(domain);
     return IPMI_MSG_ITEM_NOT_USED;
@@ -2139,6 +2782,37 @@ matching_domain_sysaddr(ipmi_domain_t *domain, const ipmi_addr_t *addr,
     return 0;
 }
 
+/* Fill in the connection options for a message, returns false if
+   its deadline has already passed. */
+static int
+msg_options(ipmi_domain_t *domain, ll_msg_t *nmsg, ipmi_con_option_t *options,
+	    ipmi_con_option_t **roptions)
+{
+    int i = 0;
+
+    if (nmsg->side_effects) {
+	options[i].option = IPMI_CON_MSG_OPTION_SIDE_EFFECTS;
+	options[i].ival = 1;
+	i++;
+    }
+    if (nmsg->has_deadline) {
+	struct timeval now;
+	long           left;
+
+	domain->os_hnd->get_monotonic_time(domain->os_hnd, &now);
+	left = ((nmsg->deadline.tv_sec - now.tv_sec) * 1000
+		+ (nmsg->deadline.tv_usec - now.tv_usec) / 1000);
+	if (left <= 0)
+	    return 0;
+	options[i].option = IPMI_CON_MSG_OPTION_DEADLINE;
+	options[i].ival = left;
+	i++;
+    }
+    options[i].option = IPMI_CON_OPTION_LIST_END;
+    *roptions = i ? options : NULL;
+    return 1;
+}
+
 static int
 send_command_option(ipmi_domain_t           *domain,
 		    int                     conn,
@@ -2149,19 +2823,55 @@ send_command_option(ipmi_domain_t           *domain,
 		    ipmi_ll_rsp_handler_t   handler,
 		    void		    *handler_data)
 {
+    int rv;
+
     if (domain->conn[conn]->send_command_option)
-	return domain->conn[conn]->send_command_option(domain->conn[conn],
-						       addr, addr_len,
-						       msg,
-						       options,
-						       handler,
-						       handler_data);
+	rv = domain->conn[conn]->send_command_option(domain->conn[conn],
+						     addr, addr_len,
+						     msg,
+						     options,
+						     handler,
+						     handler_data);
     else
-	return domain->conn[conn]->send_command(domain->conn[conn],
-						addr, addr_len,
-						msg,
-						handler,
-						handler_data);
+	rv = domain->conn[conn]->send_command(domain->conn[conn],
+					      addr, addr_len,
+					      msg,
+					      handler,
+					      handler_data);
+    if (!rv) {
+	if (domain->cmds_sent_stat)
+	    ipmi_domain_stat_add(domain->cmds_sent_stat, 1);
+	if (domain->cmd_bytes_sent_stat)
+	    ipmi_domain_stat_add(domain->cmd_bytes_sent_stat, msg->data_len);
+    }
+    return rv;
+}
+
+/* Pick the connection for an IPMB message.  Must be called with
+   cmds_lock held. */
+static int
+route_con(ipmi_domain_t *domain)
+{
+    int u = domain->working_conn;
+    int i;
+
+    /* If we don't have any working connection, just use connection
+       zero. */
+    if (u == -1)
+	return 0;
+
+    if (domain->con_routing != IPMI_DOMAIN_ROUTE_SPREAD)
+	return u;
+
+    /* Use the active connection with the least outstanding, keeping
+       the working connection on a tie. */
+    for (i=0; i<MAX_CONS; i++) {
+	if (!domain->conn[i] || !domain->con_up[i] || !domain->con_active[i])
+	    continue;
+	if (domain->con_outstanding[i] < domain->con_outstanding[u])
+	    u = i;
+    }
+    return u;
 }
 
 static int
@@ -2172,7 +2882,8 @@ send_command_addr(ipmi_domain_t                *domain,
 		  ipmi_addr_response_handler_t rsp_handler,
 		  void                         *rsp_data1,
 		  void                         *rsp_data2,
-		  int			       side_effects)
+		  int			       side_effects,
+		  long			       deadline)
 {
     int                          rv;
     int                          u;
@@ -2182,8 +2893,8 @@ send_command_addr(ipmi_domain_t                *domain,
     void                         *data4 = NULL;
     int                          is_ipmb = 0;
     ipmi_msgi_t                  *rspi;
-    ipmi_con_option_t            opt_data[2];
-    ipmi_con_option_t		 *options = NULL;
+    ipmi_con_option_t            opt_data[3];
+    ipmi_con_option_t		 *options;
 
     if (addr_len > sizeof(ipmi_addr_t))
 	return EINVAL;
@@ -2194,12 +2905,8 @@ send_command_addr(ipmi_domain_t                *domain,
     if (domain->in_shutdown)
 	return EINVAL;
 
-    if (side_effects) {
-	options = opt_data;
-	options[0].option = IPMI_CON_MSG_OPTION_SIDE_EFFECTS;
-	options[0].ival = 1;
-	options[1].option = IPMI_CON_OPTION_LIST_END;
-    }
+    if (deadline < 0)
+	return EINVAL;
 
     CHECK_DOMAIN_LOCK(domain);
 
@@ -2248,18 +2955,13 @@ send_command_addr(ipmi_domain_t                *domain,
 	addr_len = sizeof(si);
 	handler = ll_si_rsp_handler;
     } else {
-	u = domain->working_conn;
-
-	/* If we don't have any working connection, just use connection
-	   zero. */
-	if (u == -1)
-	    u = 0;
+	/* The connection is picked when we have the lock. */
+	u = -1;
 	handler = ll_rsp_handler;
 	is_ipmb = 1;
     }
 
     nmsg->domain = domain;
-    nmsg->con = u;
 
     memcpy(&nmsg->msg, msg, sizeof(nmsg->msg));
     nmsg->msg.data = nmsg->msg_data;
@@ -2271,21 +2973,60 @@ send_command_addr(ipmi_domain_t                *domain,
     nmsg->rsp_item->data2 = rsp_data2;
 
     nmsg->side_effects = side_effects;
+    nmsg->has_deadline = deadline > 0;
+    if (deadline > 0) {
+	domain->os_hnd->get_monotonic_time(domain->os_hnd, &nmsg->deadline);
+	nmsg->deadline.tv_sec += deadline / 1000;
+	nmsg->deadline.tv_usec += (deadline % 1000) * 1000;
+	if (nmsg->deadline.tv_usec >= 1000000) {
+	    nmsg->deadline.tv_sec += 1;
+	    nmsg->deadline.tv_usec -= 1000000;
+	}
+    }
+    if (!msg_options(domain, nmsg, opt_data, &options)) {
+	rv = ETIMEDOUT;
+	goto out;
+    }
 
     ipmi_lock(domain->cmds_lock);
+    if (domain->cmds_limit
+	&& (domain->cmds_outstanding >= domain->cmds_limit))
+    {
+	/* The caller should hold off until the ready handler says
+	   there is room. */
+	domain->cmds_blocked = 1;
+	rv = EAGAIN;
+	goto out_unlock;
+    }
     nmsg->seq = domain->cmds_seq;
     domain->cmds_seq++;
 
     /* Have to delay this to here so we are holding the lock. */
-    if (is_ipmb)
+    if (is_ipmb) {
+	u = route_con(domain);
 	data4 = (void *) (long) domain->conn_seq[u];
+    }
+    nmsg->con = u;
 
-    rspi = ipmi_alloc_msg_item();
+    rspi = ipmi_con_alloc_msg_item(domain->conn[u]);
     if (!rspi) {
 	rv = ENOMEM;
 	goto out_unlock;
     }
 
+    /* If it's a system interface we don't add it to the list of
+       commands running, because it will never need to be rerouted.
+       It goes on the list before sending, since adding can fail. */
+    if (is_ipmb) {
+	if (!ivec_add_tail(domain->cmds, nmsg)) {
+	    ipmi_con_free_msg_item(domain->conn[u], rspi);
+	    rv = ENOMEM;
+	    goto out_unlock;
+	}
+	domain->con_outstanding[u]++;
+    }
+    domain->cmds_outstanding++;
+
     rspi->data1 = domain;
     rspi->data2 = nmsg;
     rspi->data3 = (void *) nmsg->seq;
@@ -2294,13 +3035,13 @@ send_command_addr(ipmi_domain_t                *domain,
 			     msg, options, handler, rspi);
 
     if (rv) {
-	ipmi_free_msg_item(rspi);
+	if (is_ipmb) {
+	    ivec_remove_item_from_list(domain->cmds, nmsg);
+	    domain->con_outstanding[u]--;
+	}
+	domain->cmds_outstanding--;
+	ipmi_con_free_msg_item(domain->conn[u], rspi);
 	goto out_unlock;
-    } else if (is_ipmb) {
-	/* If it's a system interface we don't add it to the list of
-	   commands running, because it will never need to be
-	   rerouted. */
-	ilist_add_tail(domain->cmds, nmsg, &nmsg->link);
     }
  out_unlock:
     ipmi_unlock(domain->cmds_lock);
@@ -2323,7 +3064,7 @@ ipmi_send_command_addr(ipmi_domain_t                *domain,
 		       void                         *rsp_data2)
 {
     return send_command_addr(domain, addr, addr_len, msg, rsp_handler,
-			     rsp_data1, rsp_data2, 0);
+			     rsp_data1, rsp_data2, 0, 0);
 }
 
 int
@@ -2336,7 +3077,39 @@ ipmi_send_command_addr_sideeff(ipmi_domain_t                *domain,
 			       void                         *rsp_data2)
 {
     return send_command_addr(domain, addr, addr_len, msg, rsp_handler,
-			     rsp_data1, rsp_data2, 1);
+			     rsp_data1, rsp_data2, 1, 0);
+}
+
+int
+ipmi_send_command_addr_options(ipmi_domain_t                *domain,
+			       const ipmi_addr_t	    *addr,
+			       unsigned int                 addr_len,
+			       const ipmi_msg_t             *msg,
+			       const ipmi_con_option_t      *options,
+			       ipmi_addr_response_handler_t rsp_handler,
+			       void                         *rsp_data1,
+			       void                         *rsp_data2)
+{
+    int  side_effects = 0;
+    long deadline = 0;
+    int  i;
+
+    if (options) {
+	for (i=0; options[i].option != IPMI_CON_OPTION_LIST_END; i++) {
+	    switch (options[i].option) {
+	    case IPMI_CON_MSG_OPTION_SIDE_EFFECTS:
+		side_effects = options[i].ival != 0;
+		break;
+	    case IPMI_CON_MSG_OPTION_DEADLINE:
+		deadline = options[i].ival;
+		break;
+	    default:
+		return EINVAL;
+	    }
+	}
+    }
+    return send_command_addr(domain, addr, addr_len, msg, rsp_handler,
+			     rsp_data1, rsp_data2, side_effects, deadline);
 }
 
 /* Take all the commands for any inactive or down connection and
@@ -2344,36 +3117,40 @@ ipmi_send_command_addr_sideeff(ipmi_domain_t                *domain,
 static void
 reroute_cmds(ipmi_domain_t *domain, int old_con, int new_con)
 {
-    ilist_iter_t iter;
+    ivec_iter_t iter;
     int          rv;
     ll_msg_t     *nmsg;
+    int          ready = 0;
 
     ipmi_lock(domain->cmds_lock);
-    ilist_init_iter(&iter, domain->cmds);
-    rv = ilist_first(&iter);
+    ivec_init_iter(&iter, domain->cmds);
+    rv = ivec_first(&iter);
     (domain->conn_seq[old_con])++;
     while (rv) {
-	nmsg = ilist_get(&iter);
+	nmsg = ivec_get(&iter);
 	if (nmsg->con == old_con) {
 	    ipmi_msgi_t       *rspi;
-	    ipmi_con_option_t opt_data[2];
-	    ipmi_con_option_t *options = NULL;
+	    ipmi_con_option_t opt_data[3];
+	    ipmi_con_option_t *options;
+	    unsigned char     cc = IPMI_UNKNOWN_ERR_CC;
 
 	    nmsg->seq = domain->cmds_seq;
 	    domain->cmds_seq++; /* Make the message unique so a
                                    response from the other connection
                                    will not match. */
 	    nmsg->con = new_con;
+	    domain->con_outstanding[old_con]--;
+	    domain->con_outstanding[new_con]++;
 
 	    rspi = ipmi_alloc_msg_item();
 	    if (!rspi)
 		goto send_err;
 
-	    if (nmsg->side_effects) {
-		options = opt_data;
-		options[0].option = IPMI_CON_MSG_OPTION_SIDE_EFFECTS;
-		options[0].ival = 1;
-		options[1].option = IPMI_CON_OPTION_LIST_END;
+	    if (!msg_options(domain, nmsg, opt_data, &options)) {
+		/* Nobody wants the answer any more. */
+		ipmi_free_msg_item(rspi);
+		cc = IPMI_TIMEOUT_CC;
+		goto send_err;
 	    }
 
 	    rspi->data1 = domain;
@@ -2397,17 +3174,23 @@ reroute_cmds(ipmi_domain_t *domain, int old_con, int new_con)
 		    rspi->msg.cmd = nmsg->msg.cmd;
 		    rspi->msg.data = rspi->data;
 		    rspi->msg.data_len = 1;
-		    rspi->data[0] = IPMI_UNKNOWN_ERR_CC;
+		    rspi->data[0] = cc;
 		    deliver_rsp(domain, nmsg->rsp_handler, rspi);
 		}
-		rv = ilist_delete(&iter);
+		ivec_delete(&iter);
+		domain->con_outstanding[new_con]--;
+		ready |= cmd_finished(domain);
 		ipmi_mem_free(nmsg);
+		/* The delete moved to the next item, if there is one. */
+		rv = ivec_get(&iter) != NULL;
 		continue;
 	    }
 	}
-	rv = ilist_next(&iter);
+	rv = ivec_next(&iter);
     }
     ipmi_unlock(domain->cmds_lock);
+    if (ready)
+	call_cmd_ready(domain);
 }
 
 /***********************************************************************
@@ -2438,8 +3221,8 @@ ipmi_domain_set_ipmb_rescan_time(ipmi_domain_t *domain, unsigned int seconds)
 	ipmi_unlock(domain->audit_domain_timer_info->lock);
 	return;
     }
-    timeout.tv_sec = domain->audit_domain_interval;
-    timeout.tv_usec = 0;
+    _ipmi_pace_interval(domain->os_hnd, domain->audit_domain_interval, 0,
+			&timeout);
     domain->os_hnd->start_timer(domain->os_hnd,
 				domain->audit_domain_timer,
 				&timeout,
@@ -2456,6 +3239,55 @@ ipmi_domain_get_ipmb_rescan_time(ipmi_domain_t *domain)
     return domain->audit_domain_interval;
 }
 
+void
+ipmi_domain_set_ipmb_full_rescan_time(ipmi_domain_t *domain,
+				      unsigned int  seconds)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    ipmi_lock(domain->mc_lock);
+    domain->ipmb_full_rescan_interval = seconds;
+    ipmi_unlock(domain->mc_lock);
+}
+
+unsigned int
+ipmi_domain_get_ipmb_full_rescan_time(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->ipmb_full_rescan_interval;
+}
+
+void
+_ipmi_domain_ipmb_changed(ipmi_domain_t *domain, int channel, int addr)
+{
+    /* Without the targeted mode the next full scan finds it. */
+    if (!domain->ipmb_full_rescan_interval || domain->in_shutdown
+	|| !ipmi_option_IPMB_scan(domain))
+	return;
+    if ((addr & 1) || (channel < 0) || (channel >= MAX_IPMI_USED_CHANNELS)
+	|| (domain->chan[channel].medium != IPMI_CHANNEL_MEDIUM_IPMB))
+	return;
+
+    ipmi_start_ipmb_mc_scan(domain, channel, addr, addr, NULL, NULL);
+}
+
+void
+ipmi_domain_set_ipmb_scan_parallel(ipmi_domain_t *domain, unsigned int count)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    domain->ipmb_scan_parallel = count;
+}
+
+unsigned int
+ipmi_domain_get_ipmb_scan_parallel(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->ipmb_scan_parallel;
+}
+
 int
 ipmi_domain_set_full_bus_scan(ipmi_domain_t *domain, int val)
 {
@@ -2490,94 +3322,145 @@ remove_bus_scans_running(ipmi_domain_t *domain, mc_ipmb_scan_info_t *info)
 	}
 }
 
-static int devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi);
-
 static void
-rescan_timeout_handler(void *cb_data, os_hnd_timer_id_t *id)
+free_bus_scan(mc_ipmb_scan_info_t *info)
 {
-    mc_ipmb_scan_info_t *info = cb_data;
-    int                 rv;
-    ipmi_ipmb_addr_t    *ipmb;
-    ipmi_domain_t       *domain;
+    unsigned int i;
 
-    ipmi_lock(info->lock);
-    if (info->cancelled) {
-	ipmi_unlock(info->lock);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_destroy_lock(info->lock);
-	ipmi_mem_free(info);
-	return;
+    for (i=0; i<info->num_probes; i++) {
+	if (info->probes[i].timer)
+	    info->os_hnd->free_timer(info->os_hnd, info->probes[i].timer);
     }
-    info->timer_running = 0;
-    ipmi_unlock(info->lock);
+    if (info->lock)
+	ipmi_destroy_lock(info->lock);
+    ipmi_mem_free(info);
+}
 
-    domain = info->domain;
-    rv = _ipmi_domain_get(domain);
-    if (rv) {
-	ipmi_log(IPMI_LOG_INFO,
-		 "%sdomain.c(rescan_timeout_handler): "
-		 "BMC went away while scanning for MCs",
-		 DOMAIN_NAME(domain));
-	return;
-    }
+static mc_ipmb_scan_info_t *
+alloc_bus_scan(ipmi_domain_t  *domain,
+	       unsigned int   num_probes,
+	       ipmi_domain_cb done_handler,
+	       void           *cb_data)
+{
+    mc_ipmb_scan_info_t *info;
+    unsigned int        i;
+    int                 rv;
 
-    goto retry_addr;
+    info = ipmi_mem_alloc(sizeof(*info) + (sizeof(mc_ipmb_probe_t)
+					   * num_probes));
+    if (!info)
+	return NULL;
+    memset(info, 0, sizeof(*info) + sizeof(mc_ipmb_probe_t) * num_probes);
 
- next_addr_nolock:
-    ipmb = (ipmi_ipmb_addr_t *) &info->addr;
-    if ((info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
-	|| (ipmb->slave_addr >= info->end_addr)) {
-	/* We've hit the end, we can quit now. */
-	if (info->done_handler)
-	    info->done_handler(domain, 0, info->cb_data);
-	remove_bus_scans_running(domain, info);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_destroy_lock(info->lock);
-	ipmi_mem_free(info);
-	goto out;
+    info->domain = domain;
+    info->msg.netfn = IPMI_APP_NETFN;
+    info->msg.cmd = IPMI_GET_DEVICE_ID_CMD;
+    info->msg.data = NULL;
+    info->msg.data_len = 0;
+    info->done_handler = done_handler;
+    info->cb_data = cb_data;
+    info->os_hnd = domain->os_hnd;
+    info->probes = (mc_ipmb_probe_t *) (info + 1);
+    info->num_probes = num_probes;
+    for (i=0; i<num_probes; i++) {
+	info->probes[i].info = info;
+	rv = _ipmi_domain_alloc_timer(domain, &info->probes[i].timer);
+	if (rv)
+	    goto out_err;
     }
-    ipmb->slave_addr += 2;
-    info->missed_responses = 0;
-    if (in_ipmb_ignores(domain, ipmb->channel, ipmb->slave_addr))
-	goto next_addr_nolock;
-
- retry_addr:
-    rv = ipmi_send_command_addr(domain,
-				&(info->addr),
-				info->addr_len,
-				&(info->msg),
-				devid_bc_rsp_handler,
-				info, NULL);
+
+    rv = ipmi_create_lock(domain, &info->lock);
     if (rv)
-	goto next_addr_nolock;
+	goto out_err;
 
- out:
-    _ipmi_domain_put(domain);
+    return info;
+
+ out_err:
+    free_bus_scan(info);
+    return NULL;
 }
 
+static int devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi);
+
+static void rescan_timeout_handler(void *cb_data, os_hnd_timer_id_t *id);
+
 static int
-devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
+probe_send(ipmi_domain_t *domain, mc_ipmb_probe_t *probe)
+{
+    mc_ipmb_scan_info_t *info = probe->info;
+    struct timeval      wait;
+
+    if (info->throttled && _ipmi_pace_background(info->os_hnd, &wait)) {
+	/* Over the background limit, send it when allowed. */
+	ipmi_lock(info->lock);
+	probe->timer_running = 1;
+	info->timers_running++;
+	info->os_hnd->start_timer(info->os_hnd,
+				  probe->timer,
+				  &wait,
+				  rescan_timeout_handler,
+				  probe);
+	ipmi_unlock(info->lock);
+	return 0;
+    }
+
+    return ipmi_send_command_addr(domain,
+				  &probe->addr,
+				  info->addr_len,
+				  &info->msg,
+				  devid_bc_rsp_handler,
+				  probe, NULL);
+}
+
+/* Start the probe on the next address that isn't ignored and that a
+   message can be sent to.  Returns an error if there are no more
+   addresses, the last send error or ENOENT if none was tried.  Only
+   called by the thread doing the advance. */
+static int
+probe_start(ipmi_domain_t *domain, mc_ipmb_probe_t *probe)
 {
-    ipmi_msg_t          *msg = &rspi->msg;
-    ipmi_addr_t         *addr = &rspi->addr;
-    unsigned int        addr_len = rspi->addr_len;
-    mc_ipmb_scan_info_t *info = rspi->data1;
-    int                 rv;
-    ipmi_mc_t           *mc = NULL;
-    ipmi_ipmb_addr_t    *ipmb;
-    int                 mc_added = 0;
-    int                 mc_changed = 0;
+    mc_ipmb_scan_info_t *info = probe->info;
+    ipmi_ipmb_addr_t    *ipmb = (ipmi_ipmb_addr_t *) &probe->addr;
+    int                 rv = ENOENT;
 
+    while (info->addrs_left) {
+	memcpy(&probe->addr, &info->addr, info->addr_len);
+	if (info->addr.addr_type != IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	    ipmb->slave_addr = info->next_addr;
+	info->next_addr += 2;
+	if (info->next_addr > info->end_addr)
+	    info->addrs_left = 0;
 
-    rv = _ipmi_domain_get(domain);
-    if (rv) {
-	ipmi_log(IPMI_LOG_INFO,
-		 "%sdomain.c(devid_bc_rsp_handler): "
-		 "BMC went away while scanning for MCs",
-		 DOMAIN_NAME(domain));
-	return IPMI_MSG_ITEM_NOT_USED;
+	if ((info->addr.addr_type != IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	    && in_ipmb_ignores(domain, ipmb->channel, ipmb->slave_addr))
+	    continue;
+
+	probe->missed_responses = 0;
+	probe->give_up = 0;
+	rv = probe_send(domain, probe);
+	if (!rv)
+	    return 0;
     }
 
+    return rv;
+}
+
+/* Add, update or remove the MC at addr from a get device id
+   response.  give_up means an error response is because the MC has
+   stopped responding.  Returns ENOMEM if the MC could not be
+   created. */
+static int
+handle_devid_rsp(ipmi_domain_t *domain,
+		 ipmi_addr_t   *addr,
+		 unsigned int  addr_len,
+		 ipmi_msg_t    *msg,
+		 int           give_up)
+{
+    int          rv;
+    ipmi_mc_t    *mc = NULL;
+    int          mc_added = 0;
+    int          mc_changed = 0;
+
     mc = _ipmi_find_mc_by_addr(domain, addr, addr_len);
     if (msg->data[0] == 0) {
 	if (mc && ipmi_mc_is_active(mc)
@@ -2596,21 +3479,14 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 		/* If it's not there, then add it.  If it's just not
                    active, reuse the same data. */
 		rv = _ipmi_create_mc(domain, addr, addr_len, &mc);
-		if (rv) {
+		if (rv)
 		    /* Out of memory, just give up for now. */
-		    if (info->done_handler)
-			info->done_handler(domain, 0, info->cb_data);
-		    remove_bus_scans_running(domain, info);
-		    info->os_hnd->free_timer(info->os_hnd, info->timer);
-		    ipmi_destroy_lock(info->lock);
-		    ipmi_mem_free(info);
-		    goto out;
-		}
+		    return ENOMEM;
 
 		rv = add_mc_to_domain(domain, mc);
 		if (rv) {
 		    _ipmi_cleanup_mc(mc);
-		    goto next_addr;
+		    goto out;
 		}
 
 		rv = _ipmi_mc_get_device_id_data_from_rsp(mc, msg);
@@ -2649,92 +3525,302 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 	    /* Periodically check the MCs. */
 	    _ipmi_mc_check_mc(mc);
 	}
-    } else if (mc && ipmi_mc_is_active(mc)) {
-	/* Didn't get a response.  Maybe the MC has gone away? */
-	info->missed_responses++;
-
-	/* We fail system interface addresses immediately, since they
-           shouldn't be a timeout problem. */
-	if ((info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
-	    || (info->missed_responses >= MAX_MC_MISSED_RESPONSES))
-	{
-	    _ipmi_cleanup_mc(mc);
-	    goto next_addr;
-	} else {
-	    /* Try again after a second. */
-	    struct timeval timeout;
-
-	    if (msg->data[0] == IPMI_TIMEOUT_CC)
-		/* If we timed out, then no need to time, since a
-		   second has gone by already. */
-		goto retry_addr;
-
-	    ipmi_lock(info->lock);
-	    timeout.tv_sec = 1;
-	    timeout.tv_usec = 0;
-	    info->timer_running = 1;
-	    info->os_hnd->start_timer(info->os_hnd,
-				      info->timer,
-				      &timeout,
-				      rescan_timeout_handler,
-				      info);
-	    ipmi_unlock(info->lock);
-	    goto out;
-	}
+    } else if (give_up && mc && ipmi_mc_is_active(mc)) {
+	/* The MC has stopped responding, it has gone away. */
+	_ipmi_cleanup_mc(mc);
     }
 
- next_addr:
     if (mc_added)
 	call_mc_upd_handlers(domain, mc, IPMI_ADDED);
     else if (mc_changed)
 	call_mc_upd_handlers(domain, mc, IPMI_CHANGED);
 
- next_addr_nolock:
-    ipmb = (ipmi_ipmb_addr_t *) &info->addr;
-    if ((info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
-	|| (ipmb->slave_addr >= info->end_addr)) {
-	/* We've hit the end, we can quit now. */
-	if (info->done_handler)
-	    info->done_handler(domain, 0, info->cb_data);
-	remove_bus_scans_running(domain, info);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_destroy_lock(info->lock);
-	ipmi_mem_free(info);
-	goto out;
-    }
-    ipmb->slave_addr += 2;
-    info->missed_responses = 0;
-    if (in_ipmb_ignores(domain, ipmb->channel, ipmb->slave_addr))
-	goto next_addr_nolock;
-
- retry_addr:
-    rv = ipmi_send_command_addr(domain,
-				&(info->addr),
-				info->addr_len,
-				&(info->msg),
-				devid_bc_rsp_handler,
-				info, NULL);
-    if (rv)
-	goto next_addr_nolock;
-
  out:
     if (mc)
 	_ipmi_mc_put(mc);
-    _ipmi_domain_put(domain);
-    return IPMI_MSG_ITEM_NOT_USED;
+    return 0;
 }
 
-int
-ipmi_start_ipmb_mc_scan(ipmi_domain_t  *domain,
-	       		int            channel,
-	       		unsigned int   start_addr,
-			unsigned int   end_addr,
-			ipmi_domain_cb done_handler,
-			void           *cb_data)
+/* Handle the result of a probe.  This is done in address order, so
+   the MCs are added the same way no matter what order the responses
+   came back in.  Returns ENOMEM if the scan should stop. */
+static int
+probe_handle_rsp(ipmi_domain_t *domain, mc_ipmb_probe_t *probe)
 {
-    mc_ipmb_scan_info_t *info;
+    return handle_devid_rsp(domain, &probe->rsp_addr, probe->rsp_addr_len,
+			    &probe->rsp, probe->give_up);
+}
+
+/* Handle the results that are ready in address order, start probes
+   on new addresses to replace them, and finish the scan when
+   everything is done.  Must be called with the lock held, returns
+   with it released. */
+static void
+scan_advance(ipmi_domain_t *domain, mc_ipmb_scan_info_t *info)
+{
+    mc_ipmb_probe_t *probe;
+    int             rv;
+
+    if (info->in_advance) {
+	/* Another thread is already here, let it do the work. */
+	info->advance_again = 1;
+	ipmi_unlock(info->lock);
+	return;
+    }
+    info->in_advance = 1;
+
+ restart:
+    info->advance_again = 0;
+    while (info->active) {
+	probe = &info->probes[info->head];
+	if (probe->state != PROBE_DONE)
+	    break;
+	probe->state = PROBE_IDLE;
+	info->head = (info->head + 1) % info->num_probes;
+	info->active--;
+	ipmi_unlock(info->lock);
+	rv = probe_handle_rsp(domain, probe);
+	ipmi_lock(info->lock);
+	if (rv)
+	    info->addrs_left = 0;
+    }
+
+    while (info->addrs_left && (info->active < info->num_probes)) {
+	/* Mark the probe waiting before sending so a quick response
+	   doesn't get lost. */
+	probe = &info->probes[(info->head + info->active) % info->num_probes];
+	probe->state = PROBE_WAITING;
+	info->active++;
+	ipmi_unlock(info->lock);
+	rv = probe_start(domain, probe);
+	ipmi_lock(info->lock);
+	if (rv) {
+	    probe->state = PROBE_IDLE;
+	    info->active--;
+	}
+    }
+
+    if (info->advance_again)
+	goto restart;
+
+    if (info->active == 0) {
+	/* We've hit the end, we can quit now. */
+	ipmi_unlock(info->lock);
+	if (info->done_handler)
+	    info->done_handler(domain, 0, info->cb_data);
+	remove_bus_scans_running(domain, info);
+	free_bus_scan(info);
+	return;
+    }
+
+    info->in_advance = 0;
+    ipmi_unlock(info->lock);
+}
+
+/* The probe has a result (or couldn't get one if rspi is NULL), save
+   it until its turn comes. */
+static void
+probe_done(ipmi_domain_t *domain, mc_ipmb_probe_t *probe, ipmi_msgi_t *rspi)
+{
+    mc_ipmb_scan_info_t *info = probe->info;
+    unsigned int        len = 0;
+
+    if (rspi) {
+	memcpy(&probe->rsp_addr, &rspi->addr, rspi->addr_len);
+	probe->rsp_addr_len = rspi->addr_len;
+	len = rspi->msg.data_len;
+	if (len > sizeof(probe->rsp_data))
+	    len = sizeof(probe->rsp_data);
+	memcpy(probe->rsp_data, rspi->msg.data, len);
+    } else {
+	memcpy(&probe->rsp_addr, &probe->addr, info->addr_len);
+	probe->rsp_addr_len = info->addr_len;
+    }
+    if (len == 0) {
+	probe->rsp_data[0] = IPMI_UNKNOWN_ERR_CC;
+	len = 1;
+    }
+    probe->rsp.netfn = info->msg.netfn | 1;
+    probe->rsp.cmd = info->msg.cmd;
+    probe->rsp.data = probe->rsp_data;
+    probe->rsp.data_len = len;
+
+    ipmi_lock(info->lock);
+    probe->state = PROBE_DONE;
+    scan_advance(domain, info);
+}
+
+static void
+rescan_timeout_handler(void *cb_data, os_hnd_timer_id_t *id)
+{
+    mc_ipmb_probe_t     *probe = cb_data;
+    mc_ipmb_scan_info_t *info = probe->info;
     int                 rv;
+    ipmi_domain_t       *domain;
+
+    ipmi_lock(info->lock);
+    probe->timer_running = 0;
+    info->timers_running--;
+    if (info->cancelled) {
+	int last = (info->timers_running == 0);
+	ipmi_unlock(info->lock);
+	if (last)
+	    free_bus_scan(info);
+	return;
+    }
+    ipmi_unlock(info->lock);
+
+    domain = info->domain;
+    rv = _ipmi_domain_get(domain);
+    if (rv) {
+	ipmi_log(IPMI_LOG_INFO,
+		 "%sdomain.c(rescan_timeout_handler): "
+		 "BMC went away while scanning for MCs",
+		 DOMAIN_NAME(domain));
+	return;
+    }
+
+    rv = probe_send(domain, probe);
+    if (rv)
+	/* Couldn't retry, just go on to the next address. */
+	probe_done(domain, probe, NULL);
+
+    _ipmi_domain_put(domain);
+}
+
+/* The probe got an error.  If the MC at the address is active, give
+   it a few more tries before deciding it is gone.  Returns true if
+   the probe is being retried. */
+static int
+probe_retry(ipmi_domain_t *domain, mc_ipmb_probe_t *probe, ipmi_msgi_t *rspi)
+{
+    mc_ipmb_scan_info_t *info = probe->info;
+    ipmi_mc_t           *mc;
+    int                 active;
+    struct timeval      timeout;
+
+    mc = _ipmi_find_mc_by_addr(domain, &rspi->addr, rspi->addr_len);
+    if (!mc)
+	return 0;
+    active = ipmi_mc_is_active(mc);
+    _ipmi_mc_put(mc);
+    if (!active)
+	return 0;
+
+    /* Didn't get a response.  Maybe the MC has gone away? */
+    probe->missed_responses++;
+
+    /* We fail system interface addresses immediately, since they
+       shouldn't be a timeout problem. */
+    if ((info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	|| (probe->missed_responses >= MAX_MC_MISSED_RESPONSES))
+    {
+	probe->give_up = 1;
+	return 0;
+    }
+
+    if (rspi->msg.data[0] == IPMI_TIMEOUT_CC)
+	/* If we timed out, then no need to time, since a second has
+	   gone by already. */
+	return probe_send(domain, probe) == 0;
+
+    /* Try again after a second. */
+    ipmi_lock(info->lock);
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    probe->timer_running = 1;
+    info->timers_running++;
+    info->os_hnd->start_timer(info->os_hnd,
+			      probe->timer,
+			      &timeout,
+			      rescan_timeout_handler,
+			      probe);
+    ipmi_unlock(info->lock);
+    return 1;
+}
+
+static int
+devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
+{
+    mc_ipmb_probe_t *probe = rspi->data1;
+    int             rv;
+
+    rv = _ipmi_domain_get(domain);
+    if (rv) {
+	ipmi_log(IPMI_LOG_INFO,
+		 "%sdomain.c(devid_bc_rsp_handler): "
+		 "BMC went away while scanning for MCs",
+		 DOMAIN_NAME(domain));
+	return IPMI_MSG_ITEM_NOT_USED;
+    }
+
+    if ((rspi->msg.data_len == 0) || (rspi->msg.data[0] != 0)) {
+	if (rspi->msg.data_len && probe_retry(domain, probe, rspi))
+	    goto out;
+    }
+
+    probe_done(domain, probe, rspi);
+
+ out:
+    _ipmi_domain_put(domain);
+    return IPMI_MSG_ITEM_NOT_USED;
+}
+
+/* Start the probes for a new scan.  If nothing could be sent, this
+   returns the error from probe_start(), frees the scan and does not
+   call the done handler. */
+static int
+start_bus_scan(ipmi_domain_t *domain, mc_ipmb_scan_info_t *info)
+{
+    int rv = 0;
+
+    add_bus_scans_running(domain, info);
+    ipmi_lock(info->lock);
+    /* Hold off results until the first probes are started. */
+    info->in_advance = 1;
+    while (info->addrs_left && (info->active < info->num_probes)) {
+	mc_ipmb_probe_t *probe = &info->probes[info->active];
+	probe->state = PROBE_WAITING;
+	info->active++;
+	ipmi_unlock(info->lock);
+	rv = probe_start(domain, probe);
+	if (rv) {
+	    ipmi_lock(info->lock);
+	    probe->state = PROBE_IDLE;
+	    info->active--;
+	    break;
+	}
+	ipmi_lock(info->lock);
+    }
+
+    if (info->active == 0) {
+	ipmi_unlock(info->lock);
+	remove_bus_scans_running(domain, info);
+	free_bus_scan(info);
+	return rv;
+    }
+
+    info->in_advance = 0;
+    if (info->advance_again)
+	scan_advance(domain, info);
+    else
+	ipmi_unlock(info->lock);
+    return 0;
+}
+
+static int
+start_ipmb_mc_scan(ipmi_domain_t  *domain,
+		   int            channel,
+		   unsigned int   start_addr,
+		   unsigned int   end_addr,
+		   int            throttled,
+		   ipmi_domain_cb done_handler,
+		   void           *cb_data)
+{
+    mc_ipmb_scan_info_t *info;
     ipmi_ipmb_addr_t    *ipmb;
+    unsigned int        num_probes;
+    unsigned int        window;
 
     CHECK_DOMAIN_LOCK(domain);
 
@@ -2746,75 +3832,52 @@ ipmi_start_ipmb_mc_scan(ipmi_domain_t  *domain,
 	/* Make sure it is IPMB, or the BMC address. */
 	return ENOSYS;
 
-    info = ipmi_mem_alloc(sizeof(*info));
+    if (end_addr < start_addr)
+	end_addr = start_addr;
+
+    /* Probe as many addresses at once as allowed, but not more than
+       the connections can have outstanding or than there are
+       addresses. */
+    num_probes = domain->ipmb_scan_parallel;
+    window = _ipmi_domain_max_outstanding(domain);
+    if ((num_probes == 0) || (num_probes > window))
+	num_probes = window;
+    if (num_probes > ((end_addr - start_addr) / 2) + 1)
+	num_probes = ((end_addr - start_addr) / 2) + 1;
+
+    info = alloc_bus_scan(domain, num_probes, done_handler, cb_data);
     if (!info)
 	return ENOMEM;
-    memset(info, 0, sizeof(*info));
 
-    info->domain = domain;
     ipmb = (ipmi_ipmb_addr_t *) &info->addr;
     ipmb->addr_type = IPMI_IPMB_BROADCAST_ADDR_TYPE;
     ipmb->channel = channel;
     ipmb->slave_addr = start_addr;
     ipmb->lun = 0;
     info->addr_len = sizeof(*ipmb);
-    info->msg.netfn = IPMI_APP_NETFN;
-    info->msg.cmd = IPMI_GET_DEVICE_ID_CMD;
-    info->msg.data = NULL;
-    info->msg.data_len = 0;
+    info->next_addr = start_addr;
     info->end_addr = end_addr;
-    info->done_handler = done_handler;
-    info->cb_data = cb_data;
-    info->missed_responses = 0;
-    info->os_hnd = domain->os_hnd;
-    rv = info->os_hnd->alloc_timer(info->os_hnd, &info->timer);
-    if (rv)
-	goto out_err;
+    info->addrs_left = 1;
+    info->throttled = throttled;
 
-    rv = ipmi_create_lock(domain, &info->lock);
-    if (rv)
-	goto out_err;
-
-    rv = ENOSYS; /* Return err if no scans done */
+    start_bus_scan(domain, info);
 
-    /* Skip addresses we must ignore. */
-    while (in_ipmb_ignores(domain, ipmb->channel, ipmb->slave_addr)) {
-	/* ipmb->slave_addr is 8 bits, so we can't do a <= comparison as it
-	   will overflow after 254. */
-	if (ipmb->slave_addr == end_addr)
-	    goto out_err;
-	ipmb->slave_addr += 2;
-    }
-    while (rv) {
-	rv = ipmi_send_command_addr(domain,
-				    &info->addr,
-				    info->addr_len,
-				    &(info->msg),
-				    devid_bc_rsp_handler,
-				    info, NULL);
-	if (rv) {
-	    if (ipmb->slave_addr == end_addr)
-		goto out_err;
-	    ipmb->slave_addr += 2;
-	}
-    }
-
-    if (rv)
-	goto out_err;
-    else
-	add_bus_scans_running(domain, info);
-    return 0;
-
- out_err:
-    if (info->timer)
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-    if (info->lock)
-	ipmi_destroy_lock(info->lock);
-    ipmi_mem_free(info);
     return 0; /* Since the done handler is always called, always
 		 return true.  Bus scans always succeed. */
 }
 
+int
+ipmi_start_ipmb_mc_scan(ipmi_domain_t  *domain,
+	       		int            channel,
+	       		unsigned int   start_addr,
+			unsigned int   end_addr,
+			ipmi_domain_cb done_handler,
+			void           *cb_data)
+{
+    return start_ipmb_mc_scan(domain, channel, start_addr, end_addr, 0,
+			      done_handler, cb_data);
+}
+
 int
 ipmi_start_si_scan(ipmi_domain_t  *domain,
 		   int            si_num,
@@ -2823,91 +3886,212 @@ ipmi_start_si_scan(ipmi_domain_t  *domain,
 {
     mc_ipmb_scan_info_t          *info;
     ipmi_system_interface_addr_t *si;
-    int                          rv;
 
-    info = ipmi_mem_alloc(sizeof(mc_ipmb_scan_info_t));
+    info = alloc_bus_scan(domain, 1, done_handler, cb_data);
     if (!info) 
 	return ENOMEM;
-    memset(info, 0, sizeof(*info));
 
-    info->domain = domain;
     si = (void *) &info->addr;
     si->addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
     si->channel = si_num;
     si->lun = 0;
     info->addr_len = sizeof(*si);
-    info->msg.netfn = IPMI_APP_NETFN;
-    info->msg.cmd = IPMI_GET_DEVICE_ID_CMD;
-    info->msg.data = NULL;
-    info->msg.data_len = 0;
-    info->done_handler = done_handler;
-    info->cb_data = cb_data;
-    info->missed_responses = 0;
-    info->os_hnd = domain->os_hnd;
-    rv = info->os_hnd->alloc_timer(info->os_hnd, &info->timer);
-    if (rv)
-	goto out_err;
+    info->addrs_left = 1;
 
-    rv = ipmi_create_lock(domain, &info->lock);
-    if (rv)
-	goto out_err;
+    return start_bus_scan(domain, info);
+}
+
+/***********************************************************************
+ *
+ * Saved topology for warm starts
+ *
+ **********************************************************************/
+
+/* When the cache is in use, the MCs on the IPMB are saved to the
+   database whenever the bus scans finish.  When the domain comes up
+   again the saved MCs are created right away and the bus is scanned
+   in the background to catch anything that changed, so a restart of
+   a big system isn't held up waiting on a full scan.  The data is a
+   format byte followed by an entry for each MC: the channel, the
+   slave address, the length of the device id response and the
+   response. */
+#define TOPOLOGY_FORMAT		1
+#define TOPOLOGY_RSP_LEN	16
+#define TOPOLOGY_ENTRY_LEN	(3 + TOPOLOGY_RSP_LEN)
+
+static int get_ipmb_mcs(ipmi_domain_t *domain, ipmi_mc_t ***rmcs,
+			unsigned int *rcount);
+
+static void
+topology_db_key(ipmi_domain_t *domain, char *key)
+{
+    strcpy(key, "topo-");
+    ipmi_domain_get_name(domain, key + 5, IPMI_DOMAIN_NAME_LEN + 1);
+}
+
+static void
+save_topology(ipmi_domain_t *domain)
+{
+    os_handler_t  *os_hnd = domain->os_hnd;
+    char          key[IPMI_DOMAIN_NAME_LEN + 6];
+    ipmi_mc_t     **mcs;
+    unsigned int  count, i;
+    unsigned char *data, *d;
+    int           rv;
+
+    if (!ipmi_option_use_cache(domain) || !os_hnd->database_store)
+	return;
+    if (!domain->do_bus_scan || !ipmi_option_IPMB_scan(domain))
+	/* Only the BMCs were scanned. */
+	return;
 
-    rv = ipmi_send_command_addr(domain,
-				&info->addr,
-				info->addr_len,
-				&(info->msg),
-				devid_bc_rsp_handler,
-				info, NULL);
+    rv = get_ipmb_mcs(domain, &mcs, &count);
     if (rv)
-	goto out_err;
-    else
-	add_bus_scans_running(domain, info);
-    return 0;
+	return;
 
- out_err:
-    if (info->timer)
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-    if (info->lock)
-	ipmi_destroy_lock(info->lock);
-    ipmi_mem_free(info);
-    return rv;
+    data = ipmi_mem_alloc(1 + (count * TOPOLOGY_ENTRY_LEN));
+    if (data) {
+	d = data;
+	*d++ = TOPOLOGY_FORMAT;
+	for (i=0; i<count; i++) {
+	    if (!ipmi_mc_is_active(mcs[i]))
+		continue;
+	    d[0] = ipmi_mc_get_channel(mcs[i]);
+	    d[1] = ipmi_mc_get_address(mcs[i]);
+	    d[2] = _ipmi_mc_get_device_id_rsp(mcs[i], d + 3);
+	    d += TOPOLOGY_ENTRY_LEN;
+	}
+	topology_db_key(domain, key);
+	os_hnd->database_store(os_hnd, key, data, d - data);
+	ipmi_mem_free(data);
+    }
+
+    for (i=0; i<count; i++)
+	_ipmi_mc_put(mcs[i]);
+    if (mcs)
+	ipmi_mem_free(mcs);
 }
 
+/* Create the MCs saved by save_topology().  Returns true if any were
+   created. */
+static int
+load_topology(ipmi_domain_t *domain)
+{
+    os_handler_t     *os_hnd = domain->os_hnd;
+    char             key[IPMI_DOMAIN_NAME_LEN + 6];
+    unsigned char    *data, *d;
+    unsigned int     data_len;
+    unsigned int     fetched = 0;
+    unsigned int     i, count;
+    ipmi_ipmb_addr_t ipmb;
+    ipmi_msg_t       msg;
+    int              loaded = 0;
+    int              rv;
+
+    if (!ipmi_option_use_cache(domain) || !os_hnd->database_find)
+	return 0;
+    if (!domain->do_bus_scan || !ipmi_option_IPMB_scan(domain))
+	return 0;
+    if (htable_count(domain->ipmb_mcs) != 0)
+	/* Not the first time up, we already have the MCs. */
+	return 0;
+
+    topology_db_key(domain, key);
+    /* Later would be too late, the bus scan starts after this. */
+    rv = os_hnd->database_find(os_hnd, key, &fetched, &data, &data_len,
+			       NULL, NULL);
+    if (rv || !fetched)
+	return 0;
+
+    if ((data_len < 1) || (data[0] != TOPOLOGY_FORMAT)
+	|| (((data_len - 1) % TOPOLOGY_ENTRY_LEN) != 0))
+	goto out;
+
+    count = (data_len - 1) / TOPOLOGY_ENTRY_LEN;
+    for (i=0, d=data+1; i<count; i++, d+=TOPOLOGY_ENTRY_LEN) {
+	if ((d[0] >= MAX_IPMI_USED_CHANNELS) || (d[2] > TOPOLOGY_RSP_LEN))
+	    continue;
+	if (domain->chan[d[0]].medium != IPMI_CHANNEL_MEDIUM_IPMB)
+	    continue;
+	if (in_ipmb_ignores(domain, d[0], d[1]))
+	    continue;
+
+	ipmb.addr_type = IPMI_IPMB_ADDR_TYPE;
+	ipmb.channel = d[0];
+	ipmb.slave_addr = d[1];
+	ipmb.lun = 0;
+	msg.netfn = IPMI_APP_NETFN | 1;
+	msg.cmd = IPMI_GET_DEVICE_ID_CMD;
+	msg.data = d + 3;
+	msg.data_len = d[2];
+	if (handle_devid_rsp(domain, (ipmi_addr_t *) &ipmb, sizeof(ipmb),
+			     &msg, 0))
+	    break;
+	loaded = 1;
+    }
+
+ out:
+    os_hnd->database_free(os_hnd, data);
+    return loaded;
+}
+
+/* Background scans pass the domain as their callback data so they
+   don't hold up fully up. */
 static void
 mc_scan_done(ipmi_domain_t *domain, int err, void *cb_data)
 {
     ipmi_domain_cb bus_scan_handler;
     void           *bus_scan_handler_cb_data;
+    int            hold_fully_up = (cb_data == NULL);
 
     ipmi_lock(domain->mc_lock);
     domain->scanning_bus_count--;
     if (domain->scanning_bus_count) {
-	_ipmi_put_domain_fully_up(domain, "mc_scan_done");
+	if (hold_fully_up)
+	    _ipmi_put_domain_fully_up(domain, "mc_scan_done");
 	ipmi_unlock(domain->mc_lock);
 	return;
     }
 
+    domain->scan_in_background = 0;
+    if (domain->ipmb_scan_timed) {
+	domain->ipmb_scan_timed = 0;
+	_ipmi_domain_phase_time(domain, IPMI_DOMAIN_PHASE_IPMB_SCAN,
+				&domain->ipmb_scan_start);
+    }
+    _ipmi_domain_span_end(domain, domain->scan_span);
+    domain->scan_span = 0;
     bus_scan_handler = domain->bus_scan_handler;
     bus_scan_handler_cb_data = domain->bus_scan_handler_cb_data;
     ipmi_unlock(domain->mc_lock);
+    save_topology(domain);
     if (bus_scan_handler)
 	bus_scan_handler(domain, 0,
 			 bus_scan_handler_cb_data);
-    _ipmi_put_domain_fully_up(domain, "mc_scan_done");
+    if (hold_fully_up)
+	_ipmi_put_domain_fully_up(domain, "mc_scan_done");
 }
 
 void
 _ipmi_start_mc_scan_one(ipmi_domain_t *domain, int chan, int first, int last)
 {
-    int rv;
+    int  rv;
+    void *background = NULL;
+
+    /* On a warm start, only the single address scans for the BMCs
+       hold up fully up, the MCs on the bus are already there. */
+    if (domain->scan_in_background && (first != last))
+	background = domain;
 
-    _ipmi_get_domain_fully_up(domain, "_ipmi_start_mc_scan_one");
+    if (!background)
+	_ipmi_get_domain_fully_up(domain, "_ipmi_start_mc_scan_one");
     domain->scanning_bus_count++;
-    rv = ipmi_start_ipmb_mc_scan(domain, chan, first, last,
-				 mc_scan_done, NULL);
+    rv = start_ipmb_mc_scan(domain, chan, first, last,
+			    domain->throttle_scans, mc_scan_done, background);
     if (rv) {
 	domain->scanning_bus_count--;
-	_ipmi_put_domain_fully_up(domain, "_ipmi_start_mc_scan_one");
+	if (!background)
+	    _ipmi_put_domain_fully_up(domain, "_ipmi_start_mc_scan_one");
     }
 }
 
@@ -2924,8 +4108,10 @@ cmp_int(const void *v1, const void *v2)
 	return 0;
 }
 
-void
-ipmi_domain_start_full_ipmb_scan(ipmi_domain_t *domain)
+/* Scan all the IPMB addresses.  If throttled is set, the probes of
+   the bus scans go through the background operation limit. */
+static void
+start_full_ipmb_scan(ipmi_domain_t *domain, int throttled)
 {
     int i, j;
     int rv;
@@ -2935,6 +4121,7 @@ ipmi_domain_start_full_ipmb_scan(ipmi_domain_t *domain)
 	return;
 
     ipmi_lock(domain->mc_lock);
+    domain->throttle_scans = throttled;
     if (!domain->do_bus_scan || (!ipmi_option_IPMB_scan(domain))) {
 	/* Always scan the local BMC(s). */
 	for (i=0; i<MAX_CONS; i++) {
@@ -2955,14 +4142,14 @@ ipmi_domain_start_full_ipmb_scan(ipmi_domain_t *domain)
 					domain->con_ipmb_addr[i][0]);
 	    }
 	}
-	ipmi_unlock(domain->mc_lock);
-	return;
+	goto out_unlock;
     }
 
-    if (domain->scanning_bus_count) {
-	ipmi_unlock(domain->mc_lock);
-	return;
-    }
+    if (domain->scanning_bus_count)
+	goto out_unlock;
+
+    domain->os_hnd->get_monotonic_time(domain->os_hnd,
+				       &domain->last_full_ipmb_scan);
 
     /* If a connections supports sysaddress scanning, then scan the
        system address for that connection. */
@@ -3016,7 +4203,72 @@ ipmi_domain_start_full_ipmb_scan(ipmi_domain_t *domain)
 	    }
 	}
     }
+
+ out_unlock:
+    domain->throttle_scans = 0;
+    ipmi_unlock(domain->mc_lock);
+}
+
+/* Between full scans, probe just the IPMB MCs that are already known
+   so ones that have gone away are noticed.  New ones are found from
+   events, or by the next full scan. */
+static void
+start_known_ipmb_scan(ipmi_domain_t *domain)
+{
+    ipmi_mc_t        **mcs;
+    unsigned int     count, i;
+    ipmi_addr_t      addr;
+    ipmi_ipmb_addr_t *ipmb = (ipmi_ipmb_addr_t *) &addr;
+    unsigned int     addr_len;
+    int              rv;
+
+    if (domain->in_shutdown)
+	return;
+
+    if (get_ipmb_mcs(domain, &mcs, &count))
+	return;
+
+    ipmi_lock(domain->mc_lock);
+    if (domain->scanning_bus_count) {
+	ipmi_unlock(domain->mc_lock);
+	goto out;
+    }
+    for (i=0; i<count; i++) {
+	ipmi_mc_get_ipmi_address(mcs[i], &addr, &addr_len);
+	if (addr.addr_type != IPMI_IPMB_ADDR_TYPE)
+	    continue;
+	/* These never hold up fully up, the domain is already up. */
+	domain->scanning_bus_count++;
+	rv = start_ipmb_mc_scan(domain, ipmb->channel, ipmb->slave_addr,
+				ipmb->slave_addr, 1, mc_scan_done, domain);
+	if (rv)
+	    domain->scanning_bus_count--;
+    }
     ipmi_unlock(domain->mc_lock);
+
+ out:
+    for (i=0; i<count; i++)
+	_ipmi_mc_put(mcs[i]);
+    if (mcs)
+	ipmi_mem_free(mcs);
+}
+
+static int
+full_ipmb_scan_due(ipmi_domain_t *domain)
+{
+    struct timeval now;
+
+    if (!domain->ipmb_full_rescan_interval)
+	return 1;
+    domain->os_hnd->get_monotonic_time(domain->os_hnd, &now);
+    return ((now.tv_sec - domain->last_full_ipmb_scan.tv_sec)
+	    >= (long) domain->ipmb_full_rescan_interval);
+}
+
+void
+ipmi_domain_start_full_ipmb_scan(ipmi_domain_t *domain)
+{
+    start_full_ipmb_scan(domain, 0);
 }
 
 static void
@@ -3029,9 +4281,11 @@ refetch_sdr_handler(ipmi_sdr_info_t *sdrs,
     ipmi_domain_t *domain = cb_data;
 
     if (changed) {
+	_ipmi_domain_update_batch_start(domain);
 	ipmi_entity_scan_sdrs(domain, NULL,
 			      domain->entities, domain->main_sdrs);
 	ipmi_sensor_handle_sdrs(domain, NULL, domain->main_sdrs);
+	_ipmi_domain_update_batch_end(domain);
 	ipmi_detect_ents_presence_changes(domain->entities, 1);
     }
 }
@@ -3077,14 +4331,17 @@ domain_audit(void *cb_data, os_hnd_timer_id_t *id)
     /* Rescan all the presence sensors to make sure they are valid. */
     ipmi_detect_domain_presence_changes(domain, 1);
     
-    ipmi_domain_start_full_ipmb_scan(domain);
+    if (full_ipmb_scan_due(domain))
+	start_full_ipmb_scan(domain, 1);
+    else
+	start_known_ipmb_scan(domain);
 
     /* Also check to see if the SDRs have changed. */
     check_main_sdrs(domain);
 
  out_start_timer:
-    timeout.tv_sec = domain->audit_domain_interval;
-    timeout.tv_usec = 0;
+    _ipmi_pace_interval(domain->os_hnd, domain->audit_domain_interval, 0,
+			&timeout);
     domain->os_hnd->start_timer(domain->os_hnd,
 				id,
 				&timeout,
@@ -3116,6 +4373,290 @@ event_sensor_cb(ipmi_sensor_t *sensor, void *cb_data)
     info->err = ipmi_sensor_event(sensor, info->event);
 }
 
+static unsigned int
+hash_sensor_id(ipmi_sensor_id_t *id)
+{
+    return ipmi_hash_uint((id->mcid.channel << 16) | (id->mcid.mc_num << 11)
+			  | (id->lun << 8) | id->sensor_num);
+}
+
+static int
+event_filter_cmp(void *item, void *cb_data)
+{
+    event_filter_t   *f = item;
+    ipmi_sensor_id_t *id = cb_data;
+
+    return ipmi_cmp_sensor_id(f->id, *id) == 0;
+}
+
+static long
+tv_diff_ms(struct timeval *end, struct timeval *start)
+{
+    return (((end->tv_sec - start->tv_sec) * 1000)
+	    + ((end->tv_usec - start->tv_usec) / 1000));
+}
+
+/* Returns true if the event should be dropped.  If some events of
+   the sensor were dropped by the rate limit in an earlier period,
+   the count is returned in suppressed so it can be reported. */
+static int
+filter_sensor_event(ipmi_domain_t       *domain,
+		    ipmi_sensor_id_t    *id,
+		    const unsigned char *data,
+		    unsigned int        *suppressed)
+{
+    unsigned int   hash = hash_sensor_id(id);
+    event_filter_t *f;
+    struct timeval now;
+    unsigned int   i;
+    int            rv = 0;
+
+    *suppressed = 0;
+    if (!domain->event_dedup_window && !domain->event_rate_max)
+	return 0;
+
+    domain->os_hnd->get_monotonic_time(domain->os_hnd, &now);
+
+    ipmi_lock(domain->event_filter_lock);
+    f = htable_find(domain->event_filters, hash, event_filter_cmp, id);
+    if (!f) {
+	f = ipmi_mem_alloc(sizeof(*f));
+	if (!f)
+	    /* Just let it through. */
+	    goto out_unlock;
+	memset(f, 0, sizeof(*f));
+	f->id = *id;
+	f->period_start = now;
+	if (!htable_add(domain->event_filters, hash, f)) {
+	    ipmi_mem_free(f);
+	    goto out_unlock;
+	}
+    }
+
+    if (domain->event_dedup_window) {
+	for (i=0; i<f->num_recent; i++) {
+	    if ((memcmp(f->recent[i].data, data, 4) == 0)
+		&& (tv_diff_ms(&now, &f->recent[i].time)
+		    < (long) domain->event_dedup_window))
+	    {
+		if (domain->event_dedup_stat)
+		    ipmi_domain_stat_add(domain->event_dedup_stat, 1);
+		rv = 1;
+		goto out_unlock;
+	    }
+	}
+	memcpy(f->recent[f->next_recent].data, data, 4);
+	f->recent[f->next_recent].time = now;
+	f->next_recent = (f->next_recent + 1) % EVENT_DEDUP_HIST;
+	if (f->num_recent < EVENT_DEDUP_HIST)
+	    f->num_recent++;
+    }
+
+    if (domain->event_rate_max) {
+	if (tv_diff_ms(&now, &f->period_start)
+	    >= (long) domain->event_rate_period)
+	{
+	    f->period_start = now;
+	    f->period_count = 0;
+	    *suppressed = f->suppressed;
+	    f->suppressed = 0;
+	}
+	if (f->period_count >= domain->event_rate_max) {
+	    f->suppressed++;
+	    if (domain->event_rate_limit_stat)
+		ipmi_domain_stat_add(domain->event_rate_limit_stat, 1);
+	    rv = 1;
+	    goto out_unlock;
+	}
+	f->period_count++;
+    }
+
+ out_unlock:
+    ipmi_unlock(domain->event_filter_lock);
+    return rv;
+}
+
+void
+ipmi_domain_set_event_dedup_window(ipmi_domain_t *domain,
+				   unsigned int  window_ms)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    ipmi_lock(domain->event_filter_lock);
+    domain->event_dedup_window = window_ms;
+    ipmi_unlock(domain->event_filter_lock);
+}
+
+unsigned int
+ipmi_domain_get_event_dedup_window(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->event_dedup_window;
+}
+
+int
+ipmi_domain_set_event_rate_limit(ipmi_domain_t            *domain,
+				 unsigned int             max_events,
+				 unsigned int             period_ms,
+				 ipmi_event_suppressed_cb handler,
+				 void                     *cb_data)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (max_events && !period_ms)
+	return EINVAL;
+
+    ipmi_lock(domain->event_filter_lock);
+    domain->event_rate_max = max_events;
+    domain->event_rate_period = period_ms;
+    domain->event_suppressed_handler = handler;
+    domain->event_suppressed_cb_data = cb_data;
+    ipmi_unlock(domain->event_filter_lock);
+    return 0;
+}
+
+int
+ipmi_domain_set_sensor_update_handler(ipmi_domain_t         *domain,
+				      ipmi_sensor_update_cb handler,
+				      void                  *cb_data)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    ipmi_lock(domain->domain_lock);
+    domain->sensor_update_handler = handler;
+    domain->sensor_update_cb_data = cb_data;
+    ipmi_unlock(domain->domain_lock);
+    return 0;
+}
+
+ipmi_sensor_update_cb
+_ipmi_domain_get_sensor_update_handler(ipmi_domain_t *domain, void **cb_data)
+{
+    /* This is on the sensor fast path, so no lock, like the
+       suppressed event handler. */
+    *cb_data = domain->sensor_update_cb_data;
+    return domain->sensor_update_handler;
+}
+
+int
+ipmi_domain_set_update_batch_handler(ipmi_domain_t        *domain,
+				     ipmi_update_batch_cb handler,
+				     void                 *cb_data)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    ipmi_lock(domain->domain_lock);
+    domain->update_batch_handler = handler;
+    domain->update_batch_cb_data = cb_data;
+    ipmi_unlock(domain->domain_lock);
+    return 0;
+}
+
+void
+_ipmi_domain_update_batch_start(ipmi_domain_t *domain)
+{
+    ipmi_update_batch_cb handler;
+    void                 *cb_data;
+
+    ipmi_lock(domain->domain_lock);
+    handler = domain->update_batch_handler;
+    cb_data = domain->update_batch_cb_data;
+    if (!handler || (domain->batch_depth++ > 0)) {
+	ipmi_unlock(domain->domain_lock);
+	return;
+    }
+    domain->batch_num_changes = 0;
+    ipmi_unlock(domain->domain_lock);
+
+    handler(domain, 0, NULL, 0, cb_data);
+}
+
+void
+_ipmi_domain_update_batch_end(ipmi_domain_t *domain)
+{
+    ipmi_update_batch_cb       handler;
+    void                       *cb_data;
+    ipmi_update_batch_change_t *changes;
+    unsigned int               num_changes;
+
+    ipmi_lock(domain->domain_lock);
+    if ((domain->batch_depth == 0) || (--domain->batch_depth > 0)) {
+	ipmi_unlock(domain->domain_lock);
+	return;
+    }
+    handler = domain->update_batch_handler;
+    cb_data = domain->update_batch_cb_data;
+    changes = domain->batch_changes;
+    num_changes = domain->batch_num_changes;
+    domain->batch_changes = NULL;
+    domain->batch_num_changes = 0;
+    domain->batch_changes_size = 0;
+    ipmi_unlock(domain->domain_lock);
+
+    /* The handler may have been cleared in the middle, it still gets
+       its end if it is there now. */
+    if (handler)
+	handler(domain, 1, changes, num_changes, cb_data);
+    if (changes)
+	ipmi_mem_free(changes);
+}
+
+void
+_ipmi_domain_update_batch_note(ipmi_domain_t      *domain,
+			       enum ipmi_update_e op,
+			       ipmi_entity_t      *entity,
+			       ipmi_sensor_t      *sensor,
+			       ipmi_control_t     *control)
+{
+    ipmi_update_batch_change_t change, *c;
+    unsigned int               size;
+
+    /* Unlocked peek, this is called for every update. */
+    if (!domain->batch_depth)
+	return;
+
+    /* Get the ids before taking the domain lock, getting a sensor or
+       control id may need the entity lock. */
+    memset(&change, 0, sizeof(change));
+    change.op = op;
+    change.entity_id = ipmi_entity_convert_to_id(entity);
+    if (sensor) {
+	change.kind = IPMI_UPDATE_BATCH_SENSOR;
+	change.sensor_id = ipmi_sensor_convert_to_id(sensor);
+    } else if (control) {
+	change.kind = IPMI_UPDATE_BATCH_CONTROL;
+	change.control_id = ipmi_control_convert_to_id(control);
+    } else {
+	change.kind = IPMI_UPDATE_BATCH_ENTITY;
+    }
+
+    ipmi_lock(domain->domain_lock);
+    if (!domain->batch_depth)
+	goto out_unlock;
+
+    if (domain->batch_num_changes >= domain->batch_changes_size) {
+	size = domain->batch_changes_size ? domain->batch_changes_size * 2
+					  : 32;
+	c = ipmi_mem_alloc(size * sizeof(*c));
+	if (!c)
+	    /* Just lose the change, the normal handlers still get it. */
+	    goto out_unlock;
+	if (domain->batch_changes) {
+	    memcpy(c, domain->batch_changes,
+		   domain->batch_num_changes * sizeof(*c));
+	    ipmi_mem_free(domain->batch_changes);
+	}
+	domain->batch_changes = c;
+	domain->batch_changes_size = size;
+    }
+
+    domain->batch_changes[domain->batch_num_changes++] = change;
+
+ out_unlock:
+    ipmi_unlock(domain->domain_lock);
+}
+
 void
 _ipmi_domain_system_event_handler(ipmi_domain_t *domain,
 				  ipmi_mc_t     *ev_mc,
@@ -3161,10 +4702,15 @@ _ipmi_domain_system_event_handler(ipmi_domain_t *domain,
 	ipmi_sensor_id_t    id;
 	event_sensor_info_t info;
 	const unsigned char *data;
+	unsigned int        suppressed;
 
 	mc = _ipmi_event_get_generating_mc(domain, ev_mc, event);
-	if (!mc)
+	if (!mc) {
+	    /* An MC we don't know about sent an event, look for it. */
+	    data = ipmi_event_get_data_ptr(event);
+	    _ipmi_domain_ipmb_changed(domain, data[5] >> 4, data[4]);
 	    goto out;
+	}
 
 	/* Let the OEM handler for the MC that sent the event try
 	   next. */
@@ -3179,6 +4725,14 @@ _ipmi_domain_system_event_handler(ipmi_domain_t *domain,
 	id.lun = data[5] & 0x3;
 	id.sensor_num = data[8];
 
+	if (filter_sensor_event(domain, &id, data + 9, &suppressed)) {
+	    _ipmi_mc_put(mc);
+	    return;
+	}
+	if (suppressed && domain->event_suppressed_handler)
+	    domain->event_suppressed_handler(domain, id, suppressed,
+					     domain->event_suppressed_cb_data);
+
 	info.event = event;
 
 	rv = ipmi_sensor_pointer_cb(id, event_sensor_cb, &info);
@@ -3195,13 +4749,12 @@ _ipmi_domain_system_event_handler(ipmi_domain_t *domain,
 }
 
 static void
-ll_event_handler(ipmi_con_t        *ipmi,
-		 const ipmi_addr_t *addr,
-		 unsigned int      addr_len,
-		 ipmi_event_t      *event,
-		 void              *cb_data)
+handle_ll_event(ipmi_domain_t     *domain,
+		ipmi_con_t        *ipmi,
+		const ipmi_addr_t *addr,
+		unsigned int      addr_len,
+		ipmi_event_t      *event)
 {
-    ipmi_domain_t                *domain = cb_data;
     ipmi_mc_t                    *mc;
     int                          rv;
     ipmi_system_interface_addr_t si;
@@ -3228,43 +4781,246 @@ ll_event_handler(ipmi_con_t        *ipmi,
 	addr_len = sizeof(si);
     }
 
-    /* It came from an MC, so find the MC. */
-    mc = _ipmi_find_mc_by_addr(domain, addr, addr_len);
-    if (!mc)
-	goto out;
-    ipmi_event_set_mcid(event, ipmi_mc_convert_to_id(mc));
+    /* It came from an MC, so find the MC. */
+    mc = _ipmi_find_mc_by_addr(domain, addr, addr_len);
+    if (!mc)
+	goto out;
+
+    if (event == NULL) {
+	/* The incoming event didn't carry the full event information.
+	   Just scan for events in the MC's SEL.  A burst of these
+	   (like SNMP traps during an outage) all share one check if
+	   the SEL is being scanned. */
+	if (!_ipmi_mc_sel_event_hint(mc))
+	    ipmi_mc_reread_sel(mc, NULL, NULL);
+    } else {
+	ipmi_event_set_mcid(event, ipmi_mc_convert_to_id(mc));
+
+	/* Add it to the mc's event log. */
+	rv = _ipmi_mc_sel_event_add(mc, event);
+
+	if (rv != EEXIST) {
+	    /* Call the handler on it if it wasn't already in there. */
+	    _ipmi_domain_system_event_handler(domain, mc, event);
+
+	    /* The SEL has probably changed, check it soon. */
+	    _ipmi_mc_sel_event_hint(mc);
+	}
+    }
+    _ipmi_mc_put(mc);
+
+ out:
+    _ipmi_domain_put(domain);
+}
+
+typedef struct ll_event_work_s
+{
+    ipmi_domain_t *domain;
+    ipmi_con_t    *ipmi;
+    ipmi_addr_t   addr;
+    unsigned int  addr_len;
+    ipmi_event_t  *event;
+} ll_event_work_t;
+
+static void
+ll_event_work(void *cb_data)
+{
+    ll_event_work_t *info = cb_data;
+
+    /* The domain may have gone away while this was queued, that's
+       checked when the domain is fetched. */
+    handle_ll_event(info->domain, info->ipmi, &info->addr, info->addr_len,
+		    info->event);
+    if (info->event)
+	ipmi_event_free(info->event);
+    ipmi_mem_free(info);
+}
+
+static void
+ll_event_handler(ipmi_con_t        *ipmi,
+		 const ipmi_addr_t *addr,
+		 unsigned int      addr_len,
+		 ipmi_event_t      *event,
+		 void              *cb_data)
+{
+    ipmi_domain_t   *domain = cb_data;
+    ll_event_work_t *info;
+
+    if (!domain->event_wq || addr_len > sizeof(info->addr))
+	goto inline_event;
+
+    info = ipmi_mem_alloc(sizeof(*info));
+    if (!info)
+	goto inline_event;
+    info->domain = domain;
+    info->ipmi = ipmi;
+    memcpy(&info->addr, addr, addr_len);
+    info->addr_len = addr_len;
+    info->event = ipmi_event_dup(event);
+    if (domain->os_hnd->queue_work(domain->os_hnd, domain->event_wq,
+				   ll_event_work, info))
+    {
+	if (info->event)
+	    ipmi_event_free(info->event);
+	ipmi_mem_free(info);
+	goto inline_event;
+    }
+    return;
+
+ inline_event:
+    handle_ll_event(domain, ipmi, addr, addr_len, event);
+}
+
+typedef struct call_event_handler_s
+{
+    ipmi_domain_t *domain;
+    ipmi_event_t  *event;
+} call_event_handler_t;
+
+typedef struct find_event_handler_s
+{
+    ipmi_event_handler_cb handler;
+    void                  *cb_data;
+    int                   found;
+} find_event_handler_t;
+
+static int
+find_event_handler(void *cb_data, void *item1, void *item2)
+{
+    find_event_handler_t *info = cb_data;
+
+    if ((item1 == info->handler) && (item2 == info->cb_data)) {
+	info->found = 1;
+	return LOCKED_LIST_ITER_STOP;
+    }
+    return LOCKED_LIST_ITER_CONTINUE;
+}
+
+typedef struct queued_event_s
+{
+    ipmi_domain_t         *domain;
+    ipmi_event_handler_cb handler;
+    void                  *cb_data;
+    ipmi_event_t          *event;
+} queued_event_t;
+
+static void
+queued_event_work(void *cb_data)
+{
+    queued_event_t       *qe = cb_data;
+    ipmi_domain_t        *domain = qe->domain;
+    find_event_handler_t info;
+
+    /* The domain may have gone away while this was queued, that's
+       checked when the domain is fetched. */
+    if (!_ipmi_domain_get(domain)) {
+	ipmi_lock(domain->event_queue_lock);
+	domain->event_queue_count--;
+	ipmi_unlock(domain->event_queue_lock);
+
+	/* Don't call the handler if it was removed while this
+	   waited. */
+	info.handler = qe->handler;
+	info.cb_data = qe->cb_data;
+	info.found = 0;
+	locked_list_iterate(domain->event_handlers, find_event_handler,
+			    &info);
+	if (info.found)
+	    qe->handler(domain, qe->event, qe->cb_data);
+	_ipmi_domain_put(domain);
+    }
+    ipmi_event_free(qe->event);
+    ipmi_mem_free(qe);
+}
+
+/* Queue a call of the handler with the event to the handler's work
+   queue.  Returns an error if it can't be queued and the handler
+   should be called directly. */
+static int
+queue_event_handler(ipmi_domain_t         *domain,
+		    ipmi_event_handler_cb handler,
+		    void                  *cb_data,
+		    ipmi_event_t          *event)
+{
+    os_handler_t   *os_hnd = domain->os_hnd;
+    event_hqueue_t *hq;
+    queued_event_t *qe;
+    int            rv;
+
+    ipmi_lock(domain->event_queue_lock);
+    if (!domain->event_queue_max) {
+	rv = ENOSYS;
+	goto out_unlock;
+    }
+    if (domain->event_queue_count >= domain->event_queue_max) {
+	/* Making the caller run the handler slows down whoever is
+	   delivering the events, which is the backpressure we
+	   want. */
+	if (domain->event_queue_full_stat)
+	    ipmi_domain_stat_add(domain->event_queue_full_stat, 1);
+	rv = EAGAIN;
+	goto out_unlock;
+    }
 
-    if (event == NULL) {
-	/* The incoming event didn't carry the full event information.
-	   Just scan for events in the MC's SEL. */
-	ipmi_mc_reread_sel(mc, NULL, NULL);
-    } else {
-	/* Add it to the mc's event log. */
-	rv = _ipmi_mc_sel_event_add(mc, event);
+    for (hq=domain->event_hqueues; hq; hq=hq->next) {
+	if ((hq->handler == handler) && (hq->cb_data == cb_data))
+	    break;
+    }
+    if (!hq) {
+	hq = ipmi_mem_alloc(sizeof(*hq));
+	if (!hq) {
+	    rv = ENOMEM;
+	    goto out_unlock;
+	}
+	rv = os_hnd->alloc_work_queue(os_hnd, &hq->wq);
+	if (rv) {
+	    ipmi_mem_free(hq);
+	    goto out_unlock;
+	}
+	hq->handler = handler;
+	hq->cb_data = cb_data;
+	hq->next = domain->event_hqueues;
+	domain->event_hqueues = hq;
+    }
 
-	if (rv != EEXIST)
-	    /* Call the handler on it if it wasn't already in there. */
-	    _ipmi_domain_system_event_handler(domain, mc, event);
+    qe = ipmi_mem_alloc(sizeof(*qe));
+    if (!qe) {
+	rv = ENOMEM;
+	goto out_unlock;
     }
-    _ipmi_mc_put(mc);
+    qe->event = ipmi_event_dup(event);
+    if (!qe->event) {
+	ipmi_mem_free(qe);
+	rv = ENOMEM;
+	goto out_unlock;
+    }
+    qe->domain = domain;
+    qe->handler = handler;
+    qe->cb_data = cb_data;
+    rv = os_hnd->queue_work(os_hnd, hq->wq, queued_event_work, qe);
+    if (rv) {
+	ipmi_event_free(qe->event);
+	ipmi_mem_free(qe);
+	goto out_unlock;
+    }
+    domain->event_queue_count++;
+    if (domain->event_queued_stat)
+	ipmi_domain_stat_add(domain->event_queued_stat, 1);
 
- out:
-    _ipmi_domain_put(domain);
+ out_unlock:
+    ipmi_unlock(domain->event_queue_lock);
+    return rv;
 }
 
-typedef struct call_event_handler_s
-{
-    ipmi_domain_t *domain;
-    ipmi_event_t  *event;
-} call_event_handler_t;
-
 static int
 call_event_handler(void *cb_data, void *item1, void *item2)
 {
     call_event_handler_t  *info = cb_data;
     ipmi_event_handler_cb handler = item1;
 
-    handler(info->domain, info->event, item2);
+    if (!info->domain->event_queue_max
+	|| queue_event_handler(info->domain, handler, item2, info->event))
+	handler(info->domain, info->event, item2);
     return LOCKED_LIST_ITER_CONTINUE;
 }
 
@@ -3296,12 +5052,49 @@ ipmi_domain_remove_event_handler(ipmi_domain_t           *domain,
 				 ipmi_event_handler_cb   handler,
 				 void                    *cb_data)
 {
+    event_hqueue_t *hq, **prev;
+
     CHECK_DOMAIN_LOCK(domain);
 
-    if (locked_list_remove(domain->event_handlers, handler, cb_data))
-	return 0;
-    else
+    if (!locked_list_remove(domain->event_handlers, handler, cb_data))
 	return EINVAL;
+
+    /* Anything left on the handler's queue sees that it is gone and
+       is dropped. */
+    ipmi_lock(domain->event_queue_lock);
+    for (prev=&domain->event_hqueues; *prev; prev=&(*prev)->next) {
+	hq = *prev;
+	if ((hq->handler == handler) && (hq->cb_data == cb_data)) {
+	    *prev = hq->next;
+	    domain->os_hnd->free_work_queue(domain->os_hnd, hq->wq);
+	    ipmi_mem_free(hq);
+	    break;
+	}
+    }
+    ipmi_unlock(domain->event_queue_lock);
+    return 0;
+}
+
+int
+ipmi_domain_set_event_queue(ipmi_domain_t *domain, unsigned int max_queued)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (max_queued && !domain->os_hnd->alloc_work_queue)
+	return ENOSYS;
+
+    ipmi_lock(domain->event_queue_lock);
+    domain->event_queue_max = max_queued;
+    ipmi_unlock(domain->event_queue_lock);
+    return 0;
+}
+
+unsigned int
+ipmi_domain_get_event_queue(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->event_queue_max;
 }
 
 typedef struct event_handler_cl_info_s
@@ -3522,6 +5315,48 @@ ipmi_domain_prev_event(ipmi_domain_t *domain, const ipmi_event_t *event)
     return info.rv;
 }
 
+typedef struct iterate_events_info_s
+{
+    ipmi_domain_t                 *domain;
+    ipmi_domain_iterate_events_cb handler;
+    void                          *cb_data;
+    int                           stop;
+} iterate_events_info_t;
+
+static int
+iterate_events_mc_handler(ipmi_mc_t *mc, ipmi_event_t *event, void *cb_data)
+{
+    iterate_events_info_t *info = cb_data;
+
+    info->stop = info->handler(info->domain, event, info->cb_data);
+    return info->stop;
+}
+
+static void
+iterate_events_handler(ipmi_domain_t *domain, ipmi_mc_t *mc, void *cb_data)
+{
+    iterate_events_info_t *info = cb_data;
+
+    if (!info->stop)
+	ipmi_mc_iterate_events(mc, iterate_events_mc_handler, info);
+}
+
+int
+ipmi_domain_iterate_events(ipmi_domain_t                 *domain,
+			   ipmi_domain_iterate_events_cb handler,
+			   void                          *cb_data)
+{
+    iterate_events_info_t info;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    info.domain = domain;
+    info.handler = handler;
+    info.cb_data = cb_data;
+    info.stop = 0;
+    return ipmi_domain_iterate_mcs(domain, iterate_events_handler, &info);
+}
+
 static void
 sel_count_handler(ipmi_domain_t *domain, ipmi_mc_t *mc, void *cb_data)
 {
@@ -3583,6 +5418,30 @@ ipmi_domain_get_sel_rescan_time(ipmi_domain_t *domain)
     return domain->default_sel_rescan_time;
 }
 
+static void
+set_sel_rescan_max_time(ipmi_domain_t *domain, ipmi_mc_t *mc, void *cb_data)
+{
+    ipmi_mc_set_sel_rescan_max_time(mc, domain->default_sel_rescan_max_time);
+}
+
+void
+ipmi_domain_set_sel_rescan_max_time(ipmi_domain_t *domain,
+				    unsigned int  seconds)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    domain->default_sel_rescan_max_time = seconds;
+    ipmi_domain_iterate_mcs(domain, set_sel_rescan_max_time, NULL);
+}
+
+unsigned int
+ipmi_domain_get_sel_rescan_max_time(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->default_sel_rescan_max_time;
+}
+
 /* Code to explicitly reread all the SELs in the domain. */
 typedef struct sels_reread_s
 {
@@ -3730,6 +5589,22 @@ ipmi_domain_get_os_hnd(ipmi_domain_t *domain)
     return domain->os_hnd;
 }
 
+int
+_ipmi_domain_alloc_timer(ipmi_domain_t *domain, os_hnd_timer_id_t **id)
+{
+    os_handler_t *os_hnd = domain->os_hnd;
+
+    if ((domain->reactor >= 0) && os_hnd->alloc_timer_reactor)
+	return os_hnd->alloc_timer_reactor(os_hnd, domain->reactor, id);
+    return os_hnd->alloc_timer(os_hnd, id);
+}
+
+ipmi_arena_t *
+_ipmi_domain_arena(ipmi_domain_t *domain)
+{
+    return domain->arena;
+}
+
 ipmi_entity_info_t *
 ipmi_domain_get_entities(ipmi_domain_t *domain)
 {
@@ -3851,40 +5726,137 @@ ipmi_domain_iterate_entities(ipmi_domain_t      *domain,
     return 0;
 }
 
+static int
+cmp_ipmb_mc(const void *a, const void *b)
+{
+    ipmi_addr_t      addr1, addr2;
+    ipmi_ipmb_addr_t *ipmb1 = (ipmi_ipmb_addr_t *) &addr1;
+    ipmi_ipmb_addr_t *ipmb2 = (ipmi_ipmb_addr_t *) &addr2;
+    unsigned int     len;
+    unsigned int     v1, v2;
+
+    ipmi_mc_get_ipmi_address(*((ipmi_mc_t **) a), &addr1, &len);
+    ipmi_mc_get_ipmi_address(*((ipmi_mc_t **) b), &addr2, &len);
+    v1 = (ipmb1->channel << 8) | ipmb1->slave_addr;
+    v2 = (ipmb2->channel << 8) | ipmb2->slave_addr;
+    if (v1 < v2)
+	return -1;
+    if (v1 > v2)
+	return 1;
+    return 0;
+}
+
+/* Must be called with the MC table lock held for write.  Bring the
+   sorted list of IPMB MCs up to date with the hash table. */
+static int
+update_ipmb_mc_order(ipmi_domain_t *domain)
+{
+    unsigned int count = htable_count(domain->ipmb_mcs);
+    ipmi_mc_t    **order = NULL;
+
+    if (!domain->ipmb_mc_order_stale)
+	return 0;
+
+    if (count) {
+	order = ipmi_mem_alloc(sizeof(ipmi_mc_t *) * count);
+	if (!order)
+	    return ENOMEM;
+	count = htable_copy(domain->ipmb_mcs, (void **) order, count);
+	qsort(order, count, sizeof(ipmi_mc_t *), cmp_ipmb_mc);
+    }
+    if (domain->ipmb_mc_order)
+	ipmi_mem_free(domain->ipmb_mc_order);
+    domain->ipmb_mc_order = order;
+    domain->ipmb_mc_order_len = count;
+    domain->ipmb_mc_order_stale = 0;
+    return 0;
+}
+
+/* Takes the MC table lock.  The hash table can change while the
+   handlers are being called, so this returns
+   a copy of the IPMB MCs, sorted by channel and address, with a use
+   count held on each.  The user must put the MCs and free the
+   array. */
+static int
+get_ipmb_mcs(ipmi_domain_t *domain, ipmi_mc_t ***rmcs, unsigned int *rcount)
+{
+    unsigned int count;
+    unsigned int i, j;
+    ipmi_mc_t    **mcs;
+    int          rv;
+
+    *rmcs = NULL;
+    *rcount = 0;
+
+    /* Rebuilding the order changes it, so this is a writer. */
+    ipmi_rwlock_write_lock(domain->mc_table_lock);
+    rv = update_ipmb_mc_order(domain);
+    if (rv)
+	goto out_unlock;
+    count = domain->ipmb_mc_order_len;
+    if (count == 0)
+	goto out_unlock;
+
+    mcs = ipmi_mem_alloc(sizeof(ipmi_mc_t *) * count);
+    if (!mcs) {
+	rv = ENOMEM;
+	goto out_unlock;
+    }
+    for (i=0, j=0; i<count; i++) {
+	if (!_ipmi_mc_get(domain->ipmb_mc_order[i]))
+	    mcs[j++] = domain->ipmb_mc_order[i];
+    }
+    *rmcs = mcs;
+    *rcount = j;
+
+ out_unlock:
+    ipmi_rwlock_write_unlock(domain->mc_table_lock);
+    return rv;
+}
+
+/* Get the system interface MC for a connection with a use count held
+   on it, or NULL if there isn't one. */
+static ipmi_mc_t *
+get_sys_intf_mc(ipmi_domain_t *domain, int i)
+{
+    ipmi_mc_t *mc;
+
+    ipmi_rwlock_read_lock(domain->mc_table_lock);
+    mc = domain->sys_intf_mcs[i];
+    if (mc && _ipmi_mc_get(mc))
+	mc = NULL;
+    ipmi_rwlock_read_unlock(domain->mc_table_lock);
+    return mc;
+}
+
 int
 ipmi_domain_iterate_mcs(ipmi_domain_t              *domain,
 			ipmi_domain_iterate_mcs_cb handler,
 			void                       *cb_data)
 {
-    int i, j;
+    int          i;
+    ipmi_mc_t    **mcs;
+    unsigned int count, j;
+    int          rv;
 
     CHECK_DOMAIN_LOCK(domain);
 
-    ipmi_lock(domain->mc_lock);
     for (i=0; i<MAX_CONS; i++) {
-	ipmi_mc_t *mc = domain->sys_intf_mcs[i];
-	if (mc && !_ipmi_mc_get(mc)) {
-	    ipmi_unlock(domain->mc_lock);
+	ipmi_mc_t *mc = get_sys_intf_mc(domain, i);
+	if (mc) {
 	    handler(domain, mc, cb_data);
 	    _ipmi_mc_put(mc);
-	    ipmi_lock(domain->mc_lock);
 	}
     }
-    for (i=0; i<IPMB_HASH; i++) {
-	mc_table_t *tab = &(domain->ipmb_mcs[i]);
+    rv = get_ipmb_mcs(domain, &mcs, &count);
 
-	for (j=0; j<tab->size; j++) {
-	    ipmi_mc_t *mc = tab->mcs[j];
-	    if (mc && !_ipmi_mc_get(mc)) {
-		ipmi_unlock(domain->mc_lock);
-		handler(domain, mc, cb_data);
-		_ipmi_mc_put(mc);
-		ipmi_lock(domain->mc_lock);
-	    }
-	}
+    for (j=0; j<count; j++) {
+	handler(domain, mcs[j], cb_data);
+	_ipmi_mc_put(mcs[j]);
     }
-    ipmi_unlock(domain->mc_lock);
-    return 0;
+    if (mcs)
+	ipmi_mem_free(mcs);
+    return rv;
 }
 
 int
@@ -3892,37 +5864,151 @@ ipmi_domain_iterate_mcs_rev(ipmi_domain_t              *domain,
 			    ipmi_domain_iterate_mcs_cb handler,
 			    void                       *cb_data)
 {
-    int i, j;
+    int          i;
+    ipmi_mc_t    **mcs;
+    unsigned int count, j;
+    int          rv;
 
     CHECK_DOMAIN_LOCK(domain);
 
-    ipmi_lock(domain->mc_lock);
-    for (i=IPMB_HASH-1; i>=0; i--) {
-	mc_table_t *tab = &(domain->ipmb_mcs[i]);
-
-	for (j=tab->size-1; j>=0; j--) {
-	    ipmi_mc_t *mc = tab->mcs[j];
-	    if (mc && !_ipmi_mc_get(mc)) {
-		ipmi_unlock(domain->mc_lock);
-		handler(domain, mc, cb_data);
-		_ipmi_mc_put(mc);
-		ipmi_lock(domain->mc_lock);
-	    }
-	}
+    rv = get_ipmb_mcs(domain, &mcs, &count);
+
+    for (j=count; j>0; j--) {
+	handler(domain, mcs[j-1], cb_data);
+	_ipmi_mc_put(mcs[j-1]);
     }
+    if (mcs)
+	ipmi_mem_free(mcs);
+
     for (i=MAX_CONS-1; i>=0; i--) {
-	ipmi_mc_t *mc = domain->sys_intf_mcs[i];
-	if (mc && !_ipmi_mc_get(mc)) {
-	    ipmi_unlock(domain->mc_lock);
+	ipmi_mc_t *mc = get_sys_intf_mc(domain, i);
+	if (mc) {
 	    handler(domain, mc, cb_data);
 	    _ipmi_mc_put(mc);
-	    ipmi_lock(domain->mc_lock);
 	}
     }
-    ipmi_unlock(domain->mc_lock);
+    return rv;
+}
+
+ipmi_snapshot_t *
+_ipmi_snapshot_alloc(int kind, unsigned int count)
+{
+    ipmi_snapshot_t *snap;
+
+    snap = ipmi_mem_alloc(sizeof(*snap) + (count * sizeof(snap->ids[0])));
+    if (!snap)
+	return NULL;
+    snap->refcount = 1;
+    snap->kind = kind;
+    snap->count = count;
+    return snap;
+}
+
+unsigned int
+ipmi_snapshot_count(ipmi_snapshot_t *snap)
+{
+    return snap->count;
+}
+
+int
+ipmi_snapshot_get_mc_id(ipmi_snapshot_t *snap,
+			unsigned int    idx,
+			ipmi_mcid_t     *id)
+{
+    if ((snap->kind != IPMI_SNAPSHOT_MCS) || (idx >= snap->count))
+	return EINVAL;
+    *id = snap->ids[idx].mc;
+    return 0;
+}
+
+int
+ipmi_snapshot_get_entity_id(ipmi_snapshot_t  *snap,
+			    unsigned int     idx,
+			    ipmi_entity_id_t *id)
+{
+    if ((snap->kind != IPMI_SNAPSHOT_ENTITIES) || (idx >= snap->count))
+	return EINVAL;
+    *id = snap->ids[idx].entity;
+    return 0;
+}
+
+int
+ipmi_snapshot_get_sensor_id(ipmi_snapshot_t  *snap,
+			    unsigned int     idx,
+			    ipmi_sensor_id_t *id)
+{
+    if ((snap->kind != IPMI_SNAPSHOT_SENSORS) || (idx >= snap->count))
+	return EINVAL;
+    *id = snap->ids[idx].sensor;
     return 0;
 }
 
+void
+ipmi_snapshot_ref(ipmi_snapshot_t *snap)
+{
+    __atomic_add_fetch(&snap->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void
+ipmi_snapshot_put(ipmi_snapshot_t *snap)
+{
+    if (__atomic_sub_fetch(&snap->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+	ipmi_mem_free(snap);
+}
+
+int
+ipmi_domain_snapshot_mcs(ipmi_domain_t *domain, ipmi_snapshot_t **snap)
+{
+    ipmi_mc_t       *sys_mcs[MAX_CONS];
+    ipmi_mc_t       **mcs;
+    unsigned int    count, nsys = 0, i, j;
+    ipmi_snapshot_t *s;
+    int             rv;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    for (i=0; i<MAX_CONS; i++) {
+	sys_mcs[nsys] = get_sys_intf_mc(domain, i);
+	if (sys_mcs[nsys])
+	    nsys++;
+    }
+    rv = get_ipmb_mcs(domain, &mcs, &count);
+    if (rv)
+	count = 0;
+
+    /* The MCs are held, so converting them is safe with no locks. */
+    s = NULL;
+    if (!rv) {
+	s = _ipmi_snapshot_alloc(IPMI_SNAPSHOT_MCS, nsys + count);
+	if (!s)
+	    rv = ENOMEM;
+    }
+    for (i=0; i<nsys; i++) {
+	if (s)
+	    s->ids[i].mc = ipmi_mc_convert_to_id(sys_mcs[i]);
+	_ipmi_mc_put(sys_mcs[i]);
+    }
+    for (j=0; j<count; j++) {
+	if (s)
+	    s->ids[nsys + j].mc = ipmi_mc_convert_to_id(mcs[j]);
+	_ipmi_mc_put(mcs[j]);
+    }
+    if (mcs)
+	ipmi_mem_free(mcs);
+    if (!rv)
+	*snap = s;
+    return rv;
+}
+
+int
+ipmi_domain_snapshot_entities(ipmi_domain_t   *domain,
+			      ipmi_snapshot_t **snap)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return _ipmi_entities_snapshot(domain->entities, snap);
+}
+
 #if SAVE_SDR_CODE_ENABLE
 typedef struct sdrs_saved_info_s
 {
@@ -4015,15 +6101,100 @@ ipmi_domain_store_entities(ipmi_domain_t  *domain,
  *
  **********************************************************************/
 
-ipmi_domain_id_t
-ipmi_domain_convert_to_id(ipmi_domain_t *domain)
+ipmi_domain_id_t
+ipmi_domain_convert_to_id(ipmi_domain_t *domain)
+{
+    ipmi_domain_id_t val;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    val.domain = domain;
+    return val;
+}
+
+unsigned int
+_ipmi_domain_handle_alloc(ipmi_domain_t *domain,
+			  void          *obj,
+			  long          seq,
+			  unsigned int  key)
+{
+    domain_handle_t *h;
+    unsigned int    handle;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (!domain->handles_free) {
+	domain_handle_t *new_handles;
+	unsigned int    new_size = domain->handles_size * 2;
+	unsigned int    i;
+
+	if (new_size == 0)
+	    new_size = 64;
+	if (new_size > IPMI_DOMAIN_MAX_HANDLES)
+	    new_size = IPMI_DOMAIN_MAX_HANDLES;
+	if (new_size <= domain->handles_size)
+	    return 0; /* Full, the id will be looked up the slow way. */
+	new_handles = ipmi_mem_alloc(sizeof(*new_handles) * new_size);
+	if (!new_handles)
+	    return 0;
+	if (domain->handles) {
+	    memcpy(new_handles, domain->handles,
+		   sizeof(*new_handles) * domain->handles_size);
+	    ipmi_mem_free(domain->handles);
+	}
+	for (i=domain->handles_size; i<new_size; i++) {
+	    new_handles[i].obj = NULL;
+	    new_handles[i].seq = 0;
+	    new_handles[i].key = (i + 1 < new_size) ? i + 2 : 0;
+	}
+	domain->handles_free = domain->handles_size + 1;
+	domain->handles = new_handles;
+	domain->handles_size = new_size;
+    }
+
+    handle = domain->handles_free;
+    h = &domain->handles[handle - 1];
+    domain->handles_free = h->key;
+    h->obj = obj;
+    h->seq = seq;
+    h->key = key;
+    return handle;
+}
+
+void
+_ipmi_domain_handle_free(ipmi_domain_t *domain, unsigned int handle)
+{
+    domain_handle_t *h;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if ((handle == 0) || (handle > domain->handles_size))
+	return;
+    h = &domain->handles[handle - 1];
+    h->obj = NULL;
+    h->seq = 0;
+    h->key = domain->handles_free;
+    domain->handles_free = handle;
+}
+
+void *
+_ipmi_domain_handle_lookup(ipmi_domain_t *domain,
+			   unsigned int  handle,
+			   long          seq,
+			   unsigned int  key)
 {
-    ipmi_domain_id_t val;
+    domain_handle_t *h;
 
     CHECK_DOMAIN_LOCK(domain);
 
-    val.domain = domain;
-    return val;
+    /* The handle in an id may be stale, or junk if the id was put
+       together by hand, so check it is really for this object. */
+    if ((handle == 0) || (handle > domain->handles_size))
+	return NULL;
+    h = &domain->handles[handle - 1];
+    if (!h->obj || (h->seq != seq) || (h->key != key))
+	return NULL;
+    return h->obj;
 }
 
 int
@@ -4368,6 +6539,32 @@ real_close_connection(ipmi_domain_t *domain)
     }
 }
 
+static void mc_startup_flush(ipmi_domain_t *domain);
+
+int
+ipmi_domain_close_fast(ipmi_domain_t             *domain,
+		       unsigned int              flags,
+		       ipmi_domain_close_done_cb close_done,
+		       void                      *cb_data)
+{
+    unsigned int i;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (domain->in_shutdown)
+	return EINVAL;
+
+    domain->close_flags = flags;
+    if (flags & IPMI_DOMAIN_CLOSE_NO_SESSION_CLOSE) {
+	for (i=0; i<MAX_CONS; i++) {
+	    if (domain->conn[i])
+		domain->conn[i]->skip_close_session = 1;
+	}
+    }
+
+    return ipmi_domain_close(domain, close_done, cb_data);
+}
+
 int
 ipmi_domain_close(ipmi_domain_t             *domain,
 		  ipmi_domain_close_done_cb close_done,
@@ -4382,6 +6579,9 @@ ipmi_domain_close(ipmi_domain_t             *domain,
     domain->close_done = close_done;
     domain->close_done_cb_data = cb_data;
 
+    /* The MCs can't be cleaned up while they wait to start. */
+    mc_startup_flush(domain);
+
     locked_list_remove(domains_list, domain, NULL);
 
     /* We don't actually do the destroy here, since the domain should
@@ -4567,12 +6767,40 @@ con_up_complete(ipmi_domain_t *domain)
     if (con_up_handler)
 	con_up_handler(domain, con_up_handler_cb_data);
 
+    /* Bring up the MCs from the last run right away if we have them,
+       the bus scan will check them in the background. */
+    if (load_topology(domain))
+	domain->scan_in_background = 1;
+
+    domain->os_hnd->get_monotonic_time(domain->os_hnd,
+				       &domain->ipmb_scan_start);
+    bringup_step(domain, "con_up");
+    ipmi_lock(domain->mc_lock);
+    domain->ipmb_scan_timed = 1;
+    ipmi_unlock(domain->mc_lock);
+    domain->scan_span = _ipmi_domain_span_start(domain, "ipmb_scan", NULL,
+						IPMI_SPAN_TRACK_DOMAIN,
+						domain->step_span);
     ipmi_domain_start_full_ipmb_scan(domain);
+    ipmi_lock(domain->mc_lock);
+    if (!domain->scanning_bus_count) {
+	/* Nothing to scan. */
+	domain->ipmb_scan_timed = 0;
+	_ipmi_domain_span_end(domain, domain->scan_span);
+	domain->scan_span = 0;
+    }
+    ipmi_unlock(domain->mc_lock);
 
     ipmi_detect_ents_presence_changes(domain->entities, 1);
 
+    domain->os_hnd->get_monotonic_time(domain->os_hnd, &domain->phase_start);
+    bringup_step(domain, "entity_sensor");
+    _ipmi_domain_update_batch_start(domain);
     ipmi_entity_scan_sdrs(domain, NULL, domain->entities, domain->main_sdrs);
     ipmi_sensor_handle_sdrs(domain, NULL, domain->main_sdrs);
+    _ipmi_domain_update_batch_end(domain);
+    phase_done(domain, IPMI_DOMAIN_PHASE_ENTITY_SENSOR);
+    bringup_step(domain, NULL);
     ipmi_lock(domain->domain_lock);
     SDRs_read_handler = domain->SDRs_read_handler;
     SDRs_read_handler_cb_data = domain->SDRs_read_handler_cb_data;
@@ -4737,6 +6965,9 @@ sdr_handler(ipmi_sdr_info_t *sdrs,
     ipmi_domain_t *domain = cb_data;
     int           rv;
 
+    phase_done(domain, IPMI_DOMAIN_PHASE_SDR_FETCH);
+    bringup_step(domain, "channels");
+
     if (err) {
 	/* Just report an error, it shouldn't be a big deal if this
            fails. */
@@ -4772,8 +7003,12 @@ got_guid(ipmi_mc_t  *mc,
     }
 
     if (domain->SDR_repository_support && ipmi_option_SDRs(domain)) {
+	domain->os_hnd->get_monotonic_time(domain->os_hnd,
+					   &domain->phase_start);
+	bringup_step(domain, "sdr_fetch");
 	rv = ipmi_sdr_fetch(domain->main_sdrs, sdr_handler, domain);
     } else {
+	bringup_step(domain, "channels");
 	rv = get_channels(domain);
     }
     if (rv)
@@ -4786,6 +7021,9 @@ domain_oem_handlers_checked(ipmi_domain_t *domain, int err, void *cb_data)
     ipmi_msg_t msg;
     int        rv;
 
+    phase_done(domain, IPMI_DOMAIN_PHASE_OEM_CHECK);
+    bringup_step(domain, "guid");
+
     /* FIXME - handle errors setting up OEM comain information. */
 
     msg.netfn = IPMI_APP_NETFN;
@@ -4870,6 +7108,11 @@ got_dev_id(ipmi_mc_t  *mc,
 	return;
     }
 
+    /* Connecting is done once the BMC answers. */
+    domain->phase_start = domain->bringup_start;
+    phase_done(domain, IPMI_DOMAIN_PHASE_CONNECT);
+    bringup_step(domain, "oem_check");
+
     if (ipmi_option_OEM_init(domain)) {
 	rv = check_oem_handlers(domain, domain_oem_handlers_checked, NULL);
 	if (rv)
@@ -5157,6 +7400,248 @@ _ipmi_domain_get_connection(ipmi_domain_t *domain,
     return 0;
 }
 
+unsigned int
+_ipmi_domain_max_outstanding(ipmi_domain_t *domain)
+{
+    unsigned int max = 0;
+    int          i;
+
+    for (i=0; i<MAX_CONS; i++) {
+	ipmi_con_t *con = domain->conn[i];
+
+	if (con && con->msgi_max && (max == 0 || con->msgi_max < max))
+	    max = con->msgi_max;
+    }
+    if (max == 0)
+	max = 1;
+    return max;
+}
+
+/***********************************************************************
+ *
+ * MC startup scheduling.  Starting an MC fetches its GUID, device
+ * SDRs and SEL and sets its event receiver, a chain of commands.
+ * When a scan finds a lot of MCs they would all start at once and
+ * fight over the connection, so only as many run at once as the
+ * connection window allows and the MCs with sensors go first.
+ *
+ **********************************************************************/
+
+typedef struct mc_startup_s
+{
+    ipmi_mc_t                  *mc;
+    _ipmi_domain_mc_startup_cb start;
+    struct mc_startup_s        *next;
+} mc_startup_t;
+
+/* Start the MC, holding it for the start call. */
+static void
+mc_startup_run(ipmi_domain_t *domain, mc_startup_t *s, int scheduled)
+{
+    ipmi_mc_t *mc = s->mc;
+
+    _ipmi_domain_mc_lock(domain);
+    _ipmi_mc_get(mc);
+    _ipmi_domain_mc_unlock(domain);
+    s->start(mc, scheduled);
+    _ipmi_mc_put(mc);
+    ipmi_mem_free(s);
+}
+
+/* Pull the next waiting startup if there is room, must be called
+   with the mc_startup_lock held. */
+static mc_startup_t *
+mc_startup_next(ipmi_domain_t *domain)
+{
+    mc_startup_t *s = NULL;
+    int          i;
+
+    if (domain->mc_startups_running >= _ipmi_domain_max_outstanding(domain))
+	return NULL;
+    for (i=0; i<2; i++) {
+	s = domain->mc_startup_q[i];
+	if (s) {
+	    domain->mc_startup_q[i] = s->next;
+	    if (!s->next)
+		domain->mc_startup_q_tail[i] = NULL;
+	    domain->mc_startups_running++;
+	    break;
+	}
+    }
+    return s;
+}
+
+static void
+mc_startup_flush(ipmi_domain_t *domain)
+{
+    mc_startup_t *list = NULL, *s;
+    int          i;
+
+    ipmi_lock(domain->mc_startup_lock);
+    for (i=1; i>=0; i--) {
+	if (domain->mc_startup_q_tail[i]) {
+	    domain->mc_startup_q_tail[i]->next = list;
+	    list = domain->mc_startup_q[i];
+	}
+	domain->mc_startup_q[i] = NULL;
+	domain->mc_startup_q_tail[i] = NULL;
+    }
+    ipmi_unlock(domain->mc_startup_lock);
+
+    while ((s = list)) {
+	list = s->next;
+	mc_startup_run(domain, s, 0);
+    }
+}
+
+int
+_ipmi_domain_mc_startup(ipmi_domain_t              *domain,
+			ipmi_mc_t                  *mc,
+			int                        has_sdrs,
+			_ipmi_domain_mc_startup_cb start)
+{
+    mc_startup_t *s;
+    int          q = has_sdrs ? 0 : 1;
+
+    if (domain->in_shutdown) {
+	start(mc, 0);
+	return 0;
+    }
+
+    s = ipmi_mem_alloc(sizeof(*s));
+    if (!s)
+	return ENOMEM;
+    s->mc = mc;
+    s->start = start;
+    s->next = NULL;
+
+    ipmi_lock(domain->mc_startup_lock);
+    if (domain->mc_startup_q_tail[q])
+	domain->mc_startup_q_tail[q]->next = s;
+    else
+	domain->mc_startup_q[q] = s;
+    domain->mc_startup_q_tail[q] = s;
+    s = mc_startup_next(domain);
+    ipmi_unlock(domain->mc_startup_lock);
+
+    /* The caller is holding the MC, start it directly. */
+    if (s && (s->mc == mc)) {
+	start(mc, 1);
+	ipmi_mem_free(s);
+    } else if (s) {
+	mc_startup_run(domain, s, 1);
+    }
+    return 0;
+}
+
+void
+_ipmi_domain_mc_startup_done(ipmi_domain_t *domain)
+{
+    mc_startup_t *s;
+
+    ipmi_lock(domain->mc_startup_lock);
+    if (domain->mc_startups_running > 0)
+	domain->mc_startups_running--;
+    s = mc_startup_next(domain);
+    ipmi_unlock(domain->mc_startup_lock);
+
+    if (s)
+	mc_startup_run(domain, s, 1);
+}
+
+unsigned int
+_ipmi_domain_mc_concurrency(ipmi_domain_t *domain)
+{
+    unsigned int max = 0;
+    int          i;
+
+    for (i=0; i<MAX_CONS; i++) {
+	ipmi_con_t   *con = domain->conn[i];
+	unsigned int val;
+
+	if (!con)
+	    continue;
+	val = con->mc_concurrency;
+	if (val == 0)
+	    val = 1;
+	if (max == 0 || val < max)
+	    max = val;
+    }
+    if (max == 0)
+	max = 1;
+    return max;
+}
+
+int
+ipmi_domain_set_con_routing(ipmi_domain_t *domain, int routing)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    if ((routing != IPMI_DOMAIN_ROUTE_WORKING)
+	&& (routing != IPMI_DOMAIN_ROUTE_SPREAD))
+	return EINVAL;
+    ipmi_lock(domain->cmds_lock);
+    domain->con_routing = routing;
+    ipmi_unlock(domain->cmds_lock);
+    return 0;
+}
+
+int
+ipmi_domain_get_con_routing(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->con_routing;
+}
+
+int
+ipmi_domain_set_cmd_limit(ipmi_domain_t            *domain,
+			  unsigned int             limit,
+			  ipmi_domain_cmd_ready_cb handler,
+			  void                     *cb_data)
+{
+    int ready = 0;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    ipmi_lock(domain->cmds_lock);
+    domain->cmds_limit = limit;
+    domain->cmd_ready = handler;
+    domain->cmd_ready_cb_data = cb_data;
+    if (domain->cmds_blocked
+	&& (!limit || (domain->cmds_outstanding <= limit / 2)))
+    {
+	/* Raising the limit can make room for someone waiting. */
+	domain->cmds_blocked = 0;
+	ready = 1;
+    }
+    ipmi_unlock(domain->cmds_lock);
+    if (ready)
+	call_cmd_ready(domain);
+    return 0;
+}
+
+unsigned int
+ipmi_domain_get_cmd_limit(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->cmds_limit;
+}
+
+unsigned int
+ipmi_domain_get_cmds_outstanding(ipmi_domain_t *domain)
+{
+    unsigned int count;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    ipmi_lock(domain->cmds_lock);
+    count = domain->cmds_outstanding;
+    ipmi_unlock(domain->cmds_lock);
+    return count;
+}
+
 void
 ipmi_domain_iterate_connections(ipmi_domain_t          *domain,
 				ipmi_connection_ptr_cb handler,
@@ -5437,9 +7922,13 @@ ll_con_changed(ipmi_con_t   *ipmi,
            activate it, if necessary. */
 	domain->con_up[u] = 0;
 	domain->working_conn = first_working_con(domain);
-	if (domain->working_conn == -1)
+	if (domain->working_conn == -1) {
 	    domain->connection_up = 0;
-	else if ((!domain->con_active[domain->working_conn])
+	    /* Time the next bring-up from here. */
+	    domain->os_hnd->get_monotonic_time(domain->os_hnd,
+					       &domain->bringup_start);
+	    bringup_step(domain, "connect");
+	} else if ((!domain->con_active[domain->working_conn])
 		 && (domain->conn[domain->working_conn]->set_active_state)
 		 && domain->option_activate_if_possible)
 	{
@@ -5510,6 +7999,18 @@ ipmi_option_use_cache(ipmi_domain_t *domain)
     return domain->option_use_cache;
 }
 
+int
+ipmi_option_sdr_incremental(ipmi_domain_t *domain)
+{
+    return domain->option_sdr_incremental;
+}
+
+int
+ipmi_option_sel_cache(ipmi_domain_t *domain)
+{
+    return domain->option_sel_cache;
+}
+
 int
 ipmi_option_activate_if_possible(ipmi_domain_t *domain)
 {
@@ -5567,7 +8068,9 @@ ipmi_open_domain(const char         *name,
 	    goto out_err;
     }
 
-    add_known_domain(domain);
+    rv = add_known_domain(domain);
+    if (rv)
+	goto out_err;
 
     if (con_change_handler) {
 	rv = ipmi_domain_add_connect_change_handler(domain,
@@ -6332,6 +8835,283 @@ ipmi_domain_stat_iterate(ipmi_domain_t *domain,
 				domain_stat_iter, &info);
 }
 
+/***********************************************************************
+ *
+ * Bring-up recording
+ *
+ **********************************************************************/
+
+/* Bound the memory a domain that keeps rescanning can use, nothing
+   more is recorded once this is reached. */
+#define MAX_BRINGUP_SPANS	16384
+
+struct bringup_span_s
+{
+    const char     *name;
+    char           detail[32];
+    unsigned int   track;
+    int            parent;
+    int            ended;
+    struct timeval start;
+    struct timeval end;
+};
+
+int
+_ipmi_domain_span_start(ipmi_domain_t *domain,
+			const char    *name,
+			const char    *detail,
+			unsigned int  track,
+			int           parent)
+{
+    bringup_span_t *span;
+    int            rv = 0;
+
+    if (!domain->bringup_lock)
+	return 0;
+
+    ipmi_lock(domain->bringup_lock);
+    if (domain->num_spans >= domain->spans_size) {
+	bringup_span_t *new_spans;
+	unsigned int   new_size = domain->spans_size * 2;
+
+	if (new_size == 0)
+	    new_size = 64;
+	if (new_size > MAX_BRINGUP_SPANS)
+	    goto out_unlock;
+	new_spans = ipmi_mem_alloc(sizeof(*new_spans) * new_size);
+	if (!new_spans)
+	    goto out_unlock;
+	if (domain->spans) {
+	    memcpy(new_spans, domain->spans,
+		   sizeof(*new_spans) * domain->num_spans);
+	    ipmi_mem_free(domain->spans);
+	}
+	domain->spans = new_spans;
+	domain->spans_size = new_size;
+    }
+
+    span = &domain->spans[domain->num_spans];
+    memset(span, 0, sizeof(*span));
+    span->name = name;
+    if (detail)
+	strncpy(span->detail, detail, sizeof(span->detail) - 1);
+    span->track = track;
+    span->parent = parent;
+    domain->os_hnd->get_monotonic_time(domain->os_hnd, &span->start);
+    domain->num_spans++;
+    rv = domain->num_spans;
+
+ out_unlock:
+    ipmi_unlock(domain->bringup_lock);
+    return rv;
+}
+
+void
+_ipmi_domain_span_end(ipmi_domain_t *domain, int span)
+{
+    bringup_span_t *s;
+
+    if (!domain->bringup_lock || (span <= 0))
+	return;
+
+    ipmi_lock(domain->bringup_lock);
+    s = &domain->spans[span - 1];
+    if (!s->ended) {
+	domain->os_hnd->get_monotonic_time(domain->os_hnd, &s->end);
+	s->ended = 1;
+    }
+    ipmi_unlock(domain->bringup_lock);
+}
+
+int
+_ipmi_domain_scan_span(ipmi_domain_t *domain)
+{
+    return domain->scan_span;
+}
+
+/* End the current step of the domain's own bring-up and start the
+   next one (if name is not NULL), which depends on it. */
+static void
+bringup_step(ipmi_domain_t *domain, const char *name)
+{
+    int parent = domain->step_span;
+
+    if (!domain->bringup_lock)
+	return;
+
+    _ipmi_domain_span_end(domain, parent);
+    domain->step_span = 0;
+    if (name)
+	domain->step_span = _ipmi_domain_span_start(domain, name, NULL,
+						    IPMI_SPAN_TRACK_DOMAIN,
+						    parent);
+}
+
+static void
+free_bringup_spans(ipmi_domain_t *domain)
+{
+    if (domain->spans)
+	ipmi_mem_free(domain->spans);
+    domain->spans = NULL;
+    if (domain->bringup_lock)
+	ipmi_destroy_lock(domain->bringup_lock);
+    domain->bringup_lock = NULL;
+}
+
+static long long
+span_us(struct timeval *t, struct timeval *base)
+{
+    return (((long long) (t->tv_sec - base->tv_sec)) * 1000000
+	    + (t->tv_usec - base->tv_usec));
+}
+
+static void
+json_string(FILE *f, const char *str)
+{
+    putc('"', f);
+    for (; *str; str++) {
+	if ((*str == '"') || (*str == '\\'))
+	    putc('\\', f);
+	if (((unsigned char) *str) >= 0x20)
+	    putc(*str, f);
+    }
+    putc('"', f);
+}
+
+static const char *
+track_name(unsigned int track, char *buf, int len)
+{
+    if (track == IPMI_SPAN_TRACK_DOMAIN)
+	return "domain";
+    if (track >= IPMI_SPAN_TRACK_PRESENCE) {
+	snprintf(buf, len, "presence %u", track - IPMI_SPAN_TRACK_PRESENCE);
+	return buf;
+    }
+    snprintf(buf, len, "mc %u.%2.2x", (track - IPMI_SPAN_TRACK_MC_BASE) >> 8,
+	     (track - IPMI_SPAN_TRACK_MC_BASE) & 0xff);
+    return buf;
+}
+
+int
+ipmi_domain_write_bringup_trace(ipmi_domain_t *domain, const char *filename)
+{
+    FILE           *f;
+    bringup_span_t *spans;
+    unsigned int   num, i, j;
+    unsigned int   *tids = NULL;
+    struct timeval *lane_end = NULL;
+    unsigned int   num_lanes = 0;
+    struct timeval now, *end;
+    char           buf[32];
+    int            rv = 0;
+
+    if (!domain->bringup_lock)
+	return ENOSYS;
+
+    f = fopen(filename, "w");
+    if (!f)
+	return errno;
+
+    /* Work on a copy, so nothing is held while writing. */
+    ipmi_lock(domain->bringup_lock);
+    num = domain->num_spans;
+    spans = NULL;
+    if (num) {
+	spans = ipmi_mem_alloc(sizeof(*spans) * num);
+	tids = ipmi_mem_alloc(sizeof(*tids) * num);
+	lane_end = ipmi_mem_alloc(sizeof(*lane_end) * num);
+	if (spans && tids && lane_end)
+	    memcpy(spans, domain->spans, sizeof(*spans) * num);
+	else
+	    rv = ENOMEM;
+    }
+    ipmi_unlock(domain->bringup_lock);
+    if (rv)
+	goto out;
+    domain->os_hnd->get_monotonic_time(domain->os_hnd, &now);
+
+    /* The presence checks of different entities overlap, give each
+       one the first presence lane that is free when it starts. */
+    for (i=0; i<num; i++) {
+	tids[i] = spans[i].track;
+	if (spans[i].track != IPMI_SPAN_TRACK_PRESENCE)
+	    continue;
+	end = spans[i].ended ? &spans[i].end : &now;
+	for (j=0; j<num_lanes; j++) {
+	    if (span_us(&spans[i].start, &lane_end[j]) >= 0)
+		break;
+	}
+	if (j == num_lanes)
+	    num_lanes++;
+	lane_end[j] = *end;
+	tids[i] = IPMI_SPAN_TRACK_PRESENCE + j;
+    }
+
+    fputs("{\"traceEvents\":[\n", f);
+    fputs("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,"
+	  "\"args\":{\"name\":", f);
+    json_string(f, domain->name);
+    fputs("}}", f);
+    for (i=0; i<num; i++) {
+	/* Name each thread (track) the first time it is used. */
+	for (j=0; j<i; j++) {
+	    if (tids[j] == tids[i])
+		break;
+	}
+	if (j == i) {
+	    fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+		    "\"tid\":%u,\"args\":{\"name\":", tids[i]);
+	    json_string(f, track_name(tids[i], buf, sizeof(buf)));
+	    fputs("}}", f);
+	}
+    }
+
+    for (i=0; i<num; i++) {
+	bringup_span_t *s = &spans[i];
+
+	end = s->ended ? &s->end : &now;
+	fputs(",\n{\"ph\":\"X\",\"cat\":\"bringup\",\"name\":", f);
+	json_string(f, s->name);
+	fprintf(f, ",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld,"
+		"\"args\":{\"id\":%u,\"parent\":%d",
+		tids[i], span_us(&s->start, &spans[0].start),
+		span_us(end, &s->start), i + 1, s->parent);
+	if (s->detail[0]) {
+	    fputs(",\"detail\":", f);
+	    json_string(f, s->detail);
+	}
+	if (!s->ended)
+	    fputs(",\"unfinished\":1", f);
+	fputs("}}", f);
+
+	/* Draw the dependency as a flow arrow from the parent. */
+	if ((s->parent > 0) && ((unsigned int) s->parent <= num)) {
+	    bringup_span_t *p = &spans[s->parent - 1];
+
+	    fprintf(f, ",\n{\"ph\":\"s\",\"cat\":\"dep\",\"name\":\"dep\","
+		    "\"id\":%u,\"pid\":1,\"tid\":%u,\"ts\":%lld}",
+		    i + 1, tids[s->parent - 1],
+		    span_us(&p->start, &spans[0].start));
+	    fprintf(f, ",\n{\"ph\":\"f\",\"bp\":\"e\",\"cat\":\"dep\","
+		    "\"name\":\"dep\",\"id\":%u,\"pid\":1,\"tid\":%u,"
+		    "\"ts\":%lld}",
+		    i + 1, tids[i], span_us(&s->start, &spans[0].start));
+	}
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+
+ out:
+    if (spans)
+	ipmi_mem_free(spans);
+    if (tids)
+	ipmi_mem_free(tids);
+    if (lane_end)
+	ipmi_mem_free(lane_end);
+    if (fclose(f) && !rv)
+	rv = errno;
+    return rv;
+}
+
 /***********************************************************************
  *
  * Initialization and shutdown
@@ -6360,7 +9140,7 @@ _ipmi_domain_init(void)
 	return ENOMEM;
     }
 
-    oem_handlers = alloc_ilist();
+    oem_handlers = alloc_ivec();
     if (!oem_handlers) {
 	locked_list_destroy(domain_change_handlers);
 	locked_list_destroy(domains_list);
@@ -6368,16 +9148,31 @@ _ipmi_domain_init(void)
 	return ENOMEM;
     }
 
+    domains = alloc_htable();
+    if (!domains) {
+	locked_list_destroy(domain_change_handlers);
+	locked_list_destroy(domains_list);
+	domains_list = NULL;
+	free_ivec(oem_handlers);
+	oem_handlers = NULL;
+	return ENOMEM;
+    }
+
     rv = ipmi_create_global_lock(&domains_lock);
     if (rv) {
 	locked_list_destroy(domain_change_handlers);
 	locked_list_destroy(domains_list);
 	domains_list = NULL;
-	free_ilist(oem_handlers);
+	free_ivec(oem_handlers);
 	oem_handlers = NULL;
+	free_htable(domains);
+	domains = NULL;
 	return rv;
     }
 
+    /* Not fatal, the OEM checks just always get done without it. */
+    oem_check_cache = alloc_htable();
+
     domains_initialized = 1;
 
     return 0;
@@ -6392,10 +9187,17 @@ _ipmi_domain_shutdown(void)
     locked_list_destroy(mc_oem_handlers);
     locked_list_destroy(domains_list);
     domains_list = NULL;
-    free_ilist(oem_handlers);
+    free_ivec(oem_handlers);
     oem_handlers = NULL;
+    if (oem_check_cache) {
+	htable_iter(oem_check_cache, oem_check_cache_free, NULL);
+	free_htable(oem_check_cache);
+	oem_check_cache = NULL;
+    }
     ipmi_destroy_lock(domains_lock);
     domains_lock = NULL;
+    free_htable(domains);
+    domains = NULL;
 }
 
 
@@ -6611,7 +9413,9 @@ ipmi_init_domain(ipmi_con_t               *con[],
 	    return rv;
     }
 
-    add_known_domain(domain);
+    rv = add_known_domain(domain);
+    if (rv)
+	goto out_err;
 
     if (con_change_handler) {
 	rv = ipmi_domain_add_con_change_handler_nd(domain, con_change_handler,
@@ -31,6 +31,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_ENTITY
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -47,6 +49,7 @@
 #include <OpenIPMI/internal/ipmi_int.h>
 #include <OpenIPMI/internal/ipmi_entity.h>
 #include <OpenIPMI/internal/locked_list.h>
+#include <OpenIPMI/internal/htable.h>
 #include <OpenIPMI/internal/ipmi_utils.h>
 #include <OpenIPMI/internal/ipmi_control.h>
 #include <OpenIPMI/internal/ipmi_sensor.h>
@@ -129,15 +132,28 @@ typedef struct dlr_info_s
     dlr_ref_t contained_entities[4];
 } dlr_info_t;
 
+/* A hot-swap timeout for an entity.  These are kept in the entity
+   info's timer queue, sorted by expiry, so all the entities in a
+   domain share one OS timer. */
 typedef struct ent_timer_info_s
+{
+    struct ent_timer_info_s *next;
+    ipmi_entity_t           *entity;
+    struct timeval          expiry;
+    int                     queued;
+    ipmi_entity_ptr_cb      handler;
+} ent_timer_info_t;
+
+typedef struct ent_timer_queue_s
 {
     ipmi_lock_t       *lock;
-    ipmi_entity_t     *entity;
+    os_handler_t      *os_hnd;
     os_hnd_timer_id_t *timer;
-    int               destroyed;
     int               running;
-    os_handler_t      *os_hnd;
-} ent_timer_info_t;
+    int               in_timeout;
+    int               destroyed;
+    ent_timer_info_t  *head;
+} ent_timer_queue_t;
 
 struct ipmi_entity_s
 {
@@ -205,6 +221,7 @@ struct ipmi_entity_s
 					   events are reported. */
     /* Only allow one presence check at a time. */
     int           in_presence_check;
+    int           presence_span; /* For the bring-up recorder. */
 
     /* If the presence changes while the entity is in use, we store it
        in here and the count instead of actually changing it.  Then we
@@ -217,10 +234,10 @@ struct ipmi_entity_s
     int slot_num_present;
 
     /* Hot-swap timing. */
-    ent_timer_info_t *hot_swap_act_info;
+    ent_timer_info_t  hot_swap_act_info;
     ipmi_timeout_t    hot_swap_act_timeout;
 
-    ent_timer_info_t *hot_swap_deact_info;
+    ent_timer_info_t  hot_swap_deact_info;
     ipmi_timeout_t    hot_swap_deact_timeout;
 
 
@@ -275,9 +292,9 @@ struct ipmi_entity_s
     void                            *oem_info;
     ipmi_entity_cleanup_oem_info_cb oem_info_cleanup_handler;
 
-    /* Name we use for reporting.  We add a ' ' onto the end, thus
-       the +1. */
-    char name[IPMI_ENTITY_NAME_LEN+1];
+    /* Name we use for reporting, interned.  We add a ' ' onto the
+       end. */
+    const char *name;
 
 
     /* Cruft */
@@ -301,12 +318,22 @@ struct ipmi_entity_info_s
     ipmi_domain_t         *domain;
     ipmi_domain_id_t      domain_id;
     locked_list_t         *entities;
+
+    /* The entities in the above list, hashed by their key so
+       entity_find() doesn't have to search the list.  Protected by
+       the domain entity lock. */
+    htable_t              *by_key;
+
+    /* Hot-swap timeouts for all the entities. */
+    ent_timer_queue_t     *timers;
 };
 
 #define ent_lock(e) ipmi_lock(e->elock)
 #define ent_unlock(e) ipmi_unlock(e->elock)
 
 static void entity_mc_active(ipmi_mc_t *mc, int active, void *cb_data);
+static void hot_swap_act_cb(ipmi_entity_t *ent, void *cb_data);
+static void hot_swap_deact_cb(ipmi_entity_t *ent, void *cb_data);
 static void call_presence_handlers(ipmi_entity_t *ent, int present);
 static void call_fully_up_handlers(ipmi_entity_t *ent);
 
@@ -403,6 +430,232 @@ iterate_entity_prefunc(void *cb_data, void *item1, void *item2)
     return LOCKED_LIST_ITER_CONTINUE;
 }
 
+/***********************************************************************
+ *
+ * Hot-swap timers
+ *
+ **********************************************************************/
+
+static int
+timeval_cmp(struct timeval *tv1, struct timeval *tv2)
+{
+    if (tv1->tv_sec < tv2->tv_sec)
+	return -1;
+    if (tv1->tv_sec > tv2->tv_sec)
+	return 1;
+    if (tv1->tv_usec < tv2->tv_usec)
+	return -1;
+    if (tv1->tv_usec > tv2->tv_usec)
+	return 1;
+    return 0;
+}
+
+static void entity_timer_queue_timeout(void *cb_data, os_hnd_timer_id_t *t);
+
+/* Start the OS timer for the first timeout in the queue if it is not
+   running.  Must be called with the queue lock held. */
+static void
+entity_timer_queue_arm(ent_timer_queue_t *q)
+{
+    struct timeval now, tv;
+
+    if (q->running || !q->head)
+	return;
+
+    q->os_hnd->get_monotonic_time(q->os_hnd, &now);
+    if (timeval_cmp(&q->head->expiry, &now) <= 0) {
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+    } else {
+	tv.tv_sec = q->head->expiry.tv_sec - now.tv_sec;
+	tv.tv_usec = q->head->expiry.tv_usec - now.tv_usec;
+	if (tv.tv_usec < 0) {
+	    tv.tv_sec--;
+	    tv.tv_usec += 1000000;
+	}
+    }
+    if (!q->os_hnd->start_timer(q->os_hnd, q->timer, &tv,
+				entity_timer_queue_timeout, q))
+	q->running = 1;
+}
+
+static void
+entity_timer_queue_timeout(void *cb_data, os_hnd_timer_id_t *t)
+{
+    ent_timer_queue_t  *q = cb_data;
+    ent_timer_info_t   *info;
+    ipmi_entity_id_t   entity_id;
+    ipmi_entity_ptr_cb handler;
+    struct timeval     now;
+
+    ipmi_lock(q->lock);
+    if (q->destroyed) {
+	ipmi_unlock(q->lock);
+	q->os_hnd->free_timer(q->os_hnd, q->timer);
+	ipmi_destroy_lock(q->lock);
+	ipmi_mem_free(q);
+	return;
+    }
+    q->running = 0;
+    q->in_timeout = 1;
+
+    /* Run everything that has expired, one at a time since the lock
+       is released to call the handler. */
+    q->os_hnd->get_monotonic_time(q->os_hnd, &now);
+    while (!q->destroyed
+	   && q->head && (timeval_cmp(&q->head->expiry, &now) <= 0))
+    {
+	info = q->head;
+	q->head = info->next;
+	info->next = NULL;
+	info->queued = 0;
+	entity_id = ipmi_entity_convert_to_id(info->entity);
+	handler = info->handler;
+	ipmi_unlock(q->lock);
+
+	ipmi_entity_pointer_cb(entity_id, handler, NULL);
+
+	ipmi_lock(q->lock);
+    }
+
+    q->in_timeout = 0;
+    if (q->destroyed) {
+	ipmi_unlock(q->lock);
+	q->os_hnd->free_timer(q->os_hnd, q->timer);
+	ipmi_destroy_lock(q->lock);
+	ipmi_mem_free(q);
+	return;
+    }
+    entity_timer_queue_arm(q);
+    ipmi_unlock(q->lock);
+}
+
+static int
+entity_timer_queue_alloc(ipmi_domain_t *domain, ent_timer_queue_t **rq)
+{
+    ent_timer_queue_t *q;
+    int               rv;
+
+    q = ipmi_mem_alloc(sizeof(*q));
+    if (!q)
+	return ENOMEM;
+    memset(q, 0, sizeof(*q));
+
+    q->os_hnd = ipmi_domain_get_os_hnd(domain);
+    rv = _ipmi_domain_alloc_timer(domain, &q->timer);
+    if (rv) {
+	ipmi_mem_free(q);
+	return rv;
+    }
+
+    rv = ipmi_create_lock(domain, &q->lock);
+    if (rv) {
+	q->os_hnd->free_timer(q->os_hnd, q->timer);
+	ipmi_mem_free(q);
+	return rv;
+    }
+
+    *rq = q;
+    return 0;
+}
+
+static void
+entity_timer_queue_destroy(ent_timer_queue_t *q)
+{
+    int rv;
+
+    ipmi_lock(q->lock);
+    q->head = NULL;
+    rv = 0;
+    if (q->running)
+	rv = q->os_hnd->stop_timer(q->os_hnd, q->timer);
+    if (rv || q->in_timeout) {
+	/* The timeout is running, it will free the queue. */
+	q->destroyed = 1;
+	ipmi_unlock(q->lock);
+	return;
+    }
+    ipmi_unlock(q->lock);
+    q->os_hnd->free_timer(q->os_hnd, q->timer);
+    ipmi_destroy_lock(q->lock);
+    ipmi_mem_free(q);
+}
+
+static void
+entity_init_timer(ipmi_entity_t      *entity,
+		  ent_timer_info_t   *info,
+		  ipmi_entity_ptr_cb handler)
+{
+    info->next = NULL;
+    info->entity = entity;
+    info->queued = 0;
+    info->handler = handler;
+}
+
+/* Queue the timeout for the entity, if it is not already queued. */
+static void
+entity_start_timer(ent_timer_info_t *info,
+		   ipmi_timeout_t   timeout)
+{
+    ent_timer_queue_t *q = info->entity->ents->timers;
+    ent_timer_info_t  **pos;
+    struct timeval    now;
+
+    if (timeout == IPMI_TIMEOUT_FOREVER)
+	return;
+
+    ipmi_lock(q->lock);
+    if (info->queued) {
+	ipmi_unlock(q->lock);
+	return;
+    }
+
+    q->os_hnd->get_monotonic_time(q->os_hnd, &now);
+    info->expiry.tv_sec = now.tv_sec + (timeout / 1000000000);
+    info->expiry.tv_usec = now.tv_usec + ((timeout % 1000000000) / 1000);
+    while (info->expiry.tv_usec >= 1000000) {
+	info->expiry.tv_sec++;
+	info->expiry.tv_usec -= 1000000;
+    }
+
+    pos = &q->head;
+    while (*pos && (timeval_cmp(&(*pos)->expiry, &info->expiry) <= 0))
+	pos = &(*pos)->next;
+    info->next = *pos;
+    *pos = info;
+    info->queued = 1;
+
+    if ((q->head == info) && q->running) {
+	/* New first timeout, restart the OS timer for it.  If the
+	   stop fails the timeout is running and will rearm it. */
+	if (!q->os_hnd->stop_timer(q->os_hnd, q->timer))
+	    q->running = 0;
+    }
+    entity_timer_queue_arm(q);
+    ipmi_unlock(q->lock);
+}
+
+/* Take the entity's timeout out of the queue. */
+static void
+entity_stop_timer(ent_timer_info_t *info)
+{
+    ent_timer_queue_t *q = info->entity->ents->timers;
+    ent_timer_info_t  **pos;
+
+    ipmi_lock(q->lock);
+    if (info->queued) {
+	for (pos = &q->head; *pos; pos = &(*pos)->next) {
+	    if (*pos == info) {
+		*pos = info->next;
+		break;
+	    }
+	}
+	info->next = NULL;
+	info->queued = 0;
+    }
+    ipmi_unlock(q->lock);
+}
+
 /***********************************************************************
  *
  * Entity allocation/destruction
@@ -412,6 +665,7 @@ int
 ipmi_entity_info_alloc(ipmi_domain_t *domain, ipmi_entity_info_t **new_info)
 {
     ipmi_entity_info_t *ents;
+    int                rv;
 
     ents = ipmi_mem_alloc(sizeof(*ents));
     if (!ents)
@@ -427,8 +681,25 @@ ipmi_entity_info_alloc(ipmi_domain_t *domain, ipmi_entity_info_t **new_info)
 	return ENOMEM;
     }
 
+    ents->by_key = alloc_htable();
+    if (! ents->by_key) {
+	locked_list_destroy(ents->entities);
+	ipmi_mem_free(ents);
+	return ENOMEM;
+    }
+
+    rv = entity_timer_queue_alloc(domain, &ents->timers);
+    if (rv) {
+	free_htable(ents->by_key);
+	locked_list_destroy(ents->entities);
+	ipmi_mem_free(ents);
+	return rv;
+    }
+
     ents->update_handlers = locked_list_alloc(ipmi_domain_get_os_hnd(domain));
     if (! ents->update_handlers) {
+	entity_timer_queue_destroy(ents->timers);
+	free_htable(ents->by_key);
 	locked_list_destroy(ents->entities);
 	ipmi_mem_free(ents);
 	return ENOMEM;
@@ -438,6 +709,8 @@ ipmi_entity_info_alloc(ipmi_domain_t *domain, ipmi_entity_info_t **new_info)
 	= locked_list_alloc(ipmi_domain_get_os_hnd(domain));
     if (! ents->update_cl_handlers) {
 	locked_list_destroy(ents->update_handlers);
+	entity_timer_queue_destroy(ents->timers);
+	free_htable(ents->by_key);
 	locked_list_destroy(ents->entities);
 	ipmi_mem_free(ents);
 	return ENOMEM;
@@ -448,84 +721,6 @@ ipmi_entity_info_alloc(ipmi_domain_t *domain, ipmi_entity_info_t **new_info)
     return 0;
 }
 
-static void
-entity_start_timer(ent_timer_info_t *info,
-		   ipmi_timeout_t   timeout,
-		   os_timed_out_t   handler)
-{
-    /* Need to time the operation. */
-    struct timeval tv;
-
-    if (timeout == IPMI_TIMEOUT_FOREVER)
-	return;
-
-    tv.tv_sec = timeout / 1000000000;
-    tv.tv_usec = (timeout % 1000000000) / 1000;
-    ipmi_lock(info->lock);
-    if (!info->running) {
-	info->os_hnd->start_timer(info->os_hnd,
-				  info->timer,
-				  &tv,
-				  handler,
-				  info);
-	info->running = 1;
-    }
-    ipmi_unlock(info->lock);
-}
-
-static int
-entity_alloc_timer(ipmi_entity_t    *entity,
-		   ent_timer_info_t **rinfo)
-{
-    ent_timer_info_t *info;
-    int              rv;
-
-    info = ipmi_mem_alloc(sizeof(*info));
-    if (!info)
-	return ENOMEM;
-    memset(info, 0, sizeof(*info));
-
-    info->os_hnd = entity->os_hnd;
-    info->entity = entity;
-
-    rv = info->os_hnd->alloc_timer(info->os_hnd, &info->timer);
-    if (rv) {
-	ipmi_mem_free(info);
-	return rv;
-    }
-
-    rv = ipmi_create_lock(entity->domain, &info->lock);
-    if (rv) {
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_mem_free(info);
-	return rv;
-    }
-
-    *rinfo = info;
-
-    return 0;
-}
-
-static void
-entity_destroy_timer(ent_timer_info_t *info)
-{
-    int rv;
-
-    ipmi_lock(info->lock);
-    if (info->running) {
-	rv = info->os_hnd->stop_timer(info->os_hnd, info->timer);
-	if (!rv) {
-	    info->destroyed = 1;
-	    ipmi_unlock(info->lock);
-	    return;
-	}
-    }
-    ipmi_unlock(info->lock);
-    info->os_hnd->free_timer(info->os_hnd, info->timer);
-    ipmi_destroy_lock(info->lock);
-    ipmi_mem_free(info);
-}
-
 typedef struct hot_swap_cl_info_s
 {
     ipmi_entity_hot_swap_cb handler;
@@ -699,8 +894,8 @@ destroy_entity(void *cb_data, void *item1, void *item2)
 {
     ipmi_entity_t *ent = (ipmi_entity_t *) item1;
 
-    entity_destroy_timer(ent->hot_swap_act_info);
-    entity_destroy_timer(ent->hot_swap_deact_info);
+    entity_stop_timer(&ent->hot_swap_act_info);
+    entity_stop_timer(&ent->hot_swap_deact_info);
 
     if (ent->frudev_present) {
 	_ipmi_domain_mc_lock(ent->domain);
@@ -745,7 +940,8 @@ destroy_entity(void *cb_data, void *item1, void *item2)
 
     ipmi_destroy_lock(ent->elock);
 
-    ipmi_mem_free(ent);
+    _ipmi_str_unintern(ent->name);
+    ipmi_arena_free(ent);
 
     return LOCKED_LIST_ITER_CONTINUE;
 }
@@ -788,6 +984,8 @@ ipmi_entity_info_destroy(ipmi_entity_info_t *ents)
     locked_list_destroy(ents->update_cl_handlers);
     locked_list_iterate(ents->entities, destroy_entity, NULL);
     locked_list_destroy(ents->entities);
+    entity_timer_queue_destroy(ents->timers);
+    free_htable(ents->by_key);
     ipmi_mem_free(ents);
     return 0;
 }
@@ -814,6 +1012,11 @@ call_entity_update_handlers(ipmi_entity_t *ent, enum ipmi_update_e op)
 {
     ent_info_update_handler_info_t info;
 
+    if ((op == IPMI_DELETED) && _ipmi_domain_quiet_close(ent->domain))
+	return;
+
+    _ipmi_domain_update_batch_note(ent->domain, op, ent, NULL, NULL);
+
     info.op = op;
     info.entity = ent;
     info.domain = ent->domain;
@@ -822,6 +1025,15 @@ call_entity_update_handlers(ipmi_entity_t *ent, enum ipmi_update_e op)
 			&info);
 }
 
+static unsigned int
+entity_key_hash(dlr_ref_t *key)
+{
+    return ipmi_hash_uint((key->device_num.channel << 24)
+			  ^ (key->device_num.address << 16)
+			  ^ (key->entity_id << 8)
+			  ^ key->entity_instance);
+}
+
 /* Returns true if the entity was really deleted, false if not.  Must
    be called with the domain entity lock, unlocks it before return if
    it destroys the entity. */
@@ -855,6 +1067,7 @@ cleanup_entity(ipmi_entity_t *ent)
 
 	/* Remove it from the entities list. */
 	locked_list_remove_nolock(ent->ents->entities, ent, NULL);
+	htable_remove(ent->ents->by_key, entity_key_hash(&ent->key), ent);
 
 	/* The sensor, control, parent, and child lists should be empty
 	   now, we can just destroy it. */
@@ -884,50 +1097,59 @@ ipmi_entity_get_oem_info(ipmi_entity_t *entity)
 static void
 entity_set_name(ipmi_entity_t *entity)
 {
-    int length = sizeof(entity->name);
+    char       name[IPMI_ENTITY_NAME_LEN+1];
+    const char *old;
+    int        length = sizeof(name);
 
     ent_lock(entity);
-    length = ipmi_domain_get_name(entity->domain, entity->name, length);
-    entity->name[length] = '(';
+    length = ipmi_domain_get_name(entity->domain, name, length);
+    name[length] = '(';
     length++;
     if (entity->key.entity_instance >= 0x60) {
-	length += snprintf(entity->name+length, IPMI_ENTITY_NAME_LEN-length-3,
+	length += snprintf(name+length, IPMI_ENTITY_NAME_LEN-length-3,
 			   "r%d.%d.%d.%d",
 			   entity->key.device_num.channel,
 			   entity->key.device_num.address,
 			   entity->key.entity_id,
 			   entity->key.entity_instance - 0x60);
     } else {
-	length += snprintf(entity->name+length, IPMI_ENTITY_NAME_LEN-length-3,
+	length += snprintf(name+length, IPMI_ENTITY_NAME_LEN-length-3,
 			   "%d.%d", entity->key.entity_id,
 			   entity->key.entity_instance);
     }
-    entity->name[length] = ')';
-    length++;
-    entity->name[length] = ' ';
+    name[length] = ')';
     length++;
-    entity->name[length] = '\0';
+    name[length] = ' ';
     length++;
+    name[length] = '\0';
+
+    /* Intern the new one first, the name doesn't change when this is
+       redone so the old one stays in place for anyone using it. */
+    old = entity->name;
+    entity->name = _ipmi_str_intern(name, length);
+    _ipmi_str_unintern(old);
     ent_unlock(entity);
 }
 
 const char *
 _ipmi_entity_name(const ipmi_entity_t *entity)
 {
+    if (!entity->name)
+	return "";
     return entity->name;
 }
 
 static void
 entity_get_name_cb(ipmi_entity_t *entity, void *cb_data)
 {
-    char **name = cb_data;
-    *name = entity->name;
+    const char **name = cb_data;
+    *name = _ipmi_entity_name(entity);
 }
 
 const char *
 _ipmi_entity_id_name(ipmi_entity_id_t entity_id)
 {
-    char *name = "";
+    const char *name = "";
     ipmi_entity_pointer_cb(entity_id, entity_get_name_cb, &name);
     return name;
 }
@@ -941,7 +1163,7 @@ ipmi_entity_get_name(ipmi_entity_t *ent, char *name, int length)
 	return 0;
 
     /* Never changes, no lock needed. */
-    slen = strlen(ent->name);
+    slen = ent->name ? strlen(ent->name) : 0;
     if (slen == 0) {
 	if (name)
 	    *name = '\0';
@@ -1158,27 +1380,16 @@ ipmi_entity_info_remove_update_handler_cl(ipmi_entity_info_t       *ents,
 	return EINVAL;
 }
 
-typedef struct search_info_s {
-    dlr_ref_t         key;
-    ipmi_entity_t     *ent;
-} search_info_t;
-
 static int
-search_entity(void *cb_data, void *item1, void *item2)
+search_entity(void *item, void *cb_data)
 {
-    ipmi_entity_t *ent = (ipmi_entity_t *) item1;
-    search_info_t *info = (search_info_t *) cb_data;
-    int           same;
+    ipmi_entity_t *ent = item;
+    dlr_ref_t     *key = cb_data;
 
-    same = ((ent->key.device_num.channel == info->key.device_num.channel)
-	    && (ent->key.device_num.address == info->key.device_num.address)
-	    && (ent->key.entity_id == info->key.entity_id)
-	    && (ent->key.entity_instance == info->key.entity_instance));
-    if (same) {
-	info->ent = ent;
-	return LOCKED_LIST_ITER_STOP;
-    }
-    return LOCKED_LIST_ITER_CONTINUE;
+    return ((ent->key.device_num.channel == key->device_num.channel)
+	    && (ent->key.device_num.address == key->device_num.address)
+	    && (ent->key.entity_id == key->entity_id)
+	    && (ent->key.entity_instance == key->entity_instance));
 }
 
 static int
@@ -1188,16 +1399,18 @@ entity_find(ipmi_entity_info_t *ents,
 	    int                entity_instance,
 	    ipmi_entity_t      **found_ent)
 {
-    search_info_t info = { {device_num, entity_id, entity_instance}, NULL};
+    dlr_ref_t     key = { device_num, entity_id, entity_instance };
+    ipmi_entity_t *ent;
     int           rv = 0;
 
-    locked_list_iterate_nolock(ents->entities, search_entity, &info);
-    if (info.ent == NULL) {
+    ent = htable_find(ents->by_key, entity_key_hash(&key), search_entity,
+		      &key);
+    if (ent == NULL) {
 	rv = ENOENT;
     } else {
-	info.ent->usecount++;
+	ent->usecount++;
 	if (found_ent)
-	    *found_ent = info.ent;
+	    *found_ent = ent;
     }
 
     return rv;
@@ -1267,7 +1480,7 @@ entity_add(ipmi_entity_info_t *ents,
 	return 0;
     }
 
-    ent = ipmi_mem_alloc(sizeof(*ent));
+    ent = ipmi_arena_alloc(_ipmi_domain_arena(ents->domain), sizeof(*ent));
     if (!ent)
 	return ENOMEM;
     memset(ent, 0, sizeof(*ent));
@@ -1355,13 +1568,8 @@ entity_add(ipmi_entity_info_t *ents,
     if (rv)
 	goto out_err;
 
-    rv = entity_alloc_timer(ent, &ent->hot_swap_act_info);
-    if (rv)
-	goto out_err;
-
-    rv = entity_alloc_timer(ent, &ent->hot_swap_deact_info);
-    if (rv)
-	goto out_err;
+    entity_init_timer(ent, &ent->hot_swap_act_info, hot_swap_act_cb);
+    entity_init_timer(ent, &ent->hot_swap_deact_info, hot_swap_deact_cb);
 
     ent->presence_sensor = NULL;
     ent->presence_bit_sensor = NULL;
@@ -1387,6 +1595,10 @@ entity_add(ipmi_entity_info_t *ents,
 
     if (! locked_list_add_nolock(ents->entities, ent, NULL))
 	goto out_err;
+    if (! htable_add(ents->by_key, entity_key_hash(&ent->key), ent)) {
+	locked_list_remove_nolock(ents->entities, ent, NULL);
+	goto out_err;
+    }
 
     _ipmi_domain_entity_unlock(ent->domain);
 
@@ -1400,10 +1612,6 @@ entity_add(ipmi_entity_info_t *ents,
 
  out_err:
     _ipmi_domain_entity_unlock(ent->domain);
-    if (ent->hot_swap_act_info)
-	entity_destroy_timer(ent->hot_swap_act_info);
-    if (ent->hot_swap_deact_info)
-	entity_destroy_timer(ent->hot_swap_deact_info);
     if (ent->elock)
 	ipmi_destroy_lock(ent->elock);
     if (ent->presence_handlers)
@@ -1440,7 +1648,8 @@ entity_add(ipmi_entity_info_t *ents,
 	locked_list_destroy(ent->parent_entities);
     if (ent->child_entities)
 	locked_list_destroy(ent->child_entities);
-    ipmi_mem_free(ent);
+    _ipmi_str_unintern(ent->name);
+    ipmi_arena_free(ent);
     return ENOMEM;
 }
 
@@ -1828,6 +2037,11 @@ presence_changed(ipmi_entity_t *ent, int present)
 	/* If our presence changes, that can affect parents, too.  So we
 	   rescan them. */
 	ipmi_entity_iterate_parents(ent, presence_parent_handler, NULL);
+
+	/* The MC may have come or gone with it. */
+	if (ent->info.type == IPMI_ENTITY_MC)
+	    _ipmi_domain_ipmb_changed(domain, ent->info.channel,
+				      ent->info.slave_address);
     }
 }
 
@@ -1887,9 +2101,12 @@ presence_bit_sensor_changed(ipmi_sensor_t         *sensor,
     return IPMI_EVENT_NOT_HANDLED;
 }
 
+typedef struct presence_batch_s presence_batch_t;
+
 typedef struct ent_detect_info_s
 {
-    int force;
+    int              force;
+    presence_batch_t *batch; /* NULL if not batching the reads. */
 } ent_detect_info_t;
 
 typedef struct ent_active_detect_s
@@ -1901,8 +2118,20 @@ typedef struct ent_active_detect_s
     int              present;
     unsigned int     start_presence_event_count;
     ipmi_msg_t       *msg;
+
+    /* The readable threshold sensors were already read in a
+       presence batch, only try the others. */
+    int              sensors_read;
 } ent_active_detect_t;
 
+static void
+presence_check_done(ipmi_entity_t *ent)
+{
+    ent->in_presence_check = 0;
+    _ipmi_domain_span_end(ent->domain, ent->presence_span);
+    ent->presence_span = 0;
+}
+
 static void
 detect_cleanup(ent_active_detect_t *info, ipmi_entity_t *ent,
 	       ipmi_domain_t *domain)
@@ -1911,7 +2140,7 @@ detect_cleanup(ent_active_detect_t *info, ipmi_entity_t *ent,
     ipmi_destroy_lock(info->lock);
     ipmi_mem_free(info);
     if (ent)
-	ent->in_presence_check = 0;
+	presence_check_done(ent);
     _ipmi_put_domain_fully_up(domain, "detect_cleanup");
 }
 
@@ -1922,7 +2151,7 @@ detect_done(ipmi_entity_t *ent, ent_active_detect_t *info)
     presence_changed(ent, info->present);
     ipmi_destroy_lock(info->lock);
     ipmi_mem_free(info);
-    ent->in_presence_check = 0;
+    presence_check_done(ent);
     _ipmi_put_domain_fully_up(ent->domain, "detect_done");
 }
 
@@ -2252,6 +2481,15 @@ detect_reading_read(ipmi_sensor_t             *sensor,
 	ipmi_unlock(info->lock);
 }
 
+/* Can the sensor's presence check be done in a batch of readings? */
+static int
+presence_sensor_batchable(ipmi_sensor_t *sensor)
+{
+    return ((ipmi_sensor_get_event_reading_type(sensor)
+	     == IPMI_EVENT_READING_TYPE_THRESHOLD)
+	    && ipmi_sensor_get_is_readable(sensor));
+}
+
 static void
 sensor_detect_send(ipmi_entity_t *ent,
 		   ipmi_sensor_t *sensor,
@@ -2264,6 +2502,10 @@ sensor_detect_send(ipmi_entity_t *ent,
 	/* Sensor should be ignored for presence. */
 	return;
 
+    if (info->sensors_read && presence_sensor_batchable(sensor))
+	/* Already read and not present. */
+	return;
+
     info->try_count++;
     ipmi_unlock(info->lock);
 
@@ -2302,21 +2544,21 @@ try_presence_sensors(ipmi_entity_t *ent, ent_active_detect_t *info)
 }
 
 static void
-detect_no_presence_sensor_presence(ipmi_entity_t *ent)
+detect_no_presence_sensor_presence(ipmi_entity_t *ent, int sensors_read)
 {
     ent_active_detect_t *detect;
     int                 rv;
 
     detect = ipmi_mem_alloc(sizeof(*detect));
     if (!detect) {
-	ent->in_presence_check = 0;
+	presence_check_done(ent);
 	_ipmi_put_domain_fully_up(ent->domain,
 				  "detect_no_presence_sensor_presence");
 	return;
     }
     rv = ipmi_create_lock(ent->domain, &detect->lock);
     if (rv) {
-	ent->in_presence_check = 0;
+	presence_check_done(ent);
 	_ipmi_put_domain_fully_up(ent->domain,
 				  "detect_no_presence_sensor_presence(2)");
 	ipmi_mem_free(detect);
@@ -2326,6 +2568,7 @@ detect_no_presence_sensor_presence(ipmi_entity_t *ent)
     detect->start_presence_event_count = ent->presence_event_count;
     detect->ent_id = ipmi_entity_convert_to_id(ent);
     detect->present = 0;
+    detect->sensors_read = sensors_read;
     ipmi_lock(detect->lock);
 
     /* The successful one below will unlock the lock and free detect. */
@@ -2358,7 +2601,7 @@ states_read(ipmi_sensor_t *sensor,
 	_ipmi_domain_entity_lock(ent->domain);
 	_ipmi_entity_get(ent);
 	_ipmi_domain_entity_unlock(ent->domain);
-	detect_no_presence_sensor_presence(ent);
+	detect_no_presence_sensor_presence(ent, 0);
 	_ipmi_entity_put(ent);
 	return;
     }
@@ -2378,7 +2621,7 @@ states_read(ipmi_sensor_t *sensor,
     }
 
     presence_changed(ent, present);
-    ent->in_presence_check = 0;
+    presence_check_done(ent);
     _ipmi_put_domain_fully_up(ipmi_sensor_get_domain(sensor), "states_read");
 }
 
@@ -2395,7 +2638,7 @@ states_bit_read(ipmi_sensor_t *sensor,
 	_ipmi_domain_entity_lock(ent->domain);
 	_ipmi_entity_get(ent);
 	_ipmi_domain_entity_unlock(ent->domain);
-	detect_no_presence_sensor_presence(ent);
+	detect_no_presence_sensor_presence(ent, 0);
 	_ipmi_entity_put(ent);
 	return;
     }
@@ -2408,16 +2651,271 @@ states_bit_read(ipmi_sensor_t *sensor,
 	present = ipmi_is_state_set(states, ent->presence_bit_offset);
 
     presence_changed(ent, present);
-    ent->in_presence_check = 0;
+    presence_check_done(ent);
     _ipmi_put_domain_fully_up(ipmi_sensor_get_domain(sensor),
 			      "states_bit_read");
 }
 
+/*
+ * When checking all the entities in a domain, the entities without a
+ * presence sensor have their readable threshold sensors read in one
+ * batch of readings for the whole domain, with any sensor shared
+ * between entities read only once.  Entities that one of those
+ * readings shows present are done, the rest go on to the normal
+ * checks, skipping the sensors already read.
+ */
+typedef struct presence_batch_ent_s
+{
+    ipmi_entity_id_t ent_id;
+    unsigned int     start_presence_event_count;
+    unsigned int     first_sensor; /* Index into sensors. */
+    unsigned int     num_sensors;
+} presence_batch_ent_t;
+
+struct presence_batch_s
+{
+    ipmi_domain_t        *domain;
+
+    presence_batch_ent_t *ents;
+    unsigned int         num_ents;
+    unsigned int         ents_len;
+
+    /* Each entity's sensors, in entity order. */
+    ipmi_sensor_id_t     *sensors;
+    unsigned int         num_sensors;
+    unsigned int         sensors_len;
+
+    /* The sensors to read, sorted with duplicates removed. */
+    ipmi_sensor_id_t     *ids;
+    unsigned int         num_ids;
+};
+
+static presence_batch_t *
+presence_batch_alloc(ipmi_domain_t *domain)
+{
+    presence_batch_t *batch;
+
+    batch = ipmi_mem_alloc(sizeof(*batch));
+    if (!batch)
+	return NULL;
+    memset(batch, 0, sizeof(*batch));
+    batch->domain = domain;
+    return batch;
+}
+
+static void
+presence_batch_free(presence_batch_t *batch)
+{
+    if (batch->ents)
+	ipmi_mem_free(batch->ents);
+    if (batch->sensors)
+	ipmi_mem_free(batch->sensors);
+    if (batch->ids)
+	ipmi_mem_free(batch->ids);
+    ipmi_mem_free(batch);
+}
+
+/* Make room for one more item in an array, doubling it if full. */
+static int
+presence_batch_grow(void **array, unsigned int *len, unsigned int count,
+		    unsigned int size)
+{
+    unsigned int new_len;
+    void         *new_array;
+
+    if (count < *len)
+	return 0;
+    new_len = *len ? *len * 2 : 16;
+    new_array = ipmi_mem_alloc(new_len * size);
+    if (!new_array)
+	return ENOMEM;
+    if (*array) {
+	memcpy(new_array, *array, count * size);
+	ipmi_mem_free(*array);
+    }
+    *array = new_array;
+    *len = new_len;
+    return 0;
+}
+
+static void
+presence_batch_add_sensor(ipmi_entity_t *ent,
+			  ipmi_sensor_t *sensor,
+			  void          *cb_data)
+{
+    presence_batch_t *batch = cb_data;
+
+    if (ipmi_sensor_get_ignore_for_presence(sensor)
+	|| !presence_sensor_batchable(sensor))
+	return;
+
+    if (presence_batch_grow((void **) &batch->sensors, &batch->sensors_len,
+			    batch->num_sensors, sizeof(*batch->sensors)))
+	return;
+    batch->sensors[batch->num_sensors] = ipmi_sensor_convert_to_id(sensor);
+    batch->num_sensors++;
+}
+
+/* Add the entity's sensors to the batch.  Returns an error if the
+   entity has nothing to read in the batch, the caller must do the
+   normal presence check then. */
+static int
+presence_batch_add(presence_batch_t *batch, ipmi_entity_t *ent)
+{
+    presence_batch_ent_t *bent;
+    unsigned int         first = batch->num_sensors;
+
+    if (presence_batch_grow((void **) &batch->ents, &batch->ents_len,
+			    batch->num_ents, sizeof(*batch->ents)))
+	return ENOMEM;
+
+    ipmi_entity_iterate_sensors(ent, presence_batch_add_sensor, batch);
+    if (batch->num_sensors == first)
+	return ENOENT;
+
+    bent = &batch->ents[batch->num_ents];
+    bent->ent_id = ipmi_entity_convert_to_id(ent);
+    bent->start_presence_event_count = ent->presence_event_count;
+    bent->first_sensor = first;
+    bent->num_sensors = batch->num_sensors - first;
+    batch->num_ents++;
+    return 0;
+}
+
+static int
+presence_sensor_id_cmp(const void *a, const void *b)
+{
+    return ipmi_cmp_sensor_id(*((ipmi_sensor_id_t *) a),
+			      *((ipmi_sensor_id_t *) b));
+}
+
+typedef struct presence_batch_check_s
+{
+    presence_batch_t            *batch;
+    presence_batch_ent_t        *bent;
+    ipmi_sensor_batch_reading_t *readings;
+} presence_batch_check_t;
+
+static void
+presence_batch_ent_check(ipmi_entity_t *ent, void *cb_data)
+{
+    presence_batch_check_t      *check = cb_data;
+    presence_batch_ent_t        *bent = check->bent;
+    ipmi_sensor_id_t            *id, *found;
+    ipmi_sensor_batch_reading_t *reading;
+    unsigned int                i;
+    int                         present = 0;
+
+    if (bent->start_presence_event_count != ent->presence_event_count) {
+	/* Something else has set the presence since we started, see
+	   the comment in sensor_detect_handler(). */
+	presence_check_done(ent);
+	_ipmi_put_domain_fully_up(ent->domain, "presence_batch_ent_check");
+	return;
+    }
+
+    for (i=0; i<bent->num_sensors; i++) {
+	id = &check->batch->sensors[bent->first_sensor + i];
+	found = bsearch(id, check->batch->ids, check->batch->num_ids,
+			sizeof(*id), presence_sensor_id_cmp);
+	if (!found)
+	    continue;
+	reading = &check->readings[found - check->batch->ids];
+	if (!reading->err
+	    && ipmi_is_sensor_scanning_enabled(reading->states)
+	    && !ipmi_is_initial_update_in_progress(reading->states))
+	{
+	    present = 1;
+	    break;
+	}
+    }
+
+    if (present) {
+	presence_changed(ent, 1);
+	presence_check_done(ent);
+	_ipmi_put_domain_fully_up(ent->domain, "presence_batch_ent_check");
+    } else {
+	detect_no_presence_sensor_presence(ent, 1);
+    }
+}
+
+static void
+presence_batch_ent_retry(ipmi_entity_t *ent, void *cb_data)
+{
+    detect_no_presence_sensor_presence(ent, 0);
+}
+
+static void
+presence_batch_readings(ipmi_domain_t               *domain,
+			ipmi_sensor_batch_reading_t *readings,
+			unsigned int                count,
+			void                        *cb_data)
+{
+    presence_batch_t       *batch = cb_data;
+    presence_batch_check_t check;
+    unsigned int           i;
+
+    check.batch = batch;
+    check.readings = readings;
+    for (i=0; i<batch->num_ents; i++) {
+	check.bent = &batch->ents[i];
+	if (ipmi_entity_pointer_cb(check.bent->ent_id,
+				   presence_batch_ent_check, &check))
+	    /* The entity is gone, see detect_frudev() about the
+	       domain. */
+	    _ipmi_put_domain_fully_up(check.bent->ent_id.domain_id.domain,
+				      "presence_batch_readings");
+    }
+    presence_batch_free(batch);
+}
+
+static void
+presence_batch_start(presence_batch_t *batch)
+{
+    unsigned int i, j;
+    int          rv;
+
+    if (batch->num_ents == 0) {
+	presence_batch_free(batch);
+	return;
+    }
+
+    rv = ENOMEM;
+    batch->ids = ipmi_mem_alloc(sizeof(*batch->ids) * batch->num_sensors);
+    if (batch->ids) {
+	memcpy(batch->ids, batch->sensors,
+	       sizeof(*batch->ids) * batch->num_sensors);
+	qsort(batch->ids, batch->num_sensors, sizeof(*batch->ids),
+	      presence_sensor_id_cmp);
+	for (i=1, j=0; i<batch->num_sensors; i++) {
+	    if (ipmi_cmp_sensor_id(batch->ids[i], batch->ids[j]) != 0)
+		batch->ids[++j] = batch->ids[i];
+	}
+	batch->num_ids = j + 1;
+
+	rv = ipmi_domain_get_sensor_readings(batch->domain, batch->ids,
+					     batch->num_ids,
+					     presence_batch_readings, batch);
+    }
+
+    if (rv) {
+	/* Couldn't batch them, do the entities one at a time. */
+	for (i=0; i<batch->num_ents; i++) {
+	    if (ipmi_entity_pointer_cb(batch->ents[i].ent_id,
+				       presence_batch_ent_retry, NULL))
+		_ipmi_put_domain_fully_up(batch->domain,
+					  "presence_batch_start");
+	}
+	presence_batch_free(batch);
+    }
+}
+
 static void
 ent_detect_presence(ipmi_entity_t *ent, void *cb_data)
 {
     ent_detect_info_t   *info = cb_data;
     int                 rv;
+    char                name[IPMI_ENTITY_NAME_LEN];
 
     ent_lock(ent);
     if (ent->in_presence_check
@@ -2428,6 +2926,10 @@ ent_detect_presence(ipmi_entity_t *ent, void *cb_data)
     }
     ent->presence_possibly_changed = 0;
     ent->in_presence_check = 1;
+    ipmi_entity_get_name(ent, name, sizeof(name));
+    ent->presence_span = _ipmi_domain_span_start(ent->domain,
+						 "entity_presence", name,
+						 IPMI_SPAN_TRACK_PRESENCE, 0);
 
     if (ent->hot_swappable) {
 	ent_unlock(ent);
@@ -2442,7 +2944,7 @@ ent_detect_presence(ipmi_entity_t *ent, void *cb_data)
 	ent_unlock(ent);
 	rv = ipmi_sensor_id_get_states(psi, states_read, ent);
 	if (rv) {
-	    ent->in_presence_check = 0;
+	    presence_check_done(ent);
 	    _ipmi_put_domain_fully_up(ent->domain, "ent_detect_presence(2)");
 	}
     } else if (ent->presence_bit_sensor) {
@@ -2451,12 +2953,13 @@ ent_detect_presence(ipmi_entity_t *ent, void *cb_data)
 	ent_unlock(ent);
 	rv = ipmi_sensor_id_get_states(psi, states_bit_read, ent);
 	if (rv) {
-	    ent->in_presence_check = 0;
+	    presence_check_done(ent);
 	    _ipmi_put_domain_fully_up(ent->domain, "ent_detect_presence(3)");
 	}
     } else {
 	ent_unlock(ent);
-	detect_no_presence_sensor_presence(ent);
+	if (!info->batch || presence_batch_add(info->batch, ent))
+	    detect_no_presence_sensor_presence(ent, 0);
     }
 }
 
@@ -2466,7 +2969,10 @@ ipmi_detect_ents_presence_changes(ipmi_entity_info_t *ents, int force)
     ent_detect_info_t info;
 
     info.force = force;
+    info.batch = presence_batch_alloc(ents->domain);
     ipmi_entities_iterate_entities(ents, ent_detect_presence, &info);
+    if (info.batch)
+	presence_batch_start(info.batch);
     return 0;
 }
 
@@ -2476,6 +2982,7 @@ ipmi_detect_entity_presence_change(ipmi_entity_t *entity, int force)
     ent_detect_info_t info;
 
     info.force = force;
+    info.batch = NULL;
     ent_detect_presence(entity, &info);
     return 0;
 }
@@ -2778,6 +3285,9 @@ _ipmi_entity_call_sensor_handlers(ipmi_entity_t *ent, ipmi_sensor_t *sensor,
 {
     sensor_handler_t info;
 
+    if ((op == IPMI_DELETED) && _ipmi_domain_quiet_close(ent->domain))
+	return;
+
     /* If we are reporting things, make sure the entity they are attached
        to is already reported. */
     _ipmi_domain_entity_lock(ent->domain);
@@ -2789,6 +3299,8 @@ _ipmi_entity_call_sensor_handlers(ipmi_entity_t *ent, ipmi_sensor_t *sensor,
 	_ipmi_domain_entity_unlock(ent->domain);
     }
 
+    _ipmi_domain_update_batch_note(ent->domain, op, ent, sensor, NULL);
+
     info.op = op;
     info.entity = ent;
     info.sensor = sensor;
@@ -2867,6 +3379,8 @@ _ipmi_entity_call_control_handlers(ipmi_entity_t      *ent,
 {
     control_handler_t info;
 
+    if ((op == IPMI_DELETED) && _ipmi_domain_quiet_close(ent->domain))
+	return;
 
     /* If we are reporting things, make sure the entity they are attached
        to is already reported. */
@@ -2879,6 +3393,8 @@ _ipmi_entity_call_control_handlers(ipmi_entity_t      *ent,
 	_ipmi_domain_entity_unlock(ent->domain);
     }
 
+    _ipmi_domain_update_batch_note(ent->domain, op, ent, NULL, control);
+
     info.op = op;
     info.entity = ent;
     info.control = control;
@@ -3250,12 +3766,81 @@ ipmi_entity_iterate_sensors(ipmi_entity_t                 *ent,
 			    ipmi_entity_iterate_sensor_cb handler,
 			    void                          *cb_data)
 {
-    iterate_sensor_info_t info = { ent, handler, cb_data };
+    iterate_sensor_info_t info = { ent, handler, cb_data };
+
+    CHECK_ENTITY_LOCK(ent);
+
+    locked_list_iterate_prefunc(ent->sensors, iterate_sensor_prefunc,
+				iterate_sensor_handler, &info);
+}
+
+typedef struct snapshot_sensor_info_s
+{
+    ipmi_sensor_t **sensors;
+    unsigned int  n;
+} snapshot_sensor_info_t;
+
+static int
+snapshot_sensor_prefunc(void *cb_data, void *item1, void *item2)
+{
+    snapshot_sensor_info_t *info = cb_data;
+    iterate_sensor_info_t  iinfo;
+
+    /* Just hold the sensor and its MC here, the id needs the domain
+       entity lock to get a handle so it is done after unlocking. */
+    iinfo.got_failed = 0;
+    iterate_sensor_prefunc(&iinfo, item1, item2);
+    if (!iinfo.got_failed)
+	info->sensors[info->n++] = item1;
+    return LOCKED_LIST_ITER_SKIP;
+}
+
+int
+ipmi_entity_snapshot_sensors(ipmi_entity_t *ent, ipmi_snapshot_t **snap)
+{
+    snapshot_sensor_info_t info;
+    ipmi_snapshot_t        *s;
+    unsigned int           size, count, i;
 
     CHECK_ENTITY_LOCK(ent);
 
-    locked_list_iterate_prefunc(ent->sensors, iterate_sensor_prefunc,
-				iterate_sensor_handler, &info);
+    size = locked_list_num_entries(ent->sensors);
+    for (;;) {
+	/* Room for at least one so the allocation can't be zero. */
+	info.sensors = ipmi_mem_alloc(sizeof(ipmi_sensor_t *) * (size + 1));
+	if (!info.sensors)
+	    return ENOMEM;
+	info.n = 0;
+
+	locked_list_lock(ent->sensors);
+	count = locked_list_num_entries_nolock(ent->sensors);
+	if (count <= size)
+	    locked_list_iterate_prefunc_nolock(ent->sensors,
+					       snapshot_sensor_prefunc, NULL,
+					       &info);
+	locked_list_unlock(ent->sensors);
+
+	if (count <= size)
+	    break;
+	ipmi_mem_free(info.sensors);
+	size = count;
+    }
+
+    s = _ipmi_snapshot_alloc(IPMI_SNAPSHOT_SENSORS, info.n);
+    for (i=0; i<info.n; i++) {
+	ipmi_sensor_t *sensor = info.sensors[i];
+	ipmi_mc_t     *mc = ipmi_sensor_get_mc(sensor);
+
+	if (s)
+	    s->ids[i].sensor = ipmi_sensor_convert_to_id(sensor);
+	_ipmi_sensor_put(sensor);
+	_ipmi_mc_put(mc);
+    }
+    ipmi_mem_free(info.sensors);
+    if (!s)
+	return ENOMEM;
+    *snap = s;
+    return 0;
 }
 
 
@@ -3690,6 +4275,11 @@ typedef struct entity_found_s
     ipmi_entity_t **cent;
     unsigned int cent_next;
     unsigned int cent_len;
+
+    /* For an EAR that changed, the entry for the same entity's EAR in
+       the other (old or new) set of records, so only the children
+       that differ get removed and added. */
+    struct entity_found_s *other;
 } entity_found_t;
 
 typedef struct entity_sdr_info_s
@@ -3938,9 +4528,8 @@ put_entities(entity_sdr_info_t *infos)
 }
 
 static int
-cmp_dlr(const dlr_info_t *d1, const dlr_info_t *d2)
+cmp_dlr_entity(const dlr_info_t *d1, const dlr_info_t *d2)
 {
-
     if (d1->entity_id < d2->entity_id)
 	return -1;
     if (d1->entity_id > d2->entity_id)
@@ -3949,9 +4538,77 @@ cmp_dlr(const dlr_info_t *d1, const dlr_info_t *d2)
 	return -1;
     if (d1->entity_instance > d2->entity_instance)
 	return 1;
+    return 0;
+}
+
+static int
+cmp_dlr(const dlr_info_t *d1, const dlr_info_t *d2)
+{
+    int rv;
+
+    rv = cmp_dlr_entity(d1, d2);
+    if (rv)
+	return rv;
     return memcmp(d1, d2, sizeof(dlr_info_t));
 }
 
+static int
+dlr_is_ear(const dlr_info_t *dlr)
+{
+    return ((dlr->type == IPMI_ENTITY_EAR)
+	    || (dlr->type == IPMI_ENTITY_DREAR));
+}
+
+static int
+found_has_child(entity_found_t *found, ipmi_entity_t *child)
+{
+    unsigned int i;
+
+    if (!found)
+	return 0;
+    for (i=0; i<found->cent_next; i++) {
+	if (found->cent[i] == child)
+	    return 1;
+    }
+    return 0;
+}
+
+/* Pair up the unfound EARs in the old and new records that are for
+   the same entity, so a changed EAR only changes the children that
+   are really different.  Both are sorted by entity id and
+   instance. */
+static void
+pair_changed_ears(entity_sdr_info_t *old_infos, entity_sdr_info_t *infos)
+{
+    unsigned int   i, j, k;
+    entity_found_t *ofound, *nfound;
+
+    j = 0;
+    for (i=0; i<old_infos->next; i++) {
+	ofound = old_infos->found + i;
+	if (ofound->found || !ofound->ent || !dlr_is_ear(old_infos->dlrs[i]))
+	    continue;
+
+	while ((j < infos->next)
+	       && (cmp_dlr_entity(infos->dlrs[j], old_infos->dlrs[i]) < 0))
+	    j++;
+
+	for (k=j;
+	     ((k < infos->next)
+	      && (cmp_dlr_entity(infos->dlrs[k], old_infos->dlrs[i]) == 0));
+	     k++)
+	{
+	    nfound = infos->found + k;
+	    if (nfound->found || nfound->other || (nfound->ent != ofound->ent)
+		|| !dlr_is_ear(infos->dlrs[k]))
+		continue;
+	    ofound->other = nfound;
+	    nfound->other = ofound;
+	    break;
+	}
+    }
+}
+
 static int
 cmp_dlr_qsort(const void *a, const void *b)
 {
@@ -4088,6 +4745,8 @@ ipmi_entity_scan_sdrs(ipmi_domain_t      *domain,
     if (rv)
 	goto out_err_unlock;
 
+    pair_changed_ears(old_infos, &infos);
+
     /* Now ensure space is in each parent for all the children and
        each child's parent entry. */
     for (i=0; i<infos.next; i++) {
@@ -4128,10 +4787,17 @@ ipmi_entity_scan_sdrs(ipmi_domain_t      *domain,
 	    /* A real DLR, decrement the refcount, and destroy the info. */
 	    found->ent->ref_count--;
 	    memset(&found->ent->info, 0, sizeof(dlr_info_t));
+	    if (found->ent->ref_count)
+		/* Still there from another DLR, report the change. */
+		found->ent->changed = 1;
 	} else {
-	    /* It's an EAR, so handling removing the children. */
-	    for (j=0; j<found->cent_next; j++)
+	    /* It's an EAR, so handling removing the children.  Children
+	       still in the new version of the EAR stay. */
+	    for (j=0; j<found->cent_next; j++) {
+		if (found_has_child(found->other, found->cent[j]))
+		    continue;
 		ipmi_entity_remove_child_internal(found->ent, found->cent[j]);
+	    }
 	}
     }
 
@@ -4246,8 +4912,12 @@ ipmi_entity_scan_sdrs(ipmi_domain_t      *domain,
 		}
 	    }
 	} else {
-	    /* It's an EAR, so handling adding the children. */
+	    /* It's an EAR, so handling adding the children.  Children
+	       that were in the old version of the EAR are already
+	       there. */
 	    for (j=0; j<found->cent_next; j++) {
+		if (found_has_child(found->other, found->cent[j]))
+		    continue;
 		entry = entries;
 		entries = entry->next->next;
 		add_child(found->ent, found->cent[j], entry, entry->next);
@@ -5288,13 +5958,11 @@ ipmi_entities_iterate_entities(ipmi_entity_info_t              *ents,
 				iterate_entity_handler, &info);
 }
 
-ipmi_entity_id_t
-ipmi_entity_convert_to_id(ipmi_entity_t *ent)
+static ipmi_entity_id_t
+entity_to_id(ipmi_entity_t *ent)
 {
     ipmi_entity_id_t val;
 
-    CHECK_ENTITY_LOCK(ent);
-
     val.domain_id = ent->domain_id;
     val.entity_id = ent->key.entity_id;
     val.entity_instance = ent->key.entity_instance;
@@ -5305,6 +5973,63 @@ ipmi_entity_convert_to_id(ipmi_entity_t *ent)
     return val;
 }
 
+ipmi_entity_id_t
+ipmi_entity_convert_to_id(ipmi_entity_t *ent)
+{
+    CHECK_ENTITY_LOCK(ent);
+
+    return entity_to_id(ent);
+}
+
+typedef struct snapshot_fill_s
+{
+    ipmi_snapshot_t *snap;
+    unsigned int    n;
+} snapshot_fill_t;
+
+static int
+snapshot_entity_prefunc(void *cb_data, void *item1, void *item2)
+{
+    snapshot_fill_t *fill = cb_data;
+
+    /* The id is just a copy of fields that don't change while the
+       entity is in the list, so no use count is needed. */
+    fill->snap->ids[fill->n++].entity = entity_to_id(item1);
+    return LOCKED_LIST_ITER_SKIP;
+}
+
+int
+_ipmi_entities_snapshot(ipmi_entity_info_t *ents, ipmi_snapshot_t **snap)
+{
+    snapshot_fill_t fill;
+    unsigned int    size, count;
+
+    size = locked_list_num_entries(ents->entities);
+    for (;;) {
+	fill.snap = _ipmi_snapshot_alloc(IPMI_SNAPSHOT_ENTITIES, size);
+	if (!fill.snap)
+	    return ENOMEM;
+	fill.n = 0;
+
+	locked_list_lock(ents->entities);
+	count = locked_list_num_entries_nolock(ents->entities);
+	if (count <= size)
+	    locked_list_iterate_prefunc_nolock(ents->entities,
+					       snapshot_entity_prefunc, NULL,
+					       &fill);
+	locked_list_unlock(ents->entities);
+
+	if (count <= size)
+	    break;
+	/* Entities were added after the count, try again. */
+	ipmi_snapshot_put(fill.snap);
+	size = count;
+    }
+    fill.snap->count = fill.n;
+    *snap = fill.snap;
+    return 0;
+}
+
 typedef struct mc_cb_info_s
 {
     ipmi_entity_ptr_cb handler;
@@ -5557,10 +6282,14 @@ _ipmi_entity_call_fru_handlers(ipmi_entity_t *ent, enum ipmi_update_e op)
     locked_list_iterate(ent->fru_handlers, call_fru_handler, &info);
 }
 
+/* Like ipmi_entity_ptr_cb, but with the result of the fetch. */
+typedef void (*fru_fetch_done_cb)(ipmi_entity_t *ent, int err, void *cb_data);
+
 typedef struct fru_ent_info_s
 {
     ipmi_entity_id_t   ent_id;
     ipmi_entity_ptr_cb done;
+    fru_fetch_done_cb  done_err;
     void               *cb_data;
     ipmi_fru_t         *fru;
     int                err;
@@ -5602,6 +6331,8 @@ fru_fetched_ent_cb(ipmi_entity_t *ent, void *cb_data)
 
     if (info->done)
 	info->done(ent, info->cb_data);
+    else if (info->done_err)
+	info->done_err(ent, info->err, info->cb_data);
 }
 
 static void
@@ -5620,6 +6351,8 @@ fru_fetched_handler(ipmi_domain_t *domain, ipmi_fru_t *fru,
 	ipmi_fru_destroy_internal(fru, NULL, NULL);
 	if (info->done)
 	    info->done(NULL, info->cb_data);
+	else if (info->done_err)
+	    info->done_err(NULL, rv, info->cb_data);
     }
 
     ipmi_mem_free(info);
@@ -5627,10 +6360,11 @@ fru_fetched_handler(ipmi_domain_t *domain, ipmi_fru_t *fru,
 	_ipmi_put_domain_fully_up(domain, "fru_fetched_handler");
 }
 
-int
-ipmi_entity_fetch_frus_cb(ipmi_entity_t      *ent,
-			  ipmi_entity_ptr_cb done,
-			  void               *cb_data)
+static int
+entity_fetch_frus(ipmi_entity_t      *ent,
+		  ipmi_entity_ptr_cb done,
+		  fru_fetch_done_cb  done_err,
+		  void               *cb_data)
 {
     fru_ent_info_t   *info;
     int              rv;
@@ -5644,6 +6378,7 @@ ipmi_entity_fetch_frus_cb(ipmi_entity_t      *ent,
 
     info->ent_id = ipmi_entity_convert_to_id(ent);
     info->done = done;
+    info->done_err = done_err;
     info->cb_data = cb_data;
 
     /* fetch the FRU information. */
@@ -5671,12 +6406,336 @@ ipmi_entity_fetch_frus_cb(ipmi_entity_t      *ent,
     return rv;
 }
 
+int
+ipmi_entity_fetch_frus_cb(ipmi_entity_t      *ent,
+			  ipmi_entity_ptr_cb done,
+			  void               *cb_data)
+{
+    return entity_fetch_frus(ent, done, NULL, cb_data);
+}
+
 int
 ipmi_entity_fetch_frus(ipmi_entity_t *ent)
 {
     return ipmi_entity_fetch_frus_cb(ent, NULL, NULL);
 }
 
+/*
+ * Fetching the FRUs of all the entities in a domain.  The FRUs are
+ * sorted by the MC they are on, each MC is a group, and fetches are
+ * started going around the groups, one at a time per MC.
+ */
+typedef struct fru_sweep_s fru_sweep_t;
+
+typedef struct fru_sweep_ent_s
+{
+    fru_sweep_t   *sweep;
+    unsigned int  idx;   /* Index into the status. */
+    unsigned int  group; /* Index into the groups. */
+    unsigned char channel;
+    unsigned char address;
+} fru_sweep_ent_t;
+
+typedef struct fru_sweep_group_s
+{
+    unsigned int next;
+    unsigned int end;
+    unsigned int outstanding;
+} fru_sweep_group_t;
+
+struct fru_sweep_s
+{
+    ipmi_domain_id_t            domain_id;
+    ipmi_lock_t                 *lock;
+
+    ipmi_domain_fru_status_t    *status;
+    unsigned int                count;
+
+    fru_sweep_ent_t             *ents;
+    fru_sweep_group_t           *groups;
+    unsigned int                num_groups;
+    unsigned int                next_group;
+
+    unsigned int                window;
+    unsigned int                outstanding;
+    unsigned int                done_count;
+    int                         issuing;
+
+    ipmi_domain_frus_fetched_cb done;
+    void                        *cb_data;
+};
+
+static void
+fru_sweep_free(fru_sweep_t *sweep)
+{
+    if (sweep->lock)
+	ipmi_destroy_lock(sweep->lock);
+    if (sweep->status)
+	ipmi_mem_free(sweep->status);
+    if (sweep->ents)
+	ipmi_mem_free(sweep->ents);
+    if (sweep->groups)
+	ipmi_mem_free(sweep->groups);
+    ipmi_mem_free(sweep);
+}
+
+static void
+fru_sweep_done_cb(ipmi_domain_t *domain, void *cb_data)
+{
+    fru_sweep_t *sweep = cb_data;
+
+    sweep->done(domain, sweep->status, sweep->count, sweep->cb_data);
+}
+
+static void
+fru_sweep_finish(fru_sweep_t *sweep)
+{
+    int rv;
+
+    rv = ipmi_domain_pointer_cb(sweep->domain_id, fru_sweep_done_cb, sweep);
+    if (rv)
+	/* The domain went away, still report the results. */
+	sweep->done(NULL, sweep->status, sweep->count, sweep->cb_data);
+    fru_sweep_free(sweep);
+}
+
+static void fru_sweep_fetched(ipmi_entity_t *ent, int err, void *cb_data);
+
+typedef struct fru_sweep_start_s
+{
+    fru_sweep_ent_t *ent;
+    int             rv;
+} fru_sweep_start_t;
+
+static void
+fru_sweep_start_cb(ipmi_entity_t *ent, void *cb_data)
+{
+    fru_sweep_start_t *info = cb_data;
+
+    info->rv = entity_fetch_frus(ent, NULL, fru_sweep_fetched, info->ent);
+}
+
+/* Start as many fetches as the window allows, going around the MCs.
+   Must be called with the sweep lock held, it releases it. */
+static void
+fru_sweep_issue(fru_sweep_t *sweep)
+{
+    fru_sweep_group_t *group;
+    fru_sweep_ent_t   *ent;
+    fru_sweep_start_t info;
+    unsigned int      tries;
+    int               rv;
+
+    if (sweep->issuing) {
+	/* Whoever is issuing will see the change. */
+	ipmi_unlock(sweep->lock);
+	return;
+    }
+    sweep->issuing = 1;
+
+    while (sweep->outstanding < sweep->window) {
+	group = NULL;
+	for (tries=0; tries<sweep->num_groups; tries++) {
+	    fru_sweep_group_t *g = &sweep->groups[sweep->next_group];
+
+	    sweep->next_group = (sweep->next_group + 1) % sweep->num_groups;
+	    if ((g->next < g->end) && (g->outstanding == 0)) {
+		group = g;
+		break;
+	    }
+	}
+	if (!group)
+	    break;
+
+	ent = &sweep->ents[group->next];
+	group->next++;
+	group->outstanding++;
+	sweep->outstanding++;
+
+	ipmi_unlock(sweep->lock);
+	info.ent = ent;
+	info.rv = 0;
+	rv = ipmi_entity_pointer_cb(sweep->status[ent->idx].entity_id,
+				    fru_sweep_start_cb, &info);
+	if (!rv)
+	    rv = info.rv;
+	ipmi_lock(sweep->lock);
+	if (rv) {
+	    sweep->status[ent->idx].err = rv;
+	    group->outstanding--;
+	    sweep->outstanding--;
+	    sweep->done_count++;
+	}
+    }
+
+    sweep->issuing = 0;
+    if (sweep->done_count == sweep->count) {
+	ipmi_unlock(sweep->lock);
+	fru_sweep_finish(sweep);
+	return;
+    }
+    ipmi_unlock(sweep->lock);
+}
+
+static void
+fru_sweep_fetched(ipmi_entity_t *ent, int err, void *cb_data)
+{
+    fru_sweep_ent_t *sent = cb_data;
+    fru_sweep_t     *sweep = sent->sweep;
+
+    ipmi_lock(sweep->lock);
+    sweep->status[sent->idx].err = err;
+    sweep->groups[sent->group].outstanding--;
+    sweep->outstanding--;
+    sweep->done_count++;
+    fru_sweep_issue(sweep);
+}
+
+static int
+fru_sweep_ent_cmp(const void *a, const void *b)
+{
+    const fru_sweep_ent_t *e1 = a;
+    const fru_sweep_ent_t *e2 = b;
+
+    if (e1->channel != e2->channel)
+	return e1->channel < e2->channel ? -1 : 1;
+    if (e1->address != e2->address)
+	return e1->address < e2->address ? -1 : 1;
+    if (e1->idx != e2->idx)
+	return e1->idx < e2->idx ? -1 : 1;
+    return 0;
+}
+
+static int
+fru_sweep_wanted(ipmi_entity_t *ent)
+{
+    return ent->present && ipmi_entity_get_is_fru(ent);
+}
+
+static void
+fru_sweep_count_ent(ipmi_entity_t *ent, void *cb_data)
+{
+    unsigned int *count = cb_data;
+
+    if (fru_sweep_wanted(ent))
+	(*count)++;
+}
+
+static void
+fru_sweep_add_ent(ipmi_entity_t *ent, void *cb_data)
+{
+    fru_sweep_t     *sweep = cb_data;
+    fru_sweep_ent_t *sent;
+
+    if (!fru_sweep_wanted(ent) || (sweep->num_groups >= sweep->count))
+	return;
+
+    /* num_groups counts the entities until they are grouped. */
+    sent = &sweep->ents[sweep->num_groups];
+    sent->sweep = sweep;
+    sent->idx = sweep->num_groups;
+    sent->channel = ent->info.channel;
+    sent->address = ent->info.access_address;
+    sweep->status[sent->idx].entity_id = ipmi_entity_convert_to_id(ent);
+    sweep->status[sent->idx].err = 0;
+    sweep->num_groups++;
+}
+
+int
+ipmi_domain_fetch_all_frus(ipmi_domain_t               *domain,
+			   unsigned int                max_concurrent,
+			   ipmi_domain_frus_fetched_cb done,
+			   void                        *cb_data)
+{
+    fru_sweep_t       *sweep;
+    fru_sweep_group_t *group = NULL;
+    unsigned int      count = 0;
+    unsigned int      i;
+    int               rv;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (!done)
+	return EINVAL;
+
+    if (! ipmi_option_FRUs(domain))
+	return ENOSYS;
+
+    rv = ipmi_domain_iterate_entities(domain, fru_sweep_count_ent, &count);
+    if (rv)
+	return rv;
+
+    if (count == 0) {
+	done(domain, NULL, 0, cb_data);
+	return 0;
+    }
+
+    sweep = ipmi_mem_alloc(sizeof(*sweep));
+    if (!sweep)
+	return ENOMEM;
+    memset(sweep, 0, sizeof(*sweep));
+
+    rv = ipmi_create_lock(domain, &sweep->lock);
+    if (rv) {
+	sweep->lock = NULL;
+	goto out_err;
+    }
+
+    rv = ENOMEM;
+    sweep->status = ipmi_mem_alloc(sizeof(*sweep->status) * count);
+    sweep->ents = ipmi_mem_alloc(sizeof(*sweep->ents) * count);
+    sweep->groups = ipmi_mem_alloc(sizeof(*sweep->groups) * count);
+    if (!sweep->status || !sweep->ents || !sweep->groups)
+	goto out_err;
+
+    sweep->count = count;
+    rv = ipmi_domain_iterate_entities(domain, fru_sweep_add_ent, sweep);
+    if (rv)
+	goto out_err;
+    /* Nothing is added or removed while iterating, but be safe. */
+    sweep->count = sweep->num_groups;
+    if (sweep->count == 0) {
+	fru_sweep_free(sweep);
+	done(domain, NULL, 0, cb_data);
+	return 0;
+    }
+
+    qsort(sweep->ents, sweep->count, sizeof(*sweep->ents),
+	  fru_sweep_ent_cmp);
+
+    sweep->num_groups = 0;
+    for (i=0; i<sweep->count; i++) {
+	fru_sweep_ent_t *ent = &sweep->ents[i];
+
+	if ((i == 0)
+	    || (ent->channel != sweep->ents[i-1].channel)
+	    || (ent->address != sweep->ents[i-1].address))
+	{
+	    group = &sweep->groups[sweep->num_groups];
+	    group->next = i;
+	    group->outstanding = 0;
+	    sweep->num_groups++;
+	}
+	group->end = i + 1;
+	ent->group = sweep->num_groups - 1;
+    }
+
+    sweep->domain_id = ipmi_domain_convert_to_id(domain);
+    sweep->window = max_concurrent;
+    if (sweep->window == 0)
+	sweep->window = _ipmi_domain_max_outstanding(domain);
+    sweep->done = done;
+    sweep->cb_data = cb_data;
+
+    ipmi_lock(sweep->lock);
+    fru_sweep_issue(sweep);
+    return 0;
+
+ out_err:
+    fru_sweep_free(sweep);
+    return rv;
+}
+
 ipmi_fru_t *
 ipmi_entity_get_fru(ipmi_entity_t *ent)
 {
@@ -6379,26 +7438,6 @@ hot_swap_act_cb(ipmi_entity_t *ent, void *cb_data)
 		 ENTITY_NAME(ent), rv);
 }
 
-static void
-hot_swap_act_timeout(void *cb_data, os_hnd_timer_id_t *timer)
-{
-    ent_timer_info_t *info = cb_data;
-    ipmi_entity_id_t entity_id;
-
-    ipmi_lock(info->lock);
-    if (info->destroyed) {
-	ipmi_unlock(info->lock);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_mem_free(info);
-	return;
-    }
-    info->running = 0;
-    entity_id = ipmi_entity_convert_to_id(info->entity);
-    ipmi_unlock(info->lock);
-
-    ipmi_entity_pointer_cb(entity_id, hot_swap_act_cb, NULL);
-}
-
 static int
 hot_swap_deact(ipmi_entity_t *ent, ipmi_entity_cb handler, void *cb_data)
 {
@@ -6459,26 +7498,6 @@ hot_swap_deact_cb(ipmi_entity_t *ent, void *cb_data)
 		 ENTITY_NAME(ent), rv);
 }
 
-static void
-hot_swap_deact_timeout(void *cb_data, os_hnd_timer_id_t *timer)
-{
-    ent_timer_info_t *info = cb_data;
-    ipmi_entity_id_t entity_id;
-
-    ipmi_lock(info->lock);
-    if (info->destroyed) {
-	ipmi_unlock(info->lock);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_mem_free(info);
-	return;
-    }
-    info->running = 0;
-    entity_id = ipmi_entity_convert_to_id(info->entity);
-    ipmi_unlock(info->lock);
-
-    ipmi_entity_pointer_cb(entity_id, hot_swap_deact_cb, NULL);
-}
-
 /* Must be called with the entity locked.  Note that it may release
    and reclaim the lock as part of its operation. */
 static int
@@ -6501,9 +7520,8 @@ set_hot_swap_state(ipmi_entity_t             *ent,
 
     case IPMI_HOT_SWAP_ACTIVATION_REQUESTED:
 	val = ent->hot_swap_ind_req_act;
-	entity_start_timer(ent->hot_swap_act_info,
-			   ent->hot_swap_act_timeout,
-			   hot_swap_act_timeout);
+	entity_start_timer(&ent->hot_swap_act_info,
+			   ent->hot_swap_act_timeout);
 	break;
 
     case IPMI_HOT_SWAP_ACTIVE:
@@ -6512,9 +7530,8 @@ set_hot_swap_state(ipmi_entity_t             *ent,
 
     case IPMI_HOT_SWAP_DEACTIVATION_REQUESTED:
 	val = ent->hot_swap_ind_req_deact;
-	entity_start_timer(ent->hot_swap_deact_info,
-			   ent->hot_swap_deact_timeout,
-			   hot_swap_deact_timeout);
+	entity_start_timer(&ent->hot_swap_deact_info,
+			   ent->hot_swap_deact_timeout);
 	break;
 
     case IPMI_HOT_SWAP_DEACTIVATION_IN_PROGRESS:
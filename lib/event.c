@@ -41,20 +41,58 @@
 #include <OpenIPMI/internal/ipmi_mc.h>
 #include <OpenIPMI/internal/ipmi_domain.h>
 
+/* Enough data for a SEL record, events with more data are allocated
+   bigger and are not pooled. */
+#define EVENT_DATA_LEN 16
+
+/* The most free events kept for reuse. */
+#define EVENT_POOL_MAX 1024
+
 struct ipmi_event_s
 {
     ipmi_mcid_t   mcid; /* The MC this event is stored in. */
 
-    ipmi_lock_t   *lock;
-    unsigned int  refcount;
+    unsigned int  refcount; /* Atomic */
     unsigned int  record_id;
     unsigned int  type;
     ipmi_time_t   timestamp;
     unsigned int  data_len;
     unsigned char old;
-    unsigned char data[0];
+    ipmi_event_t  *next; /* In the pool */
+    unsigned char data[EVENT_DATA_LEN];
 };
 
+/* Freed events are kept here to avoid an allocation per event in an
+   event storm. */
+static ipmi_lock_t  *event_pool_lock;
+static ipmi_event_t *event_pool;
+static unsigned int event_pool_count;
+
+int
+_ipmi_event_init(void)
+{
+    if (event_pool_lock)
+	return 0;
+    return ipmi_create_global_lock(&event_pool_lock);
+}
+
+void
+_ipmi_event_shutdown(void)
+{
+    ipmi_event_t *event;
+
+    if (!event_pool_lock)
+	return;
+    while (event_pool) {
+	event = event_pool;
+	event_pool = event->next;
+	ipmi_mem_free(event);
+    }
+    event_pool_count = 0;
+    ipmi_destroy_lock(event_pool_lock);
+    event_pool_lock = NULL;
+}
+
 ipmi_event_t *
 ipmi_event_alloc(ipmi_mcid_t   mcid,
 		 unsigned int  record_id,
@@ -63,16 +101,25 @@ ipmi_event_alloc(ipmi_mcid_t   mcid,
 		 unsigned char *data,
 		 unsigned int  data_len)
 {
-    ipmi_event_t *rv;
-
-    rv = ipmi_mem_alloc(sizeof(ipmi_event_t) + data_len);
+    ipmi_event_t *rv = NULL;
+
+    if (data_len <= EVENT_DATA_LEN) {
+	if (event_pool_lock) {
+	    ipmi_lock(event_pool_lock);
+	    rv = event_pool;
+	    if (rv) {
+		event_pool = rv->next;
+		event_pool_count--;
+	    }
+	    ipmi_unlock(event_pool_lock);
+	}
+	if (!rv)
+	    rv = ipmi_mem_alloc(sizeof(ipmi_event_t));
+    } else
+	rv = ipmi_mem_alloc(sizeof(ipmi_event_t) + data_len - EVENT_DATA_LEN);
     if (!rv)
 	return NULL;
 
-    if (ipmi_create_global_lock(&rv->lock)) {
-	ipmi_mem_free(rv);
-	return NULL;
-    }
     rv->mcid = mcid;
     rv->record_id = record_id;
     rv->type = type;
@@ -91,9 +138,7 @@ ipmi_event_dup(ipmi_event_t *event)
 {
     if (!event)
 	return NULL;
-    ipmi_lock(event->lock);
-    event->refcount++;
-    ipmi_unlock(event->lock);
+    __atomic_add_fetch(&event->refcount, 1, __ATOMIC_RELAXED);
     return event;
 }
 
@@ -102,15 +147,21 @@ ipmi_event_free(ipmi_event_t *event)
 {
     if (!event)
 	return;
-    ipmi_lock(event->lock);
-    event->refcount--;
-    if (event->refcount == 0) {
-	ipmi_unlock(event->lock);
-	ipmi_destroy_lock(event->lock);
-	ipmi_mem_free(event);
+    if (__atomic_sub_fetch(&event->refcount, 1, __ATOMIC_ACQ_REL) != 0)
 	return;
+
+    if ((event->data_len <= EVENT_DATA_LEN) && event_pool_lock) {
+	ipmi_lock(event_pool_lock);
+	if (event_pool_count < EVENT_POOL_MAX) {
+	    event->next = event_pool;
+	    event_pool = event;
+	    event_pool_count++;
+	    event = NULL;
+	}
+	ipmi_unlock(event_pool_lock);
     }
-    ipmi_unlock(event->lock);
+    if (event)
+	ipmi_mem_free(event);
 }
 
 ipmi_mcid_t
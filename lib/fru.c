@@ -36,6 +36,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_FRU
+
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -45,24 +47,53 @@
 #include <OpenIPMI/ipmi_fru.h>
 #include <OpenIPMI/ipmi_err.h>
 #include <OpenIPMI/ipmi_msgbits.h>
+#include <OpenIPMI/ipmi_mc.h>
 
 #include <OpenIPMI/internal/locked_list.h>
 #include <OpenIPMI/internal/ipmi_domain.h>
+#include <OpenIPMI/internal/ipmi_mc.h>
 #include <OpenIPMI/internal/ipmi_int.h>
 #include <OpenIPMI/internal/ipmi_utils.h>
 #include <OpenIPMI/internal/ipmi_oem.h>
 #include <OpenIPMI/internal/ipmi_fru.h>
+#include <OpenIPMI/internal/ipmi_checksum.h>
 
 #define MAX_FRU_DATA_FETCH 32
 #define FRU_DATA_FETCH_DECR 8
 #define MIN_FRU_DATA_FETCH 16
 
+/* Reads start at MAX_FRU_DATA_FETCH and grow by FRU_DATA_FETCH_INCR
+   after each full-sized read until they fail or reach the most a
+   response message can carry (the completion code and count take
+   two bytes). */
+#define FRU_DATA_FETCH_INCR 16
+#define FRU_DATA_FETCH_LIMIT ((IPMI_MAX_MSG_LENGTH - 2) & ~(FRU_DATA_FETCH_DECR-1))
+
+/* Maximum number of Read FRU Data requests outstanding at once for a
+   single FRU. */
+#define FRU_DATA_FETCH_PIPELINE 4
+
 #define MAX_FRU_DATA_WRITE 16
 #define MAX_FRU_WRITE_RETRIES 30
 
+/* Maximum number of Write FRU Data requests outstanding at once for a
+   single FRU. */
+#define FRU_DATA_WRITE_PIPELINE 4
+
 #define MAX_FRU_FETCH_RETRIES 5
 
 #define IPMI_FRU_ATTR_NAME "ipmi_fru"
+#define IPMI_FRU_FETCH_ATTR_NAME "ipmi_fru_fetch"
+
+/* FRU data saved in the OS handler database is a format byte, the
+   access_by_words flag, the timestamp from the FRU locking code (if
+   any), then the data. */
+#define FRU_DB_FORMAT 1
+#define FRU_DB_HDR_LEN 6
+
+/* Before using saved data, this much of the FRU header and of the
+   start of each area the header points to is read and compared. */
+#define FRU_DB_SAMPLE_LEN MAX_FRU_DATA_FETCH
 
 /*
  * A note of FRUs, fru attributes, and locking.
@@ -147,11 +178,29 @@ struct ipmi_fru_s
     unsigned char *data;
     unsigned int  data_len;
     unsigned int  curr_pos;
-    unsigned int  curr_write_len;
     int           write_prepared;
     int           saved_err;
 
+    /* Read FRU Data state.  curr_pos is the next offset that has
+       never been requested, fetch_retry holds ranges that must be
+       requested again (after a short read or a read that was too
+       big).  fetch_limit is the largest read not known to fail. */
     int           fetch_size;
+    int           fetch_limit;
+    unsigned int  fetch_window;
+    unsigned int  fetch_outstanding;
+    int           fetch_err;
+    fru_update_t  *fetch_retry;
+
+    /* The copy of the FRU data in the OS handler database.  While
+       fetch_validating is set, only samples of the FRU are being read
+       to check against db_data. */
+    char          db_key[64];
+    int           db_key_set;
+    unsigned char *db_data;
+    unsigned int  db_data_len;
+    int           fetch_validating;
+    int           fetch_from_db;
 
     /* Is this in the list of FRUs? */
     int in_frulist;
@@ -160,9 +209,19 @@ struct ipmi_fru_s
     fru_update_t *update_recs;
     fru_update_t *update_recs_tail;
 
-    /* The last send command for writing */
-    unsigned int  last_cmd_len;
-    unsigned int  retry_count;
+    /* Write FRU Data state.  The update records are sorted and
+       merged before writing starts, then sent in chunks with up to
+       write_window chunks outstanding.  write_curr is the chunk
+       outstanding through an OEM write handler, which only allows
+       one at a time. */
+    unsigned int  write_window;
+    unsigned int  write_outstanding;
+    int           write_err;
+    unsigned int  write_total;
+    unsigned int  write_written;
+    void          *write_curr;
+
+    ipmi_fru_write_progress_cb write_progress;
 
     os_handler_t *os_hnd;
 
@@ -389,68 +448,6 @@ _ipmi_fru_get_setup_data(ipmi_fru_t *fru)
     return fru->setup_data;
 }
 
-static int
-fru_normal_write_done(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
-{
-    ipmi_msg_t      *msg = &rspi->msg;
-    ipmi_fru_t      *fru = rspi->data1;
-    unsigned char   *data = msg->data;
-    _ipmi_fru_op_cb cb = rspi->data2;
-    int             err = 0;
-
-    if (data[0]) {
-	err = IPMI_IPMI_ERR_VAL(data[0]);
-	goto out;
-    }
-
-    if (msg->data_len < 2) {
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "%sfru.c(fru_normal_write_done): "
-		 "FRU write response too small",
-		 FRU_DOMAIN_NAME(fru));
-	err = EINVAL;
-	goto out;
-    }
-
-    if ((unsigned int) (data[1] << fru->access_by_words)
-	!= (fru->last_cmd_len - 3))
-    {
-	/* Write was incomplete for some reason.  Just go on but issue
-	   a warning. */
-	ipmi_log(IPMI_LOG_WARNING,
-		 "%sfru.c(fru_normal_write_done): "
-		 "Incomplete writing FRU data, write %d, expected %d",
-		 FRU_DOMAIN_NAME(fru),
-		 data[1] << fru->access_by_words, fru->last_cmd_len-3);
-    }
-
- out:
-    cb(fru, domain, err);
-    return IPMI_MSG_ITEM_NOT_USED;
-}
-
-static int
-fru_normal_write(ipmi_fru_t      *fru,
-		 ipmi_domain_t   *domain,
-		 unsigned char   *data,
-		 unsigned int    data_len,
-		 _ipmi_fru_op_cb done)
-{
-    ipmi_msg_t msg;
-
-    msg.netfn = IPMI_STORAGE_NETFN;
-    msg.cmd = IPMI_WRITE_FRU_DATA_CMD;
-    msg.data = data;
-    msg.data_len = data_len;
-
-    return ipmi_send_command_addr(domain,
-				  &fru->addr, fru->addr_len,
-				  &msg,
-				  fru_normal_write_done,
-				  fru,
-				  done);
-}
-
 void
 ipmi_fru_set_options(ipmi_fru_t *fru, unsigned int options)
 {
@@ -614,12 +611,159 @@ fru_attr_init(ipmi_domain_t *domain, void *cb_data, void **data)
     return 0;
 }
 
+/*
+ * The read size that worked for a management controller is
+ * remembered in the domain, so later fetches from the same
+ * controller start there instead of probing all over again.
+ */
+typedef struct fru_fetch_size_s fru_fetch_size_t;
+struct fru_fetch_size_s
+{
+    unsigned char    channel;
+    unsigned char    device_address;
+    int              size;
+    int              limit;
+    fru_fetch_size_t *next;
+};
+
+typedef struct fru_fetch_sizes_s
+{
+    ipmi_lock_t      *lock;
+    fru_fetch_size_t *list;
+} fru_fetch_sizes_t;
+
+static void
+fru_fetch_attr_destroy(void *cb_data, void *data)
+{
+    fru_fetch_sizes_t *sizes = data;
+
+    while (sizes->list) {
+	fru_fetch_size_t *to_free = sizes->list;
+	sizes->list = to_free->next;
+	ipmi_mem_free(to_free);
+    }
+    ipmi_destroy_lock(sizes->lock);
+    ipmi_mem_free(sizes);
+}
+
+static int
+fru_fetch_attr_init(ipmi_domain_t *domain, void *cb_data, void **data)
+{
+    fru_fetch_sizes_t *sizes;
+    int               rv;
+
+    sizes = ipmi_mem_alloc(sizeof(*sizes));
+    if (!sizes)
+	return ENOMEM;
+    memset(sizes, 0, sizeof(*sizes));
+
+    rv = ipmi_create_lock(domain, &sizes->lock);
+    if (rv) {
+	ipmi_mem_free(sizes);
+	return rv;
+    }
+
+    *data = sizes;
+    return 0;
+}
+
+static fru_fetch_size_t *
+fru_fetch_size_find(fru_fetch_sizes_t *sizes, ipmi_fru_t *fru)
+{
+    fru_fetch_size_t *e;
+
+    for (e = sizes->list; e; e = e->next) {
+	if ((e->channel == fru->channel)
+	    && (e->device_address == fru->device_address))
+	    break;
+    }
+    return e;
+}
+
+static void
+fru_fetch_size_restore(ipmi_domain_t *domain, ipmi_fru_t *fru)
+{
+    ipmi_domain_attr_t *attr;
+    fru_fetch_sizes_t  *sizes;
+    fru_fetch_size_t   *e;
+
+    fru->fetch_size = MAX_FRU_DATA_FETCH;
+    fru->fetch_limit = FRU_DATA_FETCH_LIMIT;
+
+    if (ipmi_domain_register_attribute(domain, IPMI_FRU_FETCH_ATTR_NAME,
+				       fru_fetch_attr_init,
+				       fru_fetch_attr_destroy,
+				       NULL,
+				       &attr))
+	return;
+    sizes = ipmi_domain_attr_get_data(attr);
+    ipmi_lock(sizes->lock);
+    e = fru_fetch_size_find(sizes, fru);
+    if (e) {
+	fru->fetch_size = e->size;
+	fru->fetch_limit = e->limit;
+    }
+    ipmi_unlock(sizes->lock);
+    ipmi_domain_attr_put(attr);
+}
+
+static void
+fru_fetch_size_save(ipmi_domain_t *domain, ipmi_fru_t *fru)
+{
+    ipmi_domain_attr_t *attr;
+    fru_fetch_sizes_t  *sizes;
+    fru_fetch_size_t   *e;
+
+    if (ipmi_domain_register_attribute(domain, IPMI_FRU_FETCH_ATTR_NAME,
+				       fru_fetch_attr_init,
+				       fru_fetch_attr_destroy,
+				       NULL,
+				       &attr))
+	return;
+    sizes = ipmi_domain_attr_get_data(attr);
+    ipmi_lock(sizes->lock);
+    e = fru_fetch_size_find(sizes, fru);
+    if (!e) {
+	e = ipmi_mem_alloc(sizeof(*e));
+	if (e) {
+	    e->channel = fru->channel;
+	    e->device_address = fru->device_address;
+	    e->next = sizes->list;
+	    sizes->list = e;
+	}
+    }
+    if (e) {
+	e->size = fru->fetch_size;
+	e->limit = fru->fetch_limit;
+    }
+    ipmi_unlock(sizes->lock);
+    ipmi_domain_attr_put(attr);
+}
+
+static void
+fru_fetch_free_retries(ipmi_fru_t *fru)
+{
+    while (fru->fetch_retry) {
+	fru_update_t *to_free = fru->fetch_retry;
+	fru->fetch_retry = to_free->next;
+	ipmi_mem_free(to_free);
+    }
+}
+
 static int
 start_fru_fetch(ipmi_fru_t *fru, ipmi_domain_t *domain)
 {
     int rv;
 
     fru->curr_pos = 0;
+    fru->fetch_outstanding = 0;
+    fru->fetch_err = 0;
+    fru_fetch_free_retries(fru);
+    fru->fetch_validating = 0;
+    fru->fetch_from_db = 0;
+    fru->fetch_window = _ipmi_domain_max_outstanding(domain);
+    if (fru->fetch_window > FRU_DATA_FETCH_PIPELINE)
+	fru->fetch_window = FRU_DATA_FETCH_PIPELINE;
 
     if (fru->is_logical)
 	rv = start_logical_fru_fetch(domain, fru);
@@ -699,9 +843,8 @@ ipmi_fru_alloc_internal(ipmi_domain_t       *domain,
     fru->private_bus = private_bus;
     fru->channel = channel;
     fru->fetch_mask = fetch_mask;
-    fru->fetch_size = MAX_FRU_DATA_FETCH;
+    fru_fetch_size_restore(domain, fru);
     fru->os_hnd = ipmi_domain_get_os_hnd(domain);
-    fru->write_cb = fru_normal_write;
 
     len = sizeof(fru->name);
     p = ipmi_domain_get_name(domain, fru->name, len);
@@ -903,6 +1046,192 @@ ipmi_fru_alloc_notrack(ipmi_domain_t *domain,
  *
  **********************************************************************/
 
+/*
+ * FRU data cache.  FRU data rarely changes and is slow to read, so a
+ * copy is kept in the OS handler database, keyed by the GUID of the
+ * MC holding the FRU (or the domain name if there is none) and the
+ * FRU device.  Before the copy is used, the FRU header and the start
+ * of each area are read from the FRU and compared with it.
+ */
+static void
+fru_db_key(ipmi_domain_t *domain, ipmi_fru_t *fru)
+{
+    os_handler_t  *os_hnd = fru->os_hnd;
+    ipmi_mc_t     *mc;
+    unsigned char guid[16];
+    char          *s = fru->db_key;
+    int           i;
+
+    fru->db_key_set = 0;
+    if (!ipmi_option_use_cache(domain) || !os_hnd->database_find)
+	return;
+
+    s += sprintf(s, "fru-");
+    mc = _ipmi_find_mc_by_addr(domain, &fru->addr, fru->addr_len);
+    if (mc && (ipmi_mc_get_guid(mc, guid) == 0)) {
+	for (i=0; i<16; i++)
+	    s += sprintf(s, "%2.2x", guid[i]);
+    } else {
+	ipmi_domain_get_name(domain, s, IPMI_DOMAIN_NAME_LEN);
+	s += strlen(s);
+	s += sprintf(s, "-%x", fru->device_address);
+    }
+    if (mc)
+	_ipmi_mc_put(mc);
+    sprintf(s, "-%d.%d.%d.%d", fru->device_id, fru->lun, fru->private_bus,
+	    fru->channel);
+    fru->db_key_set = 1;
+}
+
+static void
+fru_db_release(ipmi_fru_t *fru)
+{
+    if (fru->db_data)
+	fru->os_hnd->database_free(fru->os_hnd, fru->db_data);
+    fru->db_data = NULL;
+    fru->db_data_len = 0;
+}
+
+/* Look up the saved copy of the FRU, keeping it only if it could
+   still match what the inventory area info says about the FRU. */
+static void
+fru_db_load(ipmi_fru_t *fru)
+{
+    os_handler_t  *os_hnd = fru->os_hnd;
+    unsigned char *data;
+    unsigned int  data_len;
+    unsigned int  fetched = 0;
+
+    fru_db_release(fru);
+    if (!fru->db_key_set)
+	return;
+
+    /* The FRU read starts right after this, it can't wait. */
+    if (os_hnd->database_find(os_hnd, fru->db_key, &fetched, &data,
+			      &data_len, NULL, NULL))
+	return;
+    if (!fetched)
+	return;
+
+    if ((data_len != FRU_DB_HDR_LEN + fru->data_len)
+	|| (data[0] != FRU_DB_FORMAT)
+	|| (data[1] != fru->access_by_words)
+	|| (fru->timestamp_cb
+	    && (ipmi_get_uint32(data+2) != fru->last_timestamp)))
+	goto out_free;
+
+    /* The header must be sane, it tells where to sample. */
+    if (ipmi_checksum(data + FRU_DB_HDR_LEN, 8, 0) != 0)
+	goto out_free;
+
+    fru->db_data = data;
+    fru->db_data_len = data_len;
+    return;
+
+ out_free:
+    os_hnd->database_free(os_hnd, data);
+}
+
+/* Get the idx'th range to compare against the saved copy, returns 0
+   if there is no such range. */
+static int
+fru_db_sample(ipmi_fru_t *fru, int idx, unsigned int *offset,
+	      unsigned int *length)
+{
+    unsigned int off;
+
+    if (idx == 0) {
+	*offset = 0;
+	*length = 8;
+	return 1;
+    }
+
+    off = fru->db_data[FRU_DB_HDR_LEN + idx] * 8;
+    if ((off == 0) || (off >= fru->data_len))
+	return 0;
+    *offset = off;
+    *length = fru->data_len - off;
+    if (*length > FRU_DB_SAMPLE_LEN)
+	*length = FRU_DB_SAMPLE_LEN;
+    return 1;
+}
+
+/* Queue the reads of the sample ranges in place of reading the whole
+   FRU.  Returns an error if the whole FRU must be read instead. */
+static int
+fru_db_start_validate(ipmi_fru_t *fru)
+{
+    fru_update_t *req;
+    unsigned int offset, length;
+    int          i;
+
+    /* Areas are the internal use, chassis, board, product and
+       multi-record offsets in header bytes 1-5. */
+    for (i=5; i>=0; i--) {
+	if (!fru_db_sample(fru, i, &offset, &length))
+	    continue;
+	req = ipmi_mem_alloc(sizeof(*req));
+	if (!req) {
+	    fru_fetch_free_retries(fru);
+	    return ENOMEM;
+	}
+	req->offset = offset;
+	req->length = length;
+	req->next = fru->fetch_retry;
+	fru->fetch_retry = req;
+    }
+
+    fru->fetch_validating = 1;
+    fru->curr_pos = fru->data_len;
+    return 0;
+}
+
+/* Compare the samples read with the saved copy, and use the saved
+   copy if they match. */
+static int
+fru_db_validated(ipmi_fru_t *fru)
+{
+    unsigned char *saved = fru->db_data + FRU_DB_HDR_LEN;
+    unsigned int  offset, length;
+    int           i;
+
+    if (fru->db_data_len != FRU_DB_HDR_LEN + fru->data_len)
+	/* The FRU was truncated while reading. */
+	return 0;
+
+    for (i=0; i<6; i++) {
+	if (!fru_db_sample(fru, i, &offset, &length))
+	    continue;
+	if (memcmp(fru->data + offset, saved + offset, length) != 0)
+	    return 0;
+    }
+
+    memcpy(fru->data, saved, fru->data_len);
+    fru->fetch_from_db = 1;
+    return 1;
+}
+
+static void
+fru_db_store(ipmi_fru_t *fru)
+{
+    os_handler_t  *os_hnd = fru->os_hnd;
+    unsigned char *data;
+
+    if (!fru->db_key_set || fru->fetch_from_db || !os_hnd->database_store)
+	return;
+
+    data = ipmi_mem_alloc(FRU_DB_HDR_LEN + fru->data_len);
+    if (!data)
+	return;
+    data[0] = FRU_DB_FORMAT;
+    data[1] = fru->access_by_words;
+    ipmi_set_uint32(data+2, fru->last_timestamp);
+    memcpy(data + FRU_DB_HDR_LEN, fru->data, fru->data_len);
+    os_hnd->database_store(os_hnd, fru->db_key, data,
+			   FRU_DB_HDR_LEN + fru->data_len);
+    ipmi_mem_free(data);
+}
+
 static void
 fetch_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err)
 {
@@ -918,9 +1247,16 @@ fetch_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err)
 	_ipmi_fru_lock(fru);
     }
 
-    if (fru->data)
+    if (fru->data) {
+	if (!err)
+	    fru_db_store(fru);
+	fru_fetch_size_save(domain, fru);
 	ipmi_mem_free(fru->data);
+    }
     fru->data = NULL;
+    fru_fetch_free_retries(fru);
+    fru_db_release(fru);
+    fru->fetch_validating = 0;
     fru->in_use = 0;
     _ipmi_fru_unlock(fru);
 
@@ -976,6 +1312,88 @@ end_fru_fetch(ipmi_fru_t    *fru,
     return;
 }
 
+/*
+ * Called with the FRU lock held whenever a read finishes.  If nothing
+ * is outstanding and nothing is left to request (or the fetch has
+ * failed), finish the fetch.  Returns 1 if the fetch was finished, in
+ * which case the lock has been released.
+ */
+static int
+fru_fetch_check_done(ipmi_domain_t *domain, ipmi_fru_t *fru)
+{
+    int err;
+
+    if (fru->fetch_outstanding)
+	return 0;
+
+    if (fru->fetch_err) {
+	fetch_complete(domain, fru, fru->fetch_err);
+	return 1;
+    }
+
+    /* Throw away retries that fell off the end after a truncation. */
+    while (fru->fetch_retry
+	   && (fru->fetch_retry->offset >= fru->data_len))
+    {
+	fru_update_t *to_free = fru->fetch_retry;
+	fru->fetch_retry = to_free->next;
+	ipmi_mem_free(to_free);
+    }
+    if (fru->fetch_retry || (fru->curr_pos < fru->data_len))
+	return 0;
+
+    if (fru->fetch_validating) {
+	fru->fetch_validating = 0;
+	if (!fru_db_validated(fru)) {
+	    /* It changed, read the whole thing. */
+	    fru->curr_pos = 0;
+	    err = request_next_data(domain, fru, &fru->addr, fru->addr_len);
+	    if (err) {
+		fru->fetch_err = err;
+		if (!fru->fetch_outstanding) {
+		    fetch_complete(domain, fru, err);
+		    return 1;
+		}
+	    }
+	    return 0;
+	}
+    }
+
+    if (fru->timestamp_cb) {
+	err = fru->timestamp_cb(fru, domain, end_fru_fetch);
+	if (err) {
+	    fetch_complete(domain, fru, err);
+	    return 1;
+	}
+	return 0;
+    }
+
+    fetch_complete(domain, fru, 0);
+    return 1;
+}
+
+/* A read of the given length was too big, never try it again. */
+static void
+fru_fetch_shrink(ipmi_fru_t *fru, int length)
+{
+    int limit = length - FRU_DATA_FETCH_DECR;
+
+    if (limit < MIN_FRU_DATA_FETCH)
+	limit = MIN_FRU_DATA_FETCH;
+    if (fru->fetch_limit > limit)
+	fru->fetch_limit = limit;
+    if (fru->fetch_size > fru->fetch_limit)
+	fru->fetch_size = fru->fetch_limit;
+}
+
+/* Put a range at the front of the retry list; req is taken over. */
+static void
+fru_fetch_requeue(ipmi_fru_t *fru, fru_update_t *req)
+{
+    req->next = fru->fetch_retry;
+    fru->fetch_retry = req;
+}
+
 static int
 fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 {
@@ -983,17 +1401,27 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
     unsigned int  addr_len = rspi->addr_len;
     ipmi_msg_t    *msg = &rspi->msg;
     ipmi_fru_t    *fru = rspi->data1;
+    fru_update_t  *req = rspi->data2;
     unsigned char *data = msg->data;
     int           count;
     int           err;
 
     _ipmi_fru_lock(fru);
 
+    fru->fetch_outstanding--;
+
     if (fru->deleted) {
-	fetch_complete(domain, fru, ECANCELED);
-	goto out;
+	fru->fetch_err = ECANCELED;
+	goto out_done;
     }
 
+    /* Something else failed or the data was truncated, we are just
+       waiting for the outstanding reads to drain. */
+    if (fru->fetch_err)
+	goto out_done;
+    if (req->offset >= fru->data_len)
+	goto out_next;
+
     /* The timeout and unknown errors should not be necessary, but
        some broken systems just don't return anything if the response
        is too big. */
@@ -1002,49 +1430,37 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 	 || (data[0] == IPMI_REQUEST_DATA_LENGTH_INVALID_CC)
 	 || (data[0] == IPMI_TIMEOUT_CC)
 	 || (data[0] == IPMI_UNKNOWN_ERR_CC))
-	&& (fru->fetch_size > MIN_FRU_DATA_FETCH))
+	&& (req->length > MIN_FRU_DATA_FETCH))
     {
 	/* System couldn't support the given size, try decreasing and
-	   starting again. */
-	fru->fetch_size -= FRU_DATA_FETCH_DECR;
-	err = request_next_data(domain, fru, addr, addr_len);
-	if (err) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "%sfru.c(fru_data_handler): "
-		     "Error requesting next FRU data (2)",
-		     FRU_DOMAIN_NAME(fru));
-	    fetch_complete(domain, fru, err);
-	    goto out;
-	}
-	goto out_unlock;
+	   starting again.  Systems that are that broken probably
+	   don't like pipelining, either. */
+	fru_fetch_shrink(fru, req->length);
+	if ((data[0] == IPMI_TIMEOUT_CC) || (data[0] == IPMI_UNKNOWN_ERR_CC))
+	    fru->fetch_window = 1;
+	fru_fetch_requeue(fru, req);
+	req = NULL;
+	goto out_next;
     }
 
     if (data[0] != 0) {
-	if (fru->curr_pos >= 8) {
+	if (req->offset >= 8) {
 	    /* Some screwy cards give more size in the info than they
 	       really have, if we have enough, try to process it. */
 	    ipmi_log(IPMI_LOG_WARNING,
 		     "%sfru.c(fru_data_handler): "
 		     "IPMI error getting FRU data: %x",
 		     FRU_DOMAIN_NAME(fru), data[0]);
-	    fru->data_len = fru->curr_pos;
-	    if (fru->timestamp_cb) {
-		err = fru->timestamp_cb(fru, domain, end_fru_fetch);
-		if (err)
-		    fetch_complete(domain, fru, err);
-		else
-		    goto out_unlock;
-	    } else {
-		fetch_complete(domain, fru, 0);
-	    }
+	    fru->data_len = req->offset;
+	    goto out_next;
 	} else {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "%sfru.c(fru_data_handler): "
 		     "IPMI error getting FRU data: %x",
 		     FRU_DOMAIN_NAME(fru), data[0]);
-	    fetch_complete(domain, fru, IPMI_IPMI_ERR_VAL(data[0]));
+	    fru->fetch_err = IPMI_IPMI_ERR_VAL(data[0]);
 	}
-	goto out;
+	goto out_done;
     }
 
     if (msg->data_len < 2) {
@@ -1052,8 +1468,8 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 		 "%sfru.c(fru_data_handler): "
 		 "FRU data response too small",
 		 FRU_DOMAIN_NAME(fru));
-	fetch_complete(domain, fru, EINVAL);
-	goto out;
+	fru->fetch_err = EINVAL;
+	goto out_done;
     }
 
     count = data[1] << fru->access_by_words;
@@ -1063,8 +1479,8 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 		 "%sfru.c(fru_data_handler): "
 		 "FRU got zero-sized data, must make progress!",
 		 FRU_DOMAIN_NAME(fru));
-	fetch_complete(domain, fru, EINVAL);
-	goto out;
+	fru->fetch_err = EINVAL;
+	goto out_done;
     }
 
     if (count > msg->data_len-2) {
@@ -1072,43 +1488,54 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 		 "%sfru.c(fru_data_handler): "
 		 "FRU data count mismatch",
 		 FRU_DOMAIN_NAME(fru));
-	fetch_complete(domain, fru, EINVAL);
-	goto out;
+	fru->fetch_err = EINVAL;
+	goto out_done;
     }
 
-    memcpy(fru->data+fru->curr_pos, data+2, count);
-    fru->curr_pos += count;
+    /* Never take more than was asked for, the rest of the buffer
+       may belong to another outstanding read. */
+    if (count > req->length)
+	count = req->length;
+
+    memcpy(fru->data+req->offset, data+2, count);
+
+    if (count < req->length) {
+	/* Short read, get the rest later. */
+	req->offset += count;
+	req->length -= count;
+	fru_fetch_requeue(fru, req);
+	req = NULL;
+    } else if ((count == fru->fetch_size)
+	       && (fru->fetch_size < fru->fetch_limit))
+    {
+	/* A full-sized read worked, try a bigger one. */
+	fru->fetch_size += FRU_DATA_FETCH_INCR;
+	if (fru->fetch_size > fru->fetch_limit)
+	    fru->fetch_size = fru->fetch_limit;
+    }
 
-    if (fru->curr_pos < fru->data_len) {
-	/* More to fetch. */
-	err = request_next_data(domain, fru, addr, addr_len);
-	if (err) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "%sfru.c(fru_data_handler): "
-		     "Error requesting next FRU data",
-		     FRU_DOMAIN_NAME(fru));
-	    fetch_complete(domain, fru, err);
-	    goto out;
-	}
-    } else {
-	if (fru->timestamp_cb) {
-	    err = fru->timestamp_cb(fru, domain, end_fru_fetch);
-	    if (err) {
-		fetch_complete(domain, fru, err);
-		goto out;
-	    }
-	} else {
-	    fetch_complete(domain, fru, 0);
-	    goto out;
-	}
+ out_next:
+    err = request_next_data(domain, fru, addr, addr_len);
+    if (err) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%sfru.c(fru_data_handler): "
+		 "Error requesting next FRU data",
+		 FRU_DOMAIN_NAME(fru));
+	fru->fetch_err = err;
     }
 
- out_unlock:
-    _ipmi_fru_unlock(fru);
- out:
+ out_done:
+    if (req)
+	ipmi_mem_free(req);
+    if (!fru_fetch_check_done(domain, fru))
+	_ipmi_fru_unlock(fru);
     return IPMI_MSG_ITEM_NOT_USED;
 }
 
+/*
+ * Keep up to fetch_window Read FRU Data requests outstanding, taking
+ * ranges that must be retried first.
+ */
 static int
 request_next_data(ipmi_domain_t *domain,
 		  ipmi_fru_t    *fru,
@@ -1117,28 +1544,74 @@ request_next_data(ipmi_domain_t *domain,
 {
     unsigned char cmd_data[4];
     ipmi_msg_t    msg;
+    unsigned int  offset;
     int           to_read;
+    fru_update_t  *req;
+    int           rv;
+
+    while (fru->fetch_outstanding < fru->fetch_window) {
+	/* We only request as much as we have to.  Don't always
+	   reqeust the maximum amount, some machines don't like
+	   this. */
+	if (fru->fetch_retry) {
+	    fru_update_t *retry = fru->fetch_retry;
+
+	    if (retry->offset >= fru->data_len) {
+		fru->fetch_retry = retry->next;
+		ipmi_mem_free(retry);
+		continue;
+	    }
+	    offset = retry->offset;
+	    to_read = retry->length;
+	    if (to_read > fru->data_len - offset)
+		to_read = fru->data_len - offset;
+	    if (to_read > fru->fetch_size)
+		to_read = fru->fetch_size;
+	    if (to_read < retry->length) {
+		retry->offset += to_read;
+		retry->length -= to_read;
+	    } else {
+		fru->fetch_retry = retry->next;
+		ipmi_mem_free(retry);
+	    }
+	} else if (fru->curr_pos < fru->data_len) {
+	    offset = fru->curr_pos;
+	    to_read = fru->data_len - offset;
+	    if (to_read > fru->fetch_size)
+		to_read = fru->fetch_size;
+	    fru->curr_pos += to_read;
+	} else
+	    break;
+
+	req = ipmi_mem_alloc(sizeof(*req));
+	if (!req)
+	    return ENOMEM;
+	req->offset = offset;
+	req->length = to_read;
+	req->next = NULL;
+
+	cmd_data[0] = fru->device_id;
+	ipmi_set_uint16(cmd_data+1, offset >> fru->access_by_words);
+	cmd_data[3] = to_read >> fru->access_by_words;
+	msg.netfn = IPMI_STORAGE_NETFN;
+	msg.cmd = IPMI_READ_FRU_DATA_CMD;
+	msg.data = cmd_data;
+	msg.data_len = 4;
+
+	rv = ipmi_send_command_addr(domain,
+				    addr, addr_len,
+				    &msg,
+				    fru_data_handler,
+				    fru,
+				    req);
+	if (rv) {
+	    ipmi_mem_free(req);
+	    return rv;
+	}
+	fru->fetch_outstanding++;
+    }
 
-    /* We only request as much as we have to.  Don't always reqeust
-       the maximum amount, some machines don't like this. */
-    to_read = fru->data_len - fru->curr_pos;
-    if (to_read > fru->fetch_size)
-	to_read = fru->fetch_size;
-
-    cmd_data[0] = fru->device_id;
-    ipmi_set_uint16(cmd_data+1, fru->curr_pos >> fru->access_by_words);
-    cmd_data[3] = to_read >> fru->access_by_words;
-    msg.netfn = IPMI_STORAGE_NETFN;
-    msg.cmd = IPMI_READ_FRU_DATA_CMD;
-    msg.data = cmd_data;
-    msg.data_len = 4;
-
-    return ipmi_send_command_addr(domain,
-				  addr, addr_len,
-				  &msg,
-				  fru_data_handler,
-				  fru,
-				  NULL);
+    return 0;
 }
 
 static int
@@ -1198,14 +1671,21 @@ fru_inventory_area_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 	goto out;
     }
 
+    /* If there is a saved copy, only read enough to check it. */
+    fru_db_load(fru);
+    if (fru->db_data && fru_db_start_validate(fru))
+	fru_db_release(fru);
+
     err = request_next_data(domain, fru, addr, addr_len);
     if (err) {
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "%sfru.c(fru_inventory_area_handler): "
 		 "Error requesting next FRU data",
 		 FRU_DOMAIN_NAME(fru));
-	fetch_complete(domain, fru, err);
-	goto out;
+	/* Let any reads that did go out finish first. */
+	fru->fetch_err = err;
+	if (fru_fetch_check_done(domain, fru))
+	    goto out;
     }
 
     _ipmi_fru_unlock(fru);
@@ -1219,6 +1699,8 @@ start_logical_fru_fetch(ipmi_domain_t *domain, ipmi_fru_t *fru)
     unsigned char    cmd_data[1];
     ipmi_msg_t       msg;
 
+    fru_db_key(domain, fru);
+
     cmd_data[0] = fru->device_id;
     msg.netfn = IPMI_STORAGE_NETFN;
     msg.cmd = IPMI_GET_FRU_INVENTORY_AREA_INFO_CMD;
@@ -1322,6 +1804,13 @@ write_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err)
 	if (fru->ops.write_complete)
 	    fru->ops.write_complete(fru);
     }
+    /* Anything not written after an error is thrown away, the next
+       write will encode it again. */
+    while (fru->update_recs) {
+	fru_update_t *to_free = fru->update_recs;
+	fru->update_recs = to_free->next;
+	ipmi_mem_free(to_free);
+    }
     if (fru->data)
 	ipmi_mem_free(fru->data);
     fru->data = NULL;
@@ -1335,92 +1824,249 @@ write_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err)
     fru_put(fru);
 }
 
+/* Sort the update records by offset and merge the ones that overlap
+   or touch, so each range is written once in as few requests as
+   possible.  Ranges that are apart are not merged, the bytes between
+   them may not be in the encoded data. */
 static void
-fru_write_handler(ipmi_fru_t    *fru,
-		  ipmi_domain_t *domain,
-		  int           err)
+fru_coalesce_update_records(ipmi_fru_t *fru)
 {
-    int rv;
+    fru_update_t *sorted = NULL;
+    fru_update_t *urec, **p;
+
+    while (fru->update_recs) {
+	urec = fru->update_recs;
+	fru->update_recs = urec->next;
+	for (p = &sorted; *p && ((*p)->offset <= urec->offset); p = &(*p)->next)
+	    ;
+	urec->next = *p;
+	*p = urec;
+    }
+
+    fru->update_recs = sorted;
+    fru->update_recs_tail = NULL;
+    fru->write_total = 0;
+    urec = sorted;
+    while (urec) {
+	fru_update_t *next = urec->next;
+
+	if (next && (next->offset <= urec->offset + urec->length)) {
+	    unsigned int end = next->offset + next->length;
+
+	    if (end > (unsigned int) urec->offset + urec->length)
+		urec->length = end - urec->offset;
+	    urec->next = next->next;
+	    ipmi_mem_free(next);
+	    continue;
+	}
+	fru->write_total += urec->length;
+	fru->update_recs_tail = urec;
+	urec = next;
+    }
+}
+
+/* One outstanding Write FRU Data request. */
+typedef struct fru_write_req_s
+{
+    unsigned int  offset;
+    unsigned int  length;
+    unsigned int  retry_count;
+    unsigned int  data_len;
+    unsigned char data[MAX_FRU_DATA_WRITE+3];
+} fru_write_req_t;
+
+static void fru_write_req_done(ipmi_domain_t   *domain,
+			       ipmi_fru_t      *fru,
+			       fru_write_req_t *req,
+			       int             err);
+
+static int
+fru_write_req_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
+{
+    ipmi_msg_t      *msg = &rspi->msg;
+    ipmi_fru_t      *fru = rspi->data1;
+    fru_write_req_t *req = rspi->data2;
+    unsigned char   *data = msg->data;
+    int             err = 0;
 
     _ipmi_fru_lock(fru);
 
-    /* Note that for safety, we do not stop a fru write on deletion. */
+    if (data[0]) {
+	err = IPMI_IPMI_ERR_VAL(data[0]);
+	goto out;
+    }
 
-    if (err == IPMI_IPMI_ERR_VAL(0x81)) {
-	/* Got a busy response.  Try again if we haven't run out of
-	   retries. */
-	if (fru->retry_count >= MAX_FRU_WRITE_RETRIES) {
-	    write_complete(domain, fru, err);
-	    goto out;
-	}
-	fru->retry_count++;
-	goto retry_write;
-    } else if (err) {
+    if (msg->data_len < 2) {
 	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "%sfru.c(fru_write_handler): "
-		 "IPMI error writing FRU data: %x",
-		 FRU_DOMAIN_NAME(fru), err);
-	write_complete(domain, fru, err);
+		 "%sfru.c(fru_write_req_handler): "
+		 "FRU write response too small",
+		 FRU_DOMAIN_NAME(fru));
+	err = EINVAL;
 	goto out;
     }
 
-    fru->update_recs->length -= fru->curr_write_len;
-    if (fru->update_recs->length > 0) {
-	fru->update_recs->offset += fru->curr_write_len;
-    } else {
-	fru_update_t *to_free = fru->update_recs;
-	fru->update_recs = to_free->next;
-	ipmi_mem_free(to_free);
+    if ((unsigned int) (data[1] << fru->access_by_words) != req->length) {
+	/* Write was incomplete for some reason.  Just go on but issue
+	   a warning. */
+	ipmi_log(IPMI_LOG_WARNING,
+		 "%sfru.c(fru_write_req_handler): "
+		 "Incomplete writing FRU data, write %d, expected %d",
+		 FRU_DOMAIN_NAME(fru),
+		 data[1] << fru->access_by_words, req->length);
     }
 
- retry_write:
-    if (fru->update_recs) {
-	/* More to do. */
-	rv = next_fru_write(domain, fru);
-	if (rv) {
-	    write_complete(domain, fru, rv);
-	    goto out;
-	}
-    } else {
-	write_complete(domain, fru, 0);
-	goto out;
+ out:
+    fru_write_req_done(domain, fru, req, err);
+    return IPMI_MSG_ITEM_NOT_USED;
+}
+
+/* Completion of a write through an OEM write handler. */
+static void
+fru_write_handler(ipmi_fru_t    *fru,
+		  ipmi_domain_t *domain,
+		  int           err)
+{
+    fru_write_req_t *req;
+
+    _ipmi_fru_lock(fru);
+    req = fru->write_curr;
+    fru->write_curr = NULL;
+    fru_write_req_done(domain, fru, req, err);
+}
+
+static int
+fru_write_send(ipmi_domain_t *domain, ipmi_fru_t *fru, fru_write_req_t *req)
+{
+    ipmi_msg_t msg;
+
+    if (fru->write_cb) {
+	fru->write_curr = req;
+	return fru->write_cb(fru, domain, req->data, req->data_len,
+			     fru_write_handler);
     }
 
-    _ipmi_fru_unlock(fru);
- out:
-    return;
+    msg.netfn = IPMI_STORAGE_NETFN;
+    msg.cmd = IPMI_WRITE_FRU_DATA_CMD;
+    msg.data = req->data;
+    msg.data_len = req->data_len;
+
+    return ipmi_send_command_addr(domain,
+				  &fru->addr, fru->addr_len,
+				  &msg,
+				  fru_write_req_handler,
+				  fru,
+				  req);
 }
 
+/* Send the next chunks of the update records, keeping up to
+   write_window of them outstanding. */
 static int
 next_fru_write(ipmi_domain_t *domain, ipmi_fru_t *fru)
 {
-    unsigned char data[MAX_FRU_DATA_WRITE+4];
-    int           offset, length = 0, left, noff, tlen;
+    fru_update_t    *urec;
+    fru_write_req_t *req;
+    unsigned int    length;
+    int             rv;
 
-    noff = fru->update_recs->offset;
-    offset = noff;
-    left = MAX_FRU_DATA_WRITE;
     while (fru->update_recs
-	   && (left > 0)
-	   && (noff == fru->update_recs->offset))
+	   && (fru->write_outstanding < fru->write_window))
+    {
+	urec = fru->update_recs;
+	length = urec->length;
+	if (length > MAX_FRU_DATA_WRITE)
+	    length = MAX_FRU_DATA_WRITE;
+
+	req = ipmi_mem_alloc(sizeof(*req));
+	if (!req)
+	    return ENOMEM;
+	req->offset = urec->offset;
+	req->length = length;
+	req->retry_count = 0;
+	req->data[0] = fru->device_id;
+	ipmi_set_uint16(req->data+1, req->offset >> fru->access_by_words);
+	memcpy(req->data+3, fru->data+req->offset, length);
+	req->data_len = length + 3;
+
+	urec->length -= length;
+	if (urec->length > 0) {
+	    urec->offset += length;
+	} else {
+	    fru->update_recs = urec->next;
+	    ipmi_mem_free(urec);
+	}
+
+	rv = fru_write_send(domain, fru, req);
+	if (rv) {
+	    ipmi_mem_free(req);
+	    return rv;
+	}
+	fru->write_outstanding++;
+    }
+
+    return 0;
+}
+
+/* Called with the FRU lock held, releases it. */
+static void
+fru_write_req_done(ipmi_domain_t   *domain,
+		   ipmi_fru_t      *fru,
+		   fru_write_req_t *req,
+		   int             err)
+{
+    ipmi_fru_write_progress_cb progress;
+    unsigned int               written, total;
+    int                        rv;
+
+    /* Note that for safety, we do not stop a fru write on deletion. */
+
+    fru->write_outstanding--;
+
+    if ((err == IPMI_IPMI_ERR_VAL(0x81))
+	&& (req->retry_count < MAX_FRU_WRITE_RETRIES))
     {
-	if (left < fru->update_recs->length)
-	    tlen = left;
-	else
-	    tlen = fru->update_recs->length;
+	/* Got a busy response.  Try again if we haven't run out of
+	   retries. */
+	req->retry_count++;
+	err = fru_write_send(domain, fru, req);
+	if (!err) {
+	    fru->write_outstanding++;
+	    _ipmi_fru_unlock(fru);
+	    return;
+	}
+    }
+
+    if (err) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%sfru.c(fru_write_req_done): "
+		 "IPMI error writing FRU data: %x",
+		 FRU_DOMAIN_NAME(fru), err);
+	if (!fru->write_err)
+	    fru->write_err = err;
+    } else {
+	fru->write_written += req->length;
+    }
+    ipmi_mem_free(req);
+
+    if (!fru->write_err) {
+	rv = next_fru_write(domain, fru);
+	if (rv)
+	    fru->write_err = rv;
+    }
 
-	noff += tlen;
-	length += tlen;
-	left -= tlen;
-	fru->curr_write_len = tlen;
+    if ((fru->write_outstanding == 0)
+	&& (fru->write_err || !fru->update_recs))
+    {
+	write_complete(domain, fru, fru->write_err);
+	return;
     }
 
-    fru->retry_count = 0;
-    data[0] = fru->device_id;
-    ipmi_set_uint16(data+1, offset >> fru->access_by_words);
-    memcpy(data+3, fru->data+offset, length);
-    fru->last_cmd_len = length + 3;
-    return fru->write_cb(fru, domain, data, length+3, fru_write_handler);
+    progress = fru->write_progress;
+    written = fru->write_written;
+    total = fru->write_total;
+    _ipmi_fru_unlock(fru);
+
+    if (progress && !err)
+	progress(domain, fru, written, total, fru->fetched_cb_data);
 }
 
 static void
@@ -1530,6 +2176,20 @@ start_domain_fru_write(ipmi_domain_t *domain, void *cb_data)
 	return;
     }
 
+    fru_coalesce_update_records(fru);
+    fru->write_written = 0;
+    fru->write_outstanding = 0;
+    fru->write_err = 0;
+    fru->write_curr = NULL;
+    if (fru->write_cb)
+	/* OEM write handlers don't say which write finished. */
+	fru->write_window = 1;
+    else {
+	fru->write_window = _ipmi_domain_max_outstanding(domain);
+	if (fru->write_window > FRU_DATA_WRITE_PIPELINE)
+	    fru->write_window = FRU_DATA_WRITE_PIPELINE;
+    }
+
     fru_get(fru);
     fru->write_prepared = 0;
 
@@ -1557,6 +2217,15 @@ start_domain_fru_write(ipmi_domain_t *domain, void *cb_data)
 
 int
 ipmi_fru_write(ipmi_fru_t *fru, ipmi_fru_cb done, void *cb_data)
+{
+    return ipmi_fru_write_progress(fru, NULL, done, cb_data);
+}
+
+int
+ipmi_fru_write_progress(ipmi_fru_t                 *fru,
+			ipmi_fru_write_progress_cb progress,
+			ipmi_fru_cb                done,
+			void                       *cb_data)
 {
     int                      rv;
     start_domain_fru_write_t info = {fru, 0};
@@ -1575,6 +2244,7 @@ ipmi_fru_write(ipmi_fru_t *fru, ipmi_fru_cb done, void *cb_data)
     fru->in_use = 1;
 
     fru->domain_fetched_handler = done;
+    fru->write_progress = progress;
     fru->fetched_cb_data = cb_data;
 
     /* Data is fully encoded and the update records are in place.
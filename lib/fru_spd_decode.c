@@ -35,6 +35,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_FRU
+
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -53,6 +55,7 @@
  * From PC SDRAM Serial Presence Detect (SPD) Specification
  * Revision 1.2A December, 1997 and
  *  http://www.simmtester.com/page/news/showpubnews.asp?num=101
+ * and the JEDEC DDR4 (Annex L) and DDR5 SPD layouts.
  */
 /* Used to decode byte 2, Memory Type, of SPD data */
 static const struct valstr spd_memtype_vals[] = 
@@ -60,6 +63,10 @@ static const struct valstr spd_memtype_vals[] =
     {0x02, "EDO"},
     {0x04, "SDRAM"},
     {0x07, "DDR"},
+    {0x08, "DDR2"},
+    {0x0b, "DDR3"},
+    {0x0c, "DDR4"},
+    {0x12, "DDR5"},
     {0x00, NULL},
 };
 
@@ -83,17 +90,194 @@ static const struct valstr spd_voltage_vals[] =
     {0x00, NULL},
 };
 
-typedef struct _SPDInfo
+static const struct valstr *jedec_banks[] =
+{
+    jedec_id1_vals, jedec_id2_vals, jedec_id3_vals,
+    jedec_id4_vals, jedec_id5_vals, jedec_id6_vals
+};
+#define NUM_JEDEC_BANKS (sizeof(jedec_banks) / sizeof(jedec_banks[0]))
+
+/*
+ * Where things are in each SPD layout.  Fields are decoded from the
+ * raw data only when they are asked for.
+ */
+typedef struct spd_layout_s
+{
+    unsigned char memtype;	/* Byte 2, 0 for the old 128 byte layout. */
+    unsigned int  min_len;	/* Must have at least this much data. */
+
+    /* Manufacturer id.  The old layout has a list of continuation
+       codes, the newer ones have a count and the code. */
+    unsigned int  mfr_off;
+    int           mfr_count;
+
+    unsigned int  pn_off;
+    unsigned int  pn_len;
+
+    int           (*size)(const unsigned char *d);
+    const char    *(*voltage)(const unsigned char *d);
+    const char    *(*ecc)(const unsigned char *d);
+} spd_layout_t;
+
+typedef struct spd_info_s
+{
+    const spd_layout_t *layout;
+    unsigned char      data[];
+} spd_info_t;
+
+static const char *
+val2str(uint16_t val, const struct valstr *vs)
+{
+    int i = 0;
+
+    while (vs[i].str != NULL) {
+	if (vs[i].val == val)
+	    return vs[i].str;
+	i++;
+    }
+    return NULL;
+}
+
+static int
+old_size(const unsigned char *d)
+{
+    return d[5] * (d[31] << 2);
+}
+
+static const char *
+old_voltage(const unsigned char *d)
+{
+    return val2str(d[8], spd_voltage_vals);
+}
+
+static const char *
+old_ecc(const unsigned char *d)
+{
+    return val2str(d[11], spd_config_vals);
+}
+
+/* Size in megabytes. */
+static int
+ddr4_size(const unsigned char *d)
 {
-    int           size;
-    const char    *memoryType;
-    const char    *voltageInterface;
-    const char    *errorDetection;
-    const char    *manufacturer;
-    char          partNumber[19];
-    unsigned char rawData[128];
-} SPD_info_t;
+    static const unsigned int density_mb[16] = {
+	256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 12288, 24576
+    };
+    unsigned int density = density_mb[d[4] & 0xf];
+    unsigned int bus_width = 8 << (d[13] & 0x7);
+    unsigned int dev_width = 4 << (d[12] & 0x7);
+    unsigned int ranks = ((d[12] >> 3) & 0x7) + 1;
+
+    /* 3DS packages have several dies per rank. */
+    if ((d[6] & 0x3) == 2)
+	ranks *= ((d[6] >> 4) & 0x7) + 1;
+    return density / 8 * bus_width / dev_width * ranks;
+}
 
+static const char *
+ddr4_voltage(const unsigned char *d)
+{
+    return (d[11] & 0x1) ? "1.2V" : NULL;
+}
+
+static const char *
+ddr4_ecc(const unsigned char *d)
+{
+    return ((d[13] >> 3) & 0x3) ? "ECC" : "None";
+}
+
+static int
+ddr5_size(const unsigned char *d)
+{
+    static const unsigned int density_mb[32] = {
+	0, 4096, 8192, 12288, 16384, 24576, 32768, 49152, 65536
+    };
+    static const unsigned int dies[8] = { 1, 0, 2, 4, 8, 16 };
+    unsigned int density = density_mb[d[4] & 0x1f];
+    unsigned int ndies = dies[(d[4] >> 5) & 0x7];
+    unsigned int dev_width = 4 << ((d[6] >> 5) & 0x7);
+    unsigned int bus_width = 8 << (d[235] & 0x7);
+    unsigned int channels = ((d[235] >> 5) & 0x3) + 1;
+    unsigned int ranks = ((d[234] >> 3) & 0x7) + 1;
+
+    return (channels * bus_width / dev_width * ranks * ndies
+	    * (density / 8));
+}
+
+static const char *
+ddr5_voltage(const unsigned char *d)
+{
+    return "1.1V";
+}
+
+static const char *
+ddr5_ecc(const unsigned char *d)
+{
+    return ((d[235] >> 3) & 0x3) ? "ECC" : "None";
+}
+
+static const spd_layout_t spd_layouts[] =
+{
+    { .memtype = 0x0c, .min_len = 384,
+      .mfr_off = 320, .mfr_count = 1, .pn_off = 329, .pn_len = 20,
+      .size = ddr4_size, .voltage = ddr4_voltage, .ecc = ddr4_ecc },
+    { .memtype = 0x12, .min_len = 640,
+      .mfr_off = 512, .mfr_count = 1, .pn_off = 521, .pn_len = 30,
+      .size = ddr5_size, .voltage = ddr5_voltage, .ecc = ddr5_ecc },
+    /* The old layout, matched by byte 0 being 0x80, must be last. */
+    { .memtype = 0, .min_len = 128,
+      .mfr_off = 64, .mfr_count = 0, .pn_off = 73, .pn_len = 18,
+      .size = old_size, .voltage = old_voltage, .ecc = old_ecc },
+};
+#define NUM_SPD_LAYOUTS (sizeof(spd_layouts) / sizeof(spd_layouts[0]))
+
+static const char *
+spd_manufacturer(spd_info_t *info)
+{
+    const spd_layout_t  *l = info->layout;
+    const unsigned char *d = info->data + l->mfr_off;
+    const char          *str = NULL;
+    unsigned int        bank;
+
+    if (l->mfr_count) {
+	/* Bit 7 of both bytes is parity, the JEDEC tables include it
+	   in the code. */
+	bank = d[0] & 0x7f;
+	if (bank < NUM_JEDEC_BANKS)
+	    str = val2str(d[1], jedec_banks[bank]);
+    } else {
+	/* handle jedec table bank continuation values */
+	for (bank=0; bank<NUM_JEDEC_BANKS-1; bank++) {
+	    if (d[bank] != 0x7f)
+		break;
+	}
+	str = val2str(d[bank], jedec_banks[bank]);
+    }
+
+    if (!str)
+	str = "Unknown";
+    return str;
+}
+
+static void
+spd_part_number(spd_info_t *info, char *pn)
+{
+    const spd_layout_t  *l = info->layout;
+    const unsigned char *d = info->data + l->pn_off;
+    unsigned int        i;
+
+    if (!d[0]) {
+	strcpy(pn, "Unknown");
+	return;
+    }
+    for (i=0; i<l->pn_len; i++) {
+	/* Some strings seem to use 0xff for filler. */
+	if (d[i] == 0xff)
+	    break;
+	pn[i] = d[i];
+    }
+    pn[i] = '\0';
+}
 
 static void
 fru_node_destroy (ipmi_fru_node_t *node)
@@ -115,6 +299,9 @@ set_fru_str_info(const char                **name,
 	*name = iname;
     if (dtype)
 	*dtype = IPMI_FRU_DATA_ASCII;
+    if (!idata)
+	/* Not something we can decode from this layout. */
+	return ENOSYS;
     if (data) {
 	char *d;
 	len = strlen(idata) + 1;
@@ -144,44 +331,63 @@ fru_node_get_field (ipmi_fru_node_t           *pnode,
 		    unsigned int              *data_len,
 		    ipmi_fru_node_t           **sub_node)
 {
-    ipmi_fru_t *fru = _ipmi_fru_node_get_data(pnode);
-    SPD_info_t *spd_info = _ipmi_fru_get_rec_data(fru);
-    int        rv;
-
+    ipmi_fru_t         *fru = _ipmi_fru_node_get_data(pnode);
+    spd_info_t         *spd_info = _ipmi_fru_get_rec_data(fru);
+    const spd_layout_t *l = spd_info->layout;
+    const char         *str;
+    char               pn[32];
+    int                rv;
+
+    /* Only decode what is asked for, a name lookup decodes nothing. */
     switch (index) {
     case 0:
 	if (name)
 	    *name = "size";
 	if (intval)
-	    *intval = spd_info->size;
+	    *intval = l->size(spd_info->data);
 	if (dtype)
 	    *dtype = IPMI_FRU_DATA_INT;
 	rv = 0;
 	break;
 
     case 1:
+	str = NULL;
+	if (data || data_len)
+	    str = val2str(spd_info->data[2], spd_memtype_vals);
 	rv = set_fru_str_info(name, dtype, data, data_len, "memory_type",
-			      spd_info->memoryType);
+			      str ? str : "Unknown");
 	break;
 
     case 2:
+	str = "";
+	if (data || data_len)
+	    str = l->voltage(spd_info->data);
 	rv = set_fru_str_info(name, dtype, data, data_len, "voltage_interface",
-			      spd_info->voltageInterface);
+			      str);
 	break;
 
     case 3:
+	str = "";
+	if (data || data_len)
+	    str = l->ecc(spd_info->data);
 	rv = set_fru_str_info(name, dtype, data, data_len, "error_detection",
-			      spd_info->errorDetection);
+			      str);
 	break;
 
     case 4:
+	str = "";
+	if (data || data_len)
+	    str = spd_manufacturer(spd_info);
 	rv = set_fru_str_info(name, dtype, data, data_len, "manufacturer",
-			      spd_info->manufacturer);
+			      str);
 	break;
 
     case 5:
+	pn[0] = '\0';
+	if (data || data_len)
+	    spd_part_number(spd_info, pn);
 	rv = set_fru_str_info(name, dtype, data, data_len, "part_number",
-			      spd_info->partNumber);
+			      pn);
 	break;
 
     default:
@@ -215,7 +421,7 @@ fru_get_root_node (ipmi_fru_t *fru, const char **name, ipmi_fru_node_t **rnode)
 static void
 fru_cleanup_recs (ipmi_fru_t *fru)
 {
-    SPD_info_t *spd_info = (SPD_info_t *) _ipmi_fru_get_rec_data (fru);
+    spd_info_t *spd_info = (spd_info_t *) _ipmi_fru_get_rec_data (fru);
 
     if (!spd_info)
 	return;
@@ -223,87 +429,55 @@ fru_cleanup_recs (ipmi_fru_t *fru)
     ipmi_mem_free(spd_info);
 }
 
-
-static const char *
-val2str(uint16_t val, const struct valstr *vs)
+static const spd_layout_t *
+find_spd_layout(unsigned char *data, unsigned int len)
 {
-    int i = 0;
-
-    while (vs[i].str != NULL) {
-	if (vs[i].val == val)
-	    return vs[i].str;
-	i++;
+    const spd_layout_t *l;
+    unsigned int       i;
+
+    if (len < 3)
+	return NULL;
+
+    for (i=0; i<NUM_SPD_LAYOUTS; i++) {
+	l = spd_layouts + i;
+	if (len < l->min_len)
+	    continue;
+	if (l->memtype ? (data[2] == l->memtype) : (data[0] == 0x80))
+	    return l;
     }
     return NULL;
 }
 
-static void
-loadInfo(SPD_info_t *spd_info, unsigned char *spd_data)
-{
-    int i;
-
-    memcpy(spd_info->rawData, spd_data, 128);
-    spd_info->size = spd_data[5] * (spd_data[31] << 2);
-    spd_info->memoryType = val2str(spd_data[2], spd_memtype_vals);
-    spd_info->voltageInterface = val2str(spd_data[8], spd_voltage_vals);
-    spd_info->errorDetection = val2str(spd_data[11], spd_config_vals);
-
-    /* handle jedec table bank continuation values */
-    spd_info->manufacturer = NULL;
-    if (spd_data[64] != 0x7f)
-	spd_info->manufacturer = val2str (spd_data[64], jedec_id1_vals);
-    else if (spd_data[65] != 0x7f)
-	spd_info->manufacturer = val2str (spd_data[65], jedec_id2_vals);
-    else if (spd_data[66] != 0x7f)
-	spd_info->manufacturer = val2str (spd_data[66], jedec_id3_vals);
-    else if (spd_data[67] != 0x7f)
-	spd_info->manufacturer = val2str (spd_data[67], jedec_id4_vals);
-    else if (spd_data[68] != 0x7f)
-	spd_info->manufacturer = val2str (spd_data[68], jedec_id5_vals);
-    else
-	spd_info->manufacturer = val2str (spd_data[69], jedec_id6_vals);
-
-    if (spd_info->manufacturer == NULL)
-	spd_info->manufacturer = "Unknown";
-
-    if (spd_data[73]) {
-	for (i=0; i<18; i++) {
-	    /* Some strings seem to use 0xff for filler. */
-	    if (spd_data[73+i] == 0xff)
-		break;
-	    spd_info->partNumber[i] = spd_data[73+i];
-	}
-	spd_info->partNumber[i] = '\0';
-    } else {
-	strcpy(spd_info->partNumber, "Unknown");
-    }
-}
-
 static int
 process_fru_spd_info(ipmi_fru_t *fru)
 {
-    unsigned char *data = _ipmi_fru_get_data_ptr(fru);
-    SPD_info_t    *spd_info;
+    unsigned char      *data = _ipmi_fru_get_data_ptr(fru);
+    unsigned int       len = _ipmi_fru_get_data_len(fru);
+    const spd_layout_t *layout;
+    spd_info_t         *spd_info;
 
     /*
      * We are here because FRU checksum failed
      *  ipmitool uses dev_type and dev_type_modifier
      *  to determine if it is an SPD.  ipmiutil uses
      *  first byte of 0x80, which is what we will use
-     *  to start with
+     *  to start with.  DDR4 and DDR5 are found by their
+     *  memory type in byte 2.
      */
-    if (data[0] == 0x80) {
-	_ipmi_fru_set_op_get_root_node(fru, fru_get_root_node);
-	spd_info = ipmi_mem_alloc(sizeof (*spd_info));
-	if (!spd_info)
-	    return ENOMEM;
-	memset(spd_info, 0, sizeof(*spd_info));
-	loadInfo(spd_info, data);
-	_ipmi_fru_set_rec_data(fru, spd_info);
-	_ipmi_fru_set_op_cleanup_recs(fru, fru_cleanup_recs);
-	return 0;
-    }
-    return EBADF;
+    layout = find_spd_layout(data, len);
+    if (!layout)
+	return EBADF;
+
+    /* Just keep the raw data, fields are decoded when fetched. */
+    spd_info = ipmi_mem_alloc(sizeof(*spd_info) + layout->min_len);
+    if (!spd_info)
+	return ENOMEM;
+    spd_info->layout = layout;
+    memcpy(spd_info->data, data, layout->min_len);
+    _ipmi_fru_set_op_get_root_node(fru, fru_get_root_node);
+    _ipmi_fru_set_rec_data(fru, spd_info);
+    _ipmi_fru_set_op_cleanup_recs(fru, fru_cleanup_recs);
+    return 0;
 }
 
 /************************************************************************
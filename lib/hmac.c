@@ -1,7 +1,7 @@
 /*
  * hmac.c
  *
- * MontaVista RMCP+ code for doing HMAC, both SHA1 and MD5
+ * MontaVista RMCP+ code for doing HMAC, SHA1, MD5 and SHA256
  *
  * Author: MontaVista Software, Inc.
  *         Corey Minyard <minyard@mvista.com>
@@ -37,31 +37,155 @@
 
 #include <errno.h>
 #include <string.h>
-#include <openssl/hmac.h>
+#include <openssl/evp.h>
 #include <OpenIPMI/ipmi_lan.h>
 #include <OpenIPMI/internal/ipmi_malloc.h>
+#include <OpenIPMI/internal/ipmi_locks.h>
 
+#ifndef HAVE_EVP_MD_CTX_NEW
+/* Before OpenSSL 1.1 */
+#define EVP_MD_CTX_new EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+/* Largest digest block size we handle, SHA-256 uses 64. */
+#define HMAC_MAX_BLOCK_SIZE 128
+
+/*
+ * The digest states after hashing the key XORed with the inner and
+ * outer pads are computed once per session (RFC 2104, section 4), so
+ * a packet only costs hashing its own data.  The work context is
+ * where a packet's digest gets computed from those, it is shared by
+ * sends and receives so it is under a lock.
+ */
 typedef struct hmac_info_s
 {
     const EVP_MD *evp_md;
-    unsigned int  klen;
     unsigned int  ilen;
-    unsigned char k[20];
+    EVP_MD_CTX    *ictx;
+    EVP_MD_CTX    *octx;
+    EVP_MD_CTX    *wctx;
+    ipmi_lock_t   *lock;
 } hmac_info_t;
 
+static void
+hmac_info_free(hmac_info_t *info)
+{
+    if (info->ictx)
+	EVP_MD_CTX_free(info->ictx);
+    if (info->octx)
+	EVP_MD_CTX_free(info->octx);
+    if (info->wctx)
+	EVP_MD_CTX_free(info->wctx);
+    if (info->lock)
+	ipmi_destroy_lock(info->lock);
+    ipmi_mem_free(info);
+}
+
+static int
+hmac_key_pad(EVP_MD_CTX          *ctx,
+	     const EVP_MD        *evp_md,
+	     const unsigned char *k,
+	     unsigned int        klen,
+	     unsigned char       padval)
+{
+    unsigned char pad[HMAC_MAX_BLOCK_SIZE];
+    unsigned int  bsize = EVP_MD_block_size(evp_md);
+    unsigned int  i;
+    int           ok;
+
+    memset(pad, padval, bsize);
+    for (i=0; i<klen; i++)
+	pad[i] ^= k[i];
+    ok = (EVP_DigestInit_ex(ctx, evp_md, NULL)
+	  && EVP_DigestUpdate(ctx, pad, bsize));
+    memset(pad, 0, sizeof(pad));
+    return ok ? 0 : ENOMEM;
+}
+
+static int
+hmac_info_alloc(ipmi_con_t          *ipmi,
+		const EVP_MD        *evp_md,
+		const unsigned char *k,
+		unsigned int        klen,
+		unsigned int        ilen,
+		void                **integ_data)
+{
+    hmac_info_t *info;
+    int         rv;
+
+    /* Our keys are never longer than a block, so they never need to
+       be hashed down first. */
+    if ((klen > (unsigned int) EVP_MD_block_size(evp_md))
+	|| (EVP_MD_block_size(evp_md) > HMAC_MAX_BLOCK_SIZE))
+	return EINVAL;
+
+    info = ipmi_mem_alloc(sizeof(*info));
+    if (!info)
+	return ENOMEM;
+    memset(info, 0, sizeof(*info));
+
+    info->evp_md = evp_md;
+    info->ilen = ilen;
+
+    rv = ipmi_create_lock_os_hnd(ipmi->os_hnd, &info->lock);
+    if (rv)
+	goto out_err;
+
+    info->ictx = EVP_MD_CTX_new();
+    info->octx = EVP_MD_CTX_new();
+    info->wctx = EVP_MD_CTX_new();
+    if (!info->ictx || !info->octx || !info->wctx) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+
+    rv = hmac_key_pad(info->ictx, evp_md, k, klen, 0x36);
+    if (rv)
+	goto out_err;
+    rv = hmac_key_pad(info->octx, evp_md, k, klen, 0x5c);
+    if (rv)
+	goto out_err;
+
+    *integ_data = info;
+    return 0;
+
+ out_err:
+    hmac_info_free(info);
+    return rv;
+}
+
+/* Compute the HMAC of the data into out, which must be able to hold
+   EVP_MAX_MD_SIZE bytes. */
+static int
+hmac_calc(hmac_info_t         *info,
+	  const unsigned char *data,
+	  unsigned int        len,
+	  unsigned char       *out)
+{
+    unsigned char ihash[EVP_MAX_MD_SIZE];
+    unsigned int  hlen;
+    int           ok;
+
+    ipmi_lock(info->lock);
+    ok = (EVP_MD_CTX_copy_ex(info->wctx, info->ictx)
+	  && EVP_DigestUpdate(info->wctx, data, len)
+	  && EVP_DigestFinal_ex(info->wctx, ihash, &hlen)
+	  && EVP_MD_CTX_copy_ex(info->wctx, info->octx)
+	  && EVP_DigestUpdate(info->wctx, ihash, hlen)
+	  && EVP_DigestFinal_ex(info->wctx, out, &hlen));
+    ipmi_unlock(info->lock);
+    return ok ? 0 : ENOMEM;
+}
+
 static int
 hmac_sha1_init(ipmi_con_t       *ipmi,
 	       ipmi_rmcpp_auth_t *ainfo,
 	       void             **integ_data)
 {
-    hmac_info_t         *info;
     const unsigned char *k;
     unsigned int        klen;
 
-    info = ipmi_mem_alloc(sizeof(*info));
-    if (!info)
-	return ENOMEM;
-
     if (ipmi_rmcpp_auth_get_sik_len(ainfo) < 20)
 	return EINVAL;
 
@@ -72,13 +196,7 @@ hmac_sha1_init(ipmi_con_t       *ipmi,
     if (klen < 20)
 	return EINVAL;
 
-    memcpy(info->k, k, 20);
-    info->klen = 20;
-    info->ilen = 12;
-
-    info->evp_md = EVP_sha1();
-    *integ_data = info;
-    return 0;
+    return hmac_info_alloc(ipmi, EVP_sha1(), k, 20, 12, integ_data);
 }
 
 static int
@@ -86,14 +204,9 @@ hmac_md5_init(ipmi_con_t       *ipmi,
 	      ipmi_rmcpp_auth_t *ainfo,
 	      void             **integ_data)
 {
-    hmac_info_t         *info;
     const unsigned char *k;
     unsigned int        klen;
 
-    info = ipmi_mem_alloc(sizeof(*info));
-    if (!info)
-	return ENOMEM;
-
     if (ipmi_rmcpp_auth_get_sik_len(ainfo) < 16)
 	return EINVAL;
 
@@ -101,23 +214,36 @@ hmac_md5_init(ipmi_con_t       *ipmi,
     if (klen < 16)
 	return EINVAL;
 
-    memcpy(info->k, k, 16);
-    info->klen = 16;
-    info->ilen = 16;
+    return hmac_info_alloc(ipmi, EVP_md5(), k, 16, 16, integ_data);
+}
 
-    info->evp_md = EVP_md5();
-    *integ_data = info;
-    return 0;
+static int
+hmac_sha256_init(ipmi_con_t       *ipmi,
+		 ipmi_rmcpp_auth_t *ainfo,
+		 void             **integ_data)
+{
+    const unsigned char *k;
+    unsigned int        klen;
+
+    /* This requires the 32-byte keys from RAKP-HMAC-SHA256. */
+    if (ipmi_rmcpp_auth_get_sik_len(ainfo) < 32)
+	return EINVAL;
+
+    if (ipmi->hacks & IPMI_CONN_HACK_RMCPP_INTEG_SIK)
+	k = ipmi_rmcpp_auth_get_sik(ainfo, &klen);
+    else
+	k = ipmi_rmcpp_auth_get_k1(ainfo, &klen);
+    if (klen < 32)
+	return EINVAL;
+
+    return hmac_info_alloc(ipmi, EVP_sha256(), k, 32, 16, integ_data);
 }
 
 static void
 hmac_free(ipmi_con_t *ipmi,
 	  void       *integ_data)
 {
-    hmac_info_t *info = integ_data;
-
-    memset(info->k, 0, sizeof(info->k));
-    ipmi_mem_free(integ_data);
+    hmac_info_free(integ_data);
 }
 
 static int
@@ -161,8 +287,8 @@ hmac_add(ipmi_con_t    *ipmi,
     hmac_info_t   *info = integ_data;
     unsigned char *p = payload;
     unsigned int  l = *payload_len;
-    unsigned int  ilen;
-    unsigned char integ[20];
+    unsigned char integ[EVP_MAX_MD_SIZE];
+    int           rv;
 
     if (l+info->ilen+1 > max_payload_len)
 	return E2BIG;
@@ -173,8 +299,10 @@ hmac_add(ipmi_con_t    *ipmi,
     p[l] = 0x07; /* Add the next header */
     l++;
 
-    HMAC(info->evp_md, info->k, info->klen, p+4, l-4, integ, &ilen);
-    memcpy(p+l, integ, ilen);
+    rv = hmac_calc(info, p+4, l-4, integ);
+    if (rv)
+	return rv;
+    memcpy(p+l, integ, info->ilen);
     l += info->ilen;
 
     *payload_len = l;
@@ -191,8 +319,7 @@ hmac_check(ipmi_con_t    *ipmi,
     hmac_info_t   *info = integ_data;
     unsigned char *p = payload;
     unsigned int  l = payload_len;
-    unsigned int  ilen;
-    unsigned char new_integ[20];
+    unsigned char new_integ[EVP_MAX_MD_SIZE];
 
     /* We don't authenticate this part of the header. */
     p += 4;
@@ -203,7 +330,8 @@ hmac_check(ipmi_con_t    *ipmi,
 
     /* We add 1 to the length because we also check the next header
        field. */
-    HMAC(info->evp_md, info->k, info->klen, p, l+1, new_integ, &ilen);
+    if (hmac_calc(info, p, l+1, new_integ))
+	return EINVAL;
     if (memcmp(new_integ, p+l+1, info->ilen) != 0)
 	return EINVAL;
 
@@ -227,6 +355,15 @@ static ipmi_rmcpp_integrity_t hmac_md5_integ =
     .integ_add = hmac_add,
     .integ_check = hmac_check
 };
+
+static ipmi_rmcpp_integrity_t hmac_sha256_integ =
+{
+    .integ_init = hmac_sha256_init,
+    .integ_free = hmac_free,
+    .integ_pad = hmac_pad,
+    .integ_add = hmac_add,
+    .integ_check = hmac_check
+};
 #endif /* HAVE_OPENSSL */
 
 void
@@ -237,6 +374,8 @@ _ipmi_hmac_shutdown(void)
 	(IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA1_96, NULL);
     ipmi_rmcpp_register_integrity
 	(IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_MD5_128, NULL);
+    ipmi_rmcpp_register_integrity
+	(IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128, NULL);
 #endif
 }
 
@@ -257,6 +396,13 @@ _ipmi_hmac_init(void)
 	_ipmi_hmac_shutdown();
 	return rv;
     }
+
+    rv = ipmi_rmcpp_register_integrity
+	(IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128, &hmac_sha256_integ);
+    if (rv) {
+	_ipmi_hmac_shutdown();
+	return rv;
+    }
 #endif
 
     return 0;
@@ -35,7 +35,10 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <netdb.h>
 
 #include <OpenIPMI/os_handler.h>
@@ -48,6 +51,7 @@
 
 #include <OpenIPMI/internal/ipmi_domain.h>
 #include <OpenIPMI/internal/ipmi_mc.h>
+#include <OpenIPMI/internal/ipmi_event.h>
 #include <OpenIPMI/internal/ipmi_int.h>
 #include <OpenIPMI/internal/ipmi_oem.h>
 #include <OpenIPMI/internal/locked_list.h>
@@ -70,6 +74,46 @@ static os_handler_t *ipmi_os_handler;
 
 unsigned int __ipmi_log_mask = 0;
 
+unsigned int __ipmi_trace_mask = 0;
+static ipmi_trace_cb trace_handler;
+static void *trace_cb_data;
+
+void
+ipmi_trace_set_handler(unsigned int  mask,
+		       ipmi_trace_cb handler,
+		       void          *cb_data)
+{
+    /* Turn the points off while the handler is changed so a point
+       never sees a new handler with the old data. */
+    __atomic_store_n(&__ipmi_trace_mask, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&trace_handler, handler, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&trace_cb_data, cb_data, __ATOMIC_SEQ_CST);
+    if (!handler)
+	mask = 0;
+    __atomic_store_n(&__ipmi_trace_mask, mask & IPMI_TRACE_ALL,
+		     __ATOMIC_RELEASE);
+}
+
+void
+__ipmi_trace(enum ipmi_trace_point_e point, void *con, void *opq,
+	     const void *id, unsigned int seq, int netfn, int cmd)
+{
+    ipmi_trace_cb     handler;
+    ipmi_trace_info_t info;
+
+    handler = __atomic_load_n(&trace_handler, __ATOMIC_ACQUIRE);
+    if (!handler)
+	return;
+    info.point = point;
+    info.con = con;
+    info.opq = opq;
+    info.id = id;
+    info.seq = seq;
+    info.netfn = netfn;
+    info.cmd = cmd;
+    handler(&info, __atomic_load_n(&trace_cb_data, __ATOMIC_ACQUIRE));
+}
+
 os_handler_t *
 ipmi_get_global_os_handler(void)
 {
@@ -116,13 +160,155 @@ ipmi_get_seq(void)
 {
     long rv;
 
+#ifdef __ATOMIC_RELAXED
+    /* Only uniqueness matters, no ordering against anything else. */
+    rv = __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED);
+#else
     if (seq_lock)
 	ipmi_os_handler->lock(ipmi_os_handler, seq_lock);
     rv = seq;
     seq++;
     if (seq_lock)
 	ipmi_os_handler->unlock(ipmi_os_handler, seq_lock);
+#endif
+
+    return rv;
+}
+
+/***********************************************************************
+ *
+ * Pacing of periodic background work, so that many domains started
+ * at the same time don't all audit at the same time.
+ *
+ **********************************************************************/
+
+/* Spread periodic timers by up to 10% either way by default. */
+#define DEFAULT_PACE_JITTER 10
+
+static unsigned int pace_jitter = DEFAULT_PACE_JITTER;
+static os_hnd_lock_t *pace_lock;
+
+/* The background operation token bucket.  Credit is kept in
+   millionths of a token so it can be refilled by the microsecond. */
+static unsigned int pace_rate; /* tokens per second, 0 for no limit */
+static unsigned int pace_burst;
+static unsigned long long pace_credit;
+static struct timeval pace_last;
+
+#define PACE_TOKEN 1000000ULL
+
+void
+ipmi_set_audit_jitter(unsigned int percent)
+{
+    if (percent > 100)
+	percent = 100;
+    pace_jitter = percent;
+}
+
+unsigned int
+ipmi_get_audit_jitter(void)
+{
+    return pace_jitter;
+}
 
+int
+ipmi_set_background_cmd_rate(unsigned int per_sec, unsigned int burst)
+{
+    if (!ipmi_os_handler || (per_sec && !burst))
+	return EINVAL;
+
+    if (pace_lock)
+	ipmi_os_handler->lock(ipmi_os_handler, pace_lock);
+    pace_rate = per_sec;
+    pace_burst = burst;
+    pace_credit = burst * PACE_TOKEN;
+    if (per_sec)
+	ipmi_os_handler->get_monotonic_time(ipmi_os_handler, &pace_last);
+    if (pace_lock)
+	ipmi_os_handler->unlock(ipmi_os_handler, pace_lock);
+    return 0;
+}
+
+void
+ipmi_get_background_cmd_rate(unsigned int *per_sec, unsigned int *burst)
+{
+    *per_sec = pace_rate;
+    *burst = pace_burst;
+}
+
+void
+_ipmi_pace_interval(os_handler_t   *os_hnd,
+		    unsigned int   seconds,
+		    int            first,
+		    struct timeval *timeout)
+{
+    unsigned long long usecs = seconds * 1000000ULL;
+    unsigned long long spread;
+    uint32_t           r;
+
+    timeout->tv_sec = seconds;
+    timeout->tv_usec = 0;
+
+    if (first)
+	/* Nothing has set the phase yet, spread over half the
+	   interval either way. */
+	spread = usecs / 2;
+    else
+	spread = (usecs * pace_jitter) / 100;
+    if ((spread == 0) || !os_hnd->get_random
+	|| os_hnd->get_random(os_hnd, &r, sizeof(r)))
+	return;
+
+    usecs = usecs - spread + (r % ((2 * spread) + 1));
+    timeout->tv_sec = usecs / 1000000;
+    timeout->tv_usec = usecs % 1000000;
+}
+
+int
+_ipmi_pace_background(os_handler_t *os_hnd, struct timeval *wait)
+{
+    struct timeval     now;
+    unsigned long long elapsed;
+    unsigned long long usecs;
+    int                rv = 0;
+
+    if (!pace_rate)
+	return 0;
+
+    if (pace_lock)
+	ipmi_os_handler->lock(ipmi_os_handler, pace_lock);
+    if (!pace_rate)
+	goto out_unlock;
+
+    os_hnd->get_monotonic_time(os_hnd, &now);
+    if ((now.tv_sec > pace_last.tv_sec)
+	|| ((now.tv_sec == pace_last.tv_sec)
+	    && (now.tv_usec > pace_last.tv_usec)))
+    {
+	elapsed = (((now.tv_sec - pace_last.tv_sec) * 1000000ULL)
+		   + now.tv_usec - pace_last.tv_usec);
+	/* Don't let a long idle time overflow the refill. */
+	if (elapsed > pace_burst * 1000000ULL)
+	    elapsed = pace_burst * 1000000ULL;
+	pace_credit += elapsed * pace_rate;
+	if (pace_credit > pace_burst * PACE_TOKEN)
+	    pace_credit = pace_burst * PACE_TOKEN;
+	pace_last = now;
+    }
+
+    if (pace_credit >= PACE_TOKEN) {
+	pace_credit -= PACE_TOKEN;
+    } else {
+	/* Round up so the token is there when the wait is over. */
+	usecs = (PACE_TOKEN - pace_credit + pace_rate - 1) / pace_rate;
+	wait->tv_sec = usecs / 1000000;
+	wait->tv_usec = usecs % 1000000;
+	rv = EAGAIN;
+    }
+
+ out_unlock:
+    if (pace_lock)
+	ipmi_os_handler->unlock(ipmi_os_handler, pace_lock);
     return rv;
 }
 
@@ -457,6 +643,173 @@ void _ipmi_sol_shutdown(void);
 static locked_list_t *con_type_list;
 static int ipmi_initialized;
 
+/***********************************************************************
+ *
+ * Interned strings.  Names and ids from SDRs are the same across
+ * every system of a type, so keep one refcounted copy of each.
+ *
+ **********************************************************************/
+
+typedef struct istr_s istr_t;
+struct istr_s
+{
+    istr_t       *next;
+    unsigned int hash;
+    unsigned int refcount;
+    unsigned int len;
+    char         str[1]; /* Actually len+1 long, nil terminated. */
+};
+
+#define ISTR_MIN_SIZE 256
+
+static os_hnd_lock_t *istr_lock;
+static istr_t **istr_table;
+static unsigned int istr_size;
+static unsigned int istr_count;
+
+static unsigned int
+istr_hash(const char *str, unsigned int len)
+{
+    unsigned int hash = 2166136261U;
+
+    while (len > 0) {
+	hash = (hash ^ (unsigned char) *str) * 16777619U;
+	str++;
+	len--;
+    }
+    return hash;
+}
+
+static void
+istr_grow(void)
+{
+    istr_t       **table, *e, *next;
+    unsigned int size = istr_size ? istr_size * 2 : ISTR_MIN_SIZE;
+    unsigned int i;
+
+    table = ipmi_mem_alloc(sizeof(*table) * size);
+    if (!table)
+	/* Longer chains are fine until the next try. */
+	return;
+    memset(table, 0, sizeof(*table) * size);
+    for (i=0; i<istr_size; i++) {
+	for (e=istr_table[i]; e; e=next) {
+	    next = e->next;
+	    e->next = table[e->hash & (size - 1)];
+	    table[e->hash & (size - 1)] = e;
+	}
+    }
+    if (istr_table)
+	ipmi_mem_free(istr_table);
+    istr_table = table;
+    istr_size = size;
+}
+
+const char *
+_ipmi_str_intern(const char *str, unsigned int len)
+{
+    unsigned int hash = istr_hash(str, len);
+    istr_t       *e = NULL;
+
+    if (istr_lock)
+	ipmi_os_handler->lock(ipmi_os_handler, istr_lock);
+
+    if (istr_count >= istr_size)
+	istr_grow();
+    if (!istr_table)
+	goto out_unlock;
+
+    for (e=istr_table[hash & (istr_size - 1)]; e; e=e->next) {
+	if ((e->hash == hash) && (e->len == len)
+	    && (memcmp(e->str, str, len) == 0))
+	{
+	    e->refcount++;
+	    goto out_unlock;
+	}
+    }
+
+    e = ipmi_mem_alloc(sizeof(*e) + len);
+    if (!e)
+	goto out_unlock;
+    memcpy(e->str, str, len);
+    e->str[len] = '\0';
+    e->len = len;
+    e->hash = hash;
+    e->refcount = 1;
+    e->next = istr_table[hash & (istr_size - 1)];
+    istr_table[hash & (istr_size - 1)] = e;
+    istr_count++;
+
+ out_unlock:
+    if (istr_lock)
+	ipmi_os_handler->unlock(ipmi_os_handler, istr_lock);
+    if (!e)
+	return NULL;
+    return e->str;
+}
+
+const char *
+_ipmi_str_intern_ref(const char *str)
+{
+    istr_t *e;
+
+    if (!str)
+	return NULL;
+    e = (istr_t *) (str - offsetof(istr_t, str));
+    if (istr_lock)
+	ipmi_os_handler->lock(ipmi_os_handler, istr_lock);
+    e->refcount++;
+    if (istr_lock)
+	ipmi_os_handler->unlock(ipmi_os_handler, istr_lock);
+    return str;
+}
+
+void
+_ipmi_str_unintern(const char *str)
+{
+    istr_t *e, **prev;
+
+    if (!str)
+	return;
+    e = (istr_t *) (str - offsetof(istr_t, str));
+    if (istr_lock)
+	ipmi_os_handler->lock(ipmi_os_handler, istr_lock);
+    e->refcount--;
+    if (e->refcount == 0) {
+	prev = &istr_table[e->hash & (istr_size - 1)];
+	while (*prev != e)
+	    prev = &(*prev)->next;
+	*prev = e->next;
+	istr_count--;
+	ipmi_mem_free(e);
+    }
+    if (istr_lock)
+	ipmi_os_handler->unlock(ipmi_os_handler, istr_lock);
+}
+
+static void
+istr_shutdown(void)
+{
+    istr_t       *e;
+    unsigned int i;
+
+    for (i=0; i<istr_size; i++) {
+	while (istr_table[i]) {
+	    e = istr_table[i];
+	    istr_table[i] = e->next;
+	    ipmi_mem_free(e);
+	}
+    }
+    if (istr_table)
+	ipmi_mem_free(istr_table);
+    istr_table = NULL;
+    istr_size = 0;
+    istr_count = 0;
+    if (istr_lock)
+	ipmi_os_handler->destroy_lock(ipmi_os_handler, istr_lock);
+    istr_lock = NULL;
+}
+
 int
 ipmi_init(os_handler_t *handler)
 {
@@ -485,8 +838,16 @@ ipmi_init(os_handler_t *handler)
 	rv = handler->create_lock(handler, &seq_lock);
 	if (rv)
 	    goto out_err;
+	rv = handler->create_lock(handler, &pace_lock);
+	if (rv)
+	    goto out_err;
+	rv = handler->create_lock(handler, &istr_lock);
+	if (rv)
+	    goto out_err;
     } else {
 	seq_lock = NULL;
+	pace_lock = NULL;
+	istr_lock = NULL;
     }
 
 #ifdef HAVE_OPENIPMI_SMI
@@ -502,6 +863,10 @@ ipmi_init(os_handler_t *handler)
     _ipmi_domain_init();
     _ipmi_mc_init();
 
+    rv = _ipmi_event_init();
+    if (rv)
+	goto out_err;
+
     rv = _ipmi_rakp_init();
     if (rv)
 	goto out_err;
@@ -568,12 +933,18 @@ ipmi_shutdown(void)
     ipmi_oem_kontron_conn_shutdown();
     _ipmi_mc_shutdown();
     _ipmi_domain_shutdown();
+    _ipmi_event_shutdown();
     _ipmi_fru_spd_decoder_shutdown();
     _ipmi_conn_shutdown();
     _ipmi_normal_fru_shutdown();
     _ipmi_fru_shutdown();
     if (seq_lock)
 	ipmi_os_handler->destroy_lock(ipmi_os_handler, seq_lock);
+    if (pace_lock)
+	ipmi_os_handler->destroy_lock(ipmi_os_handler, pace_lock);
+    pace_lock = NULL;
+    pace_rate = 0;
+    istr_shutdown();
     if (con_type_list)
 	locked_list_destroy(con_type_list);
 
@@ -1040,6 +1411,30 @@ ipmi_parse_options(ipmi_open_option_t *option,
     } else if (strcmp(arg, "-cache") == 0) {
 	option->option = IPMI_OPEN_OPTION_USE_CACHE;
 	option->ival = 1;
+    } else if (strcmp(arg, "-nospreadcons") == 0) {
+	option->option = IPMI_OPEN_OPTION_SPREAD_CONS;
+	option->ival = 0;
+    } else if (strcmp(arg, "-spreadcons") == 0) {
+	option->option = IPMI_OPEN_OPTION_SPREAD_CONS;
+	option->ival = 1;
+    } else if (strcmp(arg, "-nosdrincremental") == 0) {
+	option->option = IPMI_OPEN_OPTION_SDR_INCREMENTAL;
+	option->ival = 0;
+    } else if (strcmp(arg, "-sdrincremental") == 0) {
+	option->option = IPMI_OPEN_OPTION_SDR_INCREMENTAL;
+	option->ival = 1;
+    } else if (strcmp(arg, "-noselcache") == 0) {
+	option->option = IPMI_OPEN_OPTION_SEL_CACHE;
+	option->ival = 0;
+    } else if (strcmp(arg, "-selcache") == 0) {
+	option->option = IPMI_OPEN_OPTION_SEL_CACHE;
+	option->ival = 1;
+    } else if (strcmp(arg, "-norecordbringup") == 0) {
+	option->option = IPMI_OPEN_OPTION_RECORD_BRINGUP;
+	option->ival = 0;
+    } else if (strcmp(arg, "-recordbringup") == 0) {
+	option->option = IPMI_OPEN_OPTION_RECORD_BRINGUP;
+	option->ival = 1;
     } else
 	return EINVAL;
 
@@ -1060,7 +1455,11 @@ ipmi_parse_options_help(void)
 	"-[no]setseltime - setting the SEL clock\n"
 	"-[no]activate - connection activation\n"
 	"-[no]localonly - Just talk to the local BMC, (ATCA-only, for blades)\n"
-        "-[no]cache - use the local cache for SDRs.  On by default."
+        "-[no]cache - use the local cache for SDRs.  On by default.\n"
+	"-[no]spreadcons - spread messages over all active connections\n"
+	"-[no]sdrincremental - only reread changed SDRs on a refetch\n"
+	"-[no]selcache - only fetch new SEL entries after a restart\n"
+	"-[no]recordbringup - record the bring-up steps for a trace\n"
 	"-wait_til_up - wait until the domain is up before returning";
 }
 
@@ -1068,6 +1467,64 @@ ipmi_parse_options_help(void)
    1/1/98 (ipmi SNMP trap local timestamp). */
 #define IPMI_SNMP_DATE_OFFSET 883612800
 
+/* See ipmi_set_snmp_trap_decode(). */
+static int snmp_trap_decode = 0;
+
+void
+ipmi_set_snmp_trap_decode(int decode)
+{
+    snmp_trap_decode = decode;
+}
+
+int
+ipmi_get_snmp_trap_decode(void)
+{
+    return snmp_trap_decode;
+}
+
+/* Build the SEL record for the event in the trap into edata (16
+   bytes).  Returns 0 if the trap doesn't have enough to do that. */
+static int
+pet_to_sel_event(long specific, const unsigned char *data,
+		 unsigned char *edata)
+{
+    uint32_t timestamp;
+    int16_t  utc_off;
+
+    if (data[27] == 0xff)
+	/* Can't handle unspecific event generator */
+	return 0;
+    if ((data[28] == 0xff) || (data[28] == 0x00))
+	/* Can't handle unspecific sensor */
+	return 0;
+    timestamp = ((data[18] << 24) | (data[19] << 16)
+		 | (data[20] << 8) | data[21]);
+    if (timestamp == 0)
+	/* Can't handle unspecified timestamp. */
+	return 0;
+    utc_off = (data[22] << 8) | data[23];
+    if (utc_off == -1)
+	/* If unspecified (0xffff), we assume zero (UTC). */
+	utc_off = 0;
+    timestamp -= utc_off * 60; /* Remove timezone offset, in minutes */
+    timestamp += IPMI_SNMP_DATE_OFFSET; /* Convert to 1/1/70 offset */
+
+    /* We assume the record id is in the sequence # field, since that
+       makes the most sense. */
+    edata[0] = data[17];
+    edata[1] = data[16];
+    edata[2] = 2; /* record type - system event */
+    ipmi_set_uint32(edata+3, timestamp);
+    edata[7] = data[27]; /* Event generator */
+    edata[8] = 0; /* No way to get the channel or LUN, assume 0 */
+    edata[9] = 0x04; /* IPMI 1.5 revision */
+    edata[10] = (specific >> 16) & 0xff; /* Sensor type */
+    edata[11] = data[28]; /* Sensor number */
+    edata[12] = (specific >> 8) & 0xff; /* Event dir/type */
+    memcpy(edata+13, data+31, 3); /* Event data 1-3 */
+    return 1;
+}
+
 int
 ipmi_handle_snmp_trap_data(const void          *src_addr,
 			   unsigned int        src_addr_len,
@@ -1079,6 +1536,8 @@ ipmi_handle_snmp_trap_data(const void          *src_addr,
     int           handled = 0;
     unsigned char pet_ack[12];
     ipmi_msg_t    *msg = NULL;
+    ipmi_msg_t    tmsg;
+    unsigned char edata[16];
 
     if (DEBUG_RAWMSG) {
 	ipmi_log(IPMI_LOG_DEBUG_START, "Got SNMP trap from:\n  ");
@@ -1100,65 +1559,26 @@ ipmi_handle_snmp_trap_data(const void          *src_addr,
 
        Because of these, there is no guaranteed way to correlate the
        data from the SNMP trap to an SEL event.  This can result in
-       duplicate events, which is very bad.  So we currently do not
+       duplicate events, which is very bad.  So by default we do not
        deliver the events this way, we pass a NULL in the event
        message to tell the domain code to rescan the SEL for this MC.
        In addition, item 3 above means that you cannot determine which
        sensor issued the event, since the channel and the LUN are
        required to find the sensor.
-    */
-
- /* Until we have some way to get full valid data from the trap, we
-    just disable it. */
-#if 0
-    ipmi_msg_t     tmsg;
-    unsigned char  edata[17];
-    unsigned long  timestamp;
-    int16_t        utc_off;
-    unsigned short record_id;
-    timestamp = ntohl(*((uint32_t *) (data+18)));
-    if (data[27] == 0xff)
-	/* Can't handle unspecific event generator */
-	return 0;
-    if ((data[28] == 0xff) || (data[28] == 0x00))
-	/* Can't handle unspecific sensor */
-	return 0;
-    if (timestamp == 0)
-	/* Can't handle unspecified timestamp. */
-	return 0;
-    utc_off = ntohs(*((uint16_t *) (data+22)));
-    if (utc_off == -1)
-	/* If unspecified (0xffff), we assume zero (UTC). */
-	utc_off = 0;
-    timestamp -= utc_off; /* Remove timezone offset */
-    timestamp += IPMI_SNMP_DATE_OFFSET; /* Convert to 1/1/70 offset */
 
-    /* We assume the record id is in the sequence # field, since that
-       makes the most sense. */
-    record_id = ntohs(*((uint16_t *) (data+16)));
-
-    tmsg.netfn = IPMI_APP_NETFN;
-    tmsg.cmd = IPMI_READ_EVENT_MSG_BUFFER_CMD;
-    tmsg.data = edata;
-    tmsg.data_len = 17;
-    msg = &tmsg;
-    edata[0] = 0;
-    edata[1] = record_id & 0xff;
-    edata[2] = (record_id >> 8) & 0xff;
-    edata[3] = 2; /* record type - system event */
-    edata[4] = timestamp & 0xff;
-    edata[5] = (timestamp >> 8) & 0xff;
-    edata[6] = (timestamp >> 16) & 0xff;
-    edata[7] = (timestamp >> 24) & 0xff;
-    edata[8] = data[27]; /* Event generator */
-    /* FIXME - is there a way to get the LUN? */
-    edata[9] = 0; /* Assume channel 0, lun 0 */
-    edata[10] = 0x04; /* IPMI 1.5 revision */
-    edata[11] = (specific >> 16) & 0xff; /* Sensor type */
-    edata[12] = data[28]; /* Sensor number */
-    edata[13] = (specific >> 8) & 0xff; /* Event dir/type */
-    memcpy(edata+14, data+31, 3); /* Event data 1-3 */
-#endif
+       If the BMCs are known to put the SEL record id in the sequence
+       number and only use LUN 0, decoding can be turned on with
+       ipmi_set_snmp_trap_decode(), then traps that have everything
+       are delivered as events directly instead of waiting for the
+       SEL read.
+    */
+    if (snmp_trap_decode && pet_to_sel_event(specific, data, edata)) {
+	tmsg.netfn = IPMI_APP_NETFN;
+	tmsg.cmd = IPMI_READ_EVENT_MSG_BUFFER_CMD;
+	tmsg.data = edata;
+	tmsg.data_len = sizeof(edata);
+	msg = &tmsg;
+    }
 
     pet_ack[0] = data[17]; /* Record id */
     pet_ack[1] = data[16];
@@ -1216,6 +1636,115 @@ ipmi_free_msg_item_data(void *data)
     ipmi_mem_free(data);
 }
 
+static void
+msgi_cache_lock(ipmi_con_t *ipmi)
+{
+    if (ipmi->msgi_lock)
+	ipmi->os_hnd->lock(ipmi->os_hnd, ipmi->msgi_lock);
+}
+
+static void
+msgi_cache_unlock(ipmi_con_t *ipmi)
+{
+    if (ipmi->msgi_lock)
+	ipmi->os_hnd->unlock(ipmi->os_hnd, ipmi->msgi_lock);
+}
+
+int
+ipmi_con_msg_cache_init(ipmi_con_t *ipmi, unsigned int count)
+{
+    os_handler_t *os_hnd = ipmi->os_hnd;
+    ipmi_msgi_t  *item;
+    int          rv;
+
+    if (os_hnd->create_lock) {
+	rv = os_hnd->create_lock(os_hnd, &ipmi->msgi_lock);
+	if (rv)
+	    return rv;
+    }
+
+    ipmi->msgi_free = NULL;
+    ipmi->msgi_free_count = 0;
+    ipmi->msgi_max = count;
+    while (ipmi->msgi_free_count < count) {
+	item = ipmi_mem_alloc(sizeof(*item));
+	if (!item) {
+	    ipmi_con_msg_cache_cleanup(ipmi);
+	    return ENOMEM;
+	}
+	item->next = ipmi->msgi_free;
+	ipmi->msgi_free = item;
+	ipmi->msgi_free_count++;
+    }
+    return 0;
+}
+
+void
+ipmi_con_msg_cache_cleanup(ipmi_con_t *ipmi)
+{
+    ipmi_msgi_t *item;
+
+    while (ipmi->msgi_free) {
+	item = ipmi->msgi_free;
+	ipmi->msgi_free = item->next;
+	ipmi_mem_free(item);
+    }
+    ipmi->msgi_free_count = 0;
+    ipmi->msgi_max = 0;
+    if (ipmi->msgi_lock) {
+	ipmi->os_hnd->destroy_lock(ipmi->os_hnd, ipmi->msgi_lock);
+	ipmi->msgi_lock = NULL;
+    }
+}
+
+ipmi_msgi_t *
+ipmi_con_alloc_msg_item(ipmi_con_t *ipmi)
+{
+    ipmi_msgi_t *rv = NULL;
+
+    if (!ipmi || !ipmi->msgi_max)
+	return ipmi_alloc_msg_item();
+
+    msgi_cache_lock(ipmi);
+    if (ipmi->msgi_free) {
+	rv = ipmi->msgi_free;
+	ipmi->msgi_free = rv->next;
+	ipmi->msgi_free_count--;
+    }
+    msgi_cache_unlock(ipmi);
+
+    if (!rv)
+	return ipmi_alloc_msg_item();
+    memset(rv, 0, sizeof(*rv));
+    rv->msg.data = rv->data;
+    return rv;
+}
+
+void
+ipmi_con_free_msg_item(ipmi_con_t *ipmi, ipmi_msgi_t *item)
+{
+    if (!ipmi || !ipmi->msgi_max) {
+	ipmi_free_msg_item(item);
+	return;
+    }
+
+    if (item->msg.data && (item->msg.data != item->data))
+	ipmi_free_msg_item_data(item->msg.data);
+    item->msg.data = NULL;
+
+    msgi_cache_lock(ipmi);
+    if (ipmi->msgi_free_count < ipmi->msgi_max) {
+	item->next = ipmi->msgi_free;
+	ipmi->msgi_free = item;
+	ipmi->msgi_free_count++;
+	item = NULL;
+    }
+    msgi_cache_unlock(ipmi);
+
+    if (item)
+	ipmi_mem_free(item);
+}
+
 void
 ipmi_move_msg_item(ipmi_msgi_t *new_item, ipmi_msgi_t *old_item)
 {
@@ -1234,6 +1763,21 @@ ipmi_move_msg_item(ipmi_msgi_t *new_item, ipmi_msgi_t *old_item)
     }
 }
 
+static int
+call_rsp_handler(ipmi_con_t            *ipmi,
+		 ipmi_msgi_t           *rspi,
+		 ipmi_ll_rsp_handler_t rsp_handler)
+{
+    int used;
+
+    IPMI_TRACE(IPMI_TRACE_RSP_CB_START, ipmi, NULL, rspi, 0,
+	       rspi->msg.netfn, rspi->msg.cmd);
+    used = rsp_handler(ipmi, rspi);
+    /* rspi may be gone here, it is only used as a tag. */
+    IPMI_TRACE(IPMI_TRACE_RSP_CB_DONE, ipmi, NULL, rspi, 0, -1, -1);
+    return used;
+}
+
 void
 ipmi_handle_rsp_item_copyall(ipmi_con_t            *ipmi,
 			     ipmi_msgi_t           *rspi,
@@ -1252,10 +1796,10 @@ ipmi_handle_rsp_item_copyall(ipmi_con_t            *ipmi,
 
     /* call the user handler. */
     if (rsp_handler)
-	used = rsp_handler(ipmi, rspi);
+	used = call_rsp_handler(ipmi, rspi, rsp_handler);
 
     if (!used)
-	ipmi_free_msg_item(rspi);
+	ipmi_con_free_msg_item(ipmi, rspi);
 }
 
 void
@@ -1272,10 +1816,10 @@ ipmi_handle_rsp_item_copymsg(ipmi_con_t            *ipmi,
 
     /* call the user handler. */
     if (rsp_handler)
-	used = rsp_handler(ipmi, rspi);
+	used = call_rsp_handler(ipmi, rspi, rsp_handler);
 
     if (!used)
-	ipmi_free_msg_item(rspi);
+	ipmi_con_free_msg_item(ipmi, rspi);
 }
 
 void
@@ -1287,10 +1831,10 @@ ipmi_handle_rsp_item(ipmi_con_t            *ipmi,
 
     /* call the user handler. */
     if (rsp_handler)
-	used = rsp_handler(ipmi, rspi);
+	used = call_rsp_handler(ipmi, rspi, rsp_handler);
 
     if (!used)
-	ipmi_free_msg_item(rspi);
+	ipmi_con_free_msg_item(ipmi, rspi);
 }
 
 os_handler_t *
@@ -31,8 +31,15 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_LAN
+
 #include <config.h>
 
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+/* Get recvmmsg(), sendmmsg() and struct mmsghdr. */
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -56,6 +63,8 @@
 #include <OpenIPMI/internal/ipmi_event.h>
 #include <OpenIPMI/internal/ipmi_int.h>
 #include <OpenIPMI/internal/locked_list.h>
+#include <OpenIPMI/internal/htable.h>
+#include <OpenIPMI/internal/ipmi_utils.h>
 
 #if defined(DEBUG_MSG) || defined(DEBUG_RAWMSG)
 static void
@@ -90,11 +99,19 @@ dump_hex(void *vdata, int len)
    considered failed. */
 #define IP_FAIL_COUNT 4
 
+/* How many times a bridged message is requeued because the BMC said
+   it was too busy to bridge it, before the busy error is returned. */
+#define LAN_BRIDGE_BUSY_RETRIES 4
+
 /* The default for the maximum number of messages that are allowed to be
    outstanding.  This is a pretty conservative number. */
 #define DEFAULT_MAX_OUTSTANDING_MSG_COUNT 2
 #define MAX_POSSIBLE_OUTSTANDING_MSG_COUNT 63
 
+/* The ceiling of the adaptive message window if the user does not
+   set a maximum outstanding message count. */
+#define DEFAULT_MAX_MSG_WINDOW 16
+
 typedef struct lan_data_s lan_data_t;
 
 typedef struct audit_timer_info_s
@@ -109,6 +126,8 @@ typedef struct lan_timer_info_s
     ipmi_con_t        *ipmi;
     os_hnd_timer_id_t *timer;
     unsigned int      seq;
+
+    struct lan_timer_info_s *next;
 } lan_timer_info_t;
 
 typedef struct lan_wait_queue_s
@@ -121,6 +140,9 @@ typedef struct lan_wait_queue_s
     ipmi_ll_rsp_handler_t rsp_handler;
     ipmi_msgi_t           *rsp_item;
     int                   side_effects;
+    int                   busy_retries;
+    int                   has_deadline;
+    struct timeval        deadline;
 
     struct lan_wait_queue_s *next;
 } lan_wait_queue_t;
@@ -159,11 +181,12 @@ struct ipmi_rmcpp_auth_s
     unsigned int  mgsys_rand_len;
     unsigned char mgsys_guid[16];
     unsigned int  mgsys_guid_len;
-    unsigned char sik[20];
+    /* Big enough for the SHA-256 based algorithms. */
+    unsigned char sik[32];
     unsigned int  sik_len;
-    unsigned char k1[20];
+    unsigned char k1[32];
     unsigned int  k1_len;
-    unsigned char k2[20];
+    unsigned char k2[32];
     unsigned int  k2_len;
 };
 
@@ -190,8 +213,8 @@ typedef struct lan_conn_parms_s
 typedef struct lan_link_s lan_link_t;
 struct lan_link_s
 {
-    lan_link_t *next, *prev;
-    lan_data_t *lan;
+    lan_data_t   *lan; /* NULL if not in the table. */
+    unsigned int hash;
 };
 
 typedef struct lan_fd_s lan_fd_t;
@@ -217,7 +240,13 @@ typedef struct lan_stat_info_s
 #define STAT_INVALID_PAYLOAD	16
 #define STAT_SEQ_ERR		17
 #define STAT_RSP_NO_CMD		18
-#define NUM_STATS 19
+#define STAT_RTT_SAMPLES	19
+#define STAT_RTT_USEC		20
+#define STAT_WINDOW_CUTS	21
+#define STAT_AUDITS_SKIPPED	22
+#define STAT_BRIDGE_BUSY	23
+#define STAT_DEADLINE_MISSED	24
+#define NUM_STATS 25
     /* Statistics */
     void *stats[NUM_STATS];
 } lan_stat_info_t;
@@ -242,7 +271,13 @@ static const char *lan_stat_names[NUM_STATS] =
     "lan_decrypt_fail",
     "lan_invalid_payload",
     "lan_seq_err",
-    "lan_rsp_no_cmd"
+    "lan_rsp_no_cmd",
+    "lan_rtt_samples",
+    "lan_rtt_usec",
+    "lan_window_cuts",
+    "lan_audits_skipped",
+    "lan_bridge_busy",
+    "lan_deadline_missed"
 };
 
 
@@ -253,6 +288,11 @@ typedef struct lan_ip_data_s
     unsigned int               consecutive_failures;
     struct timeval             failure_time;
 
+    /* When the last response came in on the address, protected by
+       seq_num_lock.  The audit doesn't need to check the connection
+       if this is recent. */
+    struct timeval             last_rsp_time;
+
     /* For both RMCP and RMCP+.  For RMCP+, the session id is the one
        I receive and the sequence numbers are the authenticated
        ones. */
@@ -268,6 +308,10 @@ typedef struct lan_ip_data_s
     uint32_t                   unauth_recv_msg_map;
     unsigned char              working_integ;
     unsigned char              working_conf;
+    /* Set at session setup if working_integ is one of the standard
+       algorithms, whose padding is defined by the spec and is done
+       directly instead of through integ_info. */
+    unsigned char              std_integ;
     uint32_t                   mgsys_session_id;
     ipmi_rmcpp_auth_t          ainfo;
 
@@ -281,6 +325,11 @@ typedef struct lan_ip_data_s
     ipmi_rmcpp_integrity_t       *integ_info;
     void                         *integ_data;
 
+    /* Where session establishment for this address is in the global
+       connection limiter, see ipmi_lan_set_max_connecting().
+       Protected by lan_estab_lock. */
+    int                          estab_state;
+
     /* Use for linked-lists of IP addresses. */
     lan_link_t                 ip_link;
 } lan_ip_data_t;
@@ -369,12 +418,35 @@ struct lan_data_s
 	int                   retries_left;
 	int                   side_effects;
 
+	/* When the message was first sent, how many times it has
+	   been resent since (if it has, it can't be timed), and the
+	   timeout to use for the next retry if adaptive timeouts are
+	   on. */
+	struct timeval        send_time;
+	int                   rexmitted;
+	long                  rsp_timeout;
+
+	/* The value of send_epoch when the message was sent. */
+	unsigned int          send_epoch;
+
 	/* If -1, just use the normal algorithm.  If not -1, force to
            this address. */
 	int                   addr_num;
 
 	/* The number of the last IP address sent on. */
 	int                   last_ip_num;
+
+	/* Set if the BMC bridges this message onto the IPMB, and how
+	   many times it has been requeued because the BMC was busy. */
+	int                   bridged;
+	int                   busy_retries;
+
+	/* The time after which the user no longer wants the
+	   response, and whether the response timer was cut short to
+	   end at it. */
+	int                   has_deadline;
+	struct timeval        deadline;
+	int                   deadline_timer;
     } seq_table[64];
     ipmi_lock_t               *seq_num_lock;
 
@@ -391,6 +463,60 @@ struct lan_data_s
        sequence zero. */
     unsigned int max_outstanding_msg_count;
 
+    /* Timer infos for outstanding messages, kept with their timers
+       allocated when a message finishes so sends don't have to
+       allocate them.  Filled to max_outstanding_msg_count when the
+       connection is created. */
+    ipmi_lock_t      *timer_info_lock;
+    lan_timer_info_t *timer_info_free;
+    unsigned int     timer_info_free_count;
+
+    /* Response time estimator, all in microseconds.  rto is the
+       timeout for new messages without side effects, it is only used
+       if rtt_adaptive is set but is always kept up to date.  These
+       are protected by seq_num_lock. */
+    int          rtt_adaptive;
+    unsigned int rtt_samples;
+    long         srtt;
+    long         rttvar;
+    long         rto;
+    long         rto_min;
+    long         rto_max;
+
+    /* Adaptive outstanding message window, protected by seq_num_lock.
+       If msg_window_adaptive is set, msg_window replaces
+       max_outstanding_msg_count as the limit on outstanding messages
+       and max_outstanding_msg_count becomes its ceiling.  It grows by
+       one after a full window of clean responses and halves when a
+       message to the BMC times out or a packet comes in outside the
+       session sequence range.  send_epoch counts messages sent,
+       window_cut_epoch is its value at the last cut, so the window is
+       only cut once per window of messages. */
+    int          msg_window_adaptive;
+    unsigned int msg_window;
+    unsigned int msg_window_acked;
+    unsigned int send_epoch;
+    unsigned int window_cut_epoch;
+
+    /* Bridged (IPMB) messages are pipelined like any other, but the
+       BMC can only carry so many at a time.  bridge_window starts at
+       max_outstanding_msg_count and drops to what the BMC is carrying
+       when a Send Message comes back busy, and the busy message is
+       requeued.  It grows back by one after a window of clean bridged
+       responses.  Protected by seq_num_lock. */
+    unsigned int bridge_window;
+    unsigned int bridge_acked;
+    unsigned int bridge_outstanding;
+
+    /* If not zero, RMCP+ sessions are saved when the connection is
+       closed and resumed when it starts if they are no older than
+       this many seconds.  See IPMI_LANP_SESSION_RESUME. */
+    unsigned int session_resume;
+
+    /* The reactor asked for with IPMI_LANP_REACTOR, or -1 to let the
+       placement policy pick. */
+    int reactor;
+
     /* List of messages waiting to be sent. */
     lan_wait_queue_t *wait_q, *wait_q_tail;
 
@@ -415,6 +541,14 @@ struct lan_data_s
     lan_link_t link;
 
     locked_list_t *lan_stat_list;
+
+    /* The statistics, kept here all the time and updated with
+       relaxed atomics so ipmi_lan_get_stats() can fetch them.  They
+       are also pushed to the registered stat handlers if there are
+       any and stat_push is set, see ipmi_lan_set_stat_push(). */
+    unsigned long stat_counts[NUM_STATS];
+    unsigned int  stat_handlers;
+    int           stat_push;
 };
 
 
@@ -1005,7 +1139,7 @@ unsigned char *
 ipmi_rmcpp_auth_get_sik(ipmi_rmcpp_auth_t *ainfo,
 			unsigned int      *max_len)
 {
-    *max_len = 20;
+    *max_len = sizeof(ainfo->sik);
     return ainfo->sik;
 }
 
@@ -1026,7 +1160,7 @@ unsigned char *
 ipmi_rmcpp_auth_get_k1(ipmi_rmcpp_auth_t *ainfo,
 		       unsigned int      *max_len)
 {
-    *max_len = 20;
+    *max_len = sizeof(ainfo->k1);
     return ainfo->k1;
 }
 
@@ -1047,7 +1181,7 @@ unsigned char *
 ipmi_rmcpp_auth_get_k2(ipmi_rmcpp_auth_t *ainfo,
 		       unsigned int      *max_len)
 {
-    *max_len = 20;
+    *max_len = sizeof(ainfo->k2);
     return ainfo->k2;
 }
 
@@ -1068,15 +1202,45 @@ ipmi_rmcpp_auth_set_k2_len(ipmi_rmcpp_auth_t *ainfo,
 static void check_command_queue(ipmi_con_t *ipmi, lan_data_t *lan);
 static int send_auth_cap(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num,
 			 int force_ipmiv15);
+static int lan_estab_start(ipmi_con_t *ipmi, lan_data_t *lan,
+			   unsigned int addr_num);
+static int lan_start_session(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num);
+static void lan_estab_cleanup(lan_data_t *lan);
 
 static os_handler_t *lan_os_hnd;
 
-#define MAX_CONS_PER_FD	32
+#define IPMI_MAX_LAN_LEN    (IPMI_MAX_MSG_LENGTH + 128)
+#define IPMI_LAN_MAX_HEADER 128
+
+/* A packet waiting in a LAN socket's transmit queue. */
+typedef struct lan_xmit_pkt_s
+{
+    sockaddr_ip_t addr;
+    unsigned int  len;
+    unsigned char data[IPMI_MAX_LAN_LEN+IPMI_LAN_MAX_HEADER];
+} lan_xmit_pkt_t;
+
+/* Connections share sockets, the slot a connection has in the socket
+   is used to find the connection when a message comes in.  RMCP+ uses
+   the slot as the message tag during session setup, which is only 8
+   bits, so that limits the number of slots. */
+#define MAX_CONS_PER_FD	IPMI_LAN_MAX_CONS_PER_FD
+#define DEFAULT_CONS_PER_FD 32
+static unsigned int lan_cons_per_fd = DEFAULT_CONS_PER_FD;
+
 struct lan_fd_s
 {
     int            fd;
     os_hnd_fd_id_t *fd_wait_id;
     unsigned int   cons_in_use;
+
+    /* The number of slots that may be used on this socket.  This is
+       set from lan_cons_per_fd when the socket is opened. */
+    unsigned int   max_cons;
+
+    /* The OS handler reactor the socket is on, the timers of the
+       connections using it go on the same one. */
+    unsigned int   reactor;
     lan_data_t     *lan[MAX_CONS_PER_FD];
     lan_fd_t       *next, *prev;
     ipmi_lock_t    *con_lock;
@@ -1085,8 +1249,37 @@ struct lan_fd_s
     ipmi_lock_t    *lock;
     lan_fd_t       **free_list;
     lan_fd_t       *list;
+
+    /* Receive batch statistics, protected by con_lock. */
+    unsigned long  recv_batches;
+    unsigned long  recv_packets;
+    unsigned long  recv_full_batches;
+    unsigned int   recv_max_batch;
+
+    /* Transmit coalescing, see ipmi_lan_set_xmit_batch().  The queue
+       and timer are allocated the first time they are needed. */
+    ipmi_lock_t       *xmit_lock;
+    lan_xmit_pkt_t    *xmit_q;
+    unsigned int      xmit_count;
+    os_hnd_timer_id_t *xmit_timer;
+    int               xmit_timer_running;
 };
 
+/* Number of datagrams to pull from a socket per read, see
+   ipmi_lan_set_recv_batch_size(). */
+static unsigned int lan_recv_batch_size = 1;
+
+/* When a batch comes back full, there is probably more data waiting.
+   Try again, but not forever, so other file descriptors and timers
+   get a chance to run during a storm. */
+#define LAN_RECV_MAX_BATCH_PASSES 4
+
+/* Number of packets to coalesce per send and the maximum time (in
+   microseconds) a packet may wait for others, see
+   ipmi_lan_set_xmit_batch(). */
+static unsigned int lan_xmit_batch_size = 1;
+static unsigned int lan_xmit_max_delay = 0;
+
 /* This is a list, but the only searching is to find an fd with a free
    slot (when creating a new lan).  This is O(1) because the first
    entry is guaranteed to have a free slot if any have free slots.
@@ -1179,6 +1372,62 @@ move_to_lan_list_head(lan_fd_t *item)
     list->next = item;
 }
 
+static unsigned int lan_reactor_policy = IPMI_LAN_REACTOR_ROUND_ROBIN;
+
+static unsigned int
+lan_num_reactors(void)
+{
+    if (lan_os_hnd->get_num_reactors && lan_os_hnd->add_fd_to_wait_for_reactor)
+	return lan_os_hnd->get_num_reactors(lan_os_hnd);
+    return 1;
+}
+
+/* Pick the reactor for a connection without an explicit one.  Returns
+   -1 for round robin, where any socket with a free slot will do.
+   Must be called with the fd list lock held. */
+static int
+lan_pick_reactor(lan_fd_t *list, lan_data_t *lan)
+{
+    unsigned int  num = lan_num_reactors();
+    unsigned int  r, best = 0, best_cons = 0, cons;
+    unsigned char *a;
+    uint32_t      h = 2166136261U;
+    lan_fd_t      *item;
+    int           i;
+
+    if (num <= 1)
+	return -1;
+
+    switch (lan_reactor_policy) {
+    case IPMI_LAN_REACTOR_HASH:
+	/* Only the first address, so the same BMC gets the same
+	   reactor every time. */
+	a = (unsigned char *) &lan->cparm.ip_addr[0].s_ipsock;
+	for (i=0; i<(int) lan->cparm.ip_addr[0].ip_addr_len; i++) {
+	    h ^= a[i];
+	    h *= 16777619U;
+	}
+	return h % num;
+
+    case IPMI_LAN_REACTOR_LEAST_LOADED:
+	for (r=0; r<num; r++) {
+	    cons = 0;
+	    for (item=list->next; item!=list; item=item->next) {
+		if (item->reactor == r)
+		    cons += item->cons_in_use;
+	    }
+	    if ((r == 0) || (cons < best_cons)) {
+		best = r;
+		best_cons = cons;
+	    }
+	}
+	return best;
+
+    default:
+	return -1;
+    }
+}
+
 static lan_fd_t *
 find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 {
@@ -1187,6 +1436,7 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
     lan_fd_t    **free_list;
     int         rv;
     int         i;
+    int         reactor;
 
     if (family == PF_INET) {
 	lock = fd_list_lock;
@@ -1205,12 +1455,26 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
     }
 
     ipmi_lock(lock);
+    reactor = lan->reactor;
+    if (lan_num_reactors() <= 1)
+	reactor = -1;
+    else if (reactor >= 0)
+	reactor %= lan_num_reactors();
+    else
+	reactor = lan_pick_reactor(list, lan);
     item = list->next;
  retry:
-    if (item->cons_in_use < MAX_CONS_PER_FD) {
+    if ((reactor >= 0) && (item->cons_in_use < item->max_cons)
+	&& (item->reactor != (unsigned int) reactor))
+    {
+	/* Has a free slot, but on another reactor. */
+	item = item->next;
+	goto retry;
+    }
+    if (item->cons_in_use < item->max_cons) {
 	int tslot = -1;
 	/* Got an entry with a slot, just reuse it. */
-	for (i=0; i<MAX_CONS_PER_FD; i++) {
+	for (i=0; i<(int) item->max_cons; i++) {
 	    if (item->lan[i]) {
 		/* Check for a matching IP address.  Can't have two
 		   systems with the same address in the same fd entry. */
@@ -1237,7 +1501,7 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 	    /* Can't happen, but log and fix it up. */
 	    ipmi_log(IPMI_LOG_SEVERE, "ipmi_lan.c: Internal error, count"
 		     " in lan fd list item incorrect, but we can recover.");
-	    item->cons_in_use = MAX_CONS_PER_FD;
+	    item->cons_in_use = item->max_cons;
 	    move_to_lan_list_end(item);
 	    item = next;
 	    goto retry;
@@ -1246,7 +1510,7 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 	item->lan[tslot] = lan;
 	*slot = tslot;
 
-	if (item->cons_in_use == MAX_CONS_PER_FD)
+	if (item->cons_in_use == item->max_cons)
 	    /* Out of connections in this item, move it to the end of
 	       the list. */
 	    move_to_lan_list_end(item);
@@ -1265,6 +1529,12 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 		    ipmi_mem_free(item);
 		    goto out_unlock;
 		}
+		rv = ipmi_create_global_lock(&item->xmit_lock);
+		if (rv) {
+		    ipmi_destroy_lock(item->con_lock);
+		    ipmi_mem_free(item);
+		    goto out_unlock;
+		}
 		item->lock = lock;
 		item->free_list = free_list;
 		item->list = list;
@@ -1275,6 +1545,7 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 
 	item->next = item;
 	item->prev = item;
+	item->max_cons = lan_cons_per_fd;
 
 	item->fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
 	if (item->fd == -1) {
@@ -1296,12 +1567,29 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 	    goto out_unlock;
 	}
 
-	rv = lan_os_hnd->add_fd_to_wait_for(lan_os_hnd,
-					    item->fd,
-					    data_handler, 
-					    item,
-					    NULL,
-					    &(item->fd_wait_id));
+	item->reactor = 0;
+	if (lan_num_reactors() > 1) {
+	    /* Spread the sockets across the reactors. */
+	    static unsigned int next_reactor;
+
+	    if (reactor >= 0)
+		item->reactor = reactor;
+	    else
+		item->reactor = next_reactor++ % lan_num_reactors();
+	    rv = lan_os_hnd->add_fd_to_wait_for_reactor(lan_os_hnd,
+							item->reactor,
+							item->fd,
+							data_handler,
+							item,
+							NULL,
+							&(item->fd_wait_id));
+	} else
+	    rv = lan_os_hnd->add_fd_to_wait_for(lan_os_hnd,
+						item->fd,
+						data_handler, 
+						item,
+						NULL,
+						&(item->fd_wait_id));
 	if (rv) {
 	    close(item->fd);
 	    item->next = *free_list;
@@ -1322,6 +1610,88 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
     return item;
 }
 
+static void lan_fd_xmit_flush(lan_fd_t *item);
+
+/* Allocate a timer for the connection on the reactor its socket is
+   on, so the timeouts and the responses are handled together. */
+static int
+lan_alloc_timer(lan_data_t *lan, os_hnd_timer_id_t **id)
+{
+    os_handler_t *os_hnd = lan->ipmi->os_hnd;
+
+    if (lan->fd && os_hnd == lan_os_hnd && os_hnd->alloc_timer_reactor)
+	return os_hnd->alloc_timer_reactor(os_hnd, lan->fd->reactor, id);
+    return os_hnd->alloc_timer(os_hnd, id);
+}
+
+/* Get a timer info with its timer for a message, from the free list
+   if possible. */
+static int
+lan_get_timer_info(lan_data_t *lan, lan_timer_info_t **rinfo)
+{
+    lan_timer_info_t *info;
+    int              rv;
+
+    ipmi_lock(lan->timer_info_lock);
+    info = lan->timer_info_free;
+    if (info) {
+	lan->timer_info_free = info->next;
+	lan->timer_info_free_count--;
+    }
+    ipmi_unlock(lan->timer_info_lock);
+
+    if (!info) {
+	info = ipmi_mem_alloc(sizeof(*info));
+	if (!info)
+	    return ENOMEM;
+	rv = lan_alloc_timer(lan, &info->timer);
+	if (rv) {
+	    ipmi_mem_free(info);
+	    return rv;
+	}
+    }
+
+    info->ipmi = lan->ipmi;
+    info->cancelled = 0;
+    info->seq = 0;
+    info->next = NULL;
+    *rinfo = info;
+    return 0;
+}
+
+/* Give back a timer info.  The timer must not be running. */
+static void
+lan_put_timer_info(lan_data_t *lan, lan_timer_info_t *info)
+{
+    ipmi_lock(lan->timer_info_lock);
+    if (lan->timer_info_free_count < lan->max_outstanding_msg_count) {
+	info->next = lan->timer_info_free;
+	lan->timer_info_free = info;
+	lan->timer_info_free_count++;
+	info = NULL;
+    }
+    ipmi_unlock(lan->timer_info_lock);
+
+    if (info) {
+	lan->ipmi->os_hnd->free_timer(lan->ipmi->os_hnd, info->timer);
+	ipmi_mem_free(info);
+    }
+}
+
+static void
+lan_free_timer_infos(lan_data_t *lan, os_handler_t *os_hnd)
+{
+    lan_timer_info_t *info;
+
+    while (lan->timer_info_free) {
+	info = lan->timer_info_free;
+	lan->timer_info_free = info->next;
+	os_hnd->free_timer(os_hnd, info->timer);
+	ipmi_mem_free(info);
+    }
+    lan->timer_info_free_count = 0;
+}
+
 static void
 release_lan_fd(lan_fd_t *item, int slot)
 {
@@ -1330,6 +1700,8 @@ release_lan_fd(lan_fd_t *item, int slot)
     item->cons_in_use--;
     if (item->cons_in_use == 0) {
 	lan_os_hnd->remove_fd_to_wait_for(lan_os_hnd, item->fd_wait_id);
+	/* Get anything still queued out before the socket goes away. */
+	lan_fd_xmit_flush(item);
 	close(item->fd);
 	item->next->prev = item->prev;
 	item->prev->next = item->next;
@@ -1344,123 +1716,266 @@ release_lan_fd(lan_fd_t *item, int slot)
 }
 
 /*
- * We keep two hash tables, one by IP address and one by connection
- * address.
+ * We keep two hash tables, one by connection and one by IP address.
+ * Each table is split into stripes with their own lock, so lookups
+ * of different connections do not contend with each other, and each
+ * stripe's table grows as connections are added to it.  The
+ * refcount and users count of a connection are protected by the
+ * lock of the connection table stripe the connection hashes to.  If
+ * an IP table stripe lock and a connection table stripe lock are both
+ * needed, the IP table stripe lock must be taken first.
  */
-#define LAN_HASH_SIZE 256
-#define LAN_HASH_SHIFT 6
-static ipmi_lock_t *lan_list_lock = NULL;
-static lan_link_t lan_list[LAN_HASH_SIZE];
-static lan_link_t lan_ip_list[LAN_HASH_SIZE];
+#define LAN_HASH_STRIPE_BITS	4
+#define LAN_HASH_STRIPES	(1 << LAN_HASH_STRIPE_BITS)
+
+typedef struct lan_hash_stripe_s
+{
+    ipmi_lock_t *lock;
+    htable_t    *tab;
+} lan_hash_stripe_t;
+
+static lan_hash_stripe_t lan_con_hash[LAN_HASH_STRIPES];
+static lan_hash_stripe_t lan_ip_hash[LAN_HASH_STRIPES];
 
 static unsigned int
 hash_lan(const ipmi_con_t *ipmi)
 {
-    unsigned int idx;
-
-    idx = (((unsigned long) ipmi)
-	   >> (sizeof(unsigned long) + LAN_HASH_SHIFT));
-    idx %= LAN_HASH_SIZE;
-    return idx;
+    return ipmi_hash_pointer((void *) ipmi);
 }
 
+/* Note that this only hashes the IP address, not the port. */
 static unsigned int
 hash_lan_addr(const struct sockaddr *addr)
 {
-    unsigned int idx;
+    uint32_t val;
+
     switch (addr->sa_family)
     {
     case PF_INET:
 	{
 	    struct sockaddr_in *iaddr = (struct sockaddr_in *) addr;
-	    idx = ntohl(iaddr->sin_addr.s_addr) % LAN_HASH_SIZE;
+	    val = ntohl(iaddr->sin_addr.s_addr);
 	    break;
 	}
 #ifdef PF_INET6
     case PF_INET6:
 	{
-	    /* Use the lower 4 bytes of the IPV6 address. */
+	    /* Mix in the whole address.  The low 4 bytes alone are the
+	       same for BMCs numbered the same way in different subnets
+	       (2001:db8:1::10, 2001:db8:2::10), which put them all in
+	       one chain. */
 	    struct sockaddr_in6 *iaddr = (struct sockaddr_in6 *) addr;
-	    idx = htonl(*((uint32_t *) &iaddr->sin6_addr.s6_addr[12]));
-	    idx %= LAN_HASH_SIZE;
+	    const unsigned char *a = iaddr->sin6_addr.s6_addr;
+	    unsigned int        i;
+
+	    val = 0;
+	    for (i=0; i<16; i+=4)
+		val = ipmi_hash_uint(val ^ ipmi_get_uint32(a + i));
 	    break;
 	}
 #endif
     default:
-	idx = 0;
+	val = 0;
     }
-    idx %= LAN_HASH_SIZE;
-    return idx;
+    return ipmi_hash_uint(val);
+}
+
+static inline lan_hash_stripe_t *
+lan_hash_stripe(lan_hash_stripe_t *table, unsigned int hash)
+{
+    return &table[hash & (LAN_HASH_STRIPES - 1)];
+}
+
+/* The low bits picked the stripe, so use the rest in the stripe's
+   table. */
+static inline unsigned int
+lan_hash_key(unsigned int hash)
+{
+    return hash >> LAN_HASH_STRIPE_BITS;
+}
+
+/* Must be called with the stripe lock held. */
+static int
+lan_hash_add(lan_hash_stripe_t *stripe, lan_link_t *link, lan_data_t *lan)
+{
+    if (!htable_add(stripe->tab, lan_hash_key(link->hash), link))
+	return ENOMEM;
+    link->lan = lan;
+    return 0;
 }
 
+/* Must be called with the stripe lock held. */
 static void
-lan_add_con(lan_data_t *lan)
+lan_hash_remove(lan_hash_stripe_t *stripe, lan_link_t *link)
+{
+    htable_remove(stripe->tab, lan_hash_key(link->hash), link);
+    link->lan = NULL;
+}
+
+static int
+lan_hash_init(lan_hash_stripe_t *table)
+{
+    unsigned int i;
+    int          rv;
+
+    for (i=0; i<LAN_HASH_STRIPES; i++) {
+	rv = ipmi_create_global_lock(&table[i].lock);
+	if (rv)
+	    return rv;
+	table[i].tab = alloc_htable();
+	if (!table[i].tab)
+	    return ENOMEM;
+    }
+    return 0;
+}
+
+static void
+lan_hash_shutdown(lan_hash_stripe_t *table)
 {
-    unsigned int idx;
-    lan_link_t   *head;
     unsigned int i;
 
-    ipmi_lock(lan_list_lock);
-    idx = hash_lan(lan->ipmi);
-    head = &lan_list[idx];
-    lan->link.lan = lan;
-    lan->link.next = head;
-    lan->link.prev = head->prev;
-    head->prev->next = &lan->link;
-    head->prev = &lan->link;
+    for (i=0; i<LAN_HASH_STRIPES; i++) {
+	if (table[i].lock) {
+	    ipmi_destroy_lock(table[i].lock);
+	    table[i].lock = NULL;
+	}
+	if (table[i].tab) {
+	    free_htable(table[i].tab);
+	    table[i].tab = NULL;
+	}
+    }
+}
+
+/* The stripe that protects the connection's refcount and users. */
+static inline lan_hash_stripe_t *
+lan_con_stripe(lan_data_t *lan)
+{
+    return lan_hash_stripe(lan_con_hash, lan->link.hash);
+}
+
+static void lan_remove_con_ip(lan_data_t *lan);
+
+/* The IP addresses are added first, the connection cannot be used
+   from the IP table until it is in the connection table. */
+static int
+lan_add_con(lan_data_t *lan)
+{
+    lan_hash_stripe_t *stripe;
+    unsigned int      i;
+    int               rv = 0;
 
     for (i=0; i<lan->cparm.num_ip_addr; i++) {
 	struct sockaddr *addr = &lan->cparm.ip_addr[i].s_ipsock.s_addr;
+	lan_link_t      *link = &lan->ip[i].ip_link;
 
-	idx = hash_lan_addr(addr);
-
-	head = &lan_ip_list[idx];
-	lan->ip[i].ip_link.lan = lan;
-	lan->ip[i].ip_link.next = head;
-	lan->ip[i].ip_link.prev = head->prev;
-	head->prev->next = &lan->ip[i].ip_link;
-	head->prev = &lan->ip[i].ip_link;
+	link->hash = hash_lan_addr(addr);
+	stripe = lan_hash_stripe(lan_ip_hash, link->hash);
+	ipmi_lock(stripe->lock);
+	rv = lan_hash_add(stripe, link, lan);
+	ipmi_unlock(stripe->lock);
+	if (rv)
+	    goto out_err;
     }
-    ipmi_unlock(lan_list_lock);
+
+    lan->link.hash = hash_lan(lan->ipmi);
+    stripe = lan_con_stripe(lan);
+    ipmi_lock(stripe->lock);
+    rv = lan_hash_add(stripe, &lan->link, lan);
+    ipmi_unlock(stripe->lock);
+    if (rv)
+	goto out_err;
+
+    return 0;
+
+ out_err:
+    lan_remove_con_ip(lan);
+    return rv;
 }
 
-/* Must be called with the lan list lock held. */
+/* Must be called with the connection's stripe lock held.  This only
+   removes the connection from the connection table, once this is done
+   the connection cannot be found by the IP table, either.  Call
+   lan_remove_con_ip() after releasing the lock to finish the job. */
 static void
 lan_remove_con_nolock(lan_data_t *lan)
 {
-    unsigned int i;
     if (!lan->link.lan)
-	/* Hasn't been initialized. */
+	/* Hasn't been initialized or was already removed. */
 	return;
-    lan->link.prev->next = lan->link.next;
-    lan->link.next->prev = lan->link.prev;
-    lan->link.lan = NULL;
+    lan_hash_remove(lan_con_stripe(lan), &lan->link);
+}
+
+/* Must *not* be called with any stripe locks held. */
+static void
+lan_remove_con_ip(lan_data_t *lan)
+{
+    lan_hash_stripe_t *stripe;
+    unsigned int      i;
+
     for (i=0; i<lan->cparm.num_ip_addr; i++) {
-	lan->ip[i].ip_link.prev->next = lan->ip[i].ip_link.next;
-	lan->ip[i].ip_link.next->prev = lan->ip[i].ip_link.prev;
-	lan->ip[i].ip_link.lan = NULL;
+	lan_link_t *link = &lan->ip[i].ip_link;
+
+	if (!link->lan)
+	    continue;
+	stripe = lan_hash_stripe(lan_ip_hash, link->hash);
+	ipmi_lock(stripe->lock);
+	if (link->lan)
+	    lan_hash_remove(stripe, link);
+	ipmi_unlock(stripe->lock);
+    }
+}
+
+/* Called with the IP table stripe lock held, the connection was found
+   in the IP table.  Take a reference if the connection is still
+   live.  If users is set increment the user count instead. */
+static int
+lan_get_from_ip(lan_data_t *lan, int users)
+{
+    lan_hash_stripe_t *stripe = lan_con_stripe(lan);
+    int               rv = 0;
+
+    ipmi_lock(stripe->lock);
+    if (lan->link.lan) {
+	if (users)
+	    lan->users++;
+	else
+	    lan->refcount++;
+	rv = 1;
     }
+    ipmi_unlock(stripe->lock);
+    return rv;
+}
+
+static int
+lan_con_cmp(void *item, void *cb_data)
+{
+    lan_link_t *l = item;
+
+    return l->lan->ipmi == cb_data;
 }
 
 static lan_data_t *
 lan_find_con(ipmi_con_t *ipmi)
 {
-    unsigned int idx;
-    lan_link_t   *l;
+    unsigned int      hash;
+    lan_hash_stripe_t *stripe;
+    lan_link_t        *l;
+    lan_data_t        *lan = NULL;
 
-    ipmi_lock(lan_list_lock);
-    idx = hash_lan(ipmi);
-    l = lan_list[idx].next;
-    while (l->lan) {
-	if (l->lan->ipmi == ipmi)
-	    break;
-	l = l->next;
+    if (!ipmi)
+	return NULL;
+
+    hash = hash_lan(ipmi);
+    stripe = lan_hash_stripe(lan_con_hash, hash);
+    ipmi_lock(stripe->lock);
+    l = htable_find(stripe->tab, lan_hash_key(hash), lan_con_cmp, ipmi);
+    if (l) {
+	lan = l->lan;
+	lan->refcount++;
     }
-    if (l->lan)
-	l->lan->refcount++;
-    ipmi_unlock(lan_list_lock);
+    ipmi_unlock(stripe->lock);
 
-    return l->lan;
+    return lan;
 }
 
 static inline int
@@ -1506,6 +2021,12 @@ add_stat(ipmi_con_t *ipmi, int stat, int count)
     lan_data_t          *lan = ipmi->con_data;
     lan_add_stat_info_t sinfo;
 
+    __atomic_add_fetch(&lan->stat_counts[stat], count, __ATOMIC_RELAXED);
+
+    if (!__atomic_load_n(&lan->stat_handlers, __ATOMIC_RELAXED)
+	|| !__atomic_load_n(&lan->stat_push, __ATOMIC_RELAXED))
+	return;
+
     sinfo.statnum = stat;
     sinfo.count = count;
     locked_list_iterate(lan->lan_stat_list, add_stat_cb, &sinfo);
@@ -1546,20 +2067,23 @@ static void lan_cleanup(ipmi_con_t *ipmi);
 static void
 lan_put(ipmi_con_t *ipmi)
 {
-    lan_data_t *lan = ipmi->con_data;
-    int        done;
+    lan_data_t        *lan = ipmi->con_data;
+    int               done;
+    lan_hash_stripe_t *stripe = lan_con_stripe(lan);
 
-    ipmi_lock(lan_list_lock);
+    ipmi_lock(stripe->lock);
     lan->refcount--;
     done = lan->refcount == 0;
 
     /* If done, remove it before we release the lock. */
     if (done)
 	lan_remove_con_nolock(lan);
-    ipmi_unlock(lan_list_lock);
+    ipmi_unlock(stripe->lock);
 
-    if (done)
+    if (done) {
+	lan_remove_con_ip(lan);
 	lan_cleanup(ipmi);
+    }
 }
 
 static int
@@ -1604,8 +2128,33 @@ auth_check(lan_data_t    *lan,
     return rv;
 }
 
-#define IPMI_MAX_LAN_LEN    (IPMI_MAX_MSG_LENGTH + 128)
-#define IPMI_LAN_MAX_HEADER 128
+static int
+rmcpp_integ_is_std(unsigned int integ)
+{
+    return ((integ >= IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA1_96)
+	    && (integ <= IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128));
+}
+
+/* Pad so that when the pad length and the next header are added the
+   result is on a multiple of 4 boundary, then add the pad length.
+   This is the same for all the standard integrity algorithms. */
+static int
+rmcpp_std_integ_pad(unsigned char *payload,
+		    unsigned int  *payload_len,
+		    unsigned int  max_payload_len)
+{
+    unsigned int l = *payload_len;
+    unsigned int count = (4 - ((l + 2) % 4)) % 4;
+
+    if (l + count + 1 > max_payload_len)
+	return E2BIG;
+    memset(payload + l, 0xff, count);
+    l += count;
+    payload[l++] = count;
+
+    *payload_len = l;
+    return 0;
+}
 
 static int
 rmcpp_format_msg(lan_data_t *lan, int addr_num,
@@ -1721,11 +2270,14 @@ rmcpp_format_msg(lan_data_t *lan, int addr_num,
     ipmi_set_uint16(tmsg, payload_len);
 
     if (do_auth) {
-	rv = lan->ip[addr_num].integ_info->integ_pad
-	    (lan->ipmi,
-	     lan->ip[addr_num].integ_data,
-	     data, data_len,
-	     max_data_len);
+	if (lan->ip[addr_num].std_integ)
+	    rv = rmcpp_std_integ_pad(data, data_len, max_data_len);
+	else
+	    rv = lan->ip[addr_num].integ_info->integ_pad
+		(lan->ipmi,
+		 lan->ip[addr_num].integ_data,
+		 data, data_len,
+		 max_data_len);
 	if (rv)
 	    return rv;
 
@@ -1796,54 +2348,216 @@ lan15_format_msg(lan_data_t *lan, int addr_num,
     return 0;
 }
 
-static int
-lan_send_addr(lan_data_t              *lan,
-	      const ipmi_addr_t       *addr,
-	      int                     addr_len,
-	      const ipmi_msg_t        *msg,
-	      uint8_t                 seq,
-	      int                     addr_num,
-	      const ipmi_con_option_t *options)
+/* Must be called with the xmit lock held. */
+static void
+lan_fd_xmit_flush_nolock(lan_fd_t *item)
 {
-    unsigned char  data[IPMI_MAX_LAN_LEN+IPMI_LAN_MAX_HEADER];
-    unsigned char  *tmsg;
-    unsigned int   pos;
+    unsigned int   count = item->xmit_count;
+    unsigned int   i;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[IPMI_LAN_MAX_XMIT_BATCH];
+    struct iovec   iov[IPMI_LAN_MAX_XMIT_BATCH];
+    unsigned int   sent = 0;
     int            rv;
-    unsigned int   payload_type;
-    int            out_of_session = 0;
-    ipmi_payload_t *payload = NULL;
-    unsigned char  oem_iana[3] = {0, 0, 0};
-    unsigned int   oem_payload_id = 0;
 
-    if ((addr->addr_type >= IPMI_RMCPP_ADDR_START)
-	&& (addr->addr_type <= IPMI_RMCPP_ADDR_END))
-    {
-	/*
-	 * Let through the dodgy IPMI 1.5 Serial-over-LAN packets, but block
-	 * anything else that tries to send an RMCP+ packet to a non-RMCP+
-	 * host.
-	 */
-	if ((addr->addr_type != IPMI_RMCPP_ADDR_SOL)
-		&& (lan->ip[addr_num].working_authtype != IPMI_AUTHTYPE_RMCP_PLUS))
-	    return EINVAL;
-	payload_type = addr->addr_type - IPMI_RMCPP_ADDR_START;
-    } else {
-	switch (addr->addr_type) {
-	case IPMI_SYSTEM_INTERFACE_ADDR_TYPE:
-	case IPMI_IPMB_ADDR_TYPE:
-	case IPMI_IPMB_BROADCAST_ADDR_TYPE:
-	    payload_type = IPMI_RMCPP_PAYLOAD_TYPE_IPMI;
-	    break;
-	default:
-	    return EINVAL;
-	}
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    for (i=0; i<count; i++) {
+	lan_xmit_pkt_t *pkt = &item->xmit_q[i];
+
+	iov[i].iov_base = pkt->data;
+	iov[i].iov_len = pkt->len;
+	msgs[i].msg_hdr.msg_name = &pkt->addr.s_ipsock;
+	msgs[i].msg_hdr.msg_namelen = pkt->addr.ip_addr_len;
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
     }
 
-    if ((payload_type == IPMI_RMCPP_PAYLOAD_TYPE_OEM_EXPLICIT)
-	|| ((payload_type >= 0x20) && (payload_type <= 0x27)))
-    {
-	ipmi_rmcpp_addr_t *rmcpp_addr = (ipmi_rmcpp_addr_t *) addr;
-	payload_entry_t *e;
+    while (sent < count) {
+	rv = sendmmsg(item->fd, msgs + sent, count - sent, 0);
+	if (rv <= 0) {
+	    /* The first message failed, drop it and go on with the rest.
+	       This is UDP, the retransmit code will take care of it. */
+	    if (DEBUG_RAWMSG || DEBUG_MSG_ERR)
+		ipmi_log(IPMI_LOG_DEBUG, "Dropped queued message: %d", errno);
+	    sent++;
+	} else
+	    sent += rv;
+    }
+#else
+    for (i=0; i<count; i++) {
+	lan_xmit_pkt_t *pkt = &item->xmit_q[i];
+
+	sendto(item->fd, pkt->data, pkt->len, 0,
+	       (struct sockaddr *) &pkt->addr.s_ipsock,
+	       pkt->addr.ip_addr_len);
+    }
+#endif
+    item->xmit_count = 0;
+}
+
+static void
+lan_fd_xmit_flush(lan_fd_t *item)
+{
+    ipmi_lock(item->xmit_lock);
+    if (item->xmit_timer_running) {
+	/* If this fails, the timer handler is waiting on the lock and
+	   will clear the running flag itself. */
+	if (!lan_os_hnd->stop_timer(lan_os_hnd, item->xmit_timer))
+	    item->xmit_timer_running = 0;
+    }
+    if (item->xmit_count)
+	lan_fd_xmit_flush_nolock(item);
+    ipmi_unlock(item->xmit_lock);
+}
+
+static void
+lan_fd_xmit_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    lan_fd_t *item = cb_data;
+
+    ipmi_lock(item->xmit_lock);
+    item->xmit_timer_running = 0;
+    if (item->xmit_count)
+	lan_fd_xmit_flush_nolock(item);
+    ipmi_unlock(item->xmit_lock);
+}
+
+/* Queue a formatted packet on the socket.  Returns ENOMEM if the
+   queue could not be allocated, the caller should send the packet
+   directly in that case. */
+static int
+lan_fd_xmit_queue(lan_fd_t      *item,
+		  unsigned char *data,
+		  unsigned int  len,
+		  sockaddr_ip_t *addr)
+{
+    unsigned int   batch_size = lan_xmit_batch_size;
+    lan_xmit_pkt_t *pkt;
+    struct timeval tv;
+    int            rv;
+
+    ipmi_lock(item->xmit_lock);
+    if (!item->xmit_q) {
+	item->xmit_q = ipmi_mem_alloc(sizeof(lan_xmit_pkt_t)
+				      * IPMI_LAN_MAX_XMIT_BATCH);
+	if (!item->xmit_q) {
+	    ipmi_unlock(item->xmit_lock);
+	    return ENOMEM;
+	}
+	if (lan_os_hnd->alloc_timer_reactor)
+	    rv = lan_os_hnd->alloc_timer_reactor(lan_os_hnd, item->reactor,
+						 &item->xmit_timer);
+	else
+	    rv = lan_os_hnd->alloc_timer(lan_os_hnd, &item->xmit_timer);
+	if (rv) {
+	    ipmi_mem_free(item->xmit_q);
+	    item->xmit_q = NULL;
+	    ipmi_unlock(item->xmit_lock);
+	    return ENOMEM;
+	}
+    }
+
+    /* The batch size may have been lowered while packets were queued. */
+    if (item->xmit_count >= batch_size)
+	lan_fd_xmit_flush_nolock(item);
+
+    pkt = &item->xmit_q[item->xmit_count];
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+    pkt->addr = *addr;
+    item->xmit_count++;
+
+    if (item->xmit_count >= batch_size) {
+	lan_fd_xmit_flush_nolock(item);
+    } else if (!item->xmit_timer_running) {
+	tv.tv_sec = lan_xmit_max_delay / 1000000;
+	tv.tv_usec = lan_xmit_max_delay % 1000000;
+	rv = lan_os_hnd->start_timer(lan_os_hnd, item->xmit_timer, &tv,
+				     lan_fd_xmit_timeout, item);
+	if (rv)
+	    /* Can't wait, so don't. */
+	    lan_fd_xmit_flush_nolock(item);
+	else
+	    item->xmit_timer_running = 1;
+    }
+    ipmi_unlock(item->xmit_lock);
+
+    return 0;
+}
+
+int
+ipmi_lan_set_xmit_batch(unsigned int batch_size, unsigned int max_delay)
+{
+    if ((batch_size == 0) || (batch_size > IPMI_LAN_MAX_XMIT_BATCH))
+	return EINVAL;
+    if (max_delay > IPMI_LAN_MAX_XMIT_DELAY)
+	return EINVAL;
+#ifndef HAVE_SENDMMSG
+    if (batch_size > 1)
+	return ENOSYS;
+#endif
+    lan_xmit_max_delay = max_delay;
+    lan_xmit_batch_size = batch_size;
+    return 0;
+}
+
+void
+ipmi_lan_get_xmit_batch(unsigned int *batch_size, unsigned int *max_delay)
+{
+    if (batch_size)
+	*batch_size = lan_xmit_batch_size;
+    if (max_delay)
+	*max_delay = lan_xmit_max_delay;
+}
+
+static int
+lan_send_addr(lan_data_t              *lan,
+	      const ipmi_addr_t       *addr,
+	      int                     addr_len,
+	      const ipmi_msg_t        *msg,
+	      uint8_t                 seq,
+	      int                     addr_num,
+	      const ipmi_con_option_t *options)
+{
+    unsigned char  data[IPMI_MAX_LAN_LEN+IPMI_LAN_MAX_HEADER];
+    unsigned char  *tmsg;
+    unsigned int   pos;
+    int            rv;
+    unsigned int   payload_type;
+    int            out_of_session = 0;
+    ipmi_payload_t *payload = NULL;
+    unsigned char  oem_iana[3] = {0, 0, 0};
+    unsigned int   oem_payload_id = 0;
+
+    if ((addr->addr_type >= IPMI_RMCPP_ADDR_START)
+	&& (addr->addr_type <= IPMI_RMCPP_ADDR_END))
+    {
+	/*
+	 * Let through the dodgy IPMI 1.5 Serial-over-LAN packets, but block
+	 * anything else that tries to send an RMCP+ packet to a non-RMCP+
+	 * host.
+	 */
+	if ((addr->addr_type != IPMI_RMCPP_ADDR_SOL)
+		&& (lan->ip[addr_num].working_authtype != IPMI_AUTHTYPE_RMCP_PLUS))
+	    return EINVAL;
+	payload_type = addr->addr_type - IPMI_RMCPP_ADDR_START;
+    } else {
+	switch (addr->addr_type) {
+	case IPMI_SYSTEM_INTERFACE_ADDR_TYPE:
+	case IPMI_IPMB_ADDR_TYPE:
+	case IPMI_IPMB_BROADCAST_ADDR_TYPE:
+	    payload_type = IPMI_RMCPP_PAYLOAD_TYPE_IPMI;
+	    break;
+	default:
+	    return EINVAL;
+	}
+    }
+
+    if ((payload_type == IPMI_RMCPP_PAYLOAD_TYPE_OEM_EXPLICIT)
+	|| ((payload_type >= 0x20) && (payload_type <= 0x27)))
+    {
+	ipmi_rmcpp_addr_t *rmcpp_addr = (ipmi_rmcpp_addr_t *) addr;
+	payload_entry_t *e;
 
 	if (payload_type == IPMI_RMCPP_PAYLOAD_TYPE_OEM_EXPLICIT) {
 	    memcpy(oem_iana, rmcpp_addr->oem_iana, 3);
@@ -1919,6 +2633,11 @@ lan_send_addr(lan_data_t              *lan,
 
     add_stat(lan->ipmi, STAT_XMIT_PACKETS, 1);
 
+    if ((lan_xmit_batch_size > 1)
+	&& (lan_fd_xmit_queue(lan->fd, tmsg, pos,
+			      &lan->cparm.ip_addr[addr_num]) == 0))
+	return 0;
+
     rv = sendto(lan->fd->fd, tmsg, pos, 0,
 		(struct sockaddr *) &(lan->cparm.ip_addr[addr_num].s_ipsock),
 		lan->cparm.ip_addr[addr_num].ip_addr_len);
@@ -2079,6 +2798,32 @@ ipmb_handler(ipmi_con_t   *ipmi,
     }
 }
 
+/* Returns true if every working address has had a response within
+   the last audit period, so there is no need to send a keepalive. */
+static int
+lan_recent_traffic(ipmi_con_t *ipmi, lan_data_t *lan)
+{
+    struct timeval now, diff;
+    unsigned int   i;
+    int            working = 0;
+    int            recent = 1;
+
+    ipmi->os_hnd->get_monotonic_time(ipmi->os_hnd, &now);
+    ipmi_lock(lan->seq_num_lock);
+    for (i=0; i<lan->cparm.num_ip_addr; i++) {
+	if (!lan->ip[i].working)
+	    continue;
+	working = 1;
+	diff_timeval(&diff, &now, &lan->ip[i].last_rsp_time);
+	if ((diff.tv_sec * 1000000 + diff.tv_usec) >= LAN_AUDIT_TIMEOUT) {
+	    recent = 0;
+	    break;
+	}
+    }
+    ipmi_unlock(lan->seq_num_lock);
+    return working && recent;
+}
+
 static void
 audit_timeout_handler(void              *cb_data,
 		      os_hnd_timer_id_t *id)
@@ -2112,7 +2857,7 @@ audit_timeout_handler(void              *cb_data,
 
     for (i=0; i<lan->cparm.num_ip_addr; i++) {
 	if (start_up[i])
-	    send_auth_cap(ipmi, lan, i, 0);
+	    lan_estab_start(ipmi, lan, i);
     }
 
     msg.netfn = IPMI_APP_NETFN;
@@ -2123,8 +2868,13 @@ audit_timeout_handler(void              *cb_data,
     /* Send a message to check the working of the interface. */
     if (ipmi->get_ipmb_addr) {
 	/* If we have a way to query the IPMB address, do so
-           periodically. */
+           periodically.  This also tracks IPMB address changes, so
+           it is always done. */
 	ipmi->get_ipmb_addr(ipmi, ipmb_handler, NULL);
+    } else if (lan_recent_traffic(ipmi, lan)) {
+	/* Responses to other messages already show the connection
+	   is alive. */
+	add_stat(ipmi, STAT_AUDITS_SKIPPED, 1);
     } else {
 	si.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
 	si.channel = 0xf;
@@ -2299,6 +3049,7 @@ reset_session_data(lan_data_t *lan, int addr_num)
     ip->integ_info = NULL;
     ip->working_conf = IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE;
     ip->working_integ = IPMI_LANP_INTEGRITY_ALGORITHM_NONE;
+    ip->std_integ = 0;
 }
 
 static void
@@ -2353,6 +3104,338 @@ lost_connection(lan_data_t *lan, unsigned int addr_num)
     }
 }
 
+/* Get the timeout to use for the message in the given sequence slot.
+   Must be called with seq_num_lock held. */
+static void
+lan_get_rsp_timeout(lan_data_t *lan, unsigned int seq, struct timeval *tv)
+{
+    long timeout;
+
+    if (lan->seq_table[seq].side_effects)
+	timeout = LAN_RSP_TIMEOUT_SIDEEFF;
+    else if (lan->rtt_adaptive)
+	timeout = lan->seq_table[seq].rsp_timeout;
+    else
+	timeout = LAN_RSP_TIMEOUT;
+    tv->tv_sec = timeout / 1000000;
+    tv->tv_usec = timeout % 1000000;
+}
+
+static long
+lan_clamp_rto(lan_data_t *lan, long rto)
+{
+    if (rto < lan->rto_min)
+	return lan->rto_min;
+    if (rto > lan->rto_max)
+	return lan->rto_max;
+    return rto;
+}
+
+/* For timestamps that don't need to be exact, a time read a little
+   earlier in the event loop is good enough and saves a clock read per
+   message. */
+static void
+lan_cached_time(ipmi_con_t *ipmi, struct timeval *tv)
+{
+    os_handler_t *os_hnd = ipmi->os_hnd;
+
+    if (os_hnd->get_cached_monotonic_time)
+	os_hnd->get_cached_monotonic_time(os_hnd, tv);
+    else
+	os_hnd->get_monotonic_time(os_hnd, tv);
+}
+
+/* Convert a deadline option (milliseconds from now) to the time it
+   expires. */
+static void
+lan_set_deadline(ipmi_con_t *ipmi, long msec, struct timeval *deadline)
+{
+    ipmi->os_hnd->get_monotonic_time(ipmi->os_hnd, deadline);
+    deadline->tv_sec += msec / 1000;
+    deadline->tv_usec += (msec % 1000) * 1000;
+    if (deadline->tv_usec >= 1000000) {
+	deadline->tv_sec += 1;
+	deadline->tv_usec -= 1000000;
+    }
+}
+
+/* Is there no chance that a message with this deadline, sent now,
+   gets its response back in time?  Once the round-trip time has been
+   measured, a message needs at least that long.  Must be called with
+   seq_num_lock held. */
+static int
+lan_deadline_missed(ipmi_con_t *ipmi, lan_data_t *lan,
+		    int has_deadline, struct timeval *deadline)
+{
+    struct timeval now;
+
+    if (!has_deadline)
+	return 0;
+
+    ipmi->os_hnd->get_monotonic_time(ipmi->os_hnd, &now);
+    if (lan->rtt_samples) {
+	now.tv_sec += lan->srtt / 1000000;
+	now.tv_usec += lan->srtt % 1000000;
+	if (now.tv_usec >= 1000000) {
+	    now.tv_sec += 1;
+	    now.tv_usec -= 1000000;
+	}
+    }
+    return cmp_timeval(&now, deadline) >= 0;
+}
+
+/* Don't let a message's response timer run past its deadline, there
+   is nobody waiting after that.  Must be called with seq_num_lock
+   held. */
+static void
+lan_deadline_timeout(ipmi_con_t *ipmi, lan_data_t *lan, unsigned int seq,
+		     struct timeval *timeout)
+{
+    struct timeval now, left;
+
+    lan->seq_table[seq].deadline_timer = 0;
+    if (!lan->seq_table[seq].has_deadline)
+	return;
+
+    ipmi->os_hnd->get_monotonic_time(ipmi->os_hnd, &now);
+    diff_timeval(&left, &lan->seq_table[seq].deadline, &now);
+    if (cmp_timeval(&left, timeout) < 0) {
+	*timeout = left;
+	lan->seq_table[seq].deadline_timer = 1;
+    }
+}
+
+/* A response matched the message in the given sequence slot, feed its
+   round-trip time to the estimator.  Must be called with seq_num_lock
+   held. */
+static void
+lan_rtt_sample(ipmi_con_t *ipmi, lan_data_t *lan, unsigned int seq)
+{
+    struct timeval now, diff;
+    long           rtt, delta;
+
+    /* A response to a resent message can't be tied to one particular
+       send (Karn's algorithm), and messages with side effects mostly
+       measure how long the BMC takes to do the operation. */
+    if (lan->seq_table[seq].rexmitted || lan->seq_table[seq].side_effects)
+	return;
+
+    lan_cached_time(ipmi, &now);
+    diff_timeval(&diff, &now, &lan->seq_table[seq].send_time);
+    rtt = diff.tv_sec * 1000000 + diff.tv_usec;
+
+    if (lan->rtt_samples == 0) {
+	lan->srtt = rtt;
+	lan->rttvar = rtt / 2;
+    } else {
+	delta = rtt - lan->srtt;
+	lan->srtt += delta / 8;
+	if (delta < 0)
+	    delta = -delta;
+	lan->rttvar += (delta - lan->rttvar) / 4;
+    }
+    lan->rtt_samples++;
+    lan->rto = lan_clamp_rto(lan, lan->srtt + 4 * lan->rttvar);
+
+    add_stat(ipmi, STAT_RTT_SAMPLES, 1);
+    add_stat(ipmi, STAT_RTT_USEC, rtt);
+}
+
+int
+ipmi_lan_get_rtt_info(ipmi_con_t *ipmi, ipmi_lan_rtt_info_t *info)
+{
+    lan_data_t *lan;
+
+    if (!lan_valid_ipmi(ipmi))
+	return EINVAL;
+
+    lan = ipmi->con_data;
+    ipmi_lock(lan->seq_num_lock);
+    info->adaptive = lan->rtt_adaptive;
+    info->samples = lan->rtt_samples;
+    info->srtt = lan->srtt;
+    info->rttvar = lan->rttvar;
+    info->rto = lan->rto;
+    ipmi_unlock(lan->seq_num_lock);
+    lan_put(ipmi);
+    return 0;
+}
+
+/* Return the current limit on outstanding messages.  Must be called
+   with seq_num_lock held. */
+static unsigned int
+lan_msg_window(lan_data_t *lan)
+{
+    if (lan->msg_window_adaptive)
+	return lan->msg_window;
+    return lan->max_outstanding_msg_count;
+}
+
+/* A clean response came in for the message in the given slot.  Only
+   grow the window if it is actually limiting us, otherwise a
+   connection used one message at a time would open it all the way.
+   Must be called with seq_num_lock held. */
+static void
+lan_msg_window_grow(lan_data_t *lan, unsigned int seq)
+{
+    if (!lan->msg_window_adaptive || lan->seq_table[seq].rexmitted)
+	return;
+    if (lan->msg_window >= lan->max_outstanding_msg_count)
+	return;
+    if (lan->outstanding_msg_count < lan->msg_window)
+	return;
+
+    lan->msg_window_acked++;
+    if (lan->msg_window_acked >= lan->msg_window) {
+	lan->msg_window_acked = 0;
+	lan->msg_window++;
+    }
+}
+
+/* Halve the window because of a loss seen on a message sent at the
+   given epoch.  Must be called with seq_num_lock held. */
+static void
+lan_msg_window_cut(lan_data_t *lan, unsigned int epoch)
+{
+    if (!lan->msg_window_adaptive)
+	return;
+    /* Already cut for a message sent after this one. */
+    if ((int) (epoch - lan->window_cut_epoch) <= 0)
+	return;
+
+    lan->window_cut_epoch = lan->send_epoch;
+    lan->msg_window /= 2;
+    if (lan->msg_window < 1)
+	lan->msg_window = 1;
+    lan->msg_window_acked = 0;
+    add_stat(lan->ipmi, STAT_WINDOW_CUTS, 1);
+}
+
+/* Is the message to the given address bridged onto the IPMB by the
+   BMC?  Messages to the BMC's own IPMB address are sent to the system
+   interface instead, so they are not. */
+static int
+lan_addr_is_bridged(lan_data_t *lan, const ipmi_addr_t *addr)
+{
+    const ipmi_ipmb_addr_t *ipmb = (const ipmi_ipmb_addr_t *) addr;
+
+    if ((addr->addr_type != IPMI_IPMB_ADDR_TYPE)
+	&& (addr->addr_type != IPMI_IPMB_BROADCAST_ADDR_TYPE))
+	return 0;
+    if (ipmb->channel >= MAX_IPMI_USED_CHANNELS)
+	return 0;
+    return ipmb->slave_addr != lan->slave_addr[ipmb->channel];
+}
+
+/* Can a message to the given address be started now?  Must be called
+   with seq_num_lock held. */
+static int
+lan_can_start(lan_data_t *lan, const ipmi_addr_t *addr)
+{
+    if (lan->outstanding_msg_count >= lan_msg_window(lan))
+	return 0;
+    if ((lan->bridge_outstanding >= lan->bridge_window)
+	&& lan_addr_is_bridged(lan, addr))
+	return 0;
+    return 1;
+}
+
+/* The message in the given slot is finished, give up its bridge
+   slot if it has one.  Must be called with seq_num_lock held. */
+static void
+lan_bridge_done(lan_data_t *lan, unsigned int seq)
+{
+    if (!lan->seq_table[seq].bridged)
+	return;
+    lan->seq_table[seq].bridged = 0;
+    lan->bridge_outstanding--;
+}
+
+/* A bridged message got a clean response, grow the bridge window if
+   it is limiting us.  Must be called with seq_num_lock held. */
+static void
+lan_bridge_window_grow(lan_data_t *lan, unsigned int seq)
+{
+    if (!lan->seq_table[seq].bridged)
+	return;
+    if (lan->bridge_window >= lan->max_outstanding_msg_count)
+	return;
+    if (lan->bridge_outstanding < lan->bridge_window)
+	return;
+
+    lan->bridge_acked++;
+    if (lan->bridge_acked >= lan->bridge_window) {
+	lan->bridge_acked = 0;
+	lan->bridge_window++;
+    }
+}
+
+unsigned int
+ipmi_lan_num_stats(void)
+{
+    return NUM_STATS;
+}
+
+const char *
+ipmi_lan_stat_name(unsigned int stat)
+{
+    if (stat >= NUM_STATS)
+	return NULL;
+    return lan_stat_names[stat];
+}
+
+int
+ipmi_lan_get_stats(ipmi_con_t    *ipmi,
+		   unsigned long *stats,
+		   unsigned int  *num_stats)
+{
+    lan_data_t   *lan;
+    unsigned int i;
+
+    if (!lan_valid_ipmi(ipmi))
+	return EINVAL;
+
+    lan = ipmi->con_data;
+    for (i=0; (i<*num_stats) && (i<NUM_STATS); i++)
+	stats[i] = __atomic_load_n(&lan->stat_counts[i], __ATOMIC_RELAXED);
+    *num_stats = NUM_STATS;
+    lan_put(ipmi);
+    return 0;
+}
+
+int
+ipmi_lan_set_stat_push(ipmi_con_t *ipmi, int push)
+{
+    lan_data_t *lan;
+
+    if (!lan_valid_ipmi(ipmi))
+	return EINVAL;
+
+    lan = ipmi->con_data;
+    __atomic_store_n(&lan->stat_push, push != 0, __ATOMIC_RELAXED);
+    lan_put(ipmi);
+    return 0;
+}
+
+int
+ipmi_lan_get_msg_window(ipmi_con_t   *ipmi,
+			unsigned int *window,
+			unsigned int *max_window)
+{
+    lan_data_t *lan;
+
+    if (!lan_valid_ipmi(ipmi))
+	return EINVAL;
+
+    lan = ipmi->con_data;
+    ipmi_lock(lan->seq_num_lock);
+    *window = lan_msg_window(lan);
+    *max_window = lan->max_outstanding_msg_count;
+    ipmi_unlock(lan->seq_num_lock);
+    lan_put(ipmi);
+    return 0;
+}
+
 static void
 rsp_timeout_handler(void              *cb_data,
 		    os_hnd_timer_id_t *id)
@@ -2403,7 +3486,8 @@ rsp_timeout_handler(void              *cb_data,
 		 lan->ip[ip_num].failure_time.tv_usec);
     }
 
-    if (lan->seq_table[seq].addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+    if ((lan->seq_table[seq].addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	&& !lan->seq_table[seq].deadline_timer)
     {
 	/* We only count timeouts on messages to the system interface.
            Otherwise, if we sent a bunch of messages to the IPMB that
@@ -2447,12 +3531,32 @@ rsp_timeout_handler(void              *cb_data,
 
     rspi = lan->seq_table[seq].rsp_item;
 
+    /* Like the failure detection above, only messages to the system
+       interface are a sign of loss, IPMB messages may just be to
+       something that isn't there.  A timer cut short by the
+       deadline says nothing about the link. */
+    if ((lan->seq_table[seq].addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	&& !lan->seq_table[seq].deadline_timer)
+	lan_msg_window_cut(lan, lan->seq_table[seq].send_epoch);
+
+    if ((lan->seq_table[seq].retries_left > 0)
+	&& lan_deadline_missed(ipmi, lan, lan->seq_table[seq].has_deadline,
+			       &lan->seq_table[seq].deadline))
+    {
+	/* A resend could not make it back in time, give up now. */
+	lan->seq_table[seq].retries_left = 0;
+	add_stat(ipmi, STAT_DEADLINE_MISSED, 1);
+    }
+
     if (lan->seq_table[seq].retries_left > 0)
     {
 	struct timeval timeout;
 	int            rv;
 
 	lan->seq_table[seq].retries_left--;
+	lan->seq_table[seq].rexmitted++;
+	lan->seq_table[seq].rsp_timeout
+	    = lan_clamp_rto(lan, lan->seq_table[seq].rsp_timeout * 2);
 
 	add_stat(ipmi, STAT_REXMITS, 1);
 
@@ -2481,13 +3585,11 @@ rsp_timeout_handler(void              *cb_data,
 	       error. */
 	    rspi->data[0] = IPMI_UNKNOWN_ERR_CC;
 	} else {
-	    if (!lan->seq_table[seq].side_effects) {
-		timeout.tv_sec = LAN_RSP_TIMEOUT / 1000000;
-		timeout.tv_usec = LAN_RSP_TIMEOUT % 1000000;
-	    } else {
-		timeout.tv_sec = LAN_RSP_TIMEOUT_SIDEEFF / 1000000;
-		timeout.tv_usec = LAN_RSP_TIMEOUT_SIDEEFF % 1000000;
-	    }
+	    IPMI_TRACE(IPMI_TRACE_MSG_RESEND, ipmi, NULL, &lan->seq_table[seq],
+		       seq, lan->seq_table[seq].msg.netfn,
+		       lan->seq_table[seq].msg.cmd);
+	    lan_get_rsp_timeout(lan, seq, &timeout);
+	    lan_deadline_timeout(ipmi, lan, seq, &timeout);
 	    ipmi->os_hnd->start_timer(ipmi->os_hnd,
 				      id,
 				      &timeout,
@@ -2502,6 +3604,13 @@ rsp_timeout_handler(void              *cb_data,
 	}
     } else {
 	add_stat(ipmi, STAT_TIMED_OUT, 1);
+	if (ipmi->latency)
+	    ipmi_con_latency_add(ipmi, lan->seq_table[seq].msg.netfn,
+				 lan->seq_table[seq].msg.cmd, 0,
+				 lan->seq_table[seq].rexmitted, 1);
+	IPMI_TRACE(IPMI_TRACE_MSG_TIMEOUT, ipmi, NULL, &lan->seq_table[seq],
+		   seq, lan->seq_table[seq].msg.netfn,
+		   lan->seq_table[seq].msg.cmd);
 
 	rspi->data[0] = IPMI_TIMEOUT_CC;
     }
@@ -2526,12 +3635,11 @@ rsp_timeout_handler(void              *cb_data,
     handler = lan->seq_table[seq].rsp_handler;
 
     lan->seq_table[seq].inuse = 0;
+    lan_bridge_done(lan, seq);
 
     check_command_queue(ipmi, lan);
     ipmi_unlock(lan->seq_num_lock);
 
-    ipmi->os_hnd->free_timer(ipmi->os_hnd, id);
-
     /* Convert broadcasts back into normal sends. */
     if (rspi->addr.addr_type == IPMI_IPMB_BROADCAST_ADDR_TYPE)
 	rspi->addr.addr_type = IPMI_IPMB_ADDR_TYPE;
@@ -2542,8 +3650,8 @@ rsp_timeout_handler(void              *cb_data,
     ipmi_handle_rsp_item(ipmi, rspi, handler);
 
  out:
+    lan_put_timer_info(lan, info);
     lan_put(ipmi);
-    ipmi_mem_free(info);
 }
 
 typedef struct call_event_handler_s
@@ -2642,7 +3750,8 @@ handle_msg_send(lan_timer_info_t      *info,
 		const ipmi_msg_t      *msg,
 		ipmi_ll_rsp_handler_t rsp_handler,
 		ipmi_msgi_t           *rspi,
-		int                   side_effects)
+		int                   side_effects,
+		struct timeval        *deadline)
 {
     ipmi_con_t        *ipmi = info->ipmi;
     lan_data_t        *lan = ipmi->con_data;
@@ -2699,8 +3808,7 @@ handle_msg_send(lan_timer_info_t      *info,
 	ipmi_ipmb_addr_t *ipmb = (ipmi_ipmb_addr_t *) addr;
 
 	if (ipmb->channel >= MAX_IPMI_USED_CHANNELS) {
-	    ipmi->os_hnd->free_timer(ipmi->os_hnd, info->timer);
-	    ipmi_mem_free(info);
+	    lan_put_timer_info(lan, info);
 	    rv = EINVAL;
 	    goto out;
 	}
@@ -2732,6 +3840,13 @@ handle_msg_send(lan_timer_info_t      *info,
     lan->seq_table[seq].msg.data = lan->seq_table[seq].data;
     memcpy(lan->seq_table[seq].data, msg->data, msg->data_len);
     lan->seq_table[seq].timer_info = info;
+    lan->seq_table[seq].rexmitted = 0;
+    lan->seq_table[seq].bridged = 0;
+    lan->seq_table[seq].busy_retries = 0;
+    lan->seq_table[seq].has_deadline = deadline != NULL;
+    if (deadline)
+	lan->seq_table[seq].deadline = *deadline;
+    lan->seq_table[seq].rsp_timeout = lan->rto;
     if (addr->addr_type == IPMI_IPMB_BROADCAST_ADDR_TYPE)
 	lan->seq_table[seq].retries_left = 0;
     else
@@ -2747,13 +3862,8 @@ handle_msg_send(lan_timer_info_t      *info,
 	lan->seq_table[seq].use_orig_addr = 0;
     }
 
-    if (!side_effects) {
-	timeout.tv_sec = LAN_RSP_TIMEOUT / 1000000;
-	timeout.tv_usec = LAN_RSP_TIMEOUT % 1000000;
-    } else {
-	timeout.tv_sec = LAN_RSP_TIMEOUT_SIDEEFF / 1000000;
-	timeout.tv_usec = LAN_RSP_TIMEOUT_SIDEEFF % 1000000;
-    }
+    lan_get_rsp_timeout(lan, seq, &timeout);
+    lan_deadline_timeout(ipmi, lan, seq, &timeout);
     lan->seq_table[seq].timer = info->timer;
     rv = ipmi->os_hnd->start_timer(ipmi->os_hnd,
 				   lan->seq_table[seq].timer,
@@ -2762,15 +3872,16 @@ handle_msg_send(lan_timer_info_t      *info,
 				   info);
     if (rv) {
 	lan->seq_table[seq].inuse = 0;
-	ipmi->os_hnd->free_timer(ipmi->os_hnd,
-				 lan->seq_table[seq].timer);
 	lan->seq_table[seq].timer = NULL;
-	ipmi_mem_free(info);
+	lan_put_timer_info(lan, info);
 	goto out;
     }
 
     lan->last_seq = seq;
 
+    lan->send_epoch++;
+    lan->seq_table[seq].send_epoch = lan->send_epoch;
+    lan_cached_time(ipmi, &lan->seq_table[seq].send_time);
     if (addr_num >= 0) {
 	rv = lan_send_addr(lan, addr, addr_len, msg, seq, addr_num, NULL);
 	lan->seq_table[seq].last_ip_num = addr_num;
@@ -2791,34 +3902,105 @@ handle_msg_send(lan_timer_info_t      *info,
 	if (err) {
 	    info->cancelled = 1;
 	} else {
-	    ipmi->os_hnd->free_timer(ipmi->os_hnd,
-				     lan->seq_table[seq].timer);
 	    lan->seq_table[seq].timer = NULL;
-	    ipmi_mem_free(info);
+	    lan_put_timer_info(lan, info);
 	}
+    } else {
+	if (lan_addr_is_bridged(lan, addr)) {
+	    lan->seq_table[seq].bridged = 1;
+	    lan->bridge_outstanding++;
+	}
+	IPMI_TRACE(IPMI_TRACE_MSG_SEND, ipmi, NULL, &lan->seq_table[seq], seq,
+		   msg->netfn, msg->cmd);
     }
  out:
     return rv;
 }
 
+/* Fail a message from the wait queue without sending it.  Must be
+   called with seq_num_lock held, it is released while the response
+   is delivered. */
+static void
+lan_fail_queued(ipmi_con_t *ipmi, lan_data_t *lan, lan_wait_queue_t *q_item,
+		unsigned char cc)
+{
+    ipmi_unlock(lan->seq_num_lock);
+    lan_put_timer_info(lan, q_item->info);
+    q_item->info = NULL;
+    q_item->msg.netfn |= 1; /* Convert it to a response. */
+    q_item->msg.data[0] = cc;
+    q_item->msg.data_len = 1;
+    ipmi_handle_rsp_item_copyall(ipmi, q_item->rsp_item,
+				 &q_item->addr, q_item->addr_len,
+				 &q_item->msg, q_item->rsp_handler);
+    ipmi_mem_free(q_item);
+    ipmi_lock(lan->seq_num_lock);
+}
+
+/* Take out everything waiting that can no longer be answered by its
+   deadline, so it doesn't use up a slot when it gets to the front.
+   Must be called with seq_num_lock held, it may be released. */
+static void
+lan_drop_late_queued(ipmi_con_t *ipmi, lan_data_t *lan)
+{
+    lan_wait_queue_t *q_item, *prev;
+
+ restart:
+    prev = NULL;
+    for (q_item = lan->wait_q; q_item; prev = q_item, q_item = q_item->next) {
+	if (!lan_deadline_missed(ipmi, lan, q_item->has_deadline,
+				 &q_item->deadline))
+	    continue;
+
+	if (prev)
+	    prev->next = q_item->next;
+	else
+	    lan->wait_q = q_item->next;
+	if (lan->wait_q_tail == q_item)
+	    lan->wait_q_tail = prev;
+	add_stat(ipmi, STAT_DEADLINE_MISSED, 1);
+	lan_fail_queued(ipmi, lan, q_item, IPMI_TIMEOUT_CC);
+	goto restart;
+    }
+}
+
 static void
 check_command_queue(ipmi_con_t *ipmi, lan_data_t *lan)
 {
     int              rv;
-    lan_wait_queue_t *q_item;
-    int              started = 0;
+    lan_wait_queue_t *q_item, *prev;
+
+    /* The message that just finished gives up its slot, then start as
+       many waiting messages as the window allows.  Normally that is
+       just one, to replace the finished message, but an adaptive
+       window may have grown or shrunk.  Bridged messages waiting on
+       the bridge window are skipped so they don't hold up messages
+       behind them. */
+    lan->outstanding_msg_count--;
+    lan_drop_late_queued(ipmi, lan);
+    prev = NULL;
+    q_item = lan->wait_q;
+    while ((q_item != NULL)
+	   && (lan->outstanding_msg_count < lan_msg_window(lan)))
+    {
+	if (!lan_can_start(lan, &q_item->addr)) {
+	    prev = q_item;
+	    q_item = q_item->next;
+	    continue;
+	}
 
-    while (!started && (lan->wait_q != NULL)) {
-	/* Commands are waiting to be started, remove the queue item
-           and start it. */
-	q_item = lan->wait_q;
-	lan->wait_q = q_item->next;
-	if (lan->wait_q == NULL)
-	    lan->wait_q_tail = NULL;
+	/* Remove the queue item and start it. */
+	if (prev)
+	    prev->next = q_item->next;
+	else
+	    lan->wait_q = q_item->next;
+	if (lan->wait_q_tail == q_item)
+	    lan->wait_q_tail = prev;
 
 	rv = handle_msg_send(q_item->info, -1, &q_item->addr, q_item->addr_len,
 			     &(q_item->msg), q_item->rsp_handler,
-			     q_item->rsp_item, q_item->side_effects);
+			     q_item->rsp_item, q_item->side_effects,
+			     q_item->has_deadline ? &q_item->deadline : NULL);
 	if (rv) {
 	    ipmi_unlock(lan->seq_num_lock);
 
@@ -2837,14 +4019,16 @@ check_command_queue(ipmi_con_t *ipmi, lan_data_t *lan)
 					 &q_item->msg, q_item->rsp_handler);
 	    ipmi_lock(lan->seq_num_lock);
 	} else {
-	    /* We successfully sent a message, break out of the loop. */
-	    started = 1;
+	    lan->outstanding_msg_count++;
+	    lan->seq_table[q_item->info->seq].busy_retries
+		= q_item->busy_retries;
 	}
 	ipmi_mem_free(q_item);
-    }
 
-    if (!started)
-	lan->outstanding_msg_count--;
+	/* The lock may have been dropped, start over at the head. */
+	prev = NULL;
+	q_item = lan->wait_q;
+    }
 }
 
 /* Per the spec, RMCP and RMCP+ have different allowed sequence number
@@ -2881,12 +4065,23 @@ check_session_seq_num(lan_data_t *lan, uint32_t seq,
 	if (DEBUG_RAWMSG || DEBUG_MSG_ERR)
 	    ipmi_log(IPMI_LOG_DEBUG, "%sDropped message out of seq range",
 		     IPMI_CONN_NAME(lan->ipmi));
-	return EINVAL;
+	return ERANGE;
     }
 
     return 0;
 }
 
+/* A packet came in outside the session sequence range, so we have
+   likely lost some.  Called without ip_lock held, it nests inside
+   seq_num_lock. */
+static void
+lan_seq_range_loss(lan_data_t *lan)
+{
+    ipmi_lock(lan->seq_num_lock);
+    lan_msg_window_cut(lan, lan->send_epoch);
+    ipmi_unlock(lan->seq_num_lock);
+}
+
 static int
 check_15_session_seq_num(lan_data_t *lan, uint32_t seq,
 			 uint32_t *in_seq, uint32_t *map)
@@ -2901,6 +4096,73 @@ check_20_session_seq_num(lan_data_t *lan, uint32_t seq,
     return check_session_seq_num(lan, seq, in_seq, map, 15, 16);
 }
 
+/* If the response is the BMC saying it is too busy to bridge the
+   message in the given slot, shrink the bridge window to what the BMC
+   is carrying and put the message back at the head of the wait queue.
+   Returns 1 if the message was requeued, 0 to handle the response
+   normally.  Must be called with seq_num_lock held. */
+static int
+lan_bridge_busy(ipmi_con_t    *ipmi,
+		lan_data_t    *lan,
+		unsigned int  seq,
+		unsigned char *tmsg,
+		unsigned int  payload_len)
+{
+    lan_wait_queue_t *q_item;
+
+    if ((payload_len < 7)
+	|| (tmsg[5] != IPMI_SEND_MSG_CMD)
+	|| ((tmsg[1] >> 2) != (IPMI_APP_NETFN | 1))
+	|| (tmsg[6] != IPMI_NODE_BUSY_CC))
+	return 0;
+
+    add_stat(ipmi, STAT_BRIDGE_BUSY, 1);
+    lan->bridge_window = lan->bridge_outstanding - 1;
+    if (lan->bridge_window < 1)
+	lan->bridge_window = 1;
+    lan->bridge_acked = 0;
+
+    if (lan->seq_table[seq].busy_retries >= LAN_BRIDGE_BUSY_RETRIES)
+	/* Give up and pass the busy error to the user. */
+	return 0;
+
+    q_item = ipmi_mem_alloc(sizeof(*q_item));
+    if (!q_item)
+	return 0;
+
+    /* The timer info goes with the message, so it must be stopped. */
+    if (ipmi->os_hnd->stop_timer(ipmi->os_hnd, lan->seq_table[seq].timer)) {
+	ipmi_mem_free(q_item);
+	return 0;
+    }
+
+    q_item->info = lan->seq_table[seq].timer_info;
+    memcpy(&q_item->addr, &lan->seq_table[seq].addr,
+	   lan->seq_table[seq].addr_len);
+    q_item->addr_len = lan->seq_table[seq].addr_len;
+    q_item->msg = lan->seq_table[seq].msg;
+    q_item->msg.data = q_item->data;
+    memcpy(q_item->data, lan->seq_table[seq].data,
+	   lan->seq_table[seq].msg.data_len);
+    q_item->rsp_handler = lan->seq_table[seq].rsp_handler;
+    q_item->rsp_item = lan->seq_table[seq].rsp_item;
+    q_item->side_effects = lan->seq_table[seq].side_effects;
+    q_item->busy_retries = lan->seq_table[seq].busy_retries + 1;
+    q_item->has_deadline = lan->seq_table[seq].has_deadline;
+    q_item->deadline = lan->seq_table[seq].deadline;
+
+    /* It was the BMC that was busy, not a loss, so it goes first. */
+    q_item->next = lan->wait_q;
+    lan->wait_q = q_item;
+    if (lan->wait_q_tail == NULL)
+	lan->wait_q_tail = q_item;
+
+    lan->seq_table[seq].inuse = 0;
+    lan_bridge_done(lan, seq);
+    check_command_queue(ipmi, lan);
+    return 1;
+}
+
 static void
 handle_payload(ipmi_con_t    *ipmi,
 	       lan_data_t    *lan,
@@ -2967,6 +4229,11 @@ handle_payload(ipmi_con_t    *ipmi,
 	goto out_unlock;
     }
 
+    if ((payload_type == IPMI_RMCPP_PAYLOAD_TYPE_IPMI)
+	&& lan->seq_table[seq].bridged
+	&& lan_bridge_busy(ipmi, lan, seq, tmsg, payload_len))
+	goto out_unlock;
+
     rv = payloads[payload_type]->handle_recv_rsp
 	(ipmi,
 	 lan->seq_table[seq].rsp_item,
@@ -2985,6 +4252,24 @@ handle_payload(ipmi_con_t    *ipmi,
     /* We got a response from the connection, so reset the failure
        count. */
     lan->ip[addr_num].consecutive_failures = 0;
+    lan_cached_time(ipmi, &lan->ip[addr_num].last_rsp_time);
+
+    if (ipmi->latency) {
+	struct timeval diff;
+
+	diff_timeval(&diff, &lan->ip[addr_num].last_rsp_time,
+		     &lan->seq_table[seq].send_time);
+	ipmi_con_latency_add(ipmi, lan->seq_table[seq].msg.netfn,
+			     lan->seq_table[seq].msg.cmd,
+			     diff.tv_sec * 1000000 + diff.tv_usec,
+			     lan->seq_table[seq].rexmitted, 0);
+    }
+    IPMI_TRACE(IPMI_TRACE_MSG_RECV, ipmi, NULL, &lan->seq_table[seq], seq,
+	       lan->seq_table[seq].msg.netfn, lan->seq_table[seq].msg.cmd);
+
+    lan_rtt_sample(ipmi, lan, seq);
+    lan_msg_window_grow(lan, seq);
+    lan_bridge_window_grow(lan, seq);
 
     /* The command matches up, cancel the timer and deliver it */
     rv = ipmi->os_hnd->stop_timer(ipmi->os_hnd,
@@ -2993,16 +4278,14 @@ handle_payload(ipmi_con_t    *ipmi,
 	/* Couldn't cancel the timer, make sure the timer
 	   doesn't do the callback. */
 	lan->seq_table[seq].timer_info->cancelled = 1;
-    else {
+    else
 	/* Timer is cancelled, free its data. */
-	ipmi->os_hnd->free_timer(ipmi->os_hnd,
-				 lan->seq_table[seq].timer);
-	ipmi_mem_free(lan->seq_table[seq].timer_info);
-    }
+	lan_put_timer_info(lan, lan->seq_table[seq].timer_info);
 
     handler = lan->seq_table[seq].rsp_handler;
     rspi = lan->seq_table[seq].rsp_item;
     lan->seq_table[seq].inuse = 0;
+    lan_bridge_done(lan, seq);
 
     if (lan->seq_table[seq].use_orig_addr) {
 	/* We did an address translation, so translate back. */
@@ -3180,6 +4463,8 @@ handle_rmcpp_recv(ipmi_con_t    *ipmi,
 	    ipmi_log(IPMI_LOG_DEBUG, "%sInvalid sequence number",
 		     IPMI_CONN_NAME(ipmi));
 	add_stat(ipmi, STAT_SEQ_OUT_OF_RANGE, 1);
+	if (rv == ERANGE)
+	    lan_seq_range_loss(lan);
 	goto out;
     }
 
@@ -3326,8 +4611,11 @@ handle_lan15_recv(ipmi_con_t    *ipmi,
 				  &(lan->ip[addr_num].inbound_seq_num),
 				  &(lan->ip[addr_num].recv_msg_map));
     ipmi_unlock(lan->ip_lock);
-    if (rv)
+    if (rv) {
+	if (rv == ERANGE)
+	    lan_seq_range_loss(lan);
 	goto out;
+    }
 
     /*
      * Special case for Serial-over-LAN IPMI 1.5 packets, which use the
@@ -3420,7 +4708,7 @@ rmcpp_find_ipmi(lan_fd_t      *item,
     } else
 	tag = sid - 1;
 
-    if (tag >= MAX_CONS_PER_FD) {
+    if (tag >= item->max_cons) {
 	if (DEBUG_RAWMSG || DEBUG_MSG_ERR)
 	    ipmi_log(IPMI_LOG_DEBUG, "tag is out of range: %d", tag);
 	return NULL;
@@ -3437,6 +4725,24 @@ rmcpp_find_ipmi(lan_fd_t      *item,
     return ipmi;
 }
 
+typedef struct rmcp_find_s
+{
+    lan_fd_t      *item;
+    uint32_t      sid;
+    sockaddr_ip_t *addr;
+    int           *addr_num;
+} rmcp_find_t;
+
+static int
+rmcp_find_cmp(void *item, void *cb_data)
+{
+    lan_link_t  *l = item;
+    rmcp_find_t *info = cb_data;
+
+    return ((l->lan->fd == info->item)
+	    && addr_match_lan(l->lan, info->sid, info->addr, info->addr_num));
+}
+
 static ipmi_con_t *
 rmcp_find_ipmi(lan_fd_t      *item,
 	       unsigned char *data,
@@ -3444,11 +4750,13 @@ rmcp_find_ipmi(lan_fd_t      *item,
 	       sockaddr_ip_t *addr,
 	       int           *addr_num)
 {
-    /* Old RMCP is harder, we have to hunt. */
-    uint32_t   sid;
-    lan_data_t *lan;
-    int        i;
-    ipmi_con_t *ipmi = NULL;
+    /* Old RMCP is harder, the session id is picked by the BMC, so
+       look the sender up by address and then match the session id. */
+    rmcp_find_t       info;
+    lan_link_t        *l;
+    unsigned int      hash;
+    lan_hash_stripe_t *stripe;
+    ipmi_con_t        *ipmi = NULL;
 
     if (len < 13) {
 	if (DEBUG_RAWMSG || DEBUG_MSG_ERR)
@@ -3456,46 +4764,34 @@ rmcp_find_ipmi(lan_fd_t      *item,
 	return NULL;
     }
 
-    sid = ipmi_get_uint32(data+9);
-    ipmi_lock(item->con_lock);
-    for (i=0; i<MAX_CONS_PER_FD; i++) {
-	lan = item->lan[i];
-	if (lan && addr_match_lan(lan, sid, addr, addr_num)) {
-	    ipmi = lan->ipmi;
-	    break;
-	}
-    }
-    ipmi_unlock(item->con_lock);
-
-    return ipmi;
-}
-
-static void
-data_handler(int            fd,
-	     void           *cb_data,
-	     os_hnd_fd_id_t *id)
-{
-    lan_fd_t           *item = cb_data;
-    ipmi_con_t         *ipmi;
-    lan_data_t         *lan;
-    unsigned char      data[IPMI_MAX_LAN_LEN];
-    sockaddr_ip_t      ipaddrd;
-    socklen_t          from_len;
-    int                len;
-    int                addr_num = 0; /* Keep gcc happy and initialize */
-
-    from_len = sizeof(ipaddrd.s_ipsock);
-    len = recvfrom(fd, data, sizeof(data), 0, (struct sockaddr *)&ipaddrd, 
-		   &from_len);
+    info.item = item;
+    info.sid = ipmi_get_uint32(data+9);
+    info.addr = addr;
+    info.addr_num = addr_num;
+    hash = hash_lan_addr(&addr->s_ipsock.s_addr);
+    stripe = lan_hash_stripe(lan_ip_hash, hash);
+    ipmi_lock(stripe->lock);
+    l = htable_find(stripe->tab, lan_hash_key(hash), rmcp_find_cmp, &info);
+    if (l)
+	ipmi = l->lan->ipmi;
+    ipmi_unlock(stripe->lock);
 
-    if (len < 0)
-	/* Got an error, probably no data, just return. */
-	return;
+    return ipmi;
+}
+
+static void
+handle_lan_packet(lan_fd_t      *item,
+		  unsigned char *data,
+		  int           len,
+		  sockaddr_ip_t *ipaddrd)
+{
+    ipmi_con_t *ipmi;
+    lan_data_t *lan;
+    int        addr_num = 0; /* Keep gcc happy and initialize */
 
-    ipaddrd.ip_addr_len = from_len;
     if (DEBUG_RAWMSG) {
 	ipmi_log(IPMI_LOG_DEBUG_START, "incoming\n addr = ");
-	dump_hex((unsigned char *) &ipaddrd, from_len);
+	dump_hex((unsigned char *) ipaddrd, ipaddrd->ip_addr_len);
 	if (len) {
 	    ipmi_log(IPMI_LOG_DEBUG_CONT, "\n data =\n  ");
 	    dump_hex(data, len);
@@ -3520,9 +4816,9 @@ data_handler(int            fd,
     }
 
     if ((data[4] & 0x0f) == IPMI_AUTHTYPE_RMCP_PLUS) {
-	ipmi = rmcpp_find_ipmi(item, data, len, &ipaddrd, &addr_num);
+	ipmi = rmcpp_find_ipmi(item, data, len, ipaddrd, &addr_num);
     } else {
-	ipmi = rmcp_find_ipmi(item, data, len, &ipaddrd, &addr_num);
+	ipmi = rmcp_find_ipmi(item, data, len, ipaddrd, &addr_num);
     }
 
     if (!lan_valid_ipmi(ipmi))
@@ -3541,7 +4837,185 @@ data_handler(int            fd,
     }
     
     lan_put(ipmi);
-    return;
+}
+
+static void
+lan_fd_recv_stat(lan_fd_t *item, unsigned int count, unsigned int batch_size)
+{
+    ipmi_lock(item->con_lock);
+    item->recv_batches++;
+    item->recv_packets += count;
+    if (count == batch_size)
+	item->recv_full_batches++;
+    if (count > item->recv_max_batch)
+	item->recv_max_batch = count;
+    ipmi_unlock(item->con_lock);
+}
+
+#ifdef HAVE_RECVMMSG
+static void
+data_handler_batch(int fd, lan_fd_t *item, unsigned int batch_size)
+{
+    unsigned char  data[IPMI_LAN_MAX_RECV_BATCH][IPMI_MAX_LAN_LEN];
+    sockaddr_ip_t  ipaddrd[IPMI_LAN_MAX_RECV_BATCH];
+    struct iovec   iov[IPMI_LAN_MAX_RECV_BATCH];
+    struct mmsghdr msgs[IPMI_LAN_MAX_RECV_BATCH];
+    unsigned int   i;
+    int            count;
+    int            pass = 0;
+
+    do {
+	memset(msgs, 0, sizeof(msgs[0]) * batch_size);
+	for (i=0; i<batch_size; i++) {
+	    iov[i].iov_base = data[i];
+	    iov[i].iov_len = sizeof(data[i]);
+	    msgs[i].msg_hdr.msg_name = &ipaddrd[i].s_ipsock;
+	    msgs[i].msg_hdr.msg_namelen = sizeof(ipaddrd[i].s_ipsock);
+	    msgs[i].msg_hdr.msg_iov = &iov[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	count = recvmmsg(fd, msgs, batch_size, 0, NULL);
+	if (count <= 0)
+	    /* Got an error, probably no data, just return. */
+	    return;
+
+	lan_fd_recv_stat(item, count, batch_size);
+
+	/* Dispatch the whole batch before reading again. */
+	for (i=0; i<(unsigned int) count; i++) {
+	    ipaddrd[i].ip_addr_len = msgs[i].msg_hdr.msg_namelen;
+	    handle_lan_packet(item, data[i], msgs[i].msg_len, &ipaddrd[i]);
+	}
+	pass++;
+    } while (((unsigned int) count == batch_size)
+	     && (pass < LAN_RECV_MAX_BATCH_PASSES));
+}
+#endif
+
+static void
+data_handler(int            fd,
+	     void           *cb_data,
+	     os_hnd_fd_id_t *id)
+{
+    lan_fd_t           *item = cb_data;
+    unsigned char      data[IPMI_MAX_LAN_LEN];
+    sockaddr_ip_t      ipaddrd;
+    socklen_t          from_len;
+    int                len;
+#ifdef HAVE_RECVMMSG
+    unsigned int       batch_size = lan_recv_batch_size;
+
+    if (batch_size > 1) {
+	data_handler_batch(fd, item, batch_size);
+	return;
+    }
+#endif
+
+    from_len = sizeof(ipaddrd.s_ipsock);
+    len = recvfrom(fd, data, sizeof(data), 0, (struct sockaddr *)&ipaddrd, 
+		   &from_len);
+
+    if (len < 0)
+	/* Got an error, probably no data, just return. */
+	return;
+
+    lan_fd_recv_stat(item, 1, 1);
+
+    ipaddrd.ip_addr_len = from_len;
+    handle_lan_packet(item, data, len, &ipaddrd);
+}
+
+int
+ipmi_lan_set_max_cons_per_fd(unsigned int max_cons)
+{
+    if ((max_cons == 0) || (max_cons > IPMI_LAN_MAX_CONS_PER_FD))
+	return EINVAL;
+    lan_cons_per_fd = max_cons;
+    return 0;
+}
+
+unsigned int
+ipmi_lan_get_max_cons_per_fd(void)
+{
+    return lan_cons_per_fd;
+}
+
+int
+ipmi_lan_set_reactor_policy(unsigned int policy)
+{
+    if (policy > IPMI_LAN_REACTOR_LEAST_LOADED)
+	return EINVAL;
+    lan_reactor_policy = policy;
+    return 0;
+}
+
+unsigned int
+ipmi_lan_get_reactor_policy(void)
+{
+    return lan_reactor_policy;
+}
+
+int
+ipmi_lan_set_recv_batch_size(unsigned int batch_size)
+{
+    if ((batch_size == 0) || (batch_size > IPMI_LAN_MAX_RECV_BATCH))
+	return EINVAL;
+#ifndef HAVE_RECVMMSG
+    if (batch_size > 1)
+	return ENOSYS;
+#endif
+    lan_recv_batch_size = batch_size;
+    return 0;
+}
+
+unsigned int
+ipmi_lan_get_recv_batch_size(void)
+{
+    return lan_recv_batch_size;
+}
+
+static void
+add_fd_recv_stats(lan_fd_t *item, ipmi_lan_recv_batch_stats_t *stats)
+{
+    ipmi_lock(item->con_lock);
+    stats->batches += item->recv_batches;
+    stats->packets += item->recv_packets;
+    stats->full_batches += item->recv_full_batches;
+    if (item->recv_max_batch > stats->max_batch)
+	stats->max_batch = item->recv_max_batch;
+    ipmi_unlock(item->con_lock);
+}
+
+static void
+add_fd_list_recv_stats(ipmi_lock_t                 *lock,
+		       lan_fd_t                    *list,
+		       lan_fd_t                    *free_list,
+		       ipmi_lan_recv_batch_stats_t *stats)
+{
+    lan_fd_t *item;
+
+    if (!lock)
+	return;
+
+    /* Items are never destroyed, so the counts from items on the free
+       list are still valid. */
+    ipmi_lock(lock);
+    for (item = list->next; item != list; item = item->next)
+	add_fd_recv_stats(item, stats);
+    for (item = free_list; item; item = item->next)
+	add_fd_recv_stats(item, stats);
+    ipmi_unlock(lock);
+}
+
+void
+ipmi_lan_get_recv_batch_stats(ipmi_lan_recv_batch_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    add_fd_list_recv_stats(fd_list_lock, &fd_list, fd_free_list, stats);
+#ifdef PF_INET6
+    add_fd_list_recv_stats(fd6_list_lock, &fd6_list, fd6_free_list, stats);
+#endif
 }
 
 /* Note that this puts the address number in data4 of the rspi. */
@@ -3578,20 +5052,9 @@ ipmi_lan_send_command_forceip(ipmi_con_t            *ipmi,
     if (msg->netfn & 1)
 	return lan_send_addr(lan, addr, addr_len, msg, 0, addr_num, NULL);
 
-    info = ipmi_mem_alloc(sizeof(*info));
-    if (!info)
-	return ENOMEM;
-    memset(info, 0, sizeof(*info));
-
-    /* Put it in the list first. */
-    info->ipmi = ipmi;
-    info->cancelled = 0;
-
-    rv = ipmi->os_hnd->alloc_timer(ipmi->os_hnd, &(info->timer));
-    if (rv) {
-	ipmi_mem_free(info);
+    rv = lan_get_timer_info(lan, &info);
+    if (rv)
 	return rv;
-    }
 
     ipmi_lock(lan->seq_num_lock);
 
@@ -3602,7 +5065,7 @@ ipmi_lan_send_command_forceip(ipmi_con_t            *ipmi,
 
     rspi->data4 = (void *) (long) addr_num;
     rv = handle_msg_send(info, addr_num, addr, addr_len, msg,
-			 rsp_handler, rspi, 0);
+			 rsp_handler, rspi, 0, NULL);
     /* handle_msg_send handles freeing the timer and info on an error */
     info = NULL;
     if (! rv)
@@ -3613,11 +5076,8 @@ ipmi_lan_send_command_forceip(ipmi_con_t            *ipmi,
  out_unlock:
     ipmi_unlock(lan->seq_num_lock);
     if (rv) {
-	if (info) {
-	    if (info->timer)
-		ipmi->os_hnd->free_timer(ipmi->os_hnd, info->timer);
-	    ipmi_mem_free(info);
-	}
+	if (info)
+	    lan_put_timer_info(lan, info);
     }
     return rv;
 }
@@ -3636,9 +5096,10 @@ lan_send_command_option(ipmi_con_t              *ipmi,
     int              rv;
     ipmi_msgi_t      *rspi = trspi;
     int              side_effects = 0;
+    int              has_deadline = 0;
+    struct timeval   deadline;
     int              i;
 
-
     if (addr_len > sizeof(ipmi_addr_t))
 	return EINVAL;
 
@@ -3658,38 +5119,32 @@ lan_send_command_option(ipmi_con_t              *ipmi,
 	for (i=0; options[i].option != IPMI_CON_OPTION_LIST_END; i++) {
 	    if (options[i].option == IPMI_CON_MSG_OPTION_SIDE_EFFECTS)
 		side_effects = options[i].ival;
+	    else if ((options[i].option == IPMI_CON_MSG_OPTION_DEADLINE)
+		     && (options[i].ival > 0))
+	    {
+		lan_set_deadline(ipmi, options[i].ival, &deadline);
+		has_deadline = 1;
+	    }
 	}
     }
 
     if (!rspi) {
-	rspi = ipmi_mem_alloc(sizeof(*rspi));
+	rspi = ipmi_con_alloc_msg_item(ipmi);
 	if (!rspi)
 	    return ENOMEM;
     }
 
-    info = ipmi_mem_alloc(sizeof(*info));
-    if (!info) {
-	rv = ENOMEM;
-	goto out_unlock2;
-    }
-    memset(info, 0, sizeof(*info));
-
-    /* Put it in the list first. */
-    info->ipmi = ipmi;
-    info->cancelled = 0;
-
-    rv = ipmi->os_hnd->alloc_timer(ipmi->os_hnd, &(info->timer));
+    rv = lan_get_timer_info(lan, &info);
     if (rv)
-	goto out_unlock;
+	goto out_unlock2;
 
     ipmi_lock(lan->seq_num_lock);
 
-    if (lan->outstanding_msg_count >= lan->max_outstanding_msg_count) {
+    if (!lan_can_start(lan, addr)) {
 	lan_wait_queue_t *q_item;
 
 	q_item = ipmi_mem_alloc(sizeof(*q_item));
 	if (!q_item) {
-	    ipmi->os_hnd->free_timer(ipmi->os_hnd, info->timer);
 	    rv = ENOMEM;
 	    goto out_unlock;
 	}
@@ -3703,6 +5158,10 @@ lan_send_command_option(ipmi_con_t              *ipmi,
 	q_item->rsp_handler = rsp_handler;
 	q_item->rsp_item = rspi;
 	q_item->side_effects = side_effects;
+	q_item->busy_retries = 0;
+	q_item->has_deadline = has_deadline;
+	if (has_deadline)
+	    q_item->deadline = deadline;
 
 	/* Add it to the end of the queue. */
 	q_item->next = NULL;
@@ -3717,31 +5176,29 @@ lan_send_command_option(ipmi_con_t              *ipmi,
     }
 
     rv = handle_msg_send(info, -1, addr, addr_len, msg,
-			 rsp_handler, rspi, side_effects);
+			 rsp_handler, rspi, side_effects,
+			 has_deadline ? &deadline : NULL);
     /* handle_msg_send handles freeing the timer and info on an error */
     info = NULL;
     if (!rv)
 	lan->outstanding_msg_count++;
     else if (!trspi && rspi)
 	/* If we allocated an rspi, free it on error. */
-	ipmi_mem_free(rspi);
+	ipmi_con_free_msg_item(ipmi, rspi);
     ipmi_unlock(lan->seq_num_lock);
     return rv;
 
  out_unlock:
     ipmi_unlock(lan->seq_num_lock);
     if (rv) {
-	if (info) {
-	    if (info->timer)
-		ipmi->os_hnd->free_timer(ipmi->os_hnd, info->timer);
-	    ipmi_mem_free(info);
-	}
+	if (info)
+	    lan_put_timer_info(lan, info);
     }
  out_unlock2:
     if (rv) {
 	/* If we allocated an rspi, free it. */
 	if (!trspi && rspi)
-	    ipmi_mem_free(rspi);
+	    ipmi_con_free_msg_item(ipmi, rspi);
     }
     return rv;
 }
@@ -3788,6 +5245,17 @@ lan_deregister_for_command(ipmi_con_t    *ipmi,
     return ENOSYS;
 }
 
+static int
+lan_get_reactor(ipmi_con_t *ipmi)
+{
+    lan_data_t *lan = (lan_data_t *) ipmi->con_data;
+
+    if (!lan->fd || (ipmi->os_hnd != lan_os_hnd)
+	|| !ipmi->os_hnd->alloc_timer_reactor || (lan_num_reactors() <= 1))
+	return -1;
+    return lan->fd->reactor;
+}
+
 static unsigned int
 lan_get_num_ports(ipmi_con_t *ipmi)
 {
@@ -3883,6 +5351,100 @@ send_close_session(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num)
 		  NULL);
 }
 
+/*
+ * Saved RMCP+ sessions, see IPMI_LANP_SESSION_RESUME.  A session is
+ * stored in the OS handler database under a key made from the
+ * address, port, user name and privilege, so it is only used by a
+ * connection that would have set up the same session.  The record
+ * holds the save time, the session ids and sequence numbers, the
+ * algorithms and the keys the algorithms are set up from.
+ */
+#define LAN_SESSION_FORMAT	1
+#define LAN_SESSION_LEN		(1 + 4 + (8 * 4) + 3 + (3 * 17) + (3 * 33))
+
+static char *
+lan_session_db_key(lan_data_t *lan, int addr_num)
+{
+    char         *key, *s;
+    unsigned int i, len;
+
+    len = (strlen(lan->cparm.ip_addr_str[addr_num])
+	   + strlen(lan->cparm.ip_port_str[addr_num])
+	   + (lan->cparm.username_len * 2) + 32);
+    key = ipmi_mem_alloc(len);
+    if (!key)
+	return NULL;
+    s = key;
+    s += sprintf(s, "lan_session:%s:%s:", lan->cparm.ip_addr_str[addr_num],
+		 lan->cparm.ip_port_str[addr_num]);
+    for (i=0; i<lan->cparm.username_len; i++)
+	s += sprintf(s, "%2.2x", lan->cparm.username[i]);
+    sprintf(s, ":%d", lan->cparm.privilege);
+    return key;
+}
+
+static unsigned char *
+lan_session_put_key(unsigned char *d, unsigned char *key, unsigned int len,
+		    unsigned int max_len)
+{
+    *d++ = len;
+    memcpy(d, key, max_len);
+    return d + max_len;
+}
+
+/* Save the session on the address instead of closing it.  Returns
+   true if the session was saved. */
+static int
+lan_save_session(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num)
+{
+    os_handler_t      *os_hnd = ipmi->os_hnd;
+    lan_ip_data_t     *ip = &lan->ip[addr_num];
+    ipmi_rmcpp_auth_t *ainfo = &ip->ainfo;
+    unsigned char     data[LAN_SESSION_LEN], *d = data;
+    struct timeval    now;
+    char              *key;
+    int               rv;
+
+    if (!lan->session_resume || !os_hnd->database_store)
+	return 0;
+    if (!ip->working || (ip->working_authtype != IPMI_AUTHTYPE_RMCP_PLUS))
+	return 0;
+    /* OEM algorithms depend on the OEM data from the BMC, don't try
+       to save those. */
+    if ((ip->working_conf >= 0x30) || (ip->working_integ >= 0x30))
+	return 0;
+
+    key = lan_session_db_key(lan, addr_num);
+    if (!key)
+	return 0;
+
+    os_hnd->get_real_time(os_hnd, &now);
+    *d++ = LAN_SESSION_FORMAT;
+    ipmi_set_uint32(d, now.tv_sec); d += 4;
+    ipmi_set_uint32(d, ip->session_id); d += 4;
+    ipmi_set_uint32(d, ip->mgsys_session_id); d += 4;
+    ipmi_set_uint32(d, ip->outbound_seq_num); d += 4;
+    ipmi_set_uint32(d, ip->inbound_seq_num); d += 4;
+    ipmi_set_uint32(d, ip->recv_msg_map); d += 4;
+    ipmi_set_uint32(d, ip->unauth_out_seq_num); d += 4;
+    ipmi_set_uint32(d, ip->unauth_in_seq_num); d += 4;
+    ipmi_set_uint32(d, ip->unauth_recv_msg_map); d += 4;
+    *d++ = ip->working_integ;
+    *d++ = ip->working_conf;
+    *d++ = ainfo->role;
+    d = lan_session_put_key(d, ainfo->my_rand, ainfo->my_rand_len, 16);
+    d = lan_session_put_key(d, ainfo->mgsys_rand, ainfo->mgsys_rand_len, 16);
+    d = lan_session_put_key(d, ainfo->mgsys_guid, ainfo->mgsys_guid_len, 16);
+    d = lan_session_put_key(d, ainfo->sik, ainfo->sik_len, 32);
+    d = lan_session_put_key(d, ainfo->k1, ainfo->k1_len, 32);
+    d = lan_session_put_key(d, ainfo->k2, ainfo->k2_len, 32);
+
+    rv = os_hnd->database_store(os_hnd, key, data, d - data);
+    memset(data, 0, sizeof(data));
+    ipmi_mem_free(key);
+    return rv == 0;
+}
+
 typedef struct lan_unreg_stat_info_s
 {
     lan_data_t          *lan;
@@ -3900,6 +5462,7 @@ lan_unreg_stat_info(void *cb_data, void *item1, void *item2)
 
     if (!sinfo->cmpinfo || (sinfo->cmpinfo == info)) {
 	locked_list_remove(sinfo->lan->lan_stat_list, stat, info);
+	__atomic_sub_fetch(&sinfo->lan->stat_handlers, 1, __ATOMIC_RELAXED);
 	for (i=0; i<NUM_STATS; i++)
 	    if (stat->stats[i]) {
 		ipmi_ll_con_stat_call_unregister(info, stat->stats[i]);
@@ -3919,7 +5482,11 @@ cleanup_con(ipmi_con_t *ipmi)
 
     if (ipmi) {
 	lan = (lan_data_t *) ipmi->con_data;
+	if (lan)
+	    lan_free_timer_infos(lan, ipmi->os_hnd);
+	ipmi_con_msg_cache_cleanup(ipmi);
 	ipmi_con_attr_cleanup(ipmi);
+	ipmi_con_latency_cleanup(ipmi);
 	if (ipmi->name) {
 	    ipmi_mem_free(ipmi->name);
 	    ipmi->name = NULL;
@@ -3960,6 +5527,8 @@ cleanup_con(ipmi_con_t *ipmi)
 	    locked_list_destroy(lan->ipmb_change_handlers);
 	if (lan->seq_num_lock)
 	    ipmi_destroy_lock(lan->seq_num_lock);
+	if (lan->timer_info_lock)
+	    ipmi_destroy_lock(lan->timer_info_lock);
 	if (lan->fd)
 	    release_lan_fd(lan->fd, lan->fd_slot);
 	if (lan->authdata)
@@ -3987,11 +5556,15 @@ lan_cleanup(ipmi_con_t *ipmi)
     /* After this point no other operations can occur on this ipmi
        interface, so it's safe. */
 
-    for (i=0; i<lan->cparm.num_ip_addr; i++)
-	send_close_session(ipmi, lan, i);
+    for (i=0; i<lan->cparm.num_ip_addr; i++) {
+	if (!lan_save_session(ipmi, lan, i) && !ipmi->skip_close_session)
+	    send_close_session(ipmi, lan, i);
+    }
 
     lan->in_cleanup = 1;
 
+    lan_estab_cleanup(lan);
+
     ipmi_lock(lan->seq_num_lock);
     for (i=0; i<64; i++) {
 	if (lan->seq_table[i].inuse) {
@@ -4024,15 +5597,14 @@ lan_cleanup(ipmi_con_t *ipmi)
 	    rspi->msg.data_len = 1;
 
 	    lan->seq_table[i].inuse = 0;
+	    lan_bridge_done(lan, i);
 
 	    /* Wait until here to free the info, as we use it above.
 	       But we must be holding the lock while we do this. */
 	    if (rv)
 		info->cancelled = 1;
-	    else {
-		ipmi->os_hnd->free_timer(ipmi->os_hnd, info->timer);
-		ipmi_mem_free(info);
-	    }
+	    else
+		lan_put_timer_info(lan, info);
 
 	    ipmi_unlock(lan->seq_num_lock);
 
@@ -4052,7 +5624,7 @@ lan_cleanup(ipmi_con_t *ipmi)
 	q_item = lan->wait_q;
 	lan->wait_q = q_item->next;
 
-	ipmi->os_hnd->free_timer(ipmi->os_hnd, q_item->info->timer);
+	lan_put_timer_info(lan, q_item->info);
 
 	ipmi_unlock(lan->seq_num_lock);
 
@@ -4065,7 +5637,6 @@ lan_cleanup(ipmi_con_t *ipmi)
 
 	ipmi_lock(lan->seq_num_lock);
 
-	ipmi_mem_free(q_item->info);
 	ipmi_mem_free(q_item);
     }
     if (lan->audit_info) {
@@ -4100,12 +5671,12 @@ lan_close_connection_done(ipmi_con_t            *ipmi,
 
     lan = (lan_data_t *) ipmi->con_data;
 
-    ipmi_lock(lan_list_lock);
+    ipmi_lock(lan_con_stripe(lan)->lock);
     if (lan->users > 1) {
 	/* The connection has been reused, just report it going
 	   down. */
 	lan->users--;
-	ipmi_unlock(lan_list_lock);
+	ipmi_unlock(lan_con_stripe(lan)->lock);
 	if (handler)
 	    handler(ipmi, cb_data);
 	lan_put(ipmi);
@@ -4115,7 +5686,8 @@ lan_close_connection_done(ipmi_con_t            *ipmi,
     /* Once we begin the shutdown process, we don't want anyone else
        reusing the connection. */
     lan_remove_con_nolock(lan);
-    ipmi_unlock(lan_list_lock);
+    ipmi_unlock(lan_con_stripe(lan)->lock);
+    lan_remove_con_ip(lan);
 
     lan->close_done = handler;
     lan->close_cb_data = cb_data;
@@ -4133,6 +5705,209 @@ lan_close_connection(ipmi_con_t *ipmi)
     return lan_close_connection_done(ipmi, NULL, NULL);
 }
 
+/*
+ * Global limit on session establishment.  When a lot of connections
+ * are started at once, each one runs its handshake (auth caps,
+ * session open, RAKP, privilege, device id) independently, and
+ * running thousands of those together just causes timeouts and
+ * retries.  If lan_estab_max is set, only that many addresses run a
+ * handshake at a time and the rest wait in a FIFO; a slot is freed
+ * when the handshake succeeds or fails.
+ */
+#define LAN_ESTAB_IDLE		0
+#define LAN_ESTAB_QUEUED	1
+#define LAN_ESTAB_RUNNING	2
+
+typedef struct lan_estab_wait_s
+{
+    ipmi_con_t               *ipmi;
+    unsigned int             addr_num;
+    struct lan_estab_wait_s  *next;
+} lan_estab_wait_t;
+
+static ipmi_lock_t      *lan_estab_lock = NULL;
+static unsigned int     lan_estab_max = 0;
+static unsigned int     lan_estab_running = 0;
+static lan_estab_wait_t *lan_estab_head = NULL;
+static lan_estab_wait_t *lan_estab_tail = NULL;
+
+static void lan_estab_done(lan_data_t *lan, unsigned int addr_num);
+
+/* Start handshakes from the wait queue while there are free slots. */
+static void
+lan_estab_run_queue(void)
+{
+    lan_estab_wait_t *start = NULL, *e;
+    lan_data_t       *lan;
+    int              rv;
+
+    ipmi_lock(lan_estab_lock);
+    while (lan_estab_head
+	   && (!lan_estab_max || (lan_estab_running < lan_estab_max)))
+    {
+	e = lan_estab_head;
+	lan_estab_head = e->next;
+	if (!lan_estab_head)
+	    lan_estab_tail = NULL;
+
+	/* The connection removes its entries before it goes away,
+	   but it may be on its way out; this gets a refcount. */
+	lan = lan_find_con(e->ipmi);
+	if (!lan) {
+	    ipmi_mem_free(e);
+	    continue;
+	}
+	lan->ip[e->addr_num].estab_state = LAN_ESTAB_RUNNING;
+	lan_estab_running++;
+	e->next = start;
+	start = e;
+    }
+    ipmi_unlock(lan_estab_lock);
+
+    while (start) {
+	e = start;
+	start = e->next;
+	lan = e->ipmi->con_data;
+	rv = lan_start_session(e->ipmi, lan, e->addr_num);
+	if (rv)
+	    /* The audit timer will try again. */
+	    lan_estab_done(lan, e->addr_num);
+	lan_put(e->ipmi);
+	ipmi_mem_free(e);
+    }
+}
+
+static int
+lan_estab_start(ipmi_con_t *ipmi, lan_data_t *lan, unsigned int addr_num)
+{
+    lan_ip_data_t    *ip = &lan->ip[addr_num];
+    lan_estab_wait_t *e;
+    int              rv;
+
+    ipmi_lock(lan_estab_lock);
+    if (!lan_estab_max && (ip->estab_state == LAN_ESTAB_IDLE)) {
+	ipmi_unlock(lan_estab_lock);
+	return lan_start_session(ipmi, lan, addr_num);
+    }
+
+    if (ip->estab_state != LAN_ESTAB_IDLE) {
+	/* Already waiting or in progress, don't start another. */
+	ipmi_unlock(lan_estab_lock);
+	return 0;
+    }
+
+    if (lan_estab_running < lan_estab_max) {
+	ip->estab_state = LAN_ESTAB_RUNNING;
+	lan_estab_running++;
+	ipmi_unlock(lan_estab_lock);
+	rv = lan_start_session(ipmi, lan, addr_num);
+	if (rv)
+	    lan_estab_done(lan, addr_num);
+	return rv;
+    }
+
+    e = ipmi_mem_alloc(sizeof(*e));
+    if (!e) {
+	ipmi_unlock(lan_estab_lock);
+	return ENOMEM;
+    }
+    e->ipmi = ipmi;
+    e->addr_num = addr_num;
+    e->next = NULL;
+    if (lan_estab_tail)
+	lan_estab_tail->next = e;
+    else
+	lan_estab_head = e;
+    lan_estab_tail = e;
+    ip->estab_state = LAN_ESTAB_QUEUED;
+    ipmi_unlock(lan_estab_lock);
+    return 0;
+}
+
+/* The handshake on the address finished, one way or the other. */
+static void
+lan_estab_done(lan_data_t *lan, unsigned int addr_num)
+{
+    lan_ip_data_t *ip = &lan->ip[addr_num];
+
+    ipmi_lock(lan_estab_lock);
+    if (ip->estab_state != LAN_ESTAB_RUNNING) {
+	ipmi_unlock(lan_estab_lock);
+	return;
+    }
+    ip->estab_state = LAN_ESTAB_IDLE;
+    lan_estab_running--;
+    ipmi_unlock(lan_estab_lock);
+
+    lan_estab_run_queue();
+}
+
+/* The connection is going away, drop it from the limiter. */
+static void
+lan_estab_cleanup(lan_data_t *lan)
+{
+    lan_estab_wait_t *e, *prev = NULL, *next;
+    unsigned int     i;
+
+    ipmi_lock(lan_estab_lock);
+    for (e = lan_estab_head; e; e = next) {
+	next = e->next;
+	if (e->ipmi != lan->ipmi) {
+	    prev = e;
+	    continue;
+	}
+	if (prev)
+	    prev->next = next;
+	else
+	    lan_estab_head = next;
+	if (lan_estab_tail == e)
+	    lan_estab_tail = prev;
+	ipmi_mem_free(e);
+    }
+    for (i=0; i<lan->cparm.num_ip_addr; i++) {
+	if (lan->ip[i].estab_state == LAN_ESTAB_RUNNING)
+	    lan_estab_running--;
+	lan->ip[i].estab_state = LAN_ESTAB_IDLE;
+    }
+    ipmi_unlock(lan_estab_lock);
+
+    lan_estab_run_queue();
+}
+
+int
+ipmi_lan_set_max_connecting(unsigned int max_connecting)
+{
+    ipmi_lock(lan_estab_lock);
+    lan_estab_max = max_connecting;
+    ipmi_unlock(lan_estab_lock);
+
+    /* A higher limit may let waiting handshakes go. */
+    lan_estab_run_queue();
+    return 0;
+}
+
+unsigned int
+ipmi_lan_get_max_connecting(void)
+{
+    return lan_estab_max;
+}
+
+void
+ipmi_lan_get_connecting(unsigned int *running, unsigned int *waiting)
+{
+    lan_estab_wait_t *e;
+    unsigned int     count = 0;
+
+    ipmi_lock(lan_estab_lock);
+    for (e = lan_estab_head; e; e = e->next)
+	count++;
+    if (running)
+	*running = lan_estab_running;
+    if (waiting)
+	*waiting = count;
+    ipmi_unlock(lan_estab_lock);
+}
+
 static void
 handle_connected(ipmi_con_t *ipmi, int err, int addr_num)
 {
@@ -4143,6 +5918,8 @@ handle_connected(ipmi_con_t *ipmi, int err, int addr_num)
 
     lan = (lan_data_t *) ipmi->con_data;
 
+    lan_estab_done(lan, addr_num);
+
     /* This should be occurring single-threaded (the IP is down and is
        being brought back up or is initially coming up), so no need
        for a lock here. */
@@ -4161,6 +5938,7 @@ handle_connected(ipmi_con_t *ipmi, int err, int addr_num)
 static void
 finish_connection(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num)
 {
+    lan_estab_done(lan, addr_num);
     lan->connected = 1;
     connection_up(lan, addr_num, 1);
     if (! lan->initialized) {
@@ -4382,7 +6160,7 @@ session_privilege_set(ipmi_con_t *ipmi, ipmi_msgi_t *rspi)
 
 static int
 send_set_session_privilege(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num,
-			   ipmi_msgi_t *rspi)
+			   ipmi_msgi_t *rspi, ipmi_ll_rsp_handler_t rsp_handler)
 {
     unsigned char		 data[1];
     ipmi_msg_t			 msg;
@@ -4402,10 +6180,175 @@ send_set_session_privilege(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num,
 
     rv = ipmi_lan_send_command_forceip(ipmi, addr_num,
 				       (ipmi_addr_t *) &addr, sizeof(addr),
-				       &msg, session_privilege_set, rspi);
+				       &msg, rsp_handler, rspi);
+    return rv;
+}
+
+static unsigned char *
+lan_session_get_key(unsigned char *d, unsigned char *key, unsigned int *len,
+		    unsigned int max_len)
+{
+    *len = *d++;
+    if (*len > max_len)
+	*len = max_len;
+    memcpy(key, d, max_len);
+    return d + max_len;
+}
+
+static int
+resume_privilege_set(ipmi_con_t *ipmi, ipmi_msgi_t *rspi)
+{
+    ipmi_msg_t *msg = &rspi->msg;
+    lan_data_t *lan;
+    int        rv;
+    int        addr_num = (long) rspi->data4;
+
+    if (!ipmi) {
+	handle_connected(ipmi, ECANCELED, addr_num);
+	return IPMI_MSG_ITEM_NOT_USED;
+    }
+
+    lan = (lan_data_t *) ipmi->con_data;
+
+    if ((msg->data[0] == 0) && (msg->data_len >= 2))
+	return session_privilege_set(ipmi, rspi);
+
+    /* The BMC doesn't know the session any more, set up a new one. */
+    if (DEBUG_MSG_ERR)
+	ipmi_log(IPMI_LOG_DEBUG,
+		 "%sipmi_lan.c(resume_privilege_set): "
+		 "Saved session not accepted (0x%x), starting a new one",
+		 IPMI_CONN_NAME(ipmi), msg->data[0]);
+    reset_session_data(lan, addr_num);
+    rv = send_auth_cap(ipmi, lan, addr_num, 0);
+    if (rv)
+	handle_connected(ipmi, rv, addr_num);
+    return IPMI_MSG_ITEM_NOT_USED;
+}
+
+/* Pick up a session saved by lan_save_session(), if there is a
+   usable one, and check it with the BMC. */
+static int
+lan_resume_session(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num)
+{
+    os_handler_t      *os_hnd = ipmi->os_hnd;
+    lan_ip_data_t     *ip = &lan->ip[addr_num];
+    ipmi_rmcpp_auth_t *ainfo = &ip->ainfo;
+    unsigned char     *data, *d;
+    unsigned int      data_len;
+    unsigned int      fetched = 0;
+    unsigned char     empty = 0;
+    struct timeval    now;
+    uint32_t          saved;
+    unsigned int      integ, conf;
+    ipmi_msgi_t       *rspi;
+    char              *key;
+    int               rv;
+
+    if (!lan->session_resume || !os_hnd->database_find
+	|| !os_hnd->database_store)
+	return ENOSYS;
+    if (((int) lan->cparm.authtype != IPMI_AUTHTYPE_DEFAULT)
+	&& (lan->cparm.authtype != IPMI_AUTHTYPE_RMCP_PLUS))
+	return ENOSYS;
+
+    key = lan_session_db_key(lan, addr_num);
+    if (!key)
+	return ENOMEM;
+    /* The session has to be decided on now, so don't let the
+       fetch be deferred. */
+    rv = os_hnd->database_find(os_hnd, key, &fetched, &data, &data_len,
+			       NULL, NULL);
+    if (rv || !fetched) {
+	ipmi_mem_free(key);
+	return ENOENT;
+    }
+
+    /* A saved session may only be used once, the sequence numbers
+       would be wrong the second time. */
+    if (data_len > 1)
+	os_hnd->database_store(os_hnd, key, &empty, 1);
+    ipmi_mem_free(key);
+
+    rv = ENOENT;
+    if ((data_len != LAN_SESSION_LEN) || (data[0] != LAN_SESSION_FORMAT))
+	goto out;
+
+    d = data + 1;
+    saved = ipmi_get_uint32(d); d += 4;
+    os_hnd->get_real_time(os_hnd, &now);
+    if ((now.tv_sec < (long) saved)
+	|| ((now.tv_sec - saved) > lan->session_resume))
+	goto out;
+
+    integ = d[32];
+    conf = d[33];
+    if ((integ >= 0x30) || !integs[integ] || (conf >= 0x30) || !confs[conf])
+	goto out;
+
+    ip->session_id = ipmi_get_uint32(d); d += 4;
+    ip->mgsys_session_id = ipmi_get_uint32(d); d += 4;
+    ip->outbound_seq_num = ipmi_get_uint32(d); d += 4;
+    ip->inbound_seq_num = ipmi_get_uint32(d); d += 4;
+    ip->recv_msg_map = ipmi_get_uint32(d); d += 4;
+    ip->unauth_out_seq_num = ipmi_get_uint32(d); d += 4;
+    ip->unauth_in_seq_num = ipmi_get_uint32(d); d += 4;
+    ip->unauth_recv_msg_map = ipmi_get_uint32(d); d += 4;
+    d += 2;
+    ainfo->lan = lan;
+    ainfo->role = *d++;
+    d = lan_session_get_key(d, ainfo->my_rand, &ainfo->my_rand_len, 16);
+    d = lan_session_get_key(d, ainfo->mgsys_rand, &ainfo->mgsys_rand_len, 16);
+    d = lan_session_get_key(d, ainfo->mgsys_guid, &ainfo->mgsys_guid_len, 16);
+    d = lan_session_get_key(d, ainfo->sik, &ainfo->sik_len, 32);
+    d = lan_session_get_key(d, ainfo->k1, &ainfo->k1_len, 32);
+    d = lan_session_get_key(d, ainfo->k2, &ainfo->k2_len, 32);
+
+    ip->working_integ = integ;
+    ip->working_conf = conf;
+    ip->std_integ = rmcpp_integ_is_std(integ);
+    ip->integ_info = integs[integ];
+    ip->conf_info = confs[conf];
+    rv = ip->conf_info->conf_init(ipmi, ainfo, &ip->conf_data);
+    if (rv)
+	goto out_reset;
+    rv = ip->integ_info->integ_init(ipmi, ainfo, &ip->integ_data);
+    if (rv)
+	goto out_reset;
+    ip->working_authtype = IPMI_AUTHTYPE_RMCP_PLUS;
+
+    rspi = ipmi_mem_alloc(sizeof(*rspi));
+    if (!rspi) {
+	rv = ENOMEM;
+	goto out_reset;
+    }
+    /* Setting the privilege is cheap and fails if the BMC doesn't
+       have the session any more. */
+    rv = send_set_session_privilege(ipmi, lan, addr_num, rspi,
+				    resume_privilege_set);
+    if (rv) {
+	ipmi_mem_free(rspi);
+	goto out_reset;
+    }
+    goto out;
+
+ out_reset:
+    reset_session_data(lan, addr_num);
+ out:
+    memset(data, 0, data_len);
+    os_hnd->database_free(os_hnd, data);
     return rv;
 }
 
+/* Start a session on the address, resuming a saved one if possible. */
+static int
+lan_start_session(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num)
+{
+    if (lan_resume_session(ipmi, lan, addr_num) == 0)
+	return 0;
+    return send_auth_cap(ipmi, lan, addr_num, 0);
+}
+
 static int
 check_rakp_rsp(ipmi_con_t   *ipmi,
 	       ipmi_msg_t   *msg,
@@ -4478,7 +6421,8 @@ rmcpp_auth_finished(ipmi_con_t    *ipmi,
     lan->ip[addr_num].unauth_out_seq_num = 1;
 
     /* We're up!.  Start the session stuff. */
-    rv = send_set_session_privilege(ipmi, lan, addr_num, info->rspi);
+    rv = send_set_session_privilege(ipmi, lan, addr_num, info->rspi,
+				    session_privilege_set);
     if (rv) {
         handle_connected(ipmi, rv, addr_num);
 	goto out;
@@ -4673,6 +6617,7 @@ got_rmcpp_open_session_rsp(ipmi_con_t *ipmi, ipmi_msgi_t  *rspi)
 
     lan->ip[addr_num].working_conf = conf;
     lan->ip[addr_num].working_integ = integ;
+    lan->ip[addr_num].std_integ = rmcpp_integ_is_std(integ);
     lan->ip[addr_num].conf_info = confp;
     lan->ip[addr_num].integ_info = integp;
 
@@ -4765,6 +6710,7 @@ start_rmcpp(ipmi_con_t *ipmi, lan_data_t *lan, ipmi_msgi_t *rspi, int addr_num)
     lan->ip[addr_num].precon_session_id = lan->fd_slot + 1;
     lan->ip[addr_num].working_conf = IPMI_LANP_CONFIDENTIALITY_ALGORITHM_NONE;
     lan->ip[addr_num].working_integ = IPMI_LANP_INTEGRITY_ALGORITHM_NONE;
+    lan->ip[addr_num].std_integ = 0;
 
     rv = send_rmcpp_open_session(ipmi, lan, rspi, addr_num);
     if (rv) {
@@ -4816,7 +6762,8 @@ session_activated(ipmi_con_t *ipmi, ipmi_msgi_t  *rspi)
     lan->ip[addr_num].session_id = ipmi_get_uint32(msg->data+2);
     lan->ip[addr_num].outbound_seq_num = ipmi_get_uint32(msg->data+6);
 
-    rv = send_set_session_privilege(ipmi, lan, addr_num, rspi);
+    rv = send_set_session_privilege(ipmi, lan, addr_num, rspi,
+				    session_privilege_set);
     if (rv) {
         handle_connected(ipmi, rv, addr_num);
 	goto out;
@@ -5164,6 +7111,7 @@ lan_start_con(ipmi_con_t *ipmi)
     int            rv;
     struct timeval timeout;
     unsigned int   i;
+    uint32_t       rnd;
 
     ipmi_lock(lan->ip_lock);
     if (lan->started) {
@@ -5200,11 +7148,19 @@ lan_start_con(ipmi_con_t *ipmi)
 
     lan->audit_info->cancelled = 0;
     lan->audit_info->ipmi = ipmi;
-    rv = ipmi->os_hnd->alloc_timer(ipmi->os_hnd, &(lan->audit_timer));
+    rv = lan_alloc_timer(lan, &(lan->audit_timer));
     if (rv)
 	goto out_err;
-    timeout.tv_sec = LAN_AUDIT_TIMEOUT / 1000000;
-    timeout.tv_usec = LAN_AUDIT_TIMEOUT % 1000000;
+    /* Start the first audit at a random point in a period starting
+       half a period from now, so the audits of connections started
+       together are spread out instead of all going off at the same
+       time, and the first one still comes after the connection has
+       had time to come up. */
+    if (ipmi->os_hnd->get_random(ipmi->os_hnd, &rnd, sizeof(rnd)))
+	rnd = 0;
+    rnd = (rnd % LAN_AUDIT_TIMEOUT) + (LAN_AUDIT_TIMEOUT / 2);
+    timeout.tv_sec = rnd / 1000000;
+    timeout.tv_usec = rnd % 1000000;
     rv = ipmi->os_hnd->start_timer(ipmi->os_hnd,
 				   lan->audit_timer,
 				   &timeout,
@@ -5223,7 +7179,7 @@ lan_start_con(ipmi_con_t *ipmi)
 
     for (i=0; i<lan->cparm.num_ip_addr; i++)
 	/* Ignore failures, this gets retried. */
-	send_auth_cap(ipmi, lan, i, 0);
+	lan_estab_start(ipmi, lan, i);
 
     return 0;
 
@@ -5312,29 +7268,35 @@ ipmi_ip_setup_con(char         * const ip_addrs[],
     return ipmi_lanp_setup_con(parms, 6, handlers, user_data, new_con);
 }
 
+/* Called with the IP stripe lock held.  This takes a user count on
+   the connection if it matches. */
+static int
+matching_lan_cmp(void *item, void *cb_data)
+{
+    lan_link_t *l = item;
+
+    return ((memcmp(&l->lan->cparm, cb_data, sizeof(lan_conn_parms_t)) == 0)
+	    && lan_get_from_ip(l->lan, 1));
+}
+
 static lan_data_t *
 find_matching_lan(lan_conn_parms_t *cparm)
 {
-    lan_link_t   *l;
-    lan_data_t   *lan;
-    unsigned int idx;
+    lan_link_t        *l;
+    lan_data_t        *lan = NULL;
+    unsigned int      hash;
+    lan_hash_stripe_t *stripe;
 
     /* Look in the first IP addresses list. */
-    idx = hash_lan_addr(&cparm->ip_addr[0].s_ipsock.s_addr);
-    ipmi_lock(lan_list_lock);
-    l = lan_ip_list[idx].next;
-    while (l->lan) {
+    hash = hash_lan_addr(&cparm->ip_addr[0].s_ipsock.s_addr);
+    stripe = lan_hash_stripe(lan_ip_hash, hash);
+    ipmi_lock(stripe->lock);
+    l = htable_find(stripe->tab, lan_hash_key(hash), matching_lan_cmp, cparm);
+    if (l)
+	/* Parms match up, use it */
 	lan = l->lan;
-	if (memcmp(&lan->cparm, cparm, sizeof(*cparm)) == 0) {
-	    /* Parms match up, use it */
-	    lan->users++;
-	    ipmi_unlock(lan_list_lock);
-	    return lan;
-	}
-	l = l->next;
-    }
-    ipmi_unlock(lan_list_lock);
-    return NULL;
+    ipmi_unlock(stripe->lock);
+    return lan;
 }
 
 static void
@@ -5342,9 +7304,9 @@ lan_use_connection(ipmi_con_t *ipmi)
 {
     lan_data_t *lan = ipmi->con_data;
 
-    ipmi_lock(lan_list_lock);
+    ipmi_lock(lan_con_stripe(lan)->lock);
     lan->users++;
-    ipmi_unlock(lan_list_lock);
+    ipmi_unlock(lan_con_stripe(lan)->lock);
 }
 
 static int
@@ -5373,6 +7335,7 @@ lan_register_stat_handler(ipmi_con_t          *ipmi,
 	ipmi_mem_free(nstat);
 	return ENOMEM;
     }
+    __atomic_add_fetch(&lan->stat_handlers, 1, __ATOMIC_RELAXED);
 
     return 0;
 }
@@ -5470,6 +7433,13 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
     char               **ports = NULL;
     lan_conn_parms_t   cparm;
     int max_outstanding_msg_count = DEFAULT_MAX_OUTSTANDING_MSG_COUNT;
+    int max_outstanding_msg_count_set = 0;
+    int msg_window_adaptive = 0;
+    int rtt_adaptive = 0;
+    unsigned int session_resume = 0;
+    int reactor = IPMI_LAN_REACTOR_AUTO;
+    long rto_min = IPMI_LAN_DEFAULT_MIN_RSP_TIMEOUT;
+    long rto_max = IPMI_LAN_DEFAULT_MAX_RSP_TIMEOUT;
 
     memset(&cparm, 0, sizeof(cparm));
 
@@ -5576,6 +7546,37 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
 		|| (parms[i].parm_val > MAX_POSSIBLE_OUTSTANDING_MSG_COUNT))
 		return EINVAL;
 	    max_outstanding_msg_count = parms[i].parm_val;
+	    max_outstanding_msg_count_set = 1;
+	    break;
+
+	case IPMI_LANP_ADAPTIVE_MSG_WINDOW:
+	    msg_window_adaptive = parms[i].parm_val != 0;
+	    break;
+
+	case IPMI_LANP_ADAPTIVE_RSP_TIMEOUT:
+	    rtt_adaptive = parms[i].parm_val != 0;
+	    break;
+
+	case IPMI_LANP_MIN_RSP_TIMEOUT:
+	    if (parms[i].parm_val < 1)
+		return EINVAL;
+	    rto_min = parms[i].parm_val;
+	    break;
+
+	case IPMI_LANP_MAX_RSP_TIMEOUT:
+	    if (parms[i].parm_val < 1)
+		return EINVAL;
+	    rto_max = parms[i].parm_val;
+	    break;
+
+	case IPMI_LANP_SESSION_RESUME:
+	    session_resume = parms[i].parm_val;
+	    break;
+
+	case IPMI_LANP_REACTOR:
+	    if (parms[i].parm_val < IPMI_LAN_REACTOR_AUTO)
+		return EINVAL;
+	    reactor = parms[i].parm_val;
 	    break;
 		
 	default:
@@ -5585,6 +7586,8 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
 
     if ((cparm.num_ip_addr == 0) || (ip_addrs == NULL))
 	return EINVAL;
+    if (rto_min > rto_max)
+	return EINVAL;
     if (((int) cparm.authtype != IPMI_AUTHTYPE_DEFAULT)
 	&& (cparm.authtype != IPMI_AUTHTYPE_RMCP_PLUS)
 	&& ((cparm.authtype >= MAX_IPMI_AUTHS)
@@ -5720,7 +7723,29 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
     lan->initialized = 0;
 
     lan->outstanding_msg_count = 0;
+    if (msg_window_adaptive && !max_outstanding_msg_count_set)
+	max_outstanding_msg_count = DEFAULT_MAX_MSG_WINDOW;
     lan->max_outstanding_msg_count = max_outstanding_msg_count;
+    lan->msg_window_adaptive = msg_window_adaptive;
+    lan->msg_window = DEFAULT_MAX_OUTSTANDING_MSG_COUNT;
+    if (lan->msg_window > lan->max_outstanding_msg_count)
+	lan->msg_window = lan->max_outstanding_msg_count;
+    lan->msg_window_acked = 0;
+    lan->send_epoch = 0;
+    lan->window_cut_epoch = 0;
+    lan->bridge_window = lan->max_outstanding_msg_count;
+    lan->bridge_acked = 0;
+    lan->bridge_outstanding = 0;
+    lan->rtt_adaptive = rtt_adaptive;
+    lan->rtt_samples = 0;
+    lan->srtt = 0;
+    lan->rttvar = 0;
+    lan->rto_min = rto_min;
+    lan->rto_max = rto_max;
+    lan->rto = lan_clamp_rto(lan, LAN_RSP_TIMEOUT);
+    lan->session_resume = session_resume;
+    lan->reactor = reactor;
+    lan->stat_push = 1;
     lan->wait_q = NULL;
     lan->wait_q_tail = NULL;
 
@@ -5740,6 +7765,31 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
     if (rv)
 	goto out_err;
 
+    rv = ipmi_create_lock_os_hnd(handlers, &lan->timer_info_lock);
+    if (rv)
+	goto out_err;
+
+    /* Preallocate all the per-message data for a full window. */
+    rv = ipmi_con_msg_cache_init(ipmi, lan->max_outstanding_msg_count);
+    if (rv)
+	goto out_err;
+    for (i=0; i<lan->max_outstanding_msg_count; i++) {
+	lan_timer_info_t *info = ipmi_mem_alloc(sizeof(*info));
+
+	if (!info) {
+	    rv = ENOMEM;
+	    goto out_err;
+	}
+	rv = lan_alloc_timer(lan, &info->timer);
+	if (rv) {
+	    ipmi_mem_free(info);
+	    goto out_err;
+	}
+	info->next = lan->timer_info_free;
+	lan->timer_info_free = info;
+	lan->timer_info_free_count++;
+    }
+
     lan->con_change_handlers = locked_list_alloc(handlers);
     if (!lan->con_change_handlers) {
 	rv = ENOMEM;
@@ -5788,12 +7838,15 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
     ipmi->send_command_option = lan_send_command_option;
     ipmi->get_num_ports = lan_get_num_ports;
     ipmi->get_port_info = lan_get_port_info;
+    ipmi->get_reactor = lan_get_reactor;
     ipmi->register_stat_handler = lan_register_stat_handler;
     ipmi->unregister_stat_handler = lan_unregister_stat_handler;
 
     /* Add it to the list of valid IPMIs so it will validate.  This
-       must be done last, after a point where it cannot fail. */
-    lan_add_con(lan);
+       must be done last, nothing after it can fail. */
+    rv = lan_add_con(lan);
+    if (rv)
+	goto out_err;
 
     *new_con = ipmi;
 
@@ -5833,81 +7886,96 @@ typedef struct lan_do_evt_s
     struct lan_do_evt_s *next;
 } lan_do_evt_t;
 
+typedef struct lan_evt_find_s
+{
+    const struct sockaddr *src_addr;
+    lan_do_evt_t          *found;
+} lan_evt_find_t;
+
+/* Called with the IP stripe lock held. */
+static void
+lan_evt_match(void *item, void *cb_data)
+{
+    lan_link_t            *l = item;
+    lan_evt_find_t        *info = cb_data;
+    const struct sockaddr *src_addr = info->src_addr;
+    lan_do_evt_t          *next;
+    unsigned int          i;
+    int                   match = 0;
+
+    for (i=0; (i<l->lan->cparm.num_ip_addr) && !match; i++) {
+	if (l->lan->cparm.ip_addr[i].s_ipsock.s_addr.sa_family
+	    != src_addr->sa_family)
+	{
+	    continue;
+	}
+	switch (src_addr->sa_family)
+	{
+	case PF_INET:
+	{
+	    struct sockaddr_in *src, *dst;
+	    src = (struct sockaddr_in *) src_addr;
+	    dst = &(l->lan->cparm.ip_addr[i].s_ipsock.s_addr4);
+	    match = dst->sin_addr.s_addr == src->sin_addr.s_addr;
+	}
+	break;
+#ifdef PF_INET6
+	case PF_INET6:
+	{
+	    struct sockaddr_in6 *src, *dst;
+	    src = (struct sockaddr_in6 *) src_addr;
+	    dst = &(l->lan->cparm.ip_addr[i].s_ipsock.s_addr6);
+	    match = (memcmp(dst->sin6_addr.s6_addr,
+			    src->sin6_addr.s6_addr,
+			    sizeof(struct in6_addr))
+		     == 0);
+	}
+	break;
+#endif
+	}
+    }
+
+    if (!match)
+	return;
+
+    next = ipmi_mem_alloc(sizeof(*next));
+    if (!next)
+	/* Can't do anything, just go on.  It's not fatal, it just
+	   delays things. */
+	return;
+    if (!lan_get_from_ip(l->lan, 0)) {
+	ipmi_mem_free(next);
+	return;
+    }
+    /* We have a match, handle it */
+    next->lan = l->lan;
+    next->next = info->found;
+    info->found = next;
+}
+
 int
 ipmi_lan_handle_external_event(const struct sockaddr *src_addr,
 			       const ipmi_msg_t      *msg,
 			       const unsigned char   *pet_ack)
 {
-    lan_link_t   *l;
-    lan_data_t   *lan;
-    unsigned int i;
-    unsigned int idx;
-    lan_do_evt_t *found = NULL;
-    lan_do_evt_t *next = NULL;
-
-    idx = hash_lan_addr(src_addr);
-    ipmi_lock(lan_list_lock);
-    l = lan_ip_list[idx].next;
+    unsigned int      hash;
+    lan_hash_stripe_t *stripe;
+    lan_evt_find_t    info;
+    lan_do_evt_t      *found;
+    lan_do_evt_t      *next = NULL;
+
+    info.src_addr = src_addr;
+    info.found = NULL;
+    hash = hash_lan_addr(src_addr);
+    stripe = lan_hash_stripe(lan_ip_hash, hash);
+    ipmi_lock(stripe->lock);
     /* Note that we call all the connections with the given IP
        address, not just the first one we find.  There may be more
        than one. */
-    while (l->lan) {
-	lan = NULL;
-	for (i=0; i<l->lan->cparm.num_ip_addr; i++) {
-	    if (l->lan->cparm.ip_addr[i].s_ipsock.s_addr.sa_family
-		!= src_addr->sa_family)
-	    {
-		continue;
-	    }
-	    switch (src_addr->sa_family)
-	    {
-	    case PF_INET:
-	    {
-		struct sockaddr_in *src, *dst;
-		src = (struct sockaddr_in *) src_addr;
-		dst = &(l->lan->cparm.ip_addr[i].s_ipsock.s_addr4);
-		if (dst->sin_addr.s_addr == src->sin_addr.s_addr) {
-		    /* We have a match, handle it */
-		    lan = l->lan;
-		    lan->refcount++;
-		}
-	    }
-	    break;
-#ifdef PF_INET6
-	    case PF_INET6:
-	    {
-		struct sockaddr_in6 *src, *dst;
-		src = (struct sockaddr_in6 *) src_addr;
-		dst = &(l->lan->cparm.ip_addr[i].s_ipsock.s_addr6);
-		if (memcmp(dst->sin6_addr.s6_addr,
-			   src->sin6_addr.s6_addr,
-			   sizeof(struct in6_addr))
-		    == 0)
-		{
-		    /* We have a match, handle it */
-		    lan = l->lan;
-		    lan->refcount++;
-		}
-	    }
-	    break;
-#endif
-	    }
-
-	    if (lan) {
-		next = ipmi_mem_alloc(sizeof(*next));
-		if (!next)
-		    /* Can't do anything, just go on.  It's not
-		       fatal, it just delays things. */
-		    continue;
-		next->lan = lan;
-		next->next = found;
-		found = next;
-	    }
-	}
-	l = l->next;
-    }
-    ipmi_unlock(lan_list_lock);
+    htable_iter_hash(stripe->tab, lan_hash_key(hash), lan_evt_match, &info);
+    ipmi_unlock(stripe->lock);
 
+    found = info.found;
     while (found) {
 	next = found;
 	found = found->next;
@@ -5945,6 +8013,13 @@ typedef struct lan_args_s
 
     unsigned int    hacks;		/* parms 13, 14 */
     unsigned int    max_outstanding_msgs;/* parm 15 */
+    unsigned int    adaptive_rsp_timeout;/* parm 16 */
+    unsigned int    min_rsp_timeout;	/* parm 17 */
+    unsigned int    max_rsp_timeout;	/* parm 18 */
+    unsigned int    adaptive_msg_window;/* parm 19 */
+    unsigned int    session_resume;	/* parm 20 */
+    int             reactor;		/* parm 21 */
+    int             max_outstanding_msgs_set;
 } lan_args_t;
 
 static const char *auth_range[] = { "default", "none", "md2", "md5",
@@ -5967,18 +8042,21 @@ static int priv_vals[] = { IPMI_PRIVILEGE_CALLBACK,
 
 static const char *auth_alg_range[] = { "bmcpick", "rakp_none",
 					"rakp_hmac_sha1", "rakp_hmac_md5",
-					NULL };
+					"rakp_hmac_sha256", NULL };
 static int auth_alg_vals[] = { IPMI_LANP_AUTHENTICATION_ALGORITHM_BMCPICK,
 			       IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_NONE,
 			       IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA1,
-			       IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_MD5 };
+			       IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_MD5,
+			       IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA256 };
 static const char *integ_alg_range[] = { "bmcpick", "none", "hmac_sha1",
-					"hmac_md5", "md5", NULL };
+					"hmac_md5", "md5", "hmac_sha256",
+					NULL };
 static int integ_alg_vals[] = { IPMI_LANP_INTEGRITY_ALGORITHM_BMCPICK,
 				IPMI_LANP_INTEGRITY_ALGORITHM_NONE,
 				IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA1_96,
 				IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_MD5_128,
-				IPMI_LANP_INTEGRITY_ALGORITHM_MD5_128 };
+				IPMI_LANP_INTEGRITY_ALGORITHM_MD5_128,
+				IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128 };
 
 static const char *conf_alg_range[] = { "bmcpick", "none", "aes_cbc_128",
 					"xrc4_128", "xrc4_40", NULL };
@@ -5995,7 +8073,7 @@ static struct lan_argnum_info_s
     const char *help;
     const char **range;
     const int  *values;
-} lan_argnum_info[17] =
+} lan_argnum_info[23] =
 {
     { "Address",	"str",
       "*IP name or address of the MC",
@@ -6045,6 +8123,26 @@ static struct lan_argnum_info_s
     { "Max_Outstanding_Msgs",	"int",
       "How many outstanding messages on the connection, range 1-63",
       NULL, NULL },
+    { "Adaptive_Rsp_Timeout",	"bool",
+      "Derive the retry timeout from the measured response time",
+      NULL, NULL },
+    { "Min_Rsp_Timeout",	"int",
+      "Lower bound of the adaptive retry timeout, in microseconds",
+      NULL, NULL },
+    { "Max_Rsp_Timeout",	"int",
+      "Upper bound of the adaptive retry timeout, in microseconds",
+      NULL, NULL },
+    { "Adaptive_Msg_Window",	"bool",
+      "Adjust the outstanding messages to what the BMC handles",
+      NULL, NULL },
+    { "Session_Resume",	"int",
+      "Save RMCP+ sessions on close and resume them if not older than"
+      " this many seconds, 0 is off",
+      NULL, NULL },
+    { "Reactor",	"int",
+      "The OS handler reactor to put the connection on, -1 lets the"
+      " placement policy pick",
+      NULL, NULL },
 
     { NULL },
 };
@@ -6121,6 +8219,13 @@ get_startup_args(ipmi_con_t *ipmi)
 	largs->bmc_key_set = 1;
     }
     largs->max_outstanding_msgs = lan->max_outstanding_msg_count;
+    largs->max_outstanding_msgs_set = 1;
+    largs->adaptive_msg_window = lan->msg_window_adaptive;
+    largs->adaptive_rsp_timeout = lan->rtt_adaptive;
+    largs->min_rsp_timeout = lan->rto_min;
+    largs->max_rsp_timeout = lan->rto_max;
+    largs->session_resume = lan->session_resume;
+    largs->reactor = lan->reactor;
     return args;
 
  out_err:
@@ -6136,7 +8241,7 @@ lan_connect_args(ipmi_args_t  *args,
 {
     lan_args_t       *largs = _ipmi_args_get_extra_data(args);
     int              i;
-    ipmi_lanp_parm_t parms[12];
+    ipmi_lanp_parm_t parms[18];
     int              rv;
 
     i = 0;
@@ -6184,8 +8289,28 @@ lan_connect_args(ipmi_args_t  *args,
 	parms[i].parm_data_len = largs->bmc_key_len;
 	i++;
     }
-    parms[i].parm_id = IPMI_LANP_MAX_OUTSTANDING_MSG_COUNT;
-    parms[i].parm_val = largs->max_outstanding_msgs;
+    if (largs->max_outstanding_msgs_set || !largs->adaptive_msg_window) {
+	parms[i].parm_id = IPMI_LANP_MAX_OUTSTANDING_MSG_COUNT;
+	parms[i].parm_val = largs->max_outstanding_msgs;
+	i++;
+    }
+    parms[i].parm_id = IPMI_LANP_ADAPTIVE_MSG_WINDOW;
+    parms[i].parm_val = largs->adaptive_msg_window;
+    i++;
+    parms[i].parm_id = IPMI_LANP_ADAPTIVE_RSP_TIMEOUT;
+    parms[i].parm_val = largs->adaptive_rsp_timeout;
+    i++;
+    parms[i].parm_id = IPMI_LANP_MIN_RSP_TIMEOUT;
+    parms[i].parm_val = largs->min_rsp_timeout;
+    i++;
+    parms[i].parm_id = IPMI_LANP_MAX_RSP_TIMEOUT;
+    parms[i].parm_val = largs->max_rsp_timeout;
+    i++;
+    parms[i].parm_id = IPMI_LANP_SESSION_RESUME;
+    parms[i].parm_val = largs->session_resume;
+    i++;
+    parms[i].parm_id = IPMI_LANP_REACTOR;
+    parms[i].parm_val = largs->reactor;
     i++;
     rv = ipmi_lanp_setup_con(parms, i, handlers, user_data, con);
     if (!rv)
@@ -6372,6 +8497,30 @@ lan_args_get_val(ipmi_args_t  *args,
 	rv = get_int_val(value, largs->max_outstanding_msgs);
 	break;
 
+    case 16:
+	rv = get_bool_val(value, largs->adaptive_rsp_timeout, 1);
+	break;
+
+    case 17:
+	rv = get_int_val(value, largs->min_rsp_timeout);
+	break;
+
+    case 18:
+	rv = get_int_val(value, largs->max_rsp_timeout);
+	break;
+
+    case 19:
+	rv = get_bool_val(value, largs->adaptive_msg_window, 1);
+	break;
+
+    case 20:
+	rv = get_int_val(value, largs->session_resume);
+	break;
+
+    case 21:
+	rv = get_int_val(value, largs->reactor);
+	break;
+
     default:
 	return E2BIG;
     }
@@ -6475,6 +8624,24 @@ set_uint_val(unsigned int *dest, const char *value)
     return 0;
 }
 
+static int
+set_int_val(int *dest, const char *value)
+{
+    long val;
+    char *end;
+
+    if (! value)
+	return EINVAL;
+    if (*value == '\0')
+	return EINVAL;
+
+    val = strtol(value, &end, 0);
+    if (*end != '\0')
+	return EINVAL;
+    *dest = val;
+    return 0;
+}
+
 static int
 lan_args_set_val(ipmi_args_t  *args,
 		 unsigned int argnum,
@@ -6580,6 +8747,32 @@ lan_args_set_val(ipmi_args_t  *args,
 
     case 15:
 	rv = set_uint_val(&largs->max_outstanding_msgs, value);
+	if (!rv)
+	    largs->max_outstanding_msgs_set = 1;
+	break;
+
+    case 16:
+	rv = set_bool_val(&largs->adaptive_rsp_timeout, value, 1);
+	break;
+
+    case 17:
+	rv = set_uint_val(&largs->min_rsp_timeout, value);
+	break;
+
+    case 18:
+	rv = set_uint_val(&largs->max_rsp_timeout, value);
+	break;
+
+    case 19:
+	rv = set_bool_val(&largs->adaptive_msg_window, value, 1);
+	break;
+
+    case 20:
+	rv = set_uint_val(&largs->session_resume, value);
+	break;
+
+    case 21:
+	rv = set_int_val(&largs->reactor, value);
 	break;
 
     default:
@@ -6758,6 +8951,8 @@ lan_parse_args(int         *curr_arg,
 		largs->auth_alg = IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA1;
 	    } else if (strcmp(args[*curr_arg], "rakp_hmac_md5") == 0) {
 		largs->auth_alg = IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_MD5;
+	    } else if (strcmp(args[*curr_arg], "rakp_hmac_sha256") == 0) {
+		largs->auth_alg = IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA256;
 	    } else {
 		rv = EINVAL;
 		goto out_err;
@@ -6775,6 +8970,8 @@ lan_parse_args(int         *curr_arg,
 		largs->integ_alg = IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_MD5_128;
 	    } else if (strcmp(args[*curr_arg], "md5") == 0) {
 		largs->integ_alg = IPMI_LANP_INTEGRITY_ALGORITHM_MD5_128;
+	    } else if (strcmp(args[*curr_arg], "hmac_sha256") == 0) {
+		largs->integ_alg = IPMI_LANP_INTEGRITY_ALGORITHM_HMAC_SHA256_128;
 	    } else {
 		rv = EINVAL;
 		goto out_err;
@@ -6820,6 +9017,58 @@ lan_parse_args(int         *curr_arg,
 		goto out_err;
 	    }
 	    largs->max_outstanding_msgs = val;
+	    largs->max_outstanding_msgs_set = 1;
+	} else if (strcmp(args[*curr_arg], "-Wa") == 0) {
+	    largs->adaptive_msg_window = 1;
+	} else if (strcmp(args[*curr_arg], "-Ta") == 0) {
+	    largs->adaptive_rsp_timeout = 1;
+	} else if ((strcmp(args[*curr_arg], "-Tmin") == 0)
+		   || (strcmp(args[*curr_arg], "-Tmax") == 0)) {
+	    char *end;
+	    unsigned long val;
+	    int is_min = args[*curr_arg][3] == 'i';
+	    (*curr_arg)++; CHECK_ARG;
+	    if (args[*curr_arg][0] == '\0') {
+		rv = EINVAL;
+		goto out_err;
+	    }
+	    val = strtoul(args[*curr_arg], &end, 0);
+	    if (*end != '\0') {
+		rv = EINVAL;
+		goto out_err;
+	    }
+	    if (is_min)
+		largs->min_rsp_timeout = val;
+	    else
+		largs->max_rsp_timeout = val;
+	} else if (strcmp(args[*curr_arg], "-Sr") == 0) {
+	    char *end;
+	    unsigned long val;
+	    (*curr_arg)++; CHECK_ARG;
+	    if (args[*curr_arg][0] == '\0') {
+		rv = EINVAL;
+		goto out_err;
+	    }
+	    val = strtoul(args[*curr_arg], &end, 0);
+	    if (*end != '\0') {
+		rv = EINVAL;
+		goto out_err;
+	    }
+	    largs->session_resume = val;
+	} else if (strcmp(args[*curr_arg], "-Xr") == 0) {
+	    char *end;
+	    long val;
+	    (*curr_arg)++; CHECK_ARG;
+	    if (args[*curr_arg][0] == '\0') {
+		rv = EINVAL;
+		goto out_err;
+	    }
+	    val = strtol(args[*curr_arg], &end, 0);
+	    if ((*end != '\0') || (val < IPMI_LAN_REACTOR_AUTO)) {
+		rv = EINVAL;
+		goto out_err;
+	    }
+	    largs->reactor = val;
 	}
 	(*curr_arg)++;
     }
@@ -6858,7 +9107,8 @@ lan_parse_help(void)
 	" lan [-U <username>] [-P <password>] [-p[2] port] [-A <authtype>]\n"
 	"     [-L <privilege>] [-s] [-Ra <auth alg>] [-Ri <integ alg>]\n"
 	"     [-Rc <conf algo>] [-Rl] [-Rk <bmc key>] [-H <hackname>]\n"
-	"     [-M <max outstanding msgs>] <host1> [<host2>]\n"
+	"     [-M <max outstanding msgs>] [-Wa] [-Ta] [-Tmin <usec>]\n"
+	"     [-Tmax <usec>] [-Sr <sec>] [-Xr <reactor>] <host1> [<host2>]\n"
 	"If -s is supplied, then two host names are taken (the second port\n"
 	"may be specified with -p2).  Otherwise, only one hostname is\n"
 	"taken.  The defaults are an empty username and password (anonymous),\n"
@@ -6873,16 +9123,27 @@ lan_parse_help(void)
 	"authentication.  By default the most secure method available is\n"
 	"chosen, in the order given above.\n"
 	"For RMCP+ connections, the authentication algorithms supported (-Ra)\n"
-	"are: bmcpick, rakp_none, rakp_hmac_sha1, and rakp_hmac_md5.  The\n"
-	"integrity algorithms (-Ri) supported are: bmcpick, none, hmac_sha1,\n"
-	"hmac_md5, and md5.  The confidentiality algorithms (-Rc) are: bmcpick,\n"
-	"aes_cbc_128, xrc4_128, and xrc_40.  The defaults are\n"
+	"are: bmcpick, rakp_none, rakp_hmac_sha1, rakp_hmac_md5, and\n"
+	"rakp_hmac_sha256.  The integrity algorithms (-Ri) supported are:\n"
+	"bmcpick, none, hmac_sha1, hmac_md5, md5, and hmac_sha256 (which\n"
+	"requires rakp_hmac_sha256).  The confidentiality algorithms (-Rc)\n"
+	"are: bmcpick, aes_cbc_128, xrc4_128, and xrc_40.  The defaults are\n"
 	"rackp_hmac_sha1, hmac_sha1, and aes_cb_128.  -Rl turns on lookup up\n"
 	"names by the name and the privilege level (allowing the same name with\n"
 	"different privileges and different passwords), the default is straight\n"
 	"name lookup.  -Rk sets the BMC key, needed if the system does two-key\n"
 	"lookups.  The -M option sets the maximum outstanding messages.\n"
-	"The default is 2, ranges 1-63.\n"
+	"The default is 2, ranges 1-63.  -Wa starts at 2 and adjusts the\n"
+	"outstanding messages to what the BMC handles, up to the -M value\n"
+	"or 16 if -M is not given.\n"
+	"-Ta derives the retry timeout from the measured response time of\n"
+	"the BMC instead of using a fixed 1 second, bounded by -Tmin and\n"
+	"-Tmax (in microseconds, default 50000 and 5000000).\n"
+	"-Sr saves RMCP+ sessions when the connection is closed and resumes\n"
+	"them on the next start if they are no more than <sec> seconds old,\n"
+	"the saved keys are kept in the OpenIPMI database.\n"
+	"-Xr puts the connection on the given OS handler reactor, by default\n"
+	"the LAN reactor placement policy picks one.\n"
 	"The -H option enables certain hacks for broken platforms.  This may\n"
 	"be listed multiple times to enable multiple hacks.  The currently\n"
 	"available hacks are:\n"
@@ -6916,6 +9177,9 @@ lan_con_alloc_args(void)
     largs->auth_alg = most_secure_lanp_auth();
     largs->name_lookup_only = 1;
     largs->max_outstanding_msgs = DEFAULT_MAX_OUTSTANDING_MSG_COUNT;
+    largs->min_rsp_timeout = IPMI_LAN_DEFAULT_MIN_RSP_TIMEOUT;
+    largs->max_rsp_timeout = IPMI_LAN_DEFAULT_MAX_RSP_TIMEOUT;
+    largs->reactor = IPMI_LAN_REACTOR_AUTO;
     /* largs->hacks = IPMI_CONN_HACK_RAKP3_WRONG_ROLEM; */
     return args;
 }
@@ -6926,9 +9190,12 @@ int
 _ipmi_lan_init(os_handler_t *os_hnd)
 {
     int rv;
-    int i;
 
-    rv = ipmi_create_global_lock(&lan_list_lock);
+    rv = lan_hash_init(lan_con_hash);
+    if (rv)
+	return rv;
+
+    rv = lan_hash_init(lan_ip_hash);
     if (rv)
 	return rv;
 
@@ -6938,7 +9205,7 @@ _ipmi_lan_init(os_handler_t *os_hnd)
     memset(&fd_list, 0, sizeof(fd_list));
     fd_list.next = &fd_list;
     fd_list.prev = &fd_list;
-    fd_list.cons_in_use = MAX_CONS_PER_FD;
+    fd_list.max_cons = 0; /* The list head never has a free slot. */
 
 #ifdef PF_INET6
     rv = ipmi_create_global_lock(&fd6_list_lock);
@@ -6947,18 +9214,9 @@ _ipmi_lan_init(os_handler_t *os_hnd)
     memset(&fd6_list, 0, sizeof(fd6_list));
     fd6_list.next = &fd6_list;
     fd6_list.prev = &fd6_list;
-    fd6_list.cons_in_use = MAX_CONS_PER_FD;
+    fd6_list.max_cons = 0;
 #endif
 
-    for (i=0; i<LAN_HASH_SIZE; i++) {
-	lan_list[i].next = &(lan_list[i]);
-	lan_list[i].prev = &(lan_list[i]);
-	lan_list[i].lan = NULL;
-	lan_ip_list[i].next = &(lan_ip_list[i]);
-	lan_ip_list[i].prev = &(lan_ip_list[i]);
-	lan_ip_list[i].lan = NULL;
-    }
-
     rv = ipmi_create_global_lock(&lan_payload_lock);
     if (rv)
 	return rv;
@@ -6967,6 +9225,10 @@ _ipmi_lan_init(os_handler_t *os_hnd)
     if (rv)
 	return rv;
 
+    rv = ipmi_create_global_lock(&lan_estab_lock);
+    if (rv)
+	return rv;
+
     lan_setup = _ipmi_alloc_con_setup(lan_parse_args, lan_parse_help,
 				      lan_con_alloc_args);
     if (! lan_setup)
@@ -6981,6 +9243,18 @@ _ipmi_lan_init(os_handler_t *os_hnd)
     return 0;
 }
 
+static void
+free_lan_fd_item(lan_fd_t *e)
+{
+    if (e->xmit_timer)
+	lan_os_hnd->free_timer(lan_os_hnd, e->xmit_timer);
+    if (e->xmit_q)
+	ipmi_mem_free(e->xmit_q);
+    ipmi_destroy_lock(e->xmit_lock);
+    ipmi_destroy_lock(e->con_lock);
+    ipmi_mem_free(e);
+}
+
 void
 _ipmi_lan_shutdown(void)
 {
@@ -6988,10 +9262,8 @@ _ipmi_lan_shutdown(void)
     _ipmi_free_con_setup(lan_setup);
     lan_setup = NULL;
 
-    if (lan_list_lock) {
-	ipmi_destroy_lock(lan_list_lock);
-	lan_list_lock = NULL;
-    }
+    lan_hash_shutdown(lan_con_hash);
+    lan_hash_shutdown(lan_ip_hash);
     if (lan_payload_lock) {
 	ipmi_destroy_lock(lan_payload_lock);
 	lan_payload_lock = NULL;
@@ -7005,6 +9277,17 @@ _ipmi_lan_shutdown(void)
 	ipmi_destroy_lock(lan_auth_lock);
 	lan_auth_lock = NULL;
     }
+    while (lan_estab_head) {
+	lan_estab_wait_t *e = lan_estab_head;
+	lan_estab_head = e->next;
+	ipmi_mem_free(e);
+    }
+    lan_estab_tail = NULL;
+    lan_estab_running = 0;
+    if (lan_estab_lock) {
+	ipmi_destroy_lock(lan_estab_lock);
+	lan_estab_lock = NULL;
+    }
     while (oem_auth_list) {
 	auth_entry_t *e = oem_auth_list;
 	oem_auth_list = e->next;
@@ -7029,15 +9312,14 @@ _ipmi_lan_shutdown(void)
 	e->next->prev = e->prev;
 	e->prev->next = e->next;
 	lan_os_hnd->remove_fd_to_wait_for(lan_os_hnd, e->fd_wait_id);
+	lan_fd_xmit_flush(e);
 	close(e->fd);
-	ipmi_destroy_lock(e->con_lock);
-	ipmi_mem_free(e);
+	free_lan_fd_item(e);
     }
     while (fd_free_list) {
 	lan_fd_t *e = fd_free_list;
 	fd_free_list = e->next;
-	ipmi_destroy_lock(e->con_lock);
-	ipmi_mem_free(e);
+	free_lan_fd_item(e);
     }
 #ifdef PF_INET6
     if (fd6_list_lock) {
@@ -7049,15 +9331,14 @@ _ipmi_lan_shutdown(void)
 	e->next->prev = e->prev;
 	e->prev->next = e->next;
 	lan_os_hnd->remove_fd_to_wait_for(lan_os_hnd, e->fd_wait_id);
+	lan_fd_xmit_flush(e);
 	close(e->fd);
-	ipmi_destroy_lock(e->con_lock);
-	ipmi_mem_free(e);
+	free_lan_fd_item(e);
     }
     while (fd6_free_list) {
 	lan_fd_t *e = fd6_free_list;
 	fd6_free_list = e->next;
-	ipmi_destroy_lock(e->con_lock);
-	ipmi_mem_free(e);
+	free_lan_fd_item(e);
     }
 #endif
     lan_os_hnd = NULL;
@@ -40,6 +40,7 @@
 #include <OpenIPMI/ipmi_msgbits.h>
 #include <OpenIPMI/ipmi_debug.h>
 #include <OpenIPMI/internal/ipmi_int.h>
+#include <OpenIPMI/internal/ipmi_checksum.h>
 
 #if defined(DEBUG_MSG) || defined(DEBUG_RAWMSG)
 static void
@@ -59,12 +60,7 @@ dump_hex(void *vdata, int len)
 static unsigned char
 ipmb_checksum(unsigned char *data, int size)
 {
-	unsigned char csum = 0;
-	
-	for (; size > 0; size--, data++)
-		csum += *data;
-
-	return -csum;
+	return -ipmi_checksum(data, size, 0);
 }
 
 static int
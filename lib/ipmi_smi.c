@@ -31,6 +31,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_CONN
+
 #include <config.h>
 
 #ifdef HAVE_OPENIPMI_SMI
@@ -66,6 +68,17 @@ static ipmi_args_t *smi_con_alloc_args(void);
 #define SMI_TIMEOUT 60000
 
 #define SMI_AUDIT_TIMEOUT 10000000
+
+/* The number of pending commands and message items kept for reuse. */
+#define SMI_CMD_CACHE_SIZE 16
+
+/* The default number of stateless operations to run at once on an
+   MC.  The driver queues them, so this just keeps the pipe full; it
+   is kept under SMI_CMD_CACHE_SIZE to leave room for other traffic. */
+#define SMI_MC_CONCURRENCY 8
+
+/* The most messages to receive per wakeup of the fd. */
+#define SMI_MAX_RECV_BATCH 32
 #if !defined(MIN)
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #endif
@@ -101,6 +114,9 @@ typedef struct pending_cmd_s
     int                   use_orig_addr;
     ipmi_addr_t           orig_addr;
     unsigned int          orig_addr_len;
+
+    /* When the command was sent, only set if latency tracking is on. */
+    struct timeval        send_time;
     struct pending_cmd_s  *next, *prev;
 } pending_cmd_t;
 
@@ -124,6 +140,10 @@ typedef struct smi_data_s
     int                        if_num;
     pending_cmd_t              *pending_cmds;
     ipmi_lock_t                *cmd_lock;
+
+    /* Unused pending commands, protected by cmd_lock. */
+    pending_cmd_t              *free_cmds;
+    unsigned int               free_cmd_count;
     cmd_handler_t              *cmd_handlers;
     ipmi_lock_t                *cmd_handlers_lock;
     os_hnd_fd_id_t             *fd_wait_id;
@@ -148,6 +168,53 @@ typedef struct smi_data_s
 static ipmi_lock_t *smi_list_lock = NULL;
 static smi_data_t *smi_list = NULL;
 
+static pending_cmd_t *
+smi_get_cmd(smi_data_t *smi)
+{
+    pending_cmd_t *cmd;
+
+    ipmi_lock(smi->cmd_lock);
+    cmd = smi->free_cmds;
+    if (cmd) {
+	smi->free_cmds = cmd->next;
+	smi->free_cmd_count--;
+    }
+    ipmi_unlock(smi->cmd_lock);
+
+    if (!cmd)
+	cmd = ipmi_mem_alloc(sizeof(*cmd));
+    return cmd;
+}
+
+static void
+smi_put_cmd(smi_data_t *smi, pending_cmd_t *cmd)
+{
+    ipmi_lock(smi->cmd_lock);
+    if (smi->free_cmd_count < SMI_CMD_CACHE_SIZE) {
+	cmd->next = smi->free_cmds;
+	smi->free_cmds = cmd;
+	smi->free_cmd_count++;
+	cmd = NULL;
+    }
+    ipmi_unlock(smi->cmd_lock);
+
+    if (cmd)
+	ipmi_mem_free(cmd);
+}
+
+static void
+smi_free_cmds(smi_data_t *smi)
+{
+    pending_cmd_t *cmd;
+
+    while (smi->free_cmds) {
+	cmd = smi->free_cmds;
+	smi->free_cmds = cmd->next;
+	ipmi_mem_free(cmd);
+    }
+    smi->free_cmd_count = 0;
+}
+
 /* Must be called with the ipmi read or write lock. */
 static int smi_valid_ipmi(ipmi_con_t *ipmi)
 {
@@ -215,6 +282,7 @@ smi_cleanup(ipmi_con_t *ipmi)
 	ipmi_mem_free(cmd);
 	cmd = next_cmd;
     }
+    smi_free_cmds(smi);
 
     hnd_to_free = smi->cmd_handlers;
     smi->cmd_handlers = NULL;
@@ -236,7 +304,9 @@ smi_cleanup(ipmi_con_t *ipmi)
 
     if (ipmi->oem_data_cleanup)
 	ipmi->oem_data_cleanup(ipmi);
+    ipmi_con_msg_cache_cleanup(ipmi);
     ipmi_con_attr_cleanup(ipmi);
+    ipmi_con_latency_cleanup(ipmi);
     if (smi->smi_lock)
 	ipmi_destroy_lock(smi->smi_lock);
     if (smi->cmd_handlers_lock)
@@ -691,6 +761,29 @@ handle_response(ipmi_con_t *ipmi, struct ipmi_recv *recv)
 
     ipmi_unlock(smi->cmd_lock);
 
+    if (ipmi->latency && cmd->send_time.tv_sec) {
+	struct timeval now;
+	long           usec;
+	int            timed_out;
+
+	ipmi->os_hnd->get_monotonic_time(ipmi->os_hnd, &now);
+	usec = ((now.tv_sec - cmd->send_time.tv_sec) * 1000000
+		+ (now.tv_usec - cmd->send_time.tv_usec));
+	if (usec < 0)
+	    usec = 0;
+	/* The driver does the timeouts and retries. */
+	timed_out = ((recv->msg.data_len > 0)
+		     && (recv->msg.data[0] == IPMI_TIMEOUT_CC));
+	ipmi_con_latency_add(ipmi, cmd->msg.netfn, cmd->msg.cmd, usec, 0,
+			     timed_out);
+    }
+    if ((recv->msg.data_len > 0) && (recv->msg.data[0] == IPMI_TIMEOUT_CC))
+	IPMI_TRACE(IPMI_TRACE_MSG_TIMEOUT, ipmi, NULL, cmd, 0,
+		   cmd->msg.netfn, cmd->msg.cmd);
+    else
+	IPMI_TRACE(IPMI_TRACE_MSG_RECV, ipmi, NULL, cmd, 0,
+		   cmd->msg.netfn, cmd->msg.cmd);
+
     if (cmd->use_orig_addr) {
 	/* We did an address translation, make sure the address is the one
 	   that was previously provided. */
@@ -701,7 +794,7 @@ handle_response(ipmi_con_t *ipmi, struct ipmi_recv *recv)
 	rspi->addr_len = recv->addr_len;
     }
 
-    ipmi_mem_free(cmd);
+    smi_put_cmd(smi, cmd);
     cmd = NULL; /* It's gone after this point. */
 
     ipmi_handle_rsp_item_copymsg(ipmi, rspi, &recv->msg, rsp_handler);
@@ -904,6 +997,7 @@ ipmi_dev_data_handler(int            fd,
     ipmi_addr_t      addr;
     struct ipmi_recv recv;
     int              rv;
+    int              count;
 
     if (!smi_valid_ipmi(ipmi)) {
 	/* We can have due to a race condition, just return and
@@ -911,23 +1005,28 @@ ipmi_dev_data_handler(int            fd,
 	return;
     }
 
-    recv.msg.data = data;
-    recv.msg.data_len = sizeof(data);
-    recv.addr = (unsigned char *) &addr;
-    recv.addr_len = sizeof(addr);
-    rv = ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, &recv);
-    if (rv == -1) {
-	if (errno == EMSGSIZE) {
-	    /* The message was truncated, handle it as such. */
-	    data[0] = IPMI_REQUESTED_DATA_LENGTH_EXCEEDED_CC;
-	    rv = 0;
-	} else
-	    goto out;
-    }
+    /* Pull everything the driver has queued, so a busy BMC doesn't
+       cost a trip through the selector per message.  This is bounded
+       so one interface can't starve the others. */
+    for (count=0; count<SMI_MAX_RECV_BATCH; count++) {
+	recv.msg.data = data;
+	recv.msg.data_len = sizeof(data);
+	recv.addr = (unsigned char *) &addr;
+	recv.addr_len = sizeof(addr);
+	rv = ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, &recv);
+	if (rv == -1) {
+	    if (errno == EMSGSIZE) {
+		/* The message was truncated, handle it as such. */
+		data[0] = IPMI_REQUESTED_DATA_LENGTH_EXCEEDED_CC;
+		rv = 0;
+	    } else
+		/* Usually EAGAIN, the queue is empty. */
+		break;
+	}
 
-    gen_recv_msg(ipmi, &recv);
+	gen_recv_msg(ipmi, &recv);
+    }
 
- out:
     smi_put(ipmi);
 }
 
@@ -957,12 +1056,12 @@ smi_send_command(ipmi_con_t            *ipmi,
     smi = (smi_data_t *) ipmi->con_data;
 
     if (!rspi) {
-	rspi = ipmi_alloc_msg_item();
+	rspi = ipmi_con_alloc_msg_item(ipmi);
 	if (!rspi)
 	    return ENOMEM;
     }
 
-    cmd = ipmi_mem_alloc(sizeof(*cmd));
+    cmd = smi_get_cmd(smi);
     if (!cmd) {
 	rv = ENOMEM;
 	goto out_unlock2;
@@ -975,8 +1074,11 @@ smi_send_command(ipmi_con_t            *ipmi,
     {
 	ipmi_ipmb_addr_t *ipmb = (ipmi_ipmb_addr_t *) addr;
 
-	if (ipmb->channel >= MAX_IPMI_USED_CHANNELS)
-	    return EINVAL;
+	if (ipmb->channel >= MAX_IPMI_USED_CHANNELS) {
+	    smi_put_cmd(smi, cmd);
+	    rv = EINVAL;
+	    goto out_unlock2;
+	}
 
 	if (ipmb->slave_addr == smi->slave_addr[ipmb->channel]) {
 	    ipmi_system_interface_addr_t *si = (void *) addr_data2;
@@ -1001,6 +1103,10 @@ smi_send_command(ipmi_con_t            *ipmi,
     cmd->msg = *msg;
     cmd->rsp_handler = rsp_handler;
     cmd->rsp_item = rspi;
+    if (ipmi->latency)
+	ipmi->os_hnd->get_monotonic_time(ipmi->os_hnd, &cmd->send_time);
+    else
+	cmd->send_time.tv_sec = 0;
 
     ipmi_lock(smi->cmd_lock);
     add_cmd(ipmi, addr, addr_len, msg, smi, cmd);
@@ -1008,9 +1114,10 @@ smi_send_command(ipmi_con_t            *ipmi,
     rv = smi_send(smi, smi->fd, addr, addr_len, msg, (long) cmd);
     if (rv) {
 	remove_cmd(ipmi, smi, cmd);
-	ipmi_mem_free(cmd);
+	smi_put_cmd(smi, cmd);
 	goto out_unlock;
     }
+    IPMI_TRACE(IPMI_TRACE_MSG_SEND, ipmi, NULL, cmd, 0, msg->netfn, msg->cmd);
 
  out_unlock:
     ipmi_unlock(smi->cmd_lock);
@@ -1018,7 +1125,7 @@ smi_send_command(ipmi_con_t            *ipmi,
     if (rv) {
 	/* If we allocated an rspi, free it. */
 	if (!trspi && rspi)
-	    ipmi_free_msg_item(rspi);
+	    ipmi_con_free_msg_item(ipmi, rspi);
     }
     return rv;
 }
@@ -1135,7 +1242,11 @@ cleanup_con(ipmi_con_t *ipmi)
     smi = (smi_data_t *) ipmi->con_data;
     handlers = ipmi->os_hnd;
 
+    if (smi)
+	smi_free_cmds(smi);
+    ipmi_con_msg_cache_cleanup(ipmi);
     ipmi_con_attr_cleanup(ipmi);
+    ipmi_con_latency_cleanup(ipmi);
     if (ipmi->name) {
 	ipmi_mem_free(ipmi->name);
 	ipmi->name = NULL;
@@ -1503,7 +1614,23 @@ setup(int          if_num,
     if (rv)
 	goto out_err;
 
+    rv = ipmi_con_msg_cache_init(ipmi, SMI_CMD_CACHE_SIZE);
+    if (rv)
+	goto out_err;
+    for (i=0; i<SMI_CMD_CACHE_SIZE; i++) {
+	pending_cmd_t *cmd = ipmi_mem_alloc(sizeof(*cmd));
+
+	if (!cmd) {
+	    rv = ENOMEM;
+	    goto out_err;
+	}
+	cmd->next = smi->free_cmds;
+	smi->free_cmds = cmd;
+	smi->free_cmd_count++;
+    }
+
     smi->if_num = if_num;
+    ipmi->mc_concurrency = SMI_MC_CONCURRENCY;
 
     ipmi->start_con = smi_start_con;
     ipmi->set_ipmb_addr = smi_set_ipmb_addr;
@@ -43,6 +43,7 @@
 #include <sys/stat.h>
 #include <sys/poll.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -115,7 +116,18 @@
 #define IPMI_SOL_AUX_DEASSERT_HANDSHAKE 0x02
 
 
-#define IPMI_SOL_MAX_DATA_SIZE 103
+/* The most data bytes in one SoL packet, what fits in a message after
+   the 4-byte SoL header.  The BMC may allow less. */
+#define IPMI_SOL_MAX_DATA_SIZE (IPMI_MAX_MSG_LENGTH - 4)
+
+/* The starting size of the transmit ring, and the most free queue
+   items kept. */
+#define IPMI_SOL_TX_RING_SIZE 4096
+#define IPMI_SOL_TX_FREE_ITEMS 16
+
+/* Defaults for receive coalescing, if only one limit is given. */
+#define IPMI_SOL_RX_COALESCE_BYTES 4096
+#define IPMI_SOL_RX_COALESCE_MS 20
 
 #if 0
 #define IPMI_SOL_DEBUG_TRANSMIT
@@ -142,17 +154,14 @@ struct callback_list_s {
 /**
  * Stores a write-request from the client software, along with its transmit
  * complete callback and in-band operation mask (currently used only for serial
- * breaks).
+ * breaks).  The bytes themselves are in the transmitter's ring, in queue
+ * order.
  */
 typedef struct ipmi_sol_outgoing_queue_item_s ipmi_sol_outgoing_queue_item_t;
 struct ipmi_sol_outgoing_queue_item_s {
-    /* The bytes to transmit.  This will be NULL if the queue item
-       represents a BREAK. */
-    char *data;
-
-    /* The number of bytes in this packet.  Will be zero if the queue
+    /* The number of bytes in this request.  Will be zero if the queue
        item represents a BREAK. */
-    unsigned char data_len;
+    unsigned int data_len;
 
     /* The in-band (sequential) operation.  Should only contain
        IPMI_SOL_GENERATE_BREAK for now. */
@@ -243,6 +252,18 @@ struct ipmi_sol_transmitter_context_s {
     /* A queue of un-acked transmit requests. */
     ipmi_sol_outgoing_queue_t outgoing_queue;
 
+    /* Unused queue items, kept to avoid an allocation per write. */
+    ipmi_sol_outgoing_queue_item_t *free_items;
+    unsigned int free_item_count;
+
+    /* The un-acked bytes of the requests in the queue, ring_len bytes
+       starting at ring_start.  Packets are built straight from here.
+       The ring grows if a write doesn't fit. */
+    unsigned char *ring;
+    unsigned int ring_size;
+    unsigned int ring_start;
+    unsigned int ring_len;
+
     /* A reference back to the SoL connection to which this
        transmitter belongs. */
     ipmi_sol_conn_t *sol_conn;
@@ -250,11 +271,8 @@ struct ipmi_sol_transmitter_context_s {
     /* The latest entire packet transmitted is stored here. */
     ipmi_sol_outgoing_packet_record_t *transmitted_packet;
 
-    /* A buffer into which the data is coalesced for transmission. */
-    unsigned char *scratch_area;
-
-    /* The size of the scratch_area buffer. */
-    int scratch_area_size;
+    /* The most data bytes to put in one packet. */
+    int max_data_size;
 
     /* Keep track of the sequence number that we've most recently sent. */
     int latest_outgoing_seqnr;
@@ -358,6 +376,34 @@ struct ipmi_sol_conn_s {
     /* A list of callbacks that are called when data received from the BMC. */
     locked_list_t *data_received_callback_list;
 
+    /* Received data is held in rx_buf and handed to the callbacks
+       once there are rx_coalesce_bytes of it or it is rx_coalesce_ms
+       old, see ipmi_sol_set_receive_coalesce().  rx_buf is NULL if
+       coalescing is off.  If the callbacks NACK the data, it stays
+       in rx_buf until the NACK is released.  The buffer is only
+       touched by the thread that has processing_packet set. */
+    unsigned int      rx_coalesce_bytes;
+    unsigned int      rx_coalesce_ms;
+    unsigned char     *rx_buf;
+    unsigned int      rx_len;
+    int               rx_flush_pending;
+    os_hnd_timer_id_t *rx_timer;
+    int               rx_timer_running;
+
+    /* If rx_ring is set, received data goes into it for the
+       application to read with ipmi_sol_ring_read(), see
+       ipmi_sol_set_receive_ring().  rx_ring_head is only written by
+       the library and rx_ring_tail only by the reader.  If a packet
+       didn't fit, it was NACKed and rx_ring_stalled is set, the
+       reader releases the NACK once half the ring is free. */
+    unsigned char          *rx_ring;
+    unsigned int           rx_ring_size;
+    unsigned int           rx_ring_head;
+    unsigned int           rx_ring_tail;
+    int                    rx_ring_stalled;
+    ipmi_sol_ring_ready_cb rx_ring_ready;
+    void                   *rx_ring_ready_cb_data;
+
     /* A list of callbacks that are called when a break is reported by
        the BMC. */
     locked_list_t *break_detected_callback_list;
@@ -384,6 +430,7 @@ struct ipmi_sol_conn_s {
 
 
 static int transmitter_startup(ipmi_sol_transmitter_context_t *transmitter);
+static void transmitter_free_items(ipmi_sol_transmitter_context_t *transmitter);
 static void transmitter_shutdown(ipmi_sol_transmitter_context_t *transmitter,
 				 int error);
 static void transmitter_prod_nolock
@@ -391,6 +438,8 @@ static void transmitter_prod_nolock
 static void process_packet(ipmi_sol_conn_t *conn,
 			   unsigned char   *packet,
 			   unsigned int    data_len);
+static void rx_coalesce_deliver(ipmi_sol_conn_t *conn, int force);
+static void rx_coalesce_start_timer(ipmi_sol_conn_t *conn, unsigned int ms);
 
 static void
 dump_hex(unsigned char *data, int len)
@@ -537,9 +586,24 @@ sol_cleanup(ipmi_sol_conn_t *conn)
 	ipmi_mem_free(to_free);
     }
 
+    if (conn->rx_timer) {
+	os_handler_t *os_hnd = conn->ipmi->os_hnd;
+
+	if (conn->rx_timer_running)
+	    os_hnd->stop_timer(os_hnd, conn->rx_timer);
+	os_hnd->free_timer(os_hnd, conn->rx_timer);
+    }
+    if (conn->rx_buf)
+	ipmi_mem_free(conn->rx_buf);
+    if (conn->rx_ring)
+	ipmi_mem_free(conn->rx_ring);
+
     conn->ipmi->close_connection(conn->ipmi);
     if (conn->transmitter.packet_lock)
 	ipmi_destroy_lock(conn->transmitter.packet_lock);
+    transmitter_free_items(&conn->transmitter);
+    if (conn->transmitter.ring)
+	ipmi_mem_free(conn->transmitter.ring);
     if (conn->transmitter.queue_lock)
 	ipmi_destroy_lock(conn->transmitter.queue_lock);
     if (conn->transmitter.oob_op_lock)
@@ -1050,6 +1114,197 @@ ipmi_sol_get_bit_rate(ipmi_sol_conn_t *conn)
 }
 
 
+int
+ipmi_sol_set_receive_coalesce(ipmi_sol_conn_t *conn,
+			      unsigned int    max_bytes,
+			      unsigned int    max_ms)
+{
+    os_handler_t  *os_hnd;
+    unsigned char *buf = NULL;
+    int           rv = 0;
+
+    if (!conn)
+	return EINVAL;
+
+    os_hnd = conn->ipmi->os_hnd;
+
+    ipmi_lock(conn->transmitter.packet_lock);
+    if (conn->state != ipmi_sol_state_closed) {
+	rv = EINVAL;
+	goto out_unlock;
+    }
+
+    if (max_bytes || max_ms) {
+	if (!max_bytes)
+	    max_bytes = IPMI_SOL_RX_COALESCE_BYTES;
+	if (!max_ms)
+	    max_ms = IPMI_SOL_RX_COALESCE_MS;
+
+	/* Room for one more packet past the limit. */
+	buf = ipmi_mem_alloc(max_bytes + IPMI_SOL_MAX_DATA_SIZE);
+	if (!buf) {
+	    rv = ENOMEM;
+	    goto out_unlock;
+	}
+	if (!conn->rx_timer) {
+	    rv = os_hnd->alloc_timer(os_hnd, &conn->rx_timer);
+	    if (rv) {
+		ipmi_mem_free(buf);
+		goto out_unlock;
+	    }
+	}
+    }
+
+    if (conn->rx_buf)
+	ipmi_mem_free(conn->rx_buf);
+    conn->rx_buf = buf;
+    conn->rx_len = 0;
+    conn->rx_coalesce_bytes = max_bytes;
+    conn->rx_coalesce_ms = max_ms;
+
+ out_unlock:
+    ipmi_unlock(conn->transmitter.packet_lock);
+    return rv;
+}
+
+void
+ipmi_sol_get_receive_coalesce(ipmi_sol_conn_t *conn,
+			      unsigned int    *max_bytes,
+			      unsigned int    *max_ms)
+{
+    if (max_bytes)
+	*max_bytes = conn->rx_coalesce_bytes;
+    if (max_ms)
+	*max_ms = conn->rx_coalesce_ms;
+}
+
+int
+ipmi_sol_set_receive_ring(ipmi_sol_conn_t        *conn,
+			  unsigned int           size,
+			  ipmi_sol_ring_ready_cb ready,
+			  void                   *cb_data)
+{
+    unsigned char *ring = NULL;
+    unsigned int  n;
+
+    if (!conn)
+	return EINVAL;
+    if (size && ((size < 2 * IPMI_SOL_MAX_DATA_SIZE) || (size > (1U << 30))))
+	return EINVAL;
+
+    for (n=1; n<size; n <<= 1)
+	;
+    if (size) {
+	ring = ipmi_mem_alloc(n);
+	if (!ring)
+	    return ENOMEM;
+    }
+
+    ipmi_lock(conn->transmitter.packet_lock);
+    if (conn->state != ipmi_sol_state_closed) {
+	ipmi_unlock(conn->transmitter.packet_lock);
+	if (ring)
+	    ipmi_mem_free(ring);
+	return EINVAL;
+    }
+
+    if (conn->rx_ring)
+	ipmi_mem_free(conn->rx_ring);
+    conn->rx_ring = ring;
+    conn->rx_ring_size = size ? n : 0;
+    conn->rx_ring_head = 0;
+    conn->rx_ring_tail = 0;
+    conn->rx_ring_stalled = 0;
+    conn->rx_ring_ready = ready;
+    conn->rx_ring_ready_cb_data = cb_data;
+    ipmi_unlock(conn->transmitter.packet_lock);
+    return 0;
+}
+
+unsigned int
+ipmi_sol_ring_read(ipmi_sol_conn_t *conn, void *buf, unsigned int len)
+{
+    unsigned char *data = buf;
+    unsigned int  head, tail, mask, avail, off, n;
+
+    if (!conn->rx_ring)
+	return 0;
+
+    mask = conn->rx_ring_size - 1;
+    tail = conn->rx_ring_tail;
+    head = __atomic_load_n(&conn->rx_ring_head, __ATOMIC_ACQUIRE);
+    avail = head - tail;
+    if (len > avail)
+	len = avail;
+    if (len) {
+	off = tail & mask;
+	n = conn->rx_ring_size - off;
+	if (n > len)
+	    n = len;
+	memcpy(data, conn->rx_ring + off, n);
+	memcpy(data + n, conn->rx_ring, len - n);
+	tail += len;
+
+	/* Sequentially consistent so that either the library sees
+	   this space when it checks after stalling, or this sees the
+	   stall. */
+	__atomic_store_n(&conn->rx_ring_tail, tail, __ATOMIC_SEQ_CST);
+    }
+
+    if (__atomic_load_n(&conn->rx_ring_stalled, __ATOMIC_SEQ_CST)
+	&& (conn->rx_ring_size - (head - tail) >= conn->rx_ring_size / 2)
+	&& __atomic_exchange_n(&conn->rx_ring_stalled, 0, __ATOMIC_SEQ_CST))
+	ipmi_sol_release_nack(conn);
+
+    return len;
+}
+
+/*
+ * Put a packet's data into the receive ring.  Must be called with
+ * the packet lock held.  Returns false if the data did not fit, the
+ * packet should be NACKed and nack_count has been incremented for it.
+ */
+static int
+rx_ring_put(ipmi_sol_conn_t *conn, unsigned char *data, unsigned int len)
+{
+    unsigned int head, tail, mask, off, n;
+
+    mask = conn->rx_ring_size - 1;
+    head = conn->rx_ring_head;
+    tail = __atomic_load_n(&conn->rx_ring_tail, __ATOMIC_SEQ_CST);
+    if (conn->rx_ring_size - (head - tail) < len) {
+	/* Mark it stalled, then look again in case the reader made
+	   room before it could see the stall. */
+	conn->transmitter.nack_count++;
+	__atomic_store_n(&conn->rx_ring_stalled, 1, __ATOMIC_SEQ_CST);
+	tail = __atomic_load_n(&conn->rx_ring_tail, __ATOMIC_SEQ_CST);
+	if ((conn->rx_ring_size - (head - tail) < len)
+	    || !__atomic_exchange_n(&conn->rx_ring_stalled, 0,
+				    __ATOMIC_SEQ_CST))
+	    return 0;
+	conn->transmitter.nack_count--;
+    }
+
+    off = head & mask;
+    n = conn->rx_ring_size - off;
+    if (n > len)
+	n = len;
+    memcpy(conn->rx_ring + off, data, n);
+    memcpy(conn->rx_ring, data + n, len - n);
+    __atomic_store_n(&conn->rx_ring_head, head + len, __ATOMIC_SEQ_CST);
+
+    /* If the reader had taken everything, it may be waiting. */
+    if (conn->rx_ring_ready
+	&& (__atomic_load_n(&conn->rx_ring_tail, __ATOMIC_SEQ_CST) == head))
+    {
+	ipmi_unlock(conn->transmitter.packet_lock);
+	conn->rx_ring_ready(conn, conn->rx_ring_ready_cb_data);
+	ipmi_lock(conn->transmitter.packet_lock);
+    }
+    return 1;
+}
+
+
 static void
 do_and_destroy_transmit_complete_callbacks(callback_list_t *list,
 					   ipmi_sol_conn_t *conn)
@@ -1073,8 +1328,14 @@ static void
 process_waiting_packets(ipmi_sol_conn_t *conn)
 {
     while ((conn->waiting_packets) || conn->waiting_callbacks
-	   || (conn->waiting_states))
+	   || (conn->waiting_states) || conn->rx_flush_pending)
     {
+	if (conn->rx_flush_pending) {
+	    conn->rx_flush_pending = 0;
+	    rx_coalesce_deliver(conn, conn->state == ipmi_sol_state_closed);
+	    continue;
+	}
+
 	while (conn->waiting_callbacks) {
 	    callback_list_t *callbacks = conn->waiting_callbacks;
 	    conn->waiting_callbacks = NULL;
@@ -1154,7 +1415,13 @@ ipmi_sol_set_connection_state(ipmi_sol_conn_t *conn,
     conn->state = new_state;
 
     if (conn->processing_packet) {
-	sol_state_cb_info_t *sp = ipmi_mem_alloc(sizeof(*sp));
+	sol_state_cb_info_t *sp;
+
+	/* Hand over any held received data before the state change. */
+	if ((new_state == ipmi_sol_state_closed) && conn->rx_len)
+	    conn->rx_flush_pending = 1;
+
+	sp = ipmi_mem_alloc(sizeof(*sp));
 	if (!sp) {
 	    /* Yikes, no memory to store this.  Just log and give up. */
 	    ipmi_log(IPMI_LOG_SEVERE,
@@ -1177,6 +1444,8 @@ ipmi_sol_set_connection_state(ipmi_sol_conn_t *conn,
     }
 
     conn->processing_packet = 1;
+    if (new_state == ipmi_sol_state_closed)
+	rx_coalesce_deliver(conn, 1);
     ipmi_unlock(conn->transmitter.packet_lock);
     do_connection_state_callbacks(conn, new_state, error);
     ipmi_lock(conn->transmitter.packet_lock);
@@ -1215,12 +1484,8 @@ dump_transmitter_queue_state(ipmi_sol_transmitter_context_t *transmitter)
     if (transmitter->outgoing_queue.head) {
 	ipmi_sol_outgoing_queue_item_t *i = transmitter->outgoing_queue.head;
 	while (i) {
-	    printf("%p -> %d chars at %p -> [", i, i->data_len, i->data);
+	    printf("%p -> %d chars\n", i, i->data_len);
 	    fflush(stdout);
-	    int j;
-	    for (j = 0; j < i->data_len; ++j)
-		printf("%c", i->data[j]);
-	    printf("]\n"); fflush(stdout);
 	    i = i->next;
 	}
     }
@@ -1233,12 +1498,99 @@ dump_transmitter_queue_state(ipmi_sol_transmitter_context_t *transmitter)
 }
 #endif
 
+/*
+ * Copy len bytes from the start of the transmit ring.
+ */
+static void
+transmitter_ring_copy(ipmi_sol_transmitter_context_t *transmitter,
+		      unsigned char                  *dest,
+		      unsigned int                   len)
+{
+    unsigned int first = transmitter->ring_size - transmitter->ring_start;
+
+    if (first > len)
+	first = len;
+    memcpy(dest, transmitter->ring + transmitter->ring_start, first);
+    if (len > first)
+	memcpy(dest + first, transmitter->ring, len - first);
+}
+
+/*
+ * Drop len acknowledged bytes from the start of the transmit ring.
+ */
+static void
+transmitter_ring_consume(ipmi_sol_transmitter_context_t *transmitter,
+			 unsigned int                   len)
+{
+    if (len > transmitter->ring_len)
+	len = transmitter->ring_len;
+    if (len == 0)
+	return;
+    transmitter->ring_start = ((transmitter->ring_start + len)
+			       % transmitter->ring_size);
+    transmitter->ring_len -= len;
+    if (transmitter->ring_len == 0)
+	transmitter->ring_start = 0;
+}
+
+/*
+ * Make room for len more bytes in the transmit ring, growing it if
+ * necessary.
+ */
+static int
+transmitter_ring_reserve(ipmi_sol_transmitter_context_t *transmitter,
+			 unsigned int                   len)
+{
+    unsigned int  new_size;
+    unsigned char *new_ring;
+
+    if (transmitter->ring_size - transmitter->ring_len >= len)
+	return 0;
+
+    new_size = transmitter->ring_size;
+    if (new_size == 0)
+	new_size = IPMI_SOL_TX_RING_SIZE;
+    while (new_size - transmitter->ring_len < len)
+	new_size *= 2;
+    new_ring = ipmi_mem_alloc(new_size);
+    if (!new_ring)
+	return ENOMEM;
+    if (transmitter->ring) {
+	transmitter_ring_copy(transmitter, new_ring, transmitter->ring_len);
+	ipmi_mem_free(transmitter->ring);
+    }
+    transmitter->ring = new_ring;
+    transmitter->ring_size = new_size;
+    transmitter->ring_start = 0;
+    return 0;
+}
+
+/*
+ * Put len bytes on the end of the transmit ring, room must have been
+ * reserved.
+ */
+static void
+transmitter_ring_put(ipmi_sol_transmitter_context_t *transmitter,
+		     const unsigned char            *data,
+		     unsigned int                   len)
+{
+    unsigned int end = ((transmitter->ring_start + transmitter->ring_len)
+			% transmitter->ring_size);
+    unsigned int first = transmitter->ring_size - end;
+
+    if (first > len)
+	first = len;
+    memcpy(transmitter->ring + end, data, first);
+    if (len > first)
+	memcpy(transmitter->ring, data + first, len - first);
+    transmitter->ring_len += len;
+}
+
 static ipmi_sol_outgoing_packet_record_t *
 transmitter_gather(ipmi_sol_transmitter_context_t *transmitter,
 		   int                            control_only)
 {
     int data_len = 0;
-    unsigned char *ptr = &transmitter->scratch_area[0];
     ipmi_sol_outgoing_packet_record_t *new_packet_record = NULL;
     ipmi_sol_outgoing_queue_item_t *qi = transmitter->outgoing_queue.head;
     unsigned char ib_op = 0;
@@ -1254,9 +1606,9 @@ transmitter_gather(ipmi_sol_transmitter_context_t *transmitter,
 
     if (!control_only) {
 	/*
-	 * Do the data gather into the transmitter scratch area
+	 * Work out how much of the ring goes in this packet.
 	 */
-	while (qi && (data_len < transmitter->scratch_area_size)) {
+	while (qi && (data_len < transmitter->max_data_size)) {
 	    /*
 	     * Is this queue item a break?
 	     */
@@ -1275,15 +1627,14 @@ transmitter_gather(ipmi_sol_transmitter_context_t *transmitter,
 	    } else {
 		/*
 		 * Data in this qi: Figure out how many chars we are going to
-		 * copy.  Skip any bytes that the BMC has already ACKed,
-		 * then limit our copy to fit within the buffer space.
+		 * send.  Skip any bytes that the BMC has already ACKed
+		 * (they are already gone from the ring), then limit it to
+		 * fit in the packet.
 		 */
 		int copychars = qi->data_len - already_acked;
-		if (copychars > transmitter->scratch_area_size - data_len)
-		    copychars = transmitter->scratch_area_size - data_len;
+		if (copychars > transmitter->max_data_size - data_len)
+		    copychars = transmitter->max_data_size - data_len;
 
-		memcpy(ptr, &qi->data[already_acked], copychars);
-		ptr += copychars;
 		data_len += copychars;
 		already_acked = 0;
 	    }
@@ -1350,10 +1701,10 @@ transmitter_gather(ipmi_sol_transmitter_context_t *transmitter,
 	new_packet_record->transmit_attempts_remaining
 	    = transmitter->sol_conn->ACK_retries;
 
-	/* Give it the data */
-	memcpy(&new_packet_record->packet[PACKET_DATA],
-	       transmitter->scratch_area,
-	       data_len);
+	/* Give it the data, straight from the ring */
+	transmitter_ring_copy(transmitter,
+			      &new_packet_record->packet[PACKET_DATA],
+			      data_len);
     } else {
 	/* Zero sequence number for control-only packet */
 	new_packet_record->packet[PACKET_SEQNR] = 0;
@@ -1751,11 +2102,13 @@ dequeue_head(ipmi_sol_transmitter_context_t *transmitter, int error)
 	    (qitem->transmit_complete_callback)(transmitter->sol_conn,
 						error, qitem->cb_data);
 	
-	if (qitem->data)
-	    ipmi_mem_free(qitem->data);
-	
 	transmitter->outgoing_queue.head = qitem->next;
-	ipmi_mem_free(qitem);
+	if (transmitter->free_item_count < IPMI_SOL_TX_FREE_ITEMS) {
+	    qitem->next = transmitter->free_items;
+	    transmitter->free_items = qitem;
+	    transmitter->free_item_count++;
+	} else
+	    ipmi_mem_free(qitem);
 	
 	/* Deleting the last packet in the list? */
 	if (NULL == transmitter->outgoing_queue.head)
@@ -1778,6 +2131,8 @@ transmitter_flush_outbound(ipmi_sol_transmitter_context_t *transmitter,
     ipmi_lock(transmitter->queue_lock);
     while (transmitter->outgoing_queue.head)
 	dequeue_head(transmitter, error);
+    transmitter->ring_start = 0;
+    transmitter->ring_len = 0;
     ipmi_unlock(transmitter->queue_lock);
 }
 
@@ -1844,6 +2199,7 @@ transmitter_handle_acknowledge(ipmi_sol_conn_t *conn,
 	    this_ack = acknowledged_char_count;
 
 	conn->transmitter.bytes_acked_at_head += this_ack;
+	transmitter_ring_consume(&conn->transmitter, this_ack);
 	if (conn->transmitter.bytes_acked_at_head == qitem->data_len) {
 	    /*
 	     * This packet is DONE.
@@ -1863,62 +2219,83 @@ transmitter_handle_acknowledge(ipmi_sol_conn_t *conn,
 
 
 /**
- * Creates a new transmitter tail packet and adds it to the transmit queue.
+ * Adds the data in the given buffers to the transmit queue.
  *
- * If count > 0, the given data bytes are added to the queue.  If count == 0,
- * this means a serial "break" to the transmitter.
+ * The bytes go on the end of the transmit ring.  A queue item is only
+ * needed to keep the callback (or a BREAK) in order with the data, so
+ * data without a callback just extends a previous item with no
+ * callback.  If the total count is zero, this means a serial "break"
+ * to the transmitter.
  */
 static int
 add_to_transmit_queue(ipmi_sol_transmitter_context_t *tx,
-		      const void                     *buf,
-		      int                            count,
+		      const struct iovec             *iov,
+		      int                            iovcnt,
 		      unsigned char                  ib_op,
 		      ipmi_sol_transmit_complete_cb  cb,
 		      void                           *cb_data)
 {
-    ipmi_sol_outgoing_queue_item_t *new_tail;
+    ipmi_sol_outgoing_queue_item_t *new_tail, *tail;
+    unsigned int count = 0;
+    int i, rv;
 
 #ifdef IPMI_SOL_DEBUG_TRANSMIT
     dump_transmitter_queue_state(tx);
 #endif
 
-    new_tail = ipmi_mem_alloc(sizeof(*new_tail));
-    if (!new_tail)
-	return ENOMEM;
+    for (i = 0; i < iovcnt; i++)
+	count += iov[i].iov_len;
 
-    if (count) {
-	new_tail->data = ipmi_mem_alloc(count);
-	if (!new_tail->data) {
-	    ipmi_mem_free(new_tail);
-	    return ENOMEM;
+    ipmi_lock(tx->queue_lock);
+
+    rv = transmitter_ring_reserve(tx, count);
+    if (rv)
+	goto out_unlock;
+
+    tail = tx->outgoing_queue.tail;
+    if (count && !cb && tail && tail->data_len
+	&& !tail->transmit_complete_callback)
+    {
+	tail->data_len += count;
+    } else {
+	new_tail = tx->free_items;
+	if (new_tail) {
+	    tx->free_items = new_tail->next;
+	    tx->free_item_count--;
+	} else {
+	    new_tail = ipmi_mem_alloc(sizeof(*new_tail));
+	    if (!new_tail) {
+		rv = ENOMEM;
+		goto out_unlock;
+	    }
 	}
-	
-	memcpy(new_tail->data, buf, count);
-    } else
-	new_tail->data = NULL;
 
-    new_tail->data_len = count;
-    new_tail->ib_op = ib_op;
-    new_tail->transmit_complete_callback = cb;
-    new_tail->cb_data = cb_data;
-    new_tail->next = NULL;
+	new_tail->data_len = count;
+	new_tail->ib_op = ib_op;
+	new_tail->transmit_complete_callback = cb;
+	new_tail->cb_data = cb_data;
+	new_tail->next = NULL;
 
-    ipmi_lock(tx->queue_lock);
+	if (tail)
+	    tail->next = new_tail;
 
-    if (tx->outgoing_queue.tail)
-	tx->outgoing_queue.tail->next = new_tail;
+	tx->outgoing_queue.tail = new_tail;
 
-    tx->outgoing_queue.tail = new_tail;
+	/* Adding to a previously empty list? */
+	if (!tx->outgoing_queue.head)
+	    tx->outgoing_queue.head = new_tail;
+    }
 
-    /* Adding to a previously empty list? */
-    if (!tx->outgoing_queue.head)
-	tx->outgoing_queue.head = new_tail;
+    for (i = 0; i < iovcnt; i++)
+	transmitter_ring_put(tx, iov[i].iov_base, iov[i].iov_len);
 
+ out_unlock:
     ipmi_unlock(tx->queue_lock);
 
-    transmitter_prod_nolock(tx);
+    if (!rv)
+	transmitter_prod_nolock(tx);
 
-    return 0;
+    return rv;
 }
 
 /*
@@ -1957,11 +2334,15 @@ add_op_control_callback(ipmi_sol_transmitter_context_t *tx,
 static int
 transmitter_startup(ipmi_sol_transmitter_context_t *transmitter)
 {
-    transmitter->scratch_area = ipmi_mem_alloc(transmitter->scratch_area_size);
-    if (!transmitter->scratch_area) {
+    int rv;
+
+    ipmi_lock(transmitter->queue_lock);
+    rv = transmitter_ring_reserve(transmitter, IPMI_SOL_TX_RING_SIZE);
+    ipmi_unlock(transmitter->queue_lock);
+    if (rv) {
 	/* Alloc failed! */
 	ipmi_log(IPMI_LOG_SEVERE, "ipmi_sol.c(transmitter_startup): "
-		 "Insufficient memory for transmitter scratch area.");
+		 "Insufficient memory for transmitter ring.");
 		
 	return ENOMEM;
     }
@@ -1969,16 +2350,33 @@ transmitter_startup(ipmi_sol_transmitter_context_t *transmitter)
     return 0;
 }
 
+static void
+transmitter_free_items(ipmi_sol_transmitter_context_t *transmitter)
+{
+    ipmi_sol_outgoing_queue_item_t *qitem;
+
+    while (transmitter->free_items) {
+	qitem = transmitter->free_items;
+	transmitter->free_items = qitem->next;
+	ipmi_mem_free(qitem);
+    }
+    transmitter->free_item_count = 0;
+}
+
 static void
 transmitter_shutdown(ipmi_sol_transmitter_context_t *transmitter, int error)
 {
     transmitter_flush_outbound(transmitter, error);
 
     /* Free the memory being used by sundry parts */
-    if (transmitter->scratch_area) {
-	ipmi_mem_free(transmitter->scratch_area);
-	transmitter->scratch_area = NULL;
+    ipmi_lock(transmitter->queue_lock);
+    if (transmitter->ring) {
+	ipmi_mem_free(transmitter->ring);
+	transmitter->ring = NULL;
+	transmitter->ring_size = 0;
     }
+    transmitter_free_items(transmitter);
+    ipmi_unlock(transmitter->queue_lock);
 }
 
 
@@ -2002,15 +2400,45 @@ ipmi_sol_write(ipmi_sol_conn_t               *conn,
 	       ipmi_sol_transmit_complete_cb cb,
 	       void                          *cb_data)
 {
-    int rv;
+    struct iovec iov;
+
     if (count <= 0)
 	return EINVAL;
 
+    iov.iov_base = (void *) buf;
+    iov.iov_len = count;
+    return ipmi_sol_writev(conn, &iov, 1, cb, cb_data);
+}
+
+
+/*
+ * ipmi_sol_writev -
+ *
+ * Like ipmi_sol_write, but sends the bytes from a set of buffers.
+ * The callback is called once when all of them are ACKed.
+ */
+int
+ipmi_sol_writev(ipmi_sol_conn_t               *conn,
+		const struct iovec            *iov,
+		int                           iovcnt,
+		ipmi_sol_transmit_complete_cb cb,
+		void                          *cb_data)
+{
+    size_t count = 0;
+    int    i, rv;
+
+    if (iovcnt <= 0)
+	return EINVAL;
+    for (i = 0; i < iovcnt; i++)
+	count += iov[i].iov_len;
+    if (count == 0)
+	return EINVAL;
+
     ipmi_lock(conn->transmitter.packet_lock);
     if ((conn->state == ipmi_sol_state_connected)
 	|| (conn->state == ipmi_sol_state_connected_ctu))
     {
-	rv = add_to_transmit_queue(&conn->transmitter, buf, count, 0,
+	rv = add_to_transmit_queue(&conn->transmitter, iov, iovcnt, 0,
 				   cb, cb_data);
     } else
 	rv = EINVAL;
@@ -2051,6 +2479,10 @@ ipmi_sol_release_nack(ipmi_sol_conn_t *conn)
 	   nack-ed. */
 	conn->transmitter.accepted_character_count = 0;
 	transmitter_prod_nolock(&conn->transmitter);
+
+	/* Redeliver coalesced data the NACK was holding. */
+	if (conn->rx_len)
+	    rx_coalesce_start_timer(conn, 0);
     }
  out:
     ipmi_unlock(conn->transmitter.packet_lock);
@@ -2488,10 +2920,13 @@ get_sane_payload_size(int b1, int b2)
 static void
 finish_activate_payload(ipmi_sol_conn_t *conn)
 {
-    if (conn->max_outbound_payload_size > IPMI_SOL_MAX_DATA_SIZE)
-	conn->transmitter.scratch_area_size = IPMI_SOL_MAX_DATA_SIZE;
+    /* The BMC's size is for the whole payload, including the
+       header. */
+    if (conn->max_outbound_payload_size - PACKET_DATA > IPMI_SOL_MAX_DATA_SIZE)
+	conn->transmitter.max_data_size = IPMI_SOL_MAX_DATA_SIZE;
     else
-	conn->transmitter.scratch_area_size = conn->max_outbound_payload_size;
+	conn->transmitter.max_data_size
+	    = conn->max_outbound_payload_size - PACKET_DATA;
 
     ipmi_log(IPMI_LOG_INFO,
 	     "ipmi_sol.c(handle_active_payload_response): "
@@ -2506,11 +2941,12 @@ finish_activate_payload(ipmi_sol_conn_t *conn)
 	     conn->max_outbound_payload_size,
 	     conn->max_inbound_payload_size);
 
-    if (conn->max_outbound_payload_size > conn->transmitter.scratch_area_size)
+    if (conn->max_outbound_payload_size - PACKET_DATA
+	> conn->transmitter.max_data_size)
 	ipmi_log(IPMI_LOG_WARNING,
 		 "ipmi_sol.c(handle_active_payload_response): "
 		 "Limiting transmit to %d bytes.",
-		 conn->transmitter.scratch_area_size);
+		 conn->transmitter.max_data_size);
 #endif
 
     /*
@@ -3164,6 +3600,9 @@ ipmi_sol_open(ipmi_sol_conn_t *conn)
 	ipmi_sol_set_connection_state(conn, ipmi_sol_state_connecting, 0);
 
     conn->transmitter.nack_count = 0;
+    conn->rx_ring_head = 0;
+    conn->rx_ring_tail = 0;
+    conn->rx_ring_stalled = 0;
     conn->transmitter.packet_to_acknowledge = 0;
     conn->transmitter.accepted_character_count = 0;
     conn->transmitter.bytes_acked_at_head = 0;
@@ -3327,6 +3766,85 @@ sol_handle_recv(ipmi_con_t    *conn,
     return ENOSYS;
 }
 
+/*
+ * Hand the coalesced receive data to the callbacks.  Must be called
+ * with the packet lock held and processing_packet set.  If force is
+ * set (the connection is closing) the data is dropped even if the
+ * callbacks NACK it.
+ */
+static void
+rx_coalesce_deliver(ipmi_sol_conn_t *conn, int force)
+{
+    ipmi_sol_transmitter_context_t *xmitter = &conn->transmitter;
+    int                            do_nack;
+
+    conn->rx_flush_pending = 0;
+    if (!conn->rx_len || (xmitter->nack_count && !force))
+	return;
+
+    xmitter->in_recv_cb = 1;
+    ipmi_unlock(xmitter->packet_lock);
+    do_nack = do_data_received_callbacks(conn, conn->rx_buf, conn->rx_len);
+    ipmi_lock(xmitter->packet_lock);
+    xmitter->in_recv_cb = 0;
+
+    xmitter->nack_count += do_nack;
+    if (xmitter->nack_count < 0) {
+	ipmi_log(IPMI_LOG_WARNING,
+		 "ipmi_sol.c(rx_coalesce_deliver): "
+		 "Too many NACK releases.");
+	xmitter->nack_count = 0;
+    }
+
+    /* If the NACK was released inside the callback, treat the data
+       as accepted, just like an uncoalesced packet. */
+    if (force || !xmitter->nack_count)
+	conn->rx_len = 0;
+}
+
+static void
+rx_coalesce_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    ipmi_sol_conn_t *conn;
+
+    /* Get a refcount to the connection. */
+    conn = find_sol_connection(cb_data);
+    if (!conn)
+	return;
+
+    ipmi_lock(conn->transmitter.packet_lock);
+    conn->rx_timer_running = 0;
+    if (conn->processing_packet) {
+	/* Let the thread that is processing packets do it. */
+	conn->rx_flush_pending = 1;
+    } else {
+	conn->processing_packet = 1;
+	rx_coalesce_deliver(conn, 0);
+	process_waiting_packets(conn);
+	conn->processing_packet = 0;
+    }
+    ipmi_unlock(conn->transmitter.packet_lock);
+
+    sol_put_connection(conn);
+}
+
+/* Must be called with the packet lock held. */
+static void
+rx_coalesce_start_timer(ipmi_sol_conn_t *conn, unsigned int ms)
+{
+    os_handler_t   *os_hnd = conn->ipmi->os_hnd;
+    struct timeval tv;
+
+    if (conn->rx_timer_running || !conn->rx_timer)
+	return;
+
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    if (os_hnd->start_timer(os_hnd, conn->rx_timer, &tv,
+			    rx_coalesce_timeout, conn) == 0)
+	conn->rx_timer_running = 1;
+}
+
 static void
 process_packet(ipmi_sol_conn_t *conn,
 	       unsigned char   *packet,
@@ -3366,6 +3884,7 @@ process_packet(ipmi_sol_conn_t *conn,
 	} else {
 	    int character_count;
 	    int do_nack;
+	    int accepted = 0;
 
 	    /* FIXME - validate that the sequence numbers are
 	       sequentially increasing. */
@@ -3380,6 +3899,35 @@ process_packet(ipmi_sol_conn_t *conn,
 	    if (xmitter->nack_count) {
 		/* The user already sent a NACK, no reason to send any
 		   more til they release it. */
+	    } else if (conn->rx_ring) {
+		rx_ring_put(conn,
+			    &packet[PACKET_DATA + data_len - character_count],
+			    character_count);
+		if (conn->state == ipmi_sol_state_closed)
+		    return;
+	    } else if (conn->rx_buf) {
+		unsigned char *data;
+
+		data = &packet[PACKET_DATA + data_len - character_count];
+		if (conn->rx_len + character_count
+		    > conn->rx_coalesce_bytes + IPMI_SOL_MAX_DATA_SIZE)
+		    rx_coalesce_deliver(conn, 0);
+		if (conn->state == ipmi_sol_state_closed)
+		    return;
+		if (! xmitter->nack_count) {
+		    memcpy(conn->rx_buf + conn->rx_len, data,
+			   character_count);
+		    conn->rx_len += character_count;
+		    if (conn->rx_len >= conn->rx_coalesce_bytes) {
+			rx_coalesce_deliver(conn, 0);
+			if (conn->state == ipmi_sol_state_closed)
+			    return;
+			/* This packet's data is held, so ACK it even
+			   if the callbacks NACKed. */
+			accepted = 1;
+		    } else
+			rx_coalesce_start_timer(conn, conn->rx_coalesce_ms);
+		}
 	    } else {
 		xmitter->in_recv_cb = 1;
 		ipmi_unlock(xmitter->packet_lock);
@@ -3404,7 +3952,7 @@ process_packet(ipmi_sol_conn_t *conn,
 	    conn->prev_received_seqnr = packet[PACKET_SEQNR];
 	    xmitter->packet_to_acknowledge = packet[PACKET_SEQNR];
 
-	    if (xmitter->nack_count) {
+	    if (xmitter->nack_count && !accepted) {
 		conn->prev_character_count = 0;
 		/* FIXME: It is unclear from the spec whether the
 		   accepted character count on a NACK should be 0 or
@@ -3544,24 +4092,24 @@ sol_handle_recv_async(ipmi_con_t    *ipmi_conn,
 	/* Some other thread is already processing packets.  Tack this
 	   packet onto the end of waiting packets for the other thread
 	   to handle. */
-	sol_in_packet_info_t *packet, *epacket;
+	sol_in_packet_info_t *wpacket, *epacket;
 	unsigned char        *pdata;
 
-	packet = ipmi_mem_alloc(sizeof(*packet) + data_len);
-	if (!packet)
+	wpacket = ipmi_mem_alloc(sizeof(*wpacket) + data_len);
+	if (!wpacket)
 	    goto out_unlock;
-	packet->data_len = data_len;
-	packet->next = NULL;
-	pdata = ((unsigned char *) packet) + sizeof(*packet);
+	wpacket->data_len = data_len;
+	wpacket->next = NULL;
+	pdata = ((unsigned char *) wpacket) + sizeof(*wpacket);
 	memcpy(pdata, packet, data_len);
 
-	if (conn->waiting_packets) {
-	    conn->waiting_packets = packet;
+	if (! conn->waiting_packets) {
+	    conn->waiting_packets = wpacket;
 	} else {
 	    epacket = conn->waiting_packets;
 	    while (epacket->next)
 		epacket = epacket->next;
-	    epacket->next = packet;
+	    epacket->next = wpacket;
 	}
 	goto out_unlock;
     }
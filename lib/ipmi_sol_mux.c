@@ -0,0 +1,559 @@
+/*
+ * ipmi_sol_mux.c
+ *
+ * Log the output of many SoL consoles into one file.
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2006 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_sol.h>
+#include <OpenIPMI/internal/ipmi_int.h>
+#include <OpenIPMI/internal/ipmi_locks.h>
+#include <OpenIPMI/internal/ipmi_malloc.h>
+
+/* Defaults for the flush parameters. */
+#define SOL_MUX_FLUSH_THRESHOLD		65536
+#define SOL_MUX_FLUSH_INTERVAL_MS	100
+
+/* The buffer holds this many flush thresholds before we start
+   NACKing the BMCs. */
+#define SOL_MUX_BUF_FACTOR		4
+
+#define IPMI_SOL_MUX_NAME_MAX		64
+
+/* Maximum length of a log record header. */
+#define SOL_MUX_HDR_MAX			(32 + IPMI_SOL_MUX_NAME_MAX)
+
+struct ipmi_sol_mux_console_s
+{
+    ipmi_sol_mux_t  *mux;
+    ipmi_sol_conn_t *conn;
+    char            name[IPMI_SOL_MUX_NAME_MAX];
+
+    /* All the consoles in the mux. */
+    ipmi_sol_mux_console_t *next, *prev;
+
+    /* Consoles with data in the buffer that has not been written,
+       in the order of the last data they put into the buffer. */
+    ipmi_sol_mux_console_t *pnext, *pprev;
+    int                    on_pending;
+
+    /* Log offset just past the last data from this console. */
+    unsigned long long log_end;
+    unsigned long long bytes_pending;
+    struct timeval     pending_since;
+
+    /* We have NACKed a packet and must release it. */
+    int                nack_held;
+
+    int                received_data;
+    struct timeval     last_recv;
+
+    unsigned long long bytes_received;
+    unsigned long long bytes_logged;
+    unsigned long      nacks;
+};
+
+struct ipmi_sol_mux_s
+{
+    os_handler_t *os_hnd;
+    ipmi_lock_t  *lock;
+    int          fd;
+
+    unsigned int flush_threshold;
+    unsigned int flush_interval_ms;
+
+    /* Unwritten data is buf[buf_start .. buf_start+buf_len). */
+    unsigned char *buf;
+    unsigned int  buf_size;
+    unsigned int  buf_start;
+    unsigned int  buf_len;
+
+    /* Total number of bytes written to the log. */
+    unsigned long long written;
+
+    ipmi_sol_mux_console_t *consoles;
+    ipmi_sol_mux_console_t *pending_head, *pending_tail;
+    unsigned int           nacks_held;
+
+    os_hnd_timer_id_t *timer;
+    int               timer_running;
+    int               freeing;
+};
+
+static int sol_mux_data_received(ipmi_sol_conn_t *conn,
+				 const void      *buf,
+				 size_t          count,
+				 void            *cb_data);
+
+static void
+pending_remove(ipmi_sol_mux_t *mux, ipmi_sol_mux_console_t *console)
+{
+    if (console->pprev)
+	console->pprev->pnext = console->pnext;
+    else
+	mux->pending_head = console->pnext;
+    if (console->pnext)
+	console->pnext->pprev = console->pprev;
+    else
+	mux->pending_tail = console->pprev;
+    console->pnext = NULL;
+    console->pprev = NULL;
+    console->on_pending = 0;
+}
+
+static void
+pending_add_tail(ipmi_sol_mux_t *mux, ipmi_sol_mux_console_t *console)
+{
+    console->pnext = NULL;
+    console->pprev = mux->pending_tail;
+    if (mux->pending_tail)
+	mux->pending_tail->pnext = console;
+    else
+	mux->pending_head = console;
+    mux->pending_tail = console;
+    console->on_pending = 1;
+}
+
+static void
+release_nacks(ipmi_sol_mux_t *mux)
+{
+    ipmi_sol_mux_console_t *console;
+
+    for (console = mux->consoles;
+	 console && mux->nacks_held;
+	 console = console->next)
+    {
+	if (console->nack_held) {
+	    console->nack_held = 0;
+	    mux->nacks_held--;
+	    ipmi_sol_release_nack(console->conn);
+	}
+    }
+}
+
+static int
+sol_mux_flush_nolock(ipmi_sol_mux_t *mux)
+{
+    ipmi_sol_mux_console_t *console;
+    ssize_t                rv;
+    int                    err = 0;
+
+    while (mux->buf_len) {
+	rv = write(mux->fd, mux->buf + mux->buf_start, mux->buf_len);
+	if (rv < 0) {
+	    if (errno == EINTR)
+		continue;
+	    err = errno;
+	    if (err == EWOULDBLOCK)
+		err = EAGAIN;
+	    break;
+	}
+	if (rv == 0) {
+	    err = EAGAIN;
+	    break;
+	}
+	mux->buf_start += rv;
+	mux->buf_len -= rv;
+	mux->written += rv;
+    }
+
+    if (mux->buf_len == 0)
+	mux->buf_start = 0;
+    else if (mux->buf_start >= mux->buf_size / 2) {
+	memmove(mux->buf, mux->buf + mux->buf_start, mux->buf_len);
+	mux->buf_start = 0;
+    }
+
+    /* The pending list is in log order, so everything at the head
+       that ends before the write point is now in the log. */
+    while (mux->pending_head && mux->pending_head->log_end <= mux->written) {
+	console = mux->pending_head;
+	console->bytes_logged += console->bytes_pending;
+	console->bytes_pending = 0;
+	pending_remove(mux, console);
+    }
+
+    if (mux->nacks_held
+	&& (mux->buf_start + mux->buf_len
+	    <= mux->buf_size - mux->flush_threshold))
+	release_nacks(mux);
+
+    return err;
+}
+
+static void sol_mux_timeout(void *cb_data, os_hnd_timer_id_t *id);
+
+static void
+sol_mux_start_timer(ipmi_sol_mux_t *mux)
+{
+    struct timeval tv;
+
+    if (mux->timer_running || mux->freeing)
+	return;
+
+    tv.tv_sec = mux->flush_interval_ms / 1000;
+    tv.tv_usec = (mux->flush_interval_ms % 1000) * 1000;
+    if (mux->os_hnd->start_timer(mux->os_hnd, mux->timer, &tv,
+				 sol_mux_timeout, mux) == 0)
+	mux->timer_running = 1;
+}
+
+static void
+sol_mux_destroy(ipmi_sol_mux_t *mux)
+{
+    if (mux->timer)
+	mux->os_hnd->free_timer(mux->os_hnd, mux->timer);
+    if (mux->lock)
+	ipmi_destroy_lock(mux->lock);
+    if (mux->buf)
+	ipmi_mem_free(mux->buf);
+    ipmi_mem_free(mux);
+}
+
+static void
+sol_mux_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    ipmi_sol_mux_t *mux = cb_data;
+
+    ipmi_lock(mux->lock);
+    mux->timer_running = 0;
+    if (mux->freeing) {
+	ipmi_unlock(mux->lock);
+	sol_mux_destroy(mux);
+	return;
+    }
+    sol_mux_flush_nolock(mux);
+    if (mux->buf_len || mux->nacks_held)
+	sol_mux_start_timer(mux);
+    ipmi_unlock(mux->lock);
+}
+
+int
+ipmi_sol_mux_alloc(os_handler_t   *os_hnd,
+		   int            fd,
+		   unsigned int   flush_threshold,
+		   unsigned int   flush_interval_ms,
+		   ipmi_sol_mux_t **new_mux)
+{
+    ipmi_sol_mux_t *mux;
+    int            rv;
+
+    if (!os_hnd || fd < 0 || !new_mux)
+	return EINVAL;
+
+    if (flush_threshold == 0)
+	flush_threshold = SOL_MUX_FLUSH_THRESHOLD;
+    if (flush_interval_ms == 0)
+	flush_interval_ms = SOL_MUX_FLUSH_INTERVAL_MS;
+    /* Make sure at least one full record always fits. */
+    if (flush_threshold < SOL_MUX_HDR_MAX + IPMI_MAX_MSG_LENGTH)
+	flush_threshold = SOL_MUX_HDR_MAX + IPMI_MAX_MSG_LENGTH;
+
+    mux = ipmi_mem_alloc(sizeof(*mux));
+    if (!mux)
+	return ENOMEM;
+    memset(mux, 0, sizeof(*mux));
+    mux->os_hnd = os_hnd;
+    mux->fd = fd;
+    mux->flush_threshold = flush_threshold;
+    mux->flush_interval_ms = flush_interval_ms;
+    mux->buf_size = flush_threshold * SOL_MUX_BUF_FACTOR;
+
+    mux->buf = ipmi_mem_alloc(mux->buf_size);
+    if (!mux->buf) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+
+    rv = ipmi_create_lock_os_hnd(os_hnd, &mux->lock);
+    if (rv)
+	goto out_err;
+
+    rv = os_hnd->alloc_timer(os_hnd, &mux->timer);
+    if (rv)
+	goto out_err;
+
+    *new_mux = mux;
+    return 0;
+
+ out_err:
+    sol_mux_destroy(mux);
+    return rv;
+}
+
+static void
+console_detach(ipmi_sol_mux_t *mux, ipmi_sol_mux_console_t *console)
+{
+    ipmi_sol_deregister_data_received_callback(console->conn,
+					       sol_mux_data_received,
+					       console);
+    if (console->nack_held) {
+	console->nack_held = 0;
+	mux->nacks_held--;
+	ipmi_sol_release_nack(console->conn);
+    }
+    if (console->on_pending)
+	pending_remove(mux, console);
+
+    if (console->prev)
+	console->prev->next = console->next;
+    else
+	mux->consoles = console->next;
+    if (console->next)
+	console->next->prev = console->prev;
+
+    ipmi_mem_free(console);
+}
+
+void
+ipmi_sol_mux_free(ipmi_sol_mux_t *mux)
+{
+    ipmi_lock(mux->lock);
+    while (mux->consoles)
+	console_detach(mux, mux->consoles);
+    sol_mux_flush_nolock(mux);
+    mux->freeing = 1;
+    if (mux->timer_running) {
+	if (mux->os_hnd->stop_timer(mux->os_hnd, mux->timer) != 0) {
+	    /* The timeout is running, it will free the mux. */
+	    ipmi_unlock(mux->lock);
+	    return;
+	}
+	mux->timer_running = 0;
+    }
+    ipmi_unlock(mux->lock);
+    sol_mux_destroy(mux);
+}
+
+int
+ipmi_sol_mux_flush(ipmi_sol_mux_t *mux)
+{
+    int rv;
+
+    ipmi_lock(mux->lock);
+    rv = sol_mux_flush_nolock(mux);
+    ipmi_unlock(mux->lock);
+    return rv;
+}
+
+static int
+sol_mux_data_received(ipmi_sol_conn_t *conn,
+		      const void      *buf,
+		      size_t          count,
+		      void            *cb_data)
+{
+    ipmi_sol_mux_console_t *console = cb_data;
+    ipmi_sol_mux_t         *mux = console->mux;
+    struct timeval         now, mono;
+    char                   hdr[SOL_MUX_HDR_MAX];
+    int                    hdr_len;
+    unsigned int           need;
+    unsigned char          *p;
+
+    if (count == 0)
+	return 0;
+
+    mux->os_hnd->get_real_time(mux->os_hnd, &now);
+    mux->os_hnd->get_monotonic_time(mux->os_hnd, &mono);
+    hdr_len = snprintf(hdr, sizeof(hdr), "%ld.%06ld %s %lu\n",
+		       (long) now.tv_sec, (long) now.tv_usec,
+		       console->name, (unsigned long) count);
+    need = hdr_len + count;
+
+    ipmi_lock(mux->lock);
+    console->received_data = 1;
+    console->last_recv = mono;
+
+    if (mux->buf_start + mux->buf_len + need > mux->buf_size)
+	sol_mux_flush_nolock(mux);
+    if (mux->buf_start + mux->buf_len + need > mux->buf_size) {
+	/* The log is not keeping up, hold off the BMC.  The data
+	   will be resent after the NACK is released. */
+	console->nacks++;
+	if (!console->nack_held) {
+	    console->nack_held = 1;
+	    mux->nacks_held++;
+	}
+	sol_mux_start_timer(mux);
+	ipmi_unlock(mux->lock);
+	return 1;
+    }
+
+    p = mux->buf + mux->buf_start + mux->buf_len;
+    memcpy(p, hdr, hdr_len);
+    memcpy(p + hdr_len, buf, count);
+    mux->buf_len += need;
+
+    console->bytes_received += count;
+    console->bytes_pending += count;
+    console->log_end = mux->written + mux->buf_len;
+    if (console->on_pending)
+	pending_remove(mux, console);
+    else
+	console->pending_since = mono;
+    pending_add_tail(mux, console);
+
+    if (mux->buf_len >= mux->flush_threshold)
+	sol_mux_flush_nolock(mux);
+    if (mux->buf_len)
+	sol_mux_start_timer(mux);
+    ipmi_unlock(mux->lock);
+
+    return 0;
+}
+
+int
+ipmi_sol_mux_add_console(ipmi_sol_mux_t         *mux,
+			 ipmi_sol_conn_t        *conn,
+			 const char             *name,
+			 ipmi_sol_mux_console_t **new_console)
+{
+    ipmi_sol_mux_console_t *console;
+    const char             *c;
+    int                    rv;
+
+    if (!conn || !name || !*name || strlen(name) >= IPMI_SOL_MUX_NAME_MAX)
+	return EINVAL;
+    for (c = name; *c; c++) {
+	if (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r')
+	    return EINVAL;
+    }
+
+    console = ipmi_mem_alloc(sizeof(*console));
+    if (!console)
+	return ENOMEM;
+    memset(console, 0, sizeof(*console));
+    console->mux = mux;
+    console->conn = conn;
+    strcpy(console->name, name);
+
+    ipmi_lock(mux->lock);
+    console->next = mux->consoles;
+    if (mux->consoles)
+	mux->consoles->prev = console;
+    mux->consoles = console;
+    ipmi_unlock(mux->lock);
+
+    rv = ipmi_sol_register_data_received_callback(conn,
+						  sol_mux_data_received,
+						  console);
+    if (rv) {
+	ipmi_lock(mux->lock);
+	if (console->prev)
+	    console->prev->next = console->next;
+	else
+	    mux->consoles = console->next;
+	if (console->next)
+	    console->next->prev = console->prev;
+	ipmi_unlock(mux->lock);
+	ipmi_mem_free(console);
+	return rv;
+    }
+
+    if (new_console)
+	*new_console = console;
+    return 0;
+}
+
+int
+ipmi_sol_mux_remove_console(ipmi_sol_mux_console_t *console)
+{
+    ipmi_sol_mux_t *mux = console->mux;
+
+    ipmi_lock(mux->lock);
+    console_detach(mux, console);
+    ipmi_unlock(mux->lock);
+    return 0;
+}
+
+static unsigned long
+tv_diff_ms(struct timeval *now, struct timeval *then)
+{
+    long ms;
+
+    ms = ((now->tv_sec - then->tv_sec) * 1000
+	  + (now->tv_usec - then->tv_usec) / 1000);
+    if (ms < 0)
+	return 0;
+    return ms;
+}
+
+void
+ipmi_sol_mux_console_get_stats(ipmi_sol_mux_console_t       *console,
+			       ipmi_sol_mux_console_stats_t *stats)
+{
+    ipmi_sol_mux_t *mux = console->mux;
+    struct timeval now;
+
+    mux->os_hnd->get_monotonic_time(mux->os_hnd, &now);
+
+    ipmi_lock(mux->lock);
+    stats->bytes_received = console->bytes_received;
+    stats->bytes_logged = console->bytes_logged;
+    stats->bytes_pending = console->bytes_pending;
+    stats->nacks = console->nacks;
+    if (console->on_pending)
+	stats->lag_ms = tv_diff_ms(&now, &console->pending_since);
+    else
+	stats->lag_ms = 0;
+    if (console->received_data)
+	stats->idle_ms = tv_diff_ms(&now, &console->last_recv);
+    else
+	stats->idle_ms = ULONG_MAX;
+    ipmi_unlock(mux->lock);
+}
+
+void
+ipmi_sol_mux_iterate_consoles(ipmi_sol_mux_t          *mux,
+			      ipmi_sol_mux_console_cb handler,
+			      void                    *cb_data)
+{
+    ipmi_sol_mux_console_t *console, *next;
+
+    /* Don't hold the lock across the handler, it will most likely
+       want the stats. */
+    ipmi_lock(mux->lock);
+    console = mux->consoles;
+    while (console) {
+	next = console->next;
+	ipmi_unlock(mux->lock);
+	handler(console, console->name, cb_data);
+	ipmi_lock(mux->lock);
+	console = next;
+    }
+    ipmi_unlock(mux->lock);
+}
@@ -586,16 +586,20 @@ start_config_fetch(void *cb_data, int shutdown)
     return OPQ_HANDLER_STARTED;
 }
 
-int
-ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
-		      unsigned int	  parm,
-		      unsigned int	  set,
-		      unsigned int	  block,
-		      ipmi_lanparm_get_cb done,
-		      void                *cb_data)
+/* If concurrent is true, the fetch may run at the same time as other
+   concurrent operations on the LAN parms, up to the opq's maximum. */
+static int
+lanparm_get_parm(ipmi_lanparm_t      *lanparm,
+		 unsigned int	     parm,
+		 unsigned int	     set,
+		 unsigned int	     block,
+		 ipmi_lanparm_get_cb done,
+		 void                *cb_data,
+		 int                 concurrent)
 {
     lanparm_fetch_handler_t *elem;
     int                 rv = 0;
+    int                 success;
 
     if (lanparm->destroyed)
 	return EINVAL;
@@ -616,7 +620,12 @@ ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
     elem->block = block;
     elem->rv = 0;
 
-    if (!opq_new_op(lanparm->opq, start_config_fetch, elem, 0))
+    if (concurrent)
+	success = opq_new_op_concurrent(lanparm->opq, start_config_fetch,
+					elem, 0);
+    else
+	success = opq_new_op(lanparm->opq, start_config_fetch, elem, 0);
+    if (!success)
 	rv = ENOMEM;
 
     if (rv)
@@ -627,6 +636,17 @@ ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
     return rv;
 }
 
+int
+ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
+		      unsigned int	  parm,
+		      unsigned int	  set,
+		      unsigned int	  block,
+		      ipmi_lanparm_get_cb done,
+		      void                *cb_data)
+{
+    return lanparm_get_parm(lanparm, parm, set, block, done, cb_data, 0);
+}
+
 typedef struct lanparm_set_handler_s
 {
     ipmi_lanparm_t 	 *lanparm;
@@ -841,6 +861,22 @@ struct ipmi_lan_config_s
     /* Used for deferred errors. */
     int err;
 
+    /* Used to run the parameter fetches in parallel. */
+    int           next_parm;
+    int           next_sel;
+    os_handler_t  *os_hnd;
+    os_hnd_lock_t *lock;
+    unsigned int  window;
+    unsigned int  outstanding;
+    int           issuing;
+    /* Are the counts known, so the things that need them can be
+       fetched? */
+    int           fetching_tables;
+
+    /* If not zero, only the parameters with their bit set are
+       fetched, see ipmi_lan_get_config_parms(). */
+    unsigned int  fetch_mask;
+
     ipmi_lanparm_done_cb   set_done;
     ipmi_lan_get_config_cb done;
     void                   *cb_data;
@@ -1479,6 +1515,59 @@ static lanparms_t lanparms[NUM_LANPARMS] =
     { 1, S, 4, 0, gvt, svt   }, /* IPMI_LANPARM_DEST_VLAN_TAG                */
 };
 
+static void
+lanc_lock(ipmi_lan_config_t *lanc)
+{
+    if (lanc->lock)
+	lanc->os_hnd->lock(lanc->os_hnd, lanc->lock);
+}
+
+static void
+lanc_unlock(ipmi_lan_config_t *lanc)
+{
+    if (lanc->lock)
+	lanc->os_hnd->unlock(lanc->os_hnd, lanc->lock);
+}
+
+static void
+lanparm_window_cb(ipmi_mc_t *mc, void *cb_data)
+{
+    unsigned int *window = cb_data;
+
+    *window = _ipmi_mc_op_concurrency(mc);
+}
+
+/* Get how many parameter fetches may be outstanding at once and let
+   the opq run that many. */
+static unsigned int
+lanparm_op_window(ipmi_lanparm_t *lanparm)
+{
+    unsigned int window = 1;
+
+    ipmi_mc_pointer_cb(lanparm->mc, lanparm_window_cb, &window);
+    if (window == 0)
+	window = 1;
+    opq_set_max_running(lanparm->opq, window);
+    return window;
+}
+
+/* Parameters that cannot be fetched until the number of destinations
+   or cipher suites is known. */
+static int
+lanparm_needs_count(int parm)
+{
+    switch (parm) {
+    case IPMI_LANPARM_DEST_TYPE:
+    case IPMI_LANPARM_DEST_ADDR:
+    case IPMI_LANPARM_CIPHER_SUITE_ENTRY_SUPPORT:
+    case IPMI_LANPARM_CIPHER_SUITE_ENTRY_PRIV:
+    case IPMI_LANPARM_DEST_VLAN_TAG:
+	return 1;
+    default:
+	return 0;
+    }
+}
+
 static void
 err_lock_cleared(ipmi_lanparm_t *lanparm,
 		 int            err,
@@ -1493,136 +1582,83 @@ err_lock_cleared(ipmi_lanparm_t *lanparm,
     lanparm_put(lanparm);
 }
 
-static void
-got_parm(ipmi_lanparm_t    *lanparm,
-	 int               err,
-	 unsigned char     *data,
-	 unsigned int      data_len,
-	 void              *cb_data)
+typedef struct lanparm_get_req_s
 {
-    ipmi_lan_config_t *lanc = cb_data;
-    lanparms_t        *lp = &(lanparms[lanc->curr_parm]);
-
-    /* Check the length, and don't forget the revision byte must be added. */
-    if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
-	if ((data_len == 1) && (lp->optional_offset)) {
-	    /* Some systems return zero-length data for optional parms. */
-	    unsigned char *opt = ((unsigned char *)lanc) + lp->optional_offset;
-	    *opt = 0;
-	    goto next_parm;
-	}
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "lanparm.c(got_parm): "
-		 " Invalid data length on parm %d was %d, should have been %d",
-		 lanc->curr_parm, data_len, lp->length+1);
-	err = EINVAL;
-	goto done;
-    }
-
-    err = lp->get_handler(lanc, lp, err, data);
-    if (err) {
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "lanparm.c(got_parm): "
-		 "Error fetching parm %d: %x",
-		 lanc->curr_parm, err);
-	goto done;
-    }
+    ipmi_lan_config_t *lanc;
+    int               parm;
+    int               sel;
+} lanparm_get_req_t;
 
- next_parm:
-    switch (lanc->curr_parm) {
-    case IPMI_LANPARM_NUM_DESTINATIONS:
-	if (lanc->num_alert_destinations == 0)
-	    lanc->curr_parm = IPMI_LANPARM_VLAN_ID;
-	else {
-	    lanc->curr_parm++;
-	    lanc->curr_sel = 0;
-	}
-	break;
+/* Find the next parameter to fetch.  Everything that does not depend
+   on a count is fetched first, then the things that do.  Returns 0
+   if nothing is left to fetch in the current stage.  Must be called
+   with the config locked. */
+static int
+lanparm_next_get(ipmi_lan_config_t *lanc, lanparm_get_req_t *req)
+{
+    int parm;
 
-    case IPMI_LANPARM_DEST_TYPE:
-	lanc->curr_sel++;
-	if (lanc->curr_sel >= lanc->num_alert_destinations) {
-	    lanc->curr_parm++;
-	    lanc->curr_sel = 0;
-	}
-	break;
+    for (;;) {
+	parm = lanc->next_parm;
+	if (parm >= NUM_LANPARMS)
+	    return 0;
 
-    case IPMI_LANPARM_DEST_ADDR:
-	lanc->curr_sel++;
-	if (lanc->curr_sel >= lanc->num_alert_destinations) {
-	    lanc->curr_parm = IPMI_LANPARM_VLAN_ID;
-	    lanc->curr_sel = 0;
+	if ((!lanparms[parm].valid)
+	    || (lanc->fetch_mask && !(lanc->fetch_mask & (1 << parm)))
+	    || (lanparm_needs_count(parm) != lanc->fetching_tables))
+	{
+	    lanc->next_parm++;
+	    lanc->next_sel = 0;
+	    continue;
 	}
-	break;
 
-    case IPMI_LANPARM_NUM_CIPHER_SUITE_ENTRIES:
-	lanc->curr_parm++;
-	if (lanc->num_cipher_suites == 0) {
-	    if (lanc->num_alert_destinations == 0)
-		goto done;
-	    lanc->curr_parm = IPMI_LANPARM_DEST_VLAN_TAG;
-	    lanc->curr_sel = 0;
-	}
-	break;
+	switch (parm) {
+	case IPMI_LANPARM_DEST_TYPE:
+	case IPMI_LANPARM_DEST_ADDR:
+	case IPMI_LANPARM_DEST_VLAN_TAG:
+	    if (lanc->next_sel >= lanc->num_alert_destinations) {
+		lanc->next_parm++;
+		lanc->next_sel = 0;
+		continue;
+	    }
+	    req->sel = lanc->next_sel;
+	    lanc->next_sel++;
+	    break;
 
-    case IPMI_LANPARM_CIPHER_SUITE_ENTRY_PRIV:
-	if (lanc->num_alert_destinations == 0)
-	    goto done;
-	else {
-	    lanc->curr_parm++;
-	    lanc->curr_sel = 0;
-	}
-	break;
+	case IPMI_LANPARM_CIPHER_SUITE_ENTRY_SUPPORT:
+	case IPMI_LANPARM_CIPHER_SUITE_ENTRY_PRIV:
+	    lanc->next_parm++;
+	    if (lanc->num_cipher_suites == 0)
+		continue;
+	    req->sel = 0;
+	    break;
 
-    case IPMI_LANPARM_DEST_VLAN_TAG:
-	if (!lanc->vlan_tag_supported)
-	    goto done;
-	if ((data[1] & 0xf) != lanc->curr_sel) {
-	    /* Yikes, wrong selector came back! */
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "lanparm.c(got_parm): "
-		     "Error fetching dest type %d,"
-		     " wrong selector came back, expecting %d, was %d",
-		     lanc->curr_parm, lanc->curr_sel, data[1] & 0xf);
-	    err = EINVAL;
-	    goto done;
+	default:
+	    lanc->next_parm++;
+	    req->sel = 0;
 	}
-	lanc->curr_sel++;
-	if (lanc->curr_sel >= lanc->num_alert_destinations)
-	    goto done;
 	break;
-
-    default:
-	lanc->curr_parm++;
     }
 
-    lp = &(lanparms[lanc->curr_parm]);
-    if (!lp->valid)
-	goto next_parm;
-
-    err = ipmi_lanparm_get_parm(lanparm, lanc->curr_parm, lanc->curr_sel, 0,
-				got_parm, lanc);
-    if (err)
-	goto done;
-
-    return;
+    req->parm = parm;
+    return 1;
+}
 
- done:
-    if (err) {
-	unsigned char data[1];
+static void
+lanparm_get_done(ipmi_lanparm_t *lanparm, ipmi_lan_config_t *lanc)
+{
+    unsigned char data[1];
+    int           err;
 
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "lanparm.c(got_parm): Error trying to get parm %d: %x",
-		 lanc->curr_parm, err);
-	lanc->err = err;
+    if (lanc->err) {
 	/* Clear the lock */
 	data[0] = 0;
 	err = ipmi_lanparm_set_parm(lanparm, 0, data, 1,
 				    err_lock_cleared, lanc);
 	if (err) {
-	    ipmi_lan_free_config(lanc);
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "lanparm.c(got_parm): Error trying to clear lock: %x",
+		     "lanparm.c(lanparm_get_done): "
+		     "Error trying to clear lock: %x",
 		     err);
 	    lanc->done(lanparm, lanc->err, NULL, lanc->cb_data);
 	    ipmi_lan_free_config(lanc);
@@ -1635,13 +1671,149 @@ got_parm(ipmi_lanparm_t    *lanparm,
     }
 }
 
+static void got_parm(ipmi_lanparm_t    *lanparm,
+		     int               err,
+		     unsigned char     *data,
+		     unsigned int      data_len,
+		     void              *cb_data);
+
+/* Start as many parameter fetches as the window allows.  Must be
+   called with the config locked, this will unlock it. */
+static void
+lanparm_get_issue(ipmi_lanparm_t *lanparm, ipmi_lan_config_t *lanc)
+{
+    lanparm_get_req_t *req;
+    int               rv;
+
+    if (lanc->issuing) {
+	/* Whoever is issuing will see the change. */
+	lanc_unlock(lanc);
+	return;
+    }
+    lanc->issuing = 1;
+
+ restart:
+    while (!lanc->err && (lanc->outstanding < lanc->window)) {
+	req = ipmi_mem_alloc(sizeof(*req));
+	if (!req) {
+	    lanc->err = ENOMEM;
+	    break;
+	}
+	req->lanc = lanc;
+	if (!lanparm_next_get(lanc, req)) {
+	    ipmi_mem_free(req);
+	    break;
+	}
+
+	lanc->outstanding++;
+	lanc_unlock(lanc);
+	rv = lanparm_get_parm(lanparm, req->parm, req->sel, 0,
+			      got_parm, req, 1);
+	lanc_lock(lanc);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "lanparm.c(lanparm_get_issue): "
+		     "Error trying to get parm %d: %x",
+		     req->parm, rv);
+	    ipmi_mem_free(req);
+	    lanc->outstanding--;
+	    lanc->err = rv;
+	}
+    }
+
+    if (lanc->outstanding == 0) {
+	if (!lanc->err && !lanc->fetching_tables) {
+	    /* The counts are known now, get the rest. */
+	    lanc->fetching_tables = 1;
+	    lanc->next_parm = 1;
+	    lanc->next_sel = 0;
+	    goto restart;
+	}
+	lanc->issuing = 0;
+	lanc_unlock(lanc);
+	lanparm_get_done(lanparm, lanc);
+	return;
+    }
+
+    lanc->issuing = 0;
+    lanc_unlock(lanc);
+}
+
+static void
+got_parm(ipmi_lanparm_t    *lanparm,
+	 int               err,
+	 unsigned char     *data,
+	 unsigned int      data_len,
+	 void              *cb_data)
+{
+    lanparm_get_req_t *req = cb_data;
+    ipmi_lan_config_t *lanc = req->lanc;
+    lanparms_t        *lp = &(lanparms[req->parm]);
+    int               rsp_err = err;
+
+    lanc_lock(lanc);
+    lanc->outstanding--;
+
+    if (lanc->err)
+	/* Something else already failed, just let things drain. */
+	goto out;
+
+    /* The handlers use these to tell what they are handling. */
+    lanc->curr_parm = req->parm;
+    lanc->curr_sel = req->sel;
+
+    /* Check the length, and don't forget the revision byte must be added. */
+    if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
+	if ((data_len == 1) && (lp->optional_offset)) {
+	    /* Some systems return zero-length data for optional parms. */
+	    unsigned char *opt = ((unsigned char *)lanc) + lp->optional_offset;
+	    *opt = 0;
+	    goto out;
+	}
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "lanparm.c(got_parm): "
+		 " Invalid data length on parm %d was %d, should have been %d",
+		 req->parm, data_len, lp->length+1);
+	err = EINVAL;
+	goto out_err;
+    }
+
+    err = lp->get_handler(lanc, lp, err, data);
+    if (err) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "lanparm.c(got_parm): "
+		 "Error fetching parm %d: %x",
+		 req->parm, err);
+	goto out_err;
+    }
+
+    if ((req->parm == IPMI_LANPARM_DEST_VLAN_TAG) && (!rsp_err)
+	&& ((data[1] & 0xf) != req->sel))
+    {
+	/* Yikes, wrong selector came back! */
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "lanparm.c(got_parm): "
+		 "Error fetching dest type %d,"
+		 " wrong selector came back, expecting %d, was %d",
+		 req->parm, req->sel, data[1] & 0xf);
+	err = EINVAL;
+	goto out_err;
+    }
+    goto out;
+
+ out_err:
+    lanc->err = err;
+ out:
+    ipmi_mem_free(req);
+    lanparm_get_issue(lanparm, lanc);
+}
+
 static void 
 lock_done(ipmi_lanparm_t *lanparm,
 	  int            err,
 	  void           *cb_data)
 {
     ipmi_lan_config_t *lanc = cb_data;
-    int               rv;
 
     if (err == IPMI_IPMI_ERR_VAL(0x80)) {
 	/* Lock is not supported, just mark it and go on. */
@@ -1666,34 +1838,18 @@ lock_done(ipmi_lanparm_t *lanparm,
 	lanparm->locked = 1;
     }
 
-    rv = ipmi_lanparm_get_parm(lanparm, lanc->curr_parm, lanc->curr_sel, 0,
-			       got_parm, lanc);
-    if (rv) {
-	unsigned char data[1];
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "lanparm.c(lock_done): Error trying to get parms: %x",
-		 err);
-
-	lanc->err = rv;
-	/* Clear the lock */
-	data[0] = 0;
-	rv = ipmi_lanparm_set_parm(lanparm, 0, data, 1,
-				   err_lock_cleared, lanc);
-	if (rv) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "lanparm.c(lock_done): Error trying to clear lock: %x",
-		     err);
-	    lanc->done(lanparm, lanc->err, NULL, lanc->cb_data);
-	    ipmi_lan_free_config(lanc);
-	    lanparm->locked = 0;
-	    lanparm_put(lanparm);
-	}
-    }
+    /* Other than the destination and cipher suite counts, the
+       parameters are independent, so fetch them in parallel. */
+    lanc->window = lanparm_op_window(lanparm);
+    lanc_lock(lanc);
+    lanparm_get_issue(lanparm, lanc);
 }
 
-int ipmi_lan_get_config(ipmi_lanparm_t         *lanparm,
-			ipmi_lan_get_config_cb done,
-			void                   *cb_data)
+static int
+lan_get_config(ipmi_lanparm_t         *lanparm,
+	       unsigned int           fetch_mask,
+	       ipmi_lan_get_config_cb done,
+	       void                   *cb_data)
 {
     ipmi_lan_config_t *lanc;
     int               rv;
@@ -1704,8 +1860,20 @@ int ipmi_lan_get_config(ipmi_lanparm_t         *lanparm,
 	return ENOMEM;
     memset(lanc, 0, sizeof(*lanc));
 
+    lanc->os_hnd = lanparm->os_hnd;
+    if (lanparm->os_hnd->create_lock) {
+	rv = lanparm->os_hnd->create_lock(lanparm->os_hnd, &lanc->lock);
+	if (rv) {
+	    ipmi_mem_free(lanc);
+	    return rv;
+	}
+    }
+
     lanc->curr_parm = 1;
     lanc->curr_sel = 0;
+    lanc->next_parm = 1;
+    lanc->next_sel = 0;
+    lanc->fetch_mask = fetch_mask;
     lanc->done = done;
     lanc->cb_data = cb_data;
     lanc->my_lan = lanparm;
@@ -1724,6 +1892,49 @@ int ipmi_lan_get_config(ipmi_lanparm_t         *lanparm,
     return rv;
 }
 
+int ipmi_lan_get_config(ipmi_lanparm_t         *lanparm,
+			ipmi_lan_get_config_cb done,
+			void                   *cb_data)
+{
+    return lan_get_config(lanparm, 0, done, cb_data);
+}
+
+int
+ipmi_lan_get_config_parms(ipmi_lanparm_t         *lanparm,
+			  unsigned int           *parms,
+			  unsigned int           num_parms,
+			  ipmi_lan_get_config_cb done,
+			  void                   *cb_data)
+{
+    unsigned int mask = 0;
+    unsigned int i;
+
+    if (!parms || (num_parms == 0))
+	return EINVAL;
+
+    for (i=0; i<num_parms; i++) {
+	if ((parms[i] >= NUM_LANPARMS) || (!lanparms[parms[i]].valid))
+	    return EINVAL;
+	mask |= 1 << parms[i];
+
+	/* Pull in the counts these depend on. */
+	switch (parms[i]) {
+	case IPMI_LANPARM_DEST_TYPE:
+	case IPMI_LANPARM_DEST_ADDR:
+	case IPMI_LANPARM_DEST_VLAN_TAG:
+	    mask |= 1 << IPMI_LANPARM_NUM_DESTINATIONS;
+	    break;
+
+	case IPMI_LANPARM_CIPHER_SUITE_ENTRY_SUPPORT:
+	case IPMI_LANPARM_CIPHER_SUITE_ENTRY_PRIV:
+	    mask |= 1 << IPMI_LANPARM_NUM_CIPHER_SUITE_ENTRIES;
+	    break;
+	}
+    }
+
+    return lan_get_config(lanparm, mask, done, cb_data);
+}
+
 static void 
 set_clear(ipmi_lanparm_t *lanparm,
 	 int            err,
@@ -1926,11 +2137,16 @@ ipmi_lan_set_config(ipmi_lanparm_t       *lanparm,
     if (!olanc->lan_locked)
 	return EINVAL;
 
+    if (olanc->fetch_mask)
+	/* Only part of the config was fetched. */
+	return EINVAL;
+
     lanc = ipmi_mem_alloc(sizeof(*lanc));
     if (!lanc)
 	return ENOMEM;
 
     *lanc = *olanc;
+    lanc->lock = NULL; /* The set does not run in parallel. */
     lanc->alert_dest_type = NULL;
     lanc->alert_dest_addr = NULL;
     lanc->err = 0;
@@ -2046,6 +2262,8 @@ ipmi_lan_free_config(ipmi_lan_config_t *lanc)
 	ipmi_mem_free(lanc->alert_dest_type);
     if (lanc->alert_dest_addr != NULL)
 	ipmi_mem_free(lanc->alert_dest_addr);
+    if (lanc->lock)
+	lanc->os_hnd->destroy_lock(lanc->os_hnd, lanc->lock);
     ipmi_mem_free(lanc);
 }
 
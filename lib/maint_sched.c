@@ -0,0 +1,686 @@
+/*
+ * maint_sched.c
+ *
+ * Run periodic maintenance commands on a set of domains
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_mc.h>
+#include <OpenIPMI/ipmi_msgbits.h>
+#include <OpenIPMI/ipmi_err.h>
+
+#include <OpenIPMI/internal/ipmi_int.h>
+#include <OpenIPMI/internal/ipmi_locks.h>
+
+/*
+ * Domains sit on a timer wheel, in the slot for the tick their next
+ * task is due.  Each tick only the current slot is looked at, an
+ * entry that is not due yet (it is a full turn of the wheel or more
+ * away) is just left there.
+ */
+#define MAINT_WHEEL_SIZE	256
+#define MAINT_DEFAULT_TICK	1000
+
+typedef struct maint_ent_s maint_ent_t;
+struct maint_ent_s
+{
+    ipmi_domain_id_t domain_id;
+    unsigned int     tasks;
+    uint64_t         due;
+    uint64_t         next[IPMI_MAINT_NUM_TASKS];
+    maint_ent_t      *next_ent, *prev_ent;
+};
+
+typedef struct maint_run_s
+{
+    ipmi_domain_id_t domain_id;
+    unsigned int     tasks;
+} maint_run_t;
+
+typedef struct maint_task_s
+{
+    unsigned int interval;	/* In ticks, 0 means the task is off. */
+    unsigned int jitter;	/* In ticks. */
+} maint_task_t;
+
+struct ipmi_maint_sched_s
+{
+    ipmi_lock_t         *lock;
+    os_handler_t        *os_hnd;
+    os_hnd_timer_id_t   *timer;
+    unsigned int        tick;	/* In milliseconds. */
+    unsigned int        max_per_tick;
+    ipmi_maint_sched_cb done;
+    void                *cb_data;
+
+    /* One for the user, one while the timer is running and one for
+       each operation in progress. */
+    unsigned int        refcount;
+    int                 destroyed;
+
+    uint64_t            now;
+    uint32_t            rand_state;
+    maint_task_t        tasks[IPMI_MAINT_NUM_TASKS];
+    unsigned int        num_ents;
+    maint_ent_t         *wheel[MAINT_WHEEL_SIZE];
+
+    /* Only used from the timer handler, which is never running more
+       than once at a time. */
+    maint_run_t         *run;
+    unsigned int        run_size;
+};
+
+/* One task on one domain, done is called when every MC it was sent
+   to has answered. */
+typedef struct maint_op_s
+{
+    ipmi_maint_sched_t *sched;
+    ipmi_domain_id_t   domain_id;
+    unsigned int       task;
+    unsigned int       outstanding;
+    int                err;
+    struct timeval     now;
+} maint_op_t;
+
+static void
+sched_put(ipmi_maint_sched_t *sched)
+{
+    ipmi_lock(sched->lock);
+    sched->refcount--;
+    if (sched->refcount > 0) {
+	ipmi_unlock(sched->lock);
+	return;
+    }
+    ipmi_unlock(sched->lock);
+
+    sched->os_hnd->free_timer(sched->os_hnd, sched->timer);
+    ipmi_destroy_lock(sched->lock);
+    if (sched->run)
+	ipmi_mem_free(sched->run);
+    ipmi_mem_free(sched);
+}
+
+/* A cheap generator is fine for spreading things out, and it doesn't
+   cost a trip to the OS handler for every entry. */
+static unsigned int
+sched_rand(ipmi_maint_sched_t *sched, unsigned int range)
+{
+    uint32_t x = sched->rand_state;
+
+    if (range <= 1)
+	return 0;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sched->rand_state = x;
+    return x % range;
+}
+
+static void
+ent_link(ipmi_maint_sched_t *sched, maint_ent_t *ent)
+{
+    maint_ent_t **slot = &sched->wheel[ent->due & (MAINT_WHEEL_SIZE - 1)];
+
+    ent->prev_ent = NULL;
+    ent->next_ent = *slot;
+    if (*slot)
+	(*slot)->prev_ent = ent;
+    *slot = ent;
+}
+
+static void
+ent_unlink(ipmi_maint_sched_t *sched, maint_ent_t *ent)
+{
+    if (ent->prev_ent)
+	ent->prev_ent->next_ent = ent->next_ent;
+    else
+	sched->wheel[ent->due & (MAINT_WHEEL_SIZE - 1)] = ent->next_ent;
+    if (ent->next_ent)
+	ent->next_ent->prev_ent = ent->prev_ent;
+}
+
+/* Set the entry's due time from its tasks.  If none of its tasks are
+   on, it is parked a turn of the wheel away. */
+static void
+ent_set_due(ipmi_maint_sched_t *sched, maint_ent_t *ent)
+{
+    unsigned int i;
+    int          found = 0;
+
+    for (i=0; i<IPMI_MAINT_NUM_TASKS; i++) {
+	if (!(ent->tasks & (1 << i)) || !sched->tasks[i].interval)
+	    continue;
+	if (!found || (ent->next[i] < ent->due))
+	    ent->due = ent->next[i];
+	found = 1;
+    }
+    if (!found)
+	ent->due = sched->now + MAINT_WHEEL_SIZE;
+}
+
+/* A task's first run is somewhere in its first interval, so domains
+   added together don't all run together. */
+static void
+ent_start_task(ipmi_maint_sched_t *sched, maint_ent_t *ent, unsigned int task)
+{
+    ent->next[task] = (sched->now + 1
+		       + sched_rand(sched, sched->tasks[task].interval));
+}
+
+/* Later runs come up to jitter ticks early, never late, so a
+   watchdog is always reset within its interval. */
+static void
+ent_next_task(ipmi_maint_sched_t *sched, maint_ent_t *ent, unsigned int task)
+{
+    maint_task_t *t = &sched->tasks[task];
+
+    ent->next[task] = sched->now + t->interval - sched_rand(sched, t->jitter);
+    if (ent->next[task] <= sched->now)
+	ent->next[task] = sched->now + 1;
+}
+
+static maint_ent_t *
+find_ent(ipmi_maint_sched_t *sched, ipmi_domain_id_t domain_id)
+{
+    unsigned int i;
+    maint_ent_t  *ent;
+
+    for (i=0; i<MAINT_WHEEL_SIZE; i++) {
+	for (ent=sched->wheel[i]; ent; ent=ent->next_ent) {
+	    if (ipmi_cmp_domain_id(ent->domain_id, domain_id) == 0)
+		return ent;
+	}
+    }
+    return NULL;
+}
+
+static void
+op_done(maint_op_t *op, int err)
+{
+    ipmi_maint_sched_t *sched = op->sched;
+    int                expected = 0;
+    int                destroyed;
+
+    /* Keep the first error. */
+    if (err)
+	__atomic_compare_exchange_n(&op->err, &expected, err, 0,
+				    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    if (__atomic_sub_fetch(&op->outstanding, 1, __ATOMIC_ACQ_REL) > 0)
+	return;
+
+    ipmi_lock(sched->lock);
+    destroyed = sched->destroyed;
+    ipmi_unlock(sched->lock);
+    if (sched->done && !destroyed)
+	sched->done(op->domain_id, op->task,
+		    __atomic_load_n(&op->err, __ATOMIC_RELAXED),
+		    sched->cb_data);
+    ipmi_mem_free(op);
+    sched_put(sched);
+}
+
+static void
+wd_reset_rsp(ipmi_mc_t *mc, ipmi_msg_t *rsp, void *rsp_data)
+{
+    maint_op_t *op = rsp_data;
+    int        err = 0;
+
+    if (!mc)
+	err = ECANCELED;
+    else if (rsp->data_len < 1)
+	err = EINVAL;
+    else if (rsp->data[0] != 0)
+	err = IPMI_IPMI_ERR_VAL(rsp->data[0]);
+    op_done(op, err);
+}
+
+static void
+sel_time_rsp(ipmi_mc_t *mc, int err, void *cb_data)
+{
+    op_done(cb_data, err);
+}
+
+static void
+op_mc(ipmi_domain_t *domain, ipmi_mc_t *mc, void *cb_data)
+{
+    maint_op_t *op = cb_data;
+    ipmi_msg_t msg;
+    int        rv;
+    int        expected;
+
+    if (!ipmi_mc_is_active(mc))
+	return;
+
+    __atomic_add_fetch(&op->outstanding, 1, __ATOMIC_RELAXED);
+    switch (op->task) {
+    case IPMI_MAINT_WATCHDOG_RESET:
+	/* The watchdog is on the BMC. */
+	if (ipmi_mc_get_channel(mc) != IPMI_BMC_CHANNEL) {
+	    rv = -1;
+	    break;
+	}
+	msg.netfn = IPMI_APP_NETFN;
+	msg.cmd = IPMI_RESET_WATCHDOG_TIMER_CMD;
+	msg.data = NULL;
+	msg.data_len = 0;
+	rv = ipmi_mc_send_command(mc, 0, &msg, wd_reset_rsp, op);
+	break;
+
+    case IPMI_MAINT_SET_SEL_TIME:
+	if (!ipmi_mc_sel_device_support(mc)) {
+	    rv = -1;
+	    break;
+	}
+	rv = ipmi_mc_set_current_sel_time(mc, &op->now, sel_time_rsp, op);
+	break;
+
+    default:
+	rv = -1;
+    }
+
+    if (rv < 0) {
+	/* Not an MC this task is for. */
+	__atomic_sub_fetch(&op->outstanding, 1, __ATOMIC_RELAXED);
+	return;
+    }
+
+    /* There was an MC to do it on. */
+    expected = ENOENT;
+    __atomic_compare_exchange_n(&op->err, &expected, 0, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    if (rv)
+	op_done(op, rv);
+}
+
+static void
+op_domain(ipmi_domain_t *domain, void *cb_data)
+{
+    maint_op_t *op = cb_data;
+
+    ipmi_domain_iterate_mcs(domain, op_mc, op);
+}
+
+static void
+run_task(ipmi_maint_sched_t *sched, ipmi_domain_id_t domain_id,
+	 unsigned int task, struct timeval *now)
+{
+    maint_op_t *op;
+    int        rv;
+
+    op = ipmi_mem_alloc(sizeof(*op));
+    if (!op) {
+	if (sched->done)
+	    sched->done(domain_id, task, ENOMEM, sched->cb_data);
+	return;
+    }
+    memset(op, 0, sizeof(*op));
+    op->sched = sched;
+    op->domain_id = domain_id;
+    op->task = task;
+    op->now = *now;
+    op->outstanding = 1;
+    /* Stays this way if there is no MC to send the command to. */
+    op->err = ENOENT;
+
+    ipmi_lock(sched->lock);
+    sched->refcount++;
+    ipmi_unlock(sched->lock);
+
+    rv = ipmi_domain_pointer_cb(domain_id, op_domain, op);
+    if (rv)
+	op->err = rv;
+    op_done(op, 0);
+}
+
+/* Make sure the run list can take one more entry. */
+static int
+run_room(ipmi_maint_sched_t *sched, unsigned int count)
+{
+    maint_run_t  *run;
+    unsigned int size;
+
+    if (count < sched->run_size)
+	return 1;
+    size = sched->run_size ? sched->run_size * 2 : 64;
+    run = ipmi_mem_alloc(size * sizeof(*run));
+    if (!run)
+	return 0;
+    if (sched->run) {
+	memcpy(run, sched->run, count * sizeof(*run));
+	ipmi_mem_free(sched->run);
+    }
+    sched->run = run;
+    sched->run_size = size;
+    return 1;
+}
+
+/* Pull the entries that are due in the current slot into the run
+   list.  Called with the lock held. */
+static unsigned int
+collect_due(ipmi_maint_sched_t *sched)
+{
+    maint_ent_t  *ent, *next, *defer = NULL;
+    unsigned int count = 0;
+    unsigned int i, tasks;
+    uint64_t     now = sched->now;
+
+    ent = sched->wheel[now & (MAINT_WHEEL_SIZE - 1)];
+    for (; ent; ent=next) {
+	next = ent->next_ent;
+	if (ent->due > now)
+	    continue;
+
+	ent_unlink(sched, ent);
+	if ((sched->max_per_tick && (count >= sched->max_per_tick))
+	    || !run_room(sched, count))
+	{
+	    /* Too many this tick, it goes in the next one.  Don't put
+	       it back until we are done walking this slot. */
+	    ent->due = now + 1;
+	    ent->next_ent = defer;
+	    defer = ent;
+	    continue;
+	}
+
+	tasks = 0;
+	for (i=0; i<IPMI_MAINT_NUM_TASKS; i++) {
+	    if (!(ent->tasks & (1 << i)) || !sched->tasks[i].interval
+		|| (ent->next[i] > now))
+		continue;
+	    tasks |= 1 << i;
+	    ent_next_task(sched, ent, i);
+	}
+	ent_set_due(sched, ent);
+	ent_link(sched, ent);
+
+	if (tasks) {
+	    sched->run[count].domain_id = ent->domain_id;
+	    sched->run[count].tasks = tasks;
+	    count++;
+	}
+    }
+
+    for (ent=defer; ent; ent=next) {
+	next = ent->next_ent;
+	ent_link(sched, ent);
+    }
+    return count;
+}
+
+static void sched_timeout(void *cb_data, os_hnd_timer_id_t *id);
+
+static int
+sched_start_timer(ipmi_maint_sched_t *sched)
+{
+    struct timeval tv;
+
+    tv.tv_sec = sched->tick / 1000;
+    tv.tv_usec = (sched->tick % 1000) * 1000;
+    return sched->os_hnd->start_timer(sched->os_hnd, sched->timer, &tv,
+				      sched_timeout, sched);
+}
+
+static void
+sched_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    ipmi_maint_sched_t *sched = cb_data;
+    struct timeval     now;
+    unsigned int       count, i, j;
+
+    ipmi_lock(sched->lock);
+    if (sched->destroyed) {
+	ipmi_unlock(sched->lock);
+	sched_put(sched);
+	return;
+    }
+    sched->now++;
+    count = collect_due(sched);
+    ipmi_unlock(sched->lock);
+
+    sched->os_hnd->get_real_time(sched->os_hnd, &now);
+    for (i=0; i<count; i++) {
+	for (j=0; j<IPMI_MAINT_NUM_TASKS; j++) {
+	    if (sched->run[i].tasks & (1 << j))
+		run_task(sched, sched->run[i].domain_id, j, &now);
+	}
+    }
+
+    ipmi_lock(sched->lock);
+    if (sched->destroyed) {
+	ipmi_unlock(sched->lock);
+	sched_put(sched);
+	return;
+    }
+    sched_start_timer(sched);
+    ipmi_unlock(sched->lock);
+}
+
+int
+ipmi_maint_sched_alloc(os_handler_t        *os_hnd,
+		       unsigned int        tick,
+		       ipmi_maint_sched_cb done,
+		       void                *cb_data,
+		       ipmi_maint_sched_t  **new_sched)
+{
+    ipmi_maint_sched_t *sched;
+    struct timeval     tv;
+    int                rv;
+
+    if (!os_hnd || !new_sched)
+	return EINVAL;
+
+    sched = ipmi_mem_alloc(sizeof(*sched));
+    if (!sched)
+	return ENOMEM;
+    memset(sched, 0, sizeof(*sched));
+
+    rv = ipmi_create_global_lock(&sched->lock);
+    if (rv) {
+	ipmi_mem_free(sched);
+	return rv;
+    }
+    rv = os_hnd->alloc_timer(os_hnd, &sched->timer);
+    if (rv) {
+	ipmi_destroy_lock(sched->lock);
+	ipmi_mem_free(sched);
+	return rv;
+    }
+
+    sched->os_hnd = os_hnd;
+    if (!tick)
+	tick = MAINT_DEFAULT_TICK;
+    sched->tick = tick;
+    sched->done = done;
+    sched->cb_data = cb_data;
+    if (os_hnd->get_random(os_hnd, &sched->rand_state,
+			   sizeof(sched->rand_state))
+	|| !sched->rand_state)
+    {
+	os_hnd->get_monotonic_time(os_hnd, &tv);
+	sched->rand_state = (tv.tv_sec ^ tv.tv_usec) | 1;
+    }
+
+    sched->refcount = 2;
+    rv = sched_start_timer(sched);
+    if (rv) {
+	os_hnd->free_timer(os_hnd, sched->timer);
+	ipmi_destroy_lock(sched->lock);
+	ipmi_mem_free(sched);
+	return rv;
+    }
+
+    *new_sched = sched;
+    return 0;
+}
+
+void
+ipmi_maint_sched_destroy(ipmi_maint_sched_t *sched)
+{
+    unsigned int i;
+    maint_ent_t  *ent, *next;
+    int          timer_stopped;
+
+    ipmi_lock(sched->lock);
+    sched->destroyed = 1;
+    for (i=0; i<MAINT_WHEEL_SIZE; i++) {
+	for (ent=sched->wheel[i]; ent; ent=next) {
+	    next = ent->next_ent;
+	    ipmi_mem_free(ent);
+	}
+	sched->wheel[i] = NULL;
+    }
+    sched->num_ents = 0;
+    timer_stopped = (sched->os_hnd->stop_timer(sched->os_hnd, sched->timer)
+		     == 0);
+    ipmi_unlock(sched->lock);
+
+    /* If the timer couldn't be stopped its handler is running or about
+       to, and it drops the timer's reference. */
+    if (timer_stopped)
+	sched_put(sched);
+    sched_put(sched);
+}
+
+int
+ipmi_maint_sched_set_task(ipmi_maint_sched_t *sched,
+			  unsigned int       task,
+			  unsigned int       interval,
+			  unsigned int       jitter)
+{
+    maint_task_t *t;
+    unsigned int i;
+    maint_ent_t  *ent, *next, *moved = NULL;
+    int          was_on;
+
+    if (task >= IPMI_MAINT_NUM_TASKS)
+	return EINVAL;
+    if (interval && (jitter >= interval))
+	return EINVAL;
+
+    ipmi_lock(sched->lock);
+    t = &sched->tasks[task];
+    was_on = t->interval != 0;
+    t->interval = (interval + sched->tick - 1) / sched->tick;
+    t->jitter = jitter / sched->tick;
+    if (interval && !t->interval)
+	t->interval = 1;
+
+    /* Restart the task on every domain that has it, its due time may
+       have moved. */
+    for (i=0; i<MAINT_WHEEL_SIZE; i++) {
+	for (ent=sched->wheel[i]; ent; ent=next) {
+	    next = ent->next_ent;
+	    if (!(ent->tasks & (1 << task)))
+		continue;
+	    ent_unlink(sched, ent);
+	    ent->next_ent = moved;
+	    moved = ent;
+	}
+    }
+    for (ent=moved; ent; ent=next) {
+	next = ent->next_ent;
+	if (t->interval) {
+	    if (!was_on || (ent->next[task] > sched->now + t->interval))
+		ent_start_task(sched, ent, task);
+	}
+	ent_set_due(sched, ent);
+	ent_link(sched, ent);
+    }
+    ipmi_unlock(sched->lock);
+    return 0;
+}
+
+void
+ipmi_maint_sched_set_max_per_tick(ipmi_maint_sched_t *sched,
+				  unsigned int       max)
+{
+    ipmi_lock(sched->lock);
+    sched->max_per_tick = max;
+    ipmi_unlock(sched->lock);
+}
+
+int
+ipmi_maint_sched_add_domain(ipmi_maint_sched_t *sched,
+			    ipmi_domain_id_t   domain_id,
+			    unsigned int       tasks)
+{
+    maint_ent_t  *ent;
+    unsigned int i;
+
+    if (!tasks || (tasks & ~((1 << IPMI_MAINT_NUM_TASKS) - 1)))
+	return EINVAL;
+
+    ent = ipmi_mem_alloc(sizeof(*ent));
+    if (!ent)
+	return ENOMEM;
+    memset(ent, 0, sizeof(*ent));
+    ent->domain_id = domain_id;
+    ent->tasks = tasks;
+
+    ipmi_lock(sched->lock);
+    if (find_ent(sched, domain_id)) {
+	ipmi_unlock(sched->lock);
+	ipmi_mem_free(ent);
+	return EEXIST;
+    }
+
+    for (i=0; i<IPMI_MAINT_NUM_TASKS; i++) {
+	if (sched->tasks[i].interval)
+	    ent_start_task(sched, ent, i);
+    }
+    ent_set_due(sched, ent);
+    ent_link(sched, ent);
+    sched->num_ents++;
+    ipmi_unlock(sched->lock);
+    return 0;
+}
+
+int
+ipmi_maint_sched_remove_domain(ipmi_maint_sched_t *sched,
+			       ipmi_domain_id_t   domain_id)
+{
+    maint_ent_t *ent;
+
+    ipmi_lock(sched->lock);
+    ent = find_ent(sched, domain_id);
+    if (!ent) {
+	ipmi_unlock(sched->lock);
+	return ENOENT;
+    }
+    ent_unlink(sched, ent);
+    sched->num_ents--;
+    ipmi_unlock(sched->lock);
+    ipmi_mem_free(ent);
+    return 0;
+}
@@ -31,6 +31,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_MC
+
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -41,6 +43,7 @@
 #include <OpenIPMI/ipmi_err.h>
 #include <OpenIPMI/ipmi_user.h>
 #include <OpenIPMI/ipmi_mc.h>
+#include <OpenIPMI/ipmi_conn.h>
 
 #include <OpenIPMI/internal/locked_list.h>
 #include <OpenIPMI/internal/opq.h>
@@ -73,6 +76,14 @@ typedef struct mc_reread_sel_s
     int                 sel_time_set;
     int                 processing;
 
+    /* The current time between SEL scans in seconds, stretched from
+       the MC's scan interval while nothing changes.  Zero means use
+       the scan interval. */
+    unsigned int        scan_interval;
+
+    /* An event came in during a scan, check again right after. */
+    int                 recheck;
+
     ipmi_mc_ptr_cb sels_first_read_handler;
     void           *sels_first_read_cb_data;
 
@@ -290,6 +301,15 @@ struct ipmi_mc_s
     unsigned int startup_count;
     int startup_reported;
 
+    /* Set if the startup took a slot in the domain's MC startup
+       scheduler, which must be given back when it is done. */
+    int startup_scheduled;
+
+    /* Bring-up recorder spans for the startup and the current step
+       of it, 0 if not recording. */
+    int startup_span;
+    int step_span;
+
     /* If we have any external users that do not have direct
        references, we increment the usercount.  This is primarily the
        internal uses in the active_handlers list, but we cannot use
@@ -339,6 +359,12 @@ struct ipmi_mc_s
     /* Timer for rescanning the sel periodically. */
     mc_reread_sel_t   *sel_timer_info;
     unsigned int      sel_scan_interval; /* seconds between SEL scans */
+    unsigned int      sel_scan_max_interval; /* stretch scans up to this */
+
+    /* How many stateless operations (sensor reads and such) may be
+       run at once on each of the MC's queues.  0 means use the
+       connection's outstanding message window. */
+    unsigned int      max_concurrent_ops;
 
     /* Is the global events enable for the MC enabled? */
     int events_enabled;
@@ -445,6 +471,61 @@ mc_set_name(ipmi_mc_t *mc)
     ipmi_unlock(mc->lock);
 }
 
+/* How long operations wait in the queues of an MC's SEL, SDRs and
+   sensors, summed up per MC in the domain statistics. */
+typedef struct mc_opq_wait_s
+{
+    ipmi_domain_stat_t *waits;
+    ipmi_domain_stat_t *wait_ms;
+} mc_opq_wait_t;
+
+static void
+mc_opq_wait(void *cb_data, unsigned int wait_ms)
+{
+    mc_opq_wait_t *info = cb_data;
+
+    ipmi_domain_stat_add(info->waits, 1);
+    ipmi_domain_stat_add(info->wait_ms, wait_ms);
+}
+
+static void
+mc_opq_wait_free(void *cb_data)
+{
+    mc_opq_wait_t *info = cb_data;
+
+    ipmi_domain_stat_put(info->waits);
+    ipmi_domain_stat_put(info->wait_ms);
+    ipmi_mem_free(info);
+}
+
+void
+_ipmi_mc_track_opq_waits(ipmi_mc_t *mc, opq_t *opq)
+{
+    mc_opq_wait_t *info;
+    char          name[IPMI_MC_NAME_LEN];
+
+    info = ipmi_mem_alloc(sizeof(*info));
+    if (!info)
+	return;
+
+    ipmi_mc_get_name(mc, name, sizeof(name));
+
+    if (ipmi_domain_stat_register(mc->domain, "mc_opq_waits", name,
+				  &info->waits))
+    {
+	ipmi_mem_free(info);
+	return;
+    }
+    if (ipmi_domain_stat_register(mc->domain, "mc_opq_wait_ms", name,
+				  &info->wait_ms))
+    {
+	ipmi_domain_stat_put(info->waits);
+	ipmi_mem_free(info);
+	return;
+    }
+    opq_set_wait_handler(opq, mc_opq_wait, mc_opq_wait_free, info);
+}
+
 int
 ipmi_mc_get_name(ipmi_mc_t *mc, char *name, int length)
 {
@@ -542,6 +623,14 @@ active_cleanup(void *cb_data, void *item1, void *item2)
     return LOCKED_LIST_ITER_CONTINUE;
 }
 
+/* The use count is changed without the domain MC lock when finding
+   an MC by address, so it is always accessed atomically. */
+static unsigned int
+mc_usecount(const ipmi_mc_t *mc)
+{
+    return __atomic_load_n(&mc->usecount, __ATOMIC_ACQUIRE);
+}
+
 static int
 check_mc_destroy(ipmi_mc_t *mc)
 {
@@ -554,6 +643,15 @@ check_mc_destroy(ipmi_mc_t *mc)
 	&& (ipmi_sensors_get_count(mc->sensors) == 0)
 	&& (mc->usercount == 0))
     {
+	/* Finding the MC by address doesn't take the domain MC lock,
+	   so something may have found it since the use count was
+	   checked.  With the table locked it can't be found again. */
+	_ipmi_domain_mc_table_lock(domain);
+	if (mc_usecount(mc) != 1) {
+	    _ipmi_domain_mc_table_unlock(domain);
+	    return 0;
+	}
+
 	mc->in_destroy = 1;
 	ipmi_unlock(mc->lock);
 
@@ -698,6 +796,8 @@ _ipmi_create_mc(ipmi_domain_t *domain,
 
     mc->sel = NULL;
     mc->sel_scan_interval = ipmi_domain_get_sel_rescan_time(domain);
+    mc->sel_scan_max_interval = ipmi_domain_get_sel_rescan_max_time(domain);
+    mc->max_concurrent_ops = _ipmi_domain_mc_concurrency(domain);
 
     memcpy(&(mc->addr), addr, addr_len);
     mc->addr_len = addr_len;
@@ -728,7 +828,7 @@ _ipmi_create_mc(ipmi_domain_t *domain,
     mc->sel_timer_info->mc_id = ipmi_mc_convert_to_id(mc);
     mc->sel_timer_info->mc = mc;
     mc->sel_timer_info->os_hnd = os_hnd;
-    rv = os_hnd->alloc_timer(os_hnd, &mc->sel_timer_info->sel_timer);
+    rv = _ipmi_domain_alloc_timer(domain, &mc->sel_timer_info->sel_timer);
     if (rv)
 	goto out_err;
 
@@ -1000,6 +1100,53 @@ ipmi_mc_get_sel_rescan_time(ipmi_mc_t *mc)
     return mc->sel_scan_interval;
 }
 
+void
+ipmi_mc_set_sel_rescan_max_time(ipmi_mc_t *mc, unsigned int seconds)
+{
+    CHECK_MC_LOCK(mc);
+
+    ipmi_lock(mc->sel_timer_info->lock);
+    mc->sel_scan_max_interval = seconds;
+    if (mc->sel_timer_info->scan_interval > seconds)
+	mc->sel_timer_info->scan_interval = 0;
+    ipmi_unlock(mc->sel_timer_info->lock);
+}
+
+unsigned int
+ipmi_mc_get_sel_rescan_max_time(ipmi_mc_t *mc)
+{
+    CHECK_MC_LOCK(mc);
+
+    return mc->sel_scan_max_interval;
+}
+
+void
+ipmi_mc_set_max_concurrent_ops(ipmi_mc_t *mc, unsigned int max)
+{
+    CHECK_MC_LOCK(mc);
+
+    mc->max_concurrent_ops = max;
+}
+
+unsigned int
+ipmi_mc_get_max_concurrent_ops(ipmi_mc_t *mc)
+{
+    CHECK_MC_LOCK(mc);
+
+    return mc->max_concurrent_ops;
+}
+
+unsigned int
+_ipmi_mc_op_concurrency(ipmi_mc_t *mc)
+{
+    unsigned int max = mc->max_concurrent_ops;
+    unsigned int window = _ipmi_domain_max_outstanding(mc->domain);
+
+    if ((max == 0) || (max > window))
+	max = window;
+    return max;
+}
+
 typedef struct sel_op_done_info_s
 {
     ipmi_mc_t       *mc;
@@ -1053,6 +1200,39 @@ ipmi_mc_del_event(ipmi_mc_t                 *mc,
     return rv;
 }
 
+int
+ipmi_mc_del_events_by_recid(ipmi_mc_t                 *mc,
+			    const unsigned int        *record_ids,
+			    unsigned int              count,
+			    ipmi_mc_del_event_done_cb handler,
+			    void                      *cb_data)
+{
+    sel_op_done_info_t *sel_info;
+    int                rv;
+
+    if (!mc->devid.SEL_device_support)
+	return EINVAL;
+
+    /* OEM handlers only know how to delete one event. */
+    if (mc->sel_del_event_handler)
+	return ENOSYS;
+
+    sel_info = ipmi_mem_alloc(sizeof(*sel_info));
+    if (!sel_info)
+	return ENOMEM;
+
+    sel_info->mc = mc;
+    sel_info->done = handler;
+    sel_info->cb_data = cb_data;
+
+    rv = ipmi_sel_del_events_by_recid(mc->sel, record_ids, count,
+				      sel_op_done, sel_info);
+    if (rv)
+	ipmi_mem_free(sel_info);
+
+    return rv;
+}
+
 int
 ipmi_mc_sel_clear(ipmi_mc_t                 *mc,
 		  ipmi_event_t              *last_event, 
@@ -1170,6 +1350,48 @@ ipmi_mc_event_by_recid(ipmi_mc_t    *mc,
     return ipmi_sel_get_event_by_recid(mc->sel, record_id);
 }
 
+typedef struct mc_iterate_events_s
+{
+    ipmi_mc_t                 *mc;
+    ipmi_mc_iterate_events_cb handler;
+    void                      *cb_data;
+} mc_iterate_events_t;
+
+static int
+mc_iterate_events_handler(ipmi_sel_info_t *sel,
+			  ipmi_event_t    *event,
+			  void            *cb_data)
+{
+    mc_iterate_events_t *info = cb_data;
+
+    return info->handler(info->mc, event, info->cb_data);
+}
+
+int
+ipmi_mc_iterate_events(ipmi_mc_t                 *mc,
+		       ipmi_mc_iterate_events_cb handler,
+		       void                      *cb_data)
+{
+    mc_iterate_events_t info;
+
+    info.mc = mc;
+    info.handler = handler;
+    info.cb_data = cb_data;
+    return ipmi_sel_iterate_events(mc->sel, mc_iterate_events_handler,
+				   &info);
+}
+
+int
+ipmi_mc_events_by_time(ipmi_mc_t    *mc,
+		       ipmi_time_t  start,
+		       ipmi_time_t  end,
+		       int          *array_size,
+		       ipmi_event_t **array)
+{
+    return ipmi_sel_get_events_by_time(mc->sel, start, end,
+				       array_size, array);
+}
+
 int
 ipmi_mc_sel_count(ipmi_mc_t *mc)
 {
@@ -1300,24 +1522,41 @@ ipmi_mc_set_sel_oem_event_handler(ipmi_mc_t                 *mc,
 
 static void mc_reread_sel_timeout(void *cb_data, os_hnd_timer_id_t *id);
 
+/* Seconds to wait before checking the SEL after an event comes in,
+   so a burst of events is handled with one check. */
+#define SEL_EVENT_CHECK_DELAY 1
+
+/* Start the timer for the next SEL check after the given time.
+   Must be called with the info lock held. */
+static void
+sels_start_timer_wait(mc_reread_sel_t *info, struct timeval *timeout)
+{
+    os_handler_t *os_hnd = info->os_hnd;
+
+    info->processing = 0;
+    info->timer_running = 1;
+    os_hnd->start_timer(os_hnd,
+			info->sel_timer,
+			timeout,
+			mc_reread_sel_timeout,
+			info);
+}
+
 /* Must be called with the info lock held. */
 static void
 sels_start_timer(mc_reread_sel_t *info)
 {
+    unsigned int interval = info->mc->sel_scan_interval;
+
     DEBUG_INFO(info);
     info->processing = 0;
-    if (info->mc->sel_scan_interval != 0) {
-	os_handler_t   *os_hnd = info->os_hnd;
+    if (interval != 0) {
 	struct timeval timeout;
 
-	timeout.tv_sec = info->mc->sel_scan_interval;
-	timeout.tv_usec = 0;
-	info->timer_running = 1;
-	os_hnd->start_timer(os_hnd,
-			    info->sel_timer,
-			    &timeout,
-			    mc_reread_sel_timeout,
-			    info);
+	if (info->scan_interval > interval)
+	    interval = info->scan_interval;
+	_ipmi_pace_interval(info->os_hnd, interval, 0, &timeout);
+	sels_start_timer_wait(info, &timeout);
     } else {
 	info->timer_running = 0;
     }
@@ -1365,6 +1604,30 @@ sels_restart(mc_reread_sel_t *info)
     sels_start_timer(info);
 }
 
+/* Double the time to the next scan if the SEL didn't change, up to
+   the max time, or go back to the normal time if it did.  Must be
+   called with the info lock held. */
+static void
+sels_adjust_interval(mc_reread_sel_t *info, int err, int changed)
+{
+    ipmi_mc_t    *mc = info->mc;
+    unsigned int interval = info->scan_interval;
+
+    if (err || changed || (mc->sel_scan_max_interval <= mc->sel_scan_interval)
+	|| (mc->sel_scan_interval == 0))
+    {
+	info->scan_interval = 0;
+	return;
+    }
+
+    if (interval < mc->sel_scan_interval)
+	interval = mc->sel_scan_interval;
+    interval *= 2;
+    if (interval > mc->sel_scan_max_interval)
+	interval = mc->sel_scan_max_interval;
+    info->scan_interval = interval;
+}
+
 static void
 sels_fetched_start_timer(ipmi_sel_info_t *sel,
 			 int             err,
@@ -1395,21 +1658,64 @@ sels_fetched_start_timer(ipmi_sel_info_t *sel,
        case someone messes with the SEL time. */
     info->mc->startup_SEL_time = 0;
 
-    sels_start_timer(info);
+    if (info->recheck) {
+	struct timeval timeout = { SEL_EVENT_CHECK_DELAY, 0 };
+
+	info->recheck = 0;
+	info->scan_interval = 0;
+	sels_start_timer_wait(info, &timeout);
+    } else {
+	sels_adjust_interval(info, err, changed);
+	sels_start_timer(info);
+    }
     sels_fetched_call_handler(info, err, changed, count);
 }
 
+int
+_ipmi_mc_sel_event_hint(ipmi_mc_t *mc)
+{
+    mc_reread_sel_t *info = mc->sel_timer_info;
+    struct timeval  timeout = { SEL_EVENT_CHECK_DELAY, 0 };
+    int             rv = 0;
+
+    if (!info)
+	return 0;
+
+    ipmi_lock(info->lock);
+    info->scan_interval = 0;
+    if (info->cancelled || !info->timer_should_run || !info->sel_time_set)
+	goto out_unlock;
+    if (info->processing) {
+	info->recheck = 1;
+	rv = 1;
+    } else if (info->timer_running && (mc->sel_scan_interval != 0)) {
+	/* If the timer can't be stopped it is about to go off
+	   anyway. */
+	if (!info->os_hnd->stop_timer(info->os_hnd, info->sel_timer))
+	    sels_start_timer_wait(info, &timeout);
+	rv = 1;
+    }
+ out_unlock:
+    ipmi_unlock(info->lock);
+    return rv;
+}
+
 static void
 mc_reread_sel_timeout_cb(ipmi_mc_t *mc, void *cb_data)
 {
     mc_reread_sel_t *info = cb_data;
     int             rv = EINVAL;
+    struct timeval  wait;
 
     DEBUG_INFO(info);
     info->processing = 1;
     if (! info->sel_time_set) {
 	DEBUG_INFO(mc->sel_timer_info);
 	start_sel_time_set(mc, info);
+    } else if (_ipmi_pace_background(info->os_hnd, &wait)) {
+	/* Over the background limit, check again when allowed. */
+	DEBUG_INFO(mc->sel_timer_info);
+	sels_start_timer_wait(info, &wait);
     } else {
 	/* Only fetch the SEL if we know the connection is up. */
 	if (ipmi_domain_con_up(mc->domain)) {
@@ -2183,9 +2489,39 @@ _ipmi_mc_startup_get(ipmi_mc_t *mc, char *name)
     ipmi_unlock(mc->lock);
 }
 
+/* This may be called after the MC is gone, so don't check the lock. */
+static unsigned int
+mc_span_track(ipmi_mc_t *mc)
+{
+    if (mc->addr.addr_type == IPMI_IPMB_ADDR_TYPE) {
+	ipmi_ipmb_addr_t *ipmb = (ipmi_ipmb_addr_t *) &(mc->addr);
+	return IPMI_SPAN_TRACK_MC(ipmb->channel, ipmb->slave_addr);
+    }
+    return IPMI_SPAN_TRACK_MC(IPMI_BMC_CHANNEL, 0);
+}
+
+/* End the current startup step and start the next one (if name is
+   not NULL) that waited on it. */
+static void
+mc_step(ipmi_mc_t *mc, const char *name)
+{
+    int parent = mc->step_span;
+
+    _ipmi_domain_span_end(mc->domain, mc->step_span);
+    mc->step_span = 0;
+    if (!name)
+	return;
+    if (!parent)
+	parent = mc->startup_span;
+    mc->step_span = _ipmi_domain_span_start(mc->domain, name, NULL,
+					    mc_span_track(mc), parent);
+}
+
 void
 _ipmi_mc_startup_put(ipmi_mc_t *mc, char *name)
 {
+    int scheduled;
+
     ipmi_lock(mc->lock);
     DEBUG_INFO(mc->sel_timer_info);
     mc->sel_timer_info->processing = 0;
@@ -2197,7 +2533,14 @@ _ipmi_mc_startup_put(ipmi_mc_t *mc, char *name)
     mc->startup_reported = 1;
     if (mc->state == MC_ACTIVE_IN_STARTUP)
 	mc->state = MC_ACTIVE_PEND_FULLY_UP;
+    scheduled = mc->startup_scheduled;
+    mc->startup_scheduled = 0;
     ipmi_unlock(mc->lock);
+    mc_step(mc, NULL);
+    _ipmi_domain_span_end(mc->domain, mc->startup_span);
+    mc->startup_span = 0;
+    if (scheduled)
+	_ipmi_domain_mc_startup_done(mc->domain);
     _ipmi_put_domain_fully_up(mc->domain, "_ipmi_mc_startup_put");
 }
 
@@ -2259,6 +2602,7 @@ sensors_reread(ipmi_mc_t *mc, int err, void *cb_data)
 	int rv;
 	/* If the MC supports an SEL, start scanning its SEL. */
 	DEBUG_INFO(mc->sel_timer_info);
+	mc_step(mc, "mc_sel_fetch");
 	ipmi_lock(mc->lock);
 	rv = start_sel_ops(mc, 0, mc_first_sels_read, mc);
 	ipmi_unlock(mc->lock);
@@ -2297,6 +2641,7 @@ got_guid(ipmi_mc_t  *mc,
 	&& ipmi_option_SDRs(ipmi_mc_get_domain(mc)))
     {
 	DEBUG_INFO(mc->sel_timer_info);
+	mc_step(mc, "mc_sdr_fetch");
 	rv = ipmi_mc_reread_sensors(mc, sensors_reread, mc);
 	if (rv) {
 	    DEBUG_INFO(mc->sel_timer_info);
@@ -2308,16 +2653,18 @@ got_guid(ipmi_mc_t  *mc,
     }
 }
 
+/* The MC got its turn from the domain's startup scheduler. */
 static void
-mc_startup(ipmi_mc_t *mc)
+mc_startup_start(ipmi_mc_t *mc, int scheduled)
 {
     ipmi_msg_t msg;
     int        rv = 0;
 
-    DEBUG_INFO(mc->sel_timer_info);
-    mc->sel_timer_info->processing = 1;
-    mc->startup_count = 1;
-    mc->startup_reported = 0;
+    ipmi_lock(mc->lock);
+    mc->startup_scheduled = scheduled;
+    ipmi_unlock(mc->lock);
+
+    mc_step(mc, "mc_guid");
 
     if (mc->devid.chassis_support) {
 	unsigned char instance = ipmi_mc_get_address(mc);
@@ -2353,6 +2700,38 @@ mc_startup(ipmi_mc_t *mc)
     }
 }
 
+static void
+mc_startup(ipmi_mc_t *mc)
+{
+    int has_sdrs;
+    int rv;
+
+    DEBUG_INFO(mc->sel_timer_info);
+    mc->sel_timer_info->processing = 1;
+    mc->startup_count = 1;
+    mc->startup_reported = 0;
+    mc->startup_scheduled = 0;
+
+    /* A scan found the MC, so its startup waited on the scan. */
+    mc_step(mc, NULL);
+    _ipmi_domain_span_end(mc->domain, mc->startup_span);
+    mc->startup_span = _ipmi_domain_span_start(mc->domain, "mc_startup",
+					       NULL, mc_span_track(mc),
+					       _ipmi_domain_scan_span(
+						   mc->domain));
+    mc_step(mc, "mc_startup_wait");
+
+    /* MCs with sensors go first, they are what users are waiting
+       for. */
+    has_sdrs = ((mc->devid.provides_device_sdrs
+		 || mc->treat_main_as_device_sdrs)
+		&& ipmi_option_SDRs(mc->domain));
+    rv = _ipmi_domain_mc_startup(mc->domain, mc, has_sdrs, mc_startup_start);
+    if (rv)
+	/* Couldn't queue it, just start it now. */
+	mc_startup_start(mc, 0);
+}
+
 /***********************************************************************
  *
  * MC ID and state handling
@@ -2377,7 +2756,7 @@ _ipmi_mc_release(ipmi_mc_t *mc)
 int
 _ipmi_mc_get(ipmi_mc_t *mc)
 {
-    mc->usecount++;
+    __atomic_add_fetch(&mc->usecount, 1, __ATOMIC_ACQ_REL);
     return 0;
 }
 
@@ -2398,9 +2777,9 @@ void
 _ipmi_mc_put(ipmi_mc_t *mc)
 {
     _ipmi_domain_mc_lock(mc->domain);
-    if (mc->usecount == 1) {
+    if (mc_usecount(mc) == 1) {
 	/* Make sure this code cannot run when we release the lock. */
-	mc->usecount++;
+	__atomic_add_fetch(&mc->usecount, 1, __ATOMIC_ACQ_REL);
 	ipmi_lock(mc->lock);
 	switch (mc->state) {
 	case MC_INACTIVE_PEND_STARTUP:
@@ -2466,18 +2845,18 @@ _ipmi_mc_put(ipmi_mc_t *mc)
 	    break;
 	}
     still_in_startup:
-	mc->usecount--;
+	__atomic_sub_fetch(&mc->usecount, 1, __ATOMIC_ACQ_REL);
 
 	/* Only attempt the destroy if no one else has gotten the MC
 	   while we were holding it. */
-	if (mc->usecount == 1) {
+	if (mc_usecount(mc) == 1) {
 	    ipmi_lock(mc->lock);
 	    if (check_mc_destroy(mc))
 		return;
 	    ipmi_unlock(mc->lock);
 	}
     }
-    mc->usecount--;
+    __atomic_sub_fetch(&mc->usecount, 1, __ATOMIC_ACQ_REL);
     _ipmi_domain_mc_unlock(mc->domain);
 }
 
@@ -2763,6 +3142,36 @@ ipmi_mc_send_command_sideeff(ipmi_mc_t                  *mc,
     return rv;
 }
 
+int
+ipmi_mc_send_command_options(ipmi_mc_t                  *mc,
+			     unsigned int               lun,
+			     const ipmi_msg_t           *msg,
+			     const ipmi_con_option_t    *options,
+			     ipmi_mc_response_handler_t rsp_handler,
+			     void                       *rsp_data)
+{
+    int           rv;
+    ipmi_addr_t   addr = mc->addr;
+    ipmi_domain_t *domain;
+
+    CHECK_MC_LOCK(mc);
+
+    rv = ipmi_addr_set_lun(&addr, lun);
+    if (rv)
+	return rv;
+
+    domain = ipmi_mc_get_domain(mc);
+
+    rv = ipmi_send_command_addr_options(domain,
+					&addr, mc->addr_len,
+					msg,
+					options,
+					addr_rsp_handler,
+					rsp_data,
+					rsp_handler);
+    return rv;
+}
+
 /***********************************************************************
  *
  * Handle global OEM callbacks for new MCs.
@@ -2996,10 +3405,21 @@ sdrs_fetched_mc_cb(ipmi_mc_t *mc, void *cb_data)
 	mc->fixup_sdrs_handler(mc, info->sdrs, mc->fixup_sdrs_cb_data);
 
     if (info->changed) {
+	struct timeval start;
+	int            span;
+
+	mc_get_os_hnd(mc)->get_monotonic_time(mc_get_os_hnd(mc), &start);
+	span = _ipmi_domain_span_start(info->domain, "mc_entity_sensor", NULL,
+				       mc_span_track(mc), mc->step_span);
+	_ipmi_domain_update_batch_start(info->domain);
 	ipmi_entity_scan_sdrs(info->domain, mc,
 			      ipmi_domain_get_entities(info->domain),
 			      info->sdrs);
 	rv = ipmi_sensor_handle_sdrs(info->domain, mc, info->sdrs);
+	_ipmi_domain_update_batch_end(info->domain);
+	_ipmi_domain_span_end(info->domain, span);
+	_ipmi_domain_phase_time(info->domain, IPMI_DOMAIN_PHASE_ENTITY_SENSOR,
+				&start);
 
 	if (!rv)
 	    ipmi_detect_domain_presence_changes(info->domain, 0);
@@ -3152,7 +3572,7 @@ _ipmi_mc_get_device_id_data_from_rsp(ipmi_mc_t *mc, ipmi_msg_t *rsp)
     mc->real_devid = mc->pending_devid;
 
     /* Either copy it or mark it to be copied. */
-    if (mc->usecount == 1) {
+    if (mc_usecount(mc) == 1) {
 	mc->devid = mc->pending_devid;
 	mc->pending_devid_data = 0;
 	mc->pending_new_mc = 0;
@@ -3257,6 +3677,37 @@ _ipmi_mc_device_data_compares(ipmi_mc_t  *mc,
     return 1;
 }
 
+unsigned int
+_ipmi_mc_get_device_id_rsp(ipmi_mc_t *mc, unsigned char *rsp_data)
+{
+    ipmi_lock(mc->lock);
+    rsp_data[0] = 0;
+    rsp_data[1] = mc->real_devid.device_id;
+    rsp_data[2] = ((mc->real_devid.device_revision & 0xf)
+		   | (mc->real_devid.provides_device_sdrs << 7));
+    rsp_data[3] = ((mc->real_devid.major_fw_revision & 0x7f)
+		   | (mc->real_devid.device_available << 7));
+    rsp_data[4] = mc->real_devid.minor_fw_revision;
+    rsp_data[5] = ((mc->real_devid.major_version & 0xf)
+		   | (mc->real_devid.minor_version << 4));
+    rsp_data[6] = ((mc->real_devid.chassis_support << 7)
+		   | (mc->real_devid.bridge_support << 6)
+		   | (mc->real_devid.IPMB_event_generator_support << 5)
+		   | (mc->real_devid.IPMB_event_receiver_support << 4)
+		   | (mc->real_devid.FRU_inventory_support << 3)
+		   | (mc->real_devid.SEL_device_support << 2)
+		   | (mc->real_devid.SDR_repository_support << 1)
+		   | mc->real_devid.sensor_device_support);
+    rsp_data[7] = mc->real_devid.manufacturer_id & 0xff;
+    rsp_data[8] = (mc->real_devid.manufacturer_id >> 8) & 0xff;
+    rsp_data[9] = (mc->real_devid.manufacturer_id >> 16) & 0xff;
+    rsp_data[10] = mc->real_devid.product_id & 0xff;
+    rsp_data[11] = (mc->real_devid.product_id >> 8) & 0xff;
+    memcpy(rsp_data + 12, mc->real_devid.aux_fw_revision, 4);
+    ipmi_unlock(mc->lock);
+    return 16;
+}
+
 /***********************************************************************
  *
  * Get/set the information for an MC.
@@ -4140,7 +4591,7 @@ __ipmi_check_mc_lock(const ipmi_mc_t *mc)
     if (!DEBUG_LOCKS)
 	return;
 
-    if (mc->usecount == 0)
+    if (mc_usecount(mc) == 0)
 	ipmi_report_lock_error(ipmi_domain_get_os_hnd(mc->domain),
 			       "MC not locked when it should have been");
 	
@@ -36,6 +36,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_FRU
+
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -55,6 +57,7 @@
 #include <OpenIPMI/internal/ipmi_utils.h>
 #include <OpenIPMI/internal/ipmi_oem.h>
 #include <OpenIPMI/internal/ipmi_fru.h>
+#include <OpenIPMI/internal/ipmi_checksum.h>
 
 #define IPMI_LANG_CODE_ENGLISH	25
 
@@ -149,15 +152,87 @@ typedef struct normal_fru_rec_data_s
     int               header_changed;
 
     ipmi_fru_record_t *recs[IPMI_FRU_FTR_NUMBER];
+
+    /* Areas are decoded the first time they are used.  Until then a
+       copy of the raw FRU data is kept here, along with where each
+       area is.  The bits in undecoded are the areas still in raw. */
+    unsigned char     *raw;
+    unsigned int      raw_offset[IPMI_FRU_FTR_NUMBER];
+    unsigned int      raw_len[IPMI_FRU_FTR_NUMBER];
+    unsigned int      undecoded;
 } normal_fru_rec_data_t;
 
 static normal_fru_rec_data_t *setup_normal_fru(ipmi_fru_t    *fru,
 					       unsigned char version);
 
+/* Must be called with the FRU lock held. */
+static int
+normal_fru_decode_area(ipmi_fru_t *fru, normal_fru_rec_data_t *info, int area)
+{
+    int err;
+
+    if (!(info->undecoded & (1 << area)))
+	return 0;
+
+    err = fru_area_info[area].decode(fru,
+				     info->raw + info->raw_offset[area],
+				     info->raw_len[area],
+				     &info->recs[area]);
+    if (err == ENOMEM)
+	/* Leave it to try again later. */
+	return err;
+
+    info->undecoded &= ~(1 << area);
+    if (err)
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%snormal_fru.c(normal_fru_decode_area):"
+		 " Unable to decode FRU area %d",
+		 _ipmi_fru_get_iname(fru), area);
+    else if (info->recs[area])
+	info->recs[area]->offset = info->raw_offset[area];
+
+    if (!info->undecoded) {
+	ipmi_mem_free(info->raw);
+	info->raw = NULL;
+    }
+
+    return err;
+}
+
+/* Get one area, decoding only that area if it has not been used
+   yet.  Must be called with the FRU lock held. */
+static int
+normal_fru_get_rec(ipmi_fru_t *fru, int area, ipmi_fru_record_t **rec)
+{
+    normal_fru_rec_data_t *info = _ipmi_fru_get_rec_data(fru);
+    int                   err;
+
+    err = normal_fru_decode_area(fru, info, area);
+    *rec = info->recs[area];
+    return err;
+}
+
+/* Get the area array, but only decode the given area.  Must be
+   called with the FRU lock held. */
+static ipmi_fru_record_t **
+normal_fru_get_area_recs(ipmi_fru_t *fru, int area)
+{
+    normal_fru_rec_data_t *info = _ipmi_fru_get_rec_data(fru);
+
+    normal_fru_decode_area(fru, info, area);
+    return info->recs;
+}
+
+/* Get all the areas, decoding any that have not been used yet.  Must
+   be called with the FRU lock held. */
 static ipmi_fru_record_t **
 normal_fru_get_recs(ipmi_fru_t *fru)
 {
     normal_fru_rec_data_t *info = _ipmi_fru_get_rec_data(fru);
+    int                   i;
+
+    for (i=0; info->undecoded && (i<IPMI_FRU_FTR_NUMBER); i++)
+	normal_fru_decode_area(fru, info, i);
     return info->recs;
 }
 
@@ -170,15 +245,7 @@ normal_fru_get_recs(ipmi_fru_t *fru)
 static unsigned char
 checksum(unsigned char *data, unsigned int length)
 {
-    unsigned char sum = 0;
-
-    while (length) {
-	sum += *data;
-	data++;
-	length--;
-    }
-
-    return sum;
+    return ipmi_checksum(data, length, 0);
 }
 
 /* 820476000 is seconds between 1970.01.01 00:00:00 and 1996.01.01 00:00:00 */
@@ -688,6 +755,26 @@ fru_variable_string_type(fru_variable_t       *in,
     return 0;
 }
 
+static int
+fru_variable_string_ref(fru_variable_t       *in,
+			unsigned int         num,
+			enum ipmi_str_type_e *type,
+			const char           **str,
+			unsigned int         *length)
+{
+    if (num >= in->next)
+	return E2BIG;
+
+    if (!in->strings[num].str)
+	return ENOSYS;
+
+    if (type)
+	*type = in->strings[num].type;
+    *str = in->strings[num].str;
+    *length = in->strings[num].length;
+    return 0;
+}
+
 static void
 fru_free_variable_string(fru_variable_t *v)
 {
@@ -774,13 +861,18 @@ do {									\
 
 #define GET_DATA_PREFIX(lcname, ucname) \
     ipmi_fru_ ## lcname ## _area_t *u;				\
-    ipmi_fru_record_t              **recs;			\
     ipmi_fru_record_t              *rec;			\
+    int                            prefix_err;			\
     if (!_ipmi_fru_is_normal_fru(fru))				\
 	return ENOSYS;						\
     _ipmi_fru_lock(fru);					\
-    recs = normal_fru_get_recs(fru);				\
-    rec = recs[IPMI_FRU_FTR_## ucname ## _AREA];		\
+    prefix_err = normal_fru_get_rec(fru,			\
+				    IPMI_FRU_FTR_## ucname ## _AREA, \
+				    &rec);			\
+    if (prefix_err) {						\
+	_ipmi_fru_unlock(fru);					\
+	return prefix_err;					\
+    }								\
     if (!rec) {							\
 	_ipmi_fru_unlock(fru);					\
 	return ENOSYS;						\
@@ -826,6 +918,20 @@ ipmi_fru_get_ ## lcname ## _ ## fname(ipmi_fru_t	*fru,		\
     return rv;								\
 }									\
 int									\
+ipmi_fru_get_ ## lcname ## _ ## fname ## _ref(ipmi_fru_t	   *fru,	\
+					      enum ipmi_str_type_e *type, \
+					      const char	   **str, \
+					      unsigned int	   *strlen) \
+{									\
+    int rv;								\
+    GET_DATA_PREFIX(lcname, ucname);					\
+    rv = fru_variable_string_ref(&u->fields,				\
+				 ucname ## _ ## fname,			\
+				 type, str, strlen);			\
+    _ipmi_fru_unlock(fru);						\
+    return rv;								\
+}									\
+int									\
 ipmi_fru_set_ ## lcname ## _ ## fname(ipmi_fru_t	   *fru,	\
 				      enum ipmi_str_type_e type,	\
 				      char                 *str,	\
@@ -883,6 +989,21 @@ ipmi_fru_get_ ## lcname ## _ ## custom(ipmi_fru_t	 *fru,		\
     return rv;								\
 }									\
 int									\
+ipmi_fru_get_ ## lcname ## _ ## custom ## _ref(ipmi_fru_t	   *fru, \
+					       unsigned int	   num,	\
+					       enum ipmi_str_type_e *type, \
+					       const char	   **str, \
+					       unsigned int	   *strlen) \
+{									\
+    int rv;								\
+    GET_DATA_PREFIX(lcname, ucname);					\
+    rv = fru_variable_string_ref(&u->fields,				\
+				 ucname ## _ ## custom_start + num,	\
+				 type, str, strlen);			\
+    _ipmi_fru_unlock(fru);						\
+    return rv;								\
+}									\
+int									\
 ipmi_fru_set_ ## lcname ## _ ## custom(ipmi_fru_t	    *fru,	\
 				       unsigned int         num,	\
 				       enum ipmi_str_type_e type,	\
@@ -1834,33 +1955,28 @@ multi_record_area_free(ipmi_fru_record_t *rec)
     fru_record_free(rec);
 }
 
+/* Check the record headers and checksums of a multi-record area,
+   returning the number of records and how much of the area they
+   use. */
 static int
-fru_decode_multi_record_area(ipmi_fru_t        *fru,
-			     unsigned char     *data,
-			     unsigned int      data_len,
-			     ipmi_fru_record_t **rrec)
-{
-    ipmi_fru_record_t       *rec;
-    int                     err;
-    unsigned int            i;
-    unsigned int            num_records;
-    unsigned char           *orig_data = data;
-    unsigned int            orig_data_len = data_len;
-    ipmi_fru_multi_record_area_t *u;
-    ipmi_fru_record_elem_t  *r;
-    unsigned char           sum;
-    unsigned int            length;
-    unsigned int            start_offset = 0;
-    unsigned int            left = data_len;
+fru_scan_multi_record_area(ipmi_fru_t    *fru,
+			   unsigned char *data,
+			   unsigned int  data_len,
+			   unsigned int  *rnum_records,
+			   unsigned int  *rused_length)
+{
+    unsigned char *orig_data = data;
+    unsigned int  num_records = 0;
+    unsigned char sum;
+    unsigned int  length;
+    unsigned int  left = data_len;
 
-    /* First scan for the number of records. */
-    num_records = 0;
     for (;;) {
 	unsigned char eol;
 
 	if (left < 5) {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "%snormal_fru.c(fru_decode_multi_record_area):"
+		     "%snormal_fru.c(fru_scan_multi_record_area):"
 		     " Data not long enough for multi record",
 		     _ipmi_fru_get_iname(fru));
 	    return EBADF;
@@ -1868,7 +1984,7 @@ fru_decode_multi_record_area(ipmi_fru_t        *fru,
 
 	if (checksum(data, 5) != 0) {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "%snormal_fru.c(fru_decode_multi_record_area):"
+		     "%snormal_fru.c(fru_scan_multi_record_area):"
 		     " Header checksum for record %d failed",
 		     _ipmi_fru_get_iname(fru), num_records+1);
 	    return EBADF;
@@ -1877,7 +1993,7 @@ fru_decode_multi_record_area(ipmi_fru_t        *fru,
 	length = data[2];
 	if ((length + 5) > left) {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "%snormal_fru.c(fru_decode_multi_record_area):"
+		     "%snormal_fru.c(fru_scan_multi_record_area):"
 		     " Record went past end of data",
 		     _ipmi_fru_get_iname(fru));
 	    return EBADF;
@@ -1886,7 +2002,7 @@ fru_decode_multi_record_area(ipmi_fru_t        *fru,
 	sum = checksum(data+5, length) + data[3];
 	if (sum != 0) {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "%snormal_fru.c(fru_decode_multi_record_area):"
+		     "%snormal_fru.c(fru_scan_multi_record_area):"
 		     " Data checksum for record %d failed",
 		     _ipmi_fru_get_iname(fru), num_records+1);
 	    return EBADF;
@@ -1904,11 +2020,40 @@ fru_decode_multi_record_area(ipmi_fru_t        *fru,
 	    break;
     }
 
+    *rnum_records = num_records;
+    *rused_length = data - orig_data;
+    return 0;
+}
+
+static int
+fru_decode_multi_record_area(ipmi_fru_t        *fru,
+			     unsigned char     *data,
+			     unsigned int      data_len,
+			     ipmi_fru_record_t **rrec)
+{
+    ipmi_fru_record_t       *rec;
+    int                     err;
+    unsigned int            i;
+    unsigned int            num_records;
+    unsigned int            used_length;
+    unsigned char           *orig_data = data;
+    unsigned int            orig_data_len = data_len;
+    ipmi_fru_multi_record_area_t *u;
+    ipmi_fru_record_elem_t  *r;
+    unsigned int            length;
+    unsigned int            start_offset = 0;
+
+    /* First scan for the number of records. */
+    err = fru_scan_multi_record_area(fru, data, data_len, &num_records,
+				     &used_length);
+    if (err)
+	return err;
+
     rec = fru_record_alloc(IPMI_FRU_FTR_MULTI_RECORD_AREA, 0, data_len);
     if (!rec)
 	return ENOMEM;
 
-    rec->used_length = data - orig_data;
+    rec->used_length = used_length;
     rec->orig_used_length = rec->used_length;
 
     u = fru_record_get_data(rec);
@@ -1966,7 +2111,7 @@ ipmi_fru_get_num_multi_records(ipmi_fru_t *fru)
 	return 0;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, IPMI_FRU_FTR_MULTI_RECORD_AREA);
     if (!recs[IPMI_FRU_FTR_MULTI_RECORD_AREA]) {
 	_ipmi_fru_unlock(fru);
 	return 0;
@@ -1991,7 +2136,7 @@ validate_and_lock_multi_record(ipmi_fru_t                   *fru,
 	return ENOSYS;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, IPMI_FRU_FTR_MULTI_RECORD_AREA);
     if (!recs[IPMI_FRU_FTR_MULTI_RECORD_AREA]) {
 	_ipmi_fru_unlock(fru);
 	return ENOSYS;
@@ -2196,7 +2341,7 @@ ipmi_fru_set_multi_record(ipmi_fru_t    *fru,
 	return ENOSYS;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, IPMI_FRU_FTR_MULTI_RECORD_AREA);
     rec = recs[IPMI_FRU_FTR_MULTI_RECORD_AREA];
     if (!rec) {
 	_ipmi_fru_unlock(fru);
@@ -2321,7 +2466,7 @@ ipmi_fru_ins_multi_record(ipmi_fru_t    *fru,
 	return ENOSYS;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, IPMI_FRU_FTR_MULTI_RECORD_AREA);
     rec = recs[IPMI_FRU_FTR_MULTI_RECORD_AREA];
     if (!rec) {
 	_ipmi_fru_unlock(fru);
@@ -2791,7 +2936,7 @@ ipmi_fru_area_get_offset(ipmi_fru_t   *fru,
     if (area >= IPMI_FRU_FTR_NUMBER)
 	return EINVAL;
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, area);
     if (!recs[area]) {
 	_ipmi_fru_unlock(fru);
 	return ENOENT;
@@ -2817,7 +2962,7 @@ ipmi_fru_area_get_length(ipmi_fru_t   *fru,
 	return EINVAL;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, area);
     if (!recs[area]) {
 	_ipmi_fru_unlock(fru);
 	return ENOENT;
@@ -2845,7 +2990,7 @@ ipmi_fru_area_set_offset(ipmi_fru_t   *fru,
 	return EINVAL;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, area);
     if (!recs[area]) {
 	_ipmi_fru_unlock(fru);
 	return ENOENT;
@@ -2897,7 +3042,7 @@ ipmi_fru_area_set_length(ipmi_fru_t   *fru,
     if (length == 0)
 	return EINVAL;
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, area);
     if (!recs[area]) {
 	_ipmi_fru_unlock(fru);
 	return ENOENT;
@@ -3001,7 +3146,7 @@ ipmi_fru_area_get_used_length(ipmi_fru_t *fru,
 	return EINVAL;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, area);
     if (!recs[area]) {
 	_ipmi_fru_unlock(fru);
 	return ENOENT;
@@ -3026,6 +3171,12 @@ typedef struct fru_data_rep_s
     unsigned int              hasnum : 1;
     unsigned int              settable : 1;
 
+    /* For fields held directly in an area, where they are.  These
+       are read straight from the records for the flat field view. */
+    unsigned int              inarea : 1;
+    unsigned char             area;
+    unsigned char             field;
+
     union {
 	struct {
 	    int (*fetch_uchar)(ipmi_fru_t *fru, unsigned char *data);
@@ -3129,21 +3280,25 @@ typedef struct fru_data_rep_s
 			  .hasnum = 1, .settable = s,			     \
 		          .u = { .timenumtype = { .fetch = ipmi_fru_get_ ## x,\
 					          .set = ipmi_fru_set_ ## x }}}
-#define F_STR(x,s) { .name = #x, .type = IPMI_FRU_DATA_ASCII,		     \
+#define F_STR(l,a,x,s) { .name = #l "_" #x, .type = IPMI_FRU_DATA_ASCII,    \
 		     .hasnum = 0, .settable = s,			     \
+		     .inarea = 1, .area = IPMI_FRU_FTR_ ## a ## _AREA,	     \
+		     .field = a ## _ ## x,				     \
 		     .u = { .strtype = {				     \
-			    .fetch_len = ipmi_fru_get_ ## x ## _len,	     \
-		            .fetch_type = ipmi_fru_get_ ## x ## _type,	     \
-		            .fetch_data = ipmi_fru_get_ ## x,		     \
-			    .set = ipmi_fru_set_ ## x }}}
-#define F_NUM_STR(x,s) { .name = #x, .type = IPMI_FRU_DATA_ASCII,	     \
+			    .fetch_len = ipmi_fru_get_ ## l ## _ ## x ## _len,\
+		            .fetch_type = ipmi_fru_get_ ## l ## _ ## x ## _type,\
+		            .fetch_data = ipmi_fru_get_ ## l ## _ ## x,	     \
+			    .set = ipmi_fru_set_ ## l ## _ ## x }}}
+#define F_NUM_STR(l,a,s) { .name = #l "_custom", .type = IPMI_FRU_DATA_ASCII,\
 			 .hasnum = 1, .settable = s,			     \
+			 .inarea = 1, .area = IPMI_FRU_FTR_ ## a ## _AREA,   \
+			 .field = a ## _custom_start,			     \
 		         .u = { .strnumtype = {                              \
-			        .fetch_len = ipmi_fru_get_ ## x ## _len,     \
-		                .fetch_type = ipmi_fru_get_ ## x ## _type,   \
-		                .fetch_data = ipmi_fru_get_ ## x,            \
-			        .set = ipmi_fru_set_ ## x,		     \
-				.ins = ipmi_fru_ins_ ## x }}}
+			        .fetch_len = ipmi_fru_get_ ## l ## _custom_len,\
+		                .fetch_type = ipmi_fru_get_ ## l ## _custom_type,\
+		                .fetch_data = ipmi_fru_get_ ## l ## _custom, \
+			        .set = ipmi_fru_set_ ## l ## _custom,	     \
+				.ins = ipmi_fru_ins_ ## l ## _custom }}}
 #define F_BIN(x,s) { .name = #x, .type = IPMI_FRU_DATA_BINARY,		     \
 		     .hasnum = 0, .settable = s,			     \
 		     .u = { .bintype = {				     \
@@ -3160,31 +3315,36 @@ typedef struct fru_data_rep_s
 static fru_data_rep_t frul[] =
 {
     F_UCHAR(internal_use_version, 0),
-    F_BIN(internal_use, 1),
+    { .name = "internal_use", .type = IPMI_FRU_DATA_BINARY,
+      .hasnum = 0, .settable = 1,
+      .inarea = 1, .area = IPMI_FRU_FTR_INTERNAL_USE_AREA,
+      .u = { .bintype = { .fetch_len = ipmi_fru_get_internal_use_len,
+			  .fetch_data = ipmi_fru_get_internal_use,
+			  .set = ipmi_fru_set_internal_use }}},
     F_UCHAR(chassis_info_version, 0),
     F_UCHAR(chassis_info_type, 1),
-    F_STR(chassis_info_part_number, 1),
-    F_STR(chassis_info_serial_number, 1),
-    F_NUM_STR(chassis_info_custom, 1),
+    F_STR(chassis_info, CHASSIS_INFO, part_number, 1),
+    F_STR(chassis_info, CHASSIS_INFO, serial_number, 1),
+    F_NUM_STR(chassis_info, CHASSIS_INFO, 1),
     F_UCHAR(board_info_version, 0),
     F_UCHAR(board_info_lang_code, 1),
     F_TIME(board_info_mfg_time, 1),
-    F_STR(board_info_board_manufacturer, 1),
-    F_STR(board_info_board_product_name, 1),
-    F_STR(board_info_board_serial_number, 1),
-    F_STR(board_info_board_part_number, 1),
-    F_STR(board_info_fru_file_id, 1),
-    F_NUM_STR(board_info_custom, 1),
+    F_STR(board_info, BOARD_INFO, board_manufacturer, 1),
+    F_STR(board_info, BOARD_INFO, board_product_name, 1),
+    F_STR(board_info, BOARD_INFO, board_serial_number, 1),
+    F_STR(board_info, BOARD_INFO, board_part_number, 1),
+    F_STR(board_info, BOARD_INFO, fru_file_id, 1),
+    F_NUM_STR(board_info, BOARD_INFO, 1),
     F_UCHAR(product_info_version, 0),
     F_UCHAR(product_info_lang_code, 1),
-    F_STR(product_info_manufacturer_name, 1),
-    F_STR(product_info_product_name, 1),
-    F_STR(product_info_product_part_model_number, 1),
-    F_STR(product_info_product_version, 1),
-    F_STR(product_info_product_serial_number, 1),
-    F_STR(product_info_asset_tag, 1),
-    F_STR(product_info_fru_file_id, 1),
-    F_NUM_STR(product_info_custom, 1),
+    F_STR(product_info, PRODUCT_INFO, manufacturer_name, 1),
+    F_STR(product_info, PRODUCT_INFO, product_name, 1),
+    F_STR(product_info, PRODUCT_INFO, product_part_model_number, 1),
+    F_STR(product_info, PRODUCT_INFO, product_version, 1),
+    F_STR(product_info, PRODUCT_INFO, product_serial_number, 1),
+    F_STR(product_info, PRODUCT_INFO, asset_tag, 1),
+    F_STR(product_info, PRODUCT_INFO, fru_file_id, 1),
+    F_NUM_STR(product_info, PRODUCT_INFO, 1),
     F_INT(fru_length, 0),
     { .name = "internal_use_offset", .type = IPMI_FRU_DATA_INT,
       .hasnum = 0, .settable = 1,
@@ -3398,6 +3558,116 @@ ipmi_fru_get(ipmi_fru_t                *fru,
     return 0;
 }
 
+/*
+ * Fill in a field of the flat view from the decoded records.  The FRU
+ * lock must be held, string and binary data point into the records.
+ * Returns ENOSYS if the field is not present and E2BIG if num is past
+ * the end of an array, like ipmi_fru_get().
+ */
+static int
+fru_flat_get(ipmi_fru_t       *fru,
+	     unsigned int     index,
+	     int              num,
+	     ipmi_fru_field_t *f)
+{
+    fru_data_rep_t               *p = frul + index;
+    ipmi_fru_record_t            *rec;
+    ipmi_fru_internal_use_area_t *iu;
+    fru_variable_t               *v;
+    enum ipmi_str_type_e         stype;
+    unsigned int                 field;
+    unsigned char                ucval;
+    int                          rv;
+
+    memset(f, 0, sizeof(*f));
+    f->name = p->name;
+    f->index = index;
+    f->num = p->hasnum ? num : -1;
+    f->dtype = p->type;
+
+    if (!p->inarea) {
+	/* Header and fixed values, fetching these does not allocate. */
+	switch (p->type) {
+	case IPMI_FRU_DATA_INT:
+	    if (p->u.inttype.fetch_uchar) {
+		rv = p->u.inttype.fetch_uchar(fru, &ucval);
+		f->intval = ucval;
+	    } else
+		rv = p->u.inttype.fetch_int(fru, &f->intval);
+	    return rv;
+
+	case IPMI_FRU_DATA_TIME:
+	    return p->u.timetype.fetch(fru, &f->time);
+
+	default:
+	    return ENOSYS;
+	}
+    }
+
+    rv = normal_fru_get_rec(fru, p->area, &rec);
+    if (rv)
+	return rv;
+    if (!rec)
+	return ENOSYS;
+
+    if (p->area == IPMI_FRU_FTR_INTERNAL_USE_AREA) {
+	iu = fru_record_get_data(rec);
+	f->data = (char *) iu->data;
+	f->data_len = iu->length;
+	f->offset = rec->offset + 1; /* Skip the version. */
+	f->raw_len = iu->length;
+	return 0;
+    }
+
+    v = rec->handlers->get_fields(rec);
+    field = p->field;
+    if (p->hasnum)
+	field += num;
+    rv = fru_variable_string_ref(v, field, &stype, &f->data, &f->data_len);
+    if (rv)
+	return rv;
+
+    switch (stype) {
+    case IPMI_UNICODE_STR: f->dtype = IPMI_FRU_DATA_UNICODE; break;
+    case IPMI_BINARY_STR: f->dtype = IPMI_FRU_DATA_BINARY; break;
+    case IPMI_ASCII_STR: break;
+    }
+    f->offset = rec->offset + v->strings[field].offset;
+    f->raw_len = v->strings[field].raw_len;
+    return 0;
+}
+
+int
+ipmi_fru_iterate_fields(ipmi_fru_t        *fru,
+			ipmi_fru_field_cb handler,
+			void              *cb_data)
+{
+    ipmi_fru_field_t field;
+    unsigned int     i;
+    int              num;
+    int              rv = 0;
+
+    if (!_ipmi_fru_is_normal_fru(fru))
+	return ENOSYS;
+
+    _ipmi_fru_lock(fru);
+    for (i=0; i<NUM_FRUL_ENTRIES; i++) {
+	for (num=0; ; num++) {
+	    /* Missing fields and the ends of arrays are just skipped. */
+	    if (fru_flat_get(fru, i, num, &field))
+		break;
+	    rv = handler(fru, &field, cb_data);
+	    if (rv)
+		goto out;
+	    if (!frul[i].hasnum)
+		break;
+	}
+    }
+ out:
+    _ipmi_fru_unlock(fru);
+    return rv;
+}
+
 int
 ipmi_fru_set_int_val(ipmi_fru_t *fru,
 		     int        index,
@@ -3955,49 +4225,31 @@ fru_node_get_field(ipmi_fru_node_t           *pnode,
     ipmi_fru_t                   *fru = _ipmi_fru_node_get_data(pnode);
     ipmi_fru_node_t              *node;
     int                          rv;
-    int                          num;
     int                          len;
 
     if ((index >= 0) && (index < NUM_FRUL_ENTRIES)) {
-	num = 0;
-	rv = ipmi_fru_get(fru, index, name, &num, NULL, NULL, NULL, NULL,
-			  NULL);
-	if (rv)
-	    return rv;
-
-	if (num != 0) {
-	    fru_array_t               *info;
-	    enum ipmi_fru_data_type_e ldtype;
-	    int                       num2 = 0;
-
-	    /* Determine if the value exists or if the array is empty. */
-	    num2 = 0;
-	    rv = ipmi_fru_get(fru, index, name, &num2, &ldtype, NULL, NULL,
-			      NULL, NULL);
-	    if (rv) {
-		if (rv != E2BIG)
-		    /* No support for this field. */
-		    return rv;
-		else if (rv == E2BIG)
-		    len = 0;
+	if (frul[index].hasnum) {
+	    fru_array_t      *info;
+	    ipmi_fru_field_t field;
+
+	    /* Use the flat view to find the array length, an empty array
+	       is fine but a missing area means no support. */
+	    _ipmi_fru_lock(fru);
+	    rv = fru_flat_get(fru, index, 0, &field);
+	    if (rv && (rv != E2BIG)) {
+		_ipmi_fru_unlock(fru);
+		return rv;
 	    }
-	    else
-		len = 1;
+	    for (len=0; !rv; len++)
+		rv = fru_flat_get(fru, index, len + 1, &field);
+	    _ipmi_fru_unlock(fru);
 
-	    /* name is set by the previous call */
+	    if (name)
+		*name = frul[index].name;
 	    if (dtype)
 		*dtype = IPMI_FRU_DATA_SUB_NODE;
-	    if (intval) {
-		/* Get the length of the array by searching. */
-		while (num != -1) {
-		    len++;
-		    rv = ipmi_fru_get(fru, index, NULL, &num, NULL, NULL,
-				      NULL, NULL, NULL);
-		    if (rv)
-			return rv;
-		}
+	    if (intval)
 		*intval = len;
-	    }
 	    if (sub_node) {
 		node = _ipmi_fru_node_alloc(fru);
 		if (!node)
@@ -4027,7 +4279,8 @@ fru_node_get_field(ipmi_fru_node_t           *pnode,
     } else if (index == NUM_FRUL_ENTRIES) {
 	/* Handle multi-records. */
 	_ipmi_fru_lock(fru);
-	recs = normal_fru_get_recs(fru);
+	recs = normal_fru_get_area_recs(fru,
+					IPMI_FRU_FTR_MULTI_RECORD_AREA);
 	if (!recs[IPMI_FRU_FTR_MULTI_RECORD_AREA]) {
 	    _ipmi_fru_unlock(fru);
 	    return ENOSYS;
@@ -4185,6 +4438,8 @@ fru_cleanup_recs(ipmi_fru_t *fru)
     for (i=0; i<IPMI_FRU_FTR_NUMBER; i++)
 	fru_record_destroy(info->recs[i]);
 
+    if (info->raw)
+	ipmi_mem_free(info->raw);
     ipmi_mem_free(info);
 }
 
@@ -4412,7 +4667,7 @@ ipmi_fru_multi_record_get_root_node(ipmi_fru_t      *fru,
 	return ENOSYS;
 
     _ipmi_fru_lock(fru);
-    recs = normal_fru_get_recs(fru);
+    recs = normal_fru_get_area_recs(fru, IPMI_FRU_FTR_MULTI_RECORD_AREA);
     if (!recs[IPMI_FRU_FTR_MULTI_RECORD_AREA]) {
 	_ipmi_fru_unlock(fru);
 	return ENOSYS;
@@ -4748,11 +5003,51 @@ setup_normal_fru(ipmi_fru_t *fru, unsigned char version)
     return info;
 }
 
+/* The cheap checks of an area done when the FRU is fetched, the
+   rest of the decoding is done when the area is first used. */
+static int
+fru_check_area(ipmi_fru_t    *fru,
+	       int           area,
+	       unsigned char *data,
+	       unsigned int  data_len)
+{
+    unsigned int length;
+    unsigned int num_records;
+
+    switch (area) {
+    case IPMI_FRU_FTR_CHASSIS_INFO_AREA:
+    case IPMI_FRU_FTR_BOARD_INFO_AREA:
+    case IPMI_FRU_FTR_PRODUCT_INFO_AREA:
+	length = data[1] * 8;
+	if ((length == 0) || (length > data_len)) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%snormal_fru.c(fru_check_area):"
+		     " FRU string goes past data length",
+		     _ipmi_fru_get_iname(fru));
+	    return EBADF;
+	}
+	if (checksum(data, length) != 0) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%snormal_fru.c(fru_check_area):"
+		     " FRU string checksum failed",
+		     _ipmi_fru_get_iname(fru));
+	    return EBADF;
+	}
+	return 0;
+
+    case IPMI_FRU_FTR_MULTI_RECORD_AREA:
+	return fru_scan_multi_record_area(fru, data, data_len, &num_records,
+					  &length);
+
+    default:
+	return 0;
+    }
+}
+
 static int
 process_fru_info(ipmi_fru_t *fru)
 {
     normal_fru_rec_data_t *info;
-    ipmi_fru_record_t **recs;
     unsigned char     *data = _ipmi_fru_get_data_ptr(fru);
     unsigned int      data_len = _ipmi_fru_get_data_len(fru);
     fru_offset_t      foff[IPMI_FRU_FTR_NUMBER];
@@ -4813,7 +5108,14 @@ process_fru_info(ipmi_fru_t *fru)
     if (!info)
 	return ENOMEM;
 
-    recs = info->recs;
+    /* Keep the raw data, the FRU code frees its copy after this. */
+    info->raw = ipmi_mem_alloc(data_len);
+    if (!info->raw) {
+	err = ENOMEM;
+	goto out_err;
+    }
+    memcpy(info->raw, data, data_len);
+
     for (i=0; i<IPMI_FRU_FTR_NUMBER; i++) {
 	int plen, next_off, offset;
 
@@ -4832,12 +5134,18 @@ process_fru_info(ipmi_fru_t *fru)
 	    next_off = foff[j].offset;
 	plen = next_off - offset;
 
-	err = fru_area_info[i].decode(fru, data+offset, plen, &recs[i]);
+	err = fru_check_area(fru, i, data+offset, plen);
 	if (err)
 	    goto out_err;
 
-	if (recs[i])
-	    recs[i]->offset = offset;
+	info->raw_offset[i] = offset;
+	info->raw_len[i] = plen;
+	info->undecoded |= 1 << i;
+    }
+
+    if (!info->undecoded) {
+	ipmi_mem_free(info->raw);
+	info->raw = NULL;
     }
 
     return 0;
@@ -107,12 +107,19 @@ typedef struct atca_fru_s atca_fru_t;
 typedef struct atca_led_s
 {
     int            destroyed;
-    int            op_in_progress;
+    int            op_in_progress; /* Count of outstanding messages. */
+    int            cap_err;
 
     unsigned int   fru_id;
     unsigned int   num;
     unsigned int   colors; /* A bitmask, in OpenIPMI numbers. */
+    unsigned char  color_caps; /* The ATCA color capability bits. */
     int            local_control;
+
+    /* The last LED state response from the shelf audit. */
+    unsigned char  state[9];
+    unsigned int   state_len;
+    struct timeval state_time;
     atca_fru_t     *fru;
     ipmi_control_t *control;
 } atca_led_t;
@@ -128,6 +135,8 @@ struct atca_fru_s
     ipmi_sensor_id_t          hs_sensor_id;
     unsigned char             hs_sensor_lun;
     unsigned char             hs_sensor_num;
+    struct timeval            hs_state_time; /* When hs_state was read */
+    int                       audit_pending;
     ipmi_control_t            *cold_reset;
     ipmi_control_t            *warm_reset;
     ipmi_control_t            *graceful_reboot;
@@ -136,6 +145,30 @@ struct atca_fru_s
     unsigned int              fru_capabilities;
 };
 
+/*
+ * Capability information fetched from an IPMC that is kept across
+ * the MC going away and coming back, so a reconnect or a re-scan of
+ * the shelf does not have to query it all again.  It is thrown away
+ * if the MC comes back with a different identity.
+ */
+typedef struct atca_led_cache_s
+{
+    unsigned char valid;
+    unsigned char local_control;
+    unsigned char color_caps;
+} atca_led_cache_t;
+
+typedef struct atca_fru_cache_s
+{
+    unsigned int     leds_valid : 1;
+    unsigned int     fru_capabilities_valid : 1;
+    unsigned char    led_props; /* The standard LEDs supported. */
+    unsigned char    num_aux_leds;
+    unsigned char    fru_capabilities;
+    unsigned int     num_leds;
+    atca_led_cache_t *leds;
+} atca_fru_cache_t;
+
 struct atca_ipmc_s
 {
     atca_shelf_t  *shelf;
@@ -155,6 +188,18 @@ struct atca_ipmc_s
 
     /* Control for reading the address info */
     ipmi_control_t *address_control;
+
+    /* The cached capability info and the identity of the MC it came
+       from. */
+    int              cache_valid;
+    unsigned int     cache_mfg_id;
+    unsigned int     cache_prod_id;
+    unsigned char    cache_dev_rev;
+    unsigned char    cache_fw_major;
+    unsigned char    cache_fw_minor;
+    unsigned int     cache_num_frus; /* 0 if not known */
+    unsigned int     num_fru_cache;
+    atca_fru_cache_t *fru_cache;
 };
 
 struct atca_shelf_s
@@ -197,6 +242,9 @@ struct atca_shelf_s
     /* This is used to allocate address control number sequentially. */
     unsigned int next_address_control_num;
 
+    /* When the last shelf-wide hot-swap and LED state audit started. */
+    struct timeval audit_time;
+
     /* Hacks for broken implementations. */
 
     /* The shelf address is not on the advertised shelf address
@@ -385,6 +433,107 @@ atca_find_minfo_from_mc(ipmi_mc_t *mc, atca_shelf_t *info)
     return atca_find_minfo_from_ipmb(ipmi_mc_get_address(mc), info);
 }
 
+/*
+ * Hot-swap and LED states read by the shelf audit (or reported by an
+ * event) are handed out without asking the IPMC again for this many
+ * seconds.
+ */
+#define ATCA_STATE_CACHE_TIME 5
+
+static void
+atca_stamp(atca_shelf_t *info, struct timeval *t)
+{
+    os_handler_t *os_hnd = ipmi_domain_get_os_hnd(info->domain);
+
+    os_hnd->get_monotonic_time(os_hnd, t);
+}
+
+static int
+atca_is_fresh(atca_shelf_t *info, struct timeval *t)
+{
+    struct timeval now;
+
+    if (!t->tv_sec && !t->tv_usec)
+	return 0;
+    atca_stamp(info, &now);
+    return ((now.tv_sec < t->tv_sec + ATCA_STATE_CACHE_TIME)
+	    || ((now.tv_sec == t->tv_sec + ATCA_STATE_CACHE_TIME)
+		&& (now.tv_usec < t->tv_usec)));
+}
+
+static void
+atca_flush_cache(atca_ipmc_t *minfo)
+{
+    unsigned int i;
+
+    if (minfo->fru_cache) {
+	for (i=0; i<minfo->num_fru_cache; i++) {
+	    if (minfo->fru_cache[i].leds)
+		ipmi_mem_free(minfo->fru_cache[i].leds);
+	}
+	ipmi_mem_free(minfo->fru_cache);
+	minfo->fru_cache = NULL;
+    }
+    minfo->num_fru_cache = 0;
+    minfo->cache_num_frus = 0;
+    minfo->cache_valid = 0;
+}
+
+/* Throw away the cached info if it came from a different MC. */
+static void
+atca_check_cache(atca_ipmc_t *minfo, ipmi_mc_t *mc)
+{
+    if (minfo->cache_valid
+	&& (minfo->cache_mfg_id == (unsigned int) ipmi_mc_manufacturer_id(mc))
+	&& (minfo->cache_prod_id == (unsigned int) ipmi_mc_product_id(mc))
+	&& (minfo->cache_dev_rev == ipmi_mc_device_revision(mc))
+	&& (minfo->cache_fw_major == ipmi_mc_major_fw_revision(mc))
+	&& (minfo->cache_fw_minor == ipmi_mc_minor_fw_revision(mc)))
+	return;
+
+    atca_flush_cache(minfo);
+    minfo->cache_mfg_id = ipmi_mc_manufacturer_id(mc);
+    minfo->cache_prod_id = ipmi_mc_product_id(mc);
+    minfo->cache_dev_rev = ipmi_mc_device_revision(mc);
+    minfo->cache_fw_major = ipmi_mc_major_fw_revision(mc);
+    minfo->cache_fw_minor = ipmi_mc_minor_fw_revision(mc);
+    minfo->cache_valid = 1;
+}
+
+/*
+ * Find the cache entry for a FRU.  If create is set, the entry is
+ * allocated if it does not exist.  Returns NULL if there is no entry
+ * or it could not be allocated; the cache is only an optimization, so
+ * callers just go on without it.
+ */
+static atca_fru_cache_t *
+atca_fru_cache(atca_ipmc_t *minfo, unsigned int fru_id, int create)
+{
+    atca_fru_cache_t *new_cache;
+
+    if (!minfo->cache_valid)
+	return NULL;
+
+    if (fru_id < minfo->num_fru_cache)
+	return &(minfo->fru_cache[fru_id]);
+
+    if (!create)
+	return NULL;
+
+    new_cache = ipmi_mem_alloc(sizeof(atca_fru_cache_t) * (fru_id + 1));
+    if (!new_cache)
+	return NULL;
+    memset(new_cache, 0, sizeof(atca_fru_cache_t) * (fru_id + 1));
+    if (minfo->fru_cache) {
+	memcpy(new_cache, minfo->fru_cache,
+	       sizeof(atca_fru_cache_t) * minfo->num_fru_cache);
+	ipmi_mem_free(minfo->fru_cache);
+    }
+    minfo->fru_cache = new_cache;
+    minfo->num_fru_cache = fru_id + 1;
+    return &(minfo->fru_cache[fru_id]);
+}
+
 
 /***********************************************************************
  *
@@ -462,6 +611,7 @@ atca_get_hot_swap_state_done(ipmi_sensor_t *sensor,
 	goto out;
     }
 
+    atca_stamp(finfo->minfo->shelf, &finfo->hs_state_time);
     if (hs_info->handler1)
 	hs_info->handler1(finfo->entity, 0, atca_hs_to_openipmi[i],
 			  hs_info->cb_data);
@@ -491,9 +641,12 @@ atca_get_hot_swap_state_start(ipmi_entity_t *entity, int err, void *cb_data)
 	return;
     }
 
-    if (ipmi_sensor_id_is_invalid(&finfo->hs_sensor_id)) {
-	/* The sensor is not present, so the device is not present.
-	   Just return our current state. */
+    if (ipmi_sensor_id_is_invalid(&finfo->hs_sensor_id)
+	|| atca_is_fresh(finfo->minfo->shelf, &finfo->hs_state_time))
+    {
+	/* The sensor is not present, so the device is not present, or
+	   we have read the state recently.  Just return our current
+	   state. */
 	if (hs_info->handler1)
 	    hs_info->handler1(entity, 0, finfo->hs_state, hs_info->cb_data);
 	ipmi_entity_opq_done(entity);
@@ -838,9 +991,22 @@ hot_swap_checker(ipmi_entity_t             *entity,
     }
 }
 
+static void atca_audit_shelf(atca_shelf_t *info);
+
 static int
 atca_check_hot_swap_state(ipmi_entity_t *entity)
 {
+    atca_fru_t *finfo = ipmi_entity_get_oem_info(entity);
+    atca_shelf_t *info = finfo->minfo->shelf;
+
+    /* Checks tend to come for every entity at once, so check the
+       whole shelf in one pass and let that cover all of them. */
+    if (!atca_is_fresh(info, &info->audit_time))
+	atca_audit_shelf(info);
+    if (finfo->audit_pending || atca_is_fresh(info, &finfo->hs_state_time))
+	return 0;
+
+    /* Not covered by the shelf audit, check it by itself. */
     return atca_get_hot_swap_state(entity, hot_swap_checker, NULL);
 }
 
@@ -904,6 +1070,7 @@ fetched_hot_swap_state(ipmi_sensor_t *sensor,
     /* The OpenIPMI hot-swap states map directly to the ATCA ones. */
     old_state = finfo->hs_state;
     finfo->hs_state = i;
+    atca_stamp(finfo->minfo->shelf, &finfo->hs_state_time);
     handled = IPMI_EVENT_NOT_HANDLED;
     ipmi_entity_call_hot_swap_handlers(ipmi_sensor_get_entity(sensor),
 				       old_state,
@@ -954,6 +1121,7 @@ hot_swap_state_changed(ipmi_sensor_t         *sensor,
     /* The OpenIPMI hot-swap states map directly to the ATCA ones. */
     old_state = finfo->hs_state;
     finfo->hs_state = offset;
+    atca_stamp(finfo->minfo->shelf, &finfo->hs_state_time);
     ipmi_entity_call_hot_swap_handlers(entity,
 				       old_state,
 				       finfo->hs_state,
@@ -1137,6 +1305,9 @@ set_led(ipmi_control_t       *control,
     if (local_control && !l->local_control)
 	return ENOSYS;
 
+    /* Whatever the audit read is about to be wrong. */
+    memset(&l->state_time, 0, sizeof(l->state_time));
+
     if (color == IPMI_CONTROL_COLOR_BLACK) {
 	on_time = 0;
 	off_time = 1;
@@ -1320,7 +1491,9 @@ static void
 led_get_start(ipmi_control_t *control, int err, void *cb_data)
 {
     atca_control_info_t *info = cb_data;
+    atca_led_t          *l = ipmi_control_get_oem_info(control);
     int                 rv;
+    ipmi_msg_t          rsp;
 
     if (err) {
 	if (info->get_handler)
@@ -1331,6 +1504,16 @@ led_get_start(ipmi_control_t *control, int err, void *cb_data)
 	return;
     }
 
+    if (atca_is_fresh(l->fru->minfo->shelf, &l->state_time)) {
+	/* The shelf audit read this recently, use that. */
+	rsp.netfn = IPMI_GROUP_EXTENSION_NETFN | 1;
+	rsp.cmd = IPMI_PICMG_CMD_GET_FRU_LED_STATE;
+	rsp.data = l->state;
+	rsp.data_len = l->state_len;
+	led_get_done(control, 0, &rsp, info);
+	return;
+    }
+
     rv = ipmi_control_send_command(control, ipmi_control_get_mc(control), 0,
 				   &info->msg, led_get_done,
 				   &(info->sdata), info);
@@ -1393,34 +1576,17 @@ atca_led_control_oem_cleanup(ipmi_control_t *control,
 	l->control = NULL;
 }
 
+/* Create the control for an LED once we know its capabilities. */
 static void
-fru_led_cap_rsp(ipmi_mc_t  *mc,
-		ipmi_msg_t *msg,
-		void       *rsp_data)
+atca_led_add_control(ipmi_mc_t *mc, atca_led_t *l)
 {
     ipmi_domain_t *domain;
-    atca_led_t    *l = rsp_data;
-    atca_fru_t    *finfo;
+    atca_fru_t    *finfo = l->fru;
     unsigned int  num = l->num;
     char          name[10];
     int           rv;
     int           i;
 
-    if (l->destroyed) {
-	/* The entity or MC was destroyed while the message was in
-	   progress, so the memory was not freed (because this
-	   function needed it).  The control didn't yet exist, so just
-	   free the memory. */
-	ipmi_mem_free(l);
-	goto out;
-    }
-    l->op_in_progress = 0;
-
-    if (check_for_msg_err(mc, NULL, msg, 5, "fru_led_cap_rsp"))
-	goto out;
-
-    finfo = l->fru;
-
     domain = ipmi_mc_get_domain(mc);
     _ipmi_domain_entity_lock(domain);
     if (!finfo->entity)
@@ -1430,10 +1596,10 @@ fru_led_cap_rsp(ipmi_mc_t  *mc,
     _ipmi_domain_entity_unlock(domain);
     if (rv) {
 	ipmi_log(IPMI_LOG_SEVERE,
-		 "%soem_atca.c(fru_led_cap_rsp): "
+		 "%soem_atca.c(atca_led_add_control): "
 		 "Could not get entity: 0x%x",
 		 MC_NAME(mc), rv);
-	goto out;
+	return;
     }
 
     if (num == 0)
@@ -1453,14 +1619,14 @@ fru_led_cap_rsp(ipmi_mc_t  *mc,
 			    &l->control);
     if (rv) {
 	ipmi_log(IPMI_LOG_SEVERE,
-		 "%soem_atca.c(fru_led_cap_rsp): "
+		 "%soem_atca.c(atca_led_add_control): "
 		 "Could not create LED control: 0x%x",
 		 MC_NAME(mc), rv);
 	_ipmi_entity_put(finfo->entity);
-	goto out;
+	return;
     }
     for (i=1; i<=6; i++) {
-	if (msg->data[2] & (1 << i))
+	if (l->color_caps & (1 << i))
 	    ipmi_control_add_light_color_support(l->control, 0,
 						 atca_to_openipmi_color[i]);
     }
@@ -1476,74 +1642,110 @@ fru_led_cap_rsp(ipmi_mc_t  *mc,
     _ipmi_entity_put(finfo->entity);
     if (rv) {
 	ipmi_log(IPMI_LOG_SEVERE,
-		 "%soem_atca.c(fru_led_cap_rsp): "
+		 "%soem_atca.c(atca_led_add_control): "
 		 "Could not add LED control: 0x%x",
 		 MC_NAME(mc), rv);
-	goto out;
     }
- out:
-    return;
 }
 
+/*
+ * Called when one of the LED capability messages comes back.  Once
+ * both are in, the control can be created.
+ */
 static void
-get_led_capability_2(ipmi_mc_t  *mc,
-		     ipmi_msg_t *rsp,
-		     void       *rsp_data)
+led_cap_msg_done(ipmi_mc_t *mc, atca_led_t *l)
 {
-    ipmi_msg_t    msg;
-    unsigned char data[3];
-    int           rv;
-    atca_led_t    *linfo = rsp_data;
+    atca_fru_cache_t *fc;
+
+    if (l->op_in_progress || l->cap_err)
+	return;
+
+    fc = atca_fru_cache(l->fru->minfo, l->fru->fru_id, 0);
+    if (fc && fc->leds_valid && (l->num < fc->num_leds)) {
+	fc->leds[l->num].local_control = l->local_control;
+	fc->leds[l->num].color_caps = l->color_caps;
+	fc->leds[l->num].valid = 1;
+    }
+
+    atca_led_add_control(mc, l);
+}
 
-    if (linfo->destroyed) {
+static void
+led_state_rsp(ipmi_mc_t  *mc,
+	      ipmi_msg_t *rsp,
+	      void       *rsp_data)
+{
+    atca_led_t *l = rsp_data;
+
+    l->op_in_progress--;
+    if (l->destroyed) {
 	/* The entity or MC was destroyed while the message was in
 	   progress, so the memory was not freed (because this
 	   function needed it).  The control didn't yet exist, so just
-	   free the memory. */
-	ipmi_mem_free(linfo);
+	   free the memory once the last message is back. */
+	if (!l->op_in_progress)
+	    ipmi_mem_free(l);
 	return;
     }
 
-    if (check_for_msg_err(mc, NULL, rsp, 3, "get_led_capability_2")) {
-	linfo->op_in_progress = 0;
+    if (check_for_msg_err(mc, NULL, rsp, 3, "led_state_rsp"))
+	l->cap_err = 1;
+    else
+	l->local_control = rsp->data[2] & 1;
+
+    led_cap_msg_done(mc, l);
+}
+
+static void
+led_color_cap_rsp(ipmi_mc_t  *mc,
+		  ipmi_msg_t *rsp,
+		  void       *rsp_data)
+{
+    atca_led_t *l = rsp_data;
+
+    l->op_in_progress--;
+    if (l->destroyed) {
+	/* See led_state_rsp(). */
+	if (!l->op_in_progress)
+	    ipmi_mem_free(l);
 	return;
     }
 
-    linfo->local_control = rsp->data[2] & 1;
+    if (check_for_msg_err(mc, NULL, rsp, 5, "led_color_cap_rsp"))
+	l->cap_err = 1;
+    else
+	l->color_caps = rsp->data[2];
 
-    msg.netfn = IPMI_GROUP_EXTENSION_NETFN;
-    msg.cmd = IPMI_PICMG_CMD_GET_LED_COLOR_CAPABILITIES;
-    msg.data = data;
-    msg.data_len = 3;
-    data[0] = IPMI_PICMG_GRP_EXT;
-    data[1] = linfo->fru->fru_id;
-    data[2] = linfo->num;
-    linfo->op_in_progress = 1;
-    rv = ipmi_mc_send_command(mc, 0, &msg, fru_led_cap_rsp, linfo);
-    if (rv) {
-	ipmi_log(IPMI_LOG_SEVERE,
-		 "%soem_atca.c(get_led_capabilities_2): "
-		 "Could not send FRU LED color capablity command: 0x%x",
-		 MC_NAME(mc), rv);
-	linfo->op_in_progress = 0;
-	/* Just go on, don't shut down the info. */
-    }
+    led_cap_msg_done(mc, l);
 }
 
 static void
 get_led_capability(ipmi_mc_t *mc, atca_fru_t *finfo, unsigned int num)
 {
-    ipmi_msg_t    msg;
-    unsigned char data[3];
-    int           rv;
-    atca_led_t    *linfo = finfo->leds[num];
+    ipmi_msg_t       msg;
+    unsigned char    data[3];
+    int              rv;
+    atca_led_t       *linfo = finfo->leds[num];
+    atca_fru_cache_t *fc;
 
     linfo->num = num;
     linfo->fru = finfo;
 
-    /* First we get the LED state because that is where we know if the
-       LED supports local control.  Too bad it is not in the
-       capabilities. */
+    fc = atca_fru_cache(finfo->minfo, finfo->fru_id, 0);
+    if (fc && fc->leds_valid && (num < fc->num_leds) && fc->leds[num].valid) {
+	linfo->local_control = fc->leds[num].local_control;
+	linfo->color_caps = fc->leds[num].color_caps;
+	atca_led_add_control(mc, linfo);
+	return;
+    }
+
+    /* We get the LED state because that is where we know if the LED
+       supports local control.  Too bad it is not in the
+       capabilities.  The two don't depend on each other, so send
+       them both at once. */
+    linfo->cap_err = 0;
+    linfo->op_in_progress = 2;
+
     msg.netfn = IPMI_GROUP_EXTENSION_NETFN;
     msg.cmd = IPMI_PICMG_CMD_GET_FRU_LED_STATE;
     msg.data = data;
@@ -1551,30 +1753,39 @@ get_led_capability(ipmi_mc_t *mc, atca_fru_t *finfo, unsigned int num)
     data[0] = IPMI_PICMG_GRP_EXT;
     data[1] = linfo->fru->fru_id;
     data[2] = linfo->num;
-    linfo->op_in_progress = 1;
-    rv = ipmi_mc_send_command(mc, 0, &msg, get_led_capability_2, linfo);
+    rv = ipmi_mc_send_command(mc, 0, &msg, led_state_rsp, linfo);
     if (rv) {
 	ipmi_log(IPMI_LOG_SEVERE,
 		 "%soem_atca.c(get_led_capability): "
 		 "Could not send FRU LED state command: 0x%x",
 		 MC_NAME(mc), rv);
-	linfo->op_in_progress = 0;
+	linfo->cap_err = 1;
+	linfo->op_in_progress--;
+	/* Just go on, don't shut down the info. */
+    }
+
+    msg.cmd = IPMI_PICMG_CMD_GET_LED_COLOR_CAPABILITIES;
+    rv = ipmi_mc_send_command(mc, 0, &msg, led_color_cap_rsp, linfo);
+    if (rv) {
+	ipmi_log(IPMI_LOG_SEVERE,
+		 "%soem_atca.c(get_led_capability): "
+		 "Could not send FRU LED color capablity command: 0x%x",
+		 MC_NAME(mc), rv);
+	linfo->cap_err = 1;
+	linfo->op_in_progress--;
 	/* Just go on, don't shut down the info. */
     }
 }
 
 static void
-fru_led_prop_rsp(ipmi_mc_t  *mc,
-		 ipmi_msg_t *rsp,
-		 void       *rsp_data)
+setup_fru_leds(ipmi_mc_t    *mc,
+	       atca_fru_t   *finfo,
+	       unsigned int led_props,
+	       unsigned int num_aux_leds)
 {
-    atca_fru_t   *finfo = rsp_data;
-    int          i, j;
+    unsigned int i, j;
     unsigned int num_leds;
 
-    if (check_for_msg_err(mc, NULL, rsp, 4, "fru_led_prop_rsp"))
-	goto out;
-
     /* Note that while the MC exists, finfo is guaranteed to exist
        because we never decrease the number of FRUs. */
 
@@ -1582,41 +1793,41 @@ fru_led_prop_rsp(ipmi_mc_t  *mc,
 	/* There is a race here, it is possible to have two LED
 	   fetches running at the same time.  If they have already
 	   been fetched, just ignore this message. */
-	goto out;
+	return;
 
     if (!finfo->entity)
 	/* The entity was destroyed while the message was in progress. */
-	goto out;
+	return;
     
-    num_leds = 4 + rsp->data[3];
+    num_leds = 4 + num_aux_leds;
     finfo->leds = ipmi_mem_alloc(sizeof(atca_led_t *) * num_leds);
     if (!finfo->leds) {
 	ipmi_log(IPMI_LOG_SEVERE,
-		 "%soem_atca.c(fru_led_prop_rsp): "
+		 "%soem_atca.c(setup_fru_leds): "
 		 "Could not allocate memory LEDs",
 		 MC_NAME(mc));
-	goto out;
+	return;
     }
     memset(finfo->leds, 0, sizeof(atca_led_t *) * num_leds);
     finfo->num_leds = num_leds;
 
     for (i=0; i<4; i++) {
-	if (rsp->data[2] & (1 << i)) {
+	if (led_props & (1 << i)) {
 	    /* We support this LED.  Fetch its capabilities */
 	    finfo->leds[i] = ipmi_mem_alloc(sizeof(atca_led_t));
 	    if (!finfo->leds[i]) {
 		ipmi_log(IPMI_LOG_SEVERE,
-			 "%soem_atca.c(fru_led_prop_rsp): "
+			 "%soem_atca.c(setup_fru_leds): "
 			 "Could not allocate memory for an LED",
 			 MC_NAME(mc));
-		goto out;
+		return;
 	    }
 	    memset(finfo->leds[i], 0, sizeof(atca_led_t));
 	    get_led_capability(mc, finfo, i);
 	}
     }
 
-    for (j=0; j<rsp->data[3]; j++, i++) {
+    for (j=0; j<num_aux_leds; j++, i++) {
 	if (i >= 128)
 	    /* We only support 128 LEDs. */
 	    break;
@@ -1624,25 +1835,59 @@ fru_led_prop_rsp(ipmi_mc_t  *mc,
 	finfo->leds[i] = ipmi_mem_alloc(sizeof(atca_led_t));
 	if (!finfo->leds[i]) {
 	    ipmi_log(IPMI_LOG_SEVERE,
-		     "%soem_atca.c(fru_led_prop_rsp): "
+		     "%soem_atca.c(setup_fru_leds): "
 		     "Could not allocate memory for an aux LED",
 		     MC_NAME(mc));
-	    goto out;
+	    return;
 	}
 	memset(finfo->leds[i], 0, sizeof(atca_led_t));
 	get_led_capability(mc, finfo, i);
     }
- out:
-    return;
+}
+
+static void
+fru_led_prop_rsp(ipmi_mc_t  *mc,
+		 ipmi_msg_t *rsp,
+		 void       *rsp_data)
+{
+    atca_fru_t       *finfo = rsp_data;
+    atca_fru_cache_t *fc;
+    unsigned int     num_leds;
+
+    if (check_for_msg_err(mc, NULL, rsp, 4, "fru_led_prop_rsp"))
+	return;
+
+    fc = atca_fru_cache(finfo->minfo, finfo->fru_id, 1);
+    if (fc && !fc->leds_valid) {
+	num_leds = 4 + rsp->data[3];
+	fc->leds = ipmi_mem_alloc(sizeof(atca_led_cache_t) * num_leds);
+	if (fc->leds) {
+	    memset(fc->leds, 0, sizeof(atca_led_cache_t) * num_leds);
+	    fc->num_leds = num_leds;
+	    fc->led_props = rsp->data[2];
+	    fc->num_aux_leds = rsp->data[3];
+	    fc->leds_valid = 1;
+	}
+    }
+
+    setup_fru_leds(mc, finfo, rsp->data[2], rsp->data[3]);
 }
 
 static void
 fetch_fru_leds_mc_cb(ipmi_mc_t *mc, void *cb_info)
 {
-    atca_fru_t    *finfo = cb_info;
-    ipmi_msg_t    msg;
-    unsigned char data[2];
-    int           rv;
+    atca_fru_t       *finfo = cb_info;
+    atca_fru_cache_t *fc;
+    ipmi_msg_t       msg;
+    unsigned char    data[2];
+    int              rv;
+
+    fc = atca_fru_cache(finfo->minfo, finfo->fru_id, 0);
+    if (fc && fc->leds_valid) {
+	/* We already know what LEDs this FRU has. */
+	setup_fru_leds(mc, finfo, fc->led_props, fc->num_aux_leds);
+	return;
+    }
 
     /* Now fetch the LED information. */
     msg.netfn = IPMI_GROUP_EXTENSION_NETFN;
@@ -1706,6 +1951,157 @@ destroy_fru_leds(atca_fru_t *finfo)
     }
 }
 
+/***********************************************************************
+ *
+ * Shelf-wide audit of the hot-swap and LED states.  This reads every
+ * FRU's hot-swap sensor and every LED on the shelf at once, instead
+ * of one FRU at a time, and keeps the results so the getters can
+ * answer without going to the IPMC.
+ *
+ **********************************************************************/
+
+static void
+audit_hs_state_done(ipmi_sensor_t *sensor,
+		    int           err,
+		    ipmi_states_t *states,
+		    void          *cb_data)
+{
+    atca_fru_t                *finfo = cb_data;
+    int                       i;
+    int                       handled = IPMI_EVENT_NOT_HANDLED;
+    ipmi_event_t              *event = NULL;
+    enum ipmi_hot_swap_states old_state;
+
+    if (!sensor)
+	/* The MC may have gone away with the FRU info, don't touch
+	   it. */
+	return;
+
+    finfo->audit_pending = 0;
+    if (err) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%soem_atca.c(audit_hs_state_done): "
+		 "Error getting sensor value: 0x%x",
+		 SENSOR_NAME(sensor), err);
+	return;
+    }
+
+    for (i=0; i<8; i++) {
+	if (ipmi_is_state_set(states, i))
+	    break;
+    }
+    if (i == 8)
+	return;
+
+    atca_stamp(finfo->minfo->shelf, &finfo->hs_state_time);
+    if ((enum ipmi_hot_swap_states) i != finfo->hs_state) {
+	/* The OpenIPMI hot-swap states map directly to the ATCA ones. */
+	old_state = finfo->hs_state;
+	finfo->hs_state = i;
+	ipmi_entity_call_hot_swap_handlers(ipmi_sensor_get_entity(sensor),
+					   old_state,
+					   finfo->hs_state,
+					   &event,
+					   &handled);
+    }
+}
+
+static void
+audit_led_rsp(ipmi_mc_t  *mc,
+	      ipmi_msg_t *rsp,
+	      void       *rsp_data)
+{
+    atca_led_t   *l = rsp_data;
+    unsigned int len;
+
+    l->op_in_progress--;
+    if (l->destroyed) {
+	/* See led_state_rsp(). */
+	if (!l->op_in_progress)
+	    ipmi_mem_free(l);
+	return;
+    }
+
+    if (check_for_msg_err(mc, NULL, rsp, 6, "audit_led_rsp"))
+	return;
+
+    len = rsp->data_len;
+    if (len > sizeof(l->state))
+	len = sizeof(l->state);
+    memcpy(l->state, rsp->data, len);
+    l->state_len = len;
+    atca_stamp(l->fru->minfo->shelf, &l->state_time);
+}
+
+static void
+audit_ipmc_leds(ipmi_mc_t *mc, void *cb_data)
+{
+    atca_ipmc_t   *minfo = cb_data;
+    atca_fru_t    *finfo;
+    atca_led_t    *l;
+    ipmi_msg_t    msg;
+    unsigned char data[3];
+    unsigned int  i, j;
+    int           rv;
+
+    msg.netfn = IPMI_GROUP_EXTENSION_NETFN;
+    msg.cmd = IPMI_PICMG_CMD_GET_FRU_LED_STATE;
+    msg.data = data;
+    msg.data_len = 3;
+    data[0] = IPMI_PICMG_GRP_EXT;
+    for (i=0; i<minfo->num_frus; i++) {
+	finfo = minfo->frus[i];
+	if (!finfo || !finfo->leds)
+	    continue;
+	for (j=0; j<finfo->num_leds; j++) {
+	    l = finfo->leds[j];
+	    if (!l || !l->control)
+		continue;
+	    data[1] = finfo->fru_id;
+	    data[2] = l->num;
+	    l->op_in_progress++;
+	    rv = ipmi_mc_send_command(mc, 0, &msg, audit_led_rsp, l);
+	    if (rv)
+		l->op_in_progress--;
+	}
+    }
+}
+
+static void
+atca_audit_shelf(atca_shelf_t *info)
+{
+    atca_ipmc_t  *minfo;
+    atca_fru_t   *finfo;
+    unsigned int i, j;
+    int          rv;
+
+    atca_stamp(info, &info->audit_time);
+
+    /* Just send everything, the responses can come back in any
+       order. */
+    for (i=0; i<info->num_ipmcs; i++) {
+	minfo = &(info->ipmcs[i]);
+	if (!minfo->mc || (minfo->ipmb_address == 0x20))
+	    continue;
+
+	for (j=0; j<minfo->num_frus; j++) {
+	    finfo = minfo->frus[j];
+	    if (!finfo)
+		continue;
+	    finfo->audit_pending = 0;
+	    if (!finfo->entity
+		|| ipmi_sensor_id_is_invalid(&finfo->hs_sensor_id))
+		continue;
+	    rv = ipmi_sensor_id_get_states(finfo->hs_sensor_id,
+					   audit_hs_state_done, finfo);
+	    if (!rv)
+		finfo->audit_pending = 1;
+	}
+
+	ipmi_mc_pointer_cb(minfo->mcid, audit_ipmc_leds, minfo);
+    }
+}
+
 /***********************************************************************
  *
  * ATCA FRU control handling.  This is for the FRU control command.
@@ -1881,20 +2277,11 @@ add_atca_fru_control(ipmi_mc_t               *mc,
 }
 
 static void
-fru_control_capabilities_rsp(ipmi_mc_t  *mc,
-			     ipmi_msg_t *rsp,
-			     void       *rsp_data)
+add_fru_control_set(ipmi_mc_t *mc, atca_fru_t *finfo)
 {
     ipmi_domain_t *domain;
-    atca_fru_t    *finfo = rsp_data;
     int           rv;
 
-    if (!check_for_msg_err(mc, NULL, rsp, 3, "fru_control_capabilities_rsp"))
-	finfo->fru_capabilities = rsp->data[2];
-
-    if (!mc)
-	goto out;
-
     domain = ipmi_mc_get_domain(mc);
 
     /* If the command fails, we just go on, as the system doesn't
@@ -1935,15 +2322,48 @@ fru_control_capabilities_rsp(ipmi_mc_t  *mc,
 
 }
 
+static void
+fru_control_capabilities_rsp(ipmi_mc_t  *mc,
+			     ipmi_msg_t *rsp,
+			     void       *rsp_data)
+{
+    atca_fru_t       *finfo = rsp_data;
+    atca_fru_cache_t *fc;
+
+    if (!check_for_msg_err(mc, NULL, rsp, 3,
+			   "fru_control_capabilities_rsp"))
+    {
+	finfo->fru_capabilities = rsp->data[2];
+	fc = atca_fru_cache(finfo->minfo, finfo->fru_id, 1);
+	if (fc) {
+	    fc->fru_capabilities = rsp->data[2];
+	    fc->fru_capabilities_valid = 1;
+	}
+    }
+
+    if (!mc)
+	return;
+
+    add_fru_control_set(mc, finfo);
+}
+
 static void
 fetch_fru_control_mc_cb(ipmi_mc_t *mc, void *cb_info)
 {
-    atca_fru_t    *finfo = cb_info;
-    ipmi_msg_t    msg;
-    unsigned char data[2];
-    int           rv;
+    atca_fru_t       *finfo = cb_info;
+    atca_fru_cache_t *fc;
+    ipmi_msg_t       msg;
+    unsigned char    data[2];
+    int              rv;
 
-    /* Now fetch the LED information. */
+    fc = atca_fru_cache(finfo->minfo, finfo->fru_id, 0);
+    if (fc && fc->fru_capabilities_valid) {
+	finfo->fru_capabilities = fc->fru_capabilities;
+	add_fru_control_set(mc, finfo);
+	return;
+    }
+
+    /* Now fetch the FRU control capabilities. */
     msg.netfn = IPMI_GROUP_EXTENSION_NETFN;
     msg.cmd = IPMI_PICMG_CMD_FRU_CONTROL_CAPABILITIES;
     msg.data = data;
@@ -2782,6 +3202,7 @@ atca_sensor_update_handler(enum ipmi_update_e op,
 
     case IPMI_DELETED:
 	ipmi_sensor_id_set_invalid(&finfo->hs_sensor_id);
+	memset(&finfo->hs_state_time, 0, sizeof(finfo->hs_state_time));
 	/* Tell the user that we went away, if necessary. */
 	/* FIXME - what about out-of-comm state? */
 	if (finfo->hs_state != IPMI_HOT_SWAP_NOT_PRESENT) {
@@ -3011,6 +3432,8 @@ fru_picmg_prop_rsp(ipmi_mc_t  *mc,
 		 MC_NAME(mc));
 	return;
     }
+    if (minfo->cache_valid)
+	minfo->cache_num_frus = num_frus;
 }
 
 static void
@@ -3106,6 +3529,19 @@ atca_handle_new_mc(ipmi_domain_t *domain, ipmi_mc_t *mc, atca_shelf_t *info)
     minfo->mcid = ipmi_mc_convert_to_id(mc);
     minfo->mc = mc;
 
+    atca_check_cache(minfo, mc);
+    if (minfo->cache_num_frus) {
+	/* We already know the properties from the last time this MC
+	   was here. */
+	rv = realloc_frus(minfo, minfo->cache_num_frus);
+	if (rv)
+	    ipmi_log(IPMI_LOG_SEVERE,
+		     "%soem_atca.c(atca_handle_new_mc): "
+		     "Could not allocate FRU memory",
+		     MC_NAME(mc));
+	return;
+    }
+
     /* Now fetch the properties. */
     msg.netfn = IPMI_GROUP_EXTENSION_NETFN;
     msg.cmd = IPMI_PICMG_CMD_GET_PROPERTIES;
@@ -4145,6 +4581,7 @@ atca_oem_data_destroyer(ipmi_domain_t *domain, void *oem_data)
 	    }
 	    ipmi_mem_free(b->frus);
 	    b->frus = NULL;
+	    atca_flush_cache(b);
 	}
 	ipmi_mem_free(info->ipmcs);
     }
@@ -28,6 +28,7 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <math.h>
@@ -1925,6 +1926,169 @@ mxp_alloc_id_control(ipmi_mc_t                          *mc,
     return rv;
 }
 
+/***********************************************************************
+ *
+ * Table-driven sensor and control creation.  The sensors and controls
+ * for a board, power supply, etc. are described by a constant table,
+ * and mxp_create_from_defs() creates them all in one pass over it.
+ *
+ **********************************************************************/
+
+#define MXP_DEF_DISCRETE_SENSOR		1
+#define MXP_DEF_THRESHOLD_SENSOR	2
+#define MXP_DEF_CONTROL			3
+#define MXP_DEF_ID_CONTROL		4
+
+/* Flags for the table entries.  The NOT_xxx ones cause the entry to
+   be skipped for AMC boards and halfpint chassis. */
+#define MXP_DEF_IGNORE_FOR_PRESENCE	(1 << 0)
+#define MXP_DEF_NOT_AMC			(1 << 1)
+#define MXP_DEF_NOT_HALFPINT		(1 << 2)
+
+typedef struct mxp_def_s
+{
+    unsigned int kind;
+    char         *id;
+    unsigned int num;    /* Added to the sensor or control base number */
+    size_t       offset; /* Where to put the pointer in the owner */
+    unsigned int flags;
+
+    /* For sensors.  unit is only for threshold sensors, reading_type
+       only for discrete ones. */
+    unsigned int                         sensor_type;
+    unsigned int                         reading_type;
+    unsigned int                         unit;
+    unsigned int                         assert_events;
+    unsigned int                         deassert_events;
+    ipmi_sensor_get_states_func          states_get;
+    ipmi_sensor_reading_name_string_func reading_name_string;
+    ipmi_sensor_get_reading_func         reading_get;
+
+    /* For controls. */
+    unsigned int                       control_type;
+    unsigned int                       num_elements;
+    ipmi_control_light_t               *lights;
+    ipmi_control_set_val_cb            set_val;
+    ipmi_control_get_val_cb            get_val;
+    unsigned int                       id_length;
+    ipmi_control_identifier_set_val_cb id_set_val;
+    ipmi_control_identifier_get_val_cb id_get_val;
+
+    /* Anything else that needs to be done before it is added. */
+    void (*sensor_fixup)(ipmi_sensor_t *sensor);
+    void (*control_fixup)(ipmi_control_t *control);
+} mxp_def_t;
+
+#define MXP_NUM_DEFS(defs) (sizeof(defs) / sizeof(mxp_def_t))
+
+/*
+ * Create the sensors and controls in the table.  data is the OEM data
+ * for each one, and the pointer to each one is stored in owner at the
+ * entry's offset.  Entries with a flag in skip are not created.
+ */
+static int
+mxp_create_from_defs(ipmi_mc_t       *mc,
+		     ipmi_entity_t   *ent,
+		     void            *data,
+		     void            *owner,
+		     const mxp_def_t *defs,
+		     unsigned int    num_defs,
+		     unsigned int    sensor_base,
+		     unsigned int    control_base,
+		     unsigned int    skip)
+{
+    unsigned int    i;
+    const mxp_def_t *def;
+    ipmi_sensor_t   **sensor;
+    ipmi_control_t  **control;
+    int             rv = 0;
+
+    for (i=0; i<num_defs; i++) {
+	def = &(defs[i]);
+	if (def->flags & skip)
+	    continue;
+
+	switch (def->kind) {
+	case MXP_DEF_DISCRETE_SENSOR:
+	case MXP_DEF_THRESHOLD_SENSOR:
+	    sensor = (ipmi_sensor_t **) (((char *) owner) + def->offset);
+	    if (def->kind == MXP_DEF_DISCRETE_SENSOR)
+		rv = mxp_alloc_discrete_sensor(mc,
+					       data, NULL,
+					       def->sensor_type,
+					       def->reading_type,
+					       def->id,
+					       def->assert_events,
+					       def->deassert_events,
+					       def->states_get,
+					       def->reading_name_string,
+					       sensor);
+	    else
+		rv = mxp_alloc_threshold_sensor(mc,
+						data, NULL,
+						def->sensor_type,
+						def->unit,
+						def->id,
+						def->assert_events,
+						def->deassert_events,
+						def->reading_get,
+						-1, -1, -1,
+						sensor);
+	    if (rv)
+		return rv;
+	    if (def->flags & MXP_DEF_IGNORE_FOR_PRESENCE)
+		ipmi_sensor_set_ignore_for_presence(*sensor, 1);
+	    if (def->sensor_fixup)
+		def->sensor_fixup(*sensor);
+	    rv = mxp_add_sensor(mc, sensor, sensor_base + def->num, ent);
+	    break;
+
+	case MXP_DEF_CONTROL:
+	    control = (ipmi_control_t **) (((char *) owner) + def->offset);
+	    rv = mxp_alloc_control(mc,
+				   data,
+				   def->control_type,
+				   def->id,
+				   def->set_val,
+				   def->get_val,
+				   control);
+	    if (rv)
+		return rv;
+	    if (def->num_elements)
+		ipmi_control_set_num_elements(*control, def->num_elements);
+	    if (def->lights)
+		ipmi_control_light_set_lights(*control, 1, def->lights);
+	    if (def->flags & MXP_DEF_IGNORE_FOR_PRESENCE)
+		ipmi_control_set_ignore_for_presence(*control, 1);
+	    if (def->control_fixup)
+		def->control_fixup(*control);
+	    rv = mxp_add_control(mc, control, control_base + def->num, ent);
+	    break;
+
+	case MXP_DEF_ID_CONTROL:
+	    control = (ipmi_control_t **) (((char *) owner) + def->offset);
+	    rv = mxp_alloc_id_control(mc, ent,
+				      control_base + def->num,
+				      data,
+				      IPMI_CONTROL_IDENTIFIER,
+				      def->id,
+				      def->id_length,
+				      def->id_set_val,
+				      def->id_get_val,
+				      control);
+	    break;
+
+	default:
+	    rv = EINVAL;
+	    break;
+	}
+	if (rv)
+	    return rv;
+    }
+
+    return 0;
+}
+
 /***********************************************************************
  *
  * Chassis-specific controls and sensors start here.
@@ -3388,153 +3552,62 @@ ps_i2c_isolate_get(ipmi_control_t      *control,
     return rv;
 }
 
+/* Power supply sensor.  Offset 0 and 1 are standard presence and
+   failure bits.  Offsets 13 and 14 are a-feed and b-feed sensors. */
+static const mxp_def_t mxp_ps_defs[] =
+{
+    { .kind = MXP_DEF_DISCRETE_SENSOR, .id = "presence", .num = 0,
+      .offset = offsetof(mxp_power_supply_t, presence),
+      .sensor_type = IPMI_SENSOR_TYPE_ENTITY_PRESENCE,
+      .reading_type = IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
+      .assert_events = 0x3, .deassert_events = 0x3,
+      .states_get = ps_presence_states_get },
+    { .kind = MXP_DEF_DISCRETE_SENSOR, .id = "Power Supply", .num = 1,
+      .offset = offsetof(mxp_power_supply_t, ps),
+      .sensor_type = IPMI_SENSOR_TYPE_POWER_SUPPLY,
+      .reading_type = IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
+      .assert_events = 0x6003, .deassert_events = 0x6003,
+      .states_get = ps_ps_states_get,
+      .reading_name_string = ps_ps_reading_name_string },
+    { .kind = MXP_DEF_CONTROL, .id = "enable", .num = 0,
+      .offset = offsetof(mxp_power_supply_t, enable),
+      .control_type = IPMI_CONTROL_POWER, .num_elements = 1,
+      .set_val = ps_enable_set, .get_val = ps_enable_get },
+    { .kind = MXP_DEF_CONTROL, .id = "OOS LED", .num = 1,
+      .offset = offsetof(mxp_power_supply_t, oos_led),
+      .control_type = IPMI_CONTROL_LIGHT, .lights = red_led,
+      .set_val = ps_led_set, .get_val = ps_led_get },
+    { .kind = MXP_DEF_CONTROL, .id = "InS LED", .num = 2,
+      .offset = offsetof(mxp_power_supply_t, inserv_led),
+      .control_type = IPMI_CONTROL_LIGHT, .lights = green_led,
+      .set_val = ps_led_set, .get_val = ps_led_get },
+    { .kind = MXP_DEF_ID_CONTROL, .id = "type", .num = 3,
+      .offset = offsetof(mxp_power_supply_t, ps_type),
+      .id_length = 1, .id_get_val = ps_type_get },
+    { .kind = MXP_DEF_ID_CONTROL, .id = "revision", .num = 4,
+      .offset = offsetof(mxp_power_supply_t, ps_revision),
+      .id_length = 2, .id_get_val = ps_revision_get },
+    { .kind = MXP_DEF_CONTROL, .id = "I2C Isolate", .num = 5,
+      .offset = offsetof(mxp_power_supply_t, ps_i2c_isolate),
+      .flags = MXP_DEF_NOT_HALFPINT,
+      .control_type = IPMI_CONTROL_OUTPUT, .num_elements = 1,
+      .set_val = ps_i2c_isolate_set, .get_val = ps_i2c_isolate_get },
+};
+
 static int
 mxp_add_power_supply_sensors(mxp_info_t         *info,
 			     mxp_power_supply_t *ps)
 {
-    int rv;
+    unsigned int skip = 0;
 
-    /* Power supply presence */
-    rv = mxp_alloc_discrete_sensor(info->mc,
-				   ps, NULL,
-				   IPMI_SENSOR_TYPE_ENTITY_PRESENCE,
-				   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
-				   "presence",
-				   0x3, 0x3,
-				   ps_presence_states_get,
-				   NULL,
-				   &ps->presence);
-    if (rv)
-	goto out_err;
-    rv = mxp_add_sensor(info->mc, 
-			&ps->presence,
-			MXP_PS_PRESENCE_NUM(ps->idx),
-			ps->ent);
-    if (rv)
-	goto out_err;
+    if (info->chassis_config == MXP_CHASSIS_CONFIG_HALFPINT)
+	skip |= MXP_DEF_NOT_HALFPINT;
 
-    /* Power supply sensor.  Offset 0 and 1 are standard presence and
-       failure bits.  Offsets 13 and 14 are a-feed and b-feed
-       sensors. */
-    rv = mxp_alloc_discrete_sensor(info->mc,
-				   ps, NULL,
-				   IPMI_SENSOR_TYPE_POWER_SUPPLY,
-				   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
-				   "Power Supply",
-				   0x6003, 0x6003,
-				   ps_ps_states_get,
-				   ps_ps_reading_name_string,
-				   &ps->ps);
-    if (rv)
-	goto out_err;
-    rv = mxp_add_sensor(info->mc, 
-			&ps->ps,
-			MXP_PS_PS_NUM(ps->idx),
-			ps->ent);
-    if (rv)
-	goto out_err;
-
-    /* Enabled control */
-    rv = mxp_alloc_control(info->mc,
-			   ps,
-			   IPMI_CONTROL_POWER,
-			   "enable",
-			   ps_enable_set,
-			   ps_enable_get,
-			   &(ps->enable));
-    if (rv)
-	goto out_err;
-    ipmi_control_set_num_elements(ps->enable, 1);
-    rv = mxp_add_control(info->mc, 
-			 &ps->enable,
-			 MXP_PS_ENABLE_NUM(ps->idx),	       
-			 ps->ent);
-    if (rv)
-	goto out_err;
-
-    /* LED controls */
-    rv = mxp_alloc_control(info->mc,
-			   ps,
-			   IPMI_CONTROL_LIGHT,
-			   "OOS LED",
-			   ps_led_set,
-			   ps_led_get,
-			   &ps->oos_led);
-    if (rv)
-	goto out_err;
-    ipmi_control_light_set_lights(ps->oos_led, 1, red_led);
-    rv = mxp_add_control(info->mc, 
-			 &ps->oos_led,
-			 MXP_PS_OOS_LED_NUM(ps->idx),	       
-			 ps->ent);
-    if (rv)
-	goto out_err;
-
-    rv = mxp_alloc_control(info->mc,
-			   ps,
-			   IPMI_CONTROL_LIGHT,
-			   "InS LED",
-			   ps_led_set,
-			   ps_led_get,
-			   &ps->inserv_led);
-    if (rv)
-	goto out_err;
-    ipmi_control_light_set_lights(ps->inserv_led, 1, green_led);
-    rv = mxp_add_control(info->mc, 
-			 &ps->inserv_led,
-			 MXP_PS_INS_LED_NUM(ps->idx),	       
-			 ps->ent);
-    if (rv)
-	goto out_err;
-
-    /* Power Supply Type ID */
-    rv = mxp_alloc_id_control(info->mc, ps->ent,
-			      MXP_PS_TYPE_NUM(ps->idx),
-			      ps,
-			      IPMI_CONTROL_IDENTIFIER,
-			      "type",
-			      1,
-			      NULL,
-			      ps_type_get,
-			      &ps->ps_type);
-    if (rv)
-	goto out_err;
-
-    /* Power Supply Revision */
-    rv = mxp_alloc_id_control(info->mc, ps->ent,
-			      MXP_PS_REVISION_NUM(ps->idx),
-			      ps,
-			      IPMI_CONTROL_IDENTIFIER,
-			      "revision",
-			      2,
-			      NULL,
-			      ps_revision_get,
-			      &ps->ps_revision);
-    if (rv)
-	goto out_err;
-
-    if (info->chassis_config != MXP_CHASSIS_CONFIG_HALFPINT) {
-	/* Power supply I2C isolate control */
-	rv = mxp_alloc_control(info->mc,
-			       ps,
-			       IPMI_CONTROL_OUTPUT,
-			       "I2C Isolate",
-			       ps_i2c_isolate_set,
-			       ps_i2c_isolate_get,
-			       &ps->ps_i2c_isolate);
-	if (rv)
-	    goto out_err;
-	ipmi_control_set_num_elements(ps->ps_i2c_isolate, 1);
-	rv = mxp_add_control(info->mc, 
-			     &ps->ps_i2c_isolate,
-			     MXP_PS_I2C_ISOLATE_NUM(ps->idx),	       
-			     ps->ent);
-	if (rv)
-	    goto out_err;
-    }
-
- out_err:
-    return rv;
+    return mxp_create_from_defs(info->mc, ps->ent, ps, ps,
+				mxp_ps_defs, MXP_NUM_DEFS(mxp_ps_defs),
+				MXP_PS_SENSOR_NUM(ps->idx, 0),
+				MXP_PS_CONTROL_NUM(ps->idx, 0),
+				skip);
 }
 
 static void
@@ -4003,149 +4076,77 @@ mxp_fan_reading_get_cb(ipmi_sensor_t          *sensor,
     return rv;
 }
 
-static int
-mxp_add_fan_sensors(mxp_info_t *info,
-		    mxp_fan_t  *fan)
+static void
+mxp_fan_speed_fixup(ipmi_sensor_t *sensor)
 {
-    int               rv;
-    unsigned int      assert, deassert;
     ipmi_sensor_cbs_t cbs;
 
-    /* Fan presence sensor */
-    rv = mxp_alloc_discrete_sensor(info->mc,
-				   fan, NULL,
-				   IPMI_SENSOR_TYPE_ENTITY_PRESENCE,
-				   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
-				   "presence",
-				   0x7, 0,
-				   fan_presence_states_get,
-				   NULL,
-				   &fan->fan_presence);
-    if (rv)
-	goto out_err;
-    rv = mxp_add_sensor(info->mc, 
-			&fan->fan_presence,
-			MXP_FAN_PRESENCE_NUM(fan->idx),
-			fan->fan_ent);
-    if (rv)
-	goto out_err;
-
-    /* Fan speed sensor */
-    assert = 1 << ((IPMI_LOWER_CRITICAL * 2) + IPMI_GOING_LOW);
-    deassert = 1 << ((IPMI_LOWER_CRITICAL * 2) + IPMI_GOING_LOW);
-    rv = mxp_alloc_threshold_sensor(info->mc,
-				    fan, NULL,
-				    IPMI_SENSOR_TYPE_FAN,
-				    IPMI_UNIT_TYPE_RPM,
-				    "speed",
-				    assert, deassert,
-				    mxp_fan_reading_get_cb,
-				    -1, -1, -1,
-				    &fan->fan);
-    if (rv)
-	goto out_err;
-    ipmi_sensor_get_callbacks(fan->fan, &cbs);
+    ipmi_sensor_get_callbacks(sensor, &cbs);
     cbs.ipmi_sensor_convert_from_raw = mxp_fan_speed_convert_from_raw;
     cbs.ipmi_sensor_convert_to_raw = mxp_fan_speed_convert_to_raw;
-    ipmi_sensor_set_raw_sensor_max(fan->fan, 1);
-    ipmi_sensor_set_raw_sensor_min(fan->fan, 0xff);
-    ipmi_sensor_set_callbacks(fan->fan, &cbs);
-    rv = mxp_add_sensor(info->mc, 
-			&fan->fan,
-			MXP_FAN_SPEED_NUM(fan->idx),
-			fan->fan_ent);
-    if (rv)
-	goto out_err;
-
-    /* Cooling sensor */
-    assert = ((1 << ((IPMI_UPPER_NON_CRITICAL * 2) + IPMI_GOING_HIGH))
-	      | (1 << ((IPMI_UPPER_CRITICAL * 2) + IPMI_GOING_HIGH)));
-    deassert = ((1 << ((IPMI_UPPER_NON_CRITICAL * 2) + IPMI_GOING_HIGH))
-		| (1 << ((IPMI_UPPER_CRITICAL * 2) + IPMI_GOING_HIGH)));
-    rv = mxp_alloc_threshold_sensor(info->mc,
-				    fan, NULL,
-				    IPMI_SENSOR_TYPE_COOLING_DEVICE,
-				    IPMI_UNIT_TYPE_UNSPECIFIED,
-				    "cooling",
-				    assert, deassert,
-				    mxp_fan_reading_get_cb,
-				    -1, -1, -1,
-				    &fan->cooling);
-    if (rv)
-	goto out_err;
-    rv = mxp_add_sensor(info->mc, 
-			&fan->cooling,
-			MXP_FAN_COOLING_NUM(fan->idx),
-			fan->fan_ent);
-    if (rv)
-	goto out_err;
-
-    /* FAN LED controls. */
-    rv = mxp_alloc_control(info->mc,
-			   fan,
-			   IPMI_CONTROL_LIGHT,
-			   "OOS LED",
-			   fan_led_set,
-			   fan_led_get,
-			   &fan->fan_oos_led);
-    if (rv)
-	goto out_err;
-    ipmi_control_light_set_lights(fan->fan_oos_led, 1, red_led);
-    rv = mxp_add_control(info->mc, 
-			 &fan->fan_oos_led,
-			 MXP_FAN_OOS_LED_NUM(fan->idx),
-			 fan->fan_ent);
-    if (rv)
-	goto out_err;
-
-    rv = mxp_alloc_control(info->mc,
-			   fan,
-			   IPMI_CONTROL_LIGHT,
-			   "InS LED",
-			   fan_led_set,
-			   fan_led_get,
-			   &(fan->fan_inserv_led));
-    if (rv)
-	goto out_err;
-    ipmi_control_light_set_lights(fan->fan_inserv_led, 1, red_led);
-    rv = mxp_add_control(info->mc, 
-			 &fan->fan_inserv_led,
-			 MXP_FAN_INS_LED_NUM(fan->idx),
-			 fan->fan_ent);
-    if (rv)
-	goto out_err;
-	       
-    /* Fan Type ID */
-    rv = mxp_alloc_id_control(info->mc, fan->fan_ent,
-			      MXP_FAN_TYPE_NUM(fan->idx),
-			      fan,
-			      IPMI_CONTROL_IDENTIFIER,
-			      "type",
-			      1,
-			      NULL,
-			      fan_type_get,
-			      &fan->fan_type);
-    if (rv)
-	goto out_err;
-
-    /* Fan Revision */
-    rv = mxp_alloc_id_control(info->mc, fan->fan_ent,
-			      MXP_FAN_REVISION_NUM(fan->idx),
-			      fan,
-			      IPMI_CONTROL_IDENTIFIER,
-			      "revision",
-			      1,
-			      NULL,
-			      fan_revision_get,
-			      &fan->fan_revision);
-    if (rv)
-	goto out_err;
-
-    /* Voltage sensors */
-    /* There aren't any */
+    ipmi_sensor_set_raw_sensor_max(sensor, 1);
+    ipmi_sensor_set_raw_sensor_min(sensor, 0xff);
+    ipmi_sensor_set_callbacks(sensor, &cbs);
+}
+
+#define MXP_THRESH_EVENT(thresh, dir) (1 << (((thresh) * 2) + (dir)))
+
+static const mxp_def_t mxp_fan_defs[] =
+{
+    { .kind = MXP_DEF_DISCRETE_SENSOR, .id = "presence", .num = 0,
+      .offset = offsetof(mxp_fan_t, fan_presence),
+      .sensor_type = IPMI_SENSOR_TYPE_ENTITY_PRESENCE,
+      .reading_type = IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
+      .assert_events = 0x7, .deassert_events = 0,
+      .states_get = fan_presence_states_get },
+    { .kind = MXP_DEF_THRESHOLD_SENSOR, .id = "speed", .num = 1,
+      .offset = offsetof(mxp_fan_t, fan),
+      .sensor_type = IPMI_SENSOR_TYPE_FAN, .unit = IPMI_UNIT_TYPE_RPM,
+      .assert_events = MXP_THRESH_EVENT(IPMI_LOWER_CRITICAL,
+					IPMI_GOING_LOW),
+      .deassert_events = MXP_THRESH_EVENT(IPMI_LOWER_CRITICAL,
+					  IPMI_GOING_LOW),
+      .reading_get = mxp_fan_reading_get_cb,
+      .sensor_fixup = mxp_fan_speed_fixup },
+    { .kind = MXP_DEF_THRESHOLD_SENSOR, .id = "cooling", .num = 2,
+      .offset = offsetof(mxp_fan_t, cooling),
+      .sensor_type = IPMI_SENSOR_TYPE_COOLING_DEVICE,
+      .unit = IPMI_UNIT_TYPE_UNSPECIFIED,
+      .assert_events = (MXP_THRESH_EVENT(IPMI_UPPER_NON_CRITICAL,
+					 IPMI_GOING_HIGH)
+			| MXP_THRESH_EVENT(IPMI_UPPER_CRITICAL,
+					   IPMI_GOING_HIGH)),
+      .deassert_events = (MXP_THRESH_EVENT(IPMI_UPPER_NON_CRITICAL,
+					   IPMI_GOING_HIGH)
+			  | MXP_THRESH_EVENT(IPMI_UPPER_CRITICAL,
+					     IPMI_GOING_HIGH)),
+      .reading_get = mxp_fan_reading_get_cb },
+    { .kind = MXP_DEF_CONTROL, .id = "OOS LED", .num = 0,
+      .offset = offsetof(mxp_fan_t, fan_oos_led),
+      .control_type = IPMI_CONTROL_LIGHT, .lights = red_led,
+      .set_val = fan_led_set, .get_val = fan_led_get },
+    { .kind = MXP_DEF_CONTROL, .id = "InS LED", .num = 1,
+      .offset = offsetof(mxp_fan_t, fan_inserv_led),
+      .control_type = IPMI_CONTROL_LIGHT, .lights = red_led,
+      .set_val = fan_led_set, .get_val = fan_led_get },
+    { .kind = MXP_DEF_ID_CONTROL, .id = "type", .num = 2,
+      .offset = offsetof(mxp_fan_t, fan_type),
+      .id_length = 1, .id_get_val = fan_type_get },
+    { .kind = MXP_DEF_ID_CONTROL, .id = "revision", .num = 3,
+      .offset = offsetof(mxp_fan_t, fan_revision),
+      .id_length = 1, .id_get_val = fan_revision_get },
+    /* There are no voltage sensors. */
+};
 
- out_err:
-    return rv;
+static int
+mxp_add_fan_sensors(mxp_info_t *info,
+		    mxp_fan_t  *fan)
+{
+    return mxp_create_from_defs(info->mc, fan->fan_ent, fan, fan,
+				mxp_fan_defs, MXP_NUM_DEFS(mxp_fan_defs),
+				MXP_FAN_SENSOR_NUM(fan->idx, 0),
+				MXP_FAN_CONTROL_NUM(fan->idx, 0),
+				0);
 }
 
 /***********************************************************************
@@ -4876,171 +4877,68 @@ i2c_isolate_get(ipmi_control_t      *control,
     return rv;
 }
 
+/* The healthy line and the controls past the LEDs are CPCI only. */
+static const mxp_def_t mxp_board_defs[] =
+{
+    { .kind = MXP_DEF_DISCRETE_SENSOR, .id = "presence", .num = 0,
+      .offset = offsetof(mxp_board_t, presence),
+      .sensor_type = IPMI_SENSOR_TYPE_ENTITY_PRESENCE,
+      .reading_type = IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
+      .assert_events = 0x3, .deassert_events = 0x3,
+      .states_get = mxpv1_board_presence_states_get },
+    { .kind = MXP_DEF_CONTROL, .id = "OOS LED", .num = 0,
+      .offset = offsetof(mxp_board_t, oos_led),
+      .flags = MXP_DEF_IGNORE_FOR_PRESENCE,
+      .control_type = IPMI_CONTROL_LIGHT, .lights = red_led,
+      .set_val = board_led_set, .get_val = board_led_get },
+    { .kind = MXP_DEF_CONTROL, .id = "InS LED", .num = 1,
+      .offset = offsetof(mxp_board_t, inserv_led),
+      .flags = MXP_DEF_IGNORE_FOR_PRESENCE,
+      .control_type = IPMI_CONTROL_LIGHT, .lights = green_led,
+      .set_val = board_led_set, .get_val = board_led_get },
+    { .kind = MXP_DEF_DISCRETE_SENSOR, .id = "healthy", .num = 1,
+      .offset = offsetof(mxp_board_t, healthy),
+      .flags = MXP_DEF_IGNORE_FOR_PRESENCE | MXP_DEF_NOT_AMC,
+      .sensor_type = MXP_SENSOR_HEALTHY,
+      .reading_type = IPMI_EVENT_READING_TYPE_DISCRETE_DEVICE_ENABLE,
+      .assert_events = 0x2, .deassert_events = 0x2,
+      .states_get = board_healthy_states_get },
+    { .kind = MXP_DEF_CONTROL, .id = "Bd Sel", .num = 2,
+      .offset = offsetof(mxp_board_t, bd_sel),
+      .flags = MXP_DEF_IGNORE_FOR_PRESENCE | MXP_DEF_NOT_AMC,
+      .control_type = IPMI_CONTROL_POWER, .num_elements = 1,
+      .set_val = bd_sel_set, .get_val = bd_sel_get },
+    { .kind = MXP_DEF_CONTROL, .id = "PCI Reset", .num = 3,
+      .offset = offsetof(mxp_board_t, pci_reset),
+      .flags = MXP_DEF_IGNORE_FOR_PRESENCE | MXP_DEF_NOT_AMC,
+      .control_type = IPMI_CONTROL_RESET, .num_elements = 1,
+      .set_val = pci_reset_set, .get_val = pci_reset_get },
+    { .kind = MXP_DEF_CONTROL, .id = "Slot Init", .num = 4,
+      .offset = offsetof(mxp_board_t, slot_init),
+      .flags = MXP_DEF_IGNORE_FOR_PRESENCE | MXP_DEF_NOT_AMC,
+      .control_type = IPMI_CONTROL_ONE_SHOT_OUTPUT, .num_elements = 1,
+      .set_val = slot_init_set },
+    { .kind = MXP_DEF_CONTROL, .id = "I2C Isolate", .num = 5,
+      .offset = offsetof(mxp_board_t, i2c_isolate),
+      .flags = MXP_DEF_IGNORE_FOR_PRESENCE | MXP_DEF_NOT_AMC,
+      .control_type = IPMI_CONTROL_OUTPUT, .num_elements = 1,
+      .set_val = i2c_isolate_set, .get_val = i2c_isolate_get },
+};
+
 static int
 mxp_add_board_sensors(mxp_info_t  *info,
 		      mxp_board_t *board)
 {
-    int rv;
-
-    /* Presence sensor */
-    rv = mxp_alloc_discrete_sensor(board->info->mc,
-				   board, NULL,
-				   IPMI_SENSOR_TYPE_ENTITY_PRESENCE,
-				   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
-				   "presence",
-				   0x3, 0x3,
-				   mxpv1_board_presence_states_get,
-				   NULL,
-				   &board->presence);
-    if (rv)
-	goto out_err;
-    rv = mxp_add_sensor(board->info->mc, 
-			&board->presence,
-			MXP_BOARD_PRESENCE_NUM(board->idx),
-			board->ent);
-    if (rv)
-	goto out_err;
-
-    /* out-of-service LED control */
-    rv = mxp_alloc_control(board->info->mc,
-			   board,
-			   IPMI_CONTROL_LIGHT,
-			   "OOS LED",
-			   board_led_set,
-			   board_led_get,
-			   &board->oos_led);
-    if (rv)
-	goto out_err;
-    ipmi_control_light_set_lights(board->oos_led, 1, red_led);
-    ipmi_control_set_ignore_for_presence(board->oos_led, 1);
-    rv = mxp_add_control(board->info->mc, 
-			 &board->oos_led,
-			 MXP_BOARD_OOS_LED_NUM(board->idx),
-			 board->ent);
-    if (rv)
-	goto out_err;
-
-    /* in-service LED control */
-    rv = mxp_alloc_control(board->info->mc,
-			   board,
-			   IPMI_CONTROL_LIGHT,
-			   "InS LED",
-			   board_led_set,
-			   board_led_get,
-			   &(board->inserv_led));
-    if (rv)
-	goto out_err;
-    ipmi_control_light_set_lights(board->inserv_led, 1, green_led);
-    ipmi_control_set_ignore_for_presence(board->inserv_led, 1);
-    rv = mxp_add_control(board->info->mc, 
-			 &board->inserv_led,
-			 MXP_BOARD_INS_LED_NUM(board->idx),
-			 board->ent);
-    if (rv)
-	goto out_err;
-
-    if (!board->is_amc) {
-	/* The CPCI healthy line sensor. */
-	rv = mxp_alloc_discrete_sensor
-	    (board->info->mc,
-	     board, NULL,
-	     MXP_SENSOR_HEALTHY,
-	     IPMI_EVENT_READING_TYPE_DISCRETE_DEVICE_ENABLE,
-	     "healthy",
-	     0x2, 0x2,
-	     board_healthy_states_get,
-	     NULL,
-	     &board->healthy);
-	if (rv)
-	    goto out_err;
-	ipmi_sensor_set_ignore_for_presence(board->healthy, 1);
-	rv = mxp_add_sensor(board->info->mc, 
-			    &board->healthy,
-			    MXP_BOARD_HEALTHY_NUM(board->idx),
-			    board->ent);
-	if (rv)
-	    goto out_err;
-
-	/* Board Select control */
-	rv = mxp_alloc_control(board->info->mc,
-			       board,
-			       IPMI_CONTROL_POWER,
-			       "Bd Sel",
-			       bd_sel_set,
-			       bd_sel_get,
-			       &board->bd_sel);
-	if (rv)
-	    goto out_err;
-	ipmi_control_set_num_elements(board->bd_sel, 1);
-        ipmi_control_set_ignore_for_presence(board->bd_sel, 1);
-	rv = mxp_add_control(board->info->mc, 
-			     &board->bd_sel,
-			     MXP_BOARD_BD_SEL_NUM(board->idx),
-			     board->ent);
-	if (rv)
-	    goto out_err;
-
-	/* PCI Reset control */
-	rv = mxp_alloc_control(board->info->mc,
-			       board,
-			       IPMI_CONTROL_RESET,
-			       "PCI Reset",
-			       pci_reset_set,
-			       pci_reset_get,
-			       &board->pci_reset);
-	if (rv)
-	    goto out_err;
-	ipmi_control_set_num_elements(board->pci_reset, 1);
-        ipmi_control_set_ignore_for_presence(board->pci_reset, 1);
-	rv = mxp_add_control(board->info->mc, 
-			     &board->pci_reset,
-			     MXP_BOARD_PCI_RESET_NUM(board->idx),
-			     board->ent);
-	if (rv)
-	    goto out_err;
+    unsigned int skip = 0;
 
+    if (board->is_amc)
+	skip |= MXP_DEF_NOT_AMC;
 
-	/* Slot init control */
-	rv = mxp_alloc_control(board->info->mc,
-			       board,
-			       IPMI_CONTROL_ONE_SHOT_OUTPUT,
-			       "Slot Init",
-			       slot_init_set,
-			       NULL,
-			       &board->slot_init);
-	if (rv)
-	    goto out_err;
-	ipmi_control_set_num_elements(board->slot_init, 1);
-        ipmi_control_set_ignore_for_presence(board->slot_init, 1);
-	rv = mxp_add_control(board->info->mc, 
-			     &board->slot_init,
-			     MXP_SLOT_INIT_NUM(board->idx),
-			     board->ent);
-	if (rv)
-	    goto out_err;
-
-	/* I2C enable control */
-	rv = mxp_alloc_control(board->info->mc,
-			       board,
-			       IPMI_CONTROL_OUTPUT,
-			       "I2C Isolate",
-			       i2c_isolate_set,
-			       i2c_isolate_get,
-			       &board->i2c_isolate);
-	if (rv)
-	    goto out_err;
-	ipmi_control_set_num_elements(board->i2c_isolate, 1);
-        ipmi_control_set_ignore_for_presence(board->i2c_isolate, 1);
-	rv = mxp_add_control(board->info->mc, 
-			     &board->i2c_isolate,
-			     MXP_SLOT_I2C_ISOLATE_NUM(board->idx),
-			     board->ent);
-	if (rv)
-	    goto out_err;
-    }
-
- out_err:
-    return rv;
+    return mxp_create_from_defs(board->info->mc, board->ent, board, board,
+				mxp_board_defs, MXP_NUM_DEFS(mxp_board_defs),
+				MXP_BOARD_SENSOR_NUM(board->idx, 0),
+				MXP_BOARD_CONTROL_NUM(board->idx, 0),
+				skip);
 }
 
 /***********************************************************************
@@ -6071,142 +5969,81 @@ destroy_board_sensors(ipmi_mc_t *mc, board_sensor_info_t *sinfo)
 #define MXP_BOARD_POWER_CONFIG_NUM	10 /* PM only */
 #define MXP_BOARD_CHASSIS_ID_CONTROL_NUM 11
 
+static void
+board_slot_fixup(ipmi_sensor_t *sensor)
+{
+    ipmi_sensor_set_hot_swap_requester(sensor, 6, 1); /* offset 6 is for
+							 hot-swap */
+}
+
+static void
+board_power_fixup(ipmi_control_t *control)
+{
+    ipmi_control_set_hot_swap_power(control, 1);
+}
+
+static void
+board_blue_led_fixup(ipmi_control_t *control)
+{
+    ipmi_control_set_hot_swap_indicator(control, 1, 1, 0, 2, 1);
+}
+
+static const mxp_def_t mxp_board_sinfo_defs[] =
+{
+    { .kind = MXP_DEF_DISCRETE_SENSOR, .id = "slot",
+      .num = MXP_BOARD_SLOT_NUM,
+      .offset = offsetof(board_sensor_info_t, slot),
+      .sensor_type = IPMI_SENSOR_TYPE_SLOT_CONNECTOR,
+      .reading_type = IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
+      /* offsets 5 and 6 are supported (power and hot-swap requester). */
+      .assert_events = 0x60, .deassert_events = 0x60,
+      .states_get = board_slot_get,
+      .sensor_fixup = board_slot_fixup },
+    { .kind = MXP_DEF_CONTROL, .id = "reset",
+      .num = MXP_BOARD_RESET_NUM,
+      .offset = offsetof(board_sensor_info_t, reset),
+      .control_type = IPMI_CONTROL_RESET, .num_elements = 1,
+      .set_val = board_reset_set, .get_val = board_reset_get },
+    { .kind = MXP_DEF_CONTROL, .id = "power",
+      .num = MXP_BOARD_POWER_NUM,
+      .offset = offsetof(board_sensor_info_t, power),
+      .control_type = IPMI_CONTROL_POWER, .num_elements = 1,
+      .set_val = board_power_set, .get_val = board_power_get,
+      .control_fixup = board_power_fixup },
+    { .kind = MXP_DEF_CONTROL, .id = "blue led",
+      .num = MXP_BOARD_BLUE_LED_NUM,
+      .offset = offsetof(board_sensor_info_t, blue_led),
+      .control_type = IPMI_CONTROL_LIGHT, .lights = blue_blinking_led,
+      .set_val = board_blue_led_set, .get_val = board_blue_led_get,
+      .control_fixup = board_blue_led_fixup },
+    { .kind = MXP_DEF_ID_CONTROL, .id = "Geog Addr",
+      .num = MXP_BOARD_SLOT_GA_NUM,
+      .offset = offsetof(board_sensor_info_t, slot_ga),
+      .id_length = 1, .id_get_val = slot_ga_get },
+    { .kind = MXP_DEF_CONTROL, .id = "Power Config",
+      .num = MXP_BOARD_POWER_CONFIG_NUM,
+      .offset = offsetof(board_sensor_info_t, power_config),
+      .control_type = IPMI_CONTROL_OUTPUT, .num_elements = 3,
+      .set_val = board_power_config_set, .get_val = board_power_config_get },
+    { .kind = MXP_DEF_ID_CONTROL, .id = "Chassis ID",
+      .num = MXP_BOARD_CHASSIS_ID_CONTROL_NUM,
+      .offset = offsetof(board_sensor_info_t, chassis_id),
+      .id_length = 4,
+      .id_set_val = chassis_id_set, .id_get_val = chassis_id_get },
+};
+
 static int
 new_board_sensors(ipmi_mc_t           *mc,
 		  ipmi_entity_t       *ent,
 		  mxp_info_t          *info,
 		  board_sensor_info_t *sinfo)
 {
-    int rv;
-
     sinfo->ent = ent;
 
-    /* The slot sensor */
-    rv = mxp_alloc_discrete_sensor(mc,
-				   NULL, NULL,
-				   IPMI_SENSOR_TYPE_SLOT_CONNECTOR,
-				   IPMI_EVENT_READING_TYPE_SENSOR_SPECIFIC,
-				   "slot",
-				   0x60, 0x60, /* offsets 5 and 6 are
-						  supported (power and
-						  hot-swap
-						  requester). */
-				   board_slot_get,
-				   NULL,
-				   &sinfo->slot);
-    if (rv)
-	goto out_err;
-    ipmi_sensor_set_hot_swap_requester(sinfo->slot, 6, 1); /* offset 6 is for
-							      hot-swap */
-    rv = mxp_add_sensor(mc, 
-			&sinfo->slot,
-			MXP_BOARD_SLOT_NUM,
-			ent);
-    if (rv)
-	goto out_err;
-
-    /* Reset control */
-    rv = mxp_alloc_control(mc,
-			   NULL,
-			   IPMI_CONTROL_RESET,
-			   "reset",
-			   board_reset_set,
-			   board_reset_get,
-			   &sinfo->reset);
-    if (rv)
-	goto out_err;
-    ipmi_control_set_num_elements(sinfo->reset, 1);
-    rv = mxp_add_control(mc, 
-			 &sinfo->reset,
-			 MXP_BOARD_RESET_NUM,
-			 ent);
-    if (rv)
-	goto out_err;
-
-    /* Power control */
-    rv = mxp_alloc_control(mc,
-			   NULL,
-			   IPMI_CONTROL_POWER,
-			   "power",
-			   board_power_set,
-			   board_power_get,
-			   &sinfo->power);
-    if (rv)
-	goto out_err;
-    ipmi_control_set_num_elements(sinfo->power, 1);
-    ipmi_control_set_hot_swap_power(sinfo->power, 1);
-    rv = mxp_add_control(mc, 
-			 &sinfo->power,
-			 MXP_BOARD_POWER_NUM,
-			 ent);
-    if (rv)
-	goto out_err;
-
-    /* Blue LED control */
-    rv = mxp_alloc_control(mc,
-			   NULL,
-			   IPMI_CONTROL_LIGHT,
-			   "blue led",
-			   board_blue_led_set,
-			   board_blue_led_get,
-			   &sinfo->blue_led);
-    if (rv)
-	goto out_err;
-    ipmi_control_light_set_lights(sinfo->blue_led, 1, blue_blinking_led);
-    ipmi_control_set_hot_swap_indicator(sinfo->blue_led, 1, 1, 0, 2, 1);
-    rv = mxp_add_control(mc, 
-			 &sinfo->blue_led,
-			 MXP_BOARD_BLUE_LED_NUM,
-			 ent);
-    if (rv)
-	goto out_err;
-
-    /* Slot gegraphic address */
-    rv = mxp_alloc_id_control(mc, ent,
-			      MXP_BOARD_SLOT_GA_NUM,
-			      NULL,
-			      IPMI_CONTROL_IDENTIFIER,
-			      "Geog Addr",
-			      1,
-			      NULL,
-			      slot_ga_get,
-			      &sinfo->slot_ga);
-    if (rv)
-	goto out_err;
-
-    /* Board power mode */
-    rv = mxp_alloc_control(mc,
-			   NULL,
-			   IPMI_CONTROL_OUTPUT,
-			   "Power Config",
-			   board_power_config_set,
-			   board_power_config_get,
-			   &sinfo->power_config);
-    if (rv)
-	goto out_err;
-    ipmi_control_set_num_elements(sinfo->power_config, 3);
-    rv = mxp_add_control(mc, 
-			 &sinfo->power_config,
-			 MXP_BOARD_POWER_CONFIG_NUM,
-			 ent);
-    if (rv)
-	goto out_err;
-
-    /* The Chassis ID. */
-    rv = mxp_alloc_id_control(mc, ent,
-			      MXP_BOARD_CHASSIS_ID_CONTROL_NUM,
-			      NULL,
-			      IPMI_CONTROL_IDENTIFIER,
-			      "Chassis ID",
-			      4,
-			      chassis_id_set,
-			      chassis_id_get,
-			      &sinfo->chassis_id);
-    if (rv)
-	goto out_err;
-
- out_err:
-    return rv;
+    return mxp_create_from_defs(mc, ent, NULL, sinfo,
+				mxp_board_sinfo_defs,
+				MXP_NUM_DEFS(mxp_board_sinfo_defs),
+				0, 0, 0);
 }
 
 /***********************************************************************
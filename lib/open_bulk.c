@@ -0,0 +1,328 @@
+/*
+ * open_bulk.c
+ *
+ * Open a set of domains from a host inventory
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_lan.h>
+
+#include <OpenIPMI/internal/ipmi_int.h>
+#include <OpenIPMI/internal/ipmi_locks.h>
+
+enum bulk_state_e { BULK_WAITING, BULK_OPENING, BULK_CONNECTED, BULK_FAILED };
+
+typedef struct open_bulk_s open_bulk_t;
+
+typedef struct bulk_ent_s
+{
+    open_bulk_t       *bulk;
+    unsigned int      idx;
+    enum bulk_state_e state;
+    ipmi_domain_id_t  domain_id;
+} bulk_ent_t;
+
+struct open_bulk_s
+{
+    ipmi_lock_t               *lock;
+    ipmi_open_inventory_t     *inv;
+    ipmi_args_t               *tmpl;
+    os_handler_t              *os_hnd;
+    unsigned int              window;
+    ipmi_open_option_t        *options;
+    unsigned int              num_options;
+    ipmi_domain_ptr_cb        domain_fully_up;
+    void                      *domain_fully_up_cb_data;
+    ipmi_open_bulk_cb         progress;
+    ipmi_open_bulk_done_cb    done;
+    void                      *cb_data;
+
+    ipmi_open_bulk_progress_t counts;
+    unsigned int              next;
+
+    /* Someone is in bulk_fill(), results that come in meanwhile leave
+       starting the next entries and calling done to it. */
+    int                       filling;
+    int                       done_called;
+
+    bulk_ent_t                ents[0];
+};
+
+static void bulk_domain_change(ipmi_domain_t      *domain,
+			       enum ipmi_update_e op,
+			       void               *cb_data);
+
+static void
+bulk_free(open_bulk_t *bulk)
+{
+    ipmi_domain_remove_domain_change_handler(bulk_domain_change, bulk);
+    if (bulk->lock)
+	ipmi_destroy_lock(bulk->lock);
+    ipmi_mem_free(bulk);
+}
+
+/* Called with the lock held, releases it. */
+static void
+bulk_check_done(open_bulk_t *bulk)
+{
+    ipmi_open_bulk_progress_t counts;
+
+    if (bulk->filling || bulk->done_called
+	|| (bulk->counts.connected + bulk->counts.failed < bulk->counts.total))
+    {
+	ipmi_unlock(bulk->lock);
+	return;
+    }
+    bulk->done_called = 1;
+    counts = bulk->counts;
+    ipmi_unlock(bulk->lock);
+
+    if (bulk->done)
+	bulk->done(&counts, bulk->cb_data);
+    bulk_free(bulk);
+}
+
+/* Give entry its first result.  Returns false if it already had
+   one. */
+static int
+bulk_result(bulk_ent_t *ent, ipmi_domain_t *domain, int err)
+{
+    open_bulk_t               *bulk = ent->bulk;
+    ipmi_open_bulk_progress_t counts;
+    ipmi_domain_id_t          domain_id;
+
+    ipmi_lock(bulk->lock);
+    if (ent->state != BULK_OPENING) {
+	ipmi_unlock(bulk->lock);
+	return 0;
+    }
+    bulk->counts.opening--;
+    if (err) {
+	ent->state = BULK_FAILED;
+	bulk->counts.failed++;
+    } else {
+	ent->state = BULK_CONNECTED;
+	bulk->counts.connected++;
+    }
+    if (domain)
+	ent->domain_id = ipmi_domain_convert_to_id(domain);
+    domain_id = ent->domain_id;
+    counts = bulk->counts;
+    ipmi_unlock(bulk->lock);
+
+    if (bulk->progress)
+	bulk->progress(ent->idx, domain_id, err, &counts, bulk->cb_data);
+    return 1;
+}
+
+static void bulk_fill(open_bulk_t *bulk);
+
+static void
+bulk_con_change(ipmi_domain_t *domain,
+		int           err,
+		unsigned int  conn_num,
+		unsigned int  port_num,
+		int           still_connected,
+		void          *cb_data)
+{
+    bulk_ent_t *ent = cb_data;
+
+    if (!still_connected && !err)
+	return;
+
+    /* Only the first result matters here, after that the user's own
+       handlers take over. */
+    ipmi_domain_remove_connect_change_handler(domain, bulk_con_change, ent);
+    if (bulk_result(ent, domain, still_connected ? 0 : err))
+	bulk_fill(ent->bulk);
+}
+
+static void
+bulk_domain_change(ipmi_domain_t      *domain,
+		   enum ipmi_update_e op,
+		   void               *cb_data)
+{
+    open_bulk_t      *bulk = cb_data;
+    ipmi_domain_id_t domain_id;
+    unsigned int     i;
+    bulk_ent_t       *ent = NULL;
+
+    if (op != IPMI_DELETED)
+	return;
+
+    /* A domain closed before it got a connection result. */
+    domain_id = ipmi_domain_convert_to_id(domain);
+    ipmi_lock(bulk->lock);
+    for (i=0; i<bulk->next; i++) {
+	if ((bulk->ents[i].state == BULK_OPENING)
+	    && (ipmi_cmp_domain_id(bulk->ents[i].domain_id, domain_id) == 0))
+	{
+	    ent = &bulk->ents[i];
+	    break;
+	}
+    }
+    ipmi_unlock(bulk->lock);
+
+    if (ent && bulk_result(ent, NULL, ECANCELED))
+	bulk_fill(bulk);
+}
+
+static int
+bulk_open_one(open_bulk_t *bulk, bulk_ent_t *ent)
+{
+    ipmi_open_inventory_t *inv = &bulk->inv[ent->idx];
+    ipmi_args_t           *args = inv->args;
+    ipmi_con_t            *con;
+    int                   rv = 0;
+
+    if (!args) {
+	if (!bulk->tmpl)
+	    return EINVAL;
+	args = ipmi_args_copy(bulk->tmpl);
+	if (!args)
+	    return ENOMEM;
+	if (inv->address)
+	    rv = ipmi_args_set_val(args, 0, "Address", inv->address);
+	if (!rv && inv->port)
+	    rv = ipmi_args_set_val(args, 0, "Port", inv->port);
+    }
+    if (!rv)
+	rv = ipmi_args_setup_con(args, bulk->os_hnd, NULL, &con);
+    if (args != inv->args)
+	ipmi_free_args(args);
+    if (rv)
+	return rv;
+
+    rv = ipmi_open_domain(inv->name, &con, 1, bulk_con_change, ent,
+			  bulk->domain_fully_up, bulk->domain_fully_up_cb_data,
+			  bulk->options, bulk->num_options, &ent->domain_id);
+    if (rv)
+	con->close_connection(con);
+    return rv;
+}
+
+static void
+bulk_fill(open_bulk_t *bulk)
+{
+    bulk_ent_t *ent;
+    int        rv;
+
+    ipmi_lock(bulk->lock);
+    if (bulk->filling) {
+	ipmi_unlock(bulk->lock);
+	return;
+    }
+    bulk->filling = 1;
+    while ((bulk->next < bulk->counts.total)
+	   && (!bulk->window || (bulk->counts.opening < bulk->window)))
+    {
+	ent = &bulk->ents[bulk->next];
+	bulk->next++;
+	ent->state = BULK_OPENING;
+	bulk->counts.waiting--;
+	bulk->counts.opening++;
+	ipmi_unlock(bulk->lock);
+
+	rv = bulk_open_one(bulk, ent);
+	if (rv)
+	    bulk_result(ent, NULL, rv);
+
+	ipmi_lock(bulk->lock);
+    }
+    bulk->filling = 0;
+    bulk_check_done(bulk);
+}
+
+int
+ipmi_open_bulk(ipmi_open_inventory_t  *inv,
+	       unsigned int           count,
+	       ipmi_args_t            *tmpl,
+	       os_handler_t           *handlers,
+	       unsigned int           window,
+	       ipmi_open_option_t     *options,
+	       unsigned int           num_options,
+	       ipmi_domain_ptr_cb     domain_fully_up,
+	       void                   *domain_fully_up_cb_data,
+	       ipmi_open_bulk_cb      progress,
+	       ipmi_open_bulk_done_cb done,
+	       void                   *cb_data)
+{
+    open_bulk_t  *bulk;
+    unsigned int i;
+    int          rv;
+
+    if (!inv || !count || !handlers)
+	return EINVAL;
+
+    bulk = ipmi_mem_alloc(sizeof(*bulk) + (count * sizeof(bulk_ent_t)));
+    if (!bulk)
+	return ENOMEM;
+    memset(bulk, 0, sizeof(*bulk) + (count * sizeof(bulk_ent_t)));
+
+    rv = ipmi_create_global_lock(&bulk->lock);
+    if (rv) {
+	ipmi_mem_free(bulk);
+	return rv;
+    }
+    rv = ipmi_domain_add_domain_change_handler(bulk_domain_change, bulk);
+    if (rv) {
+	ipmi_destroy_lock(bulk->lock);
+	ipmi_mem_free(bulk);
+	return rv;
+    }
+
+    bulk->inv = inv;
+    bulk->tmpl = tmpl;
+    bulk->os_hnd = handlers;
+    if (!window)
+	window = ipmi_lan_get_max_connecting();
+    bulk->window = window;
+    bulk->options = options;
+    bulk->num_options = num_options;
+    bulk->domain_fully_up = domain_fully_up;
+    bulk->domain_fully_up_cb_data = domain_fully_up_cb_data;
+    bulk->progress = progress;
+    bulk->done = done;
+    bulk->cb_data = cb_data;
+    bulk->counts.total = count;
+    bulk->counts.waiting = count;
+    for (i=0; i<count; i++) {
+	bulk->ents[i].bulk = bulk;
+	bulk->ents[i].idx = i;
+	ipmi_domain_id_set_invalid(&bulk->ents[i].domain_id);
+    }
+
+    bulk_fill(bulk);
+    return 0;
+}
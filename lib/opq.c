@@ -43,11 +43,14 @@
 struct opq_elem_s
 {
     int               block;
+    int               prio;
+    int               concurrent;
     opq_handler_cb    handler;
     void              *handler_data;
     opq_done_cb       done;
     void              *done_data;
     struct opq_elem_s *next;
+    struct timeval    queued;
     ilist_item_t      ilist_item;
 };
 
@@ -55,12 +58,18 @@ struct opq_s
 {
     ilist_t        *ops;
     os_hnd_lock_t  *lock;
-    int            in_handler;
+    unsigned int   in_handler; /* The number of running operations. */
+    int            exclusive;  /* The running operation is not concurrent. */
+    unsigned int   max_running;
     os_handler_t   *os_hnd;
     opq_done_cb    done_handler;
     void           *done_data;
     int            blocked;
     int            in_destroy;
+    int            curr_prio; /* Priority of the running operation. */
+    opq_wait_cb    wait_handler;
+    void           (*wait_free)(void *cb_data);
+    void           *wait_cb_data;
 };
 
 static void
@@ -90,6 +99,7 @@ opq_alloc(os_handler_t *os_hnd)
 
     opq->os_hnd = os_hnd;
     opq->in_handler = 0;
+    opq->max_running = 1;
     opq->ops = alloc_ilist();
     if (!(opq->ops)) {
 	ipmi_mem_free(opq);
@@ -137,36 +147,114 @@ opq_destroy(opq_t *opq)
 
     ilist_iter(opq->ops, opq_destroy_item, NULL);
     free_ilist(opq->ops);
+    if (opq->wait_free)
+	opq->wait_free(opq->wait_cb_data);
     if (opq->lock)
 	opq->os_hnd->destroy_lock(opq->os_hnd, opq->lock);
     ipmi_mem_free(opq);
 }
 
+void
+opq_set_max_running(opq_t *opq, unsigned int max)
+{
+    if (max == 0)
+	max = 1;
+    opq_lock(opq);
+    opq->max_running = max;
+    opq_unlock(opq);
+}
+
+void
+opq_set_wait_handler(opq_t       *opq,
+		     opq_wait_cb handler,
+		     void        (*free_cb)(void *cb_data),
+		     void        *cb_data)
+{
+    opq_lock(opq);
+    opq->wait_handler = handler;
+    opq->wait_free = free_cb;
+    opq->wait_cb_data = cb_data;
+    opq_unlock(opq);
+}
+
+/* Report how long a queued operation waited. */
+static void
+report_wait(opq_t *opq, opq_elem_t *elem)
+{
+    struct timeval now;
+    long           ms;
+
+    opq->os_hnd->get_monotonic_time(opq->os_hnd, &now);
+    ms = ((now.tv_sec - elem->queued.tv_sec) * 1000
+	  + (now.tv_usec - elem->queued.tv_usec) / 1000);
+    if (ms < 0)
+	ms = 0;
+    opq->wait_handler(opq->wait_cb_data, ms);
+}
+
+/* Must be called with the lock held.  Returns true if an operation
+   can be started now. */
+static int
+can_start(opq_t *opq, int concurrent)
+{
+    if (concurrent)
+	return !opq->exclusive && (opq->in_handler < opq->max_running);
+    return opq->in_handler == 0;
+}
+
+/* Must be called with the lock held.  Mark an operation as running. */
+static void
+op_started(opq_t *opq, int concurrent, int prio,
+	   opq_done_cb done, void *done_data)
+{
+    opq->in_handler++;
+    if (!concurrent) {
+	opq->exclusive = 1;
+	opq->done_handler = done;
+	opq->done_data = done_data;
+	opq->curr_prio = prio;
+    }
+}
+
+/* Must be called with the lock held.  Mark an operation as no longer
+   running. */
+static void
+op_finished(opq_t *opq)
+{
+    opq->in_handler--;
+    opq->exclusive = 0;
+}
+
+/* Must be called with the lock held.  Start everything at the head
+   of the queue that can run. */
 static void
 start_next_op(opq_t *opq)
 {
     ilist_iter_t iter;
     opq_elem_t   *elem;
     int          success;
+    int          concurrent;
 
     ilist_init_iter(&iter, opq->ops);
     ilist_first(&iter);
     elem = ilist_get(&iter);
-    while (elem) {
+    while (elem && can_start(opq, elem->concurrent)) {
+	concurrent = elem->concurrent;
 	ilist_delete(&iter);
-	opq->done_handler = elem->done;
-	opq->done_data = elem->done_data;
+	op_started(opq, concurrent, elem->prio, elem->done, elem->done_data);
 	opq_unlock(opq);
+	IPMI_TRACE(IPMI_TRACE_OPQ_START, NULL, opq, elem->handler_data, 0,
+		   -1, -1);
+	if (opq->wait_handler)
+	    report_wait(opq, elem);
 	success = elem->handler(elem->handler_data, 0);
 	opq_free_elem(elem);
 	opq_lock(opq);
-	if (success == OPQ_HANDLER_STARTED)
-	    break;
+	if (success != OPQ_HANDLER_STARTED)
+	    op_finished(opq);
 	ilist_first(&iter);
 	elem = ilist_get(&iter);
     }
-    if (!elem)
-	opq->in_handler = 0;
 }
 
 opq_elem_t *
@@ -183,14 +271,55 @@ opq_free_elem(opq_elem_t *elem)
     ipmi_mem_free(elem);
 }
 
-int
-opq_new_op_prio(opq_t *opq, opq_handler_cb handler, void *cb_data,
-		int nowait, int prio, opq_elem_t *elem)
+/* Must be called with the lock held.  Operations are kept sorted by
+   priority.  Normally an operation goes after everything of its
+   priority, if "first" is set it goes ahead of them. */
+static void
+queue_elem(opq_t *opq, opq_elem_t *elem, int first)
 {
-    int        success;
+    ilist_iter_t iter;
+    opq_elem_t   *e;
+
+    IPMI_TRACE(IPMI_TRACE_OPQ_ENQUEUE, NULL, opq, elem->handler_data, 0,
+	       -1, -1);
+    if (opq->wait_handler)
+	opq->os_hnd->get_monotonic_time(opq->os_hnd, &elem->queued);
+    if (elem->prio >= OPQ_ADD_HEAD) {
+	ilist_add_head(opq->ops, elem, &elem->ilist_item);
+	return;
+    }
+
+    /* The usual case, everything queued is the same or higher
+       priority. */
+    ilist_init_iter(&iter, opq->ops);
+    if (!first) {
+	ilist_last(&iter);
+	e = ilist_get(&iter);
+	if (!e || (e->prio >= elem->prio)) {
+	    ilist_add_tail(opq->ops, elem, &elem->ilist_item);
+	    return;
+	}
+    }
+
+    ilist_unpositioned(&iter);
+    while (ilist_next(&iter)) {
+	e = ilist_get(&iter);
+	if ((e->prio < elem->prio) || (first && (e->prio == elem->prio))) {
+	    ilist_add_before(&iter, elem, &elem->ilist_item);
+	    return;
+	}
+    }
+    ilist_add_tail(opq->ops, elem, &elem->ilist_item);
+}
+
+static int
+new_op(opq_t *opq, opq_handler_cb handler, void *cb_data,
+       int nowait, int prio, int concurrent, opq_elem_t *elem)
+{
+    int success;
 
     opq_lock(opq);
-    if (opq->in_handler) {
+    if (!ilist_empty(opq->ops) || !can_start(opq, concurrent)) {
 	if (nowait) {
 	    opq_unlock(opq);
 	    return -1;
@@ -204,23 +333,23 @@ opq_new_op_prio(opq_t *opq, opq_handler_cb handler, void *cb_data,
 	elem->done = NULL;
 	elem->handler_data = cb_data;
 	elem->block = 1;
-	if (prio)
-	    ilist_add_head(opq->ops, elem, &elem->ilist_item);
-	else
-	    ilist_add_tail(opq->ops, elem, &elem->ilist_item);
+	elem->prio = prio;
+	elem->concurrent = concurrent;
+	queue_elem(opq, elem, 0);
 	opq->blocked = 0;
 	opq_unlock(opq);
     } else {
 	if (elem)
 	    opq_free_elem(elem);
 	opq->blocked = 0;
-	opq->in_handler = 1;
-	opq->done_handler = NULL;
+	op_started(opq, concurrent, prio, NULL, NULL);
 	opq_unlock(opq);
+	IPMI_TRACE(IPMI_TRACE_OPQ_START, NULL, opq, cb_data, 0, -1, -1);
 	success = handler(cb_data, 0);
 	if (success == OPQ_HANDLER_ABORTED) {
 	    /* In case any were added while I was unlocked. */
 	    opq_lock(opq);
+	    op_finished(opq);
 	    start_next_op(opq);
 	    opq_unlock(opq);
 	}
@@ -233,10 +362,24 @@ opq_new_op_prio(opq_t *opq, opq_handler_cb handler, void *cb_data,
     return 0;
 }
 
+int
+opq_new_op_prio(opq_t *opq, opq_handler_cb handler, void *cb_data,
+		int nowait, int prio, opq_elem_t *elem)
+{
+    return new_op(opq, handler, cb_data, nowait, prio, 0, elem);
+}
+
 int
 opq_new_op(opq_t *opq, opq_handler_cb handler, void *cb_data, int nowait)
 {
-    return opq_new_op_prio(opq, handler, cb_data, nowait, OPQ_ADD_TAIL, NULL);
+    return new_op(opq, handler, cb_data, nowait, OPQ_ADD_TAIL, 0, NULL);
+}
+
+int
+opq_new_op_concurrent(opq_t *opq, opq_handler_cb handler, void *cb_data,
+		      int nowait)
+{
+    return new_op(opq, handler, cb_data, nowait, OPQ_PRIO_NORMAL, 1, NULL);
 }
 
 int
@@ -250,7 +393,7 @@ opq_new_op_with_done(opq_t          *opq,
     int        success;
 
     opq_lock(opq);
-    if (opq->in_handler) {
+    if (!ilist_empty(opq->ops) || !can_start(opq, 0)) {
 	elem = ipmi_mem_alloc(sizeof(*elem));
 	if (!elem)
 	    goto out_err;
@@ -259,19 +402,21 @@ opq_new_op_with_done(opq_t          *opq,
 	elem->done = done;
 	elem->done_data = done_data;
 	elem->block = opq->blocked;
-	ilist_add_tail(opq->ops, elem, &elem->ilist_item);
+	elem->prio = OPQ_PRIO_NORMAL;
+	elem->concurrent = 0;
+	queue_elem(opq, elem, 0);
 	opq->blocked = 0;
 	opq_unlock(opq);
     } else {
 	opq->blocked = 0;
-	opq->in_handler = 1;
-	opq->done_handler = done;
-	opq->done_data = done_data;
+	op_started(opq, 0, OPQ_PRIO_NORMAL, done, done_data);
 	opq_unlock(opq);
+	IPMI_TRACE(IPMI_TRACE_OPQ_START, NULL, opq, handler_data, 0, -1, -1);
 	success = handler(handler_data, 0);
 	if (success == OPQ_HANDLER_ABORTED) {
 	    /* In case any were added while I was unlocked. */
 	    opq_lock(opq);
+	    op_finished(opq);
 	    start_next_op(opq);
 	    opq_unlock(opq);
 	}
@@ -303,8 +448,18 @@ opq_op_done(opq_t *opq)
     opq_done_cb    done_handler;
     void           *done_data;
 
-    /* First check for done handlers. */
+    IPMI_TRACE(IPMI_TRACE_OPQ_DONE, NULL, opq, NULL, 0, -1, -1);
     opq_lock(opq);
+    if (!opq->exclusive) {
+	/* A concurrent operation finished, they have no done
+	   handlers. */
+	op_finished(opq);
+	start_next_op(opq);
+	opq_unlock(opq);
+	return;
+    }
+
+    /* First check for done handlers. */
     ilist_init_iter(&iter, opq->ops);
     ilist_first(&iter);
     elem = ilist_get(&iter);
@@ -332,17 +487,76 @@ opq_op_done(opq_t *opq)
 	}
 
 	opq_lock(opq);
-	/* During the time we were unlocked, handlers may have been
-           added. */
-	ilist_first(&iter);
-	elem = ilist_get(&iter);
     }
+    op_finished(opq);
     start_next_op(opq);
     opq_unlock(opq);
 }
 
+/* Must be called with the lock held. */
+static int
+preempt_pending(opq_t *opq)
+{
+    ilist_iter_t iter;
+    opq_elem_t   *elem;
+
+    if (!opq->exclusive)
+	return 0;
+    ilist_init_iter(&iter, opq->ops);
+    ilist_first(&iter);
+    elem = ilist_get(&iter);
+    return elem && (elem->prio > opq->curr_prio);
+}
+
+int
+opq_preempt_pending(opq_t *opq)
+{
+    int rv;
+
+    opq_lock(opq);
+    rv = preempt_pending(opq);
+    opq_unlock(opq);
+    return rv;
+}
+
+int
+opq_op_yield(opq_t *opq, opq_handler_cb handler, void *cb_data)
+{
+    opq_elem_t *elem;
+
+    opq_lock(opq);
+    if (!preempt_pending(opq)) {
+	opq_unlock(opq);
+	return 0;
+    }
+
+    elem = opq_alloc_elem();
+    if (!elem) {
+	/* Just keep running the current operation. */
+	opq_unlock(opq);
+	return 0;
+    }
+
+    /* The rest of the operation runs later as a new operation, it
+       keeps the done handler and must not be collapsed with the done
+       handlers after it. */
+    elem->handler = handler;
+    elem->handler_data = cb_data;
+    elem->done = opq->done_handler;
+    elem->done_data = opq->done_data;
+    elem->block = 1;
+    elem->prio = opq->curr_prio;
+    elem->concurrent = 0;
+    queue_elem(opq, elem, 1);
+    opq->done_handler = NULL;
+    op_finished(opq);
+    start_next_op(opq);
+    opq_unlock(opq);
+    return 1;
+}
+
 int
 opq_stuff_in_progress(opq_t *opq)
 {
-    return opq->in_handler;
+    return opq->in_handler != 0;
 }
@@ -655,16 +655,20 @@ start_config_fetch(void *cb_data, int shutdown)
     return OPQ_HANDLER_STARTED;
 }
 
-int
-ipmi_pef_get_parm(ipmi_pef_t      *pef,
-		  unsigned int    parm,
-		  unsigned int    set,
-		  unsigned int    block,
-		  ipmi_pef_get_cb done,
-		  void            *cb_data)
+/* If concurrent is true, the fetch may run at the same time as other
+   concurrent operations on the PEF, up to the opq's maximum. */
+static int
+pef_get_parm(ipmi_pef_t      *pef,
+	     unsigned int    parm,
+	     unsigned int    set,
+	     unsigned int    block,
+	     ipmi_pef_get_cb done,
+	     void            *cb_data,
+	     int             concurrent)
 {
     pef_fetch_handler_t *elem;
     int                 rv = 0;
+    int                 success;
 
     if (pef->destroyed)
 	return EINVAL;
@@ -688,7 +692,11 @@ ipmi_pef_get_parm(ipmi_pef_t      *pef,
     elem->rv = 0;
 
     pef_get(pef);
-    if (!opq_new_op(pef->opq, start_config_fetch, elem, 0)) {
+    if (concurrent)
+	success = opq_new_op_concurrent(pef->opq, start_config_fetch, elem, 0);
+    else
+	success = opq_new_op(pef->opq, start_config_fetch, elem, 0);
+    if (!success) {
 	pef_put(pef);
 	rv = ENOMEM;
     }
@@ -699,6 +707,17 @@ ipmi_pef_get_parm(ipmi_pef_t      *pef,
     return rv;
 }
 
+int
+ipmi_pef_get_parm(ipmi_pef_t      *pef,
+		  unsigned int    parm,
+		  unsigned int    set,
+		  unsigned int    block,
+		  ipmi_pef_get_cb done,
+		  void            *cb_data)
+{
+    return pef_get_parm(pef, parm, set, block, done, cb_data, 0);
+}
+
 typedef struct pef_set_handler_s
 {
     ipmi_pef_t 		*pef;
@@ -817,16 +836,20 @@ start_config_set(void *cb_data, int shutdown)
     return OPQ_HANDLER_STARTED;
 }
 
-int
-ipmi_pef_set_parm(ipmi_pef_t       *pef,
-		  unsigned int     parm,
-		  unsigned char    *data,
-		  unsigned int     data_len,
-		  ipmi_pef_done_cb done,
-		  void             *cb_data)
+/* If concurrent is true, the set may run at the same time as other
+   concurrent operations on the PEF, up to the opq's maximum. */
+static int
+pef_set_parm(ipmi_pef_t       *pef,
+	     unsigned int     parm,
+	     unsigned char    *data,
+	     unsigned int     data_len,
+	     ipmi_pef_done_cb done,
+	     void             *cb_data,
+	     int              concurrent)
 {
     pef_set_handler_t *elem;
     int               rv = 0;
+    int               success;
 
     if (pef->destroyed)
 	return EINVAL;
@@ -854,7 +877,11 @@ ipmi_pef_set_parm(ipmi_pef_t       *pef,
 
     
     pef_get(pef);
-    if (!opq_new_op(pef->opq, start_config_set, elem, 0)) {
+    if (concurrent)
+	success = opq_new_op_concurrent(pef->opq, start_config_set, elem, 0);
+    else
+	success = opq_new_op(pef->opq, start_config_set, elem, 0);
+    if (!success) {
 	pef_put(pef);
 	rv = ENOMEM;
     }
@@ -865,6 +892,17 @@ ipmi_pef_set_parm(ipmi_pef_t       *pef,
     return rv;
 }
 
+int
+ipmi_pef_set_parm(ipmi_pef_t       *pef,
+		  unsigned int     parm,
+		  unsigned char    *data,
+		  unsigned int     data_len,
+		  ipmi_pef_done_cb done,
+		  void             *cb_data)
+{
+    return pef_set_parm(pef, parm, data, data_len, done, cb_data, 0);
+}
+
 int
 ipmi_pef_valid(ipmi_pef_t *pef)
 {
@@ -1013,6 +1051,15 @@ struct ipmi_pef_config_s
     /* Used for deferred errors. */
     int err;
 
+    /* Used to run the parameter fetches and sets in parallel. */
+    os_handler_t  *os_hnd;
+    os_hnd_lock_t *lock;
+    unsigned int  window;
+    unsigned int  outstanding;
+    int           issuing;
+    /* Are the table sizes known, so the tables can be fetched? */
+    int           fetching_tables;
+
     ipmi_pef_done_cb       set_done;
     ipmi_pef_get_config_cb done;
     void                   *cb_data;
@@ -1569,6 +1616,66 @@ static pefparms_t pefparms[NUM_PEFPARMS] =
     { 1, 0, 0, 18, gas,  sas  }, /* IPMI_PEFPARM_ALERT_STRING		     */
 };
 
+static void
+pefc_lock(ipmi_pef_config_t *pefc)
+{
+    if (pefc->lock)
+	pefc->os_hnd->lock(pefc->os_hnd, pefc->lock);
+}
+
+static void
+pefc_unlock(ipmi_pef_config_t *pefc)
+{
+    if (pefc->lock)
+	pefc->os_hnd->unlock(pefc->os_hnd, pefc->lock);
+}
+
+static int
+pefc_alloc_lock(ipmi_pef_config_t *pefc, ipmi_pef_t *pef)
+{
+    pefc->os_hnd = pef->os_hnd;
+    pefc->lock = NULL;
+    if (pef->os_hnd->create_lock)
+	return pef->os_hnd->create_lock(pef->os_hnd, &pefc->lock);
+    return 0;
+}
+
+static void
+pef_window_cb(ipmi_mc_t *mc, void *cb_data)
+{
+    unsigned int *window = cb_data;
+
+    *window = _ipmi_mc_op_concurrency(mc);
+}
+
+/* Get how many parameter operations may be outstanding at once and
+   let the opq run that many. */
+static unsigned int
+pef_op_window(ipmi_pef_t *pef)
+{
+    unsigned int window = 1;
+
+    ipmi_mc_pointer_cb(pef->mc, pef_window_cb, &window);
+    if (window == 0)
+	window = 1;
+    opq_set_max_running(pef->opq, window);
+    return window;
+}
+
+static int
+pef_parm_is_table(int parm)
+{
+    switch (parm) {
+    case IPMI_PEFPARM_EVENT_FILTER_TABLE:
+    case IPMI_PEFPARM_ALERT_POLICY_TABLE:
+    case IPMI_PEFPARM_ALERT_STRING_KEY:
+    case IPMI_PEFPARM_ALERT_STRING:
+	return 1;
+    default:
+	return 0;
+    }
+}
+
 static void
 err_lock_cleared(ipmi_pef_t *pef,
 		 int        err,
@@ -1581,183 +1688,249 @@ err_lock_cleared(ipmi_pef_t *pef,
     pef_put(pef);
 }
 
-static void
-got_parm(ipmi_pef_t     *pef,
-	 int            err,
-	 unsigned char  *data,
-	 unsigned int   data_len,
-	 void           *cb_data)
+typedef struct pef_get_req_s
 {
-    ipmi_pef_config_t *pefc = cb_data;
-    pefparms_t        *lp = &(pefparms[pefc->curr_parm]);
+    ipmi_pef_config_t *pefc;
+    unsigned char     parm;
+    unsigned char     sel;
+    unsigned char     block;
+} pef_get_req_t;
+
+/* Find the next parameter to fetch.  All the non-table parameters
+   (including the table sizes) are fetched first, then the tables.
+   Returns 0 if nothing is left to fetch in the current stage.  Must
+   be called with the config locked. */
+static int
+pef_next_get(ipmi_pef_config_t *pefc, pef_get_req_t *req)
+{
+    int parm;
 
-    /* Check the length, and don't forget the revision byte must be added. */
-    if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "ipmi_pefparm_got_parm:"
-		 " Invalid data length on parm %d was %d, should have been %d",
-		 pefc->curr_parm, data_len, lp->length+1);
-	err = EINVAL;
-	goto done;
-    }
+    for (;;) {
+	parm = pefc->curr_parm;
 
-    err = lp->get_handler(pefc, lp, err, data, data_len);
-    if (err) {
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "ipmi_pefparm_got_parm: Error fetching parm %d: %x",
-		 pefc->curr_parm, err);
-	goto done;
-    }
+	if (!pefc->fetching_tables) {
+	    if (parm > IPMI_PEFPARM_NUM_ALERT_STRINGS)
+		return 0;
+	    pefc->curr_parm++;
+	    if ((!pefparms[parm].valid) || pef_parm_is_table(parm))
+		continue;
+	    req->sel = 0;
+	    break;
+	}
 
- next_parm:
-    switch (pefc->curr_parm) {
-    case IPMI_PEFPARM_NUM_EVENT_FILTERS:
-	pefc->curr_parm++;
-	if (pefc->num_event_filters == 0)
-	    pefc->curr_parm = IPMI_PEFPARM_NUM_ALERT_POLICIES;
-	else
-	    pefc->curr_sel = 1;
-	break;
+	switch (parm) {
+	case IPMI_PEFPARM_EVENT_FILTER_TABLE:
+	    if (pefc->curr_sel > pefc->num_event_filters) {
+		pefc->curr_parm = IPMI_PEFPARM_ALERT_POLICY_TABLE;
+		pefc->curr_sel = 1;
+		continue;
+	    }
+	    break;
 
-    case IPMI_PEFPARM_EVENT_FILTER_TABLE:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
-	    /* Yikes, wrong selector came back! */
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "ipmi_pefparm_got_parm: Error fetching eft %d,"
-		     " wrong selector came back, expecting %d, was %d",
-		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
-	    err = EINVAL;
-	    goto done;
+	case IPMI_PEFPARM_ALERT_POLICY_TABLE:
+	    if (pefc->curr_sel > pefc->num_alert_policies) {
+		pefc->curr_parm = IPMI_PEFPARM_ALERT_STRING_KEY;
+		pefc->curr_sel = 0;
+		continue;
+	    }
+	    break;
+
+	case IPMI_PEFPARM_ALERT_STRING_KEY:
+	    if (pefc->curr_sel >= pefc->num_alert_strings) {
+		pefc->curr_parm = IPMI_PEFPARM_ALERT_STRING;
+		pefc->curr_sel = 0;
+		continue;
+	    }
+	    break;
+
+	case IPMI_PEFPARM_ALERT_STRING:
+	    if (pefc->curr_sel >= pefc->num_alert_strings)
+		return 0;
+	    break;
+
+	default:
+	    return 0;
 	}
+	req->sel = pefc->curr_sel;
 	pefc->curr_sel++;
-	if (pefc->curr_sel > pefc->num_event_filters) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
-	}
 	break;
+    }
 
-    case IPMI_PEFPARM_NUM_ALERT_POLICIES:
-	pefc->curr_parm++;
-	if (pefc->num_alert_policies == 0)
-	    pefc->curr_parm = IPMI_PEFPARM_NUM_ALERT_STRINGS;
-	else
-	    pefc->curr_sel = 1;
-	break;
+    req->parm = parm;
+    req->block = (parm == IPMI_PEFPARM_ALERT_STRING);
+    return 1;
+}
 
-    case IPMI_PEFPARM_ALERT_POLICY_TABLE:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
-	    /* Yikes, wrong selector came back! */
+static void
+pef_get_done(ipmi_pef_t *pef, ipmi_pef_config_t *pefc)
+{
+    unsigned char data[1];
+    int           err;
+
+    if (pefc->err) {
+	/* Clear the lock */
+	data[0] = 0;
+	err = ipmi_pef_set_parm(pef, 0, data, 1, err_lock_cleared, pefc);
+	if (err) {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "ipmi_pefparm_got_parm: Error fetching apt %d,"
-		     " wrong selector came back, expecting %d, was %d",
-		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
-	    err = EINVAL;
-	    goto done;
-	}
-	pefc->curr_sel++;
-	if (pefc->curr_sel > pefc->num_alert_policies) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
+		     "pef.c(pef_get_done): Error trying to clear lock: %x",
+		     err);
+	    pefc->done(pef, pefc->err, NULL, pefc->cb_data);
+	    ipmi_pef_free_config(pefc);
+	    pef_put(pef);
 	}
-	break;
+    } else {
+	pefc->done(pef, 0, pefc, pefc->cb_data);
+	pef_put(pef);
+    }
+}
 
-    case IPMI_PEFPARM_NUM_ALERT_STRINGS:
-	pefc->curr_parm++;
-	if (pefc->num_alert_strings == 0)
-	    goto done;
-	pefc->curr_sel = 0;
-	break;
+static void got_parm(ipmi_pef_t     *pef,
+		     int            err,
+		     unsigned char  *data,
+		     unsigned int   data_len,
+		     void           *cb_data);
 
-    case IPMI_PEFPARM_ALERT_STRING_KEY:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
-	    /* Yikes, wrong selector came back! */
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "ipmi_pefparm_got_parm: Error fetching ask %d,"
-		     " wrong selector came back, expecting %d, was %d",
-		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
-	    err = EINVAL;
-	    goto done;
+/* Start as many parameter fetches as the window allows.  Must be
+   called with the config locked, this will unlock it. */
+static void
+pef_get_issue(ipmi_pef_t *pef, ipmi_pef_config_t *pefc)
+{
+    pef_get_req_t *req;
+    int           rv;
+
+    if (pefc->issuing) {
+	/* Whoever is issuing will see the change. */
+	pefc_unlock(pefc);
+	return;
+    }
+    pefc->issuing = 1;
+
+ restart:
+    while (!pefc->err && (pefc->outstanding < pefc->window)) {
+	req = ipmi_mem_alloc(sizeof(*req));
+	if (!req) {
+	    pefc->err = ENOMEM;
+	    break;
 	}
-	pefc->curr_sel++;
-	if (pefc->curr_sel >= pefc->num_alert_strings) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
-	    pefc->curr_block = 1;
+	req->pefc = pefc;
+	if (!pef_next_get(pefc, req)) {
+	    ipmi_mem_free(req);
+	    break;
 	}
-	break;
 
-    case IPMI_PEFPARM_ALERT_STRING:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
-	    /* Yikes, wrong selector came back! */
+	pefc->outstanding++;
+	pefc_unlock(pefc);
+	rv = pef_get_parm(pef, req->parm, req->sel, req->block,
+			  got_parm, req, 1);
+	pefc_lock(pefc);
+	if (rv) {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "ipmi_pefparm_got_parm: Error fetching ask %d,"
-		     " wrong selector came back, expecting %d, was %d",
-		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
-	    err = EINVAL;
-	    goto done;
+		     "pef.c(pef_get_issue): Error trying to get parm %d: %x",
+		     req->parm, rv);
+	    ipmi_mem_free(req);
+	    pefc->outstanding--;
+	    pefc->err = rv;
 	}
-	if (data[2] != pefc->curr_block) {
-	    /* Yikes, wrong block came back! */
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "ipmi_pefparm_got_parm: Error fetching ask %d,"
-		     " wrong block came back, expecting %d, was %d",
-		     pefc->curr_parm, pefc->curr_block, data[2]);
-	    err = EINVAL;
-	    goto done;
-	}
-	if ((data_len < 19) ||
-	    (memchr(data+3, '\0', data_len-3)))
-	{
-	    /* End of string, either a subsize-block or a nil
-	       character in the data. */
-	    pefc->curr_sel++;
-	    pefc->curr_block = 1;
-	    if (pefc->curr_sel >= pefc->num_alert_strings)
-		goto done;
-	} else {
-	    /* Not at the end yet. */
-	    pefc->curr_block++;
-	}
-	break;
+    }
 
-    default:
-	pefc->curr_parm++;
+    if (pefc->outstanding == 0) {
+	if (!pefc->err && !pefc->fetching_tables) {
+	    /* All the sizes are known now, get the tables. */
+	    pefc->fetching_tables = 1;
+	    pefc->curr_parm = IPMI_PEFPARM_EVENT_FILTER_TABLE;
+	    pefc->curr_sel = 1;
+	    goto restart;
+	}
+	pefc->issuing = 0;
+	pefc_unlock(pefc);
+	pef_get_done(pef, pefc);
+	return;
     }
 
-    lp = &(pefparms[pefc->curr_parm]);
-    if (!lp->valid)
-	goto next_parm;
+    pefc->issuing = 0;
+    pefc_unlock(pefc);
+}
 
-    err = ipmi_pef_get_parm(pef, pefc->curr_parm, pefc->curr_sel, 
-			    pefc->curr_block, got_parm, pefc);
-    if (err)
-	goto done;
+static void
+got_parm(ipmi_pef_t     *pef,
+	 int            err,
+	 unsigned char  *data,
+	 unsigned int   data_len,
+	 void           *cb_data)
+{
+    pef_get_req_t     *req = cb_data;
+    ipmi_pef_config_t *pefc = req->pefc;
+    pefparms_t        *lp = &(pefparms[req->parm]);
 
-    return;
+    pefc_lock(pefc);
+    pefc->outstanding--;
 
- done:
+    if (pefc->err)
+	/* Something else already failed, just let things drain. */
+	goto out;
+
+    /* Check the length, and don't forget the revision byte must be added. */
+    if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "ipmi_pefparm_got_parm:"
+		 " Invalid data length on parm %d was %d, should have been %d",
+		 req->parm, data_len, lp->length+1);
+	err = EINVAL;
+	goto out_err;
+    }
+
+    err = lp->get_handler(pefc, lp, err, data, data_len);
     if (err) {
-	unsigned char data[1];
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "ipmi_pefparm_got_parm: Error fetching parm %d: %x",
+		 req->parm, err);
+	goto out_err;
+    }
 
+    if (pef_parm_is_table(req->parm) && ((data[1] & 0x7f) != req->sel)) {
+	/* Yikes, wrong selector came back! */
 	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "pef.c(got_parm): Error trying to get parm %d: %x",
-		 pefc->curr_parm, err);
-	pefc->err = err;
-	/* Clear the lock */
-	data[0] = 0;
-	err = ipmi_pef_set_parm(pef, 0, data, 1, err_lock_cleared, pefc);
-	if (err) {
+		 "ipmi_pefparm_got_parm: Error fetching parm %d,"
+		 " wrong selector came back, expecting %d, was %d",
+		 req->parm, req->sel, data[1] & 0x7f);
+	err = EINVAL;
+	goto out_err;
+    }
+
+    if (req->parm == IPMI_PEFPARM_ALERT_STRING) {
+	if (data[2] != req->block) {
+	    /* Yikes, wrong block came back! */
 	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "pef.c(got_parm): Error trying to clear lock: %x",
-		     err);
-	    pefc->done(pef, pefc->err, NULL, pefc->cb_data);
-	    ipmi_pef_free_config(pefc);
-	    pef_put(pef);
+		     "ipmi_pefparm_got_parm: Error fetching alert string %d,"
+		     " wrong block came back, expecting %d, was %d",
+		     req->sel, req->block, data[2]);
+	    err = EINVAL;
+	    goto out_err;
+	}
+	if ((data_len >= 19) && (!memchr(data+3, '\0', data_len-3))) {
+	    /* Not at the end of the string yet.  The blocks are
+	       appended as they come in, so fetch the next block of
+	       this string only after this one is done. */
+	    req->block++;
+	    pefc->outstanding++;
+	    pefc_unlock(pefc);
+	    err = pef_get_parm(pef, req->parm, req->sel, req->block,
+			       got_parm, req, 1);
+	    if (!err)
+		return;
+	    pefc_lock(pefc);
+	    pefc->outstanding--;
+	    goto out_err;
 	}
-    } else {
-	pefc->done(pef, 0, pefc, pefc->cb_data);
-	pef_put(pef);
     }
+    goto out;
+
+ out_err:
+    pefc->err = err;
+ out:
+    ipmi_mem_free(req);
+    pef_get_issue(pef, pefc);
 }
 
 static void 
@@ -1766,7 +1939,6 @@ lock_done(ipmi_pef_t *pef,
 	  void       *cb_data)
 {
     ipmi_pef_config_t *pefc = cb_data;
-    int               rv;
 
     if (err == IPMI_IPMI_ERR_VAL(0x80)) {
 	/* Lock is not supported, just mark it and go on. */
@@ -1790,27 +1962,11 @@ lock_done(ipmi_pef_t *pef,
 
     pefc->pef_locked = 1;
 
-    rv = ipmi_pef_get_parm(pef, pefc->curr_parm, pefc->curr_sel, 0,
-			    got_parm, pefc);
-    if (rv) {
-	unsigned char data[1];
-
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "pef.c(lock_done): Error trying to get parm %d: %x",
-		 pefc->curr_parm, rv);
-	pefc->err = rv;
-	/* Clear the lock */
-	data[0] = 0;
-	rv = ipmi_pef_set_parm(pef, 0, data, 1, err_lock_cleared, pefc);
-	if (rv) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "pef.c(lock_done): Error trying to clear lock: %x",
-		     err);
-	    pefc->done(pef, pefc->err, NULL, pefc->cb_data);
-	    ipmi_pef_free_config(pefc);
-	    pef_put(pef);
-	}
-    }
+    /* The parameters are independent of each other (other than the
+       table sizes), so fetch them in parallel. */
+    pefc->window = pef_op_window(pef);
+    pefc_lock(pefc);
+    pef_get_issue(pef, pefc);
 }
 
 int ipmi_pef_get_config(ipmi_pef_t             *pef,
@@ -1826,6 +1982,12 @@ int ipmi_pef_get_config(ipmi_pef_t             *pef,
 	return ENOMEM;
     memset(pefc, 0, sizeof(*pefc));
 
+    rv = pefc_alloc_lock(pefc, pef);
+    if (rv) {
+	ipmi_mem_free(pefc);
+	return rv;
+    }
+
     pefc->curr_parm = 1;
     pefc->curr_sel = 0;
     pefc->done = done;
@@ -1887,115 +2049,80 @@ commit_done(ipmi_pef_t *pef,
     }
 }
 
-static void 
-set_done(ipmi_pef_t *pef,
-	 int        err,
-	 void       *cb_data)
+/* Move the set on to the next parameter. */
+static void
+pef_set_next_parm(ipmi_pef_config_t *pefc)
 {
-    ipmi_pef_config_t *pefc = cb_data;
-    unsigned char     data[MAX_IPMI_DATA_SIZE];
-    pefparms_t        *lp = &(pefparms[pefc->curr_parm]);
-    unsigned int      length;
-
-    if (err) {
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "Error setting PEF parm %d: %x", pefc->curr_parm, err);
-	goto done;
-    }
-
- next_parm:
-    switch (pefc->curr_parm) {
-    case IPMI_PEFPARM_NUM_EVENT_FILTERS:
-	pefc->curr_parm++;
-	if (pefc->num_event_filters == 0)
-	    pefc->curr_parm = IPMI_PEFPARM_NUM_ALERT_POLICIES;
-	else {
-	    pefc->curr_sel = 1;
-	    data[0] = pefc->curr_sel;
-	}
-	break;
-
-    case IPMI_PEFPARM_EVENT_FILTER_TABLE:
-	pefc->curr_sel++;
-	if (pefc->curr_sel > pefc->num_event_filters) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 1;
-	}
-	data[0] = pefc->curr_sel;
-	break;
+    pefc->curr_parm++;
+    if ((pefc->curr_parm == IPMI_PEFPARM_EVENT_FILTER_TABLE)
+	|| (pefc->curr_parm == IPMI_PEFPARM_ALERT_POLICY_TABLE))
+	pefc->curr_sel = 1;
+    else
+	pefc->curr_sel = 0;
+    pefc->curr_block = 1;
+}
 
-    case IPMI_PEFPARM_NUM_ALERT_POLICIES:
-	pefc->curr_parm++;
-	if (pefc->num_event_filters == 0)
-	    pefc->curr_parm = IPMI_PEFPARM_NUM_ALERT_STRINGS;
-	else {
-	    pefc->curr_sel = 1;
-	    data[0] = pefc->curr_sel;
+/* Format the next parameter to set into data.  Returns the parameter
+   number, or -1 if nothing is left to set.  Must be called with the
+   config locked. */
+static int
+pef_next_set(ipmi_pef_config_t *pefc,
+	     unsigned char     *data,
+	     unsigned int      *length)
+{
+    pefparms_t *lp;
+    int        parm;
+
+    for (;;) {
+	parm = pefc->curr_parm;
+	if (parm >= NUM_PEFPARMS)
+	    return -1;
+
+	lp = &(pefparms[parm]);
+	if ((!lp->valid) || (lp->set_handler == NULL)
+	    || (lp->optional_offset
+		&& !(((unsigned char *) pefc)[lp->optional_offset])))
+	{
+	    /* The parameter is read-only or not supported, just go on. */
+	    pef_set_next_parm(pefc);
+	    continue;
 	}
-	break;
 
-    case IPMI_PEFPARM_ALERT_POLICY_TABLE:
-	pefc->curr_sel++;
-	if (pefc->curr_sel > pefc->num_alert_policies) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
-	}
-	data[0] = pefc->curr_sel;
-	break;
+	switch (parm) {
+	case IPMI_PEFPARM_EVENT_FILTER_TABLE:
+	    if (pefc->curr_sel > pefc->num_event_filters) {
+		pef_set_next_parm(pefc);
+		continue;
+	    }
+	    break;
 
-    case IPMI_PEFPARM_NUM_ALERT_STRINGS:
-	pefc->curr_parm++;
-	if (pefc->num_alert_strings == 0)
-	    goto done;
-	pefc->curr_sel = 0;
-	data[0] = pefc->curr_sel;
-	break;
+	case IPMI_PEFPARM_ALERT_POLICY_TABLE:
+	    if (pefc->curr_sel > pefc->num_alert_policies) {
+		pef_set_next_parm(pefc);
+		continue;
+	    }
+	    break;
 
-    case IPMI_PEFPARM_ALERT_STRING_KEY:
-	pefc->curr_sel++;
-	if (pefc->curr_sel >= pefc->num_alert_strings) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
-	    pefc->curr_block = 1;
-	    data[1] = pefc->curr_block;
+	case IPMI_PEFPARM_ALERT_STRING_KEY:
+	case IPMI_PEFPARM_ALERT_STRING:
+	    if (pefc->curr_sel >= pefc->num_alert_strings) {
+		pef_set_next_parm(pefc);
+		continue;
+	    }
+	    break;
 	}
-	data[0] = pefc->curr_sel;
-	break;
-
-    case IPMI_PEFPARM_ALERT_STRING:
-	/* curr_sel increment is done right after the send formatting,
-	   because we don't know until there if it's the end of the
-	   string. */
-	if (pefc->curr_sel >= pefc->num_alert_strings)
-	    goto done;
-	data[0] = pefc->curr_sel;
-	data[1] = pefc->curr_block;
 	break;
-
-    default:
-	pefc->curr_parm++;
     }
 
-    lp = &(pefparms[pefc->curr_parm]);
-    if ((!lp->valid) || (lp->set_handler == NULL)
-	|| (lp->optional_offset
-	    && !(((unsigned char *) pefc)[lp->optional_offset])))
-    {
-	/* The parameter is read-only or not supported, just go on. */
-	goto next_parm;
-    }
+    data[0] = pefc->curr_sel;
+    data[1] = pefc->curr_block;
+    *length = lp->length;
+    lp->set_handler(pefc, lp, data, length);
 
-    length = lp->length;
-    lp->set_handler(pefc, lp, data, &length);
-    err = ipmi_pef_set_parm(pef, pefc->curr_parm,
-			    data, length, set_done, pefc);
-    if (err)
-	goto done;
-
-    if (pefc->curr_parm == IPMI_PEFPARM_ALERT_STRING) {
+    if (parm == IPMI_PEFPARM_ALERT_STRING) {
 	/* Special handling for blocks of an alert string */
-	if ((length < 18) ||
-	    (memchr(data+2, '\0', length-2)))
+	if ((*length < 18) ||
+	    (memchr(data+2, '\0', *length-2)))
 	{
 	    /* End of string, either a subsize-block or a nil
 	       character in the data. */
@@ -2004,17 +2131,29 @@ set_done(ipmi_pef_t *pef,
 	} else {
 	    pefc->curr_block++;
 	}
+    } else if (pef_parm_is_table(parm)) {
+	pefc->curr_sel++;
+    } else {
+	pef_set_next_parm(pefc);
     }
-    return;
 
- done:
+    return parm;
+}
+
+/* All the sets are done, commit them (or not, on an error) and clear
+   the set in progress. */
+static void
+pef_set_finish(ipmi_pef_t *pef, ipmi_pef_config_t *pefc)
+{
+    unsigned char data[1];
+    int           err = pefc->err;
+
     if (!pefc->lock_supported) {
 	/* No lock support, just finish the operation. */
 	set_clear(pef, err, pefc);
 	return;
     } else if (err) {
 	data[0] = 0; /* Don't commit the parameters. */
-	pefc->err = err;
 	err = ipmi_pef_set_parm(pef, 0, data, 1, set_clear, pefc);
     } else {
 	data[0] = 2; /* Commit the parameters. */
@@ -2022,13 +2161,78 @@ set_done(ipmi_pef_t *pef,
     }
     if (err) {
 	ipmi_log(IPMI_LOG_WARNING,
-		 "pef.c(got_parm): Error trying to clear the set in"
+		 "pef.c(pef_set_finish): Error trying to clear the set in"
 		 " progress: %x",
 		 err);
 	set_clear(pef, err, pefc);
     }
 }
 
+static void set_done(ipmi_pef_t *pef,
+		     int        err,
+		     void       *cb_data);
+
+/* Start as many parameter sets as the window allows.  The sets all
+   happen between the set in progress and the commit, so they can
+   all be outstanding at once.  Must be called with the config
+   locked, this will unlock it. */
+static void
+pef_set_issue(ipmi_pef_t *pef, ipmi_pef_config_t *pefc)
+{
+    unsigned char data[MAX_IPMI_DATA_SIZE];
+    unsigned int  length;
+    int           parm;
+    int           rv;
+
+    if (pefc->issuing) {
+	/* Whoever is issuing will see the change. */
+	pefc_unlock(pefc);
+	return;
+    }
+    pefc->issuing = 1;
+
+    while (!pefc->err && (pefc->outstanding < pefc->window)) {
+	parm = pef_next_set(pefc, data, &length);
+	if (parm < 0)
+	    break;
+
+	pefc->outstanding++;
+	pefc_unlock(pefc);
+	rv = pef_set_parm(pef, parm, data, length, set_done, pefc, 1);
+	pefc_lock(pefc);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "Error setting PEF parm %d: %x", parm, rv);
+	    pefc->outstanding--;
+	    pefc->err = rv;
+	}
+    }
+
+    pefc->issuing = 0;
+    if (pefc->outstanding == 0) {
+	pefc_unlock(pefc);
+	pef_set_finish(pef, pefc);
+	return;
+    }
+    pefc_unlock(pefc);
+}
+
+static void 
+set_done(ipmi_pef_t *pef,
+	 int        err,
+	 void       *cb_data)
+{
+    ipmi_pef_config_t *pefc = cb_data;
+
+    pefc_lock(pefc);
+    pefc->outstanding--;
+    if (err && !pefc->err) {
+	ipmi_log(IPMI_LOG_ERR_INFO, "Error setting PEF parm: %x", err);
+	pefc->err = err;
+    }
+    pef_set_issue(pef, pefc);
+}
+
 int
 ipmi_pef_set_config(ipmi_pef_t        *pef,
 		    ipmi_pef_config_t *opefc,
@@ -2036,11 +2240,8 @@ ipmi_pef_set_config(ipmi_pef_t        *pef,
 		    void              *cb_data)
 {
     ipmi_pef_config_t *pefc;
-    unsigned char     data[MAX_IPMI_DATA_SIZE];
     int               rv;
     int               i;
-    pefparms_t        *lp;
-    unsigned int      length;
 
     if (opefc->my_pef != pef)
 	return EINVAL;
@@ -2061,6 +2262,12 @@ ipmi_pef_set_config(ipmi_pef_t        *pef,
     pefc->pef_locked = 0; /* Set this here, since we will unlock it,
 			     but we don't want the free operation to
 			     attempt an unlock */
+    pefc->outstanding = 0;
+    pefc->issuing = 0;
+
+    rv = pefc_alloc_lock(pefc, pef);
+    if (rv)
+	goto out;
 
     if (pefc->num_event_filters) {
 	pefc->efts = ipmi_mem_alloc(sizeof(ipmi_eft_t)
@@ -2114,20 +2321,16 @@ ipmi_pef_set_config(ipmi_pef_t        *pef,
 	}
     }
 
-    /* We know that parm 1 is valid an non-optional, so we just set it. */
     pefc->curr_parm = 1;
     pefc->curr_sel = 0;
-    pefc->curr_block = 0;
+    pefc->curr_block = 1;
     pefc->set_done = done;
     pefc->cb_data = cb_data;
+    pefc->window = pef_op_window(pef);
 
-    lp = &(pefparms[pefc->curr_parm]);
-    length = lp->length;
-    lp->set_handler(pefc, lp, data, &length);
     pef_get(pef);
-    rv = ipmi_pef_set_parm(pef, pefc->curr_parm, data, length, set_done, pefc);
-    if (rv)
-	pef_put(pef);
+    pefc_lock(pefc);
+    pef_set_issue(pef, pefc);
  out:
     if (rv) {
 	ipmi_pef_free_config(pefc);
@@ -2214,6 +2417,8 @@ ipmi_pef_free_config(ipmi_pef_config_t *pefc)
 	}
 	ipmi_mem_free(pefc->alert_strings);
     }
+    if (pefc->lock)
+	pefc->os_hnd->destroy_lock(pefc->os_hnd, pefc->lock);
     ipmi_mem_free(pefc);
 }
 
@@ -314,9 +314,13 @@ pet_op_done(ipmi_pet_t *pet)
 	if (pet->done) {
 	    ipmi_pet_done_cb done = pet->done;
 	    void             *cb_data = pet->cb_data;
+	    int              err = pet->pef_err;
+
+	    if (!err)
+		err = pet->lanparm_err;
 	    pet->done = NULL;
 	    pet_unlock(pet);
-	    done(pet, 0, cb_data);
+	    done(pet, err, cb_data);
 	    pet_lock(pet);
 	}
 
@@ -917,6 +921,7 @@ start_pet_setup(ipmi_mc_t  *mc,
 	ipmi_log(IPMI_LOG_WARNING,
 		 "start_pet_setup: Unable to allocate lanparm: 0x%x",
 		 rv);
+	pet->lanparm_err = rv;
     } else {
 	pet->in_progress++;
 	pet_get_nolock(pet);
@@ -932,6 +937,7 @@ start_pet_setup(ipmi_mc_t  *mc,
 	    ipmi_log(IPMI_LOG_WARNING,
 		     "start_pet_setup: Unable to get dest type: 0x%x",
 		     rv);
+	    pet->lanparm_err = rv;
 	    ipmi_lanparm_destroy(pet->lanparm, NULL, NULL);
 	    pet->lanparm = NULL;
 	}
@@ -1366,3 +1372,214 @@ ipmi_pet_get_lan_dest_sel(ipmi_pet_t *pet)
 {
     return pet->lan_dest_sel;
 }
+
+/***********************************************************************
+ *
+ * Provisioning a PET on a set of MCs.
+ *
+ **********************************************************************/
+
+/* How many MCs to set up at once if the user doesn't say. */
+#define PET_PROVISION_DEFAULT_CONCURRENT 32
+
+typedef struct pet_provision_s pet_provision_t;
+
+typedef struct pet_provision_ent_s
+{
+    pet_provision_t *prov;
+    unsigned int    idx;
+    int             err;
+} pet_provision_ent_t;
+
+struct pet_provision_s
+{
+    ipmi_lock_t                    *lock;
+
+    ipmi_pet_config_t              config;
+    ipmi_pet_provision_result_t    *results;
+    pet_provision_ent_t            *ents;
+    unsigned int                   count;
+
+    unsigned int                   next;
+    unsigned int                   window;
+    unsigned int                   outstanding;
+    unsigned int                   done_count;
+    unsigned int                   failed;
+    /* Progress callbacks that are running, we can't finish until
+       they are done. */
+    unsigned int                   reporting;
+    int                            issuing;
+    int                            finished;
+
+    ipmi_pet_provision_progress_cb progress;
+    ipmi_pet_provision_done_cb     done;
+    void                           *cb_data;
+};
+
+static void
+pet_provision_free(pet_provision_t *prov)
+{
+    if (prov->lock)
+	ipmi_destroy_lock(prov->lock);
+    if (prov->results)
+	ipmi_mem_free(prov->results);
+    if (prov->ents)
+	ipmi_mem_free(prov->ents);
+    ipmi_mem_free(prov);
+}
+
+static void pet_provision_issue(pet_provision_t *prov);
+
+static void
+pet_provision_mc_done(pet_provision_t *prov,
+		      unsigned int    idx,
+		      ipmi_pet_t      *pet,
+		      int             err)
+{
+    unsigned int done_count, failed;
+
+    ipmi_lock(prov->lock);
+    prov->results[idx].pet = pet;
+    prov->results[idx].err = err;
+    prov->outstanding--;
+    prov->done_count++;
+    if (err)
+	prov->failed++;
+    done_count = prov->done_count;
+    failed = prov->failed;
+    prov->reporting++;
+    ipmi_unlock(prov->lock);
+
+    if (prov->progress)
+	prov->progress(done_count, failed, prov->count, prov->cb_data);
+
+    ipmi_lock(prov->lock);
+    prov->reporting--;
+    pet_provision_issue(prov);
+}
+
+static void
+pet_provision_pet_done(ipmi_pet_t *pet, int err, void *cb_data)
+{
+    pet_provision_ent_t *ent = cb_data;
+
+    pet_provision_mc_done(ent->prov, ent->idx, pet, err);
+}
+
+static void
+pet_provision_start_mc(ipmi_mc_t *mc, void *cb_data)
+{
+    pet_provision_ent_t *ent = cb_data;
+    ipmi_pet_config_t   *c = &ent->prov->config;
+
+    ent->err = ipmi_pet_create_mc(mc, c->channel, c->ip_addr, c->mac_addr,
+				  c->eft_sel, c->policy_num, c->apt_sel,
+				  c->lan_dest_sel, pet_provision_pet_done, ent,
+				  NULL);
+}
+
+/* Start as many MCs as the limit allows.  Must be called with the
+   provision locked, this will unlock it. */
+static void
+pet_provision_issue(pet_provision_t *prov)
+{
+    pet_provision_ent_t *ent;
+    int                 rv;
+
+    if (prov->issuing) {
+	/* Whoever is issuing will see the change. */
+	ipmi_unlock(prov->lock);
+	return;
+    }
+    prov->issuing = 1;
+
+    while ((prov->next < prov->count) && (prov->outstanding < prov->window)) {
+	ent = &prov->ents[prov->next];
+	prov->next++;
+	prov->outstanding++;
+	ipmi_unlock(prov->lock);
+
+	ent->err = 0;
+	rv = ipmi_mc_pointer_cb(prov->results[ent->idx].mc_id,
+				pet_provision_start_mc, ent);
+	if (!rv)
+	    rv = ent->err;
+	if (rv)
+	    /* Nothing else will report this one. */
+	    pet_provision_mc_done(prov, ent->idx, NULL, rv);
+
+	ipmi_lock(prov->lock);
+    }
+    prov->issuing = 0;
+
+    if ((prov->done_count == prov->count) && (prov->reporting == 0)
+	&& (!prov->finished))
+    {
+	prov->finished = 1;
+	ipmi_unlock(prov->lock);
+	prov->done(prov->results, prov->count, prov->failed, prov->cb_data);
+	pet_provision_free(prov);
+	return;
+    }
+    ipmi_unlock(prov->lock);
+}
+
+int
+ipmi_pet_provision(ipmi_mcid_t                    *mcs,
+		   unsigned int                   num_mcs,
+		   ipmi_pet_config_t              *config,
+		   unsigned int                   max_concurrent,
+		   ipmi_pet_provision_progress_cb progress,
+		   ipmi_pet_provision_done_cb     done,
+		   void                           *cb_data)
+{
+    pet_provision_t *prov;
+    unsigned int    i;
+    int             rv;
+
+    if (!mcs || (num_mcs == 0) || !config || !done)
+	return EINVAL;
+
+    prov = ipmi_mem_alloc(sizeof(*prov));
+    if (!prov)
+	return ENOMEM;
+    memset(prov, 0, sizeof(*prov));
+
+    rv = ipmi_create_global_lock(&prov->lock);
+    if (rv) {
+	prov->lock = NULL;
+	goto out_err;
+    }
+
+    rv = ENOMEM;
+    prov->results = ipmi_mem_alloc(sizeof(*prov->results) * num_mcs);
+    prov->ents = ipmi_mem_alloc(sizeof(*prov->ents) * num_mcs);
+    if (!prov->results || !prov->ents)
+	goto out_err;
+
+    for (i=0; i<num_mcs; i++) {
+	prov->results[i].mc_id = mcs[i];
+	prov->results[i].err = 0;
+	prov->results[i].pet = NULL;
+	prov->ents[i].prov = prov;
+	prov->ents[i].idx = i;
+	prov->ents[i].err = 0;
+    }
+
+    prov->config = *config;
+    prov->count = num_mcs;
+    prov->window = max_concurrent;
+    if (prov->window == 0)
+	prov->window = PET_PROVISION_DEFAULT_CONCURRENT;
+    prov->progress = progress;
+    prov->done = done;
+    prov->cb_data = cb_data;
+
+    ipmi_lock(prov->lock);
+    pet_provision_issue(prov);
+    return 0;
+
+ out_err:
+    pet_provision_free(prov);
+    return rv;
+}
@@ -31,6 +31,8 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_LAN
+
 #include <config.h>
 
 #include <string.h>
@@ -437,12 +439,212 @@ static ipmi_rmcpp_authentication_t rakp_none_auth =
  ***********************************************************************/
 #ifdef HAVE_OPENSSL
 #include <openssl/hmac.h>
+#include <openssl/evp.h>
+
+#ifndef HAVE_EVP_MD_CTX_NEW
+/* Before OpenSSL 1.1 */
+#define EVP_MD_CTX_new EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+/* Largest digest block size and user/BMC key length we handle. */
+#define RAKP_MAX_BLOCK_SIZE 128
+#define RAKP_MAX_UKEY_LEN   20
+
+/*
+ * The user key (Kuid) and BMC key (Kg) are the same for every session
+ * opened with the same credentials, so the digest states after
+ * hashing them with the HMAC pads (RFC 2104, section 4) are computed
+ * once and shared by all the handshakes in progress that use them.
+ * When a lot of connections with the same credentials come up at
+ * once this saves two digest blocks per HMAC.  An entry only lives
+ * as long as some handshake holds it, so no keys are kept around.
+ */
+typedef struct rakp_ukey_s
+{
+    const EVP_MD       *evp_md;
+    unsigned int       klen;
+    unsigned char      key[RAKP_MAX_UKEY_LEN];
+    EVP_MD_CTX         *ictx;
+    EVP_MD_CTX         *octx;
+    unsigned int       refcount;
+    struct rakp_ukey_s *next;
+} rakp_ukey_t;
+
+static ipmi_lock_t *rakp_ukey_lock = NULL;
+static rakp_ukey_t *rakp_ukeys = NULL;
+
+static void
+rakp_ukey_free(rakp_ukey_t *ukey)
+{
+    if (ukey->ictx)
+	EVP_MD_CTX_free(ukey->ictx);
+    if (ukey->octx)
+	EVP_MD_CTX_free(ukey->octx);
+    memset(ukey->key, 0, sizeof(ukey->key));
+    ipmi_mem_free(ukey);
+}
+
+static int
+rakp_key_pad(EVP_MD_CTX          *ctx,
+	     const EVP_MD        *evp_md,
+	     const unsigned char *k,
+	     unsigned int        klen,
+	     unsigned char       padval)
+{
+    unsigned char pad[RAKP_MAX_BLOCK_SIZE];
+    unsigned int  bsize = EVP_MD_block_size(evp_md);
+    unsigned int  i;
+    int           ok;
+
+    memset(pad, padval, bsize);
+    for (i=0; i<klen; i++)
+	pad[i] ^= k[i];
+    ok = (EVP_DigestInit_ex(ctx, evp_md, NULL)
+	  && EVP_DigestUpdate(ctx, pad, bsize));
+    memset(pad, 0, sizeof(pad));
+    return ok ? 0 : ENOMEM;
+}
 
+static rakp_ukey_t *
+rakp_ukey_find(const EVP_MD        *evp_md,
+	       const unsigned char *key,
+	       unsigned int        klen)
+{
+    rakp_ukey_t *ukey;
+
+    for (ukey = rakp_ukeys; ukey; ukey = ukey->next) {
+	if ((ukey->evp_md == evp_md) && (ukey->klen == klen)
+	    && (memcmp(ukey->key, key, klen) == 0))
+	    return ukey;
+    }
+    return NULL;
+}
+
+static int
+rakp_ukey_get(const EVP_MD        *evp_md,
+	      const unsigned char *key,
+	      unsigned int        klen,
+	      rakp_ukey_t         **rukey)
+{
+    rakp_ukey_t *ukey, *old;
+    int         rv;
+
+    if ((klen > RAKP_MAX_UKEY_LEN)
+	|| (EVP_MD_block_size(evp_md) > RAKP_MAX_BLOCK_SIZE))
+	return EINVAL;
+
+    ipmi_lock(rakp_ukey_lock);
+    ukey = rakp_ukey_find(evp_md, key, klen);
+    if (ukey) {
+	ukey->refcount++;
+	ipmi_unlock(rakp_ukey_lock);
+	*rukey = ukey;
+	return 0;
+    }
+    ipmi_unlock(rakp_ukey_lock);
+
+    /* Do the digest work without the lock held. */
+    ukey = ipmi_mem_alloc(sizeof(*ukey));
+    if (!ukey)
+	return ENOMEM;
+    memset(ukey, 0, sizeof(*ukey));
+    ukey->evp_md = evp_md;
+    ukey->klen = klen;
+    memcpy(ukey->key, key, klen);
+    ukey->refcount = 1;
+    ukey->ictx = EVP_MD_CTX_new();
+    ukey->octx = EVP_MD_CTX_new();
+    if (!ukey->ictx || !ukey->octx) {
+	rakp_ukey_free(ukey);
+	return ENOMEM;
+    }
+    rv = rakp_key_pad(ukey->ictx, evp_md, key, klen, 0x36);
+    if (!rv)
+	rv = rakp_key_pad(ukey->octx, evp_md, key, klen, 0x5c);
+    if (rv) {
+	rakp_ukey_free(ukey);
+	return rv;
+    }
+
+    ipmi_lock(rakp_ukey_lock);
+    old = rakp_ukey_find(evp_md, key, klen);
+    if (old) {
+	/* Someone else added it while we were working. */
+	old->refcount++;
+	ipmi_unlock(rakp_ukey_lock);
+	rakp_ukey_free(ukey);
+	*rukey = old;
+	return 0;
+    }
+    ukey->next = rakp_ukeys;
+    rakp_ukeys = ukey;
+    ipmi_unlock(rakp_ukey_lock);
+
+    *rukey = ukey;
+    return 0;
+}
+
+static void
+rakp_ukey_put(rakp_ukey_t *ukey)
+{
+    rakp_ukey_t **p;
+
+    ipmi_lock(rakp_ukey_lock);
+    ukey->refcount--;
+    if (ukey->refcount > 0) {
+	ipmi_unlock(rakp_ukey_lock);
+	return;
+    }
+    for (p = &rakp_ukeys; *p; p = &(*p)->next) {
+	if (*p == ukey) {
+	    *p = ukey->next;
+	    break;
+	}
+    }
+    ipmi_unlock(rakp_ukey_lock);
+    rakp_ukey_free(ukey);
+}
+
+/* HMAC the data with a shared key into out, which must be able to
+   hold EVP_MAX_MD_SIZE bytes.  The shared states are only read, the
+   work is done in the caller's context. */
+static int
+rakp_ukey_hmac(rakp_ukey_t         *ukey,
+	       EVP_MD_CTX          *wctx,
+	       const unsigned char *data,
+	       unsigned int        len,
+	       unsigned char       *out)
+{
+    unsigned char ihash[EVP_MAX_MD_SIZE];
+    unsigned int  hlen;
+    int           ok;
+
+    ok = (EVP_MD_CTX_copy_ex(wctx, ukey->ictx)
+	  && EVP_DigestUpdate(wctx, data, len)
+	  && EVP_DigestFinal_ex(wctx, ihash, &hlen)
+	  && EVP_MD_CTX_copy_ex(wctx, ukey->octx)
+	  && EVP_DigestUpdate(wctx, ihash, hlen)
+	  && EVP_DigestFinal_ex(wctx, out, &hlen));
+    return ok ? 0 : ENOMEM;
+}
+
+/* key_len is the length of the HMAC output used for the RAKP auth
+   codes and the SIK, K1 and K2.  integ_len is the length of the RAKP4
+   integrity check value.  ukey_len is how much of the user and BMC
+   keys is used, and the length of the K1/K2 constants. */
 typedef struct rakp_hmac_key_s
 {
     unsigned int key_len;
     unsigned int integ_len;
+    unsigned int ukey_len;
     const EVP_MD *evp_md;
+
+    /* The shared user and BMC key states, NULL if the key is too
+       short.  They may be the same entry. */
+    rakp_ukey_t  *ukey;
+    rakp_ukey_t  *bkey;
+    EVP_MD_CTX   *wctx;
 } rakp_hmac_key_t;
 
 static int
@@ -452,7 +654,7 @@ rakp_hmac_c2(rakp_info_t   *info,
 {
     unsigned char       idata[74];
     unsigned int        ilen;
-    unsigned char       integ_data[20];
+    unsigned char       integ_data[EVP_MAX_MD_SIZE];
     rakp_hmac_key_t     *rinfo = info->key_data;
     const unsigned char *p;
     unsigned char       *s;
@@ -477,10 +679,11 @@ rakp_hmac_c2(rakp_info_t   *info,
     p = ipmi_rmcpp_auth_get_username(info->ainfo, &plen);
     memcpy(idata+58, p, idata[57]);
 
-    p = ipmi_rmcpp_auth_get_password(info->ainfo, &plen);
-    if (plen < rinfo->key_len)
+    if (!rinfo->ukey)
 	return EINVAL;
-    HMAC(rinfo->evp_md, p, rinfo->key_len, idata, 58+idata[57], integ_data, &ilen);
+    if (rakp_ukey_hmac(rinfo->ukey, rinfo->wctx, idata, 58+idata[57],
+		       integ_data))
+	return ENOMEM;
     if (memcmp(data+40, integ_data, rinfo->key_len) != 0)
 	return EINVAL;
 
@@ -493,27 +696,27 @@ rakp_hmac_c2(rakp_info_t   *info,
     idata[33] = ipmi_rmcpp_auth_get_username_len(info->ainfo);
     p = ipmi_rmcpp_auth_get_username(info->ainfo, &plen);
     memcpy(idata+34, p, idata[33]);
-    p = ipmi_rmcpp_auth_get_bmc_key(info->ainfo, &plen);
-    if (plen < rinfo->key_len)
+    if (!rinfo->bkey)
 	return EINVAL;
     s = ipmi_rmcpp_auth_get_sik(info->ainfo, &plen);
     if (plen < rinfo->key_len)
 	return EINVAL;
-    HMAC(rinfo->evp_md, p, rinfo->key_len, idata, 34+idata[33], s, &ilen);
+    if (rakp_ukey_hmac(rinfo->bkey, rinfo->wctx, idata, 34+idata[33], s))
+	return ENOMEM;
     ipmi_rmcpp_auth_set_sik_len(info->ainfo, rinfo->key_len);
 
     /* Now generate k1 and k2. */
     k = ipmi_rmcpp_auth_get_k1(info->ainfo, &plen);
     if (plen < rinfo->key_len)
 	return EINVAL;
-    memset(idata, 1, rinfo->key_len);
-    HMAC(rinfo->evp_md, s, rinfo->key_len, idata, rinfo->key_len, k, &ilen);
-    ipmi_rmcpp_auth_set_k2_len(info->ainfo, rinfo->key_len);
+    memset(idata, 1, rinfo->ukey_len);
+    HMAC(rinfo->evp_md, s, rinfo->key_len, idata, rinfo->ukey_len, k, &ilen);
+    ipmi_rmcpp_auth_set_k1_len(info->ainfo, rinfo->key_len);
     k = ipmi_rmcpp_auth_get_k2(info->ainfo, &plen);
     if (plen < rinfo->key_len)
 	return EINVAL;
-    memset(idata, 2, rinfo->key_len);
-    HMAC(rinfo->evp_md, s, rinfo->key_len, idata, rinfo->key_len, k, &ilen);
+    memset(idata, 2, rinfo->ukey_len);
+    HMAC(rinfo->evp_md, s, rinfo->key_len, idata, rinfo->ukey_len, k, &ilen);
     ipmi_rmcpp_auth_set_k2_len(info->ainfo, rinfo->key_len);
 
     return 0;
@@ -526,7 +729,7 @@ rakp_hmac_s3(rakp_info_t   *info,
 	     unsigned int  total_len)
 {
     unsigned char       idata[38];
-    unsigned int        ilen;
+    unsigned char       integ_data[EVP_MAX_MD_SIZE];
     rakp_hmac_key_t     *rinfo = info->key_data;
     const unsigned char *p;
     unsigned int        plen;
@@ -548,12 +751,12 @@ rakp_hmac_s3(rakp_info_t   *info,
     p = ipmi_rmcpp_auth_get_username(info->ainfo, &plen);
     memcpy(idata+22, p, idata[21]);
 
-    p = ipmi_rmcpp_auth_get_password(info->ainfo, &plen);
-    if (plen < rinfo->key_len)
+    if (!rinfo->ukey)
 	return EINVAL;
-
-    HMAC(rinfo->evp_md, p, rinfo->key_len, idata, 22+idata[21],
-	 data+*data_len, &ilen);
+    if (rakp_ukey_hmac(rinfo->ukey, rinfo->wctx, idata, 22+idata[21],
+		       integ_data))
+	return ENOMEM;
+    memcpy(data+*data_len, integ_data, rinfo->key_len);
     *data_len += rinfo->key_len;
     return 0;
 }
@@ -565,7 +768,7 @@ rakp_hmac_c4(rakp_info_t   *info,
 {
     unsigned char       idata[36];
     unsigned int        ilen;
-    unsigned char       integ_data[20];
+    unsigned char       integ_data[EVP_MAX_MD_SIZE];
     rakp_hmac_key_t     *rinfo = info->key_data;
     const unsigned char *p;
     unsigned int        plen;
@@ -590,26 +793,76 @@ rakp_hmac_c4(rakp_info_t   *info,
 }
 
 static void
-rakp_hmac_cleanup(rakp_info_t *info)
+rakp_hmac_key_free(rakp_hmac_key_t *key_data)
 {
-    rakp_hmac_key_t *key_data = info->key_data;
-
+    if (key_data->ukey)
+	rakp_ukey_put(key_data->ukey);
+    if (key_data->bkey)
+	rakp_ukey_put(key_data->bkey);
+    if (key_data->wctx)
+	EVP_MD_CTX_free(key_data->wctx);
     ipmi_mem_free(key_data);
 }
 
+static void
+rakp_hmac_cleanup(rakp_info_t *info)
+{
+    rakp_hmac_key_free(info->key_data);
+}
+
 static int
-rakp_sha1_init(rakp_info_t *info)
+rakp_hmac_init(rakp_info_t  *info,
+	       const EVP_MD *evp_md,
+	       unsigned int key_len,
+	       unsigned int integ_len,
+	       unsigned int ukey_len)
 {
-    rakp_hmac_key_t *key_data;
+    rakp_hmac_key_t     *key_data;
+    const unsigned char *p;
+    unsigned int        plen;
+    int                 rv = 0;
 
     key_data = ipmi_mem_alloc(sizeof(*key_data));
     if (!key_data)
 	return ENOMEM;
-    key_data->evp_md = EVP_sha1();
-    key_data->key_len = 20;
-    key_data->integ_len = 12;
+    memset(key_data, 0, sizeof(*key_data));
+    key_data->evp_md = evp_md;
+    key_data->key_len = key_len;
+    key_data->integ_len = integ_len;
+    key_data->ukey_len = ukey_len;
+
+    key_data->wctx = EVP_MD_CTX_new();
+    if (!key_data->wctx) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+
+    /* A key that is too short is reported when it gets used. */
+    p = ipmi_rmcpp_auth_get_password(info->ainfo, &plen);
+    if (plen >= ukey_len) {
+	rv = rakp_ukey_get(evp_md, p, ukey_len, &key_data->ukey);
+	if (rv)
+	    goto out_err;
+    }
+    p = ipmi_rmcpp_auth_get_bmc_key(info->ainfo, &plen);
+    if (plen >= ukey_len) {
+	rv = rakp_ukey_get(evp_md, p, ukey_len, &key_data->bkey);
+	if (rv)
+	    goto out_err;
+    }
+
     info->key_data = key_data;
     return 0;
+
+ out_err:
+    rakp_hmac_key_free(key_data);
+    return rv;
+}
+
+static int
+rakp_sha1_init(rakp_info_t *info)
+{
+    return rakp_hmac_init(info, EVP_sha1(), 20, 12, 20);
 }
 
 static int
@@ -635,16 +888,7 @@ static ipmi_rmcpp_authentication_t rakp_hmac_sha1_auth =
 static int
 rakp_md5_init(rakp_info_t *info)
 {
-    rakp_hmac_key_t *key_data;
-
-    key_data = ipmi_mem_alloc(sizeof(*key_data));
-    if (!key_data)
-	return ENOMEM;
-    key_data->evp_md = EVP_md5();
-    key_data->key_len = 16;
-    key_data->integ_len = 16;
-    info->key_data = key_data;
-    return 0;
+    return rakp_hmac_init(info, EVP_md5(), 16, 16, 16);
 }
 
 static int
@@ -666,6 +910,32 @@ static ipmi_rmcpp_authentication_t rakp_hmac_md5_auth =
 {
     start_rakp_hmac_md5
 };
+
+static int
+rakp_sha256_init(rakp_info_t *info)
+{
+    return rakp_hmac_init(info, EVP_sha256(), 32, 16, 20);
+}
+
+static int
+start_rakp_hmac_sha256(ipmi_con_t                *ipmi,
+		       int                       addr_num,
+		       unsigned char             msg_tag,
+		       ipmi_rmcpp_auth_t         *ainfo,
+		       ipmi_rmcpp_set_info_cb    set,
+		       ipmi_rmcpp_finish_auth_cb done,
+		       void                      *cb_data)
+{
+    return start_rakp(ipmi, addr_num, msg_tag, ainfo,
+		      rakp_sha256_init, rakp_hmac_cleanup,
+		      rakp_hmac_c2, rakp_hmac_s3, rakp_hmac_c4,
+		      set, done, cb_data);
+}
+
+static ipmi_rmcpp_authentication_t rakp_hmac_sha256_auth =
+{
+    start_rakp_hmac_sha256
+};
 #endif
 
 /**********************************************************************
@@ -755,6 +1025,12 @@ _ipmi_rakp_shutdown(void)
     ipmi_rmcpp_register_payload(IPMI_RMCPP_PAYLOAD_TYPE_RAKP_2, NULL);
     ipmi_rmcpp_register_payload(IPMI_RMCPP_PAYLOAD_TYPE_RAKP_1, NULL);
 #ifdef HAVE_OPENSSL
+    if (rakp_ukey_lock) {
+	ipmi_destroy_lock(rakp_ukey_lock);
+	rakp_ukey_lock = NULL;
+    }
+    ipmi_rmcpp_register_authentication
+	(IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA256, NULL);
     ipmi_rmcpp_register_authentication
 	(IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_MD5, NULL);
     ipmi_rmcpp_register_authentication
@@ -776,6 +1052,12 @@ _ipmi_rakp_init(void)
 	return rv;
 
 #ifdef HAVE_OPENSSL
+    rv = ipmi_create_global_lock(&rakp_ukey_lock);
+    if (rv) {
+	_ipmi_rakp_shutdown();
+	return rv;
+    }
+
     rv = ipmi_rmcpp_register_authentication
 	(IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA1,
 	 &rakp_hmac_sha1_auth);
@@ -791,6 +1073,14 @@ _ipmi_rakp_init(void)
 	_ipmi_rakp_shutdown();
 	return rv;
     }
+
+    rv = ipmi_rmcpp_register_authentication
+	(IPMI_LANP_AUTHENTICATION_ALGORITHM_RAKP_HMAC_SHA256,
+	 &rakp_hmac_sha256_auth);
+    if (rv) {
+	_ipmi_rakp_shutdown();
+	return rv;
+    }
 #endif
 
     rv = ipmi_rmcpp_register_payload(IPMI_RMCPP_PAYLOAD_TYPE_RAKP_1,
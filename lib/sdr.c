@@ -31,6 +31,9 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_SDR
+
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -40,12 +43,13 @@
 #include <OpenIPMI/ipmi_err.h>
 
 #include <OpenIPMI/internal/opq.h>
-#include <OpenIPMI/internal/ilist.h>
+#include <OpenIPMI/internal/ivec.h>
 #include <OpenIPMI/internal/ipmi_domain.h>
 #include <OpenIPMI/internal/ipmi_mc.h>
 #include <OpenIPMI/internal/ipmi_int.h>
 
-/* Max bytes to try to get at a time, the minimum allowed, and the
+/* Max bytes to try to get at a time, the size to start with for MCs
+   that are not directly connected, the minimum allowed, and the
    amount to decrement between tries. */
 #define MAX_SDR_FETCH_BYTES 28
 #define STD_SDR_FETCH_BYTES 16
@@ -77,13 +81,19 @@ typedef struct fetch_info_s
     unsigned int idx;
     unsigned int offset;
     unsigned int read_len;
+    /* Set on a header read when the body was taken from the cache. */
+    int          cached;
     unsigned char data[MAX_SDR_FETCH_BYTES+2];
-
-    ilist_item_t link;
 } fetch_info_t;
 
 #undef DEBUG_INFO_TRACKING
 
+typedef struct sdr_recid_idx_s
+{
+    uint16_t     record_id;
+    unsigned int pos;
+} sdr_recid_idx_t;
+
 struct ipmi_sdr_info_s
 {
     char name[IPMI_MC_NAME_LEN+1+20];
@@ -119,14 +129,17 @@ struct ipmi_sdr_info_s
     unsigned int supports_reserve_sdr : 1;
     unsigned int supports_get_sdr_repository_allocation : 1;
     unsigned int use_cache : 1;
+    unsigned int incremental : 1;
 
     /* Information from the GET DEVICE SDR INFO command, sensor mode
        only. */
     unsigned int dynamic_population : 1;
     char lun_has_sensors[4];
 
-    /* Have the SDRs previously been fetched? */
+    /* Have the SDRs previously been fetched?  read_from_mc is set if
+       the current copy was read from the MC and not the database. */
     unsigned int fetched : 1;
+    unsigned int read_from_mc : 1;
 
     /* Has the SDR been destroyed?  This is here because of race
        conditions in shutdown.  If we are currently in the process of
@@ -149,7 +162,13 @@ struct ipmi_sdr_info_s
     unsigned int           curr_rec_id;
     unsigned int           read_offset; /* Next data to read */
 
+    /* How much to read at a time.  This starts big and comes down
+       if the MC can't return that much, and is kept between fetches.
+       If header_only_reads is set, the first read of an SDR only
+       gets the header; otherwise it gets the header and as much of
+       the body as fits. */
     unsigned int           fetch_size;
+    int                    header_only_reads;
 
     unsigned int           curr_read_rec_id;
     unsigned int           next_read_rec_id;
@@ -173,9 +192,9 @@ struct ipmi_sdr_info_s
        outstanding list holds ones that have been sent but have not
        received a response, and the process queue holds one received
        out of order. */
-    ilist_t *free_fetch;
-    ilist_t *outstanding_fetch;
-    ilist_t *process_fetch;
+    ivec_t *free_fetch;
+    ivec_t *outstanding_fetch;
+    ivec_t *process_fetch;
 
     /* This is used so that start_fetch will only start when nothing
        is outstanding from other fetches.  This avoids getting
@@ -189,10 +208,22 @@ struct ipmi_sdr_info_s
     os_hnd_timer_id_t *restart_timer;
     int               restart_timer_running;
 
-    /* The actual current copy of the SDR repository. */
+    /* The actual current copy of the SDR repository.  If sdrs_map
+       is set, the SDRs are mapped read-only from the database and
+       must be copied before they are changed. */
     unsigned int num_sdrs;
     unsigned int sdr_array_size;
     ipmi_sdr_t *sdrs;
+    void       *sdrs_map;
+
+    /* Indexes for finding SDRs by record id and type, rebuilt when
+       index_stale is set.  The record id index is sorted by record
+       id and then position, type_first has the position of the first
+       SDR of each type or -1. */
+    sdr_recid_idx_t *recid_index;
+    unsigned int    recid_index_size;
+    int             type_first[256];
+    int             index_stale;
 
     char db_key[32+5];
     int  db_key_set;
@@ -233,71 +264,244 @@ static inline void sdr_unlock(ipmi_sdr_info_t *sdrs)
 }
 
 static void
-free_fetch(ilist_iter_t *iter, void *item, void *cb_data)
+free_fetch(ivec_iter_t *iter, void *item, void *cb_data)
 {
-    ilist_delete(iter);
+    ivec_delete(iter);
     ipmi_mem_free(item);
 }
 
 static void
-cancel_fetch(ilist_iter_t *iter, void *item, void *cb_data)
+cancel_fetch(ivec_iter_t *iter, void *item, void *cb_data)
 {
     fetch_info_t *info = item;
 
     info->fetch_retry_num = -1;
-    ilist_delete(iter);
+    ivec_delete(iter);
 }
 
 static void
 cleanup_fetch_items(ipmi_sdr_info_t *sdrs)
 {
-    ilist_iter(sdrs->free_fetch, free_fetch, NULL);
-    ilist_iter(sdrs->process_fetch, free_fetch, NULL);
-    ilist_iter(sdrs->outstanding_fetch, cancel_fetch, NULL);
+    ivec_iter(sdrs->free_fetch, free_fetch, NULL);
+    ivec_iter(sdrs->process_fetch, free_fetch, NULL);
+    ivec_iter(sdrs->outstanding_fetch, cancel_fetch, NULL);
 }
 
+/* Free the current SDR array, unmapping it if it came from the
+   database. */
 static void
-process_db_data(ipmi_sdr_info_t *sdrs,
-		unsigned char   *db_data,
-		unsigned int    len)
+release_sdrs(ipmi_sdr_info_t *sdrs)
+{
+    if (sdrs->sdrs_map)
+	sdrs->os_hnd->database_unmap(sdrs->os_hnd, sdrs->sdrs_map);
+    else if (sdrs->sdrs)
+	ipmi_mem_free(sdrs->sdrs);
+    sdrs->sdrs = NULL;
+    sdrs->sdrs_map = NULL;
+    sdrs->index_stale = 1;
+}
+
+static int
+cmp_recid_idx(const void *v1, const void *v2)
+{
+    const sdr_recid_idx_t *i1 = v1;
+    const sdr_recid_idx_t *i2 = v2;
+
+    if (i1->record_id < i2->record_id)
+	return -1;
+    else if (i1->record_id > i2->record_id)
+	return 1;
+    else if (i1->pos < i2->pos)
+	return -1;
+    else if (i1->pos > i2->pos)
+	return 1;
+    else
+	return 0;
+}
+
+/* Rebuild the record id and type indexes if the SDRs have changed.
+   Must be called with the SDR lock held.  If this runs out of
+   memory, the indexes stay stale and the lookups search the SDRs
+   instead. */
+static void
+update_sdr_index(ipmi_sdr_info_t *sdrs)
+{
+    unsigned int i;
+
+    if (!sdrs->index_stale)
+	return;
+
+    if (sdrs->recid_index_size < sdrs->num_sdrs) {
+	if (sdrs->recid_index)
+	    ipmi_mem_free(sdrs->recid_index);
+	sdrs->recid_index_size = 0;
+	sdrs->recid_index = ipmi_mem_alloc(sizeof(sdr_recid_idx_t)
+					   * sdrs->num_sdrs);
+	if (!sdrs->recid_index)
+	    return;
+	sdrs->recid_index_size = sdrs->num_sdrs;
+    }
+
+    for (i=0; i<256; i++)
+	sdrs->type_first[i] = -1;
+    for (i=0; i<sdrs->num_sdrs; i++) {
+	ipmi_sdr_t *sdr = &sdrs->sdrs[i];
+
+	sdrs->recid_index[i].record_id = sdr->record_id;
+	sdrs->recid_index[i].pos = i;
+	if (sdrs->type_first[sdr->type] < 0)
+	    sdrs->type_first[sdr->type] = i;
+    }
+    qsort(sdrs->recid_index, sdrs->num_sdrs, sizeof(sdr_recid_idx_t),
+	  cmp_recid_idx);
+    sdrs->index_stale = 0;
+}
+
+/* Find the first SDR with the given record id.  Must be called with
+   the SDR lock held. */
+static ipmi_sdr_t *
+find_sdr_by_recid(ipmi_sdr_info_t *sdrs, unsigned int recid)
+{
+    unsigned int i;
+
+    update_sdr_index(sdrs);
+    if (!sdrs->index_stale) {
+	unsigned int lo = 0, hi = sdrs->num_sdrs;
+
+	/* Find the first entry with the record id. */
+	while (lo < hi) {
+	    i = (lo + hi) / 2;
+	    if (sdrs->recid_index[i].record_id < recid)
+		lo = i + 1;
+	    else
+		hi = i;
+	}
+	if ((lo < sdrs->num_sdrs) && (sdrs->recid_index[lo].record_id == recid))
+	    return &sdrs->sdrs[sdrs->recid_index[lo].pos];
+    } else {
+	for (i=0; i<sdrs->num_sdrs; i++) {
+	    if (sdrs->sdrs[i].record_id == recid)
+		return &sdrs->sdrs[i];
+	}
+    }
+
+    return NULL;
+}
+
+/* Make a private copy of mapped SDRs so they can be changed. */
+static int
+unshare_sdrs(ipmi_sdr_info_t *sdrs)
+{
+    ipmi_sdr_t *new_sdrs;
+
+    if (!sdrs->sdrs_map)
+	return 0;
+
+    /* Allocate 9 extra bytes for the db info. */
+    new_sdrs = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * sdrs->num_sdrs) + 9);
+    if (!new_sdrs)
+	return ENOMEM;
+    memcpy(new_sdrs, sdrs->sdrs, sizeof(ipmi_sdr_t) * sdrs->num_sdrs);
+    release_sdrs(sdrs);
+    sdrs->sdrs = new_sdrs;
+    sdrs->sdr_array_size = sdrs->num_sdrs;
+    return 0;
+}
+
+/* The database data is the SDRs followed by the two timestamps and a
+   format byte.  The SDRs are stored as they are in memory, so only
+   use data whose size fits the current SDR structure.  Returns the
+   number of SDRs and sets the timestamps, or returns -1 if the data
+   can't be used. */
+static int
+check_db_data(ipmi_sdr_info_t *sdrs, unsigned char *db_data, unsigned int len)
 {
-    int           num;
     unsigned char *d;
-    ipmi_sdr_t    *to_free;
 
     if (len < 9)
-	goto no_db;
+	return -1;
 
     /* Format# is the last byte. */
     d = db_data + len - 1;
     if (*d != 1)
-	goto no_db;
+	return -1;
+
+    len -= 9;
+    if ((len == 0) || (len % sizeof(ipmi_sdr_t)))
+	return -1;
 
     /* timestamps are the 8 bytes before the format#. */
     d -= 8;
     sdrs->last_addition_timestamp = ipmi_get_uint32(d);
     d += 4;
     sdrs->last_erase_timestamp = ipmi_get_uint32(d);
-    d += 4;
-    len -= 9;
-    num = len / sizeof(ipmi_sdr_t);
+    return len / sizeof(ipmi_sdr_t);
+}
+
+static void
+process_db_data(ipmi_sdr_info_t *sdrs,
+		unsigned char   *db_data,
+		unsigned int    len)
+{
+    int        num;
+    ipmi_sdr_t *new_sdrs;
+
+    num = check_db_data(sdrs, db_data, len);
+    if (num < 0)
+	goto no_db;
+
     /* Allocate 9 extra bytes for storing the timestamps and
      * format#. */
-    to_free = sdrs->sdrs;
-    sdrs->sdrs = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * num) + 9);
-    if (!sdrs->sdrs)
+    new_sdrs = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * num) + 9);
+    if (!new_sdrs)
 	goto no_db;
-    memcpy(sdrs->sdrs, db_data, sizeof(ipmi_sdr_t) * num);
+    memcpy(new_sdrs, db_data, sizeof(ipmi_sdr_t) * num);
+    release_sdrs(sdrs);
+    sdrs->sdrs = new_sdrs;
     sdrs->num_sdrs = num;
     sdrs->sdr_array_size = num;
     sdrs->fetched = 1;
-    if (to_free)
-	ipmi_mem_free(to_free);
+    sdrs->read_from_mc = 0;
 
  no_db:
     sdrs->os_hnd->database_free(sdrs->os_hnd, db_data);
 }
 
+/* Use the SDRs from the database in place if the OS handler can map
+   them.  Returns 0 on success. */
+static int
+map_db_data(ipmi_sdr_info_t *sdrs)
+{
+    os_handler_t  *os_hnd = sdrs->os_hnd;
+    unsigned char *db_data;
+    unsigned int  len;
+    void          *map;
+    int           num;
+    int           rv;
+
+    if (!os_hnd->database_map || !sdrs->db_key_set)
+	return ENOSYS;
+
+    rv = os_hnd->database_map(os_hnd, sdrs->db_key, &db_data, &len, &map);
+    if (rv)
+	return rv;
+
+    num = check_db_data(sdrs, db_data, len);
+    if (num < 0) {
+	os_hnd->database_unmap(os_hnd, map);
+	return EINVAL;
+    }
+
+    release_sdrs(sdrs);
+    sdrs->sdrs = (ipmi_sdr_t *) db_data;
+    sdrs->sdrs_map = map;
+    sdrs->num_sdrs = num;
+    sdrs->sdr_array_size = num;
+    sdrs->fetched = 1;
+    sdrs->read_from_mc = 0;
+    return 0;
+}
+
 static void
 db_fetched(void          *cb_data,
 	   int           err,
@@ -320,8 +524,6 @@ db_fetched(void          *cb_data,
 
     sdrs->db_fetching = 0;
     sdr_unlock(sdrs);
-    if (!err)
-	sdrs->os_hnd->database_free(sdrs->os_hnd, db_data);
     opq_op_done(sdrs->sdr_wait_q);
 }
 
@@ -340,8 +542,12 @@ start_db_fetch(void *cb_data, int shutdown)
 	return OPQ_HANDLER_ABORTED;
     }
 
-    /* Go ahead and do the database fetch here if we have support. */
-    if (sdrs->os_hnd->database_find && sdrs->db_key_set)
+    /* Go ahead and do the database fetch here if we have support.
+       Prefer using the SDRs in place, but take them from the normal
+       database if they were saved there. */
+    if (map_db_data(sdrs) == 0)
+	rv = -1; /* Just mark it as done */
+    else if (sdrs->os_hnd->database_find && sdrs->db_key_set)
     {
 	unsigned char *db_data;
 	unsigned int  db_data_len;
@@ -413,17 +619,28 @@ ipmi_sdr_info_alloc(ipmi_domain_t   *domain,
     sdrs->sdrs = NULL;
     sdrs->num_sdrs = 0;
     sdrs->sdr_array_size = 0;
+    sdrs->index_stale = 1;
     sdrs->destroy_handler = NULL;
     sdrs->lun = lun;
     sdrs->sensor = sensor;
     sdrs->sdr_wait_q = NULL;
-    /* use guaranteed size */
+    /* The system interface can return the biggest reads, other MCs
+       start out with the guaranteed size. */
     sdrs->fetch_size = STD_SDR_FETCH_BYTES;
+    if (mc) {
+	ipmi_addr_t  addr;
+	unsigned int addr_len;
+
+	ipmi_mc_get_ipmi_address(mc, &addr, &addr_len);
+	if (addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	    sdrs->fetch_size = MAX_SDR_FETCH_BYTES;
+    }
 
     /* Assume we have a dynamic population until told otherwise. */
     sdrs->dynamic_population = 1;
 
     sdrs->use_cache = ipmi_option_use_cache(domain);
+    sdrs->incremental = ipmi_option_sdr_incremental(domain);
 
     rv = ipmi_create_lock(domain, &sdrs->sdr_lock);
     if (rv)
@@ -433,14 +650,20 @@ ipmi_sdr_info_alloc(ipmi_domain_t   *domain,
     if (rv)
 	goto out_done;
 
-    sdrs->free_fetch = alloc_ilist();
-    if (!sdrs->free_fetch) {
+    /* The fetch infos move between these, make room for all of them
+       in each so moving one never has to allocate. */
+    sdrs->free_fetch = alloc_ivec();
+    if (!sdrs->free_fetch
+	|| !ivec_reserve(sdrs->free_fetch, MAX_SDR_FETCH_OUTSTANDING))
+    {
 	rv = ENOMEM;
 	goto out_done;
     }
 
-    sdrs->outstanding_fetch = alloc_ilist();
-    if (!sdrs->outstanding_fetch) {
+    sdrs->outstanding_fetch = alloc_ivec();
+    if (!sdrs->outstanding_fetch
+	|| !ivec_reserve(sdrs->outstanding_fetch, MAX_SDR_FETCH_OUTSTANDING))
+    {
 	rv = ENOMEM;
 	goto out_done;
     }
@@ -452,11 +675,13 @@ ipmi_sdr_info_alloc(ipmi_domain_t   *domain,
 	    goto out_done;
 	}
 	info->sdrs = sdrs;
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
     }
 
-    sdrs->process_fetch = alloc_ilist();
-    if (!sdrs->process_fetch) {
+    sdrs->process_fetch = alloc_ivec();
+    if (!sdrs->process_fetch
+	|| !ivec_reserve(sdrs->process_fetch, MAX_SDR_FETCH_OUTSTANDING))
+    {
 	rv = ENOMEM;
 	goto out_done;
     }
@@ -466,18 +691,20 @@ ipmi_sdr_info_alloc(ipmi_domain_t   *domain,
 	rv = ENOMEM;
 	goto out_done;
     }
+    if (mc)
+	_ipmi_mc_track_opq_waits(mc, sdrs->sdr_wait_q);
 
  out_done:
     if (rv) {
 	if (sdrs) {
 	    if (sdrs->free_fetch) {
-		ilist_iter(sdrs->free_fetch, free_fetch, NULL);
-		free_ilist(sdrs->free_fetch);
+		ivec_iter(sdrs->free_fetch, free_fetch, NULL);
+		free_ivec(sdrs->free_fetch);
 	    }
 	    if (sdrs->outstanding_fetch)
-		free_ilist(sdrs->outstanding_fetch);
+		free_ivec(sdrs->outstanding_fetch);
 	    if (sdrs->process_fetch)
-		free_ilist(sdrs->process_fetch);
+		free_ivec(sdrs->process_fetch);
 	    if (sdrs->sdr_lock)
 		ipmi_destroy_lock(sdrs->sdr_lock);
 	    ipmi_mem_free(sdrs);
@@ -505,9 +732,9 @@ internal_destroy_sdr_info(ipmi_sdr_info_t *sdrs)
 
     sdr_unlock(sdrs);
 
-    free_ilist(sdrs->free_fetch);
-    free_ilist(sdrs->outstanding_fetch);
-    free_ilist(sdrs->process_fetch);
+    free_ivec(sdrs->free_fetch);
+    free_ivec(sdrs->outstanding_fetch);
+    free_ivec(sdrs->process_fetch);
 
     /* We don't have to worry about stopping the timer, this can't be
        called if the timer is running, because a fetch operation would
@@ -523,17 +750,17 @@ internal_destroy_sdr_info(ipmi_sdr_info_t *sdrs)
     if (sdrs->destroy_handler)
 	sdrs->destroy_handler(sdrs, sdrs->destroy_cb_data);
 
-    if (sdrs->sdrs)
-	ipmi_mem_free(sdrs->sdrs);
+    release_sdrs(sdrs);
+    if (sdrs->recid_index)
+	ipmi_mem_free(sdrs->recid_index);
     ipmi_mem_free(sdrs);
 }
 
 void
 ipmi_sdr_clean_out_sdrs(ipmi_sdr_info_t *sdrs)
 {
-    if (sdrs->sdrs)
-	ipmi_mem_free(sdrs->sdrs);
-    sdrs->sdrs = NULL;
+    release_sdrs(sdrs);
+    sdrs->num_sdrs = 0;
     sdrs->dynamic_population = 1;
     sdrs->fetched = 0;
 }
@@ -607,11 +834,36 @@ ipmi_sdr_info_destroy(ipmi_sdr_info_t      *sdrs,
     return 0;
 }
 
+/* Do the newly fetched SDRs match the current ones? */
+static int
+working_sdrs_same(ipmi_sdr_info_t *sdrs)
+{
+    unsigned int i;
+    ipmi_sdr_t   *o, *n;
+
+    if (sdrs->num_sdrs != (unsigned int) (sdrs->curr_read_idx+1))
+	return 0;
+    for (i=0; i<sdrs->num_sdrs; i++) {
+	o = &sdrs->sdrs[i];
+	n = &sdrs->working_sdrs[i];
+	if ((o->record_id != n->record_id)
+	    || (o->major_version != n->major_version)
+	    || (o->minor_version != n->minor_version)
+	    || (o->type != n->type)
+	    || (o->length != n->length)
+	    || (memcmp(o->data, n->data, o->length) != 0))
+	    return 0;
+    }
+    return 1;
+}
+
 /* Must be called with the SDR locked.  This will unlock the SDR
    before calling the callback, and will return with the sdr unlocked. */
 static void
 fetch_complete(ipmi_sdr_info_t *sdrs, int err)
 {
+    int new_copy;
+
     DEBUG_INFO(sdrs);
     sdrs->wait_err = err;
     if (err) {
@@ -621,23 +873,26 @@ fetch_complete(ipmi_sdr_info_t *sdrs, int err)
 	    sdrs->working_sdrs = NULL;
 	}
     } else {
-	/* The wierd to_free business is because at some points we put
-	   the sdrs into the working_sdrs so they will be restored
-	   properly. */
-	ipmi_sdr_t *to_free = NULL;
-
+	/* At some points we put the sdrs into the working_sdrs so
+	   they will be restored properly, don't free them then. */
 	DEBUG_INFO(sdrs);
+	new_copy = sdrs->sdrs != sdrs->working_sdrs;
+	if (new_copy && sdrs->sdrs_changed && sdrs->read_from_mc
+	    && sdrs->sdrs && working_sdrs_same(sdrs))
+	    /* Only the timestamps moved, don't make the users rescan
+	       the SDRs. */
+	    sdrs->sdrs_changed = 0;
 	sdrs->fetched = 1;
+	if (new_copy)
+	    release_sdrs(sdrs);
 	sdrs->num_sdrs = sdrs->curr_read_idx+1;
 	sdrs->sdr_array_size = sdrs->num_sdrs;
-	if (sdrs->sdrs != sdrs->working_sdrs)
-	    to_free = sdrs->sdrs;
 	sdrs->sdrs = sdrs->working_sdrs;
 	sdrs->working_sdrs = NULL;
-	if (to_free)
-	    ipmi_mem_free(to_free);
 
-	if (sdrs->sdrs && sdrs->db_key_set && sdrs->os_hnd->database_store) {
+	/* Mapped SDRs are already in the database. */
+	if (sdrs->sdrs && !sdrs->sdrs_map && sdrs->db_key_set) {
+	    os_handler_t  *os_hnd = sdrs->os_hnd;
 	    unsigned int  len = sdrs->num_sdrs * sizeof(ipmi_sdr_t);
 	    unsigned char *d = ((unsigned char *) sdrs->sdrs) + len;
 
@@ -649,11 +904,21 @@ fetch_complete(ipmi_sdr_info_t *sdrs, int err)
 	    d += 4;
 	    *d = 1; /* format # */
 	    len += 9;
-	    sdrs->os_hnd->database_store(sdrs->os_hnd,
-					 sdrs->db_key,
-					 (unsigned char *) sdrs->sdrs,
-					 len);
+	    if (os_hnd->database_map_store) {
+		/* Switch to the stored copy so it is shared with other
+		   processes using the same SDRs. */
+		if (os_hnd->database_map_store(os_hnd, sdrs->db_key,
+					       (unsigned char *) sdrs->sdrs,
+					       len) == 0)
+		    map_db_data(sdrs);
+	    } else if (os_hnd->database_store) {
+		os_hnd->database_store(os_hnd, sdrs->db_key,
+				       (unsigned char *) sdrs->sdrs, len);
+	    }
 	}
+	if (new_copy)
+	    sdrs->read_from_mc = 1;
+	update_sdr_index(sdrs);
     }
     sdrs->fetch_state = HANDLERS;
     sdr_unlock(sdrs);
@@ -812,11 +1077,18 @@ process_sdr_info(ipmi_sdr_info_t *sdrs, fetch_info_t *info)
 	sdr->minor_version = (info->data[4] >> 4) & 0xf;
 	sdr->type = info->data[5];
 	sdr->length = info->data[6];
+	/* The first read may have gotten some of the body, too. */
+	if (!info->cached && (info->read_len > SDR_HEADER_SIZE))
+	    memcpy(sdr->data, info->data+2+SDR_HEADER_SIZE,
+		   info->read_len-SDR_HEADER_SIZE);
     } else {
 	memcpy(&sdr->data[info->offset-SDR_HEADER_SIZE],
 	       info->data+2, info->read_len);
     }
-    if (info->offset+info->read_len == (uint32_t)sdr->length+SDR_HEADER_SIZE) {
+    if (info->cached
+	|| (info->offset+info->read_len
+	    == (uint32_t)sdr->length+SDR_HEADER_SIZE))
+    {
 	sdrs->curr_rec_id = ipmi_get_uint16(info->data);
 	sdrs->read_offset = 0;
     } else {
@@ -831,7 +1103,7 @@ typedef struct process_info_s
 } process_info_t;
 
 static void
-check_and_process_info(ilist_iter_t *iter, void *item, void *cb_data)
+check_and_process_info(ivec_iter_t *iter, void *item, void *cb_data)
 {
     process_info_t  *pinfo = cb_data;
     ipmi_sdr_info_t *sdrs = pinfo->sdrs;
@@ -841,10 +1113,10 @@ check_and_process_info(ilist_iter_t *iter, void *item, void *cb_data)
 	&& (info->offset == sdrs->read_offset))
     {
 	if (iter)
-	    ilist_delete(iter);
+	    ivec_delete(iter);
 	pinfo->processed = 1;
 	process_sdr_info(sdrs, info);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
     }
 }
 
@@ -855,7 +1127,7 @@ typedef struct cancel_same_or_newer_s
 } cancel_same_or_newer_t;
 
 static void
-cancel_if_same_or_newer(ilist_iter_t *iter, void *item, void *cb_data)
+cancel_if_same_or_newer(ivec_iter_t *iter, void *item, void *cb_data)
 {
     cancel_same_or_newer_t *info = cb_data;
     fetch_info_t           *finfo = item;
@@ -865,14 +1137,14 @@ cancel_if_same_or_newer(ilist_iter_t *iter, void *item, void *cb_data)
 }
 
 static void
-free_if_same_or_newer(ilist_iter_t *iter, void *item, void *cb_data)
+free_if_same_or_newer(ivec_iter_t *iter, void *item, void *cb_data)
 {
     cancel_same_or_newer_t *info = cb_data;
     fetch_info_t           *finfo = item;
 
     if (finfo->idx >= info->idx) {
-	ilist_delete(iter);
-	ilist_add_tail(info->sdrs->free_fetch, finfo, &finfo->link);
+	ivec_delete(iter);
+	ivec_add_tail(info->sdrs->free_fetch, finfo);
     }
 }
 
@@ -883,8 +1155,44 @@ cancel_same_or_newer(ipmi_sdr_info_t *sdrs, int idx)
 
     info.sdrs = sdrs;
     info.idx = idx;
-    ilist_iter(sdrs->outstanding_fetch, cancel_if_same_or_newer, &info);
-    ilist_iter(sdrs->process_fetch, free_if_same_or_newer, &info);
+    ivec_iter(sdrs->outstanding_fetch, cancel_if_same_or_newer, &info);
+    ivec_iter(sdrs->process_fetch, free_if_same_or_newer, &info);
+}
+
+/* On an incremental fetch, if the cached copy has a record with the
+   same header as the one just read, copy its body into the working
+   SDR so it does not have to be read again.  Returns true if the body
+   was copied.  Must be called with the SDR lock held. */
+static int
+copy_cached_sdr_body(ipmi_sdr_info_t *sdrs,
+		     unsigned int    idx,
+		     unsigned char   *hdr)
+{
+    ipmi_sdr_t *old;
+
+    if (!sdrs->incremental || !sdrs->sdrs
+	|| (sdrs->sdrs == sdrs->working_sdrs))
+	return 0;
+
+    old = find_sdr_by_recid(sdrs, ipmi_get_uint16(hdr));
+    if (!old
+	|| (old->major_version != (hdr[2] & 0xf))
+	|| (old->minor_version != ((hdr[2] >> 4) & 0xf))
+	|| (old->type != hdr[3])
+	|| (old->length != hdr[4]))
+	return 0;
+
+    memcpy(sdrs->working_sdrs[idx].data, old->data, old->length);
+    return 1;
+}
+
+/* How much to ask for in the first read of an SDR. */
+static unsigned int
+first_read_len(ipmi_sdr_info_t *sdrs)
+{
+    if (sdrs->header_only_reads)
+	return SDR_HEADER_SIZE;
+    return sdrs->fetch_size;
 }
 
 static void handle_sdr_data(ipmi_mc_t  *mc,
@@ -913,21 +1221,21 @@ info_send(ipmi_sdr_info_t *sdrs, fetch_info_t *info, ipmi_mc_t *mc)
     ipmi_set_uint16(cmd_msg.data+2, info->sdr_rec);
     cmd_msg.data[4] = info->offset;
     cmd_msg.data[5] = info->read_len;
+    info->cached = 0;
 
     rv = ipmi_mc_send_command(mc, sdrs->lun, &cmd_msg,
 			      handle_sdr_data, info);
     if (rv) {
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "%ssdr.c(info_send): "
 		 "initial_sdr_fetch: Couldn't send first SDR fetch: %x",
 		 sdrs->name, rv);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 	fetch_complete(sdrs, rv);
     } else {
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->outstanding_fetch, info, &info->link);
+	ivec_add_tail(sdrs->outstanding_fetch, info);
     }
 
     return rv;
@@ -945,7 +1253,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
     sdr_lock(sdrs);
     DEBUG_INFO(sdrs);
-    if (! ilist_remove_item_from_list(sdrs->outstanding_fetch, info)) {
+    if (! ivec_remove_item_from_list(sdrs->outstanding_fetch, info)) {
 	DEBUG_INFO(sdrs);
 	ipmi_log(IPMI_LOG_SEVERE,
 		 "%ssdr.c(handle_sdr_data): "
@@ -956,8 +1264,8 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
     if (sdrs->destroyed) {
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
-	if (!ilist_empty(sdrs->outstanding_fetch)) {
+	ivec_add_tail(sdrs->free_fetch, info);
+	if (!ivec_empty(sdrs->outstanding_fetch)) {
 	    DEBUG_INFO(sdrs);
 	    goto out_unlock;
 	}
@@ -972,8 +1280,8 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
     if (!mc) {
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
-	if (!ilist_empty(sdrs->outstanding_fetch)) {
+	ivec_add_tail(sdrs->free_fetch, info);
+	if (!ivec_empty(sdrs->outstanding_fetch)) {
 	    DEBUG_INFO(sdrs);
 	    goto out_unlock;
 	}
@@ -990,7 +1298,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	/* A start fetch operation is waiting for the outstanding
            queue to clear, so free this and try again. */
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 
 	rv = start_fetch(sdrs, mc, 1);
 	if (rv) {
@@ -1006,11 +1314,11 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	
     if (info->fetch_retry_num != sdrs->fetch_retry_count) {
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 
 	if (sdrs->fetch_retry_count > MAX_SDR_FETCH_RETRIES) {
 	    DEBUG_INFO(sdrs);
-	    if (!ilist_empty(sdrs->outstanding_fetch)) {
+	    if (!ivec_empty(sdrs->outstanding_fetch)) {
 		DEBUG_INFO(sdrs);
 		goto out_unlock;
 	    }
@@ -1032,14 +1340,14 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	    /* Cause the operation to be terminated. */
 	    DEBUG_INFO(sdrs);
 	    sdrs->fetch_retry_count = MAX_SDR_FETCH_RETRIES+1;
-	    ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	    ivec_add_tail(sdrs->free_fetch, info);
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "%ssdr.c(handle_sdr_data): "
 		     "To many retries trying to fetch SDRs", sdrs->name);
 
 	    sdrs->fetch_err = EAGAIN;
 
-	    if (!ilist_empty(sdrs->outstanding_fetch)) {
+	    if (!ivec_empty(sdrs->outstanding_fetch)) {
 		DEBUG_INFO(sdrs);
 		goto out_unlock;
 	    }
@@ -1058,7 +1366,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	sdrs->next_read_rec_id = info->sdr_rec;
 	sdrs->curr_read_idx = info->idx-1;
 
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 	goto out_nextmsg;
     }
 
@@ -1067,7 +1375,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
            this so many times, in order to guarantee that this
            completes. */
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 	sdrs->fetch_retry_count++;
 	if (sdrs->fetch_retry_count > MAX_SDR_FETCH_RETRIES) {
 	    DEBUG_INFO(sdrs);
@@ -1078,7 +1386,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
 	    sdrs->fetch_err = EAGAIN;
 
-	    if (!ilist_empty(sdrs->outstanding_fetch)) {
+	    if (!ivec_empty(sdrs->outstanding_fetch)) {
 		DEBUG_INFO(sdrs);
 		goto out_unlock;
 	    }
@@ -1103,7 +1411,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
 		sdrs->fetch_err = rv;
 
-		if (!ilist_empty(sdrs->outstanding_fetch)) {
+		if (!ivec_empty(sdrs->outstanding_fetch)) {
 		    DEBUG_INFO(sdrs);
 		    goto out_unlock;
 		}
@@ -1122,15 +1430,41 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	/* We got an error fetching the first SDR, so the repository is
 	   probably empty.  Just go on. */
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 	start_reservation_check(sdrs, mc);
 	goto out;
     }
 
+    if ((info->offset == 0) && (info->read_len > SDR_HEADER_SIZE)
+	&& ((rsp->data[0] == IPMI_CANNOT_RETURN_REQ_LENGTH_CC)
+	    || (rsp->data[0] == IPMI_PARAMETER_OUT_OF_RANGE_CC)
+	    || (rsp->data[0] == IPMI_REQUEST_DATA_LENGTH_INVALID_CC)
+	    || (rsp->data[0] == IPMI_INVALID_DATA_FIELD_CC)))
+    {
+	/* Some systems won't return more than the SDR has, or can't
+	   return this much at once.  Go back to reading just the
+	   header first, the body reads will find the size that
+	   works. */
+	DEBUG_INFO(sdrs);
+	ivec_add_tail(sdrs->free_fetch, info);
+	sdrs->header_only_reads = 1;
+
+	/* Cancel any current or newer pending operations. */
+	cancel_same_or_newer(sdrs, info->idx);
+
+	/* Re-start the fetch on this SDR. */
+	sdrs->next_read_offset = -1;
+	sdrs->read_size = -1;
+	sdrs->next_read_rec_id = info->sdr_rec;
+	sdrs->curr_read_idx = info->idx-1;
+
+	goto out_nextmsg;
+    }
+
     if (rsp->data[0] == IPMI_CANNOT_RETURN_REQ_LENGTH_CC) {
 	/* It's more than the system can return in a single messages,
 	   decrease the size. */
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 
 	sdrs->fetch_size -= SDR_FETCH_BYTES_DECR;
 	if (sdrs->fetch_size < MIN_SDR_FETCH_BYTES) {
@@ -1142,7 +1476,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
 	    sdrs->fetch_err = IPMI_IPMI_ERR_VAL(rsp->data[0]);
 
-	    if (!ilist_empty(sdrs->outstanding_fetch)) {
+	    if (!ivec_empty(sdrs->outstanding_fetch)) {
 		DEBUG_INFO(sdrs);
 		goto out_unlock;
 	    }
@@ -1166,7 +1500,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
     if (rsp->data[0] != 0) {
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 	sdrs->fetch_retry_count = MAX_SDR_FETCH_RETRIES+1;
 
 	ipmi_log(IPMI_LOG_ERR_INFO,
@@ -1176,7 +1510,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
 	sdrs->fetch_err = IPMI_IPMI_ERR_VAL(rsp->data[0]);
 
-	if (!ilist_empty(sdrs->outstanding_fetch)) {
+	if (!ivec_empty(sdrs->outstanding_fetch)) {
 	    DEBUG_INFO(sdrs);
 	    goto out_unlock;
 	}
@@ -1185,10 +1519,19 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	goto out;
     }
 
+    if ((info->offset == 0) && (rsp->data_len >= SDR_HEADER_SIZE+3)) {
+	/* The first read may ask for more than the SDR has, only keep
+	   what was returned and is part of the SDR. */
+	if (info->read_len > (unsigned int) rsp->data[7] + SDR_HEADER_SIZE)
+	    info->read_len = rsp->data[7] + SDR_HEADER_SIZE;
+	if (info->read_len > (unsigned int) (rsp->data_len-3))
+	    info->read_len = rsp->data_len-3;
+    }
+
     if (rsp->data_len < info->read_len+3) {
 	/* We got back an invalid amount of data, abort */
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	ivec_add_tail(sdrs->free_fetch, info);
 	sdrs->fetch_retry_count = MAX_SDR_FETCH_RETRIES+1;
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "%ssdr.c(handle_sdr_data): "
@@ -1197,7 +1540,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 
 	sdrs->fetch_err = EINVAL;
 
-	if (!ilist_empty(sdrs->outstanding_fetch)) {
+	if (!ivec_empty(sdrs->outstanding_fetch)) {
 	    DEBUG_INFO(sdrs);
 	    goto out_unlock;
 	}
@@ -1215,10 +1558,15 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	sdrs->read_size = rsp->data[7] + SDR_HEADER_SIZE;
 	sdrs->next_read_rec_id = ipmi_get_uint16(rsp->data+1);
 	sdrs->next_read_offset = info->read_len;
+	if (copy_cached_sdr_body(sdrs, info->idx, rsp->data+3)) {
+	    /* Nothing more to read for this SDR. */
+	    info->cached = 1;
+	    sdrs->next_read_offset = sdrs->read_size;
+	}
     }
 
     /* Now process it for the user. */
-    memcpy(info->data, rsp->data+1, rsp->data_len-1);
+    memcpy(info->data, rsp->data+1, info->read_len+2);
 
     pinfo.processed = 0;
     pinfo.sdrs = sdrs;
@@ -1228,9 +1576,9 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	   we have already received that were received out of
 	   order. */
 	DEBUG_INFO(sdrs);
-	ilist_iter(sdrs->process_fetch, check_and_process_info, &pinfo);
+	ivec_iter(sdrs->process_fetch, check_and_process_info, &pinfo);
     } else {
-	ilist_iter_t iter;
+	ivec_iter_t iter;
 	int          pos;
 	fetch_info_t *ninfo;
 	int          found = 0;
@@ -1238,28 +1586,28 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	DEBUG_INFO(sdrs);
 	/* It is not the reponse we are expecting, just throw it onto
            the queue in order to be handled later. */
-	ilist_init_iter(&iter, sdrs->process_fetch);
-	pos = ilist_last(&iter);
+	ivec_init_iter(&iter, sdrs->process_fetch);
+	pos = ivec_last(&iter);
 	while (pos) {
-	    ninfo = ilist_get(&iter);
+	    ninfo = ivec_get(&iter);
 	    if ((info->idx > ninfo->idx) || (info->offset > ninfo->offset)) {
 		found = 1;
 		break;
 	    }
-	    pos = ilist_prev(&iter);
+	    pos = ivec_prev(&iter);
 	}
 
 	if (found) {
 	    DEBUG_INFO(sdrs);
-	    ilist_add_after(&iter, info, &info->link);
+	    ivec_add_after(&iter, info);
 	} else {
 	    DEBUG_INFO(sdrs);
-	    ilist_add_before(&iter, info, &info->link);
+	    ivec_add_before(&iter, info);
 	}
     }
 
  out_nextmsg:
-    while (!ilist_empty(sdrs->free_fetch)) {
+    while (!ivec_empty(sdrs->free_fetch)) {
 	/* We have some free buffers, see what we can do with them. */
 
 	if (sdrs->next_read_offset == 0)
@@ -1272,7 +1620,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 		/* This is the last SDR.  However, we don't go to the
 		   next stage until all the outstanding fetches are
 		   complete. */
-		if (ilist_empty(sdrs->outstanding_fetch)) {
+		if (ivec_empty(sdrs->outstanding_fetch)) {
 		    start_reservation_check(sdrs, mc);
 		    goto out;
 		}
@@ -1317,7 +1665,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 		
 		    sdrs->fetch_err = EINVAL;
 	    
-		    if (!ilist_empty(sdrs->outstanding_fetch))
+		    if (!ivec_empty(sdrs->outstanding_fetch))
 			goto out_unlock;
 	    
 		    fetch_complete(sdrs, EINVAL);
@@ -1326,7 +1674,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	    }
 	}
 
-	info = ilist_remove_first(sdrs->free_fetch);
+	info = ivec_remove_first(sdrs->free_fetch);
 	info->fetch_retry_num = sdrs->fetch_retry_count;
 
 	if (sdrs->next_read_offset == sdrs->read_size) {
@@ -1336,7 +1684,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	    sdrs->curr_read_idx++;
 	    sdrs->next_read_offset = 0;
 	    info->offset = sdrs->next_read_offset;
-	    info->read_len = SDR_HEADER_SIZE;
+	    info->read_len = first_read_len(sdrs);
 	} else {
 	    DEBUG_INFO(sdrs);
 	    info->read_len = sdrs->read_size - sdrs->next_read_offset;
@@ -1358,7 +1706,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	    
 	    sdrs->fetch_err = rv;
 	    
-	    if (!ilist_empty(sdrs->outstanding_fetch)) {
+	    if (!ivec_empty(sdrs->outstanding_fetch)) {
 		DEBUG_INFO(sdrs);
 		goto out_unlock;
 	    }
@@ -1382,7 +1730,7 @@ initial_sdr_fetch(ipmi_sdr_info_t *sdrs, ipmi_mc_t *mc)
     fetch_info_t    *info;
 
     DEBUG_INFO(sdrs);
-    info = ilist_remove_first(sdrs->free_fetch);
+    info = ivec_remove_first(sdrs->free_fetch);
     if (!info) {
 	/* Technically this cannot fail, but just in case... */
 	DEBUG_INFO(sdrs);
@@ -1393,9 +1741,9 @@ initial_sdr_fetch(ipmi_sdr_info_t *sdrs, ipmi_mc_t *mc)
     /* If all systems were implemented correctly, we could do a big
        fetch here and if it was too big then they would just return
        what was available.  Some systems, though, are picky about the
-       sizes being exactly right.  So we fetch the header first so we
-       can get the size. */
-    info->read_len = SDR_HEADER_SIZE;
+       sizes being exactly right.  So we try a big fetch, and if that
+       fails go back to fetching the header first to get the size. */
+    info->read_len = first_read_len(sdrs);
     info->fetch_retry_num = sdrs->fetch_retry_count;
     info->idx = sdrs->curr_read_idx;
     return info_send(sdrs, info, mc);
@@ -1629,8 +1977,7 @@ handle_sdr_info(ipmi_mc_t  *mc,
 	/* No sdrs, so there's nothing to do. */
 	if (sdrs->sdrs) {
 	    DEBUG_INFO(sdrs);
-	    ipmi_mem_free(sdrs->sdrs);
-	    sdrs->sdrs = NULL;
+	    release_sdrs(sdrs);
 	}
 	DEBUG_INFO(sdrs);
 	sdrs->curr_read_idx = -1;
@@ -1711,7 +2058,7 @@ start_fetch(ipmi_sdr_info_t *sdrs, ipmi_mc_t *mc, int delay)
     sdrs->working_sdrs = NULL;
     sdrs->fetch_state = FETCHING;
 
-    if (!ilist_empty(sdrs->outstanding_fetch)) {
+    if (!ivec_empty(sdrs->outstanding_fetch)) {
 	DEBUG_INFO(sdrs);
 	sdrs->waiting_start_fetch = 1;
 	return 0;
@@ -1988,7 +2335,7 @@ ipmi_get_sdr_by_recid(ipmi_sdr_info_t *sdrs,
 		      int             recid,
 		      ipmi_sdr_t      *return_sdr)
 {
-    unsigned int i;
+    ipmi_sdr_t   *sdr;
     int          rv = ENOENT;
 
     sdr_lock(sdrs);
@@ -1997,12 +2344,10 @@ ipmi_get_sdr_by_recid(ipmi_sdr_info_t *sdrs,
 	return EINVAL;
     }
 
-    for (i=0; i<sdrs->num_sdrs; i++) {
-	if (sdrs->sdrs[i].record_id == recid) {
-	    rv = 0;
-	    *return_sdr = sdrs->sdrs[i];
-	    break;
-	}
+    sdr = find_sdr_by_recid(sdrs, recid);
+    if (sdr) {
+	rv = 0;
+	*return_sdr = *sdr;
     }
 
     sdr_unlock(sdrs);
@@ -2023,11 +2368,19 @@ ipmi_get_sdr_by_type(ipmi_sdr_info_t *sdrs,
 	return EINVAL;
     }
 
-    for (i=0; i<sdrs->num_sdrs; i++) {
-	if (sdrs->sdrs[i].type == type) {
+    update_sdr_index(sdrs);
+    if (!sdrs->index_stale) {
+	if ((type >= 0) && (type < 256) && (sdrs->type_first[type] >= 0)) {
 	    rv = 0;
-	    *return_sdr = sdrs->sdrs[i];
-	    break;
+	    *return_sdr = sdrs->sdrs[sdrs->type_first[type]];
+	}
+    } else {
+	for (i=0; i<sdrs->num_sdrs; i++) {
+	    if (sdrs->sdrs[i].type == type) {
+		rv = 0;
+		*return_sdr = sdrs->sdrs[i];
+		break;
+	    }
 	}
     }
 
@@ -2072,8 +2425,13 @@ ipmi_set_sdr_by_index(ipmi_sdr_info_t *sdrs,
 
     if ((unsigned int)index >= sdrs->num_sdrs)
 	rv = ENOENT;
-    else
-	sdrs->sdrs[index] = *sdr;
+    else {
+	rv = unshare_sdrs(sdrs);
+	if (!rv) {
+	    sdrs->sdrs[index] = *sdr;
+	    sdrs->index_stale = 1;
+	}
+    }
 
     sdr_unlock(sdrs);
     return rv;
@@ -2106,6 +2464,45 @@ int ipmi_get_all_sdrs(ipmi_sdr_info_t *sdrs,
     return rv;
 }
 
+int
+ipmi_sdr_iterate_sdrs(ipmi_sdr_info_t          *sdrs,
+		      ipmi_sdr_iterate_sdrs_cb handler,
+		      void                     *cb_data)
+{
+    unsigned int i;
+
+    sdr_lock(sdrs);
+    if (sdrs->destroyed) {
+	sdr_unlock(sdrs);
+	return EINVAL;
+    }
+
+    for (i=0; i<sdrs->num_sdrs; i++) {
+	if (handler(sdrs, &sdrs->sdrs[i], cb_data))
+	    break;
+    }
+
+    sdr_unlock(sdrs);
+    return 0;
+}
+
+int
+ipmi_sdr_array_cb(ipmi_sdr_info_t     *sdrs,
+		  ipmi_sdr_array_cb_t handler,
+		  void                *cb_data)
+{
+    sdr_lock(sdrs);
+    if (sdrs->destroyed) {
+	sdr_unlock(sdrs);
+	return EINVAL;
+    }
+
+    handler(sdrs, sdrs->sdrs, sdrs->num_sdrs, cb_data);
+
+    sdr_unlock(sdrs);
+    return 0;
+}
+
 int
 ipmi_sdr_get_major_version(ipmi_sdr_info_t *sdrs, int *val)
 {
@@ -2269,24 +2666,29 @@ ipmi_sdr_add(ipmi_sdr_info_t *sdrs,
 
     sdr_lock(sdrs);
     if (sdrs->num_sdrs >= sdrs->sdr_array_size) {
-	ipmi_sdr_t *new_array;
+	ipmi_sdr_t   *new_array;
+	unsigned int new_size;
+
+	/* Grow by half again, growing by a fixed amount makes filling
+	   a big repository one SDR at a time copy it over and over. */
+	new_size = sdrs->num_sdrs + (sdrs->num_sdrs / 2) + 10;
 	/* Allocate 9 extra bytes for the db info. */
-	new_array = ipmi_mem_alloc((sizeof(ipmi_sdr_t)
-				    * (sdrs->sdr_array_size + 10)) + 9);
+	new_array = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * new_size) + 9);
 	if (!new_array) {
 	    rv = ENOMEM;
 	    goto out_unlock;
 	}
-	memcpy(new_array, sdrs->sdrs, sizeof(ipmi_sdr_t)*sdrs->sdr_array_size);
-	ipmi_mem_free(sdrs->sdrs);
+	memcpy(new_array, sdrs->sdrs, sizeof(ipmi_sdr_t)*sdrs->num_sdrs);
+	sdrs->sdr_array_size = new_size;
+	release_sdrs(sdrs);
 	sdrs->sdrs = new_array;
-	sdrs->sdr_array_size += 10;
     }
 
     pos = sdrs->num_sdrs;
     (sdrs->num_sdrs)++;
 
     memcpy(&((sdrs->sdrs)[pos]), sdr, sizeof(*sdr));
+    sdrs->index_stale = 1;
 
  out_unlock:
     sdr_unlock(sdrs);
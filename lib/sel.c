@@ -31,6 +31,9 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_SEL
+
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -39,7 +42,9 @@
 #include <OpenIPMI/ipmi_err.h>
 
 #include <OpenIPMI/internal/opq.h>
-#include <OpenIPMI/internal/ilist.h>
+#include <OpenIPMI/internal/ivec.h>
+#include <OpenIPMI/internal/htable.h>
+#include <OpenIPMI/internal/ipmi_utils.h>
 #include <OpenIPMI/internal/ipmi_int.h>
 #include <OpenIPMI/internal/ipmi_event.h>
 #include <OpenIPMI/internal/ipmi_sel.h>
@@ -63,6 +68,7 @@ typedef struct sel_event_holder_s
 {
     unsigned int deleted : 1;
     unsigned int cancelled : 1;
+    unsigned int seen : 1; /* Found in the current full fetch. */
     unsigned int refcount;
     ipmi_event_t *event;
 } sel_event_holder_t;
@@ -76,6 +82,7 @@ sel_event_holder_alloc(void)
 	return NULL;
     holder->deleted = 0;
     holder->cancelled = 0;
+    holder->seen = 0;
     holder->refcount = 1;
     holder->event = NULL;
     return holder;
@@ -105,6 +112,13 @@ typedef struct sel_clear_req_s
 
 #define SEL_NAME_LEN (IPMI_MC_NAME_LEN + 32)
 
+/* An event from the SEL digest in the database. */
+typedef struct sel_db_entry_s
+{
+    unsigned int record_id;
+    uint32_t     hash;
+} sel_db_entry_t;
+
 struct ipmi_sel_info_s
 {
     ipmi_mcid_t mc;
@@ -165,6 +179,26 @@ struct ipmi_sel_info_s
     unsigned int           start_rec_id;
     unsigned char          start_rec_id_data[14];
 
+    /* Set when a fetch starts from the first record because entries
+       may have been erased by someone else.  Events that are not
+       found again are removed when it completes.  own_erase is set
+       when we erased something, so a change in the erase timestamp
+       is expected. */
+    int                    full_fetch;
+    int                    own_erase;
+
+    /* The digest of the SEL saved in the database, see
+       save_db_digest().  db_known holds the events from the digest
+       that have not been fetched since, sorted by record id.  They
+       are still in the SEL, but not in events, until a full fetch
+       is done. */
+    unsigned int           use_cache : 1;
+    unsigned int           db_checked : 1;
+    unsigned int           db_key_set : 1;
+    char                   db_key[4+32+1];
+    sel_db_entry_t         *db_known;
+    unsigned int           db_known_len;
+
     /* A lock, primarily for handling race conditions fetching the data. */
     os_hnd_lock_t *sel_lock;
 
@@ -175,10 +209,16 @@ struct ipmi_sel_info_s
        contain more items than num_sels, num_sels only counts the
        number of non-deleted events in the list.  del_sels+num_sels
        should be the number of events. */
-    ilist_t      *events;
+    ivec_t      *events;
     unsigned int num_sels;
     unsigned int del_sels;
 
+    /* The same events, hashed by record id and sorted by timestamp
+       (then record id).  These hold no references of their own, an
+       event is in these if and only if it is in the events list. */
+    htable_t    *recids;
+    ivec_t      *by_time;
+
     /* We serialize operations through here, since we are dealing with
        a locked resource. */
     opq_t *opq;
@@ -217,16 +257,16 @@ static inline void sel_unlock(ipmi_sel_info_t *sel)
 }
 
 static void
-free_event(ilist_iter_t *iter, void *item, void *cb_data)
+free_event(ivec_iter_t *iter, void *item, void *cb_data)
 {
     sel_event_holder_t *holder = item;
     sel_event_holder_put(holder);
 }
 
 static void
-free_events(ilist_t *events)
+free_events(ivec_t *events)
 {
-    ilist_iter(events, free_event, NULL);
+    ivec_iter(events, free_event, NULL);
 }
 
 static int
@@ -237,10 +277,119 @@ recid_search_cmp(void *item, void *cb_data)
 
     return ipmi_event_get_record_id(holder->event) == recid;
 }
+
 static sel_event_holder_t *
-find_event(ilist_t *list, unsigned int recid)
+find_event(ipmi_sel_info_t *sel, unsigned int recid)
 {
-    return ilist_search(list, recid_search_cmp, &recid);
+    return htable_find(sel->recids, ipmi_hash_uint(recid),
+		       recid_search_cmp, &recid);
+}
+
+/* Compare an event against a timestamp and record id for the time
+   index. */
+static int
+time_cmp(ipmi_event_t *event, ipmi_time_t timestamp, unsigned int recid)
+{
+    ipmi_time_t  etime = ipmi_event_get_timestamp(event);
+    unsigned int erecid;
+
+    if (etime < timestamp)
+	return -1;
+    if (etime > timestamp)
+	return 1;
+    erecid = ipmi_event_get_record_id(event);
+    if (erecid < recid)
+	return -1;
+    if (erecid > recid)
+	return 1;
+    return 0;
+}
+
+/* Return the position of the first event in the time index that is
+   not before the given timestamp and record id. */
+static unsigned int
+time_index_find(ipmi_sel_info_t *sel, ipmi_time_t timestamp,
+		unsigned int recid)
+{
+    unsigned int       lo = 0, hi = ivec_count(sel->by_time), mid;
+    sel_event_holder_t *holder;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	holder = ivec_get_at(sel->by_time, mid);
+	if (time_cmp(holder->event, timestamp, recid) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/* The time index always has room for every event (see add_holder()),
+   so this cannot fail.  Events are almost always logged in time
+   order, so this is normally an add at the tail. */
+static void
+time_index_add(ipmi_sel_info_t *sel, sel_event_holder_t *holder)
+{
+    unsigned int pos;
+
+    pos = time_index_find(sel, ipmi_event_get_timestamp(holder->event),
+			  ipmi_event_get_record_id(holder->event));
+    ivec_add_at(sel->by_time, pos, holder);
+}
+
+static void
+time_index_remove(ipmi_sel_info_t *sel, sel_event_holder_t *holder)
+{
+    unsigned int pos;
+
+    pos = time_index_find(sel, ipmi_event_get_timestamp(holder->event),
+			  ipmi_event_get_record_id(holder->event));
+    if (ivec_get_at(sel->by_time, pos) == holder)
+	ivec_remove_at(sel->by_time, pos);
+}
+
+/* Put a new holder, with its event set, onto the end of the events
+   list and into the indexes.  Returns 0 on failure, 1 on success. */
+static int
+add_holder(ipmi_sel_info_t *sel, sel_event_holder_t *holder)
+{
+    unsigned int recid = ipmi_event_get_record_id(holder->event);
+
+    if (!ivec_reserve(sel->by_time, ivec_count(sel->events) + 1))
+	return 0;
+    if (!ivec_add_tail(sel->events, holder))
+	return 0;
+    if (!htable_add(sel->recids, ipmi_hash_uint(recid), holder)) {
+	ivec_remove_last(sel->events);
+	return 0;
+    }
+    time_index_add(sel, holder);
+    return 1;
+}
+
+/* Take a holder out of the indexes.  The caller removes it from the
+   events list. */
+static void
+unindex_holder(ipmi_sel_info_t *sel, sel_event_holder_t *holder)
+{
+    unsigned int recid = ipmi_event_get_record_id(holder->event);
+
+    htable_remove(sel->recids, ipmi_hash_uint(recid), holder);
+    time_index_remove(sel, holder);
+}
+
+/* Replace the event in a holder that is already indexed.  The record
+   id stays the same, but the timestamp may change. */
+static void
+replace_holder_event(ipmi_sel_info_t    *sel,
+		     sel_event_holder_t *holder,
+		     ipmi_event_t       *event)
+{
+    time_index_remove(sel, holder);
+    ipmi_event_free(holder->event);
+    holder->event = event;
+    time_index_add(sel, holder);
 }
 
 static int
@@ -306,11 +455,21 @@ ipmi_sel_alloc(ipmi_mc_t       *mc,
     i = ipmi_mc_get_name(mc, sel->name, sizeof(sel->name));
     snprintf(sel->name+i, sizeof(sel->name)-i, "(sel)");
 
-    sel->events = alloc_ilist();
+    sel->events = alloc_ivec();
     if (!sel->events) {
 	rv = ENOMEM;
 	goto out;
     }
+    sel->recids = alloc_htable();
+    if (!sel->recids) {
+	rv = ENOMEM;
+	goto out;
+    }
+    sel->by_time = alloc_ivec();
+    if (!sel->by_time) {
+	rv = ENOMEM;
+	goto out;
+    }
 
     sel->mc = ipmi_mc_convert_to_id(mc);
     sel->destroyed = 0;
@@ -325,12 +484,15 @@ ipmi_sel_alloc(ipmi_mc_t       *mc,
     sel->lun = lun;
     sel->fetch_handlers = NULL;
     sel->new_event_handler = NULL;
+    sel->use_cache = (ipmi_option_use_cache(domain)
+		      && ipmi_option_sel_cache(domain));
 
     sel->opq = opq_alloc(sel->os_hnd);
     if (!sel->opq) {
 	rv = ENOMEM;
 	goto out;
     }
+    _ipmi_mc_track_opq_waits(mc, sel->opq);
 
     if (sel->os_hnd->create_lock) {
 	rv = sel->os_hnd->create_lock(sel->os_hnd, &sel->sel_lock);
@@ -342,7 +504,11 @@ ipmi_sel_alloc(ipmi_mc_t       *mc,
     if (rv) {
 	if (sel) {
 	    if (sel->events)
-		free_ilist(sel->events);
+		free_ivec(sel->events);
+	    if (sel->recids)
+		free_htable(sel->recids);
+	    if (sel->by_time)
+		free_ivec(sel->by_time);
 	    if (sel->opq)
 		opq_destroy(sel->opq);
 	    if (sel->sel_lock)
@@ -401,8 +567,14 @@ internal_destroy_sel(ipmi_sel_info_t *sel)
 
     if (sel->events) {
 	free_events(sel->events);
-	free_ilist(sel->events);
-    }
+	free_ivec(sel->events);
+    }
+    if (sel->recids)
+	free_htable(sel->recids);
+    if (sel->by_time)
+	free_ivec(sel->by_time);
+    if (sel->db_known)
+	ipmi_mem_free(sel->db_known);
     sel_unlock(sel);
 
     if (sel->opq)
@@ -472,6 +644,194 @@ ipmi_sel_destroy(ipmi_sel_info_t      *sel,
     return 0;
 }
 
+/*
+ * The SEL digest in the database is:
+ *
+ *   format (1 byte)
+ *   last addition timestamp (4 bytes)
+ *   last erase timestamp (4 bytes)
+ *   start record id (2 bytes)
+ *   start record data (14 bytes)
+ *   a record id (2 bytes) and event hash (4 bytes) for each event
+ *
+ * It is enough to pick up the fetch where the last one left off and
+ * to recognize the events that were already reported.
+ */
+#define SEL_DB_FORMAT		1
+#define SEL_DB_HEADER_LEN	25
+#define SEL_DB_ENTRY_LEN	6
+
+/* FNV-1a over the event type and data. */
+static uint32_t
+event_hash(ipmi_event_t *event)
+{
+    const unsigned char *data = ipmi_event_get_data_ptr(event);
+    unsigned int        len = ipmi_event_get_data_len(event);
+    uint32_t            hash = 2166136261U;
+    unsigned int        i;
+
+    hash = (hash ^ ipmi_event_get_type(event)) * 16777619U;
+    for (i=0; i<len; i++)
+	hash = (hash ^ data[i]) * 16777619U;
+    return hash;
+}
+
+static int
+db_entry_cmp(const void *a, const void *b)
+{
+    const sel_db_entry_t *e1 = a, *e2 = b;
+
+    if (e1->record_id < e2->record_id)
+	return -1;
+    if (e1->record_id > e2->record_id)
+	return 1;
+    return 0;
+}
+
+/* Was this event in the SEL when the digest was saved? */
+static int
+db_known_event(ipmi_sel_info_t *sel, ipmi_event_t *event)
+{
+    sel_db_entry_t key, *entry;
+
+    if (!sel->db_known)
+	return 0;
+    key.record_id = ipmi_event_get_record_id(event);
+    entry = bsearch(&key, sel->db_known, sel->db_known_len,
+		    sizeof(key), db_entry_cmp);
+    return entry && (entry->hash == event_hash(event));
+}
+
+static void
+free_db_known(ipmi_sel_info_t *sel)
+{
+    if (sel->db_known) {
+	ipmi_mem_free(sel->db_known);
+	sel->db_known = NULL;
+	sel->db_known_len = 0;
+    }
+}
+
+static void
+db_digest_fetched(void          *cb_data,
+		  int           err,
+		  unsigned char *data,
+		  unsigned int  data_len)
+{
+    os_handler_t *os_hnd = cb_data;
+
+    /* It's too late to use it, the fetch has already started. */
+    if (!err)
+	os_hnd->database_free(os_hnd, data);
+}
+
+/* Called with the sel locked before the first fetch.  If there is a
+   digest, act like we fetched the SEL it describes. */
+static void
+load_db_digest(ipmi_sel_info_t *sel, ipmi_mc_t *mc)
+{
+    os_handler_t   *os_hnd = sel->os_hnd;
+    unsigned char  guid[16];
+    unsigned char  *data, *d;
+    unsigned int   data_len, count, i;
+    unsigned int   fetched = 0;
+    sel_db_entry_t *known = NULL;
+    char           *s;
+    int            rv;
+
+    sel->db_checked = 1;
+    if (!sel->use_cache || !os_hnd->database_find)
+	return;
+    if (ipmi_mc_get_guid(mc, guid) != 0)
+	return;
+
+    s = sel->db_key;
+    s += sprintf(s, "sel-");
+    for (i=0; i<16; i++)
+	s += sprintf(s, "%2.2x", guid[i]);
+    sel->db_key_set = 1;
+
+    rv = os_hnd->database_find(os_hnd, sel->db_key, &fetched,
+			       &data, &data_len, db_digest_fetched, os_hnd);
+    if (rv || !fetched)
+	return;
+
+    if ((data_len < SEL_DB_HEADER_LEN) || (data[0] != SEL_DB_FORMAT)
+	|| (((data_len - SEL_DB_HEADER_LEN) % SEL_DB_ENTRY_LEN) != 0))
+	goto out;
+
+    count = (data_len - SEL_DB_HEADER_LEN) / SEL_DB_ENTRY_LEN;
+    if (count) {
+	known = ipmi_mem_alloc(count * sizeof(*known));
+	if (!known)
+	    goto out;
+	d = data + SEL_DB_HEADER_LEN;
+	for (i=0; i<count; i++, d+=SEL_DB_ENTRY_LEN) {
+	    known[i].record_id = ipmi_get_uint16(d);
+	    known[i].hash = ipmi_get_uint32(d+2);
+	}
+	qsort(known, count, sizeof(*known), db_entry_cmp);
+    }
+
+    free_db_known(sel);
+    sel->db_known = known;
+    sel->db_known_len = count;
+    sel->last_addition_timestamp = ipmi_get_uint32(data+1);
+    sel->last_erase_timestamp = ipmi_get_uint32(data+5);
+    sel->start_rec_id = ipmi_get_uint16(data+9);
+    memcpy(sel->start_rec_id_data, data+11, 14);
+    sel->fetched = 1;
+
+ out:
+    os_hnd->database_free(os_hnd, data);
+}
+
+/* Called with the sel locked after a fetch that changed something. */
+static void
+save_db_digest(ipmi_sel_info_t *sel)
+{
+    os_handler_t       *os_hnd = sel->os_hnd;
+    unsigned char      *data, *d;
+    unsigned int       i, max;
+    ivec_iter_t        iter;
+    sel_event_holder_t *holder;
+
+    if (!sel->db_key_set || !os_hnd->database_store)
+	return;
+
+    max = ivec_count(sel->events) + sel->db_known_len;
+    data = ipmi_mem_alloc(SEL_DB_HEADER_LEN + (max * SEL_DB_ENTRY_LEN));
+    if (!data)
+	return;
+
+    data[0] = SEL_DB_FORMAT;
+    ipmi_set_uint32(data+1, sel->last_addition_timestamp);
+    ipmi_set_uint32(data+5, sel->last_erase_timestamp);
+    ipmi_set_uint16(data+9, sel->start_rec_id);
+    memcpy(data+11, sel->start_rec_id_data, 14);
+    d = data + SEL_DB_HEADER_LEN;
+
+    /* Events deleted locally are still in the real SEL, so they go in
+       too. */
+    ivec_init_iter(&iter, sel->events);
+    for (holder = ivec_get(&iter); holder; ) {
+	ipmi_set_uint16(d, ipmi_event_get_record_id(holder->event));
+	ipmi_set_uint32(d+2, event_hash(holder->event));
+	d += SEL_DB_ENTRY_LEN;
+	holder = ivec_next(&iter) ? ivec_get(&iter) : NULL;
+    }
+    for (i=0; i<sel->db_known_len; i++) {
+	if (find_event(sel, sel->db_known[i].record_id))
+	    continue;
+	ipmi_set_uint16(d, sel->db_known[i].record_id);
+	ipmi_set_uint32(d+2, sel->db_known[i].hash);
+	d += SEL_DB_ENTRY_LEN;
+    }
+
+    os_hnd->database_store(os_hnd, sel->db_key, data, d - data);
+    ipmi_mem_free(data);
+}
+
 /* This should be called with the sel locked.  It will unlock the sel
    before returning. */
 static void
@@ -487,6 +847,9 @@ fetch_complete(ipmi_sel_info_t *sel, int err, int do_opq_done)
     sels_changed = sel->sels_changed;
     num_sels = sel->num_sels;
 
+    if (!err && sels_changed)
+	save_db_digest(sel);
+
     elem = sel->fetch_handlers;
     sel->fetch_handlers = NULL;
     sel->fetched = 1;
@@ -522,13 +885,14 @@ fetch_complete(ipmi_sel_info_t *sel, int err, int do_opq_done)
 }
 
 static void
-free_deleted_event(ilist_iter_t *iter, void *item, void *cb_data)
+free_deleted_event(ivec_iter_t *iter, void *item, void *cb_data)
 {
     sel_event_holder_t *holder = item;
     ipmi_sel_info_t    *sel = cb_data;
 
     if (holder->deleted) {
-	ilist_delete(iter);
+	unindex_holder(sel, holder);
+	ivec_delete(iter);
 	holder->cancelled = 1;
 	sel->del_sels--;
 	sel_event_holder_put(holder);
@@ -538,7 +902,43 @@ free_deleted_event(ilist_iter_t *iter, void *item, void *cb_data)
 static void
 free_deleted_events(ipmi_sel_info_t *sel)
 {
-    ilist_iter(sel->events, free_deleted_event, sel);
+    ivec_iter(sel->events, free_deleted_event, sel);
+}
+
+static void
+clear_seen_event(ivec_iter_t *iter, void *item, void *cb_data)
+{
+    sel_event_holder_t *holder = item;
+
+    holder->seen = 0;
+}
+
+static void
+free_unseen_event(ivec_iter_t *iter, void *item, void *cb_data)
+{
+    sel_event_holder_t *holder = item;
+    ipmi_sel_info_t    *sel = cb_data;
+
+    /* Deleted events are waiting for us to clear the SEL, leave
+       them alone. */
+    if (!holder->seen && !holder->deleted) {
+	unindex_holder(sel, holder);
+	ivec_delete(iter);
+	holder->cancelled = 1;
+	sel->num_sels--;
+	sel_event_holder_put(holder);
+    }
+}
+
+/* Start the fetch from the first record, and remember which events
+   are found so the ones that are gone can be removed. */
+static void
+start_full_fetch(ipmi_sel_info_t *sel)
+{
+    sel->start_rec_id = 0;
+    sel->curr_rec_id = 0;
+    sel->full_fetch = 1;
+    ivec_iter(sel->events, clear_seen_event, NULL);
 }
 
 static void
@@ -575,6 +975,8 @@ handle_sel_clear(ipmi_mc_t  *mc,
 	/* Success!  We can free the data. */
 	free_deleted_events(sel);
 	sel->del_sels = 0;
+	sel->own_erase = 1;
+	free_db_known(sel);
     } else if (rsp->data[0] == IPMI_INVALID_RESERVATION_CC) {
 	if (sel->sel_clear_lost_reservation)
 	    ipmi_domain_stat_add(sel->sel_clear_lost_reservation, 1);
@@ -695,8 +1097,7 @@ handle_sel_data(ipmi_mc_t  *mc,
 	       reservation, it may be that another system deleted our
 	       "current" record.  Start over from the beginning of the
 	       SEL. */
-	    sel->start_rec_id = 0;
-	    sel->curr_rec_id = 0;
+	    start_full_fetch(sel);
 	    del_event = NULL;
 	    goto start_request_sel_data;
 	}
@@ -736,7 +1137,7 @@ handle_sel_data(ipmi_mc_t  *mc,
     if ((timestamp > 0) && (timestamp < ipmi_mc_get_startup_SEL_time(mc)))
 	ipmi_event_set_is_old(del_event, 1);
 
-    holder = find_event(sel->events, record_id);
+    holder = find_event(sel, record_id);
     if (!holder) {
 	holder = sel_event_holder_alloc();
 	if (!holder) {
@@ -747,8 +1148,9 @@ handle_sel_data(ipmi_mc_t  *mc,
 	    fetch_complete(sel, ENOMEM, 1);
 	    goto out;
 	}
-	if (!ilist_add_tail(sel->events, holder, NULL)) {
-	    ipmi_mem_free(holder);
+	holder->event = del_event;
+	if (!add_holder(sel, holder)) {
+	    sel_event_holder_put(holder);
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "%ssel.c(handle_sel_data): "
 		     "Could not link log onto the log linked list",
@@ -756,18 +1158,20 @@ handle_sel_data(ipmi_mc_t  *mc,
 	    fetch_complete(sel, ENOMEM, 1);
 	    goto out;
 	}
-	holder->event = del_event;
 	holder->deleted = 0;
-	event_is_new = 1;
+	holder->seen = 1;
 	sel->num_sels++;
-	if (sel->sel_received_events)
-	    ipmi_domain_stat_add(sel->sel_received_events, 1);
+	/* Events from the database digest were already reported. */
+	if (!db_known_event(sel, del_event)) {
+	    event_is_new = 1;
+	    if (sel->sel_received_events)
+		ipmi_domain_stat_add(sel->sel_received_events, 1);
+	}
     } else if (event_cmp(del_event, holder->event) != 0) {
 	/* It's a new event in an old slot, so overwrite the old
            event. */
 	
-	ipmi_event_free(holder->event);
-	holder->event = del_event;
+	replace_holder_event(sel, holder, del_event);
 	if (holder->deleted) {
 	    holder->deleted = 0;
 	    sel->num_sels++;
@@ -776,8 +1180,10 @@ handle_sel_data(ipmi_mc_t  *mc,
 	event_is_new = 1;
 	if (sel->sel_received_events)
 	    ipmi_domain_stat_add(sel->sel_received_events, 1);
+	holder->seen = 1;
     } else {
 	ipmi_event_free(del_event);
+	holder->seen = 1;
     }
 
     if (sel->next_rec_id == 0xFFFF) {
@@ -787,6 +1193,16 @@ handle_sel_data(ipmi_mc_t  *mc,
 	sel->last_addition_timestamp = sel->curr_addition_timestamp;
 	sel->last_erase_timestamp = sel->curr_erase_timestamp;
 
+	/* The next fetch only has to look past the last record. */
+	sel->start_rec_id = record_id;
+	memcpy(sel->start_rec_id_data, rsp->data+5, 14);
+
+	if (sel->full_fetch) {
+	    ivec_iter(sel->events, free_unseen_event, sel);
+	    sel->full_fetch = 0;
+	    free_db_known(sel);
+	}
+
 	/* To avoid confusion, deliver the event before we deliver fetch
            complete. */
 	if (event_is_new && sel->new_event_handler) {
@@ -803,9 +1219,11 @@ handle_sel_data(ipmi_mc_t  *mc,
 	/* If the operation completed successfully and everything in
 	   our SEL is deleted, then clear it with our old reservation.
 	   We also do the clear if the overflow flag is set; on some
-	   systems this operation clears the overflow flag. */
-	if ((sel->num_sels == 0)
-	    && ((!ilist_empty(sel->events)) || sel->overflow))
+	   systems this operation clears the overflow flag.  Events we
+	   only know from the database digest are not deleted, so
+	   don't clear them. */
+	if ((sel->num_sels == 0) && !sel->db_known
+	    && ((!ivec_empty(sel->events)) || sel->overflow))
 	{
 	    /* We don't care if this fails, because it will just
 	       happen again later if it does. */
@@ -825,6 +1243,24 @@ handle_sel_data(ipmi_mc_t  *mc,
     memcpy(sel->start_rec_id_data, rsp->data+5, 14);
     sel->curr_rec_id = sel->next_rec_id;
 
+    if (opq_preempt_pending(sel->opq)) {
+	/* Something more important is waiting, let it run.  Like a
+	   lost reservation, start_fetch() gets a new reservation and
+	   picks up from the record we just got. */
+	if (event_is_new && sel->new_event_handler) {
+	    ipmi_sel_new_event_handler_cb handler = sel->new_event_handler;
+	    void                          *cb_data = sel->new_event_cb_data;
+	    sel_unlock(sel);
+	    handler(sel, mc, del_event, cb_data);
+	    sel_lock(sel);
+	}
+	sel_unlock(sel);
+	if (opq_op_yield(sel->opq, start_fetch, elem))
+	    goto out;
+	sel_lock(sel);
+	event_is_new = 0;
+    }
+
  start_request_sel_data:
     /* Request some more data. */
     cmd_msg.data = cmd_data;
@@ -948,9 +1384,11 @@ handle_sel_info(ipmi_mc_t  *mc,
 	/* If the operation completed successfully and everything in
 	   our SEL is deleted, then clear it with our old reservation.
 	   We also do the clear if the overflow flag is set; on some
-	   systems this operation clears the overflow flag. */
-	if ((sel->num_sels == 0)
-	    && ((!ilist_empty(sel->events)) || sel->overflow))
+	   systems this operation clears the overflow flag.  Events we
+	   only know from the database digest are not deleted, so
+	   don't clear them. */
+	if ((sel->num_sels == 0) && !sel->db_known
+	    && ((!ivec_empty(sel->events)) || sel->overflow))
 	{
 	    /* We don't care if this fails, because it will just
 	       happen again later if it does. */
@@ -972,6 +1410,17 @@ handle_sel_info(ipmi_mc_t  *mc,
     sel->sels_changed = 1;
     sel->next_rec_id = 0;
 
+    /* Normally the fetch picks up after the last record we got.  If
+       someone else erased entries, that record may have been erased
+       and written again or earlier ones may be gone, so get them
+       all. */
+    if (sel->full_fetch
+	|| (sel->fetched && !sel->own_erase
+	    && (erase_timestamp != sel->last_erase_timestamp))
+	|| (sel->db_known && (sel->start_rec_id == 0)))
+	start_full_fetch(sel);
+    sel->own_erase = 0;
+
     if (fetched_num_sels == 0) {
 	/* No sels, so there's nothing to do. */
 
@@ -981,6 +1430,11 @@ handle_sel_info(ipmi_mc_t  *mc,
 	sel->last_erase_timestamp = sel->curr_erase_timestamp;
 	sel->start_rec_id = 0;
 	sel->curr_rec_id = 0;
+	if (sel->full_fetch) {
+	    ivec_iter(sel->events, free_unseen_event, sel);
+	    sel->full_fetch = 0;
+	    free_db_known(sel);
+	}
 
 	fetch_complete(sel, 0, 1);
 	goto out;
@@ -1104,6 +1558,9 @@ start_fetch_cb(ipmi_mc_t *mc, void *cb_data)
 	goto out;
     }
 
+    if (!sel->db_checked)
+	load_db_digest(sel, mc);
+
     if (sel->supports_reserve_sel) {
 	/* Get a reservation first. */
 	cmd_msg.data = cmd_data;
@@ -1207,11 +1664,11 @@ ipmi_sel_get_cb(ipmi_mc_t *mc, void *cb_data)
 	elem->next = NULL;
 	sel->fetch_handlers = elem;
 	sel_unlock(sel);
-	/* Always put a fetch ahead of everything else.  If there are
-	   deletes in progress and a clear gets done, we can complete
-	   all the deletes. */
-	if (!opq_new_op_prio(sel->opq, start_fetch, elem, 0, OPQ_ADD_HEAD,
-			    NULL))
+	/* A fetch can take a long time on a big SEL, so let deletes
+	   and adds go ahead of it.  It gives way to them between
+	   entries, too. */
+	if (!opq_new_op_prio(sel->opq, start_fetch, elem, 0,
+			     OPQ_PRIO_BACKGROUND, NULL))
 	{
 	    sel->fetch_handlers = NULL;
 	    info->rv = ENOMEM;
@@ -1328,7 +1785,7 @@ sel_op_done(sel_del_handler_data_t *data,
 }
 
 static void
-free_all_event(ilist_iter_t *iter, void *item, void *cb_data)
+free_all_event(ivec_iter_t *iter, void *item, void *cb_data)
 {
     sel_event_holder_t *holder = item;
     ipmi_sel_info_t    *sel = cb_data;
@@ -1337,14 +1794,15 @@ free_all_event(ilist_iter_t *iter, void *item, void *cb_data)
 	sel->del_sels--;
 	holder->cancelled = 1;
     }
-    ilist_delete(iter);
+    unindex_holder(sel, holder);
+    ivec_delete(iter);
     sel_event_holder_put(holder);
 }
 
 static void
 free_all_events(ipmi_sel_info_t *sel)
 {
-    ilist_iter(sel->events, free_all_event, sel);
+    ivec_iter(sel->events, free_all_event, sel);
 }
 
 static void
@@ -1385,6 +1843,8 @@ handle_del_sel_clear(ipmi_mc_t  *mc,
 
     free_all_events(sel);
     sel->num_sels = 0;
+    sel->own_erase = 1;
+    free_db_known(sel);
 
     sel_op_done(data, 0, 1);
 
@@ -1480,17 +1940,15 @@ handle_sel_delete(ipmi_mc_t  *mc,
     } else {	
 	/* We deleted the entry, so remove it from our database. */
 	sel_event_holder_t *real_holder;
-	ilist_iter_t       iter;
 
-	ilist_init_iter(&iter, sel->events);
-	ilist_unpositioned(&iter);
-	real_holder = ilist_search_iter(&iter, recid_search_cmp,
-					&(data->record_id));
+	real_holder = find_event(sel, data->record_id);
 	if (real_holder) {
-	    ilist_delete(&iter);
+	    unindex_holder(sel, real_holder);
+	    ivec_remove_item_from_list(sel->events, real_holder);
 	    sel_event_holder_put(real_holder);
 	    sel->del_sels--;
 	}
+	sel->own_erase = 1;
     }
 
     sel_op_done(data, rv, 1);
@@ -1836,7 +2294,6 @@ sel_del_event_cb(ipmi_mc_t *mc, void *cb_data)
     ipmi_event_t          *event = info->event;
     int                   cmp_event = info->cmp_event;
     sel_event_holder_t    *real_holder = NULL;
-    ilist_iter_t          iter;
     int                   start_fetch = 0;
 
     sel_lock(sel);
@@ -1846,10 +2303,7 @@ sel_del_event_cb(ipmi_mc_t *mc, void *cb_data)
     }
 
     if (event) {
-	ilist_init_iter(&iter, sel->events);
-	ilist_unpositioned(&iter);
-	real_holder = ilist_search_iter(&iter, recid_search_cmp,
-				    &info->record_id);
+	real_holder = find_event(sel, info->record_id);
 	if (!real_holder) {
 	    info->rv = EINVAL;
 	    goto out_unlock;
@@ -1916,7 +2370,8 @@ sel_del_event_cb(ipmi_mc_t *mc, void *cb_data)
 	event = NULL;
 
 	sel_unlock(sel);
-	opq_new_op_prio(sel->opq, start_del_sel, data, 0, OPQ_ADD_TAIL, elem);
+	opq_new_op_prio(sel->opq, start_del_sel, data, 0,
+			OPQ_PRIO_INTERACTIVE, elem);
     } else {
 	sel_unlock(sel);
 	/* Don't really delete the event, but report is as done. */
@@ -1993,6 +2448,459 @@ ipmi_sel_clear(ipmi_sel_info_t       *sel,
 			 cmp_event, 1);
 }
 
+/*
+ * Deleting a batch of events.  The whole batch runs as one operation
+ * with one reservation, and the deletes are sent as fast as the
+ * connection window allows.  If the reservation is lost, the deletes
+ * that failed are sent again under a new one.  There is no check of
+ * the entry before it is deleted, the record ids come from the user.
+ */
+#define SEL_BULK_PENDING	0
+#define SEL_BULK_SENT		1
+#define SEL_BULK_DONE		2
+
+typedef struct sel_bulk_del_s sel_bulk_del_t;
+
+typedef struct sel_bulk_del_ent_s
+{
+    sel_bulk_del_t     *bulk;
+    unsigned int       record_id;
+    sel_event_holder_t *holder; /* NULL if we don't have the event. */
+    int                state;
+    unsigned int       res_gen; /* The reservation it was sent with. */
+} sel_bulk_del_ent_t;
+
+struct sel_bulk_del_s
+{
+    ipmi_sel_info_t       *sel;
+    ipmi_sel_op_done_cb_t handler;
+    void                  *cb_data;
+    unsigned int          lun;
+
+    unsigned int          reservation;
+    unsigned int          res_gen;
+    unsigned int          res_count;
+    int                   reserving;
+
+    unsigned int          window;
+    unsigned int          outstanding;
+    unsigned int          next_pending; /* Nothing pending before this. */
+    int                   err;
+
+    unsigned int          count;
+    sel_bulk_del_ent_t    *ents;
+};
+
+static void
+bulk_del_free(sel_bulk_del_t *bulk)
+{
+    unsigned int i;
+
+    for (i=0; i<bulk->count; i++) {
+	if (bulk->ents[i].holder)
+	    sel_event_holder_put(bulk->ents[i].holder);
+    }
+    ipmi_mem_free(bulk->ents);
+    ipmi_mem_free(bulk);
+}
+
+/* Called with the sel locked, returns with it unlocked. */
+static void
+bulk_del_done(sel_bulk_del_t *bulk, int do_op_done)
+{
+    ipmi_sel_info_t *sel = bulk->sel;
+
+    sel_unlock(sel);
+
+    if (bulk->handler)
+	bulk->handler(sel, bulk->cb_data, bulk->err);
+
+    sel_lock(sel);
+    bulk_del_free(bulk);
+    if (sel->in_destroy) {
+	/* Nothing to do */
+	sel_unlock(sel);
+    } else if (sel->destroyed) {
+	/* This will unlock the lock. */
+	internal_destroy_sel(sel);
+    } else {
+	sel_unlock(sel);
+	if (do_op_done)
+	    opq_op_done(sel->opq);
+    }
+}
+
+static void
+bulk_del_fail_pending(sel_bulk_del_t *bulk, int err)
+{
+    unsigned int i;
+
+    for (i=bulk->next_pending; i<bulk->count; i++) {
+	if (bulk->ents[i].state == SEL_BULK_PENDING)
+	    bulk->ents[i].state = SEL_BULK_DONE;
+    }
+    bulk->next_pending = bulk->count;
+    if (!bulk->err)
+	bulk->err = err;
+}
+
+static void handle_bulk_del_reservation(ipmi_mc_t  *mc,
+					ipmi_msg_t *rsp,
+					void       *rsp_data);
+static void handle_bulk_del(ipmi_mc_t  *mc,
+			    ipmi_msg_t *rsp,
+			    void       *rsp_data);
+
+static int
+send_bulk_del_reserve(sel_bulk_del_t *bulk, ipmi_mc_t *mc)
+{
+    unsigned char cmd_data[MAX_IPMI_DATA_SIZE];
+    ipmi_msg_t    cmd_msg;
+    int           rv;
+
+    cmd_msg.data = cmd_data;
+    cmd_msg.netfn = IPMI_STORAGE_NETFN;
+    cmd_msg.cmd = IPMI_RESERVE_SEL_CMD;
+    cmd_msg.data_len = 0;
+    rv = ipmi_mc_send_command_sideeff(mc, bulk->lun, &cmd_msg,
+				      handle_bulk_del_reservation, bulk);
+    if (!rv)
+	bulk->reserving = 1;
+    return rv;
+}
+
+static int
+send_bulk_del(sel_bulk_del_ent_t *ent, ipmi_mc_t *mc)
+{
+    sel_bulk_del_t *bulk = ent->bulk;
+    unsigned char  cmd_data[4];
+    ipmi_msg_t     cmd_msg;
+
+    cmd_msg.data = cmd_data;
+    cmd_msg.netfn = IPMI_STORAGE_NETFN;
+    cmd_msg.cmd = IPMI_DELETE_SEL_ENTRY_CMD;
+    cmd_msg.data_len = 4;
+    ipmi_set_uint16(cmd_msg.data, bulk->reservation);
+    ipmi_set_uint16(cmd_msg.data+2, ent->record_id);
+    ent->res_gen = bulk->res_gen;
+    return ipmi_mc_send_command(mc, bulk->lun, &cmd_msg,
+				handle_bulk_del, ent);
+}
+
+/* Fill the window with deletes, or finish if there is nothing left
+   to do.  Called with the sel locked, returns with it unlocked. */
+static void
+bulk_del_continue(sel_bulk_del_t *bulk, ipmi_mc_t *mc)
+{
+    ipmi_sel_info_t    *sel = bulk->sel;
+    sel_bulk_del_ent_t *ent;
+    int                rv;
+
+    while (!bulk->reserving && (bulk->outstanding < bulk->window)
+	   && (bulk->next_pending < bulk->count))
+    {
+	ent = &bulk->ents[bulk->next_pending];
+	bulk->next_pending++;
+	if (ent->state != SEL_BULK_PENDING)
+	    continue;
+	rv = send_bulk_del(ent, mc);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%ssel.c(bulk_del_continue): "
+		     "Could not send SEL delete command: %x", sel->name, rv);
+	    ent->state = SEL_BULK_DONE;
+	    if (!bulk->err)
+		bulk->err = rv;
+	} else {
+	    ent->state = SEL_BULK_SENT;
+	    bulk->outstanding++;
+	}
+    }
+
+    if (!bulk->reserving && (bulk->outstanding == 0)
+	&& (bulk->next_pending >= bulk->count))
+	bulk_del_done(bulk, 1);
+    else
+	sel_unlock(sel);
+}
+
+static void
+handle_bulk_del_reservation(ipmi_mc_t  *mc,
+			    ipmi_msg_t *rsp,
+			    void       *rsp_data)
+{
+    sel_bulk_del_t  *bulk = rsp_data;
+    ipmi_sel_info_t *sel = bulk->sel;
+
+    sel_lock(sel);
+    bulk->reserving = 0;
+    if (sel->destroyed || !mc) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(handle_bulk_del_reservation): "
+		 "SEL or MC went away while SEL delete was in progress",
+		 sel->name);
+	bulk_del_fail_pending(bulk, ECANCELED);
+    } else if (rsp->data[0] != 0) {
+	if (sel->sel_delete_errors)
+	    ipmi_domain_stat_add(sel->sel_delete_errors, 1);
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(handle_bulk_del_reservation): "
+		 "IPMI error from SEL delete reservation: %x",
+		 sel->name, rsp->data[0]);
+	bulk_del_fail_pending(bulk, IPMI_IPMI_ERR_VAL(rsp->data[0]));
+    } else if (rsp->data_len < 3) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(handle_bulk_del_reservation): "
+		 "got invalid reservation length", sel->name);
+	bulk_del_fail_pending(bulk, EINVAL);
+    } else {
+	bulk->reservation = ipmi_get_uint16(rsp->data+1);
+	bulk->res_gen++;
+    }
+
+    bulk_del_continue(bulk, mc);
+}
+
+static void
+handle_bulk_del(ipmi_mc_t  *mc,
+		ipmi_msg_t *rsp,
+		void       *rsp_data)
+{
+    sel_bulk_del_ent_t *ent = rsp_data;
+    sel_bulk_del_t     *bulk = ent->bulk;
+    ipmi_sel_info_t    *sel = bulk->sel;
+    sel_event_holder_t *holder = ent->holder;
+    int                rv = 0;
+
+    sel_lock(sel);
+    bulk->outstanding--;
+    ent->state = SEL_BULK_DONE;
+
+    if (sel->destroyed || !mc) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(handle_bulk_del): "
+		 "SEL or MC went away while SEL delete was in progress",
+		 sel->name);
+	bulk_del_fail_pending(bulk, ECANCELED);
+	goto out;
+    }
+
+    if (rsp->data[0] == IPMI_INVALID_RESERVATION_CC) {
+	if (sel->sel_delete_lost_reservation)
+	    ipmi_domain_stat_add(sel->sel_delete_lost_reservation, 1);
+	/* Send it again with the next reservation.  Only the first
+	   delete that finds the current reservation gone gets a new
+	   one. */
+	ent->state = SEL_BULK_PENDING;
+	if (bulk->next_pending > (unsigned int) (ent - bulk->ents))
+	    bulk->next_pending = ent - bulk->ents;
+	if (bulk->reserving || (ent->res_gen != bulk->res_gen))
+	    goto out;
+	if (bulk->res_count >= MAX_DEL_RESERVE_RETRIES) {
+	    if (sel->sel_fail_delete_lost_reservation)
+		ipmi_domain_stat_add(sel->sel_fail_delete_lost_reservation, 1);
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%ssel.c(handle_bulk_del): "
+		     "Too many lost reservations in SEL delete", sel->name);
+	    bulk_del_fail_pending(bulk, IPMI_IPMI_ERR_VAL(rsp->data[0]));
+	    goto out;
+	}
+	bulk->res_count++;
+	rv = send_bulk_del_reserve(bulk, mc);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%ssel.c(handle_bulk_del): "
+		     "Could not send SEL reservation: %x", sel->name, rv);
+	    bulk_del_fail_pending(bulk, rv);
+	}
+	goto out;
+    }
+
+    if (rsp->data[0] == 0x80) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(handle_bulk_del): "
+		 "Operation not supported on SEL delete",
+		 sel->name);
+	rv = ENOSYS;
+    } else if ((rsp->data[0] != 0) && (rsp->data[0] != 0x81)
+	       && (rsp->data[0] != IPMI_NOT_PRESENT_CC))
+    {
+	/* 0x81 means the SEL is being erased and "not present" means
+	   it is already gone, either way the entry is gone. */
+	if (sel->sel_delete_errors)
+	    ipmi_domain_stat_add(sel->sel_delete_errors, 1);
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(handle_bulk_del): "
+		 "IPMI error from SEL delete: %x", sel->name, rsp->data[0]);
+	rv = IPMI_IPMI_ERR_VAL(rsp->data[0]);
+    } else {
+	if (sel->sel_good_deletes)
+	    ipmi_domain_stat_add(sel->sel_good_deletes, 1);
+	if (holder && !holder->cancelled
+	    && ivec_remove_item_from_list(sel->events, holder))
+	{
+	    unindex_holder(sel, holder);
+	    holder->cancelled = 1;
+	    if (holder->deleted)
+		sel->del_sels--;
+	    else
+		sel->num_sels--;
+	    sel_event_holder_put(holder);
+	}
+	sel->own_erase = 1;
+    }
+
+    if (rv && !bulk->err)
+	bulk->err = rv;
+
+ out:
+    bulk_del_continue(bulk, mc);
+}
+
+static void
+start_bulk_del_cb(ipmi_mc_t *mc, void *cb_data)
+{
+    sel_bulk_del_t  *bulk = cb_data;
+    ipmi_sel_info_t *sel = bulk->sel;
+    int             rv;
+
+    /* Called with SEL lock held. */
+    bulk->window = _ipmi_domain_max_outstanding(ipmi_mc_get_domain(mc));
+    if (sel->supports_reserve_sel) {
+	rv = send_bulk_del_reserve(bulk, mc);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%ssel.c(start_bulk_del_cb): could not send cmd: %x",
+		     sel->name, rv);
+	    bulk_del_fail_pending(bulk, rv);
+	}
+    }
+
+    bulk_del_continue(bulk, mc);
+}
+
+static int
+start_bulk_del(void *cb_data, int shutdown)
+{
+    sel_bulk_del_t  *bulk = cb_data;
+    ipmi_sel_info_t *sel = bulk->sel;
+    int             rv;
+
+    sel_lock(sel);
+    if (shutdown || sel->destroyed) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(start_bulk_del): "
+		 "SEL info was destroyed while an operation was in progress",
+		 sel->name);
+	bulk->err = ECANCELED;
+	bulk_del_done(bulk, 0);
+	return OPQ_HANDLER_ABORTED;
+    }
+
+    rv = ipmi_mc_pointer_cb(sel->mc, start_bulk_del_cb, bulk);
+    if (rv) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssel.c(start_bulk_del): MC went away during delete",
+		 sel->name);
+	bulk->err = ECANCELED;
+	bulk_del_done(bulk, 0);
+	return OPQ_HANDLER_ABORTED;
+    }
+
+    return OPQ_HANDLER_STARTED;
+}
+
+int
+ipmi_sel_del_events_by_recid(ipmi_sel_info_t       *sel,
+			     const unsigned int    *record_ids,
+			     unsigned int          count,
+			     ipmi_sel_op_done_cb_t handler,
+			     void                  *cb_data)
+{
+    sel_bulk_del_t     *bulk;
+    sel_bulk_del_ent_t *ent;
+    sel_event_holder_t *holder;
+    opq_elem_t         *elem;
+    unsigned int       i;
+    int                start_fetch;
+
+    if (count == 0)
+	return EINVAL;
+
+    bulk = ipmi_mem_alloc(sizeof(*bulk));
+    if (!bulk)
+	return ENOMEM;
+    memset(bulk, 0, sizeof(*bulk));
+    bulk->ents = ipmi_mem_alloc(count * sizeof(*bulk->ents));
+    elem = opq_alloc_elem();
+    if (!bulk->ents || !elem) {
+	if (bulk->ents)
+	    ipmi_mem_free(bulk->ents);
+	if (elem)
+	    opq_free_elem(elem);
+	ipmi_mem_free(bulk);
+	return ENOMEM;
+    }
+    bulk->sel = sel;
+    bulk->handler = handler;
+    bulk->cb_data = cb_data;
+    bulk->lun = sel->lun;
+    bulk->window = 1;
+    bulk->count = count;
+
+    sel_lock(sel);
+    if (sel->destroyed) {
+	sel_unlock(sel);
+	opq_free_elem(elem);
+	bulk_del_free(bulk);
+	return EINVAL;
+    }
+
+    /* Take the events out of the user's view now, like a single
+       delete does. */
+    for (i=0; i<count; i++) {
+	ent = &bulk->ents[i];
+	ent->bulk = bulk;
+	ent->record_id = record_ids[i];
+	ent->state = SEL_BULK_PENDING;
+	ent->res_gen = 0;
+	holder = find_event(sel, record_ids[i]);
+	ent->holder = holder;
+	if (holder) {
+	    sel_event_holder_get(holder);
+	    if (!holder->deleted) {
+		holder->deleted = 1;
+		sel->num_sels--;
+		sel->del_sels++;
+	    }
+	}
+	if (record_ids[i] == sel->start_rec_id)
+	    /* See handle_sel_check(). */
+	    sel->start_rec_id = 0;
+    }
+    start_fetch = (sel->num_sels == 0) && (sel->del_sels > 1);
+
+    if (sel->supports_delete_sel) {
+	sel_unlock(sel);
+	opq_new_op_prio(sel->opq, start_bulk_del, bulk, 0,
+			OPQ_PRIO_INTERACTIVE, elem);
+    } else {
+	/* The events will go away when the SEL is cleared, report
+	   them as done. */
+	sel_unlock(sel);
+	opq_free_elem(elem);
+	if (handler)
+	    handler(sel, cb_data, 0);
+	sel_lock(sel);
+	bulk_del_free(bulk);
+	sel_unlock(sel);
+    }
+
+    if (start_fetch)
+	ipmi_sel_get(sel, NULL, NULL);
+    return 0;
+}
+
 int
 ipmi_get_sel_count(ipmi_sel_info_t *sel,
 		   unsigned int    *count)
@@ -2028,7 +2936,7 @@ ipmi_get_sel_entries_used(ipmi_sel_info_t *sel,
 ipmi_event_t *
 ipmi_sel_get_first_event(ipmi_sel_info_t *sel)
 {
-    ilist_iter_t iter;
+    ivec_iter_t iter;
     ipmi_event_t *rv = NULL;
 
     sel_lock(sel);
@@ -2036,14 +2944,14 @@ ipmi_sel_get_first_event(ipmi_sel_info_t *sel)
 	sel_unlock(sel);
 	return NULL;
     }
-    ilist_init_iter(&iter, sel->events);
-    if (ilist_first(&iter)) {
-	sel_event_holder_t *holder = ilist_get(&iter);
+    ivec_init_iter(&iter, sel->events);
+    if (ivec_first(&iter)) {
+	sel_event_holder_t *holder = ivec_get(&iter);
 
 	while (holder->deleted) {
-	    if (! ilist_next(&iter))
+	    if (! ivec_next(&iter))
 		goto out;
-	    holder = ilist_get(&iter);
+	    holder = ivec_get(&iter);
 	}
 	rv = ipmi_event_dup(holder->event);
     }
@@ -2055,7 +2963,7 @@ ipmi_sel_get_first_event(ipmi_sel_info_t *sel)
 ipmi_event_t *
 ipmi_sel_get_last_event(ipmi_sel_info_t *sel)
 {
-    ilist_iter_t iter;
+    ivec_iter_t iter;
     ipmi_event_t *rv = NULL;
 
     sel_lock(sel);
@@ -2063,14 +2971,14 @@ ipmi_sel_get_last_event(ipmi_sel_info_t *sel)
 	sel_unlock(sel);
 	return NULL;
     }
-    ilist_init_iter(&iter, sel->events);
-    if (ilist_last(&iter)) {
-	sel_event_holder_t *holder = ilist_get(&iter);
+    ivec_init_iter(&iter, sel->events);
+    if (ivec_last(&iter)) {
+	sel_event_holder_t *holder = ivec_get(&iter);
 
 	while (holder->deleted) {
-	    if (! ilist_prev(&iter))
+	    if (! ivec_prev(&iter))
 		goto out;
-	    holder = ilist_get(&iter);
+	    holder = ivec_get(&iter);
 	}
 	rv = ipmi_event_dup(holder->event);
     }
@@ -2082,7 +2990,7 @@ ipmi_sel_get_last_event(ipmi_sel_info_t *sel)
 ipmi_event_t *
 ipmi_sel_get_next_event(ipmi_sel_info_t *sel, const ipmi_event_t *event)
 {
-    ilist_iter_t iter;
+    ivec_iter_t iter;
     ipmi_event_t *rv = NULL;
     unsigned int record_id;
 
@@ -2091,17 +2999,17 @@ ipmi_sel_get_next_event(ipmi_sel_info_t *sel, const ipmi_event_t *event)
 	sel_unlock(sel);
 	return NULL;
     }
-    ilist_init_iter(&iter, sel->events);
-    ilist_unpositioned(&iter);
+    ivec_init_iter(&iter, sel->events);
+    ivec_unpositioned(&iter);
     record_id = ipmi_event_get_record_id(event);
-    if (ilist_search_iter(&iter, recid_search_cmp, &record_id)) {
-	if (ilist_next(&iter)) {
-	    sel_event_holder_t *holder = ilist_get(&iter);
+    if (ivec_search_iter(&iter, recid_search_cmp, &record_id)) {
+	if (ivec_next(&iter)) {
+	    sel_event_holder_t *holder = ivec_get(&iter);
 
 	    while (holder->deleted) {
-		if (! ilist_next(&iter))
+		if (! ivec_next(&iter))
 		    goto out;
-		holder = ilist_get(&iter);
+		holder = ivec_get(&iter);
 	    }
 	    rv = ipmi_event_dup(holder->event);
 	}
@@ -2114,7 +3022,7 @@ ipmi_sel_get_next_event(ipmi_sel_info_t *sel, const ipmi_event_t *event)
 ipmi_event_t *
 ipmi_sel_get_prev_event(ipmi_sel_info_t *sel, const ipmi_event_t *event)
 {
-    ilist_iter_t iter;
+    ivec_iter_t iter;
     ipmi_event_t *rv = NULL;
     unsigned int record_id;
 
@@ -2123,17 +3031,17 @@ ipmi_sel_get_prev_event(ipmi_sel_info_t *sel, const ipmi_event_t *event)
 	sel_unlock(sel);
 	return NULL;
     }
-    ilist_init_iter(&iter, sel->events);
-    ilist_unpositioned(&iter);
+    ivec_init_iter(&iter, sel->events);
+    ivec_unpositioned(&iter);
     record_id = ipmi_event_get_record_id(event);
-    if (ilist_search_iter(&iter, recid_search_cmp, &record_id)) {
-	if (ilist_prev(&iter)) {
-	    sel_event_holder_t *holder = ilist_get(&iter);
+    if (ivec_search_iter(&iter, recid_search_cmp, &record_id)) {
+	if (ivec_prev(&iter)) {
+	    sel_event_holder_t *holder = ivec_get(&iter);
 
 	    while (holder->deleted) {
-		if (! ilist_prev(&iter))
+		if (! ivec_prev(&iter))
 		    goto out;
-		holder = ilist_get(&iter);
+		holder = ivec_get(&iter);
 	    }
 	    rv = ipmi_event_dup(holder->event);
 	}
@@ -2156,7 +3064,7 @@ ipmi_sel_get_event_by_recid(ipmi_sel_info_t *sel,
 	return NULL;
     }
 
-    holder = find_event(sel->events, record_id);
+    holder = find_event(sel, record_id);
     if (!holder)
 	goto out_unlock;
 
@@ -2170,6 +3078,31 @@ ipmi_sel_get_event_by_recid(ipmi_sel_info_t *sel,
     return rv;
 }
 
+int
+ipmi_sel_iterate_events(ipmi_sel_info_t             *sel,
+			ipmi_sel_iterate_events_cb handler,
+			void                       *cb_data)
+{
+    ivec_iter_t        iter;
+    sel_event_holder_t *holder;
+
+    sel_lock(sel);
+    if (sel->destroyed) {
+	sel_unlock(sel);
+	return EINVAL;
+    }
+
+    ivec_init_iter(&iter, sel->events);
+    for (holder = ivec_get(&iter); holder; ) {
+	if (!holder->deleted && handler(sel, holder->event, cb_data))
+	    break;
+	holder = ivec_next(&iter) ? ivec_get(&iter) : NULL;
+    }
+
+    sel_unlock(sel);
+    return 0;
+}
+
 int
 ipmi_get_all_sels(ipmi_sel_info_t *sel,
 		  int             *array_size,
@@ -2189,22 +3122,22 @@ ipmi_get_all_sels(ipmi_sel_info_t *sel,
     } else if (sel->num_sels == 0) {
 	rv = 0;
     } else {
-	ilist_iter_t iter;
+	ivec_iter_t iter;
 
-	ilist_init_iter(&iter, sel->events);
-	if (! ilist_first(&iter)) {
+	ivec_init_iter(&iter, sel->events);
+	if (! ivec_first(&iter)) {
 	    rv = EINVAL;
 	    goto out_unlock;
 	}
 	for (i=0; ; ) {
-	    sel_event_holder_t *holder = ilist_get(&iter);
+	    sel_event_holder_t *holder = ivec_get(&iter);
 
 	    if (! holder->deleted) {
 		array[i] = ipmi_event_dup(holder->event);
 	    }
 	    i++;
 	    if (i < sel->num_sels) {
-		if (! ilist_next(&iter)) {
+		if (! ivec_next(&iter)) {
 		    rv = EINVAL;
 		    i--;
 		    while (i >= 0)
@@ -2222,6 +3155,50 @@ ipmi_get_all_sels(ipmi_sel_info_t *sel,
     return rv;
 }
 
+int
+ipmi_sel_get_events_by_time(ipmi_sel_info_t *sel,
+			    ipmi_time_t     start,
+			    ipmi_time_t     end,
+			    int             *array_size,
+			    ipmi_event_t    **array)
+{
+    unsigned int       first, pos, count = 0;
+    sel_event_holder_t *holder;
+    int                rv = 0;
+
+    sel_lock(sel);
+    if (sel->destroyed) {
+	sel_unlock(sel);
+	return EINVAL;
+    }
+
+    first = time_index_find(sel, start, 0);
+    for (pos = first; ; pos++) {
+	holder = ivec_get_at(sel->by_time, pos);
+	if (!holder || ipmi_event_get_timestamp(holder->event) >= end)
+	    break;
+	if (!holder->deleted)
+	    count++;
+    }
+
+    if (*array_size < (int) count) {
+	rv = E2BIG;
+    } else {
+	count = 0;
+	for (pos = first; ; pos++) {
+	    holder = ivec_get_at(sel->by_time, pos);
+	    if (!holder || ipmi_event_get_timestamp(holder->event) >= end)
+		break;
+	    if (!holder->deleted)
+		array[count++] = ipmi_event_dup(holder->event);
+	}
+    }
+    *array_size = count;
+
+    sel_unlock(sel);
+    return rv;
+}
+
 int
 ipmi_sel_get_major_version(ipmi_sel_info_t *sel, int *val)
 {
@@ -2401,26 +3378,26 @@ ipmi_sel_event_add(ipmi_sel_info_t *sel,
     }
 
     record_id = ipmi_event_get_record_id(new_event);
-    holder = find_event(sel->events, record_id);
+    holder = find_event(sel, record_id);
     if (!holder) {
 	holder = sel_event_holder_alloc();
 	if (!holder) {
 	    rv = ENOMEM;
 	    goto out_unlock;
 	}
-	if (!ilist_add_tail(sel->events, holder, NULL)) {
+	holder->event = ipmi_event_dup(new_event);
+	if (!add_holder(sel, holder)) {
+	    sel_event_holder_put(holder);
 	    rv = ENOMEM;
 	    goto out_unlock;
 	}
-	holder->event = ipmi_event_dup(new_event);
 	sel->num_sels++;
     } else if (event_cmp(holder->event, new_event) == 0) {
 	/* A duplicate event, just ignore it and return the right
 	   error. */
 	rv = EEXIST;
     } else {
-	ipmi_event_free(holder->event);
-	holder->event = ipmi_event_dup(new_event);
+	replace_holder_event(sel, holder, ipmi_event_dup(new_event));
 	if (holder->deleted) {
 	    holder->deleted = 0;
 	    sel->num_sels++;
@@ -2602,8 +3579,10 @@ ipmi_sel_add_event_to_sel(ipmi_sel_info_t           *sel,
 
     sel_unlock(sel);
 
-    /* Schedule this to run at the end of the queue. */
-    if (!opq_new_op(sel->opq, sel_add_event_op, info, 0)) {
+    /* Schedule this to run after other interactive operations. */
+    if (!opq_new_op_prio(sel->opq, sel_add_event_op, info, 0,
+			 OPQ_PRIO_INTERACTIVE, NULL))
+    {
 	rv = ENOMEM;
 	goto out_unlock;
     }
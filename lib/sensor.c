@@ -31,14 +31,18 @@
  *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define IPMI_MEM_TYPE IPMI_MEM_TYPE_SENSOR
+
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
 
 #include <OpenIPMI/ipmiif.h>
 #include <OpenIPMI/ipmi_sdr.h>
 #include <OpenIPMI/ipmi_msgbits.h>
 #include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_batch.h>
 
 #include <OpenIPMI/internal/locked_list.h>
 #include <OpenIPMI/internal/opq.h>
@@ -67,10 +71,24 @@ struct ipmi_sensor_info_s
 };
 
 #define SENSOR_ID_LEN 32 /* 16 bytes are allowed for a sensor. */
+typedef struct sensor_conv_s
+{
+    int m : 10;
+    unsigned int tolerance : 6;
+    int b : 10;
+    int r_exp : 4;
+    unsigned int accuracy_exp : 2;
+    int accuracy : 10;
+    int b_exp : 4;
+} sensor_conv_t;
+
 struct ipmi_sensor_s
 {
     unsigned int  usecount;
 
+    /* The domain handle given out in ids, 0 if none yet. */
+    unsigned int  handle;
+
     ipmi_domain_t *domain; /* Domain I am in. */
 
     ipmi_mc_t     *mc; /* My owner, NOT the SMI mc (unless that
@@ -157,15 +175,24 @@ struct ipmi_sensor_s
 
     unsigned char linearization;
 
-    struct {
-	int m : 10;
-	unsigned int tolerance : 6;
-	int b : 10;
-	int r_exp : 4;
-	unsigned int accuracy_exp : 2;
-	int accuracy : 10;
-	int b_exp : 4;
-    } conv[256];
+    /* The conversion factors.  Nearly every sensor uses the same
+       factors for all raw values, so they are kept once in conv.
+       Only if some raw value gets different factors set is
+       conv_table allocated with a set for each raw value. */
+    sensor_conv_t conv;
+    sensor_conv_t *conv_table;
+
+    /* The conversion, built from the factors the first time one is
+       done.  A linear sensor with a single set of factors converts
+       directly using cooked_b and cooked_scale, anything else gets
+       the cooked value of every raw value allocated in cooked.  Any
+       change to the conversion parameters clears cooked_valid so
+       this gets rebuilt. */
+    unsigned int  cooked_valid : 1;
+    unsigned int  cooked_order : 2;
+    double        cooked_b;
+    double        cooked_scale;
+    double        *cooked;
 
     unsigned int  normal_min_specified : 1;
     unsigned int  normal_max_specified : 1;
@@ -183,10 +210,11 @@ struct ipmi_sensor_s
 
     unsigned char oem1;
 
-    /* Note that the ID is *not* nil terminated. */
+    /* The ID from the device SDR, interned so identical systems
+       share it.  Use id_len, a unicode ID may have nils in it. */
     enum ipmi_str_type_e id_type;
     unsigned int id_len;
-    char id[SENSOR_ID_LEN]; /* The ID from the device SDR. */
+    const char *id;
 
     const char *sensor_type_string;
     const char *event_reading_type_string;
@@ -201,6 +229,41 @@ struct ipmi_sensor_s
     opq_t *waitq;
     ipmi_event_state_t event_state;
 
+    /* The last reading, kept for reading_max_age milliseconds so
+       readers close together share one Get Sensor Reading.  While a
+       read for the cache is in progress, other readers wait for it
+       on reading_waiters.  Not used if reading_max_age is 0. */
+    unsigned int              reading_max_age;
+    unsigned int              reading_cached : 1;
+    unsigned int              reading_in_progress : 1;
+    struct timeval            reading_time;
+    enum ipmi_value_present_e reading_value_present;
+    unsigned int              reading_raw;
+    double                    reading_cooked;
+    ipmi_states_t             reading_states;
+    struct reading_get_info_s *reading_waiters;
+
+    /* The last reading given to the domain's sensor update handler,
+       so only changes are reported. */
+    unsigned int              update_reported : 1;
+    unsigned int              update_raw;
+    unsigned int              update_states;
+
+    /* The thresholds, hysteresis and event enables from the last
+       get, so later gets don't have to send a command.  Thrown away
+       when they are set.  Only used if attr_cache is set. */
+    unsigned int              attr_cache : 1;
+    unsigned int              thresholds_cached : 1;
+    unsigned int              hysteresis_cached : 1;
+    unsigned int              enables_cached : 1;
+    ipmi_thresholds_t         cached_thresholds;
+    unsigned int              cached_hyst_positive;
+    unsigned int              cached_hyst_negative;
+    ipmi_event_state_t        cached_enables;
+
+    /* History of the raw readings, NULL if not kept. */
+    struct sensor_history_s   *history;
+
     /* Polymorphic functions. */
     ipmi_sensor_cbs_t cbs;
 
@@ -211,9 +274,9 @@ struct ipmi_sensor_s
     ipmi_sensor_destroy_cb destroy_handler;
     void                   *destroy_handler_cb_data;
 
-    /* Name we use for reporting.  We add a ' ' onto the end, thus
-       the +1. */
-    char name[IPMI_SENSOR_NAME_LEN+1];
+    /* Name we use for reporting, interned.  We add a ' ' onto the
+       end. */
+    const char *name;
 
     /* Used for temporary linking. */
     ipmi_sensor_t *tlink;
@@ -226,6 +289,79 @@ struct ipmi_sensor_s
 
 static void sensor_final_destroy(ipmi_sensor_t *sensor);
 
+/***********************************************************************
+ *
+ * Conversion factor storage.
+ *
+ **********************************************************************/
+
+/* Get the conversion factors for a raw value. */
+static sensor_conv_t *
+sensor_conv(ipmi_sensor_t *sensor, int idx)
+{
+    if (sensor->conv_table)
+	return &sensor->conv_table[idx & 0xff];
+    return &sensor->conv;
+}
+
+static int
+sensor_conv_equal(const sensor_conv_t *c1, const sensor_conv_t *c2)
+{
+    return ((c1->m == c2->m)
+	    && (c1->tolerance == c2->tolerance)
+	    && (c1->b == c2->b)
+	    && (c1->r_exp == c2->r_exp)
+	    && (c1->accuracy_exp == c2->accuracy_exp)
+	    && (c1->accuracy == c2->accuracy)
+	    && (c1->b_exp == c2->b_exp));
+}
+
+/* Set the conversion factors for a raw value.  Without a per-raw
+   table, setting raw value 0 sets the shared factors for all raw
+   values; OEM code sets the factors in a loop from raw value 0
+   upward, so this comes out the same.  Only when a later raw value
+   gets different factors is the table allocated.  Setting raw value
+   255 ends such a loop, so if all the entries came out the same the
+   table is dropped again. */
+static void
+sensor_set_conv(ipmi_sensor_t *sensor, int idx, sensor_conv_t *conv)
+{
+    sensor_conv_t *table = sensor->conv_table;
+    int           i;
+
+    idx &= 0xff;
+    if (!table) {
+	if ((idx == 0) || sensor_conv_equal(conv, &sensor->conv)) {
+	    sensor->conv = *conv;
+	    return;
+	}
+
+	table = ipmi_mem_alloc(sizeof(*table) * 256);
+	if (!table) {
+	    ipmi_log(IPMI_LOG_SEVERE,
+		     "%ssensor.c(sensor_set_conv):"
+		     " Out of memory allocating conversion table",
+		     SENSOR_NAME(sensor));
+	    return;
+	}
+	for (i=0; i<256; i++)
+	    table[i] = sensor->conv;
+	sensor->conv_table = table;
+    }
+
+    table[idx] = *conv;
+
+    if (idx == 255) {
+	for (i=1; i<256; i++) {
+	    if (!sensor_conv_equal(&table[0], &table[i]))
+		return;
+	}
+	sensor->conv = table[0];
+	sensor->conv_table = NULL;
+	ipmi_mem_free(table);
+    }
+}
+
 /***********************************************************************
  *
  * Sensor ID handling.
@@ -279,6 +415,17 @@ ipmi_sensor_convert_to_id(ipmi_sensor_t *sensor)
     val.lun = sensor->lun;
     val.sensor_num = sensor->num;
 
+    if (!sensor->handle && !sensor->destroyed) {
+	_ipmi_domain_entity_lock(sensor->domain);
+	if (!sensor->handle)
+	    sensor->handle = _ipmi_domain_handle_alloc(
+		sensor->domain, sensor, val.mcid.seq,
+		IPMI_DOMAIN_HANDLE_KEY(IPMI_DOMAIN_HANDLE_SENSOR,
+				       sensor->lun, sensor->num));
+	_ipmi_domain_entity_unlock(sensor->domain);
+    }
+    val.handle = sensor->handle;
+
     return val;
 }
 
@@ -371,6 +518,66 @@ mc_cb(ipmi_mc_t *mc, void *cb_data)
 	_ipmi_entity_put(entity);
 }
 
+/* Find the sensor with the handle in the id, without looking up the
+   MC.  Returns ENOENT if the handle is not good so the caller can do
+   it the normal way. */
+static int
+sensor_handle_cb(ipmi_sensor_id_t   id,
+		 ipmi_sensor_ptr_cb handler,
+		 void               *cb_data)
+{
+    ipmi_domain_t *domain = id.mcid.domain_id.domain;
+    ipmi_sensor_t *sensor;
+    ipmi_entity_t *entity;
+    ipmi_mc_t     *mc;
+    int           rv;
+
+    rv = _ipmi_domain_get(domain);
+    if (rv)
+	return rv;
+
+    _ipmi_domain_entity_lock(domain);
+    sensor = _ipmi_domain_handle_lookup(domain, id.handle, id.mcid.seq,
+					IPMI_DOMAIN_HANDLE_KEY(
+					    IPMI_DOMAIN_HANDLE_SENSOR,
+					    id.lun, id.sensor_num));
+    if (!sensor || !sensor->mc) {
+	rv = ENOENT;
+	goto out_unlock;
+    }
+
+    rv = _ipmi_entity_get(sensor->entity);
+    if (rv)
+	goto out_unlock;
+    entity = sensor->entity;
+
+    rv = _ipmi_sensor_get(sensor);
+    if (rv) {
+	_ipmi_domain_entity_unlock(domain);
+	_ipmi_entity_put(entity);
+	goto out;
+    }
+
+    /* Hold the MC like a normal lookup would, it stays around while
+       the sensor is not destroyed. */
+    mc = sensor->mc;
+    _ipmi_mc_get(mc);
+    _ipmi_domain_entity_unlock(domain);
+
+    handler(sensor, cb_data);
+
+    _ipmi_sensor_put(sensor);
+    _ipmi_entity_put(entity);
+    _ipmi_mc_put(mc);
+    goto out;
+
+ out_unlock:
+    _ipmi_domain_entity_unlock(domain);
+ out:
+    _ipmi_domain_put(domain);
+    return rv;
+}
+
 int
 ipmi_sensor_pointer_cb(ipmi_sensor_id_t   id,
 		       ipmi_sensor_ptr_cb handler,
@@ -382,6 +589,12 @@ ipmi_sensor_pointer_cb(ipmi_sensor_id_t   id,
     if (id.lun >= 5)
 	return EINVAL;
 
+    if (id.handle) {
+	rv = sensor_handle_cb(id, handler, cb_data);
+	if (rv != ENOENT)
+	    return rv;
+    }
+
     info.handler = handler;
     info.cb_data = cb_data;
     info.id = id;
@@ -536,6 +749,25 @@ ipmi_sensor_add_opq(ipmi_sensor_t         *sensor,
     return 0;
 }
 
+int
+ipmi_sensor_add_opq_concurrent(ipmi_sensor_t         *sensor,
+			       ipmi_sensor_op_cb     handler,
+			       ipmi_sensor_op_info_t *info,
+			       void                  *cb_data)
+{
+    if (sensor->destroyed)
+	return EINVAL;
+
+    info->__sensor = sensor;
+    info->__sensor_id = ipmi_sensor_convert_to_id(sensor);
+    info->__cb_data = cb_data;
+    info->__handler = handler;
+    opq_set_max_running(sensor->waitq, _ipmi_mc_op_concurrency(sensor->mc));
+    if (!opq_new_op_concurrent(sensor->waitq, sensor_opq_ready, info, 0))
+	return ENOMEM;
+    return 0;
+}
+
 static void
 sensor_id_add_opq_cb(ipmi_sensor_t *sensor, void *cb_data)
 {
@@ -817,7 +1049,7 @@ ipmi_sensor_alloc_nonstandard(ipmi_sensor_t **new_sensor)
 {
     ipmi_sensor_t *sensor;
 
-    sensor = ipmi_mem_alloc(sizeof(*sensor));
+    sensor = ipmi_arena_alloc(NULL, sizeof(*sensor));
     if (!sensor)
 	return ENOMEM;
 
@@ -931,6 +1163,7 @@ ipmi_sensor_add_nonstandard(ipmi_mc_t              *mc,
     sensor->domain = domain;
     sensor->mc = mc;
     sensor->source_mc = source_mc;
+    _ipmi_mc_track_opq_waits(mc, sensor->waitq);
     sensor->lun = 4;
     sensor->send_lun = send_lun;
     sensor->num = num;
@@ -1020,6 +1253,13 @@ handler_list_cleanup(void *cb_data, void *item1, void *item2)
 static void
 sensor_final_destroy(ipmi_sensor_t *sensor)
 {
+    if (sensor->handle) {
+	_ipmi_domain_entity_lock(sensor->domain);
+	_ipmi_domain_handle_free(sensor->domain, sensor->handle);
+	sensor->handle = 0;
+	_ipmi_domain_entity_unlock(sensor->domain);
+    }
+
     _ipmi_entity_get(sensor->entity);
     _ipmi_entity_call_sensor_handlers(sensor->entity, sensor, IPMI_DELETED);
 
@@ -1046,8 +1286,17 @@ sensor_final_destroy(ipmi_sensor_t *sensor)
     if (sensor->oem_info_cleanup_handler)
 	sensor->oem_info_cleanup_handler(sensor, sensor->oem_info);
 
+    if (sensor->conv_table)
+	ipmi_mem_free(sensor->conv_table);
+    if (sensor->cooked)
+	ipmi_mem_free(sensor->cooked);
+    if (sensor->history)
+	ipmi_mem_free(sensor->history);
+    _ipmi_str_unintern(sensor->id);
+    _ipmi_str_unintern(sensor->name);
+
     _ipmi_entity_put(sensor->entity);
-    ipmi_mem_free(sensor);
+    ipmi_arena_free(sensor);
 }
 
 int
@@ -1107,23 +1356,30 @@ ipmi_sensors_destroy(ipmi_sensor_info_t *sensors)
 static void
 sensor_set_name(ipmi_sensor_t *sensor)
 {
-    int length;
+    char       name[IPMI_SENSOR_NAME_LEN+1];
+    const char *old = sensor->name;
+    int        length;
 
-    length = ipmi_entity_get_name(sensor->entity, sensor->name,
-				  sizeof(sensor->name)-2);
-    sensor->name[length] = '.';
+    length = ipmi_entity_get_name(sensor->entity, name, sizeof(name)-2);
+    name[length] = '.';
     length++;
-    length += snprintf(sensor->name+length, IPMI_SENSOR_NAME_LEN-length-2,
-		       "%s", sensor->id);
-    sensor->name[length] = ' ';
-    length++;
-    sensor->name[length] = '\0';
+    length += snprintf(name+length, IPMI_SENSOR_NAME_LEN-length-2,
+		       "%s", sensor->id ? sensor->id : "");
+    name[length] = ' ';
     length++;
+    name[length] = '\0';
+
+    /* Intern the new one first, if it is the same the old one stays
+       in place for anyone using it. */
+    sensor->name = _ipmi_str_intern(name, length);
+    _ipmi_str_unintern(old);
 }
 
 const char *
 _ipmi_sensor_name(const ipmi_sensor_t *sensor)
 {
+    if (!sensor->name)
+	return "";
     return sensor->name;
 }
 
@@ -1136,7 +1392,7 @@ ipmi_sensor_get_name(ipmi_sensor_t *sensor, char *name, int length)
 	return 0;
 
     /* Never changes, no lock needed. */
-    slen = strlen(sensor->name);
+    slen = sensor->name ? strlen(sensor->name) : 0;
     if (slen == 0) {
 	if (name)
 	    *name = '\0';
@@ -1161,6 +1417,30 @@ ipmi_sensor_get_name(ipmi_sensor_t *sensor, char *name, int length)
  *
  **********************************************************************/
 
+/* A single SDR can contain multiple sensors, count them. */
+static int
+count_sdr_sensors(ipmi_sdr_info_t  *sdrs,
+		  const ipmi_sdr_t *sdr,
+		  void             *cb_data)
+{
+    unsigned int *p = cb_data;
+
+    if (sdr->type == 1) {
+	*p += 1;
+    } else if (sdr->type == 2) {
+	if (sdr->data[18] & 0x0f)
+	    *p += sdr->data[18] & 0x0f;
+	else
+	    *p += 1;
+    } else if (sdr->type == 3) {
+	if (sdr->data[7] & 0x0f)
+	    *p += sdr->data[7] & 0x0f;
+	else
+	    *p += 1;
+    }
+    return 0;
+}
+
 static int
 get_sensors_from_sdrs(ipmi_domain_t      *domain,
 		      ipmi_mc_t          *source_mc,
@@ -1182,7 +1462,9 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
     int           id_string_modifier_offset;
     unsigned char *str;
     unsigned int  str_len;
-    
+    char          idstr[SENSOR_ID_LEN];
+    unsigned int  idstr_len;
+    ipmi_arena_t  *arena = _ipmi_domain_arena(domain);
 
     rv = ipmi_get_sdr_count(sdrs, &count);
     if (rv) {
@@ -1196,35 +1478,14 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
     /* Get a real count on the number of sensors, since a single SDR can
        contain multiple sensors. */
     p = 0;
-    for (i=0; i<count; i++) {
-	int incr;
-
-	rv = ipmi_get_sdr_by_index(sdrs, i, &sdr);
-	if (rv) {
-	    ipmi_log(IPMI_LOG_WARNING,
-		     "%ssensor.c(get_sensors_from_sdrs):"
-		     " SDR record %d could not be fetched from the SDR"
-		     " record: %d",
-		     MC_NAME(source_mc), i, rv);
-	    goto out_err;
-	}
-
-	if (sdr.type == 1) {
-	    incr = 1;
-	} else if (sdr.type == 2) {
-	    if (sdr.data[18] & 0x0f)
-		incr = sdr.data[18] & 0x0f;
-	    else
-		incr = 1;
-	} else if (sdr.type == 3) {
-	    if (sdr.data[7] & 0x0f)
-		incr = sdr.data[7] & 0x0f;
-	    else
-		incr = 1;
-	} else
-	    continue;
-
-	p += incr;
+    rv = ipmi_sdr_iterate_sdrs(sdrs, count_sdr_sensors, &p);
+    if (rv) {
+	ipmi_log(IPMI_LOG_WARNING,
+		 "%ssensor.c(get_sensors_from_sdrs):"
+		 " SDR records could not be fetched from the SDR"
+		 " record: %d",
+		 MC_NAME(source_mc), rv);
+	goto out_err;
     }
     if (!p)
 	return 0;
@@ -1251,7 +1512,7 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 	if ((sdr.type != 1) && (sdr.type != 2) && (sdr.type != 3))
 	    continue;
 
-	s[p] = ipmi_mem_alloc(sizeof(*s[p]));
+	s[p] = ipmi_arena_alloc(arena, sizeof(*s[p]));
 	if (!s[p])
 	    goto out_err_enomem;
 	memset(s[p], 0, sizeof(*s[p]));
@@ -1292,6 +1553,7 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 		     MC_NAME(source_mc), i, sdr.data[1] >> 4, sdr.data[0], rv);
 	    goto out_err;
 	}
+	_ipmi_mc_track_opq_waits(s[p]->mc, s[p]->waitq);
 
 	share_count = 0;
 	id_string_mod_type = 0;
@@ -1346,16 +1608,15 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 	    s[p]->linearization = sdr.data[18] & 0x7f;
 
 	    if (s[p]->linearization <= 11) {
-		for (j=0; j<256; j++) {
-		    s[p]->conv[j].m = sdr.data[19] | ((sdr.data[20] & 0xc0) << 2);
-		    s[p]->conv[j].tolerance = sdr.data[20] & 0x3f;
-		    s[p]->conv[j].b = sdr.data[21] | ((sdr.data[22] & 0xc0) << 2);
-		    s[p]->conv[j].accuracy = ((sdr.data[22] & 0x3f)
-					     | ((sdr.data[23] & 0xf0) << 2));
-		    s[p]->conv[j].accuracy_exp = (sdr.data[23] >> 2) & 0x3;
-		    s[p]->conv[j].r_exp = (sdr.data[24] >> 4) & 0xf;
-		    s[p]->conv[j].b_exp = sdr.data[24] & 0xf;
-		}
+		/* The same factors apply to every raw value. */
+		s[p]->conv.m = sdr.data[19] | ((sdr.data[20] & 0xc0) << 2);
+		s[p]->conv.tolerance = sdr.data[20] & 0x3f;
+		s[p]->conv.b = sdr.data[21] | ((sdr.data[22] & 0xc0) << 2);
+		s[p]->conv.accuracy = ((sdr.data[22] & 0x3f)
+				       | ((sdr.data[23] & 0xf0) << 2));
+		s[p]->conv.accuracy_exp = (sdr.data[23] >> 2) & 0x3;
+		s[p]->conv.r_exp = (sdr.data[24] >> 4) & 0xf;
+		s[p]->conv.b_exp = sdr.data[24] & 0xf;
 	    }
 
 	    s[p]->sensor_direction = sdr.data[23] & 0x3;
@@ -1379,9 +1640,6 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 
 	    str = sdr.data + 42;
 	    str_len = sdr.length - 42;
-
-	    if (s[p]->entity)
-		sensor_set_name(s[p]);
 	} else if (sdr.type == 2) {
 	    /* FIXME - make sure this is not a threshold sensor.  The
                question is, what do I do if it is? */
@@ -1421,17 +1679,17 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 	}
 
 	rv = ipmi_get_device_string(&str, str_len,
-				    s[p]->id, IPMI_STR_SDR_SEMANTICS, 0,
+				    idstr, IPMI_STR_SDR_SEMANTICS, 0,
 				    &s[p]->id_type, SENSOR_ID_LEN,
-				    &s[p]->id_len);
+				    &idstr_len);
 	if (rv) {
 	    ipmi_log(IPMI_LOG_WARNING,
 		     "%ssensor.c(get_sensors_from_sdrs):"
 		     " Error getting device ID string from SDR record %d: %d,"
 		     " this sensor will be named **INVALID**",
 		     MC_NAME(source_mc), sdr.record_id, rv);
-	    strncpy(s[p]->id, "**INVALID**", sizeof(s[p]->id));
-	    s[p]->id_len = strlen(s[p]->id);
+	    strncpy(idstr, "**INVALID**", sizeof(idstr));
+	    idstr_len = strlen(idstr);
 	    s[p]->id_type = IPMI_ASCII_STR;
 	}
 
@@ -1440,20 +1698,24 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 	       backwards to avoid destroying the first one until we
 	       finish the others. */
 	    for (j=share_count-1; j>=0; j--) {
-		int len;
+		char         id[SENSOR_ID_LEN];
+		unsigned int len;
 
 		if (j != 0) {
 		    /* The first one is already allocated, we are
                        using it to copy to the other ones, so this is
                        not necessary.  We still have to iterate the
                        first one to set its string name, though. */
-		    s[p+j] = ipmi_mem_alloc(sizeof(ipmi_sensor_t));
+		    s[p+j] = ipmi_arena_alloc(arena, sizeof(ipmi_sensor_t));
 		    if (!s[p+j])
 			goto out_err_enomem;
 		    memcpy(s[p+j], s[p], sizeof(ipmi_sensor_t));
 		    
 		    /* In case of error */
 		    s[p+j]->handler_list = NULL;
+		    s[p+j]->conv_table = NULL;
+		    s[p+j]->cooked = NULL;
+		    s[p+j]->name = NULL;
 
 		    /* For every sensor except the first, increment the usage
 		       count for the MC so that it will decrement properly.
@@ -1467,6 +1729,7 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 		    s[p+j]->waitq = opq_alloc(ipmi_domain_get_os_hnd(domain));
 		    if (!s[p+j]->waitq)
 			goto out_err_enomem;
+		    _ipmi_mc_track_opq_waits(s[p+j]->mc, s[p+j]->waitq);
 
 		    s[p+j]->handler_list_cl
 			= locked_list_alloc(ipmi_domain_get_os_hnd(domain));
@@ -1488,42 +1751,53 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 		}
 
 		val = id_string_modifier_offset + j;
-		len = s[p+j]->id_len;
+		memcpy(id, idstr, idstr_len);
+		len = idstr_len;
 		switch (id_string_mod_type) {
 		    case 0: /* Numeric */
 			if ((val / 10) > 0) {
 			    if (len < SENSOR_ID_LEN) {
-				s[p+j]->id[len] = (val/10) + '0';
+				id[len] = (val/10) + '0';
 				len++;
 			    }
 			}
 			if (len < SENSOR_ID_LEN) {
-			    s[p+j]->id[len] = (val%10) + '0';
+			    id[len] = (val%10) + '0';
 			    len++;
 			}
 			break;
 		    case 1: /* Alpha */
 			if ((val / 26) > 0) {
 			    if (len < SENSOR_ID_LEN) {
-				s[p+j]->id[len] = (val/26) + 'A';
+				id[len] = (val/26) + 'A';
 				len++;
 			    }
 			}
 			if (len < SENSOR_ID_LEN) {
-			    s[p+j]->id[len] = (val%26) + 'A';
+			    id[len] = (val%26) + 'A';
 			    len++;
 			}
 			break;
 		    /* FIXME - unicode handling? */
 		}
+		s[p+j]->id = _ipmi_str_intern(id, len);
+		if (!s[p+j]->id)
+		    goto out_err_enomem;
 		s[p+j]->id_len = len;
 		if (s[p+j]->entity)
 		    sensor_set_name(s[p+j]);
 	    }
 
 	    p += share_count;
-	} else
+	} else {
+	    s[p]->id = _ipmi_str_intern(idstr, idstr_len);
+	    if (!s[p]->id)
+		goto out_err_enomem;
+	    s[p]->id_len = idstr_len;
+	    if (s[p]->entity)
+		sensor_set_name(s[p]);
 	    p++;
+	}
     }
 
     *sensors = s;
@@ -1548,7 +1822,9 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 		    locked_list_destroy(s[i]->handler_list);
 		if (s[i]->handler_list_cl)
 		    locked_list_destroy(s[i]->handler_list_cl);
-		ipmi_mem_free(s[i]);
+		_ipmi_str_unintern(s[i]->id);
+		_ipmi_str_unintern(s[i]->name);
+		ipmi_arena_free(s[i]);
 	    }
 	ipmi_mem_free(s);
     }
@@ -1620,13 +1896,8 @@ static int cmp_sensor(ipmi_sensor_t *s1,
     if (s1->modifier_unit != s2->modifier_unit) return 0;
     if (s1->linearization != s2->linearization) return 0;
     if (s1->linearization <= 11) {
-	if (s1->conv[0].m != s2->conv[0].m) return 0;
-	if (s1->conv[0].tolerance != s2->conv[0].tolerance) return 0;
-	if (s1->conv[0].b != s2->conv[0].b) return 0;
-	if (s1->conv[0].accuracy != s2->conv[0].accuracy) return 0;
-	if (s1->conv[0].accuracy_exp != s2->conv[0].accuracy_exp) return 0;
-	if (s1->conv[0].r_exp != s2->conv[0].r_exp) return 0;
-	if (s1->conv[0].b_exp != s2->conv[0].b_exp) return 0;
+	if (!sensor_conv_equal(sensor_conv(s1, 0), sensor_conv(s2, 0)))
+	    return 0;
     }
     if (s1->normal_min_specified != s2->normal_min_specified) return 0;
     if (s1->normal_max_specified != s2->normal_max_specified) return 0;
@@ -1649,8 +1920,8 @@ static int cmp_sensor(ipmi_sensor_t *s1,
     if (s1->oem1 != s2->oem1) return 0;
 
     if (s1->id_type != s2->id_type) return 0;
-    if (s1->id_len != s2->id_len) return 0;
-    if (memcmp(s1->id, s2->id, s1->id_len) != 0) return 0;
+    /* Interned, the same ID is the same pointer. */
+    if (s1->id != s2->id) return 0;
     
     return 1;
 }
@@ -1949,7 +2220,9 @@ ipmi_sensor_handle_sdrs(ipmi_domain_t   *domain,
 	    opq_destroy(nsensor->waitq);
 	    locked_list_destroy(nsensor->handler_list);
 	    locked_list_destroy(nsensor->handler_list_cl);
-	    ipmi_mem_free(nsensor);
+	    _ipmi_str_unintern(nsensor->id);
+	    _ipmi_str_unintern(nsensor->name);
+	    ipmi_arena_free(nsensor);
 	    ent_item->sensor = NULL;
 	    sdr_sensors[i] = osensor;
 	    if (osensor) {
@@ -2745,7 +3018,7 @@ ipmi_sensor_get_raw_m(ipmi_sensor_t *sensor, int val)
 {
     CHECK_SENSOR_LOCK(sensor);
 
-    return sensor->conv[val].m;
+    return sensor_conv(sensor, val)->m;
 }
 
 int
@@ -2753,7 +3026,7 @@ ipmi_sensor_get_raw_tolerance(ipmi_sensor_t *sensor, int val)
 {
     CHECK_SENSOR_LOCK(sensor);
 
-    return sensor->conv[val].tolerance;
+    return sensor_conv(sensor, val)->tolerance;
 }
 
 int
@@ -2761,7 +3034,7 @@ ipmi_sensor_get_raw_b(ipmi_sensor_t *sensor, int val)
 {
     CHECK_SENSOR_LOCK(sensor);
 
-    return sensor->conv[val].b;
+    return sensor_conv(sensor, val)->b;
 }
 
 int
@@ -2769,7 +3042,7 @@ ipmi_sensor_get_raw_accuracy(ipmi_sensor_t *sensor, int val)
 {
     CHECK_SENSOR_LOCK(sensor);
 
-    return sensor->conv[val].accuracy;
+    return sensor_conv(sensor, val)->accuracy;
 }
 
 int
@@ -2777,7 +3050,7 @@ ipmi_sensor_get_raw_accuracy_exp(ipmi_sensor_t *sensor, int val)
 {
     CHECK_SENSOR_LOCK(sensor);
 
-    return sensor->conv[val].accuracy_exp;
+    return sensor_conv(sensor, val)->accuracy_exp;
 }
 
 int
@@ -2785,7 +3058,7 @@ ipmi_sensor_get_raw_r_exp(ipmi_sensor_t *sensor, int val)
 {
     CHECK_SENSOR_LOCK(sensor);
 
-    return sensor->conv[val].r_exp;
+    return sensor_conv(sensor, val)->r_exp;
 }
 
 int
@@ -2793,7 +3066,7 @@ ipmi_sensor_get_raw_b_exp(ipmi_sensor_t *sensor, int val)
 {
     CHECK_SENSOR_LOCK(sensor);
 
-    return sensor->conv[val].b_exp;
+    return sensor_conv(sensor, val)->b_exp;
 }
 
 int
@@ -2914,7 +3187,8 @@ ipmi_sensor_get_id(ipmi_sensor_t *sensor, char *id, int length)
 	clen = length;
     else
 	clen = sensor->id_len;
-    memcpy(id, sensor->id, clen);
+    if (clen)
+	memcpy(id, sensor->id, clen);
 
     if (sensor->id_type == IPMI_ASCII_STR) {
 	/* NIL terminate the ASCII string. */
@@ -3055,6 +3329,7 @@ ipmi_sensor_set_event_reading_type(ipmi_sensor_t *sensor,
 				   int           event_reading_type)
 {
     sensor->event_reading_type = event_reading_type;
+    sensor->cooked_valid = 0;
 }
 
 void
@@ -3076,6 +3351,7 @@ ipmi_sensor_set_analog_data_format(ipmi_sensor_t *sensor,
 				   int           analog_data_format)
 {
     sensor->analog_data_format = analog_data_format;
+    sensor->cooked_valid = 0;
 }
 
 void
@@ -3112,48 +3388,74 @@ void
 ipmi_sensor_set_linearization(ipmi_sensor_t *sensor, int linearization)
 {
     sensor->linearization = linearization;
+    sensor->cooked_valid = 0;
 }
 
 void
 ipmi_sensor_set_raw_m(ipmi_sensor_t *sensor, int idx, int val)
 {
-    sensor->conv[idx].m = val;
+    sensor_conv_t conv = *sensor_conv(sensor, idx);
+
+    conv.m = val;
+    sensor_set_conv(sensor, idx, &conv);
+    sensor->cooked_valid = 0;
 }
 
 void
 ipmi_sensor_set_raw_tolerance(ipmi_sensor_t *sensor, int idx, int val)
 {
-    sensor->conv[idx].tolerance = val;
+    sensor_conv_t conv = *sensor_conv(sensor, idx);
+
+    conv.tolerance = val;
+    sensor_set_conv(sensor, idx, &conv);
 }
 
 void
 ipmi_sensor_set_raw_b(ipmi_sensor_t *sensor, int idx, int val)
 {
-    sensor->conv[idx].b = val;
+    sensor_conv_t conv = *sensor_conv(sensor, idx);
+
+    conv.b = val;
+    sensor_set_conv(sensor, idx, &conv);
+    sensor->cooked_valid = 0;
 }
 
 void
 ipmi_sensor_set_raw_accuracy(ipmi_sensor_t *sensor, int idx, int val)
 {
-    sensor->conv[idx].accuracy = val;
+    sensor_conv_t conv = *sensor_conv(sensor, idx);
+
+    conv.accuracy = val;
+    sensor_set_conv(sensor, idx, &conv);
 }
 
 void
 ipmi_sensor_set_raw_accuracy_exp(ipmi_sensor_t *sensor, int idx, int val)
 {
-    sensor->conv[idx].accuracy_exp = val;
+    sensor_conv_t conv = *sensor_conv(sensor, idx);
+
+    conv.accuracy_exp = val;
+    sensor_set_conv(sensor, idx, &conv);
 }
 
 void
 ipmi_sensor_set_raw_r_exp(ipmi_sensor_t *sensor, int idx, int val)
 {
-    sensor->conv[idx].r_exp = val;
+    sensor_conv_t conv = *sensor_conv(sensor, idx);
+
+    conv.r_exp = val;
+    sensor_set_conv(sensor, idx, &conv);
+    sensor->cooked_valid = 0;
 }
 
 void
 ipmi_sensor_set_raw_b_exp(ipmi_sensor_t *sensor, int idx, int val)
 {
-    sensor->conv[idx].b_exp = val;
+    sensor_conv_t conv = *sensor_conv(sensor, idx);
+
+    conv.b_exp = val;
+    sensor_set_conv(sensor, idx, &conv);
+    sensor->cooked_valid = 0;
 }
 
 void
@@ -3237,10 +3539,21 @@ void
 ipmi_sensor_set_id(ipmi_sensor_t *sensor, char *id,
 		   enum ipmi_str_type_e type, int length)
 {
+    const char *new_id;
+
     if (length > SENSOR_ID_LEN)
 	length = SENSOR_ID_LEN;
     
-    memcpy(sensor->id, id, length);
+    new_id = _ipmi_str_intern(id, length);
+    if (!new_id) {
+	ipmi_log(IPMI_LOG_SEVERE,
+		 "%ssensor.c(ipmi_sensor_set_id):"
+		 " Out of memory setting the sensor ID",
+		 SENSOR_NAME(sensor));
+	return;
+    }
+    _ipmi_str_unintern(sensor->id);
+    sensor->id = new_id;
     sensor->id_type = type;
     sensor->id_len = length;
     if (sensor->entity)
@@ -3669,6 +3982,49 @@ ipmi_sensor_call_discrete_event_handlers(ipmi_sensor_t         *sensor,
     *event = info.event;
 }
 
+/* Give an event or a changed reading to the domain's sensor update
+   handler, if there is one. */
+static void
+sensor_update(ipmi_sensor_t             *sensor,
+	      int                       type,
+	      enum ipmi_value_present_e value_present,
+	      unsigned int              raw,
+	      double                    cooked,
+	      unsigned int              states,
+	      const unsigned char       *ev_data)
+{
+    ipmi_sensor_update_cb handler;
+    void                  *cb_data;
+    ipmi_sensor_update_t  update;
+
+    handler = _ipmi_domain_get_sensor_update_handler(sensor->domain,
+						     &cb_data);
+    if (!handler)
+	return;
+
+    if (type == IPMI_SENSOR_UPDATE_READING) {
+	if (sensor->update_reported && (sensor->update_raw == raw)
+	    && (sensor->update_states == states))
+	    return;
+	sensor->update_reported = 1;
+	sensor->update_raw = raw;
+	sensor->update_states = states;
+	update.dir = IPMI_ASSERTION;
+	update.offset = 0;
+    } else {
+	update.dir = ev_data[9] >> 7;
+	update.offset = ev_data[10] & 0x0f;
+	states = 1 << update.offset;
+    }
+    update.sensor_id = ipmi_sensor_convert_to_id(sensor);
+    update.type = type;
+    update.value_present = value_present;
+    update.raw = raw;
+    update.cooked = cooked;
+    update.states = states;
+    handler(sensor->domain, &update, cb_data);
+}
+
 int
 ipmi_sensor_event(ipmi_sensor_t *sensor, ipmi_event_t *event)
 {
@@ -3704,6 +4060,8 @@ ipmi_sensor_event(ipmi_sensor_t *sensor, ipmi_event_t *event)
 	} else {
 	    value_present = IPMI_NO_VALUES_PRESENT;
 	}
+	sensor_update(sensor, IPMI_SENSOR_UPDATE_EVENT, value_present,
+		      raw_value, value, 0, data);
 	ipmi_sensor_call_threshold_event_handlers(sensor, dir,
 						  threshold,
 						  high_low,
@@ -3730,6 +4088,8 @@ ipmi_sensor_event(ipmi_sensor_t *sensor, ipmi_event_t *event)
 		prev_severity = -1;
 	}
 
+	sensor_update(sensor, IPMI_SENSOR_UPDATE_EVENT,
+		      IPMI_NO_VALUES_PRESENT, 0, 0.0, 0, data);
 	ipmi_sensor_call_discrete_event_handlers(sensor, dir, offset,
 						 severity,
 						 prev_severity,
@@ -3818,6 +4178,8 @@ static void enables_done_handler(ipmi_sensor_t *sensor,
 {
     event_enable_info_t *info = sinfo;
 
+    if (sensor)
+	sensor->enables_cached = 0;
     if (info->done)
 	info->done(sensor, err, info->cb_data);
     ipmi_sensor_opq_done(sensor);
@@ -4090,6 +4452,10 @@ static void enables_get_done_handler(ipmi_sensor_t *sensor,
 {
     event_enable_get_info_t *info = sinfo;
 
+    if (sensor && sensor->attr_cache && !err) {
+	sensor->cached_enables = info->state;
+	sensor->enables_cached = 1;
+    }
     if (info->done)
 	info->done(sensor, err, &info->state, info->cb_data);
     ipmi_sensor_opq_done(sensor);
@@ -4148,6 +4514,12 @@ event_enable_get_start(ipmi_sensor_t *sensor, int err, void *cb_data)
 			      enables_get_done_handler, info))
 	return;
 
+    if (sensor->attr_cache && sensor->enables_cached) {
+	info->state = sensor->cached_enables;
+	enables_get_done_handler(sensor, 0, info);
+	return;
+    }
+
     cmd_msg.data = cmd_data;
     cmd_msg.netfn = IPMI_SENSOR_EVENT_NETFN;
     cmd_msg.cmd = IPMI_GET_SENSOR_EVENT_ENABLE_CMD;
@@ -4306,6 +4678,11 @@ static void hyst_get_done_handler(ipmi_sensor_t *sensor,
 {
     hyst_get_info_t *info = sinfo;
 
+    if (sensor && sensor->attr_cache && !err) {
+	sensor->cached_hyst_positive = info->positive;
+	sensor->cached_hyst_negative = info->negative;
+	sensor->hysteresis_cached = 1;
+    }
     if (info->done)
 	info->done(sensor, err, info->positive, info->negative, info->cb_data);
     ipmi_sensor_opq_done(sensor);
@@ -4341,6 +4718,13 @@ hyst_get_start(ipmi_sensor_t *sensor, int err, void *cb_data)
 			      hyst_get_done_handler, info))
 	return;
 
+    if (sensor->attr_cache && sensor->hysteresis_cached) {
+	info->positive = sensor->cached_hyst_positive;
+	info->negative = sensor->cached_hyst_negative;
+	hyst_get_done_handler(sensor, 0, info);
+	return;
+    }
+
     cmd_msg.data = cmd_data;
     cmd_msg.netfn = IPMI_SENSOR_EVENT_NETFN;
     cmd_msg.cmd = IPMI_GET_SENSOR_HYSTERESIS_CMD;
@@ -4401,6 +4785,8 @@ static void hyst_set_done_handler(ipmi_sensor_t *sensor,
 {
     hyst_set_info_t *info = sinfo;
 
+    if (sensor)
+	sensor->hysteresis_cached = 0;
     if (info->done)
 	info->done(sensor, err, info->cb_data);
     ipmi_sensor_opq_done(sensor);
@@ -4498,6 +4884,10 @@ static void thresh_get_done_handler(ipmi_sensor_t *sensor,
 {
     thresh_get_info_t *info = sinfo;
 
+    if (sensor && sensor->attr_cache && !err) {
+	sensor->cached_thresholds = info->th;
+	sensor->thresholds_cached = 1;
+    }
     if (info->done)
 	info->done(sensor, err, &info->th, info->cb_data);
     ipmi_sensor_opq_done(sensor);
@@ -4575,6 +4965,12 @@ thresh_get_start(ipmi_sensor_t *sensor, int err, void *cb_data)
     if (sensor_done_check_rsp(sensor, err, NULL, 0, "thresh_get_start",
 			      thresh_get_done_handler, info))
 	return;
+
+    if (sensor->attr_cache && sensor->thresholds_cached) {
+	info->th = sensor->cached_thresholds;
+	thresh_get_done_handler(sensor, 0, info);
+	return;
+    }
     
     if (sensor->threshold_access == IPMI_THRESHOLD_ACCESS_SUPPORT_FIXED) {
 	int thnum;
@@ -4646,6 +5042,8 @@ static void thresh_set_done_handler(ipmi_sensor_t *sensor,
 {
     thresh_set_info_t *info = sinfo;
 
+    if (sensor)
+	sensor->thresholds_cached = 0;
     if (info->done)
 	info->done(sensor, err, info->cb_data);
     ipmi_sensor_opq_done(sensor);
@@ -4757,14 +5155,15 @@ typedef struct reading_get_info_s
     enum ipmi_value_present_e  value_present;
     unsigned int               raw_val;
     double                     cooked_val;
+
+    /* Set if this read fills in the sensor's reading cache. */
+    int                        cache_read;
+    struct reading_get_info_s  *next_waiter;
 } reading_get_info_t;
 
-static void reading_get_done_handler(ipmi_sensor_t *sensor,
-				     int           err,
-				     void          *sinfo)
+static void
+reading_get_finish(ipmi_sensor_t *sensor, int err, reading_get_info_t *info)
 {
-    reading_get_info_t *info = sinfo;
-
     if (info->done)
 	info->done(sensor, err, info->value_present,
 		   info->raw_val, info->cooked_val, &info->states,
@@ -4773,6 +5172,156 @@ static void reading_get_done_handler(ipmi_sensor_t *sensor,
     ipmi_mem_free(info);
 }
 
+/***********************************************************************
+ *
+ * Reading history.  Each level is a ring of one-byte raw values, one
+ * slot per "width" milliseconds of monotonic time, holding the
+ * average of the readings that came in during that slot.  A slot is
+ * marked valid when it gets a reading, so gaps in the polling show up
+ * as missing samples instead of stale ones.  Everything is in one
+ * allocation made when the history is turned on.
+ *
+ **********************************************************************/
+
+typedef struct sensor_history_level_s
+{
+    unsigned int       width;  /* Milliseconds per slot. */
+    unsigned char      *raw;
+    unsigned char      *valid; /* A bit per slot. */
+    unsigned int       head;   /* The slot for "bucket". */
+    unsigned long long bucket; /* Time / width of the newest slot. */
+    unsigned int       sum;    /* Readings in the newest slot. */
+    unsigned int       count;
+} sensor_history_level_t;
+
+typedef struct sensor_history_s
+{
+    unsigned int           samples;
+    unsigned int           levels;
+    int                    started;
+    sensor_history_level_t lvl[IPMI_SENSOR_HISTORY_MAX_LEVELS];
+} sensor_history_t;
+
+static unsigned long long
+sensor_history_now(ipmi_sensor_t *sensor)
+{
+    os_handler_t   *os_hnd = ipmi_domain_get_os_hnd(sensor->domain);
+    struct timeval now;
+
+    os_hnd->get_monotonic_time(os_hnd, &now);
+    return (((unsigned long long) now.tv_sec) * 1000) + (now.tv_usec / 1000);
+}
+
+static void
+sensor_history_clear(sensor_history_t *h, sensor_history_level_t *l)
+{
+    memset(l->valid, 0, (h->samples + 7) / 8);
+}
+
+static void
+sensor_history_add(ipmi_sensor_t *sensor, unsigned int raw)
+{
+    sensor_history_t   *h = sensor->history;
+    unsigned long long now = sensor_history_now(sensor);
+    unsigned int       i;
+
+    for (i=0; i<h->levels; i++) {
+	sensor_history_level_t *l = &h->lvl[i];
+	unsigned long long     b = now / l->width;
+
+	if (!h->started || (b >= l->bucket + h->samples)) {
+	    /* Nothing in the ring is recent enough to keep. */
+	    sensor_history_clear(h, l);
+	    l->head = 0;
+	    l->bucket = b;
+	    l->sum = 0;
+	    l->count = 0;
+	} else if (b > l->bucket) {
+	    while (l->bucket < b) {
+		l->bucket++;
+		l->head = (l->head + 1) % h->samples;
+		l->valid[l->head / 8] &= ~(1 << (l->head % 8));
+	    }
+	    l->sum = 0;
+	    l->count = 0;
+	} else if (b < l->bucket) {
+	    /* Time can't go backwards, but don't trust it. */
+	    continue;
+	}
+	l->sum += raw;
+	l->count++;
+	l->raw[l->head] = (l->sum + (l->count / 2)) / l->count;
+	l->valid[l->head / 8] |= 1 << (l->head % 8);
+    }
+    h->started = 1;
+}
+
+static int
+reading_cache_fresh(ipmi_sensor_t *sensor)
+{
+    os_handler_t   *os_hnd = ipmi_domain_get_os_hnd(sensor->domain);
+    struct timeval now;
+    long           age;
+
+    if (!sensor->reading_cached)
+	return 0;
+
+    os_hnd->get_monotonic_time(os_hnd, &now);
+    age = ((now.tv_sec - sensor->reading_time.tv_sec) * 1000
+	   + (now.tv_usec - sensor->reading_time.tv_usec) / 1000);
+    return (age >= 0) && (age <= (long) sensor->reading_max_age);
+}
+
+static void
+reading_from_cache(ipmi_sensor_t *sensor, reading_get_info_t *info)
+{
+    info->value_present = sensor->reading_value_present;
+    info->raw_val = sensor->reading_raw;
+    info->cooked_val = sensor->reading_cooked;
+    ipmi_copy_states(&info->states, &sensor->reading_states);
+}
+
+static void reading_get_done_handler(ipmi_sensor_t *sensor,
+				     int           err,
+				     void          *sinfo)
+{
+    reading_get_info_t *info = sinfo;
+    reading_get_info_t *waiters = NULL, *w;
+    ipmi_sensor_t      *s = sensor;
+
+    if (!s)
+	s = info->sdata.__sensor;
+
+    if (info->cache_read && s) {
+	waiters = s->reading_waiters;
+	s->reading_waiters = NULL;
+	s->reading_in_progress = 0;
+	if (!err) {
+	    os_handler_t *os_hnd = ipmi_domain_get_os_hnd(s->domain);
+
+	    s->reading_value_present = info->value_present;
+	    s->reading_raw = info->raw_val;
+	    s->reading_cooked = info->cooked_val;
+	    ipmi_copy_states(&s->reading_states, &info->states);
+	    os_hnd->get_monotonic_time(os_hnd, &s->reading_time);
+	    s->reading_cached = 1;
+	}
+    }
+
+    /* Everyone waiting on this read gets its result. */
+    while (waiters) {
+	w = waiters;
+	waiters = w->next_waiter;
+	w->value_present = info->value_present;
+	w->raw_val = info->raw_val;
+	w->cooked_val = info->cooked_val;
+	ipmi_copy_states(&w->states, &info->states);
+	reading_get_finish(sensor, err, w);
+    }
+
+    reading_get_finish(sensor, err, info);
+}
+
 static void
 reading_get(ipmi_sensor_t *sensor,
 	    int           err,
@@ -4805,6 +5354,10 @@ reading_get(ipmi_sensor_t *sensor,
     if (rsp->data_len >= 4)
 	info->states.__states = rsp->data[3];
 
+    sensor_update(sensor, IPMI_SENSOR_UPDATE_READING, info->value_present,
+		  info->raw_val, info->cooked_val, info->states.__states, NULL);
+    if (sensor->history)
+	sensor_history_add(sensor, info->raw_val);
     reading_get_done_handler(sensor, 0, info);
 }
 
@@ -4820,6 +5373,22 @@ reading_get_start(ipmi_sensor_t *sensor, int err, void *cb_data)
 			      reading_get_done_handler, info))
 	return;
 
+    if (sensor->reading_max_age) {
+	if (reading_cache_fresh(sensor)) {
+	    reading_from_cache(sensor, info);
+	    reading_get_done_handler(sensor, 0, info);
+	    return;
+	}
+	if (sensor->reading_in_progress) {
+	    /* Wait for the read already going. */
+	    info->next_waiter = sensor->reading_waiters;
+	    sensor->reading_waiters = info;
+	    return;
+	}
+	sensor->reading_in_progress = 1;
+	info->cache_read = 1;
+    }
+
     cmd_msg.data = cmd_data;
     cmd_msg.netfn = IPMI_SENSOR_EVENT_NETFN;
     cmd_msg.cmd = IPMI_GET_SENSOR_READING_CMD;
@@ -4860,8 +5429,11 @@ stand_ipmi_sensor_get_reading(ipmi_sensor_t          *sensor,
     info->value_present = IPMI_NO_VALUES_PRESENT;
     info->raw_val = 0;
     info->cooked_val = 0.0;
+    info->cache_read = 0;
+    info->next_waiter = NULL;
     ipmi_init_states(&info->states);
-    rv = ipmi_sensor_add_opq(sensor, reading_get_start, &(info->sdata), info);
+    rv = ipmi_sensor_add_opq_concurrent(sensor, reading_get_start,
+					&(info->sdata), info);
     if (rv)
 	ipmi_mem_free(info);
     return rv;
@@ -4909,6 +5481,8 @@ states_get(ipmi_sensor_t *sensor,
     if (rsp->data_len >= 5)
 	info->states.__states |= rsp->data[4] << 8;
 
+    sensor_update(sensor, IPMI_SENSOR_UPDATE_READING, IPMI_NO_VALUES_PRESENT,
+		  0, 0.0, info->states.__states, NULL);
     states_get_done_handler(sensor, 0, info);
 }
 
@@ -4962,7 +5536,8 @@ stand_ipmi_sensor_get_states(ipmi_sensor_t         *sensor,
     info->done = done;
     info->cb_data = cb_data;
     ipmi_init_states(&info->states);
-    rv = ipmi_sensor_add_opq(sensor, states_get_start, &(info->sdata), info);
+    rv = ipmi_sensor_add_opq_concurrent(sensor, states_get_start,
+					&(info->sdata), info);
     if (rv)
 	ipmi_mem_free(info);
     return rv;
@@ -5040,58 +5615,188 @@ sign_extend(int m, int bits)
 	return m & (~(-1 << bits));
 }
 
+/* How the cooked values change as the (signed) raw value goes up. */
+#define COOKED_INCREASING	0
+#define COOKED_DECREASING	1
+#define COOKED_UNORDERED	2
+
+/* Get the range of raw values for the sensor's data format, in the
+   sensor's own numbering, so signed formats go negative. */
 static int
-stand_ipmi_sensor_convert_from_raw(ipmi_sensor_t *sensor,
-				   int           val,
-				   double        *result)
+sensor_raw_range(ipmi_sensor_t *sensor, int *minraw, int *maxraw)
 {
-    double m, b, b_exp, r_exp, fval;
-    linearizer c_func;
-
-    if (sensor->event_reading_type != IPMI_EVENT_READING_TYPE_THRESHOLD)
-	/* Not a threshold sensor, it doesn't have readings. */
-	return ENOSYS;
-
-    if (sensor->linearization == IPMI_LINEARIZATION_NONLINEAR)
-	c_func = c_linear;
-    else if (sensor->linearization <= 11)
-	c_func = linearize[sensor->linearization];
-    else
-	return EINVAL;
-
-    val &= 0xff;
-
-    m = sensor->conv[val].m;
-    b = sensor->conv[val].b;
-    r_exp = sensor->conv[val].r_exp;
-    b_exp = sensor->conv[val].b_exp;
-
     switch(sensor->analog_data_format) {
 	case IPMI_ANALOG_DATA_FORMAT_UNSIGNED:
-	    fval = val;
+	    *minraw = 0;
+	    *maxraw = 255;
 	    break;
 	case IPMI_ANALOG_DATA_FORMAT_1_COMPL:
-	    val = sign_extend(val, 8);
-	    if (val < 0)
-		val += 1;
-	    fval = val;
+	    *minraw = -127;
+	    *maxraw = 127;
 	    break;
 	case IPMI_ANALOG_DATA_FORMAT_2_COMPL:
-	    fval = sign_extend(val, 8);
+	    *minraw = -128;
+	    *maxraw = 127;
 	    break;
 	default:
 	    return EINVAL;
     }
-
-    *result = c_func(((m * fval) + (b * pow(10, b_exp))) * pow(10, r_exp));
     return 0;
 }
 
+/* Convert a raw value from sensor_raw_range() to the byte the sensor
+   uses for it. */
 static int
-stand_ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
-				 enum ipmi_round_e rounding,
-				 double            val,
-				 int               *result)
+sensor_raw_to_byte(ipmi_sensor_t *sensor, int raw)
+{
+    if ((sensor->analog_data_format == IPMI_ANALOG_DATA_FORMAT_1_COMPL)
+	&& (raw < 0))
+	raw -= 1;
+    return raw & 0xff;
+}
+
+/* Get the number the conversion formula uses for a raw byte. */
+static double
+sensor_byte_to_fval(ipmi_sensor_t *sensor, int raw)
+{
+    int val;
+
+    switch(sensor->analog_data_format) {
+	case IPMI_ANALOG_DATA_FORMAT_UNSIGNED:
+	    return raw;
+	case IPMI_ANALOG_DATA_FORMAT_1_COMPL:
+	    val = sign_extend(raw, 8);
+	    if (val < 0)
+		val += 1;
+	    return val;
+	default: /* IPMI_ANALOG_DATA_FORMAT_2_COMPL */
+	    return sign_extend(raw, 8);
+    }
+}
+
+/* Get the cooked value for a raw byte, sensor_build_cooked() must
+   have been done. */
+static double
+sensor_cooked_byte(ipmi_sensor_t *sensor, int raw)
+{
+    if (sensor->cooked)
+	return sensor->cooked[raw];
+    return (((sensor->conv.m * sensor_byte_to_fval(sensor, raw))
+	     + sensor->cooked_b)
+	    * sensor->cooked_scale);
+}
+
+static double
+sensor_cooked(ipmi_sensor_t *sensor, int raw)
+{
+    return sensor_cooked_byte(sensor, sensor_raw_to_byte(sensor, raw));
+}
+
+/* Set up the conversion from raw for the sensor, so conversions from
+   raw are a multiply and add for linear sensors or a single table
+   lookup for anything else, and note which way the values go so
+   conversions to raw can search them. */
+static int
+sensor_build_cooked(ipmi_sensor_t *sensor)
+{
+    double        m, b, b_exp, r_exp;
+    linearizer    c_func;
+    sensor_conv_t *conv;
+    int           raw, minraw, maxraw;
+    int           increasing = 1, decreasing = 1;
+    int           rv;
+
+    if (sensor->linearization == IPMI_LINEARIZATION_NONLINEAR)
+	c_func = c_linear;
+    else if (sensor->linearization <= 11)
+	c_func = linearize[sensor->linearization];
+    else
+	return EINVAL;
+
+    rv = sensor_raw_range(sensor, &minraw, &maxraw);
+    if (rv)
+	return rv;
+
+    if ((c_func == c_linear) && !sensor->conv_table) {
+	/* No table needed, just the parts that don't depend on raw. */
+	sensor->cooked_b = sensor->conv.b * pow(10, sensor->conv.b_exp);
+	sensor->cooked_scale = pow(10, sensor->conv.r_exp);
+	if (sensor->cooked) {
+	    ipmi_mem_free(sensor->cooked);
+	    sensor->cooked = NULL;
+	}
+    } else {
+	if (!sensor->cooked) {
+	    sensor->cooked = ipmi_mem_alloc(sizeof(double) * 256);
+	    if (!sensor->cooked)
+		return ENOMEM;
+	}
+
+	for (raw=0; raw<256; raw++) {
+	    conv = sensor_conv(sensor, raw);
+	    m = conv->m;
+	    b = conv->b;
+	    r_exp = conv->r_exp;
+	    b_exp = conv->b_exp;
+
+	    sensor->cooked[raw] = c_func(((m * sensor_byte_to_fval(sensor, raw))
+					  + (b * pow(10, b_exp)))
+					 * pow(10, r_exp));
+	}
+    }
+
+    /* A NaN compares false both ways, so it makes the table
+       unordered. */
+    for (raw=minraw; raw<maxraw; raw++) {
+	double lo = sensor_cooked(sensor, raw);
+	double hi = sensor_cooked(sensor, raw+1);
+
+	if (!(lo <= hi))
+	    increasing = 0;
+	if (!(lo >= hi))
+	    decreasing = 0;
+    }
+    if (increasing)
+	sensor->cooked_order = COOKED_INCREASING;
+    else if (decreasing)
+	sensor->cooked_order = COOKED_DECREASING;
+    else
+	sensor->cooked_order = COOKED_UNORDERED;
+
+    sensor->cooked_valid = 1;
+    return 0;
+}
+
+static int
+stand_ipmi_sensor_convert_from_raw(ipmi_sensor_t *sensor,
+				   int           val,
+				   double        *result)
+{
+    int rv;
+
+    if (sensor->event_reading_type != IPMI_EVENT_READING_TYPE_THRESHOLD)
+	/* Not a threshold sensor, it doesn't have readings. */
+	return ENOSYS;
+
+    if (!sensor->cooked_valid) {
+	rv = sensor_build_cooked(sensor);
+	if (rv)
+	    return rv;
+    }
+
+    *result = sensor_cooked_byte(sensor, val & 0xff);
+    return 0;
+}
+
+/* Find the raw value for a cooked value by calling the sensor's
+   convert_from_raw in a binary search.  This is only used when an OEM
+   has replaced the standard convert_from_raw, so the table may not
+   match the sensor's conversion. */
+static int
+search_convert_to_raw(ipmi_sensor_t     *sensor,
+		      enum ipmi_round_e rounding,
+		      double            val,
+		      int               *result)
 {
     double cval;
     int    lowraw, highraw, raw, maxraw, minraw, next_raw;
@@ -5192,6 +5897,161 @@ stand_ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
     return 0;
 }
 
+/* Find the raw value whose cooked value is closest to val in the
+   direction given by the rounding, when the table has no order. */
+static int
+scan_cooked_to_raw(ipmi_sensor_t     *sensor,
+		   enum ipmi_round_e rounding,
+		   double            val,
+		   int               minraw,
+		   int               maxraw)
+{
+    int    raw, best = minraw, found = 0;
+    int    lowest = minraw, highest = minraw, have_any = 0;
+    double cval, bval = 0.0;
+
+    for (raw=minraw; raw<=maxraw; raw++) {
+	cval = sensor_cooked(sensor, raw);
+	if (isnan(cval))
+	    continue;
+
+	if (!have_any) {
+	    lowest = highest = raw;
+	    have_any = 1;
+	} else {
+	    if (cval < sensor_cooked(sensor, lowest))
+		lowest = raw;
+	    if (cval > sensor_cooked(sensor, highest))
+		highest = raw;
+	}
+
+	switch (rounding)
+	{
+	    case ROUND_NORMAL:
+		if (!found || (fabs(cval - val) < fabs(bval - val))) {
+		    best = raw;
+		    bval = cval;
+		    found = 1;
+		}
+		break;
+	    case ROUND_UP:
+		if ((cval >= val) && (!found || (cval < bval))) {
+		    best = raw;
+		    bval = cval;
+		    found = 1;
+		}
+		break;
+	    case ROUND_DOWN:
+		if ((cval <= val) && (!found || (cval > bval))) {
+		    best = raw;
+		    bval = cval;
+		    found = 1;
+		}
+		break;
+	}
+    }
+
+    /* Nothing on the requested side, so use the closest end. */
+    if (!found) {
+	if (rounding == ROUND_UP)
+	    best = highest;
+	else
+	    best = lowest;
+    }
+
+    return best;
+}
+
+static int
+stand_ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
+				 enum ipmi_round_e rounding,
+				 double            val,
+				 int               *result)
+{
+    int    minraw, maxraw, lowraw, highraw, raw, dir;
+    double lval, hval;
+    int    rv;
+
+    if (sensor->event_reading_type != IPMI_EVENT_READING_TYPE_THRESHOLD)
+	/* Not a threshold sensor, it doesn't have readings. */
+	return ENOSYS;
+
+    if (sensor->cbs.ipmi_sensor_convert_from_raw
+	!= stand_ipmi_sensor_convert_from_raw)
+	return search_convert_to_raw(sensor, rounding, val, result);
+
+    if (!sensor->cooked_valid) {
+	rv = sensor_build_cooked(sensor);
+	if (rv)
+	    return rv;
+    }
+
+    rv = sensor_raw_range(sensor, &minraw, &maxraw);
+    if (rv)
+	return rv;
+
+    if (sensor->cooked_order == COOKED_UNORDERED) {
+	raw = scan_cooked_to_raw(sensor, rounding, val, minraw, maxraw);
+	goto out;
+    }
+
+    /* Binary search for the two neighboring raw values whose cooked
+       values bracket val, lowraw on the low cooked side. */
+    dir = (sensor->cooked_order == COOKED_INCREASING) ? 1 : -1;
+    if (dir > 0) {
+	lowraw = minraw;
+	highraw = maxraw;
+    } else {
+	lowraw = maxraw;
+	highraw = minraw;
+    }
+
+    /* Outside the table, any rounding takes the closest end. */
+    if (val <= sensor_cooked(sensor, lowraw)) {
+	raw = lowraw;
+	goto out;
+    }
+    if (val >= sensor_cooked(sensor, highraw)) {
+	raw = highraw;
+	goto out;
+    }
+
+    while ((highraw - lowraw) * dir > 1) {
+	int mid = lowraw + (highraw - lowraw) / 2;
+
+	if (sensor_cooked(sensor, mid) <= val)
+	    lowraw = mid;
+	else
+	    highraw = mid;
+    }
+
+    lval = sensor_cooked(sensor, lowraw);
+    hval = sensor_cooked(sensor, highraw);
+    switch (rounding)
+    {
+	case ROUND_NORMAL:
+	    if (val >= lval + ((hval - lval) / 2.0))
+		raw = highraw;
+	    else
+		raw = lowraw;
+	    break;
+	case ROUND_UP:
+	    if (val > lval)
+		raw = highraw;
+	    else
+		raw = lowraw;
+	    break;
+	case ROUND_DOWN:
+	default:
+	    raw = lowraw;
+	    break;
+    }
+
+ out:
+    *result = sensor_raw_to_byte(sensor, raw);
+    return 0;
+}
+
 static int
 stand_ipmi_sensor_get_tolerance(ipmi_sensor_t *sensor,
 				int           val,
@@ -5213,8 +6073,8 @@ stand_ipmi_sensor_get_tolerance(ipmi_sensor_t *sensor,
 
     val &= 0xff;
 
-    m = sensor->conv[val].m;
-    r_exp = sensor->conv[val].r_exp;
+    m = sensor_conv(sensor, val)->m;
+    r_exp = sensor_conv(sensor, val)->r_exp;
 
     fval = sign_extend(val, 8);
 
@@ -5234,8 +6094,8 @@ stand_ipmi_sensor_get_accuracy(ipmi_sensor_t *sensor, int val, double *accuracy)
 
     val &= 0xff;
 
-    a = sensor->conv[val].accuracy;
-    a_exp = sensor->conv[val].r_exp;
+    a = sensor_conv(sensor, val)->accuracy;
+    a_exp = sensor_conv(sensor, val)->r_exp;
 
     *accuracy = (a * pow(10, a_exp)) / 100.0;
     return 0;
@@ -5475,6 +6335,192 @@ ipmi_sensor_get_reading(ipmi_sensor_t          *sensor,
     return sensor->cbs.ipmi_sensor_get_reading(sensor, done, cb_data);
 }
 
+void
+ipmi_sensor_set_reading_max_age(ipmi_sensor_t *sensor, unsigned int msecs)
+{
+    CHECK_SENSOR_LOCK(sensor);
+
+    sensor->reading_max_age = msecs;
+    if (!msecs)
+	sensor->reading_cached = 0;
+}
+
+unsigned int
+ipmi_sensor_get_reading_max_age(ipmi_sensor_t *sensor)
+{
+    CHECK_SENSOR_LOCK(sensor);
+
+    return sensor->reading_max_age;
+}
+
+int
+ipmi_sensor_set_history(ipmi_sensor_t *sensor,
+			unsigned int  interval,
+			unsigned int  samples,
+			unsigned int  levels,
+			unsigned int  factor)
+{
+    sensor_history_t *h;
+    unsigned int     vsize, i;
+    unsigned int     width;
+    unsigned char    *p;
+
+    CHECK_SENSOR_LOCK(sensor);
+
+    if (sensor->event_reading_type != IPMI_EVENT_READING_TYPE_THRESHOLD)
+	/* Not a threshold sensor, it doesn't have readings. */
+	return ENOSYS;
+
+    if (samples == 0) {
+	if (sensor->history) {
+	    ipmi_mem_free(sensor->history);
+	    sensor->history = NULL;
+	}
+	return 0;
+    }
+
+    if ((interval == 0) || (levels == 0)
+	|| (levels > IPMI_SENSOR_HISTORY_MAX_LEVELS)
+	|| ((levels > 1) && (factor < 2)))
+	return EINVAL;
+
+    /* Make sure the widest slot fits. */
+    width = interval;
+    for (i=1; i<levels; i++) {
+	if (width > (UINT_MAX / factor))
+	    return EINVAL;
+	width *= factor;
+    }
+
+    vsize = (samples + 7) / 8;
+    h = ipmi_mem_alloc(sizeof(*h) + (levels * (samples + vsize)));
+    if (!h)
+	return ENOMEM;
+    memset(h, 0, sizeof(*h));
+    h->samples = samples;
+    h->levels = levels;
+    p = (unsigned char *) (h + 1);
+    width = interval;
+    for (i=0; i<levels; i++) {
+	h->lvl[i].width = width;
+	h->lvl[i].raw = p;
+	p += samples;
+	h->lvl[i].valid = p;
+	p += vsize;
+	width *= factor;
+    }
+
+    if (sensor->history)
+	ipmi_mem_free(sensor->history);
+    sensor->history = h;
+    return 0;
+}
+
+int
+ipmi_sensor_get_history(ipmi_sensor_t                *sensor,
+			unsigned int                 level,
+			unsigned int                 span,
+			ipmi_sensor_history_sample_t *samples,
+			unsigned int                 *count)
+{
+    sensor_history_t       *h = sensor->history;
+    sensor_history_level_t *l;
+    unsigned long long     now, bnow, first, b;
+    unsigned int           nslots, total, skip, n;
+
+    CHECK_SENSOR_LOCK(sensor);
+
+    if (!h)
+	return ENOSYS;
+    if (level >= h->levels)
+	return EINVAL;
+
+    l = &h->lvl[level];
+    now = sensor_history_now(sensor);
+    bnow = now / l->width;
+    nslots = (span + l->width - 1) / l->width;
+    if (nslots > h->samples)
+	nslots = h->samples;
+
+    /* The slots from "first" through the current one, limited to the
+       ones still in the ring. */
+    first = 0;
+    if (bnow >= nslots)
+	first = bnow - nslots + 1;
+    if (h->started && (l->bucket >= h->samples)
+	&& (first <= l->bucket - h->samples))
+	first = l->bucket - h->samples + 1;
+
+    /* Count them first, if they don't all fit keep the newest. */
+    total = 0;
+    for (b=first; h->started && (b<=bnow) && (b<=l->bucket); b++) {
+	unsigned int slot = ((l->head + h->samples)
+			     - (unsigned int) (l->bucket - b)) % h->samples;
+
+	if (l->valid[slot / 8] & (1 << (slot % 8)))
+	    total++;
+    }
+    skip = 0;
+    if (total > *count)
+	skip = total - *count;
+
+    n = 0;
+    for (b=first; h->started && (b<=bnow) && (b<=l->bucket); b++) {
+	unsigned int slot = ((l->head + h->samples)
+			     - (unsigned int) (l->bucket - b)) % h->samples;
+
+	if (!(l->valid[slot / 8] & (1 << (slot % 8))))
+	    continue;
+	if (skip) {
+	    skip--;
+	    continue;
+	}
+	samples[n].age = now - (b * l->width);
+	samples[n].raw = l->raw[slot];
+	n++;
+    }
+    *count = n;
+    return 0;
+}
+
+unsigned int
+ipmi_sensor_get_history_interval(ipmi_sensor_t *sensor, unsigned int level)
+{
+    CHECK_SENSOR_LOCK(sensor);
+
+    if (!sensor->history || (level >= sensor->history->levels))
+	return 0;
+    return sensor->history->lvl[level].width;
+}
+
+void
+ipmi_sensor_flush_attr_cache(ipmi_sensor_t *sensor)
+{
+    CHECK_SENSOR_LOCK(sensor);
+
+    sensor->thresholds_cached = 0;
+    sensor->hysteresis_cached = 0;
+    sensor->enables_cached = 0;
+}
+
+void
+ipmi_sensor_set_attr_cache(ipmi_sensor_t *sensor, int enable)
+{
+    CHECK_SENSOR_LOCK(sensor);
+
+    sensor->attr_cache = enable != 0;
+    if (!enable)
+	ipmi_sensor_flush_attr_cache(sensor);
+}
+
+int
+ipmi_sensor_get_attr_cache(ipmi_sensor_t *sensor)
+{
+    CHECK_SENSOR_LOCK(sensor);
+
+    return sensor->attr_cache;
+}
+
 int
 ipmi_sensor_get_states(ipmi_sensor_t         *sensor,
 		       ipmi_sensor_states_cb done,
@@ -5512,6 +6558,46 @@ ipmi_sensor_convert_from_raw(ipmi_sensor_t *sensor,
     return sensor->cbs.ipmi_sensor_convert_from_raw(sensor, val, result);
 }
 
+int
+ipmi_sensor_convert_from_raw_batch(ipmi_sensor_t      **sensors,
+				   const int          *raw,
+				   double             *results,
+				   int                *errs,
+				   unsigned int       count)
+{
+    unsigned int  i;
+    int           rv, first_rv = 0;
+    ipmi_sensor_t *sensor;
+
+    for (i=0; i<count; i++) {
+	sensor = sensors[i];
+	CHECK_SENSOR_LOCK(sensor);
+
+	/* Standard threshold sensors with a built table are just a
+	   lookup, skip the call for them. */
+	if (sensor->cooked_valid
+	    && (sensor->cbs.ipmi_sensor_convert_from_raw
+		== stand_ipmi_sensor_convert_from_raw)
+	    && (sensor->event_reading_type
+		== IPMI_EVENT_READING_TYPE_THRESHOLD))
+	{
+	    results[i] = sensor_cooked_byte(sensor, raw[i] & 0xff);
+	    rv = 0;
+	} else if (!sensor->cbs.ipmi_sensor_convert_from_raw)
+	    rv = ENOSYS;
+	else
+	    rv = sensor->cbs.ipmi_sensor_convert_from_raw(sensor, raw[i],
+							  &results[i]);
+
+	if (errs)
+	    errs[i] = rv;
+	if (rv && !first_rv)
+	    first_rv = rv;
+    }
+
+    return first_rv;
+}
+
 int
 ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
 			   enum ipmi_round_e rounding,
@@ -5951,6 +7037,316 @@ ipmi_sensor_id_get_states(ipmi_sensor_id_t      sensor_id,
     return rv;
 }
 
+/***********************************************************************
+ *
+ * Reading a set of sensors as a batch.
+ *
+ **********************************************************************/
+
+typedef struct reading_batch_s reading_batch_t;
+
+typedef struct reading_batch_ent_s
+{
+    reading_batch_t *rb;
+    unsigned int    idx;   /* Index into the readings. */
+} reading_batch_ent_t;
+
+struct reading_batch_s
+{
+    ipmi_batch_t                  *batch;
+
+    ipmi_sensor_batch_reading_t   *readings;
+    unsigned int                  count;
+    unsigned char                 *states;
+    reading_batch_ent_t           *ents;
+
+    ipmi_domain_sensor_readings_cb done;
+    void                          *cb_data;
+};
+
+static void
+reading_batch_free(reading_batch_t *rb)
+{
+    if (rb->readings)
+	ipmi_mem_free(rb->readings);
+    if (rb->states)
+	ipmi_mem_free(rb->states);
+    if (rb->ents)
+	ipmi_mem_free(rb->ents);
+    ipmi_mem_free(rb);
+}
+
+static void
+reading_batch_done(ipmi_domain_t *domain,
+		   ipmi_batch_t  *batch,
+		   unsigned int  errs,
+		   void          *cb_data)
+{
+    reading_batch_t *rb = cb_data;
+
+    rb->done(domain, rb->readings, rb->count, rb->cb_data);
+    reading_batch_free(rb);
+}
+
+static void
+reading_batch_got(ipmi_sensor_t             *sensor,
+		  int                       err,
+		  enum ipmi_value_present_e value_present,
+		  unsigned int              raw_value,
+		  double                    val,
+		  ipmi_states_t             *states,
+		  void                      *cb_data)
+{
+    reading_batch_ent_t         *ent = cb_data;
+    reading_batch_t             *rb = ent->rb;
+    ipmi_sensor_batch_reading_t *reading = &rb->readings[ent->idx];
+
+    reading->err = err;
+    if (!err) {
+	reading->value_present = value_present;
+	reading->raw_value = raw_value;
+	reading->val = val;
+	if (states)
+	    ipmi_copy_states(reading->states, states);
+    }
+    ipmi_batch_item_done(rb->batch, ent->idx, err);
+}
+
+static int
+reading_batch_start(ipmi_batch_t *batch, unsigned int idx, void *cb_data)
+{
+    reading_batch_t *rb = cb_data;
+    int             rv;
+
+    rv = ipmi_sensor_id_get_reading(rb->readings[idx].sensor_id,
+				    reading_batch_got, &rb->ents[idx]);
+    if (rv)
+	rb->readings[idx].err = rv;
+    return rv;
+}
+
+int
+ipmi_domain_get_sensor_readings(ipmi_domain_t                  *domain,
+				const ipmi_sensor_id_t         *sensor_ids,
+				unsigned int                   count,
+				ipmi_domain_sensor_readings_cb done,
+				void                           *cb_data)
+{
+    reading_batch_t *rb;
+    unsigned int    i;
+    int             rv;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (!done || (count == 0))
+	return EINVAL;
+
+    rb = ipmi_mem_alloc(sizeof(*rb));
+    if (!rb)
+	return ENOMEM;
+    memset(rb, 0, sizeof(*rb));
+
+    rv = ENOMEM;
+    rb->readings = ipmi_mem_alloc(sizeof(*rb->readings) * count);
+    rb->states = ipmi_mem_alloc(ipmi_states_size() * count);
+    rb->ents = ipmi_mem_alloc(sizeof(*rb->ents) * count);
+    if (!rb->readings || !rb->states || !rb->ents)
+	goto out_err;
+
+    rb->count = count;
+    rb->done = done;
+    rb->cb_data = cb_data;
+
+    rv = ipmi_batch_alloc(domain, count, reading_batch_start, NULL,
+			  reading_batch_done, rb, &rb->batch);
+    if (rv)
+	goto out_err;
+
+    for (i=0; i<count; i++) {
+	ipmi_sensor_batch_reading_t *reading = &rb->readings[i];
+
+	reading->sensor_id = sensor_ids[i];
+	reading->err = 0;
+	reading->value_present = IPMI_NO_VALUES_PRESENT;
+	reading->raw_value = 0;
+	reading->val = 0.0;
+	reading->states = (ipmi_states_t *)
+	    (rb->states + (i * ipmi_states_size()));
+	ipmi_init_states(reading->states);
+
+	rb->ents[i].rb = rb;
+	rb->ents[i].idx = i;
+	ipmi_batch_set_mc(rb->batch, i, sensor_ids[i].mcid);
+    }
+
+    ipmi_batch_start(rb->batch);
+    return 0;
+
+ out_err:
+    reading_batch_free(rb);
+    return rv;
+}
+
+/***********************************************************************
+ *
+ * Fetching the thresholds, hysteresis and event enables of a set of
+ * sensors as a batch.
+ *
+ **********************************************************************/
+
+typedef struct attr_batch_s attr_batch_t;
+
+typedef struct attr_batch_ent_s
+{
+    attr_batch_t     *ab;
+    unsigned int     idx;
+    ipmi_sensor_id_t sensor_id;
+    unsigned int     outstanding;
+    int              err;
+} attr_batch_ent_t;
+
+struct attr_batch_s
+{
+    ipmi_batch_t                  *batch;
+    attr_batch_ent_t              *ents;
+    ipmi_domain_sensor_prefetch_cb done;
+    void                          *cb_data;
+};
+
+static void
+attr_batch_done(ipmi_domain_t *domain,
+		ipmi_batch_t  *batch,
+		unsigned int  errs,
+		void          *cb_data)
+{
+    attr_batch_t *ab = cb_data;
+
+    if (ab->done)
+	ab->done(domain, errs, ab->cb_data);
+    ipmi_mem_free(ab->ents);
+    ipmi_mem_free(ab);
+}
+
+static void
+attr_batch_put(attr_batch_ent_t *ent, int err)
+{
+    if (err && !ent->err)
+	ent->err = err;
+    ent->outstanding--;
+    if (ent->outstanding == 0)
+	ipmi_batch_item_done(ent->ab->batch, ent->idx, ent->err);
+}
+
+static void
+attr_batch_got_thresholds(ipmi_sensor_t     *sensor,
+			  int               err,
+			  ipmi_thresholds_t *th,
+			  void              *cb_data)
+{
+    attr_batch_put(cb_data, err);
+}
+
+static void
+attr_batch_got_hysteresis(ipmi_sensor_t *sensor,
+			  int           err,
+			  unsigned int  positive_hysteresis,
+			  unsigned int  negative_hysteresis,
+			  void          *cb_data)
+{
+    attr_batch_put(cb_data, err);
+}
+
+static void
+attr_batch_got_enables(ipmi_sensor_t      *sensor,
+		       int                err,
+		       ipmi_event_state_t *states,
+		       void               *cb_data)
+{
+    attr_batch_put(cb_data, err);
+}
+
+static void
+attr_batch_start_sensor(ipmi_sensor_t *sensor, void *cb_data)
+{
+    attr_batch_ent_t *ent = cb_data;
+
+    ipmi_sensor_set_attr_cache(sensor, 1);
+
+    /* Hold the item until all the gets are started, they may finish
+       right away if the values are already cached. */
+    ent->outstanding = 1;
+
+    ent->outstanding++;
+    if (ipmi_sensor_get_thresholds(sensor, attr_batch_got_thresholds, ent))
+	ent->outstanding--;
+    ent->outstanding++;
+    if (ipmi_sensor_get_hysteresis(sensor, attr_batch_got_hysteresis, ent))
+	ent->outstanding--;
+    ent->outstanding++;
+    if (ipmi_sensor_get_event_enables(sensor, attr_batch_got_enables, ent))
+	ent->outstanding--;
+
+    attr_batch_put(ent, 0);
+}
+
+static int
+attr_batch_start(ipmi_batch_t *batch, unsigned int idx, void *cb_data)
+{
+    attr_batch_t     *ab = cb_data;
+    attr_batch_ent_t *ent = &ab->ents[idx];
+
+    return ipmi_sensor_pointer_cb(ent->sensor_id, attr_batch_start_sensor,
+				  ent);
+}
+
+int
+ipmi_domain_prefetch_sensor_attrs(ipmi_domain_t                  *domain,
+				  const ipmi_sensor_id_t         *sensor_ids,
+				  unsigned int                   count,
+				  ipmi_domain_sensor_prefetch_cb done,
+				  void                           *cb_data)
+{
+    attr_batch_t *ab;
+    unsigned int i;
+    int          rv;
+
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (count == 0)
+	return EINVAL;
+
+    ab = ipmi_mem_alloc(sizeof(*ab));
+    if (!ab)
+	return ENOMEM;
+    memset(ab, 0, sizeof(*ab));
+    ab->ents = ipmi_mem_alloc(sizeof(*ab->ents) * count);
+    if (!ab->ents) {
+	ipmi_mem_free(ab);
+	return ENOMEM;
+    }
+    ab->done = done;
+    ab->cb_data = cb_data;
+
+    rv = ipmi_batch_alloc(domain, count, attr_batch_start, NULL,
+			  attr_batch_done, ab, &ab->batch);
+    if (rv) {
+	ipmi_mem_free(ab->ents);
+	ipmi_mem_free(ab);
+	return rv;
+    }
+
+    for (i=0; i<count; i++) {
+	ab->ents[i].ab = ab;
+	ab->ents[i].idx = i;
+	ab->ents[i].sensor_id = sensor_ids[i];
+	ab->ents[i].outstanding = 0;
+	ab->ents[i].err = 0;
+	ipmi_batch_set_mc(ab->batch, i, sensor_ids[i].mcid);
+    }
+
+    ipmi_batch_start(ab->batch);
+    return 0;
+}
 
 #ifdef IPMI_CHECK_LOCKS
 void
@@ -586,16 +586,20 @@ start_config_fetch(void *cb_data, int shutdown)
     return OPQ_HANDLER_STARTED;
 }
 
-int
-ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
-		      unsigned int	  parm,
-		      unsigned int	  set,
-		      unsigned int	  block,
-		      ipmi_solparm_get_cb done,
-		      void                *cb_data)
+/* If concurrent is true, the fetch may run at the same time as other
+   concurrent operations on the SOL parms, up to the opq's maximum. */
+static int
+solparm_get_parm(ipmi_solparm_t      *solparm,
+		 unsigned int	     parm,
+		 unsigned int	     set,
+		 unsigned int	     block,
+		 ipmi_solparm_get_cb done,
+		 void                *cb_data,
+		 int                 concurrent)
 {
     solparm_fetch_handler_t *elem;
     int                 rv = 0;
+    int                 success;
 
     if (solparm->destroyed)
 	return EINVAL;
@@ -616,7 +620,12 @@ ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
     elem->block = block;
     elem->rv = 0;
 
-    if (!opq_new_op(solparm->opq, start_config_fetch, elem, 0))
+    if (concurrent)
+	success = opq_new_op_concurrent(solparm->opq, start_config_fetch,
+					elem, 0);
+    else
+	success = opq_new_op(solparm->opq, start_config_fetch, elem, 0);
+    if (!success)
 	rv = ENOMEM;
 
     if (rv)
@@ -627,6 +636,17 @@ ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
     return rv;
 }
 
+int
+ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
+		      unsigned int	  parm,
+		      unsigned int	  set,
+		      unsigned int	  block,
+		      ipmi_solparm_get_cb done,
+		      void                *cb_data)
+{
+    return solparm_get_parm(solparm, parm, set, block, done, cb_data, 0);
+}
+
 typedef struct solparm_set_handler_s
 {
     ipmi_solparm_t 	 *solparm;
@@ -813,6 +833,18 @@ struct ipmi_sol_config_s
     /* Used for deferred errors. */
     int err;
 
+    /* Used to run the parameter fetches in parallel. */
+    int           next_parm;
+    os_handler_t  *os_hnd;
+    os_hnd_lock_t *lock;
+    unsigned int  window;
+    unsigned int  outstanding;
+    int           issuing;
+
+    /* If not zero, only the parameters with their bit set are
+       fetched, see ipmi_sol_get_config_parms(). */
+    unsigned int  fetch_mask;
+
     ipmi_solparm_done_cb   set_done;
     ipmi_sol_get_config_cb done;
     void                   *cb_data;
@@ -1012,6 +1044,42 @@ static solparms_t solparms[NUM_SOLPARMS] =
 #undef S
 };
 
+static void
+solc_lock(ipmi_sol_config_t *solc)
+{
+    if (solc->lock)
+	solc->os_hnd->lock(solc->os_hnd, solc->lock);
+}
+
+static void
+solc_unlock(ipmi_sol_config_t *solc)
+{
+    if (solc->lock)
+	solc->os_hnd->unlock(solc->os_hnd, solc->lock);
+}
+
+static void
+solparm_window_cb(ipmi_mc_t *mc, void *cb_data)
+{
+    unsigned int *window = cb_data;
+
+    *window = _ipmi_mc_op_concurrency(mc);
+}
+
+/* Get how many parameter fetches may be outstanding at once and let
+   the opq run that many. */
+static unsigned int
+solparm_op_window(ipmi_solparm_t *solparm)
+{
+    unsigned int window = 1;
+
+    ipmi_mc_pointer_cb(solparm->mc, solparm_window_cb, &window);
+    if (window == 0)
+	window = 1;
+    opq_set_max_running(solparm->opq, window);
+    return window;
+}
+
 static void
 err_lock_cleared(ipmi_solparm_t *solparm,
 		 int            err,
@@ -1026,6 +1094,118 @@ err_lock_cleared(ipmi_solparm_t *solparm,
     solparm_put(solparm);
 }
 
+typedef struct solparm_get_req_s
+{
+    ipmi_sol_config_t *solc;
+    int               parm;
+} solparm_get_req_t;
+
+/* Find the next parameter to fetch, returns 0 if there are no more.
+   Must be called with the config locked. */
+static int
+solparm_next_get(ipmi_sol_config_t *solc, solparm_get_req_t *req)
+{
+    int parm;
+
+    for (;;) {
+	parm = solc->next_parm;
+	if (parm > IPMI_SOLPARM_PAYLOAD_PORT_NUMBER)
+	    return 0;
+	solc->next_parm++;
+	if ((!solparms[parm].valid)
+	    || (solc->fetch_mask && !(solc->fetch_mask & (1 << parm))))
+	    continue;
+	break;
+    }
+
+    req->parm = parm;
+    return 1;
+}
+
+static void
+solparm_get_done(ipmi_solparm_t *solparm, ipmi_sol_config_t *solc)
+{
+    unsigned char data[1];
+    int           err;
+
+    if (solc->err) {
+	/* Clear the lock */
+	data[0] = 0;
+	err = ipmi_solparm_set_parm(solparm, 0, data, 1,
+				    err_lock_cleared, solc);
+	if (err) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "solparm.c(solparm_get_done): "
+		     "Error trying to clear lock: %x",
+		     err);
+	    solc->done(solparm, solc->err, NULL, solc->cb_data);
+	    ipmi_sol_free_config(solc);
+	    solparm->locked = 0;
+	    solparm_put(solparm);
+	}
+    } else {
+	solc->done(solparm, 0, solc, solc->cb_data);
+	solparm_put(solparm);
+    }
+}
+
+static void got_parm(ipmi_solparm_t    *solparm,
+		     int               err,
+		     unsigned char     *data,
+		     unsigned int      data_len,
+		     void              *cb_data);
+
+/* Start as many parameter fetches as the window allows.  Must be
+   called with the config locked, this will unlock it. */
+static void
+solparm_get_issue(ipmi_solparm_t *solparm, ipmi_sol_config_t *solc)
+{
+    solparm_get_req_t *req;
+    int               rv;
+
+    if (solc->issuing) {
+	/* Whoever is issuing will see the change. */
+	solc_unlock(solc);
+	return;
+    }
+    solc->issuing = 1;
+
+    while (!solc->err && (solc->outstanding < solc->window)) {
+	req = ipmi_mem_alloc(sizeof(*req));
+	if (!req) {
+	    solc->err = ENOMEM;
+	    break;
+	}
+	req->solc = solc;
+	if (!solparm_next_get(solc, req)) {
+	    ipmi_mem_free(req);
+	    break;
+	}
+
+	solc->outstanding++;
+	solc_unlock(solc);
+	rv = solparm_get_parm(solparm, req->parm, 0, 0, got_parm, req, 1);
+	solc_lock(solc);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "solparm.c(solparm_get_issue): "
+		     "Error trying to get parm %d: %x",
+		     req->parm, rv);
+	    ipmi_mem_free(req);
+	    solc->outstanding--;
+	    solc->err = rv;
+	}
+    }
+
+    solc->issuing = 0;
+    if (solc->outstanding == 0) {
+	solc_unlock(solc);
+	solparm_get_done(solparm, solc);
+	return;
+    }
+    solc_unlock(solc);
+}
+
 static void
 got_parm(ipmi_solparm_t    *solparm,
 	 int               err,
@@ -1033,8 +1213,16 @@ got_parm(ipmi_solparm_t    *solparm,
 	 unsigned int      data_len,
 	 void              *cb_data)
 {
-    ipmi_sol_config_t *solc = cb_data;
-    solparms_t        *lp = &(solparms[solc->curr_parm]);
+    solparm_get_req_t *req = cb_data;
+    ipmi_sol_config_t *solc = req->solc;
+    solparms_t        *lp = &(solparms[req->parm]);
+
+    solc_lock(solc);
+    solc->outstanding--;
+
+    if (solc->err)
+	/* Something else already failed, just let things drain. */
+	goto out;
 
     /* Check the length, and don't forget the revision byte must be added. */
     if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
@@ -1042,14 +1230,14 @@ got_parm(ipmi_solparm_t    *solparm,
 	    /* Some systems return zero-length data for optional parms. */
 	    unsigned char *opt = ((unsigned char *)solc) + lp->optional_offset;
 	    *opt = 0;
-	    goto next_parm;
+	    goto out;
 	}
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "solparm.c(got_parm): "
 		 " Invalid data length on parm %d was %d, should have been %d",
-		 solc->curr_parm, data_len, lp->length+1);
-	err = EINVAL;
-	goto done;
+		 req->parm, data_len, lp->length+1);
+	solc->err = EINVAL;
+	goto out;
     }
 
     err = lp->get_handler(solc, lp, err, data);
@@ -1057,55 +1245,13 @@ got_parm(ipmi_solparm_t    *solparm,
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "solparm.c(got_parm): "
 		 "Error fetching parm %d: %x",
-		 solc->curr_parm, err);
-	goto done;
-    }
-
- next_parm:
-    switch (solc->curr_parm) {
-    case IPMI_SOLPARM_PAYLOAD_PORT_NUMBER:
-	goto done;
-    default:
-	solc->curr_parm++;
-    }
-
-    lp = &(solparms[solc->curr_parm]);
-    if (!lp->valid)
-	goto next_parm;
-
-    err = ipmi_solparm_get_parm(solparm, solc->curr_parm, solc->curr_sel, 0,
-				got_parm, solc);
-    if (err)
-	goto done;
-
-    return;
-
- done:
-    if (err) {
-	unsigned char data[1];
-
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "solparm.c(got_parm): Error trying to get parm %d: %x",
-		 solc->curr_parm, err);
+		 req->parm, err);
 	solc->err = err;
-	/* Clear the lock */
-	data[0] = 0;
-	err = ipmi_solparm_set_parm(solparm, 0, data, 1,
-				    err_lock_cleared, solc);
-	if (err) {
-	    ipmi_sol_free_config(solc);
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "solparm.c(got_parm): Error trying to clear lock: %x",
-		     err);
-	    solc->done(solparm, solc->err, NULL, solc->cb_data);
-	    ipmi_sol_free_config(solc);
-	    solparm->locked = 0;
-	    solparm_put(solparm);
-	}
-    } else {
-	solc->done(solparm, 0, solc, solc->cb_data);
-	solparm_put(solparm);
     }
+
+ out:
+    ipmi_mem_free(req);
+    solparm_get_issue(solparm, solc);
 }
 
 static void 
@@ -1114,7 +1260,6 @@ lock_done(ipmi_solparm_t *solparm,
 	  void           *cb_data)
 {
     ipmi_sol_config_t *solc = cb_data;
-    int               rv;
 
     if (err == IPMI_IPMI_ERR_VAL(0x80)) {
 	/* Lock is not supported, just mark it and go on. */
@@ -1139,34 +1284,17 @@ lock_done(ipmi_solparm_t *solparm,
 	solparm->locked = 1;
     }
 
-    rv = ipmi_solparm_get_parm(solparm, solc->curr_parm, solc->curr_sel, 0,
-			       got_parm, solc);
-    if (rv) {
-	unsigned char data[1];
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "solparm.c(lock_done): Error trying to get parms: %x",
-		 err);
-
-	solc->err = rv;
-	/* Clear the lock */
-	data[0] = 0;
-	rv = ipmi_solparm_set_parm(solparm, 0, data, 1,
-				   err_lock_cleared, solc);
-	if (rv) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "solparm.c(lock_done): Error trying to clear lock: %x",
-		     err);
-	    solc->done(solparm, solc->err, NULL, solc->cb_data);
-	    ipmi_sol_free_config(solc);
-	    solparm->locked = 0;
-	    solparm_put(solparm);
-	}
-    }
+    /* The parameters are independent, so fetch them in parallel. */
+    solc->window = solparm_op_window(solparm);
+    solc_lock(solc);
+    solparm_get_issue(solparm, solc);
 }
 
-int ipmi_sol_get_config(ipmi_solparm_t         *solparm,
-			ipmi_sol_get_config_cb done,
-			void                   *cb_data)
+static int
+sol_get_config(ipmi_solparm_t         *solparm,
+	       unsigned int           fetch_mask,
+	       ipmi_sol_get_config_cb done,
+	       void                   *cb_data)
 {
     ipmi_sol_config_t *solc;
     int               rv;
@@ -1177,8 +1305,19 @@ int ipmi_sol_get_config(ipmi_solparm_t         *solparm,
 	return ENOMEM;
     memset(solc, 0, sizeof(*solc));
 
+    solc->os_hnd = solparm->os_hnd;
+    if (solparm->os_hnd->create_lock) {
+	rv = solparm->os_hnd->create_lock(solparm->os_hnd, &solc->lock);
+	if (rv) {
+	    ipmi_mem_free(solc);
+	    return rv;
+	}
+    }
+
     solc->curr_parm = 1;
     solc->curr_sel = 0;
+    solc->next_parm = 1;
+    solc->fetch_mask = fetch_mask;
     solc->done = done;
     solc->cb_data = cb_data;
     solc->my_sol = solparm;
@@ -1197,6 +1336,35 @@ int ipmi_sol_get_config(ipmi_solparm_t         *solparm,
     return rv;
 }
 
+int ipmi_sol_get_config(ipmi_solparm_t         *solparm,
+			ipmi_sol_get_config_cb done,
+			void                   *cb_data)
+{
+    return sol_get_config(solparm, 0, done, cb_data);
+}
+
+int
+ipmi_sol_get_config_parms(ipmi_solparm_t         *solparm,
+			  unsigned int           *parms,
+			  unsigned int           num_parms,
+			  ipmi_sol_get_config_cb done,
+			  void                   *cb_data)
+{
+    unsigned int mask = 0;
+    unsigned int i;
+
+    if (!parms || (num_parms == 0))
+	return EINVAL;
+
+    for (i=0; i<num_parms; i++) {
+	if ((parms[i] >= NUM_SOLPARMS) || (!solparms[parms[i]].valid))
+	    return EINVAL;
+	mask |= 1 << parms[i];
+    }
+
+    return sol_get_config(solparm, mask, done, cb_data);
+}
+
 static void 
 set_clear(ipmi_solparm_t *solparm,
 	 int            err,
@@ -1327,11 +1495,16 @@ ipmi_sol_set_config(ipmi_solparm_t       *solparm,
     if (!osolc->sol_locked)
 	return EINVAL;
 
+    if (osolc->fetch_mask)
+	/* Only part of the config was fetched. */
+	return EINVAL;
+
     solc = ipmi_mem_alloc(sizeof(*solc));
     if (!solc)
 	return ENOMEM;
 
     *solc = *osolc;
+    solc->lock = NULL; /* The set does not run in parallel. */
     solc->err = 0;
     solc->sol_locked = 0; /* Set this here, since we will unlock it,
 			     but we don't want the free operation to
@@ -1418,6 +1591,8 @@ ipmi_sol_clear_lock(ipmi_solparm_t       *solparm,
 void
 ipmi_sol_free_config(ipmi_sol_config_t *solc)
 {
+    if (solc->lock)
+	solc->os_hnd->destroy_lock(solc->os_hnd, solc->lock);
     ipmi_mem_free(solc);
 }
 
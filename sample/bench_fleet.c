@@ -0,0 +1,874 @@
+/*
+ * bench_fleet.c
+ *
+ * Measure the library against a fleet of (usually simulated) BMCs.
+ *
+ * Author: Corey Minyard <minyard@acm.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * This takes a host file in the same format as fleet_sensors and runs
+ * every host through the same phases, all hosts at once in each
+ * phase:
+ *
+ *   up     - Open the domain and wait for it to be fully up, with the
+ *            SDRs and FRUs but not the SEL, as a normal client would.
+ *   sdr    - Fetch the BMC's SDR repository again into a new copy.
+ *   sel    - Fetch the SEL for the first time.
+ *   fru    - Fetch FRU device 0 of the first MC with FRU inventory
+ *            support into a new FRU.
+ *   sweep  - Read all the threshold sensors with one
+ *            ipmi_domain_get_sensor_readings() call, repeated the
+ *            given number of times.
+ *
+ * When done, one JSON object with the results is written.  Times are
+ * in microseconds.  Each phase has the number of hosts that finished
+ * it and that failed, latency percentiles across the hosts, and for
+ * the downloads the total bytes and bytes per second over the
+ * phase's wall clock time.  The CPU time and RSS growth of this
+ * process are given per domain, and if the process id of the
+ * simulator is given, its CPU time and RSS as well (from /proc).
+ *
+ * bench_fleet.sh starts ipmi_sim with a fleet and runs this against
+ * it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_sdr.h>
+#include <OpenIPMI/ipmi_fru.h>
+#include <OpenIPMI/ipmi_mc.h>
+#include <OpenIPMI/ipmi_posix.h>
+
+#define MAX_LINE_LEN	1024
+#define MAX_HOST_ARGS	64
+
+enum phase_e { PHASE_UP, PHASE_SDR, PHASE_SEL, PHASE_FRU, PHASE_SWEEP,
+	       PHASE_CLOSE, NUM_PHASES };
+
+static const char *phase_names[NUM_PHASES] = {
+    "up", "sdr", "sel", "fru", "sweep", "close"
+};
+
+typedef struct phase_s
+{
+    long          *lat;		/* Per host (or per host per sweep). */
+    unsigned int  num_lat;
+    unsigned int  max_lat;
+    unsigned int  failed;
+    unsigned long bytes;
+    struct timeval start;
+    struct timeval end;
+} phase_t;
+
+typedef struct host_s
+{
+    char              *name;
+    char              *line;
+    ipmi_args_t       *args;
+    ipmi_domain_id_t  domain_id;
+    int               open;
+    int               failed;
+    struct timeval    start;
+
+    ipmi_sensor_id_t  *ids;
+    unsigned int      num_sensors;
+    unsigned int      max_sensors;
+} host_t;
+
+static const char   *progname;
+static os_handler_t *os_hnd;
+static FILE         *out;
+static unsigned int timeout_secs = 120;
+static unsigned int num_sweeps = 10;
+static pid_t        sim_pid;
+
+static host_t       **hosts;
+static unsigned int num_hosts;
+static unsigned int pending;
+static enum phase_e phase;
+static phase_t      phases[NUM_PHASES];
+static unsigned int sweep;
+static int          done;
+
+static os_hnd_timer_id_t *timer;
+
+static void con_usage(const char *name, const char *help, void *cb_data)
+{
+    fprintf(stderr, "\n%s%s", name, help);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, " %s [-s <sweeps>] [-t <timeout secs>] [-p <sim pid>]"
+	    " [-o <output file>] <host file>\n", progname);
+    fprintf(stderr, " <host file> may be - for stdin.  Each line of it is a"
+	    " name followed\n by <con_parms>, where <con_parms> is one of:");
+    ipmi_parse_args_iter_help(con_usage, NULL);
+    fprintf(stderr, "\n");
+}
+
+static long
+us_between(struct timeval *start, struct timeval *end)
+{
+    return (((end->tv_sec - start->tv_sec) * 1000000)
+	    + (end->tv_usec - start->tv_usec));
+}
+
+/***********************************************************************
+ *
+ * Resource usage.
+ *
+ **********************************************************************/
+
+static long
+self_cpu_us(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ((ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+	    + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+/* Returns the RSS of the given process in KB, or -1 if unavailable. */
+static long
+proc_rss_kb(const char *pid)
+{
+    char buf[128];
+    FILE *f;
+    long rss = -1;
+
+    snprintf(buf, sizeof(buf), "/proc/%s/status", pid);
+    f = fopen(buf, "r");
+    if (!f)
+	return -1;
+    while (fgets(buf, sizeof(buf), f)) {
+	if (strncmp(buf, "VmRSS:", 6) == 0) {
+	    rss = strtol(buf + 6, NULL, 10);
+	    break;
+	}
+    }
+    fclose(f);
+    return rss;
+}
+
+/* CPU time of another process from /proc, or -1 if unavailable. */
+static long
+proc_cpu_us(pid_t pid)
+{
+    char buf[1024];
+    char *s;
+    FILE *f;
+    unsigned long utime, stime;
+    int rv;
+
+    snprintf(buf, sizeof(buf), "/proc/%ld/stat", (long) pid);
+    f = fopen(buf, "r");
+    if (!f)
+	return -1;
+    s = fgets(buf, sizeof(buf), f);
+    fclose(f);
+    if (!s)
+	return -1;
+
+    /* The command name may have spaces, start after it. */
+    s = strrchr(buf, ')');
+    if (!s)
+	return -1;
+    rv = sscanf(s + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+		&utime, &stime);
+    if (rv != 2)
+	return -1;
+    return (long) ((utime + stime) * (1000000 / sysconf(_SC_CLK_TCK)));
+}
+
+/***********************************************************************
+ *
+ * Results.
+ *
+ **********************************************************************/
+
+static void
+add_lat(phase_t *p, long us)
+{
+    if (p->num_lat == p->max_lat) {
+	unsigned int nmax = p->max_lat ? p->max_lat * 2 : 64;
+	long         *lat;
+
+	lat = realloc(p->lat, nmax * sizeof(*lat));
+	if (!lat)
+	    return;
+	p->lat = lat;
+	p->max_lat = nmax;
+    }
+    p->lat[p->num_lat++] = us;
+}
+
+static int
+cmp_long(const void *a, const void *b)
+{
+    long la = *((const long *) a), lb = *((const long *) b);
+
+    return (la > lb) - (la < lb);
+}
+
+static long
+percentile(phase_t *p, unsigned int pct)
+{
+    unsigned int i;
+
+    /* Nearest rank, on a sorted array. */
+    i = (p->num_lat * pct + 99) / 100;
+    if (i > 0)
+	i--;
+    return p->lat[i];
+}
+
+static void
+out_results(long cpu_us, long rss_kb, long sim_cpu_us, long sim_rss_kb)
+{
+    unsigned int i;
+    phase_t      *p;
+    long         wall;
+
+    fprintf(out, "{\"hosts\":%u,\"sweeps\":%u,\"phases\":{",
+	    num_hosts, num_sweeps);
+    for (i = 0; i < PHASE_CLOSE; i++) {
+	p = &phases[i];
+	wall = us_between(&p->start, &p->end);
+	fprintf(out, "%s\"%s\":{\"done\":%u,\"failed\":%u,\"wall_us\":%ld",
+		i ? "," : "", phase_names[i], p->num_lat, p->failed, wall);
+	if (p->num_lat) {
+	    qsort(p->lat, p->num_lat, sizeof(long), cmp_long);
+	    fprintf(out, ",\"min_us\":%ld,\"p50_us\":%ld,\"p90_us\":%ld"
+		    ",\"p99_us\":%ld,\"max_us\":%ld",
+		    p->lat[0], percentile(p, 50), percentile(p, 90),
+		    percentile(p, 99), p->lat[p->num_lat - 1]);
+	}
+	if ((i == PHASE_SDR) || (i == PHASE_SEL) || (i == PHASE_FRU)) {
+	    fprintf(out, ",\"bytes\":%lu", p->bytes);
+	    if (wall > 0)
+		fprintf(out, ",\"bytes_per_sec\":%.0f",
+			(double) p->bytes * 1000000.0 / wall);
+	}
+	putc('}', out);
+    }
+    fprintf(out, "},\"client\":{\"cpu_us\":%ld,\"cpu_us_per_domain\":%ld",
+	    cpu_us, num_hosts ? cpu_us / (long) num_hosts : 0);
+    if (rss_kb >= 0)
+	fprintf(out, ",\"rss_kb_per_domain\":%ld",
+		num_hosts ? rss_kb / (long) num_hosts : 0);
+    putc('}', out);
+    if (sim_pid) {
+	fputs(",\"sim\":{", out);
+	if (sim_cpu_us >= 0)
+	    fprintf(out, "\"cpu_us\":%ld,\"cpu_us_per_domain\":%ld",
+		    sim_cpu_us, num_hosts ? sim_cpu_us / (long) num_hosts : 0);
+	if (sim_rss_kb >= 0)
+	    fprintf(out, "%s\"rss_kb\":%ld", sim_cpu_us >= 0 ? "," : "",
+		    sim_rss_kb);
+	putc('}', out);
+    }
+    fputs("}\n", out);
+    fflush(out);
+}
+
+/***********************************************************************
+ *
+ * Phases.  Each phase starts its operation on every host that is
+ * still good and moves to the next phase when they have all finished.
+ *
+ **********************************************************************/
+
+static void start_phase(enum phase_e next);
+
+static void
+phase_done(struct timeval *now)
+{
+    phases[phase].end = *now;
+    if (phase == PHASE_SWEEP && ++sweep < num_sweeps)
+	start_phase(PHASE_SWEEP);
+    else
+	start_phase(phase + 1);
+}
+
+static void
+host_finished(host_t *h, int err, struct timeval *start)
+{
+    phase_t        *p = &phases[phase];
+    struct timeval now;
+
+    os_hnd->get_monotonic_time(os_hnd, &now);
+    if (err) {
+	if (phase != PHASE_CLOSE)
+	    fprintf(stderr, "%s: %s failed: 0x%x\n", h->name,
+		    phase_names[phase], err);
+	h->failed = 1;
+	p->failed++;
+    } else {
+	add_lat(p, us_between(start, &now));
+    }
+
+    pending--;
+    if (pending == 0)
+	phase_done(&now);
+}
+
+static void
+domain_up(ipmi_domain_t *domain, void *cb_data)
+{
+    host_t *h = cb_data;
+
+    if (phase != PHASE_UP || h->open)
+	return;
+    h->open = 1;
+    host_finished(h, 0, &h->start);
+}
+
+static void
+start_up(host_t *h)
+{
+    ipmi_con_t         *con;
+    ipmi_open_option_t options[7];
+    int                rv;
+
+    rv = ipmi_args_setup_con(h->args, os_hnd, NULL, &con);
+    ipmi_free_args(h->args);
+    h->args = NULL;
+    if (rv)
+	goto out_err;
+
+    /* The SEL is left for its own phase, and the BMC's configuration
+       is left alone. */
+    options[0].option = IPMI_OPEN_OPTION_ALL;
+    options[0].ival = 0;
+    options[1].option = IPMI_OPEN_OPTION_SDRS;
+    options[1].ival = 1;
+    options[2].option = IPMI_OPEN_OPTION_FRUS;
+    options[2].ival = 1;
+    options[3].option = IPMI_OPEN_OPTION_IPMB_SCAN;
+    options[3].ival = 1;
+    options[4].option = IPMI_OPEN_OPTION_OEM_INIT;
+    options[4].ival = 1;
+    options[5].option = IPMI_OPEN_OPTION_SET_EVENT_RCVR;
+    options[5].ival = 0;
+    options[6].option = IPMI_OPEN_OPTION_SET_SEL_TIME;
+    options[6].ival = 0;
+
+    rv = ipmi_open_domain(h->name, &con, 1, NULL, NULL, domain_up, h,
+			  options, 7, &h->domain_id);
+    if (rv) {
+	con->close_connection(con);
+	goto out_err;
+    }
+    return;
+
+ out_err:
+    host_finished(h, rv, &h->start);
+}
+
+static int
+count_sdr(ipmi_sdr_info_t *sdrs, const ipmi_sdr_t *sdr, void *cb_data)
+{
+    /* The 5 byte header plus the body. */
+    phases[PHASE_SDR].bytes += 5 + sdr->length;
+    return 0;
+}
+
+static void
+sdrs_fetched(ipmi_sdr_info_t *sdrs,
+	     int             err,
+	     int             changed,
+	     unsigned int    count,
+	     void            *cb_data)
+{
+    host_t *h = cb_data;
+
+    if (!err)
+	ipmi_sdr_iterate_sdrs(sdrs, count_sdr, NULL);
+    ipmi_sdr_info_destroy(sdrs, NULL, NULL);
+    host_finished(h, err, &h->start);
+}
+
+typedef struct find_mc_s
+{
+    int       (*supports)(ipmi_mc_t *mc);
+    ipmi_mc_t *mc;
+} find_mc_t;
+
+static void
+find_mc(ipmi_domain_t *domain, ipmi_mc_t *mc, void *cb_data)
+{
+    find_mc_t *info = cb_data;
+
+    if (!info->mc && info->supports(mc))
+	info->mc = mc;
+}
+
+static void
+sels_read(ipmi_domain_t *domain, int err, void *cb_data)
+{
+    host_t       *h = cb_data;
+    unsigned int count;
+
+    if (!err && !ipmi_domain_sel_count(domain, &count))
+	phases[PHASE_SEL].bytes += count * 16;
+    host_finished(h, err, &h->start);
+}
+
+static void
+fru_fetched(ipmi_domain_t *domain, ipmi_fru_t *fru, int err, void *cb_data)
+{
+    host_t *h = cb_data;
+
+    if (!err)
+	phases[PHASE_FRU].bytes += ipmi_fru_get_data_length(fru);
+    if (err != ECANCELED)
+	ipmi_fru_destroy(fru, NULL, NULL);
+    host_finished(h, err, &h->start);
+}
+
+static void
+readings_done(ipmi_domain_t               *domain,
+	      ipmi_sensor_batch_reading_t *readings,
+	      unsigned int                count,
+	      void                        *cb_data)
+{
+    host_t *h = cb_data;
+
+    /* A sensor that can't be read still took its time, only losing
+       the domain counts as a failure. */
+    host_finished(h, domain ? 0 : ECANCELED, &h->start);
+}
+
+static void
+add_sensor(ipmi_entity_t *entity, ipmi_sensor_t *sensor, void *cb_data)
+{
+    host_t *h = cb_data;
+
+    if (ipmi_sensor_get_event_reading_type(sensor)
+	!= IPMI_EVENT_READING_TYPE_THRESHOLD)
+	return;
+    if (!ipmi_sensor_get_is_readable(sensor))
+	return;
+
+    if (h->num_sensors == h->max_sensors) {
+	unsigned int     nmax = h->max_sensors ? h->max_sensors * 2 : 32;
+	ipmi_sensor_id_t *ids;
+
+	ids = realloc(h->ids, nmax * sizeof(*ids));
+	if (!ids)
+	    return;
+	h->ids = ids;
+	h->max_sensors = nmax;
+    }
+    h->ids[h->num_sensors++] = ipmi_sensor_convert_to_id(sensor);
+}
+
+static void
+add_entity_sensors(ipmi_entity_t *entity, void *cb_data)
+{
+    ipmi_entity_iterate_sensors(entity, add_sensor, cb_data);
+}
+
+static void
+host_closed(void *cb_data)
+{
+    host_t *h = cb_data;
+
+    h->open = 0;
+    host_finished(h, 0, &h->start);
+}
+
+static void
+start_domain_op(ipmi_domain_t *domain, void *cb_data)
+{
+    host_t          *h = cb_data;
+    find_mc_t       info;
+    ipmi_sdr_info_t *sdrs;
+    int             rv;
+
+    switch (phase) {
+    case PHASE_SDR:
+	info.supports = ipmi_mc_sdr_repository_support;
+	info.mc = NULL;
+	ipmi_domain_iterate_mcs(domain, find_mc, &info);
+	if (!info.mc) {
+	    rv = ENOSYS;
+	    break;
+	}
+	rv = ipmi_sdr_info_alloc(domain, info.mc, 0, 0, &sdrs);
+	if (rv)
+	    break;
+	rv = ipmi_sdr_fetch(sdrs, sdrs_fetched, h);
+	if (rv)
+	    ipmi_sdr_info_destroy(sdrs, NULL, NULL);
+	break;
+
+    case PHASE_SEL:
+	rv = ipmi_domain_reread_sels(domain, sels_read, h);
+	break;
+
+    case PHASE_FRU:
+	info.supports = ipmi_mc_fru_inventory_support;
+	info.mc = NULL;
+	ipmi_domain_iterate_mcs(domain, find_mc, &info);
+	if (!info.mc) {
+	    rv = ENOSYS;
+	    break;
+	}
+	rv = ipmi_domain_fru_alloc(domain, 1, ipmi_mc_get_address(info.mc),
+				   0, 0, 0, ipmi_mc_get_channel(info.mc),
+				   fru_fetched, h, NULL);
+	break;
+
+    case PHASE_SWEEP:
+	if (!h->ids)
+	    ipmi_domain_iterate_entities(domain, add_entity_sensors, h);
+	if (h->num_sensors == 0) {
+	    rv = ENOSYS;
+	    break;
+	}
+	rv = ipmi_domain_get_sensor_readings(domain, h->ids, h->num_sensors,
+					     readings_done, h);
+	break;
+
+    case PHASE_CLOSE:
+	rv = ipmi_domain_close(domain, host_closed, h);
+	break;
+
+    default:
+	rv = EINVAL;
+    }
+
+    if (rv)
+	host_finished(h, rv, &h->start);
+}
+
+static void
+start_phase(enum phase_e next)
+{
+    unsigned int i;
+    host_t       *h;
+    int          rv;
+
+    if (next == PHASE_SWEEP && num_sweeps == 0)
+	next = PHASE_CLOSE;
+    phase = next;
+    if (phase == NUM_PHASES) {
+	done = 1;
+	return;
+    }
+    if ((phase != PHASE_SWEEP) || (sweep == 0))
+	os_hnd->get_monotonic_time(os_hnd, &phases[phase].start);
+
+    /* Count them all first so a host finishing right away doesn't end
+       the phase early. */
+    pending = 1;
+    for (i = 0; i < num_hosts; i++) {
+	h = hosts[i];
+	if (phase == PHASE_UP || (h->open && (!h->failed
+					      || phase == PHASE_CLOSE)))
+	    pending++;
+    }
+
+    for (i = 0; i < num_hosts; i++) {
+	h = hosts[i];
+	if (phase != PHASE_UP && !(h->open && (!h->failed
+					       || phase == PHASE_CLOSE)))
+	    continue;
+	os_hnd->get_monotonic_time(os_hnd, &h->start);
+	if (phase == PHASE_UP) {
+	    start_up(h);
+	} else {
+	    rv = ipmi_domain_pointer_cb(h->domain_id, start_domain_op, h);
+	    if (rv)
+		host_finished(h, rv, &h->start);
+	}
+    }
+
+    /* Drop the extra count. */
+    pending--;
+    if (pending == 0) {
+	struct timeval now;
+
+	os_hnd->get_monotonic_time(os_hnd, &now);
+	phase_done(&now);
+    }
+}
+
+static void
+up_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    unsigned int i;
+
+    if (phase != PHASE_UP)
+	return;
+
+    /* Anything not up yet has failed. */
+    for (i = 0; i < num_hosts; i++) {
+	host_t *h = hosts[i];
+
+	if (!h->open && !h->failed) {
+	    h->failed = 1;
+	    /* Still close it so it goes away. */
+	    h->open = 1;
+	    host_finished(h, ETIMEDOUT, &h->start);
+	}
+    }
+}
+
+/***********************************************************************
+ *
+ * Setup.
+ *
+ **********************************************************************/
+
+static int
+read_hosts(FILE *f, const char *fname)
+{
+    char        buf[MAX_LINE_LEN];
+    char        *argv[MAX_HOST_ARGS];
+    int         argc;
+    int         curr_arg;
+    int         lineno = 0;
+    char        *s, *tok;
+    host_t      *h;
+    host_t      **nhosts;
+    unsigned int max_hosts = 0;
+    int         rv;
+
+    while (fgets(buf, sizeof(buf), f)) {
+	lineno++;
+	s = buf;
+	while (isspace((unsigned char) *s))
+	    s++;
+	if ((*s == '\0') || (*s == '#'))
+	    continue;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+	    return ENOMEM;
+	h->line = strdup(s);
+	if (!h->line) {
+	    free(h);
+	    return ENOMEM;
+	}
+
+	argc = 0;
+	for (tok = strtok(h->line, " \t\r\n");
+	     tok && (argc < MAX_HOST_ARGS);
+	     tok = strtok(NULL, " \t\r\n"))
+	    argv[argc++] = tok;
+	if (argc < 2) {
+	    fprintf(stderr, "%s:%d: No connection parameters\n",
+		    fname, lineno);
+	    free(h->line);
+	    free(h);
+	    return EINVAL;
+	}
+	h->name = argv[0];
+
+	curr_arg = 1;
+	rv = ipmi_parse_args2(&curr_arg, argc, argv, &h->args);
+	if (rv) {
+	    fprintf(stderr, "%s:%d: Error parsing argument %d: %s\n",
+		    fname, lineno, curr_arg, strerror(rv));
+	    free(h->line);
+	    free(h);
+	    return rv;
+	}
+
+	if (num_hosts == max_hosts) {
+	    max_hosts = max_hosts ? max_hosts * 2 : 64;
+	    nhosts = realloc(hosts, max_hosts * sizeof(*hosts));
+	    if (!nhosts)
+		return ENOMEM;
+	    hosts = nhosts;
+	}
+	hosts[num_hosts++] = h;
+    }
+
+    return 0;
+}
+
+static void
+my_vlog(os_handler_t         *handler,
+	const char           *format,
+	enum ipmi_log_type_e log_type,
+	va_list              ap)
+{
+    /* Only the bad things, the output is the results. */
+    if (log_type != IPMI_LOG_SEVERE && log_type != IPMI_LOG_FATAL)
+	return;
+    vfprintf(stderr, format, ap);
+    fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    int            rv;
+    int            curr_arg = 1;
+    const char     *outname = NULL;
+    const char     *hostname;
+    FILE           *f;
+    unsigned int   i;
+    struct timeval tv;
+    long           cpu_start, rss_start, rss_up, sim_cpu_start = -1;
+    long           sim_cpu = -1, sim_rss = -1;
+
+    progname = argv[0];
+
+    while ((curr_arg < argc) && (argv[curr_arg][0] == '-')
+	   && (argv[curr_arg][1] != '\0'))
+    {
+	const char *arg = argv[curr_arg++];
+
+	if (strcmp(arg, "--") == 0)
+	    break;
+	if ((strcmp(arg, "-s") == 0) && (curr_arg < argc)) {
+	    num_sweeps = strtoul(argv[curr_arg++], NULL, 0);
+	} else if ((strcmp(arg, "-t") == 0) && (curr_arg < argc)) {
+	    timeout_secs = strtoul(argv[curr_arg++], NULL, 0);
+	} else if ((strcmp(arg, "-p") == 0) && (curr_arg < argc)) {
+	    sim_pid = strtol(argv[curr_arg++], NULL, 0);
+	} else if ((strcmp(arg, "-o") == 0) && (curr_arg < argc)) {
+	    outname = argv[curr_arg++];
+	} else {
+	    usage();
+	    exit(1);
+	}
+    }
+    if (curr_arg != argc - 1) {
+	usage();
+	exit(1);
+    }
+    hostname = argv[curr_arg];
+
+    os_hnd = ipmi_posix_setup_os_handler();
+    if (!os_hnd) {
+	fprintf(stderr, "Unable to allocate os handler\n");
+	exit(1);
+    }
+    os_hnd->set_log_handler(os_hnd, my_vlog);
+
+    ipmi_init(os_hnd);
+
+    if (strcmp(hostname, "-") == 0) {
+	f = stdin;
+    } else {
+	f = fopen(hostname, "r");
+	if (!f) {
+	    fprintf(stderr, "Unable to open %s: %s\n", hostname,
+		    strerror(errno));
+	    exit(1);
+	}
+    }
+    rv = read_hosts(f, hostname);
+    if (f != stdin)
+	fclose(f);
+    if (rv)
+	exit(1);
+
+    if (outname) {
+	out = fopen(outname, "w");
+	if (!out) {
+	    fprintf(stderr, "Unable to open %s: %s\n", outname,
+		    strerror(errno));
+	    exit(1);
+	}
+    } else {
+	out = stdout;
+    }
+
+    rv = os_hnd->alloc_timer(os_hnd, &timer);
+    if (rv) {
+	fprintf(stderr, "Unable to allocate timer: %s\n", strerror(rv));
+	exit(1);
+    }
+    tv.tv_sec = timeout_secs;
+    tv.tv_usec = 0;
+    os_hnd->start_timer(os_hnd, timer, &tv, up_timeout, NULL);
+
+    cpu_start = self_cpu_us();
+    rss_start = proc_rss_kb("self");
+    if (sim_pid)
+	sim_cpu_start = proc_cpu_us(sim_pid);
+
+    start_phase(PHASE_UP);
+    rss_up = -1;
+    while (!done) {
+	os_hnd->perform_one_op(os_hnd, NULL);
+	/* Take the RSS while all the domains are still open. */
+	if (phase == PHASE_CLOSE && rss_up < 0)
+	    rss_up = proc_rss_kb("self");
+    }
+    os_hnd->stop_timer(os_hnd, timer);
+    os_hnd->free_timer(os_hnd, timer);
+
+    if (sim_pid) {
+	char pidstr[32];
+
+	sim_cpu = proc_cpu_us(sim_pid);
+	if (sim_cpu >= 0 && sim_cpu_start >= 0)
+	    sim_cpu -= sim_cpu_start;
+	else
+	    sim_cpu = -1;
+	snprintf(pidstr, sizeof(pidstr), "%ld", (long) sim_pid);
+	sim_rss = proc_rss_kb(pidstr);
+    }
+
+    out_results(self_cpu_us() - cpu_start,
+		(rss_up >= 0 && rss_start >= 0) ? rss_up - rss_start : -1,
+		sim_cpu, sim_rss);
+
+    if (out != stdout)
+	fclose(out);
+    for (i = 0; i < num_hosts; i++) {
+	free(hosts[i]->ids);
+	free(hosts[i]->line);
+	free(hosts[i]);
+    }
+    free(hosts);
+    for (i = 0; i < NUM_PHASES; i++)
+	free(phases[i].lat);
+
+    os_hnd->free_os_handler(os_hnd);
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# Run ipmi_bench_fleet against a fleet of simulated BMCs.
+#
+# This starts "ipmi_sim -F <count>" with the given config and command
+# files, waits for it to listen, writes a host file with one line per
+# node (node n is on <port> + n), and runs ipmi_bench_fleet on it with
+# the simulator's pid so its CPU and memory use are reported too.  The
+# results (one JSON object) go to standard output, or to the -o file.
+#
+# The config file should have one "addr" line for the first node with
+# the given port, and a user matching the -U and -P options.  The
+# defaults match lanserv/lan.conf with lanserv/ipmisim1.emu.
+#
+# Set IPMI_SIM and IPMI_BENCH_FLEET to use programs that aren't on the
+# path, like the ones in a build tree.
+#
+
+usage() {
+    echo "Usage: $0 [-n <nodes>] [-c <lan.conf>] [-f <command file>]"
+    echo "          [-a <address>] [-p <port>] [-U <user>] [-P <password>]"
+    echo "          [-s <sweeps>] [-t <timeout secs>] [-o <output file>]"
+    exit 1
+}
+
+sim=${IPMI_SIM:-ipmi_sim}
+bench=${IPMI_BENCH_FLEET:-ipmi_bench_fleet}
+
+nodes=16
+conf=lan.conf
+cmdfile=ipmisim1.emu
+addr=localhost
+port=9001
+user=ipmiusr
+pass=test
+benchargs=
+
+while getopts n:c:f:a:p:U:P:s:t:o: opt; do
+    case $opt in
+	n) nodes=$OPTARG ;;
+	c) conf=$OPTARG ;;
+	f) cmdfile=$OPTARG ;;
+	a) addr=$OPTARG ;;
+	p) port=$OPTARG ;;
+	U) user=$OPTARG ;;
+	P) pass=$OPTARG ;;
+	s) benchargs="$benchargs -s $OPTARG" ;;
+	t) benchargs="$benchargs -t $OPTARG" ;;
+	o) benchargs="$benchargs -o $OPTARG" ;;
+	*) usage ;;
+    esac
+done
+
+tmpdir=`mktemp -d` || exit 1
+trap 'rm -rf $tmpdir' EXIT
+
+# Keep any state the simulator writes out of the way.
+$sim -n -s $tmpdir -c $conf -f $cmdfile -F $nodes > $tmpdir/sim.log 2>&1 &
+simpid=$!
+trap 'kill $simpid 2>/dev/null; wait $simpid 2>/dev/null; rm -rf $tmpdir' EXIT
+
+# Wait for the last node to come up.
+last=`expr $port + $nodes - 1`
+tries=0
+until echo "n lan -U $user -P $pass $addr $last" | \
+	$bench -t 2 -s 0 - 2>/dev/null | grep -q '"up":{"done":1'; do
+    if ! kill -0 $simpid 2>/dev/null; then
+	echo "$sim exited:" >&2
+	cat $tmpdir/sim.log >&2
+	exit 1
+    fi
+    tries=`expr $tries + 1`
+    if [ $tries -gt 60 ]; then
+	echo "Timed out waiting for $sim" >&2
+	exit 1
+    fi
+    sleep 1
+done
+
+n=0
+while [ $n -lt $nodes ]; do
+    echo "node$n lan -U $user -P $pass $addr `expr $port + $n`"
+    n=`expr $n + 1`
+done > $tmpdir/hosts
+
+$bench -p $simpid $benchargs $tmpdir/hosts
@@ -37,7 +37,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <ctype.h>
@@ -79,6 +84,52 @@ static bool domain_up;
 static bool delete_events;
 static int debug;
 static int childpid = -1;
+static os_handler_t *os_hnd;
+
+/*
+ * Events can be batched up and written to an append-only file or a
+ * Unix stream socket, the "sink".  Events are formatted the same as
+ * for -f/-k and held in a bounded queue; the queue is written out
+ * once it has sink_batch events or sink_flush_ms after the first
+ * event queued, whichever comes first.  If the queue is full the
+ * event is dropped (and not deleted from the SEL).
+ */
+struct sink_ev {
+    struct sink_ev *next;
+    char *buf;
+    size_t len;
+    ipmi_event_t *event; /* Only kept if deleting events. */
+};
+
+static char *sink_fname;
+static char *sink_sockname;
+static int sink_fd = -1;
+static struct sink_ev *sink_head, *sink_tail;
+static unsigned int sink_count;
+static size_t sink_pos; /* How much of the head has been written. */
+static unsigned int sink_max = 10000;
+static unsigned int sink_batch = 64;
+static unsigned int sink_flush_ms = 100;
+static os_hnd_timer_id_t *sink_timer;
+static bool sink_timer_running;
+static unsigned long long sink_written;
+static unsigned long long sink_dropped;
+static unsigned long long sink_dropped_reported;
+static unsigned long long sink_write_errs;
+
+/*
+ * Filters for running the program.  Each -m is a list of
+ * key=value matches that must all match the event, and the program
+ * is run if any of them match.  A value ending in '*' matches any
+ * value starting with what is before it.
+ */
+struct ev_match {
+    int num;
+    char **keys;
+    char **vals;
+};
+static struct ev_match *matches;
+static int num_matches;
 
 static char *indent_str(const char *instr, const char *indent)
 {
@@ -119,7 +170,9 @@ static void
 usage(void)
 {
     printf("Usage:\n");
-    printf(" %s <domain> <con_parms> [-k] [-i] [-e] [-d] [-b] [-f <filename>] <program> [<parm1> [<parm2> [...]]]\n",
+    printf(" %s <domain> <con_parms> [-k] [-i] [-e] [-d] [-b] [-f <filename>]"
+	   " [-s <socket>] [-m <filter>] [-q <len>] [-n <num>] [-t <ms>]"
+	   " <program> [<parm1> [<parm2> [...]]]\n",
 	   progname);
     printf("<domain> is a name given to locally identify the connection.\n");
     printf("Options are:\n");
@@ -130,8 +183,19 @@ usage(void)
     printf(" -e, --delete-events - Delete each event after processing.\n");
     printf(" -d, --debug - Enable debugging\n");
     printf(" -b, --dont-daemonize - Run the program in foreground.\n");
-    printf(" -f, --outfile - Send the output to the given file instead of\n");;
-    printf("    spawning another program.\n");
+    printf(" -f, --outfile - Append the events to the given file in batches.\n");
+    printf(" -s, --socket - Write the events to the given Unix socket in\n");
+    printf("    batches.\n");
+    printf(" -m, --match <key>=<val>[,<key>=<val>[...]] - Only run the\n");
+    printf("    program for events that have all the given values.  A val\n");
+    printf("    ending in '*' matches by prefix, the key 'type' is the\n");
+    printf("    event type.  May be given more than once.\n");
+    printf(" -q, --queue-len - Events to hold for -f or -s before dropping\n");
+    printf("    them, default 10000.\n");
+    printf(" -n, --batch - Write -f or -s events once this many are queued,\n");
+    printf("    default 64.\n");
+    printf(" -t, --flush-time - Write -f or -s events at most this many\n");
+    printf("    milliseconds after they come in, default 100.\n");
     printf("<con_parms> is:");
     ipmi_parse_args_iter_help(con_usage, NULL);
 }
@@ -181,6 +245,346 @@ newpipe(FILE **retfile)
     return fds[0];
 }
 
+static char *
+format_event(char *type, char **parms1, int num_parms1,
+	     char **parms2, int num_parms2, size_t *rlen)
+{
+    size_t len = strlen(type) + 1 + 9;
+    char *buf;
+    int i, pos;
+
+    for (i = 0; i + 1 < num_parms1; i += 2)
+	len += strlen(parms1[i]) + strlen(parms1[i + 1]) + 2;
+    for (i = 0; i + 1 < num_parms2; i += 2)
+	len += strlen(parms2[i]) + strlen(parms2[i + 1]) + 2;
+
+    buf = malloc(len + 1);
+    if (!buf)
+	return NULL;
+    pos = sprintf(buf, "%s\n", type);
+    for (i = 0; i + 1 < num_parms1; i += 2)
+	pos += sprintf(buf + pos, "%s %s\n", parms1[i], parms1[i + 1]);
+    for (i = 0; i + 1 < num_parms2; i += 2)
+	pos += sprintf(buf + pos, "%s %s\n", parms2[i], parms2[i + 1]);
+    pos += sprintf(buf + pos, "endevent\n");
+    *rlen = pos;
+    return buf;
+}
+
+static void
+sink_free_ev(struct sink_ev *e, bool written)
+{
+    if (e->event) {
+	if (written)
+	    ipmi_event_delete(e->event, NULL, NULL);
+	ipmi_event_free(e->event);
+    }
+    free(e->buf);
+    free(e);
+}
+
+static int
+sink_open(void)
+{
+    static bool failed;
+    struct sockaddr_un addr;
+    int fd;
+
+    if (sink_fname) {
+	fd = open(sink_fname, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd == -1)
+	    goto out_err;
+    } else {
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+	    goto out_err;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, sink_sockname, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+	    close(fd);
+	    goto out_err;
+	}
+	/* Don't let a slow reader hold up the IPMI processing. */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    if (failed)
+	syslog(LOG_NOTICE, "%s: Event output %s is open again", domainname,
+	       sink_fname ? sink_fname : sink_sockname);
+    failed = false;
+    sink_fd = fd;
+    return 0;
+
+ out_err:
+    /* Only log the first failure, we retry on every flush. */
+    if (!failed)
+	syslog(LOG_ERR, "%s: Unable to open event output %s: %s", domainname,
+	       sink_fname ? sink_fname : sink_sockname, strerror(errno));
+    failed = true;
+    return -1;
+}
+
+static void sink_timeout(void *cb_data, os_hnd_timer_id_t *id);
+
+static void
+sink_start_timer(void)
+{
+    struct timeval tv;
+
+    if (sink_timer_running)
+	return;
+    tv.tv_sec = sink_flush_ms / 1000;
+    tv.tv_usec = (sink_flush_ms % 1000) * 1000;
+    if (os_hnd->start_timer(os_hnd, sink_timer, &tv, sink_timeout, NULL) == 0)
+	sink_timer_running = true;
+}
+
+#define SINK_MAX_IOV 64
+
+static void
+sink_flush(void)
+{
+    struct iovec iov[SINK_MAX_IOV];
+    struct sink_ev *e, *done = NULL, **done_tail = &done;
+    unsigned int count;
+    ssize_t rv;
+    size_t left;
+
+    if (sink_timer_running) {
+	os_hnd->stop_timer(os_hnd, sink_timer);
+	sink_timer_running = false;
+    }
+
+    if (!sink_head)
+	return;
+
+    if (sink_fd == -1 && sink_open() == -1)
+	goto out;
+
+    while (sink_head) {
+	count = 0;
+	for (e = sink_head; e && count < SINK_MAX_IOV; e = e->next) {
+	    iov[count].iov_base = e->buf;
+	    iov[count].iov_len = e->len;
+	    if (count == 0) {
+		iov[count].iov_base = e->buf + sink_pos;
+		iov[count].iov_len -= sink_pos;
+	    }
+	    count++;
+	}
+
+	rv = writev(sink_fd, iov, count);
+	if (rv == -1) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    sink_write_errs++;
+	    syslog(LOG_ERR, "%s: Error writing events: %s", domainname,
+		   strerror(errno));
+	    /*
+	     * Reopen on the next try, the reader may have gone away.  A
+	     * new socket reader gets the whole partial event again.
+	     */
+	    close(sink_fd);
+	    sink_fd = -1;
+	    if (sink_sockname)
+		sink_pos = 0;
+	    break;
+	}
+
+	/* Move everything completely written to the done list. */
+	left = rv;
+	while (sink_head && left >= sink_head->len - sink_pos) {
+	    e = sink_head;
+	    left -= e->len - sink_pos;
+	    sink_pos = 0;
+	    sink_head = e->next;
+	    sink_count--;
+	    e->next = NULL;
+	    *done_tail = e;
+	    done_tail = &e->next;
+	    sink_written++;
+	}
+	if (!sink_head)
+	    sink_tail = NULL;
+	sink_pos += left;
+    }
+
+    /*
+     * Make sure a file is on disk before deleting the events from
+     * the SEL.
+     */
+    if (done && sink_fname && sink_fd != -1 && fdatasync(sink_fd) == -1)
+	syslog(LOG_WARNING, "%s: Unable to sync %s: %s", domainname,
+	       sink_fname, strerror(errno));
+    while (done) {
+	e = done;
+	done = e->next;
+	sink_free_ev(e, true);
+    }
+
+ out:
+    if (sink_head)
+	sink_start_timer();
+}
+
+static void
+sink_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    sink_timer_running = false;
+    sink_flush();
+}
+
+static void
+sink_add(char *buf, size_t len, ipmi_event_t *event)
+{
+    struct sink_ev *e;
+
+    e = malloc(sizeof(*e));
+    if (!e) {
+	free(buf);
+	if (event)
+	    ipmi_event_free(event);
+	sink_dropped++;
+	return;
+    }
+    e->next = NULL;
+    e->buf = buf;
+    e->len = len;
+    e->event = event;
+    if (sink_tail)
+	sink_tail->next = e;
+    else
+	sink_head = e;
+    sink_tail = e;
+    sink_count++;
+}
+
+static void
+sink_queue(char *type, ipmi_event_t *event, char **parms, int num_parms,
+	   char **parms2, int num_parms2)
+{
+    char *buf;
+    size_t len;
+
+    if (sink_count >= sink_max) {
+	if (sink_dropped == sink_dropped_reported)
+	    syslog(LOG_WARNING, "%s: Event queue full, dropping events",
+		   domainname);
+	sink_dropped++;
+	return;
+    }
+
+    if (sink_dropped != sink_dropped_reported && sink_count + 1 < sink_max) {
+	/* Tell the reader about the gap. */
+	char ovbuf[200];
+
+	len = snprintf(ovbuf, sizeof(ovbuf),
+		       "overflow\ndropped %llu\ntotal_dropped %llu\n"
+		       "total_written %llu\nwrite_errors %llu\nendevent\n",
+		       sink_dropped - sink_dropped_reported, sink_dropped,
+		       sink_written, sink_write_errs);
+	syslog(LOG_NOTICE, "%s: Dropped %llu events", domainname,
+	       sink_dropped - sink_dropped_reported);
+	sink_dropped_reported = sink_dropped;
+	buf = strdup(ovbuf);
+	if (buf)
+	    sink_add(buf, len, NULL);
+    }
+
+    buf = format_event(type, parms, num_parms, parms2, num_parms2, &len);
+    if (!buf) {
+	sink_dropped++;
+	return;
+    }
+    sink_add(buf, len, (event && delete_events) ? ipmi_event_dup(event) : NULL);
+
+    if (sink_count >= sink_batch)
+	sink_flush();
+    else
+	sink_start_timer();
+}
+
+static bool
+event_matches(char *type, char **parms1, int num_parms1,
+	      char **parms2, int num_parms2)
+{
+    int i, j, k;
+
+    if (num_matches == 0)
+	return true;
+
+    for (i = 0; i < num_matches; i++) {
+	struct ev_match *m = &matches[i];
+
+	for (j = 0; j < m->num; j++) {
+	    char *val = NULL;
+	    size_t len;
+
+	    if (strcmp(m->keys[j], "type") == 0)
+		val = type;
+	    for (k = 0; !val && k + 1 < num_parms1; k += 2) {
+		if (strcmp(m->keys[j], parms1[k]) == 0)
+		    val = parms1[k + 1];
+	    }
+	    for (k = 0; !val && k + 1 < num_parms2; k += 2) {
+		if (strcmp(m->keys[j], parms2[k]) == 0)
+		    val = parms2[k + 1];
+	    }
+	    if (!val)
+		break;
+	    len = strlen(m->vals[j]);
+	    if (len > 0 && m->vals[j][len - 1] == '*') {
+		if (strncmp(val, m->vals[j], len - 1) != 0)
+		    break;
+	    } else if (strcmp(val, m->vals[j]) != 0) {
+		break;
+	    }
+	}
+	if (j == m->num)
+	    return true;
+    }
+    return false;
+}
+
+static int
+add_match(char *str)
+{
+    struct ev_match *m;
+    char *s, *tok, *eq;
+    int n = 1;
+
+    for (s = str; *s; s++) {
+	if (*s == ',')
+	    n++;
+    }
+
+    m = realloc(matches, (num_matches + 1) * sizeof(*m));
+    if (!m)
+	return ENOMEM;
+    matches = m;
+    m = &matches[num_matches];
+    m->num = 0;
+    m->keys = malloc(n * sizeof(char *));
+    m->vals = malloc(n * sizeof(char *));
+    if (!m->keys || !m->vals)
+	return ENOMEM;
+
+    for (tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+	eq = strchr(tok, '=');
+	if (!eq)
+	    return EINVAL;
+	*eq = '\0';
+	m->keys[m->num] = tok;
+	m->vals[m->num] = eq + 1;
+	m->num++;
+    }
+    num_matches++;
+    return 0;
+}
+
 static void
 send_event_to_prog(char         *type,
 		   ipmi_event_t *event,
@@ -226,6 +630,18 @@ send_event_to_prog(char         *type,
     if (!domain_up)
 	goto out;
 
+    if (sink_fname || sink_sockname) {
+	/* The sink deletes the event once it is written. */
+	sink_queue(type, event, parms, num_parms, parms2, num_parms2);
+	if (num_prog == 0)
+	    return;
+	if (!event_matches(type, parms, num_parms, parms2, num_parms2))
+	    return;
+	event = NULL;
+    } else if (!event_matches(type, parms, num_parms, parms2, num_parms2)) {
+	return;
+    }
+
     if (outfile) {
 	if (send_parms_to_file(type, parms, num_parms, parms2, num_parms2))
 	    /* The remote end is broken, give up. */
@@ -545,8 +961,6 @@ setup_done(ipmi_domain_t *domain,
     }
 }
 
-static os_handler_t *os_hnd;
-
 static void
 handle_openipmi_vlog(os_handler_t         *handler,
 		     const char           *format,
@@ -594,6 +1008,27 @@ fully_up(ipmi_domain_t *domain, void *cb_data)
     domain_up = 1;
 }
 
+/* Get the non-zero number following the option at *curr_arg - 1. */
+static unsigned int
+get_uint_arg(int argc, char *argv[], int *curr_arg)
+{
+    char *opt = argv[*curr_arg - 1];
+    char *end;
+    unsigned long val;
+
+    if (*curr_arg == argc) {
+	fprintf(stderr, "%s given, but no value given\n", opt);
+	exit(1);
+    }
+    val = strtoul(argv[*curr_arg], &end, 0);
+    if (*end != '\0' || val == 0) {
+	fprintf(stderr, "Invalid value for %s: %s\n", opt, argv[*curr_arg]);
+	exit(1);
+    }
+    (*curr_arg)++;
+    return val;
+}
+
 static void
 sigchld_handler(int sig)
 {
@@ -610,7 +1045,6 @@ main(int argc, char *argv[])
     ipmi_con_t  *con;
     bool        execnow = false;
     bool        daemonize = true;
-    char        *outfname = NULL;
     int         syslog_options = 0;
 
     if (argc < 2) {
@@ -672,9 +1106,37 @@ main(int argc, char *argv[])
 		fprintf(stderr, "-f given, but no filename given\n");
 		exit(1);
 	    }
-	    outfname = argv[curr_arg];
+	    sink_fname = argv[curr_arg];
 	    curr_arg++;
-	} else {
+	} else if ((strcmp(argv[a], "-s") == 0) ||
+		   (strcmp(argv[a], "--socket") == 0)) {
+	    if (curr_arg == argc) {
+		fprintf(stderr, "-s given, but no socket given\n");
+		exit(1);
+	    }
+	    sink_sockname = argv[curr_arg];
+	    curr_arg++;
+	} else if ((strcmp(argv[a], "-m") == 0) ||
+		   (strcmp(argv[a], "--match") == 0)) {
+	    if (curr_arg == argc) {
+		fprintf(stderr, "-m given, but no filter given\n");
+		exit(1);
+	    }
+	    if (add_match(argv[curr_arg])) {
+		fprintf(stderr, "Invalid filter: %s\n", argv[curr_arg]);
+		exit(1);
+	    }
+	    curr_arg++;
+	} else if ((strcmp(argv[a], "-q") == 0) ||
+		   (strcmp(argv[a], "--queue-len") == 0))
+	    sink_max = get_uint_arg(argc, argv, &curr_arg);
+	else if ((strcmp(argv[a], "-n") == 0) ||
+		 (strcmp(argv[a], "--batch") == 0))
+	    sink_batch = get_uint_arg(argc, argv, &curr_arg);
+	else if ((strcmp(argv[a], "-t") == 0) ||
+		 (strcmp(argv[a], "--flush-time") == 0))
+	    sink_flush_ms = get_uint_arg(argc, argv, &curr_arg);
+	else {
 	    fprintf(stderr, "Unknown parameter: %s\n", argv[a]);
 	    exit(1);
 	}
@@ -702,22 +1164,31 @@ main(int argc, char *argv[])
 	exit(1);
     }
 
-    if (outfname) {
-	if (curr_arg != argc || execnow) {
-	    fprintf(stderr, "You can't specify a program or -k"
-		    " along with -f\n");
+    if (sink_fname && sink_sockname) {
+	fprintf(stderr, "You can't specify both -f and -s\n");
+	exit(1);
+    }
+    if (sink_fname || sink_sockname) {
+	rv = os_hnd->alloc_timer(os_hnd, &sink_timer);
+	if (rv) {
+	    STDERR_IPMIERR(rv, "Unable to allocate event output timer");
 	    exit(1);
 	}
-	outfile = fopen(outfname, "a");
-	if (!outfile) {
-	    fprintf(stderr, "Unable to output output file %s: %s\n", outfname,
+	if (sink_open() == -1 && sink_fname) {
+	    fprintf(stderr, "Unable to open output file %s: %s\n", sink_fname,
 		    strerror(errno));
 	    exit(1);
 	}
+	/* A socket reader going away shouldn't kill us. */
+	signal(SIGPIPE, SIG_IGN);
     } else if (curr_arg == argc) {
 	fprintf(stderr, "No program given to execute on an IPMI event\n");
 	exit(1);
     }
+    if (curr_arg == argc && (execnow || num_matches)) {
+	fprintf(stderr, "-k and -m require a program\n");
+	exit(1);
+    }
 
     if (execnow) {
 	/* Only watch for child processes if we keep it around. */
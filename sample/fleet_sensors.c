@@ -0,0 +1,743 @@
+/*
+ * fleet_sensors.c
+ *
+ * Dump the threshold sensor readings of many BMCs at once.
+ *
+ * Author: Corey Minyard <minyard@acm.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * This is like dump_sensors, but takes a file with a list of hosts
+ * and runs them all from one OS handler, with at most a given number
+ * of domains open at a time.  Each line of the host file is a name
+ * for the host followed by its connection parameters, like:
+ *
+ *   node17 lan -U admin -P secret 10.0.0.17
+ *
+ * Blank lines and lines starting with '#' are ignored.  Once a
+ * domain is up, its threshold sensors are all read with one
+ * ipmi_domain_get_sensor_readings() call and the domain is closed.
+ * The results are written as they come in, as CSV or as one JSON
+ * object per line.  Every host gets a "host" record with its status
+ * and how long it took to connect, read, and in total.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_posix.h>
+
+#define MAX_LINE_LEN	1024
+#define MAX_HOST_ARGS	64
+
+enum host_state_e { HOST_WAITING, HOST_CONNECTING, HOST_READING,
+		    HOST_CLOSING, HOST_DONE };
+
+typedef struct fleet_sensor_s
+{
+    char       entity[16];
+    char       name[33];
+    const char *units;
+} fleet_sensor_t;
+
+typedef struct host_s
+{
+    char              *name;
+    char              *line;
+    ipmi_args_t       *args;
+    enum host_state_e state;
+    int               err;
+    ipmi_domain_id_t  domain_id;
+    os_hnd_timer_id_t *timer;
+    int               timer_running;
+
+    ipmi_sensor_id_t  *ids;
+    fleet_sensor_t    *sensors;
+    unsigned int      num_sensors;
+    unsigned int      max_sensors;
+    unsigned int      num_read;
+
+    struct timeval    start;
+    struct timeval    up;
+    struct timeval    read;
+} host_t;
+
+static const char   *progname;
+static os_handler_t *os_hnd;
+static FILE         *out;
+static int          json_out;
+static unsigned int max_active = 16;
+static unsigned int timeout_secs = 60;
+
+static host_t       **hosts;
+static unsigned int num_hosts;
+static unsigned int next_host;
+static unsigned int active;
+static int          done;
+
+static void con_usage(const char *name, const char *help, void *cb_data)
+{
+    fprintf(stderr, "\n%s%s", name, help);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, " %s [-j] [-c <max parallel>] [-t <timeout secs>]"
+	    " [-o <output file>] <host file>\n", progname);
+    fprintf(stderr, " Output is CSV unless -j is given, then it is one\n"
+	    " JSON object per line.  <host file> may be - for stdin.\n"
+	    " Each line of <host file> is a name followed by <con_parms>,"
+	    "\n where <con_parms> is one of:");
+    ipmi_parse_args_iter_help(con_usage, NULL);
+    fprintf(stderr, "\n");
+}
+
+static long
+ms_between(struct timeval *start, struct timeval *end)
+{
+    return (((end->tv_sec - start->tv_sec) * 1000)
+	    + ((end->tv_usec - start->tv_usec) / 1000));
+}
+
+/***********************************************************************
+ *
+ * Output.  Strings can come from the BMC, so they are all escaped.
+ *
+ **********************************************************************/
+
+static void
+out_csv_str(const char *str)
+{
+    if (!strpbrk(str, ",\"\r\n")) {
+	fputs(str, out);
+	return;
+    }
+    putc('"', out);
+    for (; *str; str++) {
+	if (*str == '"')
+	    putc('"', out);
+	putc(*str, out);
+    }
+    putc('"', out);
+}
+
+static void
+out_json_str(const char *str)
+{
+    const unsigned char *c = (const unsigned char *) str;
+
+    putc('"', out);
+    for (; *c; c++) {
+	if (*c == '"' || *c == '\\') {
+	    putc('\\', out);
+	    putc(*c, out);
+	} else if (*c < 0x20 || *c >= 0x7f) {
+	    fprintf(out, "\\u%4.4x", *c);
+	} else {
+	    putc(*c, out);
+	}
+    }
+    putc('"', out);
+}
+
+static void
+out_header(void)
+{
+    if (!json_out)
+	fprintf(out, "record,host,entity,sensor,value,units,error,"
+		"connect_ms,read_ms,total_ms\n");
+}
+
+static void
+out_sensor(host_t                      *h,
+	   fleet_sensor_t              *s,
+	   ipmi_sensor_batch_reading_t *r)
+{
+    char value[32];
+    char errstr[64];
+
+    value[0] = '\0';
+    errstr[0] = '\0';
+    if (r->err)
+	ipmi_get_error_string(r->err, errstr, sizeof(errstr));
+    else if (r->value_present == IPMI_BOTH_VALUES_PRESENT)
+	snprintf(value, sizeof(value), "%g", r->val);
+    else if (r->value_present == IPMI_RAW_VALUE_PRESENT)
+	snprintf(value, sizeof(value), "raw:%u", r->raw_value);
+
+    if (json_out) {
+	fputs("{\"record\":\"sensor\",\"host\":", out);
+	out_json_str(h->name);
+	fputs(",\"entity\":", out);
+	out_json_str(s->entity);
+	fputs(",\"sensor\":", out);
+	out_json_str(s->name);
+	if (r->err) {
+	    fputs(",\"error\":", out);
+	    out_json_str(errstr);
+	} else if (r->value_present == IPMI_BOTH_VALUES_PRESENT) {
+	    /* JSON has no inf or nan. */
+	    fprintf(out, ",\"value\":%s,\"units\":",
+		    isfinite(r->val) ? value : "null");
+	    out_json_str(s->units);
+	} else if (r->value_present == IPMI_RAW_VALUE_PRESENT) {
+	    fprintf(out, ",\"raw\":%u", r->raw_value);
+	}
+	fputs("}\n", out);
+    } else {
+	fputs("sensor,", out);
+	out_csv_str(h->name);
+	putc(',', out);
+	out_csv_str(s->entity);
+	putc(',', out);
+	out_csv_str(s->name);
+	fprintf(out, ",%s,", value);
+	if (!r->err && r->value_present == IPMI_BOTH_VALUES_PRESENT)
+	    out_csv_str(s->units);
+	putc(',', out);
+	out_csv_str(errstr);
+	fputs(",,,\n", out);
+    }
+}
+
+static void
+out_host(host_t *h, struct timeval *end)
+{
+    char errstr[64];
+    long connect_ms = -1, read_ms = -1;
+
+    errstr[0] = '\0';
+    if (h->err)
+	ipmi_get_error_string(h->err, errstr, sizeof(errstr));
+    if (h->up.tv_sec || h->up.tv_usec) {
+	connect_ms = ms_between(&h->start, &h->up);
+	if (h->read.tv_sec || h->read.tv_usec)
+	    read_ms = ms_between(&h->up, &h->read);
+    }
+
+    if (json_out) {
+	fputs("{\"record\":\"host\",\"host\":", out);
+	out_json_str(h->name);
+	fprintf(out, ",\"sensors\":%u", h->num_read);
+	if (h->err) {
+	    fputs(",\"error\":", out);
+	    out_json_str(errstr);
+	}
+	if (connect_ms >= 0)
+	    fprintf(out, ",\"connect_ms\":%ld", connect_ms);
+	if (read_ms >= 0)
+	    fprintf(out, ",\"read_ms\":%ld", read_ms);
+	fprintf(out, ",\"total_ms\":%ld}\n", ms_between(&h->start, end));
+    } else {
+	fputs("host,", out);
+	out_csv_str(h->name);
+	fputs(",,,,,", out);
+	out_csv_str(errstr);
+	putc(',', out);
+	if (connect_ms >= 0)
+	    fprintf(out, "%ld", connect_ms);
+	putc(',', out);
+	if (read_ms >= 0)
+	    fprintf(out, "%ld", read_ms);
+	fprintf(out, ",%ld\n", ms_between(&h->start, end));
+    }
+    fflush(out);
+}
+
+/***********************************************************************
+ *
+ * Per-host processing.
+ *
+ **********************************************************************/
+
+static void start_hosts(void);
+
+static void
+host_done(host_t *h)
+{
+    struct timeval now;
+
+    os_hnd->get_monotonic_time(os_hnd, &now);
+    out_host(h, &now);
+
+    h->state = HOST_DONE;
+    if (h->timer) {
+	os_hnd->free_timer(os_hnd, h->timer);
+	h->timer = NULL;
+    }
+    if (h->ids)
+	free(h->ids);
+    if (h->sensors)
+	free(h->sensors);
+    h->ids = NULL;
+    h->sensors = NULL;
+
+    active--;
+    start_hosts();
+}
+
+static void
+host_closed(void *cb_data)
+{
+    host_done(cb_data);
+}
+
+static void
+close_host(ipmi_domain_t *domain, host_t *h)
+{
+    int rv;
+
+    h->state = HOST_CLOSING;
+    if (h->timer_running) {
+	os_hnd->stop_timer(os_hnd, h->timer);
+	h->timer_running = 0;
+    }
+    rv = ipmi_domain_close(domain, host_closed, h);
+    if (rv) {
+	if (!h->err)
+	    h->err = rv;
+	host_done(h);
+    }
+}
+
+static void
+timeout_close(ipmi_domain_t *domain, void *cb_data)
+{
+    close_host(domain, cb_data);
+}
+
+static void
+host_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    host_t *h = cb_data;
+    int    rv;
+
+    h->timer_running = 0;
+    if ((h->state != HOST_CONNECTING) && (h->state != HOST_READING))
+	return;
+
+    h->err = ETIMEDOUT;
+    rv = ipmi_domain_pointer_cb(h->domain_id, timeout_close, h);
+    if (rv)
+	host_done(h);
+}
+
+static void
+readings_done(ipmi_domain_t               *domain,
+	      ipmi_sensor_batch_reading_t *readings,
+	      unsigned int                count,
+	      void                        *cb_data)
+{
+    host_t       *h = cb_data;
+    unsigned int i;
+
+    os_hnd->get_monotonic_time(os_hnd, &h->read);
+    for (i=0; i<count; i++)
+	out_sensor(h, &h->sensors[i], &readings[i]);
+    h->num_read = count;
+
+    /* If we timed out while reading, the close is already going. */
+    if (h->state != HOST_READING)
+	return;
+    if (domain)
+	close_host(domain, h);
+    else
+	host_done(h);
+}
+
+static void
+add_sensor(ipmi_entity_t *entity, ipmi_sensor_t *sensor, void *cb_data)
+{
+    host_t         *h = cb_data;
+    fleet_sensor_t *s;
+
+    if (ipmi_sensor_get_event_reading_type(sensor)
+	!= IPMI_EVENT_READING_TYPE_THRESHOLD)
+	return;
+    if (!ipmi_sensor_get_is_readable(sensor))
+	return;
+
+    if (h->num_sensors == h->max_sensors) {
+	unsigned int     nmax = h->max_sensors ? h->max_sensors * 2 : 32;
+	ipmi_sensor_id_t *ids;
+	fleet_sensor_t   *sensors;
+
+	ids = realloc(h->ids, nmax * sizeof(*ids));
+	if (!ids)
+	    return;
+	h->ids = ids;
+	sensors = realloc(h->sensors, nmax * sizeof(*sensors));
+	if (!sensors)
+	    return;
+	h->sensors = sensors;
+	h->max_sensors = nmax;
+    }
+
+    s = &h->sensors[h->num_sensors];
+    snprintf(s->entity, sizeof(s->entity), "%d.%d",
+	     ipmi_entity_get_entity_id(entity),
+	     ipmi_entity_get_entity_instance(entity));
+    ipmi_sensor_get_id(sensor, s->name, sizeof(s->name));
+    s->units = ipmi_sensor_get_base_unit_string(sensor);
+    h->ids[h->num_sensors] = ipmi_sensor_convert_to_id(sensor);
+    h->num_sensors++;
+}
+
+static void
+add_entity_sensors(ipmi_entity_t *entity, void *cb_data)
+{
+    ipmi_entity_iterate_sensors(entity, add_sensor, cb_data);
+}
+
+static void
+domain_up(ipmi_domain_t *domain, void *cb_data)
+{
+    host_t *h = cb_data;
+    int    rv;
+
+    if (h->state != HOST_CONNECTING)
+	return;
+
+    os_hnd->get_monotonic_time(os_hnd, &h->up);
+    h->state = HOST_READING;
+    ipmi_domain_iterate_entities(domain, add_entity_sensors, h);
+    if (h->num_sensors == 0) {
+	close_host(domain, h);
+	return;
+    }
+
+    rv = ipmi_domain_get_sensor_readings(domain, h->ids, h->num_sensors,
+					 readings_done, h);
+    if (rv) {
+	h->err = rv;
+	close_host(domain, h);
+    }
+}
+
+static void
+start_host(host_t *h)
+{
+    ipmi_con_t         *con;
+    ipmi_open_option_t options[6];
+    struct timeval     tv;
+    int                rv;
+
+    active++;
+    os_hnd->get_monotonic_time(os_hnd, &h->start);
+    h->state = HOST_CONNECTING;
+
+    rv = ipmi_args_setup_con(h->args, os_hnd, NULL, &con);
+    ipmi_free_args(h->args);
+    h->args = NULL;
+    if (rv)
+	goto out_err;
+
+    rv = os_hnd->alloc_timer(os_hnd, &h->timer);
+    if (rv) {
+	con->close_connection(con);
+	goto out_err;
+    }
+
+    /* Only get what we need to read the sensors, and don't touch the
+       BMC's configuration. */
+    options[0].option = IPMI_OPEN_OPTION_ALL;
+    options[0].ival = 0;
+    options[1].option = IPMI_OPEN_OPTION_SDRS;
+    options[1].ival = 1;
+    options[2].option = IPMI_OPEN_OPTION_IPMB_SCAN;
+    options[2].ival = 0;
+    options[3].option = IPMI_OPEN_OPTION_OEM_INIT;
+    options[3].ival = 1;
+    options[4].option = IPMI_OPEN_OPTION_SET_EVENT_RCVR;
+    options[4].ival = 0;
+    options[5].option = IPMI_OPEN_OPTION_SET_SEL_TIME;
+    options[5].ival = 0;
+
+    rv = ipmi_open_domain(h->name, &con, 1, NULL, NULL, domain_up, h,
+			  options, 6, &h->domain_id);
+    if (rv) {
+	con->close_connection(con);
+	goto out_err;
+    }
+
+    tv.tv_sec = timeout_secs;
+    tv.tv_usec = 0;
+    rv = os_hnd->start_timer(os_hnd, h->timer, &tv, host_timeout, h);
+    if (!rv)
+	h->timer_running = 1;
+    return;
+
+ out_err:
+    h->err = rv;
+    host_done(h);
+}
+
+static void
+start_hosts(void)
+{
+    static int starting = 0;
+
+    /* host_done() calls this, and it may be called from start_host()
+       if the start fails.  The loop below will pick that up. */
+    if (starting)
+	return;
+    starting = 1;
+    while ((active < max_active) && (next_host < num_hosts))
+	start_host(hosts[next_host++]);
+    starting = 0;
+
+    if ((active == 0) && (next_host == num_hosts))
+	done = 1;
+}
+
+/***********************************************************************
+ *
+ * Setup.
+ *
+ **********************************************************************/
+
+static int
+read_hosts(FILE *f, const char *fname)
+{
+    char        buf[MAX_LINE_LEN];
+    char        *argv[MAX_HOST_ARGS];
+    int         argc;
+    int         curr_arg;
+    int         lineno = 0;
+    char        *s, *tok;
+    host_t      *h;
+    host_t      **nhosts;
+    unsigned int max_hosts = 0;
+    int         rv;
+
+    while (fgets(buf, sizeof(buf), f)) {
+	lineno++;
+	s = buf;
+	while (isspace((unsigned char) *s))
+	    s++;
+	if ((*s == '\0') || (*s == '#'))
+	    continue;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+	    return ENOMEM;
+	h->line = strdup(s);
+	if (!h->line) {
+	    free(h);
+	    return ENOMEM;
+	}
+
+	argc = 0;
+	for (tok = strtok(h->line, " \t\r\n");
+	     tok && (argc < MAX_HOST_ARGS);
+	     tok = strtok(NULL, " \t\r\n"))
+	    argv[argc++] = tok;
+	if (argc < 2) {
+	    fprintf(stderr, "%s:%d: No connection parameters\n",
+		    fname, lineno);
+	    free(h->line);
+	    free(h);
+	    return EINVAL;
+	}
+	h->name = argv[0];
+
+	curr_arg = 1;
+	rv = ipmi_parse_args2(&curr_arg, argc, argv, &h->args);
+	if (rv) {
+	    fprintf(stderr, "%s:%d: Error parsing argument %d: %s\n",
+		    fname, lineno, curr_arg, strerror(rv));
+	    free(h->line);
+	    free(h);
+	    return rv;
+	}
+
+	if (num_hosts == max_hosts) {
+	    max_hosts = max_hosts ? max_hosts * 2 : 64;
+	    nhosts = realloc(hosts, max_hosts * sizeof(*hosts));
+	    if (!nhosts)
+		return ENOMEM;
+	    hosts = nhosts;
+	}
+	hosts[num_hosts++] = h;
+    }
+
+    return 0;
+}
+
+static void
+my_vlog(os_handler_t         *handler,
+	const char           *format,
+	enum ipmi_log_type_e log_type,
+	va_list              ap)
+{
+    int do_nl = 1;
+
+    /* The output may be going to stdout, so logs go to stderr. */
+    switch(log_type)
+    {
+	case IPMI_LOG_INFO:
+	    fprintf(stderr, "INFO: ");
+	    break;
+
+	case IPMI_LOG_WARNING:
+	    fprintf(stderr, "WARN: ");
+	    break;
+
+	case IPMI_LOG_SEVERE:
+	    fprintf(stderr, "SEVR: ");
+	    break;
+
+	case IPMI_LOG_FATAL:
+	    fprintf(stderr, "FATL: ");
+	    break;
+
+	case IPMI_LOG_ERR_INFO:
+	    fprintf(stderr, "EINF: ");
+	    break;
+
+	case IPMI_LOG_DEBUG_START:
+	    do_nl = 0;
+	    /* FALLTHROUGH */
+	case IPMI_LOG_DEBUG:
+	    fprintf(stderr, "DEBG: ");
+	    break;
+
+	case IPMI_LOG_DEBUG_CONT:
+	    do_nl = 0;
+	    /* FALLTHROUGH */
+	case IPMI_LOG_DEBUG_END:
+	    break;
+    }
+
+    vfprintf(stderr, format, ap);
+
+    if (do_nl)
+	fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    int          rv;
+    int          curr_arg = 1;
+    const char   *outname = NULL;
+    const char   *hostname;
+    FILE         *f;
+    unsigned int i;
+
+    progname = argv[0];
+
+    while ((curr_arg < argc) && (argv[curr_arg][0] == '-')
+	   && (argv[curr_arg][1] != '\0'))
+    {
+	const char *arg = argv[curr_arg++];
+
+	if (strcmp(arg, "--") == 0)
+	    break;
+	if (strcmp(arg, "-j") == 0) {
+	    json_out = 1;
+	} else if ((strcmp(arg, "-c") == 0) && (curr_arg < argc)) {
+	    max_active = strtoul(argv[curr_arg++], NULL, 0);
+	    if (max_active == 0)
+		max_active = 1;
+	} else if ((strcmp(arg, "-t") == 0) && (curr_arg < argc)) {
+	    timeout_secs = strtoul(argv[curr_arg++], NULL, 0);
+	} else if ((strcmp(arg, "-o") == 0) && (curr_arg < argc)) {
+	    outname = argv[curr_arg++];
+	} else {
+	    usage();
+	    exit(1);
+	}
+    }
+    if (curr_arg != argc - 1) {
+	usage();
+	exit(1);
+    }
+    hostname = argv[curr_arg];
+
+    /* OS handler allocated first. */
+    os_hnd = ipmi_posix_setup_os_handler();
+    if (!os_hnd) {
+	fprintf(stderr, "ipmi_smi_setup_con: Unable to allocate os handler\n");
+	exit(1);
+    }
+    os_hnd->set_log_handler(os_hnd, my_vlog);
+
+    /* Initialize the OpenIPMI library. */
+    ipmi_init(os_hnd);
+
+    if (strcmp(hostname, "-") == 0) {
+	f = stdin;
+    } else {
+	f = fopen(hostname, "r");
+	if (!f) {
+	    fprintf(stderr, "Unable to open %s: %s\n", hostname,
+		    strerror(errno));
+	    exit(1);
+	}
+    }
+    rv = read_hosts(f, hostname);
+    if (f != stdin)
+	fclose(f);
+    if (rv)
+	exit(1);
+
+    if (outname) {
+	out = fopen(outname, "w");
+	if (!out) {
+	    fprintf(stderr, "Unable to open %s: %s\n", outname,
+		    strerror(errno));
+	    exit(1);
+	}
+    } else {
+	out = stdout;
+    }
+
+    out_header();
+    start_hosts();
+    while (!done)
+	os_hnd->perform_one_op(os_hnd, NULL);
+
+    if (out != stdout)
+	fclose(out);
+    for (i=0; i<num_hosts; i++) {
+	free(hosts[i]->line);
+	free(hosts[i]);
+    }
+    free(hosts);
+
+    os_hnd->free_os_handler(os_hnd);
+
+    return 0;
+}
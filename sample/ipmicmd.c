@@ -47,6 +47,7 @@
 #include <string.h>
 
 #include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_err.h>
 #include <OpenIPMI/ipmi_lan.h>
 #include <OpenIPMI/ipmi_smi.h>
 #include <OpenIPMI/ipmi_auth.h>
@@ -68,6 +69,9 @@ selector_t *sel;
 os_handler_t *os_hnd;
 static ipmi_con_t *con;
 static int continue_operation = 1;
+static int batch;
+
+static void batch_close(void);
 
 /* We cobbled everything in the next section together to provide the
    things that the low-level handlers need. */
@@ -94,6 +98,8 @@ ipmi_read_unlock()
 static void
 leave(int ret)
 {
+    if (batch)
+	batch_close();
     if (con && con->close_connection) {
 	con->close_connection(con);
 	con = NULL;
@@ -122,6 +128,13 @@ void con_usage(const char *name, const char *help, void *cb_data)
 void usage(void)
 {
     printf("%s [-k <command>] [-v] <con_parms>\n", progname);
+    printf("%s -T <target file> [-n <max outstanding>]\n", progname);
+    printf("With -T, each line of <target file> is a name followed by its\n"
+	   "<con_parms>.  Lines of \"<name> <netfn> <cmd> [<data> ...]\"\n"
+	   "(in hex) are read from stdin and sent to the named target's\n"
+	   "BMC, with up to <max outstanding> (default 64) in progress at\n"
+	   "once.  Each response is printed as it comes in as\n"
+	   "\"<name> <line> <netfn> <cmd> <ms>ms: <data ...>\".\n");
     printf("Where <con_parms> is one of:");
     ipmi_parse_args_iter_help(con_usage, NULL);
 }
@@ -578,6 +591,378 @@ process_input_line(char *buf)
     return(rv);
 }
 
+/*
+ * Batch mode.  Connections to all the targets are started up front,
+ * then commands are read from stdin and sent to their target as they
+ * come in.  Commands for a target that isn't up yet are held until
+ * it is.  Responses are printed as they arrive, and reading stdin is
+ * paused while batch_max commands are outstanding.
+ */
+#define BATCH_HASH_SIZE 1024
+
+typedef struct batch_cmd_s batch_cmd_t;
+
+typedef struct batch_target_s
+{
+    char                  *name;
+    char                  *line;
+    ipmi_args_t           *args;
+    ipmi_con_t            *con;
+    int                   up;
+    int                   failed;
+    batch_cmd_t           *pend_head, *pend_tail;
+    struct batch_target_s *hash_next;
+} batch_target_t;
+
+struct batch_cmd_s
+{
+    batch_target_t *t;
+    unsigned int   lineno;
+    ipmi_msg_t     msg;
+    unsigned char  data[MAX_IPMI_DATA_SIZE];
+    struct timeval start;
+    batch_cmd_t    *next;
+};
+
+static batch_target_t *batch_targets[BATCH_HASH_SIZE];
+static unsigned int batch_max = 64;
+static unsigned int batch_outstanding;
+static unsigned int batch_lineno;
+static unsigned int batch_sent, batch_errs;
+static int batch_input_done;
+static int batch_input_paused;
+static struct timeval batch_start;
+
+static unsigned int
+batch_hash(const char *name)
+{
+    unsigned int h = 5381;
+
+    while (*name)
+	h = (h * 33) + (unsigned char) *name++;
+    return h % BATCH_HASH_SIZE;
+}
+
+static batch_target_t *
+batch_find_target(const char *name)
+{
+    batch_target_t *t = batch_targets[batch_hash(name)];
+
+    while (t && strcmp(t->name, name) != 0)
+	t = t->hash_next;
+    return t;
+}
+
+static long
+batch_usec_since(struct timeval *start)
+{
+    struct timeval now;
+
+    os_hnd->get_monotonic_time(os_hnd, &now);
+    return (((now.tv_sec - start->tv_sec) * 1000000)
+	    + (now.tv_usec - start->tv_usec));
+}
+
+static void
+batch_check_done(void)
+{
+    if (batch_input_paused && batch_outstanding < batch_max) {
+	batch_input_paused = 0;
+	sel_set_fd_read_handler(sel, 0, SEL_FD_HANDLER_ENABLED);
+    }
+    if (batch_input_done && batch_outstanding == 0)
+	continue_operation = 0;
+}
+
+static void
+batch_cmd_err(batch_cmd_t *cmd, int err)
+{
+    char errstr[64];
+
+    ipmi_get_error_string(err, errstr, sizeof(errstr));
+    printf("%s %u %2.2x %2.2x error: %s\n", cmd->t->name, cmd->lineno,
+	   cmd->msg.netfn | 1, cmd->msg.cmd, errstr);
+    fflush(stdout);
+    batch_errs++;
+    free(cmd);
+    batch_outstanding--;
+    batch_check_done();
+}
+
+static int
+batch_rsp_handler(ipmi_con_t *ipmi, ipmi_msgi_t *rspi)
+{
+    batch_cmd_t  *cmd = rspi->data1;
+    long         usec = batch_usec_since(&cmd->start);
+    unsigned int i;
+
+    printf("%s %u %2.2x %2.2x %ld.%3.3ldms:", cmd->t->name, cmd->lineno,
+	   rspi->msg.netfn, rspi->msg.cmd, usec / 1000, usec % 1000);
+    for (i=0; i<rspi->msg.data_len; i++)
+	printf(" %2.2x", rspi->msg.data[i]);
+    printf("\n");
+    fflush(stdout);
+    if (rspi->msg.data_len < 1 || rspi->msg.data[0] != 0)
+	batch_errs++;
+
+    free(cmd);
+    batch_outstanding--;
+    batch_check_done();
+    return IPMI_MSG_ITEM_NOT_USED;
+}
+
+static void
+batch_send(batch_cmd_t *cmd)
+{
+    struct ipmi_system_interface_addr si;
+    ipmi_msgi_t                       *rspi;
+    int                               rv;
+
+    si.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
+    si.channel = IPMI_BMC_CHANNEL;
+    si.lun = 0;
+
+    rspi = ipmi_alloc_msg_item();
+    if (!rspi) {
+	batch_cmd_err(cmd, ENOMEM);
+	return;
+    }
+    rspi->data1 = cmd;
+    batch_sent++;
+    os_hnd->get_monotonic_time(os_hnd, &cmd->start);
+    rv = cmd->t->con->send_command(cmd->t->con, (ipmi_addr_t *) &si,
+				   sizeof(si), &cmd->msg, batch_rsp_handler,
+				   rspi);
+    if (rv) {
+	ipmi_free_msg_item(rspi);
+	batch_cmd_err(cmd, rv);
+    }
+}
+
+static void
+batch_con_changed(ipmi_con_t   *ipmi,
+		  int          err,
+		  unsigned int port_num,
+		  int          still_connected,
+		  void         *cb_data)
+{
+    batch_target_t *t = cb_data;
+    batch_cmd_t    *cmd;
+
+    t->up = still_connected;
+    if (err && !still_connected) {
+	char errstr[64];
+
+	ipmi_get_error_string(err, errstr, sizeof(errstr));
+	fprintf(stderr, "%s: Connection failed: %s\n", t->name, errstr);
+	t->failed = err;
+    } else if (still_connected) {
+	t->failed = 0;
+    }
+
+    /* Send or fail everything that was waiting on the connection. */
+    if (!t->up && !t->failed)
+	return;
+    while (t->pend_head) {
+	cmd = t->pend_head;
+	t->pend_head = cmd->next;
+	if (t->up)
+	    batch_send(cmd);
+	else
+	    batch_cmd_err(cmd, t->failed);
+    }
+    t->pend_tail = NULL;
+}
+
+static void
+batch_input_line(char *buf)
+{
+    char           *strtok_data, *endptr;
+    char           *v;
+    batch_target_t *t;
+    batch_cmd_t    *cmd;
+    unsigned char  vals[MAX_IPMI_DATA_SIZE + 2];
+    unsigned int   count = 0;
+
+    batch_lineno++;
+    v = strtok_r(buf, " \t\r\n", &strtok_data);
+    if (!v || v[0] == '#')
+	return;
+
+    t = batch_find_target(v);
+    if (!t) {
+	fprintf(stderr, "Line %u: Unknown target %s\n", batch_lineno, v);
+	return;
+    }
+
+    while ((v = strtok_r(NULL, " \t\r\n,", &strtok_data))) {
+	if (count >= sizeof(vals)) {
+	    fprintf(stderr, "Line %u: Message too long\n", batch_lineno);
+	    return;
+	}
+	vals[count] = strtoul(v, &endptr, 16);
+	if (*endptr != '\0') {
+	    fprintf(stderr, "Line %u: Value %u was invalid\n", batch_lineno,
+		    count + 1);
+	    return;
+	}
+	count++;
+    }
+    if (count < 2) {
+	fprintf(stderr, "Line %u: No netfn and cmd given\n", batch_lineno);
+	return;
+    }
+
+    cmd = malloc(sizeof(*cmd));
+    if (!cmd) {
+	fprintf(stderr, "Line %u: Out of memory\n", batch_lineno);
+	return;
+    }
+    cmd->t = t;
+    cmd->lineno = batch_lineno;
+    cmd->next = NULL;
+    cmd->msg.netfn = vals[0];
+    cmd->msg.cmd = vals[1];
+    cmd->msg.data_len = count - 2;
+    memcpy(cmd->data, vals + 2, count - 2);
+    cmd->msg.data = cmd->data;
+
+    batch_outstanding++;
+    if (batch_outstanding >= batch_max && !batch_input_paused) {
+	batch_input_paused = 1;
+	sel_set_fd_read_handler(sel, 0, SEL_FD_HANDLER_DISABLED);
+    }
+
+    if (t->up) {
+	batch_send(cmd);
+    } else if (t->failed) {
+	batch_cmd_err(cmd, t->failed);
+    } else {
+	if (t->pend_tail)
+	    t->pend_tail->next = cmd;
+	else
+	    t->pend_head = cmd;
+	t->pend_tail = cmd;
+    }
+}
+
+static void
+batch_eof(void)
+{
+    batch_input_done = 1;
+    batch_check_done();
+}
+
+static void
+batch_read_targets(const char *fname)
+{
+    FILE           *f;
+    char           buf[1024];
+    char           *argv[64];
+    int            argc, curr_arg, rv;
+    unsigned int   lineno = 0, h;
+    char           *s, *tok;
+    batch_target_t *t;
+
+    f = fopen(fname, "r");
+    if (!f) {
+	fprintf(stderr, "Unable to open %s: %s\n", fname, strerror(errno));
+	exit(1);
+    }
+
+    while (fgets(buf, sizeof(buf), f)) {
+	lineno++;
+	s = buf;
+	while (*s == ' ' || *s == '\t')
+	    s++;
+	if (*s == '\0' || *s == '\n' || *s == '#')
+	    continue;
+
+	t = calloc(1, sizeof(*t));
+	if (!t || !(t->line = strdup(s))) {
+	    fprintf(stderr, "Out of memory\n");
+	    exit(1);
+	}
+	argc = 0;
+	for (tok = strtok(t->line, " \t\r\n"); tok && argc < 64;
+	     tok = strtok(NULL, " \t\r\n"))
+	    argv[argc++] = tok;
+	if (argc < 2) {
+	    fprintf(stderr, "%s:%u: No connection parameters\n", fname,
+		    lineno);
+	    exit(1);
+	}
+	t->name = argv[0];
+	if (batch_find_target(t->name)) {
+	    fprintf(stderr, "%s:%u: Duplicate target %s\n", fname, lineno,
+		    t->name);
+	    exit(1);
+	}
+
+	curr_arg = 1;
+	rv = ipmi_parse_args2(&curr_arg, argc, argv, &t->args);
+	if (rv) {
+	    fprintf(stderr, "%s:%u: Error parsing argument %d: %s\n",
+		    fname, lineno, curr_arg, strerror(rv));
+	    exit(1);
+	}
+
+	h = batch_hash(t->name);
+	t->hash_next = batch_targets[h];
+	batch_targets[h] = t;
+    }
+    fclose(f);
+}
+
+static void
+batch_start_cons(void)
+{
+    batch_target_t *t;
+    unsigned int   i;
+    int            rv;
+
+    os_hnd->get_monotonic_time(os_hnd, &batch_start);
+    for (i=0; i<BATCH_HASH_SIZE; i++) {
+	for (t = batch_targets[i]; t; t = t->hash_next) {
+	    rv = ipmi_args_setup_con(t->args, os_hnd, sel, &t->con);
+	    ipmi_free_args(t->args);
+	    t->args = NULL;
+	    if (!rv) {
+		t->con->add_con_change_handler(t->con, batch_con_changed, t);
+		rv = t->con->start_con(t->con);
+		if (rv) {
+		    t->con->close_connection(t->con);
+		    t->con = NULL;
+		}
+	    }
+	    if (rv) {
+		fprintf(stderr, "%s: Unable to start connection: %s\n",
+			t->name, strerror(rv));
+		t->failed = rv;
+	    }
+	}
+    }
+}
+
+static void
+batch_close(void)
+{
+    batch_target_t *t;
+    unsigned int   i;
+    long           usec = batch_usec_since(&batch_start);
+
+    for (i=0; i<BATCH_HASH_SIZE; i++) {
+	for (t = batch_targets[i]; t; t = t->hash_next) {
+	    if (t->con) {
+		t->con->close_connection(t->con);
+		t->con = NULL;
+	    }
+	}
+    }
+    fprintf(stderr, "%u commands sent, %u errors, %ld.%3.3lds\n",
+	    batch_sent, batch_errs, usec / 1000000, (usec / 1000) % 1000);
+}
+
 static char input_line[256];
 static int pos = 0;
 
@@ -589,13 +974,16 @@ user_input_ready(int fd, void *data)
 
     if (count < 0) {
 	perror("input read");
-    	con->close_connection(con);
 	leave(1);
     }
     if (count == 0) {
+	sel_set_fd_read_handler(sel, 0, SEL_FD_HANDLER_DISABLED);
+	if (batch) {
+	    batch_eof();
+	    return;
+	}
 	if (interactive)
 	    printf("\n"); 
-    	con->close_connection(con);
 	continue_operation = 0;
 	return;
     }
@@ -604,7 +992,10 @@ user_input_ready(int fd, void *data)
 	if ((input_line[pos] == '\n') || (input_line[pos] == '\r'))
 	{
 	    input_line[pos] = '\0';
-	    process_input_line(input_line);
+	    if (batch)
+		batch_input_line(input_line);
+	    else
+		process_input_line(input_line);
 	    for (j=0; j<count; j++)
 		input_line[j] = input_line[j+pos];
 	    pos = 0;
@@ -662,6 +1053,7 @@ main(int argc, char *argv[])
     int         curr_arg;
     ipmi_args_t *args;
     int         i;
+    char        *targetfile = NULL;
 
     progname = argv[0];
 
@@ -713,12 +1105,52 @@ main(int argc, char *argv[])
 	{
 	    printInfo();
 	    exit(0);
+	} else if ((strcmp(argv[i], "-T") == 0)
+		   || (strcmp(argv[i], "--targets") == 0))
+	{
+	    i++;
+	    if (i >= argc) {
+		usage();
+		exit(1);
+	    }
+	    targetfile = argv[i];
+	    batch = 1;
+	    interactive = 0;
+	} else if ((strcmp(argv[i], "-n") == 0)
+		   || (strcmp(argv[i], "--max-outstanding") == 0))
+	{
+	    i++;
+	    if (i >= argc) {
+		usage();
+		exit(1);
+	    }
+	    batch_max = strtoul(argv[i], NULL, 0);
+	    if (batch_max == 0)
+		batch_max = 1;
 	} else {
 	    usage();
 	    exit(1);
 	}
     }
 
+    if (batch) {
+	if (cmdstr || i < argc) {
+	    fprintf(stderr, "-T can't be used with -k or <con_parms>\n");
+	    exit(1);
+	}
+	batch_read_targets(targetfile);
+	batch_start_cons();
+	sel_set_fd_handlers(sel, 0, NULL, user_input_ready, NULL, NULL,
+			    NULL);
+	sel_set_fd_read_handler(sel, 0, SEL_FD_HANDLER_ENABLED);
+	while (continue_operation) {
+	    rv = os_hnd->perform_one_op(os_hnd, NULL);
+	    if (rv)
+		break;
+	}
+	leave(batch_errs ? 1 : 0);
+    }
+
     if (i >= argc) {
 	fprintf(stderr, "Not enough arguments\n");
 	exit(1);
@@ -31,8 +31,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -68,6 +71,10 @@ usage(void)
 	    "  %s [-p <port>] [-t <waittime>] [-s <starttag>]"
 	    " [-d] [destination]\n",
 	    progname);
+    fprintf(stderr,
+	    "  %s -c <addr>/<bits> [-r <rate>] [-p <port>] [-t <waittime>]"
+	    " [-d]\n",
+	    progname);
     fprintf(stderr,
 	    "    -p - Destination port, defaults to 623\n");
     fprintf(stderr,
@@ -78,6 +85,15 @@ usage(void)
 	    " (0-254, default 0\n");
     fprintf(stderr,
 	    "    -d - enable debugging\n");
+    fprintf(stderr,
+	    "    -c - Sweep mode, ping every address in the given IPv4\n");
+    fprintf(stderr,
+	    "        network once and print each responder and its\n");
+    fprintf(stderr,
+	    "        round-trip time.  -t is the wait after the last send.\n");
+    fprintf(stderr,
+	    "    -r - Pings per second to send in sweep mode"
+	    " (default 1000)\n");
     fprintf(stderr,
 	    "    destination - the target address, default is the broadcast\n");
     fprintf(stderr,
@@ -89,6 +105,8 @@ int port = 0x26f;
 int waittime = 10;
 int starttag = 0;
 int debug_packet = 0;
+char *sweep_net = NULL;
+unsigned long sweep_rate = 1000;
 
 struct socklist
 {
@@ -121,6 +139,196 @@ add_host(struct sockaddr *addr)
     return 1;
 }
 
+static void
+print_packet(unsigned char *rsp, int len)
+{
+    int i;
+
+    printf("Got packet:");
+    for (i=0; i<len; i++) {
+	if ((i % 16) == 0)
+	    printf("\n   ");
+	printf(" %2.2x", rsp[i]);
+    }
+    printf("\n");
+}
+
+/* Returns 1 if rsp is a valid presence pong. */
+static int
+check_pong(unsigned char *rsp, int len)
+{
+    if (len < 28) {
+	fprintf(stderr, "Invalid receive length: %d, should be 28\n", len);
+	return 0;
+    } else if ((rsp[0] != 6) || (rsp[3] != 6) || (rsp[4] != 0x00)
+	       || (rsp[5] != 0x00) || (rsp[6] != 0x11) || (rsp[7] != 0xbe)
+	       || (rsp[8] != 0x40) || (rsp[11] < 16))
+    {
+	fprintf(stderr, "Invalid ping response\n");
+	return 0;
+    }
+    return 1;
+}
+
+/* Microseconds on the monotonic clock.  Only differences are used, so
+   wrapping is fine. */
+static uint32_t
+now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+/*
+ * Send one ping to every host address in the network at sweep_rate
+ * per second, collecting the responses as they come in.  The send
+ * time of each address is kept so the round-trip time can be printed
+ * for the first response from each.
+ */
+static int
+sweep(int sock)
+{
+    char               *slash, *end;
+    char               netstr[32];
+    struct in_addr     netaddr;
+    unsigned long      bits;
+    uint32_t           base, count, next = 0, responders = 0;
+    uint32_t           *sent;
+    unsigned char      *seen;
+    uint32_t           start, now, due, last_send = 0;
+    struct sockaddr_in dest, src;
+    socklen_t          fromlen;
+    unsigned char      rsp[28];
+    fd_set             readfds;
+    struct timeval     twait;
+    int                rv;
+
+    slash = strchr(sweep_net, '/');
+    if (!slash || (slash - sweep_net) >= (int) sizeof(netstr)) {
+	fprintf(stderr, "Network must be given as <addr>/<bits>\n\n");
+	usage();
+    }
+    memcpy(netstr, sweep_net, slash - sweep_net);
+    netstr[slash - sweep_net] = '\0';
+    bits = strtoul(slash + 1, &end, 10);
+    if (!inet_aton(netstr, &netaddr) || *end != '\0' || bits < 8
+	|| bits > 32)
+    {
+	fprintf(stderr, "Invalid network %s, bits must be 8-32\n\n",
+		sweep_net);
+	usage();
+    }
+
+    count = (bits == 32) ? 1 : (1U << (32 - bits));
+    base = ntohl(netaddr.s_addr) & ~(count - 1);
+    if (count > 2) {
+	/* Skip the network and broadcast addresses. */
+	base++;
+	count -= 2;
+    }
+
+    sent = calloc(count, sizeof(*sent));
+    seen = calloc((count + 7) / 8, 1);
+    if (!sent || !seen) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+
+    /* Lots of responses can come in at once. */
+    rv = 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rv, sizeof(rv));
+
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    ping_msg[9] = starttag;
+
+    start = now_usec();
+    for (;;) {
+	now = now_usec();
+
+	/* Send everything that is due at the given rate. */
+	while (next < count
+	       && (uint64_t) (now - start) * sweep_rate
+		  >= (uint64_t) next * 1000000)
+	{
+	    dest.sin_addr.s_addr = htonl(base + next);
+	    rv = sendto(sock, ping_msg, sizeof(ping_msg), 0,
+			(struct sockaddr *) &dest, sizeof(dest));
+	    if (rv < 0 && (errno == EAGAIN || errno == ENOBUFS))
+		/* Socket buffer is full, try again later. */
+		break;
+	    if (rv < 0 && debug_packet)
+		fprintf(stderr, "sendto %s: %s\n", inet_ntoa(dest.sin_addr),
+			strerror(errno));
+	    sent[next] = now;
+	    next++;
+	    last_send = now;
+	}
+
+	if (next == count
+	    && (now - last_send) >= (uint32_t) waittime * 1000000)
+	    break;
+
+	/* Wait for a response, or until the next send is due. */
+	if (next < count) {
+	    due = (uint32_t) (((uint64_t) next * 1000000) / sweep_rate);
+	    due -= now - start;
+	    if (due > 1000000)
+		due = 1000; /* Behind, just poll. */
+	} else {
+	    due = (uint32_t) waittime * 1000000 - (now - last_send);
+	}
+	twait.tv_sec = due / 1000000;
+	twait.tv_usec = due % 1000000;
+	FD_ZERO(&readfds);
+	FD_SET(sock, &readfds);
+	rv = select(sock+1, &readfds, NULL, NULL, &twait);
+	if (rv < 0) {
+	    if (errno == EINTR)
+		continue;
+	    perror("select");
+	    return 1;
+	}
+	if (rv == 0)
+	    continue;
+
+	/* Read everything that is waiting. */
+	for (;;) {
+	    uint32_t idx;
+
+	    fromlen = sizeof(src);
+	    rv = recvfrom(sock, rsp, sizeof(rsp), 0,
+			  (struct sockaddr *) &src, &fromlen);
+	    if (rv < 0)
+		break;
+	    now = now_usec();
+	    if (debug_packet)
+		print_packet(rsp, rv);
+	    if (!check_pong(rsp, rv))
+		continue;
+	    idx = ntohl(src.sin_addr.s_addr) - base;
+	    if (idx >= next || (seen[idx / 8] & (1 << (idx % 8))))
+		continue;
+	    seen[idx / 8] |= 1 << (idx % 8);
+	    responders++;
+	    printf("%s %.3f ms", inet_ntoa(src.sin_addr),
+		   (now - sent[idx]) / 1000.0);
+	    if ((rsp[20] & 0x80) && ((rsp[20] & 0xf) == 0x01))
+		printf(" IPMI");
+	    printf("\n");
+	}
+	fflush(stdout);
+    }
+
+    fprintf(stderr, "%u of %u addresses responded\n", responders, count);
+    free(sent);
+    free(seen);
+    return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -191,8 +399,31 @@ main(int argc, char *argv[])
 	    }
 	} else if (strcmp(argv[i], "-d") == 0) {
 	    debug_packet++;
+	} else if (strcmp(argv[i], "-c") == 0) {
+	    i++;
+	    if (i >= argc) {
+		fprintf(stderr, "No parameter given for -c\n\n");
+		usage();
+	    }
+	    sweep_net = argv[i];
+	} else if (strcmp(argv[i], "-r") == 0) {
+	    i++;
+	    if (i >= argc) {
+		fprintf(stderr, "No parameter given for -r\n\n");
+		usage();
+	    }
+	    sweep_rate = strtoul(argv[i], &end, 0);
+	    if (sweep_rate == 0 || *end != '\0') {
+		fprintf(stderr, "Invalid rate for -r\n\n");
+		usage();
+	    }
 	}
     }
+
+    if (sweep_net && i < argc) {
+	fprintf(stderr, "A destination can't be given with -c\n\n");
+	usage();
+    }
     
     if (i < argc) {
 	struct addrinfo hints, *res0;
@@ -241,6 +472,12 @@ main(int argc, char *argv[])
 	exit(1);
     }
 
+    if (sweep_net) {
+	rv = sweep(sock);
+	close(sock);
+	return rv;
+    }
+
     gettimeofday(&currtime, NULL);
     endtime = currtime;
     endtime.tv_sec += waittime;
@@ -283,27 +520,12 @@ main(int argc, char *argv[])
 	fromlen = sizeof(*src);
 	rv = recvfrom(sock, rsp, sizeof(rsp), 0, src, &fromlen);
 
-	if (debug_packet && (rv > 0)) {
-	    int i;
-	    printf("Got packet:");
-	    for (i=0; i<rv; i++) {
-		if ((i % 16) == 0)
-		    printf("\n   ");
-		printf(" %2.2x", rsp[i]);
-	    }
-	    printf("\n");
-	}
+	if (debug_packet && (rv > 0))
+	    print_packet(rsp, rv);
 
 	if (rv < 0) {
 	    perror("recvfrom");
-	} else if (rv < 28) {
-	    fprintf(stderr, "Invalid receive length: %d, should be 28\n", rv);
-	} else if ((rsp[0] != 6) || (rsp[3] != 6) || (rsp[4] != 0x00)
-		   || (rsp[5] != 0x00) || (rsp[6] != 0x11) || (rsp[7] != 0xbe)
-		   || (rsp[8] != 0x40) || (rsp[11] < 16))
-	{
-	    fprintf(stderr, "Invalid ping response\n");
-	} else {
+	} else if (check_pong(rsp, rv)) {
 	    if (! add_host(src))
 		goto next;
 	    rv = getnameinfo(src, fromlen, host, sizeof(host),
@@ -0,0 +1,435 @@
+/*
+ * sel_export.c
+ *
+ * Archive the SELs of a set of domains.
+ *
+ * Author: Corey Minyard <minyard@acm.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Reads a host file like the one ipmi_fleet_sensors takes, a name
+ * followed by connection parameters on each line:
+ *
+ *   node17 lan -U admin -P secret 10.0.0.17
+ *
+ * opens all the domains, and once each is fully up writes every entry
+ * in its SELs to a SEL archive (see ipmi_sel_archive.h), then closes
+ * it.  Running this with -r <archive> dumps an archive as CSV.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/time.h>
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_posix.h>
+#include <OpenIPMI/ipmi_sel_archive.h>
+
+#define MAX_LINE_LEN	1024
+#define MAX_HOST_ARGS	64
+
+enum host_state_e { HOST_OPENING, HOST_CLOSING, HOST_DONE };
+
+typedef struct host_s
+{
+    char              *name;
+    char              *line;
+    int               argc;
+    char              *argv[MAX_HOST_ARGS];
+
+    enum host_state_e state;
+    ipmi_domain_id_t  domain_id;
+    unsigned int      entries;
+    int               failed;
+} host_t;
+
+static const char                *progname;
+static host_t                    **hosts;
+static unsigned int              num_hosts;
+static unsigned int              hosts_left;
+static os_handler_t              *os_hnd;
+static ipmi_sel_archive_writer_t *writer;
+
+static void con_usage(const char *name, const char *help, void *cb_data)
+{
+    fprintf(stderr, "\n%s%s", name, help);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, " %s [-o <archive>] [-b <rows per block>]"
+	    " [-t <timeout secs>] <host file>\n", progname);
+    fprintf(stderr, " %s -r <archive>\n", progname);
+    fprintf(stderr, " The first form writes the SELs of the hosts to the"
+	    " archive, the second\n dumps an archive as CSV.\n"
+	    " Each line of <host file> is a name followed by <con_parms>,"
+	    " where\n <con_parms> is one of:");
+    ipmi_parse_args_iter_help(con_usage, NULL);
+    fprintf(stderr, "\n");
+}
+
+/***********************************************************************
+ *
+ * Writing.
+ *
+ **********************************************************************/
+
+static void
+close_done(void *cb_data)
+{
+    host_t *h = cb_data;
+
+    h->state = HOST_DONE;
+    hosts_left--;
+}
+
+static void
+close_host(ipmi_domain_t *domain, host_t *h)
+{
+    h->state = HOST_CLOSING;
+    if (ipmi_domain_close(domain, close_done, h))
+	close_done(h);
+}
+
+static void
+domain_up(ipmi_domain_t *domain, void *cb_data)
+{
+    host_t        *h = cb_data;
+    ipmi_event_t  *event, *next;
+    ipmi_mcid_t   mcid;
+    unsigned char data[IPMI_SEL_ARCHIVE_DATA_LEN];
+    unsigned int  len;
+    int           rv;
+
+    if (h->state != HOST_OPENING)
+	return;
+
+    for (event = ipmi_domain_first_event(domain); event; event = next) {
+	/* Only real SEL entries, not OpenIPMI's own event types. */
+	if (ipmi_event_get_type(event) <= 0xff) {
+	    mcid = ipmi_event_get_mcid(event);
+	    len = ipmi_event_get_data(event, data, 0, sizeof(data));
+	    rv = ipmi_sel_archive_add(writer, h->name, mcid.channel,
+				      mcid.mc_num,
+				      ipmi_event_get_record_id(event),
+				      ipmi_event_get_type(event),
+				      ipmi_event_get_timestamp(event),
+				      data, len);
+	    if (rv)
+		fprintf(stderr, "%s: Unable to write an entry: %s\n",
+			h->name, strerror(rv));
+	    else
+		h->entries++;
+	}
+	next = ipmi_domain_next_event(domain, event);
+	ipmi_event_free(event);
+    }
+
+    /* Get this domain's entries to disk before going on. */
+    rv = ipmi_sel_archive_flush(writer);
+    if (rv)
+	fprintf(stderr, "%s: Unable to write the archive: %s\n", h->name,
+		strerror(rv));
+    close_host(domain, h);
+}
+
+static void
+con_change(ipmi_domain_t *domain,
+	   int           err,
+	   unsigned int  conn_num,
+	   unsigned int  port_num,
+	   int           still_connected,
+	   void          *cb_data)
+{
+    host_t *h = cb_data;
+
+    if (still_connected || (h->state != HOST_OPENING))
+	return;
+
+    fprintf(stderr, "%s: Unable to connect: %s\n", h->name, strerror(err));
+    h->failed = 1;
+    close_host(domain, h);
+}
+
+static void
+start_host(host_t *h)
+{
+    ipmi_args_t *args;
+    ipmi_con_t  *con;
+    int         curr_arg = 1;
+    int         rv;
+
+    rv = ipmi_parse_args2(&curr_arg, h->argc, h->argv, &args);
+    if (rv) {
+	fprintf(stderr, "%s: Error parsing argument %d: %s\n", h->name,
+		curr_arg, strerror(rv));
+	goto out_err;
+    }
+    rv = ipmi_args_setup_con(args, os_hnd, NULL, &con);
+    ipmi_free_args(args);
+    if (rv) {
+	fprintf(stderr, "%s: Unable to set up the connection: %s\n",
+		h->name, strerror(rv));
+	goto out_err;
+    }
+
+    rv = ipmi_open_domain(h->name, &con, 1, con_change, h, domain_up, h,
+			  NULL, 0, &h->domain_id);
+    if (rv) {
+	fprintf(stderr, "%s: Unable to open the domain: %s\n", h->name,
+		strerror(rv));
+	con->close_connection(con);
+	goto out_err;
+    }
+    return;
+
+ out_err:
+    h->failed = 1;
+    h->state = HOST_DONE;
+    hosts_left--;
+}
+
+static int
+run_export(const char *path, unsigned int rows, unsigned int timeout)
+{
+    struct timeval end, now, tv;
+    unsigned int   i;
+    unsigned long  total = 0;
+    unsigned int   failed = 0;
+    int            rv;
+
+    rv = ipmi_sel_archive_create(path, rows, &writer);
+    if (rv) {
+	fprintf(stderr, "Unable to create %s: %s\n", path, strerror(rv));
+	return 1;
+    }
+
+    os_hnd = ipmi_posix_setup_os_handler();
+    if (!os_hnd) {
+	fprintf(stderr, "Unable to allocate os handler\n");
+	return 1;
+    }
+    ipmi_init(os_hnd);
+
+    hosts_left = num_hosts;
+    for (i=0; i<num_hosts; i++)
+	start_host(hosts[i]);
+
+    gettimeofday(&end, NULL);
+    end.tv_sec += timeout;
+    while (hosts_left > 0) {
+	gettimeofday(&now, NULL);
+	if (!timercmp(&now, &end, <))
+	    break;
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	os_hnd->perform_one_op(os_hnd, &tv);
+    }
+
+    for (i=0; i<num_hosts; i++) {
+	if (hosts[i]->state != HOST_DONE) {
+	    fprintf(stderr, "%s: Timed out\n", hosts[i]->name);
+	    failed++;
+	} else if (hosts[i]->failed) {
+	    failed++;
+	}
+	total += hosts[i]->entries;
+    }
+
+    rv = ipmi_sel_archive_finish(writer);
+    if (rv) {
+	fprintf(stderr, "Unable to write %s: %s\n", path, strerror(rv));
+	return 1;
+    }
+    fprintf(stderr, "Wrote %lu entries from %u hosts, %u failed\n", total,
+	    num_hosts - failed, failed);
+    return 0;
+}
+
+/***********************************************************************
+ *
+ * Reading.
+ *
+ **********************************************************************/
+
+static int
+run_dump(const char *path)
+{
+    ipmi_sel_archive_t          *a;
+    ipmi_sel_archive_block_t    b;
+    const ipmi_sel_archive_mc_t *mc;
+    unsigned int                i, r, j;
+    int                         rv;
+
+    rv = ipmi_sel_archive_open(path, &a);
+    if (rv) {
+	fprintf(stderr, "Unable to open %s: %s\n", path, strerror(rv));
+	return 1;
+    }
+
+    printf("domain,channel,mc,record_id,type,time,sensor_type,sensor_num,"
+	   "event_type,data\n");
+    for (i=0; ipmi_sel_archive_get_block(a, i, &b) == 0; i++) {
+	for (r=0; r<b.rows; r++) {
+	    mc = &b.mcs[b.mc[r]];
+	    printf("%.*s,%u,%2.2x,%u,%2.2x,", (int) sizeof(mc->domain),
+		   mc->domain, mc->channel, mc->addr, b.record_id[r],
+		   b.type[r]);
+	    if (b.time[r] != IPMI_INVALID_TIME)
+		printf("%lld", (long long) b.time[r]);
+	    printf(",%2.2x,%2.2x,%2.2x,", b.sensor_type[r], b.sensor_num[r],
+		   b.event_type[r]);
+	    for (j=0; j<IPMI_SEL_ARCHIVE_DATA_LEN; j++)
+		printf("%2.2x", b.data[r][j]);
+	    printf("\n");
+	}
+    }
+
+    ipmi_sel_archive_close(a);
+    return 0;
+}
+
+/***********************************************************************
+ *
+ * Setup.
+ *
+ **********************************************************************/
+
+static int
+read_hosts(FILE *f, const char *fname)
+{
+    char         buf[MAX_LINE_LEN];
+    int          lineno = 0;
+    char         *s, *tok;
+    host_t       *h;
+    host_t       **nhosts;
+    unsigned int max_hosts = 0;
+
+    while (fgets(buf, sizeof(buf), f)) {
+	lineno++;
+	s = buf;
+	while (isspace((unsigned char) *s))
+	    s++;
+	if ((*s == '\0') || (*s == '#'))
+	    continue;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+	    return ENOMEM;
+	h->line = strdup(s);
+	if (!h->line) {
+	    free(h);
+	    return ENOMEM;
+	}
+
+	for (tok = strtok(h->line, " \t\r\n");
+	     tok && (h->argc < MAX_HOST_ARGS);
+	     tok = strtok(NULL, " \t\r\n"))
+	    h->argv[h->argc++] = tok;
+	if (h->argc < 2) {
+	    fprintf(stderr, "%s:%d: No connection parameters\n",
+		    fname, lineno);
+	    free(h->line);
+	    free(h);
+	    return EINVAL;
+	}
+	h->name = h->argv[0];
+
+	if (num_hosts == max_hosts) {
+	    max_hosts = max_hosts ? max_hosts * 2 : 64;
+	    nhosts = realloc(hosts, max_hosts * sizeof(*hosts));
+	    if (!nhosts)
+		return ENOMEM;
+	    hosts = nhosts;
+	}
+	hosts[num_hosts++] = h;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int          rv;
+    int          curr_arg = 1;
+    const char   *hostname;
+    const char   *path = "sel.archive";
+    unsigned int rows = 0;
+    unsigned int timeout = 300;
+    FILE         *f;
+
+    progname = argv[0];
+
+    while ((curr_arg < argc) && (argv[curr_arg][0] == '-')
+	   && (argv[curr_arg][1] != '\0'))
+    {
+	const char *arg = argv[curr_arg++];
+
+	if (strcmp(arg, "--") == 0)
+	    break;
+	if ((strcmp(arg, "-r") == 0) && (curr_arg < argc)) {
+	    return run_dump(argv[curr_arg]);
+	} else if ((strcmp(arg, "-o") == 0) && (curr_arg < argc)) {
+	    path = argv[curr_arg++];
+	} else if ((strcmp(arg, "-b") == 0) && (curr_arg < argc)) {
+	    rows = strtoul(argv[curr_arg++], NULL, 0);
+	} else if ((strcmp(arg, "-t") == 0) && (curr_arg < argc)) {
+	    timeout = strtoul(argv[curr_arg++], NULL, 0);
+	} else {
+	    usage();
+	    exit(1);
+	}
+    }
+    if (curr_arg != argc - 1) {
+	usage();
+	exit(1);
+    }
+    hostname = argv[curr_arg];
+
+    if (strcmp(hostname, "-") == 0) {
+	f = stdin;
+    } else {
+	f = fopen(hostname, "r");
+	if (!f) {
+	    fprintf(stderr, "Unable to open %s: %s\n", hostname,
+		    strerror(errno));
+	    exit(1);
+	}
+    }
+    rv = read_hosts(f, hostname);
+    if (f != stdin)
+	fclose(f);
+    if (rv)
+	exit(1);
+
+    return run_export(path, rows, timeout);
+}
@@ -0,0 +1,651 @@
+/*
+ * shardd.c
+ *
+ * Spread a set of domains over several worker processes.
+ *
+ * Author: Corey Minyard <minyard@acm.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * The supervisor reads a host file like the one ipmi_fleet_sensors
+ * takes, a name followed by connection parameters on each line:
+ *
+ *   node17 lan -U admin -P secret 10.0.0.17
+ *
+ * and forks a number of workers.  Each worker opens the domains whose
+ * names hash to it with ipmi_shm_ring_shard(), reads their threshold
+ * sensors every interval and takes their events, and puts them all
+ * in its ring in a shared ring file.  A worker that dies is started
+ * again.  One consumer reads all the workers' records from the ring
+ * file; running this with -R <ring file> is a consumer that writes
+ * them out as CSV.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <OpenIPMI/ipmiif.h>
+#include <OpenIPMI/ipmi_conn.h>
+#include <OpenIPMI/ipmi_err.h>
+#include <OpenIPMI/ipmi_posix.h>
+#include <OpenIPMI/ipmi_shm_ring.h>
+
+#define MAX_LINE_LEN	1024
+#define MAX_HOST_ARGS	64
+
+typedef struct host_s
+{
+    char              *name;
+    char              *line;
+    int               argc;
+    char              *argv[MAX_HOST_ARGS];
+
+    /* Only used in the worker. */
+    ipmi_domain_id_t  domain_id;
+    os_hnd_timer_id_t *timer;
+    ipmi_sensor_id_t  *ids;
+    char              (*names)[64];
+    unsigned int      num_sensors;
+    unsigned int      max_sensors;
+} host_t;
+
+static const char      *progname;
+static host_t          **hosts;
+static unsigned int    num_hosts;
+static unsigned int    num_workers;
+static const char      *ring_path = "/dev/shm/openipmi_shard";
+static unsigned int    ring_slots = 4096;
+static unsigned int    interval = 10;
+static int             pin_cpus;
+static volatile int    stopping;
+
+/* Worker state. */
+static unsigned int    worker;
+static os_handler_t    *os_hnd;
+static ipmi_shm_ring_t *ring;
+
+static void con_usage(const char *name, const char *help, void *cb_data)
+{
+    fprintf(stderr, "\n%s%s", name, help);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, " %s [-w <workers>] [-f <ring file>] [-s <slots>]"
+	    " [-i <interval secs>] [-p] <host file>\n", progname);
+    fprintf(stderr, " %s -R <ring file>\n", progname);
+    fprintf(stderr, " The first form runs the workers, -p pins each one to"
+	    " a CPU.  The second\n reads the ring file and writes the records"
+	    " as CSV.\n Each line of <host file> is a name followed by"
+	    " <con_parms>, where\n <con_parms> is one of:");
+    ipmi_parse_args_iter_help(con_usage, NULL);
+    fprintf(stderr, "\n");
+}
+
+static int64_t
+now_usecs(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((int64_t) tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/***********************************************************************
+ *
+ * The worker.
+ *
+ **********************************************************************/
+
+static void
+put_rec(ipmi_shm_rec_t *rec)
+{
+    rec->time = now_usecs();
+    /* If the consumer isn't keeping up, the record is dropped and
+       counted in the ring. */
+    ipmi_shm_ring_put(ring, worker, rec);
+}
+
+static void start_read_timer(host_t *h);
+
+static void
+readings_done(ipmi_domain_t               *domain,
+	      ipmi_sensor_batch_reading_t *readings,
+	      unsigned int                count,
+	      void                        *cb_data)
+{
+    host_t         *h = cb_data;
+    ipmi_shm_rec_t rec;
+    unsigned int   i;
+
+    for (i=0; i<count; i++) {
+	memset(&rec, 0, sizeof(rec));
+	rec.type = IPMI_SHM_REC_READING;
+	strncpy(rec.domain, h->name, sizeof(rec.domain) - 1);
+	memcpy(rec.name, h->names[i], sizeof(rec.name));
+	rec.err = readings[i].err;
+	if (!readings[i].err) {
+	    rec.value_present = readings[i].value_present;
+	    rec.value = readings[i].val;
+	    rec.raw = readings[i].raw_value;
+	}
+	put_rec(&rec);
+    }
+
+    if (domain)
+	start_read_timer(h);
+}
+
+static void
+add_sensor(ipmi_entity_t *entity, ipmi_sensor_t *sensor, void *cb_data)
+{
+    host_t *h = cb_data;
+
+    if (ipmi_sensor_get_event_reading_type(sensor)
+	!= IPMI_EVENT_READING_TYPE_THRESHOLD)
+	return;
+    if (!ipmi_sensor_get_is_readable(sensor))
+	return;
+
+    if (h->num_sensors == h->max_sensors) {
+	unsigned int     nmax = h->max_sensors ? h->max_sensors * 2 : 32;
+	ipmi_sensor_id_t *ids;
+	char             (*names)[64];
+
+	ids = realloc(h->ids, nmax * sizeof(*ids));
+	if (!ids)
+	    return;
+	h->ids = ids;
+	names = realloc(h->names, nmax * sizeof(*names));
+	if (!names)
+	    return;
+	h->names = names;
+	h->max_sensors = nmax;
+    }
+
+    ipmi_sensor_get_name(sensor, h->names[h->num_sensors],
+			 sizeof(h->names[0]));
+    h->ids[h->num_sensors] = ipmi_sensor_convert_to_id(sensor);
+    h->num_sensors++;
+}
+
+static void
+add_entity_sensors(ipmi_entity_t *entity, void *cb_data)
+{
+    ipmi_entity_iterate_sensors(entity, add_sensor, cb_data);
+}
+
+static void
+read_domain(ipmi_domain_t *domain, void *cb_data)
+{
+    host_t *h = cb_data;
+    int    rv;
+
+    /* The sensors may change, so they are found again every time. */
+    h->num_sensors = 0;
+    ipmi_domain_iterate_entities(domain, add_entity_sensors, h);
+    if (h->num_sensors == 0) {
+	start_read_timer(h);
+	return;
+    }
+
+    rv = ipmi_domain_get_sensor_readings(domain, h->ids, h->num_sensors,
+					 readings_done, h);
+    if (rv)
+	start_read_timer(h);
+}
+
+static void
+read_timeout(void *cb_data, os_hnd_timer_id_t *id)
+{
+    host_t *h = cb_data;
+
+    ipmi_domain_pointer_cb(h->domain_id, read_domain, h);
+}
+
+static void
+start_read_timer(host_t *h)
+{
+    struct timeval tv;
+
+    tv.tv_sec = interval;
+    tv.tv_usec = 0;
+    os_hnd->start_timer(os_hnd, h->timer, &tv, read_timeout, h);
+}
+
+static void
+event_handler(ipmi_domain_t *domain, ipmi_event_t *event, void *cb_data)
+{
+    host_t         *h = cb_data;
+    ipmi_mcid_t    mcid = ipmi_event_get_mcid(event);
+    ipmi_shm_rec_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = IPMI_SHM_REC_EVENT;
+    strncpy(rec.domain, h->name, sizeof(rec.domain) - 1);
+    snprintf(rec.name, sizeof(rec.name), "mc(%d.%x)", mcid.channel,
+	     mcid.mc_num);
+    rec.raw = ipmi_event_get_record_id(event);
+    rec.data_len = ipmi_event_get_data(event, rec.data, 0, sizeof(rec.data));
+    put_rec(&rec);
+}
+
+static void
+domain_up(ipmi_domain_t *domain, void *cb_data)
+{
+    host_t *h = cb_data;
+
+    ipmi_domain_add_event_handler(domain, event_handler, h);
+    read_domain(domain, h);
+}
+
+static void
+start_host(host_t *h)
+{
+    ipmi_args_t *args;
+    ipmi_con_t  *con;
+    int         curr_arg = 1;
+    int         rv;
+
+    rv = ipmi_parse_args2(&curr_arg, h->argc, h->argv, &args);
+    if (rv) {
+	fprintf(stderr, "%s: Error parsing argument %d: %s\n", h->name,
+		curr_arg, strerror(rv));
+	return;
+    }
+    rv = ipmi_args_setup_con(args, os_hnd, NULL, &con);
+    ipmi_free_args(args);
+    if (rv) {
+	fprintf(stderr, "%s: Unable to set up the connection: %s\n",
+		h->name, strerror(rv));
+	return;
+    }
+    rv = os_hnd->alloc_timer(os_hnd, &h->timer);
+    if (rv) {
+	con->close_connection(con);
+	return;
+    }
+
+    rv = ipmi_open_domain(h->name, &con, 1, NULL, NULL, domain_up, h,
+			  NULL, 0, &h->domain_id);
+    if (rv) {
+	fprintf(stderr, "%s: Unable to open the domain: %s\n", h->name,
+		strerror(rv));
+	con->close_connection(con);
+    }
+}
+
+static void
+my_vlog(os_handler_t         *handler,
+	const char           *format,
+	enum ipmi_log_type_e log_type,
+	va_list              ap)
+{
+    fprintf(stderr, "worker %u: ", worker);
+    vfprintf(stderr, format, ap);
+    if ((log_type != IPMI_LOG_DEBUG_START) && (log_type != IPMI_LOG_DEBUG_CONT))
+	fprintf(stderr, "\n");
+}
+
+static void
+run_worker(void)
+{
+    unsigned int i;
+    int          rv;
+
+#ifdef CPU_SET
+    if (pin_cpus) {
+	long      ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+
+	if (ncpus > 0) {
+	    CPU_ZERO(&set);
+	    CPU_SET(worker % ncpus, &set);
+	    sched_setaffinity(0, sizeof(set), &set);
+	}
+    }
+#endif
+
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+
+    rv = ipmi_shm_ring_attach(ring_path, &ring);
+    if (rv) {
+	fprintf(stderr, "worker %u: Unable to attach %s: %s\n", worker,
+		ring_path, strerror(rv));
+	exit(1);
+    }
+
+    os_hnd = ipmi_posix_setup_os_handler();
+    if (!os_hnd) {
+	fprintf(stderr, "worker %u: Unable to allocate os handler\n", worker);
+	exit(1);
+    }
+    os_hnd->set_log_handler(os_hnd, my_vlog);
+    ipmi_init(os_hnd);
+
+    for (i=0; i<num_hosts; i++) {
+	if (ipmi_shm_ring_shard(hosts[i]->name, num_workers) == worker)
+	    start_host(hosts[i]);
+    }
+
+    for (;;)
+	os_hnd->perform_one_op(os_hnd, NULL);
+}
+
+/***********************************************************************
+ *
+ * The supervisor.
+ *
+ **********************************************************************/
+
+static void
+stop_handler(int sig)
+{
+    stopping = 1;
+}
+
+/* No SA_RESTART, so the wait for workers returns when stopping. */
+static void
+catch_stop_signals(void)
+{
+    struct sigaction act;
+
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = stop_handler;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGTERM, &act, NULL);
+    sigaction(SIGINT, &act, NULL);
+}
+
+static pid_t
+start_worker(unsigned int w)
+{
+    pid_t pid;
+
+    pid = fork();
+    if (pid == 0) {
+	worker = w;
+	run_worker();
+	exit(0);
+    }
+    if (pid == -1)
+	fprintf(stderr, "Unable to start worker %u: %s\n", w, strerror(errno));
+    return pid;
+}
+
+static int
+run_supervisor(void)
+{
+    ipmi_shm_ring_t *r;
+    pid_t           *pids;
+    pid_t           pid;
+    unsigned int    i;
+    int             status;
+    int             rv;
+
+    rv = ipmi_shm_ring_create(ring_path, num_workers, ring_slots, &r);
+    if (rv) {
+	fprintf(stderr, "Unable to create %s: %s\n", ring_path, strerror(rv));
+	return 1;
+    }
+    ipmi_shm_ring_detach(r);
+
+    pids = calloc(num_workers, sizeof(*pids));
+    if (!pids)
+	return 1;
+
+    catch_stop_signals();
+
+    for (i=0; i<num_workers; i++)
+	pids[i] = start_worker(i);
+
+    while (!stopping) {
+	pid = wait(&status);
+	if (pid == -1) {
+	    if (errno == EINTR)
+		continue;
+	    /* No workers could be started, try again later. */
+	    sleep(1);
+	}
+	for (i=0; i<num_workers; i++) {
+	    if ((pids[i] != -1) && (pids[i] != pid))
+		continue;
+	    if (stopping)
+		break;
+	    if (pids[i] != -1)
+		fprintf(stderr, "Worker %u exited, restarting it\n", i);
+	    /* Don't spin if it dies right away. */
+	    sleep(1);
+	    pids[i] = start_worker(i);
+	}
+    }
+
+    for (i=0; i<num_workers; i++) {
+	if (pids[i] != -1)
+	    kill(pids[i], SIGTERM);
+    }
+    while (wait(&status) != -1)
+	;
+    free(pids);
+    return 0;
+}
+
+/***********************************************************************
+ *
+ * The consumer.
+ *
+ **********************************************************************/
+
+static int
+run_consumer(const char *path)
+{
+    ipmi_shm_ring_t *r;
+    ipmi_shm_rec_t  rec;
+    char            errstr[64];
+    unsigned int    i;
+    int             rv;
+
+    rv = ipmi_shm_ring_attach(path, &r);
+    if (rv) {
+	fprintf(stderr, "Unable to attach %s: %s\n", path, strerror(rv));
+	return 1;
+    }
+
+    catch_stop_signals();
+
+    printf("record,time,worker,domain,name,value,raw,error\n");
+    while (!stopping) {
+	if (ipmi_shm_ring_get(r, &rec) != 0) {
+	    fflush(stdout);
+	    usleep(10000);
+	    continue;
+	}
+	rec.domain[sizeof(rec.domain) - 1] = '\0';
+	rec.name[sizeof(rec.name) - 1] = '\0';
+	if (rec.type == IPMI_SHM_REC_EVENT) {
+	    printf("event,%lld,%u,%s,%s,", (long long) rec.time, rec.producer,
+		   rec.domain, rec.name);
+	    for (i=0; (i<rec.data_len) && (i<sizeof(rec.data)); i++)
+		printf("%2.2x", rec.data[i]);
+	    printf(",%u,\n", rec.raw);
+	} else {
+	    errstr[0] = '\0';
+	    if (rec.err)
+		ipmi_get_error_string(rec.err, errstr, sizeof(errstr));
+	    printf("sensor,%lld,%u,%s,%s,", (long long) rec.time, rec.producer,
+		   rec.domain, rec.name);
+	    if (!rec.err && (rec.value_present == IPMI_BOTH_VALUES_PRESENT))
+		printf("%g", rec.value);
+	    printf(",%u,%s\n", rec.raw, errstr);
+	}
+    }
+
+    for (i=0; i<ipmi_shm_ring_num_producers(r); i++) {
+	uint64_t dropped = ipmi_shm_ring_dropped(r, i);
+
+	if (dropped)
+	    fprintf(stderr, "Worker %u dropped %llu records\n", i,
+		    (unsigned long long) dropped);
+    }
+    ipmi_shm_ring_detach(r);
+    return 0;
+}
+
+/***********************************************************************
+ *
+ * Setup.
+ *
+ **********************************************************************/
+
+static int
+read_hosts(FILE *f, const char *fname)
+{
+    char         buf[MAX_LINE_LEN];
+    int          lineno = 0;
+    char         *s, *tok;
+    host_t       *h;
+    host_t       **nhosts;
+    unsigned int max_hosts = 0;
+
+    while (fgets(buf, sizeof(buf), f)) {
+	lineno++;
+	s = buf;
+	while (isspace((unsigned char) *s))
+	    s++;
+	if ((*s == '\0') || (*s == '#'))
+	    continue;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+	    return ENOMEM;
+	h->line = strdup(s);
+	if (!h->line) {
+	    free(h);
+	    return ENOMEM;
+	}
+
+	for (tok = strtok(h->line, " \t\r\n");
+	     tok && (h->argc < MAX_HOST_ARGS);
+	     tok = strtok(NULL, " \t\r\n"))
+	    h->argv[h->argc++] = tok;
+	if (h->argc < 2) {
+	    fprintf(stderr, "%s:%d: No connection parameters\n",
+		    fname, lineno);
+	    free(h->line);
+	    free(h);
+	    return EINVAL;
+	}
+	h->name = h->argv[0];
+
+	if (num_hosts == max_hosts) {
+	    max_hosts = max_hosts ? max_hosts * 2 : 64;
+	    nhosts = realloc(hosts, max_hosts * sizeof(*hosts));
+	    if (!nhosts)
+		return ENOMEM;
+	    hosts = nhosts;
+	}
+	hosts[num_hosts++] = h;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int        rv;
+    int        curr_arg = 1;
+    const char *hostname;
+    FILE       *f;
+
+    progname = argv[0];
+
+    while ((curr_arg < argc) && (argv[curr_arg][0] == '-')
+	   && (argv[curr_arg][1] != '\0'))
+    {
+	const char *arg = argv[curr_arg++];
+
+	if (strcmp(arg, "--") == 0)
+	    break;
+	if ((strcmp(arg, "-R") == 0) && (curr_arg < argc)) {
+	    return run_consumer(argv[curr_arg]);
+	} else if ((strcmp(arg, "-w") == 0) && (curr_arg < argc)) {
+	    num_workers = strtoul(argv[curr_arg++], NULL, 0);
+	} else if ((strcmp(arg, "-f") == 0) && (curr_arg < argc)) {
+	    ring_path = argv[curr_arg++];
+	} else if ((strcmp(arg, "-s") == 0) && (curr_arg < argc)) {
+	    ring_slots = strtoul(argv[curr_arg++], NULL, 0);
+	} else if ((strcmp(arg, "-i") == 0) && (curr_arg < argc)) {
+	    interval = strtoul(argv[curr_arg++], NULL, 0);
+	    if (interval == 0)
+		interval = 1;
+	} else if (strcmp(arg, "-p") == 0) {
+	    pin_cpus = 1;
+	} else {
+	    usage();
+	    exit(1);
+	}
+    }
+    if (curr_arg != argc - 1) {
+	usage();
+	exit(1);
+    }
+    hostname = argv[curr_arg];
+
+    if (num_workers == 0) {
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	num_workers = ncpus > 0 ? ncpus : 1;
+    }
+
+    if (strcmp(hostname, "-") == 0) {
+	f = stdin;
+    } else {
+	f = fopen(hostname, "r");
+	if (!f) {
+	    fprintf(stderr, "Unable to open %s: %s\n", hostname,
+		    strerror(errno));
+	    exit(1);
+	}
+    }
+    rv = read_hosts(f, hostname);
+    if (f != stdin)
+	fclose(f);
+    if (rv)
+	exit(1);
+
+    return run_supervisor();
+}
@@ -79,6 +79,14 @@ typedef struct charbuf
     int len;
 } charbuf;
 
+/* A malloced buffer of bytes that is handed back as a string, for
+   returning bulk binary data in one object. */
+typedef struct bytebuf
+{
+    char *val;
+    int len;
+} bytebuf;
+
 os_handler_t *swig_os_hnd;
 
 static int
@@ -2129,6 +2137,274 @@ sensor_get_states_handler(ipmi_sensor_t *sensor,
     deref_swig_cb_val(cb);
 }
 
+/*
+ * Reading all the sensors in a domain in one call.  Every read is
+ * started at once and the results are collected here, then handed
+ * to the script in one list when the last one finishes so there is
+ * only one callback into the language instead of one per sensor.
+ */
+typedef struct sensor_values_s sensor_values_t;
+
+typedef struct ipmi_sensor_value_s
+{
+    ipmi_sensor_id_t id;
+    char             name[IPMI_SENSOR_NAME_LEN];
+    int              err;
+    int              threshold;
+    int              raw_set;
+    unsigned int     raw;
+    int              value_set;
+    double           value;
+    char             *states;
+    sensor_values_t  *sv;
+} ipmi_sensor_value_t;
+
+struct sensor_values_s
+{
+    swig_cb_val         cb;
+    ipmi_domain_id_t    domain_id;
+    os_hnd_lock_t       *lock;
+    int                 pending;
+    int                 count;
+    int                 size;
+    ipmi_sensor_value_t **vals;
+};
+
+static void
+sensor_values_free(sensor_values_t *sv)
+{
+    int i;
+
+    for (i=0; i<sv->count; i++) {
+	if (sv->vals[i]) {
+	    free(sv->vals[i]->states);
+	    free(sv->vals[i]);
+	}
+    }
+    if (sv->vals)
+	free(sv->vals);
+    if (sv->lock)
+	swig_os_hnd->destroy_lock(swig_os_hnd, sv->lock);
+    deref_swig_cb_val(sv->cb);
+    free(sv);
+}
+
+static void
+sensor_values_deliver(ipmi_domain_t *domain, void *cb_data)
+{
+    sensor_values_t *sv = cb_data;
+    swig_ref        domain_ref;
+    swig_ref        *val_refs;
+    swig_ref        dummy;
+    int             count = sv->count;
+    int             i;
+
+    val_refs = malloc(count * sizeof(swig_ref));
+    if (!val_refs) {
+	count = 0;
+	val_refs = &dummy;
+    }
+
+    /* The values are owned by the references from here on. */
+    for (i=0; i<count; i++) {
+	sv->vals[i]->sv = NULL;
+	val_refs[i] = swig_make_ref_destruct(sv->vals[i],
+					     ipmi_sensor_value_t);
+	sv->vals[i] = NULL;
+    }
+    domain_ref = swig_make_ref(domain, ipmi_domain_t);
+    swig_call_cb(sv->cb, "domain_sensor_values_cb", "%p%*o", &domain_ref,
+		 count, val_refs);
+    swig_free_ref_check(domain_ref, ipmi_domain_t);
+    for (i=0; i<count; i++)
+	swig_free_ref(val_refs[i]);
+    if (count)
+	free(val_refs);
+}
+
+static void
+sensor_values_put(sensor_values_t *sv)
+{
+    int last;
+
+    if (sv->lock)
+	swig_os_hnd->lock(swig_os_hnd, sv->lock);
+    sv->pending--;
+    last = (sv->pending == 0);
+    if (sv->lock)
+	swig_os_hnd->unlock(swig_os_hnd, sv->lock);
+    if (!last)
+	return;
+
+    /* If the domain went away there is nobody to report to. */
+    ipmi_domain_pointer_cb(sv->domain_id, sensor_values_deliver, sv);
+    sensor_values_free(sv);
+}
+
+static void
+sensor_values_reading(ipmi_sensor_t             *sensor,
+		      int                       err,
+		      enum ipmi_value_present_e value_present,
+		      unsigned int              raw_value,
+		      double                    value,
+		      ipmi_states_t             *states,
+		      void                      *cb_data)
+{
+    ipmi_sensor_value_t *v = cb_data;
+
+    v->err = err;
+    if (!err) {
+	if ((value_present == IPMI_RAW_VALUE_PRESENT)
+	    || (value_present == IPMI_BOTH_VALUES_PRESENT))
+	{
+	    v->raw_set = 1;
+	    v->raw = raw_value;
+	}
+	if (value_present == IPMI_BOTH_VALUES_PRESENT) {
+	    v->value_set = 1;
+	    v->value = value;
+	}
+	v->states = threshold_states_to_str(states);
+    }
+    sensor_values_put(v->sv);
+}
+
+static void
+sensor_values_states(ipmi_sensor_t *sensor,
+		     int           err,
+		     ipmi_states_t *states,
+		     void          *cb_data)
+{
+    ipmi_sensor_value_t *v = cb_data;
+
+    v->err = err;
+    if (!err)
+	v->states = discrete_states_to_str(states);
+    sensor_values_put(v->sv);
+}
+
+static void
+sensor_values_start(ipmi_entity_t *entity,
+		    ipmi_sensor_t *sensor,
+		    void          *cb_data)
+{
+    sensor_values_t     *sv = cb_data;
+    ipmi_sensor_value_t *v;
+    int                 rv;
+
+    if (sv->count == sv->size) {
+	ipmi_sensor_value_t **nvals;
+	int                 nsize = sv->size ? sv->size * 2 : 32;
+
+	nvals = realloc(sv->vals, nsize * sizeof(*nvals));
+	if (!nvals)
+	    return;
+	sv->vals = nvals;
+	sv->size = nsize;
+    }
+    v = malloc(sizeof(*v));
+    if (!v)
+	return;
+    memset(v, 0, sizeof(*v));
+    v->id = ipmi_sensor_convert_to_id(sensor);
+    ipmi_sensor_get_name(sensor, v->name, sizeof(v->name));
+    v->sv = sv;
+    sv->vals[sv->count++] = v;
+
+    if (sv->lock)
+	swig_os_hnd->lock(swig_os_hnd, sv->lock);
+    sv->pending++;
+    if (sv->lock)
+	swig_os_hnd->unlock(swig_os_hnd, sv->lock);
+
+    if (ipmi_sensor_get_event_reading_type(sensor)
+	== IPMI_EVENT_READING_TYPE_THRESHOLD)
+    {
+	v->threshold = 1;
+	rv = ipmi_sensor_get_reading(sensor, sensor_values_reading, v);
+    } else {
+	rv = ipmi_sensor_get_states(sensor, sensor_values_states, v);
+    }
+    if (rv) {
+	v->err = rv;
+	sensor_values_put(sv);
+    }
+}
+
+static void
+sensor_values_entity(ipmi_entity_t *entity, void *cb_data)
+{
+    ipmi_entity_iterate_sensors(entity, sensor_values_start, cb_data);
+}
+
+static void
+domain_events_deliver(ipmi_domain_t *domain, swig_cb_val cb)
+{
+    swig_ref     domain_ref;
+    swig_ref     *event_refs;
+    ipmi_event_t *event, *next;
+    unsigned int count;
+    int          size, len = 0;
+    int          i;
+
+    if (ipmi_domain_sel_count(domain, &count))
+	count = 0;
+    size = count + 1;
+    event_refs = malloc(size * sizeof(swig_ref));
+    event = event_refs ? ipmi_domain_first_event(domain) : NULL;
+    while (event) {
+	if (len == size) {
+	    /* Events came in while we were going through them. */
+	    swig_ref *nrefs = realloc(event_refs, size * 2 * sizeof(swig_ref));
+	    if (!nrefs) {
+		ipmi_event_free(event);
+		break;
+	    }
+	    event_refs = nrefs;
+	    size *= 2;
+	}
+	next = ipmi_domain_next_event(domain, event);
+	/* The reference owns the event now. */
+	event_refs[len++] = swig_make_ref_destruct(event, ipmi_event_t);
+	event = next;
+    }
+
+    domain_ref = swig_make_ref(domain, ipmi_domain_t);
+    swig_call_cb(cb, "domain_events_cb", "%p%*o", &domain_ref,
+		 len, event_refs);
+    swig_free_ref_check(domain_ref, ipmi_domain_t);
+    for (i=0; i<len; i++)
+	swig_free_ref(event_refs[i]);
+    if (event_refs)
+	free(event_refs);
+}
+
+/*
+ * The SEL export record: MC channel, MC IPMB address, record id (2
+ * bytes, little endian), record type, then the 13 bytes of record
+ * data as in the SEL.
+ */
+#define SEL_EXPORT_RECORD_SIZE 18
+
+static void
+sel_export_event(ipmi_event_t *event, unsigned char *d)
+{
+    ipmi_mcid_t  mcid = ipmi_event_get_mcid(event);
+    unsigned int id = ipmi_event_get_record_id(event);
+    unsigned int len;
+
+    memset(d, 0, SEL_EXPORT_RECORD_SIZE);
+    d[0] = mcid.channel;
+    d[1] = mcid.mc_num;
+    d[2] = id & 0xff;
+    d[3] = (id >> 8) & 0xff;
+    d[4] = ipmi_event_get_type(event);
+    len = ipmi_event_get_data_len(event);
+    if (len > SEL_EXPORT_RECORD_SIZE - 5)
+	len = SEL_EXPORT_RECORD_SIZE - 5;
+    ipmi_event_get_data(event, d + 5, 0, len);
+}
+
 static int
 str_to_color(char *s, int len, int *color)
 {
@@ -2996,6 +3272,9 @@ typedef struct {
 typedef struct {
 } ipmi_event_t;
 
+typedef struct {
+} ipmi_sensor_value_t;
+
 typedef struct {
 } ipmi_sensor_t;
 
@@ -4418,6 +4697,21 @@ char *get_error_string(unsigned int val);
 	return ipmi_domain_get_ipmb_rescan_time(self);
     }
 
+    /*
+     * Only scan the whole IPMB bus this often (in seconds), the
+     * rescans in between only probe the known MCs.  0, the default,
+     * scans the whole bus every time.
+     */
+    void set_ipmb_full_rescan_time(int seconds)
+    {
+	ipmi_domain_set_ipmb_full_rescan_time(self, seconds);
+    }
+
+    int get_ipmb_full_rescan_time()
+    {
+	return ipmi_domain_get_ipmb_full_rescan_time(self);
+    }
+
     /*
      * Add a handler to be called when a new unhandled event comes
      * into the domain.  When the event comes in, the event_cb method
@@ -4506,6 +4800,109 @@ char *get_error_string(unsigned int val);
 	    return count;
     }
 
+%constant int SEL_EXPORT_RECORD_SIZE = SEL_EXPORT_RECORD_SIZE;
+    /*
+     * Return the whole local copy of the domain's SEL as one string
+     * of SEL_EXPORT_RECORD_SIZE byte records, so a large SEL can be
+     * exported without fetching each event as an object.  Each record
+     * is the MC's channel, the MC's IPMB address, the record id
+     * (little endian), the record type, and the 13 bytes of the
+     * record's data.
+     */
+    bytebuf sel_export()
+    {
+	bytebuf      rv;
+	ipmi_event_t *event, *next;
+	unsigned int count;
+	int          size, len = 0;
+
+	if (ipmi_domain_sel_count(self, &count))
+	    count = 0;
+	size = (count + 1) * SEL_EXPORT_RECORD_SIZE;
+	rv.val = malloc(size);
+	event = rv.val ? ipmi_domain_first_event(self) : NULL;
+	while (event) {
+	    if (len + SEL_EXPORT_RECORD_SIZE > size) {
+		/* Events came in while we were going through them. */
+		char *nval = realloc(rv.val, size * 2);
+		if (!nval) {
+		    ipmi_event_free(event);
+		    break;
+		}
+		rv.val = nval;
+		size *= 2;
+	    }
+	    sel_export_event(event, (unsigned char *) rv.val + len);
+	    len += SEL_EXPORT_RECORD_SIZE;
+	    next = ipmi_domain_next_event(self, event);
+	    ipmi_event_free(event);
+	    event = next;
+	}
+	rv.len = len;
+	return rv;
+    }
+
+    /*
+     * Get all the events in the local copy of the domain's SEL in
+     * one call.  The domain_events_cb method of the first parameter
+     * is called once, right away, with the following parameters:
+     * <self> <domain> <events>.  In Python events is a list of
+     * ipmi_event_t objects, in Perl the events are the rest of the
+     * parameters.
+     */
+    int get_events(swig_cb handler)
+    {
+	swig_cb_val handler_val;
+	int         rv = 0;
+
+	IPMI_SWIG_C_CB_ENTRY
+	if (! valid_swig_cb(handler, domain_events_cb))
+	    rv = EINVAL;
+	else {
+	    handler_val = get_swig_cb(handler, domain_events_cb);
+	    domain_events_deliver(self, handler_val);
+	}
+	IPMI_SWIG_C_CB_EXIT
+	return rv;
+    }
+
+    /*
+     * Read every sensor in the domain.  All the reads are started at
+     * once, and when they are all done the domain_sensor_values_cb
+     * method of the first parameter is called once with the
+     * following parameters: <self> <domain> <values>, where values is
+     * a list of ipmi_sensor_value_t objects, one for each sensor.  In
+     * Perl the values are the rest of the parameters.
+     */
+    int get_sensor_values(swig_cb handler)
+    {
+	int             rv = 0;
+	sensor_values_t *sv;
+
+	IPMI_SWIG_C_CB_ENTRY
+	if (! valid_swig_cb(handler, domain_sensor_values_cb))
+	    rv = EINVAL;
+	else if (!(sv = malloc(sizeof(*sv))))
+	    rv = ENOMEM;
+	else {
+	    memset(sv, 0, sizeof(*sv));
+	    if (swig_os_hnd->create_lock)
+		rv = swig_os_hnd->create_lock(swig_os_hnd, &sv->lock);
+	    if (rv) {
+		free(sv);
+	    } else {
+		sv->cb = ref_swig_cb(handler, domain_sensor_values_cb);
+		sv->domain_id = ipmi_domain_convert_to_id(self);
+		/* Hold it until everything is started. */
+		sv->pending = 1;
+		ipmi_domain_iterate_entities(self, sensor_values_entity, sv);
+		sensor_values_put(sv);
+	    }
+	}
+	IPMI_SWIG_C_CB_EXIT
+	return rv;
+    }
+
     /*
      * Reread all SELs in the domain.  The domain_reread_sels_cb
      * method on the first parameter (if supplied) will be called with
@@ -9800,6 +10197,88 @@ ipmi_args_t *alloc_parse_args(argarray *args);
 /*
  * An event object
  */
+/*
+ * A sensor reading from ipmi_domain_t get_sensor_values.
+ */
+%extend ipmi_sensor_value_t {
+    ~ipmi_sensor_value_t()
+    {
+	free(self->states);
+	free(self);
+    }
+
+    %newobject get_sensor_id;
+    /*
+     * Get the id of the sensor that was read.
+     */
+    ipmi_sensor_id_t *get_sensor_id()
+    {
+	ipmi_sensor_id_t *rv = malloc(sizeof(*rv));
+	if (rv)
+	    *rv = self->id;
+	return rv;
+    }
+
+    /*
+     * Get the name of the sensor that was read.
+     */
+    const char *get_name()
+    {
+	return self->name;
+    }
+
+    /*
+     * The error from reading the sensor, 0 if the read worked.  The
+     * other values are not valid if this is not 0.
+     */
+    int get_err()
+    {
+	return self->err;
+    }
+
+    /*
+     * True if this is a threshold sensor, the states are then in the
+     * threshold_reading_cb format and not the discrete_states_cb one.
+     */
+    int is_threshold()
+    {
+	return self->threshold;
+    }
+
+    /*
+     * For threshold sensors, whether the raw value and the converted
+     * value are present and what they are.
+     */
+    int raw_set()
+    {
+	return self->raw_set;
+    }
+
+    int get_raw()
+    {
+	return self->raw;
+    }
+
+    int value_set()
+    {
+	return self->value_set;
+    }
+
+    double get_value()
+    {
+	return self->value;
+    }
+
+    /*
+     * The sensor's states, in the same string form the sensor's
+     * get_value callbacks return.
+     */
+    const char *get_states()
+    {
+	return self->states ? self->states : "";
+    }
+}
+
 %extend ipmi_event_t {
     ~ipmi_event_t()
     {
@@ -300,6 +300,15 @@
     /* Nothing to do, input only */
 };
 
+%typemap(out) bytebuf {
+    if (!$1.val)
+	croak("Unable to allocate bytebuf");
+    $result = newSVpvn($1.val, $1.len);
+    free($1.val);
+    sv_2mortal($result);
+    argvi++;
+}
+
 %{
 #if PERL_HAS_POSIX_THREADS
 #define USE_POSIX_THREADS
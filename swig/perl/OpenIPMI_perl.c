@@ -82,8 +82,10 @@ vswig_call_cb_rv(char rv_type, void *rv,
 		/* An array of unsigned characters */
 		len = va_arg(ap, int);
 		data = va_arg(ap, unsigned char *);
+		if (len > 0)
+		    EXTEND(SP, len);
 		while (len > 0) {
-		    XPUSHs(sv_2mortal(newSViv(*data)));
+		    PUSHs(sv_2mortal(newSViv(*data)));
 		    data++;
 		    len--;
 		}
@@ -93,8 +95,10 @@ vswig_call_cb_rv(char rv_type, void *rv,
 		/* An array of integers */
 		len = va_arg(ap, int);
 		idata = va_arg(ap, int *);
+		if (len > 0)
+		    EXTEND(SP, len);
 		while (len > 0) {
-		    XPUSHs(sv_2mortal(newSViv(*idata)));
+		    PUSHs(sv_2mortal(newSViv(*idata)));
 		    idata++;
 		    len--;
 		}
@@ -112,8 +116,12 @@ vswig_call_cb_rv(char rv_type, void *rv,
 		    swig_ref *list;
 		    len = va_arg(ap, int);
 		    list = va_arg(ap, swig_ref *);
+		    /* These may be big (a whole SEL), grow the stack
+		       once instead of checking on every push. */
+		    if (len > 0)
+			EXTEND(SP, len);
 		    while (len > 0) {
-			XPUSHs(list->val);
+			PUSHs(list->val);
 			list++;
 			len--;
 		    }
@@ -422,6 +422,15 @@
     /* Nothing to do, input only */
 };
 
+%typemap(out) bytebuf {
+    if (!$1.val) {
+	PyErr_SetString(PyExc_MemoryError, "Unable to allocate bytebuf");
+	return NULL;
+    }
+    $result = PyString_FromStringAndSize($1.val, $1.len);
+    free($1.val);
+};
+
 %{
 
 #if PYTHON_HAS_POSIX_THREADS
@@ -355,12 +355,6 @@ class Domain:
         DomainSaver(self, doc, elem)
         return
 
-    def HandleExpand(self, event):
-        for i in self.refreshers:
-            i.DoUpdate()
-            pass
-        return
-
     def HandleMenu(self, event):
         gui_popup.popup(self.ui, event,
                         [ [ "Close",        self.CloseMenuHandler ],
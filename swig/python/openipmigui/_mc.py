@@ -318,12 +318,6 @@ class MC:
         self.ui.set_item_text(self.mguid, mc.get_guid())
         return
 
-    def HandleExpand(self, event):
-        for i in self.refreshers:
-            i.DoUpdate()
-            pass
-        return
-
     def HandleMenu(self, event):
         l = [ ]
         if self.has_sel:
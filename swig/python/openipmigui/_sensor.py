@@ -41,7 +41,7 @@ class SensorRefreshData:
 
     def sensor_cb(self, sensor):
         if (sensor.is_readable()):
-            sensor.get_value(self.s)
+            self.s.start_read(sensor)
         return
 
     pass
@@ -339,6 +339,7 @@ class Sensor:
         self.ui = e.ui
         ui = self.ui
         self.destroyed = False
+        self.reading = False
         self.updater = SensorRefreshData(self)
         ui.add_sensor(self.e, self)
         self.in_warning = False
@@ -368,7 +369,11 @@ class Sensor:
 
         sensor.add_event_handler(self)
         if (sensor.is_readable()):
-            sensor.get_value(self)
+            # Don't read sensors nobody can see, opening the tree or
+            # the refresh timer will get it when it comes on the screen.
+            if (self.is_shown()):
+                self.start_read(sensor)
+                pass
             pass
         else:
             self.ui.set_item_text(self.treeroot, "(not readable)")
@@ -546,6 +551,20 @@ class Sensor:
         self.sensor_id.to_sensor(self.updater)
         return
 
+    def is_shown(self):
+        return ((self.impt_data != None)
+                or self.ui.item_visible(self.treeroot))
+
+    def start_read(self, sensor):
+        # Only have one read outstanding, if the value is asked for
+        # again while waiting the pending read will give it.
+        if (self.reading):
+            return
+        if (sensor.get_value(self) == 0):
+            self.reading = True
+            pass
+        return
+
     def HandleMenu(self, event):
         if (self.impt_data == None):
             l = [ [ "Add to watch values", self.add_impt ] ]
@@ -655,6 +674,7 @@ class Sensor:
 
     def threshold_reading_cb(self, sensor, err, raw_set, raw, value_set,
                              value, states):
+        self.reading = False
         if (self.destroyed):
             return
         if (err):
@@ -673,6 +693,7 @@ class Sensor:
         return
         
     def discrete_states_cb(self, sensor, err, states):
+        self.reading = False
         if (self.destroyed):
             return
         if (err):
@@ -715,7 +736,9 @@ class Sensor:
         if (self.destroyed):
             return OpenIPMI.EVENT_NOT_HANDLED
         self.handle_threshold_states(event_spec)
-        sensor.get_value(self)
+        if (self.is_shown()):
+            self.start_read(sensor)
+            pass
         return OpenIPMI.EVENT_NOT_HANDLED
         
     def discrete_event_cb(self, sensor, event_spec, severity, old_severity,
@@ -200,6 +200,9 @@ class IPMIGUI(Tix.Frame):
         evpane = hpane.add("events")
 
         self.tree = Tix.Tree(objpane, options="hlist.columns 2")
+        # Values are only fetched for things on the screen, so do the
+        # fetch when a branch is opened.
+        self.tree.configure(opencmd=self.TreeOpen)
         # FIXME: This doesn't work, and I don't know why
         self.tree.hlist.configure(selectbackground="beige")
         self.tree.hlist.add("D", itemtype=Tix.TEXT, text="Domains")
@@ -377,8 +380,8 @@ class IPMIGUI(Tix.Frame):
             pass
         while (callcount < 100) and (checkcount < 1000) and (next != ""):
             if (self.tree.hlist.info_hidden(next) == "1"):
-                # Not on the screen, ignore it
-                next = self.tree.hlist.info_next(next)
+                # Not on the screen, ignore it and everything under it
+                next = self.next_after_subtree(next)
                 continue
             data = self.treedata[next]
             if (data != None) and (hasattr(data, "DoUpdate")):
@@ -399,6 +402,25 @@ class IPMIGUI(Tix.Frame):
         
         return
         
+    def next_after_subtree(self, item):
+        while (item != "D"):
+            parent = self.tree.hlist.info_parent(item)
+            children = self.tree.hlist.info_children(parent)
+            i = list(children).index(item) + 1
+            if (i < len(children)):
+                return children[i]
+            item = parent
+            pass
+        return ""
+
+    def item_visible(self, item):
+        while (item != None):
+            if (self.tree.hlist.info_hidden(item) == "1"):
+                return False
+            item = self.parent_item(item)
+            pass
+        return True
+
     def quit(self, event=None):
         self.mainhandler.destroy()
         return
@@ -841,11 +863,18 @@ class IPMIGUI(Tix.Frame):
             pass
         return
 
-    def TreeExpanded(self, event):
-        item = event.GetItem()
-        data = self.tree.GetPyData(item)
-        if (data != None) and (hasattr(data, "HandleExpand")):
-            data.HandleExpand(event)
+    def TreeOpen(self, item):
+        children = self.tree.hlist.info_children(item)
+        for child in children:
+            self.tree.hlist.show_entry(child)
+            pass
+        # The children just came onto the screen, get their values now
+        # instead of waiting for the refresh timer to get to them.
+        for child in children:
+            data = self.treedata[child]
+            if (data != None) and (hasattr(data, "DoUpdate")):
+                data.DoUpdate()
+                pass
             pass
         return
 
@@ -56,11 +56,61 @@
 
 #include <tcl.h>
 
+/*
+ * Tcl keeps its timer handlers in a sorted linked list, which gets
+ * expensive with a lot of OpenIPMI timers.  So keep the OpenIPMI
+ * timers in our own heap and only give Tcl a single timer handler,
+ * for the first one to expire.  When it goes off, all the expired
+ * timers are run.
+ */
+typedef struct heap_val_s
+{
+    void           *cb_data;
+    os_timed_out_t timed_out;
+    int            running;
+    os_handler_t   *handler;
+    Tcl_Time       timeout;
+} heap_val_t;
+
+#define heap_s tcl_timer_heap_s
+#define heap_node_s os_hnd_timer_id_s
+#define HEAP_EXPORT_NAME(s) theap_ ## s
+#define HEAP_NAMES_LOCAL static
+#define HEAP_OUTPUT_PRINTF "(%ld.%7.7ld)"
+#define HEAP_OUTPUT_DATA pos->val.timeout.sec, pos->val.timeout.usec
+
+static int
+cmp_tcl_time(const Tcl_Time *t1, const Tcl_Time *t2)
+{
+    if (t1->sec < t2->sec)
+	return -1;
+    if (t1->sec > t2->sec)
+	return 1;
+    if (t1->usec < t2->usec)
+	return -1;
+    if (t1->usec > t2->usec)
+	return 1;
+    return 0;
+}
+
+static int
+heap_cmp_key(heap_val_t *v1, heap_val_t *v2)
+{
+    return cmp_tcl_time(&v1->timeout, &v2->timeout);
+}
+
+#include "heap.h"
+
 typedef struct t_os_hnd_data_s
 {
     int       priority;
     os_vlog_t log_handler;
 
+    /* The OpenIPMI timers, and the one Tcl timer that runs them. */
+    struct tcl_timer_heap_s timer_heap;
+    Tcl_TimerToken          timer_token;
+    Tcl_Time                timer_time;
+
 #ifdef HAVE_GDBM
     char      *gdbm_filename;
     GDBM_FILE gdbmf;
@@ -127,28 +177,68 @@ remove_fd(os_handler_t *handler, os_hnd_fd_id_t *fd_data)
     return 0;
 }
 
-struct os_hnd_timer_id_s
+static void timer_handler(ClientData data);
+
+/*
+ * Make sure the Tcl timer is set for the first timer in the heap.  If
+ * it is already set for that time, leave it alone.
+ */
+static void
+timer_rearm(t_os_hnd_data_t *info)
 {
-    void           *cb_data;
-    os_timed_out_t timed_out;
-    int            running;
-    os_handler_t   *handler;
-    Tcl_TimerToken token;
-};
+    os_hnd_timer_id_t *top = theap_get_top(&info->timer_heap);
+    Tcl_Time          now;
+    long long         interval;
+
+    if (!top) {
+	if (info->timer_token) {
+	    Tcl_DeleteTimerHandler(info->timer_token);
+	    info->timer_token = NULL;
+	}
+	return;
+    }
+
+    if (info->timer_token
+	&& cmp_tcl_time(&info->timer_time, &top->val.timeout) == 0)
+	return;
+
+    if (info->timer_token)
+	Tcl_DeleteTimerHandler(info->timer_token);
+
+    Tcl_GetTime(&now);
+    interval = ((long long) (top->val.timeout.sec - now.sec) * 1000000
+		+ (top->val.timeout.usec - now.usec));
+    interval = (interval + 999) / 1000;
+    if (interval < 0)
+	interval = 0;
+    info->timer_time = top->val.timeout;
+    info->timer_token = Tcl_CreateTimerHandler(interval, timer_handler, info);
+}
 
 static void
 timer_handler(ClientData data)
 {
-    os_hnd_timer_id_t *timer_data = (os_hnd_timer_id_t *) data;
+    t_os_hnd_data_t   *info = data;
+    os_hnd_timer_id_t *timer_data;
     /* Make a copy of this, because the handler may delete the timer
        data. */
     void              *cb_data;
     os_timed_out_t    timed_out;
+    Tcl_Time          now;
 
-    timed_out = timer_data->timed_out;
-    cb_data = timer_data->cb_data;
-    timer_data->running = 0;
-    timed_out(cb_data, timer_data);
+    info->timer_token = NULL;
+    Tcl_GetTime(&now);
+    for (;;) {
+	timer_data = theap_get_top(&info->timer_heap);
+	if (!timer_data || cmp_tcl_time(&timer_data->val.timeout, &now) > 0)
+	    break;
+	theap_remove(&info->timer_heap, timer_data);
+	timed_out = timer_data->val.timed_out;
+	cb_data = timer_data->val.cb_data;
+	timer_data->val.running = 0;
+	timed_out(cb_data, timer_data);
+    }
+    timer_rearm(info);
 }
 
 static int
@@ -158,28 +248,41 @@ start_timer(os_handler_t      *handler,
 	    os_timed_out_t    timed_out,
 	    void              *cb_data)
 {
-    int interval;
+    t_os_hnd_data_t *info = handler->internal_data;
 
-    if (id->running)
+    if (id->val.running)
 	return EBUSY;
 
-    id->running = 1;
-    id->cb_data = cb_data;
-    id->timed_out = timed_out;
+    id->val.running = 1;
+    id->val.cb_data = cb_data;
+    id->val.timed_out = timed_out;
+
+    Tcl_GetTime(&id->val.timeout);
+    id->val.timeout.sec += timeout->tv_sec;
+    id->val.timeout.usec += timeout->tv_usec;
+    while (id->val.timeout.usec >= 1000000) {
+	id->val.timeout.sec += 1;
+	id->val.timeout.usec -= 1000000;
+    }
 
-    interval = (timeout->tv_sec * 1000) | ((timeout->tv_usec + 999) / 1000);
-    id->token = Tcl_CreateTimerHandler(interval, timer_handler, id);
+    theap_add(&info->timer_heap, id);
+    if (theap_get_top(&info->timer_heap) == id)
+	timer_rearm(info);
     return 0;
 }
 
 static int
 stop_timer(os_handler_t *handler, os_hnd_timer_id_t *id)
 {
-    if (!id->running)
+    t_os_hnd_data_t *info = handler->internal_data;
+
+    if (!id->val.running)
 	return EINVAL;
 
-    id->running = 0;
-    Tcl_DeleteTimerHandler(id->token);
+    id->val.running = 0;
+    theap_remove(&info->timer_heap, id);
+    /* If this was the first timer, the Tcl timer is left alone and
+       just rearms itself when it goes off early. */
     return 0;
 }
 
@@ -193,9 +296,8 @@ alloc_timer(os_handler_t      *handler,
     if (!timer_data)
 	return ENOMEM;
 
-    timer_data->running = 0;
-    timer_data->timed_out = NULL;
-    timer_data->handler = handler;
+    memset(timer_data, 0, sizeof(*timer_data));
+    timer_data->val.handler = handler;
 
     *id = timer_data;
     return 0;
@@ -204,7 +306,7 @@ alloc_timer(os_handler_t      *handler,
 static int
 free_timer(os_handler_t *handler, os_hnd_timer_id_t *id)
 {
-    if (id->running)
+    if (id->val.running)
 	return EBUSY;
 
     free(id);
@@ -541,6 +643,8 @@ free_os_handler(os_handler_t *os_hnd)
 {
     t_os_hnd_data_t *info = os_hnd->internal_data;
 
+    if (info->timer_token)
+	Tcl_DeleteTimerHandler(info->timer_token);
 #ifdef HAVE_GDBM
     Tcl_MutexFinalize(&info->gdbm_lock);
     if (info->gdbm_filename)
@@ -765,6 +869,7 @@ ipmi_tcl_get_os_handler(int priority)
 	return NULL;
     }
     memset(info, 0, sizeof(*info));
+    theap_init(&info->timer_heap);
 
     info->priority = priority;
     rv->internal_data = info;
@@ -128,7 +128,8 @@ enum {
     DISPLAY_NONE, DISPLAY_SENSOR, DISPLAY_SENSORS,
     DISPLAY_CONTROLS, DISPLAY_CONTROL, DISPLAY_ENTITIES, DISPLAY_MCS,
     DISPLAY_MC,
-    DISPLAY_RSP, DISPLAY_SDRS, HELP, EVENTS, DISPLAY_ENTITY, DISPLAY_FRU
+    DISPLAY_RSP, DISPLAY_SDRS, HELP, EVENTS, DISPLAY_ENTITY, DISPLAY_FRU,
+    DISPLAY_WATCH
 } curr_display_type;
 ipmi_sensor_id_t curr_sensor_id;
 ipmi_control_id_t curr_control_id;
@@ -1552,6 +1553,272 @@ sensors_cmd(char *cmd, char **toks, void *cb_data)
     return 0;
 }
 
+/*
+ * The watch display.  Each sensor gets a line with its value, the
+ * positions are fixed when the display is set up.  Every redisplay
+ * tick reads the sensors on the lines that are on the screen and only
+ * rewrites the value of a sensor if it changed, the pad is refreshed
+ * once when all the reads from the tick are in.  So the cost of a
+ * tick depends on the size of the screen, not the number of sensors.
+ */
+#define WATCH_VALUE_WIDTH 16
+/* Leave the last column empty so the lines don't wrap. */
+#define WATCH_NAME_WIDTH  (DISPLAY_WIN_COLS - WATCH_VALUE_WIDTH - 4)
+typedef struct watch_entry_s
+{
+    ipmi_sensor_id_t id;
+    int              y;
+    int              pending;
+    char             last[WATCH_VALUE_WIDTH+1];
+} watch_entry_t;
+static watch_entry_t *watch_entries;
+static int watch_count;
+static int watch_size;
+static int watch_outstanding;
+static int watch_dirty;
+
+static void
+watch_sensor_add(ipmi_entity_t *entity, ipmi_sensor_t *sensor, void *cb_data)
+{
+    char          name[33];
+    char          loc[MAX_ENTITY_LOC_SIZE];
+    char          fullname[MAX_ENTITY_LOC_SIZE + 34];
+    watch_entry_t *e;
+    int           y;
+
+    y = getcury(display_pad);
+    if (y >= NUM_DISPLAY_LINES - 1)
+	/* No more room in the pad. */
+	return;
+
+    if (watch_count == watch_size) {
+	int           nsize = watch_size ? watch_size * 2 : 64;
+	watch_entry_t *n = ipmi_mem_alloc(nsize * sizeof(*n));
+
+	if (!n)
+	    return;
+	if (watch_entries) {
+	    memcpy(n, watch_entries, watch_count * sizeof(*n));
+	    ipmi_mem_free(watch_entries);
+	}
+	watch_entries = n;
+	watch_size = nsize;
+    }
+    e = &watch_entries[watch_count++];
+    e->id = ipmi_sensor_convert_to_id(sensor);
+    e->y = y;
+    e->pending = 0;
+    e->last[0] = '\0';
+
+    ipmi_sensor_get_id(sensor, name, 33);
+    conv_from_spaces(name);
+    snprintf(fullname, sizeof(fullname), "%s.%s",
+	     get_entity_loc(entity, loc, sizeof(loc)), name);
+    display_pad_out("  %-*.*s ?\n", WATCH_NAME_WIDTH, WATCH_NAME_WIDTH,
+		    fullname);
+}
+
+static void
+watch_entity_add(ipmi_entity_t *entity, void *cb_data)
+{
+    ipmi_entity_iterate_sensors(entity, watch_sensor_add, NULL);
+}
+
+static void
+watch_start(void)
+{
+    watch_count = 0;
+    watch_outstanding = 0;
+    watch_dirty = 0;
+    curr_display_type = DISPLAY_WATCH;
+    display_pad_clear();
+}
+
+static void
+watch_domain(ipmi_domain_t *domain, void *cb_data)
+{
+    watch_start();
+    display_pad_out("Watching all sensors:\n");
+    ipmi_domain_iterate_entities(domain, watch_entity_add, NULL);
+    display_pad_refresh();
+}
+
+static void
+found_entity_for_watch(ipmi_entity_t *entity,
+		       char          **toks,
+		       char          **toks2,
+		       void          *cb_data)
+{
+    char loc[MAX_ENTITY_LOC_SIZE];
+
+    watch_start();
+    display_pad_out("Watching sensors for entity %s:\n",
+		    get_entity_loc(entity, loc, sizeof(loc)));
+    watch_entity_add(entity, NULL);
+    display_pad_refresh();
+}
+
+static void
+watch_set_value(int idx, char *val)
+{
+    watch_entry_t *e = &watch_entries[idx];
+
+    if (strcmp(e->last, val) == 0)
+	return;
+    strncpy(e->last, val, WATCH_VALUE_WIDTH);
+    e->last[WATCH_VALUE_WIDTH] = '\0';
+    wmove(display_pad, e->y, WATCH_NAME_WIDTH + 3);
+    display_pad_out("%-*s", WATCH_VALUE_WIDTH, e->last);
+    watch_dirty = 1;
+}
+
+/* Find the entry a read is for, it may be from an old watch. */
+static int
+watch_read_done(ipmi_sensor_t *sensor, void *cb_data)
+{
+    int idx = (long) cb_data;
+
+    if ((curr_display_type != DISPLAY_WATCH) || (idx >= watch_count))
+	return -1;
+    if (ipmi_cmp_sensor_id(ipmi_sensor_convert_to_id(sensor),
+			   watch_entries[idx].id) != 0)
+	return -1;
+    if (!watch_entries[idx].pending)
+	return -1;
+    watch_entries[idx].pending = 0;
+    watch_outstanding--;
+    return idx;
+}
+
+static void
+watch_tick_done(void)
+{
+    if ((watch_outstanding == 0) && watch_dirty) {
+	watch_dirty = 0;
+	display_pad_refresh();
+    }
+}
+
+static void
+watch_read_sensor(ipmi_sensor_t             *sensor,
+		  int                       err,
+		  enum ipmi_value_present_e value_present,
+		  unsigned int              raw_val,
+		  double                    val,
+		  ipmi_states_t             *states,
+		  void                      *cb_data)
+{
+    char               str[WATCH_VALUE_WIDTH+1];
+    int                idx;
+    int                oor = 0;
+    enum ipmi_thresh_e t;
+
+    idx = watch_read_done(sensor, cb_data);
+    if (idx < 0)
+	return;
+
+    if (!err) {
+	for (t=IPMI_LOWER_NON_CRITICAL; t<=IPMI_UPPER_NON_RECOVERABLE; t++)
+	    oor |= ipmi_is_threshold_out_of_range(states, t);
+    }
+    if (err)
+	snprintf(str, sizeof(str), "unreadable: %x", err);
+    else if (value_present == IPMI_BOTH_VALUES_PRESENT)
+	snprintf(str, sizeof(str), "%f%s", val, oor ? " !" : "");
+    else if (value_present == IPMI_RAW_VALUE_PRESENT)
+	snprintf(str, sizeof(str), "0x%x (RAW)%s", raw_val, oor ? " !" : "");
+    else
+	snprintf(str, sizeof(str), "unreadable");
+    watch_set_value(idx, str);
+    watch_tick_done();
+}
+
+static void
+watch_read_states(ipmi_sensor_t *sensor,
+		  int           err,
+		  ipmi_states_t *states,
+		  void          *cb_data)
+{
+    char         str[WATCH_VALUE_WIDTH+1];
+    int          idx;
+    int          i;
+    unsigned int bits = 0;
+
+    idx = watch_read_done(sensor, cb_data);
+    if (idx < 0)
+	return;
+
+    if (err) {
+	snprintf(str, sizeof(str), "unreadable: %x", err);
+    } else {
+	for (i=0; i<15; i++) {
+	    if (ipmi_is_state_set(states, i))
+		bits |= 1 << i;
+	}
+	snprintf(str, sizeof(str), "states 0x%4.4x", bits);
+    }
+    watch_set_value(idx, str);
+    watch_tick_done();
+}
+
+static void
+watch_read(ipmi_sensor_t *sensor, void *cb_data)
+{
+    int idx = (long) cb_data;
+    int rv;
+
+    if (ipmi_sensor_get_event_reading_type(sensor)
+	== IPMI_EVENT_READING_TYPE_THRESHOLD)
+	rv = ipmi_sensor_get_reading(sensor, watch_read_sensor, cb_data);
+    else
+	rv = ipmi_sensor_get_states(sensor, watch_read_states, cb_data);
+    if (!rv) {
+	watch_entries[idx].pending = 1;
+	watch_outstanding++;
+    }
+}
+
+static void
+watch_redisplay(void)
+{
+    int i;
+
+    for (i=0; i<watch_count; i++) {
+	watch_entry_t *e = &watch_entries[i];
+
+	/* Only what is on the screen, and nothing still in progress. */
+	if ((e->y < display_pad_top_line)
+	    || (e->y >= display_pad_top_line + DISPLAY_WIN_LINES))
+	    continue;
+	if (e->pending)
+	    continue;
+	if (ipmi_sensor_pointer_cb(e->id, watch_read, (void *) (long) i))
+	    watch_set_value(i, "gone");
+    }
+    watch_tick_done();
+}
+
+int
+watch_cmd(char *cmd, char **toks, void *cb_data)
+{
+    int rv;
+
+    if (!full_screen) {
+	cmd_win_out("watch only works in full-screen mode\n");
+	return 0;
+    }
+
+    if (*toks && (strspn(*toks, " \t\n") != strlen(*toks))) {
+	entity_finder(cmd, toks, found_entity_for_watch, NULL);
+	return 0;
+    }
+
+    rv = ipmi_domain_pointer_cb(domain_id, watch_domain, NULL);
+    if (rv)
+	cmd_win_out("Unable to convert domain id to a pointer\n");
+    return 0;
+}
+
 struct sensor_info {
     int  found;
     char *name;
@@ -6322,6 +6589,11 @@ static struct {
       " - Check all the entities hot-swap states" },
     { "sensors",	sensors_cmd,
       " <entity name> - list all the sensors that monitor the entity" },
+    { "watch",		watch_cmd,
+      " [<entity name>] - show the values of all the sensors, or the"
+      " entity's sensors, and keep them updated.  Only the sensors"
+      " on the screen are read, scroll the display window to see"
+      " the rest" },
     { "sensor",		sensor_cmd,
       " <sensor name> - Pull up all the information on the sensor and start"
       " monitoring it" },
@@ -6982,6 +7254,8 @@ redisplay_timeout(void *cb_data, os_hnd_timer_id_t *id)
 	if (rv)
 	    ui_log("redisplay_timeout: Unable to get sensor pointer: 0x%x\n",
 		   rv);
+    } else if (curr_display_type == DISPLAY_WATCH) {
+	watch_redisplay();
     }
 
     ipmi_ui_os_hnd->get_monotonic_time(ipmi_ui_os_hnd, &now);
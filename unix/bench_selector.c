@@ -0,0 +1,667 @@
+/*
+ * bench_selector.c
+ *
+ * Microbenchmarks for the selector.
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+/*
+ * Times the selector's timer and fd operations so the timer heap and
+ * wheel and the select, epoll and io_uring backends can be compared
+ * on a given machine.  The tests are:
+ *
+ *   churn  - Start <count> timers well in the future and stop them
+ *            all again, <rounds> times.  Nothing is waiting in the
+ *            selector.
+ *   expire - Start <count> timers spread evenly over <spread> ms and
+ *            run the selector until they have all gone off.  Reports
+ *            the CPU time per expiry and how late they ran.
+ *   fd     - Add <count> fds and enable reading, then clear them, with
+ *            another thread waiting in the selector, <rounds> times.
+ *   wake   - With another thread waiting in the selector, make a pipe
+ *            readable or start an expired timer from this thread,
+ *            <rounds> times each, and time how long until the handler
+ *            runs.
+ *
+ * Each result is one line of "test timers backend metric value" so it
+ * is easy to pull into other tools.  Times are in nanoseconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <OpenIPMI/selector.h>
+
+static selector_t   *sel;
+static const char   *timer_name = "heap";
+static const char   *backend_name = "epoll";
+static unsigned int count = 10000;
+static unsigned int rounds = 10;
+static unsigned int spread_ms = 1000;
+static int          wake_sig = SIGUSR1;
+
+static pthread_t    sel_thread;
+static volatile int sel_thread_stop;
+
+struct sel_lock_s
+{
+    pthread_mutex_t lock;
+};
+
+static sel_lock_t *
+bench_lock_alloc(void *cb_data)
+{
+    sel_lock_t *l = malloc(sizeof(*l));
+
+    if (l)
+	pthread_mutex_init(&l->lock, NULL);
+    return l;
+}
+
+static void
+bench_lock_free(sel_lock_t *l)
+{
+    pthread_mutex_destroy(&l->lock);
+    free(l);
+}
+
+static void
+bench_lock(sel_lock_t *l)
+{
+    pthread_mutex_lock(&l->lock);
+}
+
+static void
+bench_unlock(sel_lock_t *l)
+{
+    pthread_mutex_unlock(&l->lock);
+}
+
+static void
+err_leave(int err, const char *what)
+{
+    fprintf(stderr, "%s: %s\n", what, strerror(err));
+    exit(1);
+}
+
+static long long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long
+cpu_ns(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ((ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000LL
+	    + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL);
+}
+
+static void
+report(const char *test, const char *metric, double value)
+{
+    printf("%-6s %-5s %-6s %-16s %12.0f\n", test, timer_name, backend_name,
+	   metric, value);
+    fflush(stdout);
+}
+
+static int
+cmp_ll(const void *a, const void *b)
+{
+    long long la = *((const long long *) a), lb = *((const long long *) b);
+
+    return (la > lb) - (la < lb);
+}
+
+/* Report the average, p50, p99 and max of the values, sorting them. */
+static void
+report_dist(const char *test, const char *metric, long long *v,
+	    unsigned int n)
+{
+    char         name[32];
+    long long    total = 0;
+    unsigned int i;
+
+    if (n == 0)
+	return;
+    for (i = 0; i < n; i++)
+	total += v[i];
+    qsort(v, n, sizeof(*v), cmp_ll);
+    snprintf(name, sizeof(name), "%s_avg", metric);
+    report(test, name, (double) total / n);
+    snprintf(name, sizeof(name), "%s_p50", metric);
+    report(test, name, v[n / 2]);
+    snprintf(name, sizeof(name), "%s_p99", metric);
+    report(test, name, v[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1]);
+    snprintf(name, sizeof(name), "%s_max", metric);
+    report(test, name, v[n - 1]);
+}
+
+/***********************************************************************
+ *
+ * The thread waiting in the selector for the fd and wake tests.
+ *
+ **********************************************************************/
+
+static void
+wake_sig_handler(int sig)
+{
+    /* Nothing to do, it just interrupts the wait. */
+}
+
+static void
+send_sig(long thread_id, void *cb_data)
+{
+    pthread_kill(sel_thread, wake_sig);
+}
+
+static void *
+sel_thread_func(void *data)
+{
+    struct timeval tv;
+
+    while (!sel_thread_stop) {
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	sel_select(sel, send_sig, 0, NULL, &tv);
+    }
+    return NULL;
+}
+
+static void
+nop_timeout(selector_t *sel, sel_timer_t *timer, void *data)
+{
+}
+
+static void
+start_sel_thread(void)
+{
+    int rv;
+
+    sel_thread_stop = 0;
+    rv = pthread_create(&sel_thread, NULL, sel_thread_func, NULL);
+    if (rv)
+	err_leave(rv, "pthread_create");
+}
+
+static void
+stop_sel_thread(void)
+{
+    sel_timer_t    *timer;
+    struct timeval tv;
+    int            rv;
+
+    /* An expired timer wakes it up to see the flag. */
+    sel_thread_stop = 1;
+    rv = sel_alloc_timer(sel, nop_timeout, NULL, &timer);
+    if (rv)
+	err_leave(rv, "sel_alloc_timer");
+    sel_get_monotonic_time(&tv);
+    sel_start_timer(timer, &tv);
+    pthread_join(sel_thread, NULL);
+    sel_stop_timer(timer);
+    sel_free_timer(timer);
+}
+
+/***********************************************************************
+ *
+ * Timer tests.
+ *
+ **********************************************************************/
+
+static void
+bench_churn(void)
+{
+    sel_timer_t    **timers;
+    struct timeval now, tv;
+    unsigned int   i, r;
+    long long      start, start_ns = 0, stop_ns = 0;
+    int            rv;
+
+    timers = calloc(count, sizeof(*timers));
+    if (!timers)
+	err_leave(ENOMEM, "churn");
+    for (i = 0; i < count; i++) {
+	rv = sel_alloc_timer(sel, nop_timeout, NULL, &timers[i]);
+	if (rv)
+	    err_leave(rv, "sel_alloc_timer");
+    }
+
+    sel_get_monotonic_time(&now);
+    for (r = 0; r < rounds; r++) {
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+	    /* Spread over 10-20 seconds, in an order that doesn't just
+	       append to the heap. */
+	    tv.tv_sec = now.tv_sec + 10 + ((i * 7919) % 10);
+	    tv.tv_usec = (i * 104729) % 1000000;
+	    sel_start_timer(timers[i], &tv);
+	}
+	start_ns += now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < count; i++)
+	    sel_stop_timer(timers[i]);
+	stop_ns += now_ns() - start;
+    }
+
+    report("churn", "start_ns", (double) start_ns / ((double) count * rounds));
+    report("churn", "stop_ns", (double) stop_ns / ((double) count * rounds));
+
+    for (i = 0; i < count; i++)
+	sel_free_timer(timers[i]);
+    free(timers);
+}
+
+typedef struct expire_timer_s
+{
+    long long    when;
+    long long    *late;
+    unsigned int *fired;
+} expire_timer_t;
+
+static void
+expire_timeout(selector_t *sel, sel_timer_t *timer, void *data)
+{
+    expire_timer_t *e = data;
+
+    e->late[*e->fired] = now_ns() - e->when;
+    (*e->fired)++;
+}
+
+static void
+bench_expire(void)
+{
+    sel_timer_t    **timers;
+    expire_timer_t *e;
+    long long      *late;
+    unsigned int   i, fired = 0;
+    struct timeval now, tv;
+    long long      base_ns, start_cpu, cpu;
+    int            rv;
+
+    timers = calloc(count, sizeof(*timers));
+    e = calloc(count, sizeof(*e));
+    late = calloc(count, sizeof(*late));
+    if (!timers || !e || !late)
+	err_leave(ENOMEM, "expire");
+
+    for (i = 0; i < count; i++) {
+	e[i].late = late;
+	e[i].fired = &fired;
+	rv = sel_alloc_timer(sel, expire_timeout, &e[i], &timers[i]);
+	if (rv)
+	    err_leave(rv, "sel_alloc_timer");
+    }
+
+    /* The selector's time and now_ns() are both CLOCK_MONOTONIC. */
+    sel_get_monotonic_time(&now);
+    base_ns = now.tv_sec * 1000000000LL + now.tv_usec * 1000LL;
+    for (i = 0; i < count; i++) {
+	long long offset_us = ((long long) spread_ms * 1000 * i) / count;
+
+	tv = now;
+	tv.tv_sec += offset_us / 1000000;
+	tv.tv_usec += offset_us % 1000000;
+	if (tv.tv_usec >= 1000000) {
+	    tv.tv_sec++;
+	    tv.tv_usec -= 1000000;
+	}
+	e[i].when = base_ns + offset_us * 1000;
+	sel_start_timer(timers[i], &tv);
+    }
+
+    start_cpu = cpu_ns();
+    while (fired < count) {
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	sel_select(sel, NULL, 0, NULL, &tv);
+    }
+    cpu = cpu_ns() - start_cpu;
+
+    report("expire", "cpu_per_timer_ns", (double) cpu / count);
+    report_dist("expire", "late_ns", late, count);
+
+    for (i = 0; i < count; i++)
+	sel_free_timer(timers[i]);
+    free(timers);
+    free(e);
+    free(late);
+}
+
+/***********************************************************************
+ *
+ * Fd tests.
+ *
+ **********************************************************************/
+
+static void
+nop_fd(int fd, void *data)
+{
+}
+
+static void
+bench_fd(void)
+{
+    int          (*fds)[2];
+    unsigned int i, r, n = count;
+    long long    start, add_ns = 0, clear_ns = 0;
+    int          rv;
+
+    /* select() can't go past FD_SETSIZE, leave room for the others. */
+    if (n > (FD_SETSIZE - 64) / 2)
+	n = (FD_SETSIZE - 64) / 2;
+
+    fds = calloc(n, sizeof(*fds));
+    if (!fds)
+	err_leave(ENOMEM, "fd");
+    for (i = 0; i < n; i++) {
+	if (pipe(fds[i]) == -1)
+	    err_leave(errno, "pipe");
+    }
+
+    start_sel_thread();
+    for (r = 0; r < rounds; r++) {
+	start = now_ns();
+	for (i = 0; i < n; i++) {
+	    rv = sel_set_fd_handlers(sel, fds[i][0], NULL, nop_fd, NULL, NULL,
+				     NULL);
+	    if (rv)
+		err_leave(rv, "sel_set_fd_handlers");
+	    sel_set_fd_read_handler(sel, fds[i][0], SEL_FD_HANDLER_ENABLED);
+	}
+	add_ns += now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+	    sel_clear_fd_handlers(sel, fds[i][0]);
+	clear_ns += now_ns() - start;
+    }
+    stop_sel_thread();
+
+    report("fd", "fds", n);
+    report("fd", "add_ns", (double) add_ns / ((double) n * rounds));
+    report("fd", "clear_ns", (double) clear_ns / ((double) n * rounds));
+
+    for (i = 0; i < n; i++) {
+	close(fds[i][0]);
+	close(fds[i][1]);
+    }
+    free(fds);
+}
+
+/***********************************************************************
+ *
+ * Cross-thread wakeup tests.
+ *
+ **********************************************************************/
+
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wake_cond = PTHREAD_COND_INITIALIZER;
+static long long       woke_at;
+
+static void
+woke(void)
+{
+    pthread_mutex_lock(&wake_lock);
+    woke_at = now_ns();
+    pthread_cond_signal(&wake_cond);
+    pthread_mutex_unlock(&wake_lock);
+}
+
+static long long
+wait_woke(long long sent)
+{
+    long long t;
+
+    pthread_mutex_lock(&wake_lock);
+    while (!woke_at)
+	pthread_cond_wait(&wake_cond, &wake_lock);
+    t = woke_at;
+    woke_at = 0;
+    pthread_mutex_unlock(&wake_lock);
+    return t - sent;
+}
+
+static void
+wake_fd_read(int fd, void *data)
+{
+    char c;
+
+    if (read(fd, &c, 1) == 1)
+	woke();
+}
+
+static void
+wake_timeout(selector_t *sel, sel_timer_t *timer, void *data)
+{
+    woke();
+}
+
+static void
+bench_wake(void)
+{
+    int            fds[2];
+    sel_timer_t    *timer;
+    long long      *lat, sent;
+    unsigned int   r;
+    struct timeval tv;
+    int            rv;
+
+    lat = calloc(rounds, sizeof(*lat));
+    if (!lat)
+	err_leave(ENOMEM, "wake");
+    if (pipe(fds) == -1)
+	err_leave(errno, "pipe");
+    rv = sel_set_fd_handlers(sel, fds[0], NULL, wake_fd_read, NULL, NULL,
+			     NULL);
+    if (rv)
+	err_leave(rv, "sel_set_fd_handlers");
+    sel_set_fd_read_handler(sel, fds[0], SEL_FD_HANDLER_ENABLED);
+    rv = sel_alloc_timer(sel, wake_timeout, NULL, &timer);
+    if (rv)
+	err_leave(rv, "sel_alloc_timer");
+
+    start_sel_thread();
+
+    for (r = 0; r < rounds; r++) {
+	/* Give it time to get back into the wait. */
+	usleep(100);
+	sent = now_ns();
+	if (write(fds[1], "x", 1) != 1)
+	    err_leave(errno, "write");
+	lat[r] = wait_woke(sent);
+    }
+    report_dist("wake", "fd_ns", lat, rounds);
+
+    for (r = 0; r < rounds; r++) {
+	usleep(100);
+	sel_get_monotonic_time(&tv);
+	sent = now_ns();
+	sel_start_timer(timer, &tv);
+	lat[r] = wait_woke(sent);
+    }
+    report_dist("wake", "timer_ns", lat, rounds);
+
+    stop_sel_thread();
+
+    sel_clear_fd_handlers(sel, fds[0]);
+    sel_free_timer(timer);
+    close(fds[0]);
+    close(fds[1]);
+    free(lat);
+}
+
+/***********************************************************************
+ *
+ * Setup.
+ *
+ **********************************************************************/
+
+static struct {
+    const char *name;
+    void (*func)(void);
+} tests[] = {
+    { "churn", bench_churn },
+    { "expire", bench_expire },
+    { "fd", bench_fd },
+    { "wake", bench_wake },
+    { NULL }
+};
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+	    "Usage: %s [-t heap|wheel] [-b select|epoll|uring] [-n <count>]\n"
+	    "          [-r <rounds>] [-s <spread ms>] [test ...]\n"
+	    " Tests are churn, expire, fd and wake, all by default.\n",
+	    progname);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int     flags = 0;
+    struct sigaction act;
+    sigset_t         sigset;
+    int              i, j, rv;
+
+    while ((rv = getopt(argc, argv, "t:b:n:r:s:")) != -1) {
+	switch (rv) {
+	case 't':
+	    timer_name = optarg;
+	    if (strcmp(optarg, "wheel") == 0)
+		flags |= SEL_FLAG_TIMER_WHEEL;
+	    else if (strcmp(optarg, "heap") != 0)
+		usage(argv[0]);
+	    break;
+
+	case 'b':
+	    backend_name = optarg;
+	    if (strcmp(optarg, "select") == 0)
+		flags |= SEL_FLAG_SELECT;
+	    else if (strcmp(optarg, "uring") == 0)
+		flags |= SEL_FLAG_IO_URING;
+	    else if (strcmp(optarg, "epoll") != 0)
+		usage(argv[0]);
+	    break;
+
+	case 'n':
+	    count = strtoul(optarg, NULL, 0);
+	    break;
+
+	case 'r':
+	    rounds = strtoul(optarg, NULL, 0);
+	    break;
+
+	case 's':
+	    spread_ms = strtoul(optarg, NULL, 0);
+	    break;
+
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (count == 0 || rounds == 0)
+	usage(argv[0]);
+    for (j = optind; j < argc; j++) {
+	for (i = 0; tests[i].name; i++) {
+	    if (strcmp(argv[j], tests[i].name) == 0)
+		break;
+	}
+	if (!tests[i].name)
+	    usage(argv[0]);
+    }
+
+    /* The wake signal is only let through while the selector waits. */
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = wake_sig_handler;
+    sigaction(wake_sig, &act, NULL);
+    sigemptyset(&sigset);
+    sigaddset(&sigset, wake_sig);
+    sigprocmask(SIG_BLOCK, &sigset, NULL);
+
+    rv = sel_alloc_selector_thread_flags(&sel, wake_sig, bench_lock_alloc,
+					 bench_lock_free, bench_lock,
+					 bench_unlock, NULL, flags);
+    if (rv)
+	err_leave(rv, "sel_alloc_selector_thread_flags");
+
+    for (i = 0; tests[i].name; i++) {
+	if (optind < argc) {
+	    for (j = optind; j < argc; j++) {
+		if (strcmp(argv[j], tests[i].name) == 0)
+		    break;
+	    }
+	    if (j == argc)
+		continue;
+	}
+	tests[i].func();
+    }
+
+    sel_free_selector(sel);
+    return 0;
+}
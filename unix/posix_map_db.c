@@ -0,0 +1,289 @@
+/*
+ * posix_map_db.c
+ *
+ * A database of files that can be mapped in place, shared by the
+ * POSIX OS handlers.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "posix_map_db.h"
+
+#define MAP_DB_DIR ".OpenIPMI_db.d"
+
+typedef struct map_db_map_s
+{
+    void   *addr;
+    size_t len;
+} map_db_map_t;
+
+char *
+posix_map_db_dir(const char *db_filename)
+{
+    char *dir;
+
+    dir = malloc(strlen(db_filename) + 3);
+    if (!dir)
+	return NULL;
+    strcpy(dir, db_filename);
+    strcat(dir, ".d");
+    return dir;
+}
+
+/* Build the name of an item's file, with an optional suffix.  Keys
+   are used directly as filenames, so don't allow ones that would go
+   somewhere else. */
+static char *
+item_filename(const char *dir, const char *key, const char *suffix)
+{
+    char *home = NULL;
+    char *name;
+    int  len;
+
+    if ((key[0] == '\0') || (key[0] == '.') || strchr(key, '/'))
+	return NULL;
+
+    if (!dir) {
+	home = getenv("HOME");
+	if (!home)
+	    return NULL;
+    }
+
+    len = strlen(key) + strlen(suffix) + 2;
+    if (dir)
+	len += strlen(dir);
+    else
+	len += strlen(home) + strlen(MAP_DB_DIR) + 1;
+    name = malloc(len);
+    if (!name)
+	return NULL;
+    if (dir)
+	sprintf(name, "%s/%s%s", dir, key, suffix);
+    else
+	sprintf(name, "%s/%s/%s%s", home, MAP_DB_DIR, key, suffix);
+    return name;
+}
+
+int
+posix_map_db_store(const char    *dir,
+		   const char    *key,
+		   unsigned char *data,
+		   unsigned int  data_len)
+{
+    char         suffix[32];
+    char         *name, *tmpname, *slash;
+    int          fd;
+    unsigned int written = 0;
+    ssize_t      rv;
+    int          err = 0;
+
+    name = item_filename(dir, key, "");
+    if (!name)
+	return EINVAL;
+    sprintf(suffix, ".tmp.%ld", (long) getpid());
+    tmpname = item_filename(dir, key, suffix);
+    if (!tmpname) {
+	free(name);
+	return ENOMEM;
+    }
+
+    fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if ((fd == -1) && (errno == ENOENT)) {
+	/* Create the directory the first time. */
+	slash = strrchr(tmpname, '/');
+	*slash = '\0';
+	mkdir(tmpname, 0700);
+	*slash = '/';
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    }
+    if (fd == -1) {
+	err = errno;
+	goto out;
+    }
+
+    while (written < data_len) {
+	rv = write(fd, data + written, data_len - written);
+	if (rv == -1) {
+	    if (errno == EINTR)
+		continue;
+	    err = errno;
+	    break;
+	}
+	written += rv;
+    }
+    if (close(fd) && !err)
+	err = errno;
+
+    /* Readers only ever see a complete item. */
+    if (!err && (rename(tmpname, name) == -1))
+	err = errno;
+    if (err)
+	unlink(tmpname);
+
+ out:
+    free(tmpname);
+    free(name);
+    return err;
+}
+
+int
+posix_map_db_map(const char    *dir,
+		 const char    *key,
+		 unsigned char **data,
+		 unsigned int  *data_len,
+		 void          **map)
+{
+    char         *name;
+    int          fd;
+    struct stat  st;
+    map_db_map_t *m;
+    int          err = 0;
+
+    name = item_filename(dir, key, "");
+    if (!name)
+	return EINVAL;
+    fd = open(name, O_RDONLY);
+    free(name);
+    if (fd == -1)
+	return errno;
+
+    if (fstat(fd, &st) == -1) {
+	err = errno;
+	goto out;
+    }
+    if ((st.st_size == 0) || (st.st_size > UINT_MAX)) {
+	err = EINVAL;
+	goto out;
+    }
+
+    m = malloc(sizeof(*m));
+    if (!m) {
+	err = ENOMEM;
+	goto out;
+    }
+    m->len = st.st_size;
+    m->addr = mmap(NULL, m->len, PROT_READ, MAP_SHARED, fd, 0);
+    if (m->addr == MAP_FAILED) {
+	err = errno;
+	free(m);
+	goto out;
+    }
+
+    *data = m->addr;
+    *data_len = m->len;
+    *map = m;
+
+ out:
+    close(fd);
+    return err;
+}
+
+void
+posix_map_db_unmap(void *map)
+{
+    map_db_map_t *m = map;
+
+    munmap(m->addr, m->len);
+    free(m);
+}
+
+/*
+ * database_free() only gets the data, so the item is mapped one page
+ * into a larger anonymous mapping and the length is kept in that
+ * first page.
+ */
+int
+posix_map_db_find(const char    *dir,
+		  const char    *key,
+		  unsigned char **data,
+		  unsigned int  *data_len)
+{
+    char          *name;
+    int           fd;
+    struct stat   st;
+    size_t        pg = sysconf(_SC_PAGESIZE);
+    unsigned char *base;
+    int           err = 0;
+
+    name = item_filename(dir, key, "");
+    if (!name)
+	return EINVAL;
+    fd = open(name, O_RDONLY);
+    free(name);
+    if (fd == -1)
+	return errno;
+
+    if (fstat(fd, &st) == -1) {
+	err = errno;
+	goto out;
+    }
+    if ((st.st_size == 0) || (st.st_size > UINT_MAX)) {
+	err = EINVAL;
+	goto out;
+    }
+
+    base = mmap(NULL, pg + st.st_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+	err = errno;
+	goto out;
+    }
+    if (mmap(base + pg, st.st_size, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+	err = errno;
+	munmap(base, pg + st.st_size);
+	goto out;
+    }
+    *((size_t *) base) = st.st_size;
+
+    *data = base + pg;
+    *data_len = st.st_size;
+
+ out:
+    close(fd);
+    return err;
+}
+
+void
+posix_map_db_free(unsigned char *data)
+{
+    size_t        pg = sysconf(_SC_PAGESIZE);
+    unsigned char *base = data - pg;
+
+    munmap(base, pg + *((size_t *) base));
+}
@@ -0,0 +1,74 @@
+/*
+ * posix_map_db.h
+ *
+ * A database of files that can be mapped in place, shared by the
+ * POSIX OS handlers.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _POSIX_MAP_DB_H
+#define _POSIX_MAP_DB_H
+
+/*
+ * Each item is a file named by its key in a directory, by default
+ * $HOME/.OpenIPMI_db.d.  Items are replaced by renaming a new file
+ * over the old one, so processes that have the old one mapped keep
+ * seeing the old data, and processes mapping the same item share the
+ * pages.  "dir" may be NULL for the default directory.
+ */
+
+/* A database filename starting with this keeps database_store()
+   items in the directory too, instead of in gdbm.  Without gdbm they
+   are always kept there. */
+#define POSIX_MAP_DB_PREFIX "map:"
+
+/* Return the directory to use for a database filename (the filename
+   with ".d" added), or NULL if out of memory. */
+char *posix_map_db_dir(const char *db_filename);
+
+int posix_map_db_store(const char    *dir,
+		       const char    *key,
+		       unsigned char *data,
+		       unsigned int  data_len);
+
+int posix_map_db_map(const char    *dir,
+		     const char    *key,
+		     unsigned char **data,
+		     unsigned int  *data_len,
+		     void          **map);
+
+void posix_map_db_unmap(void *map);
+
+/* Map an item for database_find().  The mapping is private, so the
+   pages are shared until the caller writes to them, and it is freed
+   with posix_map_db_free() on the returned data. */
+int posix_map_db_find(const char    *dir,
+		      const char    *key,
+		      unsigned char **data,
+		      unsigned int  *data_len);
+
+void posix_map_db_free(unsigned char *data);
+
+#endif /* _POSIX_MAP_DB_H */
@@ -50,6 +50,8 @@
 
 #include <OpenIPMI/ipmi_posix.h>
 
+#include "posix_map_db.h"
+
 /* CHEAP HACK - we don't want the user to have to provide this any
    more. */
 extern void posix_vlog(char                 *format,
@@ -61,6 +63,8 @@ typedef struct iposix_info_s
 {
     selector_t *sel;
     os_vlog_t  log_handler;
+    char       *map_dir; /* NULL for the default */
+    int        db_map; /* Keep database_store() items in map_dir. */
 #ifdef HAVE_GDBM
     char *gdbm_filename;
     GDBM_FILE gdbmf;
@@ -231,7 +235,6 @@ start_timer(os_handler_t      *handler,
 	    void              *cb_data)
 {
     struct timeval now;
-    int rv;
 
     if (id->running)
 	return EBUSY;
@@ -240,9 +243,7 @@ start_timer(os_handler_t      *handler,
     id->cb_data = cb_data;
     id->timed_out = timed_out;
 
-    rv = handler->get_monotonic_time(handler, &now);
-    if (rv)
-	return rv;
+    sel_get_cached_monotonic_time(&now);
 
     now.tv_sec += timeout->tv_sec;
     now.tv_usec += timeout->tv_usec;
@@ -470,10 +471,10 @@ init_gdbm(iposix_info_t *info)
 }
 
 static int
-database_store(os_handler_t  *handler,
-	       char          *key,
-	       unsigned char *data,
-	       unsigned int  data_len)
+gdbm_db_store(os_handler_t  *handler,
+	      char          *key,
+	      unsigned char *data,
+	      unsigned int  data_len)
 {
     iposix_info_t *info = handler->internal_data;
     datum         gkey, gdata;
@@ -497,16 +498,10 @@ database_store(os_handler_t  *handler,
 }
 
 static int
-database_find(os_handler_t  *handler,
-	      char          *key,
-	      unsigned int  *fetch_completed,
-	      unsigned char **data,
-	      unsigned int  *data_len,
-	      void (*got_data)(void          *cb_data,
-			       int           err,
-			       unsigned char *data,
-			       unsigned int  data_len),
-	      void *cb_data)
+gdbm_db_find(os_handler_t  *handler,
+	     char          *key,
+	     unsigned char **data,
+	     unsigned int  *data_len)
 {
     iposix_info_t *info = handler->internal_data;
     datum         gkey, gdata;
@@ -524,32 +519,132 @@ database_find(os_handler_t  *handler,
 	return EINVAL;
     *data = (unsigned char *) gdata.dptr;
     *data_len = gdata.dsize;
-    *fetch_completed = 1;
     return 0;
 }
+#endif
+
+static int
+database_store(os_handler_t  *handler,
+	       char          *key,
+	       unsigned char *data,
+	       unsigned int  data_len)
+{
+    iposix_info_t *info = handler->internal_data;
+
+#ifdef HAVE_GDBM
+    if (!info->db_map)
+	return gdbm_db_store(handler, key, data, data_len);
+#endif
+    return posix_map_db_store(info->map_dir, key, data, data_len);
+}
+
+static int
+database_find(os_handler_t  *handler,
+	      char          *key,
+	      unsigned int  *fetch_completed,
+	      unsigned char **data,
+	      unsigned int  *data_len,
+	      void (*got_data)(void          *cb_data,
+			       int           err,
+			       unsigned char *data,
+			       unsigned int  data_len),
+	      void *cb_data)
+{
+    iposix_info_t *info = handler->internal_data;
+    int           rv;
+
+#ifdef HAVE_GDBM
+    if (!info->db_map)
+	rv = gdbm_db_find(handler, key, data, data_len);
+    else
+#endif
+	rv = posix_map_db_find(info->map_dir, key, data, data_len);
+    if (!rv)
+	*fetch_completed = 1;
+    return rv;
+}
 
 static void
 database_free(os_handler_t  *handler,
 	      unsigned char *data)
 {
-    free(data);
+    iposix_info_t *info = handler->internal_data;
+
+    if (info->db_map)
+	posix_map_db_free(data);
+    else
+	free(data);
+}
+
+static int
+database_map_store(os_handler_t  *handler,
+		   char          *key,
+		   unsigned char *data,
+		   unsigned int  data_len)
+{
+    iposix_info_t *info = handler->internal_data;
+
+    return posix_map_db_store(info->map_dir, key, data, data_len);
+}
+
+static int
+database_map(os_handler_t  *handler,
+	     char          *key,
+	     unsigned char **data,
+	     unsigned int  *data_len,
+	     void          **map)
+{
+    iposix_info_t *info = handler->internal_data;
+
+    return posix_map_db_map(info->map_dir, key, data, data_len, map);
+}
+
+static void
+database_unmap(os_handler_t *handler, void *map)
+{
+    posix_map_db_unmap(map);
 }
 
 static int
-set_gdbm_filename(os_handler_t *os_hnd, char *name)
+set_db_filename(os_handler_t *os_hnd, char *name)
 {
     iposix_info_t *info = os_hnd->internal_data;
+    char          *map_dir;
+#ifdef HAVE_GDBM
+    int           db_map = 0;
     char          *nname;
+#endif
 
+    if (strncmp(name, POSIX_MAP_DB_PREFIX, strlen(POSIX_MAP_DB_PREFIX)) == 0)
+    {
+	name += strlen(POSIX_MAP_DB_PREFIX);
+#ifdef HAVE_GDBM
+	db_map = 1;
+#endif
+    }
+#ifdef HAVE_GDBM
     nname = strdup(name);
     if (!nname)
 	return ENOMEM;
+#endif
+    map_dir = posix_map_db_dir(name);
+    if (!map_dir) {
+#ifdef HAVE_GDBM
+	free(nname);
+#endif
+	return ENOMEM;
+    }
+    if (info->map_dir)
+	free(info->map_dir);
+    info->map_dir = map_dir;
+#ifdef HAVE_GDBM
     if (info->gdbm_filename)
 	free(info->gdbm_filename);
     info->gdbm_filename = nname;
+    info->db_map = db_map;
+#endif
     return 0;
 }
-#endif
 
 static void sset_log_handler(os_handler_t *handler,
 			     os_vlog_t    log_handler)
@@ -579,6 +674,13 @@ static int get_monotonic_time(os_handler_t *handler,
     return get_posix_time(CLOCK_MONOTONIC, tv);
 }
 
+static int get_cached_monotonic_time(os_handler_t *handler,
+				     struct timeval *tv)
+{
+    sel_get_cached_monotonic_time(tv);
+    return 0;
+}
+
 static int get_real_time(os_handler_t *handler,
 			 struct timeval *tv)
 {
@@ -603,15 +705,17 @@ static os_handler_t ipmi_posix_os_handler =
     .free_os_handler = free_os_handler,
     .perform_one_op = perform_one_op,
     .operation_loop = operation_loop,
-#ifdef HAVE_GDBM
     .database_store = database_store,
     .database_find = database_find,
     .database_free = database_free,
-    .database_set_filename = set_gdbm_filename,
-#endif
+    .database_set_filename = set_db_filename,
     .set_log_handler = sset_log_handler,
     .get_monotonic_time = get_monotonic_time,
-    .get_real_time = get_real_time
+    .get_real_time = get_real_time,
+    .get_cached_monotonic_time = get_cached_monotonic_time,
+    .database_map_store = database_map_store,
+    .database_map = database_map,
+    .database_unmap = database_unmap
 };
 
 os_handler_t *
@@ -632,6 +736,9 @@ ipmi_posix_get_os_handler(void)
 	return NULL;
     }
     memset(info, 0, sizeof(*info));
+#ifndef HAVE_GDBM
+    info->db_map = 1;
+#endif
 
     rv->internal_data = info;
 
@@ -643,6 +750,8 @@ ipmi_posix_free_os_handler(os_handler_t *os_hnd)
 {
     iposix_info_t *info = os_hnd->internal_data;
 
+    if (info->map_dir)
+	free(info->map_dir);
 #ifdef HAVE_GDBM
     if (info->gdbm_filename)
 	free(info->gdbm_filename);
@@ -44,6 +44,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 #include <signal.h>
 
@@ -55,6 +56,8 @@
 #include <OpenIPMI/selector.h>
 #include <OpenIPMI/ipmi_posix.h>
 
+#include "posix_map_db.h"
+
 #include <OpenIPMI/internal/ipmi_int.h>
 
 /* CHEAP HACK - we don't want the user to have to provide this any
@@ -64,16 +67,40 @@ extern void posix_vlog(char                 *format,
 		       va_list              ap);
 #pragma weak posix_vlog
 
+typedef struct pt_pool_s pt_pool_t;
+typedef struct pt_db_req_s pt_db_req_t;
+
 typedef struct pt_os_hnd_data_s
 {
     selector_t       *sel;
     os_vlog_t        log_handler;
     int              wake_sig;
     struct sigaction oldact;
+
+    /* With more than one reactor, which one each thread runs is kept
+       in thread data, handed out round-robin. */
+    int              have_reactor_key;
+    pthread_key_t    reactor_key;
+    pthread_mutex_t  reactor_lock;
+    unsigned int     next_reactor;
+
+    /* The worker pool, NULL until start_workers() is called. */
+    pt_pool_t        *pool;
+
+    char             *map_dir; /* NULL for the default */
+    int              db_map; /* Keep database_store() items in map_dir. */
 #ifdef HAVE_GDBM
     char *gdbm_filename;
     GDBM_FILE gdbmf;
     pthread_mutex_t gdbm_lock;
+
+    /* The database thread and its queue, see pt_db_req_s. */
+    pthread_mutex_t db_lock;
+    pthread_cond_t  db_cond;
+    pthread_t       db_thread;
+    int             db_running;
+    int             db_stop;
+    pt_db_req_t     *db_head, *db_tail;
 #endif
 } pt_os_hnd_data_t;
 
@@ -85,6 +112,7 @@ struct os_hnd_fd_id_s
     os_data_ready_t data_ready;
     os_handler_t    *handler;
     os_fd_data_freed_t freed;
+    selector_t      *sel;
 };
 
 static void
@@ -109,18 +137,30 @@ free_fd_data(int fd, void *data)
     free(data);
 }
 
+static unsigned int
+get_num_reactors(os_handler_t *handler)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+
+    return sel_num_reactors(info->sel);
+}
+
 static int
-add_fd(os_handler_t       *handler,
-       int                fd,
-       os_data_ready_t    data_ready,
-       void               *cb_data,
-       os_fd_data_freed_t freed,
-       os_hnd_fd_id_t     **id)
+add_fd_reactor(os_handler_t       *handler,
+	       unsigned int       reactor,
+	       int                fd,
+	       os_data_ready_t    data_ready,
+	       void               *cb_data,
+	       os_fd_data_freed_t freed,
+	       os_hnd_fd_id_t     **id)
 {
     os_hnd_fd_id_t   *fd_data;
     int              rv;
     pt_os_hnd_data_t *info = handler->internal_data;
-    selector_t       *posix_sel = info->sel;
+    selector_t       *posix_sel = sel_get_reactor(info->sel, reactor);
+
+    if (!posix_sel)
+	return EINVAL;
 
     fd_data = malloc(sizeof(*fd_data));
     if (!fd_data)
@@ -131,6 +171,7 @@ add_fd(os_handler_t       *handler,
     fd_data->data_ready = data_ready;
     fd_data->handler = handler;
     fd_data->freed = freed;
+    fd_data->sel = posix_sel;
     sel_set_fd_write_handler(posix_sel, fd, SEL_FD_HANDLER_DISABLED);
     sel_set_fd_except_handler(posix_sel, fd, SEL_FD_HANDLER_DISABLED);
     rv = sel_set_fd_handlers(posix_sel, fd, fd_data, fd_handler, NULL, NULL,
@@ -145,11 +186,21 @@ add_fd(os_handler_t       *handler,
     return 0;
 }
 
+static int
+add_fd(os_handler_t       *handler,
+       int                fd,
+       os_data_ready_t    data_ready,
+       void               *cb_data,
+       os_fd_data_freed_t freed,
+       os_hnd_fd_id_t     **id)
+{
+    return add_fd_reactor(handler, 0, fd, data_ready, cb_data, freed, id);
+}
+
 static int
 remove_fd(os_handler_t *handler, os_hnd_fd_id_t *fd_data)
 {
-    pt_os_hnd_data_t *info = handler->internal_data;
-    selector_t       *posix_sel = info->sel;
+    selector_t       *posix_sel = fd_data->sel;
 
     sel_set_fd_read_handler(posix_sel, fd_data->fd, SEL_FD_HANDLER_DISABLED);
     sel_clear_fd_handlers(posix_sel, fd_data->fd);
@@ -204,9 +255,7 @@ start_timer(os_handler_t      *handler,
 	goto out;
     }
 
-    rv = handler->get_monotonic_time(handler, &now);
-    if (rv)
-	return rv;
+    sel_get_cached_monotonic_time(&now);
 
     id->running = 1;
     id->cb_data = cb_data;
@@ -241,13 +290,17 @@ stop_timer(os_handler_t *handler, os_hnd_timer_id_t *timer_data)
 }
 
 static int
-alloc_timer(os_handler_t      *handler, 
-	    os_hnd_timer_id_t **id)
+alloc_timer_reactor(os_handler_t      *handler,
+		    unsigned int      reactor,
+		    os_hnd_timer_id_t **id)
 {
     os_hnd_timer_id_t *timer_data;
     int               rv;
     pt_os_hnd_data_t  *info = handler->internal_data;
-    selector_t        *posix_sel = info->sel;
+    selector_t        *posix_sel = sel_get_reactor(info->sel, reactor);
+
+    if (!posix_sel)
+	return EINVAL;
 
     timer_data = malloc(sizeof(*timer_data));
     if (!timer_data)
@@ -275,6 +328,13 @@ alloc_timer(os_handler_t      *handler,
     return 0;
 }
 
+static int
+alloc_timer(os_handler_t      *handler, 
+	    os_hnd_timer_id_t **id)
+{
+    return alloc_timer_reactor(handler, 0, id);
+}
+
 static int
 free_timer(os_handler_t *handler, os_hnd_timer_id_t *timer_data)
 {
@@ -284,6 +344,310 @@ free_timer(os_handler_t *handler, os_hnd_timer_id_t *timer_data)
     return 0;
 }
 
+/*
+ * The worker pool.  Each worker has a list of work queues that are
+ * ready to run, queues are assigned to a worker round-robin when
+ * allocated and go back on that worker's list when work is added.  An
+ * idle worker steals from the other workers' lists.  A queue is only
+ * on one list or running on one worker at a time, which is what keeps
+ * its work in order.
+ */
+typedef struct pt_work_s
+{
+    os_work_t        work;
+    void             *cb_data;
+    struct pt_work_s *next;
+} pt_work_t;
+
+struct os_hnd_work_queue_s
+{
+    pthread_mutex_t     lock;
+    pt_work_t           *head, *tail;
+
+    /* On a ready list or running. */
+    int                 scheduled;
+    int                 freed;
+    unsigned int        home;
+    os_hnd_work_queue_t *next_ready;
+};
+
+typedef struct pt_worker_s
+{
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    os_hnd_work_queue_t *ready_head, *ready_tail;
+    pt_pool_t           *pool;
+    unsigned int        idx;
+} pt_worker_t;
+
+/* How many items to run from a queue before letting other ones go. */
+#define PT_WORK_BATCH 16
+
+struct pt_pool_s
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    unsigned int    num_ready;
+    int             stop;
+    unsigned int    num_workers;
+    unsigned int    next_home;
+    pt_worker_t     *workers;
+};
+
+static void
+pool_schedule(pt_pool_t *pool, os_hnd_work_queue_t *q)
+{
+    pt_worker_t *w = &pool->workers[q->home];
+
+    q->next_ready = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->ready_tail)
+	w->ready_tail->next_ready = q;
+    else
+	w->ready_head = q;
+    w->ready_tail = q;
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->num_ready++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static os_hnd_work_queue_t *
+worker_take(pt_worker_t *w)
+{
+    os_hnd_work_queue_t *q;
+
+    pthread_mutex_lock(&w->lock);
+    q = w->ready_head;
+    if (q) {
+	w->ready_head = q->next_ready;
+	if (!w->ready_head)
+	    w->ready_tail = NULL;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return q;
+}
+
+static void
+free_work_queue_data(os_hnd_work_queue_t *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+}
+
+/* Run some work from the queue, then put it back if there is more. */
+static void
+run_work_queue(pt_pool_t *pool, os_hnd_work_queue_t *q)
+{
+    pt_work_t    *item;
+    unsigned int count;
+
+    for (count = 0; count < PT_WORK_BATCH; count++) {
+	pthread_mutex_lock(&q->lock);
+	item = q->head;
+	if (item) {
+	    q->head = item->next;
+	    if (!q->head)
+		q->tail = NULL;
+	}
+	pthread_mutex_unlock(&q->lock);
+	if (!item)
+	    break;
+	item->work(item->cb_data);
+	free(item);
+    }
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head) {
+	pthread_mutex_unlock(&q->lock);
+	pool_schedule(pool, q);
+	return;
+    }
+    q->scheduled = 0;
+    if (q->freed) {
+	pthread_mutex_unlock(&q->lock);
+	free_work_queue_data(q);
+	return;
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void *
+worker_thread(void *data)
+{
+    pt_worker_t         *w = data;
+    pt_pool_t           *pool = w->pool;
+    os_hnd_work_queue_t *q;
+    unsigned int        i;
+
+    for (;;) {
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->num_ready && !pool->stop)
+	    pthread_cond_wait(&pool->cond, &pool->lock);
+	if (pool->stop) {
+	    pthread_mutex_unlock(&pool->lock);
+	    break;
+	}
+	pool->num_ready--;
+	pthread_mutex_unlock(&pool->lock);
+
+	/* We have claimed a ready queue, it is on some list.  Look at
+	   ours first, then steal. */
+	q = NULL;
+	while (!q) {
+	    for (i = 0; !q && i < pool->num_workers; i++)
+		q = worker_take(&pool->workers[(w->idx + i)
+					       % pool->num_workers]);
+	}
+	run_work_queue(pool, q);
+    }
+    return NULL;
+}
+
+static void
+stop_workers(pt_pool_t *pool, unsigned int num_started)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < num_started; i++) {
+	pthread_join(pool->workers[i].thread, NULL);
+	pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+static int
+start_workers(os_handler_t *handler, unsigned int num_workers)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_pool_t        *pool;
+    unsigned int     i;
+    int              rv;
+
+    if (num_workers == 0)
+	return EINVAL;
+    if (info->pool)
+	return EBUSY;
+
+    pool = malloc(sizeof(*pool));
+    if (!pool)
+	return ENOMEM;
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = malloc(sizeof(*pool->workers) * num_workers);
+    if (!pool->workers) {
+	free(pool);
+	return ENOMEM;
+    }
+    memset(pool->workers, 0, sizeof(*pool->workers) * num_workers);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pool->num_workers = num_workers;
+
+    for (i = 0; i < num_workers; i++) {
+	pt_worker_t *w = &pool->workers[i];
+
+	w->pool = pool;
+	w->idx = i;
+	pthread_mutex_init(&w->lock, NULL);
+	rv = pthread_create(&w->thread, NULL, worker_thread, w);
+	if (rv) {
+	    pthread_mutex_destroy(&w->lock);
+	    stop_workers(pool, i);
+	    return rv;
+	}
+    }
+
+    info->pool = pool;
+    return 0;
+}
+
+static int
+alloc_work_queue(os_handler_t *handler, os_hnd_work_queue_t **queue)
+{
+    pt_os_hnd_data_t    *info = handler->internal_data;
+    pt_pool_t           *pool = info->pool;
+    os_hnd_work_queue_t *q;
+
+    if (!pool)
+	return ENOSYS;
+
+    q = malloc(sizeof(*q));
+    if (!q)
+	return ENOMEM;
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    q->home = pool->next_home++ % pool->num_workers;
+    pthread_mutex_unlock(&pool->lock);
+
+    *queue = q;
+    return 0;
+}
+
+static int
+free_work_queue(os_handler_t *handler, os_hnd_work_queue_t *q)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->scheduled) {
+	/* Let the worker free it when it's done. */
+	q->freed = 1;
+	pthread_mutex_unlock(&q->lock);
+	return 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    free_work_queue_data(q);
+    return 0;
+}
+
+static int
+queue_work(os_handler_t        *handler,
+	   os_hnd_work_queue_t *q,
+	   os_work_t           work,
+	   void                *cb_data)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_work_t        *item;
+    int              schedule = 0;
+
+    item = malloc(sizeof(*item));
+    if (!item)
+	return ENOMEM;
+    item->work = work;
+    item->cb_data = cb_data;
+    item->next = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->freed) {
+	pthread_mutex_unlock(&q->lock);
+	free(item);
+	return EINVAL;
+    }
+    if (q->tail)
+	q->tail->next = item;
+    else
+	q->head = item;
+    q->tail = item;
+    if (!q->scheduled) {
+	q->scheduled = 1;
+	schedule = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (schedule)
+	pool_schedule(info->pool, q);
+    return 0;
+}
+
 static int
 get_random(os_handler_t *handler, void *data, unsigned int len)
 {
@@ -462,6 +826,64 @@ unlock(os_handler_t  *handler,
     return 0;
 }
 
+struct os_hnd_rwlock_s
+{
+    pthread_rwlock_t lock;
+};
+
+static int
+create_rwlock(os_handler_t    *handler,
+	      os_hnd_rwlock_t **id)
+{
+    os_hnd_rwlock_t *lock;
+    int             rv;
+
+    lock = malloc(sizeof(*lock));
+    if (!lock)
+	return ENOMEM;
+    rv = pthread_rwlock_init(&lock->lock, NULL);
+    if (rv) {
+	free(lock);
+	return rv;
+    }
+    *id = lock;
+    return 0;
+}
+
+static int
+destroy_rwlock(os_handler_t    *handler,
+	       os_hnd_rwlock_t *id)
+{
+    int rv;
+
+    rv = pthread_rwlock_destroy(&id->lock);
+    if (rv)
+	return rv;
+    free(id);
+    return 0;
+}
+
+static int
+read_lock(os_handler_t    *handler,
+	  os_hnd_rwlock_t *id)
+{
+    return pthread_rwlock_rdlock(&id->lock);
+}
+
+static int
+write_lock(os_handler_t    *handler,
+	   os_hnd_rwlock_t *id)
+{
+    return pthread_rwlock_wrlock(&id->lock);
+}
+
+static int
+rw_unlock(os_handler_t    *handler,
+	  os_hnd_rwlock_t *id)
+{
+    return pthread_rwlock_unlock(&id->lock);
+}
+
 struct os_hnd_cond_s
 {
     pthread_cond_t cond;
@@ -606,13 +1028,21 @@ thread_exit(os_handler_t *handler)
     pthread_exit(NULL);
 }
 
+#ifdef HAVE_GDBM
+static void db_thread_stop(pt_os_hnd_data_t *info);
+#endif
 
 void
 ipmi_posix_thread_free_os_handler(os_handler_t *os_hnd)
 {
     pt_os_hnd_data_t *info = os_hnd->internal_data;
 
+    if (info->map_dir)
+	free(info->map_dir);
 #ifdef HAVE_GDBM
+    db_thread_stop(info);
+    pthread_cond_destroy(&info->db_cond);
+    pthread_mutex_destroy(&info->db_lock);
     pthread_mutex_destroy(&info->gdbm_lock);
     if (info->gdbm_filename)
 	free(info->gdbm_filename);
@@ -654,6 +1084,27 @@ posix_thread_send_sig(long thread_id, void *cb_data)
     pthread_kill(*id, info->wake_sig);
 }
 
+/* Get the reactor the calling thread runs, assigning one if this is
+   its first time in. */
+static selector_t *
+thread_reactor(pt_os_hnd_data_t *info)
+{
+    uintptr_t reactor;
+
+    if (!info->have_reactor_key)
+	return info->sel;
+
+    reactor = (uintptr_t) pthread_getspecific(info->reactor_key);
+    if (!reactor) {
+	pthread_mutex_lock(&info->reactor_lock);
+	reactor = (info->next_reactor % sel_num_reactors(info->sel)) + 1;
+	info->next_reactor++;
+	pthread_mutex_unlock(&info->reactor_lock);
+	pthread_setspecific(info->reactor_key, (void *) reactor);
+    }
+    return sel_get_reactor(info->sel, reactor - 1);
+}
+
 static int
 perform_one_op(os_handler_t   *os_hnd,
 	       struct timeval *timeout)
@@ -662,8 +1113,8 @@ perform_one_op(os_handler_t   *os_hnd,
     pt_os_hnd_data_t *info = os_hnd->internal_data;
     int              rv;
 
-    rv = sel_select(info->sel, posix_thread_send_sig, (long) &self, info,
-		    timeout);
+    rv = sel_select(thread_reactor(info), posix_thread_send_sig,
+		    (long) &self, info, timeout);
     if (rv == -1)
 	return errno;
     return 0;
@@ -675,7 +1126,8 @@ operation_loop(os_handler_t *os_hnd)
     pthread_t        self = pthread_self();
     pt_os_hnd_data_t *info = os_hnd->internal_data;
 
-    sel_select_loop(info->sel, posix_thread_send_sig, (long) &self, info);
+    sel_select_loop(thread_reactor(info), posix_thread_send_sig,
+		    (long) &self, info);
 }
 
 static void
@@ -684,7 +1136,13 @@ free_os_handler(os_handler_t *os_hnd)
     pt_os_hnd_data_t *info = os_hnd->internal_data;
 
     sigaction(info->wake_sig, &info->oldact, NULL);
+    if (info->pool)
+	stop_workers(info->pool, info->pool->num_workers);
     sel_free_selector(info->sel);
+    if (info->have_reactor_key) {
+	pthread_key_delete(info->reactor_key);
+	pthread_mutex_destroy(&info->reactor_lock);
+    }
     ipmi_posix_thread_free_os_handler(os_hnd);
 }
 
@@ -703,6 +1161,35 @@ posix_free(void *data)
 #ifdef HAVE_GDBM
 #define GDBM_FILE ".OpenIPMI_db"
 
+/*
+ * Database operations are done by a thread of their own so gdbm
+ * never holds up the selector.  Stores and fetches go on one queue
+ * and are done in order, so a fetch always sees the stores before
+ * it.  The thread takes everything queued at once and syncs the file
+ * once for all the stores in it.  A fetch's result is handed back
+ * through a selector runner.
+ *
+ * A fetch without a got_data callback can't wait, it is done in the
+ * caller with the gdbm lock, after looking for a newer copy in the
+ * stores still on the queue.  The lock order is gdbm_lock, then
+ * db_lock.
+ */
+struct pt_db_req_s
+{
+    int           store; /* Else it is a fetch. */
+    char          *key;
+    unsigned char *data;
+    unsigned int  data_len;
+    int           err;
+    void          (*got_data)(void          *cb_data,
+			      int           err,
+			      unsigned char *data,
+			      unsigned int  data_len);
+    void          *cb_data;
+    sel_runner_t  *runner;
+    pt_db_req_t   *next;
+};
+
 static void
 init_gdbm(pt_os_hnd_data_t *info)
 {
@@ -723,36 +1210,293 @@ init_gdbm(pt_os_hnd_data_t *info)
     /* gdbmf will be NULL on error, which is what reports an error. */
 }
 
-static int
-database_store(os_handler_t  *handler,
-	       char          *key,
-	       unsigned char *data,
-	       unsigned int  data_len)
+static void
+db_req_free(pt_db_req_t *req)
 {
-    pt_os_hnd_data_t *info = handler->internal_data;
-    datum            gkey, gdata;
-    int              rv;
+    if (req->runner)
+	sel_free_runner(req->runner);
+    free(req->key);
+    if (req->store)
+	free(req->data);
+    free(req);
+}
+
+static void
+db_fetch_done(sel_runner_t *runner, void *cb_data)
+{
+    pt_db_req_t *req = cb_data;
+
+    req->got_data(req->cb_data, req->err, req->data, req->data_len);
+    db_req_free(req);
+}
+
+/* Do one request.  Must be called with the gdbm lock held. */
+static void
+db_do_req(pt_os_hnd_data_t *info, pt_db_req_t *req)
+{
+    datum gkey, gdata;
 
-    pthread_mutex_lock(&info->gdbm_lock);
     if (!info->gdbmf) {
 	init_gdbm(info);
 	if (!info->gdbmf) {
-	    pthread_mutex_unlock(&info->gdbm_lock);
-	    return EINVAL;
+	    req->err = EINVAL;
+	    return;
+	}
+    }
+
+    gkey.dptr = req->key;
+    gkey.dsize = strlen(req->key);
+    if (req->store) {
+	gdata.dptr = (char *) req->data;
+	gdata.dsize = req->data_len;
+	if (gdbm_store(info->gdbmf, gkey, gdata, GDBM_REPLACE))
+	    req->err = EINVAL;
+    } else {
+	gdata = gdbm_fetch(info->gdbmf, gkey);
+	if (!gdata.dptr) {
+	    req->err = EINVAL;
+	} else {
+	    req->data = (unsigned char *) gdata.dptr;
+	    req->data_len = gdata.dsize;
+	}
+    }
+}
+
+static void *
+db_thread(void *data)
+{
+    pt_os_hnd_data_t *info = data;
+    pt_db_req_t      *list, *req, *done = NULL, **done_tail = &done;
+    int              stop = 0, stores;
+
+    while (!stop) {
+	pthread_mutex_lock(&info->db_lock);
+	while (!info->db_head && !info->db_stop)
+	    pthread_cond_wait(&info->db_cond, &info->db_lock);
+	pthread_mutex_unlock(&info->db_lock);
+
+	/* Take the batch with the gdbm lock held so a fetch in the
+	   caller can't miss a store that is between the two. */
+	pthread_mutex_lock(&info->gdbm_lock);
+	pthread_mutex_lock(&info->db_lock);
+	list = info->db_head;
+	info->db_head = NULL;
+	info->db_tail = NULL;
+	stop = info->db_stop;
+	pthread_mutex_unlock(&info->db_lock);
+
+	stores = 0;
+	while (list) {
+	    req = list;
+	    list = req->next;
+	    req->next = NULL;
+	    db_do_req(info, req);
+	    if (req->store) {
+		stores++;
+		db_req_free(req);
+	    } else {
+		*done_tail = req;
+		done_tail = &req->next;
+	    }
+	}
+	if (stores && info->gdbmf)
+	    gdbm_sync(info->gdbmf);
+	pthread_mutex_unlock(&info->gdbm_lock);
+
+	while (done) {
+	    req = done;
+	    done = req->next;
+	    if (stop) {
+		/* The handler is going away, nobody is waiting. */
+		if (req->data)
+		    free(req->data);
+		db_req_free(req);
+	    } else {
+		sel_run(req->runner, db_fetch_done, req);
+	    }
+	}
+	done_tail = &done;
+    }
+    return NULL;
+}
+
+/* Queue a request for the database thread, starting it if it is not
+   running.  Returns an error if the thread can't be started. */
+static int
+db_queue(pt_os_hnd_data_t *info, pt_db_req_t *req)
+{
+    int rv = 0;
+
+    req->next = NULL;
+    pthread_mutex_lock(&info->db_lock);
+    if (!info->db_running) {
+	rv = pthread_create(&info->db_thread, NULL, db_thread, info);
+	if (rv)
+	    goto out_unlock;
+	info->db_running = 1;
+    }
+    if (info->db_tail)
+	info->db_tail->next = req;
+    else
+	info->db_head = req;
+    info->db_tail = req;
+    pthread_cond_signal(&info->db_cond);
+ out_unlock:
+    pthread_mutex_unlock(&info->db_lock);
+    return rv;
+}
+
+static void
+db_thread_stop(pt_os_hnd_data_t *info)
+{
+    pthread_mutex_lock(&info->db_lock);
+    if (!info->db_running) {
+	pthread_mutex_unlock(&info->db_lock);
+	return;
+    }
+    info->db_stop = 1;
+    pthread_cond_signal(&info->db_cond);
+    pthread_mutex_unlock(&info->db_lock);
+
+    /* It finishes everything queued before it stops. */
+    pthread_join(info->db_thread, NULL);
+    info->db_running = 0;
+}
+
+static int
+gdbm_db_store(os_handler_t  *handler,
+	      char          *key,
+	      unsigned char *data,
+	      unsigned int  data_len)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_db_req_t      *req;
+    int              rv;
+
+    req = malloc(sizeof(*req));
+    if (!req)
+	return ENOMEM;
+    memset(req, 0, sizeof(*req));
+    req->store = 1;
+    req->key = strdup(key);
+    req->data = malloc(data_len ? data_len : 1);
+    if (!req->key || !req->data) {
+	db_req_free(req);
+	return ENOMEM;
+    }
+    memcpy(req->data, data, data_len);
+    req->data_len = data_len;
+
+    rv = db_queue(info, req);
+    if (rv) {
+	/* No thread, just do it here. */
+	pthread_mutex_lock(&info->gdbm_lock);
+	db_do_req(info, req);
+	pthread_mutex_unlock(&info->gdbm_lock);
+	rv = req->err;
+	db_req_free(req);
+    }
+    return rv;
+}
+
+/* Find the newest store of the key that is still queued and return a
+   copy of its data.  Must be called with the gdbm lock held. */
+static int
+db_find_queued(pt_os_hnd_data_t *info, char *key,
+	       unsigned char **data, unsigned int *data_len)
+{
+    pt_db_req_t *req, *found = NULL;
+    int         rv = ENOENT;
+
+    pthread_mutex_lock(&info->db_lock);
+    for (req = info->db_head; req; req = req->next) {
+	if (req->store && (strcmp(req->key, key) == 0))
+	    found = req;
+    }
+    if (found) {
+	*data = malloc(found->data_len ? found->data_len : 1);
+	if (!*data) {
+	    rv = ENOMEM;
+	} else {
+	    memcpy(*data, found->data, found->data_len);
+	    *data_len = found->data_len;
+	    rv = 0;
 	}
     }
+    pthread_mutex_unlock(&info->db_lock);
+    return rv;
+}
+
+static int
+gdbm_db_find(os_handler_t  *handler,
+	     char          *key,
+	     unsigned int  *fetch_completed,
+	     unsigned char **data,
+	     unsigned int  *data_len,
+	     void (*got_data)(void          *cb_data,
+			      int           err,
+			      unsigned char *data,
+			      unsigned int  data_len),
+	     void *cb_data)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_db_req_t      *req;
+    int              rv;
+
+    req = malloc(sizeof(*req));
+    if (!req)
+	return ENOMEM;
+    memset(req, 0, sizeof(*req));
+    req->key = strdup(key);
+    if (!req->key) {
+	free(req);
+	return ENOMEM;
+    }
 
-    gkey.dptr = key;
-    gkey.dsize = strlen(key);
-    gdata.dptr = (char *) data;
-    gdata.dsize = data_len;
+    if (got_data && info->sel
+	&& (sel_alloc_runner(info->sel, &req->runner) == 0))
+    {
+	req->got_data = got_data;
+	req->cb_data = cb_data;
+	if (db_queue(info, req) == 0) {
+	    *fetch_completed = 0;
+	    return 0;
+	}
+    }
 
-    rv = gdbm_store(info->gdbmf, gkey, gdata, GDBM_REPLACE);
+    pthread_mutex_lock(&info->gdbm_lock);
+    rv = db_find_queued(info, key, data, data_len);
+    if (rv == ENOENT) {
+	db_do_req(info, req);
+	rv = req->err;
+	*data = req->data;
+	*data_len = req->data_len;
+    }
     pthread_mutex_unlock(&info->gdbm_lock);
+    db_req_free(req);
     if (rv)
-	return EINVAL;
+	return rv;
+    *fetch_completed = 1;
     return 0;
 }
+#endif
+
+/* Items kept in map_dir are mapped in place, they are only copied if
+   the user writes to them. */
+static int
+database_store(os_handler_t  *handler,
+	       char          *key,
+	       unsigned char *data,
+	       unsigned int  data_len)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+
+#ifdef HAVE_GDBM
+    if (!info->db_map)
+	return gdbm_db_store(handler, key, data, data_len);
+#endif
+    return posix_map_db_store(info->map_dir, key, data, data_len);
+}
 
 static int
 database_find(os_handler_t  *handler,
@@ -767,51 +1511,100 @@ database_find(os_handler_t  *handler,
 	      void *cb_data)
 {
     pt_os_hnd_data_t *info = handler->internal_data;
-    datum            gkey, gdata;
-
-    pthread_mutex_lock(&info->gdbm_lock);
-    if (!info->gdbmf) {
-	init_gdbm(info);
-	if (!info->gdbmf) {
-	    pthread_mutex_unlock(&info->gdbm_lock);
-	    return EINVAL;
-	}
-    }
+    int              rv;
 
-    gkey.dptr = key;
-    gkey.dsize = strlen(key);
-    gdata = gdbm_fetch(info->gdbmf, gkey);
-    pthread_mutex_unlock(&info->gdbm_lock);
-    if (!gdata.dptr)
-	return EINVAL;
-    *data = (unsigned char *) gdata.dptr;
-    *data_len = gdata.dsize;
-    *fetch_completed = 1;
-    return 0;
+#ifdef HAVE_GDBM
+    if (!info->db_map)
+	return gdbm_db_find(handler, key, fetch_completed, data, data_len,
+			    got_data, cb_data);
+#endif
+    rv = posix_map_db_find(info->map_dir, key, data, data_len);
+    if (!rv)
+	*fetch_completed = 1;
+    return rv;
 }
 
 static void
 database_free(os_handler_t  *handler,
 	      unsigned char *data)
 {
-    free(data);
+    pt_os_hnd_data_t *info = handler->internal_data;
+
+    if (info->db_map)
+	posix_map_db_free(data);
+    else
+	free(data);
+}
+
+static int
+database_map_store(os_handler_t  *handler,
+		   char          *key,
+		   unsigned char *data,
+		   unsigned int  data_len)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+
+    return posix_map_db_store(info->map_dir, key, data, data_len);
+}
+
+static int
+database_map(os_handler_t  *handler,
+	     char          *key,
+	     unsigned char **data,
+	     unsigned int  *data_len,
+	     void          **map)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+
+    return posix_map_db_map(info->map_dir, key, data, data_len, map);
+}
+
+static void
+database_unmap(os_handler_t *handler, void *map)
+{
+    posix_map_db_unmap(map);
 }
 
 static int
-set_gdbm_filename(os_handler_t *os_hnd, char *name)
+set_db_filename(os_handler_t *os_hnd, char *name)
 {
     pt_os_hnd_data_t *info = os_hnd->internal_data;
+    char             *map_dir;
+#ifdef HAVE_GDBM
+    int              db_map = 0;
     char             *nname;
+#endif
 
+    if (strncmp(name, POSIX_MAP_DB_PREFIX, strlen(POSIX_MAP_DB_PREFIX)) == 0)
+    {
+	name += strlen(POSIX_MAP_DB_PREFIX);
+#ifdef HAVE_GDBM
+	db_map = 1;
+#endif
+    }
+#ifdef HAVE_GDBM
     nname = strdup(name);
     if (!nname)
 	return ENOMEM;
+#endif
+    map_dir = posix_map_db_dir(name);
+    if (!map_dir) {
+#ifdef HAVE_GDBM
+	free(nname);
+#endif
+	return ENOMEM;
+    }
+    if (info->map_dir)
+	free(info->map_dir);
+    info->map_dir = map_dir;
+#ifdef HAVE_GDBM
     if (info->gdbm_filename)
 	free(info->gdbm_filename);
     info->gdbm_filename = nname;
+    info->db_map = db_map;
+#endif
     return 0;
 }
-#endif
 
 static void sset_log_handler(os_handler_t *handler,
 			     os_vlog_t    log_handler)
@@ -841,6 +1634,13 @@ static int get_monotonic_time(os_handler_t *handler,
     return get_posix_time(CLOCK_MONOTONIC, tv);
 }
 
+static int get_cached_monotonic_time(os_handler_t *handler,
+				     struct timeval *tv)
+{
+    sel_get_cached_monotonic_time(tv);
+    return 0;
+}
+
 static int get_real_time(os_handler_t *handler,
 			 struct timeval *tv)
 {
@@ -861,6 +1661,12 @@ static os_handler_t ipmi_posix_thread_os_handler =
     .destroy_lock = destroy_lock,
     .lock = lock,
     .unlock = unlock,
+    .create_rwlock = create_rwlock,
+    .destroy_rwlock = destroy_rwlock,
+    .read_lock = read_lock,
+    .read_unlock = rw_unlock,
+    .write_lock = write_lock,
+    .write_unlock = rw_unlock,
     .get_random = get_random,
     .log = sposix_log,
     .vlog = sposix_vlog,
@@ -875,15 +1681,24 @@ static os_handler_t ipmi_posix_thread_os_handler =
     .free_os_handler = free_os_handler,
     .perform_one_op = perform_one_op,
     .operation_loop = operation_loop,
-#ifdef HAVE_GDBM
     .database_store = database_store,
     .database_find = database_find,
     .database_free = database_free,
-    .database_set_filename = set_gdbm_filename,
-#endif
+    .database_set_filename = set_db_filename,
     .set_log_handler = sset_log_handler,
     .get_monotonic_time = get_monotonic_time,
-    .get_real_time = get_real_time
+    .get_real_time = get_real_time,
+    .get_cached_monotonic_time = get_cached_monotonic_time,
+    .get_num_reactors = get_num_reactors,
+    .add_fd_to_wait_for_reactor = add_fd_reactor,
+    .alloc_timer_reactor = alloc_timer_reactor,
+    .start_workers = start_workers,
+    .alloc_work_queue = alloc_work_queue,
+    .free_work_queue = free_work_queue,
+    .queue_work = queue_work,
+    .database_map_store = database_map_store,
+    .database_map = database_map,
+    .database_unmap = database_unmap
 };
 
 os_handler_t *
@@ -908,6 +1723,9 @@ ipmi_posix_thread_get_os_handler2(int wake_sig)
     }
     memset(info, 0, sizeof(*info));
     rv->internal_data = info;
+#ifndef HAVE_GDBM
+    info->db_map = 1;
+#endif
 
 #ifdef HAVE_GDBM
     err = pthread_mutex_init(&info->gdbm_lock, NULL);
@@ -916,6 +1734,8 @@ ipmi_posix_thread_get_os_handler2(int wake_sig)
 	free(rv);
 	return NULL;
     }
+    pthread_mutex_init(&info->db_lock, NULL);
+    pthread_cond_init(&info->db_cond, NULL);
 #endif
 
     info->wake_sig = wake_sig;
@@ -972,7 +1792,8 @@ slock_unlock(sel_lock_t *l)
 }
 
 os_handler_t *
-ipmi_posix_thread_setup_os_handler(int wake_sig)
+ipmi_posix_thread_setup_os_handler_reactors(int wake_sig,
+					    unsigned int num_reactors)
 {
     os_handler_t     *os_hnd;
     pt_os_hnd_data_t *info;
@@ -985,10 +1806,28 @@ ipmi_posix_thread_setup_os_handler(int wake_sig)
 
     info = os_hnd->internal_data;
 
-    rv = sel_alloc_selector_thread(&info->sel, wake_sig,
-				   slock_alloc, slock_free,
-				   slock_lock, slock_unlock, os_hnd);
+    if (num_reactors > 1) {
+	rv = pthread_key_create(&info->reactor_key, NULL);
+	if (rv) {
+	    ipmi_posix_thread_free_os_handler(os_hnd);
+	    os_hnd = NULL;
+	    goto out;
+	}
+	pthread_mutex_init(&info->reactor_lock, NULL);
+	info->have_reactor_key = 1;
+	rv = sel_alloc_selector_reactors(&info->sel, num_reactors, wake_sig,
+					 slock_alloc, slock_free,
+					 slock_lock, slock_unlock, os_hnd, 0);
+    } else {
+	rv = sel_alloc_selector_thread(&info->sel, wake_sig,
+				       slock_alloc, slock_free,
+				       slock_lock, slock_unlock, os_hnd);
+    }
     if (rv) {
+	if (info->have_reactor_key) {
+	    pthread_key_delete(info->reactor_key);
+	    pthread_mutex_destroy(&info->reactor_lock);
+	}
 	ipmi_posix_thread_free_os_handler(os_hnd);
 	os_hnd = NULL;
 	goto out;
@@ -999,6 +1838,11 @@ ipmi_posix_thread_setup_os_handler(int wake_sig)
     act.sa_flags = 0;
     rv = sigaction(wake_sig, &act, &info->oldact);
     if (rv) {
+	sel_free_selector(info->sel);
+	if (info->have_reactor_key) {
+	    pthread_key_delete(info->reactor_key);
+	    pthread_mutex_destroy(&info->reactor_lock);
+	}
 	ipmi_posix_thread_free_os_handler(os_hnd);
 	os_hnd = NULL;
 	goto out;
@@ -1008,6 +1852,12 @@ ipmi_posix_thread_setup_os_handler(int wake_sig)
     return os_hnd;
 }
 
+os_handler_t *
+ipmi_posix_thread_setup_os_handler(int wake_sig)
+{
+    return ipmi_posix_thread_setup_os_handler_reactors(wake_sig, 1);
+}
+
 /*
  * Cruft below, do not use these any more.
  */
@@ -0,0 +1,530 @@
+/*
+ * sel_archive.c
+ *
+ * A compact columnar file format for archiving SEL entries
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <OpenIPMI/ipmi_sel_archive.h>
+
+/*
+ * The file header, then blocks.  A block is a block header, the MC
+ * table, then the columns in the order of ipmi_sel_archive_block_t,
+ * each starting on an 8 byte boundary.  Where everything is follows
+ * from the row and MC counts, so only those and the total length are
+ * stored.
+ */
+#define SEL_ARCHIVE_MAGIC	0x49505341
+#define SEL_BLOCK_MAGIC		0x4950534b
+#define SEL_ARCHIVE_VERSION	1
+#define SEL_ARCHIVE_ORDER	0x01020304
+#define SEL_DEFAULT_ROWS	4096
+#define SEL_MAX_ROWS		65535
+
+#define ALIGN8(v) (((v) + 7) & ~((size_t) 7))
+
+typedef struct sel_file_hdr_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t data_len;
+} sel_file_hdr_t;
+
+typedef struct sel_block_hdr_s
+{
+    uint32_t magic;
+    uint32_t rows;
+    uint32_t num_mcs;
+    uint32_t pad;
+    uint64_t len;
+} sel_block_hdr_t;
+
+typedef struct sel_layout_s
+{
+    size_t mcs;
+    size_t time;
+    size_t record_id;
+    size_t mc;
+    size_t type;
+    size_t sensor_type;
+    size_t sensor_num;
+    size_t event_type;
+    size_t data;
+    size_t len;
+} sel_layout_t;
+
+static void
+sel_layout(unsigned int rows, unsigned int num_mcs, sel_layout_t *l)
+{
+    size_t off = sizeof(sel_block_hdr_t);
+
+    l->mcs = off;
+    off = ALIGN8(off + num_mcs * sizeof(ipmi_sel_archive_mc_t));
+    l->time = off;
+    off = ALIGN8(off + rows * sizeof(int64_t));
+    l->record_id = off;
+    off = ALIGN8(off + rows * sizeof(uint16_t));
+    l->mc = off;
+    off = ALIGN8(off + rows * sizeof(uint16_t));
+    l->type = off;
+    off = ALIGN8(off + rows);
+    l->sensor_type = off;
+    off = ALIGN8(off + rows);
+    l->sensor_num = off;
+    off = ALIGN8(off + rows);
+    l->event_type = off;
+    off = ALIGN8(off + rows);
+    l->data = off;
+    off = ALIGN8(off + rows * IPMI_SEL_ARCHIVE_DATA_LEN);
+    l->len = off;
+}
+
+/***********************************************************************
+ *
+ * Writing.
+ *
+ **********************************************************************/
+
+struct ipmi_sel_archive_writer_s
+{
+    int                   fd;
+    unsigned int          max_rows;
+    unsigned int          rows;
+    unsigned int          num_mcs;
+
+    /* Open addressed, maps an MC to its index in mcs, or -1. */
+    int                   *mc_hash;
+    unsigned int          mc_hash_size;
+
+    /* The block being filled, laid out for the maximum row count and
+       packed down when it is written. */
+    char                  *buf;
+    size_t                buf_len;
+    sel_layout_t          layout;
+};
+
+static int
+write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    ssize_t    rv;
+
+    while (len > 0) {
+	rv = write(fd, p, len);
+	if (rv == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return errno;
+	}
+	p += rv;
+	len -= rv;
+    }
+    return 0;
+}
+
+int
+ipmi_sel_archive_create(const char                *path,
+			unsigned int              rows_per_block,
+			ipmi_sel_archive_writer_t **writer)
+{
+    ipmi_sel_archive_writer_t *w;
+    sel_file_hdr_t            hdr;
+    unsigned int              i;
+    int                       rv;
+
+    if (rows_per_block == 0)
+	rows_per_block = SEL_DEFAULT_ROWS;
+    if (rows_per_block > SEL_MAX_ROWS)
+	return EINVAL;
+
+    w = malloc(sizeof(*w));
+    if (!w)
+	return ENOMEM;
+    memset(w, 0, sizeof(*w));
+    w->max_rows = rows_per_block;
+
+    /* Every row could be from a different MC. */
+    sel_layout(rows_per_block, rows_per_block, &w->layout);
+    w->buf_len = w->layout.len;
+    w->buf = malloc(w->buf_len);
+    for (w->mc_hash_size = 16; w->mc_hash_size < rows_per_block * 2;
+	 w->mc_hash_size <<= 1)
+	;
+    w->mc_hash = malloc(w->mc_hash_size * sizeof(int));
+    if (!w->buf || !w->mc_hash) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+    for (i=0; i<w->mc_hash_size; i++)
+	w->mc_hash[i] = -1;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd == -1) {
+	rv = errno;
+	goto out_err;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SEL_ARCHIVE_MAGIC;
+    hdr.version = SEL_ARCHIVE_VERSION;
+    hdr.byte_order = SEL_ARCHIVE_ORDER;
+    hdr.data_len = IPMI_SEL_ARCHIVE_DATA_LEN;
+    rv = write_all(w->fd, &hdr, sizeof(hdr));
+    if (rv) {
+	close(w->fd);
+	goto out_err;
+    }
+
+    *writer = w;
+    return 0;
+
+ out_err:
+    free(w->buf);
+    free(w->mc_hash);
+    free(w);
+    return rv;
+}
+
+static unsigned int
+mc_hash(const char *domain, unsigned int channel, unsigned int addr)
+{
+    const unsigned char *c = (const unsigned char *) domain;
+    uint32_t            h = 2166136261U;
+
+    for (; *c; c++) {
+	h ^= *c;
+	h *= 16777619U;
+    }
+    h ^= (channel << 8) | addr;
+    h *= 16777619U;
+    return h;
+}
+
+static unsigned int
+find_mc(ipmi_sel_archive_writer_t *w,
+	const char                *domain,
+	unsigned int              channel,
+	unsigned int              addr)
+{
+    ipmi_sel_archive_mc_t *mcs;
+    ipmi_sel_archive_mc_t *mc;
+    unsigned int          mask = w->mc_hash_size - 1;
+    unsigned int          h;
+    int                   idx;
+
+    mcs = (ipmi_sel_archive_mc_t *) (w->buf + w->layout.mcs);
+    h = mc_hash(domain, channel, addr) & mask;
+    while ((idx = w->mc_hash[h]) != -1) {
+	mc = &mcs[idx];
+	if ((mc->channel == channel) && (mc->addr == addr)
+	    && (strncmp(mc->domain, domain, sizeof(mc->domain) - 1) == 0))
+	    return idx;
+	h = (h + 1) & mask;
+    }
+
+    idx = w->num_mcs++;
+    w->mc_hash[h] = idx;
+    mc = &mcs[idx];
+    memset(mc, 0, sizeof(*mc));
+    strncpy(mc->domain, domain, sizeof(mc->domain) - 1);
+    mc->channel = channel;
+    mc->addr = addr;
+    return idx;
+}
+
+int
+ipmi_sel_archive_add(ipmi_sel_archive_writer_t *w,
+		     const char                *domain,
+		     unsigned int              channel,
+		     unsigned int              addr,
+		     unsigned int              record_id,
+		     unsigned int              type,
+		     int64_t                   time,
+		     const unsigned char       *data,
+		     unsigned int              data_len)
+{
+    sel_layout_t *l = &w->layout;
+    unsigned int row;
+    uint8_t      *d;
+    int          rv;
+
+    if ((type > 0xff) || (channel > 0xff) || (addr > 0xff)
+	|| (record_id > 0xffff))
+	return EINVAL;
+
+    if (w->rows == w->max_rows) {
+	rv = ipmi_sel_archive_flush(w);
+	if (rv)
+	    return rv;
+    }
+
+    row = w->rows++;
+    ((int64_t *) (w->buf + l->time))[row] = time;
+    ((uint16_t *) (w->buf + l->record_id))[row] = record_id;
+    ((uint16_t *) (w->buf + l->mc))[row] = find_mc(w, domain, channel, addr);
+    ((uint8_t *) (w->buf + l->type))[row] = type;
+
+    d = (uint8_t *) (w->buf + l->data) + (row * IPMI_SEL_ARCHIVE_DATA_LEN);
+    if (data_len > IPMI_SEL_ARCHIVE_DATA_LEN)
+	data_len = IPMI_SEL_ARCHIVE_DATA_LEN;
+    memcpy(d, data, data_len);
+    memset(d + data_len, 0, IPMI_SEL_ARCHIVE_DATA_LEN - data_len);
+
+    if (type == 2) {
+	((uint8_t *) (w->buf + l->sensor_type))[row] = d[7];
+	((uint8_t *) (w->buf + l->sensor_num))[row] = d[8];
+	((uint8_t *) (w->buf + l->event_type))[row] = d[9];
+    } else {
+	((uint8_t *) (w->buf + l->sensor_type))[row] = 0;
+	((uint8_t *) (w->buf + l->sensor_num))[row] = 0;
+	((uint8_t *) (w->buf + l->event_type))[row] = 0;
+    }
+    return 0;
+}
+
+int
+ipmi_sel_archive_flush(ipmi_sel_archive_writer_t *w)
+{
+    sel_layout_t    *from = &w->layout;
+    sel_layout_t    to;
+    sel_block_hdr_t *hdr;
+    char            *b = w->buf;
+    unsigned int    rows = w->rows;
+    unsigned int    i;
+    int             rv;
+
+    if (rows == 0)
+	return 0;
+
+    /* Pack the columns down to the real counts, in place.  Each
+       column only moves toward the front and the columns are done
+       in order, so nothing is overwritten before it is moved. */
+    sel_layout(rows, w->num_mcs, &to);
+    memmove(b + to.time, b + from->time, rows * sizeof(int64_t));
+    memmove(b + to.record_id, b + from->record_id, rows * sizeof(uint16_t));
+    memmove(b + to.mc, b + from->mc, rows * sizeof(uint16_t));
+    memmove(b + to.type, b + from->type, rows);
+    memmove(b + to.sensor_type, b + from->sensor_type, rows);
+    memmove(b + to.sensor_num, b + from->sensor_num, rows);
+    memmove(b + to.event_type, b + from->event_type, rows);
+    memmove(b + to.data, b + from->data, rows * IPMI_SEL_ARCHIVE_DATA_LEN);
+    /* Zero the alignment padding so the file contents are defined. */
+    memset(b + to.data + rows * IPMI_SEL_ARCHIVE_DATA_LEN, 0,
+	   to.len - (to.data + rows * IPMI_SEL_ARCHIVE_DATA_LEN));
+
+    hdr = (sel_block_hdr_t *) b;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = SEL_BLOCK_MAGIC;
+    hdr->rows = rows;
+    hdr->num_mcs = w->num_mcs;
+    hdr->len = to.len;
+
+    rv = write_all(w->fd, b, to.len);
+
+    /* Start a new block even on failure, the entries are lost. */
+    w->rows = 0;
+    w->num_mcs = 0;
+    for (i=0; i<w->mc_hash_size; i++)
+	w->mc_hash[i] = -1;
+    return rv;
+}
+
+int
+ipmi_sel_archive_finish(ipmi_sel_archive_writer_t *w)
+{
+    int rv;
+
+    rv = ipmi_sel_archive_flush(w);
+    if (close(w->fd) == -1 && !rv)
+	rv = errno;
+    free(w->buf);
+    free(w->mc_hash);
+    free(w);
+    return rv;
+}
+
+/***********************************************************************
+ *
+ * Reading.
+ *
+ **********************************************************************/
+
+struct ipmi_sel_archive_s
+{
+    char         *addr;
+    size_t       len;
+    size_t       *blocks;
+    unsigned int num_blocks;
+    uint64_t     num_rows;
+};
+
+int
+ipmi_sel_archive_open(const char *path, ipmi_sel_archive_t **archive)
+{
+    ipmi_sel_archive_t *a;
+    sel_file_hdr_t     *hdr;
+    sel_block_hdr_t    *bhdr;
+    sel_layout_t       l;
+    struct stat        st;
+    size_t             off;
+    unsigned int       max_blocks = 0;
+    size_t             *nblocks;
+    int                fd;
+    int                rv;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+	return errno;
+    if (fstat(fd, &st) == -1) {
+	rv = errno;
+	close(fd);
+	return rv;
+    }
+    if (st.st_size < (off_t) sizeof(sel_file_hdr_t)) {
+	close(fd);
+	return EINVAL;
+    }
+
+    a = malloc(sizeof(*a));
+    if (!a) {
+	close(fd);
+	return ENOMEM;
+    }
+    memset(a, 0, sizeof(*a));
+    a->len = st.st_size;
+    a->addr = mmap(NULL, a->len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (a->addr == MAP_FAILED) {
+	rv = errno;
+	free(a);
+	return rv;
+    }
+
+    hdr = (sel_file_hdr_t *) a->addr;
+    if ((hdr->magic != SEL_ARCHIVE_MAGIC)
+	|| (hdr->version != SEL_ARCHIVE_VERSION)
+	|| (hdr->byte_order != SEL_ARCHIVE_ORDER)
+	|| (hdr->data_len != IPMI_SEL_ARCHIVE_DATA_LEN))
+    {
+	rv = EINVAL;
+	goto out_err;
+    }
+
+    /* Index the complete blocks, anything after the last one is a
+       block still being written. */
+    off = sizeof(*hdr);
+    while (off + sizeof(*bhdr) <= a->len) {
+	bhdr = (sel_block_hdr_t *) (a->addr + off);
+	if ((bhdr->magic != SEL_BLOCK_MAGIC) || (bhdr->rows > SEL_MAX_ROWS)
+	    || (bhdr->num_mcs > bhdr->rows))
+	    break;
+	sel_layout(bhdr->rows, bhdr->num_mcs, &l);
+	if ((bhdr->len != l.len) || (l.len > a->len - off))
+	    break;
+
+	if (a->num_blocks == max_blocks) {
+	    max_blocks = max_blocks ? max_blocks * 2 : 64;
+	    nblocks = realloc(a->blocks, max_blocks * sizeof(size_t));
+	    if (!nblocks) {
+		rv = ENOMEM;
+		goto out_err;
+	    }
+	    a->blocks = nblocks;
+	}
+	a->blocks[a->num_blocks++] = off;
+	a->num_rows += bhdr->rows;
+	off += l.len;
+    }
+
+    *archive = a;
+    return 0;
+
+ out_err:
+    ipmi_sel_archive_close(a);
+    return rv;
+}
+
+void
+ipmi_sel_archive_close(ipmi_sel_archive_t *archive)
+{
+    munmap(archive->addr, archive->len);
+    free(archive->blocks);
+    free(archive);
+}
+
+unsigned int
+ipmi_sel_archive_num_blocks(ipmi_sel_archive_t *archive)
+{
+    return archive->num_blocks;
+}
+
+uint64_t
+ipmi_sel_archive_num_rows(ipmi_sel_archive_t *archive)
+{
+    return archive->num_rows;
+}
+
+int
+ipmi_sel_archive_get_block(ipmi_sel_archive_t       *archive,
+			   unsigned int             idx,
+			   ipmi_sel_archive_block_t *block)
+{
+    sel_block_hdr_t *bhdr;
+    sel_layout_t    l;
+    const char      *b;
+
+    if (idx >= archive->num_blocks)
+	return EINVAL;
+
+    b = archive->addr + archive->blocks[idx];
+    bhdr = (sel_block_hdr_t *) b;
+    sel_layout(bhdr->rows, bhdr->num_mcs, &l);
+    block->rows = bhdr->rows;
+    block->num_mcs = bhdr->num_mcs;
+    block->mcs = (const ipmi_sel_archive_mc_t *) (b + l.mcs);
+    block->time = (const int64_t *) (b + l.time);
+    block->record_id = (const uint16_t *) (b + l.record_id);
+    block->mc = (const uint16_t *) (b + l.mc);
+    block->type = (const uint8_t *) (b + l.type);
+    block->sensor_type = (const uint8_t *) (b + l.sensor_type);
+    block->sensor_num = (const uint8_t *) (b + l.sensor_num);
+    block->event_type = (const uint8_t *) (b + l.event_type);
+    block->data = (const uint8_t (*)[IPMI_SEL_ARCHIVE_DATA_LEN]) (b + l.data);
+    return 0;
+}
@@ -52,12 +52,28 @@
 #include <syslog.h>
 #include <signal.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 #ifdef HAVE_EPOLL_PWAIT
 #include <sys/epoll.h>
 #else
-#define EPOLL_CTL_ADD 0
-#define EPOLL_CTL_DEL 0
-#define EPOLL_CTL_MOD 0
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+/* Need to be able to wait with a timeout and signal mask. */
+#ifdef IORING_ENTER_EXT_ARG
+#define SEL_HAVE_IO_URING
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <endian.h>
+#endif
 #endif
 
 typedef struct fd_state_s
@@ -78,6 +94,11 @@ typedef struct fd_control_s
     sel_fd_handler_t handle_read;
     sel_fd_handler_t handle_write;
     sel_fd_handler_t handle_except;
+
+    /* For io_uring, whether a poll is outstanding for the fd and a
+       count to tell it from old ones. */
+    unsigned int     uring_gen;
+    int              uring_armed;
 } fd_control_t;
 
 typedef struct heap_val_s
@@ -109,6 +130,11 @@ typedef struct heap_val_s
 
     sel_timeout_handler_t done_handler;
     void *done_cb_data;
+
+    /* Linkage and expiry tick when the selector uses a timer wheel. */
+    struct sel_timer_s *wheel_next;
+    struct sel_timer_s **wheel_pprev;
+    uint64_t wheel_tick;
 } heap_val_t;
 
 typedef struct theap_s theap_t;
@@ -145,6 +171,92 @@ heap_cmp_key(heap_val_t *v1, heap_val_t *v2)
 
 #include "heap.h"
 
+/*
+ * The optional hierarchical timer wheel (SEL_FLAG_TIMER_WHEEL).
+ * Timeouts are converted to ticks since the selector was created,
+ * rounded up so a timer never goes off early.  Level 0 has a slot per
+ * tick; each slot in a higher level covers a full turn of the level
+ * below it.  When a level wraps, the next slot of the level above is
+ * cascaded, its timers are put back in by their expiry, which moves
+ * them down.  Timers further out than the top level covers go in it
+ * as far out as possible and get re-placed when they cascade.
+ */
+#define SEL_WHEEL_TICK_USEC	1000
+#define SEL_WHEEL_L0_BITS	8
+#define SEL_WHEEL_LN_BITS	6
+#define SEL_WHEEL_LEVELS	4
+#define SEL_WHEEL_L0_SIZE	(1 << SEL_WHEEL_L0_BITS)
+#define SEL_WHEEL_LN_SIZE	(1 << SEL_WHEEL_LN_BITS)
+/* The number of bits of the tick below the slot index for level l. */
+#define SEL_WHEEL_SHIFT(l)	(SEL_WHEEL_L0_BITS			\
+				 + ((l) - 1) * SEL_WHEEL_LN_BITS)
+#define SEL_WHEEL_MAX_TICKS	(((uint64_t) 1) << SEL_WHEEL_SHIFT(SEL_WHEEL_LEVELS))
+
+typedef struct sel_wheel_s
+{
+    /* Tick 0 */
+    struct timeval base;
+
+    /* The next tick to process. */
+    uint64_t curr_tick;
+
+    /* The tick the selector will next wake up for, so we know when
+       a new timer needs to wake it. */
+    uint64_t next_tick;
+    int wake_needed;
+
+    /* Timers in the wheel or waiting to run. */
+    unsigned int count;
+
+    sel_timer_t *l0[SEL_WHEEL_L0_SIZE];
+    sel_timer_t *ln[SEL_WHEEL_LEVELS - 1][SEL_WHEEL_LN_SIZE];
+} sel_wheel_t;
+
+#ifdef SEL_HAVE_IO_URING
+/*
+ * The io_uring backend (SEL_FLAG_IO_URING) works like the epoll one,
+ * each fd has a one-shot poll outstanding for its enabled events.
+ * But re-arming the poll after the handlers run just queues a
+ * request, which goes to the kernel with the next wait, and one wait
+ * can return a bunch of events.  The rings are protected by the fd
+ * lock.
+ */
+#define SEL_URING_ENTRIES	256
+#define SEL_URING_BATCH		32
+
+/* What a completion is for, with a generation and the fd. */
+#define SEL_URING_POLL		1
+#define SEL_URING_REMOVE	2
+#define SEL_URING_WAKE		3
+#define SEL_URING_GEN_MASK	0xffffff
+#define SEL_URING_UDATA(type, gen, fd)					\
+    ((((uint64_t) (type)) << 56)					\
+     | (((uint64_t) ((gen) & SEL_URING_GEN_MASK)) << 32)		\
+     | ((uint32_t) (fd)))
+
+typedef struct sel_uring_s
+{
+    int ring_fd;
+
+    void   *sq_ring;
+    size_t sq_ring_size;
+    void   *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int *sq_array;
+
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+} sel_uring_t;
+#endif
+
 /* Used to build a list of threads that may need to be woken if a
    timer on the top of the heap changes, or an FD is added/removed.
    See wake_sel_thread() for more info. */
@@ -194,24 +306,44 @@ struct selector_s
     /* The timer heap. */
     theap_t timer_heap;
 
+    /* If not NULL, timers are kept here instead of the heap. */
+    sel_wheel_t *wheel;
+
     /* This is a list of items waiting to be woken up because they are
        sitting in a select.  See wake_sel_thread() for more info. */
     sel_wait_list_t wait_list;
 
     void *timer_lock;
 
-    sel_runner_t *runner_head;
-    sel_runner_t *runner_tail;
+    /* Runners waiting to be run, most recently posted first.  This
+       is pushed and taken atomically, without a lock. */
+    sel_runner_t *runner_stack;
 
     int wake_sig;
 
+    /* Threaded selectors are woken by making this readable instead
+       of sending a signal.  It's an eventfd if available, both
+       entries being the same, or a pipe.  -1 if not in use. */
+    int wake_fd[2];
+
 #ifdef HAVE_EPOLL_PWAIT
     int epollfd;
+#endif
+#ifdef SEL_HAVE_IO_URING
+    /* If not NULL, io_uring is used instead of epoll. */
+    sel_uring_t *uring;
 #endif
     sel_lock_t *(*sel_lock_alloc)(void *cb_data);
     void (*sel_lock_free)(sel_lock_t *);
     void (*sel_lock)(sel_lock_t *);
     void (*sel_unlock)(sel_lock_t *);
+
+    /* For selectors with more than one reactor, the first reactor
+       holds the array of all of them (including itself), the others
+       point back to the first one. */
+    selector_t **reactors;
+    unsigned int num_reactors;
+    selector_t *reactor_base;
 };
 
 static void
@@ -253,20 +385,78 @@ sel_fd_unlock(selector_t *sel)
    zero (causing it to wait zero time).  If select has already been
    called, then the signal send should wake it up.  We only need to do
    this after we have calculated the timeout, but before we have
-   called select, thus only things in the wait list matter. */
+   called select, thus only things in the wait list matter.
+
+   If the selector has a wake fd, that is written instead of sending
+   signals.  The select or epoll waits on it, so one write wakes a
+   waiter, and that waiter recalculates everything. */
 static void
 wake_sel_thread(selector_t *sel)
 {
     sel_wait_list_t *item;
 
     item = sel->wait_list.next;
+    if (item == &sel->wait_list)
+	return;
+
     while (item != &sel->wait_list) {
 	item->timeout->tv_sec = 0;
 	item->timeout->tv_usec = 0;
-	if (item->send_sig)
+	if (item->send_sig && sel->wake_fd[1] < 0)
 	    item->send_sig(item->thread_id, item->send_sig_cb_data);
 	item = item->next;
     }
+
+    if (sel->wake_fd[1] >= 0) {
+	uint64_t val = 1;
+	int      rv;
+
+	/* If this fails, the fd is already readable (the pipe is full
+	   or the counter is huge), which is all we need. */
+	rv = write(sel->wake_fd[1], &val, sizeof(val));
+	(void) rv;
+    }
+}
+
+/* Empty the wake fd so it doesn't fire again. */
+static void
+drain_wake_fd(selector_t *sel)
+{
+    uint64_t val[16];
+
+    while (read(sel->wake_fd[0], val, sizeof(val)) == sizeof(val))
+	;
+}
+
+static int
+alloc_wake_fd(selector_t *sel)
+{
+#ifdef HAVE_EVENTFD
+    sel->wake_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sel->wake_fd[0] >= 0) {
+	sel->wake_fd[1] = sel->wake_fd[0];
+	return 0;
+    }
+#endif
+    if (pipe(sel->wake_fd) == -1)
+	return errno;
+    fcntl(sel->wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(sel->wake_fd[1], F_SETFL, O_NONBLOCK);
+    fcntl(sel->wake_fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(sel->wake_fd[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+static void
+free_wake_fd(selector_t *sel)
+{
+    if (sel->wake_fd[0] < 0)
+	return;
+    if (sel->wake_fd[1] != sel->wake_fd[0])
+	close(sel->wake_fd[1]);
+    close(sel->wake_fd[0]);
+    sel->wake_fd[0] = -1;
+    sel->wake_fd[1] = -1;
 }
 
 static void
@@ -279,7 +469,13 @@ wake_fd_sel_thread(selector_t *sel)
 static void
 wake_timer_sel_thread(selector_t *sel, volatile sel_timer_t *old_top)
 {
-    if (old_top != theap_get_top(&sel->timer_heap))
+    if (sel->wheel) {
+	/* A timer went in before the selector was going to wake up. */
+	if (sel->wheel->wake_needed) {
+	    sel->wheel->wake_needed = 0;
+	    wake_sel_thread(sel);
+	}
+    } else if (old_top != theap_get_top(&sel->timer_heap))
 	/* If the top value changed, restart the waiting thread. */
 	wake_sel_thread(sel);
 
@@ -322,10 +518,213 @@ init_fd(fd_control_t *fd)
     fd->handle_except = NULL;
 }
 
-#ifdef HAVE_EPOLL_PWAIT
+#ifdef SEL_HAVE_IO_URING
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags, void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		   arg, argsz);
+}
+
+static void
+free_uring(sel_uring_t *u)
+{
+    if (u->sqes)
+	munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring && u->cq_ring != u->sq_ring)
+	munmap(u->cq_ring, u->cq_ring_size);
+    if (u->sq_ring)
+	munmap(u->sq_ring, u->sq_ring_size);
+    close(u->ring_fd);
+    free(u);
+}
+
+static int
+alloc_uring(sel_uring_t **new_u)
+{
+    struct io_uring_params p;
+    sel_uring_t            *u;
+    void                   *m;
+    int                    fd, rv;
+
+    memset(&p, 0, sizeof(p));
+    fd = sys_io_uring_setup(SEL_URING_ENTRIES, &p);
+    if (fd == -1)
+	return errno;
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+	close(fd);
+	return ENOSYS;
+    }
+
+    u = malloc(sizeof(*u));
+    if (!u) {
+	close(fd);
+	return ENOMEM;
+    }
+    memset(u, 0, sizeof(*u));
+    u->ring_fd = fd;
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_ring_size = (p.cq_off.cqes
+		       + p.cq_entries * sizeof(struct io_uring_cqe));
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (u->cq_ring_size > u->sq_ring_size)
+	    u->sq_ring_size = u->cq_ring_size;
+	u->cq_ring_size = u->sq_ring_size;
+    }
+
+    m = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+	     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (m == MAP_FAILED)
+	goto out_err;
+    u->sq_ring = m;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	u->cq_ring = u->sq_ring;
+    } else {
+	m = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	if (m == MAP_FAILED)
+	    goto out_err;
+	u->cq_ring = m;
+    }
+
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+	     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (m == MAP_FAILED)
+	goto out_err;
+    u->sqes = m;
+
+    u->sq_head = (void *) ((char *) u->sq_ring + p.sq_off.head);
+    u->sq_tail = (void *) ((char *) u->sq_ring + p.sq_off.tail);
+    u->sq_mask = *(unsigned int *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (void *) ((char *) u->sq_ring + p.sq_off.array);
+    u->cq_head = (void *) ((char *) u->cq_ring + p.cq_off.head);
+    u->cq_tail = (void *) ((char *) u->cq_ring + p.cq_off.tail);
+    u->cq_mask = *(unsigned int *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (void *) ((char *) u->cq_ring + p.cq_off.cqes);
+
+    *new_u = u;
+    return 0;
+
+ out_err:
+    rv = errno;
+    free_uring(u);
+    return rv;
+}
+
+/* Number of queued requests the kernel hasn't taken yet. */
+static unsigned int
+uring_pending(sel_uring_t *u)
+{
+    return *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static void
+uring_submit(sel_uring_t *u)
+{
+    unsigned int to_submit = uring_pending(u);
+
+    if (to_submit)
+	sys_io_uring_enter(u->ring_fd, to_submit, 0, 0, NULL, 0);
+}
+
+/* Queue a request.  Must be called with the fd lock held. */
+static void
+uring_queue(sel_uring_t *u, unsigned int opcode, int fd, uint32_t events,
+	    uint64_t addr, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int        tail = *u->sq_tail;
+    unsigned int        idx;
+
+    if (uring_pending(u) > u->sq_mask) {
+	/* Full, push what's there to the kernel. */
+	uring_submit(u);
+	if (uring_pending(u) > u->sq_mask) {
+	    syslog(LOG_ERR, "selector: io_uring submission queue full");
+	    return;
+	}
+    }
+
+    idx = tail & u->sq_mask;
+    sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    sqe->poll32_events = events;
+    sqe->addr = addr;
+    sqe->user_data = user_data;
+    u->sq_array[idx] = idx;
+    /* Fill the entry in before the kernel can see it. */
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Equivalent of epoll_ctl() with EPOLLONESHOT.  If submit is not set
+   the request waits for the next submit or wait.  Must be called with
+   the fd lock held. */
+static void
+sel_update_uring(selector_t *sel, int fd, int op, int submit)
+{
+    sel_uring_t  *u = sel->uring;
+    fd_control_t *fdc = (fd_control_t *) &(sel->fds[fd]);
+    uint32_t     events = 0;
+
+    if (fdc->uring_armed) {
+	uring_queue(u, IORING_OP_POLL_REMOVE, -1, 0,
+		    SEL_URING_UDATA(SEL_URING_POLL, fdc->uring_gen, fd),
+		    SEL_URING_UDATA(SEL_URING_REMOVE, 0, fd));
+	fdc->uring_armed = 0;
+    }
+    fdc->uring_gen++;
+
+    if (op != EPOLL_CTL_DEL) {
+	if (FD_ISSET(fd, &sel->read_set))
+	    events |= POLLIN | POLLHUP;
+	if (FD_ISSET(fd, &sel->write_set))
+	    events |= POLLOUT;
+	if (FD_ISSET(fd, &sel->except_set))
+	    events |= POLLERR | POLLPRI;
+    }
+    if (events) {
+	uring_queue(u, IORING_OP_POLL_ADD, fd, events, 0,
+		    SEL_URING_UDATA(SEL_URING_POLL, fdc->uring_gen, fd));
+	fdc->uring_armed = 1;
+    }
+
+    if (submit)
+	uring_submit(u);
+}
+
+static void
+uring_arm_wake_fd(selector_t *sel)
+{
+    uring_queue(sel->uring, IORING_OP_POLL_ADD, sel->wake_fd[0], POLLIN, 0,
+		SEL_URING_UDATA(SEL_URING_WAKE, 0, sel->wake_fd[0]));
+}
+#endif
+
 static int
 sel_update_epoll(selector_t *sel, int fd, int op)
 {
+#ifdef SEL_HAVE_IO_URING
+    if (sel->uring) {
+	sel_update_uring(sel, fd, op, 1);
+	return 0;
+    }
+#endif
+#ifdef HAVE_EPOLL_PWAIT
     struct epoll_event event;
 
     if (sel->epollfd < 0)
@@ -343,14 +742,10 @@ sel_update_epoll(selector_t *sel, int fd, int op)
 
     epoll_ctl(sel->epollfd, op, fd, &event);
     return 0;
-}
 #else
-static int
-sel_update_epoll(selector_t *sel, int fd, int op)
-{
     return 1;
-}
 #endif
+}
 
 /* Set the handlers for a file descriptor. */
 int
@@ -554,6 +949,188 @@ diff_timeval(struct timeval *dest,
     }
 }
 
+static uint64_t
+wheel_tick(sel_wheel_t *w, const struct timeval *tv, int round_up)
+{
+    int64_t usec;
+
+    usec = (((int64_t) (tv->tv_sec - w->base.tv_sec)) * 1000000
+	    + (tv->tv_usec - w->base.tv_usec));
+    if (usec <= 0)
+	return 0;
+    if (round_up)
+	usec += SEL_WHEEL_TICK_USEC - 1;
+    return usec / SEL_WHEEL_TICK_USEC;
+}
+
+static void
+wheel_tick_to_timeval(sel_wheel_t *w, uint64_t tick, struct timeval *tv)
+{
+    uint64_t usec = tick * SEL_WHEEL_TICK_USEC + w->base.tv_usec;
+
+    tv->tv_sec = w->base.tv_sec + usec / 1000000;
+    tv->tv_usec = usec % 1000000;
+}
+
+static void
+wheel_link(sel_timer_t **head, sel_timer_t *timer)
+{
+    timer->val.wheel_next = *head;
+    if (*head)
+	(*head)->val.wheel_pprev = &timer->val.wheel_next;
+    timer->val.wheel_pprev = head;
+    *head = timer;
+}
+
+static void
+wheel_unlink(sel_timer_t *timer)
+{
+    *timer->val.wheel_pprev = timer->val.wheel_next;
+    if (timer->val.wheel_next)
+	timer->val.wheel_next->val.wheel_pprev = timer->val.wheel_pprev;
+    timer->val.wheel_next = NULL;
+    timer->val.wheel_pprev = NULL;
+}
+
+/* Put a timer in the slot for its expiry, relative to the current
+   tick. */
+static void
+wheel_insert(sel_wheel_t *w, sel_timer_t *timer)
+{
+    uint64_t     expires = timer->val.wheel_tick;
+    uint64_t     delta;
+    unsigned int l, idx;
+
+    if (expires < w->curr_tick)
+	/* Already due, it will go on the next tick processed. */
+	expires = w->curr_tick;
+    delta = expires - w->curr_tick;
+    if (delta < SEL_WHEEL_L0_SIZE) {
+	wheel_link(&w->l0[expires & (SEL_WHEEL_L0_SIZE - 1)], timer);
+	return;
+    }
+
+    if (delta >= SEL_WHEEL_MAX_TICKS)
+	expires = w->curr_tick + SEL_WHEEL_MAX_TICKS - 1;
+    for (l = 1; l < SEL_WHEEL_LEVELS - 1; l++) {
+	if ((expires - w->curr_tick) < (((uint64_t) 1) << SEL_WHEEL_SHIFT(l+1)))
+	    break;
+    }
+    idx = (expires >> SEL_WHEEL_SHIFT(l)) & (SEL_WHEEL_LN_SIZE - 1);
+    wheel_link(&w->ln[l-1][idx], timer);
+}
+
+/* Re-place all the timers in a higher level slot. */
+static void
+wheel_cascade(sel_wheel_t *w, unsigned int l, unsigned int idx)
+{
+    sel_timer_t *timer;
+
+    while ((timer = w->ln[l-1][idx])) {
+	wheel_unlink(timer);
+	wheel_insert(w, timer);
+    }
+}
+
+/* Process the current tick, moving its timers to the end of the
+   expired list. */
+static void
+wheel_expire_tick(sel_wheel_t *w, sel_timer_t ***expired_tail)
+{
+    uint64_t     tick = w->curr_tick;
+    unsigned int l, idx;
+    sel_timer_t  *timer;
+
+    idx = tick & (SEL_WHEEL_L0_SIZE - 1);
+    for (l = 1; (idx == 0) && (l < SEL_WHEEL_LEVELS); l++) {
+	idx = (tick >> SEL_WHEEL_SHIFT(l)) & (SEL_WHEEL_LN_SIZE - 1);
+	wheel_cascade(w, l, idx);
+    }
+
+    idx = tick & (SEL_WHEEL_L0_SIZE - 1);
+    while ((timer = w->l0[idx])) {
+	wheel_unlink(timer);
+	wheel_link(*expired_tail, timer);
+	*expired_tail = &timer->val.wheel_next;
+    }
+
+    w->curr_tick++;
+}
+
+/* The earliest tick something needs to be done, either a level 0
+   slot with timers or a cascade of a higher level slot with timers.
+   The latter may be early, but that just means an extra wakeup. */
+static uint64_t
+wheel_next_event(sel_wheel_t *w)
+{
+    uint64_t     curr = w->curr_tick;
+    uint64_t     best = UINT64_MAX;
+    uint64_t     block;
+    unsigned int l, i, shift;
+
+    if (w->count == 0)
+	return UINT64_MAX;
+
+    for (i = 0; i < SEL_WHEEL_L0_SIZE; i++) {
+	if (w->l0[(curr + i) & (SEL_WHEEL_L0_SIZE - 1)]) {
+	    best = curr + i;
+	    break;
+	}
+    }
+
+    for (l = 1; l < SEL_WHEEL_LEVELS; l++) {
+	shift = SEL_WHEEL_SHIFT(l);
+	block = curr >> shift;
+	/* The current slot has already been cascaded unless we are
+	   sitting right on its boundary. */
+	i = (curr & ((((uint64_t) 1) << shift) - 1)) ? 1 : 0;
+	for (; i <= SEL_WHEEL_LN_SIZE; i++) {
+	    if (w->ln[l-1][(block + i) & (SEL_WHEEL_LN_SIZE - 1)]) {
+		if (((block + i) << shift) < best)
+		    best = (block + i) << shift;
+		break;
+	    }
+	}
+    }
+
+    return best;
+}
+
+/*
+ * Add and remove timers from whichever of the heap or the wheel the
+ * selector is using.  Must be called with the timer lock held.
+ */
+static void
+sel_timer_add(selector_t *sel, sel_timer_t *timer)
+{
+    sel_wheel_t *w = sel->wheel;
+
+    if (!w) {
+	theap_add(&sel->timer_heap, timer);
+	return;
+    }
+
+    timer->val.wheel_tick = wheel_tick(w, &timer->val.timeout, 1);
+    wheel_insert(w, timer);
+    w->count++;
+    if (timer->val.wheel_tick < w->next_tick) {
+	w->next_tick = timer->val.wheel_tick;
+	w->wake_needed = 1;
+    }
+}
+
+static void
+sel_timer_remove(selector_t *sel, sel_timer_t *timer)
+{
+    if (!sel->wheel) {
+	theap_remove(&sel->timer_heap, timer);
+	return;
+    }
+
+    wheel_unlink(timer);
+    sel->wheel->count--;
+}
+
 int
 sel_alloc_timer(selector_t            *sel,
 		sel_timeout_handler_t handler,
@@ -615,7 +1192,7 @@ sel_start_timer(sel_timer_t    *timer,
 
     if (!timer->val.in_handler) {
 	/* Wait until the handler returns to start the timer. */
-	theap_add(&sel->timer_heap, timer);
+	sel_timer_add(sel, timer);
 	timer->val.in_heap = 1;
     }
     timer->val.stopped = 0;
@@ -640,7 +1217,7 @@ sel_stop_timer(sel_timer_t *timer)
     if (timer->val.in_heap) {
 	top = theap_get_top(&sel->timer_heap);
 
-	theap_remove(&sel->timer_heap, timer);
+	sel_timer_remove(sel, timer);
 	timer->val.in_heap = 0;
 	wake_timer_sel_thread(sel, top);
     }
@@ -673,7 +1250,7 @@ sel_stop_timer_with_done(sel_timer_t *timer,
     if (timer->val.in_heap) {
 	top = theap_get_top(&sel->timer_heap);
 
-	theap_remove(&sel->timer_heap, timer);
+	sel_timer_remove(sel, timer);
 	timer->val.in_heap = 0;
 
 	wake_timer_sel_thread(sel, top);
@@ -695,6 +1272,129 @@ sel_get_monotonic_time(struct timeval *tv)
     tv->tv_usec = (ts.tv_nsec + 500) / 1000;
 }
 
+#ifdef HAVE_TLS
+/*
+ * The time for the pass through sel_select() this thread is in, so
+ * the timers and fd handlers it calls don't each read the clock.
+ * sel_pass is non-zero while in a pass.  The time is read again the
+ * first time it's needed after waiting for fds.
+ */
+static __thread unsigned int   sel_pass;
+static __thread int            sel_now_valid;
+static __thread struct timeval sel_now;
+#endif
+
+void
+sel_refresh_monotonic_time(struct timeval *tv)
+{
+    sel_get_monotonic_time(tv);
+#ifdef HAVE_TLS
+    if (sel_pass) {
+	sel_now = *tv;
+	sel_now_valid = 1;
+    }
+#endif
+}
+
+void
+sel_get_cached_monotonic_time(struct timeval *tv)
+{
+#ifdef HAVE_TLS
+    if (sel_pass && sel_now_valid) {
+	*tv = sel_now;
+	return;
+    }
+#endif
+    sel_refresh_monotonic_time(tv);
+}
+
+/*
+ * Call a timer that has been removed from the heap or wheel.  Must be
+ * called with sel->timer_lock held, it will be released while the
+ * handlers run.
+ */
+static void
+sel_call_timer(selector_t *sel, sel_timer_t *timer)
+{
+    timer->val.in_heap = 0;
+    timer->val.stopped = 1;
+    timer->val.in_handler = 1;
+    sel_timer_unlock(sel);
+    timer->val.handler(sel, timer, timer->val.user_data);
+    sel_timer_lock(sel);
+    timer->val.in_handler = 0;
+    if (timer->val.done_handler) {
+	sel_timeout_handler_t done_handler = timer->val.done_handler;
+	void *done_cb_data = timer->val.done_cb_data;
+	timer->val.done_handler = NULL;
+	sel_timer_unlock(sel);
+	done_handler(sel, timer, done_cb_data);
+	sel_timer_lock(sel);
+    }
+    if (timer->val.freed)
+	free(timer);
+    else if (!timer->val.stopped) {
+	/* We were restarted while in the handler. */
+	sel_timer_add(sel, timer);
+	timer->val.in_heap = 1;
+    }
+}
+
+/*
+ * Process the timers on the wheel.  Everything that is due is pulled
+ * off the wheel first, then the handlers are called.  The timers stay
+ * "in_heap" on the expired list until they are called, so they can
+ * still be stopped while another one's handler runs.
+ */
+static void
+process_wheel_timers(selector_t	             *sel,
+		     volatile struct timeval *timeout)
+{
+    sel_wheel_t    *w = sel->wheel;
+    struct timeval now;
+    struct timeval next;
+    uint64_t       now_tick;
+    sel_timer_t    *expired = NULL;
+    sel_timer_t    **expired_tail = &expired;
+    sel_timer_t    *timer;
+
+    sel_refresh_monotonic_time(&now);
+    now_tick = wheel_tick(w, &now, 0);
+    if (w->count == 0) {
+	/* Nothing to cascade or expire, just catch up. */
+	if (w->curr_tick <= now_tick)
+	    w->curr_tick = now_tick + 1;
+    } else {
+	while (w->curr_tick <= now_tick)
+	    wheel_expire_tick(w, &expired_tail);
+    }
+
+    if (expired) {
+	while ((timer = expired)) {
+	    wheel_unlink(timer);
+	    w->count--;
+	    sel_call_timer(sel, timer);
+	}
+
+	/* If called, set the timeout to zero.  The next call will
+	   figure out when to wake up. */
+	w->next_tick = w->curr_tick;
+	timeout->tv_sec = 0;
+	timeout->tv_usec = 0;
+	return;
+    }
+
+    w->next_tick = wheel_next_event(w);
+    if (w->next_tick == UINT64_MAX) {
+	/* No timers, just set a long time. */
+	timeout->tv_sec = 100000;
+	timeout->tv_usec = 0;
+    } else {
+	wheel_tick_to_timeval(w, w->next_tick, &next);
+	diff_timeval((struct timeval *) timeout, &next, &now);
+    }
+}
+
 /*
  * Process timers on selector.  The timeout is always set, to a very
  * long value if no timers are waiting.  Note that this *must* be
@@ -709,34 +1409,17 @@ process_timers(selector_t	       *sel,
     sel_timer_t    *timer;
     int            called = 0;
 
+    if (sel->wheel) {
+	process_wheel_timers(sel, timeout);
+	return;
+    }
+
     timer = theap_get_top(&sel->timer_heap);
-    sel_get_monotonic_time(&now);
+    sel_refresh_monotonic_time(&now);
     while (timer && cmp_timeval(&now, &timer->val.timeout) >= 0) {
 	called = 1;
 	theap_remove(&(sel->timer_heap), timer);
-	timer->val.in_heap = 0;
-	timer->val.stopped = 1;
-	timer->val.in_handler = 1;
-	sel_timer_unlock(sel);
-	timer->val.handler(sel, timer, timer->val.user_data);
-	sel_timer_lock(sel);
-	timer->val.in_handler = 0;
-	if (timer->val.done_handler) {
-	    sel_timeout_handler_t done_handler = timer->val.done_handler;
-	    void *done_cb_data = timer->val.done_cb_data;
-	    timer->val.done_handler = NULL;
-	    sel_timer_unlock(sel);
-	    done_handler(sel, timer, done_cb_data);
-	    sel_timer_lock(sel);
-	}
-	if (timer->val.freed)
-	    free(timer);
-	else if (!timer->val.stopped) {
-	    /* We were restarted while in the handler. */
-	    theap_add(&sel->timer_heap, timer);
-	    timer->val.in_heap = 1;
-	}
-
+	sel_call_timer(sel, timer);
 	timer = theap_get_top(&sel->timer_heap);
     }
 
@@ -745,7 +1428,7 @@ process_timers(selector_t	       *sel,
 	timeout->tv_sec = 0;
 	timeout->tv_usec = 0;
     } else if (timer) {
-	sel_get_monotonic_time(&now);
+	sel_refresh_monotonic_time(&now);
 	diff_timeval((struct timeval *) timeout,
 		     (struct timeval *) &timer->val.timeout,
 		     &now);
@@ -773,63 +1456,82 @@ sel_alloc_runner(selector_t *sel, sel_runner_t **new_runner)
 int
 sel_free_runner(sel_runner_t *runner)
 {
-    selector_t *sel = runner->sel;
-
-    sel_timer_lock(sel);
-    if (runner->in_use) {
-	sel_timer_unlock(sel);
+    if (__atomic_load_n(&runner->in_use, __ATOMIC_ACQUIRE))
 	return EBUSY;
-    }
-    sel_timer_unlock(sel);
     free(runner);
     return 0;
 }
 
+/*
+ * Runners may be posted from any thread without taking a lock.  They
+ * are pushed on a stack with compare and swap, and a selector thread
+ * takes the whole stack at once and reverses it, so they run in the
+ * order they were posted and there is no ABA problem.
+ */
 int
 sel_run(sel_runner_t *runner, sel_runner_func_t func, void *cb_data)
 {
-    selector_t *sel = runner->sel;
+    selector_t   *sel = runner->sel;
+    sel_runner_t *head;
+    int          expected = 0;
 
-    sel_timer_lock(sel);
-    if (runner->in_use) {
-	sel_timer_unlock(sel);
+    if (!__atomic_compare_exchange_n(&runner->in_use, &expected, 1, 0,
+				     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
 	return EBUSY;
-    }
 
     runner->func = func;
     runner->cb_data = cb_data;
-    runner->next = NULL;
-    runner->in_use = 1;
 
-    if (sel->runner_tail) {
-	sel->runner_tail->next = runner;
-	sel->runner_tail = runner;
-    } else {
-	sel->runner_head = runner;
-	sel->runner_tail = runner;
+    head = __atomic_load_n(&sel->runner_stack, __ATOMIC_RELAXED);
+    do {
+	runner->next = head;
+    } while (!__atomic_compare_exchange_n(&sel->runner_stack, &head, runner,
+					  1, __ATOMIC_RELEASE,
+					  __ATOMIC_RELAXED));
+
+    if (!head && sel->wake_fd[1] >= 0) {
+	/* The first one in, make sure a waiting thread runs it.  This
+	   doesn't need the lock, the fd stays readable until one of
+	   them gets it. */
+	uint64_t val = 1;
+	int      rv;
+
+	rv = write(sel->wake_fd[1], &val, sizeof(val));
+	(void) rv;
     }
-    sel_timer_unlock(sel);
     return 0;
 }
 
+/* Run all the posted runners.  Called with the timer lock held, which
+   it drops while each runs. */
 static void
 process_runners(selector_t *sel)
 {
-    while (sel->runner_head) {
-	sel_runner_t *runner = sel->runner_head;
-	sel_runner_func_t func;
-	void *cb_data;
-
-	sel->runner_head = sel->runner_head->next;
-	if (!sel->runner_head)
-	    sel->runner_tail = NULL;
-	runner->in_use = 0;
-	func = runner->func;
-	cb_data = runner->cb_data;
-	sel_timer_unlock(sel);
+    sel_runner_t *list, *next, *runner = NULL;
+
+    if (!__atomic_load_n(&sel->runner_stack, __ATOMIC_RELAXED))
+	return;
+
+    list = __atomic_exchange_n(&sel->runner_stack, NULL, __ATOMIC_ACQUIRE);
+    while (list) {
+	next = list->next;
+	list->next = runner;
+	runner = list;
+	list = next;
+    }
+
+    sel_timer_unlock(sel);
+    while (runner) {
+	sel_runner_func_t func = runner->func;
+	void              *cb_data = runner->cb_data;
+
+	next = runner->next;
+	/* Once this is cleared, the runner may be posted again. */
+	__atomic_store_n(&runner->in_use, 0, __ATOMIC_RELEASE);
 	func(runner, cb_data);
-	sel_timer_lock(sel);
+	runner = next;
     }
+    sel_timer_lock(sel);
 }
 
 static void
@@ -890,6 +1592,12 @@ process_fds(selector_t	            *sel,
     num_fds = sel->maxfd+1;
     sel_fd_unlock(sel);
 
+    if (sel->wake_fd[0] >= 0) {
+	FD_SET(sel->wake_fd[0], &tmp_read_set);
+	if (sel->wake_fd[0] >= num_fds)
+	    num_fds = sel->wake_fd[0] + 1;
+    }
+
     err = select(num_fds,
 		 &tmp_read_set,
 		 &tmp_write_set,
@@ -898,6 +1606,11 @@ process_fds(selector_t	            *sel,
     if (err <= 0)
 	goto out;
 
+    if (sel->wake_fd[0] >= 0 && FD_ISSET(sel->wake_fd[0], &tmp_read_set)) {
+	drain_wake_fd(sel);
+	FD_CLR(sel->wake_fd[0], &tmp_read_set);
+    }
+
     /* We got some I/O. */
     sel_fd_lock(sel);
     for (i = 0; i <= sel->maxfd; i++) {
@@ -945,8 +1658,13 @@ process_fds_epoll(selector_t *sel, struct timeval *tvtimeout)
     if (rv <= 0)
 	return rv;
 
-    sel_fd_lock(sel);
     fd = event.data.fd;
+    if (fd == sel->wake_fd[0]) {
+	drain_wake_fd(sel);
+	return 0;
+    }
+
+    sel_fd_lock(sel);
     if (event.events & (EPOLLIN | EPOLLHUP))
 	handle_selector_call(sel, fd, &sel->read_set,
 			     sel->fds[fd].handle_read);
@@ -966,6 +1684,105 @@ process_fds_epoll(selector_t *sel, struct timeval *tvtimeout)
 }
 #endif
 
+#ifdef SEL_HAVE_IO_URING
+static int
+process_fds_uring(selector_t *sel, struct timeval *tvtimeout)
+{
+    sel_uring_t                   *u = sel->uring;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec      ts;
+    struct io_uring_cqe           cqes[SEL_URING_BATCH];
+    sigset_t                      sigmask;
+    unsigned int                  to_submit, head, tail, n, i;
+    int                           rv, others_waiting;
+
+#ifdef USE_PTHREADS
+    pthread_sigmask(SIG_SETMASK, NULL, &sigmask);
+#else
+    sigprocmask(SIG_SETMASK, NULL, &sigmask);
+#endif
+    sigdelset(&sigmask, sel->wake_sig);
+
+    ts.tv_sec = tvtimeout->tv_sec;
+    ts.tv_nsec = tvtimeout->tv_usec * 1000;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask = (uintptr_t) &sigmask;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uintptr_t) &ts;
+
+    /* Send any re-arms along with the wait. */
+    sel_fd_lock(sel);
+    to_submit = uring_pending(u);
+    sel_fd_unlock(sel);
+    rv = sys_io_uring_enter(u->ring_fd, to_submit, 1,
+			    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			    &arg, sizeof(arg));
+    if (rv == -1 && errno != ETIME)
+	return -1;
+
+    sel_fd_lock(sel);
+    head = *u->cq_head;
+    tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for (n = 0; head != tail && n < SEL_URING_BATCH; n++, head++)
+	cqes[n] = u->cqes[head & u->cq_mask];
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+    for (i = 0; i < n; i++) {
+	uint64_t     ud = cqes[i].user_data;
+	unsigned int type = ud >> 56;
+	unsigned int gen = (ud >> 32) & SEL_URING_GEN_MASK;
+	int          fd = (uint32_t) ud;
+	int          events = cqes[i].res;
+	fd_control_t *fdc;
+
+	if (type == SEL_URING_WAKE) {
+	    drain_wake_fd(sel);
+	    uring_arm_wake_fd(sel);
+	    continue;
+	}
+	if (type != SEL_URING_POLL)
+	    continue;
+
+	fdc = (fd_control_t *) &(sel->fds[fd]);
+	if (!fdc->uring_armed
+	    || (fdc->uring_gen & SEL_URING_GEN_MASK) != gen)
+	    /* An old poll that was removed or replaced. */
+	    continue;
+	fdc->uring_armed = 0;
+	if (events < 0)
+	    continue;
+
+	if (events & (POLLIN | POLLHUP))
+	    handle_selector_call(sel, fd, &sel->read_set,
+				 sel->fds[fd].handle_read);
+	if (events & POLLOUT)
+	    handle_selector_call(sel, fd, &sel->write_set,
+				 sel->fds[fd].handle_write);
+	if (events & (POLLERR | POLLPRI))
+	    handle_selector_call(sel, fd, &sel->except_set,
+				 sel->fds[fd].handle_except);
+
+	/* Rearm, unless it was deleted or re-armed in the handler. */
+	if (sel->fds[fd].state && !fdc->uring_armed)
+	    sel_update_uring(sel, fd, EPOLL_CTL_MOD, 0);
+    }
+    sel_fd_unlock(sel);
+
+    /* If another thread is waiting in the kernel, it needs to see the
+       re-arms now, otherwise they can go with our next wait. */
+    sel_timer_lock(sel);
+    others_waiting = sel->wait_list.next != sel->wait_list.prev;
+    sel_timer_unlock(sel);
+    if (others_waiting) {
+	sel_fd_lock(sel);
+	uring_submit(u);
+	sel_fd_unlock(sel);
+    }
+
+    return n;
+}
+#endif
+
 int
 sel_select(selector_t      *sel,
 	   sel_send_sig_cb send_sig,
@@ -977,6 +1794,9 @@ sel_select(selector_t      *sel,
     struct timeval  loc_timeout;
     sel_wait_list_t wait_entry;
 
+#ifdef HAVE_TLS
+    sel_pass++;
+#endif
     sel_timer_lock(sel);
     process_runners(sel);
     process_timers(sel, (struct timeval *)(&loc_timeout));
@@ -988,6 +1808,16 @@ sel_select(selector_t      *sel,
 		      &loc_timeout);
     sel_timer_unlock(sel);
 
+#ifdef HAVE_TLS
+    /* We are about to wait, the time will be stale after it. */
+    sel_now_valid = 0;
+#endif
+
+#ifdef SEL_HAVE_IO_URING
+    if (sel->uring)
+	err = process_fds_uring(sel, &loc_timeout);
+    else
+#endif
 #ifdef HAVE_EPOLL_PWAIT
     if (sel->epollfd >= 0)
 	err = process_fds_epoll(sel, &loc_timeout);
@@ -999,6 +1829,12 @@ sel_select(selector_t      *sel,
     remove_sel_wait_list(sel, &wait_entry);
     sel_timer_unlock(sel);
 
+#ifdef HAVE_TLS
+    sel_pass--;
+    /* A handler may have run a nested pass. */
+    sel_now_valid = 0;
+#endif
+
     return err;
 }
 
@@ -1027,21 +1863,42 @@ sel_select_loop(selector_t      *sel,
 
 /* Initialize the select code. */
 int
-sel_alloc_selector_thread(selector_t **new_selector, int wake_sig,
-			  sel_lock_t *(*sel_lock_alloc)(void *cb_data),
-			  void (*sel_lock_free)(sel_lock_t *),
-			  void (*sel_lock)(sel_lock_t *),
-			  void (*sel_unlock)(sel_lock_t *),
-			  void *cb_data)
+sel_alloc_selector_thread_flags(selector_t **new_selector, int wake_sig,
+				sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+				void (*sel_lock_free)(sel_lock_t *),
+				void (*sel_lock)(sel_lock_t *),
+				void (*sel_unlock)(sel_lock_t *),
+				void *cb_data,
+				unsigned int flags)
 {
     selector_t *sel;
     unsigned int i;
 
+    if (flags & ~(SEL_FLAG_TIMER_WHEEL | SEL_FLAG_IO_URING
+		  | SEL_FLAG_SELECT))
+	return EINVAL;
+
+    if (getenv("OPENIPMI_SEL_IO_URING"))
+	flags |= SEL_FLAG_IO_URING;
+    if (flags & SEL_FLAG_SELECT)
+	flags &= ~SEL_FLAG_IO_URING;
+
     sel = malloc(sizeof(*sel));
     if (!sel)
 	return ENOMEM;
     memset(sel, 0, sizeof(*sel));
 
+    if (flags & SEL_FLAG_TIMER_WHEEL) {
+	sel->wheel = malloc(sizeof(*sel->wheel));
+	if (!sel->wheel) {
+	    free(sel);
+	    return ENOMEM;
+	}
+	memset(sel->wheel, 0, sizeof(*sel->wheel));
+	sel_get_monotonic_time(&sel->wheel->base);
+	sel->wheel->next_tick = UINT64_MAX;
+    }
+
     sel->sel_lock_alloc = sel_lock_alloc;
     sel->sel_lock_free = sel_lock_free;
     sel->sel_lock = sel_lock;
@@ -1052,6 +1909,8 @@ sel_alloc_selector_thread(selector_t **new_selector, int wake_sig,
     sel->wait_list.prev = &sel->wait_list;
 
     sel->wake_sig = wake_sig;
+    sel->wake_fd[0] = -1;
+    sel->wake_fd[1] = -1;
 
     FD_ZERO((fd_set *) &sel->read_set);
     FD_ZERO((fd_set *) &sel->write_set);
@@ -1066,22 +1925,59 @@ sel_alloc_selector_thread(selector_t **new_selector, int wake_sig,
     if (sel->sel_lock_alloc) {
 	sel->timer_lock = sel->sel_lock_alloc(cb_data);
 	if (!sel->timer_lock) {
+	    free(sel->wheel);
 	    free(sel);
 	    return ENOMEM;
 	}
 	sel->fd_lock = sel->sel_lock_alloc(cb_data);
 	if (!sel->fd_lock) {
 	    sel->sel_lock_free(sel->fd_lock);
+	    free(sel->wheel);
 	    free(sel);
 	    return ENOMEM;
 	}
+
+	/* Only other threads need to wake a selector. */
+	if (alloc_wake_fd(sel))
+	    syslog(LOG_ERR, "Unable to set up wake fd, using signals: %m");
+    }
+
+#ifdef SEL_HAVE_IO_URING
+    if (flags & SEL_FLAG_IO_URING) {
+	sigset_t sigset;
+	int      rv;
+
+	rv = alloc_uring(&sel->uring);
+	if (rv) {
+	    syslog(LOG_ERR, "Unable to set up io_uring, falling back to"
+		   " epoll: %s", strerror(rv));
+	} else {
+	    /* The wake signal only gets through while waiting. */
+	    sigemptyset(&sigset);
+	    sigaddset(&sigset, wake_sig);
+	    sigprocmask(SIG_BLOCK, &sigset, NULL);
+	    if (sel->wake_fd[0] >= 0) {
+		uring_arm_wake_fd(sel);
+		uring_submit(sel->uring);
+	    }
+	}
     }
+#endif
 
 #ifdef HAVE_EPOLL_PWAIT
-    sel->epollfd = epoll_create(32768);
-    if (sel->epollfd == -1) {
-	syslog(LOG_ERR, "Unable to set up epoll, falling back to select: %m");
-    } else {
+    if (flags & SEL_FLAG_SELECT)
+	sel->epollfd = -1;
+#ifdef SEL_HAVE_IO_URING
+    else if (sel->uring)
+	sel->epollfd = -1;
+#endif
+    else {
+	sel->epollfd = epoll_create(32768);
+	if (sel->epollfd == -1)
+	    syslog(LOG_ERR, "Unable to set up epoll, falling back to select:"
+		   " %m");
+    }
+    if (sel->epollfd != -1) {
 	int rv;
 	sigset_t sigset;
 
@@ -1091,13 +1987,30 @@ sel_alloc_selector_thread(selector_t **new_selector, int wake_sig,
 	if (rv == -1) {
 	    rv = errno;
 	    close(sel->epollfd);
+	    free_wake_fd(sel);
 	    if (sel->sel_lock_alloc) {
 		sel->sel_lock_free(sel->fd_lock);
 		sel->sel_lock_free(sel->timer_lock);
 	    }
+	    free(sel->wheel);
 	    free(sel);
 	    return rv;
 	}
+	if (sel->wake_fd[0] >= 0) {
+	    struct epoll_event event;
+
+	    memset(&event, 0, sizeof(event));
+	    event.events = EPOLLIN;
+	    event.data.fd = sel->wake_fd[0];
+	    if (epoll_ctl(sel->epollfd, EPOLL_CTL_ADD, sel->wake_fd[0],
+			  &event) == -1) {
+		/* select() will still watch it. */
+		syslog(LOG_ERR, "Unable to add wake fd to epoll, falling"
+		       " back to select: %m");
+		close(sel->epollfd);
+		sel->epollfd = -1;
+	    }
+	}
     }
 #endif
 
@@ -1106,6 +2019,82 @@ sel_alloc_selector_thread(selector_t **new_selector, int wake_sig,
     return 0;
 }
 
+int
+sel_alloc_selector_thread(selector_t **new_selector, int wake_sig,
+			  sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+			  void (*sel_lock_free)(sel_lock_t *),
+			  void (*sel_lock)(sel_lock_t *),
+			  void (*sel_unlock)(sel_lock_t *),
+			  void *cb_data)
+{
+    return sel_alloc_selector_thread_flags(new_selector, wake_sig,
+					   sel_lock_alloc, sel_lock_free,
+					   sel_lock, sel_unlock, cb_data, 0);
+}
+
+int
+sel_alloc_selector_reactors(selector_t **new_selector,
+			    unsigned int num_reactors, int wake_sig,
+			    sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+			    void (*sel_lock_free)(sel_lock_t *),
+			    void (*sel_lock)(sel_lock_t *),
+			    void (*sel_unlock)(sel_lock_t *),
+			    void *cb_data,
+			    unsigned int flags)
+{
+    selector_t   **reactors;
+    unsigned int i;
+    int          rv;
+
+    if (num_reactors == 0 || !sel_lock_alloc)
+	return EINVAL;
+
+    reactors = malloc(sizeof(*reactors) * num_reactors);
+    if (!reactors)
+	return ENOMEM;
+
+    for (i = 0; i < num_reactors; i++) {
+	rv = sel_alloc_selector_thread_flags(&reactors[i], wake_sig,
+					     sel_lock_alloc, sel_lock_free,
+					     sel_lock, sel_unlock, cb_data,
+					     flags);
+	if (rv) {
+	    while (i > 0)
+		sel_free_selector(reactors[--i]);
+	    free(reactors);
+	    return rv;
+	}
+	reactors[i]->reactor_base = reactors[0];
+    }
+    reactors[0]->reactors = reactors;
+    reactors[0]->num_reactors = num_reactors;
+
+    *new_selector = reactors[0];
+    return 0;
+}
+
+unsigned int
+sel_num_reactors(selector_t *sel)
+{
+    if (sel->reactor_base)
+	sel = sel->reactor_base;
+    if (!sel->reactors)
+	return 1;
+    return sel->num_reactors;
+}
+
+selector_t *
+sel_get_reactor(selector_t *sel, unsigned int reactor)
+{
+    if (sel->reactor_base)
+	sel = sel->reactor_base;
+    if (!sel->reactors)
+	return reactor == 0 ? sel : NULL;
+    if (reactor >= sel->num_reactors)
+	return NULL;
+    return sel->reactors[reactor];
+}
+
 int
 sel_alloc_selector_nothread(selector_t **new_selector)
 {
@@ -1118,16 +2107,50 @@ sel_free_selector(selector_t *sel)
 {
     sel_timer_t *elem;
 
+    if (sel->reactors) {
+	/* Free the other reactors; this one is freed below. */
+	unsigned int i;
+
+	for (i = 1; i < sel->num_reactors; i++)
+	    sel_free_selector(sel->reactors[i]);
+	free(sel->reactors);
+	sel->reactors = NULL;
+    }
+
     elem = theap_get_top(&(sel->timer_heap));
     while (elem) {
 	theap_remove(&(sel->timer_heap), elem);
 	free(elem);
 	elem = theap_get_top(&(sel->timer_heap));
     }
+    if (sel->wheel) {
+	unsigned int i, l;
+
+	for (i = 0; i < SEL_WHEEL_L0_SIZE; i++) {
+	    while ((elem = sel->wheel->l0[i])) {
+		wheel_unlink(elem);
+		free(elem);
+	    }
+	}
+	for (l = 0; l < SEL_WHEEL_LEVELS - 1; l++) {
+	    for (i = 0; i < SEL_WHEEL_LN_SIZE; i++) {
+		while ((elem = sel->wheel->ln[l][i])) {
+		    wheel_unlink(elem);
+		    free(elem);
+		}
+	    }
+	}
+	free(sel->wheel);
+    }
 #ifdef HAVE_EPOLL_PWAIT
     if (sel->epollfd >= 0)
 	close(sel->epollfd);
 #endif
+#ifdef SEL_HAVE_IO_URING
+    if (sel->uring)
+	free_uring(sel->uring);
+#endif
+    free_wake_fd(sel);
     if (sel->fd_lock)
 	sel->sel_lock_free(sel->fd_lock);
     if (sel->timer_lock)
@@ -0,0 +1,309 @@
+/*
+ * shm_ring.c
+ *
+ * A shared memory ring for passing results between processes
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <OpenIPMI/ipmi_shm_ring.h>
+
+/*
+ * The file is a header, then a control block for each producer, then
+ * each producer's slots.  head is only written by the producer and
+ * tail only by the consumer, they are on their own cache lines so
+ * the two sides don't keep stealing the line from each other.
+ * Records are copied in before head is moved past them and copied
+ * out before tail is, so the head and tail stores are releases and
+ * the loads of the other side's value are acquires.
+ */
+#define SHM_RING_MAGIC		0x49504d52
+#define SHM_RING_VERSION	1
+#define SHM_RING_LINE		64
+
+typedef struct shm_ring_hdr_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_producers;
+    uint32_t slots;
+    uint32_t rec_size;
+} shm_ring_hdr_t;
+
+typedef struct shm_ring_prod_s
+{
+    uint64_t head;
+    char     pad1[SHM_RING_LINE - sizeof(uint64_t)];
+    uint64_t tail;
+    char     pad2[SHM_RING_LINE - sizeof(uint64_t)];
+    uint64_t dropped;
+    char     pad3[SHM_RING_LINE - sizeof(uint64_t)];
+} shm_ring_prod_t;
+
+struct ipmi_shm_ring_s
+{
+    void            *addr;
+    size_t          len;
+    shm_ring_hdr_t  *hdr;
+    shm_ring_prod_t *prods;
+    ipmi_shm_rec_t  *recs;
+    unsigned int    num_producers;
+    unsigned int    slots;
+
+    /* The producer the consumer looks at first next time. */
+    unsigned int    next_prod;
+};
+
+static size_t
+shm_ring_size(unsigned int num_producers, unsigned int slots)
+{
+    return (SHM_RING_LINE
+	    + (num_producers * sizeof(shm_ring_prod_t))
+	    + ((size_t) num_producers * slots * sizeof(ipmi_shm_rec_t)));
+}
+
+static int
+shm_ring_map(int fd, size_t len, ipmi_shm_ring_t **ring)
+{
+    ipmi_shm_ring_t *r;
+    void            *addr;
+
+    r = malloc(sizeof(*r));
+    if (!r)
+	return ENOMEM;
+    memset(r, 0, sizeof(*r));
+
+    addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+	free(r);
+	return errno;
+    }
+    r->addr = addr;
+    r->len = len;
+    r->hdr = addr;
+    r->prods = (shm_ring_prod_t *) (((char *) addr) + SHM_RING_LINE);
+    *ring = r;
+    return 0;
+}
+
+static void
+shm_ring_set_sizes(ipmi_shm_ring_t *r, unsigned int num_producers,
+		   unsigned int slots)
+{
+    r->num_producers = num_producers;
+    r->slots = slots;
+    r->recs = (ipmi_shm_rec_t *) (r->prods + num_producers);
+}
+
+int
+ipmi_shm_ring_create(const char      *path,
+		     unsigned int    num_producers,
+		     unsigned int    slots,
+		     ipmi_shm_ring_t **ring)
+{
+    ipmi_shm_ring_t *r;
+    unsigned int    n;
+    size_t          len;
+    int             fd;
+    int             rv;
+
+    if (!num_producers || !slots || (slots > (1U << 30)))
+	return EINVAL;
+    for (n=1; n<slots; n <<= 1)
+	;
+    slots = n;
+    len = shm_ring_size(num_producers, slots);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+	return errno;
+    if (ftruncate(fd, len) == -1) {
+	rv = errno;
+	close(fd);
+	return rv;
+    }
+    rv = shm_ring_map(fd, len, &r);
+    close(fd);
+    if (rv)
+	return rv;
+
+    /* The file is new and zero filled, all the rings are empty. */
+    shm_ring_set_sizes(r, num_producers, slots);
+    r->hdr->version = SHM_RING_VERSION;
+    r->hdr->num_producers = num_producers;
+    r->hdr->slots = slots;
+    r->hdr->rec_size = sizeof(ipmi_shm_rec_t);
+    __atomic_store_n(&r->hdr->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+    *ring = r;
+    return 0;
+}
+
+int
+ipmi_shm_ring_attach(const char *path, ipmi_shm_ring_t **ring)
+{
+    ipmi_shm_ring_t *r;
+    shm_ring_hdr_t  *hdr;
+    struct stat     st;
+    int             fd;
+    int             rv;
+
+    fd = open(path, O_RDWR);
+    if (fd == -1)
+	return errno;
+    if (fstat(fd, &st) == -1) {
+	rv = errno;
+	close(fd);
+	return rv;
+    }
+    if (st.st_size < SHM_RING_LINE) {
+	close(fd);
+	return EINVAL;
+    }
+    rv = shm_ring_map(fd, st.st_size, &r);
+    close(fd);
+    if (rv)
+	return rv;
+
+    hdr = r->hdr;
+    if ((__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC)
+	|| (hdr->version != SHM_RING_VERSION)
+	|| (hdr->rec_size != sizeof(ipmi_shm_rec_t))
+	|| (hdr->num_producers == 0)
+	|| (hdr->slots == 0)
+	|| (hdr->slots & (hdr->slots - 1))
+	|| (shm_ring_size(hdr->num_producers, hdr->slots) > r->len))
+    {
+	ipmi_shm_ring_detach(r);
+	return EINVAL;
+    }
+    shm_ring_set_sizes(r, hdr->num_producers, hdr->slots);
+
+    *ring = r;
+    return 0;
+}
+
+void
+ipmi_shm_ring_detach(ipmi_shm_ring_t *ring)
+{
+    munmap(ring->addr, ring->len);
+    free(ring);
+}
+
+unsigned int
+ipmi_shm_ring_num_producers(ipmi_shm_ring_t *ring)
+{
+    return ring->num_producers;
+}
+
+int
+ipmi_shm_ring_put(ipmi_shm_ring_t      *ring,
+		  unsigned int         producer,
+		  const ipmi_shm_rec_t *rec)
+{
+    shm_ring_prod_t *p;
+    uint64_t        head, tail;
+    ipmi_shm_rec_t  *slot;
+
+    if (producer >= ring->num_producers)
+	return EINVAL;
+    p = &ring->prods[producer];
+
+    head = __atomic_load_n(&p->head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= ring->slots) {
+	__atomic_store_n(&p->dropped, p->dropped + 1, __ATOMIC_RELAXED);
+	return EAGAIN;
+    }
+
+    slot = &ring->recs[(producer * ring->slots) + (head & (ring->slots - 1))];
+    *slot = *rec;
+    slot->producer = producer;
+    __atomic_store_n(&p->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int
+ipmi_shm_ring_get(ipmi_shm_ring_t *ring, ipmi_shm_rec_t *rec)
+{
+    shm_ring_prod_t *p;
+    uint64_t        head, tail;
+    unsigned int    i, prod;
+
+    for (i=0; i<ring->num_producers; i++) {
+	prod = ring->next_prod;
+	ring->next_prod++;
+	if (ring->next_prod >= ring->num_producers)
+	    ring->next_prod = 0;
+
+	p = &ring->prods[prod];
+	tail = __atomic_load_n(&p->tail, __ATOMIC_RELAXED);
+	head = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+	if (head == tail)
+	    continue;
+
+	*rec = ring->recs[(prod * ring->slots) + (tail & (ring->slots - 1))];
+	__atomic_store_n(&p->tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+    }
+    return EAGAIN;
+}
+
+uint64_t
+ipmi_shm_ring_dropped(ipmi_shm_ring_t *ring, unsigned int producer)
+{
+    if (producer >= ring->num_producers)
+	return 0;
+    return __atomic_load_n(&ring->prods[producer].dropped, __ATOMIC_RELAXED);
+}
+
+unsigned int
+ipmi_shm_ring_shard(const char *name, unsigned int num_shards)
+{
+    const unsigned char *c = (const unsigned char *) name;
+    uint32_t            h = 2166136261U;
+
+    if (num_shards <= 1)
+	return 0;
+
+    /* FNV-1a, it is stable across runs and builds. */
+    for (; *c; c++) {
+	h ^= *c;
+	h *= 16777619U;
+    }
+    return h % num_shards;
+}
@@ -59,6 +59,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <OpenIPMI/ipmi_posix.h>
+#include <OpenIPMI/internal/ipmi_malloc.h>
 
 os_handler_t *test_os_hnd;
 
@@ -161,6 +162,138 @@ timeout_handler(void *cb_data, os_hnd_timer_id_t *id)
     }
 }
 
+os_handler_waiter_t *reactor_waiter;
+static void
+reactor_timeout_handler(void *cb_data, os_hnd_timer_id_t *id)
+{
+    int *fired = cb_data;
+
+    (*fired)++;
+    os_handler_waiter_release(reactor_waiter);
+}
+
+/* Put a timer on each reactor and make sure they all go off. */
+static void
+test_reactors(os_handler_t *os_hnd, os_handler_waiter_factory_t *factory)
+{
+    unsigned int      i, num_reactors = os_hnd->get_num_reactors(os_hnd);
+    os_hnd_timer_id_t *timers[4];
+    int               fired[4];
+    struct timeval    tv;
+    int               rv;
+
+    printf("Reactor test\n");
+    if (num_reactors > 4)
+	num_reactors = 4;
+    rv = os_hnd->alloc_timer_reactor(os_hnd, num_reactors, &timers[0]);
+    if (rv != EINVAL)
+	err_leave(rv, "Expected EINVAL allocating past the last reactor\n");
+
+    reactor_waiter = os_handler_alloc_waiter(factory);
+    if (!reactor_waiter)
+	err_leave(0, "Unable to allocate waiter\n");
+
+    for (i = 0; i < num_reactors; i++) {
+	rv = os_hnd->alloc_timer_reactor(os_hnd, i, &timers[i]);
+	if (rv)
+	    err_leave(rv, "Unable to allocate reactor timer\n");
+	fired[i] = 0;
+	tv.tv_sec = 0;
+	tv.tv_usec = 100000;
+	os_handler_waiter_use(reactor_waiter);
+	rv = os_hnd->start_timer(os_hnd, timers[i], &tv,
+				 reactor_timeout_handler, &fired[i]);
+	if (rv)
+	    err_leave(rv, "Unable to start reactor timer\n");
+    }
+    os_handler_waiter_release(reactor_waiter);
+
+    tv.tv_sec = 3;
+    tv.tv_usec = 0;
+    os_handler_waiter_wait(reactor_waiter, &tv);
+    for (i = 0; i < num_reactors; i++) {
+	if (fired[i] != 1)
+	    err_leave(0, "Reactor %u timer went off %d times\n", i, fired[i]);
+	os_hnd->free_timer(os_hnd, timers[i]);
+    }
+    os_handler_free_waiter(reactor_waiter);
+}
+
+#define NUM_WORK_QUEUES 4
+#define NUM_WORK_ITEMS 200
+struct work_check_s {
+    int next;
+    int running;
+    os_handler_waiter_t *waiter;
+} work_checks[NUM_WORK_QUEUES];
+struct work_item_s {
+    struct work_check_s *check;
+    int num;
+} work_items[NUM_WORK_QUEUES][NUM_WORK_ITEMS];
+
+static void
+work_func(void *cb_data)
+{
+    struct work_item_s *item = cb_data;
+    struct work_check_s *check = item->check;
+
+    if (check->running++)
+	err_leave(0, "Work from one queue ran in parallel\n");
+    if (check->next != item->num)
+	err_leave(0, "Work ran out of order: %d %d\n", check->next, item->num);
+    check->next++;
+    check->running--;
+    os_handler_waiter_release(check->waiter);
+}
+
+/* Work on a queue must run in order and one at a time. */
+static void
+test_workers(os_handler_t *os_hnd, os_handler_waiter_factory_t *factory)
+{
+    os_hnd_work_queue_t *queues[NUM_WORK_QUEUES];
+    struct timeval      tv;
+    int                 i, j, rv;
+
+    printf("Worker test\n");
+    rv = os_hnd->alloc_work_queue(os_hnd, &queues[0]);
+    if (rv != ENOSYS)
+	err_leave(rv, "Expected ENOSYS allocating a queue without a pool\n");
+    rv = os_hnd->start_workers(os_hnd, 3);
+    if (rv)
+	err_leave(rv, "Unable to start workers\n");
+    memset(work_checks, 0, sizeof(work_checks));
+
+    for (i = 0; i < NUM_WORK_QUEUES; i++) {
+	rv = os_hnd->alloc_work_queue(os_hnd, &queues[i]);
+	if (rv)
+	    err_leave(rv, "Unable to allocate work queue\n");
+	work_checks[i].waiter = os_handler_alloc_waiter(factory);
+	if (!work_checks[i].waiter)
+	    err_leave(0, "Unable to allocate waiter\n");
+    }
+    for (j = 0; j < NUM_WORK_ITEMS; j++) {
+	for (i = 0; i < NUM_WORK_QUEUES; i++) {
+	    work_items[i][j].check = &work_checks[i];
+	    work_items[i][j].num = j;
+	    os_handler_waiter_use(work_checks[i].waiter);
+	    rv = os_hnd->queue_work(os_hnd, queues[i], work_func,
+				    &work_items[i][j]);
+	    if (rv)
+		err_leave(rv, "Unable to queue work\n");
+	}
+    }
+    for (i = 0; i < NUM_WORK_QUEUES; i++) {
+	os_handler_waiter_release(work_checks[i].waiter);
+	tv.tv_sec = 3;
+	tv.tv_usec = 0;
+	os_handler_waiter_wait(work_checks[i].waiter, &tv);
+	if (work_checks[i].next != NUM_WORK_ITEMS)
+	    err_leave(0, "Only %d work items ran\n", work_checks[i].next);
+	os_handler_free_waiter(work_checks[i].waiter);
+	os_hnd->free_work_queue(os_hnd, queues[i]);
+    }
+}
+
 static void
 test_os_handler(os_handler_t *os_hnd, os_handler_waiter_factory_t *factory)
 {
@@ -201,6 +334,12 @@ test_os_handler(os_handler_t *os_hnd, os_handler_waiter_factory_t *factory)
 
     os_handler_free_waiter(timer_waiter);
 
+    if (os_hnd->get_num_reactors && os_hnd->get_num_reactors(os_hnd) > 1)
+	test_reactors(os_hnd, factory);
+
+    if (os_hnd->start_workers)
+	test_workers(os_hnd, factory);
+
     rv = os_handler_free_waiter_factory(factory);
     if (rv)
 	err_leave(rv, "Error freeing factory\n");
@@ -208,6 +347,244 @@ test_os_handler(os_handler_t *os_hnd, os_handler_waiter_factory_t *factory)
     os_hnd->free_os_handler(os_hnd);
 }
 
+#define NUM_WHEEL_TIMERS 300
+struct wheel_timer_s {
+    sel_timer_t    *timer;
+    struct timeval expire;
+    int            expected;
+    int            fired;
+} wheel_timers[NUM_WHEEL_TIMERS];
+int wheel_timers_left;
+
+static void
+wheel_timeout(selector_t *sel, sel_timer_t *timer, void *cb_data)
+{
+    struct wheel_timer_s *t = cb_data;
+    struct timeval       now;
+
+    sel_get_monotonic_time(&now);
+    if ((now.tv_sec < t->expire.tv_sec)
+	|| ((now.tv_sec == t->expire.tv_sec)
+	    && (now.tv_usec < t->expire.tv_usec)))
+	err_leave(0, "Wheel timer %d went off early\n",
+		  (int) (t - wheel_timers));
+    if (!t->expected)
+	err_leave(0, "Stopped wheel timer %d went off\n",
+		  (int) (t - wheel_timers));
+    if (t->fired)
+	err_leave(0, "Wheel timer %d went off twice\n",
+		  (int) (t - wheel_timers));
+    t->fired = 1;
+    wheel_timers_left--;
+}
+
+/* Start a bunch of timers spread across the first couple of wheel
+   levels, stop some of them, and make sure the rest go off once and
+   not early. */
+static void
+test_timer_wheel(selector_t *sel)
+{
+    struct timeval tv, now, end;
+    int            i, rv;
+
+    printf("Timer wheel test\n");
+    sel_get_monotonic_time(&now);
+    for (i = 0; i < NUM_WHEEL_TIMERS; i++) {
+	struct wheel_timer_s *t = &wheel_timers[i];
+
+	rv = sel_alloc_timer(sel, wheel_timeout, t, &t->timer);
+	if (rv)
+	    err_leave(rv, "Unable to allocate wheel timer\n");
+	tv.tv_sec = 0;
+	tv.tv_usec = (i * 7919) % 600000;
+	t->expire.tv_sec = now.tv_sec;
+	t->expire.tv_usec = now.tv_usec + tv.tv_usec;
+	while (t->expire.tv_usec >= 1000000) {
+	    t->expire.tv_usec -= 1000000;
+	    t->expire.tv_sec++;
+	}
+	rv = sel_start_timer(t->timer, &t->expire);
+	if (rv)
+	    err_leave(rv, "Unable to start wheel timer\n");
+	t->expected = 1;
+    }
+    wheel_timers_left = NUM_WHEEL_TIMERS;
+    for (i = 0; i < NUM_WHEEL_TIMERS; i += 3) {
+	rv = sel_stop_timer(wheel_timers[i].timer);
+	if (rv)
+	    err_leave(rv, "Unable to stop wheel timer\n");
+	wheel_timers[i].expected = 0;
+	wheel_timers_left--;
+    }
+
+    end = now;
+    end.tv_sec += 3;
+    while (wheel_timers_left > 0) {
+	sel_get_monotonic_time(&now);
+	if (now.tv_sec > end.tv_sec)
+	    err_leave(0, "Wheel timers did not go off: %d left\n",
+		      wheel_timers_left);
+	tv.tv_sec = 0;
+	tv.tv_usec = 100000;
+	sel_select(sel, NULL, 0, NULL, &tv);
+    }
+
+    for (i = 0; i < NUM_WHEEL_TIMERS; i++)
+	sel_free_timer(wheel_timers[i].timer);
+}
+
+#define NUM_RUNNERS 10
+int runner_order[NUM_RUNNERS];
+int runners_run;
+
+static void
+runner_func(sel_runner_t *runner, void *cb_data)
+{
+    runner_order[runners_run++] = (int) (long) cb_data;
+}
+
+/* Runners must run once each, in the order they were posted. */
+static void
+test_runners(selector_t *sel)
+{
+    sel_runner_t   *runners[NUM_RUNNERS];
+    struct timeval tv;
+    int            i, rv;
+
+    printf("Runner test\n");
+    for (i = 0; i < NUM_RUNNERS; i++) {
+	rv = sel_alloc_runner(sel, &runners[i]);
+	if (rv)
+	    err_leave(rv, "Unable to allocate runner\n");
+	rv = sel_run(runners[i], runner_func, (void *) (long) i);
+	if (rv)
+	    err_leave(rv, "Unable to run runner\n");
+    }
+    rv = sel_run(runners[0], runner_func, NULL);
+    if (rv != EBUSY)
+	err_leave(rv, "Expected EBUSY running a runner twice\n");
+    if (sel_free_runner(runners[0]) != EBUSY)
+	err_leave(0, "Expected EBUSY freeing a pending runner\n");
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+    sel_select(sel, NULL, 0, NULL, &tv);
+    if (runners_run != NUM_RUNNERS)
+	err_leave(0, "Only %d runners ran\n", runners_run);
+    for (i = 0; i < NUM_RUNNERS; i++) {
+	if (runner_order[i] != i)
+	    err_leave(0, "Runner %d ran out of order\n", i);
+	rv = sel_free_runner(runners[i]);
+	if (rv)
+	    err_leave(rv, "Unable to free runner\n");
+    }
+}
+
+/* Freed objects must come back out of the pool on the next
+   allocation of the same size class. */
+#define NUM_POOL_ALLOCS 10
+static void
+test_malloc_pools(void)
+{
+    ipmi_malloc_pool_stats_t before, after;
+    void                     *data[NUM_POOL_ALLOCS];
+    int                      i, rv;
+
+    printf("Malloc pool test\n");
+    rv = ipmi_malloc_pool_stats(2, &before);
+    if (rv == ENOSYS)
+	return;
+    if (rv)
+	err_leave(rv, "Unable to get pool stats\n");
+    if (before.size != 128)
+	err_leave(0, "Pool class 2 is %u bytes\n", before.size);
+    if (ipmi_malloc_pool_stats(100, &before) != EINVAL)
+	err_leave(0, "Expected EINVAL for an invalid pool class\n");
+
+    for (i = 0; i < NUM_POOL_ALLOCS; i++) {
+	data[i] = ipmi_mem_alloc(100);
+	if (!data[i])
+	    err_leave(ENOMEM, "Unable to allocate pool data\n");
+	memset(data[i], i, 100);
+    }
+    for (i = 0; i < NUM_POOL_ALLOCS; i++)
+	ipmi_mem_free(data[i]);
+    ipmi_malloc_pool_stats(2, &before);
+    for (i = 0; i < NUM_POOL_ALLOCS; i++) {
+	data[i] = ipmi_mem_alloc(100);
+	if (!data[i])
+	    err_leave(ENOMEM, "Unable to allocate pool data\n");
+    }
+    ipmi_malloc_pool_stats(2, &after);
+    if (after.hits - before.hits != NUM_POOL_ALLOCS)
+	err_leave(0, "Only %lu pool hits\n", after.hits - before.hits);
+    for (i = 0; i < NUM_POOL_ALLOCS; i++)
+	ipmi_mem_free(data[i]);
+
+    /* Large allocations bypass the pools. */
+    data[0] = ipmi_mem_alloc(10000);
+    if (!data[0])
+	err_leave(ENOMEM, "Unable to allocate large data\n");
+    memset(data[0], 0, 10000);
+    ipmi_mem_free(data[0]);
+
+    ipmi_malloc_pool_thread_cleanup();
+    ipmi_malloc_pool_stats(2, &before);
+    data[0] = ipmi_mem_alloc(100);
+    ipmi_malloc_pool_stats(2, &after);
+    if (after.hits != before.hits)
+	err_leave(0, "Pool hit after thread cleanup\n");
+    ipmi_mem_free(data[0]);
+}
+
+/* Allocations must be counted against their type and go away from
+   the live counts when freed. */
+static void
+test_malloc_accounting(void)
+{
+    ipmi_malloc_type_stats_t before, after;
+    void                     *data[NUM_POOL_ALLOCS];
+    int                      i, rv;
+
+    printf("Malloc accounting test\n");
+    rv = ipmi_malloc_type_stats(IPMI_MEM_TYPE_SEL, &before);
+    if (rv == ENOSYS)
+	return;
+    if (rv)
+	err_leave(rv, "Unable to get accounting stats\n");
+    if (strcmp(before.name, "sel") != 0)
+	err_leave(0, "Type name is %s\n", before.name);
+    if (ipmi_malloc_type_stats(IPMI_MEM_TYPE_NUM, &after) != EINVAL)
+	err_leave(0, "Expected EINVAL for an invalid type\n");
+
+    for (i = 0; i < NUM_POOL_ALLOCS; i++) {
+	/* Mix in some that are too big for the pools. */
+	data[i] = ipmi_mem_alloc_type(i & 1 ? 100 : 10000, IPMI_MEM_TYPE_SEL);
+	if (!data[i])
+	    err_leave(ENOMEM, "Unable to allocate accounted data\n");
+    }
+    ipmi_malloc_type_stats(IPMI_MEM_TYPE_SEL, &after);
+    if (after.live_objects - before.live_objects != NUM_POOL_ALLOCS)
+	err_leave(0, "%lu live objects\n",
+		  after.live_objects - before.live_objects);
+    if (after.live_bytes - before.live_bytes != 5 * (100 + 10000))
+	err_leave(0, "%lu live bytes\n", after.live_bytes - before.live_bytes);
+    if (after.allocs - before.allocs != NUM_POOL_ALLOCS)
+	err_leave(0, "%lu allocs\n", after.allocs - before.allocs);
+
+    for (i = 0; i < NUM_POOL_ALLOCS; i++)
+	ipmi_mem_free(data[i]);
+    ipmi_malloc_type_stats(IPMI_MEM_TYPE_SEL, &after);
+    if (after.live_objects != before.live_objects
+	|| after.live_bytes != before.live_bytes)
+	err_leave(0, "Live counts not back after free\n");
+    if (after.frees - before.frees != NUM_POOL_ALLOCS)
+	err_leave(0, "%lu frees\n", after.frees - before.frees);
+    if (after.alloc_bytes - before.alloc_bytes != 5 * (100 + 10000))
+	err_leave(0, "%lu bytes allocated\n",
+		  after.alloc_bytes - before.alloc_bytes);
+}
+
 static void
 reset_tests(void)
 {
@@ -222,6 +599,7 @@ main(int argc, char *argv[])
 {
     os_handler_waiter_factory_t *factory;
     os_handler_t *os_hnd;
+    selector_t   *sel;
     int          rv;
 
     printf("*** Testing POSIX OS handler\n");
@@ -231,7 +609,11 @@ main(int argc, char *argv[])
 	fprintf(stderr, "ipmi_smi_setup_con: Unable to allocate os handler\n");
 	exit(1);
     }
+    MALLOC_POOLS_ENABLE();
+    MALLOC_ACCOUNTING_ENABLE();
     ipmi_malloc_init(os_hnd);
+    test_malloc_pools();
+    test_malloc_accounting();
     rv = os_handler_alloc_waiter_factory(os_hnd, 2, 0, &factory);
     if (rv != ENOSYS)
 	err_leave(rv, "Expected ENOSYS allocating threaded factory\n");
@@ -266,5 +648,38 @@ main(int argc, char *argv[])
 	err_leave(rv, "Unable to allocate waiter factory\n");
     test_os_handler(os_hnd, factory);
 
+    printf("*** Testing POSIX Threaded OS handler (reactors)\n");
+    reset_tests();
+    os_hnd = ipmi_posix_thread_setup_os_handler_reactors(SIGUSR1, 3);
+    if (!os_hnd) {
+	fprintf(stderr, "ipmi_smi_setup_con: Unable to allocate os handler\n");
+	exit(1);
+    }
+    ipmi_malloc_init(os_hnd);
+    rv = os_handler_alloc_waiter_factory(os_hnd, 3, 0, &factory);
+    if (rv)
+	err_leave(rv, "Unable to allocate waiter factory\n");
+    test_os_handler(os_hnd, factory);
+
+    printf("*** Testing POSIX OS handler with a timer wheel\n");
+    reset_tests();
+    os_hnd = ipmi_posix_get_os_handler();
+    if (!os_hnd) {
+	fprintf(stderr, "ipmi_smi_setup_con: Unable to allocate os handler\n");
+	exit(1);
+    }
+    rv = sel_alloc_selector_thread_flags(&sel, 0, NULL, NULL, NULL, NULL,
+					 NULL, SEL_FLAG_TIMER_WHEEL);
+    if (rv)
+	err_leave(rv, "Unable to allocate timer wheel selector\n");
+    ipmi_posix_os_handler_set_sel(os_hnd, sel);
+    ipmi_malloc_init(os_hnd);
+    test_timer_wheel(sel);
+    test_runners(sel);
+    rv = os_handler_alloc_waiter_factory(os_hnd, 0, 0, &factory);
+    if (rv)
+	err_leave(rv, "Unable to allocate waiter factory\n");
+    test_os_handler(os_hnd, factory);
+
     return 0;
 }
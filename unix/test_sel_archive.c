@@ -0,0 +1,159 @@
+/*
+ * test_sel_archive.c
+ *
+ * Write a SEL archive and read it back
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <OpenIPMI/ipmi_sel_archive.h>
+
+#define NUM_ROWS	1000
+#define NUM_DOMAINS	7
+#define BLOCK_ROWS	64
+
+/* Entry i is from domain i % NUM_DOMAINS, MC 0x20 + i % 3, and its
+   data bytes are made from i so they can be checked. */
+static void
+make_entry(unsigned int i, char *domain, unsigned char *data,
+	   unsigned int *type)
+{
+    unsigned int j;
+
+    sprintf(domain, "node%u", i % NUM_DOMAINS);
+    for (j=0; j<IPMI_SEL_ARCHIVE_DATA_LEN; j++)
+	data[j] = i + j;
+    *type = (i % 5) ? 2 : 0xc0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char                      path[64];
+    char                      domain[32];
+    unsigned char             data[IPMI_SEL_ARCHIVE_DATA_LEN];
+    ipmi_sel_archive_writer_t *w;
+    ipmi_sel_archive_t        *a;
+    ipmi_sel_archive_block_t  b;
+    const ipmi_sel_archive_mc_t *mc;
+    unsigned int              i, j, r, type;
+    int                       rv, fd, err = 0;
+    uint32_t                  torn[4] = { 0x4950534b, 16, 1, 0 };
+
+    snprintf(path, sizeof(path), "/tmp/test_sel_archive.%d", (int) getpid());
+    rv = ipmi_sel_archive_create(path, BLOCK_ROWS, &w);
+    if (rv) {
+	fprintf(stderr, "Unable to create the archive: %s\n", strerror(rv));
+	exit(1);
+    }
+    for (i=0; i<NUM_ROWS; i++) {
+	make_entry(i, domain, data, &type);
+	rv = ipmi_sel_archive_add(w, domain, 0, 0x20 + (i % 3), i, type,
+				  (int64_t) i * 1000000000, data,
+				  sizeof(data));
+	if (rv) {
+	    fprintf(stderr, "Unable to add entry %u: %s\n", i, strerror(rv));
+	    exit(1);
+	}
+    }
+    rv = ipmi_sel_archive_finish(w);
+    if (rv) {
+	fprintf(stderr, "Unable to finish the archive: %s\n", strerror(rv));
+	exit(1);
+    }
+
+    /* A torn block at the end, like a writer that died, is ignored.
+       This is the start of a block header for 16 rows. */
+    fd = open(path, O_WRONLY | O_APPEND);
+    if ((fd == -1) || (write(fd, torn, sizeof(torn)) != sizeof(torn))) {
+	fprintf(stderr, "Unable to append to the archive\n");
+	exit(1);
+    }
+    close(fd);
+
+    rv = ipmi_sel_archive_open(path, &a);
+    if (rv) {
+	fprintf(stderr, "Unable to open the archive: %s\n", strerror(rv));
+	exit(1);
+    }
+    if (ipmi_sel_archive_num_rows(a) != NUM_ROWS) {
+	fprintf(stderr, "Archive has %llu rows, expected %u\n",
+		(unsigned long long) ipmi_sel_archive_num_rows(a), NUM_ROWS);
+	err = 1;
+    }
+    if (ipmi_sel_archive_num_blocks(a)
+	!= (NUM_ROWS + BLOCK_ROWS - 1) / BLOCK_ROWS)
+    {
+	fprintf(stderr, "Archive has %u blocks\n",
+		ipmi_sel_archive_num_blocks(a));
+	err = 1;
+    }
+
+    i = 0;
+    for (j=0; !err && (ipmi_sel_archive_get_block(a, j, &b) == 0); j++) {
+	if (b.num_mcs != NUM_DOMAINS * 3) {
+	    fprintf(stderr, "Block %u has %u MCs\n", j, b.num_mcs);
+	    err = 1;
+	}
+	for (r=0; !err && (r<b.rows); r++, i++) {
+	    make_entry(i, domain, data, &type);
+	    mc = &b.mcs[b.mc[r]];
+	    if ((b.time[r] != (int64_t) i * 1000000000)
+		|| (b.record_id[r] != i)
+		|| (b.type[r] != type)
+		|| (b.mc[r] >= b.num_mcs)
+		|| (strcmp(mc->domain, domain) != 0)
+		|| (mc->channel != 0) || (mc->addr != 0x20 + (i % 3))
+		|| (memcmp(b.data[r], data, sizeof(data)) != 0)
+		|| (b.sensor_type[r] != ((type == 2) ? data[7] : 0))
+		|| (b.sensor_num[r] != ((type == 2) ? data[8] : 0))
+		|| (b.event_type[r] != ((type == 2) ? data[9] : 0)))
+	    {
+		fprintf(stderr, "Entry %u (block %u row %u) is wrong\n",
+			i, j, r);
+		err = 1;
+	    }
+	}
+    }
+    if (!err && (i != NUM_ROWS)) {
+	fprintf(stderr, "Read %u entries\n", i);
+	err = 1;
+    }
+
+    ipmi_sel_archive_close(a);
+    unlink(path);
+    if (err)
+	exit(1);
+    return 0;
+}
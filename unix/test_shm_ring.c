@@ -0,0 +1,126 @@
+/*
+ * test_shm_ring.c
+ *
+ * Test the shared memory ring with several producer processes
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <OpenIPMI/ipmi_shm_ring.h>
+
+#define NUM_PROD	4
+#define PER_PROD	100000
+
+/* Each producer puts PER_PROD records numbered in order into a
+   small ring, retrying when it is full.  The consumer must see every
+   record from each producer exactly once and in order. */
+static void
+producer(const char *path, unsigned int prod)
+{
+    ipmi_shm_ring_t *ring;
+    ipmi_shm_rec_t  rec;
+    unsigned int    i = 0;
+
+    if (ipmi_shm_ring_attach(path, &ring))
+	_exit(1);
+    memset(&rec, 0, sizeof(rec));
+    rec.type = IPMI_SHM_REC_READING;
+    while (i < PER_PROD) {
+	rec.raw = i;
+	if (ipmi_shm_ring_put(ring, prod, &rec) == 0)
+	    i++;
+    }
+    ipmi_shm_ring_detach(ring);
+    _exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char            path[64];
+    ipmi_shm_ring_t *ring;
+    ipmi_shm_rec_t  rec;
+    uint32_t        next[NUM_PROD];
+    unsigned long   total = 0;
+    unsigned int    i;
+    int             rv, status, err = 0;
+
+    snprintf(path, sizeof(path), "/tmp/test_shm_ring.%d", (int) getpid());
+    rv = ipmi_shm_ring_create(path, NUM_PROD, 64, &ring);
+    if (rv) {
+	fprintf(stderr, "Unable to create the ring: %s\n", strerror(rv));
+	exit(1);
+    }
+
+    for (i=0; i<NUM_PROD; i++) {
+	next[i] = 0;
+	if (fork() == 0)
+	    producer(path, i);
+    }
+
+    while (total < (NUM_PROD * PER_PROD)) {
+	if (ipmi_shm_ring_get(ring, &rec) != 0)
+	    continue;
+	if ((rec.producer >= NUM_PROD) || (rec.raw != next[rec.producer])) {
+	    fprintf(stderr, "Got record %u from producer %u, expected %u\n",
+		    rec.raw, rec.producer,
+		    rec.producer < NUM_PROD ? next[rec.producer] : 0);
+	    err = 1;
+	    break;
+	}
+	next[rec.producer]++;
+	total++;
+    }
+
+    while (wait(&status) > 0) {
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+	    err = 1;
+    }
+    if (!err && (ipmi_shm_ring_get(ring, &rec) == 0)) {
+	fprintf(stderr, "Extra record in the ring\n");
+	err = 1;
+    }
+    if (ipmi_shm_ring_shard("node17", 8) != ipmi_shm_ring_shard("node17", 8)
+	|| ipmi_shm_ring_shard("node17", 8) >= 8)
+    {
+	fprintf(stderr, "Bad shard\n");
+	err = 1;
+    }
+
+    ipmi_shm_ring_detach(ring);
+    unlink(path);
+    if (err)
+	exit(1);
+    return 0;
+}
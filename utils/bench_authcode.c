@@ -0,0 +1,201 @@
+/*
+ * bench_authcode.c
+ *
+ * Microbenchmark for the IPMI 1.5 authcode algorithms.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * This times authcode_gen() and authcode_check() for each IPMI 1.5
+ * authtype with the same scatter-gather list the LAN code uses:
+ * session id, message, sequence number.  The password is hashed in
+ * the handle at init time, so this is the per-packet cost.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <OpenIPMI/ipmi_auth.h>
+
+static struct {
+    const char *name;
+    int        authtype;
+} types[] =
+{
+    { "none",		IPMI_AUTHTYPE_NONE },
+    { "straight",	IPMI_AUTHTYPE_STRAIGHT },
+    { "md2",		IPMI_AUTHTYPE_MD2 },
+    { "md5",		IPMI_AUTHTYPE_MD5 },
+    { NULL }
+};
+
+static void *
+bench_alloc(void *info, int size)
+{
+    return malloc(size);
+}
+
+static void
+bench_free(void *info, void *data)
+{
+    free(data);
+}
+
+static double
+tv_usec_diff(struct timeval *start, struct timeval *end)
+{
+    return ((end->tv_sec - start->tv_sec) * 1000000.0
+	    + (end->tv_usec - start->tv_usec));
+}
+
+static int
+bench_run(const char *name, ipmi_auth_t *auth, unsigned int count,
+	  unsigned int size)
+{
+    unsigned char   password[16];
+    unsigned char   sessid[4] = { 0x78, 0x56, 0x34, 0x12 };
+    unsigned char   seq[4];
+    unsigned char   *msg;
+    unsigned char   code[16];
+    ipmi_auth_sg_t  sg[4];
+    ipmi_authdata_t handle;
+    struct timeval  start, end;
+    double          gen_usec, chk_usec;
+    unsigned int    i;
+    int             rv;
+
+    memset(password, 0, sizeof(password));
+    strcpy((char *) password, "password");
+    rv = auth->authcode_init(password, &handle, NULL,
+			     bench_alloc, bench_free);
+    if (rv) {
+	printf("%-10s skipped: %s\n", name, strerror(rv));
+	return 0;
+    }
+
+    msg = malloc(size ? size : 1);
+    if (!msg) {
+	auth->authcode_cleanup(handle);
+	return ENOMEM;
+    }
+    for (i=0; i<size; i++)
+	msg[i] = i;
+
+    sg[0].data = sessid;
+    sg[0].len = sizeof(sessid);
+    sg[1].data = msg;
+    sg[1].len = size;
+    sg[2].data = seq;
+    sg[2].len = sizeof(seq);
+    sg[3].data = NULL;
+
+    gettimeofday(&start, NULL);
+    for (i=0; i<count; i++) {
+	seq[0] = i;
+	seq[1] = i >> 8;
+	seq[2] = i >> 16;
+	seq[3] = i >> 24;
+	auth->authcode_gen(handle, sg, code);
+    }
+    gettimeofday(&end, NULL);
+    gen_usec = tv_usec_diff(&start, &end);
+
+    /* seq and code are from the last packet, so every check passes. */
+    rv = 0;
+    gettimeofday(&start, NULL);
+    for (i=0; i<count; i++)
+	rv |= auth->authcode_check(handle, sg, code);
+    gettimeofday(&end, NULL);
+    chk_usec = tv_usec_diff(&start, &end);
+
+    if (rv) {
+	printf("%-10s generated code failed the check\n", name);
+	rv = EINVAL;
+	goto out;
+    }
+
+    if (gen_usec < 1)
+	gen_usec = 1;
+    if (chk_usec < 1)
+	chk_usec = 1;
+    printf("%-10s %4u  %10.0f %8.0f  %10.0f %8.0f\n", name, size,
+	   count * 1000000.0 / gen_usec, gen_usec * 1000.0 / count,
+	   count * 1000000.0 / chk_usec, chk_usec * 1000.0 / count);
+
+ out:
+    free(msg);
+    auth->authcode_cleanup(handle);
+    return rv;
+}
+
+static void
+usage(char *name)
+{
+    fprintf(stderr,
+	    "%s [-n <count>] [-s <size>] [<authtype name>]\n"
+	    "Generate and check <count> (default 1000000) authcodes over"
+	    " <size>\n"
+	    "(default 16) bytes of message data for each authtype.\n", name);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int count = 1000000;
+    unsigned int size = 16;
+    char         *match = NULL;
+    char         *end;
+    int          i;
+    int          rv = 0;
+
+    for (i=1; i<argc; i++) {
+	if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc)) {
+	    count = strtoul(argv[++i], &end, 0);
+	    if ((*end != '\0') || (count == 0))
+		usage(argv[0]);
+	} else if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc)) {
+	    size = strtoul(argv[++i], &end, 0);
+	    if ((*end != '\0') || (size > 256))
+		usage(argv[0]);
+	} else if (argv[i][0] == '-')
+	    usage(argv[0]);
+	else
+	    match = argv[i];
+    }
+
+    printf("%-10s %4s  %10s %8s  %10s %8s\n", "authtype", "len",
+	   "gen/s", "ns/gen", "check/s", "ns/check");
+    for (i=0; types[i].name; i++) {
+	if (match && (strcmp(types[i].name, match) != 0))
+	    continue;
+	rv |= bench_run(types[i].name, &ipmi_auths[types[i].authtype],
+			count, size);
+    }
+
+    return rv ? 1 : 0;
+}
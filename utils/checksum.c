@@ -0,0 +1,108 @@
+/*
+ * checksum.c
+ *
+ * The IPMI 8-bit checksum, used by IPMB messages and FRU data.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <OpenIPMI/internal/ipmi_checksum.h>
+
+unsigned char
+ipmi_checksum(const unsigned char *data, unsigned int len,
+	      unsigned char start)
+{
+    unsigned int sum = start;
+
+#ifdef __SSE2__
+    if (len >= 16) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+
+	/* psadbw against zero adds each 8 bytes into a 64-bit lane.
+	   Only the low 8 bits of the result matter, so the low 32
+	   bits of each lane are enough. */
+	while (len >= 16) {
+	    __m128i v = _mm_loadu_si128((const __m128i *) data);
+
+	    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+	    data += 16;
+	    len -= 16;
+	}
+	sum += (_mm_cvtsi128_si32(acc)
+		+ _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+    }
+#else
+    /* Add 8 bytes at a time, two bytes into each 16-bit lane.  A lane
+       gains at most 510 per word, so fold it every 128 words before
+       it can overflow. */
+    while (len >= 8) {
+	uint64_t     acc = 0, w;
+	unsigned int n;
+
+	for (n = 0; (n < 128) && (len >= 8); n++) {
+	    memcpy(&w, data, 8);
+	    acc += ((w & 0x00ff00ff00ff00ffULL)
+		    + ((w >> 8) & 0x00ff00ff00ff00ffULL));
+	    data += 8;
+	    len -= 8;
+	}
+	sum += ((acc & 0xffff) + ((acc >> 16) & 0xffff)
+		+ ((acc >> 32) & 0xffff) + (acc >> 48));
+    }
+#endif
+
+    for (; len > 0; len--, data++)
+	sum += *data;
+
+    return sum & 0xff;
+}
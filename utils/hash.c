@@ -48,11 +48,31 @@
  *      written permission.
  */
 
-/* FIXME - need a better hash value. */
+#include <stdint.h>
+#include <OpenIPMI/ipmi_types.h>
+#include <OpenIPMI/internal/ipmi_utils.h>
+
+/* A finalizer that spreads every input bit across the whole value,
+   so the low bits used to pick a slot are good even when the inputs
+   are pointers or addresses with very regular low bits. */
+unsigned int
+ipmi_hash_uint(unsigned int v)
+{
+    uint32_t h = v;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
 unsigned int
 ipmi_hash_pointer(void *ptr)
 {
     unsigned long val = (unsigned long) ptr;
 
-    return val >> 5;
+    /* Fold the upper half in for 64-bit pointers. */
+    return ipmi_hash_uint(val ^ (val >> 31 >> 1));
 }
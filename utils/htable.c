@@ -0,0 +1,240 @@
+/*
+ * htable.c
+ *
+ * Resizable open-addressing hash tables of pointers.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+#include <string.h>
+
+#include <OpenIPMI/internal/ilist.h>
+#include <OpenIPMI/internal/htable.h>
+
+#define HTABLE_MIN_SIZE 16
+
+htable_t *
+alloc_htable(void)
+{
+    htable_t *rv;
+
+    rv = ilist_mem_alloc(sizeof(*rv));
+    if (!rv)
+	return NULL;
+    rv->entries = ilist_mem_alloc(HTABLE_MIN_SIZE * sizeof(htable_entry_t));
+    if (!rv->entries) {
+	ilist_mem_free(rv);
+	return NULL;
+    }
+    memset(rv->entries, 0, HTABLE_MIN_SIZE * sizeof(htable_entry_t));
+    rv->size = HTABLE_MIN_SIZE;
+    rv->count = 0;
+    return rv;
+}
+
+void
+free_htable(htable_t *tab)
+{
+    ilist_mem_free(tab->entries);
+    ilist_mem_free(tab);
+}
+
+unsigned int
+htable_count(htable_t *tab)
+{
+    return tab->count;
+}
+
+static void
+insert_entry(htable_entry_t *entries, unsigned int mask,
+	     unsigned int hash, void *item)
+{
+    unsigned int i = hash & mask;
+
+    while (entries[i].item)
+	i = (i + 1) & mask;
+    entries[i].item = item;
+    entries[i].hash = hash;
+}
+
+static int
+resize(htable_t *tab, unsigned int size)
+{
+    htable_entry_t *entries;
+    unsigned int   i;
+
+    entries = ilist_mem_alloc(size * sizeof(htable_entry_t));
+    if (!entries)
+	return 0;
+    memset(entries, 0, size * sizeof(htable_entry_t));
+    for (i=0; i<tab->size; i++) {
+	if (tab->entries[i].item)
+	    insert_entry(entries, size - 1, tab->entries[i].hash,
+			 tab->entries[i].item);
+    }
+    ilist_mem_free(tab->entries);
+    tab->entries = entries;
+    tab->size = size;
+    return 1;
+}
+
+int
+htable_add(htable_t *tab, unsigned int hash, void *item)
+{
+    if ((tab->count + 1) * 4 > tab->size * 3) {
+	/* If we can't grow, keep going as long as there is room, it
+	   just gets slower. */
+	if (!resize(tab, tab->size * 2) && (tab->count + 1 >= tab->size))
+	    return 0;
+    }
+    insert_entry(tab->entries, tab->size - 1, hash, item);
+    tab->count++;
+    return 1;
+}
+
+/* Remove the entry in slot i and move later entries in its probe
+   sequence back so lookups don't need tombstones. */
+static void
+remove_slot(htable_t *tab, unsigned int i)
+{
+    htable_entry_t *entries = tab->entries;
+    unsigned int   mask = tab->size - 1;
+    unsigned int   j = i;
+    unsigned int   k;
+
+    for (;;) {
+	j = (j + 1) & mask;
+	if (!entries[j].item)
+	    break;
+	k = entries[j].hash & mask;
+	/* Leave the entry alone if its home slot is after the hole. */
+	if (i <= j) {
+	    if ((i < k) && (k <= j))
+		continue;
+	} else if ((i < k) || (k <= j))
+	    continue;
+	entries[i] = entries[j];
+	i = j;
+    }
+    entries[i].item = NULL;
+    tab->count--;
+}
+
+int
+htable_remove(htable_t *tab, unsigned int hash, void *item)
+{
+    unsigned int mask = tab->size - 1;
+    unsigned int i = hash & mask;
+
+    while (tab->entries[i].item) {
+	if (tab->entries[i].item == item) {
+	    remove_slot(tab, i);
+	    /* Failing to shrink is harmless. */
+	    if ((tab->size > HTABLE_MIN_SIZE) && (tab->count * 8 < tab->size))
+		resize(tab, tab->size / 2);
+	    return 1;
+	}
+	i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+void *
+htable_find(htable_t *tab, unsigned int hash,
+	    htable_cmp_cb cmp, void *cb_data)
+{
+    unsigned int mask = tab->size - 1;
+    unsigned int i = hash & mask;
+
+    while (tab->entries[i].item) {
+	if (tab->entries[i].hash == hash) {
+	    if (cmp) {
+		if (cmp(tab->entries[i].item, cb_data))
+		    return tab->entries[i].item;
+	    } else if (tab->entries[i].item == cb_data)
+		return cb_data;
+	}
+	i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+void
+htable_iter(htable_t *tab, htable_iter_cb handler, void *cb_data)
+{
+    unsigned int i;
+
+    for (i=0; i<tab->size; i++) {
+	if (tab->entries[i].item)
+	    handler(tab->entries[i].item, cb_data);
+    }
+}
+
+void
+htable_iter_hash(htable_t *tab, unsigned int hash,
+		 htable_iter_cb handler, void *cb_data)
+{
+    unsigned int mask = tab->size - 1;
+    unsigned int i = hash & mask;
+
+    while (tab->entries[i].item) {
+	if (tab->entries[i].hash == hash)
+	    handler(tab->entries[i].item, cb_data);
+	i = (i + 1) & mask;
+    }
+}
+
+unsigned int
+htable_copy(htable_t *tab, void **items, unsigned int max)
+{
+    unsigned int i, count = 0;
+
+    for (i=0; (i<tab->size) && (count<max); i++) {
+	if (tab->entries[i].item)
+	    items[count++] = tab->entries[i].item;
+    }
+    return count;
+}
@@ -55,6 +55,7 @@
 
 #include <config.h>
 #include <string.h>
+#include <errno.h>
 
 #ifdef HAVE_EXECINFO_H
 #include <execinfo.h> /* For backtrace() */
@@ -376,6 +377,277 @@ ipmi_debug_malloc_cleanup(void)
     }
 }
 
+/*
+ * Pooled allocation.  Every allocation gets a small header holding
+ * its size class so the free knows where it goes.  Freed objects in a
+ * size class go on a free list for the thread doing the free (linked
+ * through the object's data) so the message handling paths, which
+ * allocate and free the same few structures constantly, rarely go to
+ * the OS handler.
+ */
+int __ipmi_malloc_pools = 0;
+
+#define POOL_HDR_SIZE		16
+#define POOL_NUM_CLASSES	5
+#define POOL_MIN_SIZE		32
+#define POOL_NO_CLASS		POOL_NUM_CLASSES
+#define POOL_MAX_CACHED		32
+
+#ifdef HAVE_TLS
+static int malloc_pools_on;
+
+struct pool_cache
+{
+    void         *head;
+    unsigned int count;
+};
+static __thread struct pool_cache pool_cache[POOL_NUM_CLASSES];
+
+static struct pool_counts
+{
+    unsigned long allocs;
+    unsigned long hits;
+    unsigned long frees;
+    unsigned long releases;
+} pool_counts[POOL_NUM_CLASSES];
+
+#define pool_count(c, field) \
+    __atomic_fetch_add(&pool_counts[c].field, 1, __ATOMIC_RELAXED)
+
+static unsigned int
+pool_class(int size)
+{
+    unsigned int c;
+    int          csize = POOL_MIN_SIZE;
+
+    for (c=0; c<POOL_NUM_CLASSES; c++, csize <<= 1) {
+	if (size <= csize)
+	    break;
+    }
+    return c;
+}
+
+static void *
+ipmi_pool_alloc(int size)
+{
+    unsigned int      c = pool_class(size);
+    struct pool_cache *pc;
+    char              *hdr;
+
+    if (c == POOL_NO_CLASS) {
+	hdr = malloc_os_hnd->mem_alloc(size + POOL_HDR_SIZE);
+    } else {
+	pool_count(c, allocs);
+	pc = &pool_cache[c];
+	hdr = pc->head;
+	if (hdr) {
+	    pc->head = *((void **) (hdr + POOL_HDR_SIZE));
+	    pc->count--;
+	    pool_count(c, hits);
+	} else {
+	    hdr = malloc_os_hnd->mem_alloc((POOL_MIN_SIZE << c)
+					   + POOL_HDR_SIZE);
+	}
+    }
+    if (!hdr)
+	return NULL;
+    *((unsigned int *) hdr) = c;
+    return hdr + POOL_HDR_SIZE;
+}
+
+static void
+ipmi_pool_free(void *data)
+{
+    char              *hdr = ((char *) data) - POOL_HDR_SIZE;
+    unsigned int      c = *((unsigned int *) hdr);
+    struct pool_cache *pc;
+
+    if (c == POOL_NO_CLASS) {
+	malloc_os_hnd->mem_free(hdr);
+	return;
+    }
+
+    pool_count(c, frees);
+    pc = &pool_cache[c];
+    if (pc->count >= POOL_MAX_CACHED) {
+	pool_count(c, releases);
+	malloc_os_hnd->mem_free(hdr);
+	return;
+    }
+    *((void **) data) = pc->head;
+    pc->head = hdr;
+    pc->count++;
+}
+
+int
+ipmi_malloc_pool_stats(unsigned int size_class,
+		       ipmi_malloc_pool_stats_t *stats)
+{
+    struct pool_counts *pc;
+
+    if (!malloc_pools_on)
+	return ENOSYS;
+    if (size_class >= POOL_NUM_CLASSES)
+	return EINVAL;
+
+    pc = &pool_counts[size_class];
+    stats->size = POOL_MIN_SIZE << size_class;
+    stats->allocs = __atomic_load_n(&pc->allocs, __ATOMIC_RELAXED);
+    stats->hits = __atomic_load_n(&pc->hits, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&pc->frees, __ATOMIC_RELAXED);
+    stats->releases = __atomic_load_n(&pc->releases, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void
+ipmi_malloc_pool_thread_cleanup(void)
+{
+    unsigned int c;
+    char         *hdr;
+
+    if (!malloc_pools_on)
+	return;
+
+    for (c=0; c<POOL_NUM_CLASSES; c++) {
+	while (pool_cache[c].head) {
+	    hdr = pool_cache[c].head;
+	    pool_cache[c].head = *((void **) (hdr + POOL_HDR_SIZE));
+	    malloc_os_hnd->mem_free(hdr);
+	}
+	pool_cache[c].count = 0;
+    }
+}
+#else
+#define malloc_pools_on 0
+#define ipmi_pool_alloc(size) NULL
+#define ipmi_pool_free(data) do { } while (0)
+
+int
+ipmi_malloc_pool_stats(unsigned int size_class,
+		       ipmi_malloc_pool_stats_t *stats)
+{
+    return ENOSYS;
+}
+
+void
+ipmi_malloc_pool_thread_cleanup(void)
+{
+}
+#endif
+
+/*
+ * Allocation accounting.  This uses the same header as the pools,
+ * with the type and size stored after the size class, so it can be
+ * used with or without them.  Only a few atomic adds are done per
+ * allocation so it's cheap enough to leave on in production.
+ */
+int __ipmi_malloc_accounting = 0;
+
+static int malloc_acct_on;
+
+struct acct_hdr
+{
+    unsigned int  size_class;
+    unsigned int  type;
+    unsigned long size;
+};
+
+#define ACCT_HDR(data) \
+    ((struct acct_hdr *) (((char *) (data)) - POOL_HDR_SIZE))
+
+static const char *acct_names[IPMI_MEM_TYPE_NUM] =
+{
+    "other", "domain", "conn", "mc", "entity", "sensor", "sdr", "sel",
+    "fru", "lan"
+};
+
+static struct acct_counts
+{
+    unsigned long live_bytes;
+    unsigned long live_objects;
+    unsigned long allocs;
+    unsigned long alloc_bytes;
+    unsigned long frees;
+} acct_counts[IPMI_MEM_TYPE_NUM];
+
+#define acct_add(t, field, v) \
+    __atomic_fetch_add(&acct_counts[t].field, v, __ATOMIC_RELAXED)
+#define acct_sub(t, field, v) \
+    __atomic_fetch_sub(&acct_counts[t].field, v, __ATOMIC_RELAXED)
+
+static void *
+ipmi_acct_alloc(int size, unsigned int type)
+{
+    struct acct_hdr *hdr;
+    char            *rv;
+
+    if (malloc_pools_on) {
+	rv = ipmi_pool_alloc(size);
+	if (!rv)
+	    return NULL;
+    } else {
+	rv = malloc_os_hnd->mem_alloc(size + POOL_HDR_SIZE);
+	if (!rv)
+	    return NULL;
+	rv += POOL_HDR_SIZE;
+    }
+
+    if (type >= IPMI_MEM_TYPE_NUM)
+	type = IPMI_MEM_TYPE_OTHER;
+    hdr = ACCT_HDR(rv);
+    hdr->type = type;
+    hdr->size = size;
+    acct_add(type, allocs, 1);
+    acct_add(type, alloc_bytes, size);
+    acct_add(type, live_objects, 1);
+    acct_add(type, live_bytes, size);
+    return rv;
+}
+
+static void
+ipmi_acct_free(void *data)
+{
+    struct acct_hdr *hdr = ACCT_HDR(data);
+    unsigned int    type = hdr->type;
+
+    acct_add(type, frees, 1);
+    acct_sub(type, live_objects, 1);
+    acct_sub(type, live_bytes, hdr->size);
+    if (malloc_pools_on)
+	ipmi_pool_free(data);
+    else
+	malloc_os_hnd->mem_free(hdr);
+}
+
+int
+ipmi_malloc_type_stats(unsigned int type, ipmi_malloc_type_stats_t *stats)
+{
+    struct acct_counts *ac;
+
+    if (!malloc_acct_on)
+	return ENOSYS;
+    if (type >= IPMI_MEM_TYPE_NUM)
+	return EINVAL;
+
+    ac = &acct_counts[type];
+    stats->name = acct_names[type];
+    stats->live_bytes = __atomic_load_n(&ac->live_bytes, __ATOMIC_RELAXED);
+    stats->live_objects = __atomic_load_n(&ac->live_objects,
+					  __ATOMIC_RELAXED);
+    stats->allocs = __atomic_load_n(&ac->allocs, __ATOMIC_RELAXED);
+    stats->alloc_bytes = __atomic_load_n(&ac->alloc_bytes, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&ac->frees, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void *
+ipmi_mem_alloc_type(int size, unsigned int type)
+{
+    if (malloc_acct_on)
+	return ipmi_acct_alloc(size, type);
+    return ipmi_mem_alloc(size);
+}
+
 void *
 ipmi_mem_alloc(int size)
 {
@@ -401,7 +673,11 @@ ipmi_mem_alloc(int size)
 	    seed += size;
 	}
 	return rv;
-    } else
+    } else if (malloc_acct_on)
+	return ipmi_acct_alloc(size, IPMI_MEM_TYPE_OTHER);
+    else if (malloc_pools_on)
+	return ipmi_pool_alloc(size);
+    else
 	return malloc_os_hnd->mem_alloc(size);
 }
 
@@ -417,7 +693,11 @@ ipmi_mem_free(void *data)
 #else
 	ipmi_debug_free(data, NULL);
 #endif
-    } else
+    } else if (malloc_acct_on)
+	ipmi_acct_free(data);
+    else if (malloc_pools_on)
+	ipmi_pool_free(data);
+    else
 	malloc_os_hnd->mem_free(data);
 }
 
@@ -468,7 +748,12 @@ ipmi_strndup(const char *str, int n)
 int
 ipmi_malloc_init(os_handler_t *os_hnd)
 {
-    if (!malloc_os_hnd)
+    if (!malloc_os_hnd) {
 	malloc_os_hnd = os_hnd;
+	malloc_acct_on = __ipmi_malloc_accounting && !DEBUG_MALLOC;
+#ifdef HAVE_TLS
+	malloc_pools_on = __ipmi_malloc_pools && !DEBUG_MALLOC;
+#endif
+    }
     return 0;
 }
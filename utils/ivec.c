@@ -0,0 +1,351 @@
+/*
+ * ivec.c
+ *
+ * Growable arrays with list-like iterators.
+ *
+ * Copyright 2026 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+#include <string.h>
+
+#include <OpenIPMI/internal/ilist.h>
+#include <OpenIPMI/internal/ivec.h>
+
+#define IVEC_MIN_SIZE 8
+
+ivec_t *
+alloc_ivec(void)
+{
+    ivec_t *rv;
+
+    rv = ilist_mem_alloc(sizeof(*rv));
+    if (!rv)
+	return NULL;
+    rv->items = NULL;
+    rv->len = 0;
+    rv->size = 0;
+    return rv;
+}
+
+void
+free_ivec(ivec_t *vec)
+{
+    if (vec->items)
+	ilist_mem_free(vec->items);
+    ilist_mem_free(vec);
+}
+
+int
+ivec_reserve(ivec_t *vec, unsigned int count)
+{
+    void         **items;
+    unsigned int size;
+
+    if (count <= vec->size)
+	return 1;
+
+    size = vec->size ? vec->size : IVEC_MIN_SIZE;
+    while (size < count)
+	size *= 2;
+    items = ilist_mem_alloc(size * sizeof(void *));
+    if (!items)
+	return 0;
+    if (vec->items) {
+	memcpy(items, vec->items, vec->len * sizeof(void *));
+	ilist_mem_free(vec->items);
+    }
+    vec->items = items;
+    vec->size = size;
+    return 1;
+}
+
+int
+ivec_empty(ivec_t *vec)
+{
+    return vec->len == 0;
+}
+
+unsigned int
+ivec_count(ivec_t *vec)
+{
+    return vec->len;
+}
+
+static int
+insert_at(ivec_t *vec, unsigned int pos, void *item)
+{
+    if (!ivec_reserve(vec, vec->len + 1))
+	return 0;
+    memmove(vec->items + pos + 1, vec->items + pos,
+	    (vec->len - pos) * sizeof(void *));
+    vec->items[pos] = item;
+    vec->len++;
+    return 1;
+}
+
+static void *
+remove_at(ivec_t *vec, unsigned int pos)
+{
+    void *item = vec->items[pos];
+
+    vec->len--;
+    memmove(vec->items + pos, vec->items + pos + 1,
+	    (vec->len - pos) * sizeof(void *));
+    return item;
+}
+
+int
+ivec_add_head(ivec_t *vec, void *item)
+{
+    return insert_at(vec, 0, item);
+}
+
+int
+ivec_add_tail(ivec_t *vec, void *item)
+{
+    return insert_at(vec, vec->len, item);
+}
+
+int
+ivec_add_before(ivec_iter_t *iter, void *item)
+{
+    if (iter->pos < 0)
+	return insert_at(iter->vec, iter->vec->len, item);
+    if (!insert_at(iter->vec, iter->pos, item))
+	return 0;
+    iter->pos++;
+    return 1;
+}
+
+int
+ivec_add_after(ivec_iter_t *iter, void *item)
+{
+    return insert_at(iter->vec, iter->pos + 1, item);
+}
+
+int
+ivec_first(ivec_iter_t *iter)
+{
+    if (iter->vec->len == 0) {
+	iter->pos = -1;
+	return 0;
+    }
+    iter->pos = 0;
+    return 1;
+}
+
+int
+ivec_last(ivec_iter_t *iter)
+{
+    iter->pos = ((int) iter->vec->len) - 1;
+    return iter->pos >= 0;
+}
+
+int
+ivec_next(ivec_iter_t *iter)
+{
+    if (iter->pos + 1 >= (int) iter->vec->len)
+	return 0;
+    iter->pos++;
+    return 1;
+}
+
+int
+ivec_prev(ivec_iter_t *iter)
+{
+    if (iter->pos < 0)
+	return ivec_last(iter);
+    if (iter->pos == 0)
+	return 0;
+    iter->pos--;
+    return 1;
+}
+
+void *
+ivec_get(ivec_iter_t *iter)
+{
+    if (iter->pos < 0)
+	return NULL;
+    return iter->vec->items[iter->pos];
+}
+
+void *
+ivec_remove_first(ivec_t *vec)
+{
+    if (vec->len == 0)
+	return NULL;
+    return remove_at(vec, 0);
+}
+
+void *
+ivec_remove_last(ivec_t *vec)
+{
+    if (vec->len == 0)
+	return NULL;
+    return remove_at(vec, vec->len - 1);
+}
+
+void *
+ivec_get_at(ivec_t *vec, unsigned int pos)
+{
+    if (pos >= vec->len)
+	return NULL;
+    return vec->items[pos];
+}
+
+int
+ivec_add_at(ivec_t *vec, unsigned int pos, void *item)
+{
+    if (pos > vec->len)
+	pos = vec->len;
+    return insert_at(vec, pos, item);
+}
+
+void *
+ivec_remove_at(ivec_t *vec, unsigned int pos)
+{
+    if (pos >= vec->len)
+	return NULL;
+    return remove_at(vec, pos);
+}
+
+int
+ivec_remove_item_from_list(ivec_t *vec, void *item)
+{
+    unsigned int i;
+
+    for (i=0; i<vec->len; i++) {
+	if (vec->items[i] == item) {
+	    remove_at(vec, i);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+int
+ivec_delete(ivec_iter_t *iter)
+{
+    if (iter->pos < 0)
+	return 0;
+    remove_at(iter->vec, iter->pos);
+    if (iter->pos >= (int) iter->vec->len)
+	iter->pos = -1;
+    iter->deleted = 1;
+    return 1;
+}
+
+void
+ivec_unpositioned(ivec_iter_t *iter)
+{
+    iter->pos = -1;
+}
+
+void *
+ivec_search_iter(ivec_iter_t *iter, ivec_search_cb cmp, void *cb_data)
+{
+    unsigned int i;
+
+    for (i=iter->pos+1; i<iter->vec->len; i++) {
+	if (cmp(iter->vec->items[i], cb_data)) {
+	    iter->pos = i;
+	    return iter->vec->items[i];
+	}
+    }
+    return NULL;
+}
+
+void *
+ivec_search(ivec_t *vec, ivec_search_cb cmp, void *cb_data)
+{
+    unsigned int i;
+
+    for (i=0; i<vec->len; i++) {
+	if (cmp(vec->items[i], cb_data))
+	    return vec->items[i];
+    }
+    return NULL;
+}
+
+void
+ivec_iter(ivec_t *vec, ivec_iter_cb handler, void *cb_data)
+{
+    ivec_iter_t  iter;
+    unsigned int i = 0;
+
+    iter.vec = vec;
+    while (i < vec->len) {
+	iter.pos = i;
+	iter.deleted = 0;
+	handler(&iter, vec->items[i], cb_data);
+	/* If the item was deleted, the next one moved into its place. */
+	if (!iter.deleted)
+	    i++;
+    }
+}
+
+void
+ivec_iter_rev(ivec_t *vec, ivec_iter_cb handler, void *cb_data)
+{
+    ivec_iter_t iter;
+    int         i = ((int) vec->len) - 1;
+
+    iter.vec = vec;
+    while (i >= 0) {
+	iter.pos = i;
+	iter.deleted = 0;
+	handler(&iter, vec->items[i], cb_data);
+	i--;
+    }
+}
+
+void
+ivec_init_iter(ivec_iter_t *iter, ivec_t *vec)
+{
+    iter->vec = vec;
+    iter->pos = vec->len ? 0 : -1;
+    iter->deleted = 0;
+}
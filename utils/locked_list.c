@@ -61,6 +61,18 @@
 
 #define LOCKED_LIST_ENTRIES_INCREMENT 5
 
+/*
+ * locked_list_iterate() does not take the list lock.  Readers count
+ * themselves in "readers" and follow the next pointers, which the
+ * writers (holding the lock) only change with atomic stores after the
+ * entry is filled in.  A removed entry is marked destroyed right
+ * away, but it stays linked until no locked iteration is in progress
+ * (cb_count) and then stays allocated on the free list until no
+ * lock-free reader can still be looking at it.  An entry goes on the
+ * free list only after it is unlinked, so once "readers" is seen as
+ * zero no new reader can find it.
+ */
+
 struct locked_list_entry_s
 {
     unsigned int destroyed;
@@ -78,6 +90,8 @@ struct locked_list_s
     unsigned int        count;
     locked_list_entry_t head;
     locked_list_entry_t *destroy_list;
+    unsigned int        readers;
+    locked_list_entry_t *free_list;
 };
 
 static void
@@ -163,11 +177,58 @@ locked_list_destroy(locked_list_t *ll)
 	ipmi_mem_free(entry);
 	entry = next;
     }
+    while (ll->free_list) {
+	entry = ll->free_list;
+	ll->free_list = entry->dlist_next;
+	ipmi_mem_free(entry);
+    }
     if (ll->lock == ll_std_lock)
 	ipmi_destroy_lock(ll->lock_cb_data);
     ipmi_mem_free(ll);
 }
 
+/* Must be called with the lock held. */
+static void
+cleanup_destroyed(locked_list_t *ll)
+{
+    locked_list_entry_t *entry;
+
+    if (ll->cb_count == 0) {
+	while (ll->destroy_list) {
+	    entry = ll->destroy_list;
+	    ll->destroy_list = entry->dlist_next;
+	    entry->next->prev = entry->prev;
+	    __atomic_store_n(&entry->prev->next, entry->next,
+			     __ATOMIC_RELEASE);
+	    entry->dlist_next = ll->free_list;
+	    ll->free_list = entry;
+	}
+    }
+
+    /* The unlinks above must be visible before readers is checked. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ll->free_list && (__atomic_load_n(&ll->readers, __ATOMIC_SEQ_CST)
+			  == 0))
+    {
+	while (ll->free_list) {
+	    entry = ll->free_list;
+	    ll->free_list = entry->dlist_next;
+	    ipmi_mem_free(entry);
+	}
+    }
+}
+
+static void
+link_entry(locked_list_t *ll, locked_list_entry_t *entry)
+{
+    entry->next = &ll->head;
+    entry->prev = ll->head.prev;
+    entry->next->prev = entry;
+    /* Everything in the entry must be set before readers can see it. */
+    __atomic_store_n(&entry->prev->next, entry, __ATOMIC_RELEASE);
+    ll->count++;
+}
+
 static locked_list_entry_t *
 internal_find(locked_list_t *ll, void *item1, void *item2)
 {
@@ -209,11 +270,7 @@ locked_list_add_entry(locked_list_t *ll, void *item1, void *item2,
     entry->item1 = item1;
     entry->item2 = item2;
     entry->destroyed = 0;
-    entry->next = &ll->head;
-    entry->prev = ll->head.prev;
-    entry->prev->next = entry;
-    entry->next->prev = entry;
-    ll->count++;
+    link_entry(ll, entry);
 
  out_unlock:
     ll->unlock(ll->lock_cb_data);
@@ -246,11 +303,7 @@ locked_list_add_entry_nolock(locked_list_t *ll, void *item1, void *item2,
     entry->item1 = item1;
     entry->item2 = item2;
     entry->destroyed = 0;
-    entry->next = &ll->head;
-    entry->prev = ll->head.prev;
-    entry->prev->next = entry;
-    entry->next->prev = entry;
-    ll->count++;
+    link_entry(ll, entry);
 
  out:
     return rv;
@@ -274,17 +327,12 @@ locked_list_remove_nolock(locked_list_t *ll, void *item1, void *item2)
     } else {
 	rv = 1;
 	ll->count--;
-	if (ll->cb_count) {
-	    /* We are in callbacks, just mark it destroyed and let the
-	       last call back exit clear it up. */
-	    entry->destroyed = 1;
-	    entry->dlist_next = ll->destroy_list;
-	    ll->destroy_list = entry;
-	} else {
-	    entry->next->prev = entry->prev;
-	    entry->prev->next = entry->next;
-	    ipmi_mem_free(entry);
-	}
+	/* Iterators may be looking at it, mark it destroyed and let
+	   the cleanup free it when that is safe. */
+	__atomic_store_n(&entry->destroyed, 1, __ATOMIC_RELEASE);
+	entry->dlist_next = ll->destroy_list;
+	ll->destroy_list = entry;
+	cleanup_destroyed(ll);
     }
     return rv;
 }
@@ -339,15 +387,7 @@ locked_list_iterate_prefunc_nolock(locked_list_t          *ll,
 
     /* If no one else is going through the list, clean up the
        destroyed entries. */
-    if (ll->cb_count == 0) {
-	while (ll->destroy_list) {
-	    entry = ll->destroy_list;
-	    ll->destroy_list = entry->dlist_next;
-	    entry->next->prev = entry->prev;
-	    entry->prev->next = entry->next;
-	    ipmi_mem_free(entry);
-	}
-    }
+    cleanup_destroyed(ll);
 }
 
 void
@@ -366,9 +406,27 @@ locked_list_iterate(locked_list_t          *ll,
 		    locked_list_handler_cb handler,
 		    void                   *cb_data)
 {
-    ll->lock(ll->lock_cb_data);
-    locked_list_iterate_prefunc_nolock(ll, NULL, handler, cb_data);
-    ll->unlock(ll->lock_cb_data);
+    locked_list_entry_t *entry;
+
+    /* This must be ordered against the unlinking in
+       cleanup_destroyed(), see the comment at the top. */
+    __atomic_add_fetch(&ll->readers, 1, __ATOMIC_SEQ_CST);
+    entry = __atomic_load_n(&ll->head.next, __ATOMIC_ACQUIRE);
+    while (entry != &ll->head) {
+	if (!__atomic_load_n(&entry->destroyed, __ATOMIC_ACQUIRE)) {
+	    if (handler(cb_data, entry->item1, entry->item2))
+		break;
+	}
+	entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+    }
+    if ((__atomic_sub_fetch(&ll->readers, 1, __ATOMIC_SEQ_CST) == 0)
+	&& __atomic_load_n(&ll->free_list, __ATOMIC_RELAXED))
+    {
+	/* We may have been holding up freeing entries. */
+	ll->lock(ll->lock_cb_data);
+	cleanup_destroyed(ll);
+	ll->unlock(ll->lock_cb_data);
+    }
 }
 
 void
@@ -114,9 +114,12 @@ void ipmi_unlock(ipmi_lock_t *lock)
 	lock->os_hnd->unlock(lock->os_hnd, lock->ll_lock);
 }
 
+/* OS handlers don't have to supply read/write locks, a plain lock
+   is used if they don't. */
 struct ipmi_rwlock_s
 {
     os_hnd_rwlock_t *ll_lock;
+    os_hnd_lock_t   *ll_mutex;
     os_handler_t  *os_hnd;
 };
 
@@ -131,14 +134,20 @@ ipmi_create_rwlock_os_hnd(os_handler_t *os_hnd, ipmi_rwlock_t **new_lock)
 	return ENOMEM;
 
     lock->os_hnd = os_hnd;
-    if (lock->os_hnd && lock->os_hnd->create_lock) {
+    lock->ll_lock = NULL;
+    lock->ll_mutex = NULL;
+    if (lock->os_hnd && lock->os_hnd->create_rwlock) {
 	rv = lock->os_hnd->create_rwlock(lock->os_hnd, &(lock->ll_lock));
 	if (rv) {
 	    ipmi_mem_free(lock);
 	    return rv;
 	}
-    } else {
-	lock->ll_lock = NULL;
+    } else if (lock->os_hnd && lock->os_hnd->create_lock) {
+	rv = lock->os_hnd->create_lock(lock->os_hnd, &(lock->ll_mutex));
+	if (rv) {
+	    ipmi_mem_free(lock);
+	    return rv;
+	}
     }
 
     *new_lock = lock;
@@ -150,6 +159,8 @@ void ipmi_destroy_rwlock(ipmi_rwlock_t *lock)
 {
     if (lock->ll_lock)
 	lock->os_hnd->destroy_rwlock(lock->os_hnd, lock->ll_lock);
+    if (lock->ll_mutex)
+	lock->os_hnd->destroy_lock(lock->os_hnd, lock->ll_mutex);
     ipmi_mem_free(lock);
 }
 
@@ -157,24 +168,32 @@ void ipmi_rwlock_read_lock(ipmi_rwlock_t *lock)
 {
     if (lock->ll_lock)
 	lock->os_hnd->read_lock(lock->os_hnd, lock->ll_lock);
+    else if (lock->ll_mutex)
+	lock->os_hnd->lock(lock->os_hnd, lock->ll_mutex);
 }
 
 void ipmi_rwlock_read_unlock(ipmi_rwlock_t *lock)
 {
     if (lock->ll_lock)
 	lock->os_hnd->read_unlock(lock->os_hnd, lock->ll_lock);
+    else if (lock->ll_mutex)
+	lock->os_hnd->unlock(lock->os_hnd, lock->ll_mutex);
 }
 
 void ipmi_rwlock_write_lock(ipmi_rwlock_t *lock)
 {
     if (lock->ll_lock)
 	lock->os_hnd->write_lock(lock->os_hnd, lock->ll_lock);
+    else if (lock->ll_mutex)
+	lock->os_hnd->lock(lock->os_hnd, lock->ll_mutex);
 }
 
 void ipmi_rwlock_write_unlock(ipmi_rwlock_t *lock)
 {
     if (lock->ll_lock)
 	lock->os_hnd->write_unlock(lock->os_hnd, lock->ll_lock);
+    else if (lock->ll_mutex)
+	lock->os_hnd->unlock(lock->os_hnd, lock->ll_mutex);
 }
 
 #ifdef IPMI_CHECK_LOCKS
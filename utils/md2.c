@@ -207,6 +207,11 @@ struct ipmi_authdata_s
     void          *(*mem_alloc)(void *info, int size);
     void          (*mem_free)(void *info, void *data);
     unsigned char data[16];
+
+    /* The hash state with the leading password already written, each
+       packet starts from a copy of this.  The password is a whole MD2
+       block, so this saves a transform per packet. */
+    MD2_CONTEXT   prefix;
 };
 
 /* External functions for the IPMI authcode algorithms. */
@@ -228,6 +233,8 @@ ipmi_md2_authcode_init(unsigned char   *password,
     data->mem_free = mem_free;
 
     memcpy(data->data, password, 16);
+    md2_init(&data->prefix);
+    md2_write(&data->prefix, data->data, 16);
     *handle = data;
     return 0;
 }
@@ -240,8 +247,7 @@ ipmi_md2_authcode_gen(ipmi_authdata_t handle,
     MD2_CONTEXT ctx;
     int         i;
 
-    md2_init(&ctx);
-    md2_write(&ctx, handle->data, 16);
+    ctx = handle->prefix;
     for (i=0; data[i].data != NULL; i++) {
 	md2_write(&ctx, data[i].data, data[i].len);
     }
@@ -259,8 +265,7 @@ ipmi_md2_authcode_check(ipmi_authdata_t handle,
     MD2_CONTEXT ctx;
     int         i;
 
-    md2_init(&ctx);
-    md2_write(&ctx, handle->data, 16);
+    ctx = handle->prefix;
     for (i=0; data[i].data != NULL; i++) {
 	md2_write(&ctx, data[i].data, data[i].len);
     }
@@ -275,6 +280,7 @@ void
 ipmi_md2_authcode_cleanup(ipmi_authdata_t handle)
 {
     memset(handle->data, 0, sizeof(handle->data));
+    memset(&handle->prefix, 0, sizeof(handle->prefix));
     handle->mem_free(handle->info, handle);
     handle = NULL;
 }
@@ -325,6 +325,10 @@ struct ipmi_authdata_s
     void          (*mem_free)(void *info, void *data);
     unsigned char data[20];
     unsigned int  datalen;
+
+    /* The hash state with the leading password already written, each
+       packet starts from a copy of this. */
+    MD5_CONTEXT   prefix;
 };
 
 /* External functions for the IPMI authcode algorithms. */
@@ -351,6 +355,8 @@ ipmi_md5_authcode_initl(const unsigned char *password,
 
     memcpy(data->data, password, password_len);
     data->datalen = password_len;
+    md5_init(&data->prefix);
+    md5_write(&data->prefix, data->data, data->datalen);
     *handle = data;
     return 0;
 }
@@ -373,8 +379,7 @@ ipmi_md5_authcode_gen(ipmi_authdata_t handle,
     MD5_CONTEXT ctx;
     int         i;
 
-    md5_init(&ctx);
-    md5_write(&ctx, handle->data, handle->datalen);
+    ctx = handle->prefix;
     for (i=0; data[i].data != NULL; i++) {
 	md5_write(&ctx, data[i].data, data[i].len);
     }
@@ -392,8 +397,7 @@ ipmi_md5_authcode_check(ipmi_authdata_t handle,
     MD5_CONTEXT ctx;
     int         i;
 
-    md5_init(&ctx);
-    md5_write(&ctx, handle->data, handle->datalen);
+    ctx = handle->prefix;
     for (i=0; data[i].data != NULL; i++) {
 	md5_write(&ctx, data[i].data, data[i].len);
     }
@@ -408,6 +412,7 @@ void
 ipmi_md5_authcode_cleanup(ipmi_authdata_t handle)
 {
     memset(handle->data, 0, sizeof(handle->data));
+    memset(&handle->prefix, 0, sizeof(handle->prefix));
     handle->mem_free(handle->info, handle);
 }
 